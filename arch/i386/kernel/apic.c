@@ -26,6 +26,7 @@
 #include <linux/mc146818rtc.h>
 #include <linux/kernel_stat.h>
 #include <linux/sysdev.h>
+#include <linux/rcupdate.h>
 
 #include <asm/atomic.h>
 #include <asm/smp.h>
@@ -34,6 +35,7 @@
 #include <asm/desc.h>
 #include <asm/arch_hooks.h>
 #include <asm/hpet.h>
+#include <asm/div64.h>
 
 #include <mach_apic.h>
 
@@ -930,6 +932,181 @@ static void __setup_APIC_LVTT(unsigned int clocks)
 	apic_write_around(APIC_TMICT, clocks/APIC_DIVISOR);
 }
 
+static unsigned int calibration_result;
+
+#ifdef CONFIG_HIGH_RES_TIMERS
+/*
+ * With high resolution timers the local APIC timer runs in one-shot
+ * mode as the clock event device of its cpu, and the local timer
+ * interrupt is emulated by a per cpu hrtimer firing every tick.
+ */
+static int lapic_highres = 1;
+
+static int __init lapic_highres_setup(char *str)
+{
+	if (!strcmp(str, "off"))
+		lapic_highres = 0;
+	else if (!strcmp(str, "on"))
+		lapic_highres = 1;
+	return 1;
+}
+
+__setup("highres=", lapic_highres_setup);
+
+static DEFINE_PER_CPU(struct hrtimer, lapic_tick);
+static DEFINE_PER_CPU(struct clock_event, lapic_event);
+
+static void lapic_next_event(unsigned long delta, struct clock_event *evt)
+{
+	u64 clocks = (u64) delta * calibration_result;
+
+	do_div(clocks, TICK_NSEC * APIC_DIVISOR);
+	apic_write_around(APIC_TMICT, clocks ? (unsigned long) clocks : 1);
+}
+
+#ifdef CONFIG_NO_IDLE_HZ
+/*
+ * An idle cpu moves its tick hrtimer out to the next pending timer
+ * event and sets itself in nohz_cpu_mask, so that RCU does not wait
+ * for it.  The skipped ticks are accounted as idle time once the cpu
+ * wakes up again.
+ */
+int sysctl_hz_timer = 0;
+
+static DEFINE_PER_CPU(ktime_t, lapic_nohz_first);
+static DEFINE_PER_CPU(int, lapic_nohz_ticked);
+
+/*
+ * Leave nohz mode: account the ticks skipped up to @now as idle time
+ * and return the time the next tick is due.
+ */
+static ktime_t lapic_nohz_account(ktime_t now, int hardirq_offset)
+{
+	int cpu = smp_processor_id();
+	ktime_t next = per_cpu(lapic_nohz_first, cpu);
+	unsigned long ticks;
+	u64 delta;
+
+	cpu_clear(cpu, nohz_cpu_mask);
+	if (now < next)
+		return next;
+
+	delta = now - next;
+	do_div(delta, TICK_NSEC);
+	ticks = (unsigned long) delta + 1;
+	account_system_time(current, hardirq_offset,
+			    jiffies_to_cputime(ticks));
+
+	return next + (ktime_t) ticks * TICK_NSEC;
+}
+
+/*
+ * Stop the tick on the current cpu.
+ * Only the idle loop may call this, with interrupts disabled.
+ */
+void stop_hz_timer(void)
+{
+	int cpu = smp_processor_id();
+	struct hrtimer *tick = &per_cpu(lapic_tick, cpu);
+	long delta;
+
+	/*
+	 * Keep ticking without the one-shot timer, and for one tick after
+	 * each wakeup so that the scheduler gets to balance onto this cpu.
+	 */
+	if (sysctl_hz_timer || !hrtimer_active(tick) ||
+	    !per_cpu(lapic_nohz_ticked, cpu))
+		return;
+
+	cpu_set(cpu, nohz_cpu_mask);
+	/* Pairs with the read of nohz_cpu_mask when a grace period starts */
+	smp_mb();
+
+	/*
+	 * Leave the tick running if either rcu or a softirq is pending.
+	 */
+	if (rcu_pending(cpu) || local_softirq_pending())
+		goto out;
+
+	delta = next_timer_interrupt() - jiffies;
+	if (delta <= 1)
+		goto out;
+
+	per_cpu(lapic_nohz_ticked, cpu) = 0;
+	per_cpu(lapic_nohz_first, cpu) = tick->expires;
+	hrtimer_start(tick, tick->expires + (ktime_t) (delta - 1) * TICK_NSEC,
+		      HRTIMER_ABS);
+	return;
+out:
+	cpu_clear(cpu, nohz_cpu_mask);
+}
+
+/*
+ * Restart the tick on the current cpu after an idle wakeup.
+ * Only the idle loop may call this.
+ */
+void start_hz_timer(void)
+{
+	int cpu = smp_processor_id();
+	unsigned long flags;
+
+	local_irq_save(flags);
+	if (cpu_isset(cpu, nohz_cpu_mask))
+		hrtimer_start(&per_cpu(lapic_tick, cpu),
+			      lapic_nohz_account(ktime_get(), 0), HRTIMER_ABS);
+	local_irq_restore(flags);
+}
+#endif
+
+static int lapic_tick_fn(void *data)
+{
+	struct hrtimer *tick = data;
+
+#ifdef CONFIG_NO_IDLE_HZ
+	/* The ticks up to this one were skipped while idle */
+	if (cpu_isset(smp_processor_id(), nohz_cpu_mask))
+		lapic_nohz_account(tick->expires - 1, HARDIRQ_OFFSET);
+	__get_cpu_var(lapic_nohz_ticked) = 1;
+#endif
+	smp_local_timer_interrupt(hrtimer_get_irq_regs());
+	hrtimer_forward(tick, TICK_NSEC);
+
+	return HRTIMER_RESTART;
+}
+
+static void __init setup_lapic_event(void)
+{
+	struct clock_event *evt = &__get_cpu_var(lapic_event);
+	struct hrtimer *tick = &__get_cpu_var(lapic_tick);
+	unsigned int lvtt_value, ver;
+	u64 max;
+
+	/*
+	 * Switch the timer to one-shot mode, the divisor stays at 16:
+	 */
+	ver = GET_APIC_VERSION(apic_read(APIC_LVR));
+	lvtt_value = LOCAL_TIMER_VECTOR;
+	if (!APIC_INTEGRATED(ver))
+		lvtt_value |= SET_APIC_TIMER_BASE(APIC_TIMER_BASE_DIV);
+	apic_write_around(APIC_LVTT, lvtt_value);
+
+	max = (u64) 0x7fffffff * APIC_DIVISOR * TICK_NSEC;
+	do_div(max, calibration_result);
+
+	evt->name = "lapic";
+	evt->min_delta_ns = NSEC_PER_USEC;
+	evt->max_delta_ns = max > ULONG_MAX ? ULONG_MAX : (unsigned long) max;
+	evt->set_next_event = lapic_next_event;
+
+	hrtimer_init(tick, CLOCK_MONOTONIC, HRTIMER_ABS);
+	tick->function = lapic_tick_fn;
+	tick->data = tick;
+	hrtimer_start(tick, ktime_get() + TICK_NSEC, HRTIMER_ABS);
+
+	register_clock_event(evt);
+}
+#endif
+
 static void __init setup_APIC_timer(unsigned int clocks)
 {
 	unsigned long flags;
@@ -943,6 +1120,11 @@ static void __init setup_APIC_timer(unsigned int clocks)
 
 	__setup_APIC_LVTT(clocks);
 
+#ifdef CONFIG_HIGH_RES_TIMERS
+	if (lapic_highres)
+		setup_lapic_event();
+#endif
+
 	local_irq_restore(flags);
 }
 
@@ -1025,8 +1207,6 @@ static int __init calibrate_APIC_clock(void)
 	return result;
 }
 
-static unsigned int calibration_result;
-
 void __init setup_boot_APIC_clock(void)
 {
 	apic_printk(APIC_VERBOSE, "Using local APIC timer interrupts.\n");
@@ -1065,6 +1245,11 @@ void enable_APIC_timer(void)
 
 		v = apic_read(APIC_LVTT);
 		apic_write_around(APIC_LVTT, v & ~APIC_LVT_MASKED);
+#ifdef CONFIG_HIGH_RES_TIMERS
+		/* A one-shot event may have expired while masked */
+		if (lapic_highres)
+			apic_write_around(APIC_TMICT, 1);
+#endif
 	}
 }
 
@@ -1084,6 +1269,12 @@ int setup_profiling_timer(unsigned int multiplier)
 	if ( (!multiplier) || (calibration_result/multiplier < 500))
 		return -EINVAL;
 
+#ifdef CONFIG_HIGH_RES_TIMERS
+	/* The tick is emulated, the one-shot timer cannot be rescaled */
+	if (lapic_highres && multiplier != 1)
+		return -EINVAL;
+#endif
+
 	/* 
 	 * Set the new multiplier for each CPU. CPUs don't start using the
 	 * new values until the next timer interrupt in which they do process
@@ -1178,7 +1369,12 @@ fastcall void smp_apic_timer_interrupt(struct pt_regs *regs)
 	 * interrupt lock, which is the WrongThing (tm) to do.
 	 */
 	irq_enter();
-	smp_local_timer_interrupt(regs);
+#ifdef CONFIG_HIGH_RES_TIMERS
+	if (lapic_highres)
+		hrtimer_interrupt(regs);
+	else
+#endif
+		smp_local_timer_interrupt(regs);
 	irq_exit();
 }
 
@@ -0,0 +1,620 @@
+/*
+ * Just In Time compiler for socket filters, i386 and x86_64.
+ *
+ * A filter that passed sk_chk_filter() is translated once, when it is
+ * attached, into straight line machine code.  Register usage:
+ *
+ *	%eax	A, and the return value
+ *	%ebx	X
+ *	%edi	skb
+ *	%esi	skb->data
+ *	%ebp	skb headlen (what BPF_LEN loads)
+ *	%ecx	scratch, packet offset for the slow load path
+ *	%edx	scratch
+ *
+ * The BPF_MEMWORDS scratch words live at the bottom of the stack frame.
+ * Loads from the linear part of the skb are done inline; everything
+ * else (fragments, negative offsets, ancillary data reached through
+ * BPF_IND) goes to bpf_jit_load() through a small stub.
+ *
+ * The image starts with the shared exit path and the stubs, followed
+ * by the filter entry point, so that every jump into them is a known
+ * backward distance.  Forward jumps inside the filter are sized by
+ * iterating until no instruction changes length.
+ */
+
+#include <linux/config.h>
+#include <linux/kernel.h>
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/skbuff.h>
+#include <linux/netdevice.h>
+#include <linux/filter.h>
+#include <linux/moduleloader.h>
+#include <linux/workqueue.h>
+
+#define BPF_JIT_MAX_PASSES	10
+
+#ifdef CONFIG_X86_64
+#define BPF_JIT_FRAME	(BPF_MEMWORDS * 4 + 8)	/* keeps %rsp 16 byte aligned */
+#else
+#define BPF_JIT_FRAME	(BPF_MEMWORDS * 4)
+#endif
+
+/* jcc opcodes, short form */
+#define X86_JB		0x72
+#define X86_JAE		0x73
+#define X86_JE		0x74
+#define X86_JNE		0x75
+#define X86_JBE		0x76
+#define X86_JA		0x77
+
+static inline u8 *emit_code(u8 *ptr, u32 bytes, unsigned int len)
+{
+	if (len == 1)
+		*ptr = bytes;
+	else if (len == 2)
+		*(u16 *)ptr = bytes;
+	else
+		*(u32 *)ptr = bytes;	/* len == 3 writes one byte of slack */
+	return ptr + len;
+}
+
+#define EMIT(bytes, len)	do { prog = emit_code(prog, bytes, len); } while (0)
+
+#define EMIT1(b1)		EMIT(b1, 1)
+#define EMIT2(b1, b2)		EMIT((b1) + ((b2) << 8), 2)
+#define EMIT3(b1, b2, b3)	EMIT((b1) + ((b2) << 8) + ((b3) << 16), 3)
+#define EMIT4(b1, b2, b3, b4)	EMIT((b1) + ((b2) << 8) + ((b3) << 16) + ((b4) << 24), 4)
+#define EMIT1_off32(b1, off)	do { EMIT1(b1); EMIT(off, 4); } while (0)
+#define EMIT2_off32(b1, b2, off) do { EMIT2(b1, b2); EMIT(off, 4); } while (0)
+
+static inline int is_imm8(int value)
+{
+	return value <= 127 && value >= -128;
+}
+
+/*
+ * "op disp(base), reg" for an opcode sequence ending in a ModRM byte,
+ * choosing the short displacement when it fits.  modrm holds the reg
+ * and base fields with mod zero.
+ */
+#define EMIT_MODRM_DISP(modrm, disp)				\
+	do {							\
+		if (is_imm8(disp)) {				\
+			EMIT2(0x40 | (modrm), (u8)(disp));	\
+		} else {					\
+			EMIT1(0x80 | (modrm));			\
+			EMIT(disp, 4);				\
+		}						\
+	} while (0)
+
+/* op $imm,%reg for the 0x81/0x83 group, with a one byte form of %eax */
+#define EMIT_ALU_IMM(ext, eax_op, imm)				\
+	do {							\
+		if (is_imm8(imm))				\
+			EMIT3(0x83, 0xc0 | ((ext) << 3), (u8)(imm)); \
+		else						\
+			EMIT1_off32(eax_op, imm);		\
+	} while (0)
+
+/* cmp $imm,%ebp */
+#define EMIT_CMP_EBP(imm)					\
+	do {							\
+		if (is_imm8(imm))				\
+			EMIT3(0x83, 0xfd, (u8)(imm));		\
+		else						\
+			EMIT2_off32(0x81, 0xfd, imm);		\
+	} while (0)
+
+struct bpf_jit_header {
+	struct work_struct work;	/* for bpf_jit_free() */
+	u8 image[0];
+};
+
+/* Offsets into the image of the code shared by a whole filter. */
+struct bpf_jit_labels {
+	int ret0;	/* return 0 */
+	int exit;	/* return A */
+	int load[3];	/* slow path loads of 1, 2 and 4 bytes */
+	int entry;
+};
+
+static inline int load_index(unsigned int size)
+{
+	return size == 4 ? 2 : size - 1;
+}
+
+/*
+ * Emit the exit path, the slow load stubs and the prologue into buf.
+ * None of this depends on where the image ends up, so it is built
+ * once per filter.
+ */
+static int bpf_jit_emit_fixed(u8 *buf, struct bpf_jit_labels *l)
+{
+	u8 *prog = buf;
+	u8 *common_jmp[3];
+	u8 *fail;
+	int i;
+
+	l->ret0 = prog - buf;
+	EMIT2(0x31, 0xc0);			/* xor %eax,%eax */
+	l->exit = prog - buf;
+#ifdef CONFIG_X86_64
+	EMIT4(0x48, 0x83, 0xc4, BPF_JIT_FRAME);	/* add $FRAME,%rsp */
+	EMIT2(0x5b, 0x5d);			/* pop %rbx; pop %rbp */
+#else
+	EMIT3(0x83, 0xc4, BPF_JIT_FRAME);	/* add $FRAME,%esp */
+	EMIT4(0x5f, 0x5e, 0x5b, 0x5d);		/* pop %edi,%esi,%ebx,%ebp */
+#endif
+	EMIT1(0xc3);				/* ret */
+
+	/*
+	 * Slow path load, called with the packet offset in %ecx.  Returns
+	 * with the value in A, or unwinds to ret0 when the load fails.
+	 */
+	for (i = 2; i >= 0; i--) {
+		l->load[i] = prog - buf;
+		EMIT1_off32(0xba, 1 << i);	/* mov $size,%edx */
+		common_jmp[i] = prog;
+		if (i)
+			EMIT2(0xeb, 0);		/* jmp common */
+	}
+	for (i = 2; i > 0; i--)
+		common_jmp[i][1] = prog - (common_jmp[i] + 2);
+#ifdef CONFIG_X86_64
+	EMIT2(0x57, 0x56);			/* push %rdi; push %rsi */
+	EMIT4(0x48, 0x83, 0xec, 8);		/* sub $8,%rsp */
+	EMIT2(0x89, 0xce);			/* mov %ecx,%esi */
+	EMIT3(0x48, 0x89, 0xe1);		/* mov %rsp,%rcx */
+	EMIT2(0x48, 0xb8);			/* movabs $bpf_jit_load,%rax */
+	*(u64 *)prog = (unsigned long)bpf_jit_load;
+	prog += 8;
+	EMIT2(0xff, 0xd0);			/* call *%rax */
+	EMIT2(0x89, 0xc1);			/* mov %eax,%ecx */
+	EMIT3(0x8b, 0x04, 0x24);		/* mov (%rsp),%eax */
+	EMIT4(0x48, 0x83, 0xc4, 8);		/* add $8,%rsp */
+	EMIT2(0x5e, 0x5f);			/* pop %rsi; pop %rdi */
+#else
+	EMIT3(0x83, 0xec, 4);			/* sub $4,%esp */
+	EMIT2(0x89, 0xe0);			/* mov %esp,%eax */
+	EMIT4(0x50, 0x52, 0x51, 0x57);		/* push %eax,%edx,%ecx,%edi */
+	EMIT1_off32(0xb8, (unsigned long)bpf_jit_load); /* mov $bpf_jit_load,%eax */
+	EMIT2(0xff, 0xd0);			/* call *%eax */
+	EMIT3(0x83, 0xc4, 16);			/* add $16,%esp */
+	EMIT2(0x89, 0xc1);			/* mov %eax,%ecx */
+	EMIT1(0x58);				/* pop %eax */
+#endif
+	EMIT2(0x85, 0xc9);			/* test %ecx,%ecx */
+	EMIT2(X86_JNE, 1);			/* jnz fail */
+	EMIT1(0xc3);				/* ret */
+	/* fail: drop our return address and return 0 from the filter */
+#ifdef CONFIG_X86_64
+	EMIT4(0x48, 0x83, 0xc4, 8);		/* add $8,%rsp */
+#else
+	EMIT3(0x83, 0xc4, 4);			/* add $4,%esp */
+#endif
+	fail = prog;
+	EMIT2(0xeb, (u8)(l->ret0 - (fail + 2 - buf)));	/* jmp ret0 */
+
+	l->entry = prog - buf;
+#ifdef CONFIG_X86_64
+	EMIT2(0x55, 0x53);			/* push %rbp; push %rbx */
+	EMIT4(0x48, 0x83, 0xec, BPF_JIT_FRAME);	/* sub $FRAME,%rsp */
+	EMIT1(0x48);				/* mov data(%rdi),%rsi */
+	EMIT1(0x8b);
+	EMIT_MODRM_DISP(0x37, offsetof(struct sk_buff, data));
+#else
+	EMIT4(0x55, 0x53, 0x56, 0x57);		/* push %ebp,%ebx,%esi,%edi */
+#ifndef CONFIG_REGPARM
+	EMIT4(0x8b, 0x44, 0x24, 20);		/* mov 20(%esp),%eax */
+#endif
+	EMIT2(0x89, 0xc7);			/* mov %eax,%edi */
+	EMIT3(0x83, 0xec, BPF_JIT_FRAME);	/* sub $FRAME,%esp */
+	EMIT1(0x8b);				/* mov data(%edi),%esi */
+	EMIT_MODRM_DISP(0x37, offsetof(struct sk_buff, data));
+#endif
+	EMIT1(0x8b);				/* mov len(%edi),%ebp */
+	EMIT_MODRM_DISP(0x2f, offsetof(struct sk_buff, len));
+	EMIT1(0x2b);				/* sub data_len(%edi),%ebp */
+	EMIT_MODRM_DISP(0x2f, offsetof(struct sk_buff, data_len));
+	EMIT2(0x31, 0xc0);			/* xor %eax,%eax */
+	EMIT2(0x31, 0xdb);			/* xor %ebx,%ebx */
+
+	return prog - buf;
+}
+
+/* Load size bytes at %esi + k (k < 0: at %esi + %ecx) into A, host order. */
+static u8 *bpf_jit_emit_fast_load(u8 *prog, unsigned int size, int k)
+{
+	switch (size) {
+	case 4:
+		EMIT1(0x8b);			/* mov */
+		break;
+	case 2:
+		EMIT2(0x0f, 0xb7);		/* movzwl */
+		break;
+	default:
+		EMIT2(0x0f, 0xb6);		/* movzbl */
+		break;
+	}
+	if (k >= 0)
+		EMIT_MODRM_DISP(0x06, k);	/* k(%esi),%eax */
+	else
+		EMIT2(0x04, 0x0e);		/* (%esi,%ecx),%eax */
+	if (size == 4)
+		EMIT2(0x0f, 0xc8);		/* bswap %eax */
+	else if (size == 2)
+		EMIT2(0x86, 0xe0);		/* xchg %ah,%al */
+	return prog;
+}
+
+void bpf_jit_compile(struct sk_filter *fp)
+{
+	struct sock_filter *filter = fp->insns;
+	int flen = fp->len;
+	struct bpf_jit_labels l;
+	struct bpf_jit_header *header = NULL;
+	u8 fixed[192], temp[64], ld[16];
+	u8 *prog, *image = NULL;
+	int *addrs;
+	int fixedlen, proglen, ilen, ldlen;
+	int pass, changed, i;
+
+	if (!bpf_jit_enable)
+		return;
+
+	addrs = kmalloc(flen * sizeof(*addrs), GFP_KERNEL);
+	if (addrs == NULL)
+		return;
+
+	fixedlen = bpf_jit_emit_fixed(fixed, &l);
+
+	/* Overestimate to start with, so that jumps mostly shrink. */
+	for (i = 0; i < flen; i++)
+		addrs[i] = fixedlen + (i + 1) * 64;
+
+	for (pass = 0; pass <= BPF_JIT_MAX_PASSES; pass++) {
+		changed = 0;
+		proglen = fixedlen;
+
+		for (i = 0; i < flen; i++) {
+			struct sock_filter *f = &filter[i];
+			unsigned int K = f->k;
+			unsigned int size;
+			int t, rel;
+
+			prog = temp;
+
+/* Offset in the image of the next byte emitted for this instruction. */
+#define CUR_OFF		(proglen + (int)(prog - temp))
+
+/* Jump (opcode 0xeb or a short jcc) to image offset target. */
+#define EMIT_JMP(op, target)					\
+	do {							\
+		rel = (target) - (CUR_OFF + 2);			\
+		if (is_imm8(rel)) {				\
+			EMIT2(op, (u8)rel);			\
+		} else if ((op) == 0xeb) {			\
+			rel = (target) - (CUR_OFF + 5);		\
+			EMIT1_off32(0xe9, rel);			\
+		} else {					\
+			rel = (target) - (CUR_OFF + 6);		\
+			EMIT2_off32(0x0f, (op) + 0x10, rel);	\
+		}						\
+	} while (0)
+
+/* Start of filter instruction n, as laid out by the previous pass. */
+#define INSN_OFF(n)	((n) ? addrs[(n) - 1] : fixedlen)
+
+/* call a slow load stub; the offset must already be in %ecx */
+#define EMIT_CALL_LOAD(size)					\
+	do {							\
+		rel = l.load[load_index(size)] - (CUR_OFF + 5);	\
+		EMIT1_off32(0xe8, rel);				\
+	} while (0)
+
+			switch (f->code) {
+			case BPF_ALU|BPF_ADD|BPF_X:
+				EMIT2(0x01, 0xd8);	/* add %ebx,%eax */
+				break;
+			case BPF_ALU|BPF_ADD|BPF_K:
+				EMIT_ALU_IMM(0, 0x05, K);
+				break;
+			case BPF_ALU|BPF_SUB|BPF_X:
+				EMIT2(0x29, 0xd8);	/* sub %ebx,%eax */
+				break;
+			case BPF_ALU|BPF_SUB|BPF_K:
+				EMIT_ALU_IMM(5, 0x2d, K);
+				break;
+			case BPF_ALU|BPF_MUL|BPF_X:
+				EMIT3(0x0f, 0xaf, 0xc3);	/* imul %ebx,%eax */
+				break;
+			case BPF_ALU|BPF_MUL|BPF_K:
+				if (is_imm8(K))
+					EMIT3(0x6b, 0xc0, (u8)K);
+				else
+					EMIT2_off32(0x69, 0xc0, K);
+				break;
+			case BPF_ALU|BPF_DIV|BPF_X:
+				EMIT2(0x85, 0xdb);	/* test %ebx,%ebx */
+				EMIT_JMP(X86_JE, l.ret0);
+				EMIT2(0x31, 0xd2);	/* xor %edx,%edx */
+				EMIT2(0xf7, 0xf3);	/* div %ebx */
+				break;
+			case BPF_ALU|BPF_DIV|BPF_K:
+				if (K == 0) {
+					EMIT_JMP(0xeb, l.ret0);
+					break;
+				}
+				EMIT1_off32(0xb9, K);	/* mov $K,%ecx */
+				EMIT2(0x31, 0xd2);	/* xor %edx,%edx */
+				EMIT2(0xf7, 0xf1);	/* div %ecx */
+				break;
+			case BPF_ALU|BPF_AND|BPF_X:
+				EMIT2(0x21, 0xd8);	/* and %ebx,%eax */
+				break;
+			case BPF_ALU|BPF_AND|BPF_K:
+				EMIT_ALU_IMM(4, 0x25, K);
+				break;
+			case BPF_ALU|BPF_OR|BPF_X:
+				EMIT2(0x09, 0xd8);	/* or %ebx,%eax */
+				break;
+			case BPF_ALU|BPF_OR|BPF_K:
+				EMIT_ALU_IMM(1, 0x0d, K);
+				break;
+			case BPF_ALU|BPF_LSH|BPF_X:
+				EMIT2(0x89, 0xd9);	/* mov %ebx,%ecx */
+				EMIT2(0xd3, 0xe0);	/* shl %cl,%eax */
+				break;
+			case BPF_ALU|BPF_LSH|BPF_K:
+				EMIT3(0xc1, 0xe0, (u8)K);	/* shl $K,%eax */
+				break;
+			case BPF_ALU|BPF_RSH|BPF_X:
+				EMIT2(0x89, 0xd9);	/* mov %ebx,%ecx */
+				EMIT2(0xd3, 0xe8);	/* shr %cl,%eax */
+				break;
+			case BPF_ALU|BPF_RSH|BPF_K:
+				EMIT3(0xc1, 0xe8, (u8)K);	/* shr $K,%eax */
+				break;
+			case BPF_ALU|BPF_NEG:
+				EMIT2(0xf7, 0xd8);	/* neg %eax */
+				break;
+			case BPF_JMP|BPF_JA:
+				if (K)
+					EMIT_JMP(0xeb, INSN_OFF(i + 1 + K));
+				break;
+			case BPF_JMP|BPF_JGT|BPF_K:
+			case BPF_JMP|BPF_JGE|BPF_K:
+			case BPF_JMP|BPF_JEQ|BPF_K:
+			case BPF_JMP|BPF_JSET|BPF_K:
+			case BPF_JMP|BPF_JGT|BPF_X:
+			case BPF_JMP|BPF_JGE|BPF_X:
+			case BPF_JMP|BPF_JEQ|BPF_X:
+			case BPF_JMP|BPF_JSET|BPF_X: {
+				u8 op;
+
+				if (!f->jt && !f->jf)
+					break;
+				if (BPF_OP(f->code) == BPF_JSET) {
+					if (BPF_SRC(f->code) == BPF_X)
+						EMIT2(0x85, 0xd8);	/* test %ebx,%eax */
+					else
+						EMIT1_off32(0xa9, K);	/* test $K,%eax */
+					op = X86_JNE;
+				} else {
+					if (BPF_SRC(f->code) == BPF_X)
+						EMIT2(0x39, 0xd8);	/* cmp %ebx,%eax */
+					else
+						EMIT_ALU_IMM(7, 0x3d, K);
+					switch (BPF_OP(f->code)) {
+					case BPF_JGT:
+						op = X86_JA;
+						break;
+					case BPF_JGE:
+						op = X86_JAE;
+						break;
+					default:
+						op = X86_JE;
+						break;
+					}
+				}
+				/* jcc opcodes come in pairs, ^ 1 inverts */
+				if (f->jt) {
+					EMIT_JMP(op, INSN_OFF(i + 1 + f->jt));
+					if (f->jf)
+						EMIT_JMP(0xeb, INSN_OFF(i + 1 + f->jf));
+				} else {
+					EMIT_JMP(op ^ 1, INSN_OFF(i + 1 + f->jf));
+				}
+				break;
+			}
+			case BPF_LD|BPF_W|BPF_ABS:
+			case BPF_LD|BPF_H|BPF_ABS:
+			case BPF_LD|BPF_B|BPF_ABS:
+				size = BPF_SIZE(f->code) == BPF_W ? 4 :
+				       BPF_SIZE(f->code) == BPF_H ? 2 : 1;
+				t = K;
+				if (t >= 0) {
+					ldlen = bpf_jit_emit_fast_load(ld, size, t) - ld;
+					/* cmp $(K + size),%ebp; jb slow */
+					EMIT_CMP_EBP(K + size);
+					EMIT2(X86_JB, ldlen + 2);
+					memcpy(prog, ld, ldlen);
+					prog += ldlen;
+					EMIT2(0xeb, 10);	/* jmp done */
+					EMIT1_off32(0xb9, K);	/* slow: mov $K,%ecx */
+					EMIT_CALL_LOAD(size);
+				} else if (t >= SKF_AD_OFF) {
+					switch (t - SKF_AD_OFF) {
+					case SKF_AD_PROTOCOL:
+						/* movzwl protocol(%edi),%eax; xchg %ah,%al */
+						EMIT2(0x0f, 0xb7);
+						EMIT_MODRM_DISP(0x07, offsetof(struct sk_buff, protocol));
+						EMIT2(0x86, 0xe0);
+						break;
+					case SKF_AD_PKTTYPE:
+						/* movzbl pkt_type(%edi),%eax */
+						EMIT2(0x0f, 0xb6);
+						EMIT_MODRM_DISP(0x07, offsetof(struct sk_buff, pkt_type));
+						break;
+					case SKF_AD_IFINDEX:
+						/* mov dev(%edi),%eax; mov ifindex(%eax),%eax */
+#ifdef CONFIG_X86_64
+						EMIT1(0x48);
+#endif
+						EMIT1(0x8b);
+						EMIT_MODRM_DISP(0x07, offsetof(struct sk_buff, dev));
+						EMIT1(0x8b);
+						EMIT_MODRM_DISP(0x00, offsetof(struct net_device, ifindex));
+						break;
+					default:
+						EMIT_JMP(0xeb, l.ret0);
+						break;
+					}
+				} else {
+					EMIT1_off32(0xb9, K);	/* mov $K,%ecx */
+					EMIT_CALL_LOAD(size);
+				}
+				break;
+			case BPF_LD|BPF_W|BPF_IND:
+			case BPF_LD|BPF_H|BPF_IND:
+			case BPF_LD|BPF_B|BPF_IND:
+				size = BPF_SIZE(f->code) == BPF_W ? 4 :
+				       BPF_SIZE(f->code) == BPF_H ? 2 : 1;
+				ldlen = bpf_jit_emit_fast_load(ld, size, -1) - ld;
+				EMIT1(0x8d);		/* lea K(%ebx),%ecx */
+				EMIT_MODRM_DISP(0x0b, K);
+				/* negative offsets are huge unsigned and go slow */
+				EMIT2(0x39, 0xe9);	/* cmp %ebp,%ecx */
+				EMIT2(X86_JAE, ldlen + 2 + (size > 1 ? 7 : 0));
+				if (size > 1) {
+					EMIT3(0x8d, 0x51, size);	/* lea size(%ecx),%edx */
+					EMIT2(0x39, 0xea);	/* cmp %ebp,%edx */
+					EMIT2(X86_JA, ldlen + 2);
+				}
+				memcpy(prog, ld, ldlen);
+				prog += ldlen;
+				EMIT2(0xeb, 5);		/* jmp done */
+				EMIT_CALL_LOAD(size);	/* slow: */
+				break;
+			case BPF_LD|BPF_W|BPF_LEN:
+				EMIT2(0x89, 0xe8);	/* mov %ebp,%eax */
+				break;
+			case BPF_LDX|BPF_W|BPF_LEN:
+				EMIT2(0x89, 0xeb);	/* mov %ebp,%ebx */
+				break;
+			case BPF_LDX|BPF_B|BPF_MSH:
+				/* only the linear part, as in sk_run_filter() */
+				EMIT_CMP_EBP(K);
+				EMIT_JMP(X86_JBE, l.ret0);
+				EMIT2(0x0f, 0xb6);	/* movzbl K(%esi),%ebx */
+				EMIT_MODRM_DISP(0x1e, K);
+				EMIT3(0x83, 0xe3, 0x0f);	/* and $0xf,%ebx */
+				EMIT3(0xc1, 0xe3, 2);	/* shl $2,%ebx */
+				break;
+			case BPF_LD|BPF_IMM:
+				if (K)
+					EMIT1_off32(0xb8, K);	/* mov $K,%eax */
+				else
+					EMIT2(0x31, 0xc0);	/* xor %eax,%eax */
+				break;
+			case BPF_LDX|BPF_IMM:
+				if (K)
+					EMIT1_off32(0xbb, K);	/* mov $K,%ebx */
+				else
+					EMIT2(0x31, 0xdb);	/* xor %ebx,%ebx */
+				break;
+			case BPF_LD|BPF_MEM:
+				EMIT4(0x8b, 0x44, 0x24, K * 4);	/* mov K*4(%esp),%eax */
+				break;
+			case BPF_LDX|BPF_MEM:
+				EMIT4(0x8b, 0x5c, 0x24, K * 4);	/* mov K*4(%esp),%ebx */
+				break;
+			case BPF_ST:
+				EMIT4(0x89, 0x44, 0x24, K * 4);	/* mov %eax,K*4(%esp) */
+				break;
+			case BPF_STX:
+				EMIT4(0x89, 0x5c, 0x24, K * 4);	/* mov %ebx,K*4(%esp) */
+				break;
+			case BPF_MISC|BPF_TAX:
+				EMIT2(0x89, 0xc3);	/* mov %eax,%ebx */
+				break;
+			case BPF_MISC|BPF_TXA:
+				EMIT2(0x89, 0xd8);	/* mov %ebx,%eax */
+				break;
+			case BPF_RET|BPF_K:
+				if (!K) {
+					EMIT_JMP(0xeb, l.ret0);
+					break;
+				}
+				EMIT1_off32(0xb8, K);	/* mov $K,%eax */
+				EMIT_JMP(0xeb, l.exit);
+				break;
+			case BPF_RET|BPF_A:
+				EMIT_JMP(0xeb, l.exit);
+				break;
+			default:
+				/* Invalid instruction counts as RET, as in sk_run_filter() */
+				EMIT_JMP(0xeb, l.ret0);
+				break;
+			}
+
+#undef CUR_OFF
+#undef EMIT_JMP
+#undef INSN_OFF
+#undef EMIT_CALL_LOAD
+
+			ilen = prog - temp;
+			if (image)
+				memcpy(image + proglen, temp, ilen);
+			proglen += ilen;
+			if (addrs[i] != proglen) {
+				addrs[i] = proglen;
+				changed = 1;
+			}
+		}
+
+		if (image) {
+			/* the layout was final, so this pass must agree */
+			if (changed) {
+				module_free(NULL, header);
+				goto out;
+			}
+			break;
+		}
+		if (!changed) {
+			header = module_alloc(sizeof(*header) + proglen);
+			if (header == NULL)
+				goto out;
+			image = header->image;
+			memcpy(image, fixed, fixedlen);
+		}
+	}
+
+	if (image)
+		fp->bpf_func = (void *)(image + l.entry);
+out:
+	kfree(addrs);
+}
+
+static void bpf_jit_free_deferred(void *arg)
+{
+	module_free(NULL, arg);
+}
+
+/*
+ * Filters are released from softirq context, where vfree() is not
+ * allowed.  The work item lives in the image itself, and the worker does
+ * not touch it once the function has been called.
+ */
+void bpf_jit_free(struct sk_filter *fp)
+{
+	struct bpf_jit_header *header;
+
+	if (fp->bpf_func == NULL)
+		return;
+	header = (void *)((unsigned long)fp->bpf_func & PAGE_MASK);
+	INIT_WORK(&header->work, bpf_jit_free_deferred, header);
+	schedule_work(&header->work);
+}
@@ -288,6 +288,19 @@ static struct irq_cpu_info {
 
 static long balanced_irq_interval = MAX_BALANCED_IRQ_INTERVAL;
 
+/*
+ * The CPUs @irq may be moved to: those of its affinity near its devices,
+ * see irq_home[], or all of its affinity when none of those is online.
+ */
+static cpumask_t balance_mask(int irq)
+{
+	cpumask_t allowed, home;
+
+	cpus_and(allowed, cpu_online_map, irq_affinity[irq]);
+	cpus_and(home, allowed, irq_home[irq]);
+	return cpus_empty(home) ? allowed : home;
+}
+
 static unsigned long move(int curr_cpu, cpumask_t allowed_mask,
 			unsigned long now, int direction)
 {
@@ -324,7 +337,9 @@ static inline void balance_irq(int cpu, int irq)
 	if (irqbalance_disabled)
 		return; 
 
-	cpus_and(allowed_mask, cpu_online_map, irq_affinity[irq]);
+	allowed_mask = balance_mask(irq);
+	if (cpus_empty(allowed_mask))
+		return;
 	new_cpu = move(cpu, allowed_mask, now, 1);
 	if (cpu != new_cpu) {
 		irq_desc_t *desc = irq_desc + irq;
@@ -356,19 +371,102 @@ static inline void rotate_irqs_among_cpus(unsigned long useful_load_threshold)
 	return;
 }
 
+/*
+ * The least loaded CPU of @allowed, -1 if there is none: of the least
+ * loaded package, the less loaded sibling, see the NOTE in
+ * do_irq_balance().  To be called after do_irq_balance() has summed
+ * up the loads.
+ */
+static int least_loaded_cpu(cpumask_t allowed)
+{
+	unsigned long min_load = ULONG_MAX, load;
+	int i, j, package = -1, cpu;
+	cpumask_t tmp;
+
+	for (i = 0; i < NR_CPUS; i++) {
+		if (!cpu_online(i))
+			continue;
+		if (i != CPU_TO_PACKAGEINDEX(i))
+			continue;
+		cpus_and(tmp, cpu_sibling_map[i], allowed);
+		if (cpus_empty(tmp))
+			continue;
+		if (CPU_IRQ(i) < min_load) {
+			min_load = CPU_IRQ(i);
+			package = i;
+		}
+	}
+	if (package < 0)
+		return -1;
+
+	cpus_and(tmp, cpu_sibling_map[package], allowed);
+	cpu = first_cpu(tmp);
+	load = cpu == package ? CPU_IRQ(package) >> 1 : CPU_IRQ(cpu);
+	for_each_cpu_mask(j, tmp) {
+		if (j != package && load > CPU_IRQ(j)) {
+			load = CPU_IRQ(j);
+			cpu = j;
+		}
+	}
+	return cpu;
+}
+
+static inline void set_pending_irq_balance(int irq, int cpu)
+{
+	irq_desc_t *desc = irq_desc + irq;
+	unsigned long flags;
+
+	Dprintk("irq = %d moved to cpu = %d\n", irq, cpu);
+	spin_lock_irqsave(&desc->lock, flags);
+	pending_irq_balance_cpumask[irq] = cpumask_of_cpu(cpu);
+	spin_unlock_irqrestore(&desc->lock, flags);
+}
+
+/*
+ * Move the irqs which keep a package away from their devices busy back
+ * to the least loaded package near them.  Returns how many were moved.
+ */
+static int home_irqs(unsigned long useful_load_threshold)
+{
+	int i, j, cpu, moved = 0;
+	cpumask_t allowed, tmp;
+
+	for (j = 0; j < NR_IRQS; j++) {
+		if (!irq_desc[j].action)
+			continue;
+		allowed = balance_mask(j);
+		for (i = 0; i < NR_CPUS; i++) {
+			if (!cpu_online(i))
+				continue;
+			if (i != CPU_TO_PACKAGEINDEX(i))
+				continue;
+			if (IRQ_DELTA(i, j) < useful_load_threshold)
+				continue;
+			cpus_and(tmp, cpu_sibling_map[i], allowed);
+			if (!cpus_empty(tmp))
+				continue;
+			cpu = least_loaded_cpu(allowed);
+			if (cpu >= 0) {
+				set_pending_irq_balance(j, cpu);
+				moved++;
+			}
+			break;
+		}
+	}
+	return moved;
+}
+
 static void do_irq_balance(void)
 {
 	int i, j;
 	unsigned long max_cpu_irq = 0, min_cpu_irq = (~0);
 	unsigned long move_this_load = 0;
 	int max_loaded = 0, min_loaded = 0;
-	int load;
 	unsigned long useful_load_threshold = balanced_irq_interval + 10;
-	int selected_irq;
+	int selected_irq, target;
 	int tmp_loaded, first_attempt = 1;
 	unsigned long tmp_cpu_irq;
 	unsigned long imbalance = 0;
-	cpumask_t allowed_mask, target_cpu_mask, tmp;
 
 	for (i = 0; i < NR_CPUS; i++) {
 		int package_index;
@@ -410,6 +508,14 @@ static void do_irq_balance(void)
 			CPU_IRQ(package_index) += delta;
 		}
 	}
+
+	/* Locality first: an irq away from its devices goes back */
+	if (home_irqs(useful_load_threshold)) {
+		balanced_irq_interval = max((long)MIN_BALANCED_IRQ_INTERVAL,
+			balanced_irq_interval - BALANCED_IRQ_LESS_DELTA);
+		return;
+	}
+
 	/* Find the least loaded processor package */
 	for (i = 0; i < NR_CPUS; i++) {
 		if (!cpu_online(i))
@@ -512,31 +618,18 @@ tryanotherirq:
 	 *
 	 * We seek the least loaded sibling by making the comparison
 	 * (A+B)/2 vs B
+	 *
+	 * The irq only goes where it may and stays near its devices,
+	 * so the target is the least loaded package of those, which
+	 * must be less loaded than this one even after the move.
 	 */
-	load = CPU_IRQ(min_loaded) >> 1;
-	for_each_cpu_mask(j, cpu_sibling_map[min_loaded]) {
-		if (load > CPU_IRQ(j)) {
-			/* This won't change cpu_sibling_map[min_loaded] */
-			load = CPU_IRQ(j);
-			min_loaded = j;
-		}
-	}
-
-	cpus_and(allowed_mask, cpu_online_map, irq_affinity[selected_irq]);
-	target_cpu_mask = cpumask_of_cpu(min_loaded);
-	cpus_and(tmp, target_cpu_mask, allowed_mask);
+	target = least_loaded_cpu(balance_mask(selected_irq));
 
-	if (!cpus_empty(tmp)) {
-		irq_desc_t *desc = irq_desc + selected_irq;
-		unsigned long flags;
-
-		Dprintk("irq = %d moved to cpu = %d\n",
-				selected_irq, min_loaded);
+	if (target >= 0 && CPU_TO_PACKAGEINDEX(target) != max_loaded &&
+	    CPU_IRQ(CPU_TO_PACKAGEINDEX(target)) + move_this_load <
+							max_cpu_irq) {
 		/* mark for change destination */
-		spin_lock_irqsave(&desc->lock, flags);
-		pending_irq_balance_cpumask[selected_irq] =
-					cpumask_of_cpu(min_loaded);
-		spin_unlock_irqrestore(&desc->lock, flags);
+		set_pending_irq_balance(selected_irq, target);
 		/* Since we made a change, come back sooner to 
 		 * check for more variation.
 		 */
@@ -565,9 +658,18 @@ static int balanced_irq(void *unused)
 
 	daemonize("kirqd");
 	
-	/* push everything to CPU 0 to give us a starting point.  */
+	/*
+	 * push everything to the first CPU near its devices, CPU 0 when
+	 * unknown, to give us a starting point.
+	 */
 	for (i = 0 ; i < NR_IRQS ; i++) {
-		pending_irq_balance_cpumask[i] = cpumask_of_cpu(0);
+		cpumask_t allowed = balance_mask(i);
+
+		if (cpus_empty(allowed))
+			pending_irq_balance_cpumask[i] = cpumask_of_cpu(0);
+		else
+			pending_irq_balance_cpumask[i] =
+				cpumask_of_cpu(first_cpu(allowed));
 	}
 
 	for ( ; ; ) {
@@ -485,7 +485,8 @@ void nmi_watchdog_tick (struct pt_regs * regs)
 
 	sum = per_cpu(irq_stat, cpu).apic_timer_irqs;
 
-	if (last_irq_sums[cpu] == sum) {
+	/* An idle cpu with its tick stopped is not stuck */
+	if (last_irq_sums[cpu] == sum && !cpu_isset(cpu, nohz_cpu_mask)) {
 		/*
 		 * Ayiee, looks like this CPU is stuck ...
 		 * wait a few IRQs (5 seconds) before doing the oops ...
@@ -0,0 +1,224 @@
+/*
+ * arch/i386/kernel/perfctr.c
+ *
+ * The performance counters of P6 family Intel CPUs, those with
+ * architectural performance monitoring, and of the AMD K7 and K8, for
+ * kernel/perfctr.c.  Also used by x86_64.
+ *
+ * The counters interrupt through the local APIC as an NMI, like
+ * oprofile's, so the two exclude each other.  CR4.PCE is set while the
+ * counters are reserved, so that a thread can read its own with rdpmc.
+ *
+ * The Pentium 4 has a different scheme altogether, and is not handled.
+ */
+
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/smp.h>
+#include <linux/perfctr.h>
+#include <asm/processor.h>
+#include <asm/system.h>
+#include <asm/msr.h>
+#include <asm/apic.h>
+#include <asm/nmi.h>
+
+#define EVNTSEL_USR		(1 << 16)
+#define EVNTSEL_OS		(1 << 17)
+#define EVNTSEL_INT		(1 << 20)
+#define EVNTSEL_EN		(1 << 22)
+/* event, unit mask, edge, inv and cmask, of a raw event select */
+#define EVNTSEL_RAW_MASK	0xff84ffff
+
+struct x86_perfctr_model {
+	struct perfctr_pmu	pmu;
+	unsigned int		evntsel_msr;
+	unsigned int		perfctr_msr;
+	u32			high;		/* of a counter written */
+	u64			events[PERFCTR_RAW];
+};
+
+static struct x86_perfctr_model *model;
+static struct x86_perfctr_model p6_model;
+static DEFINE_PER_CPU(unsigned long, saved_lvtpc);
+
+static int x86_perfctr_event(struct perfctr_attr *attr, u64 *evntsel)
+{
+	u64 sel;
+
+	if (attr->type == PERFCTR_RAW)
+		sel = attr->config & EVNTSEL_RAW_MASK;
+	else
+		sel = model->events[attr->type];
+
+	if (!(attr->flags & PERFCTR_EXCLUDE_USER))
+		sel |= EVNTSEL_USR;
+	if (!(attr->flags & PERFCTR_EXCLUDE_KERNEL))
+		sel |= EVNTSEL_OS;
+	*evntsel = sel | EVNTSEL_INT | EVNTSEL_EN;
+	return 0;
+}
+
+/* counter 0 of the P6 enables both, so it stays on counting nothing */
+static void x86_perfctr_stop(int hw)
+{
+	u32 idle = 0;
+
+	if (hw == 0 && model == &p6_model)
+		idle = EVNTSEL_EN;
+	wrmsr(model->evntsel_msr + hw, idle, 0);
+}
+
+static void x86_perfctr_start(int hw, u64 evntsel, u64 left)
+{
+	/* Intel sign extends the low 32bit, AMD writes all 48 */
+	wrmsr(model->evntsel_msr + hw, 0, 0);
+	wrmsr(model->perfctr_msr + hw, -(u32)left, model->high);
+	wrmsr(model->evntsel_msr + hw, (u32)evntsel, 0);
+}
+
+static u64 x86_perfctr_read(int hw)
+{
+	u32 low, high;
+
+	rdmsr(model->perfctr_msr + hw, low, high);
+	return (u64)high << 32 | low;
+}
+
+static int x86_perfctr_nmi(struct pt_regs *regs, int cpu)
+{
+	perfctr_overflow(regs);
+	/* the NMI masked it */
+	apic_write(APIC_LVTPC, APIC_DM_NMI);
+	return 1;
+}
+
+static void x86_perfctr_cpu_setup(void *dummy)
+{
+	int i;
+
+	for (i = 0; i < model->pmu.num_counters; i++)
+		x86_perfctr_stop(i);
+	__get_cpu_var(saved_lvtpc) = apic_read(APIC_LVTPC);
+	apic_write(APIC_LVTPC, APIC_DM_NMI);
+	write_cr4(read_cr4() | X86_CR4_PCE);
+}
+
+static void x86_perfctr_cpu_shutdown(void *dummy)
+{
+	unsigned int v;
+	int i;
+
+	write_cr4(read_cr4() & ~X86_CR4_PCE);
+	for (i = 0; i < model->pmu.num_counters; i++)
+		wrmsr(model->evntsel_msr + i, 0, 0);
+
+	/* see nmi_cpu_shutdown() of oprofile */
+	v = apic_read(APIC_LVTERR);
+	apic_write(APIC_LVTERR, v | APIC_LVT_MASKED);
+	apic_write(APIC_LVTPC, __get_cpu_var(saved_lvtpc));
+	apic_write(APIC_LVTERR, v);
+}
+
+static int x86_perfctr_reserve(void)
+{
+	if (reserve_lapic_nmi() < 0)
+		return -EBUSY;
+	on_each_cpu(x86_perfctr_cpu_setup, NULL, 0, 1);
+	set_nmi_callback(x86_perfctr_nmi);
+	return 0;
+}
+
+static void x86_perfctr_release(void)
+{
+	on_each_cpu(x86_perfctr_cpu_shutdown, NULL, 0, 1);
+	unset_nmi_callback();
+	release_lapic_nmi();
+}
+
+#define X86_PMU(_name, _counters, _width)			\
+	{							\
+		.name		= _name,			\
+		.num_counters	= _counters,			\
+		.width		= _width,			\
+		.event		= x86_perfctr_event,		\
+		.reserve	= x86_perfctr_reserve,		\
+		.release	= x86_perfctr_release,		\
+		.start		= x86_perfctr_start,		\
+		.stop		= x86_perfctr_stop,		\
+		.read		= x86_perfctr_read,		\
+	}
+
+/* cycles, instructions, cache misses and branch misses */
+static struct x86_perfctr_model p6_model = {
+	.pmu		= X86_PMU("P6", 2, 40),
+	.evntsel_msr	= MSR_P6_EVNTSEL0,
+	.perfctr_msr	= MSR_P6_PERFCTR0,
+	.events		= { 0x79, 0xc0, 0x24, 0xc5 },
+};
+
+/* the width and number of counters are from cpuid */
+static struct x86_perfctr_model arch_model = {
+	.pmu		= X86_PMU("architectural", 0, 0),
+	.evntsel_msr	= MSR_P6_EVNTSEL0,
+	.perfctr_msr	= MSR_P6_PERFCTR0,
+	.events		= { 0x3c, 0xc0, 0x412e, 0xc5 },
+};
+
+/* K7 counts data cache misses only */
+static struct x86_perfctr_model k7_model = {
+	.pmu		= X86_PMU("K7", 4, 48),
+	.evntsel_msr	= MSR_K7_EVNTSEL0,
+	.perfctr_msr	= MSR_K7_PERFCTR0,
+	.high		= -1,
+	.events		= { 0x76, 0xc0, 0x41, 0xc3 },
+};
+
+static struct x86_perfctr_model k8_model = {
+	.pmu		= X86_PMU("K8", 4, 48),
+	.evntsel_msr	= MSR_K7_EVNTSEL0,
+	.perfctr_msr	= MSR_K7_PERFCTR0,
+	.high		= -1,
+	.events		= { 0x76, 0xc0, 0x077e, 0xc3 },
+};
+
+static struct x86_perfctr_model * __init x86_perfctr_probe(void)
+{
+	struct cpuinfo_x86 *c = &boot_cpu_data;
+
+	switch (c->x86_vendor) {
+	case X86_VENDOR_INTEL:
+		if (c->cpuid_level >= 0xa) {
+			unsigned int eax = cpuid_eax(0xa);
+
+			if ((eax & 0xff) && ((eax >> 8) & 0xff) >= 2) {
+				arch_model.pmu.num_counters =
+					min_t(int, (eax >> 8) & 0xff,
+					      PERFCTR_MAX_COUNTERS);
+				arch_model.pmu.width = (eax >> 16) & 0xff;
+				return &arch_model;
+			}
+		}
+		if (c->x86 == 6)
+			return &p6_model;
+		break;
+	case X86_VENDOR_AMD:
+		if (c->x86 == 6)
+			return &k7_model;
+		if (c->x86 >= 15)
+			return &k8_model;
+		break;
+	}
+	return NULL;
+}
+
+static int __init x86_perfctr_init(void)
+{
+	if (!cpu_has_apic)
+		return -ENODEV;
+	model = x86_perfctr_probe();
+	if (!model)
+		return -ENODEV;
+	return perfctr_register_pmu(&model->pmu);
+}
+
+__initcall(x86_perfctr_init);
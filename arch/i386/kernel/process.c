@@ -96,11 +96,19 @@ EXPORT_SYMBOL(enable_hlt);
 void default_idle(void)
 {
 	if (!hlt_counter && boot_cpu_data.hlt_works_ok) {
+		/*
+		 * The wakeup interrupt must not preempt us before the
+		 * tick is restarted.
+		 */
+		preempt_disable();
 		local_irq_disable();
-		if (!need_resched())
+		if (!need_resched()) {
+			stop_hz_timer();
 			safe_halt();
-		else
+			start_hz_timer();
+		} else
 			local_irq_enable();
+		preempt_enable_no_resched();
 	} else {
 		cpu_relax();
 	}
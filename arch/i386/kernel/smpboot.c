@@ -197,7 +197,7 @@ static void __init synchronize_tsc_bp (void)
 	unsigned long long t0;
 	unsigned long long sum, avg;
 	long long delta;
-	unsigned long one_usec;
+	unsigned long one_usec, flags;
 	int buggy = 0;
 
 	printk(KERN_INFO "checking TSC synchronization across %u CPUs: ", num_booting_cpus());
@@ -233,10 +233,15 @@ static void __init synchronize_tsc_bp (void)
 
 		rdtscll(tsc_values[smp_processor_id()]);
 		/*
-		 * We clear the TSC in the last loop:
+		 * We clear the TSC in the last loop, and have gettimeofday()
+		 * restart from it if it is what it reads:
 		 */
-		if (i == NR_LOOPS-1)
+		if (i == NR_LOOPS-1) {
+			write_seqlock_irqsave(&xtime_lock, flags);
 			write_tsc(0, 0);
+			time_interpolator_reset();
+			write_sequnlock_irqrestore(&xtime_lock, flags);
+		}
 
 		/*
 		 * Wait for all APs to leave the synchronization point:
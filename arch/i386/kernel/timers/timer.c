@@ -1,6 +1,8 @@
 #include <linux/init.h>
 #include <linux/kernel.h>
 #include <linux/string.h>
+#include <linux/timex.h>
+#include <linux/workqueue.h>
 #include <asm/timer.h>
 
 #ifdef CONFIG_HPET_TIMER
@@ -11,7 +13,18 @@
  * timer_pit when HPET is active. So, we default to timer_tsc.
  */
 #endif
-/* list of timers, ordered by preference, NULL terminated */
+/*
+ * list of timers, ordered by preference, NULL terminated.  The first one
+ * that works drives the tick, and its counter is registered as the time
+ * interpolator gettimeofday() reads.  The TSC is registered besides it
+ * when it can be used, and being the cheapest to read it is rated above
+ * the others:
+ *
+ *	tsc 300, cyclone 250, hpet 250, pmtmr 200, pit 10
+ *
+ * so the chipset timers only take over the interpolation where the TSC
+ * is not trusted or stops being so.
+ */
 static struct init_timer_opts* __initdata timers[] = {
 #ifdef CONFIG_X86_CYCLONE_TIMER
 	&timer_cyclone_init,
@@ -41,9 +54,20 @@ __setup("clock=", clock_setup);
 /* The chosen timesource has been found to be bad.
  * Fall back to a known good timesource (the PIT)
  */
+static void clock_fallback_interpolator(void *unused)
+{
+	tsc_unregister_interpolator();
+	register_time_interpolator(timer_pit.interpolator);
+}
+
+static DECLARE_WORK(clock_fallback_work, clock_fallback_interpolator, NULL);
+
 void clock_fallback(void)
 {
 	cur_timer = &timer_pit;
+	/* in the timer interrupt, with xtime_lock held */
+	if (keventd_up())
+		schedule_work(&clock_fallback_work);
 }
 
 /* iterates through the list of timers, returning the first 
@@ -55,9 +79,14 @@ struct timer_opts* __init select_timer(void)
 	
 	/* find most preferred working timer */
 	while (timers[i]) {
-		if (timers[i]->init)
-			if (timers[i]->init(clock_override) == 0)
-				return timers[i]->opts;
+		if (timers[i]->init && timers[i]->init(clock_override) == 0) {
+			struct timer_opts *opts = timers[i]->opts;
+
+			if (opts->interpolator)
+				register_time_interpolator(opts->interpolator);
+			tsc_register_interpolator(clock_override);
+			return opts;
+		}
 		++i;
 	}
 		
@@ -103,26 +103,15 @@ static void mark_offset_cyclone(void)
 		jiffies_64++;
 }
 
-static unsigned long get_offset_cyclone(void)
-{
-	u32 offset;
-
-	if(!cyclone_timer)
-		return delay_at_last_interrupt;
-
-	/* Read the cyclone timer */
-	offset = cyclone_timer[0];
-
-	/* .. relative to previous jiffy */
-	offset = offset - last_cyclone_low;
-
-	/* convert cyclone ticks to microseconds */	
-	/* XXX slow, can we speed this up? */
-	offset = offset/(CYCLONE_TIMER_FREQ/1000000);
-
-	/* our adjusted time offset in microseconds */
-	return delay_at_last_interrupt + offset;
-}
+/* the low 32 bits of the counter, for gettimeofday() */
+static struct time_interpolator cyclone_interpolator = {
+	.source =	TIME_SOURCE_MMIO32,
+	.shift =	22,
+	.mask =		0xffffffff,
+	.frequency =	CYCLONE_TIMER_FREQ,
+	.drift =	-1,
+	.rating =	250,
+};
 
 static unsigned long long monotonic_clock_cyclone(void)
 {
@@ -225,6 +214,7 @@ static int __init init_cyclone(char* override)
 	}
 
 	init_cpu_khz();
+	cyclone_interpolator.addr = cyclone_timer;
 
 	/* Everything looks good! */
 	return 0;
@@ -248,7 +238,7 @@ static void delay_cyclone(unsigned long loops)
 static struct timer_opts timer_cyclone = {
 	.name = "cyclone",
 	.mark_offset = mark_offset_cyclone, 
-	.get_offset = get_offset_cyclone,
+	.interpolator =	&cyclone_interpolator,
 	.monotonic_clock =	monotonic_clock_cyclone,
 	.delay = delay_cyclone,
 };
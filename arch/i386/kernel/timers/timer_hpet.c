@@ -12,13 +12,13 @@
 
 #include <asm/timer.h>
 #include <asm/io.h>
+#include <asm/div64.h>
 #include <asm/processor.h>
 
 #include "io_ports.h"
 #include "mach_timer.h"
 #include <asm/hpet.h>
 
-static unsigned long hpet_usec_quotient;	/* convert hpet clks to usec */
 static unsigned long tsc_hpet_quotient;		/* convert tsc to hpet clks */
 static unsigned long hpet_last; 	/* hpet counter value at last tick*/
 static unsigned long last_tsc_low;	/* lsb 32 bits of Time Stamp Counter */
@@ -73,29 +73,20 @@ static unsigned long long monotonic_clock_hpet(void)
 	return base + cycles_2_ns(this_offset - last_offset);
 }
 
-static unsigned long get_offset_hpet(void)
+static unsigned long read_hpet_interpolator(void)
 {
-	register unsigned long eax, edx;
-
-	eax = hpet_readl(HPET_COUNTER);
-	eax -= hpet_last;	/* hpet delta */
-
-	/*
-         * Time offset = (hpet delta) * ( usecs per HPET clock )
-	 *             = (hpet delta) * ( usecs per tick / HPET clocks per tick)
-	 *             = (hpet delta) * ( hpet_usec_quotient ) / (2^32)
-	 *
-	 * Where,
-	 * hpet_usec_quotient = (2^32 * usecs per tick)/HPET clocks per tick
-	 *
-	 * Using a mull instead of a divl saves some cycles in critical path.
-         */
-	ASM_MUL64_REG(eax, edx, hpet_usec_quotient, eax);
-
-	/* our adjusted time offset in microseconds */
-	return edx;
+	return hpet_readl(HPET_COUNTER);
 }
 
+static struct time_interpolator hpet_interpolator = {
+	.source =	TIME_SOURCE_FUNCTION,
+	.shift =	22,
+	.addr =		read_hpet_interpolator,
+	.mask =		0xffffffff,
+	.drift =	-1,
+	.rating =	250,
+};
+
 static void mark_offset_hpet(void)
 {
 	unsigned long long this_offset, last_offset;
@@ -135,7 +126,7 @@ static void delay_hpet(unsigned long loops)
 
 static int __init init_hpet(char* override)
 {
-	unsigned long result, remain;
+	u64 freq = 1000000000000000ULL;	/* fsecs per second */
 
 	/* check clock override */
 	if (override[0] && strncmp(override,"hpet",4))
@@ -162,14 +153,8 @@ static int __init init_hpet(char* override)
 		}
 	}
 
-	/*
-	 * Math to calculate hpet to usec multiplier
-	 * Look for the comments at get_offset_hpet()
-	 */
-	ASM_DIV64_REG(result, remain, hpet_tick, 0, KERNEL_TICK_USEC);
-	if (remain > (hpet_tick >> 1))
-		result++; /* rounding the result */
-	hpet_usec_quotient = result;
+	do_div(freq, hpet_readl(HPET_PERIOD));
+	hpet_interpolator.frequency = freq;
 
 	return 0;
 }
@@ -180,7 +165,7 @@ static int __init init_hpet(char* override)
 static struct timer_opts timer_hpet = {
 	.name = 		"hpet",
 	.mark_offset =		mark_offset_hpet,
-	.get_offset =		get_offset_hpet,
+	.interpolator =		&hpet_interpolator,
 	.monotonic_clock =	monotonic_clock_hpet,
 	.delay = 		delay_hpet,
 };
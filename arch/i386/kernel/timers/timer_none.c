@@ -6,11 +6,6 @@ static void mark_offset_none(void)
 	/* nothing needed */
 }
 
-static unsigned long get_offset_none(void)
-{
-	return 0;
-}
-
 static unsigned long long monotonic_clock_none(void)
 {
 	return 0;
@@ -33,7 +28,6 @@ static void delay_none(unsigned long loops)
 struct timer_opts timer_none = {
 	.name = 	"none",
 	.mark_offset =	mark_offset_none, 
-	.get_offset =	get_offset_none,
 	.monotonic_clock =	monotonic_clock_none,
 	.delay = delay_none,
 };
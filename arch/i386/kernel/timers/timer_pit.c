@@ -21,7 +21,7 @@ extern spinlock_t i8253_lock;
 #include "do_timer.h"
 #include "io_ports.h"
 
-static int count_p; /* counter in get_offset_pit() */
+static int count_p; /* counter in read_pit() */
 
 static int __init init_pit(char* override)
 {
@@ -89,11 +89,16 @@ static void delay_pit(unsigned long loops)
  * comp.protocols.time.ntp!
  */
 
-static unsigned long get_offset_pit(void)
+/*
+ * The PIT only counts down the current tick, so the counter read by the
+ * time interpolator is made up of jiffies and the count: PIT clocks since
+ * boot, modulo 2^32.
+ */
+static unsigned long read_pit(void)
 {
 	int count;
-	unsigned long flags;
-	static unsigned long jiffies_p = 0;
+	unsigned long flags, now;
+	static unsigned long jiffies_p = 0, last_p = 0;
 
 	/*
 	 * cache volatile jiffies temporarily; we have xtime_lock. 
@@ -141,20 +146,37 @@ static unsigned long get_offset_pit(void)
 
 	count_p = count;
 
-	spin_unlock_irqrestore(&i8253_lock, flags);
+	/*
+	 * a tick which has wrapped the counter but not yet been taken is
+	 * not seen as an overflow with I/O APICs: never go backwards, the
+	 * interpolator would take it for nearly 2^32 clocks gone by.
+	 */
+	now = jiffies_t * LATCH + (LATCH - 1 - count);
+	if ((long)(now - last_p) < 0)
+		now = last_p;
+	last_p = now;
 
-	count = ((LATCH-1) - count) * TICK_SIZE;
-	count = (count + LATCH/2) / LATCH;
+	spin_unlock_irqrestore(&i8253_lock, flags);
 
-	return count;
+	return now;
 }
 
+static struct time_interpolator pit_interpolator = {
+	.source = TIME_SOURCE_FUNCTION,
+	.shift = 20,
+	.addr = read_pit,
+	.mask = 0xffffffff,
+	.frequency = CLOCK_TICK_RATE,
+	.drift = -1,
+	.rating = 10,
+};
+
 
 /* tsc timer_opts struct */
 struct timer_opts timer_pit = {
 	.name = "pit",
 	.mark_offset = mark_offset_pit, 
-	.get_offset = get_offset_pit,
+	.interpolator = &pit_interpolator,
 	.monotonic_clock = monotonic_clock_pit,
 	.delay = delay_pit,
 };
@@ -223,27 +223,27 @@ static void delay_pmtmr(unsigned long loops)
 }
 
 
-/*
- * get the offset (in microseconds) from the last call to mark_offset()
- *	- Called holding a reader xtime_lock
- */
-static unsigned long get_offset_pmtmr(void)
+static unsigned long read_pmtmr_interpolator(void)
 {
-	u32 now, offset, delta = 0;
-
-	offset = offset_tick;
-	now = read_pmtmr();
-	delta = (now - offset)&ACPI_PM_MASK;
-
-	return (unsigned long) offset_delay + cyc2us(delta);
+	return read_pmtmr();
 }
 
+static struct time_interpolator pmtmr_interpolator = {
+	.source			= TIME_SOURCE_FUNCTION,
+	.shift			= 22,
+	.addr			= read_pmtmr_interpolator,
+	.mask			= ACPI_PM_MASK,
+	.frequency		= PMTMR_TICKS_PER_SEC,
+	.drift			= -1,
+	.rating			= 200,
+};
+
 
 /* acpi timer_opts struct */
 static struct timer_opts timer_pmtmr = {
 	.name			= "pmtmr",
 	.mark_offset		= mark_offset_pmtmr,
-	.get_offset		= get_offset_pmtmr,
+	.interpolator		= &pmtmr_interpolator,
 	.monotonic_clock 	= monotonic_clock_pmtmr,
 	.delay 			= delay_pmtmr,
 };
@@ -26,7 +26,6 @@
 #include <asm/hpet.h>
 
 #ifdef CONFIG_HPET_TIMER
-static unsigned long hpet_usec_quotient;
 static unsigned long hpet_last;
 static struct timer_opts timer_tsc;
 #endif
@@ -83,33 +82,45 @@ static int count2; /* counter for mark_offset_tsc() */
  */
 static unsigned long fast_gettimeoffset_quotient;
 
-static unsigned long get_offset_tsc(void)
-{
-	register unsigned long eax, edx;
-
-	/* Read the Time Stamp Counter */
-
-	rdtsc(eax,edx);
+/*
+ * The TSC is registered as a time interpolator whichever timer drives the
+ * tick, as it is the cheapest counter there is to read.  It is rated below
+ * the chipset timers where the CPUs' TSCs are not synchronized, and taken
+ * away again once its rate changes or it is found to lose ticks.
+ */
+static struct time_interpolator tsc_interpolator = {
+	.source = TIME_SOURCE_CPU,
+	.shift = 22,
+	.mask = ~0ULL,
+	.drift = -1,
+#ifdef CONFIG_NUMA
+	.rating = 50,
+#else
+	.rating = 300,
+#endif
+};
 
-	/* .. relative to previous jiffy (32 bits is enough) */
-	eax -= last_tsc_low;	/* tsc_low delta */
+static int tsc_interpolator_registered;
 
-	/*
-         * Time offset = (tsc_low delta) * fast_gettimeoffset_quotient
-         *             = (tsc_low delta) * (usecs_per_clock)
-         *             = (tsc_low delta) * (usecs_per_jiffy / clocks_per_jiffy)
-	 *
-	 * Using a mull instead of a divl saves up to 31 clock cycles
-	 * in the critical path.
-         */
-
-	__asm__("mull %2"
-		:"=a" (eax), "=d" (edx)
-		:"rm" (fast_gettimeoffset_quotient),
-		 "0" (eax));
+void __init tsc_register_interpolator(char *override)
+{
+	if (override[0] && strncmp(override, "tsc", 3))
+		return;
+	/* get_cycles() is 0 if the kernel is not built to use the TSC */
+	if (!cpu_has_tsc || !cpu_khz || !get_cycles())
+		return;
+
+	tsc_interpolator.frequency = cpu_khz * 1000ULL;
+	register_time_interpolator(&tsc_interpolator);
+	tsc_interpolator_registered = 1;
+}
 
-	/* our adjusted time offset in microseconds */
-	return delay_at_last_interrupt + edx;
+void tsc_unregister_interpolator(void)
+{
+	if (tsc_interpolator_registered) {
+		tsc_interpolator_registered = 0;
+		unregister_time_interpolator(&tsc_interpolator);
+	}
 }
 
 static unsigned long long monotonic_clock_tsc(void)
@@ -171,7 +182,7 @@ static void delay_tsc(unsigned long loops)
 static void mark_offset_tsc_hpet(void)
 {
 	unsigned long long this_offset, last_offset;
- 	unsigned long offset, temp, hpet_current;
+ 	unsigned long offset, hpet_current;
 
 	write_seqlock(&monotonic_lock);
 	last_offset = ((unsigned long long)last_tsc_high<<32)|last_tsc_low;
@@ -202,18 +213,6 @@ static void mark_offset_tsc_hpet(void)
 	this_offset = ((unsigned long long)last_tsc_high<<32)|last_tsc_low;
 	monotonic_base += cycles_2_ns(this_offset - last_offset);
 	write_sequnlock(&monotonic_lock);
-
-	/* calculate delay_at_last_interrupt */
-	/*
-	 * Time offset = (hpet delta) * ( usecs per HPET clock )
-	 *             = (hpet delta) * ( usecs per tick / HPET clocks per tick)
-	 *             = (hpet delta) * ( hpet_usec_quotient ) / (2^32)
-	 * Where,
-	 * hpet_usec_quotient = (2^32 * usecs per tick)/HPET clocks per tick
-	 */
-	delay_at_last_interrupt = hpet_current - offset;
-	ASM_MUL64_REG(temp, delay_at_last_interrupt,
-			hpet_usec_quotient, delay_at_last_interrupt);
 }
 #endif
 
@@ -296,6 +295,11 @@ time_cpufreq_notifier(struct notifier_block *nb, unsigned long val,
 	if (val != CPUFREQ_RESUMECHANGE)
 		write_sequnlock_irq(&xtime_lock);
 
+	/* the TSC counts at the new rate: it cannot interpolate any more */
+	if (val == CPUFREQ_POSTCHANGE && freq->old != freq->new &&
+	    !(freq->flags & CPUFREQ_CONST_LOOPS))
+		tsc_unregister_interpolator();
+
 	return 0;
 }
 
@@ -478,20 +482,9 @@ static int __init init_tsc(char* override)
 		unsigned long tsc_quotient;
 #ifdef CONFIG_HPET_TIMER
 		if (is_hpet_enabled()){
-			unsigned long result, remain;
 			printk("Using TSC for gettimeofday\n");
 			tsc_quotient = calibrate_tsc_hpet(NULL);
 			timer_tsc.mark_offset = &mark_offset_tsc_hpet;
-			/*
-			 * Math to calculate hpet to usec multiplier
-			 * Look for the comments at get_offset_tsc_hpet()
-			 */
-			ASM_DIV64_REG(result, remain, hpet_tick,
-					0, KERNEL_TICK_USEC);
-			if (remain > (hpet_tick >> 1))
-				result++; /* rounding the result */
-
-			hpet_usec_quotient = result;
 		} else
 #endif
 		{
@@ -549,7 +542,7 @@ __setup("notsc", tsc_setup);
 static struct timer_opts timer_tsc = {
 	.name = "tsc",
 	.mark_offset = mark_offset_tsc, 
-	.get_offset = get_offset_tsc,
+	/* the interpolator is registered by tsc_register_interpolator() */
 	.monotonic_clock = monotonic_clock_tsc,
 	.delay = delay_tsc,
 };
@@ -153,6 +153,7 @@ static void mark_screen_rdonly(struct task_struct * tsk)
 	pmd = pmd_offset(pud, 0xA0000);
 	if (pmd_none_or_clear_bad(pmd))
 		goto out;
+	pte_lock_nested(pmd);
 	pte = mapped = pte_offset_map(pmd, 0xA0000);
 	for (i = 0; i < 32; i++) {
 		if (pte_present(*pte))
@@ -160,6 +161,7 @@ static void mark_screen_rdonly(struct task_struct * tsk)
 		pte++;
 	}
 	pte_unmap(mapped);
+	pte_unlock_nested(pmd);
 out:
 	spin_unlock(&tsk->mm->page_table_lock);
 	preempt_enable();
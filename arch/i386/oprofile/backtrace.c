@@ -18,6 +18,22 @@ struct frame_head {
 	unsigned long ret;
 } __attribute__((packed));
 
+#ifdef CONFIG_IA32_EMULATION
+/* the frames of a 32bit task on x86_64 */
+struct frame_head32 {
+	u32 ebp;
+	u32 ret;
+} __attribute__((packed));
+#endif
+
+#ifdef CONFIG_X86_64
+#define frame_pointer(regs)	((regs)->rbp)
+#define user_regs(task)	((struct pt_regs *)(task)->thread.rsp0 - 1)
+#else
+#define frame_pointer(regs)	((regs)->ebp)
+#define user_regs(task)	((struct pt_regs *)(task)->thread.esp0 - 1)
+#endif
+
 static struct frame_head *
 dump_backtrace(struct frame_head * head)
 {
@@ -31,16 +47,34 @@ dump_backtrace(struct frame_head * head)
 	return head->ebp;
 }
 
+#ifdef CONFIG_IA32_EMULATION
+static u32 dump_backtrace32(u32 head)
+{
+	struct frame_head32 * frame = (struct frame_head32 *)(unsigned long)head;
+
+	oprofile_add_trace(frame->ret);
+
+	if (head >= frame->ebp)
+		return 0;
+
+	return frame->ebp;
+}
+#endif
+
 /* check that the page(s) containing the frame head are present */
-static int pages_present(struct frame_head * head)
+static int pages_present(unsigned long head, unsigned long size)
 {
 	struct mm_struct * mm = current->mm;
 
+	/* a broken frame pointer can point anywhere, the kernel included */
+	if (head >= TASK_SIZE || TASK_SIZE - head < size)
+		return 0;
+
 	/* FIXME: only necessary once per page */
-	if (!check_user_page_readable(mm, (unsigned long)head))
+	if (!check_user_page_readable(mm, head))
 		return 0;
 
-	return check_user_page_readable(mm, (unsigned long)(head + 1));
+	return check_user_page_readable(mm, head + size - 1);
 }
 
 /*
@@ -60,52 +94,135 @@ static int pages_present(struct frame_head * head)
  * |             |
  * |             | \/ Lower addresses
  *
- * Thus, &pt_regs <-> stack base restricts the valid(ish) ebp values
+ * Thus, &pt_regs <-> stack base restricts the valid(ish) ebp values.
+ *
+ * On x86_64 the NMI runs on a stack of its own, so the frames are
+ * looked for on the task's stack and on the interrupt stack instead.
+ *
+ * Returns the top of the stack the frame head is on, 0 if it is not
+ * on a kernel stack.
  */
 #ifdef CONFIG_FRAME_POINTER
-static int valid_kernel_stack(struct frame_head * head, struct pt_regs * regs)
+static unsigned long kernel_stack_top(struct frame_head * head,
+				      struct pt_regs * regs)
 {
 	unsigned long headaddr = (unsigned long)head;
+	unsigned long end = headaddr + sizeof(struct frame_head);
+#ifdef CONFIG_X86_64
+	unsigned long stack = (unsigned long)current_thread_info();
+	unsigned long irqstack = (unsigned long)read_pda(irqstackptr);
+
+	if (headaddr > stack && end <= stack + THREAD_SIZE)
+		return stack + THREAD_SIZE;
+	/* irqstackptr is 64 bytes below the top */
+	if (headaddr > irqstack + 64 - IRQSTACKSIZE && end <= irqstack)
+		return irqstack;
+	return 0;
+#else
 	unsigned long stack = (unsigned long)regs;
 	unsigned long stack_base = (stack & ~(THREAD_SIZE - 1)) + THREAD_SIZE;
 
-	return headaddr > stack && headaddr < stack_base;
+	if (headaddr > stack && end <= stack_base)
+		return stack_base;
+	return 0;
+#endif
 }
 #else
 /* without fp, it's just junk */
-static int valid_kernel_stack(struct frame_head * head, struct pt_regs * regs)
+static unsigned long kernel_stack_top(struct frame_head * head,
+				      struct pt_regs * regs)
 {
 	return 0;
 }
 #endif
 
-
-void
-x86_backtrace(struct pt_regs * const regs, unsigned int depth)
+/*
+ * Walk the frames on the kernel stacks, decrementing *depth for each.
+ * Returns the first frame head that is not on one.  The outermost
+ * kernel frame saved the frame pointer of the interrupted user code,
+ * because the entry code does not touch it.
+ */
+static struct frame_head *
+kernel_backtrace(struct frame_head * head, struct pt_regs * regs,
+		 unsigned int * depth)
 {
-	struct frame_head *head;
+	unsigned long top = kernel_stack_top(head, regs);
 
-#ifdef CONFIG_X86_64
-	head = (struct frame_head *)regs->rbp;
-#else
-	head = (struct frame_head *)regs->ebp;
-#endif
+	while (*depth && top) {
+		struct frame_head * next = head->ebp;
+		unsigned long next_top;
 
-	if (!user_mode(regs)) {
-		while (depth-- && valid_kernel_stack(head, regs))
-			head = dump_backtrace(head);
-		return;
+		oprofile_add_trace(head->ret);
+		(*depth)--;
+
+		/* up the same stack, or on to the stack that was interrupted
+		 * or, with the user frame pointer, off the kernel stacks */
+		next_top = kernel_stack_top(next, regs);
+		if (next_top == top && next <= head)
+			return NULL;
+
+		head = next;
+		top = next_top;
 	}
+	return head;
+}
 
+static void
+user_backtrace(struct frame_head * head, unsigned int depth)
+{
 #ifdef CONFIG_SMP
 	if (!spin_trylock(&current->mm->page_table_lock))
 		return;
 #endif
 
-	while (depth-- && head && pages_present(head))
+#ifdef CONFIG_IA32_EMULATION
+	if (test_thread_flag(TIF_IA32)) {
+		u32 head32 = (u32)(unsigned long)head;
+
+		while (depth-- && head32 &&
+		       pages_present(head32, sizeof(struct frame_head32)))
+			head32 = dump_backtrace32(head32);
+	} else
+#endif
+	while (depth-- && head &&
+	       pages_present((unsigned long)head, sizeof(struct frame_head)))
 		head = dump_backtrace(head);
 
 #ifdef CONFIG_SMP
 	spin_unlock(&current->mm->page_table_lock);
 #endif
 }
+
+
+void
+x86_backtrace(struct pt_regs * const regs, unsigned int depth)
+{
+	struct frame_head *head = (struct frame_head *)frame_pointer(regs);
+	struct pt_regs *uregs;
+
+	if (user_mode(regs)) {
+		user_backtrace(head, depth);
+		return;
+	}
+
+	head = kernel_backtrace(head, regs, &depth);
+
+	/* go on with the user stack of the task, if any */
+	if (!depth || !current->mm)
+		return;
+	uregs = user_regs(current);
+	if (!user_mode(uregs))
+		return;
+
+	/* the x86_64 syscall entry does not save %rbp in pt_regs, so there
+	 * the user frame pointer is where the kernel walk ended */
+#ifndef CONFIG_X86_64
+	head = (struct frame_head *)uregs->ebp;
+#elif !defined(CONFIG_FRAME_POINTER)
+	head = NULL;
+#endif
+
+	oprofile_trace_mode(0);
+	oprofile_add_trace(instruction_pointer(uregs));
+	user_backtrace(head, depth - 1);
+}
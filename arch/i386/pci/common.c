@@ -8,6 +8,8 @@
 #include <linux/pci.h>
 #include <linux/ioport.h>
 #include <linux/init.h>
+#include <linux/irq.h>
+#include <linux/topology.h>
 
 #include <asm/acpi.h>
 #include <asm/segment.h>
@@ -247,5 +249,13 @@ int pcibios_enable_device(struct pci_dev *dev, int mask)
 	if ((err = pcibios_enable_resources(dev, mask)) < 0)
 		return err;
 
-	return pcibios_enable_irq(dev);
+	if ((err = pcibios_enable_irq(dev)) < 0)
+		return err;
+
+#ifdef CONFIG_SMP
+	/* keep its interrupts on the node of its bus */
+	if (dev->irq)
+		set_irq_home(dev->irq, pcibus_to_cpumask(dev->bus));
+#endif
+	return 0;
 }
@@ -536,7 +536,6 @@ static int __init swap_init(void *start_mem, void *swap_data)
 	p->swap_file    = &fake_dentry;
 	p->swap_vfsmnt  = &fake_vfsmnt;
 	p->swap_map	= swap_data;
-	p->cluster_nr   = 0;
 	p->next         = -1;
 	p->prio         = 0x7ff0;	/* a rather high priority, but not the higest
 								 * to give the user a chance to override */
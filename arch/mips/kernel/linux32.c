@@ -31,7 +31,7 @@
 #include <linux/utsname.h>
 #include <linux/personality.h>
 #include <linux/timex.h>
-#include <linux/dnotify.h>
+#include <linux/fsnotify.h>
 #include <linux/module.h>
 #include <linux/binfmts.h>
 #include <linux/security.h>
@@ -481,7 +481,7 @@ asmlinkage ssize_t sys32_pread(unsigned int fd, char * buf,
 		goto out;
 	ret = read(file, buf, count, &pos);
 	if (ret > 0)
-		dnotify_parent(file->f_dentry, DN_ACCESS);
+		fsnotify_access(file->f_dentry);
 out:
 	fput(file);
 bad_file:
@@ -518,7 +518,7 @@ asmlinkage ssize_t sys32_pwrite(unsigned int fd, const char * buf,
 
 	ret = write(file, buf, count, &pos);
 	if (ret > 0)
-		dnotify_parent(file->f_dentry, DN_MODIFY);
+		fsnotify_modify(file->f_dentry);
 out:
 	fput(file);
 bad_file:
@@ -1020,6 +1020,23 @@ long sys32_fadvise64_64(int fd, __u32 offset_low, __u32 offset_high,
 			       advice); 
 } 
 
+long sys32_sync_file_range(int fd, __u32 offset_low, __u32 offset_high,
+			   __u32 nbytes_low, __u32 nbytes_high, unsigned int flags)
+{
+	return sys_sync_file_range(fd,
+				   (((u64)offset_high)<<32) | offset_low,
+				   (((u64)nbytes_high)<<32) | nbytes_low,
+				   flags);
+}
+
+long sys32_fallocate(int fd, int mode, __u32 offset_low, __u32 offset_high,
+		     __u32 len_low, __u32 len_high)
+{
+	return sys_fallocate(fd, mode,
+			     (((u64)offset_high)<<32) | offset_low,
+			     (((u64)len_high)<<32) | len_low);
+}
+
 long sys32_vm86_warning(void)
 { 
 	struct task_struct *me = current;
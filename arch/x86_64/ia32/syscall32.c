@@ -52,11 +52,13 @@ int __map_syscall32(struct mm_struct *mm, unsigned long address)
  	if (pud) {
  		pmd = pmd_alloc(mm, pud, address);
  		if (pmd && (pte = pte_alloc_map(mm, pmd, address)) != NULL) {
+			pte_lock_nested(pmd);
  			if (pte_none(*pte)) {
  				set_pte(pte,
  					mk_pte(virt_to_page(syscall32_page),
  					       PAGE_KERNEL_VSYSCALL32));
  			}
+			pte_unlock_nested(pmd);
  			/* Flush only the local CPU. Other CPUs taking a fault
  			   will just end up here again
 			   This probably not needed and just paranoia. */
@@ -109,7 +109,8 @@ static void __init smp_store_cpu_info(int id)
  * TSC synchronization.
  *
  * We first check whether all CPUs have their TSC's synchronized,
- * then we print a warning if not, and always resync.
+ * then we print a warning if not, and always resync.  Then all of
+ * them check together that none reads its TSC behind another's.
  */
 
 static atomic_t tsc_start_flag = ATOMIC_INIT(0);
@@ -117,7 +118,36 @@ static atomic_t tsc_count_start = ATOMIC_INIT(0);
 static atomic_t tsc_count_stop = ATOMIC_INIT(0);
 static unsigned long long tsc_values[NR_CPUS];
 
+static __initdata DEFINE_SPINLOCK(tsc_warp_lock);
+static unsigned long long tsc_warp_last __initdata;
+static atomic_t tsc_warp_done = ATOMIC_INIT(0);
+int tsc_unsynchronized __initdata;
+
 #define NR_LOOPS 5
+#define NR_WARP_LOOPS 10000
+
+/*
+ * Read the TSC in turn with the other CPUs: one reading behind the last
+ * one read by another CPU means time through the vsyscalls could go
+ * backwards when a process moves between these two.
+ */
+static void __init check_tsc_warp(void)
+{
+	unsigned long long prev, now;
+	int i;
+
+	for (i = 0; i < NR_WARP_LOOPS; i++) {
+		spin_lock(&tsc_warp_lock);
+		prev = tsc_warp_last;
+		sync_core();
+		rdtscll(now);
+		tsc_warp_last = now;
+		spin_unlock(&tsc_warp_lock);
+
+		if (now < prev)
+			tsc_unsynchronized = 1;
+	}
+}
 
 extern unsigned int fast_gettimeoffset_quotient;
 
@@ -212,7 +242,14 @@ static void __init synchronize_tsc_bp (void)
 
 		sum += delta;
 	}
-	if (!buggy)
+
+	check_tsc_warp();
+	while (atomic_read(&tsc_warp_done) != num_booting_cpus()-1) mb();
+	if (tsc_unsynchronized) {
+		if (!buggy)
+			printk("\n");
+		printk(KERN_WARNING "TSCs are not synchronized after reset.\n");
+	} else if (!buggy)
 		printk("passed.\n");
 }
 
@@ -239,8 +276,12 @@ static void __init synchronize_tsc_ap (void)
 		atomic_inc(&tsc_count_stop);
 		while (atomic_read(&tsc_count_stop) != num_booting_cpus()) mb();
 	}
+
+	check_tsc_warp();
+	atomic_inc(&tsc_warp_done);
 }
 #undef NR_LOOPS
+#undef NR_WARP_LOOPS
 
 static atomic_t init_deasserted;
 
@@ -69,6 +69,7 @@ struct vxtime_data __vxtime __section_vxtime;	/* for vsyscalls */
 volatile unsigned long __jiffies __section_jiffies = INITIAL_JIFFIES;
 unsigned long __wall_jiffies __section_wall_jiffies = INITIAL_JIFFIES;
 struct timespec __xtime __section_xtime;
+struct timespec __wall_to_monotonic __section_wall_to_monotonic;
 struct timezone __sys_tz __section_sys_tz;
 
 static inline void rdtscll_sync(unsigned long *tsc)
@@ -203,6 +204,29 @@ unsigned long profile_pc(struct pt_regs *regs)
 }
 EXPORT_SYMBOL(profile_pc);
 
+#ifdef CONFIG_FRAME_POINTER
+/*
+ * The return address in the frame of the function the interrupt hit,
+ * or 0.  Only the NMI and exceptions save %rbp in pt_regs, so it is
+ * checked to be on the task or interrupt stack before use.
+ */
+unsigned long profile_caller(struct pt_regs *regs)
+{
+	unsigned long stack = (unsigned long)current_thread_info();
+	unsigned long irqstack = (unsigned long)read_pda(irqstackptr);
+	unsigned long fp = regs->rbp, ret;
+
+	if (user_mode(regs))
+		return 0;
+	/* irqstackptr is 64 bytes below the top */
+	if (!(fp > stack && fp + 16 <= stack + THREAD_SIZE) &&
+	    !(fp > irqstack + 64 - IRQSTACKSIZE && fp + 16 <= irqstack))
+		return 0;
+	ret = ((unsigned long *)fp)[1];
+	return ret >= __START_KERNEL_map ? ret : 0;
+}
+#endif
+
 /*
  * In order to set the CMOS clock precisely, set_rtc_mmss has to be called 500
  * ms after the second nowtime has started, because when nowtime is written
@@ -930,6 +954,7 @@ void __init time_init_smp(void)
 	 * Exceptions:
 	 * IBM Summit2 checked by oem_force_hpet_timer().
  	 * AMD dual core may also not need HPET. Check me.
+	 * Any whose TSCs failed the check after resyncing at boot.
 	 *
 	 * Can be turned off with "notsc".
 	 */
@@ -939,6 +964,10 @@ void __init time_init_smp(void)
 	/* Some systems will want to disable TSC and use HPET. */
 	if (oem_force_hpet_timer())
 		notsc = 1;
+#ifdef CONFIG_SMP
+	if (tsc_unsynchronized)
+		notsc = 1;
+#endif
 	if (vxtime.hpet_address && notsc) {
 		timetype = "HPET";
 		vxtime.last = hpet_readl(HPET_T0_CMP) - hpet_tick;
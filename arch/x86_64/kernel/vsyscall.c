@@ -15,6 +15,11 @@
  *  mechanism because older kernels won't return -ENOSYS.
  *  If we want more than four we need a vDSO.
  *
+ *  vsyscall 2 is clock_gettime() for CLOCK_REALTIME and CLOCK_MONOTONIC,
+ *  passing other clocks on to the system call; kernels without it return
+ *  -ENOSYS there.  With the TSC it is only as good as the TSCs are
+ *  synchronized, which is checked at boot; else HPET is used.
+ *
  *  Note: the concept clashes with user mode linux. If you use UML and
  *  want per guest time just set the kernel.vsyscall64 sysctl to 0.
  */
@@ -83,6 +88,45 @@ static force_inline void do_vgettimeofday(struct timeval * tv)
 	tv->tv_usec = usec % 1000000;
 }
 
+static force_inline void do_vclock_gettime(clockid_t clock, struct timespec *ts)
+{
+	unsigned long sequence, p, t;
+	long sec, nsec;
+
+	do {
+		sequence = read_seqbegin(&__xtime_lock);
+
+		sec = __xtime.tv_sec;
+		nsec = __xtime.tv_nsec +
+			(__jiffies - __wall_jiffies) * (NSEC_PER_SEC / HZ);
+
+		/* usecs << 32, from the same quotients as above */
+		if (__vxtime.mode == VXTIME_TSC) {
+			sync_core();
+			rdtscll(t);
+			if (t < __vxtime.last_tsc)
+				t = __vxtime.last_tsc;
+			p = (t - __vxtime.last_tsc) * __vxtime.tsc_quot;
+		} else {
+			p = (unsigned int)(readl((void *)fix_to_virt(VSYSCALL_HPET) +
+					   0xf0) - __vxtime.last) * __vxtime.quot;
+		}
+		nsec += (p >> 32) * 1000 + (((p & 0xffffffff) * 1000) >> 32);
+
+		if (clock == CLOCK_MONOTONIC) {
+			sec += __wall_to_monotonic.tv_sec;
+			nsec += __wall_to_monotonic.tv_nsec;
+		}
+	} while (read_seqretry(&__xtime_lock, sequence));
+
+	while (nsec >= NSEC_PER_SEC) {
+		nsec -= NSEC_PER_SEC;
+		sec++;
+	}
+	ts->tv_sec = sec;
+	ts->tv_nsec = nsec;
+}
+
 /* RED-PEN may want to readd seq locking, but then the variable should be write-once. */
 static force_inline void do_get_tz(struct timezone * tz)
 {
@@ -98,6 +142,17 @@ static force_inline int gettimeofday(struct timeval *tv, struct timezone *tz)
 	return ret;
 }
 
+/* not patched by vsyscall_sysctl_change(): needed for the other clocks */
+static force_inline int clock_gettime_syscall(clockid_t clock,
+					      struct timespec *ts)
+{
+	int ret;
+	asm volatile("syscall"
+		: "=a" (ret)
+		: "0" (__NR_clock_gettime),"D" (clock),"S" (ts) : __syscall_clobber );
+	return ret;
+}
+
 static force_inline long time_syscall(long *t)
 {
 	long secs;
@@ -129,9 +184,13 @@ static time_t __vsyscall(1) vtime(time_t *t)
 	return __xtime.tv_sec;
 }
 
-static long __vsyscall(2) venosys_0(void)
+static int __vsyscall(2) vclock_gettime(clockid_t clock, struct timespec *ts)
 {
-	return -ENOSYS;
+	if (unlikely(!__sysctl_vsyscall) ||
+	    (clock != CLOCK_REALTIME && clock != CLOCK_MONOTONIC))
+		return clock_gettime_syscall(clock, ts);
+	do_vclock_gettime(clock, ts);
+	return 0;
 }
 
 static long __vsyscall(3) venosys_1(void)
@@ -215,6 +274,8 @@ static int __init vsyscall_init(void)
 	BUG_ON(((unsigned long) &vgettimeofday !=
 			VSYSCALL_ADDR(__NR_vgettimeofday)));
 	BUG_ON((unsigned long) &vtime != VSYSCALL_ADDR(__NR_vtime));
+	BUG_ON((unsigned long) &vclock_gettime !=
+			VSYSCALL_ADDR(__NR_vclock_gettime));
 	BUG_ON((VSYSCALL_ADDR(0) != __fix_to_virt(VSYSCALL_FIRST_PAGE)));
 	map_vsyscall();
 	sysctl_vsyscall = 1;
@@ -33,9 +33,20 @@ static inline void crypto_alg_put(struct crypto_alg *alg)
 	module_put(alg->cra_module);
 }
 
-struct crypto_alg *crypto_alg_lookup(const char *name)
+static inline const char *crypto_alg_driver_name(struct crypto_alg *alg)
+{
+	return *alg->cra_driver_name ? alg->cra_driver_name : alg->cra_name;
+}
+
+/*
+ * An exact match on the driver name wins, otherwise the implementation
+ * of the algorithm with the highest priority.  Asynchronous-only ones
+ * are only for callers which asked for them.
+ */
+struct crypto_alg *crypto_alg_lookup(const char *name, u32 flags)
 {
 	struct crypto_alg *q, *alg = NULL;
+	int best = 0;
 
 	if (!name)
 		return NULL;
@@ -43,11 +54,26 @@ struct crypto_alg *crypto_alg_lookup(const char *name)
 	down_read(&crypto_alg_sem);
 	
 	list_for_each_entry(q, &crypto_alg_list, cra_list) {
-		if (!(strcmp(q->cra_name, name))) {
-			if (crypto_alg_get(q))
-				alg = q;
+		int exact;
+
+		if ((q->cra_flags & CRYPTO_ALG_ASYNC) &&
+		    !(flags & CRYPTO_TFM_REQ_ASYNC))
+			continue;
+
+		exact = !strcmp(crypto_alg_driver_name(q), name);
+		if (!exact && (strcmp(q->cra_name, name) ||
+		               (alg && q->cra_priority <= best)))
+			continue;
+
+		if (!crypto_alg_get(q))
+			continue;
+		if (alg)
+			crypto_alg_put(alg);
+		alg = q;
+		best = q->cra_priority;
+
+		if (exact)
 			break;
-		}
 	}
 	
 	up_read(&crypto_alg_sem);
@@ -57,6 +83,7 @@ struct crypto_alg *crypto_alg_lookup(const char *name)
 static int crypto_init_flags(struct crypto_tfm *tfm, u32 flags)
 {
 	tfm->crt_flags = 0;
+	flags &= ~CRYPTO_TFM_REQ_ASYNC;
 	
 	switch (crypto_tfm_alg_type(tfm)) {
 	case CRYPTO_ALG_TYPE_CIPHER:
@@ -122,7 +149,7 @@ struct crypto_tfm *crypto_alloc_tfm(const char *name, u32 flags)
 	struct crypto_tfm *tfm = NULL;
 	struct crypto_alg *alg;
 
-	alg = crypto_alg_mod_lookup(name);
+	alg = crypto_alg_mod_lookup(name, flags);
 	if (alg == NULL)
 		goto out;
 	
@@ -172,7 +199,8 @@ int crypto_register_alg(struct crypto_alg *alg)
 	down_write(&crypto_alg_sem);
 	
 	list_for_each_entry(q, &crypto_alg_list, cra_list) {
-		if (!(strcmp(q->cra_name, alg->cra_name))) {
+		if (!(strcmp(crypto_alg_driver_name(q),
+		             crypto_alg_driver_name(alg)))) {
 			ret = -EEXIST;
 			goto out;
 		}
@@ -207,7 +235,7 @@ out:
 int crypto_alg_available(const char *name, u32 flags)
 {
 	int ret = 0;
-	struct crypto_alg *alg = crypto_alg_mod_lookup(name);
+	struct crypto_alg *alg = crypto_alg_mod_lookup(name, flags);
 	
 	if (alg) {
 		crypto_alg_put(alg);
@@ -220,6 +248,7 @@ int crypto_alg_available(const char *name, u32 flags)
 static int __init init_crypto(void)
 {
 	printk(KERN_INFO "Initializing Cryptographic API\n");
+	crypto_init_async();
 	crypto_init_proc();
 	return 0;
 }
@@ -0,0 +1,194 @@
+/*
+ * Cryptographic API.
+ *
+ * Asynchronous requests.
+ *
+ * Requests for algorithms with a hardware driver go to the driver.  The
+ * others are queued per CPU and done by a kcrypto thread, so callers in
+ * softirq context do not have to spend the time in there.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option) 
+ * any later version.
+ *
+ */
+#include <linux/crypto.h>
+#include <linux/errno.h>
+#include <linux/percpu.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
+#include "internal.h"
+
+#define CRYPTO_SOFT_QLEN	1000	/* beyond this, requests are done inline */
+#define CRYPTO_SOFT_BATCH	16	/* taken off the queue at once */
+
+void crypto_init_queue(struct crypto_queue *queue, unsigned int max_qlen)
+{
+	INIT_LIST_HEAD(&queue->list);
+	queue->qlen = 0;
+	queue->max_qlen = max_qlen;
+}
+
+int crypto_enqueue_request(struct crypto_queue *queue,
+                           struct crypto_request *req)
+{
+	if (queue->qlen >= queue->max_qlen)
+		return -EBUSY;
+
+	queue->qlen++;
+	list_add_tail(&req->list, &queue->list);
+	return 0;
+}
+
+struct crypto_request *crypto_dequeue_request(struct crypto_queue *queue)
+{
+	struct crypto_request *req;
+
+	if (list_empty(&queue->list))
+		return NULL;
+
+	req = list_entry(queue->list.next, struct crypto_request, list);
+	list_del(&req->list);
+	queue->qlen--;
+	return req;
+}
+
+/*
+ * Move up to @max requests to the tail of @batch, oldest first.
+ */
+unsigned int crypto_dequeue_batch(struct crypto_queue *queue,
+                                  struct list_head *batch, unsigned int max)
+{
+	unsigned int n = 0;
+
+	while (n < max && !list_empty(&queue->list)) {
+		list_move_tail(queue->list.next, batch);
+		n++;
+	}
+	queue->qlen -= n;
+	return n;
+}
+
+static int crypto_do_request(struct crypto_request *req)
+{
+	struct crypto_tfm *tfm = req->tfm;
+
+	switch (req->op) {
+	case CRYPTO_OP_ENCRYPT:
+		if (req->iv)
+			return crypto_cipher_encrypt_iv(tfm, req->dst, req->src,
+			                                req->nbytes, req->iv);
+		return crypto_cipher_encrypt(tfm, req->dst, req->src,
+		                             req->nbytes);
+
+	case CRYPTO_OP_DECRYPT:
+		if (req->iv)
+			return crypto_cipher_decrypt_iv(tfm, req->dst, req->src,
+			                                req->nbytes, req->iv);
+		return crypto_cipher_decrypt(tfm, req->dst, req->src,
+		                             req->nbytes);
+
+	case CRYPTO_OP_DIGEST:
+		crypto_digest_digest(tfm, req->src, req->nbytes, req->result);
+		return 0;
+
+	default:
+		break;
+	}
+
+	BUG();
+	return -EINVAL;
+}
+
+struct crypto_cpu_queue {
+	spinlock_t lock;
+	struct crypto_queue queue;
+	struct work_struct work;
+};
+
+static DEFINE_PER_CPU(struct crypto_cpu_queue, crypto_cpu_queues);
+static struct workqueue_struct *kcrypto_wq;
+
+static void crypto_soft_work(void *data)
+{
+	struct crypto_cpu_queue *cq = data;
+	struct crypto_request *req;
+	unsigned long flags;
+	LIST_HEAD(batch);
+
+	for (;;) {
+		spin_lock_irqsave(&cq->lock, flags);
+		crypto_dequeue_batch(&cq->queue, &batch, CRYPTO_SOFT_BATCH);
+		spin_unlock_irqrestore(&cq->lock, flags);
+
+		if (list_empty(&batch))
+			break;
+
+		while (!list_empty(&batch)) {
+			req = list_entry(batch.next, struct crypto_request,
+			                 list);
+			list_del(&req->list);
+			req->complete(req, crypto_do_request(req));
+		}
+		cond_resched();
+	}
+}
+
+static int crypto_soft_submit(struct crypto_request *req)
+{
+	struct crypto_cpu_queue *cq;
+	unsigned long flags;
+	int err;
+
+	if (unlikely(!kcrypto_wq))
+		return crypto_do_request(req);
+
+	cq = &per_cpu(crypto_cpu_queues, get_cpu());
+	spin_lock_irqsave(&cq->lock, flags);
+	err = crypto_enqueue_request(&cq->queue, req);
+	spin_unlock_irqrestore(&cq->lock, flags);
+	if (!err)
+		queue_work(kcrypto_wq, &cq->work);
+	put_cpu();
+
+	/* too far behind already, the caller may as well wait for it */
+	if (err)
+		return crypto_do_request(req);
+
+	return -EINPROGRESS;
+}
+
+int crypto_request_submit(struct crypto_request *req)
+{
+	struct crypto_alg *alg = req->tfm->__crt_alg;
+
+	if (alg->cra_async)
+		return alg->cra_async(req);
+
+	return crypto_soft_submit(req);
+}
+
+void __init crypto_init_async(void)
+{
+	int cpu;
+
+	for_each_cpu(cpu) {
+		struct crypto_cpu_queue *cq = &per_cpu(crypto_cpu_queues, cpu);
+
+		spin_lock_init(&cq->lock);
+		crypto_init_queue(&cq->queue, CRYPTO_SOFT_QLEN);
+		INIT_WORK(&cq->work, crypto_soft_work, cq);
+	}
+
+	kcrypto_wq = create_workqueue("kcrypto");
+	if (!kcrypto_wq)
+		printk(KERN_WARNING "crypto: no kcrypto threads, requests "
+		       "are done synchronously\n");
+}
+
+EXPORT_SYMBOL_GPL(crypto_request_submit);
+EXPORT_SYMBOL_GPL(crypto_init_queue);
+EXPORT_SYMBOL_GPL(crypto_enqueue_request);
+EXPORT_SYMBOL_GPL(crypto_dequeue_request);
+EXPORT_SYMBOL_GPL(crypto_dequeue_batch);
@@ -53,7 +53,13 @@ static int c_show(struct seq_file *m, void *p)
 	struct crypto_alg *alg = (struct crypto_alg *)p;
 	
 	seq_printf(m, "name         : %s\n", alg->cra_name);
+	seq_printf(m, "driver       : %s\n", *alg->cra_driver_name ?
+	           alg->cra_driver_name : alg->cra_name);
 	seq_printf(m, "module       : %s\n", module_name(alg->cra_module));
+	seq_printf(m, "priority     : %d\n", alg->cra_priority);
+	if (alg->cra_async)
+		seq_printf(m, "async        : %s\n",
+		           alg->cra_flags & CRYPTO_ALG_ASYNC ? "only" : "yes");
 	
 	switch (alg->cra_flags & CRYPTO_ALG_TYPE_MASK) {
 	case CRYPTO_ALG_TYPE_CIPHER:
@@ -25,6 +25,9 @@
 #include <linux/crypto.h>
 #include <linux/highmem.h>
 #include <linux/moduleparam.h>
+#include <linux/jiffies.h>
+#include <linux/interrupt.h>
+#include <asm/timex.h>
 #include "tcrypt.h"
 
 /*
@@ -57,6 +60,11 @@ static unsigned int IDX[8] = { IDX1, IDX2, IDX3, IDX4, IDX5, IDX6, IDX7, IDX8 };
 
 static int mode;
 static char *xbuf;
+
+/* for the speed tests: seconds per test or cycle counts, which algorithm */
+static unsigned int sec = 1;
+static int cycles;
+static char *alg;
 static char *tvmem;
 
 static char *check[] = {
@@ -598,6 +606,253 @@ test_crc32c(void)
 	printk("crc32c test complete\n");
 }
 
+/*
+ * Speed tests: for every key size and block size, either count how many
+ * blocks get through in sec seconds, or with cycles=1 take the average
+ * cycle count of a few runs with interrupts off, which is much more
+ * repeatable.  Use alg= with a driver name to time a given
+ * implementation, e.g. alg=aes-generic.
+ */
+static unsigned int speed_blocks[] = { 16, 64, 256, 1024, 8192, 0 };
+
+#define SPEED_WARMUP	4
+#define SPEED_RUNS	8
+
+static int speed_op(struct crypto_tfm *tfm, int enc, struct scatterlist *sg,
+                    unsigned int blen, char *result)
+{
+	if (crypto_tfm_alg_type(tfm) == CRYPTO_ALG_TYPE_DIGEST) {
+		crypto_digest_digest(tfm, sg, 1, result);
+		return 0;
+	}
+	if (enc)
+		return crypto_cipher_encrypt(tfm, sg, sg, blen);
+	return crypto_cipher_decrypt(tfm, sg, sg, blen);
+}
+
+static int speed_jiffies(struct crypto_tfm *tfm, int enc,
+                         struct scatterlist *sg, unsigned int blen)
+{
+	unsigned long end = jiffies + sec * HZ;
+	char result[64];
+	int bcount, ret;
+
+	for (bcount = 0; time_before(jiffies, end); bcount++) {
+		ret = speed_op(tfm, enc, sg, blen, result);
+		if (ret)
+			return ret;
+	}
+
+	printk("%d operations in %u seconds (%lu bytes)\n",
+	       bcount, sec, (unsigned long)bcount * blen);
+	return 0;
+}
+
+static int speed_cycles(struct crypto_tfm *tfm, int enc,
+                        struct scatterlist *sg, unsigned int blen)
+{
+	unsigned long cycles = 0, per_byte;
+	cycles_t start;
+	char result[64];
+	int i, ret = 0;
+
+	/* bh off too, so that the crypto code does not try to yield */
+	local_bh_disable();
+	local_irq_disable();
+
+	for (i = 0; i < SPEED_WARMUP && !ret; i++)
+		ret = speed_op(tfm, enc, sg, blen, result);
+
+	for (i = 0; i < SPEED_RUNS && !ret; i++) {
+		start = get_cycles();
+		ret = speed_op(tfm, enc, sg, blen, result);
+		cycles += get_cycles() - start;
+	}
+
+	local_irq_enable();
+	local_bh_enable();
+
+	if (ret)
+		return ret;
+
+	per_byte = (cycles * 10 + SPEED_RUNS * blen / 2) / (SPEED_RUNS * blen);
+	printk("%lu cycles/operation, %lu.%lu cycles/byte\n",
+	       (cycles + SPEED_RUNS / 2) / SPEED_RUNS,
+	       per_byte / 10, per_byte % 10);
+	return 0;
+}
+
+static int speed_block(struct crypto_tfm *tfm, int enc, unsigned int blen)
+{
+	struct scatterlist sg[1];
+
+	sg[0].page = virt_to_page(xbuf);
+	sg[0].offset = offset_in_page(xbuf);
+	sg[0].length = blen;
+
+	if (cycles)
+		return speed_cycles(tfm, enc, sg, blen);
+	return speed_jiffies(tfm, enc, sg, blen);
+}
+
+/*
+ * 128, 192 and 256 bit keys as far as the cipher takes them, else its
+ * smallest key.  Zero terminated.
+ */
+static void speed_keysizes(struct crypto_tfm *tfm, unsigned int *keysizes)
+{
+	unsigned int min = crypto_tfm_alg_min_keysize(tfm);
+	unsigned int max = crypto_tfm_alg_max_keysize(tfm);
+	unsigned int k, n = 0;
+
+	for (k = 16; k <= 32; k += 8)
+		if (k >= min && k <= max)
+			keysizes[n++] = k;
+	if (!n)
+		keysizes[n++] = min;
+	keysizes[n] = 0;
+}
+
+static void
+test_cipher_speed(char *algo, int mode, int enc, unsigned int *keysizes)
+{
+	struct crypto_tfm *tfm;
+	unsigned int *k, *b, i, sizes[4];
+	char key[32];
+	u8 iv[32];
+	int ret;
+
+	printk("\ntesting speed of %s %s %s\n", algo,
+	       mode == MODE_ECB ? "ecb" : "cbc", enc ? "encryption" :
+	       "decryption");
+
+	tfm = crypto_alloc_tfm(algo, mode == MODE_ECB ? 
+	                       CRYPTO_TFM_MODE_ECB : CRYPTO_TFM_MODE_CBC);
+	if (tfm == NULL) {
+		printk("failed to load transform for %s\n", algo);
+		return;
+	}
+	printk("using %s\n", crypto_tfm_alg_driver_name(tfm));
+
+	if (!keysizes) {
+		speed_keysizes(tfm, sizes);
+		keysizes = sizes;
+	}
+
+	memset(key, 0x42, sizeof(key));
+	memset(iv, 0xff, sizeof(iv));
+	memset(xbuf, 0, XBUFSIZE);
+
+	for (k = keysizes, i = 0; *k; k++) {
+		ret = crypto_cipher_setkey(tfm, key, *k);
+		if (ret) {
+			printk("setkey() failed flags=%x\n", tfm->crt_flags);
+			goto out;
+		}
+		if (mode != MODE_ECB)
+			crypto_cipher_set_iv(tfm, iv,
+			                     crypto_tfm_alg_ivsize(tfm));
+
+		for (b = speed_blocks; *b; b++, i++) {
+			if (*b % crypto_tfm_alg_blocksize(tfm))
+				continue;
+
+			printk("test %u (%u bit key, %u byte blocks): ", i,
+			       *k * 8, *b);
+
+			if (speed_block(tfm, enc, *b)) {
+				printk("failed, flags=%x\n", tfm->crt_flags);
+				goto out;
+			}
+		}
+	}
+out:
+	crypto_free_tfm(tfm);
+}
+
+static void
+test_hash_speed(char *algo)
+{
+	struct crypto_tfm *tfm;
+	unsigned int *b, i;
+
+	printk("\ntesting speed of %s\n", algo);
+
+	tfm = crypto_alloc_tfm(algo, 0);
+	if (tfm == NULL) {
+		printk("failed to load transform for %s\n", algo);
+		return;
+	}
+	printk("using %s\n", crypto_tfm_alg_driver_name(tfm));
+
+	memset(xbuf, 0, XBUFSIZE);
+
+	for (b = speed_blocks, i = 0; *b; b++, i++) {
+		printk("test %u (%u byte blocks): ", i, *b);
+		speed_block(tfm, 0, *b);
+	}
+
+	crypto_free_tfm(tfm);
+}
+
+/*
+ * Everything about one algorithm: both directions in ECB, and in CBC
+ * for block ciphers, or the digest.
+ */
+static void
+test_speed(char *algo)
+{
+	struct crypto_tfm *tfm;
+	u32 type;
+	int block;
+
+	tfm = crypto_alloc_tfm(algo, 0);
+	if (tfm == NULL) {
+		printk("failed to load transform for %s\n", algo);
+		return;
+	}
+	type = crypto_tfm_alg_type(tfm);
+	block = crypto_tfm_alg_blocksize(tfm) > 1;
+	crypto_free_tfm(tfm);
+
+	switch (type) {
+	case CRYPTO_ALG_TYPE_CIPHER:
+		test_cipher_speed(algo, MODE_ECB, ENCRYPT, NULL);
+		test_cipher_speed(algo, MODE_ECB, DECRYPT, NULL);
+		if (block) {
+			test_cipher_speed(algo, MODE_CBC, ENCRYPT, NULL);
+			test_cipher_speed(algo, MODE_CBC, DECRYPT, NULL);
+		}
+		break;
+
+	case CRYPTO_ALG_TYPE_DIGEST:
+		test_hash_speed(algo);
+		break;
+
+	default:
+		printk("\nno speed test for %s\n", algo);
+		break;
+	}
+}
+
+/* alg= or every algorithm tcrypt knows of which is there */
+static void
+test_speed_all(void)
+{
+	char **name;
+
+	if (alg) {
+		test_speed(alg);
+		return;
+	}
+
+	for (name = check; *name; name++)
+		if (crypto_alg_available(*name, 0))
+			test_speed(*name);
+}
+
+static unsigned int aes_speed_keys[] = { 16, 24, 32, 0 };
+
 static void
 test_available(void)
 {
@@ -863,6 +1118,29 @@ do_test(void)
 
 #endif
 
+	case 200:
+		test_cipher_speed(alg ? alg : "aes", MODE_ECB, ENCRYPT, aes_speed_keys);
+		test_cipher_speed(alg ? alg : "aes", MODE_ECB, DECRYPT, aes_speed_keys);
+		test_cipher_speed(alg ? alg : "aes", MODE_CBC, ENCRYPT, aes_speed_keys);
+		test_cipher_speed(alg ? alg : "aes", MODE_CBC, DECRYPT, aes_speed_keys);
+		break;
+
+	case 299:
+		test_speed_all();
+		break;
+
+	case 300:
+		test_hash_speed(alg ? alg : "sha1");
+		break;
+
+	case 301:
+		test_hash_speed(alg ? alg : "sha256");
+		break;
+
+	case 302:
+		test_hash_speed(alg ? alg : "md5");
+		break;
+
 	case 1000:
 		test_available();
 		break;
@@ -904,6 +1182,12 @@ module_init(init);
 module_exit(fini);
 
 module_param(mode, int, 0);
+module_param(sec, uint, 0);
+MODULE_PARM_DESC(sec, "Length in seconds of each speed test (modes 200 and up)");
+module_param(cycles, bool, 0);
+MODULE_PARM_DESC(cycles, "Report cycles per operation instead of operations per second");
+module_param(alg, charp, 0);
+MODULE_PARM_DESC(alg, "Algorithm or driver name for the speed tests");
 
 MODULE_LICENSE("GPL");
 MODULE_DESCRIPTION("Quick & dirty crypto testing module");
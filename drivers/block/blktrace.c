@@ -0,0 +1,348 @@
+/*
+ * drivers/block/blktrace.c
+ *
+ * Block I/O tracing: log every step of the requests of a queue, from
+ * the bio being queued to its completion, into per-CPU trace buffers,
+ * so that user space can tell where the time of each I/O goes: waiting
+ * for a request, in the io scheduler, or in the driver and the disk.
+ *
+ * The probes on the block tracepoints are attached while any queue is
+ * traced, and a queue that is not pays only for a test of q->blk_trace.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <linux/kernel.h>
+#include <linux/sched.h>
+#include <linux/blkdev.h>
+#include <linux/fs.h>
+#include <linux/slab.h>
+#include <linux/init.h>
+#include <linux/debugfs.h>
+#include <linux/tracebuf.h>
+#include <linux/blktrace.h>
+#include <trace/block.h>
+#include <asm/uaccess.h>
+#include <asm/semaphore.h>
+
+enum {
+	BLK_TRACE_SETUP,
+	BLK_TRACE_RUNNING,
+	BLK_TRACE_STOPPED,
+};
+
+struct blk_trace {
+	struct tracebuf	*tb;
+	int		state;
+	u16		act_mask;
+	u32		device;
+};
+
+static DECLARE_MUTEX(blk_trace_sem);	/* setup and teardown */
+static int blk_traces;			/* queues set up */
+static struct dentry *blk_debugfs_root;
+
+static void blk_add_trace(request_queue_t *q, int act, sector_t sector,
+			  int bytes, u32 rw, int error)
+{
+	struct blk_trace *bt = q->blk_trace;
+	struct blk_io_trace *t;
+	unsigned long flags;
+
+	if (!bt || bt->state != BLK_TRACE_RUNNING ||
+	    !(bt->act_mask & BLK_TC_ACT(act)))
+		return;
+
+	t = tracebuf_reserve(bt->tb, act, sizeof(*t), &flags);
+	if (!t)
+		return;
+	t->sector = sector;
+	t->bytes = bytes;
+	t->pid = current->pid;
+	t->device = bt->device;
+	t->rw = rw;
+	t->error = error;
+	t->pad = 0;
+	tracebuf_commit(bt->tb, flags);
+}
+
+static u32 bio_trace_rw(struct bio *bio)
+{
+	return (bio_data_dir(bio) == WRITE ? BLK_TR_WRITE : 0) |
+		(bio_barrier(bio) ? BLK_TR_BARRIER : 0) |
+		(bio_sync(bio) ? BLK_TR_SYNC : 0);
+}
+
+static u32 rq_trace_rw(struct request *rq)
+{
+	return (rq_data_dir(rq) == WRITE ? BLK_TR_WRITE : 0) |
+		((rq->flags & REQ_HARDBARRIER) ? BLK_TR_BARRIER : 0);
+}
+
+static void blk_add_trace_bio(request_queue_t *q, struct bio *bio, int act)
+{
+	blk_add_trace(q, act, bio->bi_sector, bio->bi_size,
+		      bio_trace_rw(bio), 0);
+}
+
+static void blk_add_trace_rq(request_queue_t *q, struct request *rq, int act)
+{
+	/* others, SCSI commands and the like, have no sector */
+	if (blk_fs_request(rq))
+		blk_add_trace(q, act, rq->hard_sector,
+			      rq->hard_nr_sectors << 9, rq_trace_rw(rq), 0);
+	else
+		blk_add_trace(q, act, 0, rq->data_len, rq_trace_rw(rq), 0);
+}
+
+static void probe_bio_queue(request_queue_t *q, struct bio *bio)
+{
+	blk_add_trace_bio(q, bio, BLK_TA_QUEUE);
+}
+
+static void probe_bio_backmerge(request_queue_t *q, struct request *rq,
+				struct bio *bio)
+{
+	blk_add_trace_bio(q, bio, BLK_TA_BACKMERGE);
+}
+
+static void probe_bio_frontmerge(request_queue_t *q, struct request *rq,
+				 struct bio *bio)
+{
+	blk_add_trace_bio(q, bio, BLK_TA_FRONTMERGE);
+}
+
+static void probe_getrq(request_queue_t *q, struct bio *bio)
+{
+	blk_add_trace_bio(q, bio, BLK_TA_GETRQ);
+}
+
+static void probe_sleeprq(request_queue_t *q, struct bio *bio)
+{
+	blk_add_trace_bio(q, bio, BLK_TA_SLEEPRQ);
+}
+
+static void probe_rq_insert(request_queue_t *q, struct request *rq)
+{
+	blk_add_trace_rq(q, rq, BLK_TA_INSERT);
+}
+
+static void probe_rq_issue(request_queue_t *q, struct request *rq)
+{
+	blk_add_trace_rq(q, rq, BLK_TA_ISSUE);
+}
+
+static void probe_rq_requeue(request_queue_t *q, struct request *rq)
+{
+	blk_add_trace_rq(q, rq, BLK_TA_REQUEUE);
+}
+
+static void probe_rq_complete(request_queue_t *q, struct request *rq,
+			      int bytes, int error)
+{
+	if (!q)
+		return;
+	blk_add_trace(q, BLK_TA_COMPLETE,
+		      blk_fs_request(rq) ? rq->hard_sector : 0, bytes,
+		      rq_trace_rw(rq), error);
+}
+
+static void blk_unregister_probes(void)
+{
+	unregister_trace_block_rq_complete(probe_rq_complete);
+	unregister_trace_block_rq_requeue(probe_rq_requeue);
+	unregister_trace_block_rq_issue(probe_rq_issue);
+	unregister_trace_block_rq_insert(probe_rq_insert);
+	unregister_trace_block_sleeprq(probe_sleeprq);
+	unregister_trace_block_getrq(probe_getrq);
+	unregister_trace_block_bio_frontmerge(probe_bio_frontmerge);
+	unregister_trace_block_bio_backmerge(probe_bio_backmerge);
+	unregister_trace_block_bio_queue(probe_bio_queue);
+}
+
+static int blk_register_probes(void)
+{
+	int ret;
+
+	/* what is not registered is skipped by unregister */
+	ret = register_trace_block_bio_queue(probe_bio_queue);
+	if (!ret)
+		ret = register_trace_block_bio_backmerge(probe_bio_backmerge);
+	if (!ret)
+		ret = register_trace_block_bio_frontmerge(probe_bio_frontmerge);
+	if (!ret)
+		ret = register_trace_block_getrq(probe_getrq);
+	if (!ret)
+		ret = register_trace_block_sleeprq(probe_sleeprq);
+	if (!ret)
+		ret = register_trace_block_rq_insert(probe_rq_insert);
+	if (!ret)
+		ret = register_trace_block_rq_issue(probe_rq_issue);
+	if (!ret)
+		ret = register_trace_block_rq_requeue(probe_rq_requeue);
+	if (!ret)
+		ret = register_trace_block_rq_complete(probe_rq_complete);
+	if (ret)
+		blk_unregister_probes();
+	return ret;
+}
+
+static int blk_trace_setup(request_queue_t *q, struct block_device *bdev,
+			   char __user *arg)
+{
+	struct blk_user_trace_setup buts;
+	struct gendisk *disk = bdev->bd_disk;
+	struct blk_trace *bt;
+	int ret;
+
+	if (copy_from_user(&buts, arg, sizeof(buts)))
+		return -EFAULT;
+	if (!buts.buf_size || !buts.buf_nr)
+		return -EINVAL;
+	strlcpy(buts.name, disk->disk_name, sizeof(buts.name));
+
+	down(&blk_trace_sem);
+	ret = -EBUSY;
+	if (q->blk_trace)
+		goto out;
+
+	if (!blk_debugfs_root) {
+		ret = -ENOENT;
+		blk_debugfs_root = debugfs_create_dir("block", NULL);
+		if (!blk_debugfs_root)
+			goto out;
+	}
+
+	ret = -ENOMEM;
+	bt = kmalloc(sizeof(*bt), GFP_KERNEL);
+	if (!bt)
+		goto out;
+	bt->state = BLK_TRACE_SETUP;
+	bt->act_mask = buts.act_mask ? buts.act_mask : BLK_TC_ALL;
+	bt->device = MKDEV(disk->major, disk->first_minor);
+
+	ret = -EINVAL;
+	bt->tb = tracebuf_create(buts.name, blk_debugfs_root,
+				 buts.buf_size, buts.buf_nr, 0);
+	if (!bt->tb)
+		goto out_free;
+
+	if (!blk_traces) {
+		ret = blk_register_probes();
+		if (ret)
+			goto out_destroy;
+	}
+	blk_traces++;
+
+	ret = -EFAULT;
+	if (copy_to_user(arg, &buts, sizeof(buts))) {
+		if (!--blk_traces)
+			blk_unregister_probes();
+		goto out_destroy;
+	}
+
+	smp_wmb();
+	q->blk_trace = bt;
+	up(&blk_trace_sem);
+	return 0;
+
+out_destroy:
+	tracebuf_destroy(bt->tb);
+out_free:
+	kfree(bt);
+out:
+	up(&blk_trace_sem);
+	return ret;
+}
+
+/* blk_trace_sem held */
+static int blk_trace_remove(request_queue_t *q)
+{
+	struct blk_trace *bt = q->blk_trace;
+
+	if (!bt)
+		return -EINVAL;
+
+	q->blk_trace = NULL;
+	/* wait for the probes still looking at bt */
+	synchronize_kernel();
+	if (!--blk_traces)
+		blk_unregister_probes();
+
+	tracebuf_flush(bt->tb);
+	tracebuf_destroy(bt->tb);
+	kfree(bt);
+	return 0;
+}
+
+static int blk_trace_startstop(request_queue_t *q, int start)
+{
+	struct blk_trace *bt = q->blk_trace;
+
+	if (!bt)
+		return -EINVAL;
+
+	if (start) {
+		if (bt->state == BLK_TRACE_RUNNING)
+			return -EINVAL;
+		bt->state = BLK_TRACE_RUNNING;
+	} else {
+		if (bt->state != BLK_TRACE_RUNNING)
+			return -EINVAL;
+		bt->state = BLK_TRACE_STOPPED;
+		/* so that the reader gets everything up to here */
+		tracebuf_flush(bt->tb);
+	}
+	return 0;
+}
+
+/**
+ * blk_trace_ioctl - handle the BLKTRACE* ioctls
+ * @bdev: the device, any partition traces the whole queue
+ * @cmd: the ioctl
+ * @arg: struct blk_user_trace_setup for BLKTRACESETUP
+ */
+int blk_trace_ioctl(struct block_device *bdev, unsigned cmd, char __user *arg)
+{
+	request_queue_t *q = bdev_get_queue(bdev);
+	int ret;
+
+	if (!capable(CAP_SYS_ADMIN))
+		return -EACCES;
+	if (!q)
+		return -ENXIO;
+
+	if (cmd == BLKTRACESETUP)
+		return blk_trace_setup(q, bdev, arg);
+
+	down(&blk_trace_sem);
+	switch (cmd) {
+	case BLKTRACESTART:
+		ret = blk_trace_startstop(q, 1);
+		break;
+	case BLKTRACESTOP:
+		ret = blk_trace_startstop(q, 0);
+		break;
+	case BLKTRACETEARDOWN:
+		ret = blk_trace_remove(q);
+		break;
+	default:
+		ret = -ENOTTY;
+	}
+	up(&blk_trace_sem);
+	return ret;
+}
+
+/* the queue is going away */
+void blk_trace_shutdown(request_queue_t *q)
+{
+	if (!q->blk_trace)
+		return;
+
+	down(&blk_trace_sem);
+	blk_trace_remove(q);
+	up(&blk_trace_sem);
+}
@@ -21,6 +21,7 @@
 #include <linux/hash.h>
 #include <linux/rbtree.h>
 #include <linux/mempool.h>
+#include <linux/ioprio.h>
 
 static unsigned long max_elapsed_crq;
 static unsigned long max_elapsed_dispatch;
@@ -58,6 +59,13 @@ static int cfq_back_penalty = 2;	/* penalty of a backwards seek */
 
 #define RQ_DATA(rq)		(rq)->elevator_private
 
+/*
+ * busy queues are kept on one rr list per io priority class, RT is served
+ * before BE, and IDLE only when the other two are empty
+ */
+#define CFQ_PRIO_LISTS		3
+#define cfq_class_idx(class)	((class) - IOPRIO_CLASS_RT)
+
 /*
  * rb-tree defines
  */
@@ -98,7 +106,7 @@ static kmem_cache_t *cfq_pool;
 static kmem_cache_t *cfq_ioc_pool;
 
 struct cfq_data {
-	struct list_head rr_list;
+	struct list_head rr_list[CFQ_PRIO_LISTS];
 	struct list_head empty_list;
 
 	struct hlist_head *cfq_hash;
@@ -164,6 +172,10 @@ struct cfq_queue {
 
 	int key_type;
 
+	/* io priority class and level of the last task to allocate here */
+	unsigned short ioprio_class;
+	unsigned short ioprio;
+
 	unsigned long service_start;
 	unsigned long service_used;
 
@@ -401,9 +413,25 @@ static void cfq_update_next_crq(struct cfq_rq *crq)
 		cfqq->next_crq = cfq_find_next_crq(cfqq->cfqd, cfqq, crq);
 }
 
+/*
+ * service used scaled by io priority: a queue at level 0 accumulates
+ * service at 1/8 the rate of one at level 7, so it sorts ahead of it for
+ * correspondingly longer and gets a proportionally larger share of the disk
+ */
+static inline unsigned long cfq_weighted_service(struct cfq_queue *cfqq)
+{
+	return cfqq->service_used * IOPRIO_BE_NR / (IOPRIO_BE_NR - cfqq->ioprio);
+}
+
+static inline struct list_head *cfq_rr_list(struct cfq_queue *cfqq)
+{
+	return &cfqq->cfqd->rr_list[cfq_class_idx(cfqq->ioprio_class)];
+}
+
 static int cfq_check_sort_rr_list(struct cfq_queue *cfqq)
 {
-	struct list_head *head = &cfqq->cfqd->rr_list;
+	struct list_head *head = cfq_rr_list(cfqq);
+	unsigned long service = cfq_weighted_service(cfqq);
 	struct list_head *next, *prev;
 
 	/*
@@ -413,7 +441,7 @@ static int cfq_check_sort_rr_list(struct cfq_queue *cfqq)
 	if (next != head) {
 		struct cfq_queue *cnext = list_entry_cfqq(next);
 
-		if (cfqq->service_used > cnext->service_used)
+		if (service > cfq_weighted_service(cnext))
 			return 1;
 	}
 
@@ -421,7 +449,7 @@ static int cfq_check_sort_rr_list(struct cfq_queue *cfqq)
 	if (prev != head) {
 		struct cfq_queue *cprev = list_entry_cfqq(prev);
 
-		if (cfqq->service_used < cprev->service_used)
+		if (service < cfq_weighted_service(cprev))
 			return 1;
 	}
 
@@ -430,7 +458,8 @@ static int cfq_check_sort_rr_list(struct cfq_queue *cfqq)
 
 static void cfq_sort_rr_list(struct cfq_queue *cfqq, int new_queue)
 {
-	struct list_head *entry = &cfqq->cfqd->rr_list;
+	struct list_head *head = cfq_rr_list(cfqq), *entry = head;
+	unsigned long service;
 
 	if (!cfqq->on_rr)
 		return;
@@ -440,21 +469,25 @@ static void cfq_sort_rr_list(struct cfq_queue *cfqq, int new_queue)
 	list_del(&cfqq->cfq_list);
 
 	/*
-	 * sort by our mean service_used, sub-sort by in-flight requests
+	 * sort by our weighted mean service_used, sub-sort by in-flight
+	 * requests
 	 */
-	while ((entry = entry->prev) != &cfqq->cfqd->rr_list) {
+	service = cfq_weighted_service(cfqq);
+	while ((entry = entry->prev) != head) {
 		struct cfq_queue *__cfqq = list_entry_cfqq(entry);
+		unsigned long __service = cfq_weighted_service(__cfqq);
 
-		if (cfqq->service_used > __cfqq->service_used)
+		if (service > __service)
 			break;
-		else if (cfqq->service_used == __cfqq->service_used) {
+		else if (service == __service) {
 			struct list_head *prv;
 
-			while ((prv = entry->prev) != &cfqq->cfqd->rr_list) {
+			while ((prv = entry->prev) != head) {
 				__cfqq = list_entry_cfqq(prv);
+				__service = cfq_weighted_service(__cfqq);
 
-				WARN_ON(__cfqq->service_used > cfqq->service_used);
-				if (cfqq->service_used != __cfqq->service_used)
+				WARN_ON(__service > service);
+				if (service != __service)
 					break;
 				if (cfqq->in_flight > __cfqq->in_flight)
 					break;
@@ -821,21 +854,19 @@ cfq_dispatch_request(request_queue_t *q, struct cfq_data *cfqd,
 	cfq_dispatch_sort(q, crq);
 }
 
-static int cfq_dispatch_requests(request_queue_t *q, int max_dispatch)
+static int
+__cfq_dispatch_requests(request_queue_t *q, struct cfq_data *cfqd,
+			struct list_head *rr_list, int max_dispatch)
 {
-	struct cfq_data *cfqd = q->elevator->elevator_data;
 	struct cfq_queue *cfqq;
 	struct list_head *entry, *tmp;
 	int queued, busy_queues, first_round;
 
-	if (list_empty(&cfqd->rr_list))
-		return 0;
-
 	queued = 0;
 	first_round = 1;
 restart:
 	busy_queues = 0;
-	list_for_each_safe(entry, tmp, &cfqd->rr_list) {
+	list_for_each_safe(entry, tmp, rr_list) {
 		cfqq = list_entry_cfqq(entry);
 
 		BUG_ON(RB_EMPTY(&cfqq->sort_list));
@@ -863,6 +894,31 @@ restart:
 	return queued;
 }
 
+/*
+ * serve the highest priority class that has io pending. the idle class is
+ * only served once the other classes are empty and the drive has gone quiet,
+ * so it never competes with anyone else for disk time
+ */
+static int cfq_dispatch_requests(request_queue_t *q, int max_dispatch)
+{
+	struct cfq_data *cfqd = q->elevator->elevator_data;
+	struct list_head *rr_list;
+
+	rr_list = &cfqd->rr_list[cfq_class_idx(IOPRIO_CLASS_RT)];
+	if (!list_empty(rr_list))
+		return __cfq_dispatch_requests(q, cfqd, rr_list, max_dispatch);
+
+	rr_list = &cfqd->rr_list[cfq_class_idx(IOPRIO_CLASS_BE)];
+	if (!list_empty(rr_list))
+		return __cfq_dispatch_requests(q, cfqd, rr_list, max_dispatch);
+
+	rr_list = &cfqd->rr_list[cfq_class_idx(IOPRIO_CLASS_IDLE)];
+	if (!list_empty(rr_list) && !cfqd->rq_in_driver)
+		return __cfq_dispatch_requests(q, cfqd, rr_list, 1);
+
+	return 0;
+}
+
 static inline void cfq_account_dispatch(struct cfq_rq *crq)
 {
 	struct cfq_queue *cfqq = crq->cfq_queue;
@@ -1225,6 +1281,8 @@ retry:
 		atomic_inc(&cfqd->ref);
 		cfqq->key_type = cfqd->key_type;
 		cfqq->service_start = ~0UL;
+		cfqq->ioprio_class = IOPRIO_CLASS_BE;
+		cfqq->ioprio = IOPRIO_NORM;
 	}
 
 	if (new_cfqq)
@@ -1284,7 +1342,16 @@ static int cfq_queue_empty(request_queue_t *q)
 {
 	struct cfq_data *cfqd = q->elevator->elevator_data;
 
-	return list_empty(&q->queue_head) && list_empty(&cfqd->rr_list);
+	int i;
+
+	if (!list_empty(&q->queue_head))
+		return 0;
+
+	for (i = 0; i < CFQ_PRIO_LISTS; i++)
+		if (!list_empty(&cfqd->rr_list[i]))
+			return 0;
+
+	return 1;
 }
 
 static void cfq_completed_request(request_queue_t *q, struct request *rq)
@@ -1405,6 +1472,27 @@ static void cfq_put_request(request_queue_t *q, struct request *rq)
 	}
 }
 
+/*
+ * pick up the io priority of the task allocating a request. if the class
+ * changed while the queue is busy, move it over to the new rr list.
+ * must be called with the queue lock held
+ */
+static void cfq_update_ioprio(struct cfq_queue *cfqq, struct task_struct *tsk)
+{
+	const int ioprio_class = task_ioprio_class(tsk);
+	const int ioprio = task_ioprio(tsk);
+
+	if (cfqq->ioprio_class == ioprio_class && cfqq->ioprio == ioprio)
+		return;
+
+	cfqq->ioprio_class = ioprio_class;
+	cfqq->ioprio = ioprio;
+	if (cfqq->ioprio >= IOPRIO_BE_NR)
+		cfqq->ioprio = IOPRIO_BE_NR - 1;
+
+	cfq_sort_rr_list(cfqq, 1);
+}
+
 /*
  * Allocate cfq data structures associated with this request. A queue and
  */
@@ -1426,6 +1514,8 @@ static int cfq_set_request(request_queue_t *q, struct request *rq, int gfp_mask)
 		goto out_lock;
 
 repeat:
+	cfq_update_ioprio(cfqq, current);
+
 	if (cfqq->allocated[rw] >= cfqd->max_queued)
 		goto out_lock;
 
@@ -1505,7 +1595,8 @@ static int cfq_init_queue(request_queue_t *q, elevator_t *e)
 		return -ENOMEM;
 
 	memset(cfqd, 0, sizeof(*cfqd));
-	INIT_LIST_HEAD(&cfqd->rr_list);
+	for (i = 0; i < CFQ_PRIO_LISTS; i++)
+		INIT_LIST_HEAD(&cfqd->rr_list[i]);
 	INIT_LIST_HEAD(&cfqd->empty_list);
 
 	cfqd->crq_hash = kmalloc(sizeof(struct hlist_head) * CFQ_MHASH_ENTRIES, GFP_KERNEL);
@@ -34,6 +34,7 @@
 #include <linux/slab.h>
 #include <linux/init.h>
 #include <linux/compiler.h>
+#include <trace/block.h>
 
 #include <asm/uaccess.h>
 
@@ -280,6 +281,7 @@ void elv_deactivate_request(request_queue_t *q, struct request *rq)
 
 void elv_requeue_request(request_queue_t *q, struct request *rq)
 {
+	trace_block_rq_requeue(q, rq);
 	elv_deactivate_request(q, rq);
 
 	/*
@@ -314,6 +316,7 @@ void __elv_add_request(request_queue_t *q, struct request *rq, int where,
 		blk_plug_device(q);
 
 	rq->q = q;
+	trace_block_rq_insert(q, rq);
 
 	if (!test_bit(QUEUE_FLAG_DRAIN, &q->queue_flags)) {
 		q->elevator->ops->elevator_add_req_fn(q, rq, where);
@@ -322,8 +325,10 @@ void __elv_add_request(request_queue_t *q, struct request *rq, int where,
 			int nrq = q->rq.count[READ] + q->rq.count[WRITE]
 				  - q->in_flight;
 
-			if (nrq == q->unplug_thresh)
+			if (nrq >= q->unplug_thresh) {
+				q->plug_stats.thresh_unplugs++;
 				__generic_unplug_device(q);
+			}
 		}
 	} else
 		/*
@@ -374,7 +379,10 @@ struct request *elv_next_request(request_queue_t *q)
 		 * that has been delayed should not be passed by new incoming
 		 * requests
 		 */
-		rq->flags |= REQ_STARTED;
+		if (!(rq->flags & REQ_STARTED)) {
+			trace_block_rq_issue(q, rq);
+			rq->flags |= REQ_STARTED;
+		}
 
 		if (rq == q->last_merge)
 			q->last_merge = NULL;
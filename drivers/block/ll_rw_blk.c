@@ -28,14 +28,18 @@
 #include <linux/slab.h>
 #include <linux/swap.h>
 #include <linux/writeback.h>
+#include <linux/interrupt.h>
 
 /*
  * for max sense size
  */
 #include <scsi/scsi_cmnd.h>
+#include <linux/blktrace.h>
+#include <trace/block.h>
 
 static void blk_unplug_work(void *data);
 static void blk_unplug_timeout(unsigned long data);
+static void blk_queue_free_staging(request_queue_t *q);
 
 /*
  * For the allocated request tables
@@ -67,6 +71,16 @@ unsigned long blk_max_low_pfn, blk_max_pfn;
 EXPORT_SYMBOL(blk_max_low_pfn);
 EXPORT_SYMBOL(blk_max_pfn);
 
+DEFINE_TRACE(block_bio_queue);
+DEFINE_TRACE(block_bio_backmerge);
+DEFINE_TRACE(block_bio_frontmerge);
+DEFINE_TRACE(block_getrq);
+DEFINE_TRACE(block_sleeprq);
+DEFINE_TRACE(block_rq_insert);
+DEFINE_TRACE(block_rq_issue);
+DEFINE_TRACE(block_rq_requeue);
+DEFINE_TRACE(block_rq_complete);
+
 /* Amount of time in which a process may batch requests */
 #define BLK_BATCH_TIME	(HZ/50UL)
 
@@ -1422,8 +1436,10 @@ void blk_plug_device(request_queue_t *q)
 	if (test_bit(QUEUE_FLAG_STOPPED, &q->queue_flags))
 		return;
 
-	if (!test_and_set_bit(QUEUE_FLAG_PLUGGED, &q->queue_flags))
+	if (!test_and_set_bit(QUEUE_FLAG_PLUGGED, &q->queue_flags)) {
 		mod_timer(&q->unplug_timer, jiffies + q->unplug_delay);
+		q->plug_stats.plugs++;
+	}
 }
 
 EXPORT_SYMBOL(blk_plug_device);
@@ -1440,6 +1456,7 @@ int blk_remove_plug(request_queue_t *q)
 		return 0;
 
 	del_timer(&q->unplug_timer);
+	q->plug_stats.unplugs++;
 	return 1;
 }
 
@@ -1488,6 +1505,8 @@ static void blk_backing_dev_unplug(struct backing_dev_info *bdi,
 {
 	request_queue_t *q = bdi->unplug_io_data;
 
+	blk_flush_staging(q);
+
 	/*
 	 * devices don't necessarily have an ->unplug_fn defined
 	 */
@@ -1499,6 +1518,7 @@ static void blk_unplug_work(void *data)
 {
 	request_queue_t *q = data;
 
+	blk_flush_staging(q);
 	q->unplug_fn(q);
 }
 
@@ -1506,9 +1526,42 @@ static void blk_unplug_timeout(unsigned long data)
 {
 	request_queue_t *q = (request_queue_t *)data;
 
+	q->plug_stats.timer_unplugs++;
 	kblockd_schedule_work(&q->unplug_work);
 }
 
+#define BLK_ADAPT_WINDOW	64	/* new requests between retunes */
+#define BLK_UNPLUG_THRESH_MAX	32
+
+/*
+ * Adaptive unplugging.  Holding the plug is only worth its delay if
+ * bios actually get merged while the queue is plugged, and if the
+ * delay is small compared to what the device needs to complete a
+ * request anyway.  So walk unplug_thresh down on fast devices or
+ * unmergeable streams, and up when most bios end up being merged.
+ *
+ * Called with the queue lock held.
+ */
+static void blk_adapt_unplug_thresh(request_queue_t *q)
+{
+	struct blk_plug_stats *ps = &q->plug_stats;
+	unsigned long merges = ps->merges - q->adapt_merges;
+	unsigned long requests = ps->requests - q->adapt_requests;
+	int max = min_t(int, BLK_UNPLUG_THRESH_MAX, q->nr_requests / 4);
+
+	if (requests < BLK_ADAPT_WINDOW)
+		return;
+
+	q->adapt_merges = ps->merges;
+	q->adapt_requests = ps->requests;
+
+	if (merges * 8 < requests || (q->avg_latency >> 3) < q->unplug_delay) {
+		if (q->unplug_thresh > 1)
+			q->unplug_thresh--;
+	} else if (merges * 2 > requests && q->unplug_thresh < max)
+		q->unplug_thresh++;
+}
+
 /**
  * blk_start_queue - restart a previously stopped queue
  * @q:    The &request_queue_t in question
@@ -1575,6 +1628,8 @@ EXPORT_SYMBOL(blk_stop_queue);
 void blk_sync_queue(struct request_queue *q)
 {
 	del_timer_sync(&q->unplug_timer);
+	if (q->staging)
+		del_timer_sync(&q->staging_timer);
 	kblockd_flush();
 }
 EXPORT_SYMBOL(blk_sync_queue);
@@ -1616,6 +1671,10 @@ void blk_cleanup_queue(request_queue_t * q)
 	if (!atomic_dec_and_test(&q->refcnt))
 		return;
 
+	blk_trace_shutdown(q);
+	blk_flush_staging(q);
+	blk_queue_free_staging(q);
+
 	if (q->elevator)
 		elevator_exit(q->elevator);
 
@@ -2556,7 +2615,11 @@ void __blk_attempt_remerge(request_queue_t *q, struct request *rq)
 
 EXPORT_SYMBOL(__blk_attempt_remerge);
 
-static int __make_request(request_queue_t *q, struct bio *bio)
+/*
+ * Queue @bio on @q.  Called with the queue lock held and returns with
+ * it held, but may drop it to allocate a request.
+ */
+static void __make_request_locked(request_queue_t *q, struct bio *bio)
 {
 	struct request *req, *freereq = NULL;
 	int el_ret, rw, nr_sectors, cur_nr_sectors, barrier, err;
@@ -2567,25 +2630,9 @@ static int __make_request(request_queue_t *q, struct bio *bio)
 	cur_nr_sectors = bio_cur_sectors(bio);
 
 	rw = bio_data_dir(bio);
-
-	/*
-	 * low level driver can indicate that it wants pages above a
-	 * certain limit bounced to low memory (ie for highmem, or even
-	 * ISA dma in theory)
-	 */
-	blk_queue_bounce(q, &bio);
-
-	spin_lock_prefetch(q->queue_lock);
-
 	barrier = bio_barrier(bio);
-	if (barrier && (q->ordered == QUEUE_ORDERED_NONE)) {
-		err = -EOPNOTSUPP;
-		goto end_io;
-	}
 
 again:
-	spin_lock_irq(q->queue_lock);
-
 	if (elv_queue_empty(q)) {
 		blk_plug_device(q);
 		goto get_rq;
@@ -2601,10 +2648,12 @@ again:
 			if (!q->back_merge_fn(q, req, bio))
 				break;
 
+			trace_block_bio_backmerge(q, req, bio);
 			req->biotail->bi_next = bio;
 			req->biotail = bio;
 			req->nr_sectors = req->hard_nr_sectors += nr_sectors;
 			drive_stat_acct(req, nr_sectors, 0);
+			q->plug_stats.merges++;
 			if (!attempt_back_merge(q, req))
 				elv_merged_request(q, req);
 			goto out;
@@ -2615,6 +2664,7 @@ again:
 			if (!q->front_merge_fn(q, req, bio))
 				break;
 
+			trace_block_bio_frontmerge(q, req, bio);
 			bio->bi_next = req->bio;
 			req->bio = bio;
 
@@ -2629,6 +2679,7 @@ again:
 			req->sector = req->hard_sector = sector;
 			req->nr_sectors = req->hard_nr_sectors += nr_sectors;
 			drive_stat_acct(req, nr_sectors, 0);
+			q->plug_stats.merges++;
 			if (!attempt_front_merge(q, req))
 				elv_merged_request(q, req);
 			goto out;
@@ -2663,11 +2714,14 @@ get_rq:
 			if (bio_rw_ahead(bio))
 				goto end_io;
 	
+			trace_block_sleeprq(q, bio);
 			freereq = get_request_wait(q, rw);
 		}
+		spin_lock_irq(q->queue_lock);
 		goto again;
 	}
 
+	trace_block_getrq(q, bio);
 	req->flags |= REQ_CMD;
 
 	/*
@@ -2694,18 +2748,200 @@ get_rq:
 	req->rq_disk = bio->bi_bdev->bd_disk;
 	req->start_time = jiffies;
 
+	q->plug_stats.requests++;
+	if (q->unplug_adaptive)
+		blk_adapt_unplug_thresh(q);
+
 	add_request(q, req);
 out:
 	if (freereq)
 		__blk_put_request(q, freereq);
 	if (bio_sync(bio))
 		__generic_unplug_device(q);
+	return;
+
+end_io:
+	bio_endio(bio, nr_sectors << 9, err);
+	spin_lock_irq(q->queue_lock);
+}
+
+/*
+ * Per-CPU staging.  Taking queue_lock for every bio is what limits
+ * submission on big SMP boxes driving fast arrays, so a queue with
+ * QUEUE_FLAG_STAGING collects bios on a sector-sorted list on the
+ * submitting CPU and feeds them to the elevator BLK_STAGING_BATCH at a
+ * time under a single queue_lock hold.  Staged bios are flushed when
+ * the batch is full, for sync bios and barriers, whenever the queue is
+ * unplugged, and at the latest after unplug_delay by staging_timer.
+ */
+#define BLK_STAGING_BATCH	16
+
+static void blk_submit_staged(request_queue_t *q, struct bio *list)
+{
+	spin_lock_irq(q->queue_lock);
+	while (list) {
+		struct bio *bio = list;
 
+		list = bio->bi_next;
+		bio->bi_next = NULL;
+		__make_request_locked(q, bio);
+	}
 	spin_unlock_irq(q->queue_lock);
+}
+
+static struct bio *blk_staging_detach(struct blk_staging *bs)
+{
+	struct bio *list;
+
+	spin_lock_irq(&bs->lock);
+	list = bs->head;
+	bs->head = NULL;
+	bs->count = 0;
+	spin_unlock_irq(&bs->lock);
+	return list;
+}
+
+/**
+ * blk_flush_staging - submit all staged bios of a queue
+ * @q:	the queue
+ *
+ * May sleep waiting for free requests.
+ */
+void blk_flush_staging(request_queue_t *q)
+{
+	int cpu;
+
+	if (!q->staging)
+		return;
+
+	for_each_cpu(cpu) {
+		struct blk_staging *bs = per_cpu_ptr(q->staging, cpu);
+		struct bio *list;
+
+		if (!bs->head)
+			continue;
+		list = blk_staging_detach(bs);
+		if (list)
+			blk_submit_staged(q, list);
+	}
+}
+EXPORT_SYMBOL(blk_flush_staging);
+
+static void blk_stage_bio(request_queue_t *q, struct bio *bio)
+{
+	struct blk_staging *bs;
+	struct bio **p, *list = NULL;
+
+	bs = per_cpu_ptr(q->staging, get_cpu());
+	spin_lock_irq(&bs->lock);
+
+	/* sorted by start sector, equal sectors in submission order */
+	for (p = &bs->head; *p; p = &(*p)->bi_next)
+		if ((*p)->bi_sector > bio->bi_sector)
+			break;
+	bio->bi_next = *p;
+	*p = bio;
+
+	if (++bs->count >= BLK_STAGING_BATCH || bio_sync(bio)) {
+		list = bs->head;
+		bs->head = NULL;
+		bs->count = 0;
+	}
+	spin_unlock_irq(&bs->lock);
+	put_cpu();
+
+	if (list)
+		blk_submit_staged(q, list);
+	else if (!timer_pending(&q->staging_timer))
+		mod_timer(&q->staging_timer, jiffies + q->unplug_delay);
+}
+
+static void blk_staging_work(void *data)
+{
+	blk_flush_staging(data);
+}
+
+static void blk_staging_timeout(unsigned long data)
+{
+	request_queue_t *q = (request_queue_t *)data;
+
+	kblockd_schedule_work(&q->staging_work);
+}
+
+/**
+ * blk_queue_enable_staging - stage bios on per-CPU lists
+ * @q:	the queue, which must use the default __make_request
+ *
+ * Meant for fast devices where queue_lock contention on submission
+ * dominates; see the comment above BLK_STAGING_BATCH.
+ */
+int blk_queue_enable_staging(request_queue_t *q)
+{
+	if (!q->staging) {
+		struct blk_staging *staging;
+		int cpu;
+
+		staging = alloc_percpu(struct blk_staging);
+		if (!staging)
+			return -ENOMEM;
+		for_each_cpu(cpu)
+			spin_lock_init(&per_cpu_ptr(staging, cpu)->lock);
+
+		init_timer(&q->staging_timer);
+		q->staging_timer.function = blk_staging_timeout;
+		q->staging_timer.data = (unsigned long)q;
+		INIT_WORK(&q->staging_work, blk_staging_work, q);
+
+		smp_wmb();
+		q->staging = staging;
+	}
+	set_bit(QUEUE_FLAG_STAGING, &q->queue_flags);
 	return 0;
+}
+EXPORT_SYMBOL(blk_queue_enable_staging);
 
-end_io:
-	bio_endio(bio, nr_sectors << 9, err);
+static void blk_queue_free_staging(request_queue_t *q)
+{
+	if (!q->staging)
+		return;
+
+	clear_bit(QUEUE_FLAG_STAGING, &q->queue_flags);
+	del_timer_sync(&q->staging_timer);
+	kblockd_flush();
+	free_percpu(q->staging);
+	q->staging = NULL;
+}
+
+static int __make_request(request_queue_t *q, struct bio *bio)
+{
+	int nr_sectors = bio_sectors(bio);
+
+	/*
+	 * low level driver can indicate that it wants pages above a
+	 * certain limit bounced to low memory (ie for highmem, or even
+	 * ISA dma in theory)
+	 */
+	blk_queue_bounce(q, &bio);
+
+	trace_block_bio_queue(q, bio);
+
+	spin_lock_prefetch(q->queue_lock);
+
+	if (bio_barrier(bio)) {
+		if (q->ordered == QUEUE_ORDERED_NONE) {
+			bio_endio(bio, nr_sectors << 9, -EOPNOTSUPP);
+			return 0;
+		}
+		/* everything staged so far must go in front of the barrier */
+		blk_flush_staging(q);
+	} else if (blk_queue_staging(q) && !in_interrupt()) {
+		blk_stage_bio(q, bio);
+		return 0;
+	}
+
+	spin_lock_irq(q->queue_lock);
+	__make_request_locked(q, bio);
+	spin_unlock_irq(q->queue_lock);
 	return 0;
 }
 
@@ -3056,6 +3292,8 @@ static int __end_that_request_first(struct request *req, int uptodate,
 	if (!blk_pc_request(req))
 		req->errors = 0;
 
+	trace_block_rq_complete(req->q, req, nr_bytes, error);
+
 	if (!uptodate) {
 		if (blk_fs_request(req) && !(req->flags & REQ_QUIET))
 			printk("end_request: I/O error, dev %s, sector %llu\n",
@@ -3191,6 +3429,12 @@ void end_that_request_last(struct request *req)
 
 	if (disk && blk_fs_request(req)) {
 		unsigned long duration = jiffies - req->start_time;
+		request_queue_t *q = req->q;
+
+		/* running average, scaled by 8, for adaptive unplugging */
+		if (q)
+			q->avg_latency += duration - (q->avg_latency >> 3);
+
 		switch (rq_data_dir(req)) {
 		    case WRITE:
 			__disk_stat_inc(disk, writes);
@@ -3523,6 +3767,120 @@ static ssize_t queue_max_hw_sectors_show(struct request_queue *q, char *page)
 }
 
 
+/*
+ * plugs unplugs timer_unplugs thresh_unplugs kick_unplugs merges requests
+ */
+static ssize_t queue_plug_stats_show(struct request_queue *q, char *page)
+{
+	struct blk_plug_stats ps;
+	unsigned long kicks;
+
+	spin_lock_irq(q->queue_lock);
+	ps = q->plug_stats;
+	spin_unlock_irq(q->queue_lock);
+
+	/* whatever was not the timer or the threshold was an explicit kick */
+	kicks = ps.unplugs - ps.timer_unplugs - ps.thresh_unplugs;
+	if ((long)kicks < 0)
+		kicks = 0;
+
+	return sprintf(page, "%lu %lu %lu %lu %lu %lu %lu\n",
+		       ps.plugs, ps.unplugs, ps.timer_unplugs,
+		       ps.thresh_unplugs, kicks, ps.merges, ps.requests);
+}
+
+static ssize_t queue_unplug_thresh_show(struct request_queue *q, char *page)
+{
+	return queue_var_show(q->unplug_thresh, (page));
+}
+
+static ssize_t
+queue_unplug_thresh_store(struct request_queue *q, const char *page,
+			  size_t count)
+{
+	unsigned long thresh;
+	ssize_t ret = queue_var_store(&thresh, page, count);
+
+	if (thresh < 1 || thresh > q->nr_requests)
+		return -EINVAL;
+
+	spin_lock_irq(q->queue_lock);
+	q->unplug_thresh = thresh;
+	spin_unlock_irq(q->queue_lock);
+
+	return ret;
+}
+
+static ssize_t queue_unplug_delay_show(struct request_queue *q, char *page)
+{
+	return queue_var_show(jiffies_to_msecs(q->unplug_delay), (page));
+}
+
+static ssize_t
+queue_unplug_delay_store(struct request_queue *q, const char *page,
+			 size_t count)
+{
+	unsigned long msecs, delay;
+	ssize_t ret = queue_var_store(&msecs, page, count);
+
+	delay = msecs_to_jiffies(msecs);
+	if (delay == 0)
+		delay = 1;
+
+	spin_lock_irq(q->queue_lock);
+	q->unplug_delay = delay;
+	spin_unlock_irq(q->queue_lock);
+
+	return ret;
+}
+
+static ssize_t queue_unplug_adaptive_show(struct request_queue *q, char *page)
+{
+	return queue_var_show(q->unplug_adaptive, (page));
+}
+
+static ssize_t
+queue_unplug_adaptive_store(struct request_queue *q, const char *page,
+			    size_t count)
+{
+	unsigned long adaptive;
+	ssize_t ret = queue_var_store(&adaptive, page, count);
+
+	spin_lock_irq(q->queue_lock);
+	q->unplug_adaptive = adaptive != 0;
+	q->adapt_merges = q->plug_stats.merges;
+	q->adapt_requests = q->plug_stats.requests;
+	spin_unlock_irq(q->queue_lock);
+
+	return ret;
+}
+
+static ssize_t queue_staging_show(struct request_queue *q, char *page)
+{
+	return queue_var_show(blk_queue_staging(q), (page));
+}
+
+static ssize_t
+queue_staging_store(struct request_queue *q, const char *page, size_t count)
+{
+	unsigned long staging;
+	ssize_t ret = queue_var_store(&staging, page, count);
+
+	if (q->make_request_fn != __make_request)
+		return -EINVAL;
+
+	if (staging) {
+		int err = blk_queue_enable_staging(q);
+		if (err)
+			return err;
+	} else if (blk_queue_staging(q)) {
+		/* the lists stay allocated until blk_cleanup_queue() */
+		clear_bit(QUEUE_FLAG_STAGING, &q->queue_flags);
+		blk_flush_staging(q);
+	}
+	return ret;
+}
+
 static struct queue_sysfs_entry queue_requests_entry = {
 	.attr = {.name = "nr_requests", .mode = S_IRUGO | S_IWUSR },
 	.show = queue_requests_show,
@@ -3546,6 +3904,35 @@ static struct queue_sysfs_entry queue_max_hw_sectors_entry = {
 	.show = queue_max_hw_sectors_show,
 };
 
+static struct queue_sysfs_entry queue_plug_stats_entry = {
+	.attr = {.name = "plug_stats", .mode = S_IRUGO },
+	.show = queue_plug_stats_show,
+};
+
+static struct queue_sysfs_entry queue_unplug_thresh_entry = {
+	.attr = {.name = "unplug_thresh", .mode = S_IRUGO | S_IWUSR },
+	.show = queue_unplug_thresh_show,
+	.store = queue_unplug_thresh_store,
+};
+
+static struct queue_sysfs_entry queue_unplug_delay_entry = {
+	.attr = {.name = "unplug_delay_ms", .mode = S_IRUGO | S_IWUSR },
+	.show = queue_unplug_delay_show,
+	.store = queue_unplug_delay_store,
+};
+
+static struct queue_sysfs_entry queue_unplug_adaptive_entry = {
+	.attr = {.name = "unplug_adaptive", .mode = S_IRUGO | S_IWUSR },
+	.show = queue_unplug_adaptive_show,
+	.store = queue_unplug_adaptive_store,
+};
+
+static struct queue_sysfs_entry queue_staging_entry = {
+	.attr = {.name = "staging", .mode = S_IRUGO | S_IWUSR },
+	.show = queue_staging_show,
+	.store = queue_staging_store,
+};
+
 static struct queue_sysfs_entry queue_iosched_entry = {
 	.attr = {.name = "scheduler", .mode = S_IRUGO | S_IWUSR },
 	.show = elv_iosched_show,
@@ -3557,6 +3944,11 @@ static struct attribute *default_attrs[] = {
 	&queue_ra_entry.attr,
 	&queue_max_hw_sectors_entry.attr,
 	&queue_max_sectors_entry.attr,
+	&queue_plug_stats_entry.attr,
+	&queue_unplug_thresh_entry.attr,
+	&queue_unplug_delay_entry.attr,
+	&queue_unplug_adaptive_entry.attr,
+	&queue_staging_entry.attr,
 	&queue_iosched_entry.attr,
 	NULL,
 };
@@ -3626,6 +4018,9 @@ int blk_register_queue(struct gendisk *disk)
 		return ret;
 	}
 
+	/* without a flusher thread, pdflush writes the queue back as before */
+	bdi_register(&q->backing_dev_info, disk->disk_name);
+
 	return 0;
 }
 
@@ -3634,6 +4029,7 @@ void blk_unregister_queue(struct gendisk *disk)
 	request_queue_t *q = disk->queue;
 
 	if (q && q->request_fn) {
+		bdi_unregister(&q->backing_dev_info);
 		elv_unregister_queue(q);
 
 		kobject_unregister(&q->kobj);
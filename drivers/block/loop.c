@@ -44,6 +44,9 @@
  * backing filesystem.
  * Anton Altaparmakov, 16 Feb 2005
  *
+ * Asynchronous direct IO to backing files opened with O_DIRECT, several
+ * bios in flight at once instead of one at a time through the page cache.
+ *
  * Still To Fix:
  * - Advisory locking is ignored here.
  * - Should use an own CAP_* category instead of CAP_SYS_ADMIN
@@ -74,6 +77,8 @@
 #include <linux/completion.h>
 #include <linux/highmem.h>
 #include <linux/gfp.h>
+#include <linux/aio.h>
+#include <linux/uio.h>
 
 #include <asm/uaccess.h>
 
@@ -504,6 +509,125 @@ static struct bio *loop_get_bio(struct loop_device *lo)
 	return bio;
 }
 
+/*
+ * A bio under direct IO to the backing file.  The kiocb has the pages of
+ * the bio itself for buffer, see init_kernel_kiocb().
+ */
+struct loop_dio {
+	struct kiocb		iocb;
+	struct loop_device	*lo;
+	struct bio		*bio;
+	struct loop_dio		*next;		/* on lo_dio_redo */
+	struct iovec		*iov;
+	struct page		**pages;
+};
+
+static void loop_dio_done(struct loop_device *lo)
+{
+	if (atomic_dec_and_test(&lo->lo_dio_inflight))
+		wake_up(&lo->lo_dio_wait);
+}
+
+/*
+ * Direct IO completion, often from interrupt context.  What did not go
+ * all the way, a write into a hole of the file say, the loop thread does
+ * again through the page cache.
+ */
+static void loop_dio_complete(struct kiocb *iocb, long res)
+{
+	struct loop_dio *ld = container_of(iocb, struct loop_dio, iocb);
+	struct loop_device *lo = ld->lo;
+	struct bio *bio = ld->bio;
+	unsigned long flags;
+
+	if (res == (long)bio->bi_size) {
+		kfree(ld);
+		bio_endio(bio, bio->bi_size, 0);
+		loop_dio_done(lo);
+		if (atomic_dec_and_test(&lo->lo_pending))
+			up(&lo->lo_bh_mutex);
+		return;
+	}
+
+	spin_lock_irqsave(&lo->lo_lock, flags);
+	ld->next = lo->lo_dio_redo;
+	lo->lo_dio_redo = ld;
+	spin_unlock_irqrestore(&lo->lo_lock, flags);
+	loop_dio_done(lo);
+	up(&lo->lo_bh_mutex);
+}
+
+static struct bio *loop_get_redo(struct loop_device *lo)
+{
+	struct loop_dio *ld;
+	struct bio *bio = NULL;
+
+	spin_lock_irq(&lo->lo_lock);
+	if ((ld = lo->lo_dio_redo))
+		lo->lo_dio_redo = ld->next;
+	spin_unlock_irq(&lo->lo_lock);
+
+	if (ld) {
+		bio = ld->bio;
+		kfree(ld);
+	}
+	return bio;
+}
+
+/*
+ * Start direct IO for bio, 0 if it is under way and is going to complete
+ * by itself.  Otherwise the caller has to do it through the page cache.
+ */
+static int loop_submit_dio(struct loop_device *lo, struct bio *bio)
+{
+	struct file *file = lo->lo_backing_file;
+	struct inode *inode = file->f_mapping->host;
+	int rw = bio_data_dir(bio);
+	struct loop_dio *ld;
+	struct bio_vec *bvec;
+	loff_t pos;
+	ssize_t ret;
+	int i, nr = 0;
+
+	if (lo->transfer && lo->transfer != transfer_none)
+		return -EINVAL;
+	/* growing the file is left to the page cache */
+	pos = ((loff_t) bio->bi_sector << 9) + lo->lo_offset;
+	if (pos + bio->bi_size > i_size_read(inode))
+		return -EINVAL;
+
+	ld = kmalloc(sizeof(*ld) + bio->bi_vcnt *
+		     (sizeof(struct iovec) + sizeof(struct page *)), GFP_NOIO);
+	if (!ld)
+		return -ENOMEM;
+	ld->iov = (struct iovec *)(ld + 1);
+	ld->pages = (struct page **)(ld->iov + bio->bi_vcnt);
+	bio_for_each_segment(bvec, bio, i) {
+		ld->pages[nr] = bvec->bv_page;
+		ld->iov[nr].iov_base = (void __user *)
+			(((unsigned long)nr << PAGE_SHIFT) + bvec->bv_offset);
+		ld->iov[nr].iov_len = bvec->bv_len;
+		nr++;
+	}
+	ld->lo = lo;
+	ld->bio = bio;
+	init_kernel_kiocb(&ld->iocb, file, ld->pages, loop_dio_complete);
+	ld->iocb.ki_pos = pos;
+
+	atomic_inc(&lo->lo_dio_inflight);
+	if (rw == WRITE)
+		down(&inode->i_sem);
+	ret = generic_file_direct_IO(rw, &ld->iocb, ld->iov, pos, nr);
+	if (rw == WRITE)
+		up(&inode->i_sem);
+	if (ret == -EIOCBQUEUED)
+		return 0;
+
+	loop_dio_done(lo);
+	kfree(ld);
+	return ret < 0 ? ret : -EIO;
+}
+
 static int loop_make_request(request_queue_t *q, struct bio *old_bio)
 {
 	struct loop_device *lo = q->queuedata;
@@ -558,7 +682,10 @@ struct switch_request {
 
 static void do_loop_switch(struct loop_device *, struct switch_request *);
 
-static inline void loop_handle_bio(struct loop_device *lo, struct bio *bio)
+/*
+ * Returns 1 if bio was left to complete asynchronously.
+ */
+static inline int loop_handle_bio(struct loop_device *lo, struct bio *bio)
 {
 	int ret;
 
@@ -566,9 +693,13 @@ static inline void loop_handle_bio(struct loop_device *lo, struct bio *bio)
 		do_loop_switch(lo, bio->bi_private);
 		bio_put(bio);
 	} else {
+		if ((lo->lo_flags & LO_FLAGS_DIRECT_IO) &&
+		    !loop_submit_dio(lo, bio))
+			return 1;
 		ret = do_bio_filebacked(lo, bio);
 		bio_endio(bio, bio->bi_size, ret);
 	}
+	return 0;
 }
 
 /*
@@ -610,12 +741,20 @@ static int loop_thread(void *data)
 		if (!atomic_read(&lo->lo_pending))
 			break;
 
-		bio = loop_get_bio(lo);
-		if (!bio) {
-			printk("loop: missing bio\n");
-			continue;
+		bio = loop_get_redo(lo);
+		if (bio) {
+			bio_endio(bio, bio->bi_size,
+				  do_bio_filebacked(lo, bio));
+		} else {
+			bio = loop_get_bio(lo);
+			if (!bio) {
+				printk("loop: missing bio\n");
+				continue;
+			}
+			/* direct IO holds its lo_pending until completion */
+			if (loop_handle_bio(lo, bio))
+				continue;
 		}
-		loop_handle_bio(lo, bio);
 
 		/*
 		 * upped both for pending work and tear-down, lo_pending
@@ -658,7 +797,13 @@ static void do_loop_switch(struct loop_device *lo, struct switch_request *p)
 	struct file *old_file = lo->lo_backing_file;
 	struct address_space *mapping = file->f_mapping;
 
+	/* direct IO in flight still uses the old file */
+	wait_event(lo->lo_dio_wait, !atomic_read(&lo->lo_dio_inflight));
+
 	mapping_set_gfp_mask(old_file->f_mapping, lo->old_gfp_mask);
+	lo->lo_flags &= ~LO_FLAGS_DIRECT_IO;
+	if (file->f_flags & O_DIRECT)
+		lo->lo_flags |= LO_FLAGS_DIRECT_IO;
 	lo->lo_backing_file = file;
 	lo->lo_blocksize = mapping->host->i_blksize;
 	lo->old_gfp_mask = mapping_gfp_mask(mapping);
@@ -791,6 +936,9 @@ static int loop_set_fd(struct loop_device *lo, struct file *lo_file,
 			lo_flags |= LO_FLAGS_USE_AOPS;
 		if (!(lo_flags & LO_FLAGS_USE_AOPS) && !file->f_op->write)
 			lo_flags |= LO_FLAGS_READ_ONLY;
+		/* open() made sure of aops->direct_IO */
+		if (file->f_flags & O_DIRECT)
+			lo_flags |= LO_FLAGS_DIRECT_IO;
 
 		lo_blocksize = inode->i_blksize;
 		error = 0;
@@ -821,6 +969,7 @@ static int loop_set_fd(struct loop_device *lo, struct file *lo_file,
 	mapping_set_gfp_mask(mapping, lo->old_gfp_mask & ~(__GFP_IO|__GFP_FS));
 
 	lo->lo_bio = lo->lo_biotail = NULL;
+	lo->lo_dio_redo = NULL;
 
 	/*
 	 * set queue make_request_fn, and add limits based on lower level
@@ -1283,6 +1432,7 @@ static int __init loop_init(void)
 		init_MUTEX(&lo->lo_ctl_mutex);
 		init_MUTEX_LOCKED(&lo->lo_sem);
 		init_MUTEX_LOCKED(&lo->lo_bh_mutex);
+		init_waitqueue_head(&lo->lo_dio_wait);
 		lo->lo_number = i;
 		spin_lock_init(&lo->lo_lock);
 		disk->major = LOOP_MAJOR;
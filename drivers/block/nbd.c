@@ -140,6 +140,46 @@ static void nbd_end_request(struct request *req)
 	spin_unlock_irqrestore(q->queue_lock, flags);
 }
 
+static void nbd_block_sigs(sigset_t *oldset)
+{
+	unsigned long flags;
+
+	/* Allow interception of SIGKILL only
+	 * Don't allow other signals to interrupt the transmission */
+	spin_lock_irqsave(&current->sighand->siglock, flags);
+	*oldset = current->blocked;
+	sigfillset(&current->blocked);
+	sigdelsetmask(&current->blocked, sigmask(SIGKILL));
+	recalc_sigpending();
+	spin_unlock_irqrestore(&current->sighand->siglock, flags);
+}
+
+static void nbd_restore_sigs(sigset_t *oldset)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&current->sighand->siglock, flags);
+	current->blocked = *oldset;
+	recalc_sigpending();
+	spin_unlock_irqrestore(&current->sighand->siglock, flags);
+}
+
+/* 1 if the transmission was killed */
+static int nbd_xmit_killed(void)
+{
+	unsigned long flags;
+	siginfo_t info;
+
+	if (!signal_pending(current))
+		return 0;
+	spin_lock_irqsave(&current->sighand->siglock, flags);
+	printk(KERN_WARNING "nbd (pid %d: %s) got signal %d\n",
+		current->pid, current->comm,
+		dequeue_signal(current, &current->blocked, &info));
+	spin_unlock_irqrestore(&current->sighand->siglock, flags);
+	return 1;
+}
+
 /*
  *  Send or receive packet.
  */
@@ -149,17 +189,9 @@ static int sock_xmit(struct socket *sock, int send, void *buf, int size,
 	int result;
 	struct msghdr msg;
 	struct kvec iov;
-	unsigned long flags;
 	sigset_t oldset;
 
-	/* Allow interception of SIGKILL only
-	 * Don't allow other signals to interrupt the transmission */
-	spin_lock_irqsave(&current->sighand->siglock, flags);
-	oldset = current->blocked;
-	sigfillset(&current->blocked);
-	sigdelsetmask(&current->blocked, sigmask(SIGKILL));
-	recalc_sigpending();
-	spin_unlock_irqrestore(&current->sighand->siglock, flags);
+	nbd_block_sigs(&oldset);
 
 	do {
 		sock->sk->sk_allocation = GFP_NOIO;
@@ -177,13 +209,7 @@ static int sock_xmit(struct socket *sock, int send, void *buf, int size,
 		else
 			result = kernel_recvmsg(sock, &msg, &iov, 1, size, 0);
 
-		if (signal_pending(current)) {
-			siginfo_t info;
-			spin_lock_irqsave(&current->sighand->siglock, flags);
-			printk(KERN_WARNING "nbd (pid %d: %s) got signal %d\n",
-				current->pid, current->comm, 
-				dequeue_signal(current, &current->blocked, &info));
-			spin_unlock_irqrestore(&current->sighand->siglock, flags);
+		if (nbd_xmit_killed()) {
 			result = -EINTR;
 			break;
 		}
@@ -197,31 +223,62 @@ static int sock_xmit(struct socket *sock, int send, void *buf, int size,
 		buf += result;
 	} while (size > 0);
 
-	spin_lock_irqsave(&current->sighand->siglock, flags);
-	current->blocked = oldset;
-	recalc_sigpending();
-	spin_unlock_irqrestore(&current->sighand->siglock, flags);
+	nbd_restore_sigs(&oldset);
 
 	return result;
 }
 
-static inline int sock_send_bvec(struct socket *sock, struct bio_vec *bvec,
-		int flags)
+/*
+ * Send part of a page.  The protocol may keep a reference to it in place
+ * of a copy: the request is not complete before the server has replied,
+ * long after it got the data.
+ */
+static int sock_send_page(struct socket *sock, struct page *page,
+		int offset, int size, int msg_flags)
 {
 	int result;
-	void *kaddr = kmap(bvec->bv_page);
-	result = sock_xmit(sock, 1, kaddr + bvec->bv_offset, bvec->bv_len,
-			flags);
-	kunmap(bvec->bv_page);
+	sigset_t oldset;
+
+	nbd_block_sigs(&oldset);
+
+	do {
+		sock->sk->sk_allocation = GFP_NOIO;
+		result = kernel_sendpage(sock, page, offset, size,
+				msg_flags | MSG_NOSIGNAL);
+
+		if (nbd_xmit_killed()) {
+			result = -EINTR;
+			break;
+		}
+
+		if (result <= 0) {
+			if (result == 0)
+				result = -EPIPE;
+			break;
+		}
+		size -= result;
+		offset += result;
+	} while (size > 0);
+
+	nbd_restore_sigs(&oldset);
+
 	return result;
 }
 
-static int nbd_send_req(struct nbd_device *lo, struct request *req)
+static inline int sock_send_bvec(struct socket *sock, struct bio_vec *bvec,
+		int flags)
+{
+	return sock_send_page(sock, bvec->bv_page, bvec->bv_offset,
+			bvec->bv_len, flags);
+}
+
+static int nbd_send_req(struct nbd_device *lo, struct nbd_sock *ns,
+		struct request *req)
 {
 	int result, i, flags;
 	struct nbd_request request;
 	unsigned long size = req->nr_sectors << 9;
-	struct socket *sock = lo->sock;
+	struct socket *sock;
 
 	request.magic = htonl(NBD_REQUEST_MAGIC);
 	request.type = htonl(nbd_cmd(req));
@@ -229,9 +286,10 @@ static int nbd_send_req(struct nbd_device *lo, struct request *req)
 	request.len = htonl(size);
 	memcpy(request.handle, &req, sizeof(req));
 
-	down(&lo->tx_lock);
+	down(&ns->tx_lock);
 
-	if (!sock || !lo->sock) {
+	sock = ns->sock;
+	if (!sock) {
 		printk(KERN_ERR "%s: Attempted send on closed socket\n",
 				lo->disk->disk_name);
 		goto error_out;
@@ -275,11 +333,11 @@ static int nbd_send_req(struct nbd_device *lo, struct request *req)
 			}
 		}
 	}
-	up(&lo->tx_lock);
+	up(&ns->tx_lock);
 	return 0;
 
 error_out:
-	up(&lo->tx_lock);
+	up(&ns->tx_lock);
 	return 1;
 }
 
@@ -315,12 +373,13 @@ static inline int sock_recv_bvec(struct socket *sock, struct bio_vec *bvec)
 }
 
 /* NULL returned = something went wrong, inform userspace */
-static struct request *nbd_read_stat(struct nbd_device *lo)
+static struct request *nbd_read_stat(struct nbd_device *lo,
+		struct nbd_sock *ns)
 {
 	int result;
 	struct nbd_reply reply;
 	struct request *req;
-	struct socket *sock = lo->sock;
+	struct socket *sock = ns->sock;
 
 	reply.magic = 0;
 	result = sock_xmit(sock, 0, &reply, sizeof(reply), MSG_WAITALL);
@@ -377,15 +436,139 @@ harderror:
 	return NULL;
 }
 
-static void nbd_do_it(struct nbd_device *lo)
+/*
+ * Make the receivers of all connections return, once one has failed:
+ * the requests of a connection which is gone are lost.
+ */
+static void nbd_shutdown_socks(struct nbd_device *lo)
+{
+	int i;
+
+	for (i = 0; i < lo->nr_socks; i++) {
+		struct nbd_sock *ns = &lo->socks[i];
+
+		down(&ns->tx_lock);
+		if (ns->sock)
+			ns->sock->ops->shutdown(ns->sock,
+				SEND_SHUTDOWN|RCV_SHUTDOWN);
+		up(&ns->tx_lock);
+	}
+}
+
+static void nbd_do_it(struct nbd_device *lo, struct nbd_sock *ns)
 {
 	struct request *req;
 
 	BUG_ON(lo->magic != LO_MAGIC);
 
-	while ((req = nbd_read_stat(lo)) != NULL)
+	while ((req = nbd_read_stat(lo, ns)) != NULL)
 		nbd_end_request(req);
-	return;
+	nbd_shutdown_socks(lo);
+}
+
+/* The receiver of each connection but the first, which has NBD_DO_IT's */
+struct nbd_rx {
+	struct nbd_device *lo;
+	struct nbd_sock *ns;
+	struct completion done;
+};
+
+static int nbd_rx_thread(void *data)
+{
+	struct nbd_rx *rx = data;
+
+	daemonize("%s.%d", rx->lo->disk->disk_name,
+		  (int)(rx->ns - rx->lo->socks));
+	nbd_do_it(rx->lo, rx->ns);
+	complete_and_exit(&rx->done, 0);
+}
+
+static void nbd_clear_que(struct nbd_device *lo);
+
+/*
+ * Forget the connections, failing what is still queued on them.  The
+ * sockets have to be gone from under tx_lock already.
+ */
+static void nbd_clear_socks(struct nbd_device *lo)
+{
+	struct file *files[NBD_MAX_SOCKS];
+	int i, nr;
+
+	spin_lock(&lo->queue_lock);
+	nr = lo->nr_socks;
+	for (i = 0; i < nr; i++) {
+		files[i] = lo->socks[i].file;
+		lo->socks[i].file = NULL;
+	}
+	lo->nr_socks = 0;
+	lo->next_sock = 0;
+	spin_unlock(&lo->queue_lock);
+	nbd_clear_que(lo);
+	for (i = 0; i < nr; i++)
+		fput(files[i]);
+}
+
+/*
+ * NBD_DO_IT: receive on all connections until one fails.
+ */
+static int nbd_run(struct nbd_device *lo)
+{
+	struct nbd_rx rx[NBD_MAX_SOCKS];
+	int i, nr, started;
+
+	spin_lock(&lo->queue_lock);
+	nr = lo->nr_socks;
+	if (lo->flags & NBD_RUNNING)
+		nr = 0;
+	if (nr)
+		lo->flags |= NBD_RUNNING;
+	spin_unlock(&lo->queue_lock);
+	if (!nr)
+		return -EINVAL;
+
+	for (i = 1; i < nr; i++) {
+		rx[i].lo = lo;
+		rx[i].ns = &lo->socks[i];
+		init_completion(&rx[i].done);
+		if (kernel_thread(nbd_rx_thread, &rx[i], CLONE_KERNEL) < 0)
+			break;
+	}
+	started = i;
+	if (started == nr)
+		nbd_do_it(lo, &lo->socks[0]);
+	else {
+		lo->harderror = -ENOMEM;
+		nbd_shutdown_socks(lo);
+	}
+	for (i = 1; i < started; i++)
+		wait_for_completion(&rx[i].done);
+
+	/* on return tidy up in case we have a signal */
+	/* Forcibly shutdown the socket causing all listeners
+	 * to error
+	 *
+	 * FIXME: This code is duplicated from sys_shutdown, but
+	 * there should be a more generic interface rather than
+	 * calling socket ops directly here */
+	for (i = 0; i < nr; i++) {
+		struct nbd_sock *ns = &lo->socks[i];
+
+		down(&ns->tx_lock);
+		if (ns->sock) {
+			printk(KERN_WARNING "%s: shutting down socket\n",
+				lo->disk->disk_name);
+			ns->sock->ops->shutdown(ns->sock,
+				SEND_SHUTDOWN|RCV_SHUTDOWN);
+			ns->sock = NULL;
+		}
+		up(&ns->tx_lock);
+	}
+	nbd_clear_socks(lo);
+	printk(KERN_WARNING "%s: queue cleared\n", lo->disk->disk_name);
+	spin_lock(&lo->queue_lock);
+	lo->flags &= ~NBD_RUNNING;
+	spin_unlock(&lo->queue_lock);
+	return lo->harderror;
 }
 
 static void nbd_clear_que(struct nbd_device *lo)
@@ -422,6 +605,7 @@ static void do_nbd_request(request_queue_t * q)
 	
 	while ((req = elv_next_request(q)) != NULL) {
 		struct nbd_device *lo;
+		struct nbd_sock *ns;
 
 		blkdev_dequeue_request(req);
 		dprintk(DBG_BLKDEV, "%s: request %p: dequeued (flags=%lx)\n",
@@ -434,7 +618,7 @@ static void do_nbd_request(request_queue_t * q)
 
 		BUG_ON(lo->magic != LO_MAGIC);
 
-		if (!lo->file) {
+		if (!lo->nr_socks) {
 			printk(KERN_ERR "%s: Request when not-ready\n",
 					lo->disk->disk_name);
 			goto error_out;
@@ -454,7 +638,7 @@ static void do_nbd_request(request_queue_t * q)
 
 		spin_lock(&lo->queue_lock);
 
-		if (!lo->file) {
+		if (!lo->nr_socks) {
 			spin_unlock(&lo->queue_lock);
 			printk(KERN_ERR "%s: failed between accept and semaphore, file lost\n",
 					lo->disk->disk_name);
@@ -464,10 +648,17 @@ static void do_nbd_request(request_queue_t * q)
 			continue;
 		}
 
+		/*
+		 * Round robin over the connections, each of which has as
+		 * many requests in flight as the server lets it.
+		 */
+		ns = &lo->socks[lo->next_sock];
+		if (++lo->next_sock >= lo->nr_socks)
+			lo->next_sock = 0;
 		list_add(&req->queuelist, &lo->queue_head);
 		spin_unlock(&lo->queue_lock);
 
-		if (nbd_send_req(lo, req) != 0) {
+		if (nbd_send_req(lo, ns, req) != 0) {
 			printk(KERN_ERR "%s: Request send failed\n",
 					lo->disk->disk_name);
 			if (nbd_find_request(lo, (char *)&req) != NULL) {
@@ -494,7 +685,7 @@ static int nbd_ioctl(struct inode *inode, struct file *file,
 		     unsigned int cmd, unsigned long arg)
 {
 	struct nbd_device *lo = inode->i_bdev->bd_disk->private_data;
-	int error;
+	int error, i;
 	struct request sreq ;
 
 	if (!capable(CAP_SYS_ADMIN))
@@ -518,45 +709,48 @@ static int nbd_ioctl(struct inode *inode, struct file *file,
 		 */
 		sreq.sector = 0;
 		sreq.nr_sectors = 0;
-                if (!lo->sock)
+                if (!lo->nr_socks)
 			return -EINVAL;
-                nbd_send_req(lo, &sreq);
+		for (i = 0; i < lo->nr_socks; i++)
+			nbd_send_req(lo, &lo->socks[i], &sreq);
                 return 0;
  
 	case NBD_CLEAR_SOCK:
 		error = 0;
-		down(&lo->tx_lock);
-		lo->sock = NULL;
-		up(&lo->tx_lock);
-		spin_lock(&lo->queue_lock);
-		file = lo->file;
-		lo->file = NULL;
-		spin_unlock(&lo->queue_lock);
-		nbd_clear_que(lo);
+		for (i = 0; i < NBD_MAX_SOCKS; i++) {
+			down(&lo->socks[i].tx_lock);
+			lo->socks[i].sock = NULL;
+			up(&lo->socks[i].tx_lock);
+		}
+		nbd_clear_socks(lo);
 		spin_lock(&lo->queue_lock);
 		if (!list_empty(&lo->queue_head)) {
 			printk(KERN_ERR "nbd: disconnect: some requests are in progress -> please try again.\n");
 			error = -EBUSY;
 		}
 		spin_unlock(&lo->queue_lock);
-		if (file)
-			fput(file);
 		return error;
 	case NBD_SET_SOCK:
-		if (lo->file)
-			return -EBUSY;
 		error = -EINVAL;
 		file = fget(arg);
-		if (file) {
-			inode = file->f_dentry->d_inode;
-			if (S_ISSOCK(inode->i_mode)) {
-				lo->file = file;
-				lo->sock = SOCKET_I(inode);
+		if (!file)
+			return error;
+		inode = file->f_dentry->d_inode;
+		if (S_ISSOCK(inode->i_mode)) {
+			/* more connections to the same server, up to a point */
+			error = -EBUSY;
+			spin_lock(&lo->queue_lock);
+			if (lo->nr_socks < NBD_MAX_SOCKS &&
+			    !(lo->flags & NBD_RUNNING)) {
+				lo->socks[lo->nr_socks].file = file;
+				lo->socks[lo->nr_socks].sock = SOCKET_I(inode);
+				lo->nr_socks++;
 				error = 0;
-			} else {
-				fput(file);
 			}
+			spin_unlock(&lo->queue_lock);
 		}
+		if (error)
+			fput(file);
 		return error;
 	case NBD_SET_BLKSIZE:
 		lo->blksize = arg;
@@ -578,42 +772,11 @@ static int nbd_ioctl(struct inode *inode, struct file *file,
 		set_capacity(lo->disk, lo->bytesize >> 9);
 		return 0;
 	case NBD_DO_IT:
-		if (!lo->file)
-			return -EINVAL;
-		nbd_do_it(lo);
-		/* on return tidy up in case we have a signal */
-		/* Forcibly shutdown the socket causing all listeners
-		 * to error
-		 *
-		 * FIXME: This code is duplicated from sys_shutdown, but
-		 * there should be a more generic interface rather than
-		 * calling socket ops directly here */
-		down(&lo->tx_lock);
-		if (lo->sock) {
-			printk(KERN_WARNING "%s: shutting down socket\n",
-				lo->disk->disk_name);
-			lo->sock->ops->shutdown(lo->sock,
-				SEND_SHUTDOWN|RCV_SHUTDOWN);
-			lo->sock = NULL;
-		}
-		up(&lo->tx_lock);
-		spin_lock(&lo->queue_lock);
-		file = lo->file;
-		lo->file = NULL;
-		spin_unlock(&lo->queue_lock);
-		nbd_clear_que(lo);
-		printk(KERN_WARNING "%s: queue cleared\n", lo->disk->disk_name);
-		if (file)
-			fput(file);
-		return lo->harderror;
+		return nbd_run(lo);
 	case NBD_CLEAR_QUE:
-		down(&lo->tx_lock);
-		if (lo->sock) {
-			up(&lo->tx_lock);
+		if (lo->nr_socks)
 			return 0; /* probably should be error, but that would
 				   * break "nbd-client -d", so just return 0 */
-		}
-		up(&lo->tx_lock);
 		nbd_clear_que(lo);
 		return 0;
 	case NBD_PRINT_DEBUG:
@@ -675,12 +838,14 @@ static int __init nbd_init(void)
 	devfs_mk_dir("nbd");
 	for (i = 0; i < MAX_NBD; i++) {
 		struct gendisk *disk = nbd_dev[i].disk;
-		nbd_dev[i].file = NULL;
+		int j;
+		nbd_dev[i].nr_socks = 0;
 		nbd_dev[i].magic = LO_MAGIC;
 		nbd_dev[i].flags = 0;
 		spin_lock_init(&nbd_dev[i].queue_lock);
 		INIT_LIST_HEAD(&nbd_dev[i].queue_head);
-		init_MUTEX(&nbd_dev[i].tx_lock);
+		for (j = 0; j < NBD_MAX_SOCKS; j++)
+			init_MUTEX(&nbd_dev[i].socks[j].tx_lock);
 		nbd_dev[i].blksize = 1024;
 		nbd_dev[i].bytesize = 0x7ffffc00ULL << 10; /* 2TB */
 		disk->major = NBD_MAJOR;
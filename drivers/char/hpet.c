@@ -708,12 +708,18 @@ static void hpet_register_interpolator(struct hpets *hpetp)
 		return;
 
 	memset(ti, 0, sizeof(*ti));
+#ifdef readq
 	ti->source = TIME_SOURCE_MMIO64;
+	ti->mask = -1;
+#else
+	/* the interpolator cannot do two reads, take the low half */
+	ti->source = TIME_SOURCE_MMIO32;
+	ti->mask = 0xffffffff;
+#endif
 	ti->shift = 10;
 	ti->addr = &hpetp->hp_hpet->hpet_mc;
 	ti->frequency = hpet_time_div(hpets->hp_period);
 	ti->drift = ti->frequency * HPET_DRIFT / 1000000;
-	ti->mask = -1;
 
 	hpetp->hp_interpolator = ti;
 	register_time_interpolator(ti);
@@ -562,6 +562,8 @@ static inline size_t read_zero_pagealigned(char __user * buf, size_t size)
 		if (count > size)
 			count = size;
 
+		if (unshare_page_table_ends(mm, addr, addr + count))
+			break;
 		zap_page_range(vma, addr, count, NULL);
         	zeromap_page_range(vma, addr, count, PAGE_COPY);
 
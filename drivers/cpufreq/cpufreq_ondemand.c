@@ -56,37 +56,61 @@ static unsigned int 				def_sampling_rate;
 #define MAX_SAMPLING_RATE			(500 * def_sampling_rate)
 #define DEF_SAMPLING_RATE_LATENCY_MULTIPLIER	(1000)
 #define DEF_SAMPLING_DOWN_FACTOR		(10)
+#define DEF_FREQUENCY_STEP			(5)
 #define TRANSITION_LATENCY_LIMIT		(10 * 1000)
 #define sampling_rate_in_HZ(x)			(((x * HZ) < (1000 * 1000))?1:((x * HZ) / (1000 * 1000)))
 
 static void do_dbs_timer(void *data);
 
+/*
+ * Each policy is sampled by work of its own, on the CPU of the policy,
+ * so that policies are checked independently and the samples are
+ * taken where the counters are updated.
+ */
 struct cpu_dbs_info_s {
 	struct cpufreq_policy 	*cur_policy;
 	unsigned int 		prev_cpu_idle_up;
 	unsigned int 		prev_cpu_idle_down;
 	unsigned int 		enable;
+	unsigned int		down_skip;
+	struct work_struct	work;
 };
 static DEFINE_PER_CPU(struct cpu_dbs_info_s, cpu_dbs_info);
 
 static unsigned int dbs_enable;	/* number of CPUs using this policy */
 
 static DECLARE_MUTEX 	(dbs_sem);
-static DECLARE_WORK	(dbs_work, do_dbs_timer, NULL);
 
 struct dbs_tuners {
 	unsigned int 		sampling_rate;
 	unsigned int		sampling_down_factor;
 	unsigned int		up_threshold;
 	unsigned int		down_threshold;
+	unsigned int		io_is_busy;
+	unsigned int		freq_step;
 };
 
 static struct dbs_tuners dbs_tuners_ins = {
 	.up_threshold 		= DEF_FREQUENCY_UP_THRESHOLD,
 	.down_threshold 	= DEF_FREQUENCY_DOWN_THRESHOLD,
 	.sampling_down_factor 	= DEF_SAMPLING_DOWN_FACTOR,
+	.freq_step		= DEF_FREQUENCY_STEP,
 };
 
+/*
+ * Time a CPU waited for io counts as idle unless io_is_busy: waiting
+ * for the disk is no reason to run slowly when the cpu work needed
+ * between the ios decides how long they take.
+ */
+static inline unsigned int dbs_idle_ticks(unsigned int cpu)
+{
+	unsigned int ticks = kstat_cpu(cpu).cpustat.idle;
+
+	if (!dbs_tuners_ins.io_is_busy)
+		ticks += kstat_cpu(cpu).cpustat.iowait;
+	return ticks;
+}
+
 /************************** sysfs interface ************************/
 static ssize_t show_sampling_rate_max(struct cpufreq_policy *policy, char *buf)
 {
@@ -116,6 +140,8 @@ show_one(sampling_rate, sampling_rate);
 show_one(sampling_down_factor, sampling_down_factor);
 show_one(up_threshold, up_threshold);
 show_one(down_threshold, down_threshold);
+show_one(io_is_busy, io_is_busy);
+show_one(freq_step, freq_step);
 
 static ssize_t store_sampling_down_factor(struct cpufreq_policy *unused, 
 		const char *buf, size_t count)
@@ -194,6 +220,51 @@ static ssize_t store_down_threshold(struct cpufreq_policy *unused,
 	return count;
 }
 
+static ssize_t store_io_is_busy(struct cpufreq_policy *unused,
+		const char *buf, size_t count)
+{
+	unsigned int input;
+	unsigned int j;
+	int ret;
+	ret = sscanf (buf, "%u", &input);
+	if (ret != 1)
+		return -EINVAL;
+
+	down(&dbs_sem);
+	dbs_tuners_ins.io_is_busy = !!input;
+
+	/* the idle counts changed meaning, start the samples again */
+	for (j = 0; j < NR_CPUS; j++) {
+		struct cpu_dbs_info_s *j_dbs_info;
+
+		if (!cpu_online(j))
+			continue;
+		j_dbs_info = &per_cpu(cpu_dbs_info, j);
+		j_dbs_info->prev_cpu_idle_up = dbs_idle_ticks(j);
+		j_dbs_info->prev_cpu_idle_down = j_dbs_info->prev_cpu_idle_up;
+	}
+	up(&dbs_sem);
+
+	return count;
+}
+
+static ssize_t store_freq_step(struct cpufreq_policy *unused,
+		const char *buf, size_t count)
+{
+	unsigned int input;
+	int ret;
+	ret = sscanf (buf, "%u", &input);
+
+	if (ret != 1 || input < 1 || input > 100)
+		return -EINVAL;
+
+	down(&dbs_sem);
+	dbs_tuners_ins.freq_step = input;
+	up(&dbs_sem);
+
+	return count;
+}
+
 #define define_one_rw(_name) \
 static struct freq_attr _name = \
 __ATTR(_name, 0644, show_##_name, store_##_name)
@@ -202,6 +273,8 @@ define_one_rw(sampling_rate);
 define_one_rw(sampling_down_factor);
 define_one_rw(up_threshold);
 define_one_rw(down_threshold);
+define_one_rw(io_is_busy);
+define_one_rw(freq_step);
 
 static struct attribute * dbs_attributes[] = {
 	&sampling_rate_max.attr,
@@ -210,6 +283,8 @@ static struct attribute * dbs_attributes[] = {
 	&sampling_down_factor.attr,
 	&up_threshold.attr,
 	&down_threshold.attr,
+	&io_is_busy.attr,
+	&freq_step.attr,
 	NULL
 };
 
@@ -226,7 +301,6 @@ static void dbs_check_cpu(int cpu)
 	unsigned int total_idle_ticks;
 	unsigned int freq_down_step;
 	unsigned int freq_down_sampling_rate;
-	static int down_skip[NR_CPUS];
 	struct cpu_dbs_info_s *this_dbs_info;
 
 	struct cpufreq_policy *policy;
@@ -248,12 +322,11 @@ static void dbs_check_cpu(int cpu)
 	 *
 	 * Any frequency increase takes it to the maximum frequency. 
 	 * Frequency reduction happens at minimum steps of 
-	 * 5% of max_frequency 
+	 * freq_step% (5% by default) of max_frequency 
 	 */
 
 	/* Check for frequency increase */
-	total_idle_ticks = kstat_cpu(cpu).cpustat.idle +
-		kstat_cpu(cpu).cpustat.iowait;
+	total_idle_ticks = dbs_idle_ticks(cpu);
 	idle_ticks = total_idle_ticks -
 		this_dbs_info->prev_cpu_idle_up;
 	this_dbs_info->prev_cpu_idle_up = total_idle_ticks;
@@ -268,8 +341,7 @@ static void dbs_check_cpu(int cpu)
 
 		j_dbs_info = &per_cpu(cpu_dbs_info, j);
 		/* Check for frequency increase */
-		total_idle_ticks = kstat_cpu(j).cpustat.idle +
-			kstat_cpu(j).cpustat.iowait;
+		total_idle_ticks = dbs_idle_ticks(j);
 		tmp_idle_ticks = total_idle_ticks -
 			j_dbs_info->prev_cpu_idle_up;
 		j_dbs_info->prev_cpu_idle_up = total_idle_ticks;
@@ -286,18 +358,24 @@ static void dbs_check_cpu(int cpu)
 	if (idle_ticks < up_idle_ticks) {
 		__cpufreq_driver_target(policy, policy->max, 
 			CPUFREQ_RELATION_H);
-		down_skip[cpu] = 0;
-		this_dbs_info->prev_cpu_idle_down = total_idle_ticks;
+		/* the down check starts counting from here again */
+		this_dbs_info->down_skip = 0;
+		for_each_cpu_mask(j, policy->cpus) {
+			struct cpu_dbs_info_s *j_dbs_info;
+
+			j_dbs_info = &per_cpu(cpu_dbs_info, j);
+			j_dbs_info->prev_cpu_idle_down =
+				j_dbs_info->prev_cpu_idle_up;
+		}
 		return;
 	}
 
 	/* Check for frequency decrease */
-	down_skip[cpu]++;
-	if (down_skip[cpu] < dbs_tuners_ins.sampling_down_factor)
+	this_dbs_info->down_skip++;
+	if (this_dbs_info->down_skip < dbs_tuners_ins.sampling_down_factor)
 		return;
 
-	total_idle_ticks = kstat_cpu(cpu).cpustat.idle +
-		kstat_cpu(cpu).cpustat.iowait;
+	total_idle_ticks = this_dbs_info->prev_cpu_idle_up;
 	idle_ticks = total_idle_ticks -
 		this_dbs_info->prev_cpu_idle_down;
 	this_dbs_info->prev_cpu_idle_down = total_idle_ticks;
@@ -310,9 +388,8 @@ static void dbs_check_cpu(int cpu)
 			continue;
 
 		j_dbs_info = &per_cpu(cpu_dbs_info, j);
-		/* Check for frequency increase */
-		total_idle_ticks = kstat_cpu(j).cpustat.idle +
-			kstat_cpu(j).cpustat.iowait;
+		/* Check for frequency decrease */
+		total_idle_ticks = j_dbs_info->prev_cpu_idle_up;
 		tmp_idle_ticks = total_idle_ticks -
 			j_dbs_info->prev_cpu_idle_down;
 		j_dbs_info->prev_cpu_idle_down = total_idle_ticks;
@@ -323,7 +400,7 @@ static void dbs_check_cpu(int cpu)
 
 	/* Scale idle ticks by 100 and compare with up and down ticks */
 	idle_ticks *= 100;
-	down_skip[cpu] = 0;
+	this_dbs_info->down_skip = 0;
 
 	freq_down_sampling_rate = dbs_tuners_ins.sampling_rate *
 		dbs_tuners_ins.sampling_down_factor;
@@ -331,7 +408,7 @@ static void dbs_check_cpu(int cpu)
 			sampling_rate_in_HZ(freq_down_sampling_rate);
 
 	if (idle_ticks > down_idle_ticks ) {
-		freq_down_step = (5 * policy->max) / 100;
+		freq_down_step = (dbs_tuners_ins.freq_step * policy->max) / 100;
 
 		/* max freq cannot be less than 100. But who knows.... */
 		if (unlikely(freq_down_step == 0))
@@ -346,27 +423,43 @@ static void dbs_check_cpu(int cpu)
 
 static void do_dbs_timer(void *data)
 { 
-	int i;
+	unsigned int cpu = (unsigned long) data;
+	struct cpu_dbs_info_s *dbs_info = &per_cpu(cpu_dbs_info, cpu);
+
 	down(&dbs_sem);
-	for (i = 0; i < NR_CPUS; i++)
-		if (cpu_online(i))
-			dbs_check_cpu(i);
-	schedule_delayed_work(&dbs_work, 
+	if (!dbs_info->enable) {
+		up(&dbs_sem);
+		return;
+	}
+	dbs_check_cpu(cpu);
+	schedule_delayed_work_on(cpu, &dbs_info->work,
 			sampling_rate_in_HZ(dbs_tuners_ins.sampling_rate));
 	up(&dbs_sem);
 } 
 
-static inline void dbs_timer_init(void)
+/*
+ * Work still queued from an earlier start, or running and blocked on
+ * dbs_sem, just carries on: the queueing here is then a no-op.
+ */
+static inline void dbs_timer_init(unsigned int cpu)
 {
-	INIT_WORK(&dbs_work, do_dbs_timer, NULL);
-	schedule_delayed_work(&dbs_work,
+	struct cpu_dbs_info_s *dbs_info = &per_cpu(cpu_dbs_info, cpu);
+
+	schedule_delayed_work_on(cpu, &dbs_info->work,
 			sampling_rate_in_HZ(dbs_tuners_ins.sampling_rate));
 	return;
 }
 
-static inline void dbs_timer_exit(void)
+/*
+ * Once ->enable is cleared the work does not rearm itself, and does
+ * nothing if it runs once more.  It is not waited for, keventd may
+ * have cpufreq work queued which needs the policy we were called for.
+ */
+static inline void dbs_timer_exit(unsigned int cpu)
 {
-	cancel_delayed_work(&dbs_work);
+	struct cpu_dbs_info_s *dbs_info = &per_cpu(cpu_dbs_info, cpu);
+
+	cancel_delayed_work(&dbs_info->work);
 	return;
 }
 
@@ -397,19 +490,17 @@ static int cpufreq_governor_dbs(struct cpufreq_policy *policy,
 			j_dbs_info = &per_cpu(cpu_dbs_info, j);
 			j_dbs_info->cur_policy = policy;
 		
-			j_dbs_info->prev_cpu_idle_up = 
-				kstat_cpu(j).cpustat.idle +
-				kstat_cpu(j).cpustat.iowait;
-			j_dbs_info->prev_cpu_idle_down = 
-				kstat_cpu(j).cpustat.idle +
-				kstat_cpu(j).cpustat.iowait;
+			j_dbs_info->prev_cpu_idle_up = dbs_idle_ticks(j);
+			j_dbs_info->prev_cpu_idle_down =
+				j_dbs_info->prev_cpu_idle_up;
 		}
 		this_dbs_info->enable = 1;
+		this_dbs_info->down_skip = 0;
 		sysfs_create_group(&policy->kobj, &dbs_attr_group);
 		dbs_enable++;
 		/*
-		 * Start the timerschedule work, when this governor
-		 * is used for first time
+		 * The sampling rate is set when this governor is used
+		 * for the first time
 		 */
 		if (dbs_enable == 1) {
 			unsigned int latency;
@@ -422,9 +513,8 @@ static int cpufreq_governor_dbs(struct cpufreq_policy *policy,
 			def_sampling_rate = (latency / 1000) *
 					DEF_SAMPLING_RATE_LATENCY_MULTIPLIER;
 			dbs_tuners_ins.sampling_rate = def_sampling_rate;
-
-			dbs_timer_init();
 		}
+		dbs_timer_init(cpu);
 		
 		up(&dbs_sem);
 		break;
@@ -434,13 +524,7 @@ static int cpufreq_governor_dbs(struct cpufreq_policy *policy,
 		this_dbs_info->enable = 0;
 		sysfs_remove_group(&policy->kobj, &dbs_attr_group);
 		dbs_enable--;
-		/*
-		 * Stop the timerschedule work, when this governor
-		 * is used for first time
-		 */
-		if (dbs_enable == 0) 
-			dbs_timer_exit();
-		
+		dbs_timer_exit(cpu);
 		up(&dbs_sem);
 
 		break;
@@ -470,12 +554,22 @@ EXPORT_SYMBOL(cpufreq_gov_dbs);
 
 static int __init cpufreq_gov_dbs_init(void)
 {
+	int i;
+
+	for (i = 0; i < NR_CPUS; i++)
+		INIT_WORK(&per_cpu(cpu_dbs_info, i).work, do_dbs_timer,
+			  (void *)(unsigned long) i);
+
 	return cpufreq_register_governor(&cpufreq_gov_dbs);
 }
 
 static void __exit cpufreq_gov_dbs_exit(void)
 {
+	int i;
+
 	/* Make sure that the scheduled work is indeed not running */
+	for (i = 0; i < NR_CPUS; i++)
+		cancel_delayed_work(&per_cpu(cpu_dbs_info, i).work);
 	flush_scheduled_work();
 
 	cpufreq_unregister_governor(&cpufreq_gov_dbs);
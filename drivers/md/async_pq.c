@@ -0,0 +1,47 @@
+/*
+ * async_pq.c : Multiple Devices driver for Linux
+ *
+ * Asynchronous RAID-6 P+Q generation, run by a registered engine where
+ * there is one and by the raid6 routine picked at boot otherwise.  See
+ * include/linux/raid/async_tx.h.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ */
+
+#include "raid6.h"
+#include <linux/raid/async_tx.h>
+
+/*
+ * Generate P into blocks[@disks - 2] and Q into blocks[@disks - 1] from
+ * the data blocks before them.
+ */
+struct async_tx *async_gen_syndrome(struct page **blocks,
+		unsigned int offset, int disks, size_t len,
+		enum async_tx_flags flags, struct async_tx *depend_tx,
+		async_tx_callback callback, void *callback_param)
+{
+	struct async_tx_engine *engine;
+	struct async_tx *tx = NULL;
+	/**** FIX THIS: This could be very bad if disks is close to 256 ****/
+	void *ptrs[disks];
+	int i;
+
+	engine = async_tx_find_engine(ASYNC_TX_CAP_PQ);
+	if (engine)
+		tx = engine->prep_pq(engine, blocks, disks, offset, len);
+	if (tx)
+		return async_tx_submit(engine, tx, flags, depend_tx,
+				       callback, callback_param);
+
+	async_tx_sync_prolog(flags, depend_tx);
+	for (i = 0; i < disks; i++)
+		ptrs[i] = page_address(blocks[i]) + offset;
+	raid6_call.gen_syndrome(disks, len, ptrs);
+	async_tx_sync_epilog(callback, callback_param);
+	return NULL;
+}
+
+EXPORT_SYMBOL(async_gen_syndrome);
@@ -0,0 +1,233 @@
+/*
+ * async_tx.c : Multiple Devices driver for Linux
+ *
+ * Asynchronous xor and memcpy for the RAID personalities, run by a
+ * registered engine where there is one and on the CPU otherwise.
+ * See include/linux/raid/async_tx.h.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ */
+
+#include <linux/module.h>
+#include <linux/highmem.h>
+#include <linux/spinlock.h>
+#include <linux/string.h>
+#include <linux/raid/xor.h>
+#include <linux/raid/async_tx.h>
+
+static LIST_HEAD(async_tx_engines);
+static DEFINE_SPINLOCK(async_tx_lock);
+
+int async_tx_register_engine(struct async_tx_engine *engine)
+{
+	if (!engine->submit || !engine->issue_pending || !engine->free)
+		return -EINVAL;
+	if ((engine->cap & ASYNC_TX_CAP_XOR) && engine->max_xor < 1)
+		return -EINVAL;
+
+	spin_lock(&async_tx_lock);
+	list_add_tail(&engine->node, &async_tx_engines);
+	spin_unlock(&async_tx_lock);
+	printk(KERN_INFO "async_tx: using %s\n", engine->name);
+	return 0;
+}
+
+void async_tx_unregister_engine(struct async_tx_engine *engine)
+{
+	spin_lock(&async_tx_lock);
+	list_del(&engine->node);
+	spin_unlock(&async_tx_lock);
+}
+
+struct async_tx_engine *async_tx_find_engine(unsigned long cap)
+{
+	struct async_tx_engine *engine;
+
+	spin_lock(&async_tx_lock);
+	list_for_each_entry(engine, &async_tx_engines, node)
+		if ((engine->cap & cap) == cap) {
+			spin_unlock(&async_tx_lock);
+			return engine;
+		}
+	spin_unlock(&async_tx_lock);
+	return NULL;
+}
+
+static void async_tx_put(struct async_tx *tx)
+{
+	if (atomic_dec_and_test(&tx->count))
+		tx->engine->free(tx);
+}
+
+void async_tx_complete(struct async_tx *tx)
+{
+	if (tx->callback)
+		tx->callback(tx->callback_param);
+	smp_mb__before_clear_bit();
+	set_bit(ASYNC_TX_COMPLETE, &tx->state);
+	async_tx_put(tx);
+}
+
+void async_tx_ack(struct async_tx *tx)
+{
+	async_tx_put(tx);
+}
+
+void async_tx_wait(struct async_tx *tx)
+{
+	struct async_tx_engine *engine = tx->engine;
+
+	engine->issue_pending(engine);
+	while (!test_bit(ASYNC_TX_COMPLETE, &tx->state)) {
+		if (engine->poll)
+			engine->poll(engine);
+		cpu_relax();
+	}
+	smp_rmb();
+}
+
+void async_tx_issue_pending_all(void)
+{
+	struct async_tx_engine *engine;
+
+	spin_lock(&async_tx_lock);
+	list_for_each_entry(engine, &async_tx_engines, node)
+		engine->issue_pending(engine);
+	spin_unlock(&async_tx_lock);
+}
+
+/*
+ * Hand a prepared descriptor to its engine.  An engine runs what it is
+ * given in order, so a dependency on the same engine needs no waiting;
+ * one on another engine is waited for here.  An acked transaction is
+ * not passed back.
+ */
+struct async_tx *async_tx_submit(struct async_tx_engine *engine,
+		struct async_tx *tx, enum async_tx_flags flags,
+		struct async_tx *depend_tx,
+		async_tx_callback callback, void *callback_param)
+{
+	tx->callback = callback;
+	tx->callback_param = callback_param;
+
+	if (depend_tx && depend_tx->engine != engine)
+		async_tx_wait(depend_tx);
+	engine->submit(tx);
+	if (depend_tx && (flags & ASYNC_TX_DEP_ACK))
+		async_tx_ack(depend_tx);
+
+	if (flags & ASYNC_TX_ACK) {
+		async_tx_ack(tx);
+		return NULL;
+	}
+	return tx;
+}
+
+/* Before doing an operation on the CPU: let the dependency finish */
+void async_tx_sync_prolog(enum async_tx_flags flags, struct async_tx *depend_tx)
+{
+	if (!depend_tx)
+		return;
+	async_tx_wait(depend_tx);
+	if (flags & ASYNC_TX_DEP_ACK)
+		async_tx_ack(depend_tx);
+}
+
+void async_tx_sync_epilog(async_tx_callback callback, void *callback_param)
+{
+	if (callback)
+		callback(callback_param);
+}
+
+struct async_tx *async_memcpy(struct page *dest, struct page *src,
+		unsigned int dest_offset, unsigned int src_offset, size_t len,
+		enum async_tx_flags flags, struct async_tx *depend_tx,
+		async_tx_callback callback, void *callback_param)
+{
+	struct async_tx_engine *engine;
+	struct async_tx *tx = NULL;
+	char *d, *s;
+
+	engine = async_tx_find_engine(ASYNC_TX_CAP_MEMCPY);
+	if (engine)
+		tx = engine->prep_memcpy(engine, dest, dest_offset,
+					 src, src_offset, len);
+	if (tx)
+		return async_tx_submit(engine, tx, flags, depend_tx,
+				       callback, callback_param);
+
+	async_tx_sync_prolog(flags, depend_tx);
+	d = kmap_atomic(dest, KM_USER0);
+	s = kmap_atomic(src, KM_USER1);
+	memcpy(d + dest_offset, s + src_offset, len);
+	kunmap_atomic(s, KM_USER1);
+	kunmap_atomic(d, KM_USER0);
+	async_tx_sync_epilog(callback, callback_param);
+	return NULL;
+}
+
+static void do_sync_xor(struct page *dest, struct page **src_list,
+			unsigned int offset, int src_cnt, size_t len,
+			enum async_tx_flags flags)
+{
+	void *ptr[MAX_XOR_BLOCKS];
+	int i, count;
+
+	ptr[0] = page_address(dest) + offset;
+	if (flags & ASYNC_TX_XOR_ZERO_DST)
+		memset(ptr[0], 0, len);
+
+	count = 1;
+	for (i = 0; i < src_cnt; i++) {
+		ptr[count++] = page_address(src_list[i]) + offset;
+		if (count == MAX_XOR_BLOCKS) {
+			xor_block(count, len, ptr);
+			count = 1;
+		}
+	}
+	if (count > 1)
+		xor_block(count, len, ptr);
+}
+
+/*
+ * xor @src_cnt pages into @dest.  Without ASYNC_TX_XOR_ZERO_DST the old
+ * contents of @dest are part of the result.
+ */
+struct async_tx *async_xor(struct page *dest, struct page **src_list,
+		unsigned int offset, int src_cnt, size_t len,
+		enum async_tx_flags flags, struct async_tx *depend_tx,
+		async_tx_callback callback, void *callback_param)
+{
+	struct async_tx_engine *engine;
+	struct async_tx *tx = NULL;
+
+	engine = async_tx_find_engine(ASYNC_TX_CAP_XOR);
+	if (engine && src_cnt <= engine->max_xor)
+		tx = engine->prep_xor(engine, dest, src_list, src_cnt, offset,
+				      len, flags & ASYNC_TX_XOR_ZERO_DST);
+	if (tx)
+		return async_tx_submit(engine, tx, flags, depend_tx,
+				       callback, callback_param);
+
+	async_tx_sync_prolog(flags, depend_tx);
+	do_sync_xor(dest, src_list, offset, src_cnt, len, flags);
+	async_tx_sync_epilog(callback, callback_param);
+	return NULL;
+}
+
+EXPORT_SYMBOL(async_tx_register_engine);
+EXPORT_SYMBOL(async_tx_unregister_engine);
+EXPORT_SYMBOL(async_tx_find_engine);
+EXPORT_SYMBOL(async_tx_complete);
+EXPORT_SYMBOL(async_tx_submit);
+EXPORT_SYMBOL(async_tx_sync_prolog);
+EXPORT_SYMBOL(async_tx_sync_epilog);
+EXPORT_SYMBOL(async_tx_ack);
+EXPORT_SYMBOL(async_tx_wait);
+EXPORT_SYMBOL(async_tx_issue_pending_all);
+EXPORT_SYMBOL(async_memcpy);
+EXPORT_SYMBOL(async_xor);
+MODULE_LICENSE("GPL");
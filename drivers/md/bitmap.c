@@ -0,0 +1,582 @@
+/*
+ * bitmap.c: write-intent bitmap for md arrays
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * The personality calls bitmap_startwrite() before it writes to a
+ * range of the member devices and bitmap_endwrite() once all the
+ * copies are done.  The first write to an idle chunk sets its bit and
+ * waits for the bitmap page to reach every device, later ones only
+ * count.  When a chunk goes idle its bit stays set for two passes of
+ * bitmap_daemon_work(), so a hot chunk does not cost a bitmap write
+ * per request.  Resync asks bitmap_start_sync() and skips the chunks
+ * which are idle and not marked NEEDED.
+ *
+ * The bitmap is kept after the 0.90 superblock and written to every
+ * working device along with it.  Its superblock carries the array
+ * event count; a bitmap older than the array superblock can't be
+ * trusted and makes the next resync cover everything.
+ */
+
+#include <linux/raid/md.h>
+#include <linux/raid/bitmap.h>
+
+#define PAGE_BITS		(PAGE_SIZE << 3)
+/* what the reserved area after the superblock leaves for the bits */
+#define BITMAP_MAX_BITS		((MD_RESERVED_BYTES - MD_SB_BYTES) * 8 - \
+				 BITMAP_SB_BITS)
+
+static inline bitmap_super_t *bitmap_sb(struct bitmap *bitmap)
+{
+	return page_address(bitmap->pages[0]);
+}
+
+/* bit numbers count from the start of the bitmap superblock */
+static inline int chunk_page(unsigned long chunk)
+{
+	return (chunk + BITMAP_SB_BITS) / PAGE_BITS;
+}
+
+static inline void *chunk_page_addr(struct bitmap *bitmap, unsigned long chunk)
+{
+	return page_address(bitmap->pages[chunk_page(chunk)]);
+}
+
+static inline int chunk_page_bit(unsigned long chunk)
+{
+	return (chunk + BITMAP_SB_BITS) % PAGE_BITS;
+}
+
+/* called with bitmap->lock held */
+static void set_chunk_bit(struct bitmap *bitmap, unsigned long chunk)
+{
+	ext2_set_bit(chunk_page_bit(chunk), chunk_page_addr(bitmap, chunk));
+	__set_bit(chunk_page(chunk), &bitmap->dirty);
+}
+
+static void clear_chunk_bit(struct bitmap *bitmap, unsigned long chunk)
+{
+	ext2_clear_bit(chunk_page_bit(chunk), chunk_page_addr(bitmap, chunk));
+	__set_bit(chunk_page(chunk), &bitmap->dirty);
+}
+
+static int test_chunk_bit(struct bitmap *bitmap, unsigned long chunk)
+{
+	return ext2_test_bit(chunk_page_bit(chunk),
+			     chunk_page_addr(bitmap, chunk));
+}
+
+/* bytes of page @index which are part of the bitmap, whole sectors */
+static int page_bytes(struct bitmap *bitmap, int index)
+{
+	unsigned long bits = BITMAP_SB_BITS + bitmap->chunks;
+	unsigned long bytes = ((bits + 7) / 8 + 511) & ~511UL;
+
+	bytes -= (unsigned long)index * PAGE_SIZE;
+	return bytes > PAGE_SIZE ? PAGE_SIZE : bytes;
+}
+
+static inline sector_t page_sector(struct bitmap *bitmap, mdk_rdev_t *rdev,
+				   int index)
+{
+	return (rdev->sb_offset << 1) + bitmap->offset +
+		(sector_t)index * (PAGE_SIZE >> 9);
+}
+
+static void write_page(struct bitmap *bitmap, int index)
+{
+	mddev_t *mddev = bitmap->mddev;
+	struct list_head *tmp;
+	mdk_rdev_t *rdev;
+
+	ITERATE_RDEV(mddev, rdev, tmp) {
+		char b[BDEVNAME_SIZE];
+
+		if (rdev->faulty)
+			continue;
+		if (sync_page_io(rdev->bdev, page_sector(bitmap, rdev, index),
+				 page_bytes(bitmap, index),
+				 bitmap->pages[index], WRITE))
+			continue;
+		printk(KERN_ERR "md: bitmap write failed on %s\n",
+		       bdevname(rdev->bdev, b));
+		md_error(mddev, rdev);
+	}
+}
+
+/*
+ * Write out every dirty page and return once the pages which were
+ * dirty or being written on entry are on disk.
+ */
+void bitmap_unplug(struct bitmap *bitmap)
+{
+	unsigned long dirty;
+	int i;
+
+	down(&bitmap->write_sem);
+	spin_lock_irq(&bitmap->lock);
+	dirty = bitmap->dirty;
+	bitmap->dirty = 0;
+	bitmap->writing = dirty;
+	spin_unlock_irq(&bitmap->lock);
+
+	for (i = 0; i < bitmap->nr_pages; i++)
+		if (test_bit(i, &dirty))
+			write_page(bitmap, i);
+
+	spin_lock_irq(&bitmap->lock);
+	bitmap->writing = 0;
+	spin_unlock_irq(&bitmap->lock);
+	up(&bitmap->write_sem);
+}
+
+/*
+ * Before a write to [offset, offset + sectors) of the member devices.
+ * May sleep.
+ */
+void bitmap_startwrite(struct bitmap *bitmap, sector_t offset,
+		       unsigned long sectors)
+{
+	int flush = 0;
+
+	while (sectors) {
+		unsigned long chunk = offset >> bitmap->chunkshift;
+		sector_t end = (sector_t)(chunk + 1) << bitmap->chunkshift;
+		bitmap_counter_t *bmc;
+		int page;
+
+		if (chunk >= bitmap->chunks)
+			break;
+		bmc = &bitmap->counters[chunk];
+		page = chunk_page(chunk);
+
+		spin_lock_irq(&bitmap->lock);
+		if (COUNTER(*bmc) == COUNTER_MAX) {
+			DEFINE_WAIT(wait);
+
+			prepare_to_wait(&bitmap->overflow_wait, &wait,
+					TASK_UNINTERRUPTIBLE);
+			spin_unlock_irq(&bitmap->lock);
+			schedule();
+			finish_wait(&bitmap->overflow_wait, &wait);
+			continue;
+		}
+		if (!*bmc)
+			set_chunk_bit(bitmap, chunk);
+		else if (*bmc & (PENDING_MASK | RIPE_MASK))
+			bitmap->pending--;
+		*bmc = (*bmc & NEEDED_MASK) | (COUNTER(*bmc) + 1);
+		/* our bit may be in a page which is not on disk yet */
+		if (test_bit(page, &bitmap->dirty) ||
+		    test_bit(page, &bitmap->writing))
+			flush = 1;
+		spin_unlock_irq(&bitmap->lock);
+
+		if (end - offset >= sectors)
+			break;
+		sectors -= end - offset;
+		offset = end;
+	}
+
+	if (flush)
+		bitmap_unplug(bitmap);
+}
+
+/*
+ * The write started by bitmap_startwrite() is done.  Unless every copy
+ * made it, the chunk stays dirty until it has been resynced.  Safe in
+ * interrupt context.
+ */
+void bitmap_endwrite(struct bitmap *bitmap, sector_t offset,
+		     unsigned long sectors, int success)
+{
+	unsigned long flags;
+
+	while (sectors) {
+		unsigned long chunk = offset >> bitmap->chunkshift;
+		sector_t end = (sector_t)(chunk + 1) << bitmap->chunkshift;
+		bitmap_counter_t *bmc;
+
+		if (chunk >= bitmap->chunks)
+			break;
+		bmc = &bitmap->counters[chunk];
+
+		spin_lock_irqsave(&bitmap->lock, flags);
+		if (!COUNTER(*bmc))
+			BUG();
+		if (!success)
+			*bmc |= NEEDED_MASK;
+		if (COUNTER(*bmc) == COUNTER_MAX)
+			wake_up(&bitmap->overflow_wait);
+		(*bmc)--;
+		if (!*bmc) {
+			*bmc = PENDING_MASK;
+			bitmap->pending++;
+		}
+		spin_unlock_irqrestore(&bitmap->lock, flags);
+
+		if (end - offset >= sectors)
+			break;
+		sectors -= end - offset;
+		offset = end;
+	}
+}
+
+/*
+ * Does the chunk at @offset need resyncing?  *@blocks is set to the
+ * number of sectors the answer holds for.
+ */
+int bitmap_start_sync(struct bitmap *bitmap, sector_t offset, int *blocks)
+{
+	unsigned long chunk = offset >> bitmap->chunkshift;
+	int rv;
+
+	*blocks = (((sector_t)(chunk + 1) << bitmap->chunkshift) - offset);
+	if (chunk >= bitmap->chunks)
+		return 1;
+
+	spin_lock_irq(&bitmap->lock);
+	rv = (bitmap->counters[chunk] & NEEDED_MASK) ||
+		COUNTER(bitmap->counters[chunk]);
+	spin_unlock_irq(&bitmap->lock);
+	return rv;
+}
+
+/*
+ * Resync or recovery has brought everything below @upto in sync; let
+ * the bits of the chunks wholly below it be cleared.
+ */
+void bitmap_close_sync(struct bitmap *bitmap, sector_t upto)
+{
+	unsigned long chunk, last;
+
+	if (upto >= bitmap->mddev->size << 1)
+		last = bitmap->chunks;
+	else
+		last = upto >> bitmap->chunkshift;
+
+	spin_lock_irq(&bitmap->lock);
+	for (chunk = 0; chunk < last; chunk++) {
+		bitmap_counter_t *bmc = &bitmap->counters[chunk];
+
+		if (!(*bmc & NEEDED_MASK))
+			continue;
+		*bmc &= ~NEEDED_MASK;
+		if (!*bmc) {
+			*bmc = PENDING_MASK;
+			bitmap->pending++;
+		}
+	}
+	spin_unlock_irq(&bitmap->lock);
+}
+
+/*
+ * Called by the personality's thread, which md wakes at least every
+ * daemon_sleep.  Bits of chunks idle since the last pass are cleared.
+ */
+void bitmap_daemon_work(struct bitmap *bitmap)
+{
+	unsigned long chunk;
+
+	if (!bitmap ||
+	    time_before(jiffies, bitmap->daemon_lastrun + bitmap->daemon_sleep))
+		return;
+	bitmap->daemon_lastrun = jiffies;
+	if (!bitmap->pending)
+		return;
+
+	for (chunk = 0; chunk < bitmap->chunks; ) {
+		/* one page of bits at a time, not to hold the lock for long */
+		unsigned long end = chunk + PAGE_BITS - chunk_page_bit(chunk);
+
+		if (end > bitmap->chunks)
+			end = bitmap->chunks;
+		spin_lock_irq(&bitmap->lock);
+		for (; chunk < end; chunk++) {
+			bitmap_counter_t *bmc = &bitmap->counters[chunk];
+
+			if (*bmc == PENDING_MASK)
+				*bmc = RIPE_MASK;
+			else if (*bmc == RIPE_MASK) {
+				*bmc = 0;
+				clear_chunk_bit(bitmap, chunk);
+				bitmap->pending--;
+			}
+		}
+		spin_unlock_irq(&bitmap->lock);
+	}
+
+	if (bitmap->dirty)
+		bitmap_unplug(bitmap);
+}
+
+/* called with the array locked, before the superblocks are written */
+void bitmap_update_sb(struct bitmap *bitmap)
+{
+	if (!bitmap)
+		return;
+	spin_lock_irq(&bitmap->lock);
+	bitmap_sb(bitmap)->events = cpu_to_le64(bitmap->mddev->events);
+	__set_bit(0, &bitmap->dirty);
+	spin_unlock_irq(&bitmap->lock);
+	bitmap_unplug(bitmap);
+}
+
+void bitmap_status(struct seq_file *seq, struct bitmap *bitmap)
+{
+	unsigned long chunk, dirty = 0;
+
+	spin_lock_irq(&bitmap->lock);
+	for (chunk = 0; chunk < bitmap->chunks; chunk++)
+		if (bitmap->counters[chunk])
+			dirty++;
+	spin_unlock_irq(&bitmap->lock);
+
+	seq_printf(seq, "\n      bitmap: %lu/%lu chunks dirty, %dKB chunk",
+		   dirty, bitmap->chunks, 1 << (bitmap->chunkshift - 1));
+}
+
+static void bitmap_free(struct bitmap *bitmap)
+{
+	int i;
+
+	if (bitmap->pages) {
+		for (i = 0; i < bitmap->nr_pages; i++)
+			if (bitmap->pages[i])
+				__free_page(bitmap->pages[i]);
+		kfree(bitmap->pages);
+	}
+	vfree(bitmap->counters);
+	kfree(bitmap);
+}
+
+static int bitmap_alloc_pages(struct bitmap *bitmap)
+{
+	int i;
+
+	bitmap->nr_pages = (BITMAP_SB_BITS + bitmap->chunks + PAGE_BITS - 1)
+		/ PAGE_BITS;
+	bitmap->pages = kmalloc(bitmap->nr_pages * sizeof(struct page *),
+				GFP_KERNEL);
+	if (!bitmap->pages)
+		return -ENOMEM;
+	memset(bitmap->pages, 0, bitmap->nr_pages * sizeof(struct page *));
+	for (i = 0; i < bitmap->nr_pages; i++) {
+		bitmap->pages[i] = alloc_page(GFP_KERNEL);
+		if (!bitmap->pages[i])
+			return -ENOMEM;
+		memset(page_address(bitmap->pages[i]), 0, PAGE_SIZE);
+	}
+
+	bitmap->counters = vmalloc(bitmap->chunks * sizeof(bitmap_counter_t));
+	if (!bitmap->counters)
+		return -ENOMEM;
+	memset(bitmap->counters, 0, bitmap->chunks * sizeof(bitmap_counter_t));
+	return 0;
+}
+
+/* the bitmap superblock, from the first working device */
+static int bitmap_read_sb(struct bitmap *bitmap, struct page *page)
+{
+	mddev_t *mddev = bitmap->mddev;
+	struct list_head *tmp;
+	mdk_rdev_t *rdev;
+
+	ITERATE_RDEV(mddev, rdev, tmp) {
+		if (rdev->faulty || !rdev->in_sync)
+			continue;
+		if (sync_page_io(rdev->bdev, page_sector(bitmap, rdev, 0),
+				 512, page, READ))
+			return 0;
+	}
+	return -EIO;
+}
+
+static int bitmap_read(struct bitmap *bitmap)
+{
+	mddev_t *mddev = bitmap->mddev;
+	struct list_head *tmp;
+	mdk_rdev_t *rdev;
+	int i;
+
+	ITERATE_RDEV(mddev, rdev, tmp) {
+		if (rdev->faulty || !rdev->in_sync)
+			continue;
+		for (i = 0; i < bitmap->nr_pages; i++)
+			if (!sync_page_io(rdev->bdev,
+					  page_sector(bitmap, rdev, i),
+					  page_bytes(bitmap, i),
+					  bitmap->pages[i], READ))
+				break;
+		if (i == bitmap->nr_pages)
+			return 0;
+	}
+	return -EIO;
+}
+
+/* the chunk size giving the finest bitmap which fits */
+static int bitmap_chunkshift(sector_t sectors)
+{
+	int shift = BITMAP_MIN_CHUNK_SHIFT;
+
+	while ((sectors >> shift) >= BITMAP_MAX_BITS)
+		shift++;
+	return shift;
+}
+
+/*
+ * Set up the bitmap of @mddev before the personality runs.  A fresh
+ * bitmap is written out with every chunk marked in need of resync,
+ * unless the array is clean; otherwise it is read from the devices.
+ */
+int bitmap_create(mddev_t *mddev, int fresh)
+{
+	struct bitmap *bitmap;
+	bitmap_super_t *sb = NULL;
+	sector_t sectors = mddev->size << 1;
+	unsigned long chunk;
+	int stale = 0, err;
+	struct page *first;
+
+	if (mddev->major_version != 0 || !mddev->persistent) {
+		printk(KERN_ERR "%s: bitmaps need 0.90 superblocks\n",
+		       mdname(mddev));
+		return -EINVAL;
+	}
+	if (mddev->level != 1 && mddev->level != 4 && mddev->level != 5) {
+		printk(KERN_ERR "%s: no bitmap support for raid level %d\n",
+		       mdname(mddev), mddev->level);
+		return -EINVAL;
+	}
+
+	bitmap = kmalloc(sizeof(*bitmap), GFP_KERNEL);
+	if (!bitmap)
+		return -ENOMEM;
+	memset(bitmap, 0, sizeof(*bitmap));
+	bitmap->mddev = mddev;
+	bitmap->offset = mddev->bitmap_offset;
+	spin_lock_init(&bitmap->lock);
+	init_MUTEX(&bitmap->write_sem);
+	init_waitqueue_head(&bitmap->overflow_wait);
+
+	if (fresh) {
+		bitmap->chunkshift = bitmap_chunkshift(sectors);
+		bitmap->daemon_sleep = BITMAP_DAEMON_SLEEP;
+	} else {
+		/* geometry comes from the bitmap superblock */
+		err = -ENOMEM;
+		first = alloc_page(GFP_KERNEL);
+		if (!first)
+			goto out;
+		err = bitmap_read_sb(bitmap, first);
+		sb = page_address(first);
+		if (!err &&
+		    (le32_to_cpu(sb->magic) != BITMAP_MAGIC ||
+		     le32_to_cpu(sb->version) != BITMAP_MAJOR ||
+		     memcmp(sb->uuid, mddev->uuid, 16) ||
+		     le64_to_cpu(sb->sync_size) != sectors ||
+		     le32_to_cpu(sb->chunksize) < (512 << BITMAP_MIN_CHUNK_SHIFT) ||
+		     (le32_to_cpu(sb->chunksize) &
+		      (le32_to_cpu(sb->chunksize) - 1)))) {
+			printk(KERN_ERR "%s: invalid bitmap superblock\n",
+			       mdname(mddev));
+			err = -EINVAL;
+		}
+		if (err) {
+			__free_page(first);
+			goto out;
+		}
+		bitmap->chunkshift = ffz(~le32_to_cpu(sb->chunksize)) - 9;
+		bitmap->daemon_sleep = le32_to_cpu(sb->daemon_sleep);
+		stale = le64_to_cpu(sb->events) < mddev->events;
+		__free_page(first);
+		if ((sectors >> bitmap->chunkshift) >= BITMAP_MAX_BITS) {
+			printk(KERN_ERR "%s: bitmap chunks too small\n",
+			       mdname(mddev));
+			err = -EINVAL;
+			goto out;
+		}
+	}
+	if (bitmap->daemon_sleep < 1 || bitmap->daemon_sleep > 15)
+		bitmap->daemon_sleep = BITMAP_DAEMON_SLEEP;
+	bitmap->chunks = (sectors + (1 << bitmap->chunkshift) - 1)
+		>> bitmap->chunkshift;
+
+	err = bitmap_alloc_pages(bitmap);
+	if (err)
+		goto out;
+
+	if (!fresh) {
+		err = bitmap_read(bitmap);
+		if (err)
+			goto out;
+	}
+
+	sb = bitmap_sb(bitmap);
+	if (fresh) {
+		sb->magic = cpu_to_le32(BITMAP_MAGIC);
+		sb->version = cpu_to_le32(BITMAP_MAJOR);
+		memcpy(sb->uuid, mddev->uuid, 16);
+		sb->sync_size = cpu_to_le64(sectors);
+		sb->chunksize = cpu_to_le32(512 << bitmap->chunkshift);
+		sb->daemon_sleep = cpu_to_le32(bitmap->daemon_sleep);
+	}
+	sb->events = cpu_to_le64(mddev->events);
+
+	if (stale)
+		printk(KERN_WARNING "%s: bitmap is out of date, "
+		       "resyncing everything\n", mdname(mddev));
+
+	/*
+	 * A set bit means the chunk may be out of sync, unless the array
+	 * was shut down cleanly.  A new or stale bitmap can't tell which
+	 * chunks those are, so all of them are if the array is dirty.
+	 */
+	for (chunk = 0; chunk < bitmap->chunks; chunk++) {
+		int set;
+
+		if (fresh || stale)
+			set = mddev->recovery_cp != MaxSector;
+		else
+			set = test_chunk_bit(bitmap, chunk);
+		if (!set) {
+			clear_chunk_bit(bitmap, chunk);
+			continue;
+		}
+		set_chunk_bit(bitmap, chunk);
+		if (mddev->recovery_cp == MaxSector) {
+			bitmap->counters[chunk] = PENDING_MASK;
+			bitmap->pending++;
+		} else
+			bitmap->counters[chunk] = NEEDED_MASK;
+	}
+
+	bitmap->daemon_sleep *= HZ;
+	bitmap->daemon_lastrun = jiffies;
+	bitmap->dirty = (1UL << bitmap->nr_pages) - 1;
+	mddev->bitmap = bitmap;
+	bitmap_unplug(bitmap);
+
+	printk(KERN_INFO "%s: bitmap of %lu chunks of %dKB\n", mdname(mddev),
+	       bitmap->chunks, 1 << (bitmap->chunkshift - 1));
+	return 0;
+
+ out:
+	bitmap_free(bitmap);
+	return err;
+}
+
+/* once the personality has stopped, no writes are in flight */
+void bitmap_destroy(mddev_t *mddev)
+{
+	struct bitmap *bitmap = mddev->bitmap;
+
+	if (!bitmap)
+		return;
+	bitmap_unplug(bitmap);
+	mddev->bitmap = NULL;
+	bitmap_free(bitmap);
+}
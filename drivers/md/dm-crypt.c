@@ -14,6 +14,7 @@
 #include <linux/slab.h>
 #include <linux/crypto.h>
 #include <linux/workqueue.h>
+#include <linux/completion.h>
 #include <asm/atomic.h>
 #include <asm/scatterlist.h>
 #include <asm/page.h>
@@ -22,6 +23,16 @@
 
 #define PFX	"crypt: "
 
+/*
+ * A conversion spread over several CPUs: done() runs once the last
+ * unit of it has been converted
+ */
+struct crypt_job {
+	atomic_t pending;
+	int error;
+	void (*done)(struct crypt_job *job);
+};
+
 /*
  * per bio private data
  */
@@ -30,6 +41,7 @@ struct crypt_io {
 	struct bio *bio;
 	struct bio *first_clone;
 	struct work_struct work;
+	struct crypt_job job;		/* decryption of a read */
 	atomic_t pending;
 	int error;
 };
@@ -48,6 +60,17 @@ struct convert_context {
 	int write;
 };
 
+/*
+ * a run of sectors of a job, converted by kcryptd on another CPU
+ */
+struct crypt_unit {
+	struct work_struct work;
+	struct crypt_config *cc;
+	struct crypt_job *job;
+	struct convert_context ctx;
+	unsigned int sectors;
+};
+
 struct crypt_config;
 
 struct crypt_iv_operations {
@@ -91,7 +114,14 @@ struct crypt_config {
 #define MIN_POOL_PAGES 32
 #define MIN_BIO_PAGES  8
 
+/*
+ * conversions are only split up if every CPU gets at least this much,
+ * below that queueing costs more than it saves
+ */
+#define MIN_UNIT_SECTORS 16
+
 static kmem_cache_t *_crypt_io_pool;
+static kmem_cache_t *_crypt_unit_cache;
 
 /*
  * Mempool alloc and free functions for the page
@@ -274,14 +304,17 @@ crypt_convert_init(struct crypt_config *cc, struct convert_context *ctx,
 }
 
 /*
- * Encrypt / decrypt data from one bio to another one (can be the same one)
+ * Encrypt / decrypt up to the given number of sectors from one bio
+ * to another one (can be the same one), or just step over them
  */
-static int crypt_convert(struct crypt_config *cc,
-                         struct convert_context *ctx)
+static int crypt_convert_sectors(struct crypt_config *cc,
+                                 struct convert_context *ctx,
+                                 unsigned int sectors, int skip)
 {
 	int r = 0;
 
-	while(ctx->idx_in < ctx->bio_in->bi_vcnt &&
+	while(sectors-- &&
+	      ctx->idx_in < ctx->bio_in->bi_vcnt &&
 	      ctx->idx_out < ctx->bio_out->bi_vcnt) {
 		struct bio_vec *bv_in = bio_iovec_idx(ctx->bio_in, ctx->idx_in);
 		struct bio_vec *bv_out = bio_iovec_idx(ctx->bio_out, ctx->idx_out);
@@ -308,10 +341,13 @@ static int crypt_convert(struct crypt_config *cc,
 			ctx->idx_out++;
 		}
 
-		r = crypt_convert_scatterlist(cc, &sg_out, &sg_in, sg_in.length,
-		                              ctx->write, ctx->sector);
-		if (r < 0)
-			break;
+		if (!skip) {
+			r = crypt_convert_scatterlist(cc, &sg_out, &sg_in,
+			                              sg_in.length, ctx->write,
+			                              ctx->sector);
+			if (r < 0)
+				break;
+		}
 
 		ctx->sector++;
 	}
@@ -319,6 +355,118 @@ static int crypt_convert(struct crypt_config *cc,
 	return r;
 }
 
+/*
+ * Encrypt / decrypt data from one bio to another one (can be the same one)
+ */
+static inline int crypt_convert(struct crypt_config *cc,
+                                struct convert_context *ctx)
+{
+	return crypt_convert_sectors(cc, ctx, ~0U, 0);
+}
+
+static void crypt_job_put(struct crypt_job *job, int error)
+{
+	if (error < 0)
+		job->error = error;
+
+	if (atomic_dec_and_test(&job->pending))
+		job->done(job);
+}
+
+static struct workqueue_struct *_kcryptd_workqueue;
+
+static void kcryptd_do_unit(void *data)
+{
+	struct crypt_unit *unit = (struct crypt_unit *) data;
+	struct crypt_job *job = unit->job;
+	int r;
+
+	r = crypt_convert_sectors(unit->cc, &unit->ctx, unit->sectors, 0);
+	kmem_cache_free(_crypt_unit_cache, unit);
+
+	crypt_job_put(job, r);
+}
+
+/*
+ * Convert the next @sectors of @ctx, handing equal runs of them to
+ * kcryptd on the other online CPUs and doing the last one here.
+ * Sectors are independent of each other (every one has its own IV),
+ * so the runs can be done in any order.  When the job is done, @ctx
+ * has moved on past all of them, as after crypt_convert().
+ *
+ * Units are allocated without waiting; if there are none to be had the
+ * rest is simply converted by the caller.
+ */
+static void crypt_convert_job(struct crypt_config *cc,
+                              struct convert_context *ctx,
+                              unsigned int sectors, struct crypt_job *job)
+{
+	unsigned int per_cpu = sectors / num_online_cpus();
+	int cpu = -1;
+	int r;
+
+	atomic_set(&job->pending, 1); /* our own share */
+	job->error = 0;
+
+	if (per_cpu < MIN_UNIT_SECTORS)
+		per_cpu = MIN_UNIT_SECTORS;
+
+	while (sectors > per_cpu) {
+		struct crypt_unit *unit;
+
+		unit = kmem_cache_alloc(_crypt_unit_cache,
+		                        (GFP_NOIO & ~__GFP_WAIT) | __GFP_NOWARN);
+		if (!unit)
+			break;
+
+		unit->cc = cc;
+		unit->job = job;
+		unit->ctx = *ctx;
+		unit->sectors = per_cpu;
+		crypt_convert_sectors(cc, ctx, per_cpu, 1);
+		sectors -= per_cpu;
+
+		cpu = next_cpu(cpu, cpu_online_map);
+		if (cpu >= NR_CPUS)
+			cpu = first_cpu(cpu_online_map);
+
+		atomic_inc(&job->pending);
+		INIT_WORK(&unit->work, kcryptd_do_unit, unit);
+		queue_work_on(cpu, _kcryptd_workqueue, &unit->work);
+	}
+
+	r = crypt_convert(cc, ctx);
+	crypt_job_put(job, r);
+}
+
+/*
+ * The same for a caller which can sleep until the whole job is done.
+ */
+struct crypt_sync_job {
+	struct crypt_job job;
+	struct completion done;
+};
+
+static void crypt_sync_job_done(struct crypt_job *job)
+{
+	complete(&container_of(job, struct crypt_sync_job, job)->done);
+}
+
+static int crypt_convert_wait(struct crypt_config *cc,
+                              struct convert_context *ctx,
+                              unsigned int sectors)
+{
+	struct crypt_sync_job sync;
+
+	sync.job.done = crypt_sync_job_done;
+	init_completion(&sync.done);
+
+	crypt_convert_job(cc, ctx, sectors, &sync.job);
+	wait_for_completion(&sync.done);
+
+	return sync.job.error;
+}
+
 /*
  * Generate a new unfragmented bio with the given size
  * This should never violate the device limitations
@@ -464,22 +612,27 @@ static void dec_pending(struct crypt_io *io, int error)
  *
  * Needed because it would be very unwise to do decryption in an
  * interrupt context, so bios returning from read requests get
- * queued here.
+ * queued here.  Large reads are decrypted on all CPUs at once, and
+ * completed by whichever finishes last.
  */
-static struct workqueue_struct *_kcryptd_workqueue;
+static void kcryptd_read_done(struct crypt_job *job)
+{
+	struct crypt_io *io = container_of(job, struct crypt_io, job);
+
+	dec_pending(io, job->error);
+}
 
 static void kcryptd_do_work(void *data)
 {
 	struct crypt_io *io = (struct crypt_io *) data;
 	struct crypt_config *cc = (struct crypt_config *) io->target->private;
 	struct convert_context ctx;
-	int r;
 
 	crypt_convert_init(cc, &ctx, io->bio, io->bio,
 	                   io->bio->bi_sector - io->target->begin, 0);
-	r = crypt_convert(cc, &ctx);
 
-	dec_pending(io, r);
+	io->job.done = kcryptd_read_done;
+	crypt_convert_job(cc, &ctx, bio_sectors(io->bio), &io->job);
 }
 
 static void kcryptd_queue_io(struct crypt_io *io)
@@ -765,7 +918,8 @@ crypt_clone(struct crypt_config *cc, struct crypt_io *io, struct bio *bio,
                                  io->first_clone, bvec_idx);
 		if (clone) {
 			ctx->bio_out = clone;
-			if (crypt_convert(cc, ctx) < 0) {
+			if (crypt_convert_wait(cc, ctx,
+			                       bio_sectors(clone)) < 0) {
 				crypt_free_buffer_pages(cc, clone,
 				                        clone->bi_size);
 				bio_put(clone);
@@ -936,23 +1090,33 @@ static int __init dm_crypt_init(void)
 	if (!_crypt_io_pool)
 		return -ENOMEM;
 
+	_crypt_unit_cache = kmem_cache_create("dm-crypt_unit",
+	                                      sizeof(struct crypt_unit),
+	                                      0, 0, NULL, NULL);
+	if (!_crypt_unit_cache) {
+		r = -ENOMEM;
+		goto bad1;
+	}
+
 	_kcryptd_workqueue = create_workqueue("kcryptd");
 	if (!_kcryptd_workqueue) {
 		r = -ENOMEM;
 		DMERR(PFX "couldn't create kcryptd");
-		goto bad1;
+		goto bad2;
 	}
 
 	r = dm_register_target(&crypt_target);
 	if (r < 0) {
 		DMERR(PFX "register failed %d", r);
-		goto bad2;
+		goto bad3;
 	}
 
 	return 0;
 
-bad2:
+bad3:
 	destroy_workqueue(_kcryptd_workqueue);
+bad2:
+	kmem_cache_destroy(_crypt_unit_cache);
 bad1:
 	kmem_cache_destroy(_crypt_io_pool);
 	return r;
@@ -966,6 +1130,7 @@ static void __exit dm_crypt_exit(void)
 		DMERR(PFX "unregister failed %d", r);
 
 	destroy_workqueue(_kcryptd_workqueue);
+	kmem_cache_destroy(_crypt_unit_cache);
 	kmem_cache_destroy(_crypt_io_pool);
 }
 
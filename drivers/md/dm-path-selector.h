@@ -75,7 +75,14 @@ struct path_selector_type {
 	int (*status) (struct path_selector *ps, struct path *path,
 		       status_type_t type, char *result, unsigned int maxlen);
 
-	int (*end_io) (struct path_selector *ps, struct path *path);
+	/*
+	 * Optional: told about each io of nr_bytes sent down the path
+	 * and about its completion, which may be in interrupt context.
+	 */
+	int (*start_io) (struct path_selector *ps, struct path *path,
+			 size_t nr_bytes);
+	int (*end_io) (struct path_selector *ps, struct path *path,
+		       size_t nr_bytes);
 };
 
 /* Register a path selector */
@@ -63,6 +63,12 @@ struct pending_exception {
 	 * kcopyd.
 	 */
 	int started;
+
+	/*
+	 * Next of the exceptions copied from the origin by the
+	 * same kcopyd job, see start_copies().
+	 */
+	struct pending_exception *copy_next;
 };
 
 /*
@@ -194,11 +200,13 @@ static void unregister_snapshot(struct dm_snapshot *s)
 /*
  * Implementation of the exception hash tables.
  */
-static int init_exception_table(struct exception_table *et, uint32_t size)
+static int init_exception_table(struct exception_table *et, uint32_t size,
+				unsigned hash_shift)
 {
 	unsigned int i;
 
 	et->hash_mask = size - 1;
+	et->hash_shift = hash_shift;
 	et->table = dm_vcalloc(size, sizeof(struct list_head));
 	if (!et->table)
 		return -ENOMEM;
@@ -226,9 +234,14 @@ static void exit_exception_table(struct exception_table *et, kmem_cache_t *mem)
 	vfree(et->table);
 }
 
+/*
+ * With a hash_shift, runs of chunks share a bucket, so that
+ * consecutive exceptions can be merged.  A run never extends past
+ * its bucket, see insert_completed_exception().
+ */
 static inline uint32_t exception_hash(struct exception_table *et, chunk_t chunk)
 {
-	return chunk & et->hash_mask;
+	return (chunk >> et->hash_shift) & et->hash_mask;
 }
 
 static void insert_exception(struct exception_table *eh, struct exception *e)
@@ -254,7 +267,8 @@ static struct exception *lookup_exception(struct exception_table *et,
 
 	slot = &et->table[exception_hash(et, chunk)];
 	list_for_each_entry (e, slot, hash_list)
-		if (e->old_chunk == chunk)
+		if (chunk >= e->old_chunk &&
+		    chunk <= e->old_chunk + e->consecutive)
 			return e;
 
 	return NULL;
@@ -286,6 +300,42 @@ static inline void free_pending_exception(struct pending_exception *pe)
 	mempool_free(pe, pending_pool);
 }
 
+/*
+ * Add a completed exception, merging it into an exception of the
+ * same bucket it extends at either end.  new_e is freed if merged.
+ */
+static void insert_completed_exception(struct exception_table *eh,
+				       struct exception *new_e)
+{
+	struct list_head *l = &eh->table[exception_hash(eh, new_e->old_chunk)];
+	struct exception *e;
+
+	list_for_each_entry (e, l, hash_list) {
+		if (e->consecutive >= DM_MAX_CONSECUTIVE_CHUNKS)
+			continue;
+
+		/* just after e */
+		if (new_e->old_chunk == e->old_chunk + e->consecutive + 1 &&
+		    new_e->new_chunk == e->new_chunk + e->consecutive + 1) {
+			e->consecutive++;
+			free_exception(new_e);
+			return;
+		}
+
+		/* just before e */
+		if (new_e->old_chunk == e->old_chunk - 1 &&
+		    new_e->new_chunk == e->new_chunk - 1) {
+			e->consecutive++;
+			e->old_chunk--;
+			e->new_chunk--;
+			free_exception(new_e);
+			return;
+		}
+	}
+
+	list_add(&new_e->hash_list, l);
+}
+
 int dm_add_exception(struct dm_snapshot *s, chunk_t old, chunk_t new)
 {
 	struct exception *e;
@@ -296,7 +346,8 @@ int dm_add_exception(struct dm_snapshot *s, chunk_t old, chunk_t new)
 
 	e->old_chunk = old;
 	e->new_chunk = new;
-	insert_exception(&s->complete, e);
+	e->consecutive = 0;
+	insert_completed_exception(&s->complete, e);
 	return 0;
 }
 
@@ -327,7 +378,7 @@ static inline uint32_t round_down(uint32_t n)
  */
 static int init_hash_tables(struct dm_snapshot *s)
 {
-	sector_t hash_size, cow_dev_size, origin_dev_size, max_buckets;
+	sector_t hash_size, cow_dev_size, origin_dev_size, max_buckets, chunks;
 
 	/*
 	 * Calculate based on the size of the original volume or
@@ -337,23 +388,30 @@ static int init_hash_tables(struct dm_snapshot *s)
 	origin_dev_size = get_dev_size(s->origin->bdev);
 	max_buckets = calc_max_buckets();
 
-	hash_size = min(origin_dev_size, cow_dev_size) >> s->chunk_shift;
-	hash_size = min(hash_size, max_buckets);
+	chunks = min(origin_dev_size, cow_dev_size) >> s->chunk_shift;
 
-	/* Round it down to a power of 2 */
+	/*
+	 * A bucket of the completed exceptions holds a run of
+	 * 2^DM_CHUNK_CONSECUTIVE_BITS chunks, so it needs that
+	 * many times fewer buckets.  Round it down to a power of 2.
+	 */
+	hash_size = min(chunks >> DM_CHUNK_CONSECUTIVE_BITS, max_buckets);
 	hash_size = round_down(hash_size);
-	if (init_exception_table(&s->complete, hash_size))
+	if (hash_size < 64)
+		hash_size = 64;
+	if (init_exception_table(&s->complete, hash_size,
+				 DM_CHUNK_CONSECUTIVE_BITS))
 		return -ENOMEM;
 
 	/*
 	 * Allocate hash table for in-flight exceptions
-	 * Make this smaller than the real hash table
+	 * Make this smaller than a table of all the chunks
 	 */
-	hash_size >>= 3;
+	hash_size = round_down(min(chunks, max_buckets)) >> 3;
 	if (hash_size < 64)
 		hash_size = 64;
 
-	if (init_exception_table(&s->pending, hash_size)) {
+	if (init_exception_table(&s->pending, hash_size, 0)) {
 		exit_exception_table(&s->complete, exception_cache);
 		return -ENOMEM;
 	}
@@ -619,8 +677,8 @@ static void pending_complete(struct pending_exception *pe, int success)
 		 * in-flight exception from the list.
 		 */
 		down_write(&s->lock);
-		insert_exception(&s->complete, e);
 		remove_exception(&pe->e);
+		insert_completed_exception(&s->complete, e);
 		flush = __flush_bios(pe);
 
 		/* Submit any pending write bios */
@@ -657,46 +715,91 @@ static void commit_callback(void *context, int success)
 }
 
 /*
- * Called when the copy I/O has finished.  kcopyd actually runs
- * this code so don't block.
+ * Called when the copy I/O has finished, for the exceptions of
+ * one kcopyd job: write_err has a bit for each of their COW
+ * devices.  kcopyd actually runs this code so don't block.
  */
 static void copy_callback(int read_err, unsigned int write_err, void *context)
 {
 	struct pending_exception *pe = (struct pending_exception *) context;
-	struct dm_snapshot *s = pe->snap;
+	struct pending_exception *next;
+	struct dm_snapshot *s;
+	unsigned int i;
 
-	if (read_err || write_err)
-		pending_complete(pe, 0);
+	for (i = 0; pe; i++, pe = next) {
+		next = pe->copy_next;
+		s = pe->snap;
 
-	else
-		/* Update the metadata if we are persistent */
-		s->store.commit_exception(&s->store, &pe->e, commit_callback,
-					  pe);
+		if (read_err || (write_err & (1 << i)))
+			pending_complete(pe, 0);
+
+		else
+			/* Update the metadata if we are persistent */
+			s->store.commit_exception(&s->store, &pe->e,
+						  commit_callback, pe);
+	}
 }
 
 /*
- * Dispatches the copy operation to kcopyd.
+ * Dispatches the copy operations of a copy_next list of
+ * exceptions to kcopyd.  Exceptions of snapshots with the same
+ * chunk size need the same origin chunk, so they share one job
+ * which reads it once and writes it to each of their COW devices.
  */
-static inline void start_copy(struct pending_exception *pe)
+static void start_copies(struct pending_exception *pe)
 {
-	struct dm_snapshot *s = pe->snap;
-	struct io_region src, dest;
-	struct block_device *bdev = s->origin->bdev;
+	struct io_region src, dests[KCOPYD_MAX_REGIONS];
+	struct pending_exception *job, *rest, **tail, **pp;
+	struct dm_snapshot *s;
+	struct block_device *bdev;
 	sector_t dev_size;
+	unsigned int n;
+
+	for (rest = pe; rest; ) {
+		/* move the exceptions of the same chunk size to the job */
+		job = rest;
+		rest = rest->copy_next;
+		job->copy_next = NULL;
+		tail = &job->copy_next;
+		n = 1;
+		for (pp = &rest; *pp && n < KCOPYD_MAX_REGIONS; ) {
+			pe = *pp;
+			if (pe->snap->chunk_size != job->snap->chunk_size) {
+				pp = &pe->copy_next;
+				continue;
+			}
+			*pp = pe->copy_next;
+			pe->copy_next = NULL;
+			*tail = pe;
+			tail = &pe->copy_next;
+			n++;
+		}
 
-	dev_size = get_dev_size(bdev);
+		s = job->snap;
+		bdev = s->origin->bdev;
+		dev_size = get_dev_size(bdev);
 
-	src.bdev = bdev;
-	src.sector = chunk_to_sector(s, pe->e.old_chunk);
-	src.count = min(s->chunk_size, dev_size - src.sector);
+		src.bdev = bdev;
+		src.sector = chunk_to_sector(s, job->e.old_chunk);
+		src.count = min(s->chunk_size, dev_size - src.sector);
 
-	dest.bdev = s->cow->bdev;
-	dest.sector = chunk_to_sector(s, pe->e.new_chunk);
-	dest.count = src.count;
+		for (n = 0, pe = job; pe; n++, pe = pe->copy_next) {
+			dests[n].bdev = pe->snap->cow->bdev;
+			dests[n].sector = chunk_to_sector(pe->snap,
+							  pe->e.new_chunk);
+			dests[n].count = src.count;
+		}
 
-	/* Hand over to kcopyd */
-	kcopyd_copy(s->kcopyd_client,
-		    &src, 1, &dest, 0, copy_callback, pe);
+		/* Hand over to kcopyd */
+		kcopyd_copy(s->kcopyd_client,
+			    &src, n, dests, 0, copy_callback, job);
+	}
+}
+
+static inline void start_copy(struct pending_exception *pe)
+{
+	pe->copy_next = NULL;
+	start_copies(pe);
 }
 
 /*
@@ -737,6 +840,7 @@ __find_pending_exception(struct dm_snapshot *s, struct bio *bio)
 			pe = container_of(e, struct pending_exception, e);
 		} else {
 			pe->e.old_chunk = chunk;
+			pe->e.consecutive = 0;
 			bio_list_init(&pe->origin_bios);
 			bio_list_init(&pe->snapshot_bios);
 			INIT_LIST_HEAD(&pe->siblings);
@@ -757,10 +861,11 @@ __find_pending_exception(struct dm_snapshot *s, struct bio *bio)
 }
 
 static inline void remap_exception(struct dm_snapshot *s, struct exception *e,
-				   struct bio *bio)
+				   struct bio *bio, chunk_t chunk)
 {
 	bio->bi_bdev = s->cow->bdev;
-	bio->bi_sector = chunk_to_sector(s, e->new_chunk) +
+	bio->bi_sector = chunk_to_sector(s, e->new_chunk +
+					 (chunk - e->old_chunk)) +
 		(bio->bi_sector & s->chunk_mask);
 }
 
@@ -793,7 +898,7 @@ static int snapshot_map(struct dm_target *ti, struct bio *bio,
 		/* If the block is already remapped - use that, else remap it */
 		e = lookup_exception(&s->complete, chunk);
 		if (e) {
-			remap_exception(s, e, bio);
+			remap_exception(s, e, bio, chunk);
 			up_write(&s->lock);
 
 		} else {
@@ -806,7 +911,7 @@ static int snapshot_map(struct dm_target *ti, struct bio *bio,
 				r = -EIO;
 				up_write(&s->lock);
 			} else {
-				remap_exception(s, &pe->e, bio);
+				remap_exception(s, &pe->e, bio, chunk);
 				bio_list_add(&pe->snapshot_bios, bio);
 
 				if (!pe->started) {
@@ -834,7 +939,7 @@ static int snapshot_map(struct dm_target *ti, struct bio *bio,
 		/* See if it it has been remapped */
 		e = lookup_exception(&s->complete, chunk);
 		if (e)
-			remap_exception(s, e, bio);
+			remap_exception(s, e, bio, chunk);
 		else
 			bio->bi_bdev = s->origin->bdev;
 
@@ -921,7 +1026,7 @@ static int __origin_write(struct list_head *snapshots, struct bio *bio)
 	int r = 1, first = 1;
 	struct dm_snapshot *snap;
 	struct exception *e;
-	struct pending_exception *pe, *last = NULL;
+	struct pending_exception *pe, *last = NULL, *copies = NULL;
 	chunk_t chunk;
 
 	/* Do all the snapshots on this origin */
@@ -965,7 +1070,9 @@ static int __origin_write(struct list_head *snapshots, struct bio *bio)
 	}
 
 	/*
-	 * Now that we have a complete pe list we can start the copying.
+	 * Now that we have a complete pe list we can start the copying,
+	 * once the list has been walked: a started copy can complete
+	 * and take its pe off the list at any time.
 	 */
 	if (last) {
 		pe = last;
@@ -975,15 +1082,17 @@ static int __origin_write(struct list_head *snapshots, struct bio *bio)
 				bio_list_add(&pe->origin_bios, bio);
 			if (!pe->started) {
 				pe->started = 1;
-				up_write(&pe->snap->lock);
-				start_copy(pe);
-			} else
-				up_write(&pe->snap->lock);
+				pe->copy_next = copies;
+				copies = pe;
+			}
+			up_write(&pe->snap->lock);
 			first = 0;
 			pe = list_entry(pe->siblings.next,
 					struct pending_exception, siblings);
 
 		} while (pe != last);
+
+		start_copies(copies);
 	}
 
 	return r;
@@ -14,6 +14,7 @@
 
 struct exception_table {
 	uint32_t hash_mask;
+	unsigned hash_shift;
 	struct list_head *table;
 };
 
@@ -26,13 +27,19 @@ typedef sector_t chunk_t;
 
 /*
  * An exception is used where an old chunk of data has been
- * replaced by a new one.
+ * replaced by a new one.  One exception can stand for a run of
+ * chunks which are consecutive both on the origin and on the COW
+ * device: 'consecutive' is the number of chunks after the first.
  */
+#define DM_CHUNK_CONSECUTIVE_BITS 4
+#define DM_MAX_CONSECUTIVE_CHUNKS ((1 << DM_CHUNK_CONSECUTIVE_BITS) - 1)
+
 struct exception {
 	struct list_head hash_list;
 
 	chunk_t old_chunk;
 	chunk_t new_chunk;
+	unsigned consecutive;
 };
 
 /*
@@ -173,8 +173,14 @@ static void mddev_put(mddev_t *mddev)
 		return;
 	if (!mddev->raid_disks && list_empty(&mddev->disks)) {
 		list_del(&mddev->all_mddevs);
+		spin_unlock(&all_mddevs_lock);
 		blk_put_queue(mddev->queue);
-		kfree(mddev);
+		/* an open attribute file may still hold the kobject */
+		if (mddev->gendisk)
+			kobject_unregister(&mddev->kobj);
+		else
+			kfree(mddev);
+		return;
 	}
 	spin_unlock(&all_mddevs_lock);
 }
@@ -329,8 +335,8 @@ static int bi_complete(struct bio *bio, unsigned int bytes_done, int error)
 	return 0;
 }
 
-static int sync_page_io(struct block_device *bdev, sector_t sector, int size,
-		   struct page *page, int rw)
+int sync_page_io(struct block_device *bdev, sector_t sector, int size,
+		 struct page *page, int rw)
 {
 	struct bio *bio = bio_alloc(GFP_KERNEL, 1);
 	struct completion event;
@@ -582,6 +588,9 @@ static int super_90_validate(mddev_t *mddev, mdk_rdev_t *rdev)
 		mddev->raid_disks = sb->raid_disks;
 		mddev->size = sb->size;
 		mddev->events = md_event(sb);
+		mddev->bitmap_offset = 0;
+		if (sb->state & (1<<MD_SB_BITMAP_PRESENT))
+			mddev->bitmap_offset = MD_SB_SECTORS;
 
 		if (sb->state & (1<<MD_SB_CLEAN))
 			mddev->recovery_cp = MaxSector;
@@ -679,6 +688,8 @@ static void super_90_sync(mddev_t *mddev, mdk_rdev_t *rdev)
 			sb->state = (1<< MD_SB_CLEAN);
 	} else
 		sb->recovery_cp = 0;
+	if (mddev->bitmap_offset)
+		sb->state |= (1<<MD_SB_BITMAP_PRESENT);
 
 	sb->layout = mddev->layout;
 	sb->chunk_size = mddev->chunk_size;
@@ -1279,6 +1290,9 @@ repeat:
 		"md: updating %s RAID superblock on device (in sync %d)\n",
 		mdname(mddev),mddev->in_sync);
 
+	/* a bitmap newer than the superblock is fine, an older one isn't */
+	bitmap_update_sb(mddev->bitmap);
+
 	err = 0;
 	ITERATE_RDEV(mddev,rdev,tmp) {
 		char b[BDEVNAME_SIZE];
@@ -1444,6 +1458,59 @@ static int analyze_sbs(mddev_t * mddev)
 	return 0;
 }
 
+static ssize_t md_attr_show(struct kobject *kobj, struct attribute *attr,
+			    char *page)
+{
+	struct md_sysfs_entry *entry = container_of(attr, struct md_sysfs_entry,
+						    attr);
+	mddev_t *mddev = container_of(kobj, mddev_t, kobj);
+	ssize_t rv;
+
+	if (!entry->show)
+		return -EIO;
+	rv = mddev_lock(mddev);
+	if (!rv) {
+		rv = entry->show(mddev, page);
+		mddev_unlock(mddev);
+	}
+	return rv;
+}
+
+static ssize_t md_attr_store(struct kobject *kobj, struct attribute *attr,
+			     const char *page, size_t length)
+{
+	struct md_sysfs_entry *entry = container_of(attr, struct md_sysfs_entry,
+						    attr);
+	mddev_t *mddev = container_of(kobj, mddev_t, kobj);
+	ssize_t rv;
+
+	if (!entry->store)
+		return -EIO;
+	rv = mddev_lock(mddev);
+	if (!rv) {
+		rv = entry->store(mddev, page, length);
+		mddev_unlock(mddev);
+	}
+	return rv;
+}
+
+static void md_free(struct kobject *kobj)
+{
+	mddev_t *mddev = container_of(kobj, mddev_t, kobj);
+
+	kfree(mddev);
+}
+
+static struct sysfs_ops md_sysfs_ops = {
+	.show	= md_attr_show,
+	.store	= md_attr_store,
+};
+
+static struct kobj_type md_ktype = {
+	.release	= md_free,
+	.sysfs_ops	= &md_sysfs_ops,
+};
+
 int mdp_major = 0;
 
 static struct kobject *md_probe(dev_t dev, int *part, void *data)
@@ -1485,6 +1552,11 @@ static struct kobject *md_probe(dev_t dev, int *part, void *data)
 	add_disk(disk);
 	mddev->gendisk = disk;
 	up(&disks_sem);
+
+	mddev->kobj.parent = &disk->kobj;
+	kobject_set_name(&mddev->kobj, "md");
+	mddev->kobj.ktype = &md_ktype;
+	kobject_register(&mddev->kobj);
 	return NULL;
 }
 
@@ -1616,13 +1688,28 @@ static int do_md_run(mddev_t * mddev)
 
 	mddev->resync_max_sectors = mddev->size << 1; /* may be over-ridden by personality */
 
+	if (mddev->bitmap_offset) {
+		/* a new array has not written its superblock yet */
+		err = bitmap_create(mddev, mddev->events == 0);
+		if (err) {
+			printk(KERN_ERR "md: failed to set up bitmap for %s\n",
+			       mdname(mddev));
+			module_put(mddev->pers->owner);
+			mddev->pers = NULL;
+			return err;
+		}
+	}
+
 	err = mddev->pers->run(mddev);
 	if (err) {
 		printk(KERN_ERR "md: pers->run() failed ...\n");
+		bitmap_destroy(mddev);
 		module_put(mddev->pers->owner);
 		mddev->pers = NULL;
 		return -EINVAL;
 	}
+	if (mddev->bitmap && mddev->thread)
+		mddev->thread->timeout = mddev->bitmap->daemon_sleep;
  	atomic_set(&mddev->writes_pending,0);
 	mddev->safemode = 0;
 	mddev->safemode_timer.function = md_safemode_timeout;
@@ -1731,6 +1818,9 @@ static int do_md_stop(mddev_t * mddev, int ro)
 			mddev->in_sync = 1;
 			md_update_sb(mddev);
 		}
+		if (!ro)
+			/* after the last superblock update brought it along */
+			bitmap_destroy(mddev);
 		if (ro)
 			set_disk_ro(disk, 1);
 	}
@@ -1744,6 +1834,7 @@ static int do_md_stop(mddev_t * mddev, int ro)
 		export_array(mddev);
 
 		mddev->array_size = 0;
+		mddev->bitmap_offset = 0;
 		disk = mddev->gendisk;
 		if (disk)
 			set_capacity(disk, 0);
@@ -1980,6 +2071,8 @@ static int get_array_info(mddev_t * mddev, void __user * arg)
 	info.state         = 0;
 	if (mddev->in_sync)
 		info.state = (1<<MD_SB_CLEAN);
+	if (mddev->bitmap_offset)
+		info.state |= (1<<MD_SB_BITMAP_PRESENT);
 	info.active_disks  = active;
 	info.working_disks = working;
 	info.failed_disks  = failed;
@@ -2315,6 +2408,9 @@ static int set_array_info(mddev_t * mddev, mdu_array_info_t *info)
 	else
 		mddev->recovery_cp = 0;
 	mddev->persistent    = ! info->not_persistent;
+	mddev->bitmap_offset = 0;
+	if (info->state & (1<<MD_SB_BITMAP_PRESENT))
+		mddev->bitmap_offset = MD_SB_SECTORS;
 
 	mddev->layout        = info->layout;
 	mddev->chunk_size    = info->chunk_size;
@@ -2387,6 +2483,9 @@ static int update_array_info(mddev_t *mddev, mdu_array_info_t *info)
 		 */
 		if (mddev->sync_thread)
 			return -EBUSY;
+		if (mddev->bitmap)
+			/* it covers exactly the old size */
+			return -EBUSY;
 		ITERATE_RDEV(mddev,rdev,tmp) {
 			sector_t avail;
 			int fit = (info->size == 0);
@@ -2784,8 +2883,9 @@ int md_thread(void * arg)
 	while (thread->run) {
 		void (*run)(mddev_t *);
 
-		wait_event_interruptible(thread->wqueue,
-					 test_bit(THREAD_WAKEUP, &thread->flags));
+		wait_event_interruptible_timeout(thread->wqueue,
+						 test_bit(THREAD_WAKEUP, &thread->flags),
+						 thread->timeout);
 		if (current->flags & PF_FREEZE)
 			refrigerator(PF_FREEZE);
 
@@ -2831,6 +2931,7 @@ mdk_thread_t *md_register_thread(void (*run) (mddev_t *), mddev_t *mddev,
 	thread->run = run;
 	thread->mddev = mddev;
 	thread->name = name;
+	thread->timeout = MAX_SCHEDULE_TIMEOUT;
 	ret = kernel_thread(md_thread, thread, 0);
 	if (ret < 0) {
 		kfree(thread);
@@ -3084,6 +3185,8 @@ static int md_seq_show(struct seq_file *seq, void *v)
 
 		if (mddev->pers) {
 			mddev->pers->status (seq, mddev);
+			if (mddev->bitmap)
+				bitmap_status(seq, mddev->bitmap);
 	 		seq_printf(seq, "\n      ");
 			if (mddev->curr_resync > 2)
 				status_resync (seq, mddev);
@@ -3265,6 +3368,9 @@ static void md_do_sync(mddev_t *mddev)
 	int last_mark,m;
 	struct list_head *tmp;
 	sector_t last_check;
+	/* the speed limits count sectors actually synced, not skipped */
+	sector_t io_sectors, io_mark, io_mark_cnt[SYNC_MARKS];
+	int skipped = 0;
 
 	/* just incase thread restarts... */
 	if (test_bit(MD_RECOVERY_DONE, &mddev->recovery))
@@ -3349,9 +3455,11 @@ static void md_do_sync(mddev_t *mddev)
 		j = mddev->recovery_cp;
 	else
 		j = 0;
+	io_sectors = io_mark = 0;
 	for (m = 0; m < SYNC_MARKS; m++) {
 		mark[m] = jiffies;
 		mark_cnt[m] = j;
+		io_mark_cnt[m] = 0;
 	}
 	last_mark = 0;
 	mddev->resync_mark = mark[last_mark];
@@ -3378,19 +3486,24 @@ static void md_do_sync(mddev_t *mddev)
 	while (j < max_sectors) {
 		int sectors;
 
-		sectors = mddev->pers->sync_request(mddev, j, currspeed < sysctl_speed_limit_min);
+		skipped = 0;
+		sectors = mddev->pers->sync_request(mddev, j, &skipped,
+					currspeed < sysctl_speed_limit_min);
 		if (sectors < 0) {
 			set_bit(MD_RECOVERY_ERR, &mddev->recovery);
 			goto out;
 		}
-		atomic_add(sectors, &mddev->recovery_active);
+		if (!skipped) {
+			io_sectors += sectors;
+			atomic_add(sectors, &mddev->recovery_active);
+		}
 		j += sectors;
 		if (j>1) mddev->curr_resync = j;
 
-		if (last_check + window > j || j == max_sectors)
+		if (last_check + window > io_sectors || j == max_sectors)
 			continue;
 
-		last_check = j;
+		last_check = io_sectors;
 
 		if (test_bit(MD_RECOVERY_INTR, &mddev->recovery) ||
 		    test_bit(MD_RECOVERY_ERR, &mddev->recovery))
@@ -3403,8 +3516,10 @@ static void md_do_sync(mddev_t *mddev)
 
 			mddev->resync_mark = mark[next];
 			mddev->resync_mark_cnt = mark_cnt[next];
+			io_mark = io_mark_cnt[next];
 			mark[next] = jiffies;
 			mark_cnt[next] = j - atomic_read(&mddev->recovery_active);
+			io_mark_cnt[next] = io_sectors - atomic_read(&mddev->recovery_active);
 			last_mark = next;
 		}
 
@@ -3431,7 +3546,7 @@ static void md_do_sync(mddev_t *mddev)
 		mddev->queue->unplug_fn(mddev->queue);
 		cond_resched();
 
-		currspeed = ((unsigned long)(j-mddev->resync_mark_cnt))/2/((jiffies-mddev->resync_mark)/HZ +1) +1;
+		currspeed = ((unsigned long)(io_sectors-io_mark))/2/((jiffies-mddev->resync_mark)/HZ +1) +1;
 
 		if (currspeed > sysctl_speed_limit_min) {
 			if ((currspeed > sysctl_speed_limit_max) ||
@@ -3451,7 +3566,13 @@ static void md_do_sync(mddev_t *mddev)
 	wait_event(mddev->recovery_wait, !atomic_read(&mddev->recovery_active));
 
 	/* tell personality that we are finished */
-	mddev->pers->sync_request(mddev, max_sectors, 1);
+	mddev->pers->sync_request(mddev, max_sectors, &skipped, 1);
+
+	if (mddev->bitmap && !test_bit(MD_RECOVERY_ERR, &mddev->recovery) &&
+	    mddev->curr_resync > 2)
+		bitmap_close_sync(mddev->bitmap,
+				  test_bit(MD_RECOVERY_INTR, &mddev->recovery) ?
+				  mddev->curr_resync : max_sectors);
 
 	if (!test_bit(MD_RECOVERY_ERR, &mddev->recovery) &&
 	    mddev->curr_resync > 2 &&
@@ -209,6 +209,18 @@ static void raid_end_bio_io(r1bio_t *r1_bio)
 	free_r1bio(r1_bio);
 }
 
+/* the last mirrored write is done: a chunk not on every mirror stays dirty */
+static void raid_end_write(r1bio_t *r1_bio)
+{
+	mddev_t *mddev = r1_bio->mddev;
+
+	if (mddev->bitmap)
+		bitmap_endwrite(mddev->bitmap, r1_bio->sector, r1_bio->sectors,
+				!test_bit(R1BIO_Degraded, &r1_bio->state));
+	md_write_end(mddev);
+	raid_end_bio_io(r1_bio);
+}
+
 /*
  * Update disk head position estimator based on IRQ completion info.
  */
@@ -287,9 +299,10 @@ static int raid1_end_write_request(struct bio *bio, unsigned int bytes_done, int
 	/*
 	 * this branch is our 'one mirror IO has finished' event handler:
 	 */
-	if (!uptodate)
+	if (!uptodate) {
 		md_error(r1_bio->mddev, conf->mirrors[mirror].rdev);
-	else
+		set_bit(R1BIO_Degraded, &r1_bio->state);
+	} else
 		/*
 		 * Set R1BIO_Uptodate in our master bio, so that
 		 * we will return a good error code for to the higher
@@ -308,10 +321,8 @@ static int raid1_end_write_request(struct bio *bio, unsigned int bytes_done, int
 	 * Let's see if all mirrored write operations have finished
 	 * already.
 	 */
-	if (atomic_dec_and_test(&r1_bio->remaining)) {
-		md_write_end(r1_bio->mddev);
-		raid_end_bio_io(r1_bio);
-	}
+	if (atomic_dec_and_test(&r1_bio->remaining))
+		raid_end_write(r1_bio);
 
 	rdev_dec_pending(conf->mirrors[mirror].rdev, conf->mddev);
 	return 0;
@@ -607,11 +618,16 @@ static int make_request(request_queue_t *q, struct bio * bio)
 				r1_bio->bios[i] = bio;
 		} else
 			r1_bio->bios[i] = NULL;
+		if (!r1_bio->bios[i])
+			set_bit(R1BIO_Degraded, &r1_bio->state);
 	}
 	rcu_read_unlock();
 
 	atomic_set(&r1_bio->remaining, 1);
 	md_write_start(mddev);
+	if (mddev->bitmap)
+		bitmap_startwrite(mddev->bitmap, r1_bio->sector,
+				  r1_bio->sectors);
 	for (i = 0; i < disks; i++) {
 		struct bio *mbio;
 		if (!r1_bio->bios[i])
@@ -630,10 +646,8 @@ static int make_request(request_queue_t *q, struct bio * bio)
 		generic_make_request(mbio);
 	}
 
-	if (atomic_dec_and_test(&r1_bio->remaining)) {
-		md_write_end(mddev);
-		raid_end_bio_io(r1_bio);
-	}
+	if (atomic_dec_and_test(&r1_bio->remaining))
+		raid_end_write(r1_bio);
 
 	return 0;
 }
@@ -932,6 +946,7 @@ static void raid1d(mddev_t *mddev)
 
 	md_check_recovery(mddev);
 	md_handle_safemode(mddev);
+	bitmap_daemon_work(mddev->bitmap);
 	
 	for (;;) {
 		char b[BDEVNAME_SIZE];
@@ -1009,7 +1024,7 @@ static int init_resync(conf_t *conf)
  * that can be installed to exclude normal IO requests.
  */
 
-static int sync_request(mddev_t *mddev, sector_t sector_nr, int go_faster)
+static int sync_request(mddev_t *mddev, sector_t sector_nr, int *skipped, int go_faster)
 {
 	conf_t *conf = mddev_to_conf(mddev);
 	mirror_info_t *mirror;
@@ -1019,6 +1034,7 @@ static int sync_request(mddev_t *mddev, sector_t sector_nr, int go_faster)
 	int disk;
 	int i;
 	int write_targets = 0;
+	int sync_blocks;
 
 	if (!conf->r1buf_pool)
 		if (init_resync(conf))
@@ -1030,6 +1046,15 @@ static int sync_request(mddev_t *mddev, sector_t sector_nr, int go_faster)
 		return 0;
 	}
 
+	if (mddev->bitmap && test_bit(MD_RECOVERY_SYNC, &mddev->recovery) &&
+	    !bitmap_start_sync(mddev->bitmap, sector_nr, &sync_blocks)) {
+		/* no write has been lost here */
+		*skipped = 1;
+		if (sync_blocks > max_sector - sector_nr)
+			sync_blocks = max_sector - sector_nr;
+		return sync_blocks;
+	}
+
 	/*
 	 * If there is non-resync activity waiting for us then
 	 * put in a delay to throttle resync.
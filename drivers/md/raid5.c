@@ -20,15 +20,22 @@
 #include <linux/module.h>
 #include <linux/slab.h>
 #include <linux/raid/raid5.h>
+#include <linux/raid/async_tx.h>
 #include <linux/highmem.h>
 #include <linux/bitops.h>
+#include <linux/kthread.h>
+#include <linux/cpu.h>
+#include <linux/swap.h>
 #include <asm/atomic.h>
 
 /*
  * Stripe cache
  */
 
-#define NR_STRIPES		256
+#define NR_STRIPES		256	/* minimum default cache size */
+#define MAX_NR_STRIPES		32768
+#define NR_STRIPES_RAM_SHIFT	8	/* default cache: 1/256 of memory ... */
+#define NR_STRIPES_DEFAULT_MAX	4096	/* ... but no more stripes than this */
 #define STRIPE_SIZE		PAGE_SIZE
 #define STRIPE_SHIFT		(PAGE_SHIFT - 9)
 #define STRIPE_SECTORS		(STRIPE_SIZE>>9)
@@ -69,6 +76,38 @@
 
 static void print_raid5_conf (raid5_conf_t *conf);
 
+/*
+ * Queue a stripe for handling, on its worker's list when there are
+ * workers.  Called with device_lock held.
+ */
+static inline void queue_stripe(raid5_conf_t *conf, struct stripe_head *sh)
+{
+	struct raid5_worker *worker;
+
+	if (!conf->nr_workers) {
+		list_add_tail(&sh->lru, &conf->handle_list);
+		md_wakeup_thread(conf->mddev->thread);
+		return;
+	}
+	worker = conf->workers + (unsigned long)(sh->sector >> STRIPE_SHIFT) %
+		conf->nr_workers;
+	list_add_tail(&sh->lru, &worker->handle_list);
+	wake_up(&worker->wait);
+}
+
+/* Nothing queued for handling anywhere; called with device_lock held */
+static inline int handle_lists_empty(raid5_conf_t *conf)
+{
+	int i;
+
+	if (!list_empty(&conf->handle_list))
+		return 0;
+	for (i = 0; i < conf->nr_workers; i++)
+		if (!list_empty(&conf->workers[i].handle_list))
+			return 0;
+	return 1;
+}
+
 static inline void __release_stripe(raid5_conf_t *conf, struct stripe_head *sh)
 {
 	if (atomic_dec_and_test(&sh->count)) {
@@ -77,11 +116,11 @@ static inline void __release_stripe(raid5_conf_t *conf, struct stripe_head *sh)
 		if (atomic_read(&conf->active_stripes)==0)
 			BUG();
 		if (test_bit(STRIPE_HANDLE, &sh->state)) {
-			if (test_bit(STRIPE_DELAYED, &sh->state))
+			if (test_bit(STRIPE_DELAYED, &sh->state)) {
 				list_add_tail(&sh->lru, &conf->delayed_list);
-			else
-				list_add_tail(&sh->lru, &conf->handle_list);
-			md_wakeup_thread(conf->mddev->thread);
+				md_wakeup_thread(conf->mddev->thread);
+			} else
+				queue_stripe(conf, sh);
 		} else {
 			if (test_and_clear_bit(STRIPE_PREREAD_ACTIVE, &sh->state)) {
 				atomic_dec(&conf->preread_active_stripes);
@@ -91,7 +130,7 @@ static inline void __release_stripe(raid5_conf_t *conf, struct stripe_head *sh)
 			list_add_tail(&sh->lru, &conf->inactive_list);
 			atomic_dec(&conf->active_stripes);
 			if (!conf->inactive_blocked ||
-			    atomic_read(&conf->active_stripes) < (NR_STRIPES*3/4))
+			    atomic_read(&conf->active_stripes) < (conf->max_nr_stripes*3/4))
 				wake_up(&conf->wait_for_stripe);
 		}
 	}
@@ -246,15 +285,17 @@ static struct stripe_head *get_active_stripe(raid5_conf_t *conf, sector_t sector
 	do {
 		sh = __find_stripe(conf, sector);
 		if (!sh) {
+			atomic_inc(&conf->cache_misses);
 			if (!conf->inactive_blocked)
 				sh = get_free_stripe(conf);
 			if (noblock && sh == NULL)
 				break;
 			if (!sh) {
+				atomic_inc(&conf->stripe_waits);
 				conf->inactive_blocked = 1;
 				wait_event_lock_irq(conf->wait_for_stripe,
 						    !list_empty(&conf->inactive_list) &&
-						    (atomic_read(&conf->active_stripes) < (NR_STRIPES *3/4)
+						    (atomic_read(&conf->active_stripes) < (conf->max_nr_stripes *3/4)
 						     || !conf->inactive_blocked),
 						    conf->device_lock,
 						    unplug_slaves(conf->mddev);
@@ -263,6 +304,7 @@ static struct stripe_head *get_active_stripe(raid5_conf_t *conf, sector_t sector
 			} else
 				init_stripe(sh, sector, pd_idx);
 		} else {
+			atomic_inc(&conf->cache_hits);
 			if (atomic_read(&sh->count)) {
 				if (!list_empty(&sh->lru))
 					BUG();
@@ -283,9 +325,33 @@ static struct stripe_head *get_active_stripe(raid5_conf_t *conf, sector_t sector
 	return sh;
 }
 
-static int grow_stripes(raid5_conf_t *conf, int num)
+static int grow_one_stripe(raid5_conf_t *conf)
 {
 	struct stripe_head *sh;
+	int devs = conf->raid_disks;
+
+	sh = kmem_cache_alloc(conf->slab_cache, GFP_KERNEL);
+	if (!sh)
+		return 0;
+	memset(sh, 0, sizeof(*sh) + (devs-1)*sizeof(struct r5dev));
+	sh->raid_conf = conf;
+	spin_lock_init(&sh->lock);
+
+	if (grow_buffers(sh, conf->raid_disks)) {
+		shrink_buffers(sh, conf->raid_disks);
+		kmem_cache_free(conf->slab_cache, sh);
+		return 0;
+	}
+	/* we just created an active stripe so... */
+	atomic_set(&sh->count, 1);
+	atomic_inc(&conf->active_stripes);
+	INIT_LIST_HEAD(&sh->lru);
+	release_stripe(sh);
+	return 1;
+}
+
+static int grow_stripes(raid5_conf_t *conf, int num)
+{
 	kmem_cache_t *sc;
 	int devs = conf->raid_disks;
 
@@ -297,48 +363,58 @@ static int grow_stripes(raid5_conf_t *conf, int num)
 	if (!sc)
 		return 1;
 	conf->slab_cache = sc;
-	while (num--) {
-		sh = kmem_cache_alloc(sc, GFP_KERNEL);
-		if (!sh)
-			return 1;
-		memset(sh, 0, sizeof(*sh) + (devs-1)*sizeof(struct r5dev));
-		sh->raid_conf = conf;
-		spin_lock_init(&sh->lock);
-
-		if (grow_buffers(sh, conf->raid_disks)) {
-			shrink_buffers(sh, conf->raid_disks);
-			kmem_cache_free(sc, sh);
+	while (num--)
+		if (!grow_one_stripe(conf))
 			return 1;
-		}
-		/* we just created an active stripe so... */
-		atomic_set(&sh->count, 1);
-		atomic_inc(&conf->active_stripes);
-		INIT_LIST_HEAD(&sh->lru);
-		release_stripe(sh);
-	}
 	return 0;
 }
 
-static void shrink_stripes(raid5_conf_t *conf)
+/* free one inactive stripe, returns 0 if all of them are in use */
+static int drop_one_stripe(raid5_conf_t *conf)
 {
 	struct stripe_head *sh;
 
-	while (1) {
-		spin_lock_irq(&conf->device_lock);
-		sh = get_free_stripe(conf);
-		spin_unlock_irq(&conf->device_lock);
-		if (!sh)
-			break;
-		if (atomic_read(&sh->count))
-			BUG();
-		shrink_buffers(sh, conf->raid_disks);
-		kmem_cache_free(conf->slab_cache, sh);
-		atomic_dec(&conf->active_stripes);
-	}
+	spin_lock_irq(&conf->device_lock);
+	sh = get_free_stripe(conf);
+	spin_unlock_irq(&conf->device_lock);
+	if (!sh)
+		return 0;
+	if (atomic_read(&sh->count))
+		BUG();
+	shrink_buffers(sh, conf->raid_disks);
+	kmem_cache_free(conf->slab_cache, sh);
+	atomic_dec(&conf->active_stripes);
+	return 1;
+}
+
+static void shrink_stripes(raid5_conf_t *conf)
+{
+	while (drop_one_stripe(conf))
+		;
+
 	kmem_cache_destroy(conf->slab_cache);
 	conf->slab_cache = NULL;
 }
 
+/*
+ * Resize the stripe cache of a running array.  Growing stops short when
+ * memory runs out, shrinking when the remaining stripes are all busy;
+ * max_nr_stripes always says how many there are.
+ */
+static void raid5_set_cache_size(raid5_conf_t *conf, int size)
+{
+	while (size < conf->max_nr_stripes) {
+		if (!drop_one_stripe(conf))
+			break;
+		conf->max_nr_stripes--;
+	}
+	while (size > conf->max_nr_stripes) {
+		if (!grow_one_stripe(conf))
+			break;
+		conf->max_nr_stripes++;
+	}
+}
+
 static int raid5_end_read_request (struct bio * bi, unsigned int bytes_done,
 				   int error)
 {
@@ -618,12 +694,13 @@ static sector_t compute_blocknr(struct stripe_head *sh, int i)
  * There are no alignment or size guarantees between the page or the
  * bio except that there is some overlap.
  * All iovecs in the bio must be considered.
+ *
+ * The copies are queued behind @tx, the last of them is returned.
  */
-static void copy_data(int frombio, struct bio *bio,
-		     struct page *page,
-		     sector_t sector)
+static struct async_tx *copy_data(int frombio, struct bio *bio,
+				  struct page *page, sector_t sector,
+				  struct async_tx *tx)
 {
-	char *pa = page_address(page);
 	struct bio_vec *bvl;
 	int i;
 	int page_offset;
@@ -648,54 +725,50 @@ static void copy_data(int frombio, struct bio *bio,
 		else clen = len;
 			
 		if (clen > 0) {
-			char *ba = __bio_kmap_atomic(bio, i, KM_USER0);
 			if (frombio)
-				memcpy(pa+page_offset, ba+b_offset, clen);
+				tx = async_memcpy(page, bvl->bv_page,
+						  page_offset,
+						  bvl->bv_offset + b_offset,
+						  clen, ASYNC_TX_DEP_ACK, tx,
+						  NULL, NULL);
 			else
-				memcpy(ba+b_offset, pa+page_offset, clen);
-			__bio_kunmap_atomic(ba, KM_USER0);
+				tx = async_memcpy(bvl->bv_page, page,
+						  bvl->bv_offset + b_offset,
+						  page_offset,
+						  clen, ASYNC_TX_DEP_ACK, tx,
+						  NULL, NULL);
 		}
 		if (clen < len) /* hit end of page */
 			break;
 		page_offset +=  len;
 	}
+	return tx;
 }
 
-#define check_xor() 	do { 						\
-			   if (count == MAX_XOR_BLOCKS) {		\
-				xor_block(count, STRIPE_SIZE, ptr);	\
-				count = 1;				\
-			   }						\
-			} while(0)
-
-
 static void compute_block(struct stripe_head *sh, int dd_idx)
 {
 	raid5_conf_t *conf = sh->raid_conf;
 	int i, count, disks = conf->raid_disks;
-	void *ptr[MAX_XOR_BLOCKS], *p;
+	struct page *srcs[disks];
+	struct async_tx *tx;
 
 	PRINTK("compute_block, stripe %llu, idx %d\n", 
 		(unsigned long long)sh->sector, dd_idx);
 
-	ptr[0] = page_address(sh->dev[dd_idx].page);
-	memset(ptr[0], 0, STRIPE_SIZE);
-	count = 1;
+	count = 0;
 	for (i = disks ; i--; ) {
 		if (i == dd_idx)
 			continue;
-		p = page_address(sh->dev[i].page);
 		if (test_bit(R5_UPTODATE, &sh->dev[i].flags))
-			ptr[count++] = p;
+			srcs[count++] = sh->dev[i].page;
 		else
 			printk("compute_block() %d, stripe %llu, %d"
 				" not present\n", dd_idx,
 				(unsigned long long)sh->sector, i);
-
-		check_xor();
 	}
-	if (count != 1)
-		xor_block(count, STRIPE_SIZE, ptr);
+	tx = async_xor(sh->dev[dd_idx].page, srcs, 0, count, STRIPE_SIZE,
+		       ASYNC_TX_XOR_ZERO_DST, NULL, NULL, NULL);
+	async_tx_quiesce(&tx);
 	set_bit(R5_UPTODATE, &sh->dev[dd_idx].flags);
 }
 
@@ -703,16 +776,22 @@ static void compute_parity(struct stripe_head *sh, int method)
 {
 	raid5_conf_t *conf = sh->raid_conf;
 	int i, pd_idx = sh->pd_idx, disks = conf->raid_disks, count;
-	void *ptr[MAX_XOR_BLOCKS];
+	struct page *srcs[disks];
+	struct async_tx *tx = NULL;
 	struct bio *chosen;
 
 	PRINTK("compute_parity, stripe %llu, method %d\n",
 		(unsigned long long)sh->sector, method);
 
-	count = 1;
-	ptr[0] = page_address(sh->dev[pd_idx].page);
+	/*
+	 * The old data comes out of the parity before copy_data()
+	 * overwrites it, then the new data goes in: each step is queued
+	 * behind the one before.
+	 */
+	count = 0;
 	switch(method) {
 	case READ_MODIFY_WRITE:
+		atomic_inc(&conf->rmw_writes);
 		if (!test_bit(R5_UPTODATE, &sh->dev[pd_idx].flags))
 			BUG();
 		for (i=disks ; i-- ;) {
@@ -720,7 +799,7 @@ static void compute_parity(struct stripe_head *sh, int method)
 				continue;
 			if (sh->dev[i].towrite &&
 			    test_bit(R5_UPTODATE, &sh->dev[i].flags)) {
-				ptr[count++] = page_address(sh->dev[i].page);
+				srcs[count++] = sh->dev[i].page;
 				chosen = sh->dev[i].towrite;
 				sh->dev[i].towrite = NULL;
 
@@ -729,12 +808,11 @@ static void compute_parity(struct stripe_head *sh, int method)
 
 				if (sh->dev[i].written) BUG();
 				sh->dev[i].written = chosen;
-				check_xor();
 			}
 		}
 		break;
 	case RECONSTRUCT_WRITE:
-		memset(ptr[0], 0, STRIPE_SIZE);
+		atomic_inc(&conf->full_stripe_writes);
 		for (i= disks; i-- ;)
 			if (i!=pd_idx && sh->dev[i].towrite) {
 				chosen = sh->dev[i].towrite;
@@ -750,9 +828,10 @@ static void compute_parity(struct stripe_head *sh, int method)
 	case CHECK_PARITY:
 		break;
 	}
-	if (count>1) {
-		xor_block(count, STRIPE_SIZE, ptr);
-		count = 1;
+	if (count) {
+		tx = async_xor(sh->dev[pd_idx].page, srcs, 0, count,
+			       STRIPE_SIZE, 0, NULL, NULL, NULL);
+		count = 0;
 	}
 	
 	for (i = disks; i--;)
@@ -760,7 +839,8 @@ static void compute_parity(struct stripe_head *sh, int method)
 			sector_t sector = sh->dev[i].sector;
 			struct bio *wbi = sh->dev[i].written;
 			while (wbi && wbi->bi_sector < sector + STRIPE_SECTORS) {
-				copy_data(1, wbi, sh->dev[i].page, sector);
+				tx = copy_data(1, wbi, sh->dev[i].page, sector,
+					       tx);
 				wbi = r5_next_bio(wbi, sector);
 			}
 
@@ -772,20 +852,18 @@ static void compute_parity(struct stripe_head *sh, int method)
 	case RECONSTRUCT_WRITE:
 	case CHECK_PARITY:
 		for (i=disks; i--;)
-			if (i != pd_idx) {
-				ptr[count++] = page_address(sh->dev[i].page);
-				check_xor();
-			}
+			if (i != pd_idx)
+				srcs[count++] = sh->dev[i].page;
 		break;
 	case READ_MODIFY_WRITE:
 		for (i = disks; i--;)
-			if (sh->dev[i].written) {
-				ptr[count++] = page_address(sh->dev[i].page);
-				check_xor();
-			}
+			if (sh->dev[i].written)
+				srcs[count++] = sh->dev[i].page;
 	}
-	if (count != 1)
-		xor_block(count, STRIPE_SIZE, ptr);
+	tx = async_xor(sh->dev[pd_idx].page, srcs, 0, count, STRIPE_SIZE,
+		       (method == RECONSTRUCT_WRITE ? ASYNC_TX_XOR_ZERO_DST : 0) |
+		       ASYNC_TX_DEP_ACK, tx, NULL, NULL);
+	async_tx_quiesce(&tx);
 	
 	if (method != CHECK_PARITY) {
 		set_bit(R5_UPTODATE, &sh->dev[pd_idx].flags);
@@ -889,6 +967,7 @@ static void handle_stripe(struct stripe_head *sh)
 	int non_overwrite = 0;
 	int failed_num=0;
 	struct r5dev *dev;
+	struct async_tx *tx = NULL;
 
 	PRINTK("handling stripe %llu, cnt=%d, pd_idx=%d\n",
 		(unsigned long long)sh->sector, atomic_read(&sh->count),
@@ -920,7 +999,8 @@ static void handle_stripe(struct stripe_head *sh)
 				wake_up(&conf->wait_for_overlap);
 			spin_unlock_irq(&conf->device_lock);
 			while (rbi && rbi->bi_sector < dev->sector + STRIPE_SECTORS) {
-				copy_data(0, rbi, dev->page, dev->sector);
+				tx = copy_data(0, rbi, dev->page, dev->sector,
+					       tx);
 				rbi2 = r5_next_bio(rbi, dev->sector);
 				spin_lock_irq(&conf->device_lock);
 				if (--rbi->bi_phys_segments == 0) {
@@ -930,6 +1010,7 @@ static void handle_stripe(struct stripe_head *sh)
 				spin_unlock_irq(&conf->device_lock);
 				rbi = rbi2;
 			}
+			async_tx_quiesce(&tx);
 		}
 
 		/* now count some things */
@@ -971,6 +1052,9 @@ static void handle_stripe(struct stripe_head *sh)
 			while (bi && bi->bi_sector < sh->dev[i].sector + STRIPE_SECTORS){
 				struct bio *nextbi = r5_next_bio(bi, sh->dev[i].sector);
 				clear_bit(BIO_UPTODATE, &bi->bi_flags);
+				if (conf->mddev->bitmap)
+					bitmap_endwrite(conf->mddev->bitmap, sh->sector,
+							STRIPE_SECTORS, 0);
 				if (--bi->bi_phys_segments == 0) {
 					md_write_end(conf->mddev);
 					bi->bi_next = return_bi;
@@ -984,6 +1068,9 @@ static void handle_stripe(struct stripe_head *sh)
 			while (bi && bi->bi_sector < sh->dev[i].sector + STRIPE_SECTORS) {
 				struct bio *bi2 = r5_next_bio(bi, sh->dev[i].sector);
 				clear_bit(BIO_UPTODATE, &bi->bi_flags);
+				if (conf->mddev->bitmap)
+					bitmap_endwrite(conf->mddev->bitmap, sh->sector,
+							STRIPE_SECTORS, 0);
 				if (--bi->bi_phys_segments == 0) {
 					md_write_end(conf->mddev);
 					bi->bi_next = return_bi;
@@ -1044,6 +1131,11 @@ static void handle_stripe(struct stripe_head *sh)
 			    dev->written = NULL;
 			    while (wbi && wbi->bi_sector < dev->sector + STRIPE_SECTORS) {
 				    wbi2 = r5_next_bio(wbi, dev->sector);
+				    /* with a failed drive, parity is all it got */
+				    if (conf->mddev->bitmap)
+					    bitmap_endwrite(conf->mddev->bitmap,
+							    sh->sector, STRIPE_SECTORS,
+							    !failed);
 				    if (--wbi->bi_phys_segments == 0) {
 					    md_write_end(conf->mddev);
 					    wbi->bi_next = return_bi;
@@ -1317,7 +1409,7 @@ static inline void raid5_activate_delayed(raid5_conf_t *conf)
 			clear_bit(STRIPE_DELAYED, &sh->state);
 			if (!test_and_set_bit(STRIPE_PREREAD_ACTIVE, &sh->state))
 				atomic_inc(&conf->preread_active_stripes);
-			list_add_tail(&sh->lru, &conf->handle_list);
+			queue_stripe(conf, sh);
 		}
 	}
 }
@@ -1436,6 +1528,10 @@ static int make_request (request_queue_t *q, struct bio * bi)
 			(unsigned long long)logical_sector);
 
 	retry:
+		/* the bit must be on disk before the stripe can write */
+		if (mddev->bitmap && bio_data_dir(bi) == WRITE)
+			bitmap_startwrite(mddev->bitmap, new_sector,
+					  STRIPE_SECTORS);
 		prepare_to_wait(&conf->wait_for_overlap, &w, TASK_UNINTERRUPTIBLE);
 		sh = get_active_stripe(conf, new_sector, pd_idx, (bi->bi_rw&RWA_MASK));
 		if (sh) {
@@ -1443,6 +1539,9 @@ static int make_request (request_queue_t *q, struct bio * bi)
 				/* Add failed due to overlap.  Flush everything
 				 * and wait a while
 				 */
+				if (mddev->bitmap && bio_data_dir(bi) == WRITE)
+					bitmap_endwrite(mddev->bitmap, new_sector,
+							STRIPE_SECTORS, 1);
 				raid5_unplug_device(mddev->queue);
 				release_stripe(sh);
 				schedule();
@@ -1475,7 +1574,7 @@ static int make_request (request_queue_t *q, struct bio * bi)
 }
 
 /* FIXME go_faster isn't used */
-static int sync_request (mddev_t *mddev, sector_t sector_nr, int go_faster)
+static int sync_request (mddev_t *mddev, sector_t sector_nr, int *skipped, int go_faster)
 {
 	raid5_conf_t *conf = (raid5_conf_t *) mddev->private;
 	struct stripe_head *sh;
@@ -1487,12 +1586,21 @@ static int sync_request (mddev_t *mddev, sector_t sector_nr, int go_faster)
 	sector_t first_sector;
 	int raid_disks = conf->raid_disks;
 	int data_disks = raid_disks-1;
+	int sync_blocks;
 
 	if (sector_nr >= mddev->size <<1) {
 		/* just being told to finish up .. nothing much to do */
 		unplug_slaves(mddev);
 		return 0;
 	}
+	if (mddev->bitmap && test_bit(MD_RECOVERY_SYNC, &mddev->recovery) &&
+	    !bitmap_start_sync(mddev->bitmap, sector_nr, &sync_blocks)) {
+		/* no write has been lost here */
+		*skipped = 1;
+		if (sync_blocks > (mddev->size << 1) - sector_nr)
+			sync_blocks = (mddev->size << 1) - sector_nr;
+		return sync_blocks;
+	}
 	/* if there is 1 or more failed drives and we are trying
 	 * to resync, then assert that we are finished, because there is
 	 * nothing we can do.
@@ -1547,13 +1655,14 @@ static void raid5d (mddev_t *mddev)
 
 	md_check_recovery(mddev);
 	md_handle_safemode(mddev);
+	bitmap_daemon_work(mddev->bitmap);
 
 	handled = 0;
 	spin_lock_irq(&conf->device_lock);
 	while (1) {
 		struct list_head *first;
 
-		if (list_empty(&conf->handle_list) &&
+		if (handle_lists_empty(conf) &&
 		    atomic_read(&conf->preread_active_stripes) < IO_THRESHOLD &&
 		    !blk_queue_plugged(mddev->queue) &&
 		    !list_empty(&conf->delayed_list))
@@ -1586,6 +1695,202 @@ static void raid5d (mddev_t *mddev)
 	PRINTK("--- raid5d inactive\n");
 }
 
+/*
+ * Per-CPU worker thread: handles the stripes queued to it, the same way
+ * raid5d does without workers.  Activating delayed stripes, recovery and
+ * safemode stay with raid5d.
+ */
+static int raid5_worker(void *arg)
+{
+	struct raid5_worker *worker = arg;
+	raid5_conf_t *conf = worker->conf;
+	struct stripe_head *sh;
+
+	while (!kthread_should_stop()) {
+		wait_event_interruptible(worker->wait,
+					 !list_empty(&worker->handle_list) ||
+					 kthread_should_stop());
+		if (current->flags & PF_FREEZE)
+			refrigerator(PF_FREEZE);
+
+		spin_lock_irq(&conf->device_lock);
+		while (!list_empty(&worker->handle_list)) {
+			sh = list_entry(worker->handle_list.next,
+					struct stripe_head, lru);
+			list_del_init(&sh->lru);
+			atomic_inc(&sh->count);
+			if (atomic_read(&sh->count) != 1)
+				BUG();
+			spin_unlock_irq(&conf->device_lock);
+
+			handle_stripe(sh);
+			release_stripe(sh);
+
+			spin_lock_irq(&conf->device_lock);
+		}
+		if (!list_empty(&conf->delayed_list))
+			md_wakeup_thread(conf->mddev->thread);
+		spin_unlock_irq(&conf->device_lock);
+
+		unplug_slaves(conf->mddev);
+	}
+	return 0;
+}
+
+static void stop_workers(raid5_conf_t *conf, int nr)
+{
+	int i;
+
+	conf->nr_workers = 0;
+	for (i = 0; i < nr; i++)
+		kthread_stop(conf->workers[i].thread);
+	kfree(conf->workers);
+	conf->workers = NULL;
+}
+
+/* One worker per online CPU, none on UP where raid5d does the work */
+static int start_workers(raid5_conf_t *conf)
+{
+	struct raid5_worker *worker;
+	int cpu, nr = 0, max;
+
+	lock_cpu_hotplug();
+	max = num_online_cpus();
+	if (max < 2)
+		goto out;
+	conf->workers = kmalloc(max * sizeof(struct raid5_worker), GFP_KERNEL);
+	if (!conf->workers)
+		goto fail;
+	for_each_online_cpu(cpu) {
+		worker = conf->workers + nr;
+		worker->conf = conf;
+		INIT_LIST_HEAD(&worker->handle_list);
+		init_waitqueue_head(&worker->wait);
+		worker->thread = kthread_create(raid5_worker, worker,
+						"%s_raid5/%d",
+						mdname(conf->mddev), cpu);
+		if (IS_ERR(worker->thread))
+			goto fail;
+		kthread_bind(worker->thread, cpu);
+		wake_up_process(worker->thread);
+		if (++nr == max)
+			break;
+	}
+	conf->nr_workers = nr;
+out:
+	unlock_cpu_hotplug();
+	return 0;
+fail:
+	unlock_cpu_hotplug();
+	if (conf->workers)
+		stop_workers(conf, nr);
+	return -ENOMEM;
+}
+
+static mdk_personality_t raid5_personality;
+
+/*
+ * The attributes are there while the array runs as raid5, but an open
+ * file outlives them: check before looking at mddev->private.
+ */
+static raid5_conf_t *raid5_conf(mddev_t *mddev)
+{
+	if (mddev->pers != &raid5_personality)
+		return NULL;
+	return mddev_to_conf(mddev);
+}
+
+static ssize_t
+stripe_cache_size_show(mddev_t *mddev, char *page)
+{
+	raid5_conf_t *conf = raid5_conf(mddev);
+
+	if (!conf)
+		return 0;
+	return sprintf(page, "%d\n", conf->max_nr_stripes);
+}
+
+static ssize_t
+stripe_cache_size_store(mddev_t *mddev, const char *page, size_t len)
+{
+	raid5_conf_t *conf = raid5_conf(mddev);
+	char *end;
+	long new;
+
+	if (!conf)
+		return -ENODEV;
+	new = simple_strtol(page, &end, 10);
+	if (end == page || (*end && *end != '\n'))
+		return -EINVAL;
+	if (new <= 16 || new > MAX_NR_STRIPES)
+		return -EINVAL;
+	raid5_set_cache_size(conf, new);
+	return len;
+}
+
+static struct md_sysfs_entry raid5_stripecache_size = {
+	.attr	= { .name = "stripe_cache_size", .mode = S_IRUGO | S_IWUSR,
+		    .owner = THIS_MODULE },
+	.show	= stripe_cache_size_show,
+	.store	= stripe_cache_size_store,
+};
+
+static ssize_t
+stripe_cache_active_show(mddev_t *mddev, char *page)
+{
+	raid5_conf_t *conf = raid5_conf(mddev);
+
+	if (!conf)
+		return 0;
+	return sprintf(page, "%d\n", atomic_read(&conf->active_stripes));
+}
+
+static struct md_sysfs_entry raid5_stripecache_active = {
+	.attr	= { .name = "stripe_cache_active", .mode = S_IRUGO,
+		    .owner = THIS_MODULE },
+	.show	= stripe_cache_active_show,
+};
+
+#define RAID5_COUNTER(_name, _field)					\
+static ssize_t _name##_show(mddev_t *mddev, char *page)		\
+{									\
+	raid5_conf_t *conf = raid5_conf(mddev);				\
+									\
+	if (!conf)							\
+		return 0;						\
+	return sprintf(page, "%u\n",					\
+		       (unsigned int)atomic_read(&conf->_field));	\
+}									\
+static struct md_sysfs_entry raid5_##_name = {				\
+	.attr	= { .name = #_name, .mode = S_IRUGO,			\
+		    .owner = THIS_MODULE },				\
+	.show	= _name##_show,						\
+}
+
+/* lookups which found the stripe in the cache, or did not */
+RAID5_COUNTER(stripe_cache_hits, cache_hits);
+RAID5_COUNTER(stripe_cache_misses, cache_misses);
+/* times a request had to wait for a stripe to come free */
+RAID5_COUNTER(stripe_waits, stripe_waits);
+/* parity computed from all the data blocks, or from old data and parity */
+RAID5_COUNTER(full_stripe_writes, full_stripe_writes);
+RAID5_COUNTER(rmw_writes, rmw_writes);
+
+static struct attribute *raid5_attrs[] = {
+	&raid5_stripecache_size.attr,
+	&raid5_stripecache_active.attr,
+	&raid5_stripe_cache_hits.attr,
+	&raid5_stripe_cache_misses.attr,
+	&raid5_stripe_waits.attr,
+	&raid5_full_stripe_writes.attr,
+	&raid5_rmw_writes.attr,
+	NULL,
+};
+
+static struct attribute_group raid5_attrs_group = {
+	.attrs	= raid5_attrs,
+};
+
 static int run (mddev_t *mddev)
 {
 	raid5_conf_t *conf;
@@ -1652,7 +1957,15 @@ static int run (mddev_t *mddev)
 	conf->chunk_size = mddev->chunk_size;
 	conf->level = mddev->level;
 	conf->algorithm = mddev->layout;
-	conf->max_nr_stripes = NR_STRIPES;
+	/* with big arrays and lots of memory, a bigger cache lets more
+	 * writes gather into full stripes
+	 */
+	conf->max_nr_stripes = (totalram_pages >> NR_STRIPES_RAM_SHIFT)
+		/ conf->raid_disks;
+	if (conf->max_nr_stripes > NR_STRIPES_DEFAULT_MAX)
+		conf->max_nr_stripes = NR_STRIPES_DEFAULT_MAX;
+	if (conf->max_nr_stripes < NR_STRIPES)
+		conf->max_nr_stripes = NR_STRIPES;
 
 	/* device size must be a multiple of chunk size */
 	mddev->size &= ~(mddev->chunk_size/1024 -1);
@@ -1691,6 +2004,13 @@ static int run (mddev_t *mddev)
 				mdname(mddev));
 			goto abort;
 		}
+		if (start_workers(conf)) {
+			printk(KERN_ERR
+				"raid5: couldn't start worker threads for %s\n",
+				mdname(mddev));
+			md_unregister_thread(mddev->thread);
+			goto abort;
+		}
 	}
 memory = conf->max_nr_stripes * (sizeof(struct stripe_head) +
 		 conf->raid_disks * ((sizeof(struct bio) + PAGE_SIZE))) / 1024;
@@ -1699,6 +2019,7 @@ memory = conf->max_nr_stripes * (sizeof(struct stripe_head) +
 			"raid5: couldn't allocate %dkB for buffers\n", memory);
 		shrink_stripes(conf);
 		md_unregister_thread(mddev->thread);
+		stop_workers(conf, conf->nr_workers);
 		goto abort;
 	} else
 		printk(KERN_INFO "raid5: allocated %dkB for %s\n",
@@ -1717,6 +2038,11 @@ memory = conf->max_nr_stripes * (sizeof(struct stripe_head) +
 
 	print_raid5_conf(conf);
 
+	if (sysfs_create_group(&mddev->kobj, &raid5_attrs_group))
+		printk(KERN_WARNING
+		       "raid5: failed to create sysfs attributes for %s\n",
+		       mdname(mddev));
+
 	/* read-ahead size must cover two whole stripes, which is
 	 * 2 * (n-1) * chunksize where 'n' is the number of raid devices
 	 */
@@ -1751,6 +2077,8 @@ static int stop (mddev_t *mddev)
 
 	md_unregister_thread(mddev->thread);
 	mddev->thread = NULL;
+	stop_workers(conf, conf->nr_workers);
+	sysfs_remove_group(&mddev->kobj, &raid5_attrs_group);
 	shrink_stripes(conf);
 	free_pages((unsigned long) conf->stripe_hashtbl, HASH_PAGES_ORDER);
 	blk_sync_queue(mddev->queue); /* the unplug fn references 'conf'*/
@@ -26,8 +26,11 @@
 #include <linux/slab.h>
 #include <linux/highmem.h>
 #include <linux/bitops.h>
+#include <linux/kthread.h>
+#include <linux/cpu.h>
 #include <asm/atomic.h>
 #include "raid6.h"
+#include <linux/raid/async_tx.h>
 
 /*
  * Stripe cache
@@ -88,6 +91,38 @@ static inline int raid6_next_disk(int disk, int raid_disks)
 
 static void print_raid6_conf (raid6_conf_t *conf);
 
+/*
+ * Queue a stripe for handling, on its worker's list when there are
+ * workers.  Called with device_lock held.
+ */
+static inline void queue_stripe(raid6_conf_t *conf, struct stripe_head *sh)
+{
+	struct raid5_worker *worker;
+
+	if (!conf->nr_workers) {
+		list_add_tail(&sh->lru, &conf->handle_list);
+		md_wakeup_thread(conf->mddev->thread);
+		return;
+	}
+	worker = conf->workers + (unsigned long)(sh->sector >> STRIPE_SHIFT) %
+		conf->nr_workers;
+	list_add_tail(&sh->lru, &worker->handle_list);
+	wake_up(&worker->wait);
+}
+
+/* Nothing queued for handling anywhere; called with device_lock held */
+static inline int handle_lists_empty(raid6_conf_t *conf)
+{
+	int i;
+
+	if (!list_empty(&conf->handle_list))
+		return 0;
+	for (i = 0; i < conf->nr_workers; i++)
+		if (!list_empty(&conf->workers[i].handle_list))
+			return 0;
+	return 1;
+}
+
 static inline void __release_stripe(raid6_conf_t *conf, struct stripe_head *sh)
 {
 	if (atomic_dec_and_test(&sh->count)) {
@@ -96,11 +131,11 @@ static inline void __release_stripe(raid6_conf_t *conf, struct stripe_head *sh)
 		if (atomic_read(&conf->active_stripes)==0)
 			BUG();
 		if (test_bit(STRIPE_HANDLE, &sh->state)) {
-			if (test_bit(STRIPE_DELAYED, &sh->state))
+			if (test_bit(STRIPE_DELAYED, &sh->state)) {
 				list_add_tail(&sh->lru, &conf->delayed_list);
-			else
-				list_add_tail(&sh->lru, &conf->handle_list);
-			md_wakeup_thread(conf->mddev->thread);
+				md_wakeup_thread(conf->mddev->thread);
+			} else
+				queue_stripe(conf, sh);
 		} else {
 			if (test_and_clear_bit(STRIPE_PREREAD_ACTIVE, &sh->state)) {
 				atomic_dec(&conf->preread_active_stripes);
@@ -663,12 +698,13 @@ static sector_t compute_blocknr(struct stripe_head *sh, int i)
  * several bion, each with several bio_vecs, which cover part of the page
  * Multiple bion are linked together on bi_next.  There may be extras
  * at the end of this list.  We ignore them.
+ *
+ * The copies are queued behind @tx, the last of them is returned.
  */
-static void copy_data(int frombio, struct bio *bio,
-		     struct page *page,
-		     sector_t sector)
+static struct async_tx *copy_data(int frombio, struct bio *bio,
+				  struct page *page, sector_t sector,
+				  struct async_tx *tx)
 {
-	char *pa = page_address(page);
 	struct bio_vec *bvl;
 	int i;
 	int page_offset;
@@ -693,26 +729,26 @@ static void copy_data(int frombio, struct bio *bio,
 		else clen = len;
 
 		if (clen > 0) {
-			char *ba = __bio_kmap_atomic(bio, i, KM_USER0);
 			if (frombio)
-				memcpy(pa+page_offset, ba+b_offset, clen);
+				tx = async_memcpy(page, bvl->bv_page,
+						  page_offset,
+						  bvl->bv_offset + b_offset,
+						  clen, ASYNC_TX_DEP_ACK, tx,
+						  NULL, NULL);
 			else
-				memcpy(ba+b_offset, pa+page_offset, clen);
-			__bio_kunmap_atomic(ba, KM_USER0);
+				tx = async_memcpy(bvl->bv_page, page,
+						  bvl->bv_offset + b_offset,
+						  page_offset,
+						  clen, ASYNC_TX_DEP_ACK, tx,
+						  NULL, NULL);
 		}
 		if (clen < len) /* hit end of page */
 			break;
 		page_offset +=  len;
 	}
+	return tx;
 }
 
-#define check_xor() 	do { 						\
-			   if (count == MAX_XOR_BLOCKS) {		\
-				xor_block(count, STRIPE_SIZE, ptr);	\
-				count = 1;				\
-			   }						\
-			} while(0)
-
 /* Compute P and Q syndromes */
 static void compute_parity(struct stripe_head *sh, int method)
 {
@@ -720,7 +756,8 @@ static void compute_parity(struct stripe_head *sh, int method)
 	int i, pd_idx = sh->pd_idx, qd_idx, d0_idx, disks = conf->raid_disks, count;
 	struct bio *chosen;
 	/**** FIX THIS: This could be very bad if disks is close to 256 ****/
-	void *ptrs[disks];
+	struct page *blocks[disks];
+	struct async_tx *tx = NULL;
 
 	qd_idx = raid6_next_disk(pd_idx, disks);
 	d0_idx = raid6_next_disk(qd_idx, disks);
@@ -753,7 +790,8 @@ static void compute_parity(struct stripe_head *sh, int method)
 			sector_t sector = sh->dev[i].sector;
 			struct bio *wbi = sh->dev[i].written;
 			while (wbi && wbi->bi_sector < sector + STRIPE_SECTORS) {
-				copy_data(1, wbi, sh->dev[i].page, sector);
+				tx = copy_data(1, wbi, sh->dev[i].page, sector,
+					       tx);
 				wbi = r5_next_bio(wbi, sector);
 			}
 
@@ -770,7 +808,7 @@ static void compute_parity(struct stripe_head *sh, int method)
 		count = 0;
 		i = d0_idx;
 		do {
-			ptrs[count++] = page_address(sh->dev[i].page);
+			blocks[count++] = sh->dev[i].page;
 			if (count <= disks-2 && !test_bit(R5_UPTODATE, &sh->dev[i].flags))
 				printk("block %d/%d not uptodate on parity calc\n", i,count);
 			i = raid6_next_disk(i, disks);
@@ -778,7 +816,9 @@ static void compute_parity(struct stripe_head *sh, int method)
 //		break;
 //	}
 
-	raid6_call.gen_syndrome(disks, STRIPE_SIZE, ptrs);
+	tx = async_gen_syndrome(blocks, 0, disks, STRIPE_SIZE,
+				ASYNC_TX_DEP_ACK, tx, NULL, NULL);
+	async_tx_quiesce(&tx);
 
 	switch(method) {
 	case RECONSTRUCT_WRITE:
@@ -799,7 +839,8 @@ static void compute_block_1(struct stripe_head *sh, int dd_idx)
 {
 	raid6_conf_t *conf = sh->raid_conf;
 	int i, count, disks = conf->raid_disks;
-	void *ptr[MAX_XOR_BLOCKS], *p;
+	struct page *srcs[disks];
+	struct async_tx *tx;
 	int pd_idx = sh->pd_idx;
 	int qd_idx = raid6_next_disk(pd_idx, disks);
 
@@ -810,24 +851,21 @@ static void compute_block_1(struct stripe_head *sh, int dd_idx)
 		/* We're actually computing the Q drive */
 		compute_parity(sh, UPDATE_PARITY);
 	} else {
-		ptr[0] = page_address(sh->dev[dd_idx].page);
-		memset(ptr[0], 0, STRIPE_SIZE);
-		count = 1;
+		count = 0;
 		for (i = disks ; i--; ) {
 			if (i == dd_idx || i == qd_idx)
 				continue;
-			p = page_address(sh->dev[i].page);
 			if (test_bit(R5_UPTODATE, &sh->dev[i].flags))
-				ptr[count++] = p;
+				srcs[count++] = sh->dev[i].page;
 			else
 				printk("compute_block() %d, stripe %llu, %d"
 				       " not present\n", dd_idx,
 				       (unsigned long long)sh->sector, i);
-
-			check_xor();
 		}
-		if (count != 1)
-			xor_block(count, STRIPE_SIZE, ptr);
+		tx = async_xor(sh->dev[dd_idx].page, srcs, 0, count,
+			       STRIPE_SIZE, ASYNC_TX_XOR_ZERO_DST, NULL,
+			       NULL, NULL);
+		async_tx_quiesce(&tx);
 		set_bit(R5_UPTODATE, &sh->dev[dd_idx].flags);
 	}
 }
@@ -992,6 +1030,7 @@ static void handle_stripe(struct stripe_head *sh)
 	int non_overwrite = 0;
 	int failed_num[2] = {0, 0};
 	struct r5dev *dev, *pdev, *qdev;
+	struct async_tx *tx = NULL;
 	int pd_idx = sh->pd_idx;
 	int qd_idx = raid6_next_disk(pd_idx, disks);
 	int p_failed, q_failed;
@@ -1026,7 +1065,8 @@ static void handle_stripe(struct stripe_head *sh)
 				wake_up(&conf->wait_for_overlap);
 			spin_unlock_irq(&conf->device_lock);
 			while (rbi && rbi->bi_sector < dev->sector + STRIPE_SECTORS) {
-				copy_data(0, rbi, dev->page, dev->sector);
+				tx = copy_data(0, rbi, dev->page, dev->sector,
+					       tx);
 				rbi2 = r5_next_bio(rbi, dev->sector);
 				spin_lock_irq(&conf->device_lock);
 				if (--rbi->bi_phys_segments == 0) {
@@ -1036,6 +1076,7 @@ static void handle_stripe(struct stripe_head *sh)
 				spin_unlock_irq(&conf->device_lock);
 				rbi = rbi2;
 			}
+			async_tx_quiesce(&tx);
 		}
 
 		/* now count some things */
@@ -1476,7 +1517,7 @@ static inline void raid6_activate_delayed(raid6_conf_t *conf)
 			clear_bit(STRIPE_DELAYED, &sh->state);
 			if (!test_and_set_bit(STRIPE_PREREAD_ACTIVE, &sh->state))
 				atomic_inc(&conf->preread_active_stripes);
-			list_add_tail(&sh->lru, &conf->handle_list);
+			queue_stripe(conf, sh);
 		}
 	}
 }
@@ -1634,7 +1675,7 @@ static int make_request (request_queue_t *q, struct bio * bi)
 }
 
 /* FIXME go_faster isn't used */
-static int sync_request (mddev_t *mddev, sector_t sector_nr, int go_faster)
+static int sync_request (mddev_t *mddev, sector_t sector_nr, int *skipped, int go_faster)
 {
 	raid6_conf_t *conf = (raid6_conf_t *) mddev->private;
 	struct stripe_head *sh;
@@ -1712,7 +1753,7 @@ static void raid6d (mddev_t *mddev)
 	while (1) {
 		struct list_head *first;
 
-		if (list_empty(&conf->handle_list) &&
+		if (handle_lists_empty(conf) &&
 		    atomic_read(&conf->preread_active_stripes) < IO_THRESHOLD &&
 		    !blk_queue_plugged(mddev->queue) &&
 		    !list_empty(&conf->delayed_list))
@@ -1745,6 +1786,98 @@ static void raid6d (mddev_t *mddev)
 	PRINTK("--- raid6d inactive\n");
 }
 
+/*
+ * Per-CPU worker thread: handles the stripes queued to it, the same way
+ * raid6d does without workers.  Activating delayed stripes, recovery and
+ * safemode stay with raid6d.
+ */
+static int raid6_worker(void *arg)
+{
+	struct raid5_worker *worker = arg;
+	raid6_conf_t *conf = worker->conf;
+	struct stripe_head *sh;
+
+	while (!kthread_should_stop()) {
+		wait_event_interruptible(worker->wait,
+					 !list_empty(&worker->handle_list) ||
+					 kthread_should_stop());
+		if (current->flags & PF_FREEZE)
+			refrigerator(PF_FREEZE);
+
+		spin_lock_irq(&conf->device_lock);
+		while (!list_empty(&worker->handle_list)) {
+			sh = list_entry(worker->handle_list.next,
+					struct stripe_head, lru);
+			list_del_init(&sh->lru);
+			atomic_inc(&sh->count);
+			if (atomic_read(&sh->count) != 1)
+				BUG();
+			spin_unlock_irq(&conf->device_lock);
+
+			handle_stripe(sh);
+			release_stripe(sh);
+
+			spin_lock_irq(&conf->device_lock);
+		}
+		if (!list_empty(&conf->delayed_list))
+			md_wakeup_thread(conf->mddev->thread);
+		spin_unlock_irq(&conf->device_lock);
+
+		unplug_slaves(conf->mddev);
+	}
+	return 0;
+}
+
+static void stop_workers(raid6_conf_t *conf, int nr)
+{
+	int i;
+
+	conf->nr_workers = 0;
+	for (i = 0; i < nr; i++)
+		kthread_stop(conf->workers[i].thread);
+	kfree(conf->workers);
+	conf->workers = NULL;
+}
+
+/* One worker per online CPU, none on UP where raid6d does the work */
+static int start_workers(raid6_conf_t *conf)
+{
+	struct raid5_worker *worker;
+	int cpu, nr = 0, max;
+
+	lock_cpu_hotplug();
+	max = num_online_cpus();
+	if (max < 2)
+		goto out;
+	conf->workers = kmalloc(max * sizeof(struct raid5_worker), GFP_KERNEL);
+	if (!conf->workers)
+		goto fail;
+	for_each_online_cpu(cpu) {
+		worker = conf->workers + nr;
+		worker->conf = conf;
+		INIT_LIST_HEAD(&worker->handle_list);
+		init_waitqueue_head(&worker->wait);
+		worker->thread = kthread_create(raid6_worker, worker,
+						"%s_raid6/%d",
+						mdname(conf->mddev), cpu);
+		if (IS_ERR(worker->thread))
+			goto fail;
+		kthread_bind(worker->thread, cpu);
+		wake_up_process(worker->thread);
+		if (++nr == max)
+			break;
+	}
+	conf->nr_workers = nr;
+out:
+	unlock_cpu_hotplug();
+	return 0;
+fail:
+	unlock_cpu_hotplug();
+	if (conf->workers)
+		stop_workers(conf, nr);
+	return -ENOMEM;
+}
+
 static int run (mddev_t *mddev)
 {
 	raid6_conf_t *conf;
@@ -1856,6 +1989,13 @@ static int run (mddev_t *mddev)
 			       mdname(mddev));
 			goto abort;
 		}
+		if (start_workers(conf)) {
+			printk(KERN_ERR
+			       "raid6: couldn't start worker threads for %s\n",
+			       mdname(mddev));
+			md_unregister_thread(mddev->thread);
+			goto abort;
+		}
 	}
 
 	memory = conf->max_nr_stripes * (sizeof(struct stripe_head) +
@@ -1865,6 +2005,7 @@ static int run (mddev_t *mddev)
 		       "raid6: couldn't allocate %dkB for buffers\n", memory);
 		shrink_stripes(conf);
 		md_unregister_thread(mddev->thread);
+		stop_workers(conf, conf->nr_workers);
 		goto abort;
 	} else
 		printk(KERN_INFO "raid6: allocated %dkB for %s\n",
@@ -1917,6 +2058,7 @@ static int stop (mddev_t *mddev)
 
 	md_unregister_thread(mddev->thread);
 	mddev->thread = NULL;
+	stop_workers(conf, conf->nr_workers);
 	shrink_stripes(conf);
 	free_pages((unsigned long) conf->stripe_hashtbl, HASH_PAGES_ORDER);
 	blk_sync_queue(mddev->queue); /* the unplug fn references 'conf'*/
@@ -58,6 +58,7 @@
 #include <linux/if_ether.h>
 #include <linux/netdevice.h>
 #include <linux/spinlock.h>
+#include <linux/rcupdate.h>
 #include <linux/ethtool.h>
 #include <linux/if_bonding.h>
 #include <linux/pkt_sched.h>
@@ -2321,9 +2322,18 @@ void bond_3ad_handle_link_change(struct slave *slave, char link)
 int bond_3ad_get_active_agg_info(struct bonding *bond, struct ad_info *ad_info)
 {
 	struct aggregator *aggregator = NULL;
-	struct port *port;
+	struct slave *slave, *first;
+	int i;
+
+	/* bounded by slave_cnt, as it is also called from the transmit path */
+	first = rcu_dereference(bond->first_slave);
+	if (!first) {
+		return -1;
+	}
+
+	bond_for_each_slave_from(bond, slave, i, first) {
+		struct port *port = &(SLAVE_AD_INFO(slave).port);
 
-	for (port = __get_first_port(bond); port; port = __get_next_port(port)) {
 		if (port->aggregator && port->aggregator->is_active) {
 			aggregator = port->aggregator;
 			break;
@@ -2346,7 +2356,6 @@ int bond_3ad_xmit_xor(struct sk_buff *skb, struct net_device *dev)
 {
 	struct slave *slave, *start_at;
 	struct bonding *bond = dev->priv;
-	struct ethhdr *data = (struct ethhdr *)skb->data;
 	int slave_agg_no;
 	int slaves_in_agg;
 	int agg_id;
@@ -2354,10 +2363,8 @@ int bond_3ad_xmit_xor(struct sk_buff *skb, struct net_device *dev)
 	struct ad_info ad_info;
 	int res = 1;
 
-	/* make sure that the slaves list will
-	 * not change during tx
-	 */
-	read_lock(&bond->lock);
+	/* the slaves list is walked under RCU, see bonding.h */
+	rcu_read_lock();
 
 	if (!BOND_IS_OK(bond)) {
 		goto out;
@@ -2377,9 +2384,14 @@ int bond_3ad_xmit_xor(struct sk_buff *skb, struct net_device *dev)
 		goto out;
 	}
 
-	slave_agg_no = (data->h_dest[5]^bond->dev->dev_addr[5]) % slaves_in_agg;
+	slave_agg_no = bond_xmit_hash(bond, skb, slaves_in_agg);
 
-	bond_for_each_slave(bond, slave, i) {
+	start_at = rcu_dereference(bond->first_slave);
+	if (!start_at) {
+		goto out;
+	}
+
+	bond_for_each_slave_from(bond, slave, i, start_at) {
 		struct aggregator *agg = SLAVE_AD_INFO(slave).port.aggregator;
 
 		if (agg && (agg->aggregator_identifier == agg_id)) {
@@ -2416,7 +2428,7 @@ out:
 		/* no suitable interface, frame not sent */
 		dev_kfree_skb(skb);
 	}
-	read_unlock(&bond->lock);
+	rcu_read_unlock();
 	return 0;
 }
 
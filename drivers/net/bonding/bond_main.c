@@ -519,6 +519,9 @@
 #include <linux/ethtool.h>
 #include <linux/if_vlan.h>
 #include <linux/if_bonding.h>
+#include <linux/rcupdate.h>
+#include <linux/percpu.h>
+#include <net/ip.h>
 #include "bonding.h"
 #include "bond_3ad.h"
 #include "bond_alb.h"
@@ -537,6 +540,7 @@ static int use_carrier	= 1;
 static char *mode	= NULL;
 static char *primary	= NULL;
 static char *lacp_rate	= NULL;
+static char *xmit_hash_policy = NULL;
 static int arp_interval = BOND_LINK_ARP_INTERV;
 static char *arp_ip_target[BOND_MAX_ARP_TARGETS] = { NULL, };
 
@@ -556,6 +560,8 @@ module_param(primary, charp, 0);
 MODULE_PARM_DESC(primary, "Primary network device to use");
 module_param(lacp_rate, charp, 0);
 MODULE_PARM_DESC(lacp_rate, "LACPDU tx rate to request from 802.3ad partner (slow/fast)");
+module_param(xmit_hash_policy, charp, 0);
+MODULE_PARM_DESC(xmit_hash_policy, "XOR hashing method : 0 for layer 2 (default), 1 for layer 3+4");
 module_param(arp_interval, int, 0);
 MODULE_PARM_DESC(arp_interval, "arp interval in milliseconds");
 module_param_array(arp_ip_target, charp, NULL, 0);
@@ -577,6 +583,7 @@ static int arp_ip_count	= 0;
 static u32 my_ip	= 0;
 static int bond_mode	= BOND_MODE_ROUNDROBIN;
 static int lacp_fast	= 0;
+static int xmit_policy	= BOND_XMIT_POLICY_LAYER2;
 static int app_abi_ver	= 0;
 static int orig_app_abi_ver = -1; /* This is used to save the first ABI version
 				   * we receive from the application. Once set,
@@ -608,6 +615,12 @@ static struct bond_parm_tbl bond_mode_tbl[] = {
 {	NULL,			-1},
 };
 
+static struct bond_parm_tbl xmit_hashtype_tbl[] = {
+{	"layer2",		BOND_XMIT_POLICY_LAYER2},
+{	"layer3+4",		BOND_XMIT_POLICY_LAYER34},
+{	NULL,			-1},
+};
+
 /*-------------------------- Forward declarations ---------------------------*/
 
 static inline void bond_set_mode_ops(struct net_device *bond_dev, int mode);
@@ -1523,12 +1536,12 @@ static void bond_attach_slave(struct bonding *bond, struct slave *new_slave)
 	if (bond->first_slave == NULL) { /* attaching the first slave */
 		new_slave->next = new_slave;
 		new_slave->prev = new_slave;
-		bond->first_slave = new_slave;
+		rcu_assign_pointer(bond->first_slave, new_slave);
 	} else {
 		new_slave->next = bond->first_slave;
 		new_slave->prev = bond->first_slave->prev;
 		new_slave->next->prev = new_slave;
-		new_slave->prev->next = new_slave;
+		rcu_assign_pointer(new_slave->prev->next, new_slave);
 	}
 
 	bond->slave_cnt++;
@@ -1541,6 +1554,8 @@ static void bond_attach_slave(struct bonding *bond, struct slave *new_slave)
  * Nothing is freed on return, structures are just unchained.
  * If any slave pointer in bond was pointing to <slave>,
  * it should be changed by the calling function.
+ * <slave>->next is left alone for the transmit routines which may still
+ * be passing over it, <slave> is not to be freed before synchronize_net().
  *
  * bond->lock held for writing by caller.
  */
@@ -1562,8 +1577,6 @@ static void bond_detach_slave(struct bonding *bond, struct slave *slave)
 		}
 	}
 
-	slave->next = NULL;
-	slave->prev = NULL;
 	bond->slave_cnt--;
 }
 
@@ -2173,6 +2186,7 @@ static int bond_release(struct net_device *bond_dev, struct net_device *slave_de
 		slave_dev->flags &= ~IFF_NOARP;
 	}
 
+	synchronize_net();
 	kfree(slave);
 
 	return 0;  /* deletion OK */
@@ -2263,6 +2277,7 @@ static int bond_release_all(struct net_device *bond_dev)
 			slave_dev->flags &= ~IFF_NOARP;
 		}
 
+		synchronize_net();
 		kfree(slave);
 
 		/* re-acquire the lock before getting the next slave */
@@ -3145,6 +3160,12 @@ static void bond_info_show_master(struct seq_file *seq)
 	seq_printf(seq, "Bonding Mode: %s\n",
 		   bond_mode_name(bond->params.mode));
 
+	if ((bond->params.mode == BOND_MODE_XOR) ||
+	    (bond->params.mode == BOND_MODE_8023AD)) {
+		seq_printf(seq, "Transmit Hash Policy: %s\n",
+			   xmit_hashtype_tbl[bond->params.xmit_policy].modename);
+	}
+
 	if (USES_PRIMARY(bond->params.mode)) {
 		seq_printf(seq, "Primary Slave: %s\n",
 			   (bond->params.primary[0]) ?
@@ -4006,48 +4027,87 @@ unwind:
 	return res;
 }
 
+/*
+ * The slave to send @skb on, out of @count, for balance-xor and 802.3ad.
+ * Layer 2 hashes the MAC addresses; layer 3+4 the IP addresses and the
+ * ports of TCP and UDP, but not of fragments, which carry none past
+ * the first.  Frames which are not IP fall back to layer 2.
+ */
+int bond_xmit_hash(struct bonding *bond, struct sk_buff *skb, int count)
+{
+	struct ethhdr *data = (struct ethhdr *)skb->data;
+
+	if (bond->params.xmit_policy == BOND_XMIT_POLICY_LAYER34 &&
+	    skb->protocol == __constant_htons(ETH_P_IP)) {
+		struct iphdr *iph = skb->nh.iph;
+		u16 *ports = (u16 *)((u32 *)iph + iph->ihl);
+		u32 layer4_xor = 0;
+
+		if (!(iph->frag_off & __constant_htons(IP_MF|IP_OFFSET)) &&
+		    (iph->protocol == IPPROTO_TCP ||
+		     iph->protocol == IPPROTO_UDP) &&
+		    (unsigned char *)(ports + 2) <= skb->tail)
+			layer4_xor = ntohs(ports[0] ^ ports[1]);
+
+		return (layer4_xor ^
+			((ntohl(iph->saddr ^ iph->daddr)) & 0xffff)) % count;
+	}
+
+	return (data->h_dest[5] ^ bond->dev->dev_addr[5]) % count;
+}
+
+/*
+ * The transmit routines below run without bond->lock, see bonding.h: the
+ * first slave and the count are read once, the list is only walked from
+ * a slave that was seen in it.
+ */
+
+/*
+ * Each CPU takes the slaves in turn on its own, so that
+ * sending does not write to a line the other CPUs share.
+ */
 static int bond_xmit_roundrobin(struct sk_buff *skb, struct net_device *bond_dev)
 {
 	struct bonding *bond = bond_dev->priv;
 	struct slave *slave, *start_at;
+	int slave_cnt, slave_no;
 	int i;
 	int res = 1;
 
-	read_lock(&bond->lock);
+	rcu_read_lock();
 
 	if (!BOND_IS_OK(bond)) {
 		goto out;
 	}
 
-	read_lock(&bond->curr_slave_lock);
-	slave = start_at = bond->curr_active_slave;
-	read_unlock(&bond->curr_slave_lock);
-
-	if (!slave) {
+	slave_cnt = bond->slave_cnt;
+	slave = rcu_dereference(bond->first_slave);
+	if (!slave || slave_cnt <= 0) {
 		goto out;
 	}
 
+	slave_no = (*per_cpu_ptr(bond->rr_tx_counter, smp_processor_id()))++ %
+		   slave_cnt;
+	while (slave_no--) {
+		slave = rcu_dereference(slave->next);
+	}
+
+	start_at = slave;
 	bond_for_each_slave_from(bond, slave, i, start_at) {
 		if (IS_UP(slave->dev) &&
 		    (slave->link == BOND_LINK_UP) &&
 		    (slave->state == BOND_STATE_ACTIVE)) {
 			res = bond_dev_queue_xmit(bond, skb, slave->dev);
-
-			write_lock(&bond->curr_slave_lock);
-			bond->curr_active_slave = slave->next;
-			write_unlock(&bond->curr_slave_lock);
-
 			break;
 		}
 	}
 
-
 out:
 	if (res) {
 		/* no suitable interface, frame not sent */
 		dev_kfree_skb(skb);
 	}
-	read_unlock(&bond->lock);
+	rcu_read_unlock();
 	return 0;
 }
 
@@ -4058,6 +4118,7 @@ out:
 static int bond_xmit_activebackup(struct sk_buff *skb, struct net_device *bond_dev)
 {
 	struct bonding *bond = bond_dev->priv;
+	struct slave *slave;
 	int res = 1;
 
 	/* if we are sending arp packets, try to at least
@@ -4071,15 +4132,15 @@ static int bond_xmit_activebackup(struct sk_buff *skb, struct net_device *bond_d
 		memcpy(&my_ip, the_ip, 4);
 	}
 
-	read_lock(&bond->lock);
-	read_lock(&bond->curr_slave_lock);
+	rcu_read_lock();
 
 	if (!BOND_IS_OK(bond)) {
 		goto out;
 	}
 
-	if (bond->curr_active_slave) { /* one usable interface */
-		res = bond_dev_queue_xmit(bond, skb, bond->curr_active_slave->dev);
+	slave = rcu_dereference(bond->curr_active_slave);
+	if (slave) { /* one usable interface */
+		res = bond_dev_queue_xmit(bond, skb, slave->dev);
 	}
 
 out:
@@ -4087,42 +4148,41 @@ out:
 		/* no suitable interface, frame not sent */
 		dev_kfree_skb(skb);
 	}
-	read_unlock(&bond->curr_slave_lock);
-	read_unlock(&bond->lock);
+	rcu_read_unlock();
 	return 0;
 }
 
 /*
- * in XOR mode, we determine the output device by performing xor on
- * the source and destination hw adresses.  If this device is not
- * enabled, find the next slave following this xor slave.
+ * in XOR mode, we determine the output device by hashing the frame,
+ * see bond_xmit_hash().  If this device is not enabled, find the next
+ * slave following this xor slave.
  */
 static int bond_xmit_xor(struct sk_buff *skb, struct net_device *bond_dev)
 {
 	struct bonding *bond = bond_dev->priv;
-	struct ethhdr *data = (struct ethhdr *)skb->data;
 	struct slave *slave, *start_at;
-	int slave_no;
+	int slave_cnt, slave_no;
 	int i;
 	int res = 1;
 
-	read_lock(&bond->lock);
+	rcu_read_lock();
 
 	if (!BOND_IS_OK(bond)) {
 		goto out;
 	}
 
-	slave_no = (data->h_dest[5]^bond_dev->dev_addr[5]) % bond->slave_cnt;
+	slave_cnt = bond->slave_cnt;
+	slave = rcu_dereference(bond->first_slave);
+	if (!slave || slave_cnt <= 0) {
+		goto out;
+	}
 
-	bond_for_each_slave(bond, slave, i) {
-		slave_no--;
-		if (slave_no < 0) {
-			break;
-		}
+	slave_no = bond_xmit_hash(bond, skb, slave_cnt);
+	while (slave_no--) {
+		slave = rcu_dereference(slave->next);
 	}
 
 	start_at = slave;
-
 	bond_for_each_slave_from(bond, slave, i, start_at) {
 		if (IS_UP(slave->dev) &&
 		    (slave->link == BOND_LINK_UP) &&
@@ -4137,7 +4197,7 @@ out:
 		/* no suitable interface, frame not sent */
 		dev_kfree_skb(skb);
 	}
-	read_unlock(&bond->lock);
+	rcu_read_unlock();
 	return 0;
 }
 
@@ -4152,16 +4212,13 @@ static int bond_xmit_broadcast(struct sk_buff *skb, struct net_device *bond_dev)
 	int i;
 	int res = 1;
 
-	read_lock(&bond->lock);
+	rcu_read_lock();
 
 	if (!BOND_IS_OK(bond)) {
 		goto out;
 	}
 
-	read_lock(&bond->curr_slave_lock);
-	start_at = bond->curr_active_slave;
-	read_unlock(&bond->curr_slave_lock);
-
+	start_at = rcu_dereference(bond->curr_active_slave);
 	if (!start_at) {
 		goto out;
 	}
@@ -4199,7 +4256,7 @@ out:
 		dev_kfree_skb(skb);
 	}
 	/* frame sent to all suitable interfaces */
-	read_unlock(&bond->lock);
+	rcu_read_unlock();
 	return 0;
 }
 
@@ -4240,8 +4297,16 @@ static inline void bond_set_mode_ops(struct net_device *bond_dev, int mode)
 	}
 }
 
+static void bond_destructor(struct net_device *bond_dev)
+{
+	struct bonding *bond = bond_dev->priv;
+
+	free_percpu(bond->rr_tx_counter);
+	free_netdev(bond_dev);
+}
+
 /*
- * Does not allocate but creates a /proc entry.
+ * Allocates the round robin counters and creates a /proc entry.
  * Allowed to fail.
  */
 static int __init bond_init(struct net_device *bond_dev, struct bond_params *params)
@@ -4250,6 +4315,11 @@ static int __init bond_init(struct net_device *bond_dev, struct bond_params *par
 
 	dprintk("Begin bond_init for %s\n", bond_dev->name);
 
+	bond->rr_tx_counter = alloc_percpu(u32);
+	if (!bond->rr_tx_counter) {
+		return -ENOMEM;
+	}
+
 	/* initialize rwlocks */
 	rwlock_init(&bond->lock);
 	rwlock_init(&bond->curr_slave_lock);
@@ -4275,7 +4345,7 @@ static int __init bond_init(struct net_device *bond_dev, struct bond_params *par
 
 	bond_set_mode_ops(bond_dev, bond->params.mode);
 
-	bond_dev->destructor = free_netdev;
+	bond_dev->destructor = bond_destructor;
 
 	/* Initialize the device options */
 	bond_dev->tx_queue_len = 0;
@@ -4400,6 +4470,24 @@ static int bond_check_params(struct bond_params *params)
 		}
 	}
 
+	if (xmit_hash_policy) {
+		if ((bond_mode != BOND_MODE_XOR) &&
+		    (bond_mode != BOND_MODE_8023AD)) {
+			printk(KERN_INFO DRV_NAME
+			       ": xmit_hash_policy param is irrelevant in mode %s\n",
+			       bond_mode_name(bond_mode));
+		} else {
+			xmit_policy = bond_parse_parm(xmit_hash_policy,
+						      xmit_hashtype_tbl);
+			if (xmit_policy == -1) {
+				printk(KERN_ERR DRV_NAME
+				       ": Error: Invalid xmit_hash_policy \"%s\"\n",
+				       xmit_hash_policy);
+				return -EINVAL;
+			}
+		}
+	}
+
 	if (max_bonds < 1 || max_bonds > INT_MAX) {
 		printk(KERN_WARNING DRV_NAME
 		       ": Warning: max_bonds (%d) not in range %d-%d, so it "
@@ -4601,6 +4689,7 @@ static int bond_check_params(struct bond_params *params)
 	params->downdelay = downdelay;
 	params->use_carrier = use_carrier;
 	params->lacp_fast = lacp_fast;
+	params->xmit_policy = xmit_policy;
 	params->primary[0] = 0;
 
 	if (primary) {
@@ -4662,7 +4751,7 @@ static int __init bonding_init(void)
 		res = register_netdevice(bond_dev);
 		if (res < 0) {
 			bond_deinit(bond_dev);
-			free_netdev(bond_dev);
+			bond_destructor(bond_dev);
 			goto out_err;
 		}
 	}
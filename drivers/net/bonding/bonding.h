@@ -59,7 +59,7 @@
 /*
  * Checks whether bond is ready for transmit.
  *
- * Caller must hold bond->lock
+ * Caller must hold bond->lock, or rcu_read_lock() on the transmit path
  */
 #define BOND_IS_OK(bond)			     \
 		   (((bond)->dev->flags & IFF_UP) && \
@@ -101,7 +101,9 @@
  * @cnt:	counter for max number of moves
  * @start:	starting point.
  *
- * Caller must hold bond->lock
+ * Caller must hold bond->lock, or rcu_read_lock() on the transmit path.
+ * The slaves seen then are bounded by the current slave_cnt, so passing
+ * over a slave being released, which still points into the list, is safe.
  */
 #define bond_for_each_slave_from(bond, pos, cnt, start)	\
 	for (cnt = 0, pos = start;				\
@@ -143,6 +145,7 @@ struct bond_params {
 	int updelay;
 	int downdelay;
 	int lacp_fast;
+	int xmit_policy;
 	char primary[IFNAMSIZ];
 	u32 arp_targets[BOND_MAX_ARP_TARGETS];
 };
@@ -177,6 +180,10 @@ struct slave {
  *    (It is unnecessary when the write-lock is put with bond->lock.)
  * 3) When we lock with bond->curr_slave_lock, we must lock with bond->lock
  *    beforehand.
+ * 4) The transmit routines take neither, they walk the slave list and read
+ *    bond->curr_active_slave under rcu_read_lock().  So the slave list is
+ *    changed in an order they can follow, and a released slave is only
+ *    freed after synchronize_net().
  */
 struct bonding {
 	struct   net_device *dev; /* first - usefull for panic debug */
@@ -184,6 +191,7 @@ struct bonding {
 	struct   slave *curr_active_slave;
 	struct   slave *current_arp_slave;
 	struct   slave *primary_slave;
+	u32      *rr_tx_counter; /* per cpu, the round robin slave to send on */
 	s32      slave_cnt; /* never change this value outside the attach/detach wrappers */
 	rwlock_t lock;
 	rwlock_t curr_slave_lock;
@@ -247,6 +255,7 @@ extern inline void bond_set_slave_active_flags(struct slave *slave)
 
 struct vlan_entry *bond_next_vlan(struct bonding *bond, struct vlan_entry *curr);
 int bond_dev_queue_xmit(struct bonding *bond, struct sk_buff *skb, struct net_device *slave_dev);
+int bond_xmit_hash(struct bonding *bond, struct sk_buff *skb, int count);
 
 #endif /* _LINUX_BONDING_H */
 
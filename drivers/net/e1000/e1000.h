@@ -100,6 +100,17 @@ struct e1000_adapter;
 
 #define E1000_MAX_INTR 10
 
+#define E1000_WATCHDOG_PERIOD	2	/* seconds */
+
+/* Dynamic Interrupt Throttle Rate defaults, rates in packets/sec */
+#define E1000_ITR_PKT_RATE_LOW	2000
+#define E1000_ITR_PKT_RATE_HIGH	50000
+#define E1000_ITR_BULK		4000	/* ints/sec */
+
+/* Interrupt interval limits exposed through ethtool, in usecs */
+#define E1000_MIN_ITR_USECS	10	/* 100000 ints/sec */
+#define E1000_MAX_ITR_USECS	10000	/* 100 ints/sec */
+
 /* TX/RX descriptor defines */
 #define E1000_DEFAULT_TXD                  256
 #define E1000_MAX_TXD                      256
@@ -239,6 +250,16 @@ struct e1000_adapter {
 
 	/* Interrupt Throttle Rate */
 	uint32_t itr;
+	/* Dynamic ITR: below itr_pkt_rate_low packets/sec itr_low is used,
+	 * above itr_pkt_rate_high itr_high (both in ints/sec, 0 is off) */
+	uint32_t itr_pkt_rate_low;
+	uint32_t itr_pkt_rate_high;
+	uint32_t itr_low;
+	uint32_t itr_high;
+	uint32_t gprc;
+	uint64_t gprc_old;
+	uint32_t gptc;
+	uint64_t gptc_old;
 
 	/* OS defined structs */
 	struct net_device *netdev;
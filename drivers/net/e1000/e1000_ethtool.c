@@ -558,6 +558,75 @@ e1000_get_drvinfo(struct net_device *netdev,
 	drvinfo->eedump_len = e1000_get_eeprom_len(netdev);
 }
 
+/* The Interrupt Throttle Rate is kept in ints/sec with 0 meaning off,
+ * ethtool talks about the interval between interrupts in usecs. */
+#define E1000_ITR_TO_USECS(itr) ((itr) ? 1000000 / (itr) : 0)
+
+static int
+e1000_itr_usecs_valid(uint32_t usecs)
+{
+	return !usecs || (usecs >= E1000_MIN_ITR_USECS &&
+			  usecs <= E1000_MAX_ITR_USECS);
+}
+
+static int
+e1000_get_coalesce(struct net_device *netdev, struct ethtool_coalesce *ec)
+{
+	struct e1000_adapter *adapter = netdev->priv;
+
+	if(adapter->hw.mac_type < e1000_82540)
+		return -EOPNOTSUPP;
+
+	if(adapter->itr == 1)
+		ec->use_adaptive_rx_coalesce = 1;
+	else
+		ec->rx_coalesce_usecs = E1000_ITR_TO_USECS(adapter->itr);
+
+	ec->pkt_rate_low = adapter->itr_pkt_rate_low;
+	ec->rx_coalesce_usecs_low = E1000_ITR_TO_USECS(adapter->itr_low);
+	ec->pkt_rate_high = adapter->itr_pkt_rate_high;
+	ec->rx_coalesce_usecs_high = E1000_ITR_TO_USECS(adapter->itr_high);
+	ec->rate_sample_interval = E1000_WATCHDOG_PERIOD;
+
+	return 0;
+}
+
+static int
+e1000_set_coalesce(struct net_device *netdev, struct ethtool_coalesce *ec)
+{
+	struct e1000_adapter *adapter = netdev->priv;
+
+	if(adapter->hw.mac_type < e1000_82540)
+		return -EOPNOTSUPP;
+
+	if(!e1000_itr_usecs_valid(ec->rx_coalesce_usecs) ||
+	   !e1000_itr_usecs_valid(ec->rx_coalesce_usecs_low) ||
+	   !e1000_itr_usecs_valid(ec->rx_coalesce_usecs_high))
+		return -EINVAL;
+
+	/* the rate is sampled by the watchdog, whose period is fixed */
+	if(ec->use_adaptive_rx_coalesce &&
+	   (ec->rate_sample_interval != E1000_WATCHDOG_PERIOD ||
+	    ec->pkt_rate_low > ec->pkt_rate_high))
+		return -EINVAL;
+
+	adapter->itr_pkt_rate_low = ec->pkt_rate_low;
+	adapter->itr_low = E1000_ITR_TO_USECS(ec->rx_coalesce_usecs_low);
+	adapter->itr_pkt_rate_high = ec->pkt_rate_high;
+	adapter->itr_high = E1000_ITR_TO_USECS(ec->rx_coalesce_usecs_high);
+
+	if(ec->use_adaptive_rx_coalesce) {
+		/* e1000_watchdog programs ITR from now on */
+		adapter->itr = 1;
+	} else {
+		adapter->itr = E1000_ITR_TO_USECS(ec->rx_coalesce_usecs);
+		E1000_WRITE_REG(&adapter->hw, ITR, adapter->itr ?
+				1000000000 / (adapter->itr * 256) : 0);
+	}
+
+	return 0;
+}
+
 static void
 e1000_get_ringparam(struct net_device *netdev,
                     struct ethtool_ringparam *ring)
@@ -1645,6 +1714,8 @@ struct ethtool_ops e1000_ethtool_ops = {
 	.get_eeprom_len         = e1000_get_eeprom_len,
 	.get_eeprom             = e1000_get_eeprom,
 	.set_eeprom             = e1000_set_eeprom,
+	.get_coalesce		= e1000_get_coalesce,
+	.set_coalesce		= e1000_set_coalesce,
 	.get_ringparam          = e1000_get_ringparam,
 	.set_ringparam          = e1000_set_ringparam,
 	.get_pauseparam		= e1000_get_pauseparam,
@@ -1220,7 +1220,8 @@ e1000_unmap_and_free_tx_resource(struct e1000_adapter *adapter,
 		buffer_info->dma = 0;
 	}
 	if(buffer_info->skb) {
-		dev_kfree_skb_any(buffer_info->skb);
+		skb_recycle(buffer_info->skb,
+			    adapter->rx_buffer_len + NET_IP_ALIGN);
 		buffer_info->skb = NULL;
 	}
 }
@@ -1604,6 +1605,11 @@ e1000_watchdog_task(struct e1000_adapter *adapter)
 	adapter->gotcl = adapter->stats.gotcl - adapter->gotcl_old;
 	adapter->gotcl_old = adapter->stats.gotcl;
 
+	adapter->gprc = adapter->stats.gprc - adapter->gprc_old;
+	adapter->gprc_old = adapter->stats.gprc;
+	adapter->gptc = adapter->stats.gptc - adapter->gptc_old;
+	adapter->gptc_old = adapter->stats.gptc;
+
 	e1000_update_adaptive(&adapter->hw);
 
 	if(!netif_carrier_ok(netdev)) {
@@ -1618,15 +1624,27 @@ e1000_watchdog_task(struct e1000_adapter *adapter)
 
 	/* Dynamic mode for Interrupt Throttle Rate (ITR) */
 	if(adapter->hw.mac_type >= e1000_82540 && adapter->itr == 1) {
-		/* Symmetric Tx/Rx gets a reduced ITR=2000; Total
-		 * asymmetrical Tx or Rx gets ITR=8000; everyone
-		 * else is between 2000-8000. */
-		uint32_t goc = (adapter->gotcl + adapter->gorcl) / 10000;
-		uint32_t dif = (adapter->gotcl > adapter->gorcl ? 
-			adapter->gotcl - adapter->gorcl :
-			adapter->gorcl - adapter->gotcl) / 10000;
-		uint32_t itr = goc > 0 ? (dif * 6000 / goc + 2000) : 8000;
-		E1000_WRITE_REG(&adapter->hw, ITR, 1000000000 / (itr * 256));
+		/* The packet rate over the watchdog period picks the low
+		 * or bulk setting at either end.  In between, symmetric
+		 * Tx/Rx gets a reduced ITR=2000; Total asymmetrical Tx
+		 * or Rx gets ITR=8000; everyone else is between 2000-8000. */
+		uint32_t rate = (adapter->gprc + adapter->gptc) /
+			E1000_WATCHDOG_PERIOD;
+		uint32_t itr;
+
+		if(rate < adapter->itr_pkt_rate_low)
+			itr = adapter->itr_low;
+		else if(rate > adapter->itr_pkt_rate_high)
+			itr = adapter->itr_high;
+		else {
+			uint32_t goc = (adapter->gotcl + adapter->gorcl) / 10000;
+			uint32_t dif = (adapter->gotcl > adapter->gorcl ?
+				adapter->gotcl - adapter->gorcl :
+				adapter->gorcl - adapter->gotcl) / 10000;
+			itr = goc > 0 ? (dif * 6000 / goc + 2000) : 8000;
+		}
+		E1000_WRITE_REG(&adapter->hw, ITR,
+				itr ? 1000000000 / (itr * 256) : 0);
 	}
 
 	/* Cause software interrupt to ensure rx ring is cleaned */
@@ -1636,7 +1654,7 @@ e1000_watchdog_task(struct e1000_adapter *adapter)
 	adapter->detect_tx_hung = TRUE;
 
 	/* Reset the timer */
-	mod_timer(&adapter->watchdog_timer, jiffies + 2 * HZ);
+	mod_timer(&adapter->watchdog_timer, jiffies + E1000_WATCHDOG_PERIOD * HZ);
 }
 
 #define E1000_TX_FLAGS_CSUM		0x00000001
@@ -2549,7 +2567,7 @@ e1000_clean_rx_irq(struct e1000_adapter *adapter)
 					le16_to_cpu(rx_desc->special) &
 					E1000_RXD_SPC_VLAN_MASK);
 		} else {
-			netif_receive_skb(skb);
+			netif_gro_receive(skb);
 		}
 #else /* CONFIG_E1000_NAPI */
 		if(unlikely(adapter->vlgrp &&
@@ -2600,7 +2618,7 @@ e1000_alloc_rx_buffers(struct e1000_adapter *adapter)
 	while(!buffer_info->skb) {
 		bufsz = adapter->rx_buffer_len + NET_IP_ALIGN;
 
-		skb = dev_alloc_skb(bufsz);
+		skb = dev_alloc_skb_recycle(bufsz);
 		if(unlikely(!skb)) {
 			/* Better luck next round */
 			break;
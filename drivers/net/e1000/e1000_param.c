@@ -487,6 +487,13 @@ e1000_check_options(struct e1000_adapter *adapter)
 		} else {
 			adapter->itr = opt.def;
 		}
+
+		/* Quiet links get no throttling at all for lowest latency,
+		 * busy ones the bulk rate; see e1000_watchdog. */
+		adapter->itr_pkt_rate_low = E1000_ITR_PKT_RATE_LOW;
+		adapter->itr_pkt_rate_high = E1000_ITR_PKT_RATE_HIGH;
+		adapter->itr_low = 0;
+		adapter->itr_high = E1000_ITR_BULK;
 	}
 
 	switch(adapter->hw.media_type) {
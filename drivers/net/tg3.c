@@ -2472,7 +2472,7 @@ static int tg3_setup_phy(struct tg3 *tp, int force_reset)
 	if (!(tp->tg3_flags2 & TG3_FLG2_5705_PLUS)) {
 		if (netif_carrier_ok(tp->dev)) {
 			tw32(HOSTCC_STAT_COAL_TICKS,
-			     DEFAULT_STAT_COAL_TICKS);
+			     tp->coal.stats_block_coalesce_usecs);
 		} else {
 			tw32(HOSTCC_STAT_COAL_TICKS, 0);
 		}
@@ -2524,6 +2524,7 @@ static void tg3_tx(struct tg3 *tp)
 		}
 
 		dev_kfree_skb_irq(skb);
+		tp->coal_pkts++;
 	}
 
 	tp->tx_cons = sw_idx;
@@ -2787,7 +2788,7 @@ static int tg3_rx(struct tg3 *tp, int budget)
 				    desc->err_vlan & RXD_VLAN_MASK);
 		} else
 #endif
-			netif_receive_skb(skb);
+			netif_gro_receive(skb);
 
 		tp->dev->last_rx = jiffies;
 		received++;
@@ -2863,6 +2864,7 @@ static int tg3_poll(struct net_device *netdev, int *budget)
 			orig_budget = netdev->quota;
 
 		work_done = tg3_rx(tp, orig_budget);
+		tp->coal_pkts += work_done;
 
 		*budget -= work_done;
 		netdev->quota -= work_done;
@@ -2954,6 +2956,37 @@ static irqreturn_t tg3_interrupt(int irq, void *dev_id, struct pt_regs *regs)
 	return IRQ_RETVAL(handled);
 }
 
+/*
+ * MSI is never shared and arrives after the status block it announces
+ * is in memory, so the PCI state register need not be read to find out
+ * whether it is ours and flush the status block.
+ */
+static irqreturn_t tg3_msi(int irq, void *dev_id, struct pt_regs *regs)
+{
+	struct net_device *dev = dev_id;
+	struct tg3 *tp = netdev_priv(dev);
+	struct tg3_hw_status *sblk = tp->hw_status;
+	unsigned long flags;
+
+	spin_lock_irqsave(&tp->lock, flags);
+
+	/* stop further interrupts until the poll is done, as above */
+	tw32_mailbox(MAILBOX_INTERRUPT_0 + TG3_64BIT_REG_LOW, 0x00000001);
+	sblk->status &= ~SD_STATUS_UPDATED;
+
+	if (likely(tg3_has_work(dev, tp)))
+		netif_rx_schedule(dev);		/* schedule NAPI poll */
+	else {
+		/* no work, re-enable interrupts */
+		tw32_mailbox(MAILBOX_INTERRUPT_0 + TG3_64BIT_REG_LOW,
+			     0x00000000);
+	}
+
+	spin_unlock_irqrestore(&tp->lock, flags);
+
+	return IRQ_RETVAL(1);
+}
+
 static int tg3_init_hw(struct tg3 *);
 static int tg3_halt(struct tg3 *);
 
@@ -3957,6 +3990,12 @@ static int tg3_chip_reset(struct tg3 *tp)
 		tw32(0x7c00, val | (1 << 25));
 	}
 
+	/* The reset turned message signalled interrupts off.  */
+	if (tp->tg3_flags2 & TG3_FLG2_USING_MSI) {
+		val = tr32(MSGINT_MODE);
+		tw32(MSGINT_MODE, val | MSGINT_MODE_ENABLE);
+	}
+
 	/* Reprobe ASF enable state.  */
 	tp->tg3_flags &= ~TG3_FLAG_ENABLE_ASF;
 	tp->tg3_flags2 &= ~TG3_FLG2_ASF_NEW_HANDSHAKE;
@@ -4961,6 +5000,97 @@ static void tg3_set_bdinfo(struct tg3 *tp, u32 bdinfo_addr,
 
 static void __tg3_set_rx_mode(struct net_device *);
 
+/* Program the rx/tx coalescing engine with one of the parameter
+ * sets in tp->coal.  Only the directions with adaptive coalescing
+ * enabled follow the level, the others always use the base values.
+ *
+ * tp->lock is held.
+ */
+static void tg3_set_coal_level(struct tg3 *tp, int level)
+{
+	struct ethtool_coalesce *ec = &tp->coal;
+	u32 rx_ticks = ec->rx_coalesce_usecs;
+	u32 rx_frames = ec->rx_max_coalesced_frames;
+	u32 tx_ticks = ec->tx_coalesce_usecs;
+	u32 tx_frames = ec->tx_max_coalesced_frames;
+
+	if (ec->use_adaptive_rx_coalesce) {
+		if (level == TG3_COAL_LOW) {
+			rx_ticks = ec->rx_coalesce_usecs_low;
+			rx_frames = ec->rx_max_coalesced_frames_low;
+		} else if (level == TG3_COAL_HIGH) {
+			rx_ticks = ec->rx_coalesce_usecs_high;
+			rx_frames = ec->rx_max_coalesced_frames_high;
+		}
+	}
+	if (ec->use_adaptive_tx_coalesce) {
+		if (level == TG3_COAL_LOW) {
+			tx_ticks = ec->tx_coalesce_usecs_low;
+			tx_frames = ec->tx_max_coalesced_frames_low;
+		} else if (level == TG3_COAL_HIGH) {
+			tx_ticks = ec->tx_coalesce_usecs_high;
+			tx_frames = ec->tx_max_coalesced_frames_high;
+		}
+	}
+
+	tw32(HOSTCC_RXCOL_TICKS, rx_ticks);
+	tw32(HOSTCC_TXCOL_TICKS, tx_ticks);
+	tw32(HOSTCC_RXMAX_FRAMES, rx_frames);
+	tw32(HOSTCC_TXMAX_FRAMES, tx_frames);
+
+	tp->coal_level = level;
+}
+
+/* tp->lock is held. */
+static void __tg3_set_coalesce(struct tg3 *tp)
+{
+	struct ethtool_coalesce *ec = &tp->coal;
+
+	tg3_set_coal_level(tp, TG3_COAL_NORMAL);
+	tp->coal_pkts_last = tp->coal_pkts;
+	tp->coal_jiffies = jiffies;
+
+	if (!(tp->tg3_flags2 & TG3_FLG2_5705_PLUS)) {
+		tw32(HOSTCC_RXCOAL_TICK_INT, ec->rx_coalesce_usecs_irq);
+		tw32(HOSTCC_TXCOAL_TICK_INT, ec->tx_coalesce_usecs_irq);
+	}
+	tw32(HOSTCC_RXCOAL_MAXF_INT, ec->rx_max_coalesced_frames_irq);
+	tw32(HOSTCC_TXCOAL_MAXF_INT, ec->tx_max_coalesced_frames_irq);
+}
+
+/* Called once a second from tg3_timer.  Work out the packet rate
+ * tg3_poll has seen over the last sample interval and move the
+ * coalescing engine towards low latency when the link is quiet and
+ * towards fewer interrupts when it is busy.
+ *
+ * tp->lock is held.
+ */
+static void tg3_adapt_coal(struct tg3 *tp)
+{
+	struct ethtool_coalesce *ec = &tp->coal;
+	unsigned long elapsed = jiffies - tp->coal_jiffies;
+	u32 pkts, rate;
+	int level;
+
+	if (elapsed < ec->rate_sample_interval * HZ)
+		return;
+
+	pkts = tp->coal_pkts - tp->coal_pkts_last;
+	tp->coal_pkts_last += pkts;
+	tp->coal_jiffies = jiffies;
+	rate = pkts / (elapsed / HZ);
+
+	if (rate < ec->pkt_rate_low)
+		level = TG3_COAL_LOW;
+	else if (rate > ec->pkt_rate_high)
+		level = TG3_COAL_HIGH;
+	else
+		level = TG3_COAL_NORMAL;
+
+	if (level != tp->coal_level)
+		tg3_set_coal_level(tp, level);
+}
+
 /* tp->lock is held. */
 static int tg3_reset_hw(struct tg3 *tp)
 {
@@ -5279,16 +5409,7 @@ static int tg3_reset_hw(struct tg3 *tp)
 		udelay(10);
 	}
 
-	tw32(HOSTCC_RXCOL_TICKS, 0);
-	tw32(HOSTCC_TXCOL_TICKS, LOW_TXCOL_TICKS);
-	tw32(HOSTCC_RXMAX_FRAMES, 1);
-	tw32(HOSTCC_TXMAX_FRAMES, LOW_RXMAX_FRAMES);
-	if (!(tp->tg3_flags2 & TG3_FLG2_5705_PLUS)) {
-		tw32(HOSTCC_RXCOAL_TICK_INT, 0);
-		tw32(HOSTCC_TXCOAL_TICK_INT, 0);
-	}
-	tw32(HOSTCC_RXCOAL_MAXF_INT, 1);
-	tw32(HOSTCC_TXCOAL_MAXF_INT, 0);
+	__tg3_set_coalesce(tp);
 
 	/* set status block DMA address */
 	tw32(HOSTCC_STATUS_BLK_HOST_ADDR + TG3_64BIT_REG_HIGH,
@@ -5302,7 +5423,7 @@ static int tg3_reset_hw(struct tg3 *tp)
 		 * tg3_get_stats to see how this works for 5705/5750 chips.
 		 */
 		tw32(HOSTCC_STAT_COAL_TICKS,
-		     DEFAULT_STAT_COAL_TICKS);
+		     tp->coal.stats_block_coalesce_usecs);
 		tw32(HOSTCC_STATS_BLK_HOST_ADDR + TG3_64BIT_REG_HIGH,
 		     ((u64) tp->stats_mapping >> 32));
 		tw32(HOSTCC_STATS_BLK_HOST_ADDR + TG3_64BIT_REG_LOW,
@@ -5681,6 +5802,10 @@ static void tg3_timer(unsigned long __opaque)
 			}
 		}
 
+		if (tp->coal.use_adaptive_rx_coalesce ||
+		    tp->coal.use_adaptive_tx_coalesce)
+			tg3_adapt_coal(tp);
+
 		tp->timer_counter = tp->timer_multiplier;
 	}
 
@@ -5706,6 +5831,126 @@ static void tg3_timer(unsigned long __opaque)
 	add_timer(&tp->timer);
 }
 
+static int tg3_request_irq(struct tg3 *tp)
+{
+	struct net_device *dev = tp->dev;
+
+	/* MSI moved the device to another vector */
+	dev->irq = tp->pdev->irq;
+	if (tp->tg3_flags2 & TG3_FLG2_USING_MSI)
+		return request_irq(dev->irq, tg3_msi, 0, dev->name, dev);
+	return request_irq(dev->irq, tg3_interrupt, SA_SHIRQ, dev->name, dev);
+}
+
+static void tg3_disable_msi(struct tg3 *tp)
+{
+	if (tp->tg3_flags2 & TG3_FLG2_USING_MSI) {
+		pci_disable_msi(tp->pdev);
+		tp->tg3_flags2 &= ~TG3_FLG2_USING_MSI;
+		tp->dev->irq = tp->pdev->irq;
+	}
+}
+
+static irqreturn_t tg3_test_isr(int irq, void *dev_id, struct pt_regs *regs)
+{
+	struct net_device *dev = dev_id;
+	struct tg3 *tp = netdev_priv(dev);
+
+	tg3_disable_ints(tp);
+	return IRQ_HANDLED;
+}
+
+/*
+ * Have the chip raise an interrupt and see whether it arrives, which
+ * leaves the mailbox non-zero.  Called without tp->lock, with the
+ * hardware initialised and the interrupt requested.
+ */
+static int tg3_test_interrupt(struct tg3 *tp)
+{
+	struct net_device *dev = tp->dev;
+	u32 int_mbox = 0;
+	int err, i;
+
+	free_irq(dev->irq, dev);
+	err = request_irq(dev->irq, tg3_test_isr, SA_SHIRQ, dev->name, dev);
+	if (err)
+		return err;
+
+	spin_lock_irq(&tp->lock);
+	tg3_enable_ints(tp);
+	tw32_f(HOSTCC_MODE, tp->coalesce_mode | HOSTCC_MODE_ENABLE |
+	       HOSTCC_MODE_NOW);
+	spin_unlock_irq(&tp->lock);
+
+	for (i = 0; i < 5; i++) {
+		int_mbox = tr32(MAILBOX_INTERRUPT_0 + TG3_64BIT_REG_LOW);
+		if (int_mbox != 0)
+			break;
+		msleep(10);
+	}
+
+	spin_lock_irq(&tp->lock);
+	tg3_disable_ints(tp);
+	spin_unlock_irq(&tp->lock);
+
+	free_irq(dev->irq, dev);
+	err = tg3_request_irq(tp);
+	if (err)
+		return err;
+
+	return int_mbox != 0 ? 0 : -EIO;
+}
+
+/*
+ * Some chipsets and bridges lose MSI writes.  Fall back to the INTx
+ * line if no MSI arrives, resetting the chip that may be confused by
+ * the attempt.
+ */
+static int tg3_test_msi(struct tg3 *tp)
+{
+	struct net_device *dev = tp->dev;
+	u16 pci_cmd;
+	int err;
+
+	if (!(tp->tg3_flags2 & TG3_FLG2_USING_MSI))
+		return 0;
+
+	/* a lost MSI write must not be taken for a system error */
+	pci_read_config_word(tp->pdev, PCI_COMMAND, &pci_cmd);
+	pci_write_config_word(tp->pdev, PCI_COMMAND,
+			      pci_cmd & ~PCI_COMMAND_SERR);
+
+	err = tg3_test_interrupt(tp);
+
+	pci_write_config_word(tp->pdev, PCI_COMMAND, pci_cmd);
+
+	if (err != -EIO)
+		return err;
+
+	printk(KERN_WARNING PFX "%s: No interrupt was generated using MSI, "
+	       "switching to INTx mode.\n", dev->name);
+
+	free_irq(dev->irq, dev);
+	tg3_disable_msi(tp);
+	err = tg3_request_irq(tp);
+	if (err)
+		return err;
+
+	spin_lock_irq(&tp->lock);
+	spin_lock(&tp->tx_lock);
+
+	tg3_halt(tp);
+	err = tg3_init_hw(tp);
+
+	spin_unlock(&tp->tx_lock);
+	spin_unlock_irq(&tp->lock);
+
+	if (err)
+		free_irq(dev->irq, dev);
+
+	return err;
+}
+
 static int tg3_open(struct net_device *dev)
 {
 	struct tg3 *tp = netdev_priv(dev);
@@ -5727,10 +5972,17 @@ static int tg3_open(struct net_device *dev)
 	if (err)
 		return err;
 
-	err = request_irq(dev->irq, tg3_interrupt,
-			  SA_SHIRQ, dev->name, dev);
+	/* The 5750 AX and BX cannot do MSI.  */
+	if (GET_ASIC_REV(tp->pci_chip_rev_id) == ASIC_REV_5750 &&
+	    GET_CHIP_REV(tp->pci_chip_rev_id) != CHIPREV_5750_AX &&
+	    GET_CHIP_REV(tp->pci_chip_rev_id) != CHIPREV_5750_BX &&
+	    pci_enable_msi(tp->pdev) == 0)
+		tp->tg3_flags2 |= TG3_FLG2_USING_MSI;
+
+	err = tg3_request_irq(tp);
 
 	if (err) {
+		tg3_disable_msi(tp);
 		tg3_free_consistent(tp);
 		return err;
 	}
@@ -5761,6 +6013,26 @@ static int tg3_open(struct net_device *dev)
 
 	if (err) {
 		free_irq(dev->irq, dev);
+		tg3_disable_msi(tp);
+		tg3_free_consistent(tp);
+		return err;
+	}
+
+	err = tg3_test_msi(tp);
+	if (err) {
+		del_timer_sync(&tp->timer);
+
+		spin_lock_irq(&tp->lock);
+		spin_lock(&tp->tx_lock);
+
+		tg3_halt(tp);
+		tg3_free_rings(tp);
+		tp->tg3_flags &= ~TG3_FLAG_INIT_COMPLETE;
+
+		spin_unlock(&tp->tx_lock);
+		spin_unlock_irq(&tp->lock);
+
+		tg3_disable_msi(tp);
 		tg3_free_consistent(tp);
 		return err;
 	}
@@ -6036,6 +6308,7 @@ static int tg3_close(struct net_device *dev)
 	spin_unlock_irq(&tp->lock);
 
 	free_irq(dev->irq, dev);
+	tg3_disable_msi(tp);
 
 	memcpy(&tp->net_stats_prev, tg3_get_stats(tp->dev),
 	       sizeof(tp->net_stats_prev));
@@ -6936,6 +7209,88 @@ static void tg3_vlan_rx_kill_vid(struct net_device *dev, unsigned short vid)
 }
 #endif
 
+static int tg3_get_coalesce(struct net_device *dev, struct ethtool_coalesce *ec)
+{
+	struct tg3 *tp = netdev_priv(dev);
+
+	memcpy(ec, &tp->coal, sizeof(*ec));
+	return 0;
+}
+
+static int tg3_set_coalesce(struct net_device *dev, struct ethtool_coalesce *ec)
+{
+	struct tg3 *tp = netdev_priv(dev);
+	u32 max_rxcoal_tick_int = 0, max_txcoal_tick_int = 0;
+	u32 max_stat_coal_ticks = 0, min_stat_coal_ticks = 0;
+
+	if (!(tp->tg3_flags2 & TG3_FLG2_5705_PLUS)) {
+		max_rxcoal_tick_int = MAX_RXCOAL_TICK_INT;
+		max_txcoal_tick_int = MAX_TXCOAL_TICK_INT;
+		max_stat_coal_ticks = MAX_STAT_COAL_TICKS;
+		min_stat_coal_ticks = MIN_STAT_COAL_TICKS;
+	}
+
+	if ((ec->rx_coalesce_usecs > MAX_RXCOL_TICKS) ||
+	    (ec->rx_coalesce_usecs_low > MAX_RXCOL_TICKS) ||
+	    (ec->rx_coalesce_usecs_high > MAX_RXCOL_TICKS) ||
+	    (ec->tx_coalesce_usecs > MAX_TXCOL_TICKS) ||
+	    (ec->tx_coalesce_usecs_low > MAX_TXCOL_TICKS) ||
+	    (ec->tx_coalesce_usecs_high > MAX_TXCOL_TICKS) ||
+	    (ec->rx_max_coalesced_frames > MAX_RXMAX_FRAMES) ||
+	    (ec->rx_max_coalesced_frames_low > MAX_RXMAX_FRAMES) ||
+	    (ec->rx_max_coalesced_frames_high > MAX_RXMAX_FRAMES) ||
+	    (ec->tx_max_coalesced_frames > MAX_TXMAX_FRAMES) ||
+	    (ec->tx_max_coalesced_frames_low > MAX_TXMAX_FRAMES) ||
+	    (ec->tx_max_coalesced_frames_high > MAX_TXMAX_FRAMES) ||
+	    (ec->rx_coalesce_usecs_irq > max_rxcoal_tick_int) ||
+	    (ec->tx_coalesce_usecs_irq > max_txcoal_tick_int) ||
+	    (ec->rx_max_coalesced_frames_irq > MAX_RXCOAL_MAXF_INT) ||
+	    (ec->tx_max_coalesced_frames_irq > MAX_TXCOAL_MAXF_INT) ||
+	    (ec->stats_block_coalesce_usecs > max_stat_coal_ticks) ||
+	    (ec->stats_block_coalesce_usecs < min_stat_coal_ticks))
+		return -EINVAL;
+
+	/* The chip never interrupts for a direction whose usecs and
+	 * frames limits are both zero.
+	 */
+	if ((!ec->rx_coalesce_usecs && !ec->rx_max_coalesced_frames) ||
+	    (!ec->tx_coalesce_usecs && !ec->tx_max_coalesced_frames))
+		return -EINVAL;
+
+	if (ec->use_adaptive_rx_coalesce &&
+	    ((!ec->rx_coalesce_usecs_low && !ec->rx_max_coalesced_frames_low) ||
+	     (!ec->rx_coalesce_usecs_high && !ec->rx_max_coalesced_frames_high)))
+		return -EINVAL;
+
+	if (ec->use_adaptive_tx_coalesce &&
+	    ((!ec->tx_coalesce_usecs_low && !ec->tx_max_coalesced_frames_low) ||
+	     (!ec->tx_coalesce_usecs_high && !ec->tx_max_coalesced_frames_high)))
+		return -EINVAL;
+
+	if ((ec->use_adaptive_rx_coalesce || ec->use_adaptive_tx_coalesce) &&
+	    (!ec->rate_sample_interval || ec->pkt_rate_low > ec->pkt_rate_high))
+		return -EINVAL;
+
+	spin_lock_irq(&tp->lock);
+	spin_lock(&tp->tx_lock);
+
+	memcpy(&tp->coal, ec, sizeof(*ec));
+	tp->coal.cmd = ETHTOOL_GCOALESCE;
+
+	if (netif_running(dev)) {
+		__tg3_set_coalesce(tp);
+		if (!(tp->tg3_flags2 & TG3_FLG2_5705_PLUS) &&
+		    netif_carrier_ok(dev))
+			tw32(HOSTCC_STAT_COAL_TICKS,
+			     tp->coal.stats_block_coalesce_usecs);
+	}
+
+	spin_unlock(&tp->tx_lock);
+	spin_unlock_irq(&tp->lock);
+
+	return 0;
+}
+
 static struct ethtool_ops tg3_ethtool_ops = {
 	.get_settings		= tg3_get_settings,
 	.set_settings		= tg3_set_settings,
@@ -6968,6 +7323,8 @@ static struct ethtool_ops tg3_ethtool_ops = {
 	.get_strings		= tg3_get_strings,
 	.get_stats_count	= tg3_get_stats_count,
 	.get_ethtool_stats	= tg3_get_ethtool_stats,
+	.get_coalesce		= tg3_get_coalesce,
+	.set_coalesce		= tg3_set_coalesce,
 };
 
 static void __devinit tg3_get_eeprom_size(struct tg3 *tp)
@@ -8617,6 +8974,45 @@ static void __devinit tg3_init_bufmgr_config(struct tg3 *tp)
 	tp->bufmgr_config.dma_high_water = DEFAULT_DMA_HIGH_WATER;
 }
 
+/* The base values are what the driver has always programmed: an
+ * interrupt per received frame for lowest latency.  The high rate
+ * set trades some of that latency for fewer interrupts under load.
+ */
+static void __devinit tg3_init_coal(struct tg3 *tp)
+{
+	struct ethtool_coalesce *ec = &tp->coal;
+
+	memset(ec, 0, sizeof(*ec));
+	ec->cmd = ETHTOOL_GCOALESCE;
+	ec->rx_coalesce_usecs = 0;
+	ec->rx_max_coalesced_frames = 1;
+	ec->rx_coalesce_usecs_irq = 0;
+	ec->rx_max_coalesced_frames_irq = 1;
+	ec->tx_coalesce_usecs = LOW_TXCOL_TICKS;
+	ec->tx_max_coalesced_frames = LOW_RXMAX_FRAMES;
+	ec->tx_coalesce_usecs_irq = 0;
+	ec->tx_max_coalesced_frames_irq = 0;
+
+	if (!(tp->tg3_flags2 & TG3_FLG2_5705_PLUS))
+		ec->stats_block_coalesce_usecs = DEFAULT_STAT_COAL_TICKS;
+
+	ec->pkt_rate_low = TG3_PKT_RATE_LOW;
+	ec->rx_coalesce_usecs_low = 0;
+	ec->rx_max_coalesced_frames_low = 1;
+	ec->tx_coalesce_usecs_low = LOW_TXCOL_TICKS;
+	ec->tx_max_coalesced_frames_low = LOW_RXMAX_FRAMES;
+
+	ec->pkt_rate_high = TG3_PKT_RATE_HIGH;
+	ec->rx_coalesce_usecs_high = DEFAULT_RXCOL_TICKS;
+	ec->rx_max_coalesced_frames_high = DEFAULT_RXMAX_FRAMES;
+	ec->tx_coalesce_usecs_high = DEFAULT_TXCOL_TICKS;
+	ec->tx_max_coalesced_frames_high = DEFAULT_TXMAX_FRAMES;
+
+	ec->rate_sample_interval = 1;
+
+	tp->coal_level = TG3_COAL_NORMAL;
+}
+
 static char * __devinit tg3_phy_string(struct tg3 *tp)
 {
 	switch (tp->phy_id & PHY_ID_MASK) {
@@ -8831,6 +9227,8 @@ static int __devinit tg3_init_one(struct pci_dev *pdev,
 			DEFAULT_MB_HIGH_WATER_5705;
 	}
 
+	tg3_init_coal(tp);
+
 #if TG3_TSO_SUPPORT != 0
 	if (tp->tg3_flags2 & TG3_FLG2_HW_TSO) {
 		tp->tg3_flags2 |= TG3_FLG2_TSO_CAPABLE;
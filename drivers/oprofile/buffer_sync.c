@@ -466,9 +466,11 @@ static void mark_done(int cpu)
 }
 
 
-/* FIXME: this is not sufficient if we implement syscall barrier backtrace
- * traversal, the code switch to sb_sample_start at first kernel enter/exit
- * switch so we need a fifth state and some special handling in sync_buffer()
+/* A backtrace of a kernel sample can go on into the user stack of the
+ * task, with a kernel exit switch in between, see oprofile_trace_mode().
+ * Only the first switch of the buffer changes the state, so the user
+ * part is merged into the same trace; a user entry without a mapping
+ * ends the trace there (sb_bt_ignore).
  */
 typedef enum {
 	sb_bt_ignore = -2,
@@ -284,6 +284,28 @@ void oprofile_add_trace(unsigned long pc)
 }
 
 
+void oprofile_trace_mode(int is_kernel)
+{
+	struct oprofile_cpu_buffer * cpu_buf = &cpu_buffer[smp_processor_id()];
+
+	if (!cpu_buf->tracing)
+		return;
+
+	if (nr_available_slots(cpu_buf) < 1) {
+		cpu_buf->tracing = 0;
+		cpu_buf->sample_lost_overflow++;
+		return;
+	}
+
+	/* the same code log_sample() uses, so sync_buffer() sees it alike */
+	is_kernel = !!is_kernel;
+	if (cpu_buf->last_is_kernel != is_kernel) {
+		cpu_buf->last_is_kernel = is_kernel;
+		add_code(cpu_buf, is_kernel);
+	}
+}
+
+
 
 /*
  * This serves to avoid cpu buffer overflow, and makes sure
@@ -46,12 +46,12 @@ enum {
 	AHCI_MAX_SG		= 168, /* hardware max is 64K */
 	AHCI_DMA_BOUNDARY	= 0xffffffff,
 	AHCI_USE_CLUSTERING	= 0,
-	AHCI_CMD_SLOT_SZ	= 32 * 32,
+	AHCI_MAX_CMDS		= 32,
+	AHCI_CMD_SLOT_SZ	= AHCI_MAX_CMDS * 32,
 	AHCI_RX_FIS_SZ		= 256,
 	AHCI_CMD_TBL_HDR	= 0x80,
 	AHCI_CMD_TBL_SZ		= AHCI_CMD_TBL_HDR + (AHCI_MAX_SG * 16),
-	AHCI_PORT_PRIV_DMA_SZ	= AHCI_CMD_SLOT_SZ + AHCI_CMD_TBL_SZ +
-				  AHCI_RX_FIS_SZ,
+	AHCI_PORT_PRIV_DMA_SZ	= AHCI_CMD_SLOT_SZ + AHCI_RX_FIS_SZ,
 	AHCI_IRQ_ON_SG		= (1 << 31),
 	AHCI_CMD_ATAPI		= (1 << 5),
 	AHCI_CMD_WRITE		= (1 << 6),
@@ -74,6 +74,7 @@ enum {
 
 	/* HOST_CAP bits */
 	HOST_CAP_64		= (1 << 31), /* PCI DAC (64-bit DMA) support */
+	HOST_CAP_NCQ		= (1 << 30), /* native command queuing */
 
 	/* registers for each SATA port */
 	PORT_LST_ADDR		= 0x00, /* command list DMA addr */
@@ -159,9 +160,8 @@ struct ahci_host_priv {
 struct ahci_port_priv {
 	struct ahci_cmd_hdr	*cmd_slot;
 	dma_addr_t		cmd_slot_dma;
-	void			*cmd_tbl;
+	void			*cmd_tbl;	/* one per slot in use */
 	dma_addr_t		cmd_tbl_dma;
-	struct ahci_sg		*cmd_tbl_sg;
 	void			*rx_fis;
 	dma_addr_t		rx_fis_dma;
 };
@@ -189,7 +189,7 @@ static Scsi_Host_Template ahci_sht = {
 	.ioctl			= ata_scsi_ioctl,
 	.queuecommand		= ata_scsi_queuecmd,
 	.eh_strategy_handler	= ata_scsi_error,
-	.can_queue		= ATA_DEF_QUEUE,
+	.can_queue		= ATA_MAX_QUEUE - 1,
 	.this_id		= ATA_SHT_THIS_ID,
 	.sg_tablesize		= AHCI_MAX_SG,
 	.max_sectors		= ATA_MAX_SECTORS,
@@ -279,6 +279,22 @@ static inline void *ahci_port_base (void *base, unsigned int port)
 	return (void *) ahci_port_base_ul((unsigned long)base, port);
 }
 
+/*
+ * With NCQ each command has the slot and command table of its tag,
+ * otherwise the single command in flight has slot 0.
+ */
+static inline unsigned int ahci_slot(struct ata_queued_cmd *qc)
+{
+	return (qc->ap->flags & ATA_FLAG_NCQ) ? qc->tag : 0;
+}
+
+static inline size_t ahci_port_priv_dma_sz(struct ata_port *ap)
+{
+	unsigned int n_tbl = (ap->flags & ATA_FLAG_NCQ) ? AHCI_MAX_CMDS : 1;
+
+	return AHCI_PORT_PRIV_DMA_SZ + n_tbl * AHCI_CMD_TBL_SZ;
+}
+
 static void ahci_host_stop(struct ata_host_set *host_set)
 {
 	struct ahci_host_priv *hpriv = host_set->private_data;
@@ -306,12 +322,13 @@ static int ahci_port_start(struct ata_port *ap)
 	}
 	memset(pp, 0, sizeof(*pp));
 
-	mem = dma_alloc_coherent(dev, AHCI_PORT_PRIV_DMA_SZ, &mem_dma, GFP_KERNEL);
+	mem = dma_alloc_coherent(dev, ahci_port_priv_dma_sz(ap), &mem_dma,
+				 GFP_KERNEL);
 	if (!mem) {
 		rc = -ENOMEM;
 		goto err_out_kfree;
 	}
-	memset(mem, 0, AHCI_PORT_PRIV_DMA_SZ);
+	memset(mem, 0, ahci_port_priv_dma_sz(ap));
 
 	/*
 	 * First item in chunk of DMA memory: 32-slot command table,
@@ -333,14 +350,12 @@ static int ahci_port_start(struct ata_port *ap)
 	mem_dma += AHCI_RX_FIS_SZ;
 
 	/*
-	 * Third item: data area for storing a single command
-	 * and its scatter-gather table
+	 * Third item: data area for storing a command and its
+	 * scatter-gather table, for each slot in use
 	 */
 	pp->cmd_tbl = mem;
 	pp->cmd_tbl_dma = mem_dma;
 
-	pp->cmd_tbl_sg = mem + AHCI_CMD_TBL_HDR;
-
 	ap->private_data = pp;
 
 	if (hpriv->cap & HOST_CAP_64)
@@ -387,7 +402,7 @@ static void ahci_port_stop(struct ata_port *ap)
 	msleep(500);
 
 	ap->private_data = NULL;
-	dma_free_coherent(dev, AHCI_PORT_PRIV_DMA_SZ,
+	dma_free_coherent(dev, ahci_port_priv_dma_sz(ap),
 			  pp->cmd_slot, pp->cmd_slot_dma);
 	kfree(pp);
 	ata_port_stop(ap);
@@ -472,9 +487,8 @@ static void ahci_tf_read(struct ata_port *ap, struct ata_taskfile *tf)
 	ata_tf_from_fis(d2h_fis, tf);
 }
 
-static void ahci_fill_sg(struct ata_queued_cmd *qc)
+static void ahci_fill_sg(struct ata_queued_cmd *qc, struct ahci_sg *sg)
 {
-	struct ahci_port_priv *pp = qc->ap->private_data;
 	unsigned int i;
 
 	VPRINTK("ENTER\n");
@@ -489,21 +503,23 @@ static void ahci_fill_sg(struct ata_queued_cmd *qc)
 		addr = sg_dma_address(&qc->sg[i]);
 		sg_len = sg_dma_len(&qc->sg[i]);
 
-		pp->cmd_tbl_sg[i].addr = cpu_to_le32(addr & 0xffffffff);
-		pp->cmd_tbl_sg[i].addr_hi = cpu_to_le32((addr >> 16) >> 16);
-		pp->cmd_tbl_sg[i].flags_size = cpu_to_le32(sg_len - 1);
+		sg[i].addr = cpu_to_le32(addr & 0xffffffff);
+		sg[i].addr_hi = cpu_to_le32((addr >> 16) >> 16);
+		sg[i].flags_size = cpu_to_le32(sg_len - 1);
 	}
 }
 
 static void ahci_qc_prep(struct ata_queued_cmd *qc)
 {
 	struct ahci_port_priv *pp = qc->ap->private_data;
+	unsigned int slot = ahci_slot(qc);
+	void *cmd_tbl = pp->cmd_tbl + slot * AHCI_CMD_TBL_SZ;
+	dma_addr_t cmd_tbl_dma = pp->cmd_tbl_dma + slot * AHCI_CMD_TBL_SZ;
 	u32 opts;
 	const u32 cmd_fis_len = 5; /* five dwords */
 
 	/*
-	 * Fill in command slot information (currently only one slot,
-	 * slot 0, is currently since we don't do queueing)
+	 * Fill in command slot information
 	 */
 
 	opts = (qc->n_elem << 16) | cmd_fis_len;
@@ -522,21 +538,21 @@ static void ahci_qc_prep(struct ata_queued_cmd *qc)
 		break;
 	}
 
-	pp->cmd_slot[0].opts = cpu_to_le32(opts);
-	pp->cmd_slot[0].status = 0;
-	pp->cmd_slot[0].tbl_addr = cpu_to_le32(pp->cmd_tbl_dma & 0xffffffff);
-	pp->cmd_slot[0].tbl_addr_hi = cpu_to_le32((pp->cmd_tbl_dma >> 16) >> 16);
+	pp->cmd_slot[slot].opts = cpu_to_le32(opts);
+	pp->cmd_slot[slot].status = 0;
+	pp->cmd_slot[slot].tbl_addr = cpu_to_le32(cmd_tbl_dma & 0xffffffff);
+	pp->cmd_slot[slot].tbl_addr_hi = cpu_to_le32((cmd_tbl_dma >> 16) >> 16);
 
 	/*
 	 * Fill in command table information.  First, the header,
 	 * a SATA Register - Host to Device command FIS.
 	 */
-	ata_tf_to_fis(&qc->tf, pp->cmd_tbl, 0);
+	ata_tf_to_fis(&qc->tf, cmd_tbl, 0);
 
 	if (!(qc->flags & ATA_QCFLAG_DMAMAP))
 		return;
 
-	ahci_fill_sg(qc);
+	ahci_fill_sg(qc, cmd_tbl + AHCI_CMD_TBL_HDR);
 }
 
 static void ahci_intr_error(struct ata_port *ap, u32 irq_stat)
@@ -597,6 +613,18 @@ static void ahci_eng_timeout(struct ata_port *ap)
 
 	ahci_intr_error(ap, readl(port_mmio + PORT_IRQ_STAT));
 
+	if (ap->sactive) {
+		unsigned int tag;
+
+		/* same hack as below, for each of the queued commands */
+		for (tag = 0; tag < ATA_MAX_QUEUE; tag++)
+			if (ap->sactive & (1 << tag))
+				ata_qc_from_tag(ap, tag)->scsidone =
+					scsi_finish_command;
+		ata_ncq_error(ap);
+		return;
+	}
+
 	qc = ata_qc_from_tag(ap, ap->active_tag);
 	if (!qc) {
 		printk(KERN_ERR "ata%u: BUG: timeout without command\n",
@@ -626,18 +654,22 @@ static inline int ahci_host_intr(struct ata_port *ap, struct ata_queued_cmd *qc)
 	status = readl(port_mmio + PORT_IRQ_STAT);
 	writel(status, port_mmio + PORT_IRQ_STAT);
 
-	ci = readl(port_mmio + PORT_CMD_ISSUE);
-	if (likely((ci & 0x1) == 0)) {
-		if (qc) {
-			ata_qc_complete(qc, 0);
-			qc = NULL;
-		}
-	}
-
-	if (status & PORT_IRQ_FATAL) {
+	if (unlikely(status & PORT_IRQ_FATAL)) {
 		ahci_intr_error(ap, status);
-		if (qc)
+		if (ap->sactive)
+			ata_ncq_error(ap);
+		else if (qc)
 			ata_qc_complete(qc, ATA_ERR);
+		return 1;
+	}
+
+	/* NCQ commands complete with their SActive bit cleared */
+	if (ap->sactive)
+		ata_ncq_complete(ap, readl(port_mmio + PORT_SCR_ACT));
+	else if (qc) {
+		ci = readl(port_mmio + PORT_CMD_ISSUE);
+		if (likely((ci & (1 << ahci_slot(qc))) == 0))
+			ata_qc_complete(qc, 0);
 	}
 
 	return 1;
@@ -700,11 +732,14 @@ static int ahci_qc_issue(struct ata_queued_cmd *qc)
 {
 	struct ata_port *ap = qc->ap;
 	void *port_mmio = (void *) ap->ioaddr.cmd_addr;
+	u32 slot_bit = 1 << ahci_slot(qc);
 
-	writel(1, port_mmio + PORT_SCR_ACT);
-	readl(port_mmio + PORT_SCR_ACT);	/* flush */
+	if (qc->tf.protocol == ATA_PROT_NCQ) {
+		writel(slot_bit, port_mmio + PORT_SCR_ACT);
+		readl(port_mmio + PORT_SCR_ACT);	/* flush */
+	}
 
-	writel(1, port_mmio + PORT_CMD_ISSUE);
+	writel(slot_bit, port_mmio + PORT_CMD_ISSUE);
 	readl(port_mmio + PORT_CMD_ISSUE);	/* flush */
 
 	return 0;
@@ -771,6 +806,11 @@ static int ahci_host_init(struct ata_probe_ent *probe_ent)
 	hpriv->port_map = readl(mmio + HOST_PORTS_IMPL);
 	probe_ent->n_ports = (hpriv->cap & 0x1f) + 1;
 
+	/* NCQ tags are command slots, all of them are needed */
+	if ((hpriv->cap & HOST_CAP_NCQ) &&
+	    ((hpriv->cap >> 8) & 0x1f) + 1 == AHCI_MAX_CMDS)
+		probe_ent->host_flags |= ATA_FLAG_NCQ;
+
 	VPRINTK("cap 0x%x  port_map 0x%x  n_ports %d\n",
 		hpriv->cap, hpriv->port_map, probe_ent->n_ports);
 
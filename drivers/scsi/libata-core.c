@@ -1146,14 +1146,21 @@ retry:
 			dev->n_sectors = ata_id_u32(dev->id, 60);
 		}
 
+		/* FPDMA QUEUED commands only come with 48-bit addresses */
+		if ((ap->flags & ATA_FLAG_NCQ) && ata_id_has_ncq(dev->id) &&
+		    (dev->flags & ATA_DFLAG_LBA48) &&
+		    ata_id_queue_depth(dev->id) > 1)
+			dev->flags |= ATA_DFLAG_NCQ;
+
 		ap->host->max_cmd_len = 16;
 
 		/* print device info to dmesg */
-		printk(KERN_INFO "ata%u: dev %u ATA, max %s, %Lu sectors:%s\n",
+		printk(KERN_INFO "ata%u: dev %u ATA, max %s, %Lu sectors:%s%s\n",
 		       ap->id, device,
 		       ata_mode_string(xfer_modes),
 		       (unsigned long long)dev->n_sectors,
-		       dev->flags & ATA_DFLAG_LBA48 ? " lba48" : "");
+		       dev->flags & ATA_DFLAG_LBA48 ? " lba48" : "",
+		       dev->flags & ATA_DFLAG_NCQ ? " ncq" : "");
 	}
 
 	/* ATAPI-specific feature tests */
@@ -2685,6 +2692,75 @@ out:
 	DPRINTK("EXIT\n");
 }
 
+/**
+ *	ata_ncq_complete - Complete the NCQ commands a device is done with
+ *	@ap: Port the commands were issued on
+ *	@sactive: Current contents of the SActive register
+ *
+ *	The device clears the SActive bit of each tag it has finished
+ *	successfully, with a Set Device Bits FIS.  Complete the
+ *	commands in flight on @ap whose bits have been cleared.
+ *
+ *	LOCKING:
+ *	spin_lock_irqsave(host_set lock)
+ *
+ *	RETURNS:
+ *	Number of commands completed.
+ */
+
+unsigned int ata_ncq_complete(struct ata_port *ap, u32 sactive)
+{
+	u32 done = ap->sactive & ~sactive;
+	unsigned int tag, n = 0;
+
+	for (tag = 0; tag < ATA_MAX_QUEUE; tag++)
+		if (done & (1 << tag)) {
+			ata_qc_complete(ata_qc_from_tag(ap, tag), 0);
+			n++;
+		}
+
+	return n;
+}
+
+/**
+ *	ata_ncq_error - Fail the NCQ commands in flight after an error
+ *	@ap: Port the device reported an error on
+ *
+ *	After an error the device aborts all of its queued commands,
+ *	and which of them failed could only be read from its NCQ error
+ *	log.  Rather than that, hand each back to the SCSI layer to be
+ *	retried, and take the device off NCQ so that the retries run
+ *	one at a time and report their own errors.
+ *
+ *	The host must already have been stopped and restarted by the
+ *	driver, so that none of the tags is still active.
+ *
+ *	LOCKING:
+ *	spin_lock_irqsave(host_set lock)
+ */
+
+void ata_ncq_error(struct ata_port *ap)
+{
+	u32 sactive = ap->sactive;
+	unsigned int tag;
+
+	for (tag = 0; tag < ATA_MAX_QUEUE; tag++) {
+		struct ata_queued_cmd *qc;
+
+		if (!(sactive & (1 << tag)))
+			continue;
+
+		qc = ata_qc_from_tag(ap, tag);
+		if (qc->dev->flags & ATA_DFLAG_NCQ) {
+			printk(KERN_WARNING "ata%u: dev %u NCQ error, "
+			       "disabling NCQ\n", ap->id, qc->dev->devno);
+			qc->dev->flags &= ~ATA_DFLAG_NCQ;
+		}
+		qc->flags |= ATA_QCFLAG_RETRY;
+		ata_qc_complete(qc, ATA_ERR);
+	}
+}
+
 /**
  *	ata_qc_new - Request an available ATA command, for queueing
  *	@ap: Port associated with device @dev
@@ -2756,7 +2832,9 @@ static void __ata_qc_complete(struct ata_queued_cmd *qc)
 	qc->flags = 0;
 	tag = qc->tag;
 	if (likely(ata_tag_valid(tag))) {
-		if (tag == ap->active_tag)
+		if (qc->tf.protocol == ATA_PROT_NCQ)
+			ap->sactive &= ~(1 << tag);
+		else if (tag == ap->active_tag)
 			ap->active_tag = ATA_TAG_POISON;
 		qc->tag = ATA_TAG_POISON;
 		do_clear = 1;
@@ -2829,6 +2907,7 @@ static inline int ata_should_dma_map(struct ata_queued_cmd *qc)
 
 	switch (qc->tf.protocol) {
 	case ATA_PROT_DMA:
+	case ATA_PROT_NCQ:
 	case ATA_PROT_ATAPI_DMA:
 		return 1;
 
@@ -2881,7 +2960,10 @@ int ata_qc_issue(struct ata_queued_cmd *qc)
 
 	ap->ops->qc_prep(qc);
 
-	qc->ap->active_tag = qc->tag;
+	if (qc->tf.protocol == ATA_PROT_NCQ)
+		ap->sactive |= 1 << qc->tag;
+	else
+		ap->active_tag = qc->tag;
 	qc->flags |= ATA_QCFLAG_ACTIVE;
 
 	return ap->ops->qc_issue(qc);
@@ -3982,6 +4064,8 @@ EXPORT_SYMBOL_GPL(ata_sg_init_one);
 EXPORT_SYMBOL_GPL(ata_qc_complete);
 EXPORT_SYMBOL_GPL(ata_qc_issue_prot);
 EXPORT_SYMBOL_GPL(ata_eng_timeout);
+EXPORT_SYMBOL_GPL(ata_ncq_complete);
+EXPORT_SYMBOL_GPL(ata_ncq_error);
 EXPORT_SYMBOL_GPL(ata_tf_load);
 EXPORT_SYMBOL_GPL(ata_tf_read);
 EXPORT_SYMBOL_GPL(ata_noop_dev_select);
@@ -28,6 +28,7 @@
 #include <scsi/scsi.h>
 #include "scsi.h"
 #include <scsi/scsi_host.h>
+#include <scsi/scsi_tcq.h>
 #include <linux/libata.h>
 #include <asm/uaccess.h>
 
@@ -350,6 +351,12 @@ int ata_scsi_slave_config(struct scsi_device *sdev)
 			sdev->host->max_sectors = 2048;
 			blk_queue_max_sectors(sdev->request_queue, 2048);
 		}
+
+		/* one tag is kept back for non-queued commands */
+		if (dev->flags & ATA_DFLAG_NCQ)
+			scsi_adjust_queue_depth(sdev, MSG_SIMPLE_TAG,
+				min(ata_id_queue_depth(dev->id),
+				    sdev->host->can_queue));
 	}
 
 	return 0;	/* scsi layer doesn't check return value, sigh */
@@ -377,11 +384,11 @@ int ata_scsi_error(struct Scsi_Host *host)
 	ap = (struct ata_port *) &host->hostdata[0];
 	ap->ops->eng_timeout(ap);
 
-	/* TODO: this is per-command; when queueing is supported
-	 * this code will either change or move to a more
-	 * appropriate place
+	/* ->eng_timeout() has completed every command in flight,
+	 * queued or not, which the SCSI layer then saw time out
 	 */
-	host->host_failed--;
+	host->host_failed = 0;
+	INIT_LIST_HEAD(&host->eh_cmd_q);
 
 	DPRINTK("EXIT\n");
 	return 0;
@@ -510,6 +517,36 @@ static unsigned int ata_scsi_verify_xlat(struct ata_queued_cmd *qc, u8 *scsicmd)
 	return 0;
 }
 
+/**
+ *	ata_scsi_ncq_tf - Turn a read/write taskfile into its NCQ form
+ *	@qc: Command translated by ata_scsi_rw_xlat(), LBA48
+ *
+ *	READ/WRITE FPDMA QUEUED take the sector count in the feature
+ *	registers, and the tag of the command in bits 7:3 of the
+ *	sector count register.  The device register holds the FUA bit
+ *	in place of the obsolete bits.
+ *
+ *	LOCKING:
+ *	spin_lock_irqsave(host_set lock)
+ */
+
+static void ata_scsi_ncq_tf(struct ata_queued_cmd *qc)
+{
+	struct ata_taskfile *tf = &qc->tf;
+
+	tf->protocol = ATA_PROT_NCQ;
+	if (tf->flags & ATA_TFLAG_WRITE)
+		tf->command = ATA_CMD_FPDMA_WRITE;
+	else
+		tf->command = ATA_CMD_FPDMA_READ;
+
+	tf->hob_feature = tf->hob_nsect;
+	tf->feature = tf->nsect;
+	tf->hob_nsect = 0;
+	tf->nsect = qc->tag << 3;
+	tf->device = ATA_LBA;
+}
+
 /**
  *	ata_scsi_rw_xlat - Translate SCSI r/w command into an ATA one
  *	@qc: Storage for translated ATA taskfile
@@ -572,7 +609,7 @@ static unsigned int ata_scsi_rw_xlat(struct ata_queued_cmd *qc, u8 *scsicmd)
 		tf->lbah = scsicmd[3];
 
 		VPRINTK("ten-byte command\n");
-		return 0;
+		goto out;
 	}
 
 	if (scsicmd[0] == READ_6 || scsicmd[0] == WRITE_6) {
@@ -582,7 +619,7 @@ static unsigned int ata_scsi_rw_xlat(struct ata_queued_cmd *qc, u8 *scsicmd)
 		tf->lbah = scsicmd[1] & 0x1f; /* mask out reserved bits */
 
 		VPRINTK("six-byte command\n");
-		return 0;
+		goto out;
 	}
 
 	if (scsicmd[0] == READ_16 || scsicmd[0] == WRITE_16) {
@@ -616,18 +653,26 @@ static unsigned int ata_scsi_rw_xlat(struct ata_queued_cmd *qc, u8 *scsicmd)
 		tf->lbah = scsicmd[7];
 
 		VPRINTK("sixteen-byte command\n");
-		return 0;
+		goto out;
 	}
 
 	DPRINTK("no-byte command\n");
 	return 1;
+
+out:
+	if ((qc->dev->flags & ATA_DFLAG_NCQ) && tf->protocol == ATA_PROT_DMA)
+		ata_scsi_ncq_tf(qc);
+	return 0;
 }
 
 static int ata_scsi_qc_complete(struct ata_queued_cmd *qc, u8 drv_stat)
 {
 	struct scsi_cmnd *cmd = qc->scsicmd;
 
-	if (unlikely(drv_stat & (ATA_ERR | ATA_BUSY | ATA_DRQ)))
+	/* not necessarily the one which failed, have it retried */
+	if (unlikely(qc->flags & ATA_QCFLAG_RETRY))
+		cmd->result = DID_SOFT_ERROR << 16;
+	else if (unlikely(drv_stat & (ATA_ERR | ATA_BUSY | ATA_DRQ)))
 		ata_to_sense_error(qc, drv_stat);
 	else
 		cmd->result = SAM_STAT_GOOD;
@@ -652,11 +697,19 @@ static int ata_scsi_qc_complete(struct ata_queued_cmd *qc, u8 drv_stat)
  *	This function sets up an ata_queued_cmd structure for the
  *	SCSI command, and sends that ata_queued_cmd to the hardware.
  *
+ *	A device does not take a non-queued command while it has NCQ
+ *	commands outstanding, nor an NCQ command during a non-queued
+ *	one; in that case the command is handed back to the SCSI layer
+ *	to be issued again later.
+ *
  *	LOCKING:
  *	spin_lock_irqsave(host_set lock)
+ *
+ *	RETURNS:
+ *	Zero, or %SCSI_MLQUEUE_DEVICE_BUSY if the command must wait.
  */
 
-static void ata_scsi_translate(struct ata_port *ap, struct ata_device *dev,
+static int ata_scsi_translate(struct ata_port *ap, struct ata_device *dev,
 			      struct scsi_cmnd *cmd,
 			      void (*done)(struct scsi_cmnd *),
 			      ata_xlat_func_t xlat_func)
@@ -668,7 +721,7 @@ static void ata_scsi_translate(struct ata_port *ap, struct ata_device *dev,
 
 	qc = ata_scsi_qc_new(ap, dev, cmd, done);
 	if (!qc)
-		return;
+		return 0;
 
 	/* data is present; dma-map it */
 	if (cmd->sc_data_direction == SCSI_DATA_READ ||
@@ -693,17 +746,25 @@ static void ata_scsi_translate(struct ata_port *ap, struct ata_device *dev,
 	if (xlat_func(qc, scsicmd))
 		goto err_out;
 
+	if (ata_tag_valid(ap->active_tag) ||
+	    (ap->sactive && qc->tf.protocol != ATA_PROT_NCQ)) {
+		ata_qc_free(qc);
+		VPRINTK("EXIT - busy\n");
+		return SCSI_MLQUEUE_DEVICE_BUSY;
+	}
+
 	/* select device, send command to hardware */
 	if (ata_qc_issue(qc))
 		goto err_out;
 
 	VPRINTK("EXIT\n");
-	return;
+	return 0;
 
 err_out:
 	ata_qc_free(qc);
 	ata_bad_cdb(cmd, done);
 	DPRINTK("EXIT - badcmd\n");
+	return 0;
 }
 
 /**
@@ -1470,7 +1531,8 @@ static inline void ata_scsi_dump_cdb(struct ata_port *ap,
  *	Releases scsi-layer-held lock, and obtains host_set lock.
  *
  *	RETURNS:
- *	Zero.
+ *	Zero, or %SCSI_MLQUEUE_DEVICE_BUSY to have the command retried
+ *	later.
  */
 
 int ata_scsi_queuecmd(struct scsi_cmnd *cmd, void (*done)(struct scsi_cmnd *))
@@ -1478,6 +1540,7 @@ int ata_scsi_queuecmd(struct scsi_cmnd *cmd, void (*done)(struct scsi_cmnd *))
 	struct ata_port *ap;
 	struct ata_device *dev;
 	struct scsi_device *scsidev = cmd->device;
+	int rc = 0;
 
 	ap = (struct ata_port *) &scsidev->host->hostdata[0];
 
@@ -1495,14 +1558,14 @@ int ata_scsi_queuecmd(struct scsi_cmnd *cmd, void (*done)(struct scsi_cmnd *))
 							      cmd->cmnd[0]);
 
 		if (xlat_func)
-			ata_scsi_translate(ap, dev, cmd, done, xlat_func);
+			rc = ata_scsi_translate(ap, dev, cmd, done, xlat_func);
 		else
 			ata_scsi_simulate(dev->id, cmd, done);
 	} else
-		ata_scsi_translate(ap, dev, cmd, done, atapi_xlat);
+		rc = ata_scsi_translate(ap, dev, cmd, done, atapi_xlat);
 
 out_unlock:
-	return 0;
+	return rc;
 }
 
 /**
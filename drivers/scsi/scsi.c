@@ -520,20 +520,21 @@ static inline void scsi_cmd_get_serial(struct Scsi_Host *host, struct scsi_cmnd
 }
 
 /*
- * Function:    scsi_dispatch_command
+ * Function:    scsi_dispatch_prep
  *
- * Purpose:     Dispatch a command to the low-level driver.
+ * Purpose:     Get a command ready for the low-level driver.
  *
  * Arguments:   cmd - command block we are dispatching.
  *
- * Notes:
+ * Returns:     1 if the command is to be queued, 0 if it has been
+ *              completed or put back on the device queue already.
+ *
+ * Notes:       Called without the host_lock.
  */
-int scsi_dispatch_cmd(struct scsi_cmnd *cmd)
+static int scsi_dispatch_prep(struct scsi_cmnd *cmd)
 {
 	struct Scsi_Host *host = cmd->device->host;
-	unsigned long flags = 0;
 	unsigned long timeout;
-	int rtn = 0;
 
 	/* check if the device is still usable */
 	if (unlikely(cmd->device->sdev_state == SDEV_DEL)) {
@@ -543,8 +544,7 @@ int scsi_dispatch_cmd(struct scsi_cmnd *cmd)
 		cmd->result = DID_NO_CONNECT << 16;
 		atomic_inc(&cmd->device->iorequest_cnt);
 		scsi_done(cmd);
-		/* return 0 (because the command has been processed) */
-		goto out;
+		return 0;
 	}
 
 	/* Check to see if the scsi lld put this device into state SDEV_BLOCK. */
@@ -560,10 +560,10 @@ int scsi_dispatch_cmd(struct scsi_cmnd *cmd)
 		SCSI_LOG_MLQUEUE(3, printk("queuecommand : device blocked \n"));
 
 		/*
-		 * NOTE: rtn is still zero here because we don't need the
-		 * queue to be plugged on return (it's already stopped)
+		 * NOTE: this is not a refusal by the driver, we don't need
+		 * the queue to be plugged on return (it's already stopped)
 		 */
-		goto out;
+		return 0;
 	}
 
 	/* 
@@ -624,20 +624,57 @@ int scsi_dispatch_cmd(struct scsi_cmnd *cmd)
 		cmd->result = (DID_ABORT << 16);
 
 		scsi_done(cmd);
-		goto out;
+		return 0;
 	}
 
+	return 1;
+}
+
+/*
+ * Function:    scsi_dispatch_cmds
+ *
+ * Purpose:     Dispatch a batch of commands to the low-level driver.
+ *
+ * Arguments:   cmds - command blocks we are dispatching, of one device.
+ *              nr   - number of them.
+ *
+ * Returns:     0, or the refusal of queuecommand.
+ *
+ * Notes:       All of the batch is handed to queuecommand under one
+ *              hold of the host_lock.  Once a command is refused, the
+ *              ones after it are not tried, but go back on the device
+ *              queue in their order as well.  The contents of cmds are
+ *              lost.
+ */
+int scsi_dispatch_cmds(struct scsi_cmnd **cmds, int nr)
+{
+	struct Scsi_Host *host = cmds[0]->device->host;
+	unsigned long flags;
+	int i, n, rtn = 0;
+
+	for (i = n = 0; i < nr; i++)
+		if (scsi_dispatch_prep(cmds[i]))
+			cmds[n++] = cmds[i];
+
 	spin_lock_irqsave(host->host_lock, flags);
-	scsi_cmd_get_serial(host, cmd); 
+	for (i = 0; i < n; i++) {
+		scsi_cmd_get_serial(host, cmds[i]);
 
-	if (unlikely(test_bit(SHOST_CANCEL, &host->shost_state))) {
-		cmd->result = (DID_NO_CONNECT << 16);
-		scsi_done(cmd);
-	} else {
-		rtn = host->hostt->queuecommand(cmd, scsi_done);
+		if (unlikely(test_bit(SHOST_CANCEL, &host->shost_state))) {
+			cmds[i]->result = (DID_NO_CONNECT << 16);
+			scsi_done(cmds[i]);
+			continue;
+		}
+		rtn = host->hostt->queuecommand(cmds[i], scsi_done);
+		if (rtn)
+			break;
 	}
 	spin_unlock_irqrestore(host->host_lock, flags);
-	if (rtn) {
+
+	/* from the back, as each is reinserted at the head */
+	while (rtn && n > i) {
+		struct scsi_cmnd *cmd = cmds[--n];
+
 		atomic_inc(&cmd->device->iodone_cnt);
 		scsi_queue_insert(cmd,
 				(rtn == SCSI_MLQUEUE_DEVICE_BUSY) ?
@@ -646,8 +683,7 @@ int scsi_dispatch_cmd(struct scsi_cmnd *cmd)
 		    printk("queuecommand : request rejected\n"));
 	}
 
- out:
-	SCSI_LOG_MLQUEUE(3, printk("leaving scsi_dispatch_cmnd()\n"));
+	SCSI_LOG_MLQUEUE(3, printk("leaving scsi_dispatch_cmds()\n"));
 	return rtn;
 }
 
@@ -803,6 +839,12 @@ static void scsi_softirq(struct softirq_action *h)
 	list_splice_init(&__get_cpu_var(scsi_done_q), &local_q);
 	local_irq_enable();
 
+	/*
+	 * The queues which completions make room on are run once at the
+	 * end, so that they are refilled with a batch at a time.
+	 */
+	scsi_defer_queue_runs();
+
 	while (!list_empty(&local_q)) {
 		struct scsi_cmnd *cmd = list_entry(local_q.next,
 						   struct scsi_cmnd, eh_entry);
@@ -825,6 +867,8 @@ static void scsi_softirq(struct softirq_action *h)
 				scsi_finish_command(cmd);
 		}
 	}
+
+	scsi_run_deferred_queues();
 }
 
 /*
@@ -12,6 +12,7 @@
 #include <linux/sched.h>
 #include <linux/mm.h>
 #include <linux/string.h>
+#include <linux/smp_lock.h>
 #include <asm/uaccess.h>
 
 #include <scsi/scsi.h>
@@ -385,6 +386,7 @@ static int scsi_ioctl_get_pci(struct scsi_device *sdev, void __user *arg)
 int scsi_ioctl(struct scsi_device *sdev, int cmd, void __user *arg)
 {
 	char scsi_cmd[MAX_COMMAND_SIZE];
+	int err;
 
 	/* No idea how this happens.... */
 	if (!sdev)
@@ -460,8 +462,13 @@ int scsi_ioctl(struct scsi_device *sdev, int cmd, void __user *arg)
         case SCSI_IOCTL_GET_PCI:
                 return scsi_ioctl_get_pci(sdev, arg);
 	default:
-		if (sdev->host->hostt->ioctl)
-			return sdev->host->hostt->ioctl(sdev, cmd, arg);
+		if (sdev->host->hostt->ioctl) {
+			/* host drivers still get the BKL, as they always had */
+			lock_kernel();
+			err = sdev->host->hostt->ioctl(sdev, cmd, arg);
+			unlock_kernel();
+			return err;
+		}
 	}
 	return -EINVAL;
 }
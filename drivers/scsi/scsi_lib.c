@@ -16,6 +16,7 @@
 #include <linux/init.h>
 #include <linux/pci.h>
 #include <linux/delay.h>
+#include <linux/hardirq.h>
 
 #include <scsi/scsi.h>
 #include <scsi/scsi_dbg.h>
@@ -493,12 +494,70 @@ static void scsi_requeue_command(struct request_queue *q, struct scsi_cmnd *cmd)
 	scsi_run_queue(q);
 }
 
+/*
+ * Queue runs deferred by scsi_softirq(), so that a device completing
+ * several commands in one pass has its queue run once for all of them.
+ * Only touched from softirq context of the CPU.
+ */
+#define SCSI_MAX_DEFERRED_RUNS	8
+
+struct scsi_deferred_runs {
+	int			active;
+	int			nr;
+	struct scsi_device	*sdev[SCSI_MAX_DEFERRED_RUNS];
+};
+
+static DEFINE_PER_CPU(struct scsi_deferred_runs, scsi_deferred_runs);
+
+void scsi_defer_queue_runs(void)
+{
+	__get_cpu_var(scsi_deferred_runs).active = 1;
+}
+
+void scsi_run_deferred_queues(void)
+{
+	struct scsi_deferred_runs *runs = &__get_cpu_var(scsi_deferred_runs);
+
+	runs->active = 0;
+	while (runs->nr) {
+		struct scsi_device *sdev = runs->sdev[--runs->nr];
+
+		scsi_run_queue(sdev->request_queue);
+		put_device(&sdev->sdev_gendev);
+	}
+}
+
+/* 1 if the run of @sdev's queue has been left to scsi_run_deferred_queues */
+static int scsi_defer_queue_run(struct scsi_device *sdev)
+{
+	struct scsi_deferred_runs *runs;
+	int i;
+
+	if (!in_softirq() || in_irq())
+		return 0;
+	runs = &__get_cpu_var(scsi_deferred_runs);
+	if (!runs->active)
+		return 0;
+
+	for (i = 0; i < runs->nr; i++)
+		if (runs->sdev[i] == sdev)
+			return 1;
+	if (runs->nr == SCSI_MAX_DEFERRED_RUNS)
+		return 0;
+	get_device(&sdev->sdev_gendev);
+	runs->sdev[runs->nr++] = sdev;
+	return 1;
+}
+
 void scsi_next_command(struct scsi_cmnd *cmd)
 {
-	struct request_queue *q = cmd->device->request_queue;
+	struct scsi_device *sdev = cmd->device;
+	struct request_queue *q = sdev->request_queue;
+	int deferred = scsi_defer_queue_run(sdev);
 
 	scsi_put_command(cmd);
-	scsi_run_queue(q);
+	if (!deferred)
+		scsi_run_queue(q);
 }
 
 void scsi_run_host_queues(struct Scsi_Host *shost)
@@ -1259,6 +1318,8 @@ static void scsi_kill_requests(request_queue_t *q)
 	}
 }
 
+#define SCSI_DISPATCH_BATCH	16	/* requests dispatched at a time */
+
 /*
  * Function:    scsi_request_fn()
  *
@@ -1274,8 +1335,9 @@ static void scsi_request_fn(struct request_queue *q)
 {
 	struct scsi_device *sdev = q->queuedata;
 	struct Scsi_Host *shost;
-	struct scsi_cmnd *cmd;
+	struct scsi_cmnd *cmd, *cmds[SCSI_DISPATCH_BATCH];
 	struct request *req;
+	int nr, ready, i;
 
 	if (!sdev) {
 		printk("scsi: killing requests for dead queue\n");
@@ -1293,74 +1355,96 @@ static void scsi_request_fn(struct request_queue *q)
 	 */
 	shost = sdev->host;
 	while (!blk_queue_plugged(q)) {
-		int rtn;
+		int rtn = 0;
+
 		/*
-		 * get next queueable request.  We do this early to make sure
-		 * that the request is fully prepared even if we cannot 
-		 * accept it.
+		 * Take a batch of requests off the queue, as many as the
+		 * device has room for, so that the locks are taken once for
+		 * all of them.  We get each early to make sure that it is
+		 * fully prepared even if we cannot accept it.
 		 */
-		req = elv_next_request(q);
-		if (!req || !scsi_dev_queue_ready(q, sdev))
-			break;
-
-		if (unlikely(!scsi_device_online(sdev))) {
-			printk(KERN_ERR "scsi%d (%d:%d): rejecting I/O to offline device\n",
-			       sdev->host->host_no, sdev->id, sdev->lun);
-			blkdev_dequeue_request(req);
-			req->flags |= REQ_QUIET;
-			while (end_that_request_first(req, 0, req->nr_sectors))
-				;
-			end_that_request_last(req);
-			continue;
-		}
+		nr = 0;
+		while (nr < SCSI_DISPATCH_BATCH) {
+			req = elv_next_request(q);
+			if (!req || !scsi_dev_queue_ready(q, sdev))
+				break;
+
+			if (unlikely(!scsi_device_online(sdev))) {
+				printk(KERN_ERR "scsi%d (%d:%d): rejecting I/O to offline device\n",
+				       sdev->host->host_no, sdev->id, sdev->lun);
+				blkdev_dequeue_request(req);
+				req->flags |= REQ_QUIET;
+				while (end_that_request_first(req, 0, req->nr_sectors))
+					;
+				end_that_request_last(req);
+				continue;
+			}
 
+			/*
+			 * Remove the request from the request list.
+			 */
+			if (!(blk_queue_tagged(q) && !blk_queue_start_tag(q, req)))
+				blkdev_dequeue_request(req);
+			sdev->device_busy++;
 
-		/*
-		 * Remove the request from the request list.
-		 */
-		if (!(blk_queue_tagged(q) && !blk_queue_start_tag(q, req)))
-			blkdev_dequeue_request(req);
-		sdev->device_busy++;
+			cmd = req->special;
+			if (unlikely(cmd == NULL)) {
+				printk(KERN_CRIT "impossible request in %s.\n"
+						 "please mail a stack trace to "
+						 "linux-scsi@vger.kernel.org",
+						 __FUNCTION__);
+				BUG();
+			}
+			cmds[nr++] = cmd;
+		}
+		if (!nr)
+			break;
 
 		spin_unlock(q->queue_lock);
 		spin_lock(shost->host_lock);
 
-		if (!scsi_host_queue_ready(q, shost, sdev))
-			goto not_ready;
-		if (sdev->single_lun) {
-			if (scsi_target(sdev)->starget_sdev_user &&
-			    scsi_target(sdev)->starget_sdev_user != sdev)
-				goto not_ready;
-			scsi_target(sdev)->starget_sdev_user = sdev;
+		for (ready = 0; ready < nr; ready++) {
+			if (!scsi_host_queue_ready(q, shost, sdev))
+				break;
+			if (sdev->single_lun) {
+				if (scsi_target(sdev)->starget_sdev_user &&
+				    scsi_target(sdev)->starget_sdev_user != sdev)
+					break;
+				scsi_target(sdev)->starget_sdev_user = sdev;
+			}
+			shost->host_busy++;
 		}
-		shost->host_busy++;
 
-		/*
-		 * XXX(hch): This is rather suboptimal, scsi_dispatch_cmd will
-		 *		take the lock again.
-		 */
 		spin_unlock_irq(shost->host_lock);
 
-		cmd = req->special;
-		if (unlikely(cmd == NULL)) {
-			printk(KERN_CRIT "impossible request in %s.\n"
-					 "please mail a stack trace to "
-					 "linux-scsi@vger.kernel.org",
-					 __FUNCTION__);
-			BUG();
+		if (ready) {
+			/*
+			 * Finally, initialize any error handling parameters,
+			 * and dispatch the commands to the low-level driver.
+			 */
+			for (i = 0; i < ready; i++)
+				scsi_init_cmd_errh(cmds[i]);
+			rtn = scsi_dispatch_cmds(cmds, ready);
 		}
 
-		/*
-		 * Finally, initialize any error handling parameters, and set up
-		 * the timers for timeouts.
-		 */
-		scsi_init_cmd_errh(cmd);
-
-		/*
-		 * Dispatch the command to the low-level driver.
-		 */
-		rtn = scsi_dispatch_cmd(cmd);
 		spin_lock_irq(q->queue_lock);
+		if (ready < nr) {
+			/*
+			 * Requeue the rest, last first to keep their order,
+			 * and decrement device_busy.
+			 *
+			 * Decrementing device_busy without checking it is OK,
+			 * as all such cases (host limits or settings) should
+			 * run the queue at some later time.
+			 */
+			while (nr > ready) {
+				blk_requeue_request(q, cmds[--nr]->request);
+				sdev->device_busy--;
+			}
+			if(sdev->device_busy == 0)
+				blk_plug_device(q);
+			break;
+		}
 		if(rtn) {
 			/* we're refusing the command; because of
 			 * the way locks get dropped, we need to 
@@ -1372,25 +1456,6 @@ static void scsi_request_fn(struct request_queue *q)
 		}
 	}
 
-	goto out;
-
- not_ready:
-	spin_unlock_irq(shost->host_lock);
-
-	/*
-	 * lock q, handle tag, requeue req, and decrement device_busy. We
-	 * must return with queue_lock held.
-	 *
-	 * Decrementing device_busy without checking it is OK, as all such
-	 * cases (host limits or settings) should run the queue at some
-	 * later time.
-	 */
-	spin_lock_irq(q->queue_lock);
-	blk_requeue_request(q, req);
-	sdev->device_busy--;
-	if(sdev->device_busy == 0)
-		blk_plug_device(q);
- out:
 	/* must be careful here...if we trigger the ->remove() function
 	 * we cannot be holding the q lock */
 	spin_unlock_irq(q->queue_lock);
@@ -716,6 +716,7 @@ static void usb_bus_init (struct usb_bus *bus)
 	bus->bandwidth_allocated = 0;
 	bus->bandwidth_int_reqs  = 0;
 	bus->bandwidth_isoc_reqs = 0;
+	bus->sg_tablesize = 0;
 
 	INIT_LIST_HEAD (&bus->bus_list);
 
@@ -326,6 +326,7 @@ int usb_sg_init (
 	int			i;
 	int			urb_flags;
 	int			dma;
+	int			nr_sgs = 0;
 
 	if (!io || !dev || !sg
 			|| usb_pipecontrol (pipe)
@@ -352,6 +353,23 @@ int usb_sg_init (
 	if (io->entries <= 0)
 		return io->entries;
 
+	/* an hc taking urb->sg gets the whole list in a single urb, unless
+	 * an entry before the last would end in a short packet
+	 */
+	if (dma && io->entries > 1 && io->entries <= dev->bus->sg_tablesize) {
+		unsigned	maxp = usb_maxpacket (dev, pipe,
+						usb_pipeout (pipe));
+
+		for (i = 0; i < io->entries - 1; i++)
+			if (!maxp || !sg_dma_len (sg + i)
+					|| sg_dma_len (sg + i) % maxp)
+				break;
+		if (i == io->entries - 1) {
+			nr_sgs = io->entries;
+			io->entries = 1;
+		}
+	}
+
 	io->count = io->entries;
 	io->urbs = kmalloc (io->entries * sizeof *io->urbs, mem_flags);
 	if (!io->urbs)
@@ -381,7 +399,15 @@ int usb_sg_init (
 		io->urbs [i]->status = -EINPROGRESS;
 		io->urbs [i]->actual_length = 0;
 
-		if (dma) {
+		if (nr_sgs) {
+			int		j;
+
+			io->urbs [i]->sg = sg;
+			io->urbs [i]->num_sgs = nr_sgs;
+			io->urbs [i]->transfer_dma = sg_dma_address (sg);
+			for (j = 0, len = 0; j < nr_sgs; j++)
+				len += sg_dma_len (sg + j);
+		} else if (dma) {
 			/* hc may use _only_ transfer_dma */
 			io->urbs [i]->transfer_dma = sg_dma_address (sg + i);
 			len = sg_dma_len (sg + i);
@@ -480,9 +480,10 @@ qh_urb_transaction (
 ) {
 	struct ehci_qtd		*qtd, *qtd_prev;
 	dma_addr_t		buf;
-	int			len, maxpacket;
+	int			len, this_sg_len, maxpacket;
 	int			is_input;
 	u32			token;
+	struct scatterlist	*sg = urb->sg;
 
 	/*
 	 * URBs map to sequences of QTDs:  one logical transaction
@@ -530,6 +531,11 @@ qh_urb_transaction (
 
 	maxpacket = max_packet(usb_maxpacket(urb->dev, urb->pipe, !is_input));
 
+	/* with urb->sg, the qtds go through its entries one by one */
+	this_sg_len = len;
+	if (urb->num_sgs && len > 0)
+		this_sg_len = min_t (int, sg_dma_len (sg), len);
+
 	/*
 	 * buffer gets wrapped in one or more qtds;
 	 * last one may be "short" (including zero len)
@@ -538,7 +544,9 @@ qh_urb_transaction (
 	for (;;) {
 		int this_qtd_len;
 
-		this_qtd_len = qtd_fill (qtd, buf, len, token, maxpacket);
+		this_qtd_len = qtd_fill (qtd, buf, this_sg_len, token,
+				maxpacket);
+		this_sg_len -= this_qtd_len;
 		len -= this_qtd_len;
 		buf += this_qtd_len;
 		if (is_input)
@@ -551,6 +559,12 @@ qh_urb_transaction (
 		if (likely (len <= 0))
 			break;
 
+		if (this_sg_len <= 0) {
+			sg++;
+			buf = sg_dma_address (sg);
+			this_sg_len = min_t (int, sg_dma_len (sg), len);
+		}
+
 		qtd_prev = qtd;
 		qtd = ehci_qtd_alloc (ehci, flags);
 		if (unlikely (!qtd))
@@ -121,6 +121,16 @@ static int slave_configure(struct scsi_device *sdev)
 			sdev->request_queue->max_sectors > 64)
 		blk_queue_max_sectors(sdev->request_queue, 64);
 
+	/* The 120 KB of the host template keep the commands of full speed
+	 * devices short.  At high speed each command costs as much as a
+	 * good part of such a transfer, so disks get transfers of up to
+	 * 512 KB; sysfs can still lower max_sectors for those which
+	 * choke on them. */
+	else if (sdev->type == TYPE_DISK &&
+			us->pusb_dev->speed == USB_SPEED_HIGH &&
+			sdev->request_queue->max_sectors < 1024)
+		blk_queue_max_sectors(sdev->request_queue, 1024);
+
 	/* We can't put these settings in slave_alloc() because that gets
 	 * called before the device type is known.  Consequently these
 	 * settings can't be overridden via the scsi devinfo mechanism. */
@@ -724,13 +724,14 @@ static ssize_t aio_run_iocb(struct kiocb *iocb)
 	 * the aio_wake_function callback).
 	 */
 	BUG_ON(current->io_wait != NULL);
-	current->io_wait = &iocb->ki_wait;
+	iocb->ki_wait.key.flags = NULL;		/* set by page waits */
+	current->io_wait = &iocb->ki_wait.wait;
 	ret = retry(iocb);
 	current->io_wait = NULL;
 
 	if (-EIOCBRETRY != ret) {
  		if (-EIOCBQUEUED != ret) {
-			BUG_ON(!list_empty(&iocb->ki_wait.task_list));
+			BUG_ON(!list_empty(&iocb->ki_wait.wait.task_list));
 			aio_complete(iocb, ret, 0);
 			/* must not access the iocb after this */
 		}
@@ -739,7 +740,7 @@ static ssize_t aio_run_iocb(struct kiocb *iocb)
 		 * Issue an additional retry to avoid waiting forever if
 		 * no waits were queued (e.g. in case of a short read).
 		 */
-		if (list_empty(&iocb->ki_wait.task_list))
+		if (list_empty(&iocb->ki_wait.wait.task_list))
 			kiocbSetKicked(iocb);
 	}
 out:
@@ -885,7 +886,7 @@ void queue_kicked_iocb(struct kiocb *iocb)
 	unsigned long flags;
 	int run = 0;
 
-	WARN_ON((!list_empty(&iocb->ki_wait.task_list)));
+	WARN_ON((!list_empty(&iocb->ki_wait.wait.task_list)));
 
 	spin_lock_irqsave(&ctx->ctx_lock, flags);
 	run = __queue_kicked_iocb(iocb);
@@ -942,6 +943,10 @@ int fastcall aio_complete(struct kiocb *iocb, long res, long res2)
 	 * case the usage count checks will have to move under ctx_lock
 	 * for all cases.
 	 */
+	if (is_kernel_kiocb(iocb)) {
+		iocb->ki_complete(iocb, res);
+		return 1;
+	}
 	if (is_sync_kiocb(iocb)) {
 		int ret;
 
@@ -1030,13 +1035,17 @@ put_rq:
 /* aio_read_evt
  *	Pull an event off of the ioctx's event ring.  Returns the number of 
  *	events fetched (0 or 1 ;-)
- *	FIXME: make this use cmpxchg.
- *	TODO: make the ringbuffer user mmap()able (requires FIXME).
+ *
+ *	User space may be reaping the same ring through its mapping (see
+ *	the protocol in aio_abi.h), so ring->head is only trusted modulo
+ *	nr, and is advanced with cmpxchg where the architecture has it.
+ *	The tail is taken from the kernel's own copy in info->tail.
  */
 static int aio_read_evt(struct kioctx *ioctx, struct io_event *ent)
 {
 	struct aio_ring_info *info = &ioctx->ring_info;
 	struct aio_ring *ring;
+	struct io_event *evp;
 	unsigned long head;
 	int ret = 0;
 
@@ -1045,14 +1054,32 @@ static int aio_read_evt(struct kioctx *ioctx, struct io_event *ent)
 		 (unsigned long)ring->head, (unsigned long)ring->tail,
 		 (unsigned long)ring->nr);
 
-	if (ring->head == ring->tail)
+	if (ring->head == info->tail)
 		goto out;
 
+#ifdef __HAVE_ARCH_CMPXCHG
+	for (;;) {
+		unsigned old = ring->head;
+
+		head = old % info->nr;
+		if (head == info->tail)
+			goto out;
+		smp_rmb(); /* read the tail before the event */
+		evp = aio_ring_event(info, head, KM_USER1);
+		*ent = *evp;
+		put_aio_ring_event(evp, KM_USER1);
+		smp_mb(); /* finish reading the event before updating the head */
+		if (cmpxchg(&ring->head, old, (head + 1) % info->nr) == old)
+			break;
+	}
+	ret = 1;
+#else
 	spin_lock(&info->ring_lock);
 
 	head = ring->head % info->nr;
-	if (head != ring->tail) {
-		struct io_event *evp = aio_ring_event(info, head, KM_USER1);
+	if (head != info->tail) {
+		smp_rmb(); /* read the tail before the event */
+		evp = aio_ring_event(info, head, KM_USER1);
 		*ent = *evp;
 		head = (head + 1) % info->nr;
 		smp_mb(); /* finish reading the event before updatng the head */
@@ -1061,6 +1088,7 @@ static int aio_read_evt(struct kioctx *ioctx, struct io_event *ent)
 		put_aio_ring_event(evp, KM_USER1);
 	}
 	spin_unlock(&info->ring_lock);
+#endif
 
 out:
 	kunmap_atomic(ring, KM_USER0);
@@ -1463,6 +1491,11 @@ ssize_t aio_setup_iocb(struct kiocb *kiocb)
  * 	instead of a synchronous wait when an i/o blocking
  *	condition is encountered during aio).
  *
+ *	When the iocb is queued on a hashed page waitqueue (see
+ *	lock_page_async()), ki_wait.key says which page bit we are
+ *	waiting for, and wakeups for other pages or bits are ignored
+ *	just like wake_bit_function() does for synchronous waiters.
+ *
  * Note:
  * This routine is executed with the wait queue lock held.
  * Since kick_iocb acquires iocb->ctx->ctx_lock, it nests
@@ -1472,7 +1505,15 @@ ssize_t aio_setup_iocb(struct kiocb *kiocb)
  */
 int aio_wake_function(wait_queue_t *wait, unsigned mode, int sync, void *key)
 {
-	struct kiocb *iocb = container_of(wait, struct kiocb, ki_wait);
+	struct kiocb *iocb = io_wait_to_kiocb(wait);
+	struct wait_bit_key *bit_key = key;
+
+	if (iocb->ki_wait.key.flags && bit_key) {
+		if (iocb->ki_wait.key.flags != bit_key->flags ||
+		    iocb->ki_wait.key.bit_nr != bit_key->bit_nr ||
+		    test_bit(bit_key->bit_nr, bit_key->flags))
+			return 0;
+	}
 
 	list_del_init(&wait->task_list);
 	kick_iocb(iocb);
@@ -1528,8 +1569,10 @@ int fastcall io_submit_one(struct kioctx *ctx, struct iocb __user *user_iocb,
 	req->ki_buf = (char __user *)(unsigned long)iocb->aio_buf;
 	req->ki_left = req->ki_nbytes = iocb->aio_nbytes;
 	req->ki_opcode = iocb->aio_lio_opcode;
-	init_waitqueue_func_entry(&req->ki_wait, aio_wake_function);
-	INIT_LIST_HEAD(&req->ki_wait.task_list);
+	init_waitqueue_func_entry(&req->ki_wait.wait, aio_wake_function);
+	INIT_LIST_HEAD(&req->ki_wait.wait.task_list);
+	req->ki_wait.key.flags = NULL;
+	req->ki_wait.key.bit_nr = 0;
 	req->ki_run_list.next = req->ki_run_list.prev = NULL;
 	req->ki_retry = NULL;
 	req->ki_retried = 0;
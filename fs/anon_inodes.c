@@ -0,0 +1,162 @@
+/*
+ *  fs/anon_inodes.c
+ *
+ *  Files which are only an interface to some kernel object - an event
+ *  counter, a timer - need a dentry and an inode for the VFS, but
+ *  nothing that a new inode per file would add.  They all share one
+ *  inode of an internal file system, and each gets a dentry named
+ *  after its kind, so that /proc/<pid>/fd shows "anon_inode:[name]".
+ */
+
+#include <linux/init.h>
+#include <linux/fs.h>
+#include <linux/file.h>
+#include <linux/mount.h>
+#include <linux/dcache.h>
+#include <linux/sched.h>
+#include <linux/err.h>
+#include <linux/anon_inodes.h>
+
+#define ANON_INODE_FS_MAGIC	0x09041934
+
+static struct vfsmount *anon_inode_mnt;
+static struct inode *anon_inode_inode;
+static struct file_operations anon_inode_fops;
+
+static struct super_block *
+anon_inodefs_get_sb(struct file_system_type *fs_type, int flags,
+		    const char *dev_name, void *data)
+{
+	return get_sb_pseudo(fs_type, "anon_inode:", NULL, ANON_INODE_FS_MAGIC);
+}
+
+static struct file_system_type anon_inode_fs_type = {
+	.name		= "anon_inodefs",
+	.get_sb		= anon_inodefs_get_sb,
+	.kill_sb	= kill_anon_super,
+};
+
+static int anon_inodefs_delete_dentry(struct dentry *dentry)
+{
+	return 1;
+}
+
+static struct dentry_operations anon_inodefs_dentry_operations = {
+	.d_delete	= anon_inodefs_delete_dentry,
+};
+
+/**
+ * anon_inode_getfd - new file descriptor on the anonymous inode
+ * @name: kind of file, "[eventfd]" for instance
+ * @fops: file operations of the file
+ * @priv: its private_data
+ *
+ * The file is open for reading and writing.  Returns the descriptor,
+ * or a negative error.
+ */
+int anon_inode_getfd(const char *name, struct file_operations *fops,
+		     void *priv)
+{
+	struct qstr this;
+	struct dentry *dentry;
+	struct file *file;
+	int fd, error;
+
+	if (IS_ERR(anon_inode_inode))
+		return -ENODEV;
+
+	file = get_empty_filp();
+	if (!file)
+		return -ENFILE;
+
+	fd = get_unused_fd();
+	if (fd < 0) {
+		error = fd;
+		goto err_put_filp;
+	}
+
+	error = -ENOMEM;
+	this.name = name;
+	this.len = strlen(name);
+	this.hash = 0;
+	dentry = d_alloc(anon_inode_mnt->mnt_sb->s_root, &this);
+	if (!dentry)
+		goto err_put_unused_fd;
+	dentry->d_op = &anon_inodefs_dentry_operations;
+	/* every file holds a reference to the one inode */
+	atomic_inc(&anon_inode_inode->i_count);
+	d_add(dentry, anon_inode_inode);
+
+	file->f_vfsmnt = mntget(anon_inode_mnt);
+	file->f_dentry = dentry;
+	file->f_mapping = anon_inode_inode->i_mapping;
+	file->f_pos = 0;
+	file->f_flags = O_RDWR;
+	file->f_op = fops;
+	file->f_mode = FMODE_READ | FMODE_WRITE;
+	file->f_version = 0;
+	file->private_data = priv;
+
+	fd_install(fd, file);
+	return fd;
+
+err_put_unused_fd:
+	put_unused_fd(fd);
+err_put_filp:
+	put_filp(file);
+	return error;
+}
+
+static struct inode *anon_inode_mkinode(void)
+{
+	struct inode *inode = new_inode(anon_inode_mnt->mnt_sb);
+
+	if (!inode)
+		return ERR_PTR(-ENOMEM);
+
+	inode->i_fop = &anon_inode_fops;
+
+	/*
+	 * Mark the inode dirty from the very beginning, so that it
+	 * never goes on the dirty list, as for pipes.
+	 */
+	inode->i_state = I_DIRTY;
+	inode->i_mode = S_IRUSR | S_IWUSR;
+	inode->i_uid = current->fsuid;
+	inode->i_gid = current->fsgid;
+	inode->i_atime = inode->i_mtime = inode->i_ctime = CURRENT_TIME;
+	inode->i_blksize = PAGE_SIZE;
+	return inode;
+}
+
+static int __init anon_inode_init(void)
+{
+	int error;
+
+	error = register_filesystem(&anon_inode_fs_type);
+	if (error)
+		goto err_exit;
+	anon_inode_mnt = kern_mount(&anon_inode_fs_type);
+	if (IS_ERR(anon_inode_mnt)) {
+		error = PTR_ERR(anon_inode_mnt);
+		goto err_unregister_filesystem;
+	}
+	anon_inode_inode = anon_inode_mkinode();
+	if (IS_ERR(anon_inode_inode)) {
+		error = PTR_ERR(anon_inode_inode);
+		goto err_mntput;
+	}
+
+	return 0;
+
+err_mntput:
+	mntput(anon_inode_mnt);
+err_unregister_filesystem:
+	unregister_filesystem(&anon_inode_fs_type);
+err_exit:
+	printk(KERN_ERR "anon_inode_init() failed (%d)\n", error);
+	anon_inode_inode = ERR_PTR(error);
+	return error;
+}
+
+fs_initcall(anon_inode_init);
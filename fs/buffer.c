@@ -408,6 +408,125 @@ out:
 	return ret;
 }
 
+/*
+ * do_sync_file_range - write out and/or wait upon the pagecache of a byte
+ * range, without fsync's full-file sweep and without touching metadata.
+ * @endbyte is inclusive.
+ *
+ * SYNC_FILE_RANGE_WAIT_BEFORE waits on writeout which is already in flight,
+ * so that pages redirtied since then are written again; SYNC_FILE_RANGE_WRITE
+ * starts writeout of the dirty pages in the range; SYNC_FILE_RANGE_WAIT_AFTER
+ * waits for it.  All three together make the data of the range stable, but
+ * neither the blocks allocated for it nor the inode size are committed, so
+ * this is for files whose metadata is already on disk (preallocated or
+ * overwritten in place); everything else still needs fsync or fdatasync.
+ */
+int do_sync_file_range(struct file *file, loff_t offset, loff_t endbyte,
+		       unsigned int flags)
+{
+	struct address_space *mapping = file->f_mapping;
+	int sync_mode = WB_SYNC_NONE;
+	int ret = 0;
+
+	if (flags & SYNC_FILE_RANGE_WAIT_BEFORE) {
+		ret = wait_on_page_writeback_range(mapping,
+					offset >> PAGE_CACHE_SHIFT,
+					endbyte >> PAGE_CACHE_SHIFT);
+		if (ret < 0)
+			goto out;
+	}
+
+	if (flags & SYNC_FILE_RANGE_WRITE) {
+		/*
+		 * Somebody will wait on this writeout: have writepage wait
+		 * for pages it finds under writeback rather than skipping
+		 * them, or the wait below would miss their new contents.
+		 */
+		if (flags & SYNC_FILE_RANGE_WAIT_AFTER)
+			sync_mode = WB_SYNC_ALL;
+		ret = __filemap_fdatawrite_range(mapping, offset, endbyte,
+						 sync_mode);
+		if (ret < 0)
+			goto out;
+	}
+
+	if (flags & SYNC_FILE_RANGE_WAIT_AFTER)
+		ret = wait_on_page_writeback_range(mapping,
+					offset >> PAGE_CACHE_SHIFT,
+					endbyte >> PAGE_CACHE_SHIFT);
+out:
+	return ret;
+}
+
+#define VALID_SYNC_FILE_RANGE_FLAGS \
+	(SYNC_FILE_RANGE_WAIT_BEFORE|SYNC_FILE_RANGE_WRITE| \
+	 SYNC_FILE_RANGE_WAIT_AFTER)
+
+/*
+ * sys_sync_file_range - sync the pagecache of @nbytes from @offset; zero
+ * @nbytes means to the end of the file.  Without any flags this is a no-op.
+ */
+asmlinkage long sys_sync_file_range(int fd, loff_t offset, loff_t nbytes,
+				    unsigned int flags)
+{
+	struct file *file;
+	loff_t endbyte;
+	int ret, fput_needed;
+	umode_t i_mode;
+
+	ret = -EINVAL;
+	if (flags & ~VALID_SYNC_FILE_RANGE_FLAGS)
+		goto out;
+
+	endbyte = offset + nbytes;
+
+	if ((s64)offset < 0)
+		goto out;
+	if ((s64)endbyte < 0)
+		goto out;
+	if (endbyte < offset)
+		goto out;
+
+	if (sizeof(pgoff_t) == 4) {
+		if (offset >= (0x100000000ULL << PAGE_CACHE_SHIFT)) {
+			/*
+			 * The range starts outside a 32 bit machine's
+			 * pagecache addressing capabilities.  Let it "succeed"
+			 */
+			ret = 0;
+			goto out;
+		}
+		if (endbyte >= (0x100000000ULL << PAGE_CACHE_SHIFT)) {
+			/* Out to EOF */
+			nbytes = 0;
+		}
+	}
+
+	if (nbytes == 0)
+		endbyte = LLONG_MAX;
+	else
+		endbyte--;		/* inclusive */
+
+	ret = -EBADF;
+	file = fget_light(fd, &fput_needed);
+	if (!file)
+		goto out;
+
+	i_mode = file->f_dentry->d_inode->i_mode;
+	ret = -ESPIPE;
+	if (!S_ISREG(i_mode) && !S_ISBLK(i_mode) && !S_ISDIR(i_mode) &&
+			!S_ISLNK(i_mode))
+		goto out_put;
+
+	current->flags |= PF_SYNCWRITE;
+	ret = do_sync_file_range(file, offset, endbyte, flags);
+	current->flags &= ~PF_SYNCWRITE;
+out_put:
+	fput_light(file, fput_needed);
+out:
+	return ret;
+}
+
 /*
  * Various filesystems appear to want __find_get_block to be non-blocking.
  * But it's the page lock which protects the buffers.  To get around this,
@@ -878,8 +997,11 @@ int __set_page_dirty_buffers(struct page *page)
 	if (!TestSetPageDirty(page)) {
 		write_lock_irq(&mapping->tree_lock);
 		if (page->mapping) {	/* Race with truncate? */
-			if (mapping_cap_account_dirty(mapping))
+			if (mapping_cap_account_dirty(mapping)) {
 				inc_page_state(nr_dirty);
+				inc_bdi_stat(mapping->backing_dev_info,
+						BDI_RECLAIMABLE);
+			}
 			radix_tree_tag_set(&mapping->page_tree,
 						page_index(page),
 						PAGECACHE_TAG_DIRTY);
@@ -1342,16 +1464,59 @@ static struct buffer_head *__bread_slow(struct buffer_head *bh)
  *
  * The LRUs themselves only need locking against invalidate_bh_lrus.  We use
  * a local interrupt disable for that.
+ *
+ * Buffers falling off the end of the LRU go into a small direct-mapped
+ * per-cpu hash.  That keeps a working set of bitmap and inode table
+ * blocks which is larger than the LRU, as a scan over many groups has,
+ * out of the pagecache lookup.  A buffer is in at most one of the two.
+ *
+ * The sizes can be set with bh_lru= and bh_hash= at boot; how well they
+ * do shows up as bh_lru_hit, bh_hash_hit and bh_lru_miss in /proc/vmstat.
  */
 
-#define BH_LRU_SIZE	8
+#define BH_LRU_MAX	16
+#define BH_HASH_BITS	8
+#define BH_HASH_MAX	(1 << BH_HASH_BITS)
+
+static int bh_lru_size = 8;
+static int bh_hash_size = 64;		/* 0 or a power of two */
 
 struct bh_lru {
-	struct buffer_head *bhs[BH_LRU_SIZE];
+	struct buffer_head *bhs[BH_LRU_MAX];
+	struct buffer_head *hash[BH_HASH_MAX];
 };
 
 static DEFINE_PER_CPU(struct bh_lru, bh_lrus) = {{ NULL }};
 
+static int __init set_bh_lru_size(char *str)
+{
+	int size = simple_strtol(str, NULL, 0);
+
+	bh_lru_size = max(1, min(size, BH_LRU_MAX));
+	return 1;
+}
+__setup("bh_lru=", set_bh_lru_size);
+
+static int __init set_bh_hash_size(char *str)
+{
+	int size = simple_strtol(str, NULL, 0);
+
+	bh_hash_size = 0;
+	if (size > 0)
+		bh_hash_size = 1 << min(long_log2(size), BH_HASH_BITS);
+	return 1;
+}
+__setup("bh_hash=", set_bh_hash_size);
+
+static inline struct buffer_head **
+bh_hash_slot(struct bh_lru *lru, struct block_device *bdev, sector_t block)
+{
+	unsigned long hash = hash_long((unsigned long)bdev ^ (unsigned long)block,
+				       BH_HASH_BITS);
+
+	return &lru->hash[hash & (bh_hash_size - 1)];
+}
+
 #ifdef CONFIG_SMP
 #define bh_lru_lock()	local_irq_disable()
 #define bh_lru_unlock()	local_irq_enable()
@@ -1379,19 +1544,19 @@ static void bh_lru_install(struct buffer_head *bh)
 	bh_lru_lock();
 	lru = &__get_cpu_var(bh_lrus);
 	if (lru->bhs[0] != bh) {
-		struct buffer_head *bhs[BH_LRU_SIZE];
+		struct buffer_head *bhs[BH_LRU_MAX];
 		int in;
 		int out = 0;
 
 		get_bh(bh);
 		bhs[out++] = bh;
-		for (in = 0; in < BH_LRU_SIZE; in++) {
+		for (in = 0; in < bh_lru_size; in++) {
 			struct buffer_head *bh2 = lru->bhs[in];
 
 			if (bh2 == bh) {
 				__brelse(bh2);
 			} else {
-				if (out >= BH_LRU_SIZE) {
+				if (out >= bh_lru_size) {
 					BUG_ON(evictee != NULL);
 					evictee = bh2;
 				} else {
@@ -1399,9 +1564,19 @@ static void bh_lru_install(struct buffer_head *bh)
 				}
 			}
 		}
-		while (out < BH_LRU_SIZE)
+		while (out < bh_lru_size)
 			bhs[out++] = NULL;
-		memcpy(lru->bhs, bhs, sizeof(bhs));
+		memcpy(lru->bhs, bhs, bh_lru_size * sizeof(bhs[0]));
+
+		/* the evictee moves to the hash, whatever it displaces goes */
+		if (evictee && bh_hash_size) {
+			struct buffer_head **slot = bh_hash_slot(lru,
+					evictee->b_bdev, evictee->b_blocknr);
+			struct buffer_head *old = *slot;
+
+			*slot = evictee;
+			evictee = old;
+		}
 	}
 	bh_lru_unlock();
 
@@ -1411,6 +1586,7 @@ static void bh_lru_install(struct buffer_head *bh)
 
 /*
  * Look up the bh in this cpu's LRU.  If it's there, move it to the head.
+ * Otherwise try the hash, which leaves the bh where it is.
  */
 static inline struct buffer_head *
 lookup_bh_lru(struct block_device *bdev, sector_t block, int size)
@@ -1422,7 +1598,7 @@ lookup_bh_lru(struct block_device *bdev, sector_t block, int size)
 	check_irqs_on();
 	bh_lru_lock();
 	lru = &__get_cpu_var(bh_lrus);
-	for (i = 0; i < BH_LRU_SIZE; i++) {
+	for (i = 0; i < bh_lru_size; i++) {
 		struct buffer_head *bh = lru->bhs[i];
 
 		if (bh && bh->b_bdev == bdev &&
@@ -1439,7 +1615,22 @@ lookup_bh_lru(struct block_device *bdev, sector_t block, int size)
 			break;
 		}
 	}
+	if (!ret && bh_hash_size) {
+		struct buffer_head *bh = *bh_hash_slot(lru, bdev, block);
+
+		if (bh && bh->b_bdev == bdev &&
+				bh->b_blocknr == block && bh->b_size == size) {
+			get_bh(bh);
+			ret = bh;
+		}
+		bh_lru_unlock();
+		if (ret)
+			inc_page_state(bh_hash_hit);
+		return ret;
+	}
 	bh_lru_unlock();
+	if (ret)
+		inc_page_state(bh_lru_hit);
 	return ret;
 }
 
@@ -1454,6 +1645,7 @@ __find_get_block(struct block_device *bdev, sector_t block, int size)
 	struct buffer_head *bh = lookup_bh_lru(bdev, block, size);
 
 	if (bh == NULL) {
+		inc_page_state(bh_lru_miss);
 		bh = __find_get_block_slow(bdev, block, size);
 		if (bh)
 			bh_lru_install(bh);
@@ -1523,15 +1715,23 @@ EXPORT_SYMBOL(__bread);
  * This doesn't race because it runs in each cpu either in irq
  * or with preempt disabled.
  */
-static void invalidate_bh_lru(void *arg)
+static void release_bh_lru(struct bh_lru *b)
 {
-	struct bh_lru *b = &get_cpu_var(bh_lrus);
 	int i;
 
-	for (i = 0; i < BH_LRU_SIZE; i++) {
+	for (i = 0; i < BH_LRU_MAX; i++) {
 		brelse(b->bhs[i]);
 		b->bhs[i] = NULL;
 	}
+	for (i = 0; i < BH_HASH_MAX; i++) {
+		brelse(b->hash[i]);
+		b->hash[i] = NULL;
+	}
+}
+
+static void invalidate_bh_lru(void *arg)
+{
+	release_bh_lru(&get_cpu_var(bh_lrus));
 	put_cpu_var(bh_lrus);
 }
 	
@@ -3091,13 +3291,7 @@ init_buffer_head(void *data, kmem_cache_t *cachep, unsigned long flags)
 #ifdef CONFIG_HOTPLUG_CPU
 static void buffer_exit_cpu(int cpu)
 {
-	int i;
-	struct bh_lru *b = &per_cpu(bh_lrus, cpu);
-
-	for (i = 0; i < BH_LRU_SIZE; i++) {
-		brelse(b->bhs[i]);
-		b->bhs[i] = NULL;
-	}
+	release_bh_lru(&per_cpu(bh_lrus, cpu));
 }
 
 static int buffer_cpu_notify(struct notifier_block *self,
@@ -3115,7 +3309,7 @@ void __init buffer_init(void)
 
 	bh_cachep = kmem_cache_create("buffer_head",
 			sizeof(struct buffer_head), 0,
-			SLAB_PANIC, init_buffer_head, NULL);
+			SLAB_PANIC|SLAB_MEM_SPREAD, init_buffer_head, NULL);
 
 	/*
 	 * Limit the bh occupancy to 10% of ZONE_NORMAL
@@ -55,6 +55,7 @@
 #include <linux/smb_fs.h>
 #include <linux/blkpg.h>
 #include <linux/blkdev.h>
+#include <linux/blktrace.h>
 #include <linux/elevator.h>
 #include <linux/rtc.h>
 #include <linux/pci.h>
@@ -34,6 +34,8 @@
 #include <linux/buffer_head.h>
 #include <linux/rwsem.h>
 #include <linux/uio.h>
+#include <linux/vmalloc.h>
+#include <linux/syscalls.h>
 #include <asm/atomic.h>
 
 /*
@@ -131,6 +133,170 @@ struct dio {
 	ssize_t result;                 /* IO result */
 };
 
+/*
+ * A user buffer registered with dio_register(2).  Its pages are pinned once,
+ * at registration, and direct IO to or from it takes them from here instead
+ * of walking the page tables under mmap_sem on every request.
+ *
+ * The region describes the pages which backed the buffer when it was
+ * registered.  If the mapping is later changed (munmap, mremap or a COW break
+ * after fork) without unregistering, IO keeps going to the old pages.
+ */
+struct dio_region {
+	struct list_head list;		/* on mm->dio_regions */
+	unsigned long start;		/* page aligned user address */
+	unsigned long nr_pages;
+	struct page **pages;
+};
+
+static void dio_region_free(struct dio_region *region, unsigned long nr_pages)
+{
+	unsigned long i;
+
+	for (i = 0; i < nr_pages; i++)
+		page_cache_release(region->pages[i]);
+	vfree(region->pages);
+	kfree(region);
+}
+
+/*
+ * Take up to nr_pages pages for the dio from a registered region covering
+ * dio->curr_user_address.  Returns the number of pages found, zero if the
+ * address is not in a region.
+ */
+static int dio_region_pages(struct dio *dio, int nr_pages)
+{
+	struct mm_struct *mm = current->mm;
+	unsigned long addr = dio->curr_user_address;
+	struct dio_region *region;
+	int i, ret = 0;
+
+	spin_lock(&mm->dio_lock);
+	list_for_each_entry(region, &mm->dio_regions, list) {
+		unsigned long idx;
+
+		if (addr < region->start)
+			continue;
+		idx = (addr - region->start) >> PAGE_SHIFT;
+		if (idx >= region->nr_pages)
+			continue;
+
+		ret = min_t(unsigned long, nr_pages, region->nr_pages - idx);
+		for (i = 0; i < ret; i++) {
+			dio->pages[i] = region->pages[idx + i];
+			page_cache_get(dio->pages[i]);
+		}
+		break;
+	}
+	spin_unlock(&mm->dio_lock);
+	return ret;
+}
+
+/*
+ * Pin [start, start + len) for direct IO.  The pages are counted against
+ * RLIMIT_MEMLOCK.  The buffer must be writable, so that the pinned pages are
+ * the process' own and can be used for reads.
+ */
+asmlinkage long sys_dio_register(unsigned long start, unsigned long len)
+{
+	struct mm_struct *mm = current->mm;
+	struct dio_region *region, *r;
+	unsigned long nr_pages, lock_limit;
+	int ret;
+
+	if (!mm || (start & ~PAGE_MASK))
+		return -EINVAL;
+	len = PAGE_ALIGN(len);
+	if (!len || start + len < start)
+		return -EINVAL;
+	nr_pages = len >> PAGE_SHIFT;
+
+	lock_limit = current->signal->rlim[RLIMIT_MEMLOCK].rlim_cur >> PAGE_SHIFT;
+	if (mm->dio_pinned + nr_pages > lock_limit && !capable(CAP_IPC_LOCK))
+		return -ENOMEM;
+
+	region = kmalloc(sizeof(*region), GFP_KERNEL);
+	if (!region)
+		return -ENOMEM;
+	region->pages = vmalloc(nr_pages * sizeof(struct page *));
+	if (!region->pages) {
+		kfree(region);
+		return -ENOMEM;
+	}
+
+	down_read(&mm->mmap_sem);
+	ret = get_user_pages(current, mm, start, nr_pages, 1, 0,
+				region->pages, NULL);
+	up_read(&mm->mmap_sem);
+	if (ret < 0) {
+		vfree(region->pages);
+		kfree(region);
+		return ret;
+	}
+	if (ret < nr_pages) {
+		dio_region_free(region, ret);
+		return -EFAULT;
+	}
+	region->start = start;
+	region->nr_pages = nr_pages;
+
+	spin_lock(&mm->dio_lock);
+	list_for_each_entry(r, &mm->dio_regions, list) {
+		if (start < r->start + (r->nr_pages << PAGE_SHIFT) &&
+				r->start < start + len) {
+			spin_unlock(&mm->dio_lock);
+			dio_region_free(region, nr_pages);
+			return -EBUSY;
+		}
+	}
+	list_add(&region->list, &mm->dio_regions);
+	mm->dio_pinned += nr_pages;
+	spin_unlock(&mm->dio_lock);
+	return 0;
+}
+
+/*
+ * Drop the region registered at start.  IO in flight holds its own page
+ * references, so this need not wait for it.
+ */
+asmlinkage long sys_dio_unregister(unsigned long start)
+{
+	struct mm_struct *mm = current->mm;
+	struct dio_region *region;
+
+	if (!mm)
+		return -EINVAL;
+
+	spin_lock(&mm->dio_lock);
+	list_for_each_entry(region, &mm->dio_regions, list) {
+		if (region->start == start) {
+			list_del(&region->list);
+			mm->dio_pinned -= region->nr_pages;
+			spin_unlock(&mm->dio_lock);
+			dio_region_free(region, region->nr_pages);
+			return 0;
+		}
+	}
+	spin_unlock(&mm->dio_lock);
+	return -EINVAL;
+}
+
+/*
+ * Called from mmput() when the last user of the mm goes away.
+ */
+void exit_dio_regions(struct mm_struct *mm)
+{
+	while (!list_empty(&mm->dio_regions)) {
+		struct dio_region *region;
+
+		region = list_entry(mm->dio_regions.next,
+					struct dio_region, list);
+		list_del(&region->list);
+		dio_region_free(region, region->nr_pages);
+	}
+	mm->dio_pinned = 0;
+}
+
 /*
  * How many pages are in the queue?
  */
@@ -139,6 +305,22 @@ static inline unsigned dio_pages_present(struct dio *dio)
 	return dio->tail - dio->head;
 }
 
+/*
+ * The pages of a kernel kiocb, whose addresses are offsets into ki_pages.
+ */
+static int dio_kernel_pages(struct dio *dio, int nr_pages)
+{
+	struct page **pages = dio->iocb->ki_pages +
+				(dio->curr_user_address >> PAGE_SHIFT);
+	int i;
+
+	for (i = 0; i < nr_pages; i++) {
+		dio->pages[i] = pages[i];
+		page_cache_get(dio->pages[i]);
+	}
+	return nr_pages;
+}
+
 /*
  * Go grab and pin some userspace pages.   Typically we'll get 64 at a time.
  */
@@ -148,6 +330,19 @@ static int dio_refill_pages(struct dio *dio)
 	int nr_pages;
 
 	nr_pages = min(dio->total_pages - dio->curr_page, DIO_PAGES);
+
+	if (is_kernel_kiocb(dio->iocb)) {
+		ret = dio_kernel_pages(dio, nr_pages);
+		goto got_pages;
+	}
+
+	/* unlocked test is OK here, regions are per-mm and rarely change */
+	if (!list_empty(&current->mm->dio_regions)) {
+		ret = dio_region_pages(dio, nr_pages);
+		if (ret)
+			goto got_pages;
+	}
+
 	down_read(&current->mm->mmap_sem);
 	ret = get_user_pages(
 		current,			/* Task for fault acounting */
@@ -175,6 +370,7 @@ static int dio_refill_pages(struct dio *dio)
 		goto out;
 	}
 
+got_pages:
 	if (ret >= 0) {
 		dio->curr_user_address += ret * PAGE_SIZE;
 		dio->curr_page += ret;
@@ -237,9 +433,13 @@ static void finished_one_bio(struct dio *dio)
 			spin_unlock_irqrestore(&dio->bio_lock, flags);
 			dio_complete(dio, dio->block_in_file << dio->blkbits,
 					dio->result);
-			/* Complete AIO later if falling back to buffered i/o */
+			/*
+			 * Complete AIO later if falling back to buffered i/o.
+			 * Kernel kiocbs do their own fallback once called.
+			 */
 			if (dio->result == dio->size ||
-				((dio->rw == READ) && dio->result)) {
+				((dio->rw == READ) && dio->result) ||
+				is_kernel_kiocb(dio->iocb)) {
 				aio_complete(dio->iocb, dio->result, 0);
 				kfree(dio);
 				return;
@@ -337,7 +537,7 @@ static void dio_bio_submit(struct dio *dio)
 	dio->bio_count++;
 	dio->bios_in_flight++;
 	spin_unlock_irqrestore(&dio->bio_lock, flags);
-	if (dio->is_async && dio->rw == READ)
+	if (dio->is_async && dio->rw == READ && !is_kernel_kiocb(dio->iocb))
 		bio_set_pages_dirty(bio);
 	submit_bio(dio->rw, bio);
 
@@ -388,18 +588,19 @@ static int dio_bio_complete(struct dio *dio, struct bio *bio)
 {
 	const int uptodate = test_bit(BIO_UPTODATE, &bio->bi_flags);
 	struct bio_vec *bvec = bio->bi_io_vec;
+	int dirty = dio->rw == READ && !is_kernel_kiocb(dio->iocb);
 	int page_no;
 
 	if (!uptodate)
 		dio->result = -EIO;
 
-	if (dio->is_async && dio->rw == READ) {
+	if (dio->is_async && dirty) {
 		bio_check_pages_dirty(bio);	/* transfers ownership */
 	} else {
 		for (page_no = 0; page_no < bio->bi_vcnt; page_no++) {
 			struct page *page = bvec[page_no].bv_page;
 
-			if (dio->rw == READ && !PageCompound(page))
+			if (dirty && !PageCompound(page))
 				set_page_dirty_lock(page);
 			page_cache_release(page);
 		}
@@ -1059,7 +1260,8 @@ direct_io_worker(int rw, struct kiocb *iocb, struct inode *inode,
 	if (dio->is_async) {
 		int should_wait = 0;
 
-		if (dio->result < dio->size && rw == WRITE) {
+		if (dio->result < dio->size && rw == WRITE &&
+		    !is_kernel_kiocb(iocb)) {
 			dio->waiter = current;
 			should_wait = 1;
 		}
@@ -1087,6 +1289,8 @@ direct_io_worker(int rw, struct kiocb *iocb, struct inode *inode,
 			set_current_state(TASK_RUNNING);
 			kfree(dio);
 		}
+		if (is_kernel_kiocb(iocb))
+			ret = -EIOCBQUEUED;
 	} else {
 		ssize_t transferred = 0;
 
@@ -1112,7 +1316,10 @@ direct_io_worker(int rw, struct kiocb *iocb, struct inode *inode,
 			ret = transferred;
 
 		/* We could have also come here on an AIO file extend */
-		if (!is_sync_kiocb(iocb) && rw == WRITE &&
+		if (is_kernel_kiocb(iocb)) {
+			aio_complete(iocb, ret, 0);
+			ret = -EIOCBQUEUED;
+		} else if (!is_sync_kiocb(iocb) && rw == WRITE &&
 		    ret >= 0 && dio->result == dio->size)
 			/*
 			 * For AIO writes where we have completed the
@@ -83,14 +83,19 @@
 #define __DQUOT_PARANOIA
 
 /*
- * There are two quota SMP locks. dq_list_lock protects all lists with quotas
- * and quota formats and also dqstats structure containing statistics about the
- * lists. dq_data_lock protects data from dq_dqb and also mem_dqinfo structures
- * and also guards consistency of dquot->dq_dqb with inode->i_blocks, i_bytes.
- * i_blocks and i_bytes updates itself are guarded by i_lock acquired directly
- * in inode_add_bytes() and inode_sub_bytes().
+ * There are three kinds of quota SMP locks. dq_list_lock protects all lists
+ * with quotas and quota formats and also dqstats structure containing
+ * statistics about the lists. dq_data_lock protects mem_dqinfo structures.
+ * Each dquot has its dq_dqb_lock protecting its dq_dqb, so that usage updates
+ * of different users don't contend; operations on all the dquots of an inode
+ * take their dq_dqb_locks in the order of quota types.  The consistency of
+ * dquot->dq_dqb with inode->i_blocks, i_bytes is guarded by dqptr_sem, held
+ * for writing by dquot_transfer() which reads them together.  i_blocks and
+ * i_bytes updates itself are guarded by i_lock acquired directly in
+ * inode_add_bytes() and inode_sub_bytes().
  *
- * The spinlock ordering is hence: dq_data_lock > dq_list_lock > i_lock
+ * The spinlock ordering is hence:
+ *   dq_data_lock > dq_dqb_lock > dq_list_lock > i_lock
  *
  * Note that some things (eg. sb pointer, type, id) doesn't change during
  * the life of the dquot structure and so needn't to be protected by a lock
@@ -112,7 +117,7 @@
  * it is being allocated) on the first dqget() and when it is being released on
  * the last dqput(). The allocation and release oparations are serialized by
  * the dq_lock and by checking the use count in dquot_release().  Write
- * operations on dquots don't hold dq_lock as they copy data under dq_data_lock
+ * operations on dquots don't hold dq_lock as they copy data under dq_dqb_lock
  * spinlock to internal buffers before writing.
  *
  * Lock ordering (including related VFS locks) is the following:
@@ -287,6 +292,9 @@ static void wait_on_dquot(struct dquot *dquot)
 
 int dquot_mark_dquot_dirty(struct dquot *dquot)
 {
+	/* Usually it is, by an earlier update: then dq_list_lock isn't needed */
+	if (test_bit(DQ_MOD_B, &dquot->dq_flags))
+		return 0;
 	spin_lock(&dq_list_lock);
 	if (!test_and_set_bit(DQ_MOD_B, &dquot->dq_flags))
 		list_add(&dquot->dq_dirty, &sb_dqopt(dquot->dq_sb)->
@@ -582,6 +590,7 @@ static struct dquot *get_empty_dquot(struct super_block *sb, int type)
 	INIT_LIST_HEAD(&dquot->dq_inuse);
 	INIT_HLIST_NODE(&dquot->dq_hash);
 	INIT_LIST_HEAD(&dquot->dq_dirty);
+	spin_lock_init(&dquot->dq_dqb_lock);
 	dquot->dq_sb = sb;
 	dquot->dq_type = type;
 	atomic_set(&dquot->dq_count, 1);
@@ -856,7 +865,7 @@ static inline char ignore_hardlimit(struct dquot *dquot)
 	    (info->dqi_format->qf_fmt_id != QFMT_VFS_OLD || !(info->dqi_flags & V1_DQF_RSQUASH));
 }
 
-/* needs dq_data_lock */
+/* needs dq_dqb_lock */
 static int check_idq(struct dquot *dquot, ulong inodes, char *warntype)
 {
 	*warntype = NOWARN;
@@ -888,7 +897,7 @@ static int check_idq(struct dquot *dquot, ulong inodes, char *warntype)
 	return QUOTA_OK;
 }
 
-/* needs dq_data_lock */
+/* needs dq_dqb_lock */
 static int check_bdq(struct dquot *dquot, qsize_t space, int prealloc, char *warntype)
 {
 	*warntype = 0;
@@ -986,6 +995,25 @@ int dquot_drop(struct inode *inode)
 	return 0;
 }
 
+/* Lock the dq_dqb of the dquots of an inode, in the order of quota types */
+static void lock_inode_dquots(struct dquot * const *dquots)
+{
+	int cnt;
+
+	for (cnt = 0; cnt < MAXQUOTAS; cnt++)
+		if (dquots[cnt] != NODQUOT)
+			spin_lock(&dquots[cnt]->dq_dqb_lock);
+}
+
+static void unlock_inode_dquots(struct dquot * const *dquots)
+{
+	int cnt;
+
+	for (cnt = MAXQUOTAS - 1; cnt >= 0; cnt--)
+		if (dquots[cnt] != NODQUOT)
+			spin_unlock(&dquots[cnt]->dq_dqb_lock);
+}
+
 /*
  * Following four functions update i_blocks+i_bytes fields and
  * quota information (together with appropriate checks)
@@ -1018,7 +1046,7 @@ out_add:
 		up_read(&sb_dqopt(inode->i_sb)->dqptr_sem);
 		goto out_add;
 	}
-	spin_lock(&dq_data_lock);
+	lock_inode_dquots(inode->i_dquot);
 	for (cnt = 0; cnt < MAXQUOTAS; cnt++) {
 		if (inode->i_dquot[cnt] == NODQUOT)
 			continue;
@@ -1033,7 +1061,7 @@ out_add:
 	inode_add_bytes(inode, number);
 	ret = QUOTA_OK;
 warn_put_all:
-	spin_unlock(&dq_data_lock);
+	unlock_inode_dquots(inode->i_dquot);
 	if (ret == QUOTA_OK)
 		/* Dirtify all the dquots - this can block when journalling */
 		for (cnt = 0; cnt < MAXQUOTAS; cnt++)
@@ -1063,7 +1091,7 @@ int dquot_alloc_inode(const struct inode *inode, unsigned long number)
 		up_read(&sb_dqopt(inode->i_sb)->dqptr_sem);
 		return QUOTA_OK;
 	}
-	spin_lock(&dq_data_lock);
+	lock_inode_dquots(inode->i_dquot);
 	for (cnt = 0; cnt < MAXQUOTAS; cnt++) {
 		if (inode->i_dquot[cnt] == NODQUOT)
 			continue;
@@ -1078,7 +1106,7 @@ int dquot_alloc_inode(const struct inode *inode, unsigned long number)
 	}
 	ret = QUOTA_OK;
 warn_put_all:
-	spin_unlock(&dq_data_lock);
+	unlock_inode_dquots(inode->i_dquot);
 	if (ret == QUOTA_OK)
 		/* Dirtify all the dquots - this can block when journalling */
 		for (cnt = 0; cnt < MAXQUOTAS; cnt++)
@@ -1109,14 +1137,14 @@ out_sub:
 		up_read(&sb_dqopt(inode->i_sb)->dqptr_sem);
 		goto out_sub;
 	}
-	spin_lock(&dq_data_lock);
+	lock_inode_dquots(inode->i_dquot);
 	for (cnt = 0; cnt < MAXQUOTAS; cnt++) {
 		if (inode->i_dquot[cnt] == NODQUOT)
 			continue;
 		dquot_decr_space(inode->i_dquot[cnt], number);
 	}
 	inode_sub_bytes(inode, number);
-	spin_unlock(&dq_data_lock);
+	unlock_inode_dquots(inode->i_dquot);
 	/* Dirtify all the dquots - this can block when journalling */
 	for (cnt = 0; cnt < MAXQUOTAS; cnt++)
 		if (inode->i_dquot[cnt])
@@ -1142,13 +1170,13 @@ int dquot_free_inode(const struct inode *inode, unsigned long number)
 		up_read(&sb_dqopt(inode->i_sb)->dqptr_sem);
 		return QUOTA_OK;
 	}
-	spin_lock(&dq_data_lock);
+	lock_inode_dquots(inode->i_dquot);
 	for (cnt = 0; cnt < MAXQUOTAS; cnt++) {
 		if (inode->i_dquot[cnt] == NODQUOT)
 			continue;
 		dquot_decr_inodes(inode->i_dquot[cnt], number);
 	}
-	spin_unlock(&dq_data_lock);
+	unlock_inode_dquots(inode->i_dquot);
 	/* Dirtify all the dquots - this can block when journalling */
 	for (cnt = 0; cnt < MAXQUOTAS; cnt++)
 		if (inode->i_dquot[cnt])
@@ -1204,13 +1232,22 @@ int dquot_transfer(struct inode *inode, struct iattr *iattr)
 				break;
 		}
 	}
-	spin_lock(&dq_data_lock);
 	space = inode_get_bytes(inode);
-	/* Build the transfer_from list and check the limits */
+	/* Build the transfer_from list */
+	for (cnt = 0; cnt < MAXQUOTAS; cnt++)
+		if (transfer_to[cnt] != NODQUOT)
+			transfer_from[cnt] = inode->i_dquot[cnt];
+	/*
+	 * Nobody else takes two dq_dqb_locks of one type while we hold
+	 * dqptr_sem for writing, so the order between from and to doesn't
+	 * matter.
+	 */
+	lock_inode_dquots(transfer_from);
+	lock_inode_dquots(transfer_to);
+	/* Check the limits */
 	for (cnt = 0; cnt < MAXQUOTAS; cnt++) {
 		if (transfer_to[cnt] == NODQUOT)
 			continue;
-		transfer_from[cnt] = inode->i_dquot[cnt];
 		if (check_idq(transfer_to[cnt], 1, warntype+cnt) == NO_QUOTA ||
 		    check_bdq(transfer_to[cnt], space, 0, warntype+cnt) == NO_QUOTA)
 			goto warn_put_all;
@@ -1239,7 +1276,8 @@ int dquot_transfer(struct inode *inode, struct iattr *iattr)
 	}
 	ret = QUOTA_OK;
 warn_put_all:
-	spin_unlock(&dq_data_lock);
+	unlock_inode_dquots(transfer_to);
+	unlock_inode_dquots(transfer_from);
 	/* Dirtify all the dquots - this can block when journalling */
 	for (cnt = 0; cnt < MAXQUOTAS; cnt++) {
 		if (transfer_from[cnt])
@@ -1533,7 +1571,7 @@ static void do_get_dqblk(struct dquot *dquot, struct if_dqblk *di)
 {
 	struct mem_dqblk *dm = &dquot->dq_dqb;
 
-	spin_lock(&dq_data_lock);
+	spin_lock(&dquot->dq_dqb_lock);
 	di->dqb_bhardlimit = dm->dqb_bhardlimit;
 	di->dqb_bsoftlimit = dm->dqb_bsoftlimit;
 	di->dqb_curspace = dm->dqb_curspace;
@@ -1543,7 +1581,7 @@ static void do_get_dqblk(struct dquot *dquot, struct if_dqblk *di)
 	di->dqb_btime = dm->dqb_btime;
 	di->dqb_itime = dm->dqb_itime;
 	di->dqb_valid = QIF_ALL;
-	spin_unlock(&dq_data_lock);
+	spin_unlock(&dquot->dq_dqb_lock);
 }
 
 int vfs_get_dqblk(struct super_block *sb, int type, qid_t id, struct if_dqblk *di)
@@ -1567,7 +1605,7 @@ static void do_set_dqblk(struct dquot *dquot, struct if_dqblk *di)
 	struct mem_dqblk *dm = &dquot->dq_dqb;
 	int check_blim = 0, check_ilim = 0;
 
-	spin_lock(&dq_data_lock);
+	spin_lock(&dquot->dq_dqb_lock);
 	if (di->dqb_valid & QIF_SPACE) {
 		dm->dqb_curspace = di->dqb_curspace;
 		check_blim = 1;
@@ -1611,7 +1649,7 @@ static void do_set_dqblk(struct dquot *dquot, struct if_dqblk *di)
 		clear_bit(DQ_FAKE_B, &dquot->dq_flags);
 	else
 		set_bit(DQ_FAKE_B, &dquot->dq_flags);
-	spin_unlock(&dq_data_lock);
+	spin_unlock(&dquot->dq_dqb_lock);
 	mark_dquot_dirty(dquot);
 }
 
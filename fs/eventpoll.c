@@ -29,6 +29,7 @@
 #include <linux/spinlock.h>
 #include <linux/syscalls.h>
 #include <linux/rwsem.h>
+#include <linux/mutex.h>
 #include <linux/rbtree.h>
 #include <linux/wait.h>
 #include <linux/eventpoll.h>
@@ -46,7 +47,7 @@
  * LOCKING:
  * There are three level of locking required by epoll :
  *
- * 1) epsem (semaphore)
+ * 1) epsem (mutex)
  * 2) ep->sem (rw_semaphore)
  * 3) ep->lock (rw_lock)
  *
@@ -67,7 +68,7 @@
  * if a file has been pushed inside an epoll set and it is then
  * close()d without a previous call toepoll_ctl(EPOLL_CTL_DEL).
  * It is possible to drop the "ep->sem" and to use the global
- * semaphore "epsem" (together with "ep->lock") to have it working,
+ * mutex "epsem" (together with "ep->lock") to have it working,
  * but having "ep->sem" will make the interface more scalable.
  * Events that require holding "epsem" are very rare, while for
  * normal operations the epoll private "ep->sem" will guarantee
@@ -101,6 +102,9 @@
 /* Maximum number of poll wake up nests we are allowing */
 #define EP_MAX_POLLWAKE_NESTS 4
 
+/* Maximum number of commands accepted by a single sys_epoll_ctl_batch() */
+#define EP_MAX_CTL_BATCH 256
+
 /* Macro to allocate a "struct epitem" from the slab cache */
 #define EPI_MEM_ALLOC()	(struct epitem *) kmem_cache_alloc(epi_cache, SLAB_KERNEL)
 
@@ -298,6 +302,8 @@ static int ep_modify(struct eventpoll *ep, struct epitem *epi,
 static void ep_unregister_pollwait(struct eventpoll *ep, struct epitem *epi);
 static int ep_unlink(struct eventpoll *ep, struct epitem *epi);
 static int ep_remove(struct eventpoll *ep, struct epitem *epi);
+static int ep_ctl(struct eventpoll *ep, int op, struct file *tfile, int fd,
+		  struct epoll_event *epds);
 static int ep_poll_callback(wait_queue_t *wait, unsigned mode, int sync, void *key);
 static int ep_eventpoll_close(struct inode *inode, struct file *file);
 static unsigned int ep_eventpoll_poll(struct file *file, poll_table *wait);
@@ -318,9 +324,9 @@ static struct super_block *eventpollfs_get_sb(struct file_system_type *fs_type,
 					      void *data);
 
 /*
- * This semaphore is used to serialize ep_free() and eventpoll_release_file().
+ * This mutex is used to serialize ep_free() and eventpoll_release_file().
  */
-struct semaphore epsem;
+static DEFINE_MUTEX(epsem);
 
 /* Safe wake up implementation */
 static struct poll_safewake psw;
@@ -450,7 +456,7 @@ void eventpoll_release_file(struct file *file)
 	 * "ep->sem" after "epsem" because ep_remove() requires it when called
 	 * from anywhere but ep_free().
 	 */
-	down(&epsem);
+	mutex_lock(&epsem);
 
 	while (!list_empty(lsthead)) {
 		epi = list_entry(lsthead->next, struct epitem, fllink);
@@ -462,7 +468,7 @@ void eventpoll_release_file(struct file *file)
 		up_write(&ep->sem);
 	}
 
-	up(&epsem);
+	mutex_unlock(&epsem);
 }
 
 
@@ -527,7 +533,6 @@ sys_epoll_ctl(int epfd, int op, int fd, struct epoll_event __user *event)
 	int error;
 	struct file *file, *tfile;
 	struct eventpoll *ep;
-	struct epitem *epi;
 	struct epoll_event epds;
 
 	DNPRINTK(3, (KERN_INFO "[%p] eventpoll: sys_epoll_ctl(%d, %d, %d, %p)\n",
@@ -570,51 +575,108 @@ sys_epoll_ctl(int epfd, int op, int fd, struct epoll_event __user *event)
 	ep = file->private_data;
 
 	down_write(&ep->sem);
+	error = ep_ctl(ep, op, tfile, fd, &epds);
+	up_write(&ep->sem);
 
-	/* Try to lookup the file inside our hash table */
-	epi = ep_find(ep, tfile, fd);
+eexit_3:
+	fput(tfile);
+eexit_2:
+	fput(file);
+eexit_1:
+	DNPRINTK(3, (KERN_INFO "[%p] eventpoll: sys_epoll_ctl(%d, %d, %d, %p) = %d\n",
+		     current, epfd, op, fd, event, error));
+
+	return error;
+}
+
+/*
+ * Vectorized version of sys_epoll_ctl(). All the commands are applied
+ * under a single acquisition of "ep->sem", and the per-command return
+ * code is stored in the "result" member of each "struct epoll_ctl_cmd".
+ * The target files are looked up before taking the semaphore and released
+ * after dropping it, since a final fput() would recurse into
+ * eventpoll_release_file() and try to take "ep->sem" again.
+ * Returns the number of commands processed.
+ */
+asmlinkage long sys_epoll_ctl_batch(int epfd, struct epoll_ctl_cmd __user *ucmds,
+				    int ncmds, unsigned int flags)
+{
+	int i, error;
+	struct file *file;
+	struct eventpoll *ep;
+	struct epoll_ctl_cmd *cmds;
+	struct file **tfiles;
+
+	DNPRINTK(3, (KERN_INFO "[%p] eventpoll: sys_epoll_ctl_batch(%d, %p, %d)\n",
+		     current, epfd, ucmds, ncmds));
+
+	if (flags || ncmds <= 0 || ncmds > EP_MAX_CTL_BATCH)
+		return -EINVAL;
+
+	error = -ENOMEM;
+	cmds = kmalloc(ncmds * (sizeof(*cmds) + sizeof(*tfiles)), GFP_KERNEL);
+	if (!cmds)
+		goto eexit_1;
+	tfiles = (struct file **) (cmds + ncmds);
+
+	error = -EFAULT;
+	if (copy_from_user(cmds, ucmds, ncmds * sizeof(*cmds)))
+		goto eexit_2;
+
+	/* Get the "struct file *" for the eventpoll file */
+	error = -EBADF;
+	file = fget(epfd);
+	if (!file)
+		goto eexit_2;
 
 	error = -EINVAL;
-	switch (op) {
-	case EPOLL_CTL_ADD:
-		if (!epi) {
-			epds.events |= POLLERR | POLLHUP;
+	if (!IS_FILE_EPOLL(file))
+		goto eexit_3;
 
-			error = ep_insert(ep, &epds, tfile, fd);
-		} else
-			error = -EEXIST;
-		break;
-	case EPOLL_CTL_DEL:
-		if (epi)
-			error = ep_remove(ep, epi);
+	/* Resolve and validate the targets, the same way sys_epoll_ctl() does */
+	for (i = 0; i < ncmds; i++) {
+		struct file *tfile = fget(cmds[i].fd);
+
+		tfiles[i] = NULL;
+		cmds[i].result = -EBADF;
+		if (!tfile)
+			continue;
+		if (!tfile->f_op || !tfile->f_op->poll)
+			cmds[i].result = -EPERM;
+		else if (tfile == file)
+			cmds[i].result = -EINVAL;
 		else
-			error = -ENOENT;
-		break;
-	case EPOLL_CTL_MOD:
-		if (epi) {
-			epds.events |= POLLERR | POLLHUP;
-			error = ep_modify(ep, epi, &epds);
-		} else
-			error = -ENOENT;
-		break;
+			cmds[i].result = 0;
+		tfiles[i] = tfile;
 	}
 
-	/*
-	 * The function ep_find() increments the usage count of the structure
-	 * so, if this is not NULL, we need to release it.
-	 */
-	if (epi)
-		ep_release_epitem(epi);
+	ep = file->private_data;
 
+	down_write(&ep->sem);
+	for (i = 0; i < ncmds; i++)
+		if (!cmds[i].result)
+			cmds[i].result = ep_ctl(ep, cmds[i].op, tfiles[i],
+						cmds[i].fd, &cmds[i].event);
 	up_write(&ep->sem);
 
+	for (i = 0; i < ncmds; i++)
+		if (tfiles[i])
+			fput(tfiles[i]);
+
+	error = ncmds;
+	for (i = 0; i < ncmds; i++)
+		if (put_user(cmds[i].result, &ucmds[i].result)) {
+			error = -EFAULT;
+			break;
+		}
+
 eexit_3:
-	fput(tfile);
-eexit_2:
 	fput(file);
+eexit_2:
+	kfree(cmds);
 eexit_1:
-	DNPRINTK(3, (KERN_INFO "[%p] eventpoll: sys_epoll_ctl(%d, %d, %d, %p) = %d\n",
-		     current, epfd, op, fd, event, error));
+	DNPRINTK(3, (KERN_INFO "[%p] eventpoll: sys_epoll_ctl_batch(%d, %p, %d) = %d\n",
+		     current, epfd, ucmds, ncmds, error));
 
 	return error;
 }
@@ -792,7 +854,7 @@ static void ep_free(struct eventpoll *ep)
 	 * anymore. The only hit might come from eventpoll_release_file() but
 	 * holding "epsem" is sufficent here.
 	 */
-	down(&epsem);
+	mutex_lock(&epsem);
 
 	/*
 	 * Walks through the whole tree by unregistering poll callbacks.
@@ -814,7 +876,7 @@ static void ep_free(struct eventpoll *ep)
 		ep_remove(ep, epi);
 	}
 
-	up(&epsem);
+	mutex_unlock(&epsem);
 }
 
 
@@ -1201,6 +1263,55 @@ eexit_1:
 }
 
 
+/*
+ * Applies a single epoll_ctl(2) operation. The caller has validated "tfile"
+ * and must hold "ep->sem" for writing.
+ */
+static int ep_ctl(struct eventpoll *ep, int op, struct file *tfile, int fd,
+		  struct epoll_event *epds)
+{
+	int error;
+	struct epitem *epi;
+
+	/* Try to lookup the file inside our hash table */
+	epi = ep_find(ep, tfile, fd);
+
+	error = -EINVAL;
+	switch (op) {
+	case EPOLL_CTL_ADD:
+		if (!epi) {
+			epds->events |= POLLERR | POLLHUP;
+
+			error = ep_insert(ep, epds, tfile, fd);
+		} else
+			error = -EEXIST;
+		break;
+	case EPOLL_CTL_DEL:
+		if (epi)
+			error = ep_remove(ep, epi);
+		else
+			error = -ENOENT;
+		break;
+	case EPOLL_CTL_MOD:
+		if (epi) {
+			epds->events |= POLLERR | POLLHUP;
+			error = ep_modify(ep, epi, epds);
+		} else
+			error = -ENOENT;
+		break;
+	}
+
+	/*
+	 * The function ep_find() increments the usage count of the structure
+	 * so, if this is not NULL, we need to release it.
+	 */
+	if (epi)
+		ep_release_epitem(epi);
+
+	return error;
+}
+
+
 /*
  * This is the callback that is passed to the wait queue wakeup
  * machanism. It is called by the stored file descriptors when they
@@ -1417,7 +1528,12 @@ static void ep_reinject_items(struct eventpoll *ep, struct list_head *txlist)
 		}
 	}
 
-	if (ricnt) {
+	/*
+	 * Waiters inside ep_poll() are woken exclusively, so if anything is
+	 * left in the ready list ( reinjected items, or items beyond the caller
+	 * "maxevents" ) we have to hand the wakeup over to the next waiter.
+	 */
+	if (ricnt || !list_empty(&ep->rdllist)) {
 		/*
 		 * Wake up ( if active ) both the eventpoll wait list and the ->poll()
 		 * wait list.
@@ -1493,9 +1609,12 @@ retry:
 		 * We don't have any available event to return to the caller.
 		 * We need to sleep here, and we will be wake up by
 		 * ep_poll_callback() when events will become available.
+		 * The wait is exclusive, so that a ready event wakes only
+		 * one of the threads sharing this epoll set instead of all
+		 * of them.
 		 */
 		init_waitqueue_entry(&wait, current);
-		add_wait_queue(&ep->wq, &wait);
+		add_wait_queue_exclusive(&ep->wq, &wait);
 
 		for (;;) {
 			/*
@@ -1586,8 +1705,6 @@ static int __init eventpoll_init(void)
 {
 	int error;
 
-	init_MUTEX(&epsem);
-
 	/* Initialize the structure used to perform safe poll wait head wake ups */
 	ep_poll_safewake_init(&psw);
 
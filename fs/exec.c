@@ -48,6 +48,7 @@
 #include <linux/syscalls.h>
 #include <linux/rmap.h>
 #include <linux/acct.h>
+#include <linux/signalfd.h>
 
 #include <asm/uaccess.h>
 #include <asm/mmu_context.h>
@@ -327,6 +328,7 @@ void install_arg_page(struct vm_area_struct *vma,
 		goto out;
 	}
 	inc_mm_counter(mm, rss);
+	SetPageSwapBacked(page);
 	lru_cache_add_active(page);
 	set_pte_at(mm, address, pte, pte_mkdirty(pte_mkwrite(mk_pte(
 					page, vma->vm_page_prot))));
@@ -752,6 +754,7 @@ no_thread_group:
 		 * Move our state over to newsighand and switch it in.
 		 */
 		spin_lock_init(&newsighand->siglock);
+		INIT_LIST_HEAD(&newsighand->signalfd_list);
 		atomic_set(&newsighand->count, 1);
 		memcpy(newsighand->action, oldsighand->action,
 		       sizeof(newsighand->action));
@@ -767,8 +770,10 @@ no_thread_group:
 		spin_unlock(&oldsighand->siglock);
 		write_unlock_irq(&tasklist_lock);
 
-		if (atomic_dec_and_test(&oldsighand->count))
+		if (atomic_dec_and_test(&oldsighand->count)) {
+			signalfd_detach(oldsighand);
 			kmem_cache_free(sighand_cachep, oldsighand);
+		}
 	}
 
 	if (!thread_group_empty(current))
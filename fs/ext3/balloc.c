@@ -649,12 +649,18 @@ claim_block(spinlock_t *lock, int block, struct buffer_head *bh)
  * If we failed to allocate the desired block then we may end up crossing to a
  * new bitmap.  In that case we must release write access to the old one via
  * ext3_journal_release_buffer(), else we'll run out of credits.
+ *
+ * On entry *count is the number of blocks wanted.  Once the first block is
+ * claimed we keep claiming the ones directly after it, up to *count or the
+ * end of the window, and return the length of the run in *count.
  */
 static int
 ext3_try_to_allocate(struct super_block *sb, handle_t *handle, int group,
-	struct buffer_head *bitmap_bh, int goal, struct ext3_reserve_window *my_rsv)
+	struct buffer_head *bitmap_bh, int goal, unsigned long *count,
+	struct ext3_reserve_window *my_rsv)
 {
 	int group_first_block, start, end;
+	unsigned long num = 0;
 
 	/* we do allocation within the reservation window if we have a window */
 	if (my_rsv) {
@@ -712,8 +718,15 @@ repeat:
 			goto fail_access;
 		goto repeat;
 	}
+	num++;
+	while (num < *count && goal + num < end &&
+	       claim_block(sb_bgl_lock(EXT3_SB(sb), group), goal + num,
+			   bitmap_bh))
+		num++;
+	*count = num;
 	return goal;
 fail_access:
+	*count = num;
 	return -1;
 }
 
@@ -1021,10 +1034,11 @@ static int
 ext3_try_to_allocate_with_rsv(struct super_block *sb, handle_t *handle,
 			unsigned int group, struct buffer_head *bitmap_bh,
 			int goal, struct ext3_reserve_window_node * my_rsv,
-			int *errp)
+			unsigned long *count, int *errp)
 {
 	spinlock_t *rsv_lock;
 	unsigned long group_first_block;
+	unsigned long num = *count;
 	int ret = 0;
 	int fatal;
 
@@ -1049,7 +1063,8 @@ ext3_try_to_allocate_with_rsv(struct super_block *sb, handle_t *handle,
 	 * or last attempt to allocate a block with reservation turned on failed
 	 */
 	if (my_rsv == NULL ) {
-		ret = ext3_try_to_allocate(sb, handle, group, bitmap_bh, goal, NULL);
+		ret = ext3_try_to_allocate(sb, handle, group, bitmap_bh, goal,
+					   count, NULL);
 		goto out;
 	}
 	rsv_lock = &EXT3_SB(sb)->s_rsv_window_lock;
@@ -1076,7 +1091,13 @@ ext3_try_to_allocate_with_rsv(struct super_block *sb, handle_t *handle,
 	 * at the beginning with a goal and the goal is inside the window, or
 	 * we don't have a goal but already have a reservation window.
 	 * then we could go to allocate from the reservation window directly.
+	 *
+	 * A request for a run of blocks larger than the window grows the
+	 * window goal so the whole run can come out of one window.
 	 */
+	if (my_rsv->rsv_goal_size < num)
+		my_rsv->rsv_goal_size = min_t(unsigned long, num,
+					      EXT3_MAX_RESERVE_BLOCKS);
 	while (1) {
 		struct ext3_reserve_window rsv_copy;
 
@@ -1100,8 +1121,9 @@ ext3_try_to_allocate_with_rsv(struct super_block *sb, handle_t *handle,
 		if ((rsv_copy._rsv_start >= group_first_block + EXT3_BLOCKS_PER_GROUP(sb))
 		    || (rsv_copy._rsv_end < group_first_block))
 			BUG();
+		*count = num;
 		ret = ext3_try_to_allocate(sb, handle, group, bitmap_bh, goal,
-					   &rsv_copy);
+					   count, &rsv_copy);
 		if (ret >= 0) {
 			my_rsv->rsv_alloc_hit++;
 			break;				/* succeed */
@@ -1124,13 +1146,24 @@ out:
 	return ret;
 }
 
-static int ext3_has_free_blocks(struct ext3_sb_info *sbi)
+/*
+ * Blocks promised to delayed buffers (the "delalloc" mount option) are
+ * still free in the bitmaps, but s_dirtyblocks_counter keeps them from
+ * being handed out twice.
+ */
+static int ext3_has_free_blocks(struct ext3_sb_info *sbi, unsigned long nblocks)
 {
-	int free_blocks, root_blocks;
+	long free_blocks, dirty_blocks, root_blocks;
 
 	free_blocks = percpu_counter_read_positive(&sbi->s_freeblocks_counter);
+	dirty_blocks = percpu_counter_read(&sbi->s_dirtyblocks_counter);
+	if (dirty_blocks > 0)
+		free_blocks -= dirty_blocks;
 	root_blocks = le32_to_cpu(sbi->s_es->s_r_blocks_count);
-	if (free_blocks < root_blocks + 1 && !capable(CAP_SYS_RESOURCE) &&
+	if (free_blocks < (long)nblocks)
+		return 0;
+	if (free_blocks < root_blocks + (long)nblocks &&
+		!capable(CAP_SYS_RESOURCE) &&
 		sbi->s_resuid != current->fsuid &&
 		(sbi->s_resgid == 0 || !in_group_p (sbi->s_resgid))) {
 		return 0;
@@ -1138,6 +1171,26 @@ static int ext3_has_free_blocks(struct ext3_sb_info *sbi)
 	return 1;
 }
 
+/*
+ * ext3_claim_free_blocks() promises nblocks to a delayed allocation.
+ * The promise is turned back with ext3_release_free_blocks() just before
+ * the blocks are really allocated, or when the dirty data is thrown away.
+ */
+int ext3_claim_free_blocks(struct super_block *sb, unsigned long nblocks)
+{
+	struct ext3_sb_info *sbi = EXT3_SB(sb);
+
+	if (!ext3_has_free_blocks(sbi, nblocks))
+		return -ENOSPC;
+	percpu_counter_mod(&sbi->s_dirtyblocks_counter, nblocks);
+	return 0;
+}
+
+void ext3_release_free_blocks(struct super_block *sb, unsigned long nblocks)
+{
+	percpu_counter_mod(&EXT3_SB(sb)->s_dirtyblocks_counter, -(long)nblocks);
+}
+
 /*
  * ext3_should_retry_alloc() is called when ENOSPC is returned, and if
  * it is profitable to retry the operation, this function will wait
@@ -1146,7 +1199,7 @@ static int ext3_has_free_blocks(struct ext3_sb_info *sbi)
  */
 int ext3_should_retry_alloc(struct super_block *sb, int *retries)
 {
-	if (!ext3_has_free_blocks(EXT3_SB(sb)) || (*retries)++ > 3)
+	if (!ext3_has_free_blocks(EXT3_SB(sb), 1) || (*retries)++ > 3)
 		return 0;
 
 	jbd_debug(1, "%s: retrying operation after ENOSPC\n", sb->s_id);
@@ -1155,15 +1208,17 @@ int ext3_should_retry_alloc(struct super_block *sb, int *retries)
 }
 
 /*
- * ext3_new_block uses a goal block to assist allocation.  If the goal is
+ * ext3_new_blocks uses a goal block to assist allocation.  If the goal is
  * free, or there is a free block within 32 blocks of the goal, that block
  * is allocated.  Otherwise a forward search is made for a free block; within 
  * each block group the search first looks for an entire free byte in the block
  * bitmap, and then for any free bit if that fails.
+ * Up to *count blocks contiguous with the first one are allocated with it;
+ * the number actually allocated is returned in *count.
  * This function also updates quota and i_blocks field.
  */
-int ext3_new_block(handle_t *handle, struct inode *inode,
-			unsigned long goal, int *errp)
+int ext3_new_blocks(handle_t *handle, struct inode *inode,
+			unsigned long goal, unsigned long *count, int *errp)
 {
 	struct buffer_head *bitmap_bh = NULL;
 	struct buffer_head *gdp_bh;
@@ -1175,6 +1230,7 @@ int ext3_new_block(handle_t *handle, struct inode *inode,
 	int fatal = 0, err;
 	int performed_allocation = 0;
 	int free_blocks;
+	unsigned long num = *count;
 	struct super_block *sb;
 	struct ext3_group_desc *gdp;
 	struct ext3_super_block *es;
@@ -1195,9 +1251,9 @@ int ext3_new_block(handle_t *handle, struct inode *inode,
 	}
 
 	/*
-	 * Check quota for allocation of this block.
+	 * Check quota for allocation of these blocks.
 	 */
-	if (DQUOT_ALLOC_BLOCK(inode, 1)) {
+	if (DQUOT_ALLOC_BLOCK(inode, num)) {
 		*errp = -EDQUOT;
 		return 0;
 	}
@@ -1217,7 +1273,7 @@ int ext3_new_block(handle_t *handle, struct inode *inode,
 	if (block_i && ((windowsz = block_i->rsv_window_node.rsv_goal_size) > 0))
 		my_rsv = &block_i->rsv_window_node;
 
-	if (!ext3_has_free_blocks(sbi)) {
+	if (!ext3_has_free_blocks(sbi, 1)) {
 		*errp = -ENOSPC;
 		goto out;
 	}
@@ -1252,7 +1308,8 @@ retry:
 		if (!bitmap_bh)
 			goto io_error;
 		ret_block = ext3_try_to_allocate_with_rsv(sb, handle, group_no,
-					bitmap_bh, ret_block, my_rsv, &fatal);
+					bitmap_bh, ret_block, my_rsv, count,
+					&fatal);
 		if (fatal)
 			goto out;
 		if (ret_block >= 0)
@@ -1288,8 +1345,9 @@ retry:
 		bitmap_bh = read_block_bitmap(sb, group_no);
 		if (!bitmap_bh)
 			goto io_error;
+		*count = num;
 		ret_block = ext3_try_to_allocate_with_rsv(sb, handle, group_no,
-					bitmap_bh, -1, my_rsv, &fatal);
+					bitmap_bh, -1, my_rsv, count, &fatal);
 		if (fatal)
 			goto out;
 		if (ret_block >= 0) 
@@ -1305,6 +1363,7 @@ retry:
 	if (my_rsv) {
 		my_rsv = NULL;
 		group_no = goal_group;
+		*count = num;
 		goto retry;
 	}
 	/* No space left on the device */
@@ -1324,15 +1383,21 @@ allocated:
 	target_block = ret_block + group_no * EXT3_BLOCKS_PER_GROUP(sb)
 				+ le32_to_cpu(es->s_first_data_block);
 
-	if (target_block == le32_to_cpu(gdp->bg_block_bitmap) ||
-	    target_block == le32_to_cpu(gdp->bg_inode_bitmap) ||
+	if (in_range(le32_to_cpu(gdp->bg_block_bitmap), target_block, *count) ||
+	    in_range(le32_to_cpu(gdp->bg_inode_bitmap), target_block, *count) ||
 	    in_range(target_block, le32_to_cpu(gdp->bg_inode_table),
+		      EXT3_SB(sb)->s_itb_per_group) ||
+	    in_range(target_block + *count - 1,
+		      le32_to_cpu(gdp->bg_inode_table),
 		      EXT3_SB(sb)->s_itb_per_group))
 		ext3_error(sb, "ext3_new_block",
 			    "Allocating block in system zone - "
-			    "block = %u", target_block);
+			    "blocks from %u, length %lu", target_block, *count);
 
 	performed_allocation = 1;
+	/* Give back the quota for the part of the run we didn't get */
+	if (*count < num)
+		DQUOT_FREE_BLOCK(inode, num - *count);
 
 #ifdef CONFIG_JBD_DEBUG
 	{
@@ -1363,7 +1428,7 @@ allocated:
 	/* ret_block was blockgroup-relative.  Now it becomes fs-relative */
 	ret_block = target_block;
 
-	if (ret_block >= le32_to_cpu(es->s_blocks_count)) {
+	if (ret_block + *count - 1 >= le32_to_cpu(es->s_blocks_count)) {
 		ext3_error(sb, "ext3_new_block",
 			    "block(%d) >= blocks count(%d) - "
 			    "block_group = %d, es == %p ", ret_block,
@@ -1381,9 +1446,9 @@ allocated:
 
 	spin_lock(sb_bgl_lock(sbi, group_no));
 	gdp->bg_free_blocks_count =
-			cpu_to_le16(le16_to_cpu(gdp->bg_free_blocks_count) - 1);
+		cpu_to_le16(le16_to_cpu(gdp->bg_free_blocks_count) - *count);
 	spin_unlock(sb_bgl_lock(sbi, group_no));
-	percpu_counter_mod(&sbi->s_freeblocks_counter, -1);
+	percpu_counter_mod(&sbi->s_freeblocks_counter, -*count);
 
 	BUFFER_TRACE(gdp_bh, "journal_dirty_metadata for group descriptor");
 	err = ext3_journal_dirty_metadata(handle, gdp_bh);
@@ -1409,11 +1474,19 @@ out:
 	 * Undo the block allocation
 	 */
 	if (!performed_allocation)
-		DQUOT_FREE_BLOCK(inode, 1);
+		DQUOT_FREE_BLOCK(inode, num);
 	brelse(bitmap_bh);
 	return 0;
 }
 
+int ext3_new_block(handle_t *handle, struct inode *inode,
+			unsigned long goal, int *errp)
+{
+	unsigned long count = 1;
+
+	return ext3_new_blocks(handle, inode, goal, &count, errp);
+}
+
 unsigned long ext3_count_free_blocks(struct super_block *sb)
 {
 	unsigned long desc_count;
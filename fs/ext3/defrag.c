@@ -0,0 +1,296 @@
+/*
+ *  linux/fs/ext3/defrag.c
+ *
+ * Online defragmentation of regular files.
+ *
+ * EXT3_IOC_DEFRAG walks a file in chunks.  For each chunk which is
+ * scattered on disk, a contiguous run is allocated through the inode's
+ * block reservation window, the data is written to it from the page
+ * cache, and the block mapping is switched over to the new run in the
+ * same handle that frees the old blocks.  Until that handle commits the
+ * old mapping and the old blocks stay valid, so a crash leaves the file
+ * either entirely before or entirely after the move of a chunk.
+ *
+ * i_sem keeps writers and truncate out, i_alloc_sem direct I/O.  The
+ * pages of a chunk are kept locked from before the mapping is looked at
+ * until the switch, so neither readpage nor writepage can see blocks in
+ * transit.  truncate_sem is taken under the page locks and the handle,
+ * in the same order ext3_writepage() takes them.
+ */
+
+#include <linux/config.h>
+#include <linux/fs.h>
+#include <linux/time.h>
+#include <linux/ext3_jbd.h>
+#include <linux/jbd.h>
+#include <linux/pagemap.h>
+#include <linux/buffer_head.h>
+#include <linux/sched.h>
+
+/* Blocks moved per handle; each may cost two credits to free */
+#define EXT3_DEFRAG_CHUNK	64
+#define EXT3_DEFRAG_MAX_PAGES	(EXT3_DEFRAG_CHUNK + 1)
+
+static int ext3_defrag_credits(struct inode *inode, unsigned long count)
+{
+	struct super_block *sb = inode->i_sb;
+
+	/* bitmaps and group descriptors of the new run and of the old blocks */
+	return 2 * (count / EXT3_BLOCKS_PER_GROUP(sb) + 2) + 2 * count +
+		/* pointer blocks or the leaf, and the inode */
+		count / EXT3_ADDR_PER_BLOCK(sb) + 2 + 1 +
+		2 * EXT3_QUOTA_TRANS_BLOCKS;
+}
+
+static void ext3_defrag_unlock_pages(struct page **pages, int nr_pages)
+{
+	int i;
+
+	for (i = 0; i < nr_pages; i++) {
+		unlock_page(pages[i]);
+		page_cache_release(pages[i]);
+	}
+}
+
+/* Read in and lock the pages covering @count blocks from @iblock */
+static int ext3_defrag_lock_pages(struct file *filp, unsigned long iblock,
+				  unsigned long count, struct page **pages,
+				  int *nr_pages)
+{
+	struct address_space *mapping = filp->f_mapping;
+	struct inode *inode = mapping->host;
+	int shift = PAGE_CACHE_SHIFT - inode->i_blkbits;
+	pgoff_t index = iblock >> shift;
+	pgoff_t last = (iblock + count - 1) >> shift;
+	struct page *page;
+
+	*nr_pages = 0;
+	for (; index <= last; index++) {
+		page = read_cache_page(mapping, index,
+				(filler_t *)mapping->a_ops->readpage, filp);
+		if (IS_ERR(page))
+			goto failed;
+		lock_page(page);
+		if (!PageUptodate(page) || page->mapping != mapping) {
+			unlock_page(page);
+			page_cache_release(page);
+			page = ERR_PTR(-EIO);
+			goto failed;
+		}
+		wait_on_page_writeback(page);
+		if (!page_has_buffers(page))
+			create_empty_buffers(page, inode->i_sb->s_blocksize, 0);
+		pages[(*nr_pages)++] = page;
+	}
+	return 0;
+
+failed:
+	ext3_defrag_unlock_pages(pages, *nr_pages);
+	*nr_pages = 0;
+	return PTR_ERR(page);
+}
+
+/*
+ * Point the buffers of @count blocks from @iblock at the new run and
+ * write them out.  On failure the buffers are left unmapped and dirty,
+ * so the next writepage maps them back to the old blocks.
+ */
+static int ext3_defrag_write(struct inode *inode, struct page **pages,
+			     unsigned long iblock, unsigned long count,
+			     unsigned long newblock)
+{
+	struct super_block *sb = inode->i_sb;
+	struct buffer_head *bhs[EXT3_DEFRAG_CHUNK];
+	struct buffer_head *head, *bh;
+	unsigned long block;
+	int shift = PAGE_CACHE_SHIFT - inode->i_blkbits;
+	int i, n = 0, err = 0;
+
+	for (i = 0; n < count; i++) {
+		block = pages[i]->index << shift;
+		head = bh = page_buffers(pages[i]);
+		do {
+			if (block < iblock || block >= iblock + count)
+				continue;
+			/* waits for writeback to the old block as well */
+			lock_buffer(bh);
+			map_bh(bh, sb, newblock + block - iblock);
+			unmap_underlying_metadata(bh->b_bdev, bh->b_blocknr);
+			set_buffer_uptodate(bh);
+			clear_buffer_dirty(bh);
+			get_bh(bh);
+			bh->b_end_io = end_buffer_write_sync;
+			submit_bh(WRITE, bh);
+			bhs[n++] = bh;
+		} while (block++, (bh = bh->b_this_page) != head);
+	}
+
+	for (i = 0; i < n; i++) {
+		wait_on_buffer(bhs[i]);
+		if (!buffer_uptodate(bhs[i]))
+			err = -EIO;
+	}
+	if (err) {
+		for (i = 0; i < n; i++) {
+			lock_buffer(bhs[i]);
+			clear_buffer_mapped(bhs[i]);
+			set_buffer_uptodate(bhs[i]);
+			unlock_buffer(bhs[i]);
+			mark_buffer_dirty(bhs[i]);
+		}
+	}
+	return err;
+}
+
+/*
+ * Move one chunk of at most @count blocks from @iblock.  *@next is where
+ * the following chunk starts, *@goal where its new run should go.
+ */
+static int ext3_defrag_chunk(struct file *filp, unsigned long iblock,
+			     unsigned long count, unsigned long *next,
+			     unsigned long *goal, unsigned long *moved)
+{
+	struct inode *inode = filp->f_dentry->d_inode;
+	struct ext3_inode_info *ei = EXT3_I(inode);
+	struct page *pages[EXT3_DEFRAG_MAX_PAGES];
+	unsigned long len, min, newblock;
+	handle_t *handle;
+	int nr_pages, ret, err;
+
+	*next = iblock + count;
+	err = ext3_defrag_lock_pages(filp, iblock, count, pages, &nr_pages);
+	if (err)
+		return err;
+
+	handle = ext3_journal_start(inode, ext3_defrag_credits(inode, count));
+	if (IS_ERR(handle)) {
+		err = PTR_ERR(handle);
+		goto out_unlock;
+	}
+
+	down(&ei->truncate_sem);
+	if (ei->i_flags & EXT3_EXTENTS_FL)
+		ret = ext3_ext_defrag_plan(inode, iblock, count, next, &min,
+					   goal);
+	else
+		ret = ext3_ind_defrag_plan(inode, iblock, count, next, &min,
+					   goal);
+	if (ret <= 0) {
+		err = ret;
+		goto out_stop;
+	}
+
+	if (!ei->i_block_alloc_info)
+		ext3_init_block_alloc_info(inode);
+	len = ret;
+	newblock = ext3_new_blocks(handle, inode, *goal, &len, &err);
+	if (!newblock)
+		goto out_stop;
+	if (len < min) {
+		/* no better than what we have, try again after it */
+		ext3_free_blocks(handle, inode, newblock, len);
+		*next = iblock + min - 1;
+		goto out_stop;
+	}
+
+	err = ext3_defrag_write(inode, pages, iblock, len, newblock);
+	if (err) {
+		ext3_free_blocks(handle, inode, newblock, len);
+		goto out_stop;
+	}
+
+	if (ei->i_flags & EXT3_EXTENTS_FL)
+		err = ext3_ext_remap_blocks(handle, inode, iblock, len,
+					    newblock);
+	else
+		err = ext3_ind_remap_blocks(handle, inode, iblock, len,
+					    newblock);
+	if (!err) {
+		*next = iblock + len;
+		*goal = newblock + len;
+		*moved += len;
+	}
+
+out_stop:
+	up(&ei->truncate_sem);
+	ret = ext3_journal_stop(handle);
+	if (!err)
+		err = ret;
+out_unlock:
+	ext3_defrag_unlock_pages(pages, nr_pages);
+	return err;
+}
+
+int ext3_defrag(struct file *filp, struct ext3_defrag_range *range)
+{
+	struct inode *inode = filp->f_dentry->d_inode;
+	struct ext3_inode_info *ei = EXT3_I(inode);
+	struct ext3_reserve_window_node *rsv;
+	unsigned long iblock, end, next, goal = 0, moved = 0;
+	__u32 rsv_goal_size;
+	int err;
+
+	range->moved = 0;
+	if (!S_ISREG(inode->i_mode))
+		return -EINVAL;
+	if (IS_IMMUTABLE(inode) || IS_APPEND(inode))
+		return -EPERM;
+	/* the data would have to go through the journal */
+	if (ext3_should_journal_data(inode))
+		return -EOPNOTSUPP;
+
+	down(&inode->i_sem);
+	down_write(&inode->i_alloc_sem);
+
+	/* have delayed and dirty data allocated and on disk first */
+	err = filemap_write_and_wait(inode->i_mapping);
+	if (err)
+		goto out;
+
+	iblock = range->start;
+	end = (i_size_read(inode) + inode->i_sb->s_blocksize - 1) >>
+		inode->i_blkbits;
+	if (iblock >= end)
+		goto out;
+	if (range->len && range->len < end - iblock)
+		end = iblock + range->len;
+
+	/* ask the reservation code for a window that fits the whole range */
+	down(&ei->truncate_sem);
+	if (!ei->i_block_alloc_info)
+		ext3_init_block_alloc_info(inode);
+	rsv = NULL;
+	if (ei->i_block_alloc_info) {
+		rsv = &ei->i_block_alloc_info->rsv_window_node;
+		rsv_goal_size = rsv->rsv_goal_size;
+		rsv->rsv_goal_size = min_t(unsigned long, end - iblock,
+					   EXT3_MAX_RESERVE_BLOCKS);
+	}
+	up(&ei->truncate_sem);
+
+	while (iblock < end) {
+		err = ext3_defrag_chunk(filp, iblock,
+				min_t(unsigned long, end - iblock,
+				      EXT3_DEFRAG_CHUNK),
+				&next, &goal, &moved);
+		if (err)
+			break;
+		iblock = next;
+		if (signal_pending(current)) {
+			err = -EINTR;
+			break;
+		}
+		cond_resched();
+	}
+
+	if (rsv) {
+		down(&ei->truncate_sem);
+		rsv->rsv_goal_size = rsv_goal_size;
+		up(&ei->truncate_sem);
+	}
+out:
+	up_write(&inode->i_alloc_sem);
+	up(&inode->i_sem);
+	range->moved = moved;
+	return err;
+}
@@ -430,7 +430,6 @@ static int ext3_dx_readdir(struct file * filp,
 			 void * dirent, filldir_t filldir)
 {
 	struct dir_private_info *info = filp->private_data;
-	struct inode *inode = filp->f_dentry->d_inode;
 	struct fname *fname;
 	int	ret;
 
@@ -466,15 +465,15 @@ static int ext3_dx_readdir(struct file * filp,
 
 	while (1) {
 		/*
-		 * Fill the rbtree if we have no more entries,
-		 * or the inode has changed since we last read in the
-		 * cached entries. 
+		 * Fill the rbtree if we have no more entries.  Names
+		 * created or removed after we cached a leaf may or may
+		 * not be reported, which POSIX allows; throwing the
+		 * cache away on every change of the directory would
+		 * make each getdents() on a busy directory re-read and
+		 * re-hash the current leaf.
 		 */
-		if ((!info->curr_node) ||
-		    (filp->f_version != inode->i_version)) {
-			info->curr_node = NULL;
+		if (!info->curr_node) {
 			free_rb_tree_fname(&info->root);
-			filp->f_version = inode->i_version;
 			ret = ext3_htree_fill_tree(filp, info->curr_hash,
 						   info->curr_minor_hash,
 						   &info->next_hash);
@@ -0,0 +1,1400 @@
+/*
+ *  linux/fs/ext3/extents.c
+ *
+ * Extent based block mapping for regular files.
+ *
+ * The tree is a B-tree keyed by logical block.  Its root sits in i_data,
+ * see include/linux/ext3_extents.h for the layout.  Lookups and changes
+ * to the tree are serialised by truncate_sem, the same way the indirect
+ * tree is protected against ext3_truncate().
+ *
+ * Blocks are only ever added by ext3_ext_get_blocks() and only removed
+ * from the end of the file by ext3_ext_truncate(), which keeps both the
+ * insert and the remove side simple: there is never a hole punched in
+ * the middle of an extent.  Online defragmentation moves blocks with
+ * ext3_ext_remap_blocks(), which only rewrites extents inside one leaf
+ * and never changes its first key.
+ *
+ * fallocate() fills holes with uninitialized extents: they own their
+ * blocks but read back as zeroes, and the first write into them turns
+ * the written part into an ordinary extent.
+ */
+
+#include <linux/config.h>
+#include <linux/fs.h>
+#include <linux/time.h>
+#include <linux/ext3_jbd.h>
+#include <linux/jbd.h>
+#include <linux/smp_lock.h>
+#include <linux/highuid.h>
+#include <linux/quotaops.h>
+#include <linux/string.h>
+#include <linux/slab.h>
+#include <linux/falloc.h>
+#include <linux/ext3_extents.h>
+
+static inline struct ext3_extent_header *ext_inode_hdr(struct inode *inode)
+{
+	return (struct ext3_extent_header *) EXT3_I(inode)->i_data;
+}
+
+static inline struct ext3_extent_header *ext_block_hdr(struct buffer_head *bh)
+{
+	return (struct ext3_extent_header *) bh->b_data;
+}
+
+static inline unsigned short ext_depth(struct inode *inode)
+{
+	return le16_to_cpu(ext_inode_hdr(inode)->eh_depth);
+}
+
+static inline int ext3_ext_space_block(struct inode *inode)
+{
+	return (inode->i_sb->s_blocksize - sizeof(struct ext3_extent_header))
+			/ sizeof(struct ext3_extent);
+}
+
+static inline int ext3_ext_space_block_idx(struct inode *inode)
+{
+	return (inode->i_sb->s_blocksize - sizeof(struct ext3_extent_header))
+			/ sizeof(struct ext3_extent_idx);
+}
+
+static inline int ext3_ext_space_root(struct inode *inode)
+{
+	return (sizeof(EXT3_I(inode)->i_data) -
+		sizeof(struct ext3_extent_header)) / sizeof(struct ext3_extent);
+}
+
+static inline int ext3_ext_space_root_idx(struct inode *inode)
+{
+	return (sizeof(EXT3_I(inode)->i_data) -
+		sizeof(struct ext3_extent_header))
+			/ sizeof(struct ext3_extent_idx);
+}
+
+static int ext3_ext_check_header(struct inode *inode,
+				 struct ext3_extent_header *eh, int depth)
+{
+	const char *error_msg;
+	int max;
+
+	if (eh == ext_inode_hdr(inode))
+		max = depth ? ext3_ext_space_root_idx(inode) :
+			      ext3_ext_space_root(inode);
+	else
+		max = depth ? ext3_ext_space_block_idx(inode) :
+			      ext3_ext_space_block(inode);
+
+	if (le16_to_cpu(eh->eh_magic) != EXT3_EXT_MAGIC) {
+		error_msg = "invalid magic";
+		goto corrupted;
+	}
+	if (le16_to_cpu(eh->eh_depth) != depth ||
+	    depth > EXT3_EXT_MAX_DEPTH) {
+		error_msg = "unexpected eh_depth";
+		goto corrupted;
+	}
+	if (eh->eh_max == 0 || le16_to_cpu(eh->eh_max) > max) {
+		error_msg = "invalid eh_max";
+		goto corrupted;
+	}
+	/* an empty index is only legal in the root, mid truncate */
+	if (le16_to_cpu(eh->eh_entries) > le16_to_cpu(eh->eh_max) ||
+	    (depth && eh->eh_entries == 0 && eh != ext_inode_hdr(inode))) {
+		error_msg = "invalid eh_entries";
+		goto corrupted;
+	}
+	return 0;
+
+corrupted:
+	ext3_error(inode->i_sb, "ext3_ext_check_header",
+		   "bad header in inode #%lu: %s - magic %x, "
+		   "entries %u, max %u(%u), depth %u(%u)",
+		   inode->i_ino, error_msg, le16_to_cpu(eh->eh_magic),
+		   le16_to_cpu(eh->eh_entries), le16_to_cpu(eh->eh_max),
+		   max, le16_to_cpu(eh->eh_depth), depth);
+	return -EIO;
+}
+
+/*
+ * The root is written out with the inode, every other level is a
+ * journalled metadata block.
+ */
+static int ext3_ext_get_access(handle_t *handle, struct inode *inode,
+			       struct ext3_ext_path *path)
+{
+	if (path->p_bh)
+		return ext3_journal_get_write_access(handle, path->p_bh);
+	return 0;
+}
+
+static int ext3_ext_dirty(handle_t *handle, struct inode *inode,
+			  struct ext3_ext_path *path)
+{
+	if (path->p_bh)
+		return ext3_journal_dirty_metadata(handle, path->p_bh);
+	return ext3_mark_inode_dirty(handle, inode);
+}
+
+static void ext3_ext_drop_refs(struct ext3_ext_path *path)
+{
+	int depth = path->p_depth;
+	int i;
+
+	for (i = 0; i <= depth; i++, path++) {
+		if (path->p_bh) {
+			brelse(path->p_bh);
+			path->p_bh = NULL;
+		}
+	}
+}
+
+/*
+ * Pick the index entry covering @block: the last one whose key is not
+ * above it.  Blocks left of the first key go to the first entry.
+ */
+static void ext3_ext_binsearch_idx(struct ext3_ext_path *path,
+				   unsigned long block)
+{
+	struct ext3_extent_header *eh = path->p_hdr;
+	struct ext3_extent_idx *l, *r, *m;
+
+	l = EXT_FIRST_INDEX(eh) + 1;
+	r = EXT_LAST_INDEX(eh);
+	while (l <= r) {
+		m = l + (r - l) / 2;
+		if (block < le32_to_cpu(m->ei_block))
+			r = m - 1;
+		else
+			l = m + 1;
+	}
+	path->p_idx = l - 1;
+}
+
+/* Same for a leaf, which may be empty if it is the root */
+static void ext3_ext_binsearch(struct ext3_ext_path *path,
+			       unsigned long block)
+{
+	struct ext3_extent_header *eh = path->p_hdr;
+	struct ext3_extent *l, *r, *m;
+
+	if (eh->eh_entries == 0)
+		return;
+
+	l = EXT_FIRST_EXTENT(eh) + 1;
+	r = EXT_LAST_EXTENT(eh);
+	while (l <= r) {
+		m = l + (r - l) / 2;
+		if (block < le32_to_cpu(m->ee_block))
+			r = m - 1;
+		else
+			l = m + 1;
+	}
+	path->p_ext = l - 1;
+}
+
+int ext3_ext_tree_init(handle_t *handle, struct inode *inode)
+{
+	struct ext3_extent_header *eh = ext_inode_hdr(inode);
+
+	eh->eh_depth = 0;
+	eh->eh_entries = 0;
+	eh->eh_magic = cpu_to_le16(EXT3_EXT_MAGIC);
+	eh->eh_max = cpu_to_le16(ext3_ext_space_root(inode));
+	eh->eh_generation = 0;
+	return ext3_mark_inode_dirty(handle, inode);
+}
+
+/*
+ * Walk from the root to the leaf that should hold @block.  A @path
+ * passed in must have room for one level more than it was filled for
+ * and must have had its references dropped; it stays owned by the
+ * caller even on failure.  A NULL @path gets a fresh array sized for a
+ * tree that grows by one level.
+ */
+static struct ext3_ext_path *
+ext3_ext_find_extent(struct inode *inode, unsigned long block,
+		     struct ext3_ext_path *path)
+{
+	struct ext3_extent_header *eh;
+	struct ext3_ext_path *apath = NULL;
+	struct buffer_head *bh;
+	int depth, i, ppos = 0;
+
+	eh = ext_inode_hdr(inode);
+	depth = ext_depth(inode);
+	if (ext3_ext_check_header(inode, eh, depth))
+		return ERR_PTR(-EIO);
+
+	if (!path) {
+		path = apath = kmalloc(sizeof(struct ext3_ext_path) *
+				       (depth + 2), GFP_NOFS);
+		if (!path)
+			return ERR_PTR(-ENOMEM);
+	}
+	memset(path, 0, sizeof(struct ext3_ext_path) * (depth + 1));
+	path[0].p_hdr = eh;
+	path[0].p_depth = depth;
+
+	for (i = depth; i > 0; i--) {
+		/* only a root left behind by an interrupted truncate */
+		if (path[ppos].p_hdr->eh_entries == 0)
+			goto err;
+		ext3_ext_binsearch_idx(path + ppos, block);
+		path[ppos].p_block = le32_to_cpu(path[ppos].p_idx->ei_leaf);
+
+		bh = sb_bread(inode->i_sb, path[ppos].p_block);
+		if (!bh)
+			goto err;
+		ppos++;
+		path[ppos].p_bh = bh;
+		path[ppos].p_hdr = eh = ext_block_hdr(bh);
+		if (ext3_ext_check_header(inode, eh, i - 1))
+			goto err;
+	}
+	ext3_ext_binsearch(path + ppos, block);
+	return path;
+
+err:
+	ext3_ext_drop_refs(path);
+	kfree(apath);
+	return ERR_PTR(-EIO);
+}
+
+/* Logical block of the first extent to the right of the path, if any */
+static unsigned long ext3_ext_next_allocated_block(struct ext3_ext_path *path)
+{
+	int depth = path->p_depth;
+	int i;
+
+	for (i = depth; i >= 0; i--) {
+		if (i == depth) {
+			if (path[i].p_ext &&
+			    path[i].p_ext != EXT_LAST_EXTENT(path[i].p_hdr))
+				return le32_to_cpu(path[i].p_ext[1].ee_block);
+		} else if (path[i].p_idx != EXT_LAST_INDEX(path[i].p_hdr)) {
+			return le32_to_cpu(path[i].p_idx[1].ei_block);
+		}
+	}
+	return EXT_MAX_BLOCK;
+}
+
+/*
+ * Place new blocks right behind the extent we are next to, or near the
+ * tree block holding it, else in the inode's group as ext3_find_near()
+ * does.
+ */
+static unsigned long ext3_ext_find_goal(struct inode *inode,
+					struct ext3_ext_path *path,
+					unsigned long block)
+{
+	struct ext3_inode_info *ei = EXT3_I(inode);
+	struct ext3_extent *ex;
+	unsigned long bg_start;
+	unsigned long colour;
+	int depth = path->p_depth;
+
+	ex = path[depth].p_ext;
+	if (ex) {
+		unsigned long ee_block = le32_to_cpu(ex->ee_block);
+		unsigned long ee_start = le32_to_cpu(ex->ee_start);
+
+		if (block > ee_block)
+			return ee_start + (block - ee_block);
+		return ee_start - (ee_block - block);
+	}
+
+	if (path[depth].p_bh)
+		return path[depth].p_bh->b_blocknr;
+
+	bg_start = (ei->i_block_group * EXT3_BLOCKS_PER_GROUP(inode->i_sb)) +
+		le32_to_cpu(EXT3_SB(inode->i_sb)->s_es->s_first_data_block);
+	colour = (current->pid % 16) *
+			(EXT3_BLOCKS_PER_GROUP(inode->i_sb) / 16);
+	return bg_start + colour + block;
+}
+
+static unsigned long ext3_ext_new_block(handle_t *handle, struct inode *inode,
+					struct ext3_ext_path *path,
+					struct ext3_extent *ex, int *err)
+{
+	unsigned long goal;
+
+	goal = ext3_ext_find_goal(inode, path, le32_to_cpu(ex->ee_block));
+	return ext3_new_block(handle, inode, goal, err);
+}
+
+static inline int ext3_can_extents_be_merged(struct ext3_extent *ex1,
+					     struct ext3_extent *ex2)
+{
+	unsigned long len1 = ext3_ext_get_len(ex1);
+	unsigned long max = EXT3_EXT_MAX_LEN;
+
+	if (ext3_ext_is_uninit(ex1) != ext3_ext_is_uninit(ex2))
+		return 0;
+	if (ext3_ext_is_uninit(ex1))
+		max = EXT3_EXT_UNINIT_MAX_LEN;
+	if (le32_to_cpu(ex1->ee_block) + len1 != le32_to_cpu(ex2->ee_block))
+		return 0;
+	if (len1 + ext3_ext_get_len(ex2) > max)
+		return 0;
+	return le32_to_cpu(ex1->ee_start) + len1 == le32_to_cpu(ex2->ee_start);
+}
+
+/*
+ * Merge @ex into the extent before it if they are contiguous, then the
+ * extents after it into the result.  The first entry of the leaf is
+ * never removed, so no key changes.  Returns the extent now covering
+ * the blocks of @ex.
+ */
+static struct ext3_extent *ext3_ext_try_to_merge(struct ext3_extent_header *eh,
+						 struct ext3_extent *ex)
+{
+	int len;
+
+	if (ex > EXT_FIRST_EXTENT(eh) && ext3_can_extents_be_merged(ex - 1, ex))
+		ex--;
+	while (ex < EXT_LAST_EXTENT(eh) &&
+	       ext3_can_extents_be_merged(ex, ex + 1)) {
+		ext3_ext_set_len(ex, ext3_ext_get_len(ex) +
+				     ext3_ext_get_len(ex + 1),
+				 ext3_ext_is_uninit(ex));
+		len = EXT_LAST_EXTENT(eh) - ex - 1;
+		if (len > 0)
+			memmove(ex + 1, ex + 2,
+				len * sizeof(struct ext3_extent));
+		eh->eh_entries = cpu_to_le16(le16_to_cpu(eh->eh_entries) - 1);
+	}
+	return ex;
+}
+
+/*
+ * The first key of a node is the key of its entry in the parent.  When
+ * the first extent of a leaf changes, walk up and fix every parent key
+ * for which this subtree is the leftmost one.
+ */
+static int ext3_ext_correct_indexes(handle_t *handle, struct inode *inode,
+				    struct ext3_ext_path *path)
+{
+	int depth = ext_depth(inode);
+	struct ext3_extent_header *eh = path[depth].p_hdr;
+	__le32 border;
+	int k, err;
+
+	if (depth == 0 || path[depth].p_ext != EXT_FIRST_EXTENT(eh))
+		return 0;
+
+	border = path[depth].p_ext->ee_block;
+	for (k = depth - 1; k >= 0; k--) {
+		if (path[k].p_idx->ei_block == border)
+			break;
+		err = ext3_ext_get_access(handle, inode, path + k);
+		if (err)
+			return err;
+		path[k].p_idx->ei_block = border;
+		err = ext3_ext_dirty(handle, inode, path + k);
+		if (err)
+			return err;
+		if (path[k].p_idx != EXT_FIRST_INDEX(path[k].p_hdr))
+			break;
+	}
+	return 0;
+}
+
+static int ext3_ext_insert_index(handle_t *handle, struct inode *inode,
+				 struct ext3_ext_path *curp,
+				 unsigned long logical, unsigned long ptr)
+{
+	struct ext3_extent_idx *ix;
+	int len, err;
+
+	err = ext3_ext_get_access(handle, inode, curp);
+	if (err)
+		return err;
+
+	if (logical > le32_to_cpu(curp->p_idx->ei_block))
+		ix = curp->p_idx + 1;
+	else
+		ix = curp->p_idx;
+
+	len = EXT_LAST_INDEX(curp->p_hdr) - ix + 1;
+	if (len > 0)
+		memmove(ix + 1, ix, len * sizeof(struct ext3_extent_idx));
+	ix->ei_block = cpu_to_le32(logical);
+	ix->ei_leaf = cpu_to_le32(ptr);
+	ix->ei_leaf_hi = 0;
+	ix->ei_unused = 0;
+	curp->p_hdr->eh_entries =
+		cpu_to_le16(le16_to_cpu(curp->p_hdr->eh_entries) + 1);
+
+	return ext3_ext_dirty(handle, inode, curp);
+}
+
+/*
+ * Split the full levels below @at, which still has a free index slot.
+ * Everything right of the insertion point moves to a fresh chain of
+ * blocks hung off a new entry in level @at, so afterwards either the
+ * old leaf or the new one has room for @newext.
+ */
+static int ext3_ext_split(handle_t *handle, struct inode *inode,
+			  struct ext3_ext_path *path,
+			  struct ext3_extent *newext, int at)
+{
+	struct buffer_head *bh = NULL;
+	int depth = ext_depth(inode);
+	struct ext3_extent_header *neh;
+	struct ext3_extent_idx *fidx;
+	unsigned long newblock, oldblock;
+	unsigned long *ablocks;
+	__le32 border;
+	int i, k, m, a;
+	int err = 0;
+
+	if (path[depth].p_ext != EXT_LAST_EXTENT(path[depth].p_hdr))
+		border = path[depth].p_ext[1].ee_block;
+	else
+		border = newext->ee_block;
+
+	ablocks = kmalloc(sizeof(unsigned long) * depth, GFP_NOFS);
+	if (!ablocks)
+		return -ENOMEM;
+	memset(ablocks, 0, sizeof(unsigned long) * depth);
+
+	/* allocate all the blocks up front, the tree is untouched on failure */
+	for (a = 0; a < depth - at; a++) {
+		newblock = ext3_ext_new_block(handle, inode, path, newext, &err);
+		if (newblock == 0)
+			goto cleanup;
+		ablocks[a] = newblock;
+	}
+
+	/* the new leaf gets the extents right of the insertion point */
+	newblock = ablocks[--a];
+	bh = sb_getblk(inode->i_sb, newblock);
+	if (!bh) {
+		err = -EIO;
+		goto cleanup;
+	}
+	lock_buffer(bh);
+	err = ext3_journal_get_create_access(handle, bh);
+	if (err)
+		goto cleanup;
+
+	neh = ext_block_hdr(bh);
+	memset(bh->b_data, 0, bh->b_size);
+	neh->eh_magic = cpu_to_le16(EXT3_EXT_MAGIC);
+	neh->eh_max = cpu_to_le16(ext3_ext_space_block(inode));
+	m = EXT_LAST_EXTENT(path[depth].p_hdr) - path[depth].p_ext;
+	if (m) {
+		memmove(EXT_FIRST_EXTENT(neh), path[depth].p_ext + 1,
+			sizeof(struct ext3_extent) * m);
+		neh->eh_entries = cpu_to_le16(m);
+	}
+	set_buffer_uptodate(bh);
+	unlock_buffer(bh);
+	err = ext3_journal_dirty_metadata(handle, bh);
+	if (err)
+		goto cleanup;
+	brelse(bh);
+	bh = NULL;
+
+	if (m) {
+		err = ext3_ext_get_access(handle, inode, path + depth);
+		if (err)
+			goto cleanup;
+		path[depth].p_hdr->eh_entries =
+			cpu_to_le16(le16_to_cpu(path[depth].p_hdr->eh_entries) - m);
+		err = ext3_ext_dirty(handle, inode, path + depth);
+		if (err)
+			goto cleanup;
+	}
+
+	/* and each full index level gets a new node pointing down the chain */
+	k = depth - at - 1;
+	i = depth - 1;
+	while (k--) {
+		oldblock = newblock;
+		newblock = ablocks[--a];
+		bh = sb_getblk(inode->i_sb, newblock);
+		if (!bh) {
+			err = -EIO;
+			goto cleanup;
+		}
+		lock_buffer(bh);
+		err = ext3_journal_get_create_access(handle, bh);
+		if (err)
+			goto cleanup;
+
+		neh = ext_block_hdr(bh);
+		memset(bh->b_data, 0, bh->b_size);
+		neh->eh_magic = cpu_to_le16(EXT3_EXT_MAGIC);
+		neh->eh_max = cpu_to_le16(ext3_ext_space_block_idx(inode));
+		neh->eh_depth = cpu_to_le16(depth - i);
+		neh->eh_entries = cpu_to_le16(1);
+		fidx = EXT_FIRST_INDEX(neh);
+		fidx->ei_block = border;
+		fidx->ei_leaf = cpu_to_le32(oldblock);
+
+		m = EXT_LAST_INDEX(path[i].p_hdr) - path[i].p_idx;
+		if (m) {
+			memmove(fidx + 1, path[i].p_idx + 1,
+				sizeof(struct ext3_extent_idx) * m);
+			neh->eh_entries = cpu_to_le16(1 + m);
+		}
+		set_buffer_uptodate(bh);
+		unlock_buffer(bh);
+		err = ext3_journal_dirty_metadata(handle, bh);
+		if (err)
+			goto cleanup;
+		brelse(bh);
+		bh = NULL;
+
+		if (m) {
+			err = ext3_ext_get_access(handle, inode, path + i);
+			if (err)
+				goto cleanup;
+			path[i].p_hdr->eh_entries =
+				cpu_to_le16(le16_to_cpu(path[i].p_hdr->eh_entries) - m);
+			err = ext3_ext_dirty(handle, inode, path + i);
+			if (err)
+				goto cleanup;
+		}
+		i--;
+	}
+
+	err = ext3_ext_insert_index(handle, inode, path + at,
+				    le32_to_cpu(border), newblock);
+
+cleanup:
+	if (bh) {
+		if (buffer_locked(bh))
+			unlock_buffer(bh);
+		brelse(bh);
+	}
+	if (err) {
+		for (i = 0; i < depth; i++)
+			if (ablocks[i])
+				ext3_free_blocks(handle, inode, ablocks[i], 1);
+	}
+	kfree(ablocks);
+	return err;
+}
+
+/*
+ * Every level is full: move the root into a new block and make the
+ * root a one entry index above it.
+ */
+static int ext3_ext_grow_indepth(handle_t *handle, struct inode *inode,
+				 struct ext3_ext_path *path,
+				 struct ext3_extent *newext)
+{
+	struct ext3_extent_header *neh;
+	struct ext3_extent_idx *fidx;
+	struct buffer_head *bh;
+	unsigned long newblock;
+	int err = 0;
+
+	if (ext_depth(inode) >= EXT3_EXT_MAX_DEPTH) {
+		ext3_error(inode->i_sb, "ext3_ext_grow_indepth",
+			   "extent tree of inode #%lu too deep", inode->i_ino);
+		return -EIO;
+	}
+
+	newblock = ext3_ext_new_block(handle, inode, path, newext, &err);
+	if (newblock == 0)
+		return err;
+
+	bh = sb_getblk(inode->i_sb, newblock);
+	if (!bh) {
+		ext3_free_blocks(handle, inode, newblock, 1);
+		return -EIO;
+	}
+	lock_buffer(bh);
+	err = ext3_journal_get_create_access(handle, bh);
+	if (err) {
+		unlock_buffer(bh);
+		goto out;
+	}
+
+	memset(bh->b_data, 0, bh->b_size);
+	memcpy(bh->b_data, path[0].p_hdr, sizeof(EXT3_I(inode)->i_data));
+	neh = ext_block_hdr(bh);
+	if (ext_depth(inode))
+		neh->eh_max = cpu_to_le16(ext3_ext_space_block_idx(inode));
+	else
+		neh->eh_max = cpu_to_le16(ext3_ext_space_block(inode));
+	set_buffer_uptodate(bh);
+	unlock_buffer(bh);
+
+	err = ext3_journal_dirty_metadata(handle, bh);
+	if (err)
+		goto out;
+
+	/* ei_block and ee_block sit at the same offset */
+	neh = path[0].p_hdr;
+	fidx = EXT_FIRST_INDEX(neh);
+	fidx->ei_block = EXT_FIRST_EXTENT(neh)->ee_block;
+	fidx->ei_leaf = cpu_to_le32(newblock);
+	fidx->ei_leaf_hi = 0;
+	fidx->ei_unused = 0;
+	neh->eh_entries = cpu_to_le16(1);
+	neh->eh_max = cpu_to_le16(ext3_ext_space_root_idx(inode));
+	neh->eh_depth = cpu_to_le16(le16_to_cpu(neh->eh_depth) + 1);
+	err = ext3_ext_dirty(handle, inode, path);
+out:
+	if (err)
+		ext3_free_blocks(handle, inode, newblock, 1);
+	brelse(bh);
+	return err;
+}
+
+/*
+ * Make room in the leaf for @newext: split below the lowest level that
+ * has a free slot, or grow the tree when there is none.  @path is
+ * refilled for @newext on return.
+ */
+static int ext3_ext_create_new_leaf(handle_t *handle, struct inode *inode,
+				    struct ext3_ext_path *path,
+				    struct ext3_extent *newext)
+{
+	unsigned long block = le32_to_cpu(newext->ee_block);
+	struct ext3_ext_path *curp;
+	int depth, i, err;
+
+repeat:
+	i = depth = ext_depth(inode);
+	curp = path + depth;
+	while (i > 0 && !EXT_HAS_FREE_INDEX(curp)) {
+		i--;
+		curp--;
+	}
+
+	if (EXT_HAS_FREE_INDEX(curp)) {
+		err = ext3_ext_split(handle, inode, path, newext, i);
+		ext3_ext_drop_refs(path);
+		if (!err && IS_ERR(ext3_ext_find_extent(inode, block, path)))
+			err = -EIO;
+		return err;
+	}
+
+	err = ext3_ext_grow_indepth(handle, inode, path, newext);
+	ext3_ext_drop_refs(path);
+	if (err)
+		return err;
+	if (IS_ERR(ext3_ext_find_extent(inode, block, path)))
+		return -EIO;
+
+	/* growing a leaf root makes room, growing an index root does not */
+	depth = ext_depth(inode);
+	if (!EXT_HAS_FREE_INDEX(path + depth))
+		goto repeat;
+	return 0;
+}
+
+static int ext3_ext_insert_extent(handle_t *handle, struct inode *inode,
+				  struct ext3_ext_path *path,
+				  struct ext3_extent *newext)
+{
+	struct ext3_extent_header *eh;
+	struct ext3_extent *ex, *nearex;
+	int depth, len, err;
+
+	depth = ext_depth(inode);
+	ex = path[depth].p_ext;
+
+	/* the common case: appending right behind the extent we found */
+	if (ex && ext3_can_extents_be_merged(ex, newext)) {
+		err = ext3_ext_get_access(handle, inode, path + depth);
+		if (err)
+			return err;
+		ext3_ext_set_len(ex, ext3_ext_get_len(ex) +
+				     ext3_ext_get_len(newext),
+				 ext3_ext_is_uninit(ex));
+		eh = path[depth].p_hdr;
+		nearex = ex;
+		goto merge;
+	}
+
+	if (!EXT_HAS_FREE_INDEX(path + depth)) {
+		err = ext3_ext_create_new_leaf(handle, inode, path, newext);
+		if (err)
+			return err;
+		depth = ext_depth(inode);
+	}
+
+	eh = path[depth].p_hdr;
+	err = ext3_ext_get_access(handle, inode, path + depth);
+	if (err)
+		return err;
+
+	nearex = path[depth].p_ext;
+	if (!nearex)
+		nearex = EXT_FIRST_EXTENT(eh);
+	else if (le32_to_cpu(newext->ee_block) > le32_to_cpu(nearex->ee_block))
+		nearex++;
+
+	len = EXT_LAST_EXTENT(eh) - nearex + 1;
+	if (len > 0)
+		memmove(nearex + 1, nearex, len * sizeof(struct ext3_extent));
+	*nearex = *newext;
+	eh->eh_entries = cpu_to_le16(le16_to_cpu(eh->eh_entries) + 1);
+
+merge:
+	/* the new blocks may also close the gap to the next extent */
+	path[depth].p_ext = ext3_ext_try_to_merge(eh, nearex);
+	err = ext3_ext_correct_indexes(handle, inode, path);
+	if (err)
+		return err;
+	return ext3_ext_dirty(handle, inode, path + depth);
+}
+
+/*
+ * Turn up to @max_blocks blocks from @iblock of the uninitialized extent
+ * the path ends at into initialized ones.  The extent is split into an
+ * uninitialized head, the initialized blocks and an uninitialized tail,
+ * any of the two ends may be empty.  The caller treats the blocks like
+ * newly allocated ones and zeroes what it does not write of them.
+ *
+ * If a piece cannot be inserted into the tree, the preallocated blocks
+ * from there on are given back rather than left unaccounted for: the
+ * file gets a hole there instead.  Returns the number of blocks
+ * converted or a negative error.
+ */
+static int ext3_ext_convert_uninit(handle_t *handle, struct inode *inode,
+				   struct ext3_ext_path *path,
+				   unsigned long iblock,
+				   unsigned long max_blocks)
+{
+	int depth = path->p_depth;
+	struct ext3_extent *ex = path[depth].p_ext;
+	struct ext3_extent newex;
+	unsigned long ee_block = le32_to_cpu(ex->ee_block);
+	unsigned long ee_start = le32_to_cpu(ex->ee_start);
+	unsigned long head = iblock - ee_block;
+	unsigned long count, tail;
+	int err;
+
+	count = ext3_ext_get_len(ex) - head;
+	if (count > max_blocks)
+		count = max_blocks;
+	tail = ext3_ext_get_len(ex) - head - count;
+
+	err = ext3_ext_get_access(handle, inode, path + depth);
+	if (err)
+		return err;
+
+	if (!head) {
+		/* the front turns initialized in place */
+		ext3_ext_set_len(ex, count, 0);
+		path[depth].p_ext = ext3_ext_try_to_merge(path[depth].p_hdr,
+							  ex);
+	} else {
+		ext3_ext_set_len(ex, head, 1);
+	}
+	err = ext3_ext_dirty(handle, inode, path + depth);
+	if (err)
+		return err;
+
+	if (head) {
+		newex.ee_block = cpu_to_le32(iblock);
+		newex.ee_start = cpu_to_le32(ee_start + head);
+		newex.ee_start_hi = 0;
+		ext3_ext_set_len(&newex, count, 0);
+		err = ext3_ext_insert_extent(handle, inode, path, &newex);
+		if (err) {
+			ext3_free_blocks(handle, inode, ee_start + head,
+					 count + tail);
+			return err;
+		}
+	}
+
+	if (tail) {
+		ext3_ext_drop_refs(path);
+		if (IS_ERR(ext3_ext_find_extent(inode, iblock, path))) {
+			err = -EIO;
+		} else {
+			newex.ee_block = cpu_to_le32(iblock + count);
+			newex.ee_start = cpu_to_le32(ee_start + head + count);
+			newex.ee_start_hi = 0;
+			ext3_ext_set_len(&newex, tail, 1);
+			err = ext3_ext_insert_extent(handle, inode, path,
+						     &newex);
+		}
+		if (err)
+			ext3_free_blocks(handle, inode,
+					 ee_start + head + count, tail);
+	}
+	return count;
+}
+
+/*
+ * Map up to @max_blocks blocks starting at @iblock.  Returns the number
+ * of blocks mapped in @bh_result, 0 for a hole when !@create, or a
+ * negative error.  Allocation covers as much of the hole as was asked
+ * for in a single contiguous run where the allocator can find one.
+ *
+ * Uninitialized blocks are a hole to a lookup.  Writing into them
+ * (@create) converts them and returns them as new blocks, while
+ * EXT3_CREATE_UNINIT leaves whatever is mapped alone and fills a hole
+ * with an uninitialized extent.
+ */
+int ext3_ext_get_blocks(handle_t *handle, struct inode *inode, sector_t iblock,
+			unsigned long max_blocks, struct buffer_head *bh_result,
+			int create, int extend_disksize)
+{
+	struct ext3_inode_info *ei = EXT3_I(inode);
+	struct ext3_ext_path *path;
+	struct ext3_extent newex, *ex;
+	unsigned long goal, newblock, next;
+	unsigned long allocated = 0;
+	int uninit = create == EXT3_CREATE_UNINIT;
+	int err = 0;
+
+	J_ASSERT(handle != NULL || create == 0);
+
+	down(&ei->truncate_sem);
+
+	path = ext3_ext_find_extent(inode, iblock, NULL);
+	if (IS_ERR(path)) {
+		err = PTR_ERR(path);
+		up(&ei->truncate_sem);
+		return err;
+	}
+
+	next = ext3_ext_next_allocated_block(path);
+	ex = path[path->p_depth].p_ext;
+	if (ex) {
+		unsigned long ee_block = le32_to_cpu(ex->ee_block);
+		unsigned long ee_len = ext3_ext_get_len(ex);
+
+		if (iblock >= ee_block && iblock < ee_block + ee_len) {
+			newblock = iblock - ee_block + le32_to_cpu(ex->ee_start);
+			if (ext3_ext_is_uninit(ex) && !uninit) {
+				if (!create)
+					goto out;
+				err = ext3_ext_convert_uninit(handle, inode,
+						path, iblock, max_blocks);
+				if (err <= 0)
+					goto out;
+				allocated = err;
+				err = 0;
+				goto out_new;
+			}
+			allocated = ee_len - (iblock - ee_block);
+			if (allocated > max_blocks)
+				allocated = max_blocks;
+			clear_buffer_new(bh_result);
+			map_bh(bh_result, inode->i_sb, newblock);
+			goto out;
+		}
+		if (iblock < ee_block)
+			next = ee_block;
+	}
+
+	if (!create)
+		goto out;
+
+	allocated = max_blocks;
+	if (allocated > next - iblock)
+		allocated = next - iblock;
+	if (allocated > EXT3_EXT_MAX_LEN)
+		allocated = EXT3_EXT_MAX_LEN;
+	if (uninit && allocated > EXT3_EXT_UNINIT_MAX_LEN)
+		allocated = EXT3_EXT_UNINIT_MAX_LEN;
+
+	/* lazy initialize the block allocation info here if necessary */
+	if (S_ISREG(inode->i_mode) && (!ei->i_block_alloc_info))
+		ext3_init_block_alloc_info(inode);
+
+	goal = ext3_ext_find_goal(inode, path, iblock);
+	newblock = ext3_new_blocks(handle, inode, goal, &allocated, &err);
+	if (!newblock) {
+		allocated = 0;
+		goto out;
+	}
+
+	newex.ee_block = cpu_to_le32(iblock);
+	newex.ee_start = cpu_to_le32(newblock);
+	newex.ee_start_hi = 0;
+	ext3_ext_set_len(&newex, allocated, uninit);
+	err = ext3_ext_insert_extent(handle, inode, path, &newex);
+	if (err) {
+		ext3_free_blocks(handle, inode, newblock, allocated);
+		allocated = 0;
+		goto out;
+	}
+
+out_new:
+	/* i_disksize growing is protected by truncate_sem */
+	if (extend_disksize && inode->i_size > ei->i_disksize)
+		ei->i_disksize = inode->i_size;
+
+	set_buffer_new(bh_result);
+	map_bh(bh_result, inode->i_sb, newblock);
+out:
+	ext3_ext_drop_refs(path);
+	kfree(path);
+	up(&ei->truncate_sem);
+	return err ? err : allocated;
+}
+
+/*
+ * Defragmentation, see defrag.c; the caller holds truncate_sem.  Only
+ * whole extents are moved, together with the logically adjacent ones
+ * after them in the same leaf.  Returns how many blocks from @iblock
+ * are worth relocating, 0 when there is nothing to gain there, or a
+ * negative error.  *@next is where to look next when nothing is moved,
+ * *@min how many blocks the new run has to cover at least.  A zero
+ * *@goal is set to where the run starts now.
+ */
+int ext3_ext_defrag_plan(struct inode *inode, unsigned long iblock,
+			 unsigned long max, unsigned long *next,
+			 unsigned long *min, unsigned long *goal)
+{
+	struct ext3_ext_path *path;
+	struct ext3_extent_header *eh;
+	struct ext3_extent *ex;
+	unsigned long ee_block, ee_len, len = 0;
+
+	path = ext3_ext_find_extent(inode, iblock, NULL);
+	if (IS_ERR(path))
+		return PTR_ERR(path);
+
+	eh = path[path->p_depth].p_hdr;
+	ex = path[path->p_depth].p_ext;
+	*next = ext3_ext_next_allocated_block(path);
+	if (!ex)
+		goto out;
+
+	ee_block = le32_to_cpu(ex->ee_block);
+	ee_len = ext3_ext_get_len(ex);
+	if (iblock < ee_block) {
+		*next = ee_block;
+		goto out;
+	}
+	if (iblock >= ee_block + ee_len)
+		goto out;
+	*next = ee_block + ee_len;
+	/* preallocated space has no data worth moving */
+	if (iblock != ee_block || ext3_ext_is_uninit(ex))
+		goto out;
+
+	len = ee_len;
+	*min = ee_len + 1;
+	if (!*goal)
+		*goal = le32_to_cpu(ex->ee_start);
+	while (len < max && ex < EXT_LAST_EXTENT(eh)) {
+		ex++;
+		if (le32_to_cpu(ex->ee_block) != iblock + len ||
+		    ext3_ext_is_uninit(ex))
+			break;
+		len += ext3_ext_get_len(ex);
+	}
+	if (len > max)
+		len = max;
+	if (len < *min)
+		len = 0;
+out:
+	ext3_ext_drop_refs(path);
+	kfree(path);
+	return len;
+}
+
+/*
+ * Point @count blocks from @iblock, as planned by ext3_ext_defrag_plan(),
+ * at the run starting at @newblock and free the blocks they used.  The
+ * first extent of the run takes over the whole run, the others are
+ * dropped and the last one may only lose its front.
+ */
+int ext3_ext_remap_blocks(handle_t *handle, struct inode *inode,
+			  unsigned long iblock, unsigned long count,
+			  unsigned long newblock)
+{
+	struct ext3_ext_path *path;
+	struct ext3_extent_header *eh;
+	struct ext3_extent *ex, *e;
+	unsigned long ee_len, left;
+	int depth, len, err;
+
+	path = ext3_ext_find_extent(inode, iblock, NULL);
+	if (IS_ERR(path))
+		return PTR_ERR(path);
+
+	depth = path->p_depth;
+	eh = path[depth].p_hdr;
+	ex = path[depth].p_ext;
+	if (!ex || le32_to_cpu(ex->ee_block) != iblock)
+		goto changed;
+
+	/* find the extent the run ends in */
+	left = count;
+	for (e = ex; left && e <= EXT_LAST_EXTENT(eh); e++) {
+		if (le32_to_cpu(e->ee_block) != iblock + count - left)
+			goto changed;
+		ee_len = ext3_ext_get_len(e);
+		if (ee_len > left)
+			break;
+		left -= ee_len;
+	}
+	if (left && (e > EXT_LAST_EXTENT(eh) || e == ex))
+		goto changed;
+
+	err = ext3_ext_get_access(handle, inode, path + depth);
+	if (err)
+		goto out;
+
+	for (ex = path[depth].p_ext; ex < e; ex++)
+		ext3_free_blocks(handle, inode, le32_to_cpu(ex->ee_start),
+				 ext3_ext_get_len(ex));
+	if (left) {
+		ext3_free_blocks(handle, inode, le32_to_cpu(e->ee_start), left);
+		e->ee_block = cpu_to_le32(le32_to_cpu(e->ee_block) + left);
+		e->ee_start = cpu_to_le32(le32_to_cpu(e->ee_start) + left);
+		ext3_ext_set_len(e, ext3_ext_get_len(e) - left, 0);
+	}
+
+	ex = path[depth].p_ext;
+	ex->ee_start = cpu_to_le32(newblock);
+	ex->ee_start_hi = 0;
+	ext3_ext_set_len(ex, count, 0);
+	if (e > ex + 1) {
+		len = EXT_LAST_EXTENT(eh) - e + 1;
+		if (len > 0)
+			memmove(ex + 1, e, len * sizeof(struct ext3_extent));
+		eh->eh_entries =
+			cpu_to_le16(le16_to_cpu(eh->eh_entries) - (e - ex - 1));
+	}
+
+	/* the new run may continue the extent before it */
+	if (ex > EXT_FIRST_EXTENT(eh) && ext3_can_extents_be_merged(ex - 1, ex)) {
+		ext3_ext_set_len(ex - 1, ext3_ext_get_len(ex - 1) + count, 0);
+		len = EXT_LAST_EXTENT(eh) - ex;
+		if (len > 0)
+			memmove(ex, ex + 1, len * sizeof(struct ext3_extent));
+		eh->eh_entries = cpu_to_le16(le16_to_cpu(eh->eh_entries) - 1);
+	}
+	err = ext3_ext_dirty(handle, inode, path + depth);
+	goto out;
+
+changed:
+	ext3_error(inode->i_sb, "ext3_ext_remap_blocks",
+		   "inode %lu: extents changed under block %lu",
+		   inode->i_ino, iblock);
+	err = -EIO;
+out:
+	ext3_ext_drop_refs(path);
+	kfree(path);
+	return err;
+}
+
+/*
+ * Truncate frees extents one at a time, so a huge file never needs
+ * more than a handful of credits at once.  The caller must have
+ * dirtied everything it changed so far; write access has to be taken
+ * again after a restart.
+ */
+static int ext3_ext_truncate_extend_restart(handle_t *handle,
+					    struct inode *inode, int needed)
+{
+	int err;
+
+	if (handle->h_buffer_credits > needed)
+		return 0;
+	err = ext3_journal_extend(handle, needed);
+	if (err <= 0)
+		return err;
+	ext3_mark_inode_dirty(handle, inode);
+	return ext3_journal_restart(handle, needed);
+}
+
+/* Unhook the node below @path from its parent and free it */
+static int ext3_ext_rm_idx(handle_t *handle, struct inode *inode,
+			   struct ext3_ext_path *path)
+{
+	struct buffer_head *bh;
+	unsigned long leaf;
+	int len, err;
+
+	err = ext3_ext_truncate_extend_restart(handle, inode,
+					       EXT3_DATA_TRANS_BLOCKS);
+	if (err)
+		return err;
+
+	path--;
+	leaf = le32_to_cpu(path->p_idx->ei_leaf);
+	err = ext3_ext_get_access(handle, inode, path);
+	if (err)
+		return err;
+	len = EXT_LAST_INDEX(path->p_hdr) - path->p_idx;
+	if (len > 0)
+		memmove(path->p_idx, path->p_idx + 1,
+			len * sizeof(struct ext3_extent_idx));
+	path->p_hdr->eh_entries =
+		cpu_to_le16(le16_to_cpu(path->p_hdr->eh_entries) - 1);
+	err = ext3_ext_dirty(handle, inode, path);
+	if (err)
+		return err;
+
+	bh = sb_find_get_block(inode->i_sb, leaf);
+	ext3_forget(handle, 1, inode, bh, leaf);
+	ext3_free_blocks(handle, inode, leaf, 1);
+	return 0;
+}
+
+/*
+ * Free everything from logical block @start on in one leaf.  Extents
+ * are dropped from the right, so removed entries are always the last
+ * ones and the first key of the leaf never changes.
+ */
+static int ext3_ext_rm_leaf(handle_t *handle, struct inode *inode,
+			    struct ext3_ext_path *path, unsigned long start)
+{
+	struct super_block *sb = inode->i_sb;
+	int depth = ext_depth(inode);
+	struct ext3_extent_header *eh = path[depth].p_hdr;
+	struct ext3_extent *ex;
+	unsigned long ee_block, ee_len, keep;
+	int credits, err;
+
+	ex = EXT_LAST_EXTENT(eh);
+	while (ex >= EXT_FIRST_EXTENT(eh)) {
+		ee_block = le32_to_cpu(ex->ee_block);
+		ee_len = ext3_ext_get_len(ex);
+		if (ee_block + ee_len <= start)
+			break;
+		keep = ee_block < start ? start - ee_block : 0;
+
+		/* the leaf, the inode and the bitmaps the run spills over */
+		credits = EXT3_DATA_TRANS_BLOCKS +
+			  2 * (ee_len / EXT3_BLOCKS_PER_GROUP(sb) + 2);
+		err = ext3_ext_truncate_extend_restart(handle, inode, credits);
+		if (err)
+			return err;
+		err = ext3_ext_get_access(handle, inode, path + depth);
+		if (err)
+			return err;
+
+		ext3_free_blocks(handle, inode,
+				 le32_to_cpu(ex->ee_start) + keep,
+				 ee_len - keep);
+		if (keep) {
+			ext3_ext_set_len(ex, keep, ext3_ext_is_uninit(ex));
+		} else {
+			memset(ex, 0, sizeof(*ex));
+			eh->eh_entries =
+				cpu_to_le16(le16_to_cpu(eh->eh_entries) - 1);
+		}
+		err = ext3_ext_dirty(handle, inode, path + depth);
+		if (err)
+			return err;
+		ex--;
+	}
+
+	if (eh->eh_entries == 0 && path[depth].p_bh)
+		return ext3_ext_rm_idx(handle, inode, path + depth);
+	return 0;
+}
+
+/*
+ * Walk the tree right to left, depth first.  p_block of an index level
+ * remembers how many entries it had when we went down; if the child
+ * came back without being freed it was only partly truncated and
+ * nothing further left can be affected.
+ */
+static int ext3_ext_remove_space(handle_t *handle, struct inode *inode,
+				 unsigned long start)
+{
+	int depth = ext_depth(inode);
+	struct ext3_ext_path *path;
+	struct buffer_head *bh;
+	int i = 0, err = 0;
+
+	path = kmalloc(sizeof(struct ext3_ext_path) * (depth + 1), GFP_NOFS);
+	if (!path)
+		return -ENOMEM;
+	memset(path, 0, sizeof(struct ext3_ext_path) * (depth + 1));
+	path[0].p_hdr = ext_inode_hdr(inode);
+	path[0].p_depth = depth;
+	if (ext3_ext_check_header(inode, path[0].p_hdr, depth)) {
+		err = -EIO;
+		goto out;
+	}
+
+	while (i >= 0 && err == 0) {
+		if (i == depth) {
+			err = ext3_ext_rm_leaf(handle, inode, path, start);
+			brelse(path[i].p_bh);
+			path[i].p_bh = NULL;
+			i--;
+			continue;
+		}
+
+		if (!path[i].p_idx) {
+			path[i].p_idx = EXT_LAST_INDEX(path[i].p_hdr);
+			path[i].p_block =
+				le16_to_cpu(path[i].p_hdr->eh_entries) + 1;
+		} else {
+			path[i].p_idx--;
+		}
+
+		if (path[i].p_idx >= EXT_FIRST_INDEX(path[i].p_hdr) &&
+		    le16_to_cpu(path[i].p_hdr->eh_entries) != path[i].p_block) {
+			bh = sb_bread(inode->i_sb,
+				      le32_to_cpu(path[i].p_idx->ei_leaf));
+			if (!bh) {
+				err = -EIO;
+				break;
+			}
+			memset(path + i + 1, 0, sizeof(struct ext3_ext_path));
+			path[i + 1].p_bh = bh;
+			path[i + 1].p_hdr = ext_block_hdr(bh);
+			if (ext3_ext_check_header(inode, path[i + 1].p_hdr,
+						  depth - i - 1)) {
+				err = -EIO;
+				break;
+			}
+			path[i].p_block = le16_to_cpu(path[i].p_hdr->eh_entries);
+			i++;
+		} else {
+			if (i > 0 && path[i].p_hdr->eh_entries == 0)
+				err = ext3_ext_rm_idx(handle, inode, path + i);
+			brelse(path[i].p_bh);
+			path[i].p_bh = NULL;
+			i--;
+		}
+	}
+
+	/* an emptied tree goes back to a leaf root */
+	if (!err && path[0].p_hdr->eh_entries == 0 && depth) {
+		path[0].p_hdr->eh_depth = 0;
+		path[0].p_hdr->eh_max = cpu_to_le16(ext3_ext_space_root(inode));
+		err = ext3_ext_dirty(handle, inode, path);
+	}
+out:
+	for (i = 0; i <= depth; i++)
+		brelse(path[i].p_bh);
+	kfree(path);
+	return err;
+}
+
+/*
+ * Called from ext3_truncate() with truncate_sem held, the inode on the
+ * orphan list and the partial tail page already zeroed.
+ */
+void ext3_ext_truncate(handle_t *handle, struct inode *inode,
+		       unsigned long last_block)
+{
+	int err;
+
+	err = ext3_ext_remove_space(handle, inode, last_block);
+	if (err && err != -EIO)
+		ext3_std_error(inode->i_sb, err);
+}
+
+/*
+ * Worst case tree metadata for mapping one extent: a split dirties and
+ * allocates a block at every level and may add a new level on top.
+ */
+int ext3_ext_index_trans_blocks(struct inode *inode)
+{
+	return 2 * (ext_depth(inode) + 1) + 1;
+}
+
+/*
+ * Preallocate the blocks of a byte range as uninitialized extents, see
+ * ext3_ext_get_blocks().  Each handle maps at most one extent, so a big
+ * range is reserved in pieces; the size grows with every piece unless
+ * FALLOC_FL_KEEP_SIZE was asked for, so what is allocated past i_size
+ * when we bail out is only what the caller asked to keep there anyway.
+ */
+long ext3_fallocate(struct file *file, int mode, loff_t offset, loff_t len)
+{
+	struct inode *inode = file->f_dentry->d_inode;
+	struct ext3_inode_info *ei = EXT3_I(inode);
+	struct ext3_reserve_window_node *rsv;
+	struct buffer_head dummy;
+	unsigned long iblock, end, count;
+	loff_t new_size;
+	__u32 rsv_goal_size;
+	handle_t *handle;
+	int credits, ret = 0, ret2, retries = 0;
+
+	/* the indirect tree has no way to tell preallocated blocks apart */
+	if (!(ei->i_flags & EXT3_EXTENTS_FL))
+		return -EOPNOTSUPP;
+	if (!S_ISREG(inode->i_mode))
+		return -ENODEV;
+
+	iblock = offset >> inode->i_blkbits;
+	end = (offset + len + inode->i_sb->s_blocksize - 1) >> inode->i_blkbits;
+
+	down(&inode->i_sem);
+
+	down(&ei->truncate_sem);
+	if (!ei->i_block_alloc_info)
+		ext3_init_block_alloc_info(inode);
+	rsv = NULL;
+	if (ei->i_block_alloc_info) {
+		rsv = &ei->i_block_alloc_info->rsv_window_node;
+		rsv_goal_size = rsv->rsv_goal_size;
+		rsv->rsv_goal_size = min_t(unsigned long, end - iblock,
+					   EXT3_MAX_RESERVE_BLOCKS);
+	}
+	up(&ei->truncate_sem);
+
+	while (iblock < end) {
+		count = min_t(unsigned long, end - iblock,
+			      EXT3_EXT_UNINIT_MAX_LEN);
+		credits = ext3_ext_index_trans_blocks(inode) +
+			2 * (count / EXT3_BLOCKS_PER_GROUP(inode->i_sb) + 2) +
+			1 + 2 * EXT3_QUOTA_TRANS_BLOCKS;
+		handle = ext3_journal_start(inode, credits);
+		if (IS_ERR(handle)) {
+			ret = PTR_ERR(handle);
+			break;
+		}
+
+		dummy.b_state = 0;
+		ret = ext3_ext_get_blocks(handle, inode, iblock, count, &dummy,
+					  EXT3_CREATE_UNINIT, 0);
+		if (ret > 0) {
+			iblock += ret;
+			new_size = (loff_t)iblock << inode->i_blkbits;
+			if (new_size > offset + len)
+				new_size = offset + len;
+			if (!(mode & FALLOC_FL_KEEP_SIZE) &&
+			    new_size > i_size_read(inode)) {
+				i_size_write(inode, new_size);
+				ei->i_disksize = new_size;
+			}
+			inode->i_ctime = CURRENT_TIME_SEC;
+			ext3_mark_inode_dirty(handle, inode);
+			ret = 0;
+		}
+
+		ret2 = ext3_journal_stop(handle);
+		if (!ret)
+			ret = ret2;
+		if (ret == -ENOSPC &&
+		    ext3_should_retry_alloc(inode->i_sb, &retries)) {
+			ret = 0;
+			continue;
+		}
+		if (ret)
+			break;
+		if (signal_pending(current)) {
+			ret = -EINTR;
+			break;
+		}
+		cond_resched();
+	}
+
+	if (rsv) {
+		down(&ei->truncate_sem);
+		rsv->rsv_goal_size = rsv_goal_size;
+		up(&ei->truncate_sem);
+	}
+	up(&inode->i_sem);
+	return ret;
+}
@@ -115,6 +115,7 @@ struct file_operations ext3_file_operations = {
 	.release	= ext3_release_file,
 	.fsync		= ext3_sync_file,
 	.sendfile	= generic_file_sendfile,
+	.fallocate	= ext3_fallocate,
 };
 
 struct inode_operations ext3_file_inode_operations = {
@@ -565,7 +565,7 @@ got:
 	ei->i_dir_start_lookup = 0;
 	ei->i_disksize = 0;
 
-	ei->i_flags = EXT3_I(dir)->i_flags & ~EXT3_INDEX_FL;
+	ei->i_flags = EXT3_I(dir)->i_flags & ~(EXT3_INDEX_FL|EXT3_EXTENTS_FL);
 	if (S_ISLNK(mode))
 		ei->i_flags &= ~(EXT3_IMMUTABLE_FL|EXT3_APPEND_FL);
 	/* dirsync only applies to directories */
@@ -606,6 +606,28 @@ got:
 		DQUOT_FREE_INODE(inode);
 		goto fail2;
   	}
+	if (test_opt(sb, EXTENTS) && S_ISREG(mode)) {
+		/* the first extent mapped file makes the fs extent only */
+		if (!EXT3_HAS_INCOMPAT_FEATURE(sb,
+					EXT3_FEATURE_INCOMPAT_EXTENTS)) {
+			lock_super(sb);
+			err = ext3_journal_get_write_access(handle, sbi->s_sbh);
+			if (!err) {
+				EXT3_SET_INCOMPAT_FEATURE(sb,
+					EXT3_FEATURE_INCOMPAT_EXTENTS);
+				sb->s_dirt = 1;
+				err = ext3_journal_dirty_metadata(handle,
+								  sbi->s_sbh);
+			}
+			unlock_super(sb);
+			if (err) {
+				DQUOT_FREE_INODE(inode);
+				goto fail2;
+			}
+		}
+		ei->i_flags |= EXT3_EXTENTS_FL;
+		ext3_ext_tree_init(handle, inode);
+	}
 	err = ext3_mark_inode_dirty(handle, inode);
 	if (err) {
 		ext3_std_error(sb, err);
@@ -695,11 +695,41 @@ err_out:
  * akpm: `handle' can be NULL if create == 0.
  *
  * The BKL may not be held on entry here.  Be sure to take it early.
+ *
+ * Returns the number of blocks mapped from @iblock, at most @maxblocks,
+ * 0 for a hole when !create, or a negative error.  Blocks which are
+ * already mapped are returned as the run of contiguous pointers in the
+ * same pointer block; an allocation maps a single block.
+ */
+
+/*
+ * How many pointers from chain[depth-1].p on refer to consecutive disk
+ * blocks, stopping at the end of the pointer block.
  */
+static int ext3_ind_count_run(struct inode *inode, Indirect *chain,
+			      int depth, int maxblocks, int *boundary)
+{
+	__le32 *p = chain[depth - 1].p;
+	__le32 *end;
+	u32 key = le32_to_cpu(chain[depth - 1].key);
+	int count = 1;
+
+	if (depth == 1)
+		end = EXT3_I(inode)->i_data + EXT3_NDIR_BLOCKS;
+	else
+		end = (__le32 *)chain[depth - 1].bh->b_data +
+			EXT3_ADDR_PER_BLOCK(inode->i_sb);
+	while (count < maxblocks && p + count < end &&
+	       le32_to_cpu(p[count]) == key + count)
+		count++;
+	*boundary = (p + count == end);
+	return count;
+}
 
 static int
-ext3_get_block_handle(handle_t *handle, struct inode *inode, sector_t iblock,
-		struct buffer_head *bh_result, int create, int extend_disksize)
+ext3_get_blocks_handle(handle_t *handle, struct inode *inode, sector_t iblock,
+		unsigned long maxblocks, struct buffer_head *bh_result,
+		int create, int extend_disksize)
 {
 	int err = -EIO;
 	int offsets[4];
@@ -708,11 +738,17 @@ ext3_get_block_handle(handle_t *handle, struct inode *inode, sector_t iblock,
 	unsigned long goal;
 	int left;
 	int boundary = 0;
-	int depth = ext3_block_to_path(inode, iblock, offsets, &boundary);
+	int depth;
+	int count = 0;
 	struct ext3_inode_info *ei = EXT3_I(inode);
 
 	J_ASSERT(handle != NULL || create == 0);
 
+	if (ei->i_flags & EXT3_EXTENTS_FL)
+		return ext3_ext_get_blocks(handle, inode, iblock, maxblocks,
+					   bh_result, create, extend_disksize);
+
+	depth = ext3_block_to_path(inode, iblock, offsets, &boundary);
 	if (depth == 0)
 		goto out;
 
@@ -722,6 +758,10 @@ reread:
 	/* Simplest case - block found, no allocation needed */
 	if (!partial) {
 		clear_buffer_new(bh_result);
+		count = 1;
+		if (maxblocks > 1)
+			count = ext3_ind_count_run(inode, chain, depth,
+						   maxblocks, &boundary);
 got_it:
 		map_bh(bh_result, inode->i_sb, le32_to_cpu(chain[depth-1].key));
 		if (boundary)
@@ -741,7 +781,7 @@ cleanup:
 		}
 		BUFFER_TRACE(bh_result, "returned");
 out:
-		return err;
+		return err ? err : count;
 	}
 
 	/*
@@ -793,6 +833,7 @@ out:
 		goto cleanup;
 
 	set_buffer_new(bh_result);
+	count = 1;
 	goto got_it;
 
 changed:
@@ -805,6 +846,17 @@ changed:
 	goto reread;
 }
 
+static int
+ext3_get_block_handle(handle_t *handle, struct inode *inode, sector_t iblock,
+		struct buffer_head *bh_result, int create, int extend_disksize)
+{
+	int ret;
+
+	ret = ext3_get_blocks_handle(handle, inode, iblock, 1, bh_result,
+				     create, extend_disksize);
+	return ret < 0 ? ret : 0;
+}
+
 static int ext3_get_block(struct inode *inode, sector_t iblock,
 			struct buffer_head *bh_result, int create)
 {
@@ -820,6 +872,145 @@ static int ext3_get_block(struct inode *inode, sector_t iblock,
 	return ret;
 }
 
+/*
+ * Defragmentation of indirect mapped files, see defrag.c and the extent
+ * versions in extents.c.  The caller holds truncate_sem, so the chains
+ * cannot change under us.
+ */
+static int ext3_ind_lookup(struct inode *inode, unsigned long iblock,
+			   unsigned long *blocknr)
+{
+	int offsets[4];
+	Indirect chain[4];
+	Indirect *partial;
+	int depth, err;
+
+	*blocknr = 0;
+	depth = ext3_block_to_path(inode, iblock, offsets, NULL);
+	if (depth == 0)
+		return -EIO;
+	partial = ext3_get_branch(inode, depth, offsets, chain, &err);
+	if (!partial) {
+		*blocknr = le32_to_cpu(chain[depth - 1].key);
+		partial = chain + depth - 1;
+	}
+	while (partial > chain) {
+		brelse(partial->bh);
+		partial--;
+	}
+	return err;
+}
+
+/*
+ * Returns how many mapped blocks from @iblock are worth relocating: a
+ * run of at most @max which is not contiguous on disk.  0 means nothing
+ * to gain, *@next then says where to look next.  *@min and *@goal are
+ * as for ext3_ext_defrag_plan().
+ */
+int ext3_ind_defrag_plan(struct inode *inode, unsigned long iblock,
+			 unsigned long max, unsigned long *next,
+			 unsigned long *min, unsigned long *goal)
+{
+	unsigned long blocknr, prev = 0, len = 0;
+	int err;
+
+	/* step over a hole */
+	while (len < max) {
+		err = ext3_ind_lookup(inode, iblock + len, &blocknr);
+		if (err)
+			return err;
+		if (blocknr)
+			break;
+		len++;
+	}
+	if (len) {
+		*next = iblock + len;
+		return 0;
+	}
+
+	*min = 0;
+	while (len < max) {
+		err = ext3_ind_lookup(inode, iblock + len, &blocknr);
+		if (err)
+			return err;
+		if (!blocknr)
+			break;
+		if (!len && !*goal)
+			*goal = blocknr;
+		if (len && blocknr != prev + 1 && !*min)
+			*min = len + 1;
+		prev = blocknr;
+		len++;
+	}
+	*next = iblock + len;
+	return *min ? len : 0;
+}
+
+/*
+ * Point @count blocks from @iblock at the run starting at @newblock and
+ * free the blocks they used.
+ */
+int ext3_ind_remap_blocks(handle_t *handle, struct inode *inode,
+			  unsigned long iblock, unsigned long count,
+			  unsigned long newblock)
+{
+	unsigned long i, old, freed = 0, nr_freed = 0;
+	int offsets[4];
+	Indirect chain[4];
+	Indirect *partial, *where;
+	int depth, err = 0;
+
+	for (i = 0; i < count && !err; i++) {
+		depth = ext3_block_to_path(inode, iblock + i, offsets, NULL);
+		if (depth == 0) {
+			err = -EIO;
+			break;
+		}
+		partial = ext3_get_branch(inode, depth, offsets, chain, &err);
+		if (partial) {
+			/* a hole, which ext3_ind_defrag_plan() ruled out */
+			if (!err)
+				err = -EIO;
+			goto release;
+		}
+
+		partial = where = chain + depth - 1;
+		if (where->bh) {
+			BUFFER_TRACE(where->bh, "get_write_access");
+			err = ext3_journal_get_write_access(handle, where->bh);
+			if (err)
+				goto release;
+		}
+		old = le32_to_cpu(where->key);
+		*where->p = cpu_to_le32(newblock + i);
+		if (where->bh) {
+			BUFFER_TRACE(where->bh, "call ext3_journal_dirty_metadata");
+			err = ext3_journal_dirty_metadata(handle, where->bh);
+		}
+
+		/* free the old blocks a contiguous piece at a time */
+		if (nr_freed && old == freed + nr_freed) {
+			nr_freed++;
+		} else {
+			if (nr_freed)
+				ext3_free_blocks(handle, inode, freed, nr_freed);
+			freed = old;
+			nr_freed = 1;
+		}
+release:
+		while (partial > chain) {
+			brelse(partial->bh);
+			partial--;
+		}
+	}
+	if (nr_freed)
+		ext3_free_blocks(handle, inode, freed, nr_freed);
+
+	/* the first blocks live in i_data */
+	ext3_mark_inode_dirty(handle, inode);
+	return err;
+}
+
 #define DIO_CREDITS (EXT3_RESERVE_TRANS_BLOCKS + 32)
 
 static int
@@ -859,17 +1050,38 @@ ext3_direct_io_get_blocks(struct inode *inode, sector_t iblock,
 	}
 
 get_block:
-	if (ret == 0)
-		ret = ext3_get_block_handle(handle, inode, iblock,
-					bh_result, create, 0);
+	if (ret == 0) {
+		/* an extent maps, and allocates, the whole run in one go */
+		ret = ext3_get_blocks_handle(handle, inode, iblock, max_blocks,
+					     bh_result, create, 0);
+		if (ret > 0) {
+			bh_result->b_size = ret << inode->i_blkbits;
+			return 0;
+		}
+	}
 	bh_result->b_size = (1 << inode->i_blkbits);
 	return ret;
 }
 
-static int ext3_writepages_get_block(struct inode *inode, sector_t iblock,
-			struct buffer_head *bh, int create)
+/*
+ * Read-side mapping for mpage_readpages_blocks(): returns a whole run of
+ * mapped blocks so readahead does not look the mapping up block by block.
+ */
+static int ext3_readpages_get_blocks(struct inode *inode, sector_t iblock,
+		unsigned long max_blocks, struct buffer_head *bh_result,
+		int create)
 {
-	return ext3_direct_io_get_blocks(inode, iblock, 1, bh, create);
+	int ret;
+
+	J_ASSERT(create == 0);
+	ret = ext3_get_blocks_handle(NULL, inode, iblock, max_blocks,
+				     bh_result, 0, 0);
+	if (ret > 0) {
+		bh_result->b_size = ret << inode->i_blkbits;
+		return 0;
+	}
+	bh_result->b_size = (1 << inode->i_blkbits);
+	return ret;
 }
 
 /*
@@ -1349,6 +1561,8 @@ static int
 ext3_writeback_writepage_helper(struct page *page,
 				struct writeback_control *wbc)
 {
+	if (test_opt(page->mapping->host->i_sb, NOBH))
+		return nobh_writepage(page, ext3_get_block, wbc);
 	return block_write_full_page(page, ext3_get_block, wbc);
 }
 
@@ -1369,11 +1583,16 @@ ext3_writeback_writepages(struct address_space *mapping,
 		return ret;
 	}
 
-        ret = __mpage_writepages(mapping, wbc, ext3_writepages_get_block,
-					ext3_writeback_writepage_helper);
+	/*
+	 * Pages which are not under buffers are written straight from
+	 * runs mapped by ext3_direct_io_get_blocks(), without attaching
+	 * buffer heads to them.
+	 */
+	ret = mpage_writepages_blocks(mapping, wbc, ext3_direct_io_get_blocks,
+				      ext3_writeback_writepage_helper);
 
 	/*
-	 * Need to reaquire the handle since ext3_writepages_get_block()
+	 * Need to reaquire the handle since ext3_direct_io_get_blocks()
 	 * can restart the handle
 	 */
 	handle = journal_current_handle();
@@ -1417,6 +1636,327 @@ out_fail:
 	return ret;
 }
 
+/*
+ * Delayed allocation.
+ *
+ * With the "delalloc" mount option, prepare_write() on an extent mapped
+ * file in data=writeback mode does not allocate.  A hole is only
+ * reserved: the space is claimed with ext3_claim_free_blocks() and
+ * charged to quota, and the buffer is marked mapped and BH_Delay with a
+ * block number which maps nothing.  Writeback then hands whole runs of
+ * delayed buffers, across as many dirty pages as it can lock, to
+ * ext3_ext_get_blocks(), so the allocator sees the entire range at once
+ * and the bitmap and the extent tree are journaled once per run instead
+ * of once per block.
+ */
+#define EXT3_DELAYED_BLOCK	((sector_t)-1)
+
+/* Most pages one ext3_da_writepage() call allocates for */
+#define EXT3_DA_MAX_PAGES	64
+
+static int ext3_da_reserve_space(struct inode *inode, unsigned long nblocks)
+{
+	int err;
+
+	if (DQUOT_ALLOC_BLOCK(inode, nblocks))
+		return -EDQUOT;
+	err = ext3_claim_free_blocks(inode->i_sb, nblocks);
+	if (err) {
+		DQUOT_FREE_BLOCK(inode, nblocks);
+		return err;
+	}
+	spin_lock(&inode->i_lock);
+	EXT3_I(inode)->i_reserved_blocks += nblocks;
+	spin_unlock(&inode->i_lock);
+	return 0;
+}
+
+static void ext3_da_release_space(struct inode *inode, unsigned long nblocks)
+{
+	struct ext3_inode_info *ei = EXT3_I(inode);
+
+	spin_lock(&inode->i_lock);
+	if (nblocks > ei->i_reserved_blocks)
+		nblocks = ei->i_reserved_blocks;
+	ei->i_reserved_blocks -= nblocks;
+	spin_unlock(&inode->i_lock);
+
+	if (nblocks) {
+		ext3_release_free_blocks(inode->i_sb, nblocks);
+		DQUOT_FREE_BLOCK(inode, nblocks);
+	}
+}
+
+/* Count the delayed buffers of @page which start at or after @offset */
+static unsigned long ext3_da_delayed_buffers(struct page *page,
+					     unsigned long offset)
+{
+	struct buffer_head *head, *bh;
+	unsigned long curr_off = 0, delayed = 0;
+
+	if (!page_has_buffers(page))
+		return 0;
+	head = bh = page_buffers(page);
+	do {
+		if (curr_off >= offset && buffer_delay(bh))
+			delayed++;
+		curr_off += bh->b_size;
+		bh = bh->b_this_page;
+	} while (bh != head);
+	return delayed;
+}
+
+/*
+ * get_block for prepare_write: map what is already allocated, reserve
+ * the rest.  A new delayed buffer has nothing on disk which could be
+ * read back, so it is zeroed and made uptodate right here.
+ */
+static int ext3_da_get_block(struct inode *inode, sector_t iblock,
+			     struct buffer_head *bh_result, int create)
+{
+	struct page *page;
+	int ret;
+
+	ret = ext3_ext_get_blocks(NULL, inode, iblock, 1, bh_result, 0, 0);
+	if (ret)
+		return ret < 0 ? ret : 0;
+
+	ret = ext3_da_reserve_space(inode, 1);
+	if (ret)
+		return ret;
+
+	map_bh(bh_result, inode->i_sb, EXT3_DELAYED_BLOCK);
+	set_buffer_delay(bh_result);
+	page = bh_result->b_page;
+	if (!PageUptodate(page) && !buffer_uptodate(bh_result)) {
+		void *kaddr;
+
+		kaddr = kmap_atomic(page, KM_USER0);
+		memset(kaddr + bh_offset(bh_result), 0, bh_result->b_size);
+		flush_dcache_page(page);
+		kunmap_atomic(kaddr, KM_USER0);
+		set_buffer_uptodate(bh_result);
+	}
+	return 0;
+}
+
+static int ext3_da_prepare_write(struct file *file, struct page *page,
+				 unsigned from, unsigned to)
+{
+	struct inode *inode = page->mapping->host;
+	int ret, retries = 0;
+
+retry:
+	ret = block_prepare_write(page, from, to, ext3_da_get_block);
+	if (ret && page_has_buffers(page)) {
+		struct buffer_head *head, *bh;
+
+		/* give back what this call reserved and nobody dirtied */
+		head = bh = page_buffers(page);
+		do {
+			if (buffer_delay(bh) && !buffer_dirty(bh)) {
+				clear_buffer_delay(bh);
+				clear_buffer_mapped(bh);
+				ext3_da_release_space(inode, 1);
+			}
+			bh = bh->b_this_page;
+		} while (bh != head);
+	}
+	if (ret == -ENOSPC && ext3_should_retry_alloc(inode->i_sb, &retries))
+		goto retry;
+	return ret;
+}
+
+/*
+ * No transaction is open here: generic_commit_write()'s mark_inode_dirty()
+ * starts its own to log the new i_disksize.  A crash before writeback
+ * leaves the tail of the file as a hole which reads back as zeroes.
+ */
+static int ext3_da_commit_write(struct file *file, struct page *page,
+				unsigned from, unsigned to)
+{
+	struct inode *inode = page->mapping->host;
+	loff_t new_i_size;
+
+	new_i_size = ((loff_t)page->index << PAGE_CACHE_SHIFT) + to;
+	if (new_i_size > EXT3_I(inode)->i_disksize)
+		EXT3_I(inode)->i_disksize = new_i_size;
+	return generic_commit_write(file, page, from, to);
+}
+
+/*
+ * Allocate @len blocks from logical block @lblk on for the delayed
+ * buffers of @pages, which hold consecutive page indices.  The space
+ * promised to them is given back just before the allocator charges it
+ * again, and taken back for whatever could not be allocated.
+ */
+static int ext3_da_alloc_run(handle_t *handle, struct inode *inode,
+			     struct page **pages, sector_t lblk,
+			     unsigned long len)
+{
+	int needed = ext3_writepage_trans_blocks(inode);
+	int bbits = inode->i_blkbits;
+	sector_t first = (sector_t)pages[0]->index << (PAGE_CACHE_SHIFT - bbits);
+	struct buffer_head dummy, *bh;
+	int ret = 0;
+
+	while (len) {
+		sector_t pblk;
+		unsigned long i;
+
+		if (handle->h_buffer_credits < needed) {
+			ret = ext3_journal_extend(handle, needed);
+			if (ret > 0)
+				ret = ext3_journal_restart(handle, needed);
+			if (ret)
+				break;
+		}
+
+		ext3_da_release_space(inode, len);
+		dummy.b_state = 0;
+		dummy.b_blocknr = -1000;
+		buffer_trace_init(&dummy.b_history);
+		ret = ext3_ext_get_blocks(handle, inode, lblk, len, &dummy, 1, 1);
+		if (ret <= 0) {
+			ext3_da_reserve_space(inode, len);
+			if (ret == 0)
+				ret = -EIO;
+			break;
+		}
+
+		pblk = dummy.b_blocknr;
+		for (i = 0; i < ret; i++, lblk++, pblk++) {
+			unsigned long off = lblk - first;
+
+			bh = page_buffers(pages[off >> (PAGE_CACHE_SHIFT - bbits)]);
+			off &= (1 << (PAGE_CACHE_SHIFT - bbits)) - 1;
+			while (off--)
+				bh = bh->b_this_page;
+			bh->b_blocknr = pblk;
+			clear_buffer_delay(bh);
+			if (buffer_new(&dummy))
+				unmap_underlying_metadata(bh->b_bdev, pblk);
+		}
+		len -= ret;
+		ret = 0;
+	}
+	if (!ret)
+		ret = ext3_mark_inode_dirty(handle, inode);
+	return ret;
+}
+
+/*
+ * Give every delayed buffer of @page a real block.  While the delayed
+ * blocks run up to the end of a page, the following dirty pages which
+ * can be locked without waiting join in, so that one extent covers all
+ * of them.
+ */
+static int ext3_da_map_pages(handle_t *handle, struct page *page,
+			     struct writeback_control *wbc)
+{
+	struct address_space *mapping = page->mapping;
+	struct inode *inode = mapping->host;
+	struct page *pages[EXT3_DA_MAX_PAGES];
+	struct buffer_head *head, *bh;
+	sector_t lblk, start = 0;
+	unsigned long len = 0;
+	int nr_pages = 1, i, ret = 0;
+
+	if (!ext3_da_delayed_buffers(page, 0))
+		return 0;
+
+	pages[0] = page;
+	while (!wbc->for_reclaim && nr_pages < EXT3_DA_MAX_PAGES) {
+		struct page *next;
+
+		/* only a run reaching the end of the page carries on */
+		head = page_buffers(pages[nr_pages - 1]);
+		for (bh = head; bh->b_this_page != head; bh = bh->b_this_page)
+			;
+		if (!buffer_delay(bh))
+			break;
+
+		next = find_get_page(mapping, page->index + nr_pages);
+		if (!next)
+			break;
+		if (TestSetPageLocked(next)) {
+			page_cache_release(next);
+			break;
+		}
+		if (next->mapping != mapping || !PageDirty(next) ||
+		    PageWriteback(next) || !page_has_buffers(next) ||
+		    !buffer_delay(page_buffers(next))) {
+			unlock_page(next);
+			page_cache_release(next);
+			break;
+		}
+		pages[nr_pages++] = next;
+	}
+
+	lblk = (sector_t)page->index << (PAGE_CACHE_SHIFT - inode->i_blkbits);
+	for (i = 0; i < nr_pages && !ret; i++) {
+		head = bh = page_buffers(pages[i]);
+		do {
+			if (buffer_delay(bh)) {
+				if (!len++)
+					start = lblk;
+			} else if (len) {
+				ret = ext3_da_alloc_run(handle, inode, pages,
+							start, len);
+				len = 0;
+				if (ret)
+					break;
+			}
+			lblk++;
+			bh = bh->b_this_page;
+		} while (bh != head);
+	}
+	if (len && !ret)
+		ret = ext3_da_alloc_run(handle, inode, pages, start, len);
+
+	/* the other pages stay dirty and are written when writeback gets there */
+	for (i = 1; i < nr_pages; i++) {
+		unlock_page(pages[i]);
+		page_cache_release(pages[i]);
+	}
+	return ret;
+}
+
+static int ext3_da_writepage(struct page *page,
+				struct writeback_control *wbc)
+{
+	struct inode *inode = page->mapping->host;
+	handle_t *handle = NULL;
+	int ret = 0;
+	int err;
+
+	if (ext3_journal_current_handle())
+		goto out_fail;
+
+	handle = ext3_journal_start(inode, ext3_writepage_trans_blocks(inode));
+	if (IS_ERR(handle)) {
+		ret = PTR_ERR(handle);
+		goto out_fail;
+	}
+
+	ret = ext3_da_map_pages(handle, page, wbc);
+	if (ret) {
+		ext3_journal_stop(handle);
+		goto out_fail;
+	}
+	ret = block_write_full_page(page, ext3_get_block, wbc);
+
+	err = ext3_journal_stop(handle);
+	if (!ret)
+		ret = err;
+	return ret;
+
+out_fail:
+	redirty_page_for_writepage(wbc, page);
+	unlock_page(page);
+	return ret;
+}
+
 static int ext3_journalled_writepage(struct page *page,
 				struct writeback_control *wbc)
 {
@@ -1483,7 +2023,8 @@ static int
 ext3_readpages(struct file *file, struct address_space *mapping,
 		struct list_head *pages, unsigned nr_pages)
 {
-	return mpage_readpages(mapping, pages, nr_pages, ext3_get_block);
+	return mpage_readpages_blocks(mapping, pages, nr_pages, ext3_get_block,
+				      ext3_readpages_get_blocks);
 }
 
 static int ext3_invalidatepage(struct page *page, unsigned long offset)
@@ -1509,6 +2050,47 @@ static int ext3_releasepage(struct page *page, int wait)
 	return journal_try_to_free_buffers(journal, page, wait);
 }
 
+static int ext3_da_invalidatepage(struct page *page, unsigned long offset)
+{
+	unsigned long delayed = ext3_da_delayed_buffers(page, offset);
+
+	if (delayed) {
+		struct buffer_head *head, *bh;
+		unsigned long curr_off = 0;
+
+		/* journal_invalidatepage() does not know about BH_Delay */
+		head = bh = page_buffers(page);
+		do {
+			if (curr_off >= offset)
+				clear_buffer_delay(bh);
+			curr_off += bh->b_size;
+			bh = bh->b_this_page;
+		} while (bh != head);
+		ext3_da_release_space(page->mapping->host, delayed);
+	}
+	return ext3_invalidatepage(page, offset);
+}
+
+/* A write which failed to copy anything can leave clean delayed buffers */
+static int ext3_da_releasepage(struct page *page, int wait)
+{
+	unsigned long delayed = ext3_da_delayed_buffers(page, 0);
+	int ret;
+
+	ret = ext3_releasepage(page, wait);
+	if (ret && delayed)
+		ext3_da_release_space(page->mapping->host, delayed);
+	return ret;
+}
+
+/* Delayed blocks have no number until they are written out */
+static sector_t ext3_da_bmap(struct address_space *mapping, sector_t block)
+{
+	if (mapping_tagged(mapping, PAGECACHE_TAG_DIRTY))
+		filemap_write_and_wait(mapping);
+	return ext3_bmap(mapping, block);
+}
+
 /*
  * If the O_DIRECT write will extend the file then add this inode to the
  * orphan list.  So recovery will truncate it back to the original size
@@ -1631,6 +2213,23 @@ static struct address_space_operations ext3_writeback_aops = {
 	.direct_IO	= ext3_direct_IO,
 };
 
+/*
+ * No .writepages: generic_writepages() calls ext3_da_writepage() page by
+ * page, and the first delayed page of a run allocates for the others.
+ */
+static struct address_space_operations ext3_da_aops = {
+	.readpage	= ext3_readpage,
+	.readpages	= ext3_readpages,
+	.writepage	= ext3_da_writepage,
+	.sync_page	= block_sync_page,
+	.prepare_write	= ext3_da_prepare_write,
+	.commit_write	= ext3_da_commit_write,
+	.bmap		= ext3_da_bmap,
+	.invalidatepage	= ext3_da_invalidatepage,
+	.releasepage	= ext3_da_releasepage,
+	.direct_IO	= ext3_direct_IO,
+};
+
 static struct address_space_operations ext3_journalled_aops = {
 	.readpage	= ext3_readpage,
 	.readpages	= ext3_readpages,
@@ -1648,6 +2247,10 @@ void ext3_set_aops(struct inode *inode)
 {
 	if (ext3_should_order_data(inode))
 		inode->i_mapping->a_ops = &ext3_ordered_aops;
+	else if (ext3_should_writeback_data(inode) &&
+		 test_opt(inode->i_sb, DELALLOC) &&
+		 (EXT3_I(inode)->i_flags & EXT3_EXTENTS_FL))
+		inode->i_mapping->a_ops = &ext3_da_aops;
 	else if (ext3_should_writeback_data(inode))
 		inode->i_mapping->a_ops = &ext3_writeback_aops;
 	else
@@ -2188,9 +2791,12 @@ void ext3_truncate(struct inode * inode)
 	if (page)
 		ext3_block_truncate_page(handle, page, mapping, inode->i_size);
 
-	n = ext3_block_to_path(inode, last_block, offsets, NULL);
-	if (n == 0)
-		goto out_stop;	/* error */
+	n = 0;
+	if (!(ei->i_flags & EXT3_EXTENTS_FL)) {
+		n = ext3_block_to_path(inode, last_block, offsets, NULL);
+		if (n == 0)
+			goto out_stop;	/* error */
+	}
 
 	/*
 	 * OK.  This truncate is going to happen.  We add the inode to the
@@ -2219,6 +2825,11 @@ void ext3_truncate(struct inode * inode)
 	 */
 	down(&ei->truncate_sem);
 
+	if (ei->i_flags & EXT3_EXTENTS_FL) {
+		ext3_ext_truncate(handle, inode, last_block);
+		goto out_discard;
+	}
+
 	if (n == 1) {		/* direct blocks */
 		ext3_free_data(handle, inode, NULL, i_data+offsets[0],
 			       i_data + EXT3_NDIR_BLOCKS);
@@ -2282,6 +2893,7 @@ do_indirects:
 			;
 	}
 
+out_discard:
 	ext3_discard_reservation(inode);
 
 	up(&ei->truncate_sem);
@@ -2921,6 +3533,9 @@ static int ext3_writepage_trans_blocks(struct inode *inode)
 	int indirects = (EXT3_NDIR_BLOCKS % bpp) ? 5 : 3;
 	int ret;
 
+	if (EXT3_I(inode)->i_flags & EXT3_EXTENTS_FL)
+		indirects = ext3_ext_index_trans_blocks(inode);
+
 	if (ext3_should_journal_data(inode))
 		ret = 3 * (bpp + indirects) + 2;
 	else
@@ -3098,6 +3713,10 @@ int ext3_change_inode_journal_flag(struct inode *inode, int val)
 	if (is_journal_aborted(journal) || IS_RDONLY(inode))
 		return -EROFS;
 
+	/* delayed buffers must get their blocks before the aops change */
+	if (inode->i_mapping->a_ops == &ext3_da_aops)
+		filemap_write_and_wait(inode->i_mapping);
+
 	journal_lock_updates(journal);
 	journal_flush(journal);
 
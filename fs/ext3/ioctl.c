@@ -192,6 +192,27 @@ flags_err:
 		up(&ei->truncate_sem);
 		return 0;
 	}
+	case EXT3_IOC_DEFRAG: {
+		struct ext3_defrag_range range;
+		int err;
+
+		if (!(filp->f_mode & FMODE_WRITE))
+			return -EBADF;
+
+		if (IS_RDONLY(inode))
+			return -EROFS;
+
+		if (copy_from_user(&range,
+				   (struct ext3_defrag_range __user *)arg,
+				   sizeof(range)))
+			return -EFAULT;
+
+		err = ext3_defrag(filp, &range);
+		if (copy_to_user((struct ext3_defrag_range __user *)arg,
+				 &range, sizeof(range)))
+			return -EFAULT;
+		return err;
+	}
 	case EXT3_IOC_GROUP_EXTEND: {
 		unsigned long n_blocks_count;
 		struct super_block *sb = inode->i_sb;
@@ -393,6 +393,7 @@ static void ext3_put_super (struct super_block * sb)
 	percpu_counter_destroy(&sbi->s_freeblocks_counter);
 	percpu_counter_destroy(&sbi->s_freeinodes_counter);
 	percpu_counter_destroy(&sbi->s_dirs_counter);
+	percpu_counter_destroy(&sbi->s_dirtyblocks_counter);
 	brelse(sbi->s_sbh);
 #ifdef CONFIG_QUOTA
 	for (i = 0; i < MAXQUOTAS; i++)
@@ -440,6 +441,7 @@ static struct inode *ext3_alloc_inode(struct super_block *sb)
 	ei->i_default_acl = EXT3_ACL_NOT_CACHED;
 #endif
 	ei->i_block_alloc_info = NULL;
+	ei->i_reserved_blocks = 0;
 	ei->vfs_inode.i_version = 1;
 	return &ei->vfs_inode;
 }
@@ -468,7 +470,7 @@ static int init_inodecache(void)
 {
 	ext3_inode_cachep = kmem_cache_create("ext3_inode_cache",
 					     sizeof(struct ext3_inode_info),
-					     0, SLAB_RECLAIM_ACCOUNT,
+					     0, SLAB_RECLAIM_ACCOUNT|SLAB_MEM_SPREAD,
 					     init_once, NULL);
 	if (ext3_inode_cachep == NULL)
 		return -ENOMEM;
@@ -578,7 +580,9 @@ enum {
 	Opt_nouid32, Opt_check, Opt_nocheck, Opt_debug, Opt_oldalloc, Opt_orlov,
 	Opt_user_xattr, Opt_nouser_xattr, Opt_acl, Opt_noacl,
 	Opt_reservation, Opt_noreservation, Opt_noload, Opt_nobh,
-	Opt_commit, Opt_journal_update, Opt_journal_inum,
+	Opt_extents, Opt_noextents, Opt_delalloc, Opt_nodelalloc,
+	Opt_journal_checksum, Opt_journal_async_commit,
+	Opt_commit, Opt_min_batch_time, Opt_max_batch_time, Opt_journal_update, Opt_journal_inum,
 	Opt_abort, Opt_data_journal, Opt_data_ordered, Opt_data_writeback,
 	Opt_usrjquota, Opt_grpjquota, Opt_offusrjquota, Opt_offgrpjquota,
 	Opt_jqfmt_vfsold, Opt_jqfmt_vfsv0,
@@ -613,7 +617,15 @@ static match_table_t tokens = {
 	{Opt_noreservation, "noreservation"},
 	{Opt_noload, "noload"},
 	{Opt_nobh, "nobh"},
+	{Opt_extents, "extents"},
+	{Opt_noextents, "noextents"},
+	{Opt_delalloc, "delalloc"},
+	{Opt_nodelalloc, "nodelalloc"},
+	{Opt_journal_checksum, "journal_checksum"},
+	{Opt_journal_async_commit, "journal_async_commit"},
 	{Opt_commit, "commit=%u"},
+	{Opt_min_batch_time, "min_batch_time=%u"},
+	{Opt_max_batch_time, "max_batch_time=%u"},
 	{Opt_journal_update, "journal=update"},
 	{Opt_journal_inum, "journal=%u"},
 	{Opt_abort, "abort"},
@@ -809,6 +821,20 @@ static int parse_options (char * options, struct super_block *sb,
 				option = JBD_DEFAULT_MAX_COMMIT_AGE;
 			sbi->s_commit_interval = HZ * option;
 			break;
+		case Opt_min_batch_time:
+			if (match_int(&args[0], &option))
+				return 0;
+			if (option < 0)
+				return 0;
+			sbi->s_min_batch_time = option;
+			break;
+		case Opt_max_batch_time:
+			if (match_int(&args[0], &option))
+				return 0;
+			if (option < 0)
+				return 0;
+			sbi->s_max_batch_time = option;
+			break;
 		case Opt_data_journal:
 			data_opt = EXT3_MOUNT_JOURNAL_DATA;
 			goto datacheck;
@@ -927,6 +953,25 @@ clear_qf_name:
 		case Opt_nobh:
 			set_opt(sbi->s_mount_opt, NOBH);
 			break;
+		case Opt_extents:
+			set_opt (sbi->s_mount_opt, EXTENTS);
+			break;
+		case Opt_noextents:
+			clear_opt (sbi->s_mount_opt, EXTENTS);
+			break;
+		case Opt_delalloc:
+			set_opt (sbi->s_mount_opt, DELALLOC);
+			break;
+		case Opt_nodelalloc:
+			clear_opt (sbi->s_mount_opt, DELALLOC);
+			break;
+		case Opt_journal_checksum:
+			set_opt (sbi->s_mount_opt, JOURNAL_CHECKSUM);
+			break;
+		case Opt_journal_async_commit:
+			set_opt (sbi->s_mount_opt, JOURNAL_ASYNC_COMMIT);
+			set_opt (sbi->s_mount_opt, JOURNAL_CHECKSUM);
+			break;
 		default:
 			printk (KERN_ERR
 				"EXT3-fs: Unrecognized mount option \"%s\" "
@@ -1259,6 +1304,8 @@ static int ext3_fill_super (struct super_block *sb, void *data, int silent)
 	sbi->s_mount_opt = 0;
 	sbi->s_resuid = EXT3_DEF_RESUID;
 	sbi->s_resgid = EXT3_DEF_RESGID;
+	sbi->s_min_batch_time = JBD_DEFAULT_MIN_BATCH_TIME;
+	sbi->s_max_batch_time = JBD_DEFAULT_MAX_BATCH_TIME;
 
 	unlock_kernel();
 
@@ -1477,6 +1524,7 @@ static int ext3_fill_super (struct super_block *sb, void *data, int silent)
 	percpu_counter_init(&sbi->s_freeblocks_counter);
 	percpu_counter_init(&sbi->s_freeinodes_counter);
 	percpu_counter_init(&sbi->s_dirs_counter);
+	percpu_counter_init(&sbi->s_dirtyblocks_counter);
 	bgl_lock_init(&sbi->s_blockgroup_lock);
 
 	for (i = 0; i < db_count; i++) {
@@ -1572,6 +1620,27 @@ static int ext3_fill_super (struct super_block *sb, void *data, int silent)
 		break;
 	}
 
+	/*
+	 * Journal checksums only get turned on, never off: a log written
+	 * with async commits must not be replayed by a kernel which would
+	 * trust its commit blocks blindly.
+	 */
+	if (test_opt(sb, JOURNAL_CHECKSUM) && !(sb->s_flags & MS_RDONLY)) {
+		unsigned long incompat = 0;
+
+		if (test_opt(sb, JOURNAL_ASYNC_COMMIT))
+			incompat = JFS_FEATURE_INCOMPAT_ASYNC_COMMIT;
+		if (!journal_check_used_features(sbi->s_journal,
+				JFS_FEATURE_COMPAT_CHECKSUM, 0, incompat)) {
+			if (journal_set_features(sbi->s_journal,
+				    JFS_FEATURE_COMPAT_CHECKSUM, 0, incompat))
+				journal_update_superblock(sbi->s_journal, 1);
+			else
+				printk(KERN_WARNING "EXT3-fs: journal does "
+				       "not support checksums\n");
+		}
+	}
+
 	if (test_opt(sb, NOBH)) {
 		if (sb->s_blocksize_bits != PAGE_CACHE_SHIFT) {
 			printk(KERN_WARNING "EXT3-fs: Ignoring nobh option "
@@ -1676,6 +1745,8 @@ static void ext3_init_journal_params(struct super_block *sb, journal_t *journal)
 	 * default. */
 
 	spin_lock(&journal->j_state_lock);
+	journal->j_min_batch_time = sbi->s_min_batch_time;
+	journal->j_max_batch_time = sbi->s_max_batch_time;
 	if (test_opt(sb, BARRIER))
 		journal->j_flags |= JFS_BARRIER;
 	else
@@ -2157,6 +2228,7 @@ static int ext3_statfs (struct super_block * sb, struct kstatfs * buf)
 {
 	struct ext3_super_block *es = EXT3_SB(sb)->s_es;
 	unsigned long overhead;
+	long dirty;
 	int i;
 
 	if (test_opt (sb, MINIX_DF))
@@ -2198,6 +2270,11 @@ static int ext3_statfs (struct super_block * sb, struct kstatfs * buf)
 	buf->f_bsize = sb->s_blocksize;
 	buf->f_blocks = le32_to_cpu(es->s_blocks_count) - overhead;
 	buf->f_bfree = ext3_count_free_blocks (sb);
+	/* blocks promised to delayed allocations are as good as used */
+	dirty = percpu_counter_read(&EXT3_SB(sb)->s_dirtyblocks_counter);
+	if (dirty > 0)
+		buf->f_bfree = buf->f_bfree > (unsigned long)dirty ?
+			buf->f_bfree - dirty : 0;
 	buf->f_bavail = buf->f_bfree - le32_to_cpu(es->s_r_blocks_count);
 	if (buf->f_bfree < le32_to_cpu(es->s_r_blocks_count))
 		buf->f_bavail = 0;
@@ -151,7 +151,7 @@ asmlinkage long sys_dup2(unsigned int oldfd, unsigned int newfd)
 	if (!tofree && FD_ISSET(newfd, files->open_fds))
 		goto out_fput;
 
-	files->fd[newfd] = file;
+	rcu_assign_pointer(files->fd[newfd], file);
 	FD_SET(newfd, files->open_fds);
 	FD_CLR(newfd, files->close_on_exec);
 	spin_unlock(&files->file_lock);
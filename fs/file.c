@@ -97,11 +97,8 @@ static int expand_fd_array(struct files_struct *files, int nr)
 	/* Copy the existing array and install the new pointer */
 
 	if (nfds > files->max_fds) {
-		struct file **old_fds;
-		int i;
-		
-		old_fds = xchg(&files->fd, new_fds);
-		i = xchg(&files->max_fds, nfds);
+		struct file **old_fds = files->fd;
+		int i = files->max_fds;
 
 		/* Don't copy/clear the array if we are creating a new
 		   fd array for fork() */
@@ -110,8 +107,20 @@ static int expand_fd_array(struct files_struct *files, int nr)
 			/* clear the remainder of the array */
 			memset(&new_fds[i], 0,
 			       (nfds-i) * sizeof(struct file *)); 
+		}
 
+		/*
+		 * fget() looks at max_fds before fd without file_lock, so
+		 * the new array has to be complete and visible first.
+		 */
+		rcu_assign_pointer(files->fd, new_fds);
+		smp_wmb();
+		files->max_fds = nfds;
+
+		if (i) {
 			spin_unlock(&files->file_lock);
+			/* ... and it may still be reading the old array */
+			synchronize_kernel();
 			free_fd_array(old_fds, i);
 			spin_lock(&files->file_lock);
 		}
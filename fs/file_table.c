@@ -14,8 +14,11 @@
 #include <linux/fs.h>
 #include <linux/security.h>
 #include <linux/eventpoll.h>
+#include <linux/fsnotify.h>
 #include <linux/mount.h>
 #include <linux/cdev.h>
+#include <linux/sysctl.h>
+#include <linux/percpu_counter.h>
 
 /* sysctl tunables... */
 struct files_stat_struct files_stat = {
@@ -27,36 +30,55 @@ EXPORT_SYMBOL(files_stat); /* Needed by unix.o */
 /* public. Not pretty! */
  __cacheline_aligned_in_smp DEFINE_SPINLOCK(files_lock);
 
-static DEFINE_SPINLOCK(filp_count_lock);
-
-/* slab constructors and destructors are called from arbitrary
- * context and must be fully threaded - use a local spinlock
- * to protect files_stat.nr_files
+/*
+ * Number of allocated struct files.  Every open and close updates it, so
+ * it is kept per-CPU and only folded into the global count in batches;
+ * readers get an approximation unless they ask for the exact sum.
  */
-void filp_ctor(void * objp, struct kmem_cache_s *cachep, unsigned long cflags)
-{
-	if ((cflags & (SLAB_CTOR_VERIFY|SLAB_CTOR_CONSTRUCTOR)) ==
-	    SLAB_CTOR_CONSTRUCTOR) {
-		unsigned long flags;
-		spin_lock_irqsave(&filp_count_lock, flags);
-		files_stat.nr_files++;
-		spin_unlock_irqrestore(&filp_count_lock, flags);
-	}
-}
+static struct percpu_counter nr_files __cacheline_aligned_in_smp;
 
-void filp_dtor(void * objp, struct kmem_cache_s *cachep, unsigned long dflags)
+static void file_free_rcu(struct rcu_head *head)
 {
-	unsigned long flags;
-	spin_lock_irqsave(&filp_count_lock, flags);
-	files_stat.nr_files--;
-	spin_unlock_irqrestore(&filp_count_lock, flags);
+	struct file *f = container_of(head, struct file, f_rcuhead);
+
+	kmem_cache_free(filp_cachep, f);
 }
 
+/* fget() may still be looking at it, see there */
 static inline void file_free(struct file *f)
 {
-	kmem_cache_free(filp_cachep, f);
+	percpu_counter_dec(&nr_files);
+	call_rcu(&f->f_rcuhead, file_free_rcu);
+}
+
+/*
+ * Return the total number of open files in the system
+ */
+int get_nr_files(void)
+{
+	return percpu_counter_read_positive(&nr_files);
 }
 
+EXPORT_SYMBOL_GPL(get_nr_files);
+
+/*
+ * Handle nr_files sysctl
+ */
+#if defined(CONFIG_SYSCTL) && defined(CONFIG_PROC_FS)
+int proc_nr_files(ctl_table *table, int write, struct file *filp,
+		  void __user *buffer, size_t *lenp, loff_t *ppos)
+{
+	files_stat.nr_files = percpu_counter_sum(&nr_files);
+	return proc_dointvec(table, write, filp, buffer, lenp, ppos);
+}
+#else
+int proc_nr_files(ctl_table *table, int write, struct file *filp,
+		  void __user *buffer, size_t *lenp, loff_t *ppos)
+{
+	return -ENOSYS;
+}
+#endif
+
 /* Find an unused file structure and return a pointer to it.
  * Returns NULL, if there are no more free file structures or
  * we run out of memory.
@@ -67,37 +89,44 @@ static int old_max;
 	struct file * f;
 
 	/*
-	 * Privileged users can go above max_files
+	 * Privileged users can go above max_files.  The per-CPU approximation
+	 * is good enough as long as we are well below the limit; only pay
+	 * for the exact sum when we get close to it.
 	 */
-	if (files_stat.nr_files < files_stat.max_files ||
-				capable(CAP_SYS_ADMIN)) {
-		f = kmem_cache_alloc(filp_cachep, GFP_KERNEL);
-		if (f) {
-			memset(f, 0, sizeof(*f));
-			if (security_file_alloc(f)) {
-				file_free(f);
-				goto fail;
-			}
-			eventpoll_init_file(f);
-			atomic_set(&f->f_count, 1);
-			f->f_uid = current->fsuid;
-			f->f_gid = current->fsgid;
-			rwlock_init(&f->f_owner.lock);
-			/* f->f_version: 0 */
-			INIT_LIST_HEAD(&f->f_list);
-			f->f_maxcount = INT_MAX;
-			return f;
+	if (get_nr_files() >= files_stat.max_files && !capable(CAP_SYS_ADMIN)) {
+		if (percpu_counter_sum(&nr_files) >= files_stat.max_files)
+			goto over;
+	}
+
+	f = kmem_cache_alloc(filp_cachep, GFP_KERNEL);
+	if (f) {
+		percpu_counter_inc(&nr_files);
+		memset(f, 0, sizeof(*f));
+		if (security_file_alloc(f)) {
+			file_free(f);
+			goto fail;
 		}
+		eventpoll_init_file(f);
+		atomic_set(&f->f_count, 1);
+		f->f_uid = current->fsuid;
+		f->f_gid = current->fsgid;
+		rwlock_init(&f->f_owner.lock);
+		/* f->f_version: 0 */
+		INIT_LIST_HEAD(&f->f_list);
+		f->f_maxcount = INT_MAX;
+		return f;
 	}
 
+	/* Big problems... */
+	printk(KERN_WARNING "VFS: filp allocation failed\n");
+	goto fail;
+
+over:
 	/* Ran out of filps - report that */
 	if (files_stat.max_files >= old_max) {
 		printk(KERN_INFO "VFS: file-max limit %d reached\n",
 					files_stat.max_files);
 		old_max = files_stat.max_files;
-	} else {
-		/* Big problems... */
-		printk(KERN_WARNING "VFS: filp allocation failed\n");
 	}
 fail:
 	return NULL;
@@ -123,6 +152,8 @@ void fastcall __fput(struct file *file)
 	struct inode *inode = dentry->d_inode;
 
 	might_sleep();
+
+	fsnotify_close(file);
 	/*
 	 * The function eventpoll_release() should be the first called
 	 * in the file cleanup chain.
@@ -146,10 +177,42 @@ void fastcall __fput(struct file *file)
 	mntput(mnt);
 }
 
-struct file fastcall *fget(unsigned int fd)
+#ifdef __HAVE_ARCH_CMPXCHG
+/*
+ * Look up and take a reference to a file in a possibly shared fd table
+ * without file_lock.  The file found may be closed under us at any time;
+ * if its last reference is already gone we treat the fd as closed, as the
+ * struct file stays around only until file_free()'s grace period is over.
+ */
+static inline struct file *fget_shared(struct files_struct *files,
+				       unsigned int fd)
+{
+	struct file *file;
+	int count, old;
+
+	rcu_read_lock();
+	file = fcheck_files_rcu(files, fd);
+	if (file) {
+		count = atomic_read(&file->f_count);
+		for (;;) {
+			if (!count) {
+				file = NULL;
+				break;
+			}
+			old = cmpxchg(&file->f_count.counter, count, count + 1);
+			if (old == count)
+				break;
+			count = old;
+		}
+	}
+	rcu_read_unlock();
+	return file;
+}
+#else
+static inline struct file *fget_shared(struct files_struct *files,
+				       unsigned int fd)
 {
 	struct file *file;
-	struct files_struct *files = current->files;
 
 	spin_lock(&files->file_lock);
 	file = fcheck_files(files, fd);
@@ -158,6 +221,12 @@ struct file fastcall *fget(unsigned int fd)
 	spin_unlock(&files->file_lock);
 	return file;
 }
+#endif
+
+struct file fastcall *fget(unsigned int fd)
+{
+	return fget_shared(current->files, fd);
+}
 
 EXPORT_SYMBOL(fget);
 
@@ -177,13 +246,9 @@ struct file fastcall *fget_light(unsigned int fd, int *fput_needed)
 	if (likely((atomic_read(&files->count) == 1))) {
 		file = fcheck_files(files, fd);
 	} else {
-		spin_lock(&files->file_lock);
-		file = fcheck_files(files, fd);
-		if (file) {
-			get_file(file);
+		file = fget_shared(files, fd);
+		if (file)
 			*fput_needed = 1;
-		}
-		spin_unlock(&files->file_lock);
 	}
 	return file;
 }
@@ -252,4 +317,5 @@ void __init files_init(unsigned long mempages)
 	files_stat.max_files = n; 
 	if (files_stat.max_files < NR_FILE)
 		files_stat.max_files = NR_FILE;
+	percpu_counter_init(&nr_files);
 } 
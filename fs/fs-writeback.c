@@ -347,6 +347,18 @@ sync_sb_inodes(struct super_block *sb, struct writeback_control *wbc)
 			continue;		/* blockdev has wrong queue */
 		}
 
+		/*
+		 * Queues with their own flusher thread are left to it by
+		 * pdflush's background and kupdate walks
+		 */
+		if (!wbc->bdi && bdi->flusher && current_is_pdflush() &&
+				wbc->sync_mode == WB_SYNC_NONE) {
+			if (sb != blockdev_superblock)
+				break;
+			list_move(&inode->i_list, &sb->s_dirty);
+			continue;
+		}
+
 		/* Was this inode dirtied after sync_sb_inodes was called? */
 		if (time_after(inode->dirtied_when, start))
 			break;
@@ -15,6 +15,7 @@
 #include <linux/file.h>
 #include <linux/writeback.h>
 #include <linux/pagemap.h>
+#include <linux/mman.h>
 #include <linux/highmem.h>
 #include <linux/init.h>
 #include <linux/string.h>
@@ -223,12 +224,12 @@ static void hugetlbfs_delete_inode(struct inode *inode)
 {
 	struct hugetlbfs_sb_info *sbinfo = HUGETLBFS_SB(inode->i_sb);
 
-	hlist_del_init(&inode->i_hash);
 	list_del_init(&inode->i_list);
 	list_del_init(&inode->i_sb_list);
 	inode->i_state |= I_FREEING;
 	inodes_stat.nr_inodes--;
 	spin_unlock(&inode_lock);
+	remove_inode_hash(inode);
 
 	if (inode->i_data.nrpages)
 		truncate_hugepages(&inode->i_data, 0);
@@ -265,13 +266,13 @@ static void hugetlbfs_forget_inode(struct inode *inode)
 
 	/* write_inode_now() ? */
 	inodes_stat.nr_unused--;
-	hlist_del_init(&inode->i_hash);
 out_truncate:
 	list_del_init(&inode->i_list);
 	list_del_init(&inode->i_sb_list);
 	inode->i_state |= I_FREEING;
 	inodes_stat.nr_inodes--;
 	spin_unlock(&inode_lock);
+	remove_inode_hash(inode);
 	if (inode->i_data.nrpages)
 		truncate_hugepages(&inode->i_data, 0);
 
@@ -754,7 +755,7 @@ static int can_do_hugetlb_shm(void)
 			can_do_mlock());
 }
 
-struct file *hugetlb_zero_setup(size_t size)
+static struct file *hugetlb_file_setup(size_t size, int shm_account)
 {
 	int error = -ENOMEM;
 	struct file *file;
@@ -769,7 +770,7 @@ struct file *hugetlb_zero_setup(size_t size)
 	if (!is_hugepage_mem_enough(size))
 		return ERR_PTR(-ENOMEM);
 
-	if (!user_shm_lock(size, current->user))
+	if (shm_account && !user_shm_lock(size, current->user))
 		return ERR_PTR(-ENOMEM);
 
 	root = hugetlbfs_vfsmount->mnt_root;
@@ -807,10 +808,107 @@ out_file:
 out_dentry:
 	dput(dentry);
 out_shm_unlock:
-	user_shm_unlock(size, current->user);
+	if (shm_account)
+		user_shm_unlock(size, current->user);
 	return ERR_PTR(error);
 }
 
+struct file *hugetlb_zero_setup(size_t size)
+{
+	return hugetlb_file_setup(size, 1);
+}
+
+/*
+ * Fill a huge page from file, starting at pos.  Past EOF the page is left
+ * zeroed, as alloc_huge_page() hands it out.
+ */
+static int hugetlb_fill_page(struct file *file, struct page *page, loff_t pos)
+{
+	int i, ret;
+
+	for (i = 0; i < HPAGE_SIZE / PAGE_SIZE; i++, pos += PAGE_SIZE) {
+		ret = kernel_read(file, pos, kmap(page + i), PAGE_SIZE);
+		kunmap(page + i);
+		if (ret < 0)
+			return ret;
+		if (ret < PAGE_SIZE)
+			break;
+	}
+	return 0;
+}
+
+/*
+ * mmap(MAP_LARGEPAGE) of a regular file: map a read-only snapshot of the
+ * range in huge pages, copied in from the file at mmap time.  The mapping
+ * does not see later changes to the file.  The huge pages come from the
+ * hugetlb pool, under the same permission check as SHM_HUGETLB; if they
+ * can't be had the caller falls back to an ordinary mapping.
+ *
+ * Called from do_mmap_pgoff() with mmap_sem held.
+ */
+unsigned long hugetlb_mmap_file(struct file *file, unsigned long addr,
+		unsigned long len, unsigned long prot, unsigned long flags,
+		unsigned long pgoff)
+{
+	struct address_space *mapping;
+	struct file *hfile;
+	unsigned long idx, nr;
+	loff_t pos;
+	int error;
+
+	if ((prot & PROT_WRITE) || (pgoff & (HPAGE_SIZE / PAGE_SIZE - 1)))
+		return -EINVAL;
+	if (!S_ISREG(file->f_dentry->d_inode->i_mode) ||
+	    !(file->f_mode & FMODE_READ))
+		return -EINVAL;
+
+	len = ALIGN(len, HPAGE_SIZE);
+	if (!len)
+		return -ENOMEM;
+
+	hfile = hugetlb_file_setup(len, 0);
+	if (IS_ERR(hfile))
+		return PTR_ERR(hfile);
+	mapping = hfile->f_mapping;
+
+	nr = len >> HPAGE_SHIFT;
+	pos = (loff_t)pgoff << PAGE_SHIFT;
+	for (idx = 0; idx < nr; idx++, pos += HPAGE_SIZE) {
+		struct page *page;
+
+		error = -ENOMEM;
+		if (hugetlb_get_quota(mapping))
+			goto out;
+		page = alloc_huge_page();
+		if (!page) {
+			hugetlb_put_quota(mapping);
+			goto out;
+		}
+
+		error = hugetlb_fill_page(file, page, pos);
+		if (!error)
+			error = add_to_page_cache(page, mapping, idx, GFP_KERNEL);
+		if (error) {
+			hugetlb_put_quota(mapping);
+			free_huge_page(page);
+			goto out;
+		}
+		unlock_page(page);
+		put_page(page);
+	}
+
+	/* no FMODE_WRITE, so this can never be made writable */
+	hfile->f_mode = FMODE_READ;
+	addr = do_mmap_pgoff(hfile, addr, len, PROT_READ | (prot & PROT_EXEC),
+			MAP_SHARED | (flags & MAP_FIXED), 0);
+	fput(hfile);
+	return addr;
+out:
+	/* the page cache of the unlinked file goes with it */
+	fput(hfile);
+	return error;
+}
+
 static int __init init_hugetlbfs_fs(void)
 {
 	int error;
@@ -21,6 +21,7 @@
 #include <linux/pagemap.h>
 #include <linux/cdev.h>
 #include <linux/bootmem.h>
+#include <linux/inotify.h>
 
 /*
  * This is needed for the following functions:
@@ -75,7 +76,29 @@ LIST_HEAD(inode_unused);
 static struct hlist_head *inode_hashtable;
 
 /*
- * A simple spinlock to protect the list manipulations.
+ * The hash chains are protected by an array of spinlocks, each covering
+ * every I_HASHLOCKS'th chain, rather than by inode_lock.  A hashed inode
+ * records its lock in i_hash_lock.
+ *
+ * The last reference to a hashed inode is dropped under its hash lock,
+ * so a lookup which finds an inode with i_count already elevated may
+ * take another reference under the hash lock alone: such an inode is on
+ * the in-use or a dirty list and nothing else has to change.  Everything
+ * else, inodes with i_count zero in particular, still needs inode_lock,
+ * which nests inside the hash lock.
+ */
+#define I_HASHLOCKS	1024
+
+static spinlock_t inode_hash_locks[I_HASHLOCKS];
+
+static inline spinlock_t *inode_hash_lock(struct hlist_head *head)
+{
+	return &inode_hash_locks[(head - inode_hashtable) & (I_HASHLOCKS - 1)];
+}
+
+/*
+ * A simple spinlock to protect the list manipulations.  It nests inside
+ * the hash locks.
  *
  * NOTE! You also have to own the lock if you change
  * the i_state of an inode while it is in use..
@@ -126,6 +149,7 @@ static struct inode *alloc_inode(struct super_block *sb)
 		inode->i_blocks = 0;
 		inode->i_bytes = 0;
 		inode->i_generation = 0;
+		inode->i_hash_lock = NULL;
 #ifdef CONFIG_QUOTA
 		memset(&inode->i_dquot, 0, sizeof(inode->i_dquot));
 #endif
@@ -203,6 +227,10 @@ void inode_init_once(struct inode *inode)
 	INIT_LIST_HEAD(&inode->i_data.i_mmap_nonlinear);
 	spin_lock_init(&inode->i_lock);
 	i_size_ordered_init(inode);
+#ifdef CONFIG_INOTIFY
+	INIT_LIST_HEAD(&inode->inotify_watches);
+	sema_init(&inode->inotify_sem, 1);
+#endif
 }
 
 EXPORT_SYMBOL(inode_init_once);
@@ -268,15 +296,19 @@ EXPORT_SYMBOL(clear_inode);
  * @head: the head of the list to free
  *
  * Dispose-list gets a local list with local inodes in it, so it doesn't
- * need to worry about list corruption and SMP locks.
+ * need to worry about list corruption and SMP locks.  The inodes are still
+ * hashed, as the hash locks can't be taken under inode_lock; unhash them
+ * all first so that lookups waiting on them aren't held up by the rest.
  */
 static void dispose_list(struct list_head *head)
 {
+	struct inode *inode;
 	int nr_disposed = 0;
 
-	while (!list_empty(head)) {
-		struct inode *inode;
+	list_for_each_entry(inode, head, i_list)
+		remove_inode_hash(inode);
 
+	while (!list_empty(head)) {
 		inode = list_entry(head->next, struct inode, i_list);
 		list_del(&inode->i_list);
 
@@ -318,7 +350,6 @@ static int invalidate_list(struct list_head *head, struct list_head *dispose)
 		inode = list_entry(tmp, struct inode, i_sb_list);
 		invalidate_inode_buffers(inode);
 		if (!atomic_read(&inode->i_count)) {
-			hlist_del_init(&inode->i_hash);
 			list_del(&inode->i_sb_list);
 			list_move(&inode->i_list, dispose);
 			inode->i_state |= I_FREEING;
@@ -355,6 +386,7 @@ int invalidate_inodes(struct super_block * sb)
 
 	down(&iprune_sem);
 	spin_lock(&inode_lock);
+	inotify_unmount_inodes(&sb->s_inodes);
 	busy = invalidate_list(&sb->s_inodes, &throw_away);
 	spin_unlock(&inode_lock);
 
@@ -454,7 +486,6 @@ static void prune_icache(int nr_to_scan)
 			if (!can_unuse(inode))
 				continue;
 		}
-		hlist_del_init(&inode->i_hash);
 		list_del_init(&inode->i_sb_list);
 		list_move(&inode->i_list, &freeable);
 		inode->i_state |= I_FREEING;
@@ -496,9 +527,9 @@ static int shrink_icache_memory(int nr, unsigned int gfp_mask)
 	return (inodes_stat.nr_unused / 100) * sysctl_vfs_cache_pressure;
 }
 
-static void __wait_on_freeing_inode(struct inode *inode);
+static void __wait_on_freeing_inode(struct inode *inode, spinlock_t *lock);
 /*
- * Called with the inode lock held.
+ * Called with the hash lock of @head and the inode lock held.
  * NOTE: we are not increasing the inode-refcount, you must call __iget()
  * by hand after calling find_inode now! This simplifies iunique and won't
  * add any additional branch in the common code.
@@ -516,7 +547,7 @@ repeat:
 		if (!test(inode, data))
 			continue;
 		if (inode->i_state & (I_FREEING|I_CLEAR)) {
-			__wait_on_freeing_inode(inode);
+			__wait_on_freeing_inode(inode, inode_hash_lock(head));
 			goto repeat;
 		}
 		break;
@@ -541,7 +572,7 @@ repeat:
 		if (inode->i_sb != sb)
 			continue;
 		if (inode->i_state & (I_FREEING|I_CLEAR)) {
-			__wait_on_freeing_inode(inode);
+			__wait_on_freeing_inode(inode, inode_hash_lock(head));
 			goto repeat;
 		}
 		break;
@@ -601,12 +632,14 @@ EXPORT_SYMBOL(unlock_new_inode);
  */
 static struct inode * get_new_inode(struct super_block *sb, struct hlist_head *head, int (*test)(struct inode *, void *), int (*set)(struct inode *, void *), void *data)
 {
+	spinlock_t *lock = inode_hash_lock(head);
 	struct inode * inode;
 
 	inode = alloc_inode(sb);
 	if (inode) {
 		struct inode * old;
 
+		spin_lock(lock);
 		spin_lock(&inode_lock);
 		/* We released the lock, so.. */
 		old = find_inode(sb, head, test, data);
@@ -618,8 +651,10 @@ static struct inode * get_new_inode(struct super_block *sb, struct hlist_head *h
 			list_add(&inode->i_list, &inode_in_use);
 			list_add(&inode->i_sb_list, &sb->s_inodes);
 			hlist_add_head(&inode->i_hash, head);
+			inode->i_hash_lock = lock;
 			inode->i_state = I_LOCK|I_NEW;
 			spin_unlock(&inode_lock);
+			spin_unlock(lock);
 
 			/* Return the locked inode with I_NEW set, the
 			 * caller is responsible for filling in the contents
@@ -634,6 +669,7 @@ static struct inode * get_new_inode(struct super_block *sb, struct hlist_head *h
 		 */
 		__iget(old);
 		spin_unlock(&inode_lock);
+		spin_unlock(lock);
 		destroy_inode(inode);
 		inode = old;
 		wait_on_inode(inode);
@@ -642,6 +678,7 @@ static struct inode * get_new_inode(struct super_block *sb, struct hlist_head *h
 
 set_failed:
 	spin_unlock(&inode_lock);
+	spin_unlock(lock);
 	destroy_inode(inode);
 	return NULL;
 }
@@ -652,12 +689,14 @@ set_failed:
  */
 static struct inode * get_new_inode_fast(struct super_block *sb, struct hlist_head *head, unsigned long ino)
 {
+	spinlock_t *lock = inode_hash_lock(head);
 	struct inode * inode;
 
 	inode = alloc_inode(sb);
 	if (inode) {
 		struct inode * old;
 
+		spin_lock(lock);
 		spin_lock(&inode_lock);
 		/* We released the lock, so.. */
 		old = find_inode_fast(sb, head, ino);
@@ -667,8 +706,10 @@ static struct inode * get_new_inode_fast(struct super_block *sb, struct hlist_he
 			list_add(&inode->i_list, &inode_in_use);
 			list_add(&inode->i_sb_list, &sb->s_inodes);
 			hlist_add_head(&inode->i_hash, head);
+			inode->i_hash_lock = lock;
 			inode->i_state = I_LOCK|I_NEW;
 			spin_unlock(&inode_lock);
+			spin_unlock(lock);
 
 			/* Return the locked inode with I_NEW set, the
 			 * caller is responsible for filling in the contents
@@ -683,6 +724,7 @@ static struct inode * get_new_inode_fast(struct super_block *sb, struct hlist_he
 		 */
 		__iget(old);
 		spin_unlock(&inode_lock);
+		spin_unlock(lock);
 		destroy_inode(inode);
 		inode = old;
 		wait_on_inode(inode);
@@ -716,20 +758,31 @@ static inline unsigned long hash(struct super_block *sb, unsigned long hashval)
  */
 ino_t iunique(struct super_block *sb, ino_t max_reserved)
 {
+	static DEFINE_SPINLOCK(iunique_lock);
 	static ino_t counter;
-	struct inode *inode;
 	struct hlist_head * head;
+	struct hlist_node *node;
+	struct inode *inode;
+	spinlock_t *lock;
 	ino_t res;
-	spin_lock(&inode_lock);
+
+	spin_lock(&iunique_lock);
 retry:
 	if (counter > max_reserved) {
 		head = inode_hashtable + hash(sb,counter);
+		lock = inode_hash_lock(head);
 		res = counter++;
-		inode = find_inode_fast(sb, head, res);
-		if (!inode) {
-			spin_unlock(&inode_lock);
-			return res;
+		/* an inode on its way out still has the number */
+		spin_lock(lock);
+		hlist_for_each_entry(inode, node, head, i_hash) {
+			if (inode->i_ino == res && inode->i_sb == sb) {
+				spin_unlock(lock);
+				goto retry;
+			}
 		}
+		spin_unlock(lock);
+		spin_unlock(&iunique_lock);
+		return res;
 	} else {
 		counter = max_reserved + 1;
 	}
@@ -757,6 +810,19 @@ struct inode *igrab(struct inode *inode)
 
 EXPORT_SYMBOL(igrab);
 
+/*
+ * Take a reference to a hashed inode which already has some, under its
+ * hash lock only.  Returns 0 if the inode_lock path has to be taken.
+ */
+static inline int __iget_referenced(struct inode *inode)
+{
+	if (!atomic_read(&inode->i_count) ||
+	    (inode->i_state & (I_FREEING|I_CLEAR)))
+		return 0;
+	atomic_inc(&inode->i_count);
+	return 1;
+}
+
 /**
  * ifind - internal function, you want ilookup5() or iget5().
  * @sb:		super block of file system to search
@@ -773,23 +839,38 @@ EXPORT_SYMBOL(igrab);
  *
  * Otherwise NULL is returned.
  *
- * Note, @test is called with the inode_lock held, so can't sleep.
+ * Note, @test is called with the hash lock held, so can't sleep.
  */
 static inline struct inode *ifind(struct super_block *sb,
 		struct hlist_head *head, int (*test)(struct inode *, void *),
 		void *data)
 {
+	spinlock_t *lock = inode_hash_lock(head);
+	struct hlist_node *node;
 	struct inode *inode;
 
+	spin_lock(lock);
+	hlist_for_each_entry(inode, node, head, i_hash) {
+		if (inode->i_sb == sb && test(inode, data)) {
+			if (!__iget_referenced(inode))
+				break;
+			spin_unlock(lock);
+			wait_on_inode(inode);
+			return inode;
+		}
+	}
+
 	spin_lock(&inode_lock);
 	inode = find_inode(sb, head, test, data);
 	if (inode) {
 		__iget(inode);
 		spin_unlock(&inode_lock);
+		spin_unlock(lock);
 		wait_on_inode(inode);
 		return inode;
 	}
 	spin_unlock(&inode_lock);
+	spin_unlock(lock);
 	return NULL;
 }
 
@@ -811,17 +892,32 @@ static inline struct inode *ifind(struct super_block *sb,
 static inline struct inode *ifind_fast(struct super_block *sb,
 		struct hlist_head *head, unsigned long ino)
 {
+	spinlock_t *lock = inode_hash_lock(head);
+	struct hlist_node *node;
 	struct inode *inode;
 
+	spin_lock(lock);
+	hlist_for_each_entry(inode, node, head, i_hash) {
+		if (inode->i_ino == ino && inode->i_sb == sb) {
+			if (!__iget_referenced(inode))
+				break;
+			spin_unlock(lock);
+			wait_on_inode(inode);
+			return inode;
+		}
+	}
+
 	spin_lock(&inode_lock);
 	inode = find_inode_fast(sb, head, ino);
 	if (inode) {
 		__iget(inode);
 		spin_unlock(&inode_lock);
+		spin_unlock(lock);
 		wait_on_inode(inode);
 		return inode;
 	}
 	spin_unlock(&inode_lock);
+	spin_unlock(lock);
 	return NULL;
 }
 
@@ -842,7 +938,7 @@ static inline struct inode *ifind_fast(struct super_block *sb,
  *
  * Otherwise NULL is returned.
  *
- * Note, @test is called with the inode_lock held, so can't sleep.
+ * Note, @test is called with the hash lock held, so can't sleep.
  */
 struct inode *ilookup5(struct super_block *sb, unsigned long hashval,
 		int (*test)(struct inode *, void *), void *data)
@@ -897,7 +993,7 @@ EXPORT_SYMBOL(ilookup);
  * inode and this is returned locked, hashed, and with the I_NEW flag set. The
  * file system gets to fill it in before unlocking it via unlock_new_inode().
  *
- * Note both @test and @set are called with the inode_lock held, so can't sleep.
+ * Note both @test and @set are called with the hash lock held, so can't sleep.
  */
 struct inode *iget5_locked(struct super_block *sb, unsigned long hashval,
 		int (*test)(struct inode *, void *),
@@ -963,9 +1059,12 @@ EXPORT_SYMBOL(iget_locked);
 void __insert_inode_hash(struct inode *inode, unsigned long hashval)
 {
 	struct hlist_head *head = inode_hashtable + hash(inode->i_sb, hashval);
-	spin_lock(&inode_lock);
+	spinlock_t *lock = inode_hash_lock(head);
+
+	spin_lock(lock);
 	hlist_add_head(&inode->i_hash, head);
-	spin_unlock(&inode_lock);
+	inode->i_hash_lock = lock;
+	spin_unlock(lock);
 }
 
 EXPORT_SYMBOL(__insert_inode_hash);
@@ -974,13 +1073,19 @@ EXPORT_SYMBOL(__insert_inode_hash);
  *	remove_inode_hash - remove an inode from the hash
  *	@inode: inode to unhash
  *
- *	Remove an inode from the superblock.
+ *	Remove an inode from the superblock.  Must not be called with
+ *	inode_lock held.
  */
 void remove_inode_hash(struct inode *inode)
 {
-	spin_lock(&inode_lock);
+	spinlock_t *lock = inode->i_hash_lock;
+
+	if (!lock)
+		return;
+	spin_lock(lock);
 	hlist_del_init(&inode->i_hash);
-	spin_unlock(&inode_lock);
+	inode->i_hash_lock = NULL;
+	spin_unlock(lock);
 }
 
 EXPORT_SYMBOL(remove_inode_hash);
@@ -1020,9 +1125,7 @@ void generic_delete_inode(struct inode *inode)
 		delete(inode);
 	} else
 		clear_inode(inode);
-	spin_lock(&inode_lock);
-	hlist_del_init(&inode->i_hash);
-	spin_unlock(&inode_lock);
+	remove_inode_hash(inode);
 	wake_up_inode(inode);
 	if (inode->i_state != I_CLEAR)
 		BUG();
@@ -1043,9 +1146,9 @@ static void generic_forget_inode(struct inode *inode)
 		if (!sb || (sb->s_flags & MS_ACTIVE))
 			return;
 		write_inode_now(inode, 1);
+		remove_inode_hash(inode);
 		spin_lock(&inode_lock);
 		inodes_stat.nr_unused--;
-		hlist_del_init(&inode->i_hash);
 	}
 	list_del_init(&inode->i_list);
 	list_del_init(&inode->i_sb_list);
@@ -1105,14 +1208,40 @@ void iput(struct inode *inode)
 {
 	if (inode) {
 		struct super_operations *op = inode->i_sb->s_op;
+		spinlock_t *lock;
 
 		BUG_ON(inode->i_state == I_CLEAR);
 
 		if (op && op->put_inode)
 			op->put_inode(inode);
 
-		if (atomic_dec_and_lock(&inode->i_count, &inode_lock))
+		/*
+		 * Unless we hold the last reference nobody can hash or
+		 * unhash the inode under us, so a stale i_hash_lock only
+		 * matters when we aren't going to take it.
+		 */
+		lock = inode->i_hash_lock;
+		if (!lock) {
+			if (atomic_dec_and_lock(&inode->i_count, &inode_lock))
+				iput_final(inode);
+			return;
+		}
+		if (atomic_dec_and_lock(&inode->i_count, lock)) {
+			spin_lock(&inode_lock);
+			spin_unlock(lock);
+			/*
+			 * Somebody holding only inode_lock, writeback or
+			 * igrab(), got in before us and took a reference as
+			 * if the inode were on the unused list.  Leave it to
+			 * them and fix up the count __iget() dropped.
+			 */
+			if (atomic_read(&inode->i_count)) {
+				inodes_stat.nr_unused++;
+				spin_unlock(&inode_lock);
+				return;
+			}
 			iput_final(inode);
+		}
 	}
 }
 
@@ -1139,13 +1268,33 @@ sector_t bmap(struct inode * inode, sector_t block)
 
 EXPORT_SYMBOL(bmap);
 
+/*
+ * With relatime, atime is only updated when the previous one is older
+ * than mtime or ctime, so that "has this been read since it was last
+ * changed" keeps working, or when it is more than a day old.
+ */
+#define RELATIME_MAX_AGE	(24 * 60 * 60)
+
+static int relatime_need_update(struct inode *inode, struct timespec now)
+{
+	if (timespec_compare(&inode->i_mtime, &inode->i_atime) >= 0)
+		return 1;
+	if (timespec_compare(&inode->i_ctime, &inode->i_atime) >= 0)
+		return 1;
+	if ((long)(now.tv_sec - inode->i_atime.tv_sec) >= RELATIME_MAX_AGE)
+		return 1;
+	return 0;
+}
+
 /**
  *	update_atime	-	update the access time
  *	@inode: inode accessed
  *
  *	Update the accessed time on an inode and mark it for writeback.
  *	This function automatically handles read only file systems and media,
- *	as well as the "noatime" flag and inode specific "noatime" markers.
+ *	as well as the "noatime" flag and inode specific "noatime" markers,
+ *	and skips the update under "relatime" when it would tell nobody
+ *	anything.
  */
 void update_atime(struct inode *inode)
 {
@@ -1159,6 +1308,8 @@ void update_atime(struct inode *inode)
 		return;
 
 	now = current_fs_time(inode->i_sb);
+	if (IS_RELATIME(inode) && !relatime_need_update(inode, now))
+		return;
 	if (!timespec_equal(&inode->i_atime, &now)) {
 		inode->i_atime = now;
 		mark_inode_dirty_sync(inode);
@@ -1258,29 +1409,33 @@ int inode_wait(void *word)
  * that it isn't found.  This is because iget will immediately call
  * ->read_inode, and we want to be sure that evidence of the deletion is found
  * by ->read_inode.
- * This is called with inode_lock held.
+ * This is called with the hash lock @lock and inode_lock held.
  */
-static void __wait_on_freeing_inode(struct inode *inode)
+static void __wait_on_freeing_inode(struct inode *inode, spinlock_t *lock)
 {
 	wait_queue_head_t *wq;
 	DEFINE_WAIT_BIT(wait, &inode->i_state, __I_LOCK);
 
 	/*
-	 * I_FREEING and I_CLEAR are cleared in process context under
-	 * inode_lock, so we have to give the tasks who would clear them
-	 * a chance to run and acquire inode_lock.
+	 * Freeing inodes are unhashed in process context under the hash
+	 * lock, so we have to give the tasks who would unhash them a
+	 * chance to run and acquire it.
 	 */
 	if (!(inode->i_state & I_LOCK)) {
 		spin_unlock(&inode_lock);
+		spin_unlock(lock);
 		yield();
+		spin_lock(lock);
 		spin_lock(&inode_lock);
 		return;
 	}
 	wq = bit_waitqueue(&inode->i_state, __I_LOCK);
 	prepare_to_wait(wq, &wait.wait, TASK_UNINTERRUPTIBLE);
 	spin_unlock(&inode_lock);
+	spin_unlock(lock);
 	schedule();
 	finish_wait(wq, &wait.wait);
+	spin_lock(lock);
 	spin_lock(&inode_lock);
 }
 
@@ -1310,6 +1465,9 @@ void __init inode_init_early(void)
 {
 	int loop;
 
+	for (loop = 0; loop < I_HASHLOCKS; loop++)
+		spin_lock_init(&inode_hash_locks[loop]);
+
 	/* If hashes are distributed across NUMA nodes, defer
 	 * hash allocation until vmalloc space is available.
 	 */
@@ -1336,7 +1494,7 @@ void __init inode_init(unsigned long mempages)
 
 	/* inode slab cache */
 	inode_cachep = kmem_cache_create("inode_cache", sizeof(struct inode),
-				0, SLAB_PANIC, init_once, NULL);
+				0, SLAB_PANIC|SLAB_MEM_SPREAD, init_once, NULL);
 	set_shrinker(DEFAULT_SEEKS, shrink_icache_memory);
 
 	/* Hash may have been set up in inode_init_early */
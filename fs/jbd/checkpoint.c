@@ -596,6 +596,11 @@ void __journal_insert_checkpoint(struct journal_head *jh,
 	transaction->t_checkpoint_list = jh;
 }
 
+static void journal_free_transaction_rcu(struct rcu_head *head)
+{
+	kfree(container_of(head, transaction_t, t_rcu));
+}
+
 /*
  * We've finished with this transaction structure: adios...
  * 
@@ -627,10 +632,10 @@ void __journal_drop_transaction(journal_t *journal, transaction_t *transaction)
 	J_ASSERT(transaction->t_shadow_list == NULL);
 	J_ASSERT(transaction->t_log_list == NULL);
 	J_ASSERT(transaction->t_checkpoint_list == NULL);
-	J_ASSERT(transaction->t_updates == 0);
+	J_ASSERT(atomic_read(&transaction->t_updates) == 0);
 	J_ASSERT(journal->j_committing_transaction != transaction);
 	J_ASSERT(journal->j_running_transaction != transaction);
 
 	jbd_debug(1, "Dropping transaction %d, all done\n", transaction->t_tid);
-	kfree(transaction);
+	call_rcu(&transaction->t_rcu, journal_free_transaction_rcu);
 }
@@ -21,6 +21,9 @@
 #include <linux/mm.h>
 #include <linux/pagemap.h>
 #include <linux/smp_lock.h>
+#include <linux/highmem.h>
+#include <linux/crc32.h>
+#include <linux/blkdev.h>
 
 /*
  * Default IO end handler for temporary BJ_IO buffer_heads.
@@ -93,6 +96,124 @@ static int inverted_lock(journal_t *journal, struct buffer_head *bh)
 	return 1;
 }
 
+/*
+ * Fold a log block into the transaction checksum.  The temporary
+ * BJ_IO buffers of journal_write_metadata_buffer() may live in highmem,
+ * in which case b_data is only an offset into the page.
+ */
+static __u32 journal_checksum_data(__u32 crc32_sum, struct buffer_head *bh)
+{
+	char *addr;
+
+	addr = kmap_atomic(bh->b_page, KM_USER0);
+	crc32_sum = crc32_be(crc32_sum,
+			     (void *)(addr + offset_in_page(bh->b_data)),
+			     bh->b_size);
+	kunmap_atomic(addr, KM_USER0);
+	return crc32_sum;
+}
+
+/*
+ * Set up the commit block, with the transaction checksum if the
+ * journal carries them.
+ */
+static struct journal_head *
+journal_get_commit_record(journal_t *journal,
+			  transaction_t *commit_transaction, __u32 crc32_sum)
+{
+	struct journal_head *descriptor;
+	struct commit_header *tmp;
+	struct buffer_head *bh;
+	int i;
+
+	descriptor = journal_get_descriptor_buffer(journal);
+	if (!descriptor)
+		return NULL;
+
+	bh = jh2bh(descriptor);
+	tmp = (struct commit_header *)bh->b_data;
+
+	/* AKPM: buglet - add `i' to tmp! */
+	for (i = 0; i < bh->b_size; i += 512) {
+		tmp->h_magic = cpu_to_be32(JFS_MAGIC_NUMBER);
+		tmp->h_blocktype = cpu_to_be32(JFS_COMMIT_BLOCK);
+		tmp->h_sequence = cpu_to_be32(commit_transaction->t_tid);
+	}
+
+	if (JFS_HAS_COMPAT_FEATURE(journal, JFS_FEATURE_COMPAT_CHECKSUM)) {
+		tmp->h_chksum_type = JBD_CRC32_CHKSUM;
+		tmp->h_chksum_size = JBD_CRC32_CHKSUM_SIZE;
+		tmp->h_chksum[0] = cpu_to_be32(crc32_sum);
+	}
+	return descriptor;
+}
+
+/*
+ * With JFS_FEATURE_INCOMPAT_ASYNC_COMMIT the commit block goes out
+ * together with the rest of the transaction, with no barrier of its
+ * own: the checksum lets recovery throw the transaction away if the
+ * commit block reached the disk before the blocks it covers.  The one
+ * cache flush after everything has completed makes the commit durable.
+ */
+static struct journal_head *
+journal_submit_commit_record(journal_t *journal,
+			     transaction_t *commit_transaction,
+			     __u32 crc32_sum)
+{
+	struct journal_head *descriptor;
+	struct buffer_head *bh;
+
+	if (is_journal_aborted(journal))
+		return NULL;
+
+	descriptor = journal_get_commit_record(journal, commit_transaction,
+					       crc32_sum);
+	if (!descriptor)
+		return NULL;
+
+	bh = jh2bh(descriptor);
+	JBUFFER_TRACE(descriptor, "submit async commit block");
+	lock_buffer(bh);
+	clear_buffer_dirty(bh);
+	set_buffer_uptodate(bh);
+	bh->b_end_io = journal_end_buffer_io_sync;
+	submit_bh(WRITE, bh);
+	return descriptor;
+}
+
+/*
+ * Wait for the commit block queued by journal_submit_commit_record()
+ * and flush the drive cache behind it.
+ *
+ * Returns 1 if the journal needs to be aborted or 0 on success
+ */
+static int journal_wait_on_commit_record(journal_t *journal,
+					 struct journal_head *descriptor)
+{
+	struct buffer_head *bh = jh2bh(descriptor);
+	int ret = 0;
+
+	wait_on_buffer(bh);
+	if (unlikely(!buffer_uptodate(bh)))
+		ret = 1;
+	put_bh(bh);		/* One for getblk() */
+	journal_put_journal_head(descriptor);
+
+	if (!ret && (journal->j_flags & JFS_BARRIER) &&
+	    blkdev_issue_flush(journal->j_dev, NULL) == -EOPNOTSUPP) {
+		char b[BDEVNAME_SIZE];
+
+		printk(KERN_WARNING
+			"JBD: cache flush failed on %s - "
+			"disabling barriers\n",
+			bdevname(journal->j_dev, b));
+		spin_lock(&journal->j_state_lock);
+		journal->j_flags &= ~JFS_BARRIER;
+		spin_unlock(&journal->j_state_lock);
+	}
+	return ret;
+}
+
 /* Done it all: now write the commit record.  We should have
  * cleaned up our previous buffers by now, so if we are in abort
  * mode we can now just skip the rest of the journal write
@@ -101,30 +222,24 @@ static int inverted_lock(journal_t *journal, struct buffer_head *bh)
  * Returns 1 if the journal needs to be aborted or 0 on success
  */
 static int journal_write_commit_record(journal_t *journal,
-					transaction_t *commit_transaction)
+					transaction_t *commit_transaction,
+					__u32 crc32_sum)
 {
 	struct journal_head *descriptor;
 	struct buffer_head *bh;
-	int i, ret;
+	int ret;
 	int barrier_done = 0;
 
 	if (is_journal_aborted(journal))
 		return 0;
 
-	descriptor = journal_get_descriptor_buffer(journal);
+	descriptor = journal_get_commit_record(journal, commit_transaction,
+					       crc32_sum);
 	if (!descriptor)
 		return 1;
 
 	bh = jh2bh(descriptor);
 
-	/* AKPM: buglet - add `i' to tmp! */
-	for (i = 0; i < bh->b_size; i += 512) {
-		journal_header_t *tmp = (journal_header_t*)bh->b_data;
-		tmp->h_magic = cpu_to_be32(JFS_MAGIC_NUMBER);
-		tmp->h_blocktype = cpu_to_be32(JFS_COMMIT_BLOCK);
-		tmp->h_sequence = cpu_to_be32(commit_transaction->t_tid);
-	}
-
 	JBUFFER_TRACE(descriptor, "write commit block");
 	set_buffer_dirty(bh);
 	if (journal->j_flags & JFS_BARRIER) {
@@ -169,7 +284,7 @@ static int journal_write_commit_record(journal_t *journal,
 void journal_commit_transaction(journal_t *journal)
 {
 	transaction_t *commit_transaction;
-	struct journal_head *jh, *new_jh, *descriptor;
+	struct journal_head *jh, *new_jh, *descriptor, *commit_jh = NULL;
 	struct buffer_head **wbuf = journal->j_wbuf;
 	int bufs;
 	int flags;
@@ -182,12 +297,17 @@ void journal_commit_transaction(journal_t *journal)
 	int first_tag = 0;
 	int tag_flag;
 	int i;
+	__u32 crc32_sum = ~0;
+	unsigned long start_time, commit_time;
+	int nr_handles, nr_blocks;
 
 	/*
 	 * First job: lock down the current transaction and wait for
 	 * all outstanding updates to complete.
 	 */
 
+	start_time = jbd_time_usecs();
+
 #ifdef COMMIT_STATS
 	spin_lock(&journal->j_list_lock);
 	summarise_journal_usage(journal);
@@ -213,25 +333,23 @@ void journal_commit_transaction(journal_t *journal)
 
 	spin_lock(&journal->j_state_lock);
 	commit_transaction->t_state = T_LOCKED;
+	/* pairs with the barrier in try_start_handle() */
+	smp_mb();
 
-	spin_lock(&commit_transaction->t_handle_lock);
-	while (commit_transaction->t_updates) {
+	while (atomic_read(&commit_transaction->t_updates)) {
 		DEFINE_WAIT(wait);
 
 		prepare_to_wait(&journal->j_wait_updates, &wait,
 					TASK_UNINTERRUPTIBLE);
-		if (commit_transaction->t_updates) {
-			spin_unlock(&commit_transaction->t_handle_lock);
+		if (atomic_read(&commit_transaction->t_updates)) {
 			spin_unlock(&journal->j_state_lock);
 			schedule();
 			spin_lock(&journal->j_state_lock);
-			spin_lock(&commit_transaction->t_handle_lock);
 		}
 		finish_wait(&journal->j_wait_updates, &wait);
 	}
-	spin_unlock(&commit_transaction->t_handle_lock);
 
-	J_ASSERT (commit_transaction->t_outstanding_credits <=
+	J_ASSERT (atomic_read(&commit_transaction->t_outstanding_credits) <=
 			journal->j_max_transaction_buffers);
 
 	/*
@@ -290,6 +408,9 @@ void journal_commit_transaction(journal_t *journal)
 	journal->j_committing_transaction = commit_transaction;
 	journal->j_running_transaction = NULL;
 	commit_transaction->t_log_start = journal->j_head;
+	/* No more updates can come in: these are final */
+	nr_handles = atomic_read(&commit_transaction->t_handle_count);
+	nr_blocks = commit_transaction->t_nr_buffers;
 	wake_up(&journal->j_wait_transaction_locked);
 	spin_unlock(&journal->j_state_lock);
 
@@ -521,7 +642,7 @@ write_out_data:
 		 * the free space in the log, but this counter is changed
 		 * by journal_next_log_block() also.
 		 */
-		commit_transaction->t_outstanding_credits--;
+		atomic_dec(&commit_transaction->t_outstanding_credits);
 
 		/* Bump b_count to prevent truncate from stumbling over
                    the shadowed buffer!  @@@ This can go if we ever get
@@ -585,6 +706,11 @@ write_out_data:
 start_journal_io:
 			for (i = 0; i < bufs; i++) {
 				struct buffer_head *bh = wbuf[i];
+
+				if (JFS_HAS_COMPAT_FEATURE(journal,
+					    JFS_FEATURE_COMPAT_CHECKSUM))
+					crc32_sum = journal_checksum_data(
+							crc32_sum, bh);
 				lock_buffer(bh);
 				clear_buffer_dirty(bh);
 				set_buffer_uptodate(bh);
@@ -600,6 +726,15 @@ start_journal_io:
 		}
 	}
 
+	/* With async commit the commit block rides along with the rest */
+	if (JFS_HAS_INCOMPAT_FEATURE(journal,
+				     JFS_FEATURE_INCOMPAT_ASYNC_COMMIT)) {
+		commit_jh = journal_submit_commit_record(journal,
+						commit_transaction, crc32_sum);
+		if (!commit_jh && !is_journal_aborted(journal))
+			__journal_abort_hard(journal);
+	}
+
 	/* Lo and behold: we have just managed to send a transaction to
            the log.  Before we can commit it, wait for the IO so far to
            complete.  Control buffers being written are on the
@@ -699,8 +834,15 @@ wait_for_iobuf:
 
 	jbd_debug(3, "JBD: commit phase 6\n");
 
-	if (journal_write_commit_record(journal, commit_transaction))
-		err = -EIO;
+	if (commit_jh) {
+		if (journal_wait_on_commit_record(journal, commit_jh))
+			err = -EIO;
+	} else if (!JFS_HAS_INCOMPAT_FEATURE(journal,
+					JFS_FEATURE_INCOMPAT_ASYNC_COMMIT)) {
+		if (journal_write_commit_record(journal, commit_transaction,
+						crc32_sum))
+			err = -EIO;
+	}
 
 	if (err)
 		__journal_abort_hard(journal);
@@ -815,6 +957,23 @@ restart_loop:
 	J_ASSERT(commit_transaction == journal->j_committing_transaction);
 	journal->j_commit_sequence = commit_transaction->t_tid;
 	journal->j_committing_transaction = NULL;
+
+	/*
+	 * Weight the new commit time by 1/4 against the history, so that
+	 * synchronous handles in journal_stop() follow the device.
+	 */
+	commit_time = jbd_time_usecs() - start_time;
+	if (likely(journal->j_average_commit_time))
+		journal->j_average_commit_time =
+			(commit_time + journal->j_average_commit_time * 3) / 4;
+	else
+		journal->j_average_commit_time = commit_time;
+
+	journal->j_stats.ts_tid++;
+	journal->j_stats.ts_handles += nr_handles;
+	journal->j_stats.ts_blocks += nr_blocks;
+	if (commit_time > journal->j_stats.ts_max_commit_time)
+		journal->j_stats.ts_max_commit_time = commit_time;
 	spin_unlock(&journal->j_state_lock);
 
 	if (commit_transaction->t_checkpoint_list == NULL) {
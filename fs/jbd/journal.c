@@ -646,6 +646,95 @@ struct journal_head *journal_get_descriptor_buffer(journal_t *journal)
 	return journal_add_journal_head(bh);
 }
 
+/*
+ * Commit statistics, one file per journal in /proc/fs/jbd, named after
+ * the device holding the journal.
+ */
+#ifdef CONFIG_PROC_FS
+
+#define JBD_STATS_PROC_NAME "fs/jbd"
+
+static struct proc_dir_entry *proc_jbd_stats;
+
+static int read_jbd_stats(char *page, char **start, off_t off,
+			  int count, int *eof, void *data)
+{
+	journal_t *journal = data;
+	struct transaction_stats_s stats;
+	unsigned long average, n;
+	int len;
+
+	spin_lock(&journal->j_state_lock);
+	stats = journal->j_stats;
+	average = journal->j_average_commit_time;
+	spin_unlock(&journal->j_state_lock);
+
+	n = stats.ts_tid ? stats.ts_tid : 1;
+	len = sprintf(page,
+		"transactions: %lu\n"
+		"handles per transaction: %lu\n"
+		"blocks per transaction: %lu\n"
+		"average commit time: %luus\n"
+		"maximum commit time: %luus\n"
+		"batch time: %lu-%luus\n",
+		stats.ts_tid, stats.ts_handles / n, stats.ts_blocks / n,
+		average, stats.ts_max_commit_time,
+		journal->j_min_batch_time, journal->j_max_batch_time);
+
+	if (off >= len) {
+		*eof = 1;
+		return 0;
+	}
+	*start = page + off;
+	len -= off;
+	if (len > count)
+		len = count;
+	else
+		*eof = 1;
+	return len;
+}
+
+static void jbd_stats_proc_init(journal_t *journal)
+{
+	char name[BDEVNAME_SIZE];
+
+	if (!proc_jbd_stats)
+		return;
+	bdevname(journal->j_dev, name);
+	journal->j_proc_entry = create_proc_read_entry(name, 0444,
+				proc_jbd_stats, read_jbd_stats, journal);
+}
+
+static void jbd_stats_proc_exit(journal_t *journal)
+{
+	char name[BDEVNAME_SIZE];
+
+	if (!journal->j_proc_entry)
+		return;
+	bdevname(journal->j_dev, name);
+	remove_proc_entry(name, proc_jbd_stats);
+}
+
+static void __init create_jbd_stats_proc_dir(void)
+{
+	proc_jbd_stats = proc_mkdir(JBD_STATS_PROC_NAME, NULL);
+}
+
+static void __exit remove_jbd_stats_proc_dir(void)
+{
+	if (proc_jbd_stats)
+		remove_proc_entry(JBD_STATS_PROC_NAME, NULL);
+}
+
+#else
+
+#define jbd_stats_proc_init(journal) do {} while (0)
+#define jbd_stats_proc_exit(journal) do {} while (0)
+#define create_jbd_stats_proc_dir() do {} while (0)
+#define remove_jbd_stats_proc_dir() do {} while (0)
+
+#endif
+
 /*
  * Management for journal control blocks: functions to create and
  * destroy journal_t structures, and to initialise and read existing
@@ -678,6 +767,8 @@ static journal_t * journal_init_common (void)
 	spin_lock_init(&journal->j_state_lock);
 
 	journal->j_commit_interval = (HZ * JBD_DEFAULT_MAX_COMMIT_AGE);
+	journal->j_min_batch_time = JBD_DEFAULT_MIN_BATCH_TIME;
+	journal->j_max_batch_time = JBD_DEFAULT_MAX_BATCH_TIME;
 
 	/* The journal is marked for error until we succeed with recovery! */
 	journal->j_flags = JFS_ABORT;
@@ -745,9 +836,10 @@ journal_t * journal_init_dev(struct block_device *bdev,
 		printk(KERN_ERR "%s: Cant allocate bhs for commit thread\n",
 			__FUNCTION__);
 		kfree(journal);
-		journal = NULL;
+		return NULL;
 	}
 
+	jbd_stats_proc_init(journal);
 	return journal;
 }
  
@@ -806,6 +898,7 @@ journal_t * journal_init_inode (struct inode *inode)
 	journal->j_sb_buffer = bh;
 	journal->j_superblock = (journal_superblock_t *)bh->b_data;
 
+	jbd_stats_proc_init(journal);
 	return journal;
 }
 
@@ -1165,6 +1258,7 @@ void journal_destroy(journal_t *journal)
 		iput(journal->j_inode);
 	if (journal->j_revoke)
 		journal_destroy_revoke(journal);
+	jbd_stats_proc_exit(journal);
 	kfree(journal->j_wbuf);
 	kfree(journal);
 }
@@ -1983,6 +2077,7 @@ static int __init journal_init(void)
 	if (ret != 0)
 		journal_destroy_caches();
 	create_jbd_proc_entry();
+	create_jbd_stats_proc_dir();
 	return ret;
 }
 
@@ -1993,6 +2088,9 @@ static void __exit journal_exit(void)
 	if (n)
 		printk(KERN_EMERG "JBD: leaked %d journal_heads!\n", n);
 #endif
+	/* transactions still waiting to be freed by __journal_drop_transaction */
+	rcu_barrier();
+	remove_jbd_stats_proc_dir();
 	remove_jbd_proc_entry();
 	journal_destroy_caches();
 }
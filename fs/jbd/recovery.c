@@ -21,6 +21,7 @@
 #include <linux/jbd.h>
 #include <linux/errno.h>
 #include <linux/slab.h>
+#include <linux/crc32.h>
 #endif
 
 /*
@@ -209,6 +210,36 @@ do {									\
 		var -= ((journal)->j_last - (journal)->j_first);	\
 } while (0)
 
+/*
+ * Fold a descriptor block and the log blocks it describes into the
+ * running transaction checksum, stepping next_log_block past them.
+ */
+static int calc_chksums(journal_t *journal, struct buffer_head *bh,
+			unsigned long *next_log_block, __u32 *crc32_sum)
+{
+	int i, num_blks, err;
+	unsigned long io_block;
+	struct buffer_head *obh;
+
+	num_blks = count_tags(bh, journal->j_blocksize);
+	*crc32_sum = crc32_be(*crc32_sum, (void *)bh->b_data, bh->b_size);
+
+	for (i = 0; i < num_blks; i++) {
+		io_block = (*next_log_block)++;
+		wrap(journal, *next_log_block);
+		err = jread(&obh, journal, io_block);
+		if (err) {
+			printk(KERN_ERR "JBD: IO error %d recovering block "
+				"%lu in log\n", err, io_block);
+			return -EIO;
+		}
+		*crc32_sum = crc32_be(*crc32_sum, (void *)obh->b_data,
+				      obh->b_size);
+		brelse(obh);
+	}
+	return 0;
+}
+
 /**
  * int journal_recover(journal_t *journal) - recovers a on-disk journal
  * @journal: the journal to recover
@@ -318,6 +349,7 @@ static int do_one_pass(journal_t *journal,
 	struct buffer_head *	bh;
 	unsigned int		sequence;
 	int			blocktype;
+	__u32			crc32_sum = ~0;	/* Transactional Checksums */
 
 	/* Precompute the maximum metadata descriptors in a descriptor block */
 	int			MAX_BLOCKS_PER_DESC;
@@ -411,6 +443,17 @@ static int do_one_pass(journal_t *journal,
 			/* If it is a valid descriptor block, replay it
 			 * in pass REPLAY; otherwise, just skip over the
 			 * blocks it describes. */
+			if (pass == PASS_SCAN &&
+			    JFS_HAS_COMPAT_FEATURE(journal,
+					JFS_FEATURE_COMPAT_CHECKSUM)) {
+				err = calc_chksums(journal, bh,
+						   &next_log_block,
+						   &crc32_sum);
+				brelse(bh);
+				if (err)
+					goto failed;
+				continue;
+			}
 			if (pass != PASS_REPLAY) {
 				next_log_block +=
 					count_tags(bh, journal->j_blocksize);
@@ -506,9 +549,37 @@ static int do_one_pass(journal_t *journal,
 			continue;
 
 		case JFS_COMMIT_BLOCK:
-			/* Found an expected commit block: not much to
-			 * do other than move on to the next sequence
-			 * number. */
+			/* Found an expected commit block: check the
+			 * transaction checksum if there is one, then
+			 * move on to the next sequence number.  A
+			 * mismatch means the commit block got to disk
+			 * ahead of blocks it covers, and the log ends
+			 * before this transaction.  Commit blocks from
+			 * before checksums were turned on carry none. */
+			if (pass == PASS_SCAN &&
+			    JFS_HAS_COMPAT_FEATURE(journal,
+					JFS_FEATURE_COMPAT_CHECKSUM)) {
+				struct commit_header *cbh =
+					(struct commit_header *)bh->b_data;
+				__u32 found = be32_to_cpu(cbh->h_chksum[0]);
+
+				if (cbh->h_chksum_type || found) {
+					if (cbh->h_chksum_type !=
+						JBD_CRC32_CHKSUM ||
+					    cbh->h_chksum_size !=
+						JBD_CRC32_CHKSUM_SIZE ||
+					    found != crc32_sum) {
+						printk(KERN_WARNING
+							"JBD: checksum mismatch"
+							" in transaction %u, "
+							"ending log there\n",
+							next_commit_ID);
+						brelse(bh);
+						goto done;
+					}
+				}
+				crc32_sum = ~0;
+			}
 			brelse(bh);
 			next_commit_ID++;
 			continue;
@@ -50,14 +50,14 @@ get_transaction(journal_t *journal, transaction_t *transaction)
 	transaction->t_state = T_RUNNING;
 	transaction->t_tid = journal->j_transaction_sequence++;
 	transaction->t_expires = jiffies + journal->j_commit_interval;
-	spin_lock_init(&transaction->t_handle_lock);
+	transaction->t_start_time = jbd_time_usecs();
 
 	/* Set up the commit timer for the new transaction. */
 	journal->j_commit_timer->expires = transaction->t_expires;
 	add_timer(journal->j_commit_timer);
 
 	J_ASSERT(journal->j_running_transaction == NULL);
-	journal->j_running_transaction = transaction;
+	rcu_assign_pointer(journal->j_running_transaction, transaction);
 
 	return transaction;
 }
@@ -70,6 +70,96 @@ get_transaction(journal_t *journal, transaction_t *transaction)
  * of that one update.
  */
 
+/*
+ * Drop an update taken on a transaction.  Once t_updates reaches zero
+ * the transaction may commit and be freed under us, so the caller must
+ * not touch it afterwards.
+ */
+static inline void drop_transaction_update(journal_t *journal,
+					   transaction_t *transaction)
+{
+	if (atomic_dec_and_test(&transaction->t_updates)) {
+		wake_up(&journal->j_wait_updates);
+		if (journal->j_barrier_count)
+			wake_up(&journal->j_wait_transaction_locked);
+	}
+}
+
+/*
+ * Charge nblocks credits to a transaction, unless that would take it
+ * past j_max_transaction_buffers.  The caller holds an update on the
+ * transaction, or j_state_lock with the transaction T_RUNNING, so the
+ * commit code never sees a total that is about to be backed out.
+ */
+static inline int add_transaction_credits(journal_t *journal,
+					  transaction_t *transaction,
+					  int nblocks)
+{
+	if (atomic_add_return(nblocks, &transaction->t_outstanding_credits) >
+	    journal->j_max_transaction_buffers) {
+		atomic_sub(nblocks, &transaction->t_outstanding_credits);
+		return 0;
+	}
+	return 1;
+}
+
+/*
+ * try_start_handle: the fast path of start_this_handle().  When a
+ * transaction is running, is not locked down for commit and has room
+ * to spare, the handle joins it with nothing but atomic operations.
+ *
+ * This races with journal_commit_transaction() and
+ * journal_lock_updates(), which make their state change under
+ * j_state_lock and only then look at t_updates.  We take our update
+ * first and only then look at their state, with a full barrier in
+ * between on both sides, so either they see our update and wait for
+ * it, or we see their state and back out.
+ *
+ * Returns 1 if the handle was started, 0 to take the slow path.
+ */
+static int try_start_handle(journal_t *journal, handle_t *handle)
+{
+	transaction_t *transaction;
+	int nblocks = handle->h_buffer_credits;
+
+	if (is_journal_aborted(journal) || journal->j_errno != 0)
+		return 0;
+
+	rcu_read_lock();
+	transaction = rcu_dereference(journal->j_running_transaction);
+	if (!transaction || transaction->t_state != T_RUNNING)
+		goto fail;
+
+	atomic_inc(&transaction->t_updates);
+	smp_mb__after_atomic_inc();
+	if (transaction->t_state != T_RUNNING || journal->j_barrier_count)
+		goto fail_update;
+
+	/*
+	 * The committing transaction can be at most
+	 * j_max_transaction_buffers large, so this implies the
+	 * jbd_space_needed() test of the slow path without having to
+	 * look at it.
+	 */
+	if (__log_space_left(journal) < 2 * journal->j_max_transaction_buffers)
+		goto fail_update;
+	if (!add_transaction_credits(journal, transaction, nblocks))
+		goto fail_update;
+
+	atomic_inc(&transaction->t_handle_count);
+	handle->h_transaction = transaction;
+	rcu_read_unlock();
+	jbd_debug(4, "Handle %p given %d credits (fast path)\n",
+		  handle, nblocks);
+	return 1;
+
+fail_update:
+	drop_transaction_update(journal, transaction);
+fail:
+	rcu_read_unlock();
+	return 0;
+}
+
 /*
  * start_this_handle: Given a handle, deal with any locking or stalling
  * needed to make sure that there is enough journal space for the handle
@@ -93,6 +183,9 @@ static int start_this_handle(journal_t *journal, handle_t *handle)
 		goto out;
 	}
 
+	if (try_start_handle(journal, handle))
+		goto out;
+
 alloc_transaction:
 	if (!journal->j_running_transaction) {
 		new_transaction = jbd_kmalloc(sizeof(*new_transaction),
@@ -160,8 +253,7 @@ repeat_locked:
 	 * buffers requested by this operation, we need to stall pending a log
 	 * checkpoint to free some more log space.
 	 */
-	spin_lock(&transaction->t_handle_lock);
-	needed = transaction->t_outstanding_credits + nblocks;
+	needed = atomic_read(&transaction->t_outstanding_credits) + nblocks;
 
 	if (needed > journal->j_max_transaction_buffers) {
 		/*
@@ -172,7 +264,6 @@ repeat_locked:
 		DEFINE_WAIT(wait);
 
 		jbd_debug(2, "Handle %p starting new commit...\n", handle);
-		spin_unlock(&transaction->t_handle_lock);
 		prepare_to_wait(&journal->j_wait_transaction_locked, &wait,
 				TASK_UNINTERRUPTIBLE);
 		__log_start_commit(journal, transaction->t_tid);
@@ -209,22 +300,26 @@ repeat_locked:
 	 */
 	if (__log_space_left(journal) < jbd_space_needed(journal)) {
 		jbd_debug(2, "Handle %p waiting for checkpoint...\n", handle);
-		spin_unlock(&transaction->t_handle_lock);
 		__log_wait_for_space(journal);
 		goto repeat_locked;
 	}
 
-	/* OK, account for the buffers that this operation expects to
-	 * use and add the handle to the running transaction. */
+	/*
+	 * OK, account for the buffers that this operation expects to
+	 * use and add the handle to the running transaction.  Fast path
+	 * starters may have raced us past the limit since the check
+	 * above: start over, which commits the transaction.
+	 */
+	if (!add_transaction_credits(journal, transaction, nblocks))
+		goto repeat_locked;
 
 	handle->h_transaction = transaction;
-	transaction->t_outstanding_credits += nblocks;
-	transaction->t_updates++;
-	transaction->t_handle_count++;
+	atomic_inc(&transaction->t_updates);
+	atomic_inc(&transaction->t_handle_count);
 	jbd_debug(4, "Handle %p given %d credits (total %d, free %d)\n",
-		  handle, nblocks, transaction->t_outstanding_credits,
+		  handle, nblocks,
+		  atomic_read(&transaction->t_outstanding_credits),
 		  __log_space_left(journal));
-	spin_unlock(&transaction->t_handle_lock);
 	spin_unlock(&journal->j_state_lock);
 out:
 	if (new_transaction)
@@ -330,28 +425,24 @@ int journal_extend(handle_t *handle, int nblocks)
 		goto error_out;
 	}
 
-	spin_lock(&transaction->t_handle_lock);
-	wanted = transaction->t_outstanding_credits + nblocks;
+	wanted = atomic_read(&transaction->t_outstanding_credits) + nblocks;
 
-	if (wanted > journal->j_max_transaction_buffers) {
+	if (wanted > __log_space_left(journal)) {
 		jbd_debug(3, "denied handle %p %d blocks: "
-			  "transaction too large\n", handle, nblocks);
-		goto unlock;
+			  "insufficient log space\n", handle, nblocks);
+		goto error_out;
 	}
 
-	if (wanted > __log_space_left(journal)) {
+	if (!add_transaction_credits(journal, transaction, nblocks)) {
 		jbd_debug(3, "denied handle %p %d blocks: "
-			  "insufficient log space\n", handle, nblocks);
-		goto unlock;
+			  "transaction too large\n", handle, nblocks);
+		goto error_out;
 	}
 
 	handle->h_buffer_credits += nblocks;
-	transaction->t_outstanding_credits += nblocks;
 	result = 0;
 
 	jbd_debug(3, "extended handle %p by %d\n", handle, nblocks);
-unlock:
-	spin_unlock(&transaction->t_handle_lock);
 error_out:
 	spin_unlock(&journal->j_state_lock);
 out:
@@ -378,6 +469,7 @@ int journal_restart(handle_t *handle, int nblocks)
 {
 	transaction_t *transaction = handle->h_transaction;
 	journal_t *journal = transaction->t_journal;
+	tid_t tid;
 	int ret;
 
 	/* If we've had an abort of any type, don't even think about
@@ -389,20 +481,17 @@ int journal_restart(handle_t *handle, int nblocks)
 	 * First unlink the handle from its current transaction, and start the
 	 * commit on that.
 	 */
-	J_ASSERT(transaction->t_updates > 0);
+	J_ASSERT(atomic_read(&transaction->t_updates) > 0);
 	J_ASSERT(journal_current_handle() == handle);
 
 	spin_lock(&journal->j_state_lock);
-	spin_lock(&transaction->t_handle_lock);
-	transaction->t_outstanding_credits -= handle->h_buffer_credits;
-	transaction->t_updates--;
-
-	if (!transaction->t_updates)
-		wake_up(&journal->j_wait_updates);
-	spin_unlock(&transaction->t_handle_lock);
+	atomic_sub(handle->h_buffer_credits,
+		   &transaction->t_outstanding_credits);
+	tid = transaction->t_tid;
+	drop_transaction_update(journal, transaction);
 
 	jbd_debug(2, "restarting handle %p\n", handle);
-	__log_start_commit(journal, transaction->t_tid);
+	__log_start_commit(journal, tid);
 	spin_unlock(&journal->j_state_lock);
 
 	handle->h_buffer_credits = nblocks;
@@ -427,6 +516,8 @@ void journal_lock_updates(journal_t *journal)
 
 	spin_lock(&journal->j_state_lock);
 	++journal->j_barrier_count;
+	/* pairs with the barrier in try_start_handle() */
+	smp_mb();
 
 	/* Wait until there are no running updates */
 	while (1) {
@@ -435,14 +526,12 @@ void journal_lock_updates(journal_t *journal)
 		if (!transaction)
 			break;
 
-		spin_lock(&transaction->t_handle_lock);
-		if (!transaction->t_updates) {
-			spin_unlock(&transaction->t_handle_lock);
-			break;
-		}
 		prepare_to_wait(&journal->j_wait_updates, &wait,
 				TASK_UNINTERRUPTIBLE);
-		spin_unlock(&transaction->t_handle_lock);
+		if (!atomic_read(&transaction->t_updates)) {
+			finish_wait(&journal->j_wait_updates, &wait);
+			break;
+		}
 		spin_unlock(&journal->j_state_lock);
 		schedule();
 		finish_wait(&journal->j_wait_updates, &wait);
@@ -1307,9 +1396,11 @@ int journal_stop(handle_t *handle)
 {
 	transaction_t *transaction = handle->h_transaction;
 	journal_t *journal = transaction->t_journal;
-	int old_handle_count, err;
+	int err, need_commit = 0;
+	pid_t pid;
+	tid_t tid;
 
-	J_ASSERT(transaction->t_updates > 0);
+	J_ASSERT(atomic_read(&transaction->t_updates) > 0);
 	J_ASSERT(journal_current_handle() == handle);
 
 	if (is_handle_aborted(handle))
@@ -1328,52 +1419,64 @@ int journal_stop(handle_t *handle)
 	/*
 	 * Implement synchronous transaction batching.  If the handle
 	 * was synchronous, don't force a commit immediately.  Let's
-	 * yield and let another thread piggyback onto this transaction.
-	 * Keep doing that while new threads continue to arrive.
+	 * wait and let other threads piggyback onto this transaction.
 	 * It doesn't cost much - we're about to run a commit and sleep
 	 * on IO anyway.  Speeds up many-threaded, many-dir operations
 	 * by 30x or more...
+	 *
+	 * Waiting longer than a commit takes only adds latency, so a
+	 * transaction that has already been open for an average commit
+	 * time gets committed straight away.  That makes the wait short
+	 * on fast devices and long enough to gather a batch on slow
+	 * ones.  And if the same process is the only one doing sync
+	 * writes, nobody is going to join: don't wait at all.
 	 */
-	if (handle->h_sync) {
-		do {
-			old_handle_count = transaction->t_handle_count;
+	pid = current->pid;
+	if (handle->h_sync && journal->j_last_sync_writer != pid) {
+		unsigned long commit_time, trans_time;
+
+		journal->j_last_sync_writer = pid;
+
+		spin_lock(&journal->j_state_lock);
+		commit_time = journal->j_average_commit_time;
+		spin_unlock(&journal->j_state_lock);
+
+		commit_time = max(commit_time, journal->j_min_batch_time);
+		commit_time = min(commit_time, journal->j_max_batch_time);
+		trans_time = jbd_time_usecs() - transaction->t_start_time;
+
+		if (trans_time < commit_time) {
 			set_current_state(TASK_UNINTERRUPTIBLE);
-			schedule_timeout(1);
-		} while (old_handle_count != transaction->t_handle_count);
+			schedule_timeout(usecs_to_jiffies(commit_time -
+							  trans_time));
+		}
 	}
 
 	current->journal_info = NULL;
-	spin_lock(&journal->j_state_lock);
-	spin_lock(&transaction->t_handle_lock);
-	transaction->t_outstanding_credits -= handle->h_buffer_credits;
-	transaction->t_updates--;
-	if (!transaction->t_updates) {
-		wake_up(&journal->j_wait_updates);
-		if (journal->j_barrier_count)
-			wake_up(&journal->j_wait_transaction_locked);
-	}
+	tid = transaction->t_tid;
 
 	/*
 	 * If the handle is marked SYNC, we need to set another commit
 	 * going!  We also want to force a commit if the current
 	 * transaction is occupying too much of the log, or if the
-	 * transaction is too old now.
+	 * transaction is too old now.  Decide before dropping our
+	 * update: after that the transaction may be gone.
 	 */
-	if (handle->h_sync ||
-			transaction->t_outstanding_credits >
+	if (atomic_sub_return(handle->h_buffer_credits,
+			      &transaction->t_outstanding_credits) >
 				journal->j_max_transaction_buffers ||
-	    		time_after_eq(jiffies, transaction->t_expires)) {
+	    time_after_eq(jiffies, transaction->t_expires))
+		need_commit = 1;
+	drop_transaction_update(journal, transaction);
+
+	if (handle->h_sync || need_commit) {
 		/* Do this even for aborted journals: an abort still
 		 * completes the commit thread, it just doesn't write
 		 * anything to disk. */
-		tid_t tid = transaction->t_tid;
-
-		spin_unlock(&transaction->t_handle_lock);
 		jbd_debug(2, "transaction too old, requesting commit for "
 					"handle %p\n", handle);
 		/* This is non-blocking */
-		__log_start_commit(journal, transaction->t_tid);
-		spin_unlock(&journal->j_state_lock);
+		log_start_commit(journal, tid);
 
 		/*
 		 * Special case: JFS_SYNC synchronous updates require us
@@ -1381,9 +1484,6 @@ int journal_stop(handle_t *handle)
 		 */
 		if (handle->h_sync && !(current->flags & PF_MEMALLOC))
 			err = log_wait_commit(journal, tid);
-	} else {
-		spin_unlock(&transaction->t_handle_lock);
-		spin_unlock(&journal->j_state_lock);
 	}
 
 	jbd_free_handle(handle);
@@ -635,6 +635,7 @@ static int jffs2_garbage_collect_pristine(struct jffs2_sb_info *c,
 	}
 	nraw->flash_offset |= REF_PRISTINE;
 	jffs2_add_physical_node_ref(c, nraw);
+	jffs2_sum_add_node(c, node, phys_ofs);
 
 	/* Link into per-inode list. This is safe because of the ic
 	   state being INO_STATE_GC. Note that if we're doing this
@@ -57,6 +57,10 @@ static int jffs2_scan_inode_node(struct jffs2_sb_info *c, struct jffs2_erasebloc
 				 struct jffs2_raw_inode *ri, uint32_t ofs);
 static int jffs2_scan_dirent_node(struct jffs2_sb_info *c, struct jffs2_eraseblock *jeb,
 				 struct jffs2_raw_dirent *rd, uint32_t ofs);
+#ifdef CONFIG_JFFS2_SUMMARY
+static int jffs2_scan_sumnode(struct jffs2_sb_info *c, struct jffs2_eraseblock *jeb,
+			      unsigned char *buf, uint32_t buf_size);
+#endif
 
 #define BLK_STATE_ALLFF		0
 #define BLK_STATE_CLEAN		1
@@ -310,6 +314,13 @@ static int jffs2_scan_eraseblock (struct jffs2_sb_info *c, struct jffs2_eraseblo
 		default: 	return ret;
 		}
 	}
+#endif
+#ifdef CONFIG_JFFS2_SUMMARY
+	err = jffs2_scan_sumnode(c, jeb, buf, buf_size);
+	if (err < 0)
+		return err;
+	if (err)
+		goto scanned;
 #endif
 	buf_ofs = jeb->offset;
 
@@ -605,7 +616,9 @@ scan_more:
 		}
 	}
 
-
+#ifdef CONFIG_JFFS2_SUMMARY
+ scanned:
+#endif
 	D1(printk(KERN_DEBUG "Block at 0x%08x: free 0x%08x, dirty 0x%08x, unchecked 0x%08x, used 0x%08x\n", jeb->offset, 
 		  jeb->free_size, jeb->dirty_size, jeb->unchecked_size, jeb->used_size));
 
@@ -809,6 +822,265 @@ static int jffs2_scan_dirent_node(struct jffs2_sb_info *c, struct jffs2_eraseblo
 	return 0;
 }
 
+#ifdef CONFIG_JFFS2_SUMMARY
+/*
+ * Check the entries of a summary against the block before trusting any:
+ * in order, within the block before the summary, and of sane sizes.
+ */
+static int jffs2_sum_entries_valid(struct jffs2_sb_info *c, unsigned char *p,
+				   uint32_t sum_size, uint32_t sum_num, uint32_t sumofs)
+{
+	unsigned char *end = p + sum_size;
+	uint32_t prev_end = 0, ofs, totlen, minlen;
+	uint32_t num = 0;
+
+	while (p < end) {
+		if (end - p < sizeof(jint16_t))
+			return 0;
+		switch (je16_to_cpu(((struct jffs2_sum_inode_flash *)p)->nodetype)) {
+		case JFFS2_NODETYPE_INODE: {
+			struct jffs2_sum_inode_flash *sn = (void *)p;
+
+			if (end - p < JFFS2_SUM_INODE_SIZE)
+				return 0;
+			ofs = je32_to_cpu(sn->offset);
+			totlen = je32_to_cpu(sn->totlen);
+			minlen = sizeof(struct jffs2_raw_inode);
+			p += JFFS2_SUM_INODE_SIZE;
+			break;
+		}
+		case JFFS2_NODETYPE_DIRENT: {
+			struct jffs2_sum_dirent_flash *sd = (void *)p;
+
+			if (end - p < JFFS2_SUM_DIRENT_SIZE(0) ||
+			    end - p < JFFS2_SUM_DIRENT_SIZE(sd->nsize))
+				return 0;
+			ofs = je32_to_cpu(sd->offset);
+			totlen = je32_to_cpu(sd->totlen);
+			minlen = sizeof(struct jffs2_raw_dirent) + sd->nsize;
+			if (PAD(minlen) != PAD(totlen))
+				return 0;
+			p += JFFS2_SUM_DIRENT_SIZE(sd->nsize);
+			break;
+		}
+		default:
+			return 0;
+		}
+		if ((ofs & 3) || ofs < prev_end || totlen < minlen ||
+		    totlen > sumofs || ofs > sumofs - PAD(totlen))
+			return 0;
+		prev_end = ofs + PAD(totlen);
+		num++;
+	}
+	return num == sum_num;
+}
+
+/* Whether a node listed in a summary has since been marked obsolete */
+static int jffs2_sum_node_obsolete(struct jffs2_sb_info *c, unsigned char *buf,
+				   uint32_t buf_size, uint32_t ofs)
+{
+	struct jffs2_unknown_node n, *np = &n;
+	size_t retlen;
+
+	/* Only where it can be marked on the flash itself */
+	if (!jffs2_can_mark_obsolete(c))
+		return 0;
+	if (!buf_size)
+		np = (void *)(buf + ofs);
+	else if (jffs2_flash_read(c, ofs, sizeof(n), &retlen, (void *)&n) ||
+		 retlen != sizeof(n))
+		return 1;
+	return !(je16_to_cpu(np->nodetype) & JFFS2_NODE_ACCURATE);
+}
+
+/*
+ * Account for a block from its summary instead of reading every node.
+ * Returns 1 when that was done, 0 when the block has no usable summary
+ * and needs the full scan, or an error.
+ */
+static int jffs2_scan_sumnode(struct jffs2_sb_info *c, struct jffs2_eraseblock *jeb,
+			      unsigned char *buf, uint32_t buf_size)
+{
+	struct jffs2_raw_summary hdr, *sum;
+	struct jffs2_sum_marker *sm;
+	struct jffs2_raw_node_ref *raw;
+	struct jffs2_inode_cache *ic;
+	unsigned char *sumbuf = NULL, *p, *end;
+	uint32_t sumofs, sumlen, sum_size, ofs, totlen, prev_end;
+	int ret;
+
+	/* The marker takes the last bytes of the block */
+	if (!buf_size)
+		sm = (void *)(buf + c->sector_size - sizeof(*sm));
+	else {
+		ret = jffs2_fill_scan_buf(c, buf, jeb->offset + c->sector_size - sizeof(*sm),
+					  sizeof(*sm));
+		if (ret)
+			return ret;
+		sm = (void *)buf;
+	}
+	if (je32_to_cpu(sm->magic) != JFFS2_SUM_MAGIC)
+		return 0;
+	sumofs = je32_to_cpu(sm->offset);
+	if ((sumofs & 3) || sumofs >= c->sector_size ||
+	    c->sector_size - sumofs < sizeof(*sum) + sizeof(*sm))
+		return 0;
+	sumlen = c->sector_size - sumofs;
+
+	if (!buf_size)
+		memcpy(&hdr, buf + sumofs, sizeof(hdr));
+	else {
+		ret = jffs2_fill_scan_buf(c, (void *)&hdr, jeb->offset + sumofs, sizeof(hdr));
+		if (ret)
+			return ret;
+	}
+
+	/* On NOR, the garbage collector may have marked it obsolete since */
+	hdr.nodetype = cpu_to_je16(je16_to_cpu(hdr.nodetype) | JFFS2_NODE_ACCURATE);
+	sum_size = je32_to_cpu(hdr.sum_size);
+	if (je16_to_cpu(hdr.magic) != JFFS2_MAGIC_BITMASK ||
+	    je16_to_cpu(hdr.nodetype) != JFFS2_NODETYPE_SUMMARY ||
+	    je32_to_cpu(hdr.totlen) != sumlen ||
+	    crc32(0, &hdr, sizeof(struct jffs2_unknown_node)-4) != je32_to_cpu(hdr.hdr_crc) ||
+	    crc32(0, &hdr, sizeof(hdr)-4) != je32_to_cpu(hdr.node_crc) ||
+	    sum_size > sumlen - sizeof(*sum) - sizeof(*sm)) {
+		printk(KERN_NOTICE "jffs2_scan_sumnode(): Bad summary node at 0x%08x, scanning the block\n",
+		       jeb->offset + sumofs);
+		return 0;
+	}
+
+	if (!buf_size)
+		sum = (void *)(buf + sumofs);
+	else {
+		p = buf;
+		if (sizeof(*sum) + sum_size > buf_size) {
+			p = sumbuf = kmalloc(sizeof(*sum) + sum_size, GFP_KERNEL);
+			if (!sumbuf)
+				return 0;
+		}
+		ret = jffs2_fill_scan_buf(c, p, jeb->offset + sumofs, sizeof(*sum) + sum_size);
+		if (ret)
+			goto out;
+		sum = (void *)p;
+	}
+	p = (unsigned char *)sum->sum;
+	end = p + sum_size;
+
+	ret = 0;
+	if (crc32(0, p, sum_size) != je32_to_cpu(hdr.sum_crc) ||
+	    !jffs2_sum_entries_valid(c, p, sum_size, je32_to_cpu(hdr.sum_num), sumofs)) {
+		printk(KERN_NOTICE "jffs2_scan_sumnode(): Bad summary entries at 0x%08x, scanning the block\n",
+		       jeb->offset + sumofs);
+		goto out;
+	}
+
+	D1(printk(KERN_DEBUG "jffs2_scan_sumnode(): %d entries in summary at 0x%08x\n",
+		  je32_to_cpu(hdr.sum_num), jeb->offset + sumofs));
+
+	prev_end = 0;
+	while (p < end) {
+		struct jffs2_sum_inode_flash *sn = (void *)p;
+		struct jffs2_sum_dirent_flash *sd = (void *)p;
+		struct jffs2_full_dirent *fd = NULL;
+		uint32_t ino;
+
+		if (je16_to_cpu(sn->nodetype) == JFFS2_NODETYPE_INODE) {
+			ofs = je32_to_cpu(sn->offset);
+			totlen = PAD(je32_to_cpu(sn->totlen));
+			ino = je32_to_cpu(sn->inode);
+			p += JFFS2_SUM_INODE_SIZE;
+		} else {
+			ofs = je32_to_cpu(sd->offset);
+			totlen = PAD(je32_to_cpu(sd->totlen));
+			ino = je32_to_cpu(sd->pino);
+			p += JFFS2_SUM_DIRENT_SIZE(sd->nsize);
+		}
+		if (ofs > prev_end)
+			DIRTY_SPACE(ofs - prev_end);
+		prev_end = ofs + totlen;
+
+		if (jffs2_sum_node_obsolete(c, buf, buf_size, jeb->offset + ofs)) {
+			D2(printk(KERN_DEBUG "Node at 0x%08x is obsolete. Skipping\n", jeb->offset + ofs));
+			DIRTY_SPACE(totlen);
+			continue;
+		}
+
+		ret = -ENOMEM;
+		if (je16_to_cpu(sn->nodetype) == JFFS2_NODETYPE_DIRENT) {
+			fd = jffs2_alloc_full_dirent(sd->nsize+1);
+			if (!fd)
+				goto out;
+			memcpy(&fd->name, sd->name, sd->nsize);
+			fd->name[sd->nsize] = 0;
+		}
+		raw = jffs2_alloc_raw_node_ref();
+		if (!raw) {
+			if (fd)
+				jffs2_free_full_dirent(fd);
+			goto out;
+		}
+		ic = jffs2_scan_make_ino_cache(c, ino);
+		if (!ic) {
+			if (fd)
+				jffs2_free_full_dirent(fd);
+			jffs2_free_raw_node_ref(raw);
+			goto out;
+		}
+
+		raw->flash_offset = (jeb->offset + ofs) | (fd ? REF_PRISTINE : REF_UNCHECKED);
+		raw->__totlen = totlen;
+		raw->next_phys = NULL;
+		raw->next_in_ino = ic->nodes;
+		ic->nodes = raw;
+		if (!jeb->first_node)
+			jeb->first_node = raw;
+		if (jeb->last_node)
+			jeb->last_node->next_phys = raw;
+		jeb->last_node = raw;
+
+		if (fd) {
+			fd->raw = raw;
+			fd->next = NULL;
+			fd->version = je32_to_cpu(sd->version);
+			fd->ino = je32_to_cpu(sd->ino);
+			fd->nhash = full_name_hash(fd->name, sd->nsize);
+			fd->type = sd->type;
+			pseudo_random += fd->version;
+			USED_SPACE(totlen);
+			jffs2_add_fd_to_list(c, fd, &ic->scan_dents);
+		} else {
+			pseudo_random += je32_to_cpu(sn->version);
+			UNCHECKED_SPACE(totlen);
+		}
+	}
+	if (sumofs > prev_end)
+		DIRTY_SPACE(sumofs - prev_end);
+
+	/* And the summary itself, unless it has been marked obsolete */
+	if (!jffs2_sum_node_obsolete(c, buf, buf_size, jeb->offset + sumofs)) {
+		ret = -ENOMEM;
+		raw = jffs2_alloc_raw_node_ref();
+		if (!raw)
+			goto out;
+		raw->flash_offset = (jeb->offset + sumofs) | REF_NORMAL;
+		raw->__totlen = sumlen;
+		raw->next_phys = NULL;
+		raw->next_in_ino = NULL;
+		if (!jeb->first_node)
+			jeb->first_node = raw;
+		if (jeb->last_node)
+			jeb->last_node->next_phys = raw;
+		jeb->last_node = raw;
+		USED_SPACE(sumlen);
+	} else
+		DIRTY_SPACE(sumlen);
+	ret = 1;
+ out:
+	kfree(sumbuf);
+	return ret;
+}
+#endif /* CONFIG_JFFS2_SUMMARY */
+
 static int count_list(struct list_head *l)
 {
 	uint32_t count = 0;
@@ -0,0 +1,250 @@
+/*
+ * JFFS2 -- Journalling Flash File System, Version 2.
+ *
+ * Erase block summaries, see summary.h.
+ *
+ * An entry is collected for each inode and dirent node written to
+ * c->nextblock, and jffs2_do_reserve_space() keeps enough room at the end
+ * of the block for the summary node listing them, which it writes when
+ * the block is full.  Anything else that ends up in the block, apart from
+ * padding and obsolete space, means the list is incomplete: the block
+ * then gets no summary and is scanned in full at mount.
+ *
+ * For licensing information, see the file 'LICENCE' in this directory.
+ *
+ */
+
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/mtd/mtd.h>
+#include <linux/crc32.h>
+#include "nodelist.h"
+
+/* Worst case for the entry of the next node written */
+#define JFFS2_SUM_MAX_ENTRY	JFFS2_SUM_DIRENT_SIZE(JFFS2_MAX_NAME_LEN)
+
+static void jffs2_sum_clear(struct jffs2_summary *s)
+{
+	struct jffs2_sum_entry *e, *next;
+
+	for (e = s->head; e; e = next) {
+		next = e->next;
+		kfree(e);
+	}
+	s->head = NULL;
+	s->tail = &s->head;
+	s->sum_num = 0;
+	s->sum_size = 0;
+}
+
+int jffs2_sum_init(struct jffs2_sb_info *c)
+{
+	c->summary = kmalloc(sizeof(struct jffs2_summary), GFP_KERNEL);
+	if (!c->summary)
+		return -ENOMEM;
+	c->summary->head = NULL;
+	jffs2_sum_clear(c->summary);
+	/* The nextblock picked by the scan has nodes we know nothing of */
+	c->summary->nosum = 1;
+	return 0;
+}
+
+void jffs2_sum_exit(struct jffs2_sb_info *c)
+{
+	if (c->summary) {
+		jffs2_sum_clear(c->summary);
+		kfree(c->summary);
+		c->summary = NULL;
+	}
+}
+
+/* c->nextblock has just been taken off the free_list */
+void jffs2_sum_reset_collected(struct jffs2_sb_info *c)
+{
+	jffs2_sum_clear(c->summary);
+	c->summary->nosum = 0;
+}
+
+void jffs2_sum_disable_collecting(struct jffs2_sb_info *c)
+{
+	D1(if (!c->summary->nosum)
+		   printk(KERN_DEBUG "jffs2_sum_disable_collecting(): no summary for block at 0x%08x\n",
+			  c->nextblock ? c->nextblock->offset : 0));
+	jffs2_sum_clear(c->summary);
+	c->summary->nosum = 1;
+}
+
+/* Space to keep free at the end of c->nextblock for its summary */
+uint32_t jffs2_sum_reserve(struct jffs2_sb_info *c)
+{
+	struct jffs2_summary *s = c->summary;
+
+	if (s->nosum)
+		return 0;
+	return PAD(sizeof(struct jffs2_raw_summary) + s->sum_size +
+		   JFFS2_SUM_MAX_ENTRY + sizeof(struct jffs2_sum_marker));
+}
+
+static void *jffs2_sum_add_entry(struct jffs2_sb_info *c, uint32_t len, uint32_t ofs)
+{
+	struct jffs2_summary *s = c->summary;
+	struct jffs2_sum_entry *e;
+
+	if (s->nosum)
+		return NULL;
+	if (!c->nextblock || ofs - c->nextblock->offset >= c->sector_size) {
+		jffs2_sum_disable_collecting(c);
+		return NULL;
+	}
+	e = kmalloc(sizeof(*e) + len, GFP_KERNEL);
+	if (!e) {
+		jffs2_sum_disable_collecting(c);
+		return NULL;
+	}
+	e->next = NULL;
+	e->len = len;
+	*s->tail = e;
+	s->tail = &e->next;
+	s->sum_num++;
+	s->sum_size += len;
+	return e->data;
+}
+
+void jffs2_sum_add_inode(struct jffs2_sb_info *c, struct jffs2_raw_inode *ri, uint32_t ofs)
+{
+	struct jffs2_sum_inode_flash *sn;
+
+	sn = jffs2_sum_add_entry(c, JFFS2_SUM_INODE_SIZE, ofs);
+	if (!sn)
+		return;
+	sn->nodetype = ri->nodetype;
+	sn->inode = ri->ino;
+	sn->version = ri->version;
+	sn->offset = cpu_to_je32(ofs - c->nextblock->offset);
+	sn->totlen = ri->totlen;
+}
+
+void jffs2_sum_add_dirent(struct jffs2_sb_info *c, struct jffs2_raw_dirent *rd,
+			  const unsigned char *name, uint32_t ofs)
+{
+	struct jffs2_sum_dirent_flash *sd;
+
+	sd = jffs2_sum_add_entry(c, JFFS2_SUM_DIRENT_SIZE(rd->nsize), ofs);
+	if (!sd)
+		return;
+	sd->nodetype = rd->nodetype;
+	sd->totlen = rd->totlen;
+	sd->offset = cpu_to_je32(ofs - c->nextblock->offset);
+	sd->pino = rd->pino;
+	sd->version = rd->version;
+	sd->ino = rd->ino;
+	sd->nsize = rd->nsize;
+	sd->type = rd->type;
+	memcpy(sd->name, name, rd->nsize);
+}
+
+/* A node copied as it was by the garbage collector */
+void jffs2_sum_add_node(struct jffs2_sb_info *c, union jffs2_node_union *node, uint32_t ofs)
+{
+	switch (je16_to_cpu(node->u.nodetype)) {
+	case JFFS2_NODETYPE_INODE:
+		jffs2_sum_add_inode(c, &node->i, ofs);
+		break;
+	case JFFS2_NODETYPE_DIRENT:
+		jffs2_sum_add_dirent(c, &node->d, node->d.name, ofs);
+		break;
+	default:
+		jffs2_sum_disable_collecting(c);
+	}
+}
+
+/*
+ * Write the summary into the rest of c->nextblock, which fills it.
+ * Called with the alloc_sem held but not the erase_completion_lock.
+ * Either way, c->nextblock gets no other summary afterwards.
+ */
+int jffs2_sum_write_sumnode(struct jffs2_sb_info *c)
+{
+	struct jffs2_summary *s = c->summary;
+	struct jffs2_eraseblock *jeb = c->nextblock;
+	struct jffs2_raw_summary *sum;
+	struct jffs2_sum_marker *sm;
+	struct jffs2_raw_node_ref *raw;
+	struct jffs2_sum_entry *e;
+	unsigned char *buf, *p;
+	uint32_t sumofs, totlen;
+	size_t retlen;
+	int ret = 0;
+
+	if (s->nosum || !jeb)
+		goto out;
+
+	sumofs = c->sector_size - jeb->free_size;
+	totlen = jeb->free_size;
+	if (totlen < sizeof(*sum) + s->sum_size + sizeof(*sm)) {
+		/* A padded wbuf flush ate into the space kept for it */
+		D1(printk(KERN_DEBUG "jffs2_sum_write_sumnode(): no room left for summary at 0x%08x\n",
+			  jeb->offset + sumofs));
+		goto out;
+	}
+
+	ret = -ENOMEM;
+	raw = jffs2_alloc_raw_node_ref();
+	if (!raw)
+		goto out;
+	buf = kmalloc(totlen, GFP_KERNEL);
+	if (!buf) {
+		jffs2_free_raw_node_ref(raw);
+		goto out;
+	}
+	memset(buf, 0xff, totlen);
+
+	sum = (struct jffs2_raw_summary *)buf;
+	p = (unsigned char *)sum->sum;
+	for (e = s->head; e; e = e->next) {
+		memcpy(p, e->data, e->len);
+		p += e->len;
+	}
+	sum->magic = cpu_to_je16(JFFS2_MAGIC_BITMASK);
+	sum->nodetype = cpu_to_je16(JFFS2_NODETYPE_SUMMARY);
+	sum->totlen = cpu_to_je32(totlen);
+	sum->hdr_crc = cpu_to_je32(crc32(0, sum, sizeof(struct jffs2_unknown_node)-4));
+	sum->sum_num = cpu_to_je32(s->sum_num);
+	sum->sum_size = cpu_to_je32(s->sum_size);
+	sum->sum_crc = cpu_to_je32(crc32(0, sum->sum, s->sum_size));
+	sum->node_crc = cpu_to_je32(crc32(0, sum, sizeof(*sum)-4));
+
+	sm = (struct jffs2_sum_marker *)(buf + totlen - sizeof(*sm));
+	sm->offset = cpu_to_je32(sumofs);
+	sm->magic = cpu_to_je32(JFFS2_SUM_MAGIC);
+
+	raw->flash_offset = jeb->offset + sumofs;
+	raw->__totlen = totlen;
+	raw->next_phys = NULL;
+	raw->next_in_ino = NULL;
+
+	D1(printk(KERN_DEBUG "jffs2_sum_write_sumnode(): %u entries at 0x%08x\n",
+		  s->sum_num, raw->flash_offset));
+
+	ret = jffs2_flash_write(c, raw->flash_offset, totlen, &retlen, buf);
+	kfree(buf);
+	if (ret || retlen != totlen) {
+		printk(KERN_NOTICE "Write of %u bytes of summary at 0x%08x failed. returned %d, retlen %zd\n",
+		       totlen, raw->flash_offset, ret, retlen);
+		if (retlen) {
+			raw->flash_offset |= REF_OBSOLETE;
+			jffs2_add_physical_node_ref(c, raw);
+			jffs2_mark_node_obsolete(c, raw);
+		} else
+			jffs2_free_raw_node_ref(raw);
+		if (!ret)
+			ret = -EIO;
+		goto out;
+	}
+	raw->flash_offset |= REF_NORMAL;
+	ret = jffs2_add_physical_node_ref(c, raw);
+ out:
+	jffs2_sum_clear(s);
+	s->nosum = 1;
+	return ret;
+}
@@ -0,0 +1,106 @@
+/*
+ * JFFS2 -- Journalling Flash File System, Version 2.
+ *
+ * Erase block summaries: the last node of a full erase block lists the
+ * nodes before it, so that the scan at mount time can read that node
+ * instead of the whole block.  Blocks without one are scanned as ever.
+ *
+ * For licensing information, see the file 'LICENCE' in this directory.
+ *
+ */
+
+#ifndef JFFS2_SUMMARY_H
+#define JFFS2_SUMMARY_H
+
+/* Found at the very end of an erase block with a summary */
+#define JFFS2_SUM_MAGIC	0x02851885
+
+struct jffs2_sum_inode_flash
+{
+	jint16_t nodetype;	/* == JFFS2_NODETYPE_INODE */
+	jint32_t inode;
+	jint32_t version;
+	jint32_t offset;	/* from the start of the erase block */
+	jint32_t totlen;
+} __attribute__((packed));
+
+struct jffs2_sum_dirent_flash
+{
+	jint16_t nodetype;	/* == JFFS2_NODETYPE_DIRENT */
+	jint32_t totlen;
+	jint32_t offset;	/* from the start of the erase block */
+	jint32_t pino;
+	jint32_t version;
+	jint32_t ino;
+	uint8_t nsize;
+	uint8_t type;
+	uint8_t name[0];
+} __attribute__((packed));
+
+/* The summary node runs to the end of the block, marker included */
+struct jffs2_raw_summary
+{
+	jint16_t magic;
+	jint16_t nodetype;	/* == JFFS2_NODETYPE_SUMMARY */
+	jint32_t totlen;
+	jint32_t hdr_crc;
+	jint32_t sum_num;	/* number of entries */
+	jint32_t sum_size;	/* bytes of entries */
+	jint32_t sum_crc;	/* CRC of the entries */
+	jint32_t node_crc;	/* CRC of the above */
+	jint32_t sum[0];
+} __attribute__((packed));
+
+struct jffs2_sum_marker
+{
+	jint32_t offset;	/* of the summary node, from the start of the block */
+	jint32_t magic;		/* == JFFS2_SUM_MAGIC */
+} __attribute__((packed));
+
+#define JFFS2_SUM_INODE_SIZE	(sizeof(struct jffs2_sum_inode_flash))
+#define JFFS2_SUM_DIRENT_SIZE(x) (sizeof(struct jffs2_sum_dirent_flash) + (x))
+
+#ifdef CONFIG_JFFS2_SUMMARY
+
+/* The entries collected for the nodes written to c->nextblock so far */
+struct jffs2_sum_entry
+{
+	struct jffs2_sum_entry *next;
+	uint32_t len;
+	unsigned char data[0];
+};
+
+struct jffs2_summary
+{
+	struct jffs2_sum_entry *head, **tail;
+	uint32_t sum_num;
+	uint32_t sum_size;
+	int nosum;		/* c->nextblock will get no summary */
+};
+
+int jffs2_sum_init(struct jffs2_sb_info *c);
+void jffs2_sum_exit(struct jffs2_sb_info *c);
+void jffs2_sum_reset_collected(struct jffs2_sb_info *c);
+void jffs2_sum_disable_collecting(struct jffs2_sb_info *c);
+uint32_t jffs2_sum_reserve(struct jffs2_sb_info *c);
+int jffs2_sum_write_sumnode(struct jffs2_sb_info *c);
+void jffs2_sum_add_inode(struct jffs2_sb_info *c, struct jffs2_raw_inode *ri, uint32_t ofs);
+void jffs2_sum_add_dirent(struct jffs2_sb_info *c, struct jffs2_raw_dirent *rd,
+			  const unsigned char *name, uint32_t ofs);
+void jffs2_sum_add_node(struct jffs2_sb_info *c, union jffs2_node_union *node, uint32_t ofs);
+
+#else
+
+#define jffs2_sum_init(c) (0)
+#define jffs2_sum_exit(c) do { } while (0)
+#define jffs2_sum_reset_collected(c) do { } while (0)
+#define jffs2_sum_disable_collecting(c) do { } while (0)
+#define jffs2_sum_reserve(c) (0)
+#define jffs2_sum_write_sumnode(c) (0)
+#define jffs2_sum_add_inode(c, ri, ofs) do { } while (0)
+#define jffs2_sum_add_dirent(c, rd, name, ofs) do { } while (0)
+#define jffs2_sum_add_node(c, node, ofs) do { } while (0)
+
+#endif /* CONFIG_JFFS2_SUMMARY */
+
+#endif /* JFFS2_SUMMARY_H */
@@ -282,6 +282,7 @@ static void jffs2_put_super (struct super_block *sb)
 	else
 		kfree(c->blocks);
 	jffs2_flash_cleanup(c);
+	jffs2_sum_exit(c);
 	kfree(c->inocache_list);
 	if (c->mtd->sync)
 		c->mtd->sync(c->mtd);
@@ -211,6 +211,7 @@ struct jffs2_full_dnode *jffs2_write_dnode(struct jffs2_sb_info *c, struct jffs2
 		raw->flash_offset |= REF_NORMAL;
 	}
 	jffs2_add_physical_node_ref(c, raw);
+	jffs2_sum_add_inode(c, ri, flash_ofs);
 
 	/* Link into per-inode list */
 	spin_lock(&c->erase_completion_lock);
@@ -334,6 +335,7 @@ struct jffs2_full_dirent *jffs2_write_dirent(struct jffs2_sb_info *c, struct jff
 	/* Mark the space used */
 	raw->flash_offset |= REF_PRISTINE;
 	jffs2_add_physical_node_ref(c, raw);
+	jffs2_sum_add_dirent(c, rd, name, flash_ofs);
 
 	spin_lock(&c->erase_completion_lock);
 	raw->next_in_ino = f->inocache->nodes;
@@ -117,6 +117,7 @@
 #include <linux/capability.h>
 #include <linux/file.h>
 #include <linux/fs.h>
+#include <linux/hash.h>
 #include <linux/init.h>
 #include <linux/module.h>
 #include <linux/security.h>
@@ -142,6 +143,14 @@ LIST_HEAD(file_lock_list);
 
 EXPORT_SYMBOL(file_lock_list);
 
+/*
+ * Blocked POSIX waiters, hashed by fl_owner for posix_locks_deadlock().
+ * Those of lock managers which compare owners their own way can't be
+ * hashed like that and all go on blocked_list.
+ */
+#define BLOCKED_HASH_BITS	7
+
+static struct list_head blocked_hash[1 << BLOCKED_HASH_BITS];
 static LIST_HEAD(blocked_list);
 
 static kmem_cache_t *filelock_cache;
@@ -475,6 +484,16 @@ posix_same_owner(struct file_lock *fl1, struct file_lock *fl2)
 	return fl1->fl_owner == fl2->fl_owner;
 }
 
+static inline int posix_lm_owner(struct file_lock *fl)
+{
+	return fl->fl_lmops && fl->fl_lmops->fl_compare_owner;
+}
+
+static inline struct list_head *posix_owner_hash(struct file_lock *fl)
+{
+	return &blocked_hash[hash_ptr(fl->fl_owner, BLOCKED_HASH_BITS)];
+}
+
 /* Remove waiter from blocker's block list.
  * When blocker ends up pointing to itself then the list is empty.
  */
@@ -511,7 +530,8 @@ static void locks_insert_block(struct file_lock *blocker,
 	list_add_tail(&waiter->fl_block, &blocker->fl_block);
 	waiter->fl_next = blocker;
 	if (IS_POSIX(blocker))
-		list_add(&waiter->fl_link, &blocked_list);
+		list_add(&waiter->fl_link, posix_lm_owner(waiter) ?
+			 &blocked_list : posix_owner_hash(waiter));
 }
 
 /* Wake up processes blocked waiting for blocker.
@@ -679,21 +699,36 @@ EXPORT_SYMBOL(posix_test_lock);
  * from a broken NFS client. But broken NFS clients have a lot more to
  * worry about than proper deadlock detection anyway... --okir
  */
+static struct file_lock *posix_blocked_by_owner(struct list_head *list,
+						struct file_lock *block_fl)
+{
+	struct file_lock *fl;
+
+	list_for_each_entry(fl, list, fl_link)
+		if (posix_same_owner(fl, block_fl))
+			return fl;
+	return NULL;
+}
+
+/*
+ * A hashed waiter can only have the owner of block_fl if it has the same
+ * fl_owner, and one on blocked_list only if block_fl has the same lock
+ * manager, so only those two lists need searching.
+ */
 int posix_locks_deadlock(struct file_lock *caller_fl,
 				struct file_lock *block_fl)
 {
-	struct list_head *tmp;
+	struct file_lock *fl;
 
 next_task:
 	if (posix_same_owner(caller_fl, block_fl))
 		return 1;
-	list_for_each(tmp, &blocked_list) {
-		struct file_lock *fl = list_entry(tmp, struct file_lock, fl_link);
-		if (posix_same_owner(fl, block_fl)) {
-			fl = fl->fl_next;
-			block_fl = fl;
-			goto next_task;
-		}
+	fl = posix_blocked_by_owner(posix_owner_hash(block_fl), block_fl);
+	if (!fl && posix_lm_owner(block_fl))
+		fl = posix_blocked_by_owner(&blocked_list, block_fl);
+	if (fl) {
+		block_fl = fl->fl_next;
+		goto next_task;
 	}
 	return 0;
 }
@@ -2203,6 +2238,11 @@ EXPORT_SYMBOL(steal_locks);
 
 static int __init filelock_init(void)
 {
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(blocked_hash); i++)
+		INIT_LIST_HEAD(&blocked_hash[i]);
+
 	filelock_cache = kmem_cache_create("file_lock_cache",
 			sizeof(struct file_lock), 0, SLAB_PANIC,
 			init_once, NULL);
@@ -117,6 +117,66 @@ mpage_alloc(struct block_device *bdev,
 	return bio;
 }
 
+/*
+ * Map blocks from @iblock.  A get_blocks function may map up to
+ * @max_blocks contiguous blocks in one call and says how many in
+ * bh->b_size; a get_block function always maps just one.
+ */
+static int
+mpage_map_blocks(struct inode *inode, sector_t iblock, unsigned long max_blocks,
+		struct buffer_head *bh, int create, get_block_t get_block,
+		get_blocks_t get_blocks)
+{
+	const unsigned blocksize = 1 << inode->i_blkbits;
+	int ret;
+
+	bh->b_state = 0;
+	bh->b_size = blocksize;
+	if (get_blocks) {
+		ret = get_blocks(inode, iblock, max_blocks, bh, create);
+		if (bh->b_size < blocksize)
+			bh->b_size = blocksize;
+		else if (bh->b_size > (max_blocks << inode->i_blkbits))
+			bh->b_size = max_blocks << inode->i_blkbits;
+	} else {
+		ret = get_block(inode, iblock, bh, create);
+	}
+	return ret;
+}
+
+/*
+ * The mapping in @map_bh starts at @first_logical_block.  Fill @blocks
+ * with the disk blocks of up to @nr blocks from @block_in_file which it
+ * covers, and return how many those were.  This lets a run mapped for
+ * one page be used for the pages after it without asking the
+ * filesystem again.
+ */
+static unsigned
+mpage_use_mapping(struct buffer_head *map_bh, sector_t first_logical_block,
+		sector_t block_in_file, sector_t *blocks, unsigned nr,
+		unsigned blkbits)
+{
+	sector_t end = first_logical_block + (map_bh->b_size >> blkbits);
+	unsigned i;
+
+	if (!buffer_mapped(map_bh) || block_in_file < first_logical_block ||
+	    block_in_file >= end)
+		return 0;
+	for (i = 0; i < nr && block_in_file + i < end; i++)
+		blocks[i] = map_bh->b_blocknr +
+			(block_in_file - first_logical_block) + i;
+	return i;
+}
+
+/* Did the page take the last block of the mapping? */
+static inline int
+mpage_mapping_done(struct buffer_head *map_bh, sector_t first_logical_block,
+		sector_t block_in_file, unsigned blkbits)
+{
+	return block_in_file == first_logical_block +
+				(map_bh->b_size >> blkbits);
+}
+
 /*
  * support function for mpage_readpages.  The fs supplied get_block might
  * return an up to date buffer.  This is used to map that buffer into
@@ -205,10 +265,17 @@ map_buffer_to_page(struct page *page, struct buffer_head *bh, int page_block)
  * this one.  So you should push what I/O you have currently accumulated.
  *
  * This all causes the disk requests to be issued in the correct order.
+ *
+ * With a get_blocks function the filesystem can map a whole run of blocks
+ * at once.  The run is kept in @map_bh and used for the following pages
+ * until it is exhausted, so a large contiguous file is mapped once per
+ * extent rather than once per block.
  */
 static struct bio *
 do_mpage_readpage(struct bio *bio, struct page *page, unsigned nr_pages,
-			sector_t *last_block_in_bio, get_block_t get_block)
+			sector_t *last_block_in_bio, struct buffer_head *map_bh,
+			sector_t *first_logical_block, get_block_t get_block,
+			get_blocks_t get_blocks)
 {
 	struct inode *inode = page->mapping->host;
 	const unsigned blkbits = inode->i_blkbits;
@@ -216,33 +283,58 @@ do_mpage_readpage(struct bio *bio, struct page *page, unsigned nr_pages,
 	const unsigned blocksize = 1 << blkbits;
 	sector_t block_in_file;
 	sector_t last_block;
+	sector_t last_block_in_file;
 	sector_t blocks[MAX_BUF_PER_PAGE];
 	unsigned page_block;
 	unsigned first_hole = blocks_per_page;
+	unsigned nr;
 	struct block_device *bdev = NULL;
-	struct buffer_head bh;
 	int length;
 	int fully_mapped = 1;
 
 	if (page_has_buffers(page))
 		goto confused;
 
-	block_in_file = page->index << (PAGE_CACHE_SHIFT - blkbits);
-	last_block = (i_size_read(inode) + blocksize - 1) >> blkbits;
+	block_in_file = (sector_t)page->index << (PAGE_CACHE_SHIFT - blkbits);
+	last_block = block_in_file + nr_pages * blocks_per_page;
+	last_block_in_file = (i_size_read(inode) + blocksize - 1) >> blkbits;
+	if (last_block > last_block_in_file)
+		last_block = last_block_in_file;
+
+	map_bh->b_page = page;
+	for (page_block = 0; page_block < blocks_per_page; ) {
+		nr = mpage_use_mapping(map_bh, *first_logical_block,
+				block_in_file, blocks + page_block,
+				blocks_per_page - page_block, blkbits);
+		if (nr) {
+			if (first_hole != blocks_per_page)
+				goto confused;		/* hole -> non-hole */
+
+			/* Contiguous blocks? */
+			if (page_block &&
+			    blocks[page_block-1] != blocks[page_block] - 1)
+				goto confused;
+			bdev = map_bh->b_bdev;
+			page_block += nr;
+			block_in_file += nr;
+			continue;
+		}
 
-	bh.b_page = page;
-	for (page_block = 0; page_block < blocks_per_page;
-				page_block++, block_in_file++) {
-		bh.b_state = 0;
+		map_bh->b_state = 0;
 		if (block_in_file < last_block) {
-			if (get_block(inode, block_in_file, &bh, 0))
+			if (mpage_map_blocks(inode, block_in_file,
+					last_block - block_in_file, map_bh, 0,
+					get_block, get_blocks))
 				goto confused;
+			*first_logical_block = block_in_file;
 		}
 
-		if (!buffer_mapped(&bh)) {
+		if (!buffer_mapped(map_bh)) {
 			fully_mapped = 0;
 			if (first_hole == blocks_per_page)
 				first_hole = page_block;
+			page_block++;
+			block_in_file++;
 			continue;
 		}
 
@@ -252,19 +344,11 @@ do_mpage_readpage(struct bio *bio, struct page *page, unsigned nr_pages,
 		 * we just collected from get_block into the page's buffers
 		 * so readpage doesn't have to repeat the get_block call
 		 */
-		if (buffer_uptodate(&bh)) {
-			map_buffer_to_page(page, &bh, page_block);
+		if (buffer_uptodate(map_bh)) {
+			map_buffer_to_page(page, map_bh, page_block);
+			map_bh->b_state = 0;
 			goto confused;
 		}
-	
-		if (first_hole != blocks_per_page)
-			goto confused;		/* hole -> non-hole */
-
-		/* Contiguous blocks? */
-		if (page_block && blocks[page_block-1] != bh.b_blocknr-1)
-			goto confused;
-		blocks[page_block] = bh.b_blocknr;
-		bdev = bh.b_bdev;
 	}
 
 	if (first_hole != blocks_per_page) {
@@ -303,7 +387,10 @@ alloc_new:
 		goto alloc_new;
 	}
 
-	if (buffer_boundary(&bh) || (first_hole != blocks_per_page))
+	if ((buffer_boundary(map_bh) &&
+	     mpage_mapping_done(map_bh, *first_logical_block, block_in_file,
+				blkbits)) ||
+	    (first_hole != blocks_per_page))
 		bio = mpage_bio_submit(READ, bio);
 	else
 		*last_block_in_bio = blocks[blocks_per_page - 1];
@@ -320,15 +407,20 @@ confused:
 	goto out;
 }
 
-int
-mpage_readpages(struct address_space *mapping, struct list_head *pages,
-				unsigned nr_pages, get_block_t get_block)
+static int
+__mpage_readpages(struct address_space *mapping, struct list_head *pages,
+		unsigned nr_pages, get_block_t get_block,
+		get_blocks_t get_blocks)
 {
 	struct bio *bio = NULL;
 	unsigned page_idx;
 	sector_t last_block_in_bio = 0;
+	struct buffer_head map_bh;
+	sector_t first_logical_block = 0;
 	struct pagevec lru_pvec;
 
+	map_bh.b_state = 0;
+	map_bh.b_size = 0;
 	pagevec_init(&lru_pvec, 0);
 	for (page_idx = 0; page_idx < nr_pages; page_idx++) {
 		struct page *page = list_entry(pages->prev, struct page, lru);
@@ -339,7 +431,9 @@ mpage_readpages(struct address_space *mapping, struct list_head *pages,
 					page->index, GFP_KERNEL)) {
 			bio = do_mpage_readpage(bio, page,
 					nr_pages - page_idx,
-					&last_block_in_bio, get_block);
+					&last_block_in_bio, &map_bh,
+					&first_logical_block,
+					get_block, get_blocks);
 			if (!pagevec_add(&lru_pvec, page))
 				__pagevec_lru_add(&lru_pvec);
 		} else {
@@ -352,8 +446,34 @@ mpage_readpages(struct address_space *mapping, struct list_head *pages,
 		mpage_bio_submit(READ, bio);
 	return 0;
 }
+
+int
+mpage_readpages(struct address_space *mapping, struct list_head *pages,
+				unsigned nr_pages, get_block_t get_block)
+{
+	return __mpage_readpages(mapping, pages, nr_pages, get_block, NULL);
+}
 EXPORT_SYMBOL(mpage_readpages);
 
+/**
+ * mpage_readpages_blocks - mpage_readpages() mapping a run at a time
+ *
+ * @get_blocks: maps up to max_blocks blocks in one call, returning the
+ *   number mapped in bh_result->b_size like it does for direct I/O
+ *
+ * @get_block is still needed for pages which fall back to
+ * block_read_full_page().
+ */
+int
+mpage_readpages_blocks(struct address_space *mapping, struct list_head *pages,
+		unsigned nr_pages, get_block_t get_block,
+		get_blocks_t get_blocks)
+{
+	return __mpage_readpages(mapping, pages, nr_pages, get_block,
+				 get_blocks);
+}
+EXPORT_SYMBOL(mpage_readpages_blocks);
+
 /*
  * This isn't called much at all
  */
@@ -361,9 +481,13 @@ int mpage_readpage(struct page *page, get_block_t get_block)
 {
 	struct bio *bio = NULL;
 	sector_t last_block_in_bio = 0;
+	struct buffer_head map_bh;
+	sector_t first_logical_block = 0;
 
-	bio = do_mpage_readpage(bio, page, 1,
-			&last_block_in_bio, get_block);
+	map_bh.b_state = 0;
+	map_bh.b_size = 0;
+	bio = do_mpage_readpage(bio, page, 1, &last_block_in_bio,
+			&map_bh, &first_logical_block, get_block, NULL);
 	if (bio)
 		mpage_bio_submit(READ, bio);
 	return 0;
@@ -381,6 +505,12 @@ EXPORT_SYMBOL(mpage_readpage);
  *
  * If all blocks are found to be contiguous then the page can go into the
  * BIO.  Otherwise fall back to the mapping's writepage().
+ *
+ * With a get_blocks function, blocks which are already allocated are
+ * looked up a run at a time and the run is kept in @map_bh for the
+ * following pages, as on the read side.  Only the blocks of the page
+ * being written are ever allocated, so no block outside the dirty pages
+ * gets mapped to stale data.
  * 
  * FIXME: This code wants an estimate of how many pages are still to be
  * written, so it can intelligently allocate a suitably-sized BIO.  For now,
@@ -388,8 +518,9 @@ EXPORT_SYMBOL(mpage_readpage);
  */
 static struct bio *
 __mpage_writepage(struct bio *bio, struct page *page, get_block_t get_block,
-	sector_t *last_block_in_bio, int *ret, struct writeback_control *wbc,
-	writepage_t writepage_fn)
+	get_blocks_t get_blocks, struct buffer_head *map_bh,
+	sector_t *first_logical_block, sector_t *last_block_in_bio, int *ret,
+	struct writeback_control *wbc, writepage_t writepage_fn)
 {
 	struct address_space *mapping = page->mapping;
 	struct inode *inode = page->mapping->host;
@@ -406,7 +537,7 @@ __mpage_writepage(struct bio *bio, struct page *page, get_block_t get_block,
 	sector_t boundary_block = 0;
 	struct block_device *boundary_bdev = NULL;
 	int length;
-	struct buffer_head map_bh;
+	unsigned nr;
 	loff_t i_size = i_size_read(inode);
 
 	if (page_has_buffers(page)) {
@@ -463,31 +594,64 @@ __mpage_writepage(struct bio *bio, struct page *page, get_block_t get_block,
 	 * The page has no buffers: map it to disk
 	 */
 	BUG_ON(!PageUptodate(page));
-	block_in_file = page->index << (PAGE_CACHE_SHIFT - blkbits);
+	block_in_file = (sector_t)page->index << (PAGE_CACHE_SHIFT - blkbits);
 	last_block = (i_size - 1) >> blkbits;
-	map_bh.b_page = page;
+	if (!i_size || block_in_file > last_block)
+		goto confused;		/* truncated under us */
+	map_bh->b_page = page;
 	for (page_block = 0; page_block < blocks_per_page; ) {
+		unsigned long max_blocks = last_block + 1 - block_in_file;
 
-		map_bh.b_state = 0;
-		if (get_block(inode, block_in_file, &map_bh, 1))
-			goto confused;
-		if (buffer_new(&map_bh))
-			unmap_underlying_metadata(map_bh.b_bdev,
-						map_bh.b_blocknr);
-		if (buffer_boundary(&map_bh)) {
-			boundary_block = map_bh.b_blocknr;
-			boundary_bdev = map_bh.b_bdev;
+		nr = mpage_use_mapping(map_bh, *first_logical_block,
+				block_in_file, blocks + page_block,
+				min_t(unsigned long, max_blocks,
+				      blocks_per_page - page_block), blkbits);
+		if (!nr) {
+			/*
+			 * Look up what is allocated first, then allocate for
+			 * this page only.
+			 */
+			if (get_blocks && mpage_map_blocks(inode, block_in_file,
+					max_blocks, map_bh, 0, NULL, get_blocks))
+				goto confused;
+			if (!get_blocks || !buffer_mapped(map_bh)) {
+				if (mpage_map_blocks(inode, block_in_file,
+						min_t(unsigned long, max_blocks,
+						      blocks_per_page - page_block),
+						map_bh, 1, get_block, get_blocks))
+					goto confused;
+				if (!buffer_mapped(map_bh))
+					goto confused;
+			}
+			*first_logical_block = block_in_file;
+			if (buffer_new(map_bh)) {
+				sector_t i, n = map_bh->b_size >> blkbits;
+
+				for (i = 0; i < n; i++)
+					unmap_underlying_metadata(
+						map_bh->b_bdev,
+						map_bh->b_blocknr + i);
+				clear_buffer_new(map_bh);
+			}
+			continue;
 		}
+
 		if (page_block) {
-			if (map_bh.b_blocknr != blocks[page_block-1] + 1)
+			if (blocks[page_block] != blocks[page_block-1] + 1)
 				goto confused;
 		}
-		blocks[page_block++] = map_bh.b_blocknr;
-		boundary = buffer_boundary(&map_bh);
-		bdev = map_bh.b_bdev;
-		if (block_in_file == last_block)
+		page_block += nr;
+		block_in_file += nr;
+		bdev = map_bh->b_bdev;
+		boundary = buffer_boundary(map_bh) &&
+			mpage_mapping_done(map_bh, *first_logical_block,
+					   block_in_file, blkbits);
+		if (boundary) {
+			boundary_block = blocks[page_block - 1];
+			boundary_bdev = map_bh->b_bdev;
+		}
+		if (block_in_file > last_block)
 			break;
-		block_in_file++;
 	}
 	BUG_ON(page_block == 0);
 
@@ -631,14 +795,16 @@ mpage_writepages(struct address_space *mapping,
 		mapping->a_ops->writepage);
 }
 
-int
-__mpage_writepages(struct address_space *mapping,
+static int
+do_mpage_writepages(struct address_space *mapping,
 		struct writeback_control *wbc, get_block_t get_block,
-		writepage_t writepage_fn)
+		get_blocks_t get_blocks, writepage_t writepage_fn)
 {
 	struct backing_dev_info *bdi = mapping->backing_dev_info;
 	struct bio *bio = NULL;
 	sector_t last_block_in_bio = 0;
+	struct buffer_head map_bh;
+	sector_t first_logical_block = 0;
 	int ret = 0;
 	int done = 0;
 	int (*writepage)(struct page *page, struct writeback_control *wbc);
@@ -655,7 +821,7 @@ __mpage_writepages(struct address_space *mapping,
 	}
 
 	writepage = NULL;
-	if (get_block == NULL)
+	if (get_block == NULL && get_blocks == NULL)
 		writepage = mapping->a_ops->writepage;
 
 	pagevec_init(&pvec, 0);
@@ -678,6 +844,14 @@ retry:
 			min(end - index, (pgoff_t)PAGEVEC_SIZE-1) + 1))) {
 		unsigned i;
 
+		/*
+		 * A mapped run is only trusted for pages which were in the
+		 * page cache together with the one it was mapped for: blocks
+		 * are freed only after truncate has taken their pages out,
+		 * so a page which went away drops the run below.
+		 */
+		map_bh.b_state = 0;
+		map_bh.b_size = 0;
 		scanned = 1;
 		for (i = 0; i < nr_pages; i++) {
 			struct page *page = pvec.pages[i];
@@ -693,6 +867,7 @@ retry:
 			lock_page(page);
 
 			if (unlikely(page->mapping != mapping)) {
+				map_bh.b_state = 0;
 				unlock_page(page);
 				continue;
 			}
@@ -724,6 +899,8 @@ retry:
 				}
 			} else {
 				bio = __mpage_writepage(bio, page, get_block,
+						get_blocks, &map_bh,
+						&first_logical_block,
 						&last_block_in_bio, &ret, wbc,
 						writepage_fn);
 			}
@@ -752,8 +929,36 @@ retry:
 		mpage_bio_submit(WRITE, bio);
 	return ret;
 }
+
+int
+__mpage_writepages(struct address_space *mapping,
+		struct writeback_control *wbc, get_block_t get_block,
+		writepage_t writepage_fn)
+{
+	return do_mpage_writepages(mapping, wbc, get_block, NULL,
+				   writepage_fn);
+}
+
+/**
+ * mpage_writepages_blocks - __mpage_writepages() mapping a run at a time
+ *
+ * @get_blocks: the filesystem's multi-block mapper, as for direct I/O.
+ * @writepage_fn: called for pages which cannot go direct-to-BIO.
+ *
+ * Pages without buffers stay without buffers, unless @writepage_fn
+ * attaches them.
+ */
+int
+mpage_writepages_blocks(struct address_space *mapping,
+		struct writeback_control *wbc, get_blocks_t get_blocks,
+		writepage_t writepage_fn)
+{
+	return do_mpage_writepages(mapping, wbc, NULL, get_blocks,
+				   writepage_fn);
+}
 EXPORT_SYMBOL(mpage_writepages);
 EXPORT_SYMBOL(__mpage_writepages);
+EXPORT_SYMBOL(mpage_writepages_blocks);
 
 int mpage_writepage(struct page *page, get_block_t get_block,
 	struct writeback_control *wbc)
@@ -761,9 +966,14 @@ int mpage_writepage(struct page *page, get_block_t get_block,
 	int ret = 0;
 	struct bio *bio;
 	sector_t last_block_in_bio = 0;
+	struct buffer_head map_bh;
+	sector_t first_logical_block = 0;
 
-	bio = __mpage_writepage(NULL, page, get_block,
-			&last_block_in_bio, &ret, wbc, NULL);
+	map_bh.b_state = 0;
+	map_bh.b_size = 0;
+	bio = __mpage_writepage(NULL, page, get_block, NULL, &map_bh,
+			&first_logical_block, &last_block_in_bio, &ret, wbc,
+			NULL);
 	if (bio)
 		mpage_bio_submit(WRITE, bio);
 
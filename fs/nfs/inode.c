@@ -35,6 +35,7 @@
 #include <linux/mount.h>
 #include <linux/nfs_idmap.h>
 #include <linux/vfs.h>
+#include <linux/moduleparam.h>
 
 #include <asm/system.h>
 #include <asm/uaccess.h>
@@ -45,12 +46,20 @@
 #define NFS_PARANOIA 1
 
 /* Maximum number of readahead requests
- * FIXME: this should really be a sysctl so that users may tune it to suit
- *        their needs. People that do NFS over a slow network, might for
- *        instance want to reduce it to something closer to 1 for improved
- *        interactive response.
+ * nfs_readpages() sends the READs of a readahead window all at once, so
+ * this is how many are in flight for a sequential reader.  Over UDP the
+ * slot table bounds it anyway; over TCP the slot table grows as needed,
+ * and the window should hold the bandwidth-delay product of the link
+ * divided by rsize.  People that do NFS over a slow network might instead
+ * want to reduce it to something closer to 1 for improved interactive
+ * response.
  */
 #define NFS_MAX_READAHEAD	(RPC_DEF_SLOT_TABLE - 1)
+#define NFS_MAX_TCP_READAHEAD	(4 * RPC_DEF_SLOT_TABLE)
+
+static unsigned int nfs_tcp_readahead = NFS_MAX_TCP_READAHEAD;
+module_param_named(tcp_readahead, nfs_tcp_readahead, uint, 0644);
+MODULE_PARM_DESC(tcp_readahead, "READs in a readahead window over TCP");
 
 static void nfs_invalidate_inode(struct inode *);
 static int nfs_update_inode(struct inode *, struct nfs_fattr *, unsigned long);
@@ -320,7 +329,10 @@ nfs_sb_init(struct super_block *sb, rpc_authflavor_t authflavor)
 		server->acdirmin = server->acdirmax = 0;
 		sb->s_flags |= MS_SYNCHRONOUS;
 	}
-	server->backing_dev_info.ra_pages = server->rpages * NFS_MAX_READAHEAD;
+	if (server->client->cl_xprt->stream && nfs_tcp_readahead)
+		server->backing_dev_info.ra_pages = server->rpages * nfs_tcp_readahead;
+	else
+		server->backing_dev_info.ra_pages = server->rpages * NFS_MAX_READAHEAD;
 
 	sb->s_maxbytes = fsinfo.maxfilesize;
 	if (sb->s_maxbytes > MAX_LFS_FILESIZE) 
@@ -1908,7 +1920,7 @@ int nfs_init_inodecache(void)
 {
 	nfs_inode_cachep = kmem_cache_create("nfs_inode_cache",
 					     sizeof(struct nfs_inode),
-					     0, SLAB_RECLAIM_ACCOUNT,
+					     0, SLAB_RECLAIM_ACCOUNT|SLAB_MEM_SPREAD,
 					     init_once, NULL);
 	if (nfs_inode_cachep == NULL)
 		return -ENOMEM;
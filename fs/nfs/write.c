@@ -54,6 +54,7 @@
 #include <linux/file.h>
 #include <linux/mpage.h>
 #include <linux/writeback.h>
+#include <linux/backing-dev.h>
 
 #include <linux/sunrpc/clnt.h>
 #include <linux/nfs_fs.h>
@@ -325,9 +326,34 @@ out:
 	return err; 
 }
 
+/*
+ * Whether background writeback should leave the COMMIT of @inode for
+ * later: while most of its WRITEs are still in flight, a COMMIT now
+ * would cover only the few that are back, and the rest would need
+ * another.  Their completion redirties the inode, so one COMMIT for the
+ * lot follows.
+ */
+static int nfs_commit_later(struct inode *inode, struct writeback_control *wbc)
+{
+	struct nfs_inode *nfsi = NFS_I(inode);
+	int defer;
+
+	if (wbc->sync_mode == WB_SYNC_ALL || wbc->for_reclaim)
+		return 0;
+	spin_lock(&nfsi->req_lock);
+	defer = nfsi->ncommit && nfsi->ncommit <= (nfsi->npages >> 1);
+	spin_unlock(&nfsi->req_lock);
+	if (defer)
+		mark_inode_dirty(inode);
+	return defer;
+}
+
 /*
  * Note: causes nfs_update_request() to block on the assumption
  * 	 that the writeback is generated due to memory pressure.
+ *	 It only blocks while the WRITEs are sent, not while waiting for
+ *	 them or committing them, so that writers are held up no longer
+ *	 than the flush they are competing with.
  */
 int nfs_writepages(struct address_space *mapping, struct writeback_control *wbc)
 {
@@ -344,22 +370,23 @@ int nfs_writepages(struct address_space *mapping, struct writeback_control *wbc)
 		nfs_wait_on_write_congestion(mapping, 0);
 	}
 	err = nfs_flush_inode(inode, 0, 0, wb_priority(wbc));
+	clear_bit(BDI_write_congested, &bdi->state);
+	wake_up_all(&nfs_write_congestion);
 	if (err < 0)
-		goto out;
+		return err;
 	wbc->nr_to_write -= err;
 	if (!wbc->nonblocking && wbc->sync_mode == WB_SYNC_ALL) {
 		err = nfs_wait_on_requests(inode, 0, 0);
 		if (err < 0)
-			goto out;
+			return err;
 	}
+	if (nfs_commit_later(inode, wbc))
+		return 0;
 	err = nfs_commit_inode(inode, 0, 0, wb_priority(wbc));
 	if (err > 0) {
 		wbc->nr_to_write -= err;
 		err = 0;
 	}
-out:
-	clear_bit(BDI_write_congested, &bdi->state);
-	wake_up_all(&nfs_write_congestion);
 	return err;
 }
 
@@ -450,6 +477,7 @@ nfs_mark_request_dirty(struct nfs_page *req)
 	nfsi->ndirty++;
 	spin_unlock(&nfsi->req_lock);
 	inc_page_state(nr_dirty);
+	inc_bdi_stat(inode->i_mapping->backing_dev_info, BDI_RECLAIMABLE);
 	mark_inode_dirty(inode);
 }
 
@@ -478,6 +506,7 @@ nfs_mark_request_commit(struct nfs_page *req)
 	nfsi->ncommit++;
 	spin_unlock(&nfsi->req_lock);
 	inc_page_state(nr_unstable);
+	inc_bdi_stat(inode->i_mapping->backing_dev_info, BDI_RECLAIMABLE);
 	mark_inode_dirty(inode);
 }
 #endif
@@ -542,6 +571,7 @@ nfs_scan_dirty(struct inode *inode, struct list_head *dst, unsigned long idx_sta
 	res = nfs_scan_list(&nfsi->dirty, dst, idx_start, npages);
 	nfsi->ndirty -= res;
 	sub_page_state(nr_dirty,res);
+	sub_bdi_stat(inode->i_mapping->backing_dev_info, BDI_RECLAIMABLE, res);
 	if ((nfsi->ndirty == 0) != list_empty(&nfsi->dirty))
 		printk(KERN_ERR "NFS: desynchronized value of nfs_i.ndirty.\n");
 	return res;
@@ -922,7 +952,8 @@ static int nfs_flush_multi(struct list_head *head, struct inode *inode, int how)
 	atomic_set(&req->wb_complete, requests);
 
 	ClearPageError(page);
-	SetPageWriteback(page);
+	if (!TestSetPageWriteback(page))
+		inc_bdi_stat(page->mapping->backing_dev_info, BDI_WRITEBACK);
 	offset = 0;
 	nbytes = req->wb_bytes;
 	do {
@@ -985,7 +1016,9 @@ static int nfs_flush_one(struct list_head *head, struct inode *inode, int how)
 		nfs_list_remove_request(req);
 		nfs_list_add_request(req, &data->pages);
 		ClearPageError(req->wb_page);
-		SetPageWriteback(req->wb_page);
+		if (!TestSetPageWriteback(req->wb_page))
+			inc_bdi_stat(req->wb_page->mapping->backing_dev_info,
+					BDI_WRITEBACK);
 		*pages++ = req->wb_page;
 		count += req->wb_bytes;
 	}
@@ -1299,6 +1332,8 @@ nfs_commit_done(struct rpc_task *task)
 	while (!list_empty(&data->pages)) {
 		req = nfs_list_entry(data->pages.next);
 		nfs_list_remove_request(req);
+		dec_bdi_stat(req->wb_context->dentry->d_inode->i_mapping->backing_dev_info,
+				BDI_RECLAIMABLE);
 
 		dprintk("NFS: commit (%s/%Ld %d@%Ld)",
 			req->wb_context->dentry->d_inode->i_sb->s_id,
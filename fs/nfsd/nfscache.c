@@ -16,6 +16,11 @@
 #include <linux/string.h>
 #include <linux/spinlock.h>
 #include <linux/list.h>
+#include <linux/vmalloc.h>
+#include <linux/hash.h>
+#include <linux/mm.h>
+#include <linux/swap.h>
+#include <net/checksum.h>
 
 #include <linux/sunrpc/svc.h>
 #include <linux/nfsd/nfsd.h>
@@ -26,13 +31,27 @@
  * 4.4BSD:	256
  * Solaris2:	1024
  * DEC Unix:	512-4096
+ * A busy server sees far more than that inside the retransmit window,
+ * so we scale with the amount of low memory, see nfsd_cache_size().
+ *
+ * The cache is split into buckets of RC_BUCKETSIZE entries, each with
+ * its own lock and LRU list, so lookups from different clients rarely
+ * contend.  An entry stays in the bucket it was allocated to.
  */
-#define CACHESIZE		1024
-#define HASHSIZE		64
-#define REQHASH(xid)		((((xid) >> 24) ^ (xid)) & (HASHSIZE-1))
+#define CACHESIZE_MIN		1024
+#define CACHESIZE_MAX		(256*1024)
+#define RC_BUCKETSIZE		8
+
+/* Bytes of request arguments summed to tell calls with the same XID apart */
+#define RC_CSUMLEN		256
+
+struct nfsd_drc_bucket {
+	struct list_head	lru_head;
+	spinlock_t		cache_lock;
+};
 
-static struct hlist_head *	hash_list;
-static struct list_head 	lru_head;
+static struct nfsd_drc_bucket *	drc_hashtbl;
+static unsigned int		drc_hashbits;
 static int			cache_disabled = 1;
 
 static int	nfsd_cache_append(struct svc_rqst *rqstp, struct kvec *vec);
@@ -40,82 +59,124 @@ static int	nfsd_cache_append(struct svc_rqst *rqstp, struct kvec *vec);
 /* 
  * locking for the reply cache:
  * A cache entry is "single use" if c_state == RC_INPROG
- * Otherwise, it when accessing _prev or _next, the lock must be held.
+ * Otherwise, it when accessing _prev or _next, the lock of its
+ * bucket must be held.
  */
-static DEFINE_SPINLOCK(cache_lock);
+
+static inline struct nfsd_drc_bucket *
+nfsd_cache_bucket(u32 xid)
+{
+	return &drc_hashtbl[hash_long(xid, drc_hashbits)];
+}
+
+/*
+ * Roughly 16 entries per megabyte for the first megabytes of low
+ * memory, growing with the square root of it after that.
+ */
+static unsigned int
+nfsd_cache_size(void)
+{
+	unsigned long low_pages = num_physpages - totalhigh_pages;
+	unsigned int size;
+
+	size = (16 * int_sqrt(low_pages)) << (PAGE_SHIFT - 10);
+	if (size < CACHESIZE_MIN)
+		size = CACHESIZE_MIN;
+	if (size > CACHESIZE_MAX)
+		size = CACHESIZE_MAX;
+	return size;
+}
 
 void
 nfsd_cache_init(void)
 {
 	struct svc_cacherep	*rp;
-	int			i;
-
-	INIT_LIST_HEAD(&lru_head);
-	i = CACHESIZE;
-	while(i) {
-		rp = kmalloc(sizeof(*rp), GFP_KERNEL);
-		if (!rp) break;
-		list_add(&rp->c_lru, &lru_head);
-		rp->c_state = RC_UNUSED;
-		rp->c_type = RC_NOCACHE;
-		INIT_HLIST_NODE(&rp->c_hash);
-		i--;
-	}
+	unsigned int		size, nbuckets, i, j;
 
-	if (i)
-		printk (KERN_ERR "nfsd: cannot allocate all %d cache entries, only got %d\n",
-			CACHESIZE, CACHESIZE-i);
+	size = nfsd_cache_size();
+	drc_hashbits = 0;
+	while ((RC_BUCKETSIZE << (drc_hashbits + 1)) <= size)
+		drc_hashbits++;
+	nbuckets = 1 << drc_hashbits;
 
-	hash_list = kmalloc (HASHSIZE * sizeof(struct hlist_head), GFP_KERNEL);
-	if (!hash_list) {
-		nfsd_cache_shutdown();
+	drc_hashtbl = vmalloc(nbuckets * sizeof(struct nfsd_drc_bucket));
+	if (!drc_hashtbl) {
 		printk (KERN_ERR "nfsd: cannot allocate %Zd bytes for hash list\n",
-			HASHSIZE * sizeof(struct hlist_head));
+			nbuckets * sizeof(struct nfsd_drc_bucket));
 		return;
 	}
-	memset(hash_list, 0, HASHSIZE * sizeof(struct hlist_head));
+	for (i = 0; i < nbuckets; i++) {
+		INIT_LIST_HEAD(&drc_hashtbl[i].lru_head);
+		spin_lock_init(&drc_hashtbl[i].cache_lock);
+	}
+
+	for (i = 0; i < nbuckets; i++)
+		for (j = 0; j < RC_BUCKETSIZE; j++) {
+			rp = kmalloc(sizeof(*rp), GFP_KERNEL);
+			if (!rp)
+				goto nomem;
+			list_add(&rp->c_lru, &drc_hashtbl[i].lru_head);
+			rp->c_state = RC_UNUSED;
+			rp->c_type = RC_NOCACHE;
+		}
 
 	cache_disabled = 0;
+	return;
+
+nomem:
+	printk (KERN_ERR "nfsd: cannot allocate all %d cache entries, only got %d\n",
+		nbuckets * RC_BUCKETSIZE, i * RC_BUCKETSIZE + j);
+	nfsd_cache_shutdown();
 }
 
 void
 nfsd_cache_shutdown(void)
 {
 	struct svc_cacherep	*rp;
-
-	while (!list_empty(&lru_head)) {
-		rp = list_entry(lru_head.next, struct svc_cacherep, c_lru);
-		if (rp->c_state == RC_DONE && rp->c_type == RC_REPLBUFF)
-			kfree(rp->c_replvec.iov_base);
-		list_del(&rp->c_lru);
-		kfree(rp);
-	}
+	struct list_head	*lru_head;
+	unsigned int		i;
 
 	cache_disabled = 1;
 
-	if (hash_list)
-		kfree (hash_list);
-	hash_list = NULL;
+	if (!drc_hashtbl)
+		return;
+
+	for (i = 0; i < (1 << drc_hashbits); i++) {
+		lru_head = &drc_hashtbl[i].lru_head;
+		while (!list_empty(lru_head)) {
+			rp = list_entry(lru_head->next, struct svc_cacherep, c_lru);
+			if (rp->c_state == RC_DONE && rp->c_type == RC_REPLBUFF)
+				kfree(rp->c_replvec.iov_base);
+			list_del(&rp->c_lru);
+			kfree(rp);
+		}
+	}
+
+	vfree(drc_hashtbl);
+	drc_hashtbl = NULL;
 }
 
 /*
  * Move cache entry to end of LRU list
  */
 static void
-lru_put_end(struct svc_cacherep *rp)
+lru_put_end(struct nfsd_drc_bucket *b, struct svc_cacherep *rp)
 {
-	list_del(&rp->c_lru);
-	list_add_tail(&rp->c_lru, &lru_head);
+	list_move_tail(&rp->c_lru, &b->lru_head);
 }
 
 /*
- * Move a cache entry from one hash list to another
+ * Sum the start of the call arguments.  Clients reuse XIDs after a
+ * reboot or when they wrap, this keeps us from answering a new call
+ * with somebody else's old reply.
  */
-static void
-hash_refile(struct svc_cacherep *rp)
+static u32
+nfsd_cache_csum(struct svc_rqst *rqstp)
 {
-	hlist_del_init(&rp->c_hash);
-	hlist_add_head(&rp->c_hash, hash_list + REQHASH(rp->c_xid));
+	struct kvec *head = &rqstp->rq_arg.head[0];
+	int len = min(head->iov_len, (size_t)RC_CSUMLEN);
+
+	return csum_partial(head->iov_base, len, 0);
 }
 
 /*
@@ -126,13 +187,14 @@ hash_refile(struct svc_cacherep *rp)
 int
 nfsd_cache_lookup(struct svc_rqst *rqstp, int type)
 {
-	struct hlist_node	*hn;
-	struct hlist_head 	*rh;
-	struct svc_cacherep	*rp;
+	struct nfsd_drc_bucket	*b;
+	struct svc_cacherep	*rp, *found = NULL;
 	u32			xid = rqstp->rq_xid,
 				proto =  rqstp->rq_prot,
 				vers = rqstp->rq_vers,
-				proc = rqstp->rq_proc;
+				proc = rqstp->rq_proc,
+				len = rqstp->rq_arg.len,
+				csum;
 	unsigned long		age;
 	int rtn;
 
@@ -142,47 +204,31 @@ nfsd_cache_lookup(struct svc_rqst *rqstp, int type)
 		return RC_DOIT;
 	}
 
-	spin_lock(&cache_lock);
+	csum = nfsd_cache_csum(rqstp);
+	b = nfsd_cache_bucket(xid);
+	spin_lock(&b->cache_lock);
 	rtn = RC_DOIT;
 
-	rh = &hash_list[REQHASH(xid)];
-	hlist_for_each_entry(rp, hn, rh, c_hash) {
+	/* Search newest first, and note the oldest entry we may reuse */
+	list_for_each_entry_reverse(rp, &b->lru_head, c_lru) {
 		if (rp->c_state != RC_UNUSED &&
 		    xid == rp->c_xid && proc == rp->c_proc &&
 		    proto == rp->c_prot && vers == rp->c_vers &&
+		    len == rp->c_len && csum == rp->c_csum &&
 		    time_before(jiffies, rp->c_timestamp + 120*HZ) &&
 		    memcmp((char*)&rqstp->rq_addr, (char*)&rp->c_addr, sizeof(rp->c_addr))==0) {
 			nfsdstats.rchits++;
 			goto found_entry;
 		}
-	}
-	nfsdstats.rcmisses++;
-
-	/* This loop shouldn't take more than a few iterations normally */
-	{
-	int	safe = 0;
-	list_for_each_entry(rp, &lru_head, c_lru) {
 		if (rp->c_state != RC_INPROG)
-			break;
-		if (safe++ > CACHESIZE) {
-			printk("nfsd: loop in repcache LRU list\n");
-			cache_disabled = 1;
-			goto out;
-		}
-	}
+			found = rp;
 	}
+	nfsdstats.rcmisses++;
 
-	/* This should not happen */
-	if (rp == NULL) {
-		static int	complaints;
-
-		printk(KERN_WARNING "nfsd: all repcache entries locked!\n");
-		if (++complaints > 5) {
-			printk(KERN_WARNING "nfsd: disabling repcache.\n");
-			cache_disabled = 1;
-		}
+	/* Every entry of the bucket is in progress: rare, just don't cache */
+	rp = found;
+	if (rp == NULL)
 		goto out;
-	}
 
 	rqstp->rq_cacherep = rp;
 	rp->c_state = RC_INPROG;
@@ -191,9 +237,11 @@ nfsd_cache_lookup(struct svc_rqst *rqstp, int type)
 	rp->c_addr = rqstp->rq_addr;
 	rp->c_prot = proto;
 	rp->c_vers = vers;
+	rp->c_len = len;
+	rp->c_csum = csum;
 	rp->c_timestamp = jiffies;
 
-	hash_refile(rp);
+	lru_put_end(b, rp);
 
 	/* release any buffer */
 	if (rp->c_type == RC_REPLBUFF) {
@@ -202,14 +250,14 @@ nfsd_cache_lookup(struct svc_rqst *rqstp, int type)
 	}
 	rp->c_type = RC_NOCACHE;
  out:
-	spin_unlock(&cache_lock);
+	spin_unlock(&b->cache_lock);
 	return rtn;
 
 found_entry:
 	/* We found a matching entry which is either in progress or done. */
 	age = jiffies - rp->c_timestamp;
 	rp->c_timestamp = jiffies;
-	lru_put_end(rp);
+	lru_put_end(b, rp);
 
 	rtn = RC_DROPIT;
 	/* Request being processed or excessive rexmits */
@@ -263,11 +311,13 @@ void
 nfsd_cache_update(struct svc_rqst *rqstp, int cachetype, u32 *statp)
 {
 	struct svc_cacherep *rp;
+	struct nfsd_drc_bucket *b;
 	struct kvec	*resv = &rqstp->rq_res.head[0], *cachv;
 	int		len;
 
 	if (!(rp = rqstp->rq_cacherep) || cache_disabled)
 		return;
+	b = nfsd_cache_bucket(rp->c_xid);
 
 	len = resv->iov_len - ((char*)statp - (char*)resv->iov_base);
 	len >>= 2;
@@ -288,22 +338,22 @@ nfsd_cache_update(struct svc_rqst *rqstp, int cachetype, u32 *statp)
 		cachv = &rp->c_replvec;
 		cachv->iov_base = kmalloc(len << 2, GFP_KERNEL);
 		if (!cachv->iov_base) {
-			spin_lock(&cache_lock);
+			spin_lock(&b->cache_lock);
 			rp->c_state = RC_UNUSED;
-			spin_unlock(&cache_lock);
+			spin_unlock(&b->cache_lock);
 			return;
 		}
 		cachv->iov_len = len << 2;
 		memcpy(cachv->iov_base, statp, len << 2);
 		break;
 	}
-	spin_lock(&cache_lock);
-	lru_put_end(rp);
+	spin_lock(&b->cache_lock);
+	lru_put_end(b, rp);
 	rp->c_secure = rqstp->rq_secure;
 	rp->c_type = cachetype;
 	rp->c_state = RC_DONE;
 	rp->c_timestamp = jiffies;
-	spin_unlock(&cache_lock);
+	spin_unlock(&b->cache_lock);
 	return;
 }
 
@@ -10,7 +10,7 @@
 #include <linux/file.h>
 #include <linux/smp_lock.h>
 #include <linux/quotaops.h>
-#include <linux/dnotify.h>
+#include <linux/fsnotify.h>
 #include <linux/module.h>
 #include <linux/slab.h>
 #include <linux/tty.h>
@@ -23,6 +23,7 @@
 #include <linux/fs.h>
 #include <linux/pagemap.h>
 #include <linux/syscalls.h>
+#include <linux/falloc.h>
 
 #include <asm/unistd.h>
 
@@ -337,6 +338,54 @@ asmlinkage long sys_ftruncate64(unsigned int fd, loff_t length)
 }
 #endif
 
+/*
+ * Reserve the blocks of a byte range ahead of the writes to it, so that
+ * they cannot fail for want of space and get laid out in one piece.
+ * What is reserved reads back as zeroes.
+ */
+asmlinkage long sys_fallocate(int fd, int mode, loff_t offset, loff_t len)
+{
+	struct file *file;
+	struct inode *inode;
+	long error;
+
+	error = -EINVAL;
+	if (offset < 0 || len <= 0)
+		goto out;
+	error = -EOPNOTSUPP;
+	if (mode & ~FALLOC_FL_KEEP_SIZE)
+		goto out;
+	error = -EBADF;
+	file = fget(fd);
+	if (!file)
+		goto out;
+	if (!(file->f_mode & FMODE_WRITE))
+		goto out_fput;
+
+	inode = file->f_dentry->d_inode;
+	error = -ESPIPE;
+	if (S_ISFIFO(inode->i_mode))
+		goto out_fput;
+	error = -ENODEV;
+	if (!S_ISREG(inode->i_mode) && !S_ISDIR(inode->i_mode))
+		goto out_fput;
+
+	error = -EFBIG;
+	if (offset + len > inode->i_sb->s_maxbytes || offset + len < 0)
+		goto out_fput;
+	error = -EPERM;
+	if (IS_IMMUTABLE(inode))
+		goto out_fput;
+
+	error = -EOPNOTSUPP;
+	if (file->f_op && file->f_op->fallocate)
+		error = file->f_op->fallocate(file, mode, offset, len);
+out_fput:
+	fput(file);
+out:
+	return error;
+}
+
 #ifdef __ARCH_WANT_SYS_UTIME
 
 /*
@@ -924,7 +973,7 @@ void fastcall fd_install(unsigned int fd, struct file * file)
 	spin_lock(&files->file_lock);
 	if (unlikely(files->fd[fd] != NULL))
 		BUG();
-	files->fd[fd] = file;
+	rcu_assign_pointer(files->fd[fd], file);
 	spin_unlock(&files->file_lock);
 }
 
@@ -947,6 +996,7 @@ asmlinkage long sys_open(const char __user * filename, int flags, int mode)
 			error = PTR_ERR(f);
 			if (IS_ERR(f))
 				goto out_error;
+			fsnotify_open(f->f_dentry);
 			fd_install(fd, f);
 		}
 out:
@@ -46,72 +46,111 @@ void pipe_wait(struct inode * inode)
 	down(PIPE_SEM(*inode));
 }
 
-static inline int
-pipe_iov_copy_from_user(void *to, struct iovec *iov, unsigned long len)
+/*
+ * The copies return the number of bytes not copied, and move the iovec
+ * over the ones that were.  With atomic set they do not sleep, and stop
+ * at a fault: the caller finishes off with the page kmap()ed instead.
+ * The iovec has been access_ok()ed by the read and write paths.
+ */
+static inline unsigned long
+pipe_iov_copy_from_user(void *to, struct iovec *iov, unsigned long len,
+			int atomic)
 {
-	unsigned long copy;
+	unsigned long copy, left;
 
 	while (len > 0) {
 		while (!iov->iov_len)
 			iov++;
 		copy = min_t(unsigned long, len, iov->iov_len);
 
-		if (copy_from_user(to, iov->iov_base, copy))
-			return -EFAULT;
+		if (atomic)
+			left = __copy_from_user_inatomic(to, iov->iov_base, copy);
+		else
+			left = copy_from_user(to, iov->iov_base, copy);
+		copy -= left;
 		to += copy;
 		len -= copy;
 		iov->iov_base += copy;
 		iov->iov_len -= copy;
+		if (left)
+			break;
 	}
-	return 0;
+	return len;
 }
 
-static inline int
-pipe_iov_copy_to_user(struct iovec *iov, const void *from, unsigned long len)
+static inline unsigned long
+pipe_iov_copy_to_user(struct iovec *iov, const void *from, unsigned long len,
+		      int atomic)
 {
-	unsigned long copy;
+	unsigned long copy, left;
 
 	while (len > 0) {
 		while (!iov->iov_len)
 			iov++;
 		copy = min_t(unsigned long, len, iov->iov_len);
 
-		if (copy_to_user(iov->iov_base, from, copy))
-			return -EFAULT;
+		if (atomic)
+			left = __copy_to_user_inatomic(iov->iov_base, from, copy);
+		else
+			left = copy_to_user(iov->iov_base, from, copy);
+		copy -= left;
 		from += copy;
 		len -= copy;
 		iov->iov_base += copy;
 		iov->iov_len -= copy;
+		if (left)
+			break;
 	}
-	return 0;
+	return len;
 }
 
 static void anon_pipe_buf_release(struct pipe_inode_info *info, struct pipe_buffer *buf)
 {
 	struct page *page = buf->page;
 
-	if (info->tmp_page) {
-		__free_page(page);
+	/*
+	 * A page that tee() has shared with another pipe must not be
+	 * recycled as our tmp_page, the other pipe still reads from it.
+	 */
+	if (info->tmp_page || page_count(page) != 1) {
+		put_page(page);
 		return;
 	}
 	info->tmp_page = page;
 }
 
-static void *anon_pipe_buf_map(struct file *file, struct pipe_inode_info *info, struct pipe_buffer *buf)
+void *generic_pipe_buf_map(struct file *file, struct pipe_inode_info *info,
+			   struct pipe_buffer *buf, int atomic)
 {
+	if (atomic) {
+		buf->flags |= PIPE_BUF_FLAG_ATOMIC;
+		return kmap_atomic(buf->page, KM_USER0);
+	}
+	buf->flags &= ~PIPE_BUF_FLAG_ATOMIC;
 	return kmap(buf->page);
 }
 
-static void anon_pipe_buf_unmap(struct pipe_inode_info *info, struct pipe_buffer *buf)
+void generic_pipe_buf_unmap(struct pipe_inode_info *info,
+			    struct pipe_buffer *buf, void *addr)
 {
-	kunmap(buf->page);
+	if (buf->flags & PIPE_BUF_FLAG_ATOMIC) {
+		buf->flags &= ~PIPE_BUF_FLAG_ATOMIC;
+		kunmap_atomic(addr, KM_USER0);
+	} else
+		kunmap(buf->page);
 }
 
-static struct pipe_buf_operations anon_pipe_buf_ops = {
+static void anon_pipe_buf_get(struct pipe_inode_info *info, struct pipe_buffer *buf)
+{
+	get_page(buf->page);
+}
+
+struct pipe_buf_operations anon_pipe_buf_ops = {
 	.can_merge = 1,
-	.map = anon_pipe_buf_map,
-	.unmap = anon_pipe_buf_unmap,
+	.map = generic_pipe_buf_map,
+	.unmap = generic_pipe_buf_unmap,
 	.release = anon_pipe_buf_release,
+	.get = anon_pipe_buf_get,
 };
 
 static ssize_t
@@ -142,15 +181,22 @@ pipe_readv(struct file *filp, const struct iovec *_iov,
 			struct pipe_buf_operations *ops = buf->ops;
 			void *addr;
 			size_t chars = buf->len;
-			int error;
+			unsigned long left;
 
 			if (chars > total_len)
 				chars = total_len;
 
-			addr = ops->map(filp, info, buf);
-			error = pipe_iov_copy_to_user(iov, addr + buf->offset, chars);
-			ops->unmap(info, buf);
-			if (unlikely(error)) {
+			addr = ops->map(filp, info, buf, 1);
+			left = pipe_iov_copy_to_user(iov, addr + buf->offset,
+						     chars, 1);
+			ops->unmap(info, buf, addr);
+			if (unlikely(left)) {
+				addr = ops->map(filp, info, buf, 0);
+				left = pipe_iov_copy_to_user(iov, addr + buf->offset +
+							     chars - left, left, 0);
+				ops->unmap(info, buf, addr);
+			}
+			if (unlikely(left)) {
 				if (!ret) ret = -EFAULT;
 				break;
 			}
@@ -249,14 +295,26 @@ pipe_writev(struct file *filp, const struct iovec *_iov,
 		struct pipe_buffer *buf = info->bufs + lastbuf;
 		struct pipe_buf_operations *ops = buf->ops;
 		int offset = buf->offset + buf->len;
-		if (ops->can_merge && offset + chars <= PAGE_SIZE) {
-			void *addr = ops->map(filp, info, buf);
-			int error = pipe_iov_copy_from_user(offset + addr, iov, chars);
-			ops->unmap(info, buf);
-			ret = error;
+		if (ops->can_merge && page_count(buf->page) == 1 &&
+		    offset + chars <= PAGE_SIZE) {
+			void *addr = ops->map(filp, info, buf, 1);
+			unsigned long left;
+
+			left = pipe_iov_copy_from_user(offset + addr, iov,
+						       chars, 1);
+			ops->unmap(info, buf, addr);
+			if (unlikely(left)) {
+				addr = ops->map(filp, info, buf, 0);
+				left = pipe_iov_copy_from_user(offset + addr +
+							       chars - left,
+							       iov, left, 0);
+				ops->unmap(info, buf, addr);
+			}
 			do_wakeup = 1;
-			if (error)
+			if (left) {
+				ret = -EFAULT;
 				goto out;
+			}
 			buf->len += chars;
 			total_len -= chars;
 			ret = chars;
@@ -277,7 +335,8 @@ pipe_writev(struct file *filp, const struct iovec *_iov,
 			int newbuf = (info->curbuf + bufs) & (PIPE_BUFFERS-1);
 			struct pipe_buffer *buf = info->bufs + newbuf;
 			struct page *page = info->tmp_page;
-			int error;
+			unsigned long left;
+			void *addr;
 
 			if (!page) {
 				page = alloc_page(GFP_HIGHUSER);
@@ -297,9 +356,16 @@ pipe_writev(struct file *filp, const struct iovec *_iov,
 			if (chars > total_len)
 				chars = total_len;
 
-			error = pipe_iov_copy_from_user(kmap(page), iov, chars);
-			kunmap(page);
-			if (unlikely(error)) {
+			addr = kmap_atomic(page, KM_USER0);
+			left = pipe_iov_copy_from_user(addr, iov, chars, 1);
+			kunmap_atomic(addr, KM_USER0);
+			if (unlikely(left)) {
+				addr = kmap(page);
+				left = pipe_iov_copy_from_user(addr + chars - left,
+							       iov, left, 0);
+				kunmap(page);
+			}
+			if (unlikely(left)) {
 				if (!ret) ret = -EFAULT;
 				break;
 			}
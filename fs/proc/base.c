@@ -34,6 +34,7 @@
 #include <linux/ptrace.h>
 #include <linux/seccomp.h>
 #include <linux/cpuset.h>
+#include <linux/swap.h>
 #include <linux/audit.h>
 #include "internal.h"
 
@@ -86,6 +87,9 @@ enum pid_directory_inos {
 	PROC_TGID_FD_DIR,
 	PROC_TGID_OOM_SCORE,
 	PROC_TGID_OOM_ADJUST,
+#ifdef CONFIG_SWAP
+	PROC_TGID_SWAP_TOKEN,
+#endif
 	PROC_TID_INO,
 	PROC_TID_STATUS,
 	PROC_TID_MEM,
@@ -123,6 +127,9 @@ enum pid_directory_inos {
 	PROC_TID_FD_DIR = 0x8000,	/* 0x8000-0xffff */
 	PROC_TID_OOM_SCORE,
 	PROC_TID_OOM_ADJUST,
+#ifdef CONFIG_SWAP
+	PROC_TID_SWAP_TOKEN,
+#endif
 };
 
 struct pid_entry {
@@ -166,6 +173,9 @@ static struct pid_entry tgid_base_stuff[] = {
 #endif
 	E(PROC_TGID_OOM_SCORE, "oom_score",S_IFREG|S_IRUGO),
 	E(PROC_TGID_OOM_ADJUST,"oom_adj", S_IFREG|S_IRUGO|S_IWUSR),
+#ifdef CONFIG_SWAP
+	E(PROC_TGID_SWAP_TOKEN,"swap_token",S_IFREG|S_IRUGO),
+#endif
 #ifdef CONFIG_AUDITSYSCALL
 	E(PROC_TGID_LOGINUID, "loginuid", S_IFREG|S_IWUSR|S_IRUGO),
 #endif
@@ -202,6 +212,9 @@ static struct pid_entry tid_base_stuff[] = {
 #endif
 	E(PROC_TID_OOM_SCORE,  "oom_score",S_IFREG|S_IRUGO),
 	E(PROC_TID_OOM_ADJUST, "oom_adj", S_IFREG|S_IRUGO|S_IWUSR),
+#ifdef CONFIG_SWAP
+	E(PROC_TID_SWAP_TOKEN, "swap_token",S_IFREG|S_IRUGO),
+#endif
 #ifdef CONFIG_AUDITSYSCALL
 	E(PROC_TID_LOGINUID, "loginuid", S_IFREG|S_IWUSR|S_IRUGO),
 #endif
@@ -432,17 +445,43 @@ static int proc_pid_schedstat(struct task_struct *task, char *buffer)
 #endif
 
 /* The badness from the OOM killer */
-unsigned long badness(struct task_struct *p, unsigned long uptime);
+unsigned long badness(struct task_struct *p);
 static int proc_oom_score(struct task_struct *task, char *buffer)
 {
 	unsigned long points;
-	struct timespec uptime;
 
-	do_posix_clock_monotonic_gettime(&uptime);
-	points = badness(task, uptime.tv_sec);
+	/* for the walk of its children */
+	read_lock(&tasklist_lock);
+	points = badness(task);
+	read_unlock(&tasklist_lock);
 	return sprintf(buffer, "%lu\n", points);
 }
 
+#ifdef CONFIG_SWAP
+/* The thrashing protection state of the task's mm */
+static int proc_pid_swap_token(struct task_struct *task, char *buffer)
+{
+	struct mm_struct *mm = get_task_mm(task);
+	int res;
+
+	if (!mm)
+		return 0;
+	res = sprintf(buffer,
+		"held %d\n"
+		"priority %u\n"
+		"faults %lu\n"
+		"grabs %lu\n"
+		"held_ms %u\n",
+		has_swap_token(mm),
+		mm->token_priority,
+		mm->swap_token_faults,
+		mm->swap_token_grabs,
+		jiffies_to_msecs(swap_token_held_time(mm)));
+	mmput(mm);
+	return res;
+}
+#endif
+
 /************************************************************************/
 /*                       Here the fs part begins                        */
 /************************************************************************/
@@ -1586,6 +1625,13 @@ static struct dentry *proc_pident_lookup(struct inode *dir,
 		case PROC_TGID_OOM_ADJUST:
 			inode->i_fop = &proc_oom_adjust_operations;
 			break;
+#ifdef CONFIG_SWAP
+		case PROC_TID_SWAP_TOKEN:
+		case PROC_TGID_SWAP_TOKEN:
+			inode->i_fop = &proc_info_file_operations;
+			ei->op.proc_read = proc_pid_swap_token;
+			break;
+#endif
 #ifdef CONFIG_AUDITSYSCALL
 		case PROC_TID_LOGINUID:
 		case PROC_TGID_LOGINUID:
@@ -1873,45 +1919,6 @@ out:
 #define PROC_NUMBUF 10
 #define PROC_MAXPIDS 20
 
-/*
- * Get a few tgid's to return for filldir - we need to hold the
- * tasklist lock while doing this, and we must release it before
- * we actually do the filldir itself, so we use a temp buffer..
- */
-static int get_tgid_list(int index, unsigned long version, unsigned int *tgids)
-{
-	struct task_struct *p;
-	int nr_tgids = 0;
-
-	index--;
-	read_lock(&tasklist_lock);
-	p = NULL;
-	if (version) {
-		p = find_task_by_pid(version);
-		if (p && !thread_group_leader(p))
-			p = NULL;
-	}
-
-	if (p)
-		index = 0;
-	else
-		p = next_task(&init_task);
-
-	for ( ; p != &init_task; p = next_task(p)) {
-		int tgid = p->pid;
-		if (!pid_alive(p))
-			continue;
-		if (--index >= 0)
-			continue;
-		tgids[nr_tgids] = tgid;
-		nr_tgids++;
-		if (nr_tgids >= PROC_MAXPIDS)
-			break;
-	}
-	read_unlock(&tasklist_lock);
-	return nr_tgids;
-}
-
 /*
  * Get a few tid's to return for filldir - we need to hold the
  * tasklist lock while doing this, and we must release it before
@@ -1944,62 +1951,42 @@ static int get_tid_list(int index, unsigned int *tids, struct inode *dir)
 	return nr_tids;
 }
 
+/*
+ * Past "self", f_pos of /proc is TGID_OFFSET plus the next tgid to
+ * return, so processes coming and going do not shift the others.
+ */
+#define TGID_OFFSET (FIRST_PROCESS_ENTRY + 1)
+
 /* for the /proc/ directory itself, after non-process stuff has been done */
 int proc_pid_readdir(struct file * filp, void * dirent, filldir_t filldir)
 {
-	unsigned int tgid_array[PROC_MAXPIDS];
 	char buf[PROC_NUMBUF];
 	unsigned int nr = filp->f_pos - FIRST_PROCESS_ENTRY;
-	unsigned int nr_tgids, i;
-	int next_tgid;
+	int tgid;
 
 	if (!nr) {
 		ino_t ino = fake_ino(0,PROC_TGID_INO);
 		if (filldir(dirent, "self", 4, filp->f_pos, ino, DT_LNK) < 0)
 			return 0;
 		filp->f_pos++;
-		nr++;
 	}
 
-	/* f_version caches the tgid value that the last readdir call couldn't
-	 * return. lseek aka telldir automagically resets f_version to 0.
-	 */
-	next_tgid = filp->f_version;
-	filp->f_version = 0;
-	for (;;) {
-		nr_tgids = get_tgid_list(nr, next_tgid, tgid_array);
-		if (!nr_tgids) {
-			/* no more entries ! */
-			break;
-		}
-		next_tgid = 0;
-
-		/* do not use the last found pid, reserve it for next_tgid */
-		if (nr_tgids == PROC_MAXPIDS) {
-			nr_tgids--;
-			next_tgid = tgid_array[nr_tgids];
-		}
-
-		for (i=0;i<nr_tgids;i++) {
-			int tgid = tgid_array[i];
-			ino_t ino = fake_ino(tgid,PROC_TGID_INO);
-			unsigned long j = PROC_NUMBUF;
+	/* no tasklist_lock: the tgids come from the pidmap, in order */
+	for (tgid = next_tgid(filp->f_pos - TGID_OFFSET); tgid;
+	     tgid = next_tgid(tgid + 1)) {
+		ino_t ino = fake_ino(tgid,PROC_TGID_INO);
+		unsigned long j = PROC_NUMBUF;
+		int n = tgid;
 
-			do
-				buf[--j] = '0' + (tgid % 10);
-			while ((tgid /= 10) != 0);
+		do
+			buf[--j] = '0' + (n % 10);
+		while ((n /= 10) != 0);
 
-			if (filldir(dirent, buf+j, PROC_NUMBUF-j, filp->f_pos, ino, DT_DIR) < 0) {
-				/* returning this tgid failed, save it as the first
-				 * pid for the next readir call */
-				filp->f_version = tgid_array[i];
-				goto out;
-			}
-			filp->f_pos++;
-			nr++;
-		}
+		filp->f_pos = tgid + TGID_OFFSET;
+		if (filldir(dirent, buf+j, PROC_NUMBUF-j, filp->f_pos, ino, DT_DIR) < 0)
+			return 0;
 	}
-out:
+	filp->f_pos = PID_MAX_LIMIT + TGID_OFFSET;
 	return 0;
 }
 
@@ -344,7 +344,8 @@ read_kcore(struct file *file, char __user *buffer, size_t buflen, loff_t *fpos)
 				unsigned long msize = m->size - PAGE_SIZE;
 
 				if (((unsigned long)m->addr + msize) < 
-								curstart)
+								curstart ||
+				    (m->flags & VM_LAZY_FREE))
 					continue;
 				if ((unsigned long)m->addr > (curstart + 
 								cursize))
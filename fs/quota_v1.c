@@ -64,7 +64,9 @@ static int v1_commit_dqblk(struct dquot *dquot)
 	ssize_t ret;
 	struct v1_disk_dqblk dqblk;
 
+	spin_lock(&dquot->dq_dqb_lock);
 	v1_mem2disk_dqblk(&dqblk, &dquot->dq_dqb);
+	spin_unlock(&dquot->dq_dqb_lock);
 	if (dquot->dq_id == 0) {
 		dqblk.dqb_btime = sb_dqopt(dquot->dq_sb)->info[type].dqi_bgrace;
 		dqblk.dqb_itime = sb_dqopt(dquot->dq_sb)->info[type].dqi_igrace;
@@ -13,6 +13,8 @@
 #include <linux/smp_lock.h>
 #include <linux/fs.h>
 #include <linux/dirent.h>
+#include <linux/namei.h>
+#include <linux/mount.h>
 #include <linux/security.h>
 #include <linux/syscalls.h>
 #include <linux/unistd.h>
@@ -298,3 +300,169 @@ out_putf:
 out:
 	return error;
 }
+
+/*
+ * getdents_plus() reads the directory into a page of names first, and
+ * looks the names up once vfs_readdir() has dropped i_sem: the lookup
+ * of an entry may need the parent's i_sem, and some filesystems hold
+ * their own locks around filldir.  Filesystems which learn attributes
+ * while reading the directory, like NFS with READDIRPLUS, have put the
+ * entries in the dcache by then, so the lookups do not go to disk or
+ * to the server.
+ */
+struct dirent_plus_name {
+	u64		ino;
+	s64		off;
+	unsigned short	reclen;		/* of the dirent64_plus record */
+	unsigned char	type;
+	char		name[0];
+};
+
+struct getdents_plus_callback {
+	struct dirent_plus_name * current_dir;
+	struct dirent_plus_name * previous;
+	int count;			/* room left in the user buffer */
+	int room;			/* room left in the page of names */
+	int error;
+};
+
+static int filldir_plus(void * __buf, const char * name, int namlen,
+			loff_t offset, ino_t ino, unsigned int d_type)
+{
+	struct dirent_plus_name *de;
+	struct getdents_plus_callback * buf = __buf;
+	int reclen = ROUND_UP64(offsetof(struct dirent64_plus, d_name) +
+				namlen + 1);
+	int len = ROUND_UP64(offsetof(struct dirent_plus_name, name) +
+			     namlen + 1);
+
+	buf->error = -EINVAL;	/* only used if we fail.. */
+	if (reclen > buf->count || len > buf->room)
+		return -EINVAL;
+	if (buf->previous)
+		buf->previous->off = offset;
+	de = buf->current_dir;
+	de->ino = ino;
+	de->off = 0;
+	de->reclen = reclen;
+	de->type = d_type;
+	memcpy(de->name, name, namlen);
+	de->name[namlen] = 0;
+	buf->previous = de;
+	buf->current_dir = (void *)de + len;
+	buf->count -= reclen;
+	buf->room -= len;
+	return 0;
+}
+
+static int dirent_plus_stat(struct file *file, const char *name,
+			    struct kstat *stat)
+{
+	struct nameidata nd;
+	int error;
+
+	nd.last_type = LAST_ROOT;
+	nd.flags = 0;
+	nd.depth = 0;
+	nd.mnt = mntget(file->f_vfsmnt);
+	nd.dentry = dget(file->f_dentry);
+	error = path_walk(name, &nd);
+	if (!error) {
+		error = vfs_getattr(nd.mnt, nd.dentry, stat);
+		path_release(&nd);
+	}
+	return error;
+}
+
+static void cp_dirent_stat(struct dirent_stat *ds, struct kstat *stat)
+{
+	ds->st_dev = huge_encode_dev(stat->dev);
+	ds->st_ino = stat->ino;
+	ds->st_rdev = huge_encode_dev(stat->rdev);
+	ds->st_size = stat->size;
+	ds->st_blocks = stat->blocks;
+	ds->st_mode = stat->mode;
+	ds->st_nlink = stat->nlink;
+	ds->st_uid = stat->uid;
+	ds->st_gid = stat->gid;
+	ds->st_blksize = stat->blksize;
+	ds->st_atime_sec = stat->atime.tv_sec;
+	ds->st_atime_nsec = stat->atime.tv_nsec;
+	ds->st_mtime_sec = stat->mtime.tv_sec;
+	ds->st_mtime_nsec = stat->mtime.tv_nsec;
+	ds->st_ctime_sec = stat->ctime.tv_sec;
+	ds->st_ctime_nsec = stat->ctime.tv_nsec;
+}
+
+asmlinkage long sys_getdents_plus(unsigned int fd,
+		struct dirent64_plus __user * dirent, unsigned int count)
+{
+	struct file * file;
+	struct getdents_plus_callback buf;
+	struct dirent_plus_name *de;
+	struct dirent64_plus rec;
+	struct kstat stat;
+	char *names;
+	int namlen;
+	int error, size;
+
+	error = -EFAULT;
+	if (!access_ok(VERIFY_WRITE, dirent, count))
+		goto out;
+
+	error = -EBADF;
+	file = fget(fd);
+	if (!file)
+		goto out;
+
+	error = -ENOMEM;
+	names = (char *)__get_free_page(GFP_KERNEL);
+	if (!names)
+		goto out_putf;
+
+	buf.current_dir = (struct dirent_plus_name *)names;
+	buf.previous = NULL;
+	buf.count = count;
+	buf.room = PAGE_SIZE;
+	buf.error = 0;
+
+	error = vfs_readdir(file, filldir_plus, &buf);
+	if (error < 0)
+		goto out_free;
+	error = buf.error;
+	if (!buf.previous)
+		goto out_free;
+	buf.previous->off = file->f_pos;
+
+	size = 0;
+	de = (struct dirent_plus_name *)names;
+	while (de != buf.current_dir) {
+		namlen = strlen(de->name);
+		memset(&rec, 0, sizeof(rec));
+		rec.d_ino = de->ino;
+		rec.d_off = de->off;
+		rec.d_reclen = de->reclen;
+		rec.d_type = de->type;
+		rec.d_error = dirent_plus_stat(file, de->name, &stat);
+		if (!rec.d_error)
+			cp_dirent_stat(&rec.d_stat, &stat);
+		if (__copy_to_user(dirent, &rec,
+				   offsetof(struct dirent64_plus, d_name)) ||
+		    __copy_to_user(dirent->d_name, de->name, namlen + 1)) {
+			error = -EFAULT;
+			goto out_free;
+		}
+		dirent = (void __user *)dirent + de->reclen;
+		size += de->reclen;
+		de = (void *)de + ROUND_UP64(offsetof(struct dirent_plus_name,
+						      name) + namlen + 1);
+	}
+	error = size;
+
+out_free:
+	free_page((unsigned long)names);
+out_putf:
+	fput(file);
+out:
+	return error;
+}
@@ -28,12 +28,6 @@
 #define ROUND_UP(x,y) (((x)+(y)-1)/(y))
 #define DEFAULT_POLLMASK (POLLIN | POLLOUT | POLLRDNORM | POLLWRNORM)
 
-struct poll_table_entry {
-	struct file * filp;
-	wait_queue_t wait;
-	wait_queue_head_t * wait_address;
-};
-
 struct poll_table_page {
 	struct poll_table_page * next;
 	struct poll_table_entry * entry;
@@ -62,13 +56,24 @@ void poll_initwait(struct poll_wqueues *pwq)
 	init_poll_funcptr(&pwq->pt, __pollwait);
 	pwq->error = 0;
 	pwq->table = NULL;
+	pwq->inline_index = 0;
 }
 
 EXPORT_SYMBOL(poll_initwait);
 
+static void free_poll_entry(struct poll_table_entry *entry)
+{
+	remove_wait_queue(entry->wait_address,&entry->wait);
+	fput(entry->filp);
+}
+
 void poll_freewait(struct poll_wqueues *pwq)
 {
 	struct poll_table_page * p = pwq->table;
+	int i;
+
+	for (i = 0; i < pwq->inline_index; i++)
+		free_poll_entry(pwq->inline_entries + i);
 	while (p) {
 		struct poll_table_entry * entry;
 		struct poll_table_page *old;
@@ -76,8 +81,7 @@ void poll_freewait(struct poll_wqueues *pwq)
 		entry = p->entry;
 		do {
 			entry--;
-			remove_wait_queue(entry->wait_address,&entry->wait);
-			fput(entry->filp);
+			free_poll_entry(entry);
 		} while (entry > p->entries);
 		old = p;
 		p = p->next;
@@ -87,11 +91,13 @@ void poll_freewait(struct poll_wqueues *pwq)
 
 EXPORT_SYMBOL(poll_freewait);
 
-void __pollwait(struct file *filp, wait_queue_head_t *wait_address, poll_table *_p)
+static struct poll_table_entry *poll_get_entry(struct poll_wqueues *p)
 {
-	struct poll_wqueues *p = container_of(_p, struct poll_wqueues, pt);
 	struct poll_table_page *table = p->table;
 
+	if (p->inline_index < N_INLINE_POLL_ENTRIES)
+		return p->inline_entries + p->inline_index++;
+
 	if (!table || POLL_TABLE_FULL(table)) {
 		struct poll_table_page *new_table;
 
@@ -99,7 +105,7 @@ void __pollwait(struct file *filp, wait_queue_head_t *wait_address, poll_table *
 		if (!new_table) {
 			p->error = -ENOMEM;
 			__set_current_state(TASK_RUNNING);
-			return;
+			return NULL;
 		}
 		new_table->entry = new_table->entries;
 		new_table->next = table;
@@ -107,16 +113,21 @@ void __pollwait(struct file *filp, wait_queue_head_t *wait_address, poll_table *
 		table = new_table;
 	}
 
-	/* Add a new entry */
-	{
-		struct poll_table_entry * entry = table->entry;
-		table->entry = entry+1;
-	 	get_file(filp);
-	 	entry->filp = filp;
-		entry->wait_address = wait_address;
-		init_waitqueue_entry(&entry->wait, current);
-		add_wait_queue(wait_address,&entry->wait);
-	}
+	return table->entry++;
+}
+
+void __pollwait(struct file *filp, wait_queue_head_t *wait_address, poll_table *_p)
+{
+	struct poll_wqueues *p = container_of(_p, struct poll_wqueues, pt);
+	struct poll_table_entry *entry = poll_get_entry(p);
+
+	if (!entry)
+		return;
+	get_file(filp);
+	entry->filp = filp;
+	entry->wait_address = wait_address;
+	init_waitqueue_entry(&entry->wait, current);
+	add_wait_queue(wait_address,&entry->wait);
 }
 
 #define FDS_IN(fds, n)		(fds->in + n)
@@ -178,7 +189,7 @@ int do_select(int n, fd_set_bits *fds, long *timeout)
 {
 	struct poll_wqueues table;
 	poll_table *wait;
-	int retval, i;
+	int retval, i, queued = 0;
 	long __timeout = *timeout;
 
  	spin_lock(&current->files->file_lock);
@@ -190,9 +201,7 @@ int do_select(int n, fd_set_bits *fds, long *timeout)
 	n = retval;
 
 	poll_initwait(&table);
-	wait = &table.pt;
-	if (!__timeout)
-		wait = NULL;
+	wait = NULL;
 	retval = 0;
 	for (;;) {
 		unsigned long *rinp, *routp, *rexp, *inp, *outp, *exp;
@@ -256,6 +265,16 @@ int do_select(int n, fd_set_bits *fds, long *timeout)
 			retval = table.error;
 			break;
 		}
+		/*
+		 * Nothing was ready at the first look, which did not bother
+		 * with the wait queues: look again, adding us to them this
+		 * time, before going to sleep.
+		 */
+		if (!queued) {
+			queued = 1;
+			wait = &table.pt;
+			continue;
+		}
 		__timeout = schedule_timeout(__timeout);
 	}
 	__set_current_state(TASK_RUNNING);
@@ -429,12 +448,9 @@ static void do_pollfd(unsigned int num, struct pollfd * fdpage,
 static int do_poll(unsigned int nfds,  struct poll_list *list,
 			struct poll_wqueues *wait, long timeout)
 {
-	int count = 0;
-	poll_table* pt = &wait->pt;
+	int count = 0, queued = 0;
+	poll_table* pt = NULL;
 
-	if (!timeout)
-		pt = NULL;
- 
 	for (;;) {
 		struct poll_list *walk;
 		set_current_state(TASK_INTERRUPTIBLE);
@@ -449,6 +465,12 @@ static int do_poll(unsigned int nfds,  struct poll_list *list,
 		count = wait->error;
 		if (count)
 			break;
+		/* as in do_select() */
+		if (!queued) {
+			queued = 1;
+			pt = &wait->pt;
+			continue;
+		}
 		timeout = schedule_timeout(timeout);
 	}
 	__set_current_state(TASK_RUNNING);
@@ -0,0 +1,321 @@
+/*
+ *  fs/signalfd.c
+ *
+ *  A signalfd hands signals out through read() rather than through a
+ *  handler: the signals of its mask which are pending for the reader
+ *  are dequeued, as sigtimedwait() would, and returned as an array of
+ *  struct signalfd_siginfo.  poll() tells when there is one to read,
+ *  so that the signals, normally blocked, can be waited for in the
+ *  same event loop as descriptors.
+ *
+ *  A signalfd is attached to the signal handlers of the process which
+ *  created it, and is woken when a signal of its mask is queued on them.
+ *  Once that process is gone read() returns 0.  Reads dequeue the
+ *  signals of the reader, so a signalfd passed to another process does
+ *  not see the signals of its creator.
+ */
+
+#include <linux/file.h>
+#include <linux/poll.h>
+#include <linux/init.h>
+#include <linux/fs.h>
+#include <linux/sched.h>
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/list.h>
+#include <linux/signal.h>
+#include <linux/spinlock.h>
+#include <linux/syscalls.h>
+#include <linux/anon_inodes.h>
+#include <linux/signalfd.h>
+#include <asm/uaccess.h>
+
+struct signalfd_ctx {
+	wait_queue_head_t wqh;
+	/* under the siglock of ->sighand */
+	sigset_t sigmask;
+	struct list_head lnk;
+	/* the signal handlers it is attached to, under signalfd_lock */
+	struct sighand_struct *sighand;
+};
+
+/*
+ * Keeps ->sighand of each signalfd from being freed while it is used.
+ * Nests outside of siglock.
+ */
+static DEFINE_SPINLOCK(signalfd_lock);
+
+/* Called with the siglock of @sighand held */
+void __signalfd_notify(struct sighand_struct *sighand, int sig)
+{
+	struct signalfd_ctx *ctx;
+
+	list_for_each_entry(ctx, &sighand->signalfd_list, lnk)
+		if (sigismember(&ctx->sigmask, sig))
+			wake_up(&ctx->wqh);
+}
+
+/* Called as @sighand is freed, when no more signals can be sent to it */
+void signalfd_detach(struct sighand_struct *sighand)
+{
+	struct signalfd_ctx *ctx, *tmp;
+	unsigned long flags;
+
+	spin_lock_irqsave(&signalfd_lock, flags);
+	list_for_each_entry_safe(ctx, tmp, &sighand->signalfd_list, lnk) {
+		list_del_init(&ctx->lnk);
+		ctx->sighand = NULL;
+		wake_up(&ctx->wqh);
+	}
+	spin_unlock_irqrestore(&signalfd_lock, flags);
+}
+
+static int signalfd_release(struct inode *inode, struct file *file)
+{
+	struct signalfd_ctx *ctx = file->private_data;
+	unsigned long flags;
+
+	spin_lock_irqsave(&signalfd_lock, flags);
+	if (ctx->sighand) {
+		spin_lock(&ctx->sighand->siglock);
+		list_del(&ctx->lnk);
+		spin_unlock(&ctx->sighand->siglock);
+	}
+	spin_unlock_irqrestore(&signalfd_lock, flags);
+
+	kfree(ctx);
+	return 0;
+}
+
+/* Whether a signal of @mask is pending for the current task */
+static int signalfd_pending(sigset_t *mask)
+{
+	sigset_t pending;
+	int i;
+
+	sigorsets(&pending, &current->pending.signal,
+		  &current->signal->shared_pending.signal);
+	sigandsets(&pending, &pending, mask);
+	for (i = 0; i < _NSIG_WORDS; i++)
+		if (pending.sig[i])
+			return 1;
+
+	return 0;
+}
+
+static unsigned int signalfd_poll(struct file *file, poll_table *wait)
+{
+	struct signalfd_ctx *ctx = file->private_data;
+	unsigned int events = 0;
+
+	poll_wait(file, &ctx->wqh, wait);
+
+	spin_lock_irq(&current->sighand->siglock);
+	if (signalfd_pending(&ctx->sigmask) || !ctx->sighand)
+		events |= POLLIN;
+	spin_unlock_irq(&current->sighand->siglock);
+
+	return events;
+}
+
+static int signalfd_copyinfo(struct signalfd_siginfo __user *uinfo,
+			     siginfo_t const *kinfo)
+{
+	long err;
+
+	/* unused fields must read as 0, the array was not cleared */
+	if (__clear_user(uinfo, sizeof(*uinfo)))
+		return -EFAULT;
+
+	/* the fields copied by class, as in copy_siginfo_to_user() */
+	err = __put_user(kinfo->si_signo, &uinfo->ssi_signo);
+	err |= __put_user(kinfo->si_errno, &uinfo->ssi_errno);
+	err |= __put_user((short) kinfo->si_code, &uinfo->ssi_code);
+	switch (kinfo->si_code & __SI_MASK) {
+	case __SI_KILL:
+		err |= __put_user(kinfo->si_pid, &uinfo->ssi_pid);
+		err |= __put_user(kinfo->si_uid, &uinfo->ssi_uid);
+		break;
+	case __SI_TIMER:
+		err |= __put_user(kinfo->si_tid, &uinfo->ssi_tid);
+		err |= __put_user(kinfo->si_overrun, &uinfo->ssi_overrun);
+		err |= __put_user((long) kinfo->si_ptr, &uinfo->ssi_ptr);
+		break;
+	case __SI_POLL:
+		err |= __put_user(kinfo->si_band, &uinfo->ssi_band);
+		err |= __put_user(kinfo->si_fd, &uinfo->ssi_fd);
+		break;
+	case __SI_FAULT:
+		err |= __put_user((long) kinfo->si_addr, &uinfo->ssi_addr);
+#ifdef __ARCH_SI_TRAPNO
+		err |= __put_user(kinfo->si_trapno, &uinfo->ssi_trapno);
+#endif
+		break;
+	case __SI_CHLD:
+		err |= __put_user(kinfo->si_pid, &uinfo->ssi_pid);
+		err |= __put_user(kinfo->si_uid, &uinfo->ssi_uid);
+		err |= __put_user(kinfo->si_status, &uinfo->ssi_status);
+		err |= __put_user(kinfo->si_utime, &uinfo->ssi_utime);
+		err |= __put_user(kinfo->si_stime, &uinfo->ssi_stime);
+		break;
+	default:	/* __SI_RT, __SI_MESGQ and whatever comes next */
+		err |= __put_user(kinfo->si_pid, &uinfo->ssi_pid);
+		err |= __put_user(kinfo->si_uid, &uinfo->ssi_uid);
+		err |= __put_user((long) kinfo->si_ptr, &uinfo->ssi_ptr);
+		err |= __put_user(kinfo->si_int, &uinfo->ssi_int);
+		break;
+	}
+
+	return err ? -EFAULT : 0;
+}
+
+/*
+ * Dequeue one signal of the mask, waiting for it unless @nonblock.
+ * Returns its number, 0 when detached, or an error.
+ */
+static int signalfd_dequeue(struct signalfd_ctx *ctx, siginfo_t *info,
+			    int nonblock)
+{
+	sigset_t notmask;
+	int sig;
+	DECLARE_WAITQUEUE(wait, current);
+
+	spin_lock_irq(&current->sighand->siglock);
+	notmask = ctx->sigmask;
+	signotset(&notmask);
+	sig = dequeue_signal(current, &notmask, info);
+	spin_unlock_irq(&current->sighand->siglock);
+	if (sig || nonblock)
+		return sig ? : (ctx->sighand ? -EAGAIN : 0);
+
+	add_wait_queue(&ctx->wqh, &wait);
+	for (;;) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		spin_lock_irq(&current->sighand->siglock);
+		notmask = ctx->sigmask;
+		signotset(&notmask);
+		sig = dequeue_signal(current, &notmask, info);
+		spin_unlock_irq(&current->sighand->siglock);
+		if (sig || !ctx->sighand)
+			break;
+		if (signal_pending(current)) {
+			sig = -ERESTARTSYS;
+			break;
+		}
+		schedule();
+	}
+	remove_wait_queue(&ctx->wqh, &wait);
+	__set_current_state(TASK_RUNNING);
+
+	return sig;
+}
+
+/*
+ * Returns as many signals as are pending and fit, waiting for the first
+ * of them only.
+ */
+static ssize_t signalfd_read(struct file *file, char __user *buf, size_t count,
+			     loff_t *ppos)
+{
+	struct signalfd_ctx *ctx = file->private_data;
+	struct signalfd_siginfo __user *siginfo;
+	int nonblock = file->f_flags & O_NONBLOCK;
+	ssize_t ret, total = 0;
+	siginfo_t info;
+
+	count /= sizeof(struct signalfd_siginfo);
+	if (!count)
+		return -EINVAL;
+
+	siginfo = (struct signalfd_siginfo __user *) buf;
+	if (!access_ok(VERIFY_WRITE, siginfo, count * sizeof(*siginfo)))
+		return -EFAULT;
+
+	do {
+		ret = signalfd_dequeue(ctx, &info, nonblock);
+		if (unlikely(ret <= 0))
+			break;
+		ret = signalfd_copyinfo(siginfo, &info);
+		if (ret < 0)
+			break;
+		siginfo++;
+		total += sizeof(*siginfo);
+		nonblock = 1;
+	} while (--count);
+
+	return total ? total : ret;
+}
+
+static struct file_operations signalfd_fops = {
+	.release	= signalfd_release,
+	.poll		= signalfd_poll,
+	.read		= signalfd_read,
+};
+
+/*
+ * @ufd -1 makes a new signalfd for the signals of @user_mask, otherwise
+ * the mask of the signalfd @ufd is replaced.  SIGKILL and SIGSTOP are
+ * never dequeued.
+ */
+asmlinkage long sys_signalfd(int ufd, sigset_t __user *user_mask,
+			     size_t sizemask)
+{
+	struct signalfd_ctx *ctx;
+	struct file *file;
+	sigset_t sigmask;
+	unsigned long flags;
+
+	if (sizemask != sizeof(sigset_t))
+		return -EINVAL;
+	if (copy_from_user(&sigmask, user_mask, sizeof(sigmask)))
+		return -EFAULT;
+	sigdelsetmask(&sigmask, sigmask(SIGKILL) | sigmask(SIGSTOP));
+
+	if (ufd == -1) {
+		ctx = kmalloc(sizeof(*ctx), GFP_KERNEL);
+		if (!ctx)
+			return -ENOMEM;
+
+		init_waitqueue_head(&ctx->wqh);
+		ctx->sigmask = sigmask;
+		ctx->sighand = current->sighand;
+
+		/* the creator is alive, so is its sighand */
+		spin_lock_irq(&ctx->sighand->siglock);
+		list_add_tail(&ctx->lnk, &ctx->sighand->signalfd_list);
+		spin_unlock_irq(&ctx->sighand->siglock);
+
+		ufd = anon_inode_getfd("[signalfd]", &signalfd_fops, ctx);
+		if (ufd < 0) {
+			spin_lock_irq(&ctx->sighand->siglock);
+			list_del(&ctx->lnk);
+			spin_unlock_irq(&ctx->sighand->siglock);
+			kfree(ctx);
+		}
+		return ufd;
+	}
+
+	file = fget(ufd);
+	if (!file)
+		return -EBADF;
+	if (file->f_op != &signalfd_fops) {
+		fput(file);
+		return -EINVAL;
+	}
+	ctx = file->private_data;
+
+	spin_lock_irqsave(&signalfd_lock, flags);
+	if (ctx->sighand) {
+		spin_lock(&ctx->sighand->siglock);
+		ctx->sigmask = sigmask;
+		spin_unlock(&ctx->sighand->siglock);
+	} else
+		ctx->sigmask = sigmask;
+	spin_unlock_irqrestore(&signalfd_lock, flags);
+
+	/* the new mask may have signals pending */
+	wake_up(&ctx->wqh);
+	fput(file);
+
+	return ufd;
+}
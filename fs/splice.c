@@ -0,0 +1,471 @@
+/*
+ *  linux/fs/splice.c
+ *
+ * Move data between a pipe and a file or socket without copying it
+ * through user space.  The pipe_buffer ring in fs/pipe.c is used as the
+ * in-kernel buffer: splicing a file into a pipe stores references to its
+ * page cache pages, splicing a pipe into a socket hands those same pages
+ * to ->sendpage(), and tee() duplicates page references between pipes.
+ */
+
+#include <linux/mm.h>
+#include <linux/file.h>
+#include <linux/fs.h>
+#include <linux/pagemap.h>
+#include <linux/pipe_fs_i.h>
+#include <linux/highmem.h>
+#include <linux/security.h>
+#include <linux/syscalls.h>
+
+#include <asm/uaccess.h>
+
+/*
+ * Buffers that reference page cache pages.  They must never be merged
+ * into by pipe_writev(), the page belongs to the file.
+ */
+static void page_cache_pipe_buf_release(struct pipe_inode_info *info,
+					struct pipe_buffer *buf)
+{
+	page_cache_release(buf->page);
+}
+
+static void page_cache_pipe_buf_get(struct pipe_inode_info *info,
+				    struct pipe_buffer *buf)
+{
+	page_cache_get(buf->page);
+}
+
+static struct pipe_buf_operations page_cache_pipe_buf_ops = {
+	.can_merge = 0,
+	.map = generic_pipe_buf_map,
+	.unmap = generic_pipe_buf_unmap,
+	.release = page_cache_pipe_buf_release,
+	.get = page_cache_pipe_buf_get,
+};
+
+static inline int is_pipe(struct file *file)
+{
+	return file->f_dentry->d_inode->i_pipe != NULL;
+}
+
+/*
+ * Wait until the pipe has room for at least one more buffer.  Called and
+ * returns with PIPE_SEM held.
+ */
+static int splice_wait_for_space(struct inode *inode, unsigned int flags)
+{
+	struct pipe_inode_info *info = inode->i_pipe;
+
+	while (info->nrbufs == PIPE_BUFFERS) {
+		if (!PIPE_READERS(*inode)) {
+			send_sig(SIGPIPE, current, 0);
+			return -EPIPE;
+		}
+		if (flags & SPLICE_F_NONBLOCK)
+			return -EAGAIN;
+		if (signal_pending(current))
+			return -ERESTARTSYS;
+		PIPE_WAITING_WRITERS(*inode)++;
+		pipe_wait(inode);
+		PIPE_WAITING_WRITERS(*inode)--;
+	}
+	if (!PIPE_READERS(*inode)) {
+		send_sig(SIGPIPE, current, 0);
+		return -EPIPE;
+	}
+	return 0;
+}
+
+/*
+ * Wait until the pipe has data.  Returns 1 if there is something to
+ * consume, 0 on EOF.  Called and returns with PIPE_SEM held.
+ */
+static int splice_wait_for_data(struct inode *inode, unsigned int flags)
+{
+	struct pipe_inode_info *info = inode->i_pipe;
+
+	while (!info->nrbufs) {
+		if (!PIPE_WRITERS(*inode))
+			return 0;
+		if (flags & SPLICE_F_NONBLOCK)
+			return -EAGAIN;
+		if (signal_pending(current))
+			return -ERESTARTSYS;
+		pipe_wait(inode);
+	}
+	return 1;
+}
+
+static inline struct pipe_buffer *pipe_next_free_buf(struct pipe_inode_info *info)
+{
+	return info->bufs + ((info->curbuf + info->nrbufs) & (PIPE_BUFFERS-1));
+}
+
+/*
+ * read_actor_t for ->sendfile(): instead of copying the page, take a
+ * reference to it and queue it in the pipe.  Stops the read early once
+ * the pipe is full.
+ */
+static int pipe_splice_actor(read_descriptor_t *desc, struct page *page,
+			     unsigned long offset, unsigned long size)
+{
+	struct pipe_inode_info *info = desc->arg.data;
+	struct pipe_buffer *buf;
+
+	if (info->nrbufs == PIPE_BUFFERS)
+		return 0;
+
+	if (size > desc->count)
+		size = desc->count;
+
+	buf = pipe_next_free_buf(info);
+	page_cache_get(page);
+	buf->page = page;
+	buf->offset = offset;
+	buf->len = size;
+	buf->ops = &page_cache_pipe_buf_ops;
+	info->nrbufs++;
+
+	desc->count -= size;
+	desc->written += size;
+	return size;
+}
+
+/*
+ * Fallback for sources without ->sendfile(), e.g. sockets: read into
+ * freshly allocated pages that are then owned by the pipe.  This still
+ * costs one copy, but saves the round trip through a user buffer.
+ */
+static ssize_t splice_read_copy(struct file *in, loff_t *ppos,
+				struct pipe_inode_info *info, size_t len)
+{
+	ssize_t ret = 0;
+	mm_segment_t old_fs;
+
+	old_fs = get_fs();
+	set_fs(KERNEL_DS);
+	while (len && info->nrbufs < PIPE_BUFFERS) {
+		struct pipe_buffer *buf = pipe_next_free_buf(info);
+		struct page *page = alloc_page(GFP_HIGHUSER);
+		size_t chars = min_t(size_t, len, PAGE_SIZE);
+		ssize_t got;
+
+		if (!page) {
+			ret = ret ? : -ENOMEM;
+			break;
+		}
+		got = in->f_op->read(in, (char __user *)kmap(page), chars, ppos);
+		kunmap(page);
+		if (got <= 0) {
+			__free_page(page);
+			if (!ret)
+				ret = got;
+			break;
+		}
+		buf->page = page;
+		buf->offset = 0;
+		buf->len = got;
+		buf->ops = &anon_pipe_buf_ops;
+		info->nrbufs++;
+
+		ret += got;
+		len -= got;
+		if (got < chars)
+			break;
+	}
+	set_fs(old_fs);
+	return ret;
+}
+
+static long do_splice_to(struct file *in, loff_t *ppos, struct file *out,
+			 size_t len, unsigned int flags)
+{
+	struct inode *inode = out->f_dentry->d_inode;
+	struct pipe_inode_info *info;
+	long ret;
+
+	if (!(in->f_mode & FMODE_READ))
+		return -EBADF;
+	if (!in->f_op || (!in->f_op->sendfile && !in->f_op->read))
+		return -EINVAL;
+	ret = rw_verify_area(READ, in, ppos, len);
+	if (ret)
+		return ret;
+	ret = security_file_permission(in, MAY_READ);
+	if (ret)
+		return ret;
+
+	down(PIPE_SEM(*inode));
+	info = inode->i_pipe;
+	ret = splice_wait_for_space(inode, flags);
+	if (!ret) {
+		if (in->f_op->sendfile)
+			ret = in->f_op->sendfile(in, ppos, len,
+						 pipe_splice_actor, info);
+		else
+			ret = splice_read_copy(in, ppos, info, len);
+	}
+	up(PIPE_SEM(*inode));
+
+	if (ret > 0) {
+		wake_up_interruptible(PIPE_WAIT(*inode));
+		kill_fasync(PIPE_FASYNC_READERS(*inode), SIGIO, POLL_IN);
+		current->rchar += ret;
+	}
+	current->syscr++;
+	return ret;
+}
+
+/*
+ * Push one pipe buffer to the destination.  Sockets take the page
+ * reference directly through ->sendpage(); everything else gets a
+ * single kernel-to-kernel copy through ->write().
+ */
+static ssize_t splice_push_buf(struct file *in, struct pipe_inode_info *info,
+			       struct pipe_buffer *buf, struct file *out,
+			       loff_t *ppos, size_t chars, int more)
+{
+	struct pipe_buf_operations *ops = buf->ops;
+	mm_segment_t old_fs;
+	ssize_t ret;
+	void *addr;
+
+	if (out->f_op->sendpage)
+		return out->f_op->sendpage(out, buf->page, buf->offset,
+					   chars, ppos, more);
+
+	addr = ops->map(in, info, buf, 0);
+	old_fs = get_fs();
+	set_fs(KERNEL_DS);
+	ret = out->f_op->write(out, (char __user *)addr + buf->offset,
+			       chars, ppos);
+	set_fs(old_fs);
+	ops->unmap(info, buf, addr);
+	return ret;
+}
+
+static long do_splice_from(struct file *in, struct file *out, loff_t *ppos,
+			   size_t len, unsigned int flags)
+{
+	struct inode *inode = in->f_dentry->d_inode;
+	struct pipe_inode_info *info;
+	int do_wakeup = 0;
+	long ret;
+
+	if (!(out->f_mode & FMODE_WRITE))
+		return -EBADF;
+	if (!out->f_op || (!out->f_op->sendpage && !out->f_op->write))
+		return -EINVAL;
+	ret = rw_verify_area(WRITE, out, ppos, len);
+	if (ret)
+		return ret;
+	ret = security_file_permission(out, MAY_WRITE);
+	if (ret)
+		return ret;
+
+	down(PIPE_SEM(*inode));
+	info = inode->i_pipe;
+	ret = splice_wait_for_data(inode, flags);
+	if (ret <= 0)
+		goto out;
+
+	ret = 0;
+	while (len && info->nrbufs) {
+		struct pipe_buffer *buf = info->bufs + info->curbuf;
+		size_t chars = min_t(size_t, len, buf->len);
+		int more = (flags & SPLICE_F_MORE) || chars < len;
+		ssize_t written;
+
+		written = splice_push_buf(in, info, buf, out, ppos, chars, more);
+		if (written <= 0) {
+			if (!ret)
+				ret = written;
+			break;
+		}
+		ret += written;
+		len -= written;
+		buf->offset += written;
+		buf->len -= written;
+		if (!buf->len) {
+			struct pipe_buf_operations *ops = buf->ops;
+
+			buf->ops = NULL;
+			ops->release(info, buf);
+			info->curbuf = (info->curbuf + 1) & (PIPE_BUFFERS-1);
+			info->nrbufs--;
+			do_wakeup = 1;
+		}
+		if (written < chars)
+			break;
+	}
+out:
+	up(PIPE_SEM(*inode));
+	if (do_wakeup) {
+		wake_up_interruptible(PIPE_WAIT(*inode));
+		kill_fasync(PIPE_FASYNC_WRITERS(*inode), SIGIO, POLL_OUT);
+	}
+	if (ret > 0)
+		current->wchar += ret;
+	current->syscw++;
+	return ret;
+}
+
+static long do_splice(struct file *in, loff_t __user *off_in,
+		      struct file *out, loff_t __user *off_out,
+		      size_t len, unsigned int flags)
+{
+	loff_t pos, *ppos;
+	long ret;
+
+	if (is_pipe(in) == is_pipe(out))
+		return -EINVAL;
+
+	if (is_pipe(in)) {
+		if (off_in)
+			return -ESPIPE;
+		ppos = &out->f_pos;
+		if (off_out) {
+			if (!(out->f_mode & FMODE_PWRITE))
+				return -ESPIPE;
+			if (copy_from_user(&pos, off_out, sizeof(loff_t)))
+				return -EFAULT;
+			ppos = &pos;
+		}
+		ret = do_splice_from(in, out, ppos, len, flags);
+		if (off_out && put_user(pos, off_out))
+			ret = -EFAULT;
+		return ret;
+	}
+
+	if (off_out)
+		return -ESPIPE;
+	ppos = &in->f_pos;
+	if (off_in) {
+		if (!(in->f_mode & FMODE_PREAD))
+			return -ESPIPE;
+		if (copy_from_user(&pos, off_in, sizeof(loff_t)))
+			return -EFAULT;
+		ppos = &pos;
+	}
+	ret = do_splice_to(in, ppos, out, len, flags);
+	if (off_in && put_user(pos, off_in))
+		ret = -EFAULT;
+	return ret;
+}
+
+asmlinkage long sys_splice(int fd_in, loff_t __user *off_in,
+			   int fd_out, loff_t __user *off_out,
+			   size_t len, unsigned int flags)
+{
+	struct file *in, *out;
+	int fput_in, fput_out;
+	long error;
+
+	if (unlikely(!len))
+		return 0;
+
+	error = -EBADF;
+	in = fget_light(fd_in, &fput_in);
+	if (!in)
+		goto out;
+	out = fget_light(fd_out, &fput_out);
+	if (out) {
+		error = do_splice(in, off_in, out, off_out, len, flags);
+		fput_light(out, fput_out);
+	}
+	fput_light(in, fput_in);
+out:
+	return error;
+}
+
+/*
+ * Duplicate up to len bytes worth of buffers from one pipe into another,
+ * without consuming them from the source.  Both pipes hold a reference
+ * to the same pages afterwards.
+ */
+static long do_tee(struct file *in, struct file *out, size_t len,
+		   unsigned int flags)
+{
+	struct inode *iinode = in->f_dentry->d_inode;
+	struct inode *oinode = out->f_dentry->d_inode;
+	struct pipe_inode_info *ipipe, *opipe;
+	int i, nr;
+	long ret = 0;
+
+	if (!is_pipe(in) || !is_pipe(out) || iinode == oinode)
+		return -EINVAL;
+	if (!(in->f_mode & FMODE_READ) || !(out->f_mode & FMODE_WRITE))
+		return -EBADF;
+
+	/* lock ordering: lower inode address first */
+	if (iinode < oinode) {
+		down(PIPE_SEM(*iinode));
+		down(PIPE_SEM(*oinode));
+	} else {
+		down(PIPE_SEM(*oinode));
+		down(PIPE_SEM(*iinode));
+	}
+	ipipe = iinode->i_pipe;
+	opipe = oinode->i_pipe;
+
+	if (!PIPE_READERS(*oinode)) {
+		send_sig(SIGPIPE, current, 0);
+		ret = -EPIPE;
+		goto out;
+	}
+	if (!ipipe->nrbufs || opipe->nrbufs == PIPE_BUFFERS) {
+		if (flags & SPLICE_F_NONBLOCK)
+			ret = -EAGAIN;
+		goto out;
+	}
+
+	nr = ipipe->nrbufs;
+	for (i = 0; i < nr && len; i++) {
+		struct pipe_buffer *ibuf, *obuf;
+
+		if (opipe->nrbufs == PIPE_BUFFERS)
+			break;
+		ibuf = ipipe->bufs + ((ipipe->curbuf + i) & (PIPE_BUFFERS-1));
+		obuf = pipe_next_free_buf(opipe);
+
+		ibuf->ops->get(ipipe, ibuf);
+		*obuf = *ibuf;
+		if (obuf->len > len)
+			obuf->len = len;
+		opipe->nrbufs++;
+		ret += obuf->len;
+		len -= obuf->len;
+	}
+out:
+	up(PIPE_SEM(*iinode));
+	up(PIPE_SEM(*oinode));
+
+	if (ret > 0) {
+		wake_up_interruptible(PIPE_WAIT(*oinode));
+		kill_fasync(PIPE_FASYNC_READERS(*oinode), SIGIO, POLL_IN);
+	}
+	return ret;
+}
+
+asmlinkage long sys_tee(int fdin, int fdout, size_t len, unsigned int flags)
+{
+	struct file *in, *out;
+	int fput_in, fput_out;
+	long error;
+
+	if (unlikely(!len))
+		return 0;
+
+	error = -EBADF;
+	in = fget_light(fdin, &fput_in);
+	if (!in)
+		goto out;
+	out = fget_light(fdout, &fput_out);
+	if (out) {
+		error = do_tee(in, out, len, flags);
+		fput_light(out, fput_out);
+	}
+	fput_light(in, fput_in);
+out:
+	return error;
+}
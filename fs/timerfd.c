@@ -0,0 +1,310 @@
+/*
+ *  fs/timerfd.c
+ *
+ *  A timerfd is a timer behind a file descriptor.  timerfd_settime()
+ *  arms it, like timer_settime(), and each expiry counts one tick
+ *  instead of sending a signal.  read() returns the ticks as a 64 bit
+ *  number and resets them, blocking while there are none, and poll()
+ *  reports them, so a timer is one more descriptor of an event loop.
+ *
+ *  The timer is a kernel timer, so expiries are rounded up to the
+ *  next jiffy, and an absolute CLOCK_REALTIME expiry does not move
+ *  when the clock is set.
+ */
+
+#include <linux/file.h>
+#include <linux/poll.h>
+#include <linux/init.h>
+#include <linux/fs.h>
+#include <linux/sched.h>
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/list.h>
+#include <linux/spinlock.h>
+#include <linux/time.h>
+#include <linux/timer.h>
+#include <linux/mutex.h>
+#include <linux/syscalls.h>
+#include <linux/anon_inodes.h>
+#include <linux/timerfd.h>
+#include <asm/uaccess.h>
+
+struct timerfd_ctx {
+	struct timer_list timer;
+	/* its lock protects the fields below and the timer expiry */
+	wait_queue_head_t wqh;
+	unsigned long interval;		/* in jiffies, 0 for one shot */
+	__u64 ticks;
+	int armed;
+	clockid_t clockid;
+	/* serializes timerfd_settime() against itself */
+	struct mutex settime_mutex;
+};
+
+/*
+ * Counts an expiry, and those missed by a periodic timer which could
+ * not run in time, and rearms a periodic timer.
+ */
+static void timerfd_tmrproc(unsigned long data)
+{
+	struct timerfd_ctx *ctx = (struct timerfd_ctx *) data;
+	unsigned long flags, missed;
+
+	spin_lock_irqsave(&ctx->wqh.lock, flags);
+	ctx->ticks++;
+	if (ctx->interval) {
+		ctx->timer.expires += ctx->interval;
+		if (time_before_eq(ctx->timer.expires, jiffies)) {
+			missed = (jiffies - ctx->timer.expires) /
+				ctx->interval + 1;
+			ctx->ticks += missed;
+			ctx->timer.expires += missed * ctx->interval;
+		}
+		add_timer(&ctx->timer);
+	} else
+		ctx->armed = 0;
+	wake_up_locked(&ctx->wqh);
+	spin_unlock_irqrestore(&ctx->wqh.lock, flags);
+}
+
+/* Called with the lock of ctx->wqh */
+static void timerfd_get_value(struct timerfd_ctx *ctx, struct itimerspec *t)
+{
+	long left = 0;
+
+	if (ctx->armed) {
+		left = (long) (ctx->timer.expires - jiffies);
+		if (left < 1)
+			left = 1;
+	}
+	jiffies_to_timespec(left, &t->it_value);
+	jiffies_to_timespec(ctx->interval, &t->it_interval);
+}
+
+static int timespec_ok(const struct timespec *ts)
+{
+	return ts->tv_sec >= 0 &&
+		ts->tv_nsec >= 0 && ts->tv_nsec < NSEC_PER_SEC;
+}
+
+/* Jiffies from now to the expiry of it_value, 0 for none */
+static unsigned long timerfd_delay(struct timerfd_ctx *ctx, int flags,
+				   const struct timespec *value)
+{
+	struct timespec now, delta;
+
+	if (!value->tv_sec && !value->tv_nsec)
+		return 0;
+	if (!(flags & TFD_TIMER_ABSTIME))
+		return timespec_to_jiffies(value);
+
+	if (ctx->clockid == CLOCK_REALTIME)
+		getnstimeofday(&now);
+	else
+		do_posix_clock_monotonic_gettime(&now);
+	set_normalized_timespec(&delta, value->tv_sec - now.tv_sec,
+				value->tv_nsec - now.tv_nsec);
+	/* already past: expire at the next tick */
+	if (delta.tv_sec < 0)
+		return 1;
+	return timespec_to_jiffies(&delta) ? : 1;
+}
+
+static int timerfd_release(struct inode *inode, struct file *file)
+{
+	struct timerfd_ctx *ctx = file->private_data;
+
+	del_timer_sync(&ctx->timer);
+	kfree(ctx);
+	return 0;
+}
+
+static unsigned int timerfd_poll(struct file *file, poll_table *wait)
+{
+	struct timerfd_ctx *ctx = file->private_data;
+	unsigned int events = 0;
+	unsigned long flags;
+
+	poll_wait(file, &ctx->wqh, wait);
+
+	spin_lock_irqsave(&ctx->wqh.lock, flags);
+	if (ctx->ticks)
+		events |= POLLIN;
+	spin_unlock_irqrestore(&ctx->wqh.lock, flags);
+
+	return events;
+}
+
+static ssize_t timerfd_read(struct file *file, char __user *buf, size_t count,
+			    loff_t *ppos)
+{
+	struct timerfd_ctx *ctx = file->private_data;
+	ssize_t res;
+	__u64 ticks = 0;
+	DECLARE_WAITQUEUE(wait, current);
+
+	if (count < sizeof(ticks))
+		return -EINVAL;
+
+	spin_lock_irq(&ctx->wqh.lock);
+	res = -EAGAIN;
+	if (ctx->ticks)
+		res = sizeof(ticks);
+	else if (!(file->f_flags & O_NONBLOCK)) {
+		__add_wait_queue(&ctx->wqh, &wait);
+		for (;;) {
+			set_current_state(TASK_INTERRUPTIBLE);
+			if (ctx->ticks) {
+				res = sizeof(ticks);
+				break;
+			}
+			if (signal_pending(current)) {
+				res = -ERESTARTSYS;
+				break;
+			}
+			spin_unlock_irq(&ctx->wqh.lock);
+			schedule();
+			spin_lock_irq(&ctx->wqh.lock);
+		}
+		__remove_wait_queue(&ctx->wqh, &wait);
+		__set_current_state(TASK_RUNNING);
+	}
+	if (res > 0) {
+		ticks = ctx->ticks;
+		ctx->ticks = 0;
+	}
+	spin_unlock_irq(&ctx->wqh.lock);
+
+	if (res > 0 && put_user(ticks, (__u64 __user *) buf))
+		return -EFAULT;
+
+	return res;
+}
+
+static struct file_operations timerfd_fops = {
+	.release	= timerfd_release,
+	.poll		= timerfd_poll,
+	.read		= timerfd_read,
+};
+
+static struct file *timerfd_fget(int fd)
+{
+	struct file *file;
+
+	file = fget(fd);
+	if (!file)
+		return ERR_PTR(-EBADF);
+	if (file->f_op != &timerfd_fops) {
+		fput(file);
+		return ERR_PTR(-EINVAL);
+	}
+
+	return file;
+}
+
+asmlinkage long sys_timerfd_create(int clockid, int flags)
+{
+	struct timerfd_ctx *ctx;
+	int fd;
+
+	if (flags || (clockid != CLOCK_MONOTONIC && clockid != CLOCK_REALTIME))
+		return -EINVAL;
+
+	ctx = kmalloc(sizeof(*ctx), GFP_KERNEL);
+	if (!ctx)
+		return -ENOMEM;
+
+	init_waitqueue_head(&ctx->wqh);
+	init_timer(&ctx->timer);
+	ctx->timer.function = timerfd_tmrproc;
+	ctx->timer.data = (unsigned long) ctx;
+	ctx->interval = 0;
+	ctx->ticks = 0;
+	ctx->armed = 0;
+	ctx->clockid = clockid;
+	mutex_init(&ctx->settime_mutex);
+
+	fd = anon_inode_getfd("[timerfd]", &timerfd_fops, ctx);
+	if (fd < 0)
+		kfree(ctx);
+
+	return fd;
+}
+
+asmlinkage long sys_timerfd_settime(int ufd, int flags,
+				    const struct itimerspec __user *utmr,
+				    struct itimerspec __user *otmr)
+{
+	struct file *file;
+	struct timerfd_ctx *ctx;
+	struct itimerspec ktmr, kotmr;
+	unsigned long delay;
+
+	if (copy_from_user(&ktmr, utmr, sizeof(ktmr)))
+		return -EFAULT;
+
+	if ((flags & ~TFD_TIMER_ABSTIME) ||
+	    !timespec_ok(&ktmr.it_value) ||
+	    !timespec_ok(&ktmr.it_interval))
+		return -EINVAL;
+
+	file = timerfd_fget(ufd);
+	if (IS_ERR(file))
+		return PTR_ERR(file);
+	ctx = file->private_data;
+
+	/*
+	 * Only the handler itself rearms the timer while the mutex is
+	 * held, which del_timer_sync() copes with.
+	 */
+	mutex_lock(&ctx->settime_mutex);
+	spin_lock_irq(&ctx->wqh.lock);
+	timerfd_get_value(ctx, &kotmr);
+	ctx->armed = 0;
+	spin_unlock_irq(&ctx->wqh.lock);
+
+	del_timer_sync(&ctx->timer);
+
+	delay = timerfd_delay(ctx, flags, &ktmr.it_value);
+
+	spin_lock_irq(&ctx->wqh.lock);
+	ctx->ticks = 0;
+	ctx->interval = 0;
+	if (delay) {
+		if (ktmr.it_interval.tv_sec || ktmr.it_interval.tv_nsec)
+			ctx->interval = timespec_to_jiffies(&ktmr.it_interval)
+				? : 1;
+		ctx->armed = 1;
+		ctx->timer.expires = jiffies + delay;
+		add_timer(&ctx->timer);
+	}
+	spin_unlock_irq(&ctx->wqh.lock);
+	mutex_unlock(&ctx->settime_mutex);
+
+	fput(file);
+
+	if (otmr && copy_to_user(otmr, &kotmr, sizeof(kotmr)))
+		return -EFAULT;
+
+	return 0;
+}
+
+asmlinkage long sys_timerfd_gettime(int ufd, struct itimerspec __user *otmr)
+{
+	struct file *file;
+	struct timerfd_ctx *ctx;
+	struct itimerspec kotmr;
+
+	file = timerfd_fget(ufd);
+	if (IS_ERR(file))
+		return PTR_ERR(file);
+	ctx = file->private_data;
+
+	spin_lock_irq(&ctx->wqh.lock);
+	timerfd_get_value(ctx, &kotmr);
+	spin_unlock_irq(&ctx->wqh.lock);
+
+	fput(file);
+
+	return copy_to_user(otmr, &kotmr, sizeof(kotmr)) ? -EFAULT : 0;
+}
@@ -0,0 +1,489 @@
+/*
+ * VFS and page cache benchmark module.
+ *
+ * Runs fixed workloads against a scratch tree made under the directory
+ * given as "dir", and prints for each one the operations per second and
+ * the cycles per operation, like the speed tests of crypto/tcrypt.c.
+ * The counts do not depend on the speed of the machine, so the numbers
+ * can be compared between kernels run on the same box and filesystem.
+ *
+ *	modprobe vfsbench dir=/mnt/ext3 [mode=N] [scale=N]
+ *
+ * The module loads to run the tests and fails with -EAGAIN afterwards,
+ * so that it can be run again straight away.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ */
+
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/fs.h>
+#include <linux/namei.h>
+#include <linux/stat.h>
+#include <linux/mm.h>
+#include <linux/mman.h>
+#include <linux/pagemap.h>
+#include <linux/slab.h>
+#include <linux/time.h>
+#include <asm/uaccess.h>
+#include <asm/timex.h>
+#include <asm/div64.h>
+
+/* Directories between the scratch directory and the file looked up */
+#define VB_DEPTH	8
+
+/* Size of the file read and mapped, in pages */
+#define VB_FILE_PAGES	64
+
+static char *dir = "/tmp";
+static int mode;
+static unsigned int scale = 1;
+
+static char *vb_root;		/* <dir>/vfsbench.<pid> */
+static char *vb_deep;		/* vb_root/d0/.../d7 */
+static char *vb_file;		/* vb_deep/file */
+static char *vb_name;		/* scratch for the names of created files */
+static char *vb_page;
+
+struct vb_test {
+	const char *name;
+	unsigned long nr;	/* operations per run, times scale */
+	int (*setup)(void);
+	int (*op)(unsigned long i);
+	void (*teardown)(void);
+};
+
+static int vb_mkdir(const char *path)
+{
+	struct nameidata nd;
+	struct dentry *dentry;
+	int err;
+
+	err = path_lookup(path, LOOKUP_PARENT, &nd);
+	if (err)
+		return err;
+	down(&nd.dentry->d_inode->i_sem);
+	dentry = lookup_one_len(nd.last.name, nd.dentry, nd.last.len);
+	err = PTR_ERR(dentry);
+	if (!IS_ERR(dentry)) {
+		err = vfs_mkdir(nd.dentry->d_inode, dentry, 0700);
+		dput(dentry);
+	}
+	up(&nd.dentry->d_inode->i_sem);
+	path_release(&nd);
+	return err;
+}
+
+static int vb_remove(const char *path, int isdir)
+{
+	struct nameidata nd;
+	struct dentry *dentry;
+	int err;
+
+	err = path_lookup(path, LOOKUP_PARENT, &nd);
+	if (err)
+		return err;
+	down(&nd.dentry->d_inode->i_sem);
+	dentry = lookup_one_len(nd.last.name, nd.dentry, nd.last.len);
+	err = PTR_ERR(dentry);
+	if (!IS_ERR(dentry)) {
+		err = -ENOENT;
+		if (dentry->d_inode) {
+			if (isdir)
+				err = vfs_rmdir(nd.dentry->d_inode, dentry);
+			else
+				err = vfs_unlink(nd.dentry->d_inode, dentry);
+		}
+		dput(dentry);
+	}
+	up(&nd.dentry->d_inode->i_sem);
+	path_release(&nd);
+	return err;
+}
+
+static ssize_t vb_rw(struct file *file, int write, loff_t pos)
+{
+	mm_segment_t oldfs = get_fs();
+	ssize_t ret;
+
+	set_fs(KERNEL_DS);
+	if (write)
+		ret = vfs_write(file, (char __user *)vb_page, PAGE_SIZE, &pos);
+	else
+		ret = vfs_read(file, (char __user *)vb_page, PAGE_SIZE, &pos);
+	set_fs(oldfs);
+	if (ret >= 0 && ret != PAGE_SIZE)
+		ret = -EIO;
+	return ret;
+}
+
+/* As sys_fsync() does it */
+static int vb_fsync(struct file *file)
+{
+	struct address_space *mapping = file->f_mapping;
+	int ret, err;
+
+	if (!file->f_op || !file->f_op->fsync)
+		return -EINVAL;
+
+	current->flags |= PF_SYNCWRITE;
+	ret = filemap_fdatawrite(mapping);
+	down(&mapping->host->i_sem);
+	err = file->f_op->fsync(file, file->f_dentry, 0);
+	if (!ret)
+		ret = err;
+	up(&mapping->host->i_sem);
+	err = filemap_fdatawait(mapping);
+	if (!ret)
+		ret = err;
+	current->flags &= ~PF_SYNCWRITE;
+	return ret;
+}
+
+static int vb_op_lookup(unsigned long i)
+{
+	struct nameidata nd;
+	int err;
+
+	err = path_lookup(vb_file, LOOKUP_FOLLOW, &nd);
+	if (!err)
+		path_release(&nd);
+	return err;
+}
+
+static int vb_op_open(unsigned long i)
+{
+	struct file *file;
+
+	file = filp_open(vb_file, O_RDONLY, 0);
+	if (IS_ERR(file))
+		return PTR_ERR(file);
+	return filp_close(file, current->files);
+}
+
+static int vb_op_stat(unsigned long i)
+{
+	struct nameidata nd;
+	struct kstat stat;
+	int err;
+
+	err = path_lookup(vb_file, LOOKUP_FOLLOW, &nd);
+	if (err)
+		return err;
+	err = vfs_getattr(nd.mnt, nd.dentry, &stat);
+	path_release(&nd);
+	return err;
+}
+
+static struct file *vb_filp;
+
+static int vb_setup_file(void)
+{
+	vb_filp = filp_open(vb_file, O_RDWR | O_LARGEFILE, 0);
+	if (IS_ERR(vb_filp))
+		return PTR_ERR(vb_filp);
+	return 0;
+}
+
+static void vb_teardown_file(void)
+{
+	filp_close(vb_filp, current->files);
+}
+
+/* One page of the file out of the page cache, which the setup filled */
+static int vb_op_read(unsigned long i)
+{
+	ssize_t ret;
+
+	ret = vb_rw(vb_filp, 0, (loff_t)(i % VB_FILE_PAGES) << PAGE_SHIFT);
+	return ret < 0 ? ret : 0;
+}
+
+static int vb_setup_read(void)
+{
+	unsigned long i;
+	int err;
+
+	err = vb_setup_file();
+	for (i = 0; !err && i < VB_FILE_PAGES; i++)
+		err = vb_op_read(i);
+	if (err)
+		vb_teardown_file();
+	return err;
+}
+
+/*
+ * The file gets mapped at the first of every VB_FILE_PAGES operations and
+ * unmapped after the last, and each operation faults a page of it in.
+ */
+static unsigned long vb_addr;
+
+static int vb_op_fault(unsigned long i)
+{
+	unsigned long len = VB_FILE_PAGES << PAGE_SHIFT;
+	unsigned long idx = i % VB_FILE_PAGES;
+	char c;
+	int err;
+
+	if (!idx) {
+		down_write(&current->mm->mmap_sem);
+		vb_addr = do_mmap(vb_filp, 0, len, PROT_READ, MAP_SHARED, 0);
+		up_write(&current->mm->mmap_sem);
+		if (vb_addr & ~PAGE_MASK) {
+			err = vb_addr;
+			vb_addr = 0;
+			return err;
+		}
+	}
+
+	err = get_user(c, (char __user *)(vb_addr + (idx << PAGE_SHIFT)));
+
+	if (idx == VB_FILE_PAGES - 1 || err) {
+		down_write(&current->mm->mmap_sem);
+		do_munmap(current->mm, vb_addr, len);
+		up_write(&current->mm->mmap_sem);
+		vb_addr = 0;
+	}
+	return err;
+}
+
+static void vb_teardown_fault(void)
+{
+	if (vb_addr) {
+		down_write(&current->mm->mmap_sem);
+		do_munmap(current->mm, vb_addr, VB_FILE_PAGES << PAGE_SHIFT);
+		up_write(&current->mm->mmap_sem);
+		vb_addr = 0;
+	}
+	vb_teardown_file();
+}
+
+/* Rewrite a page and wait for it, and on a journalling fs the commit */
+static int vb_op_fsync(unsigned long i)
+{
+	ssize_t ret;
+
+	ret = vb_rw(vb_filp, 1, 0);
+	if (ret < 0)
+		return ret;
+	return vb_fsync(vb_filp);
+}
+
+/* Create an empty file, and unlink it again */
+static int vb_op_create(unsigned long i)
+{
+	struct file *file;
+	int err;
+
+	snprintf(vb_name, PATH_MAX, "%s/f%lu", vb_root, i);
+	file = filp_open(vb_name, O_CREAT | O_EXCL | O_WRONLY, 0600);
+	if (IS_ERR(file))
+		return PTR_ERR(file);
+	err = filp_close(file, current->files);
+	if (!err)
+		err = vb_remove(vb_name, 0);
+	return err;
+}
+
+static struct vb_test vb_tests[] = {
+	{
+		.name = "lookup",
+		.nr = 100000,
+		.op = vb_op_lookup,
+	}, {
+		.name = "open/close",
+		.nr = 50000,
+		.op = vb_op_open,
+	}, {
+		.name = "stat",
+		.nr = 100000,
+		.op = vb_op_stat,
+	}, {
+		.name = "cached read",
+		.nr = 100000,
+		.setup = vb_setup_read,
+		.op = vb_op_read,
+		.teardown = vb_teardown_file,
+	}, {
+		.name = "mmap fault",
+		.nr = 64 * VB_FILE_PAGES,
+		.setup = vb_setup_file,
+		.op = vb_op_fault,
+		.teardown = vb_teardown_fault,
+	}, {
+		.name = "write+fsync",
+		.nr = 200,
+		.setup = vb_setup_file,
+		.op = vb_op_fsync,
+		.teardown = vb_teardown_file,
+	}, {
+		.name = "create+unlink",
+		.nr = 10000,
+		.op = vb_op_create,
+	},
+};
+
+static void vb_run(struct vb_test *t)
+{
+	unsigned long i, nr = t->nr * scale;
+	struct timeval start, end;
+	cycles_t c_start, c_end;
+	u64 usecs, rate, cyc;
+	int err = 0;
+
+	if (!nr)
+		return;
+	if (t->setup && (err = t->setup())) {
+		printk(KERN_ERR "vfsbench: %s: setup failed: %d\n", t->name, err);
+		return;
+	}
+
+	do_gettimeofday(&start);
+	c_start = get_cycles();
+	for (i = 0; i < nr; i++) {
+		err = t->op(i);
+		if (err)
+			break;
+		cond_resched();
+	}
+	c_end = get_cycles();
+	do_gettimeofday(&end);
+
+	if (t->teardown)
+		t->teardown();
+
+	if (err) {
+		printk(KERN_ERR "vfsbench: %s: failed at op %lu: %d\n",
+		       t->name, i, err);
+		return;
+	}
+
+	usecs = (u64)(end.tv_sec - start.tv_sec) * USEC_PER_SEC +
+		end.tv_usec - start.tv_usec;
+	if (!usecs)
+		usecs = 1;
+	rate = (u64)nr * USEC_PER_SEC;
+	do_div(rate, usecs);
+	cyc = c_end - c_start;
+	do_div(cyc, nr);
+
+	printk(KERN_INFO "vfsbench: %-14s %8lu ops in %8llu us: %8llu ops/s, "
+	       "%8llu cycles/op\n", t->name, nr, (unsigned long long)usecs,
+	       (unsigned long long)rate, (unsigned long long)cyc);
+}
+
+static void vb_make_path(char *buf, int depth)
+{
+	char *p = buf + snprintf(buf, PATH_MAX, "%s", vb_root);
+	int d;
+
+	for (d = 0; d < depth; d++)
+		p += snprintf(p, PATH_MAX - (p - buf), "/d%d", d);
+}
+
+/* Everything below vb_root, which exists */
+static int vb_make_tree(void)
+{
+	struct file *file;
+	int d, err;
+	unsigned long i;
+
+	for (d = 1; d <= VB_DEPTH; d++) {
+		vb_make_path(vb_name, d);
+		err = vb_mkdir(vb_name);
+		if (err)
+			return err;
+	}
+
+	file = filp_open(vb_file, O_CREAT | O_EXCL | O_WRONLY | O_LARGEFILE,
+			 0600);
+	if (IS_ERR(file))
+		return PTR_ERR(file);
+	memset(vb_page, 0x5a, PAGE_SIZE);
+	for (i = 0; !err && i < VB_FILE_PAGES; i++) {
+		ssize_t ret = vb_rw(file, 1, (loff_t)i << PAGE_SHIFT);
+		if (ret < 0)
+			err = ret;
+	}
+	if (!err)
+		err = vb_fsync(file);
+	filp_close(file, current->files);
+	return err;
+}
+
+static void vb_remove_tree(void)
+{
+	int d;
+
+	vb_remove(vb_file, 0);
+	for (d = VB_DEPTH; d >= 0; d--) {
+		vb_make_path(vb_name, d);
+		vb_remove(vb_name, 1);
+	}
+}
+
+static int __init vb_init(void)
+{
+	int i, err = -ENOMEM;
+
+	vb_root = kmalloc(4 * PATH_MAX, GFP_KERNEL);
+	if (!vb_root)
+		return -ENOMEM;
+	vb_deep = vb_root + PATH_MAX;
+	vb_file = vb_deep + PATH_MAX;
+	vb_name = vb_file + PATH_MAX;
+	vb_page = (char *)__get_free_page(GFP_KERNEL);
+	if (!vb_page)
+		goto out;
+
+	snprintf(vb_root, PATH_MAX, "%s/vfsbench.%d", dir, current->pid);
+	vb_make_path(vb_deep, VB_DEPTH);
+	snprintf(vb_file, PATH_MAX, "%s/file", vb_deep);
+
+	err = vb_mkdir(vb_root);
+	if (!err)
+		err = vb_make_tree();
+	if (err) {
+		printk(KERN_ERR "vfsbench: cannot set up under %s: %d\n",
+		       dir, err);
+		if (err != -EEXIST)
+			vb_remove_tree();
+		goto out_page;
+	}
+
+	printk(KERN_INFO "vfsbench: under %s, scale %u\n", dir, scale);
+	for (i = 0; i < ARRAY_SIZE(vb_tests); i++)
+		if (!mode || mode == i + 1)
+			vb_run(&vb_tests[i]);
+	vb_remove_tree();
+	err = -EAGAIN;
+
+out_page:
+	free_page((unsigned long)vb_page);
+out:
+	kfree(vb_root);
+	return err;
+}
+
+/*
+ * If an init function is provided, an exit function must also be provided
+ * to allow module unload.
+ */
+static void __exit vb_exit(void) { }
+
+module_init(vb_init);
+module_exit(vb_exit);
+module_param(dir, charp, 0);
+MODULE_PARM_DESC(dir, "Directory to make the scratch tree in, on the filesystem to measure");
+module_param(mode, int, 0);
+MODULE_PARM_DESC(mode, "Run only test number N: 1 lookup, 2 open/close, 3 stat, "
+		 "4 cached read, 5 mmap fault, 6 write+fsync, 7 create+unlink");
+module_param(scale, uint, 0);
+MODULE_PARM_DESC(scale, "Multiply the operation counts of every test by N");
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("VFS and page cache benchmarks");
@@ -55,6 +55,7 @@
 
 #include <linux/dcache.h>
 #include <linux/smp_lock.h>
+#include <linux/falloc.h>
 
 static struct vm_operations_struct linvfs_file_vm_ops;
 
@@ -461,6 +462,71 @@ linvfs_ioctl_invis(
 	return error;
 }
 
+/*
+ * fallocate() is XFS_IOC_RESVSP64 on the whole range, which leaves
+ * unwritten extents behind, plus a size update unless the caller wants
+ * the size kept.  i_sem keeps writers from moving EOF in between.
+ */
+STATIC long
+__linvfs_fallocate(
+	struct file	*filp,
+	int		mode,
+	loff_t		offset,
+	loff_t		len,
+	int		attr_flags)
+{
+	struct inode	*inode = filp->f_dentry->d_inode;
+	vnode_t		*vp = LINVFS_GET_VP(inode);
+	bhv_desc_t	*bdp;
+	xfs_flock64_t	bf;
+	vattr_t		va;
+	int		error;
+
+	bdp = vn_bhv_lookup(VN_BHV_HEAD(vp), &xfs_vnodeops);
+	if (!bdp)
+		return -EINVAL;
+
+	memset(&bf, 0, sizeof(bf));
+	bf.l_start = offset;
+	bf.l_len = len;
+
+	if (filp->f_flags & (O_NDELAY|O_NONBLOCK))
+		attr_flags |= ATTR_NONBLOCK;
+
+	down(&inode->i_sem);
+	error = xfs_change_file_space(bdp, XFS_IOC_RESVSP64, &bf, 0,
+				      NULL, attr_flags);
+	if (!error && !(mode & FALLOC_FL_KEEP_SIZE) &&
+	    offset + len > i_size_read(inode)) {
+		va.va_mask = XFS_AT_SIZE;
+		va.va_size = offset + len;
+		VOP_SETATTR(vp, &va, attr_flags, NULL, error);
+	}
+	up(&inode->i_sem);
+	VMODIFY(vp);
+	return -error;
+}
+
+STATIC long
+linvfs_fallocate(
+	struct file	*filp,
+	int		mode,
+	loff_t		offset,
+	loff_t		len)
+{
+	return __linvfs_fallocate(filp, mode, offset, len, 0);
+}
+
+STATIC long
+linvfs_fallocate_invis(
+	struct file	*filp,
+	int		mode,
+	loff_t		offset,
+	loff_t		len)
+{
+	return __linvfs_fallocate(filp, mode, offset, len, ATTR_DMI);
+}
+
 #ifdef HAVE_VMOP_MPROTECT
 STATIC int
 linvfs_mprotect(
@@ -532,6 +598,7 @@ struct file_operations linvfs_file_operations = {
 	.open		= linvfs_open,
 	.release	= linvfs_release,
 	.fsync		= linvfs_fsync,
+	.fallocate	= linvfs_fallocate,
 #ifdef HAVE_FOP_OPEN_EXEC
 	.open_exec	= linvfs_open_exec,
 #endif
@@ -554,6 +621,7 @@ struct file_operations linvfs_invis_file_operations = {
 	.open		= linvfs_open,
 	.release	= linvfs_release,
 	.fsync		= linvfs_fsync,
+	.fallocate	= linvfs_fallocate_invis,
 };
 
 
@@ -86,8 +86,6 @@ STATIC int  xlog_state_get_iclog_space(xlog_t		*log,
 				       xlog_ticket_t	*ticket,
 				       int		*continued_write,
 				       int		*logoffsetp);
-STATIC void xlog_state_put_ticket(xlog_t	*log,
-				  xlog_ticket_t *tic);
 STATIC int  xlog_state_release_iclog(xlog_t		*log,
 				     xlog_in_core_t	*iclog);
 STATIC void xlog_state_switch_iclogs(xlog_t		*log,
@@ -112,11 +110,6 @@ STATIC void xlog_ungrant_log_space(xlog_t	 *log,
 
 /* local ticket functions */
 STATIC void		xlog_state_ticket_alloc(xlog_t *log);
-STATIC xlog_ticket_t	*xlog_ticket_get(xlog_t *log,
-					 int	unit_bytes,
-					 int	count,
-					 char	clientid,
-					 uint	flags);
 STATIC void		xlog_ticket_put(xlog_t *log, xlog_ticket_t *ticket);
 
 /* local debug functions */
@@ -322,6 +315,17 @@ xfs_log_force(xfs_mount_t *mp,
 
 	XFS_STATS_INC(xs_log_force);
 
+	/*
+	 * With delayed logging nothing committed is in the iclogs until
+	 * its checkpoint is written, and the lsn a transaction was handed
+	 * at commit does not name the iclog it will end up in.  Write out
+	 * the current checkpoint and force everything.
+	 */
+	if (log->l_cilp) {
+		xlog_cil_push(log);
+		lsn = 0;
+	}
+
 	if ((log->l_flags & XLOG_IO_ERROR) == 0) {
 		if (lsn == 0)
 			rval = xlog_state_sync_all(log, flags);
@@ -465,6 +469,10 @@ xfs_log_mount(xfs_mount_t	*mp,
 
 	mp->m_log = xlog_alloc_log(mp, log_target, blk_offset, num_bblks);
 
+	/* recovery commits transactions too, so this has to come first */
+	if (mp->m_flags & XFS_MOUNT_DELAYLOG)
+		xlog_cil_init(mp->m_log);
+
 #if defined(DEBUG) || defined(XLOG_NOLOG)
 	if (!xlog_debug) {
 		cmn_err(CE_NOTE, "log dev: %s", XFS_BUFTARG_NAME(log_target));
@@ -1533,6 +1541,9 @@ xlog_unalloc_log(xlog_t *log)
 	int		i;
 
 
+	if (log->l_cilp)
+		xlog_cil_destroy(log);
+
 	iclog = log->l_iclog;
 	for (i=0; i<log->l_iclog_bufs; i++) {
 		sv_destroy(&iclog->ic_forcesema);
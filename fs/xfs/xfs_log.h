@@ -171,6 +171,14 @@ void      xfs_log_unmount_dealloc(struct xfs_mount *mp);
 int	  xfs_log_force_umount(struct xfs_mount *mp, int logerror);
 int	  xfs_log_need_covered(struct xfs_mount *mp);
 
+struct xfs_trans;
+int	  xfs_log_commit_cil(struct xfs_mount	*mp,
+			     struct xfs_trans	*tp,
+			     xfs_log_iovec_t	*log_vector,
+			     xfs_lsn_t		*commit_lsn,
+			     uint		flags);
+void	  xfs_log_commit_cil_done(struct xfs_mount *mp);
+
 void	  xlog_iodone(struct xfs_buf *);
 
 #endif
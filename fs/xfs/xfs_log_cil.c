@@ -0,0 +1,446 @@
+/*
+ * Copyright (c) 2005 Silicon Graphics, Inc.  All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it would be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * Further, this software is distributed without any warranty that it is
+ * free of the rightful claim of any third person regarding infringement
+ * or the like.  Any license provided herein, whether implied or
+ * otherwise, applies only to this software file.  Patent licenses, if
+ * any, provided herein do not apply to combinations of this program with
+ * other software, or any other product whatsoever.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston MA 02111-1307, USA.
+ *
+ * Contact information: Silicon Graphics, Inc., 1600 Amphitheatre Pkwy,
+ * Mountain View, CA  94043, or:
+ *
+ * http://www.sgi.com
+ *
+ * For further information regarding this notice, see:
+ *
+ * http://oss.sgi.com/projects/GenInfo/SGIGPLNoticeExplan/
+ */
+
+/*
+ * Committed item list (CIL) for delayed logging
+ */
+
+#include "xfs.h"
+#include "xfs_macros.h"
+#include "xfs_types.h"
+#include "xfs_inum.h"
+#include "xfs_ag.h"
+#include "xfs_sb.h"
+#include "xfs_log.h"
+#include "xfs_trans.h"
+#include "xfs_dir.h"
+#include "xfs_dmapi.h"
+#include "xfs_mount.h"
+#include "xfs_error.h"
+#include "xfs_log_priv.h"
+#include "xfs_trans_priv.h"
+
+
+/* the checkpoint header and its op header, on top of the ticket overhead */
+#define XLOG_CIL_HDR_BYTES \
+	(sizeof(xfs_trans_header_t) + sizeof(xlog_op_header_t))
+
+#define XLOG_CIL_LV_ALLOC(niovecs, bytes) \
+	(sizeof(xfs_log_vec_t) + (niovecs) * sizeof(xfs_log_iovec_t) + (bytes))
+
+/* log space a vector takes: every region gets an op header */
+#define XLOG_CIL_LV_SPACE(lv) \
+	((lv)->lv_bytes + (lv)->lv_niovecs * (int)sizeof(xlog_op_header_t))
+
+STATIC void	xlog_cil_committed(xfs_cil_ctx_t *ctx, int abortflag);
+
+
+/*
+ * Allocate a checkpoint context.  Its ticket starts out without grant
+ * space; the first transaction committed into the context donates the
+ * room for the start and commit records and the checkpoint header.
+ */
+STATIC xfs_cil_ctx_t *
+xlog_cil_ctx_alloc(
+	xlog_t		*log)
+{
+	xfs_cil_ctx_t	*ctx;
+	xlog_ticket_t	*tic;
+
+	ctx = (xfs_cil_ctx_t *)kmem_zalloc(sizeof(xfs_cil_ctx_t), KM_SLEEP);
+	INIT_LIST_HEAD(&ctx->cc_items);
+	INIT_LIST_HEAD(&ctx->cc_trans);
+
+	tic = xlog_ticket_get(log, XLOG_CIL_HDR_BYTES, 1, XFS_TRANSACTION, 0);
+	ctx->cc_res = tic->t_unit_res;
+	tic->t_unit_res = tic->t_curr_res = 0;
+	ctx->cc_ticket = tic;
+	ctx->cc_headers = 1;
+	return ctx;
+}
+
+/*
+ * Free a context nothing was committed into.
+ */
+STATIC void
+xlog_cil_ctx_free(
+	xlog_t		*log,
+	xfs_cil_ctx_t	*ctx)
+{
+	ASSERT(list_empty(&ctx->cc_trans));
+	ASSERT(ctx->cc_ticket->t_curr_res == 0);
+	xlog_state_put_ticket(log, ctx->cc_ticket);
+	kmem_free(ctx, sizeof(xfs_cil_ctx_t));
+}
+
+void
+xlog_cil_init(
+	xlog_t		*log)
+{
+	xfs_cil_t	*cil;
+
+	cil = (xfs_cil_t *)kmem_zalloc(sizeof(xfs_cil_t), KM_SLEEP);
+	mrinit(&cil->xc_ctx_lock, "xfscil");
+	spinlock_init(&cil->xc_lock, "xfscil");
+	initnsema(&cil->xc_push_sema, 1, "xfscilpush");
+	cil->xc_ctx = xlog_cil_ctx_alloc(log);
+	log->l_cilp = cil;
+}
+
+void
+xlog_cil_destroy(
+	xlog_t		*log)
+{
+	xfs_cil_t	*cil = log->l_cilp;
+
+	xlog_cil_ctx_free(log, cil->xc_ctx);
+	freesema(&cil->xc_push_sema);
+	spinlock_destroy(&cil->xc_lock);
+	mrfree(&cil->xc_ctx_lock);
+	kmem_free(cil, sizeof(xfs_cil_t));
+	log->l_cilp = NULL;
+}
+
+/*
+ * Copy the regions an item formatted into a single allocation, so the
+ * item can be changed again as soon as the transaction unlocks it.
+ */
+STATIC xfs_log_vec_t *
+xlog_cil_copy_vecs(
+	xfs_log_iovec_t	*vecp,
+	int		niovecs)
+{
+	xfs_log_vec_t	*lv;
+	xfs_caddr_t	ptr;
+	int		bytes = 0;
+	int		i;
+
+	for (i = 0; i < niovecs; i++)
+		bytes += vecp[i].i_len;
+
+	lv = (xfs_log_vec_t *)kmem_alloc(XLOG_CIL_LV_ALLOC(niovecs, bytes),
+					 KM_SLEEP);
+	lv->lv_next = NULL;
+	lv->lv_niovecs = niovecs;
+	lv->lv_bytes = bytes;
+	lv->lv_iovecp = (xfs_log_iovec_t *)&lv[1];
+
+	ptr = (xfs_caddr_t)&lv->lv_iovecp[niovecs];
+	for (i = 0; i < niovecs; i++) {
+		ASSERT(vecp[i].i_len % sizeof(__int32_t) == 0);
+		memcpy(ptr, vecp[i].i_addr, vecp[i].i_len);
+		lv->lv_iovecp[i].i_addr = ptr;
+		lv->lv_iovecp[i].i_len = vecp[i].i_len;
+		ptr += vecp[i].i_len;
+	}
+	return lv;
+}
+
+STATIC void
+xlog_cil_free_vecs(
+	xfs_log_vec_t	*lv)
+{
+	xfs_log_vec_t	*next;
+
+	for (; lv != NULL; lv = next) {
+		next = lv->lv_next;
+		kmem_free(lv, XLOG_CIL_LV_ALLOC(lv->lv_niovecs, lv->lv_bytes));
+	}
+}
+
+/*
+ * Commit a transaction into the CIL instead of writing it to the log.
+ * log_vector is what xfs_trans_fill_vecs() built; entry 0 is the
+ * transaction header, which the checkpoint replaces with its own.
+ *
+ * On success the CIL is left held shared, so the checkpoint cannot be
+ * written before the caller has unlocked the items and stamped them
+ * with *commit_lsn.  xfs_log_commit_cil_done() drops it.  From then on
+ * the transaction belongs to the CIL.  Fails only before anything was
+ * done, so the caller can still back the transaction out.
+ */
+int
+xfs_log_commit_cil(
+	xfs_mount_t		*mp,
+	xfs_trans_t		*tp,
+	xfs_log_iovec_t		*log_vector,
+	xfs_lsn_t		*commit_lsn,
+	uint			flags)
+{
+	xlog_t			*log = mp->m_log;
+	xfs_cil_t		*cil = log->l_cilp;
+	xfs_cil_ctx_t		*ctx;
+	xlog_ticket_t		*tic = (xlog_ticket_t *)tp->t_ticket;
+	xfs_log_item_desc_t	*lidp;
+	xfs_log_item_t		*lip;
+	xfs_log_iovec_t		*vecp;
+	xfs_log_vec_t		*lv;
+	xfs_log_vec_t		*new_lv = NULL;
+	xfs_log_vec_t		**new_tail = &new_lv;
+	xfs_log_vec_t		*old_lv = NULL;
+	int			diff = 0;
+	int			steal = 0;
+	int			headers;
+	SPLDECL(s);
+
+	if (XFS_FORCED_SHUTDOWN(mp))
+		return XFS_ERROR(EIO);
+
+	/*
+	 * Take the copies before locking anything, in the same order as
+	 * the descriptors are walked again below.
+	 */
+	vecp = log_vector + 1;		/* pointer arithmetic */
+	for (lidp = xfs_trans_first_item(tp);
+	     lidp != NULL;
+	     lidp = xfs_trans_next_item(tp, lidp)) {
+		if (!(lidp->lid_flags & XFS_LID_DIRTY) || !lidp->lid_size)
+			continue;
+		*new_tail = xlog_cil_copy_vecs(vecp, lidp->lid_size);
+		new_tail = &(*new_tail)->lv_next;
+		vecp += lidp->lid_size;		/* pointer arithmetic */
+	}
+
+	mraccess(&cil->xc_ctx_lock);
+	ctx = cil->xc_ctx;
+
+	s = mutex_spinlock(&cil->xc_lock);
+	for (lidp = xfs_trans_first_item(tp);
+	     lidp != NULL;
+	     lidp = xfs_trans_next_item(tp, lidp)) {
+		if (!(lidp->lid_flags & XFS_LID_DIRTY) || !lidp->lid_size)
+			continue;
+		lip = lidp->lid_item;
+		lv = new_lv;
+		new_lv = lv->lv_next;
+		lv->lv_next = NULL;
+
+		/*
+		 * An item logged again only has its copy replaced, and moves
+		 * to the end so the checkpoint keeps the order of the last
+		 * changes.
+		 */
+		diff += XLOG_CIL_LV_SPACE(lv);
+		if (lip->li_lv) {
+			diff -= XLOG_CIL_LV_SPACE(lip->li_lv);
+			lip->li_lv->lv_next = old_lv;
+			old_lv = lip->li_lv;
+			list_move_tail(&lip->li_cil, &ctx->cc_items);
+		} else {
+			list_add_tail(&lip->li_cil, &ctx->cc_items);
+			ctx->cc_nitems++;
+		}
+		lip->li_lv = lv;
+	}
+	ASSERT(new_lv == NULL);
+
+	/*
+	 * Move the log space the checkpoint will need for these changes
+	 * from the transaction's ticket to the checkpoint's.  Space freed by
+	 * a smaller copy stays with the checkpoint.
+	 */
+	if (list_empty(&ctx->cc_trans))
+		steal += ctx->cc_res;
+	if (diff > 0)
+		steal += diff;
+	ctx->cc_space += diff;
+	headers = ctx->cc_space / (log->l_iclog_size - log->l_iclog_hsize) + 2;
+	if (headers > ctx->cc_headers) {
+		steal += (headers - ctx->cc_headers) *
+			 (log->l_iclog_hsize + sizeof(xlog_op_header_t));
+		ctx->cc_headers = headers;
+	}
+	if (steal > tic->t_curr_res)
+		steal = tic->t_curr_res;
+	tic->t_curr_res -= steal;
+	ctx->cc_ticket->t_curr_res += steal;
+	ctx->cc_ticket->t_unit_res += steal;
+
+	list_add_tail(&tp->t_cil, &ctx->cc_trans);
+	mutex_spinunlock(&cil->xc_lock, s);
+
+	xlog_cil_free_vecs(old_lv);
+
+	/*
+	 * Give back what is left of the reservation.  Nothing was written
+	 * with the ticket, so no commit record goes out.  A shutdown
+	 * after this point is left to the push, which aborts the
+	 * checkpoint.
+	 */
+	xfs_log_done(mp, tp->t_ticket, NULL, flags);
+
+	/*
+	 * The lsn an item is stamped with only has to order commits and be
+	 * nonzero; forces under delaylog always write the whole CIL.
+	 */
+	s = LOG_LOCK(log);
+	ASSIGN_ANY_LSN_HOST(*commit_lsn, log->l_curr_cycle, log->l_curr_block);
+	LOG_UNLOCK(log, s);
+
+	return 0;
+}
+
+/*
+ * The items of the transaction committed by xfs_log_commit_cil() are
+ * unlocked, let checkpoints be written again.  Push the CIL here if it
+ * got big, so a checkpoint never takes up too much of the log.
+ */
+void
+xfs_log_commit_cil_done(
+	xfs_mount_t	*mp)
+{
+	xlog_t		*log = mp->m_log;
+	xfs_cil_t	*cil = log->l_cilp;
+	int		push;
+
+	push = cil->xc_ctx->cc_space > XLOG_CIL_SPACE_LIMIT(log);
+	mrunlock(&cil->xc_ctx_lock);
+
+	if (push)
+		xlog_cil_push(log);
+}
+
+/*
+ * Write the current context to the log as one transaction and start a
+ * new one.  Returns once the checkpoint is in the iclogs, its commit
+ * record included, so a log force that follows covers it.
+ *
+ * xc_push_sema keeps the commit records of the checkpoints in the order
+ * the contexts were switched, and makes a caller that finds the CIL
+ * empty wait for a push still writing to the iclogs.
+ */
+void
+xlog_cil_push(
+	xlog_t		*log)
+{
+	xfs_mount_t	*mp = log->l_mp;
+	xfs_cil_t	*cil = log->l_cilp;
+	xfs_cil_ctx_t	*ctx;
+	xfs_cil_ctx_t	*new_ctx;
+	xfs_log_item_t	*lip;
+	xfs_log_vec_t	*lv;
+	xfs_log_vec_t	*lv_chain = NULL;
+	xfs_log_vec_t	**lv_tail = &lv_chain;
+	xfs_log_iovec_t	lhdr;
+	void		*commit_iclog;
+	xfs_lsn_t	lsn;
+	int		error;
+	int		empty;
+	SPLDECL(s);
+
+	/* allocate up front, reclaim may force the log itself */
+	new_ctx = xlog_cil_ctx_alloc(log);
+
+	psema(&cil->xc_push_sema, PINOD);
+	s = mutex_spinlock(&cil->xc_lock);
+	empty = list_empty(&cil->xc_ctx->cc_trans);
+	mutex_spinunlock(&cil->xc_lock, s);
+	if (empty) {
+		vsema(&cil->xc_push_sema);
+		xlog_cil_ctx_free(log, new_ctx);
+		return;
+	}
+
+	/*
+	 * Wait for the committers of the old context to drain and switch
+	 * to the new one.  Taking the copies off the items lets them be
+	 * committed into the new context while this one is written.
+	 */
+	mrupdate(&cil->xc_ctx_lock);
+	ctx = cil->xc_ctx;
+	cil->xc_ctx = new_ctx;
+	while (!list_empty(&ctx->cc_items)) {
+		lip = list_entry(ctx->cc_items.next, xfs_log_item_t, li_cil);
+		list_del_init(&lip->li_cil);
+		*lv_tail = lip->li_lv;
+		lv_tail = &lip->li_lv->lv_next;
+		lip->li_lv = NULL;
+	}
+	mrunlock(&cil->xc_ctx_lock);
+
+	ctx->cc_header.th_magic = XFS_TRANS_HEADER_MAGIC;
+	ctx->cc_header.th_type = XFS_TRANS_CHECKPOINT;
+	ctx->cc_header.th_num_items = ctx->cc_nitems;
+	lhdr.i_addr = (xfs_caddr_t)&ctx->cc_header;
+	lhdr.i_len = sizeof(xfs_trans_header_t);
+
+	error = xfs_log_write(mp, &lhdr, 1, ctx->cc_ticket, &ctx->cc_lsn);
+	for (lv = lv_chain; lv != NULL && !error; lv = lv->lv_next)
+		error = xfs_log_write(mp, lv->lv_iovecp, lv->lv_niovecs,
+				      ctx->cc_ticket, &lsn);
+
+	/*
+	 * xfs_log_done() sees the shutdown a write error causes and skips
+	 * the commit record.
+	 */
+	lsn = xfs_log_done(mp, ctx->cc_ticket, &commit_iclog, 0);
+	if (lsn == -1) {
+		xlog_cil_committed(ctx, XFS_LI_ABORTED);
+		goto out;
+	}
+
+	/*
+	 * Same as for a single transaction: hook the callback to the
+	 * iclog holding the commit record, then let it go to disk.  The
+	 * context may be gone once the iclog is released.
+	 */
+	ctx->cc_logcb.cb_func = (void(*)(void *, int))xlog_cil_committed;
+	ctx->cc_logcb.cb_arg = ctx;
+	if (xfs_log_notify(mp, commit_iclog, &ctx->cc_logcb))
+		xlog_cil_committed(ctx, XFS_LI_ABORTED);
+	xfs_log_release_iclog(mp, commit_iclog);
+
+out:
+	vsema(&cil->xc_push_sema);
+	xlog_cil_free_vecs(lv_chain);
+}
+
+/*
+ * The commit record of a checkpoint is on disk, or the log died.  Finish
+ * the transactions in it in commit order, as if each had been written
+ * on its own at the start of the checkpoint.
+ */
+STATIC void
+xlog_cil_committed(
+	xfs_cil_ctx_t	*ctx,
+	int		abortflag)
+{
+	xfs_trans_t	*tp;
+
+	while (!list_empty(&ctx->cc_trans)) {
+		tp = list_entry(ctx->cc_trans.next, xfs_trans_t, t_cil);
+		list_del(&tp->t_cil);
+		tp->t_lsn = ctx->cc_lsn;
+		xfs_trans_committed(tp, abortflag);
+	}
+	kmem_free(ctx, sizeof(xfs_cil_ctx_t));
+}
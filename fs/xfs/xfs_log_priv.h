@@ -466,6 +466,54 @@ typedef struct xlog_in_core {
 #define ic_datap	hic_fields.ic_datap
 #define ic_header	hic_data->hic_header
 
+/*
+ * Delayed logging.
+ *
+ * With the delaylog mount option transactions are not written to the
+ * iclogs when they commit.  Instead a copy of what each dirty item
+ * formatted is attached to the item and the item is put on the
+ * committed item list (CIL) of the current checkpoint context.  An item
+ * that is logged again before the checkpoint is written only has its
+ * copy replaced, so it is written once however often it changed.
+ *
+ * A push writes the whole context to the log as one ordinary
+ * transaction of type XFS_TRANS_CHECKPOINT and hands the committed
+ * transactions to xfs_trans_committed() when its commit record is on
+ * disk.  Log space is moved from each committing transaction's ticket to
+ * the ticket of the context, so the grant heads always cover everything
+ * the CIL will write.
+ */
+typedef struct xfs_log_vec {
+	struct xfs_log_vec	*lv_next;	/* next vector in a push */
+	int			lv_niovecs;	/* number of iovecs */
+	int			lv_bytes;	/* data bytes in the iovecs */
+	xfs_log_iovec_t		*lv_iovecp;	/* iovecs, data follows them */
+} xfs_log_vec_t;
+
+typedef struct xfs_cil_ctx {
+	struct list_head	cc_items;	/* dirty items, in log order */
+	struct list_head	cc_trans;	/* committed transactions */
+	xlog_ticket_t		*cc_ticket;	/* checkpoint reservation */
+	int			cc_res;		/* fixed cost of a checkpoint */
+	int			cc_space;	/* bytes the items will use */
+	int			cc_headers;	/* record headers reserved */
+	int			cc_nitems;	/* items on cc_items */
+	xfs_lsn_t		cc_lsn;		/* start of the checkpoint */
+	xfs_trans_header_t	cc_header;	/* header for in-log trans */
+	xfs_log_callback_t	cc_logcb;	/* checkpoint commit callback */
+} xfs_cil_ctx_t;
+
+typedef struct xfs_cil {
+	mrlock_t		xc_ctx_lock;	/* committers shared, push
+						 * exclusive */
+	lock_t			xc_lock;	/* protects the current ctx */
+	sema_t			xc_push_sema;	/* orders checkpoints in log */
+	xfs_cil_ctx_t		*xc_ctx;	/* context being filled */
+} xfs_cil_t;
+
+/* push the CIL from the committing thread once it holds this much */
+#define XLOG_CIL_SPACE_LIMIT(log)	((log)->l_logsize >> 3)
+
 /*
  * The reservation head lsn is not made up of a cycle number and block number.
  * Instead, it uses a cycle number and byte number.  Logs don't expect to
@@ -530,6 +578,7 @@ typedef struct log {
 	uint			l_sectbb_log;   /* log2 of sector size in BBs */
 	uint			l_sectbb_mask;  /* sector size (in BBs)
 						 * alignment mask */
+	xfs_cil_t		*l_cilp;	/* delayed logging, or NULL */
 } xlog_t;
 
 
@@ -545,6 +594,14 @@ extern int	 xlog_recover_finish(xlog_t *log, int mfsi_flags);
 extern void	 xlog_pack_data(xlog_t *log, xlog_in_core_t *iclog, int);
 extern void	 xlog_recover_process_iunlinks(xlog_t *log);
 
+extern xlog_ticket_t *xlog_ticket_get(xlog_t *log, int unit_bytes,
+				      int count, char clientid, uint flags);
+extern void	 xlog_state_put_ticket(xlog_t *log, xlog_ticket_t *tic);
+
+extern void	 xlog_cil_init(xlog_t *log);
+extern void	 xlog_cil_destroy(xlog_t *log);
+extern void	 xlog_cil_push(xlog_t *log);
+
 extern struct xfs_buf *xlog_get_bp(xlog_t *, int);
 extern void	 xlog_put_bp(struct xfs_buf *);
 extern int	 xlog_bread(xlog_t *, xfs_daddr_t, int, struct xfs_buf *);
@@ -420,6 +420,7 @@ typedef struct xfs_mount {
 						 * allocation */
 #define XFS_MOUNT_IHASHSIZE	0x00100000	/* inode hash table size */
 #define XFS_MOUNT_DIRSYNC	0x00200000	/* synchronous directory ops */
+#define XFS_MOUNT_DELAYLOG	0x00400000	/* log changes in checkpoints */
 
 /*
  * Default minimum read and write sizes.
@@ -65,7 +65,6 @@ STATIC void	xfs_trans_apply_sb_deltas(xfs_trans_t *);
 STATIC uint	xfs_trans_count_vecs(xfs_trans_t *);
 STATIC void	xfs_trans_fill_vecs(xfs_trans_t *, xfs_log_iovec_t *);
 STATIC void	xfs_trans_uncommit(xfs_trans_t *, uint);
-STATIC void	xfs_trans_committed(xfs_trans_t *, int);
 STATIC void	xfs_trans_chunk_committed(xfs_log_item_chunk_t *, xfs_lsn_t, int);
 STATIC void	xfs_trans_free(xfs_trans_t *);
 
@@ -790,6 +789,9 @@ shut_us_down:
 	 */
 	xfs_trans_fill_vecs(tp, log_vector);
 
+	if (mp->m_flags & XFS_MOUNT_DELAYLOG)
+		goto delaylog;
+
 	/*
 	 * Ignore errors here. xfs_log_done would do the right thing.
 	 * We need to put the ticket, etc. away.
@@ -921,6 +923,46 @@ shut_us_down:
 	}
 
 	return (error);
+
+delaylog:
+	/*
+	 * Hand the items to the CIL.  They stay pinned until the
+	 * checkpoint that writes them is on disk, and the CIL calls
+	 * xfs_trans_committed() for us then.  The CIL is held shared
+	 * until the items are unlocked, so no checkpoint can be
+	 * written between copying an item and stamping it with its lsn.
+	 */
+	error = xfs_log_commit_cil(mp, tp, log_vector, &commit_lsn, log_flags);
+	if (nvec > XFS_TRANS_LOGVEC_COUNT) {
+		kmem_free(log_vector, nvec * sizeof(xfs_log_iovec_t));
+	}
+	if (error) {
+		if (commit_lsn_p)
+			*commit_lsn_p = -1;
+		PFLAGS_RESTORE_FSTRANS(&tp->t_pflags);
+		xfs_trans_uncommit(tp, flags|XFS_TRANS_ABORT);
+		return XFS_ERROR(EIO);
+	}
+
+	tp->t_commit_lsn = commit_lsn;
+	if (commit_lsn_p)
+		*commit_lsn_p = commit_lsn;
+	xfs_trans_unreserve_and_mod_sb(tp);
+	sync = tp->t_flags & XFS_TRANS_SYNC;
+	PFLAGS_RESTORE_FSTRANS(&tp->t_pflags);
+	xfs_trans_unlock_items(tp, commit_lsn);
+
+	/* tp belongs to the CIL from here on */
+	xfs_log_commit_cil_done(mp);
+
+	if (sync) {
+		error = xfs_log_force(mp, commit_lsn,
+				      XFS_LOG_FORCE | XFS_LOG_SYNC);
+		XFS_STATS_INC(xs_trans_sync);
+	} else {
+		XFS_STATS_INC(xs_trans_async);
+	}
+	return error;
 }
 
 
@@ -1156,7 +1198,7 @@ xfs_trans_free(
  * Call xfs_trans_chunk_committed() to process the items in
  * each chunk.
  */
-STATIC void
+void
 xfs_trans_committed(
 	xfs_trans_t	*tp,
 	int		abortflag)
@@ -112,6 +112,7 @@ typedef struct xfs_trans_header {
 #define	XFS_TRANS_GROWFSRT_ZERO		38
 #define	XFS_TRANS_GROWFSRT_FREE		39
 #define	XFS_TRANS_SWAPEXT		40
+#define	XFS_TRANS_CHECKPOINT		41
 /* new transaction types need to be reflected in xfs_logprint(8) */
 
 
@@ -160,6 +161,8 @@ typedef struct xfs_log_item {
 							/* buffer item iodone */
 							/* callback func */
 	struct xfs_item_ops		*li_ops;	/* function list */
+	struct xfs_log_vec		*li_lv;		/* copy in the CIL */
+	struct list_head		li_cil;		/* CIL pointers */
 } xfs_log_item_t;
 
 #define	XFS_LI_IN_AIL	0x1
@@ -382,6 +385,7 @@ typedef struct xfs_trans {
 	xfs_lsn_t		t_commit_lsn;	/* log seq num of end of
 						 * transaction. */
 	struct xfs_mount	*t_mountp;	/* ptr to fs mount struct */
+	struct list_head	t_cil;		/* checkpoint list pointers */
 	struct xfs_dquot_acct   *t_dqinfo;	/* accting info for dquots */
 	xfs_trans_callback_t	t_callback;	/* transaction callback */
 	void			*t_callarg;	/* callback arg */
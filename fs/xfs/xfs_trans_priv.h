@@ -69,5 +69,10 @@ struct xfs_log_item	*xfs_trans_first_ail(struct xfs_mount *, int *);
 struct xfs_log_item	*xfs_trans_next_ail(struct xfs_mount *,
 				     struct xfs_log_item *, int *, int *);
 
+/*
+ * From xfs_trans.c, for checkpoints of the CIL
+ */
+void			xfs_trans_committed(struct xfs_trans *, int);
+
 
 #endif	/* __XFS_TRANS_PRIV_H__ */
@@ -307,6 +307,9 @@ xfs_start_flags(
 	if (ap->flags & XFSMNT_DIRSYNC)
 		mp->m_flags |= XFS_MOUNT_DIRSYNC;
 
+	if (ap->flags & XFSMNT_DELAYLOG)
+		mp->m_flags |= XFS_MOUNT_DELAYLOG;
+
 	/*
 	 * no recovery flag requires a read-only mount
 	 */
@@ -1656,6 +1659,8 @@ xfs_vget(
 #define MNTOPT_64BITINODE   "inode64"	/* inodes can be allocated anywhere */
 #define MNTOPT_IKEEP	"ikeep"		/* do not free empty inode clusters */
 #define MNTOPT_NOIKEEP	"noikeep"	/* free empty inode clusters */
+#define MNTOPT_DELAYLOG	"delaylog"	/* aggregate changes in memory */
+#define MNTOPT_NODELAYLOG "nodelaylog"	/* log every transaction */
 
 
 int
@@ -1792,6 +1797,10 @@ xfs_parseargs(
 			args->flags &= ~XFSMNT_IDELETE;
 		} else if (!strcmp(this_char, MNTOPT_NOIKEEP)) {
 			args->flags |= XFSMNT_IDELETE;
+		} else if (!strcmp(this_char, MNTOPT_DELAYLOG)) {
+			args->flags |= XFSMNT_DELAYLOG;
+		} else if (!strcmp(this_char, MNTOPT_NODELAYLOG)) {
+			args->flags &= ~XFSMNT_DELAYLOG;
 		} else if (!strcmp(this_char, "osyncisdsync")) {
 			/* no-op, this is now the default */
 printk("XFS: osyncisdsync is now the default, option is deprecated.\n");
@@ -1863,6 +1872,7 @@ xfs_showargs(
 		{ XFS_MOUNT_OSYNCISOSYNC,	"," MNTOPT_OSYNCISOSYNC },
 		{ XFS_MOUNT_NOLOGFLUSH,		"," MNTOPT_NOLOGFLUSH },
 		{ XFS_MOUNT_IDELETE,		"," MNTOPT_NOIKEEP },
+		{ XFS_MOUNT_DELAYLOG,		"," MNTOPT_DELAYLOG },
 		{ 0, NULL }
 	};
 	struct proc_xfs_info	*xfs_infop;
@@ -1913,8 +1923,12 @@ xfs_freeze(
 {
 	xfs_mount_t	*mp = XFS_BHVTOM(bdp);
 
-	while (atomic_read(&mp->m_active_trans) > 0)
+	while (atomic_read(&mp->m_active_trans) > 0) {
+		/* committed transactions live until their checkpoint is out */
+		if (mp->m_flags & XFS_MOUNT_DELAYLOG)
+			xfs_log_force(mp, (xfs_lsn_t)0, XFS_LOG_FORCE);
 		delay(100);
+	}
 
 	/* Push the superblock and write an unmount record */
 	xfs_log_unmount_write(mp);
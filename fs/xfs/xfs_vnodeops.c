@@ -3709,7 +3709,12 @@ xfs_inode_flush(
 			sync_lsn = log->l_last_sync_lsn;
 			GRANT_UNLOCK(log, s);
 
-			if ((XFS_LSN_CMP(iip->ili_last_lsn, sync_lsn) <= 0))
+			/*
+			 * Under delaylog ili_last_lsn only orders commits,
+			 * the inode may still be waiting in the CIL.
+			 */
+			if (!(mp->m_flags & XFS_MOUNT_DELAYLOG) &&
+			    (XFS_LSN_CMP(iip->ili_last_lsn, sync_lsn) <= 0))
 				return 0;
 
 			if (flags & FLUSH_SYNC)
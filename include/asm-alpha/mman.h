@@ -42,6 +42,7 @@
 #define MADV_WILLNEED	3		/* will need these pages */
 #define	MADV_SPACEAVAIL	5		/* ensure resources are available */
 #define MADV_DONTNEED	6		/* don't need these pages */
+#define MADV_FREE	8		/* free pages only under memory pressure */
 
 /* compatibility flags */
 #define MAP_ANON	MAP_ANONYMOUS
@@ -35,6 +35,7 @@
 #define MADV_SEQUENTIAL	0x2		/* read-ahead aggressively */
 #define MADV_WILLNEED	0x3		/* pre-fault pages */
 #define MADV_DONTNEED	0x4		/* discard these pages */
+#define MADV_FREE	0x8		/* free pages only under memory pressure */
 
 /* compatibility flags */
 #define MAP_ANON	MAP_ANONYMOUS
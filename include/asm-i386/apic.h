@@ -123,4 +123,12 @@ static inline void lapic_shutdown(void) { }
 
 #endif /* !CONFIG_X86_LOCAL_APIC */
 
+#ifdef CONFIG_NO_IDLE_HZ
+extern void stop_hz_timer(void);
+extern void start_hz_timer(void);
+#else
+static inline void stop_hz_timer(void) { }
+static inline void start_hz_timer(void) { }
+#endif
+
 #endif /* __ASM_APIC_H */
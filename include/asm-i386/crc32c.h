@@ -0,0 +1,38 @@
+#ifndef __I386_CRC32C_H
+#define __I386_CRC32C_H
+
+/*
+ * CRC32C with the crc32 instruction of SSE4.2, for lib/libcrc32c.c.
+ * It only uses integer registers, so unlike the other SSE code it
+ * needs no kernel_fpu_begin() and is fine in interrupts.
+ *
+ * The instructions are spelled out for older assemblers:
+ *	crc32b %cl, %esi	f2 0f 38 f0 f1
+ *	crc32l %ecx, %esi	f2 0f 38 f1 f1
+ */
+
+#include <linux/types.h>
+#include <asm/cpufeature.h>
+
+#define crc32c_hw_available()	cpu_has_xmm4_2
+
+#define __crc32c_byte(crc, x)						\
+	__asm__(".byte 0xf2, 0x0f, 0x38, 0xf0, 0xf1"			\
+		: "=S" (crc) : "0" (crc), "c" (x))
+
+#define __crc32c_long(crc, x)						\
+	__asm__(".byte 0xf2, 0x0f, 0x38, 0xf1, 0xf1"			\
+		: "=S" (crc) : "0" (crc), "c" (x))
+
+static inline u32 crc32c_le_hw(u32 crc, unsigned char const *p, size_t len)
+{
+	for (; len && ((unsigned long)p & 3); len--)
+		__crc32c_byte(crc, *p++);
+	for (; len >= 4; len -= 4, p += 4)
+		__crc32c_long(crc, *(const u32 *)p);
+	for (; len; len--)
+		__crc32c_byte(crc, *p++);
+	return crc;
+}
+
+#endif
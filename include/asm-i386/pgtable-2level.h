@@ -19,6 +19,12 @@
 #define set_pmd(pmdptr, pmdval) (*(pmdptr) = (pmdval))
 
 #define ptep_get_and_clear(mm,addr,xp)	__pte(xchg(&(xp)->pte_low, 0))
+#ifdef CONFIG_X86_CMPXCHG
+#define __HAVE_ARCH_PTEP_CMPXCHG
+#define ptep_cmpxchg(mm,addr,xp,oldval,newval) \
+	(cmpxchg(&(xp)->pte_low, (oldval).pte_low, (newval).pte_low) == \
+	 (oldval).pte_low)
+#endif
 #define pte_same(a, b)		((a).pte_low == (b).pte_low)
 #define pte_page(x)		pfn_to_page(pte_pfn(x))
 #define pte_none(x)		(!(x).pte_low)
@@ -107,6 +107,24 @@ static inline int pte_same(pte_t a, pte_t b)
 	return a.pte_low == b.pte_low && a.pte_high == b.pte_high;
 }
 
+/*
+ * Replace *ptep by newval only if it still holds oldval, returning
+ * nonzero if so.  Used to fill a pte without holding its lock.
+ */
+#define __HAVE_ARCH_PTEP_CMPXCHG
+static inline int ptep_cmpxchg(struct mm_struct *mm, unsigned long addr,
+			       pte_t *ptep, pte_t oldval, pte_t newval)
+{
+	unsigned long long prev = pte_val(oldval);
+
+	__asm__ __volatile__(
+		"lock cmpxchg8b %1"
+		: "+A" (prev), "+m" (*ptep)
+		: "b" (newval.pte_low), "c" (newval.pte_high)
+		: "memory");
+	return prev == pte_val(oldval);
+}
+
 #define pte_page(x)	pfn_to_page(pte_pfn(x))
 
 static inline int pte_none(pte_t pte)
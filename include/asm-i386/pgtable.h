@@ -206,7 +206,17 @@ extern unsigned long pg0[];
 #define pmd_none(x)	(!pmd_val(x))
 #define pmd_present(x)	(pmd_val(x) & _PAGE_PRESENT)
 #define pmd_clear(xp)	do { set_pmd(xp, __pmd(0)); } while (0)
-#define	pmd_bad(x)	((pmd_val(x) & (~PAGE_MASK & ~_PAGE_USER)) != _KERNPG_TABLE)
+#define	pmd_bad(x)	((pmd_val(x) & (~PAGE_MASK & ~(_PAGE_USER | _PAGE_RW))) != \
+			 (_KERNPG_TABLE & ~_PAGE_RW))
+
+/*
+ * A page table shared copy-on-write between mms (see mm/memory.c) is
+ * write protected in their pmds, whatever its ptes say.
+ */
+#define pmd_write(x)	(pmd_val(x) & _PAGE_RW)
+#define pmd_wrprotect(x)	__pmd(pmd_val(x) & ~_PAGE_RW)
+#define pmd_mkwrite(x)	__pmd(pmd_val(x) | _PAGE_RW)
+#define __HAVE_ARCH_PMD_WRPROTECT
 
 
 #define pages_to_mb(x) ((x) >> (20-PAGE_SHIFT))
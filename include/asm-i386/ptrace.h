@@ -64,6 +64,12 @@ extern unsigned long profile_pc(struct pt_regs *regs);
 #else
 #define profile_pc(regs) instruction_pointer(regs)
 #endif
+#define ARCH_HAS_PROFILE_CALLER
+#ifdef CONFIG_FRAME_POINTER
+extern unsigned long profile_caller(struct pt_regs *regs);
+#else
+#define profile_caller(regs) 0UL
+#endif
 #endif
 
 #endif
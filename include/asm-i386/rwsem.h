@@ -5,8 +5,9 @@
  * Derived from asm-i386/semaphore.h
  *
  *
- * The MSW of the count is the negated number of active writers and waiting
- * lockers, and the LSW is the total number of active locks
+ * The MSW of the count is the negated number of active writers, plus one
+ * more while there are lockers on the queue, and the LSW is the total number
+ * of active locks, including lockers just trying for one
  *
  * The lock count is initialized to 0 (no active and no waiting lockers).
  *
@@ -16,17 +17,14 @@
  * if there are writers (and maybe) readers waiting (in which case it goes to
  * sleep).
  *
- * The value of WAITING_BIAS supports up to 32766 waiting processes. This can
- * be extended to 65534 by manually checking the whole MSW rather than relying
- * on the S flag.
- *
  * The value of ACTIVE_BIAS supports up to 65535 active processes.
  *
- * This should be totally fair - if anything is waiting, a process that wants a
- * lock will go to the back of the queue. When the currently active lock is
- * released, if there's a writer at the front of the queue, then that and only
- * that will be woken up; if there's a bunch of consequtive readers at the
- * front, then they'll all be woken up, but no other readers will be.
+ * If anything is waiting, a reader goes to the back of the queue.  A writer
+ * may take the lock without queueing whenever no lock is active, see
+ * lib/rwsem.c: when the currently active lock is released, a writer at the
+ * front of the queue is only woken to try for it, so that one which is
+ * running gets it first.  If there's a bunch of consecutive readers at the
+ * front, then they'll all be granted the lock and woken up.
  */
 
 #ifndef _I386_RWSEM_H
@@ -61,11 +59,22 @@ struct rw_semaphore {
 #define RWSEM_ACTIVE_WRITE_BIAS		(RWSEM_WAITING_BIAS + RWSEM_ACTIVE_BIAS)
 	spinlock_t		wait_lock;
 	struct list_head	wait_list;
+#ifdef RWSEM_SPIN_ON_OWNER
+	struct thread_info	*owner;		/* the writer, or NULL */
+#endif
 #if RWSEM_DEBUG
 	int			debug;
 #endif
 };
 
+#ifdef RWSEM_SPIN_ON_OWNER
+#define __RWSEM_OWNER_INIT	, NULL
+#define rwsem_set_owner(sem)	((sem)->owner = current_thread_info())
+#define rwsem_clear_owner(sem)	((sem)->owner = NULL)
+#else
+#define __RWSEM_OWNER_INIT	/* */
+#endif
+
 /*
  * initialisation
  */
@@ -77,7 +86,7 @@ struct rw_semaphore {
 
 #define __RWSEM_INITIALIZER(name) \
 { RWSEM_UNLOCKED_VALUE, SPIN_LOCK_UNLOCKED, LIST_HEAD_INIT((name).wait_list) \
-	__RWSEM_DEBUG_INIT }
+	__RWSEM_OWNER_INIT __RWSEM_DEBUG_INIT }
 
 #define DECLARE_RWSEM(name) \
 	struct rw_semaphore name = __RWSEM_INITIALIZER(name)
@@ -87,6 +96,9 @@ static inline void init_rwsem(struct rw_semaphore *sem)
 	sem->count = RWSEM_UNLOCKED_VALUE;
 	spin_lock_init(&sem->wait_lock);
 	INIT_LIST_HEAD(&sem->wait_list);
+#ifdef RWSEM_SPIN_ON_OWNER
+	sem->owner = NULL;
+#endif
 #if RWSEM_DEBUG
 	sem->debug = 0;
 #endif
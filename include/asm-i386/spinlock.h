@@ -32,15 +32,110 @@ typedef struct {
 #define SPINLOCK_MAGIC_INIT	/* */
 #endif
 
+/*
+ * Simple spin lock operations.  There are two variants, one clears IRQ's
+ * on the local processor, one does not.
+ *
+ * These are ticket locks: the low byte of slock is the ticket now being
+ * served and the next byte the next one to hand out.  A locker takes a
+ * ticket with xadd and spins until it is served, so CPUs get the lock
+ * in the order they asked for it, rather than whichever is nearest to
+ * the cacheline when it is released.  NR_CPUS is at most 255, so a
+ * byte each is enough.
+ */
+
+#ifdef CONFIG_X86_XADD
+
+#define SPIN_LOCK_UNLOCKED (spinlock_t) { 0 SPINLOCK_MAGIC_INIT }
+
+#define spin_lock_init(x)	do { *(x) = SPIN_LOCK_UNLOCKED; } while(0)
+
+static inline int spin_is_locked(spinlock_t *lock)
+{
+	unsigned int tmp = lock->slock;
+
+	return ((tmp >> 8) ^ tmp) & 0xff;
+}
+
+#define spin_unlock_wait(x)	do { barrier(); } while(spin_is_locked(x))
+
+static inline void _raw_spin_lock(spinlock_t *lock)
+{
+	unsigned short inc = 0x0100;
+
+#ifdef CONFIG_DEBUG_SPINLOCK
+	if (unlikely(lock->magic != SPINLOCK_MAGIC)) {
+		printk("eip: %p\n", __builtin_return_address(0));
+		BUG();
+	}
+#endif
+	__asm__ __volatile__(
+		"lock ; xaddw %w0, %1\n"
+		"1:\t"
+		"cmpb %h0, %b0\n\t"
+		"je 2f\n\t"
+		"rep ; nop\n\t"
+		"movb %1, %b0\n\t"
+		"jmp 1b\n"
+		"2:"
+		:"+Q" (inc), "+m" (lock->slock) : : "memory", "cc");
+}
+
+/*
+ * Interrupts cannot be enabled while waiting: with our ticket taken, an
+ * interrupt handler wanting the same lock would wait behind us forever.
+ */
+#define _raw_spin_lock_flags(lock, flags) _raw_spin_lock(lock)
+
+static inline int _raw_spin_trylock(spinlock_t *lock)
+{
+	int tmp;
+	short new;
+
+	__asm__ __volatile__(
+		"movw %2, %w0\n\t"
+		"cmpb %h0, %b0\n\t"
+		"jne 1f\n\t"
+		"movw %w0, %w1\n\t"
+		"incb %h1\n\t"
+		"lock ; cmpxchgw %w1, %2\n\t"
+		"1:"
+		"sete %b1\n\t"
+		"movzbl %b1, %0"
+		:"=&a" (tmp), "=Q" (new), "+m" (lock->slock) : : "memory", "cc");
+	return tmp;
+}
+
+/*
+ * Only the owner writes the low byte, so the increment needs no lock
+ * prefix, except on PPro SMP or with OOSTORE (PPro errata 66, 92).
+ */
+#if !defined(CONFIG_X86_OOSTORE) && !defined(CONFIG_X86_PPRO_FENCE)
+#define SPIN_UNLOCK_PREFIX
+#else
+#define SPIN_UNLOCK_PREFIX	"lock ; "
+#endif
+
+static inline void _raw_spin_unlock(spinlock_t *lock)
+{
+#ifdef CONFIG_DEBUG_SPINLOCK
+	BUG_ON(lock->magic != SPINLOCK_MAGIC);
+	BUG_ON(!spin_is_locked(lock));
+#endif
+	__asm__ __volatile__(
+		SPIN_UNLOCK_PREFIX "incb %0"
+		:"+m" (lock->slock) : : "memory", "cc");
+}
+
+#else /* !CONFIG_X86_XADD */
+
 #define SPIN_LOCK_UNLOCKED (spinlock_t) { 1 SPINLOCK_MAGIC_INIT }
 
 #define spin_lock_init(x)	do { *(x) = SPIN_LOCK_UNLOCKED; } while(0)
 
 /*
- * Simple spin lock operations.  There are two variants, one clears IRQ's
- * on the local processor, one does not.
- *
- * We make no fairness assumptions. They have a cost.
+ * The 386 has no xadd: a byte which is 1 when unlocked, decremented
+ * by the locker.  There are no fairness assumptions here.
  */
 
 #define spin_is_locked(x)	(*(volatile signed char *)(&(x)->slock) <= 0)
@@ -154,6 +249,8 @@ static inline void _raw_spin_lock_flags (spinlock_t *lock, unsigned long flags)
 		:"=m" (lock->slock) : "r" (flags) : "memory");
 }
 
+#endif /* CONFIG_X86_XADD */
+
 /*
  * Read-write spinlocks, allowing multiple readers
  * but only one writer.
@@ -2,6 +2,8 @@
 #define _ASMi386_TIMER_H
 #include <linux/init.h>
 
+struct time_interpolator;
+
 /**
  * struct timer_ops - used to define a timer source
  *
@@ -10,8 +12,10 @@
  *        string as an argument. Returns 0 on success, anything else
  *        on failure.
  * @mark_offset: called by the timer interrupt.
- * @get_offset:  called by gettimeofday(). Returns the number of microseconds
- *               since the last timer interupt.
+ * @interpolator: the counter gettimeofday() can read between timer
+ *                interrupts, registered when the timer is selected.
+ *                The TSC may be registered besides it, the best rated
+ *                of them is used.
  * @monotonic_clock: returns the number of nanoseconds since the init of the
  *                   timer.
  * @delay: delays this many clock cycles.
@@ -19,7 +23,7 @@
 struct timer_opts {
 	char* name;
 	void (*mark_offset)(void);
-	unsigned long (*get_offset)(void);
+	struct time_interpolator *interpolator;
 	unsigned long long (*monotonic_clock)(void);
 	void (*delay)(unsigned long);
 };
@@ -52,6 +56,8 @@ extern struct init_timer_opts timer_cyclone_init;
 #endif
 
 extern unsigned long calibrate_tsc(void);
+extern void tsc_register_interpolator(char *override);
+extern void tsc_unregister_interpolator(void);
 extern void init_cpu_khz(void);
 #ifdef CONFIG_HPET_TIMER
 extern struct init_timer_opts timer_hpet_init;
@@ -294,8 +294,31 @@
 #define __NR_add_key		286
 #define __NR_request_key	287
 #define __NR_keyctl		288
+#define __NR_splice		289
+#define __NR_tee		290
+#define __NR_epoll_ctl_batch	291
+#define __NR_ioprio_set		292
+#define __NR_ioprio_get		293
+#define __NR_dio_register	294
+#define __NR_dio_unregister	295
+#define __NR_getdents_plus	296
+#define __NR_inotify_init	297
+#define __NR_inotify_add_watch	298
+#define __NR_inotify_rm_watch	299
+#define __NR_sync_file_range	300
+#define __NR_fallocate		301
+#define __NR_perfctr_open	302
+#define __NR_spawn		303
+#define __NR_migrate_pages	304
+#define __NR_signalfd		305
+#define __NR_timerfd_create	306
+#define __NR_eventfd		307
+#define __NR_timerfd_settime	308
+#define __NR_timerfd_gettime	309
+#define __NR_mq_timedsendv	310
+#define __NR_mq_timedreceivev	311
 
-#define NR_syscalls 289
+#define NR_syscalls 312
 
 /*
  * user-visible error numbers are in the range -1 - -128: see
@@ -434,6 +457,17 @@ __syscall_return(type,__res); \
  */
 static inline _syscall3(int,execve,const char *,file,char **,argv,char **,envp)
 
+/* execve() returning the error itself instead of setting errno */
+static inline long kernel_execve(const char *file, char **argv, char **envp)
+{
+	long __res;
+	__asm__ volatile ("int $0x80"
+		: "=a" (__res)
+		: "0" (__NR_execve),"b" ((long)(file)),"c" ((long)(argv)),
+		  "d" ((long)(envp)) : "memory");
+	return __res;
+}
+
 asmlinkage int sys_modify_ldt(int func, void __user *ptr, unsigned long bytecount);
 asmlinkage long sys_mmap2(unsigned long addr, unsigned long len,
 			unsigned long prot, unsigned long flags,
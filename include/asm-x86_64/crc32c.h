@@ -0,0 +1,40 @@
+#ifndef __X86_64_CRC32C_H
+#define __X86_64_CRC32C_H
+
+/*
+ * CRC32C with the crc32 instruction of SSE4.2, for lib/libcrc32c.c.
+ * It only uses integer registers, so unlike the other SSE code it
+ * needs no kernel_fpu_begin() and is fine in interrupts.
+ *
+ * The instructions are spelled out for older assemblers:
+ *	crc32b %cl, %esi	f2 0f 38 f0 f1
+ *	crc32q %rcx, %rsi	f2 48 0f 38 f1 f1
+ */
+
+#include <linux/types.h>
+#include <asm/cpufeature.h>
+
+#define crc32c_hw_available()	cpu_has_xmm4_2
+
+#define __crc32c_byte(crc, x)						\
+	__asm__(".byte 0xf2, 0x0f, 0x38, 0xf0, 0xf1"			\
+		: "=S" (crc) : "0" (crc), "c" (x))
+
+#define __crc32c_quad(crc, x)						\
+	__asm__(".byte 0xf2, 0x48, 0x0f, 0x38, 0xf1, 0xf1"		\
+		: "=S" (crc) : "0" (crc), "c" (x))
+
+static inline u32 crc32c_le_hw(u32 seed, unsigned char const *p, size_t len)
+{
+	unsigned long crc = seed;
+
+	for (; len && ((unsigned long)p & 7); len--)
+		__crc32c_byte(crc, *p++);
+	for (; len >= 8; len -= 8, p += 8)
+		__crc32c_quad(crc, *(const unsigned long *)p);
+	for (; len; len--)
+		__crc32c_byte(crc, *p++);
+	return crc;
+}
+
+#endif
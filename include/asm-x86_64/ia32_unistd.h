@@ -294,7 +294,30 @@
 #define __NR_ia32_add_key		286
 #define __NR_ia32_request_key	287
 #define __NR_ia32_keyctl		288
+#define __NR_ia32_splice		289
+#define __NR_ia32_tee		290
+#define __NR_ia32_epoll_ctl_batch	291
+#define __NR_ia32_ioprio_set		292
+#define __NR_ia32_ioprio_get		293
+#define __NR_ia32_dio_register		294
+#define __NR_ia32_dio_unregister	295
+#define __NR_ia32_getdents_plus		296
+#define __NR_ia32_inotify_init		297
+#define __NR_ia32_inotify_add_watch	298
+#define __NR_ia32_inotify_rm_watch	299
+#define __NR_ia32_sync_file_range	300
+#define __NR_ia32_fallocate		301
+#define __NR_ia32_perfctr_open		302
+#define __NR_ia32_spawn			303
+#define __NR_ia32_migrate_pages		304
+#define __NR_ia32_signalfd		305
+#define __NR_ia32_timerfd_create	306
+#define __NR_ia32_eventfd		307
+#define __NR_ia32_timerfd_settime	308
+#define __NR_ia32_timerfd_gettime	309
+#define __NR_ia32_mq_timedsendv		310
+#define __NR_ia32_mq_timedreceivev	311
 
-#define IA32_NR_syscalls 290	/* must be > than biggest syscall! */
+#define IA32_NR_syscalls 312	/* must be > than biggest syscall! */
 
 #endif /* _ASM_X86_64_IA32_UNISTD_H_ */
@@ -335,7 +335,16 @@ static inline pud_t *__pud_offset_k(pud_t *pud, unsigned long address)
 #define pmd_none(x)	(!pmd_val(x))
 #define pmd_present(x)	(pmd_val(x) & _PAGE_PRESENT)
 #define pmd_clear(xp)	do { set_pmd(xp, __pmd(0)); } while (0)
-#define	pmd_bad(x)	((pmd_val(x) & (~PTE_MASK & ~_PAGE_USER)) != _KERNPG_TABLE )
+#define	pmd_bad(x)	((pmd_val(x) & (~PTE_MASK & ~(_PAGE_USER | _PAGE_RW))) != \
+			 (_KERNPG_TABLE & ~_PAGE_RW))
+/*
+ * A page table shared copy-on-write between mms (see mm/memory.c) is
+ * write protected in their pmds, whatever its ptes say.
+ */
+#define pmd_write(x)	(pmd_val(x) & _PAGE_RW)
+#define pmd_wrprotect(x)	__pmd(pmd_val(x) & ~_PAGE_RW)
+#define pmd_mkwrite(x)	__pmd(pmd_val(x) | _PAGE_RW)
+#define __HAVE_ARCH_PMD_WRPROTECT
 #define pfn_pmd(nr,prot) (__pmd(((nr) << PAGE_SHIFT) | pgprot_val(prot)))
 #define pmd_pfn(x)  ((pmd_val(x) >> PAGE_SHIFT) & __PHYSICAL_MASK)
 
@@ -434,4 +443,10 @@ extern int kern_addr_valid(unsigned long addr);
 #define __HAVE_ARCH_PTE_SAME
 #include <asm-generic/pgtable.h>
 
+/* Replace *ptep by newval only if it still holds oldval. */
+#define __HAVE_ARCH_PTEP_CMPXCHG
+#define ptep_cmpxchg(mm,addr,xp,oldval,newval) \
+	(cmpxchg(&(xp)->pte, pte_val(oldval), pte_val(newval)) == \
+	 pte_val(oldval))
+
 #endif /* _X86_64_PGTABLE_H */
@@ -30,6 +30,7 @@ extern void ia32_syscall(void);
 extern void iommu_hole_init(void);
 
 extern void time_init_smp(void);
+extern int tsc_unsynchronized;
 
 extern void do_softirq_thunk(void);
 
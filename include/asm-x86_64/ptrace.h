@@ -84,6 +84,12 @@ struct pt_regs {
 #define user_mode(regs) (!!((regs)->cs & 3))
 #define instruction_pointer(regs) ((regs)->rip)
 extern unsigned long profile_pc(struct pt_regs *regs);
+#define ARCH_HAS_PROFILE_CALLER
+#ifdef CONFIG_FRAME_POINTER
+extern unsigned long profile_caller(struct pt_regs *regs);
+#else
+#define profile_caller(regs) 0UL
+#endif
 void signal_fault(struct pt_regs *regs, void __user *frame, char *where);
 
 enum {
@@ -31,7 +31,7 @@ typedef struct {
 #define SPINLOCK_MAGIC_INIT	/* */
 #endif
 
-#define SPIN_LOCK_UNLOCKED (spinlock_t) { 1 SPINLOCK_MAGIC_INIT }
+#define SPIN_LOCK_UNLOCKED (spinlock_t) { 0 SPINLOCK_MAGIC_INIT }
 
 #define spin_lock_init(x)	do { *(x) = SPIN_LOCK_UNLOCKED; } while(0)
 
@@ -39,78 +39,135 @@ typedef struct {
  * Simple spin lock operations.  There are two variants, one clears IRQ's
  * on the local processor, one does not.
  *
- * We make no fairness assumptions. They have a cost.
+ * These are ticket locks: the low half of lock is the ticket now being
+ * served and the high half the next one to hand out, a byte each while
+ * NR_CPUS fits in one.  A locker takes a ticket with xadd and spins
+ * until it is served, so CPUs get the lock in the order they asked for
+ * it, rather than whichever is nearest to the cacheline when it is
+ * released.
+ *
+ * Interrupts cannot be enabled while waiting: with our ticket taken, an
+ * interrupt handler wanting the same lock would wait behind us forever.
+ * Only the owner writes the ticket being served, so the unlock needs no
+ * lock prefix, except on PPro SMP or with OOSTORE (PPro errata 66, 92).
  */
 
-#define spin_is_locked(x)	(*(volatile signed char *)(&(x)->lock) <= 0)
 #define spin_unlock_wait(x)	do { barrier(); } while(spin_is_locked(x))
 #define _raw_spin_lock_flags(lock, flags) _raw_spin_lock(lock)
 
-#define spin_lock_string \
-	"\n1:\t" \
-	"lock ; decb %0\n\t" \
-	"js 2f\n" \
-	LOCK_SECTION_START("") \
-	"2:\t" \
-	"rep;nop\n\t" \
-	"cmpb $0,%0\n\t" \
-	"jle 2b\n\t" \
-	"jmp 1b\n" \
-	LOCK_SECTION_END
-
-/*
- * This works. Despite all the confusion.
- * (except on PPro SMP or if we are using OOSTORE)
- * (PPro errata 66, 92)
- */
- 
 #if !defined(CONFIG_X86_OOSTORE) && !defined(CONFIG_X86_PPRO_FENCE)
+#define SPIN_UNLOCK_PREFIX
+#else
+#define SPIN_UNLOCK_PREFIX	"lock ; "
+#endif
 
-#define spin_unlock_string \
-	"movb $1,%0" \
-		:"=m" (lock->lock) : : "memory"
+#if NR_CPUS < 256
 
+static inline int spin_is_locked(spinlock_t *lock)
+{
+	unsigned int tmp = lock->lock;
 
-static inline void _raw_spin_unlock(spinlock_t *lock)
+	return ((tmp >> 8) ^ tmp) & 0xff;
+}
+
+static inline void __ticket_spin_lock(spinlock_t *lock)
 {
-#ifdef CONFIG_DEBUG_SPINLOCK
-	BUG_ON(lock->magic != SPINLOCK_MAGIC);
-	assert_spin_locked(lock);
-#endif
+	unsigned short inc = 0x0100;
+
 	__asm__ __volatile__(
-		spin_unlock_string
-	);
+		"lock ; xaddw %w0, %1\n"
+		"1:\t"
+		"cmpb %h0, %b0\n\t"
+		"je 2f\n\t"
+		"rep ; nop\n\t"
+		"movb %1, %b0\n\t"
+		"jmp 1b\n"
+		"2:"
+		:"+Q" (inc), "+m" (lock->lock) : : "memory", "cc");
 }
 
-#else
+static inline int _raw_spin_trylock(spinlock_t *lock)
+{
+	int tmp;
+	short new;
+
+	__asm__ __volatile__(
+		"movw %2, %w0\n\t"
+		"cmpb %h0, %b0\n\t"
+		"jne 1f\n\t"
+		"movw %w0, %w1\n\t"
+		"incb %h1\n\t"
+		"lock ; cmpxchgw %w1, %2\n\t"
+		"1:"
+		"sete %b1\n\t"
+		"movzbl %b1, %0"
+		:"=&a" (tmp), "=Q" (new), "+m" (lock->lock) : : "memory", "cc");
+	return tmp;
+}
+
+#define spin_unlock_string	SPIN_UNLOCK_PREFIX "incb %0"
+
+#else /* NR_CPUS >= 256 */
 
-#define spin_unlock_string \
-	"xchgb %b0, %1" \
-		:"=q" (oldval), "=m" (lock->lock) \
-		:"0" (oldval) : "memory"
+static inline int spin_is_locked(spinlock_t *lock)
+{
+	unsigned int tmp = lock->lock;
+
+	return ((tmp >> 16) ^ tmp) & 0xffff;
+}
+
+static inline void __ticket_spin_lock(spinlock_t *lock)
+{
+	unsigned int inc = 0x00010000;
+	unsigned int tmp;
+
+	__asm__ __volatile__(
+		"lock ; xaddl %0, %1\n\t"
+		"movzwl %w0, %2\n\t"
+		"shrl $16, %0\n"
+		"1:\t"
+		"cmpl %0, %2\n\t"
+		"je 2f\n\t"
+		"rep ; nop\n\t"
+		"movzwl %1, %2\n\t"
+		"jmp 1b\n"
+		"2:"
+		:"+r" (inc), "+m" (lock->lock), "=&r" (tmp) : : "memory", "cc");
+}
+
+static inline int _raw_spin_trylock(spinlock_t *lock)
+{
+	int tmp;
+	int new;
+
+	__asm__ __volatile__(
+		"movl %2, %0\n\t"
+		"movl %0, %1\n\t"
+		"roll $16, %0\n\t"
+		"cmpl %0, %1\n\t"
+		"jne 1f\n\t"
+		"addl $0x00010000, %1\n\t"
+		"lock ; cmpxchgl %1, %2\n\t"
+		"1:"
+		"sete %b1\n\t"
+		"movzbl %b1, %0"
+		:"=&a" (tmp), "=&q" (new), "+m" (lock->lock) : : "memory", "cc");
+	return tmp;
+}
+
+#define spin_unlock_string	SPIN_UNLOCK_PREFIX "incw %0"
+
+#endif /* NR_CPUS */
 
 static inline void _raw_spin_unlock(spinlock_t *lock)
 {
-	char oldval = 1;
 #ifdef CONFIG_DEBUG_SPINLOCK
 	BUG_ON(lock->magic != SPINLOCK_MAGIC);
 	assert_spin_locked(lock);
 #endif
 	__asm__ __volatile__(
 		spin_unlock_string
-	);
-}
-
-#endif
-
-static inline int _raw_spin_trylock(spinlock_t *lock)
-{
-	char oldval;
-	__asm__ __volatile__(
-		"xchgb %b0,%1"
-		:"=q" (oldval), "=m" (lock->lock)
-		:"0" (0) : "memory");
-	return oldval > 0;
+		:"+m" (lock->lock) : : "memory", "cc");
 }
 
 static inline void _raw_spin_lock(spinlock_t *lock)
@@ -121,9 +178,7 @@ static inline void _raw_spin_lock(spinlock_t *lock)
 		BUG();
 	}
 #endif
-	__asm__ __volatile__(
-		spin_lock_string
-		:"=m" (lock->lock) : : "memory");
+	__ticket_spin_lock(lock);
 }
 
 
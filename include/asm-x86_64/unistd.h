@@ -563,8 +563,54 @@ __SYSCALL(__NR_add_key, sys_add_key)
 __SYSCALL(__NR_request_key, sys_request_key)
 #define __NR_keyctl		250
 __SYSCALL(__NR_keyctl, sys_keyctl)
-
-#define __NR_syscall_max __NR_keyctl
+#define __NR_splice		251
+__SYSCALL(__NR_splice, sys_splice)
+#define __NR_tee		252
+__SYSCALL(__NR_tee, sys_tee)
+#define __NR_epoll_ctl_batch	253
+__SYSCALL(__NR_epoll_ctl_batch, sys_epoll_ctl_batch)
+#define __NR_ioprio_set		254
+__SYSCALL(__NR_ioprio_set, sys_ioprio_set)
+#define __NR_ioprio_get		255
+__SYSCALL(__NR_ioprio_get, sys_ioprio_get)
+#define __NR_dio_register	256
+__SYSCALL(__NR_dio_register, sys_dio_register)
+#define __NR_dio_unregister	257
+__SYSCALL(__NR_dio_unregister, sys_dio_unregister)
+#define __NR_getdents_plus	258
+__SYSCALL(__NR_getdents_plus, sys_getdents_plus)
+#define __NR_inotify_init	259
+__SYSCALL(__NR_inotify_init, sys_inotify_init)
+#define __NR_inotify_add_watch	260
+__SYSCALL(__NR_inotify_add_watch, sys_inotify_add_watch)
+#define __NR_inotify_rm_watch	261
+__SYSCALL(__NR_inotify_rm_watch, sys_inotify_rm_watch)
+#define __NR_sync_file_range	262
+__SYSCALL(__NR_sync_file_range, sys_sync_file_range)
+#define __NR_fallocate		263
+__SYSCALL(__NR_fallocate, sys_fallocate)
+#define __NR_perfctr_open	264
+__SYSCALL(__NR_perfctr_open, sys_perfctr_open)
+#define __NR_spawn		265
+__SYSCALL(__NR_spawn, sys_spawn)
+#define __NR_migrate_pages	266
+__SYSCALL(__NR_migrate_pages, sys_migrate_pages)
+#define __NR_signalfd		267
+__SYSCALL(__NR_signalfd, sys_signalfd)
+#define __NR_timerfd_create	268
+__SYSCALL(__NR_timerfd_create, sys_timerfd_create)
+#define __NR_eventfd		269
+__SYSCALL(__NR_eventfd, sys_eventfd)
+#define __NR_timerfd_settime	270
+__SYSCALL(__NR_timerfd_settime, sys_timerfd_settime)
+#define __NR_timerfd_gettime	271
+__SYSCALL(__NR_timerfd_gettime, sys_timerfd_gettime)
+#define __NR_mq_timedsendv	272
+__SYSCALL(__NR_mq_timedsendv, sys_mq_timedsendv)
+#define __NR_mq_timedreceivev	273
+__SYSCALL(__NR_mq_timedreceivev, sys_mq_timedreceivev)
+
+#define __NR_syscall_max __NR_mq_timedreceivev
 #ifndef __NO_STUBS
 
 /* user-visible error numbers are in the range -1 - -4095 */
@@ -733,6 +779,12 @@ static inline long dup(unsigned int fd)
 /* implemented in asm in arch/x86_64/kernel/entry.S */
 extern int execve(const char *, char * const *, char * const *);
 
+/* execve() above already returns the error itself */
+static inline long kernel_execve(const char *file, char **argv, char **envp)
+{
+	return execve(file, argv, envp);
+}
+
 static inline long open(const char * filename, int flags, int mode)
 {
 	return sys_open(filename, flags, mode);
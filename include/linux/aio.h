@@ -11,6 +11,7 @@
 #define AIO_KIOGRP_NR_ATOMIC	8
 
 struct kioctx;
+struct page;
 
 /* Notes on cancelling a kiocb:
  *	If a kiocb is cancelled, aio_complete may return 0 to indicate 
@@ -22,6 +23,7 @@ struct kioctx;
 #define KIOCB_C_COMPLETE	0x02
 
 #define KIOCB_SYNC_KEY		(~0U)
+#define KIOCB_KERNEL_KEY	(~1U)
 
 /* ki_flags bits */
 #define KIF_LOCKED		0
@@ -69,12 +71,16 @@ struct kiocb {
 	size_t			ki_nbytes; 	/* copy of iocb->aio_nbytes */
 	char 			__user *ki_buf;	/* remaining iocb->aio_buf */
 	size_t			ki_left; 	/* remaining bytes */
-	wait_queue_t		ki_wait;
+	struct wait_bit_queue	ki_wait;	/* key set when waiting on a page bit */
 	long			ki_retried; 	/* just for testing */
 	long			ki_kicked; 	/* just for testing */
 	long			ki_queued; 	/* just for testing */
 
 	void			*private;
+
+	/* kernel kiocbs only, see init_kernel_kiocb() */
+	struct page		**ki_pages;
+	void			(*ki_complete)(struct kiocb *, long);
 };
 
 #define is_sync_kiocb(iocb)	((iocb)->ki_key == KIOCB_SYNC_KEY)
@@ -90,28 +96,39 @@ struct kiocb {
 		(x)->ki_dtor = NULL;			\
 		(x)->ki_obj.tsk = tsk;			\
 		(x)->ki_user_data = 0;                  \
-		init_wait((&(x)->ki_wait));             \
+		init_wait((&(x)->ki_wait.wait));        \
 	} while (0)
 
-#define AIO_RING_MAGIC			0xa10a10a1
-#define AIO_RING_COMPAT_FEATURES	1
-#define AIO_RING_INCOMPAT_FEATURES	0
-struct aio_ring {
-	unsigned	id;	/* kernel internal index number */
-	unsigned	nr;	/* number of io_events */
-	unsigned	head;
-	unsigned	tail;
-
-	unsigned	magic;
-	unsigned	compat_features;
-	unsigned	incompat_features;
-	unsigned	header_length;	/* size of aio_ring */
-
+/*
+ * A kiocb the kernel issues for itself, with no context or task behind
+ * it.  Direct IO takes its buffer from the pages: iov_base of each
+ * segment is a byte offset into them, as if they were mapped one after
+ * the other from address 0.  aio_complete() calls done, perhaps from
+ * interrupt context, instead of queueing an event.  __blockdev_direct_IO()
+ * returns -EIOCBQUEUED once done is certain to be called, with the bytes
+ * transferred or an error; any other return means it will not be.
+ */
+#define is_kernel_kiocb(iocb)	((iocb)->ki_key == KIOCB_KERNEL_KEY)
+#define init_kernel_kiocb(x, filp, pages, done)	\
+	do {						\
+		(x)->ki_flags = 0;			\
+		(x)->ki_users = 1;			\
+		(x)->ki_key = KIOCB_KERNEL_KEY;		\
+		(x)->ki_filp = (filp);			\
+		(x)->ki_ctx = NULL;			\
+		(x)->ki_cancel = NULL;			\
+		(x)->ki_dtor = NULL;			\
+		(x)->ki_obj.tsk = NULL;			\
+		(x)->ki_user_data = 0;			\
+		(x)->ki_pages = (pages);		\
+		(x)->ki_complete = (done);		\
+	} while (0)
 
-	struct io_event		io_events[0];
-}; /* 128 bytes + ring size */
+#define AIO_RING_COMPAT_FEATURES	(AIO_RING_F_BASE | AIO_RING_F_USER_REAP)
+#define AIO_RING_INCOMPAT_FEATURES	0
 
-#define aio_ring_avail(info, ring)	(((ring)->head + (info)->nr - 1 - (ring)->tail) % (info)->nr)
+/* ring->head may be written by user space: only trust it modulo nr */
+#define aio_ring_avail(info, ring)	(((ring)->head % (info)->nr + (info)->nr - 1 - (info)->tail) % (info)->nr)
 
 #define AIO_RING_PAGES	8
 struct aio_ring_info {
@@ -184,7 +201,7 @@ do {									\
 	}								\
 } while (0)
 
-#define io_wait_to_kiocb(wait) container_of(wait, struct kiocb, ki_wait)
+#define io_wait_to_kiocb(wait) container_of(wait, struct kiocb, ki_wait.wait)
 #define is_retried_kiocb(iocb) ((iocb)->ki_retried > 1)
 
 #include <linux/aio_abi.h>
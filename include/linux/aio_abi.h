@@ -51,6 +51,49 @@ struct io_event {
 	__s64		res2;		/* secondary result */
 };
 
+/*
+ * The completion ring.  io_setup() maps it into the caller's address
+ * space and returns its address as the aio_context_t.  The header is
+ * followed by nr io_events; the first ones share the header's page.
+ *
+ * The kernel is the only producer: it fills io_events[tail], issues a
+ * write barrier and then advances tail.  When compat_features has
+ * AIO_RING_F_USER_REAP set, user space may consume events directly
+ * from the mapping, without io_getevents():
+ *
+ *	head = ring->head;
+ *	if (head == ring->tail)
+ *		return 0;		(empty: io_getevents() to sleep)
+ *	read barrier;
+ *	ev = ring->io_events[head];
+ *	full barrier;
+ *	cmpxchg(&ring->head, head, (head + 1) % ring->nr);
+ *	(retry if the cmpxchg lost)
+ *
+ * The kernel reaps with the same compare-and-exchange on head, so user
+ * space and io_getevents() may consume the same ring concurrently on
+ * architectures with cmpxchg.  Elsewhere only one of them may reap at a
+ * time.  head and tail are always kept in the range [0, nr).
+ */
+#define AIO_RING_MAGIC			0xa10a10a1
+#define AIO_RING_F_BASE			1	/* ring layout as below */
+#define AIO_RING_F_USER_REAP		2	/* head may be advanced by user */
+
+struct aio_ring {
+	unsigned	id;	/* kernel internal index number */
+	unsigned	nr;	/* number of io_events */
+	unsigned	head;	/* next event to consume */
+	unsigned	tail;	/* next slot the kernel fills */
+
+	unsigned	magic;
+	unsigned	compat_features;
+	unsigned	incompat_features;
+	unsigned	header_length;	/* size of aio_ring */
+
+
+	struct io_event		io_events[0];
+}; /* 128 bytes + ring size */
+
 #if defined(__LITTLE_ENDIAN)
 #define PADDED(x,y)	x, y
 #elif defined(__BIG_ENDIAN)
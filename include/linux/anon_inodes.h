@@ -0,0 +1,15 @@
+/*
+ *  include/linux/anon_inodes.h
+ *
+ *  File descriptors which need no inode of their own, see fs/anon_inodes.c.
+ */
+
+#ifndef _LINUX_ANON_INODES_H
+#define _LINUX_ANON_INODES_H
+
+struct file_operations;
+
+int anon_inode_getfd(const char *name, struct file_operations *fops,
+		     void *priv);
+
+#endif /* _LINUX_ANON_INODES_H */
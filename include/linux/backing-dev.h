@@ -8,8 +8,12 @@
 #ifndef _LINUX_BACKING_DEV_H
 #define _LINUX_BACKING_DEV_H
 
+#include <linux/list.h>
+#include <linux/wait.h>
 #include <asm/atomic.h>
 
+struct task_struct;
+
 /*
  * Bits in backing_dev_info.state
  */
@@ -17,11 +21,24 @@ enum bdi_state {
 	BDI_pdflush,		/* A pdflush thread is working this device */
 	BDI_write_congested,	/* The write queue is getting full */
 	BDI_read_congested,	/* The read queue is getting full */
+	BDI_flush_background,	/* Flusher thread asked for background writeout */
+	BDI_flush_kupdate,	/* Flusher thread asked for kupdate writeout */
 	BDI_unused,		/* Available bits start here */
 };
 
 typedef int (congested_fn)(void *, int);
 
+/*
+ * Per-device page counts, used to throttle dirtiers against the device they
+ * are actually writing to.  Plain atomics so that statically allocated
+ * backing_dev_infos need no initialisation.
+ */
+enum bdi_stat_item {
+	BDI_RECLAIMABLE,	/* dirty + unstable pages */
+	BDI_WRITEBACK,		/* pages under writeback */
+	NR_BDI_STAT_ITEMS
+};
+
 struct backing_dev_info {
 	unsigned long ra_pages;	/* max readahead in PAGE_CACHE_SIZE units */
 	unsigned long state;	/* Always use atomic bitops on this */
@@ -30,8 +47,60 @@ struct backing_dev_info {
 	void *congested_data;	/* Pointer to aux data for congested func */
 	void (*unplug_io_fn)(struct backing_dev_info *, struct page *);
 	void *unplug_io_data;
+
+	atomic_t bdi_stat[NR_BDI_STAT_ITEMS];
+
+	/* completed writeouts, halved every writeout period (page-writeback.c) */
+	atomic_t writeout_events;
+	unsigned long writeout_period;
+
+	/* dedicated writeback thread, if registered (mm/backing-dev.c) */
+	struct task_struct *flusher;
+	wait_queue_head_t flush_wait;
+	long flush_pages;	/* background pages asked for */
+	struct list_head bdi_list;
 };
 
+static inline void add_bdi_stat(struct backing_dev_info *bdi,
+				enum bdi_stat_item item, int nr)
+{
+	atomic_add(nr, &bdi->bdi_stat[item]);
+}
+
+static inline void sub_bdi_stat(struct backing_dev_info *bdi,
+				enum bdi_stat_item item, int nr)
+{
+	atomic_sub(nr, &bdi->bdi_stat[item]);
+}
+
+static inline void inc_bdi_stat(struct backing_dev_info *bdi,
+				enum bdi_stat_item item)
+{
+	atomic_inc(&bdi->bdi_stat[item]);
+}
+
+static inline void dec_bdi_stat(struct backing_dev_info *bdi,
+				enum bdi_stat_item item)
+{
+	atomic_dec(&bdi->bdi_stat[item]);
+}
+
+static inline long bdi_stat(struct backing_dev_info *bdi,
+			    enum bdi_stat_item item)
+{
+	int nr = atomic_read(&bdi->bdi_stat[item]);
+
+	return nr < 0 ? 0 : nr;
+}
+
+void bdi_writeout_inc(struct backing_dev_info *bdi);
+
+int bdi_register(struct backing_dev_info *bdi, const char *name);
+void bdi_unregister(struct backing_dev_info *bdi);
+int bdi_start_writeback(struct backing_dev_info *bdi, long nr_pages,
+			int for_kupdate);
+void bdi_writeback_all(long nr_pages, int for_kupdate);
+
 
 /*
  * Flags in backing_dev_info::capability
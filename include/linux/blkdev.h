@@ -298,6 +298,30 @@ struct blk_queue_tag {
 	atomic_t refcnt;		/* map can be shared */
 };
 
+/*
+ * Plugging statistics.  Everything but timer_unplugs is updated under
+ * the queue lock; timer_unplugs only by the (non-reentrant) unplug timer.
+ */
+struct blk_plug_stats {
+	unsigned long		plugs;		/* queue was plugged */
+	unsigned long		unplugs;	/* plug was removed, any reason */
+	unsigned long		timer_unplugs;	/* unplug_timer expired */
+	unsigned long		thresh_unplugs;	/* unplug_thresh reached */
+	unsigned long		merges;		/* bios merged into a request */
+	unsigned long		requests;	/* bios that started a request */
+};
+
+/*
+ * Per-CPU bio staging (QUEUE_FLAG_STAGING).  bios are kept sorted by
+ * sector on the submitting CPU and handed to the elevator in batches,
+ * taking the queue lock once per batch instead of once per bio.
+ */
+struct blk_staging {
+	spinlock_t		lock;
+	struct bio		*head;
+	int			count;
+};
+
 struct request_queue
 {
 	/*
@@ -332,6 +356,24 @@ struct request_queue
 	int			unplug_thresh;	/* After this many requests */
 	unsigned long		unplug_delay;	/* After this many jiffies */
 	struct work_struct	unplug_work;
+	struct blk_plug_stats	plug_stats;
+
+	/*
+	 * Adaptive unplugging: retune unplug_thresh every
+	 * BLK_ADAPT_WINDOW new requests from the merge rate and the
+	 * average completion latency (in jiffies, scaled by 8).
+	 */
+	int			unplug_adaptive;
+	unsigned long		avg_latency;
+	unsigned long		adapt_merges;
+	unsigned long		adapt_requests;
+
+	/*
+	 * Per-CPU staging, allocated when first enabled
+	 */
+	struct blk_staging	*staging;
+	struct timer_list	staging_timer;
+	struct work_struct	staging_work;
 
 	struct backing_dev_info	backing_dev_info;
 
@@ -401,6 +443,8 @@ struct request_queue
 	 */
 	struct request		*flush_rq;
 	unsigned char		ordered;
+
+	struct blk_trace	*blk_trace;	/* see blktrace.c */
 };
 
 enum {
@@ -425,11 +469,13 @@ enum {
 #define QUEUE_FLAG_PLUGGED	7	/* queue is plugged */
 #define QUEUE_FLAG_DRAIN	8	/* draining queue for sched switch */
 #define QUEUE_FLAG_FLUSH	9	/* doing barrier flush sequence */
+#define QUEUE_FLAG_STAGING	10	/* stage bios on per-CPU lists */
 
 #define blk_queue_plugged(q)	test_bit(QUEUE_FLAG_PLUGGED, &(q)->queue_flags)
 #define blk_queue_tagged(q)	test_bit(QUEUE_FLAG_QUEUED, &(q)->queue_flags)
 #define blk_queue_stopped(q)	test_bit(QUEUE_FLAG_STOPPED, &(q)->queue_flags)
 #define blk_queue_flushing(q)	test_bit(QUEUE_FLAG_FLUSH, &(q)->queue_flags)
+#define blk_queue_staging(q)	test_bit(QUEUE_FLAG_STAGING, &(q)->queue_flags)
 
 #define blk_fs_request(rq)	((rq)->flags & REQ_CMD)
 #define blk_pc_request(rq)	((rq)->flags & REQ_BLOCK_PC)
@@ -626,6 +672,8 @@ extern void blk_queue_segment_boundary(request_queue_t *, unsigned long);
 extern void blk_queue_prep_rq(request_queue_t *, prep_rq_fn *pfn);
 extern void blk_queue_merge_bvec(request_queue_t *, merge_bvec_fn *);
 extern void blk_queue_dma_alignment(request_queue_t *, int);
+extern int blk_queue_enable_staging(request_queue_t *);
+extern void blk_flush_staging(request_queue_t *);
 extern struct backing_dev_info *blk_get_backing_dev_info(struct block_device *bdev);
 extern void blk_queue_ordered(request_queue_t *, int);
 extern void blk_queue_issue_flush_fn(request_queue_t *, issue_flush_fn *);
@@ -0,0 +1,77 @@
+#ifndef _LINUX_BLKTRACE_H
+#define _LINUX_BLKTRACE_H
+
+/*
+ * Block I/O tracing, see drivers/block/blktrace.c.
+ *
+ * BLKTRACESETUP on a block device creates per-CPU trace buffers for
+ * its queue in debugfs, block/<name>/cpu<n>, see linux/tracebuf.h.
+ * Each event is a struct tracebuf_event with the action as its id,
+ * followed by a struct blk_io_trace.
+ */
+
+#include <linux/types.h>
+
+/* the points a request passes through, tracebuf_event.id */
+enum blktrace_act {
+	BLK_TA_QUEUE = 1,	/* bio queued */
+	BLK_TA_BACKMERGE,	/* bio merged at the back of a request */
+	BLK_TA_FRONTMERGE,	/* bio merged at the front of a request */
+	BLK_TA_GETRQ,		/* request allocated for a bio */
+	BLK_TA_SLEEPRQ,		/* waiting for a free request */
+	BLK_TA_INSERT,		/* request handed to the io scheduler */
+	BLK_TA_ISSUE,		/* request handed to the driver */
+	BLK_TA_REQUEUE,		/* request given back by the driver */
+	BLK_TA_COMPLETE,	/* bytes of a request done */
+};
+
+#define BLK_TC_ACT(act)		(1 << (act))
+#define BLK_TC_ALL		0xffff
+
+/* blk_io_trace.rw */
+#define BLK_TR_WRITE		1
+#define BLK_TR_BARRIER		2
+#define BLK_TR_SYNC		4
+
+struct blk_io_trace {
+	__u64 sector;		/* first sector, on the whole disk */
+	__u32 bytes;
+	__u32 pid;		/* current task, meaningless on completion */
+	__u32 device;		/* of the disk, major << 20 | minor */
+	__u32 rw;		/* BLK_TR_* */
+	__s32 error;		/* of BLK_TA_COMPLETE, 0 or -errno */
+	__u32 pad;
+};
+
+/* argument of BLKTRACESETUP */
+struct blk_user_trace_setup {
+	char name[32];		/* output: directory in block/ */
+	__u16 act_mask;		/* BLK_TC_ACT() of the actions to trace */
+	__u16 pad;
+	__u32 buf_size;		/* bytes per sub-buffer */
+	__u32 buf_nr;		/* sub-buffers per CPU, a power of 2 */
+};
+
+#ifdef __KERNEL__
+
+struct block_device;
+struct request_queue;
+
+#ifdef CONFIG_BLK_DEV_IO_TRACE
+extern int blk_trace_ioctl(struct block_device *bdev, unsigned cmd,
+			   char __user *arg);
+extern void blk_trace_shutdown(struct request_queue *q);
+#else
+static inline int blk_trace_ioctl(struct block_device *bdev, unsigned cmd,
+				  char __user *arg)
+{
+	return -ENOTTY;
+}
+static inline void blk_trace_shutdown(struct request_queue *q)
+{
+}
+#endif
+
+#endif /* __KERNEL__ */
+
+#endif /* _LINUX_BLKTRACE_H */
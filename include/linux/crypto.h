@@ -32,6 +32,9 @@
 #define CRYPTO_ALG_TYPE_DIGEST		0x00000002
 #define CRYPTO_ALG_TYPE_COMPRESS	0x00000004
 
+/* The algorithm can only be used through crypto_request_submit() */
+#define CRYPTO_ALG_ASYNC		0x00000100
+
 /*
  * Transform masks and values (for crt_flags).
  */
@@ -45,6 +48,7 @@
 #define CRYPTO_TFM_MODE_CTR		0x00000008
 
 #define CRYPTO_TFM_REQ_WEAK_KEY		0x00000100
+#define CRYPTO_TFM_REQ_ASYNC		0x00000200
 #define CRYPTO_TFM_RES_WEAK_KEY		0x00100000
 #define CRYPTO_TFM_RES_BAD_KEY_LEN   	0x00200000
 #define CRYPTO_TFM_RES_BAD_KEY_SCHED 	0x00400000
@@ -61,6 +65,7 @@
 #define CRYPTO_DIR_DECRYPT		0
 
 struct scatterlist;
+struct crypto_request;
 
 /*
  * Algorithms: modular crypto algorithm implementations, managed
@@ -97,12 +102,26 @@ struct compress_alg {
 #define cra_digest	cra_u.digest
 #define cra_compress	cra_u.compress
 
+/*
+ * Several implementations of one algorithm may be registered under the
+ * same cra_name, each with its own cra_driver_name.  Looking up the
+ * algorithm name gets the one with the highest cra_priority, looking up
+ * a driver name gets that implementation.
+ *
+ * A hardware driver sets cra_async to take requests; it returns
+ * -EINPROGRESS if it will call the request's completion later, -EBUSY
+ * if its queue is full, or anything else if it is done already.
+ */
 struct crypto_alg {
 	struct list_head cra_list;
 	u32 cra_flags;
 	unsigned int cra_blocksize;
 	unsigned int cra_ctxsize;
+	int cra_priority;
 	const char cra_name[CRYPTO_MAX_ALG_NAME];
+	const char cra_driver_name[CRYPTO_MAX_ALG_NAME];
+
+	int (*cra_async)(struct crypto_request *req);
 
 	union {
 		struct cipher_alg cipher;
@@ -227,6 +246,13 @@ static inline const char *crypto_tfm_alg_name(struct crypto_tfm *tfm)
 	return tfm->__crt_alg->cra_name;
 }
 
+static inline const char *crypto_tfm_alg_driver_name(struct crypto_tfm *tfm)
+{
+	struct crypto_alg *alg = tfm->__crt_alg;
+
+	return *alg->cra_driver_name ? alg->cra_driver_name : alg->cra_name;
+}
+
 static inline const char *crypto_tfm_alg_modname(struct crypto_tfm *tfm)
 {
 	return module_name(tfm->__crt_alg->cra_module);
@@ -381,6 +407,96 @@ static inline int crypto_comp_decompress(struct crypto_tfm *tfm,
 	return tfm->crt_compress.cot_decompress(tfm, src, slen, dst, dlen);
 }
 
+/*
+ * Asynchronous requests.
+ *
+ * A request describes one cipher or digest operation on a tfm.  It is
+ * given to a hardware driver if the tfm's algorithm has one, or else
+ * queued and done by the software algorithm in process context on the
+ * submitting CPU.  crypto_request_submit() returns -EINPROGRESS if the
+ * request was queued, in which case complete() is called once it is
+ * done, from process, softirq or hardirq context.  Any other value is
+ * the result of a request which was done on the spot; complete() is
+ * not called then.  See struct crypto_alg for -EBUSY.
+ *
+ * As with the synchronous calls, concurrent requests on a tfm must
+ * not share state: a digest tfm or a cipher without an explicit IV
+ * does one request at a time.
+ */
+#define CRYPTO_OP_ENCRYPT		1
+#define CRYPTO_OP_DECRYPT		2
+#define CRYPTO_OP_DIGEST		3
+
+typedef void (*crypto_completion_t)(struct crypto_request *req, int err);
+
+struct crypto_request {
+	struct list_head list;		/* for whoever owns it right now */
+	struct crypto_tfm *tfm;
+	int op;
+
+	struct scatterlist *dst;	/* cipher only */
+	struct scatterlist *src;
+	unsigned int nbytes;		/* entries of src for a digest */
+	u8 *iv;				/* cipher, NULL for the tfm's own */
+	u8 *result;			/* digest */
+
+	crypto_completion_t complete;
+	void *data;
+};
+
+static inline void crypto_request_init(struct crypto_request *req,
+                                       struct crypto_tfm *tfm,
+                                       crypto_completion_t complete,
+                                       void *data)
+{
+	req->tfm = tfm;
+	req->complete = complete;
+	req->data = data;
+}
+
+static inline void crypto_request_cipher(struct crypto_request *req, int op,
+                                         struct scatterlist *dst,
+                                         struct scatterlist *src,
+                                         unsigned int nbytes, u8 *iv)
+{
+	BUG_ON(crypto_tfm_alg_type(req->tfm) != CRYPTO_ALG_TYPE_CIPHER);
+	req->op = op;
+	req->dst = dst;
+	req->src = src;
+	req->nbytes = nbytes;
+	req->iv = iv;
+}
+
+static inline void crypto_request_digest(struct crypto_request *req,
+                                         struct scatterlist *sg,
+                                         unsigned int nsg, u8 *out)
+{
+	BUG_ON(crypto_tfm_alg_type(req->tfm) != CRYPTO_ALG_TYPE_DIGEST);
+	req->op = CRYPTO_OP_DIGEST;
+	req->src = sg;
+	req->nbytes = nsg;
+	req->result = out;
+}
+
+int crypto_request_submit(struct crypto_request *req);
+
+/*
+ * Request queues for drivers, which do their own locking.  Requests
+ * can be taken off one at a time or in batches for the hardware.
+ */
+struct crypto_queue {
+	struct list_head list;
+	unsigned int qlen;
+	unsigned int max_qlen;
+};
+
+void crypto_init_queue(struct crypto_queue *queue, unsigned int max_qlen);
+int crypto_enqueue_request(struct crypto_queue *queue,
+                           struct crypto_request *req);
+struct crypto_request *crypto_dequeue_request(struct crypto_queue *queue);
+unsigned int crypto_dequeue_batch(struct crypto_queue *queue,
+                                  struct list_head *batch, unsigned int max);
+
 /*
  * HMAC support.
  */
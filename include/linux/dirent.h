@@ -16,6 +16,46 @@ struct dirent64 {
 	char		d_name[256];
 };
 
+/*
+ * Attributes of an entry as returned by getdents_plus(), the same as
+ * lstat() would give.  The layout is the same for 32 and 64-bit tasks.
+ */
+struct dirent_stat {
+	__u64		st_dev;
+	__u64		st_ino;
+	__u64		st_rdev;
+	__s64		st_size;
+	__u64		st_blocks;
+	__u32		st_mode;
+	__u32		st_nlink;
+	__u32		st_uid;
+	__u32		st_gid;
+	__u32		st_blksize;
+	__u32		__pad;
+	__s64		st_atime_sec;
+	__s64		st_mtime_sec;
+	__s64		st_ctime_sec;
+	__u32		st_atime_nsec;
+	__u32		st_mtime_nsec;
+	__u32		st_ctime_nsec;
+	__u32		__unused;
+};
+
+/*
+ * getdents_plus() record: a dirent64 with the attributes of the entry.
+ * d_error is zero if d_stat is filled in, or the error lstat() would
+ * have returned for the entry.  d_reclen is a multiple of 8.
+ */
+struct dirent64_plus {
+	__u64		d_ino;
+	__s64		d_off;
+	struct dirent_stat d_stat;
+	__s32		d_error;
+	unsigned short	d_reclen;
+	unsigned char	d_type;
+	char		d_name[0];
+};
+
 #ifdef __KERNEL__
 
 struct linux_dirent64 {
@@ -43,6 +43,15 @@ struct epoll_event {
 	__u64 data;
 } EPOLL_PACKED;
 
+/* One entry of the array passed to sys_epoll_ctl_batch() */
+struct epoll_ctl_cmd {
+	__s32 op;
+	__s32 fd;
+	struct epoll_event event;
+	/* Filled in by the kernel with the epoll_ctl(2) return code */
+	__s32 result;
+} EPOLL_PACKED;
+
 #ifdef __KERNEL__
 
 /* Forward declarations to avoid compiler errors */
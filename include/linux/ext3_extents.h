@@ -0,0 +1,116 @@
+/*
+ * linux/include/linux/ext3_extents.h
+ *
+ * On-disk format of the ext3 extent tree.
+ *
+ * A file flagged EXT3_EXTENTS_FL maps its blocks with a tree of
+ * contiguous ranges instead of the indirect block tree.  The root
+ * lives in i_data: a header followed by four entries.  Interior nodes
+ * hold ext3_extent_idx entries pointing at the block of the next
+ * level, leaves hold ext3_extent entries.  Every node, the root
+ * included, starts with an ext3_extent_header.
+ */
+
+#ifndef _LINUX_EXT3_EXTENTS_H
+#define _LINUX_EXT3_EXTENTS_H
+
+#include <linux/types.h>
+
+/*
+ * Leaf entry: maps ee_len blocks starting at logical ee_block to the
+ * physical blocks starting at ee_start.  ee_start_hi is reserved for
+ * block numbers wider than 32 bits and is always zero.
+ *
+ * An ee_len above EXT3_EXT_MAX_LEN marks an uninitialized extent of
+ * ee_len - EXT3_EXT_MAX_LEN blocks: space preallocated by fallocate()
+ * which was never written.  It reads back as zeroes and its blocks turn
+ * into an initialized extent as they are written.
+ */
+struct ext3_extent {
+	__le32	ee_block;	/* first logical block extent covers */
+	__le16	ee_len;		/* number of blocks covered by extent */
+	__le16	ee_start_hi;	/* high 16 bits of physical block */
+	__le32	ee_start;	/* low 32 bits of physical block */
+};
+
+/*
+ * Interior entry: covers logical blocks from ei_block up to the key of
+ * the next entry.
+ */
+struct ext3_extent_idx {
+	__le32	ei_block;	/* index covers logical blocks from 'block' */
+	__le32	ei_leaf;	/* block of the next level down */
+	__le16	ei_leaf_hi;	/* high 16 bits of physical block */
+	__u16	ei_unused;
+};
+
+struct ext3_extent_header {
+	__le16	eh_magic;	/* probably will support different formats */
+	__le16	eh_entries;	/* number of valid entries */
+	__le16	eh_max;		/* capacity of store in entries */
+	__le16	eh_depth;	/* has tree real underlying blocks? */
+	__le32	eh_generation;	/* generation of the tree */
+};
+
+#define EXT3_EXT_MAGIC		0xf30a
+
+/* Longest initialized and uninitialized extent */
+#define EXT3_EXT_MAX_LEN	(1UL << 15)
+#define EXT3_EXT_UNINIT_MAX_LEN	(EXT3_EXT_MAX_LEN - 1)
+
+/* A four entry root and full 1k blocks need five levels for 2^32 blocks */
+#define EXT3_EXT_MAX_DEPTH	5
+
+#define EXT_MAX_BLOCK		0xffffffff
+
+#ifdef __KERNEL__
+
+/*
+ * In-core walk from the root to a leaf.  p_hdr/p_idx/p_ext point into
+ * i_data for the root and into p_bh for the other levels.
+ */
+struct ext3_ext_path {
+	unsigned long			p_block;
+	__u16				p_depth;
+	struct ext3_extent		*p_ext;
+	struct ext3_extent_idx		*p_idx;
+	struct ext3_extent_header	*p_hdr;
+	struct buffer_head		*p_bh;
+};
+
+#define EXT_FIRST_EXTENT(__hdr__) \
+	((struct ext3_extent *) (((char *) (__hdr__)) +		\
+				 sizeof(struct ext3_extent_header)))
+#define EXT_FIRST_INDEX(__hdr__) \
+	((struct ext3_extent_idx *) (((char *) (__hdr__)) +	\
+				     sizeof(struct ext3_extent_header)))
+#define EXT_HAS_FREE_INDEX(__path__) \
+	(le16_to_cpu((__path__)->p_hdr->eh_entries) < \
+	 le16_to_cpu((__path__)->p_hdr->eh_max))
+#define EXT_LAST_EXTENT(__hdr__) \
+	(EXT_FIRST_EXTENT((__hdr__)) + le16_to_cpu((__hdr__)->eh_entries) - 1)
+#define EXT_LAST_INDEX(__hdr__) \
+	(EXT_FIRST_INDEX((__hdr__)) + le16_to_cpu((__hdr__)->eh_entries) - 1)
+
+static inline int ext3_ext_is_uninit(struct ext3_extent *ex)
+{
+	return le16_to_cpu(ex->ee_len) > EXT3_EXT_MAX_LEN;
+}
+
+/* Number of blocks @ex covers, whether initialized or not */
+static inline unsigned long ext3_ext_get_len(struct ext3_extent *ex)
+{
+	unsigned long len = le16_to_cpu(ex->ee_len);
+
+	return len > EXT3_EXT_MAX_LEN ? len - EXT3_EXT_MAX_LEN : len;
+}
+
+static inline void ext3_ext_set_len(struct ext3_extent *ex,
+				    unsigned long len, int uninit)
+{
+	ex->ee_len = cpu_to_le16(uninit ? len + EXT3_EXT_MAX_LEN : len);
+}
+
+#endif /* __KERNEL__ */
+
+#endif /* _LINUX_EXT3_EXTENTS_H */
@@ -185,9 +185,10 @@ struct ext3_group_desc
 #define EXT3_NOTAIL_FL			0x00008000 /* file tail should not be merged */
 #define EXT3_DIRSYNC_FL			0x00010000 /* dirsync behaviour (directories only) */
 #define EXT3_TOPDIR_FL			0x00020000 /* Top of directory hierarchies*/
+#define EXT3_EXTENTS_FL			0x00080000 /* Inode uses extents */
 #define EXT3_RESERVED_FL		0x80000000 /* reserved for ext3 lib */
 
-#define EXT3_FL_USER_VISIBLE		0x0003DFFF /* User visible flags */
+#define EXT3_FL_USER_VISIBLE		0x000BDFFF /* User visible flags */
 #define EXT3_FL_USER_MODIFIABLE		0x000380FF /* User modifiable flags */
 
 /*
@@ -220,6 +221,17 @@ struct ext3_new_group_data {
 	__u32 free_blocks_count;
 };
 
+/*
+ * Used by EXT3_IOC_DEFRAG: relocate the blocks of a file from block
+ * start on, len blocks of it or up to EOF if len is 0.  moved returns
+ * how many blocks were moved.
+ */
+struct ext3_defrag_range {
+	__u32 start;
+	__u32 len;
+	__u32 moved;
+};
+
 
 /*
  * ioctl commands
@@ -230,6 +242,7 @@ struct ext3_new_group_data {
 #define	EXT3_IOC_SETVERSION		_IOW('f', 4, long)
 #define EXT3_IOC_GROUP_EXTEND		_IOW('f', 7, unsigned long)
 #define EXT3_IOC_GROUP_ADD		_IOW('f', 8,struct ext3_new_group_input)
+#define EXT3_IOC_DEFRAG			_IOWR('f', 9, struct ext3_defrag_range)
 #define	EXT3_IOC_GETVERSION_OLD		_IOR('v', 1, long)
 #define	EXT3_IOC_SETVERSION_OLD		_IOW('v', 2, long)
 #ifdef CONFIG_JBD_DEBUG
@@ -358,6 +371,10 @@ struct ext3_inode {
 #define EXT3_MOUNT_RESERVATION		0x10000	/* Preallocation */
 #define EXT3_MOUNT_BARRIER		0x20000 /* Use block barriers */
 #define EXT3_MOUNT_NOBH			0x40000 /* No bufferheads */
+#define EXT3_MOUNT_EXTENTS		0x80000	/* New files use extents */
+#define EXT3_MOUNT_DELALLOC		0x100000 /* Allocate at writeback time */
+#define EXT3_MOUNT_JOURNAL_CHECKSUM	0x200000 /* Journal checksums */
+#define EXT3_MOUNT_JOURNAL_ASYNC_COMMIT	0x400000 /* Journal async commit */
 
 /* Compatibility, for having both ext2_fs.h and ext3_fs.h included at once */
 #ifndef _LINUX_EXT2_FS_H
@@ -545,11 +562,13 @@ static inline struct ext3_inode_info *EXT3_I(struct inode *inode)
 #define EXT3_FEATURE_INCOMPAT_RECOVER		0x0004 /* Needs recovery */
 #define EXT3_FEATURE_INCOMPAT_JOURNAL_DEV	0x0008 /* Journal device */
 #define EXT3_FEATURE_INCOMPAT_META_BG		0x0010
+#define EXT3_FEATURE_INCOMPAT_EXTENTS		0x0040 /* extents support */
 
 #define EXT3_FEATURE_COMPAT_SUPP	EXT2_FEATURE_COMPAT_EXT_ATTR
 #define EXT3_FEATURE_INCOMPAT_SUPP	(EXT3_FEATURE_INCOMPAT_FILETYPE| \
 					 EXT3_FEATURE_INCOMPAT_RECOVER| \
-					 EXT3_FEATURE_INCOMPAT_META_BG)
+					 EXT3_FEATURE_INCOMPAT_META_BG| \
+					 EXT3_FEATURE_INCOMPAT_EXTENTS)
 #define EXT3_FEATURE_RO_COMPAT_SUPP	(EXT3_FEATURE_RO_COMPAT_SPARSE_SUPER| \
 					 EXT3_FEATURE_RO_COMPAT_LARGE_FILE| \
 					 EXT3_FEATURE_RO_COMPAT_BTREE_DIR)
@@ -715,6 +734,8 @@ struct dir_private_info {
 extern int ext3_bg_has_super(struct super_block *sb, int group);
 extern unsigned long ext3_bg_num_gdb(struct super_block *sb, int group);
 extern int ext3_new_block (handle_t *, struct inode *, unsigned long, int *);
+extern int ext3_new_blocks (handle_t *, struct inode *, unsigned long,
+			    unsigned long *, int *);
 extern void ext3_free_blocks (handle_t *, struct inode *, unsigned long,
 			      unsigned long);
 extern void ext3_free_blocks_sb (handle_t *, struct super_block *,
@@ -725,6 +746,9 @@ extern struct ext3_group_desc * ext3_get_group_desc(struct super_block * sb,
 						    unsigned int block_group,
 						    struct buffer_head ** bh);
 extern int ext3_should_retry_alloc(struct super_block *sb, int *retries);
+extern int ext3_claim_free_blocks(struct super_block *sb, unsigned long nblocks);
+extern void ext3_release_free_blocks(struct super_block *sb,
+				     unsigned long nblocks);
 extern void ext3_init_block_alloc_info(struct inode *);
 extern void ext3_rsv_window_add(struct super_block *sb, struct ext3_reserve_window_node *rsv);
 
@@ -737,6 +761,25 @@ extern int ext3_htree_store_dirent(struct file *dir_file, __u32 hash,
 				    struct ext3_dir_entry_2 *dirent);
 extern void ext3_htree_free_dir_info(struct dir_private_info *p);
 
+/* defrag.c */
+extern int ext3_defrag(struct file *, struct ext3_defrag_range *);
+
+/* extents.c */
+/* @create for ext3_ext_get_blocks(): preallocate uninitialized blocks */
+#define EXT3_CREATE_UNINIT	2
+
+extern int ext3_ext_tree_init(handle_t *, struct inode *);
+extern int ext3_ext_get_blocks(handle_t *, struct inode *, sector_t,
+			       unsigned long, struct buffer_head *, int, int);
+extern void ext3_ext_truncate(handle_t *, struct inode *, unsigned long);
+extern int ext3_ext_defrag_plan(struct inode *, unsigned long, unsigned long,
+				unsigned long *, unsigned long *,
+				unsigned long *);
+extern int ext3_ext_remap_blocks(handle_t *, struct inode *, unsigned long,
+				 unsigned long, unsigned long);
+extern int ext3_ext_index_trans_blocks(struct inode *);
+extern long ext3_fallocate(struct file *, int, loff_t, loff_t);
+
 /* fsync.c */
 extern int ext3_sync_file (struct file *, struct dentry *, int);
 
@@ -771,6 +814,11 @@ extern int ext3_get_inode_loc(struct inode *, struct ext3_iloc *);
 extern void ext3_truncate (struct inode *);
 extern void ext3_set_inode_flags(struct inode *);
 extern void ext3_set_aops(struct inode *inode);
+extern int ext3_ind_defrag_plan(struct inode *, unsigned long, unsigned long,
+				unsigned long *, unsigned long *,
+				unsigned long *);
+extern int ext3_ind_remap_blocks(handle_t *, struct inode *, unsigned long,
+				 unsigned long, unsigned long);
 
 /* ioctl.c */
 extern int ext3_ioctl (struct inode *, struct file *, unsigned int,
@@ -83,6 +83,9 @@ struct ext3_inode_info {
 	/* block reservation info */
 	struct ext3_block_alloc_info *i_block_alloc_info;
 
+	/* blocks promised to delayed buffers, protected by i_lock */
+	unsigned long i_reserved_blocks;
+
 	__u32	i_dir_start_lookup;
 #ifdef CONFIG_EXT3_FS_XATTR
 	/*
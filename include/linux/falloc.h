@@ -0,0 +1,6 @@
+#ifndef _FALLOC_H_
+#define _FALLOC_H_
+
+#define FALLOC_FL_KEEP_SIZE	0x01	/* default is extend size */
+
+#endif	/* _FALLOC_H_ */
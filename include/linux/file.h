@@ -48,9 +48,6 @@ extern void FASTCALL(set_close_on_exec(unsigned int fd, int flag));
 extern void put_filp(struct file *);
 extern int get_unused_fd(void);
 extern void FASTCALL(put_unused_fd(unsigned int fd));
-struct kmem_cache_s;
-extern void filp_ctor(void * objp, struct kmem_cache_s *cachep, unsigned long cflags);
-extern void filp_dtor(void * objp, struct kmem_cache_s *cachep, unsigned long dflags);
 
 extern struct file ** alloc_fd_array(int);
 extern void free_fd_array(struct file **, int);
@@ -69,6 +66,25 @@ static inline struct file * fcheck_files(struct files_struct *files, unsigned in
 	return file;
 }
 
+/*
+ * fcheck_files() for callers holding rcu_read_lock() instead of file_lock.
+ * expand_files() fills in a new fd array before installing it, raises
+ * max_fds only after that and waits for a grace period before freeing the
+ * old array; struct file itself is freed through RCU as well.
+ */
+static inline struct file * fcheck_files_rcu(struct files_struct *files, unsigned int fd)
+{
+	struct file ** fds;
+	struct file * file = NULL;
+
+	if (fd < files->max_fds) {
+		smp_rmb();
+		fds = rcu_dereference(files->fd);
+		file = rcu_dereference(fds[fd]);
+	}
+	return file;
+}
+
 /*
  * Check whether the specified fd has an open file.
  */
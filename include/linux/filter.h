@@ -9,6 +9,8 @@
 #include <linux/types.h>
 
 #ifdef __KERNEL__
+#include <linux/config.h>
+#include <linux/linkage.h>
 #include <asm/atomic.h>
 #endif
 
@@ -38,10 +40,15 @@ struct sock_fprog	/* Required for SO_ATTACH_FILTER. */
 };
 
 #ifdef __KERNEL__
+struct sk_buff;
+
 struct sk_filter
 {
 	atomic_t		refcnt;
         unsigned int         	len;	/* Number of filter blocks */
+	/* native code for insns, if the JIT compiled them */
+	unsigned int		(*bpf_func)(struct sk_buff *skb,
+					    struct sock_filter *filter);
         struct sock_filter     	insns[0];
 };
 
@@ -146,6 +153,29 @@ struct sock;
 extern int sk_run_filter(struct sk_buff *skb, struct sock_filter *filter, int flen);
 extern int sk_attach_filter(struct sock_fprog *fprog, struct sock *sk);
 extern int sk_chk_filter(struct sock_filter *filter, int flen);
+
+#ifdef CONFIG_BPF_JIT
+extern int bpf_jit_enable;
+extern void bpf_jit_compile(struct sk_filter *fp);
+extern void bpf_jit_free(struct sk_filter *fp);
+extern asmlinkage int bpf_jit_load(struct sk_buff *skb, int k,
+				   unsigned int size, u32 *to);
+
+#define SK_RUN_FILTER(FILTER, SKB)					\
+	((FILTER)->bpf_func ? (FILTER)->bpf_func(SKB, (FILTER)->insns) :	\
+	 sk_run_filter(SKB, (FILTER)->insns, (FILTER)->len))
+#else
+static inline void bpf_jit_compile(struct sk_filter *fp)
+{
+}
+
+static inline void bpf_jit_free(struct sk_filter *fp)
+{
+}
+
+#define SK_RUN_FILTER(FILTER, SKB)					\
+	sk_run_filter(SKB, (FILTER)->insns, (FILTER)->len)
+#endif
 #endif /* __KERNEL__ */
 
 #endif /* __LINUX_FILTER_H__ */
@@ -10,6 +10,19 @@
 #define FUTEX_REQUEUE (3)
 #define FUTEX_CMP_REQUEUE (4)
 
+/*
+ * Or'ed into the operation by callers whose futex is not shared with
+ * other processes: the kernel then keys it on the address alone and
+ * skips the mmap_sem/vma lookup.
+ */
+#define FUTEX_PRIVATE_FLAG	128
+#define FUTEX_CMD_MASK		(~FUTEX_PRIVATE_FLAG)
+
+#define FUTEX_WAIT_PRIVATE	(FUTEX_WAIT | FUTEX_PRIVATE_FLAG)
+#define FUTEX_WAKE_PRIVATE	(FUTEX_WAKE | FUTEX_PRIVATE_FLAG)
+#define FUTEX_REQUEUE_PRIVATE	(FUTEX_REQUEUE | FUTEX_PRIVATE_FLAG)
+#define FUTEX_CMP_REQUEUE_PRIVATE (FUTEX_CMP_REQUEUE | FUTEX_PRIVATE_FLAG)
+
 long do_futex(unsigned long uaddr, int op, int val,
 		unsigned long timeout, unsigned long uaddr2, int val2,
 		int val3);
@@ -0,0 +1,128 @@
+/*
+ *  include/linux/hrtimer.h
+ *
+ *  hrtimers - High-resolution kernel timers
+ *
+ *  Timers are kept in a per cpu, per clock rbtree ordered by their
+ *  nanosecond expiry time.  They expire from the timer softirq on every
+ *  tick, or from the interrupt of a programmable clock event device
+ *  once one is registered for the cpu.  The jiffy timer wheel stays
+ *  for coarse timeouts.
+ */
+#ifndef _LINUX_HRTIMER_H
+#define _LINUX_HRTIMER_H
+
+#include <linux/rbtree.h>
+#include <linux/ktime.h>
+#include <linux/init.h>
+
+/*
+ * Mode arguments of hrtimer_init() and hrtimer_start():
+ */
+enum hrtimer_mode {
+	HRTIMER_ABS,	/* Time value is absolute */
+	HRTIMER_REL,	/* Time value is relative to now */
+};
+
+/*
+ * Return values of the expiry callback:
+ */
+#define HRTIMER_NORESTART	0	/* Timer is done */
+#define HRTIMER_RESTART		1	/* Requeue the timer at ->expires */
+
+#define HRTIMER_INACTIVE	0
+#define HRTIMER_PENDING		1
+
+struct hrtimer_base;
+struct pt_regs;
+
+/**
+ * struct hrtimer - the basic hrtimer structure
+ *
+ * @node:	red black tree node for time ordered insertion
+ * @expires:	the absolute expiry time against the timer's clock
+ * @state:	HRTIMER_PENDING while the timer is queued
+ * @function:	expiry callback, returns HRTIMER_[NO]RESTART
+ * @data:	argument for the expiry callback
+ * @base:	pointer to the per cpu, per clock timer base
+ *
+ * The callback runs with the timer dequeued and the base unlocked,
+ * from softirq or hardirq context.
+ */
+struct hrtimer {
+	struct rb_node		node;
+	ktime_t			expires;
+	int			state;
+	int			(*function)(void *);
+	void			*data;
+	struct hrtimer_base	*base;
+};
+
+/**
+ * struct hrtimer_sleeper - simple sleeper structure
+ *
+ * @timer:	embedded timer structure
+ * @task:	task to wake up, cleared when the timer expires
+ */
+struct hrtimer_sleeper {
+	struct hrtimer		timer;
+	struct task_struct	*task;
+};
+
+/**
+ * struct clock_event - a programmable per cpu event device
+ *
+ * @name:		name of the device, for the boot log
+ * @min_delta_ns:	shortest delay the device can be programmed for
+ * @max_delta_ns:	longest delay the device can be programmed for
+ * @set_next_event:	fire one interrupt after @delta_ns nanoseconds;
+ *			its handler must call hrtimer_interrupt()
+ */
+struct clock_event {
+	const char		*name;
+	unsigned long		min_delta_ns;
+	unsigned long		max_delta_ns;
+	void			(*set_next_event)(unsigned long delta_ns,
+						  struct clock_event *evt);
+};
+
+/* Basic timer operations: */
+extern void hrtimer_init(struct hrtimer *timer, const clockid_t which_clock,
+			 const enum hrtimer_mode mode);
+extern int hrtimer_start(struct hrtimer *timer, ktime_t tim,
+			 const enum hrtimer_mode mode);
+extern int hrtimer_cancel(struct hrtimer *timer);
+extern int hrtimer_try_to_cancel(struct hrtimer *timer);
+
+#define hrtimer_restart(timer) \
+	hrtimer_start((timer), (timer)->expires, HRTIMER_ABS)
+
+/* Query timers: */
+extern ktime_t hrtimer_get_remaining(const struct hrtimer *timer);
+extern ktime_t hrtimer_cb_get_time(const struct hrtimer *timer);
+extern int hrtimer_get_res(const clockid_t which_clock, struct timespec *tp);
+
+static inline int hrtimer_active(const struct hrtimer *timer)
+{
+	return timer->state == HRTIMER_PENDING;
+}
+
+/* Forward a hrtimer so it expires after now: */
+extern unsigned long hrtimer_forward(struct hrtimer *timer, ktime_t interval);
+
+/* Precise sleep: */
+extern long hrtimer_nanosleep(struct timespec *rqtp, struct timespec *rmtp,
+			      const enum hrtimer_mode mode,
+			      const clockid_t clockid);
+
+/* Expiry, from the timer softirq or a clock event interrupt: */
+extern void hrtimer_run_queues(void);
+extern void hrtimer_interrupt(struct pt_regs *regs);
+extern struct pt_regs *hrtimer_get_irq_regs(void);
+
+extern int register_clock_event(struct clock_event *evt);
+
+/* Bootup initialization: */
+extern void __init hrtimers_init(void);
+
+#endif
@@ -119,6 +119,9 @@ static inline struct hugetlbfs_sb_info *HUGETLBFS_SB(struct super_block *sb)
 extern struct file_operations hugetlbfs_file_operations;
 extern struct vm_operations_struct hugetlb_vm_ops;
 struct file *hugetlb_zero_setup(size_t);
+unsigned long hugetlb_mmap_file(struct file *file, unsigned long addr,
+		unsigned long len, unsigned long prot, unsigned long flags,
+		unsigned long pgoff);
 int hugetlb_get_quota(struct address_space *mapping);
 void hugetlb_put_quota(struct address_space *mapping);
 
@@ -136,6 +139,7 @@ static inline void set_file_hugepages(struct file *file)
 #define is_file_hugepages(file)		0
 #define set_file_hugepages(file)	BUG()
 #define hugetlb_zero_setup(size)	ERR_PTR(-ENOSYS)
+#define hugetlb_mmap_file(file, addr, len, prot, flags, pgoff)	(-ENOSYS)
 
 #endif /* !CONFIG_HUGETLBFS */
 
@@ -39,6 +39,7 @@ struct sockaddr_ll
 #define PACKET_RX_RING			5
 #define PACKET_STATISTICS		6
 #define PACKET_COPY_THRESH		7
+#define PACKET_TX_RING			8
 
 struct tpacket_stats
 {
@@ -54,6 +55,10 @@ struct tpacket_hdr
 #define TP_STATUS_COPY		2
 #define TP_STATUS_LOSING	4
 #define TP_STATUS_CSUMNOTREADY	8
+/* Tx ring */
+#define TP_STATUS_AVAILABLE	0
+#define TP_STATUS_SEND_REQUEST	1
+#define TP_STATUS_WRONG_FORMAT	4
 	unsigned int	tp_len;
 	unsigned int	tp_snaplen;
 	unsigned short	tp_mac;
@@ -77,6 +82,14 @@ struct tpacket_hdr
    - Start+tp_mac: [ Optional MAC header ]
    - Start+tp_net: Packet data, aligned to TPACKET_ALIGNMENT=16.
    - Pad to align to TPACKET_ALIGNMENT=16
+
+   Tx ring frames use the same header: user space sets tp_len, puts the
+   packet at Start+TPACKET_ALIGN(sizeof(struct tpacket_hdr)) (with the
+   MAC header on SOCK_RAW) and sets TP_STATUS_SEND_REQUEST.  send() then
+   transmits the requested frames from the ring head on, and sets their
+   status back to TP_STATUS_AVAILABLE, or to TP_STATUS_WRONG_FORMAT if
+   the frame could not be sent as is.  The tx ring is mapped in the same
+   mmap() as the rx ring, right after it.
  */
 
 struct tpacket_req
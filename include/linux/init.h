@@ -96,6 +96,21 @@ extern char saved_command_line[];
 
 #define __initcall(fn) device_initcall(fn)
 
+/*
+ * A device initcall which may run in parallel with the others, in one
+ * of a few threads, for probes which sleep: bus scans and the like.
+ * It must not need any other device initcall to have run, or to run
+ * after it.  The late initcalls and the mounting of root wait for all
+ * of them; an earlier wait is initcall_async_sync().  See init/main.c.
+ */
+extern int initcall_async(initcall_t fn);
+extern void initcall_async_sync(void);
+
+#define device_initcall_async(fn)				\
+	static int __init __async_initcall_##fn(void)		\
+	{ return initcall_async(fn); }				\
+	device_initcall(__async_initcall_##fn)
+
 #define __exitcall(fn) \
 	static exitcall_t __exitcall_##fn __exit_call = fn
 
@@ -155,6 +170,16 @@ void __init parse_early_param(void);
  */
 #define module_init(x)	__initcall(x);
 
+/**
+ * module_init_async() - driver initialization which may run in parallel
+ * @x: function to be run at kernel boot time or module insertion
+ *
+ * Like module_init(), but when builtin @x may run in parallel with the
+ * other initcalls, see device_initcall_async().  Probe order, and with
+ * it device naming, is not kept then.
+ */
+#define module_init_async(x)	device_initcall_async(x);
+
 /**
  * module_exit() - driver exit entry point
  * @x: function to be run when driver is removed
@@ -192,6 +217,8 @@ void __init parse_early_param(void);
 	{ return initfn; }					\
 	int init_module(void) __attribute__((alias(#initfn)));
 
+#define module_init_async(initfn)	module_init(initfn)
+
 /* This is only required if you want to be unloadable. */
 #define module_exit(exitfn)					\
 	static inline exitcall_t __exittest(void)		\
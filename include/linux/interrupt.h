@@ -26,12 +26,18 @@
  * IRQ_NONE means we didn't handle it.
  * IRQ_HANDLED means that we did have a valid interrupt and handled it.
  * IRQ_RETVAL(x) selects on the two depending on x being non-zero (for handled)
+ * IRQ_WAKE_THREAD means the handler of request_threaded_irq() has quieted
+ * the device, and its thread is to do the rest.
  */
 typedef int irqreturn_t;
 
 #define IRQ_NONE	(0)
 #define IRQ_HANDLED	(1)
 #define IRQ_RETVAL(x)	((x) != 0)
+#define IRQ_WAKE_THREAD	(2)
+
+/* irqaction->thread_flags */
+#define IRQTF_RUNTHREAD	0	/* the thread has work */
 
 struct irqaction {
 	irqreturn_t (*handler)(int, void *, struct pt_regs *);
@@ -42,6 +48,9 @@ struct irqaction {
 	struct irqaction *next;
 	int irq;
 	struct proc_dir_entry *dir;
+	irqreturn_t (*thread_fn)(int, void *);
+	struct task_struct *thread;
+	unsigned long thread_flags;
 };
 
 extern irqreturn_t no_action(int cpl, void *dev_id, struct pt_regs *regs);
@@ -52,6 +61,10 @@ extern void free_irq(unsigned int, void *);
 
 
 #ifdef CONFIG_GENERIC_HARDIRQS
+extern int request_threaded_irq(unsigned int,
+		irqreturn_t (*handler)(int, void *, struct pt_regs *),
+		irqreturn_t (*thread_fn)(int, void *),
+		unsigned long, const char *, void *);
 extern void disable_irq_nosync(unsigned int irq);
 extern void disable_irq(unsigned int irq);
 extern void enable_irq(unsigned int irq);
@@ -107,7 +120,8 @@ enum
 	NET_TX_SOFTIRQ,
 	NET_RX_SOFTIRQ,
 	SCSI_SOFTIRQ,
-	TASKLET_SOFTIRQ
+	TASKLET_SOFTIRQ,
+	MAX_SOFTIRQ
 };
 
 /* softirq mask and active fields moved to irq_cpustat_t in
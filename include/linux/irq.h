@@ -77,6 +77,8 @@ extern int setup_irq(unsigned int irq, struct irqaction * new);
 
 #ifdef CONFIG_GENERIC_HARDIRQS
 extern cpumask_t irq_affinity[NR_IRQS];
+extern cpumask_t irq_home[NR_IRQS];
+extern void set_irq_home(unsigned int irq, cpumask_t mask);
 extern int no_irq_affinity;
 extern int noirqdebug_setup(char *str);
 
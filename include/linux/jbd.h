@@ -47,6 +47,13 @@
  */
 #define JBD_DEFAULT_MAX_COMMIT_AGE 5
 
+/*
+ * Default limits, in usecs, on how long a synchronous handle waits for
+ * other handles to join its transaction before forcing the commit.
+ */
+#define JBD_DEFAULT_MIN_BATCH_TIME 0
+#define JBD_DEFAULT_MAX_BATCH_TIME 15000
+
 #ifdef CONFIG_JBD_DEBUG
 /*
  * Define JBD_EXPENSIVE_CHECKING to enable more expensive internal
@@ -142,6 +149,32 @@ typedef struct journal_header_s
 	__be32		h_sequence;
 } journal_header_t;
 
+/*
+ * Checksum types.
+ */
+#define JBD_CRC32_CHKSUM	1
+
+#define JBD_CRC32_CHKSUM_SIZE	4
+
+#define JBD_CHECKSUM_BYTES	(32 / sizeof(__u32))
+
+/*
+ * Commit block header for storing transactional checksums.  The
+ * checksum covers every descriptor and metadata block the transaction
+ * wrote to the log, so recovery can tell a complete transaction from a
+ * torn one without the commit block having to be written last.
+ */
+struct commit_header
+{
+	__be32		h_magic;
+	__be32		h_blocktype;
+	__be32		h_sequence;
+	unsigned char	h_chksum_type;
+	unsigned char	h_chksum_size;
+	unsigned char	h_padding[2];
+	__be32		h_chksum[JBD_CHECKSUM_BYTES];
+};
+
 
 /* 
  * The block tag: used to describe a single buffer in the journal 
@@ -228,17 +261,22 @@ typedef struct journal_superblock_s
 	((j)->j_format_version >= 2 &&					\
 	 ((j)->j_superblock->s_feature_incompat & cpu_to_be32((mask))))
 
+#define JFS_FEATURE_COMPAT_CHECKSUM	0x00000001
+
 #define JFS_FEATURE_INCOMPAT_REVOKE	0x00000001
+#define JFS_FEATURE_INCOMPAT_ASYNC_COMMIT	0x00000004
 
 /* Features known to this kernel version: */
-#define JFS_KNOWN_COMPAT_FEATURES	0
+#define JFS_KNOWN_COMPAT_FEATURES	JFS_FEATURE_COMPAT_CHECKSUM
 #define JFS_KNOWN_ROCOMPAT_FEATURES	0
-#define JFS_KNOWN_INCOMPAT_FEATURES	JFS_FEATURE_INCOMPAT_REVOKE
+#define JFS_KNOWN_INCOMPAT_FEATURES	(JFS_FEATURE_INCOMPAT_REVOKE | \
+					 JFS_FEATURE_INCOMPAT_ASYNC_COMMIT)
 
 #ifdef __KERNEL__
 
 #include <linux/fs.h>
 #include <linux/sched.h>
+#include <linux/rcupdate.h>
 #include <asm/bug.h>
 
 #define JBD_ASSERTIONS
@@ -423,9 +461,6 @@ struct handle_s
  *    ->j_list_lock
  *
  *    j_state_lock
- *    ->t_handle_lock
- *
- *    j_state_lock
  *    ->j_list_lock			(journal_unmap_buffer)
  *
  */
@@ -517,22 +552,17 @@ struct transaction_s
 	 */
 	struct journal_head	*t_log_list;
 
-	/*
-	 * Protects info related to handles
-	 */
-	spinlock_t		t_handle_lock;
-
 	/*
 	 * Number of outstanding updates running on this transaction
-	 * [t_handle_lock]
+	 * [atomic]
 	 */
-	int			t_updates;
+	atomic_t		t_updates;
 
 	/*
 	 * Number of buffers reserved for use by all handles in this transaction
-	 * handle but not yet modified. [t_handle_lock]
+	 * handle but not yet modified. [atomic]
 	 */
-	int			t_outstanding_credits;
+	atomic_t		t_outstanding_credits;
 
 	/*
 	 * Forward and backward links for the circular list of all transactions
@@ -547,10 +577,32 @@ struct transaction_s
 	unsigned long		t_expires;
 
 	/*
-	 * How many handles used this transaction? [t_handle_lock]
+	 * How many handles used this transaction? [atomic]
+	 */
+	atomic_t		t_handle_count;
+
+	/*
+	 * When the transaction was started, in usecs, for batching of
+	 * synchronous handles against the commit time.  [no locking]
 	 */
-	int t_handle_count;
+	unsigned long		t_start_time;
 
+	/*
+	 * journal_start() may look at j_running_transaction without
+	 * j_state_lock, so the structure is freed after a grace period.
+	 */
+	struct rcu_head		t_rcu;
+};
+
+/*
+ * Running totals over all commits of a journal, reported through
+ * /proc/fs/jbd/<dev>.  [j_state_lock]
+ */
+struct transaction_stats_s {
+	unsigned long		ts_tid;		/* transactions committed */
+	unsigned long		ts_handles;	/* handles in them */
+	unsigned long		ts_blocks;	/* metadata blocks logged */
+	unsigned long		ts_max_commit_time; /* slowest commit, usecs */
 };
 
 /**
@@ -606,6 +658,15 @@ struct transaction_s
  * @j_commit_interval: What is the maximum transaction lifetime before we begin
  *  a commit?
  * @j_commit_timer:  The timer used to wakeup the commit thread
+ * @j_last_sync_writer: most recent pid which did a synchronous write
+ * @j_average_commit_time: the average amount of time in usecs it takes to
+ *  commit a transaction to disk
+ * @j_min_batch_time: minimum time in usecs a synchronous handle waits for
+ *  others to join its transaction
+ * @j_max_batch_time: maximum time in usecs a synchronous handle waits for
+ *  others to join its transaction
+ * @j_stats: commit statistics
+ * @j_proc_entry: /proc/fs/jbd entry of the statistics
  * @j_revoke_lock: Protect the revoke table
  * @j_revoke: The revoke table - maintains the list of revoked blocks in the
  *     current transaction.
@@ -646,7 +707,8 @@ struct journal_s
 
 	/*
 	 * Transactions: The current running transaction...
-	 * [j_state_lock] [caller holding open handle]
+	 * [j_state_lock] [caller holding open handle] [rcu: reading in
+	 * journal_start()]
 	 */
 	transaction_t		*j_running_transaction;
 
@@ -785,6 +847,23 @@ struct journal_s
 	/* The timer used to wakeup the commit thread: */
 	struct timer_list	*j_commit_timer;
 
+	/*
+	 * Batching of synchronous handles: the last process to do a
+	 * synchronous write, and how long committing a transaction has been
+	 * taking, in usecs.  A synchronous handle waits for others to join
+	 * its transaction for about one commit time, clamped to the batch
+	 * time limits.  [j_state_lock, except j_last_sync_writer which is
+	 * only a hint]
+	 */
+	pid_t			j_last_sync_writer;
+	unsigned long		j_average_commit_time;
+	unsigned long		j_min_batch_time;
+	unsigned long		j_max_batch_time;
+
+	/* Commit statistics [j_state_lock] */
+	struct transaction_stats_s j_stats;
+	struct proc_dir_entry	*j_proc_entry;
+
 	/*
 	 * The revoke table: maintains the list of revoked blocks in the
 	 * current transaction.  [j_revoke_lock]
@@ -870,6 +949,18 @@ static inline handle_t *journal_current_handle(void)
 	return current->journal_info;
 }
 
+/*
+ * Wall clock in usecs, for timing commits.  Wraps, so only differences
+ * between two readings are meaningful.
+ */
+static inline unsigned long jbd_time_usecs(void)
+{
+	struct timeval tv;
+
+	do_gettimeofday(&tv);
+	return tv.tv_sec * USEC_PER_SEC + tv.tv_usec;
+}
+
 /* The journaling code user interface:
  *
  * Create and destroy handles
@@ -1046,8 +1137,8 @@ static inline int jbd_space_needed(journal_t *journal)
 {
 	int nblocks = journal->j_max_transaction_buffers;
 	if (journal->j_committing_transaction)
-		nblocks += journal->j_committing_transaction->
-					t_outstanding_credits;
+		nblocks += atomic_read(&journal->j_committing_transaction->
+					t_outstanding_credits);
 	return nblocks;
 }
 
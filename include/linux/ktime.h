@@ -0,0 +1,43 @@
+/*
+ *  include/linux/ktime.h
+ *
+ *  ktime_t - nanosecond-resolution time format.
+ *
+ *  Used by the high resolution timer subsystem for absolute expiry
+ *  times against a clock as well as for intervals.
+ */
+#ifndef _LINUX_KTIME_H
+#define _LINUX_KTIME_H
+
+#include <linux/time.h>
+#include <linux/compiler.h>
+
+/*
+ * A signed 64 bit count of nanoseconds.  On CLOCK_MONOTONIC that
+ * lasts for 292 years, long enough not to care about wrapping.
+ */
+typedef s64 ktime_t;
+
+#define KTIME_MAX		((ktime_t)~((u64)1 << 63))
+#define KTIME_SEC_MAX		(KTIME_MAX / NSEC_PER_SEC)
+
+/* Convert seconds and nanoseconds, saturating at KTIME_MAX */
+static inline ktime_t ktime_set(const long secs, const unsigned long nsecs)
+{
+	if (unlikely((s64)secs >= KTIME_SEC_MAX))
+		return KTIME_MAX;
+	return (s64)secs * NSEC_PER_SEC + (s64)nsecs;
+}
+
+#define timespec_to_ktime(ts)	ktime_set((ts).tv_sec, (ts).tv_nsec)
+#define timeval_to_ktime(tv)	ktime_set((tv).tv_sec, \
+					  (tv).tv_usec * NSEC_PER_USEC)
+
+extern struct timespec ktime_to_timespec(const ktime_t kt);
+extern struct timeval ktime_to_timeval(const ktime_t kt);
+
+/* Current CLOCK_MONOTONIC and CLOCK_REALTIME time */
+extern ktime_t ktime_get(void);
+extern ktime_t ktime_get_real(void);
+
+#endif
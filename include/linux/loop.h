@@ -26,6 +26,7 @@ enum {
 };
 
 struct loop_func_table;
+struct loop_dio;
 
 struct loop_device {
 	int		lo_number;
@@ -63,6 +64,10 @@ struct loop_device {
 	struct semaphore	lo_bh_mutex;
 	atomic_t		lo_pending;
 
+	struct loop_dio		*lo_dio_redo;	/* short direct IO, under lo_lock */
+	atomic_t		lo_dio_inflight;
+	wait_queue_head_t	lo_dio_wait;
+
 	request_queue_t		*lo_queue;
 };
 
@@ -74,6 +79,7 @@ struct loop_device {
 enum {
 	LO_FLAGS_READ_ONLY	= 1,
 	LO_FLAGS_USE_AOPS	= 2,
+	LO_FLAGS_DIRECT_IO	= 4,	/* backing file opened O_DIRECT */
 };
 
 #include <asm/posix_types.h>	/* for __kernel_old_dev_t */
@@ -0,0 +1,20 @@
+#ifndef _LINUX_MIGRATE_H
+#define _LINUX_MIGRATE_H
+
+/*
+ * Moving pages between NUMA nodes, see mm/migrate.c.
+ */
+
+#include <linux/config.h>
+#include <linux/list.h>
+
+struct mm_struct;
+struct page;
+
+#ifdef CONFIG_NUMA
+extern int isolate_lru_page(struct page *, struct list_head *);
+extern void putback_lru_pages(struct list_head *);
+extern int migrate_pages(struct mm_struct *, struct list_head *, const int *);
+#endif
+
+#endif /* _LINUX_MIGRATE_H */
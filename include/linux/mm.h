@@ -428,6 +428,26 @@ static inline void set_page_zone(struct page *page, unsigned long nodezone_num)
 	page->flags |= nodezone_num << NODEZONE_SHIFT;
 }
 
+/*
+ * On NUMA the anonymous rss is also counted by the node of the page,
+ * for the scheduler to keep tasks near their memory.
+ */
+static inline void inc_mm_anon_rss(struct mm_struct *mm, struct page *page)
+{
+	inc_mm_counter(mm, anon_rss);
+#ifdef CONFIG_NUMA
+	inc_mm_counter(mm, node_anon_rss[page_to_nid(page)]);
+#endif
+}
+
+static inline void dec_mm_anon_rss(struct mm_struct *mm, struct page *page)
+{
+	dec_mm_counter(mm, anon_rss);
+#ifdef CONFIG_NUMA
+	dec_mm_counter(mm, node_anon_rss[page_to_nid(page)]);
+#endif
+}
+
 #ifndef CONFIG_DISCONTIGMEM
 /* The array of struct pages - for discontigmem use pgdat->lmem_map */
 extern struct page *mem_map;
@@ -552,11 +572,14 @@ int shmem_set_policy(struct vm_area_struct *vma, struct mempolicy *new);
 struct mempolicy *shmem_get_policy(struct vm_area_struct *vma,
 					unsigned long addr);
 int shmem_lock(struct file *file, int lock, struct user_struct *user);
+struct page *shmem_find_lock_page(struct address_space *mapping,
+					unsigned long idx);
 #else
 #define shmem_nopage filemap_nopage
 #define shmem_lock(a, b, c) 	({0;})	/* always in memory, no need to lock */
 #define shmem_set_policy(a, b)	(0)
 #define shmem_get_policy(a, b)	(NULL)
+#define shmem_find_lock_page(a, b)	(NULL)	/* never swap entries in cache */
 #endif
 struct file *shmem_file_setup(char *name, loff_t size, unsigned long flags);
 
@@ -683,6 +706,78 @@ static inline pmd_t *pmd_alloc(struct mm_struct *mm, pud_t *pud, unsigned long a
 #endif
 #endif /* CONFIG_MMU */
 
+/*
+ * The lock protecting the ptes of a user page table page.  Page faults
+ * take only this lock, under down_read(mmap_sem) which keeps the page
+ * table itself in place.  Walkers which cannot rely on mmap_sem - rmap
+ * and truncation - hold mm->page_table_lock over the upper levels and
+ * nest the pte lock inside it with pte_lock_nested().  Without
+ * SPLIT_PTLOCKS all of these are mm->page_table_lock itself.
+ */
+#ifdef SPLIT_PTLOCKS
+#define __pte_lockptr(page)	((spinlock_t *)&(page)->private)
+#define pte_lockptr(mm, pmd)	({(void)(mm); __pte_lockptr(pmd_page(*(pmd)));})
+#define pte_lock_init(page)	do {					\
+	BUILD_BUG_ON(sizeof(spinlock_t) >				\
+		     sizeof((page)->private) + sizeof((page)->mapping));\
+	spin_lock_init(__pte_lockptr(page));				\
+} while (0)
+#define pte_lock_deinit(page)	((page)->mapping = NULL)
+#define pte_lock_nested(pmd)	spin_lock(__pte_lockptr(pmd_page(*(pmd))))
+#define pte_unlock_nested(pmd)	spin_unlock(__pte_lockptr(pmd_page(*(pmd))))
+#else
+#define pte_lockptr(mm, pmd)	({(void)(pmd); &(mm)->page_table_lock;})
+#define pte_lock_init(page)	do {} while (0)
+#define pte_lock_deinit(page)	do {} while (0)
+#define pte_lock_nested(pmd)	do {} while (0)
+#define pte_unlock_nested(pmd)	do {} while (0)
+#endif
+
+/*
+ * Page table pages of large shared file mappings can be shared by all the
+ * mms mapping the same part of the file at the same alignment: sharers
+ * serialize on the pte lock in the page table page, so this depends on
+ * SPLIT_PTLOCKS.  page_count() of the page table page is the number of
+ * pmds pointing to it.  The ptes of a page table which has been shared
+ * are not in anybody's rss: pt_counted() tells callers which adjust rss,
+ * handing the ptes back to an mm which turns out to be the last sharer.
+ *
+ * Where the pmd can be write protected, fork also shares the page tables
+ * of large private mappings copy-on-write (COW_PAGE_TABLES), and the
+ * first fault through such a pmd gives the mm a copy of its own.
+ */
+#ifdef SPLIT_PTLOCKS
+#define SHARED_PAGE_TABLES
+#ifdef __HAVE_ARCH_PMD_WRPROTECT
+#define COW_PAGE_TABLES
+#endif
+#define pt_shared(pmd)		(page_count(pmd_page(*(pmd))) > 1)
+#define pt_counted(mm, pmd)	(!PagePtShared(pmd_page(*(pmd))) || \
+				 __pt_counted(mm, pmd))
+extern int __pt_counted(struct mm_struct *mm, pmd_t *pmd);
+extern int unshare_page_tables(struct vm_area_struct *vma,
+				unsigned long start, unsigned long end);
+#else
+#define pt_shared(pmd)		0
+#define pt_counted(mm, pmd)	1
+static inline int unshare_page_tables(struct vm_area_struct *vma,
+				unsigned long start, unsigned long end)
+{
+	return 0;
+}
+#endif
+
+#ifdef COW_PAGE_TABLES
+extern int unshare_page_table_ends(struct mm_struct *mm,
+				unsigned long start, unsigned long end);
+#else
+static inline int unshare_page_table_ends(struct mm_struct *mm,
+				unsigned long start, unsigned long end)
+{
+	return 0;
+}
+#endif
+
 extern void free_area_init(unsigned long * zones_size);
 extern void free_area_init_node(int nid, pg_data_t *pgdat,
 	unsigned long * zones_size, unsigned long zone_start_pfn, 
@@ -1,40 +1,61 @@
+/*
+ * Which LRU list a page belongs on.  PG_swapbacked picks the anon or the
+ * file pair, PG_active the list within it.
+ */
+static inline enum lru_list page_lru_base(struct page *page)
+{
+	return PageSwapBacked(page) ? LRU_INACTIVE_ANON : LRU_INACTIVE_FILE;
+}
+
+static inline enum lru_list page_lru(struct page *page)
+{
+	return page_lru_base(page) + (PageActive(page) ? LRU_ACTIVE : 0);
+}
+
+static inline void
+add_page_to_lru_list(struct zone *zone, struct page *page, enum lru_list l)
+{
+	list_add(&page->lru, &zone->lru[l]);
+	zone->nr_lru[l]++;
+}
+
+static inline void
+del_page_from_lru_list(struct zone *zone, struct page *page, enum lru_list l)
+{
+	list_del(&page->lru);
+	zone->nr_lru[l]--;
+}
 
 static inline void
 add_page_to_active_list(struct zone *zone, struct page *page)
 {
-	list_add(&page->lru, &zone->active_list);
-	zone->nr_active++;
+	add_page_to_lru_list(zone, page, page_lru_base(page) + LRU_ACTIVE);
 }
 
 static inline void
 add_page_to_inactive_list(struct zone *zone, struct page *page)
 {
-	list_add(&page->lru, &zone->inactive_list);
-	zone->nr_inactive++;
+	add_page_to_lru_list(zone, page, page_lru_base(page));
 }
 
 static inline void
 del_page_from_active_list(struct zone *zone, struct page *page)
 {
-	list_del(&page->lru);
-	zone->nr_active--;
+	del_page_from_lru_list(zone, page, page_lru_base(page) + LRU_ACTIVE);
 }
 
 static inline void
 del_page_from_inactive_list(struct zone *zone, struct page *page)
 {
-	list_del(&page->lru);
-	zone->nr_inactive--;
+	del_page_from_lru_list(zone, page, page_lru_base(page));
 }
 
 static inline void
 del_page_from_lru(struct zone *zone, struct page *page)
 {
-	list_del(&page->lru);
-	if (PageActive(page)) {
+	enum lru_list l = page_lru(page);
+
+	del_page_from_lru_list(zone, page, l);
+	if (is_active_lru(l))
 		ClearPageActive(page);
-		zone->nr_active--;
-	} else {
-		zone->nr_inactive--;
-	}
 }
@@ -21,6 +21,12 @@
 #define MAX_ORDER CONFIG_FORCE_MAX_ZONEORDER
 #endif
 
+/*
+ * Allocations above this order are not retried indefinitely by the page
+ * allocator, and reclaim works harder to free whole blocks for them.
+ */
+#define PAGE_ALLOC_COSTLY_ORDER 3
+
 struct free_area {
 	struct list_head	free_list;
 	unsigned long		nr_free;
@@ -49,6 +55,8 @@ struct per_cpu_pages {
 	int high;		/* high watermark, emptying needed */
 	int batch;		/* chunk size for buddy add/remove */
 	struct list_head list;	/* the list of pages */
+	unsigned long refills;	/* batches taken from the buddy lists */
+	unsigned long drains;	/* batches given back to the buddy lists */
 };
 
 struct per_cpu_pageset {
@@ -63,6 +71,36 @@ struct per_cpu_pageset {
 #endif
 } ____cacheline_aligned_in_smp;
 
+/*
+ * Each zone keeps its anonymous (swap-backed) and file-backed pages on
+ * separate active and inactive lists, so that reclaim can aim at the kind
+ * of page it can actually free without wading through the other kind.
+ * PG_swapbacked says which pair a page belongs on and PG_active which of
+ * the two; the layout lets page_lru() be computed by addition.
+ */
+#define LRU_ACTIVE		1
+#define LRU_FILE		2
+
+enum lru_list {
+	LRU_INACTIVE_ANON = 0,
+	LRU_ACTIVE_ANON = LRU_ACTIVE,
+	LRU_INACTIVE_FILE = LRU_FILE,
+	LRU_ACTIVE_FILE = LRU_FILE + LRU_ACTIVE,
+	NR_LRU_LISTS
+};
+
+#define for_each_lru(l)	for (l = 0; l < NR_LRU_LISTS; l++)
+
+static inline int is_file_lru(enum lru_list l)
+{
+	return l & LRU_FILE;
+}
+
+static inline int is_active_lru(enum lru_list l)
+{
+	return l & LRU_ACTIVE;
+}
+
 #define ZONE_DMA		0
 #define ZONE_NORMAL		1
 #define ZONE_HIGHMEM		2
@@ -130,17 +168,32 @@ struct zone {
 	spinlock_t		lock;
 	struct free_area	free_area[MAX_ORDER];
 
+	/*
+	 * Free pages kzerod has zeroed for __GFP_ZERO allocations, up to
+	 * sysctl_prezero_pages.  They count in free_pages, not free_area.
+	 */
+	struct list_head	zeroed_list;
+	unsigned long		nr_zeroed;
+
 
 	ZONE_PADDING(_pad1_)
 
 	/* Fields commonly accessed by the page reclaim scanner */
 	spinlock_t		lru_lock;	
-	struct list_head	active_list;
-	struct list_head	inactive_list;
-	unsigned long		nr_scan_active;
-	unsigned long		nr_scan_inactive;
-	unsigned long		nr_active;
-	unsigned long		nr_inactive;
+	struct list_head	lru[NR_LRU_LISTS];
+	unsigned long		nr_scan[NR_LRU_LISTS];
+	unsigned long		nr_lru[NR_LRU_LISTS];
+
+	/*
+	 * How many anon (index 0) and file (index 1) pages reclaim has
+	 * recently scanned, and how many of those it had to put back on
+	 * the active list because they were in use.  The ratio tells
+	 * shrink_zone() which kind of page is cheaper to reclaim.  Both
+	 * are decayed as they grow, and protected by lru_lock.
+	 */
+	unsigned long		recent_scanned[2];
+	unsigned long		recent_rotated[2];
+
 	unsigned long		pages_scanned;	   /* since last reclaim */
 	int			all_unreclaimable; /* All pages pinned */
 
@@ -151,8 +204,7 @@ struct zone {
 	 * invokation.
 	 *
 	 * We use prev_priority as a measure of how much stress page reclaim is
-	 * under - it drives the swappiness decision: whether to unmap mapped
-	 * pages.
+	 * under - it drives the decision whether to unmap mapped file pages.
 	 *
 	 * temp_priority is used to remember the scanning priority at which
 	 * this zone was successfully refilled to free_pages == pages_high.
@@ -378,6 +430,12 @@ int min_free_kbytes_sysctl_handler(struct ctl_table *, int, struct file *,
 extern int sysctl_lowmem_reserve_ratio[MAX_NR_ZONES-1];
 int lowmem_reserve_ratio_sysctl_handler(struct ctl_table *, int, struct file *,
 					void __user *, size_t *, loff_t *);
+extern int percpu_pagelist_fraction;
+int percpu_pagelist_fraction_sysctl_handler(struct ctl_table *, int,
+			struct file *, void __user *, size_t *, loff_t *);
+extern int sysctl_prezero_pages;
+int prezero_pages_sysctl_handler(struct ctl_table *, int,
+			struct file *, void __user *, size_t *, loff_t *);
 
 #include <linux/topology.h>
 /* Returns the number of the current Node. */
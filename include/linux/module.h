@@ -429,6 +429,9 @@ int unregister_module_notifier(struct notifier_block * nb);
 
 extern void print_modules(void);
 
+/* Sort the kernel's export tables, for binary search */
+void sort_main_ksymtab(void);
+
 struct device_driver;
 void module_add_driver(struct module *, struct device_driver *);
 void module_remove_driver(struct device_driver *);
@@ -533,6 +536,10 @@ static inline void module_remove_driver(struct device_driver *driver)
 {
 }
 
+static inline void sort_main_ksymtab(void)
+{
+}
+
 #endif /* CONFIG_MODULES */
 
 #define symbol_request(x) try_then_request_module(symbol_get(x), "symbol:" #x)
@@ -15,6 +15,9 @@ typedef int (writepage_t)(struct page *page, struct writeback_control *wbc);
 
 int mpage_readpages(struct address_space *mapping, struct list_head *pages,
 				unsigned nr_pages, get_block_t get_block);
+int mpage_readpages_blocks(struct address_space *mapping,
+		struct list_head *pages, unsigned nr_pages,
+		get_block_t get_block, get_blocks_t get_blocks);
 int mpage_readpage(struct page *page, get_block_t get_block);
 int mpage_writepages(struct address_space *mapping,
 		struct writeback_control *wbc, get_block_t get_block);
@@ -23,6 +26,9 @@ int mpage_writepage(struct page *page, get_block_t *get_block,
 int __mpage_writepages(struct address_space *mapping,
 		struct writeback_control *wbc, get_block_t get_block,
 		writepage_t writepage);
+int mpage_writepages_blocks(struct address_space *mapping,
+		struct writeback_control *wbc, get_blocks_t get_blocks,
+		writepage_t writepage);
 
 static inline int
 generic_writepages(struct address_space *mapping, struct writeback_control *wbc)
@@ -32,6 +32,13 @@ struct mq_attr {
 	long	__reserved[4];	/* ignored for input, zeroed for output */
 };
 
+/* One message of mq_timedsendv() or mq_timedreceivev() */
+struct mq_mmsg {
+	void	__user *msg_ptr;
+	size_t	msg_len;	/* to send; buffer size, then size received	*/
+	unsigned int msg_prio;	/* to send; received				*/
+};
+
 /*
  * SIGEV_THREAD implementation:
  * SIGEV_THREAD must be implemented in user space. If SIGEV_THREAD is passed
@@ -0,0 +1,71 @@
+/*
+ * include/linux/mutex.h: sleeping mutual exclusion locks, see kernel/mutex.c
+ *
+ * Unlike a semaphore a mutex has one owner, which has to be the one to
+ * unlock it, and it cannot count above one.  In exchange the contended
+ * case can spin while the owner runs on another CPU, rather than put
+ * the waiter to sleep straight away.
+ */
+
+#ifndef _LINUX_MUTEX_H
+#define _LINUX_MUTEX_H
+
+#ifdef __KERNEL__
+
+#include <linux/config.h>
+#include <linux/list.h>
+#include <linux/spinlock.h>
+#include <asm/system.h>
+#include <asm/atomic.h>
+
+struct thread_info;
+
+struct mutex {
+	/* 1: unlocked, 0: locked, negative: locked, possible waiters */
+	atomic_t		count;
+	spinlock_t		wait_lock;
+	struct list_head	wait_list;
+	struct thread_info	*owner;		/* while locked, or NULL */
+};
+
+#define __MUTEX_INITIALIZER(name)					\
+	{								\
+		.count		= ATOMIC_INIT(1),			\
+		.wait_lock	= SPIN_LOCK_UNLOCKED,			\
+		.wait_list	= LIST_HEAD_INIT(name.wait_list),	\
+		.owner		= NULL,					\
+	}
+
+#define DEFINE_MUTEX(name) \
+	struct mutex name = __MUTEX_INITIALIZER(name)
+
+static inline void mutex_init(struct mutex *lock)
+{
+	atomic_set(&lock->count, 1);
+	spin_lock_init(&lock->wait_lock);
+	INIT_LIST_HEAD(&lock->wait_list);
+	lock->owner = NULL;
+}
+
+static inline int mutex_is_locked(struct mutex *lock)
+{
+	return atomic_read(&lock->count) != 1;
+}
+
+extern void FASTCALL(mutex_lock(struct mutex *lock));
+extern int FASTCALL(mutex_lock_interruptible(struct mutex *lock));
+/* returns 1 if it got the mutex, 0 if it is taken */
+extern int FASTCALL(mutex_trylock(struct mutex *lock));
+extern void FASTCALL(mutex_unlock(struct mutex *lock));
+
+/*
+ * Spinning needs cmpxchg to take the lock without losing the waiters'
+ * mark, and spin_on_owner() of sched.h.
+ */
+#if defined(CONFIG_SMP) && defined(__HAVE_ARCH_CMPXCHG) && \
+	!defined(CONFIG_DEBUG_PAGEALLOC)
+#define MUTEX_SPIN_ON_OWNER
+#endif
+
+#endif /* __KERNEL__ */
+#endif /* _LINUX_MUTEX_H */
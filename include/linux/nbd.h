@@ -10,6 +10,9 @@
  *            Cleanup PARANOIA usage & code.
  * 2004/02/19 Paul Clements
  *            Removed PARANOIA, plus various cleanup and comments
+ *
+ * NBD_SET_SOCK may be given up to NBD_MAX_SOCKS connections to the same
+ * server before NBD_DO_IT; requests are spread over all of them.
  */
 
 #ifndef LINUX_NBD_H
@@ -40,16 +43,26 @@ enum {
 /* values for flags field */
 #define NBD_READ_ONLY 0x0001
 #define NBD_WRITE_NOCHK 0x0002
+#define NBD_RUNNING 0x0004	/* in NBD_DO_IT */
+
+#define NBD_MAX_SOCKS 8
+
+/* One connection to the server */
+struct nbd_sock {
+	struct socket * sock;
+	struct file * file;
+	struct semaphore tx_lock;
+};
 
 struct nbd_device {
 	int flags;
 	int harderror;		/* Code of hard error			*/
-	struct socket * sock;
-	struct file * file; 	/* If == NULL, device is not ready, yet	*/
+	struct nbd_sock socks[NBD_MAX_SOCKS];
+	int nr_socks;		/* If == 0, device is not ready, yet	*/
+	int next_sock;		/* Where the next request goes		*/
 	int magic;
 	spinlock_t queue_lock;
 	struct list_head queue_head;/* Requests are added here...	*/
-	struct semaphore tx_lock;
 	struct gendisk *disk;
 	int blksize;
 	u64 bytesize;
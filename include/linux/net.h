@@ -200,6 +200,8 @@ extern int   	     kernel_sendmsg(struct socket *sock, struct msghdr *msg,
 extern int   	     kernel_recvmsg(struct socket *sock, struct msghdr *msg,
 				    struct kvec *vec, size_t num,
 				    size_t len, int flags);
+extern int	     kernel_sendpage(struct socket *sock, struct page *page,
+				     int offset, size_t size, int flags);
 
 #ifndef CONFIG_SMP
 #define SOCKOPS_WRAPPED(name) name
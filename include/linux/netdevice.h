@@ -240,6 +240,18 @@ enum netdev_state_t
 };
 
 
+/*
+ * One hardware transmit queue of a NETIF_F_MULTI_QUEUE device.  Its
+ * lock is taken around hard_start_xmit() of the skbs mapped to it,
+ * instead of dev->xmit_lock.
+ */
+struct net_device_subqueue
+{
+	unsigned long		state;		/* __LINK_STATE_XOFF */
+	spinlock_t		xmit_lock;
+	int			xmit_lock_owner;
+} ____cacheline_aligned_in_smp;
+
 /*
  * This structure holds at boot time configured netdevice settings. They
  * are then used in the device probing. 
@@ -372,6 +384,9 @@ struct net_device
 	struct list_head	qdisc_list;
 	unsigned long		tx_queue_len;	/* Max frames per queue allowed */
 
+	/* Partially transmitted GSO packet, protected by queue_lock */
+	struct sk_buff		*gso_skb;
+
 	/* ingress path synchronizer */
 	spinlock_t		ingress_lock;
 	/* hard_start_xmit synchronizer */
@@ -380,6 +395,9 @@ struct net_device
 	   if nobody entered there.
 	 */
 	int			xmit_lock_owner;
+	/* hardware tx queues, see NETIF_F_MULTI_QUEUE */
+	struct net_device_subqueue *egress_subqueue;
+	unsigned short		egress_subqueue_count;
 	/* device queue lock */
 	spinlock_t		queue_lock;
 	/* Number of references to this device */
@@ -414,6 +432,9 @@ struct net_device
 #define NETIF_F_VLAN_CHALLENGED	1024	/* Device cannot handle VLAN packets */
 #define NETIF_F_TSO		2048	/* Can offload TCP/IP segmentation */
 #define NETIF_F_LLTX		4096	/* LockLess TX */
+#define NETIF_F_GSO		8192	/* Segment large sends in software */
+#define NETIF_F_GRO		16384	/* Merge received TCP segments */
+#define NETIF_F_MULTI_QUEUE	32768	/* Has several hardware tx queues */
 
 	/* Called after device is detached from network. */
 	void			(*uninit)(struct net_device *dev);
@@ -507,10 +528,38 @@ struct packet_type {
 	struct net_device		*dev;	/* NULL is wildcarded here		*/
 	int			(*func) (struct sk_buff *, struct net_device *,
 					 struct packet_type *);
+	struct sk_buff		*(*gso_segment)(struct sk_buff *skb,
+						int features);
+	int			(*gro_receive)(struct sk_buff *held,
+					       struct sk_buff *skb);
+	void			(*gro_complete)(struct sk_buff *skb);
 	void			*af_packet_priv;
 	struct list_head	list;
 };
 
+/* Return codes of the gro_receive hooks.  With held == NULL the hook
+ * only classifies skb, otherwise it tries to append skb to held.
+ */
+enum {
+	GRO_NORMAL,		/* not for aggregation, pass it up as is */
+	GRO_NOHOLD,		/* may end a held flow, but never held */
+	GRO_HOLD,		/* may start or extend a held flow */
+	GRO_NOMATCH,		/* held belongs to another flow */
+	GRO_MERGED,		/* skb was appended to held */
+	GRO_MERGED_FLUSH,	/* ditto, and held is complete now */
+	GRO_FLUSH,		/* same flow, pass held up before skb */
+};
+
+/* Per skb state of a held flow, kept in skb->cb until it is passed up */
+struct gro_cb {
+	struct sk_buff		*last;	/* tail of the frag_list chain */
+	int			count;	/* segments merged so far */
+	unsigned int		size;	/* payload of the first segment */
+	int			flush;	/* headers differ, do not merge */
+};
+
+#define GRO_CB(skb)	((struct gro_cb *)(skb)->cb)
+
 #include <linux/interrupt.h>
 #include <linux/notifier.h>
 
@@ -534,6 +583,9 @@ extern int		dev_alloc_name(struct net_device *dev, const char *name);
 extern int		dev_open(struct net_device *dev);
 extern int		dev_close(struct net_device *dev);
 extern int		dev_queue_xmit(struct sk_buff *skb);
+extern int		dev_hard_start_xmit(struct sk_buff *skb,
+					    struct net_device *dev);
+extern struct sk_buff	*skb_gso_segment(struct sk_buff *skb, int features);
 extern int		register_netdevice(struct net_device *dev);
 extern int		unregister_netdevice(struct net_device *dev);
 extern void		free_netdev(struct net_device *dev);
@@ -570,6 +622,10 @@ struct softnet_data
 	struct net_device	*output_queue;
 	struct sk_buff		*completion_queue;
 
+	/* Flows being merged by netif_gro_receive(), newest first */
+	struct sk_buff		*gro_list;
+	int			gro_count;
+
 	struct net_device	backlog_dev;	/* Sorry. 8) */
 };
 
@@ -627,11 +683,69 @@ static inline int netif_queue_stopped(const struct net_device *dev)
 	return test_bit(__LINK_STATE_XOFF, &dev->state);
 }
 
+/*
+ * Flow control of the hardware queues of a NETIF_F_MULTI_QUEUE device.
+ * An skb is sent on dev->egress_subqueue[skb->queue_mapping], and the
+ * driver stops and wakes that queue instead of the whole device.
+ */
+static inline void netif_start_subqueue(struct net_device *dev, u16 queue_index)
+{
+	clear_bit(__LINK_STATE_XOFF, &dev->egress_subqueue[queue_index].state);
+}
+
+static inline void netif_stop_subqueue(struct net_device *dev, u16 queue_index)
+{
+#ifdef CONFIG_NETPOLL_TRAP
+	if (netpoll_trap())
+		return;
+#endif
+	set_bit(__LINK_STATE_XOFF, &dev->egress_subqueue[queue_index].state);
+}
+
+static inline void netif_wake_subqueue(struct net_device *dev, u16 queue_index)
+{
+#ifdef CONFIG_NETPOLL_TRAP
+	if (netpoll_trap())
+		return;
+#endif
+	if (test_and_clear_bit(__LINK_STATE_XOFF,
+			       &dev->egress_subqueue[queue_index].state))
+		__netif_schedule(dev);
+}
+
+static inline int __netif_subqueue_stopped(const struct net_device *dev,
+					   u16 queue_index)
+{
+	return test_bit(__LINK_STATE_XOFF,
+			&dev->egress_subqueue[queue_index].state);
+}
+
+/* Can the driver take skb now?  Caller holds its transmit lock. */
+static inline int netif_tx_stopped(const struct net_device *dev,
+				   const struct sk_buff *skb)
+{
+	return netif_queue_stopped(dev) ||
+	       ((dev->features & NETIF_F_MULTI_QUEUE) &&
+		__netif_subqueue_stopped(dev, skb->queue_mapping));
+}
+
 static inline int netif_running(const struct net_device *dev)
 {
 	return test_bit(__LINK_STATE_START, &dev->state);
 }
 
+/* A large send the device cannot segment itself is cut up in software
+ * just before it is handed to the driver.  NETIF_F_TSO only covers
+ * TCP over IPv4.
+ */
+static inline int netif_needs_gso(const struct net_device *dev,
+				  const struct sk_buff *skb)
+{
+	return skb_shinfo(skb)->tso_size &&
+	       (!(dev->features & NETIF_F_TSO) ||
+		skb->protocol != htons(ETH_P_IP));
+}
+
 
 /* Use this variant when it is known for sure that it
  * is executing from interrupt context.
@@ -667,6 +781,9 @@ extern int		netif_rx(struct sk_buff *skb);
 extern int		netif_rx_ni(struct sk_buff *skb);
 #define HAVE_NETIF_RECEIVE_SKB 1
 extern int		netif_receive_skb(struct sk_buff *skb);
+extern int		netif_gro_receive(struct sk_buff *skb);
+extern void		skb_gro_append(struct sk_buff *held,
+				       struct sk_buff *skb);
 extern int		dev_ioctl(unsigned int cmd, void __user *);
 extern int		dev_ethtool(struct ifreq *);
 extern unsigned		dev_get_flags(const struct net_device *);
@@ -891,9 +1008,19 @@ static inline void __netif_rx_complete(struct net_device *dev)
 
 static inline void netif_tx_disable(struct net_device *dev)
 {
+	int i;
+
 	spin_lock_bh(&dev->xmit_lock);
 	netif_stop_queue(dev);
 	spin_unlock_bh(&dev->xmit_lock);
+
+	/* Wait for transmits already in progress on the hardware queues */
+	if (dev->features & NETIF_F_MULTI_QUEUE) {
+		for (i = 0; i < dev->egress_subqueue_count; i++) {
+			spin_lock_bh(&dev->egress_subqueue[i].xmit_lock);
+			spin_unlock_bh(&dev->egress_subqueue[i].xmit_lock);
+		}
+	}
 }
 
 /* These functions live elsewhere (drivers/net/net_init.c, but related) */
@@ -901,8 +1028,11 @@ static inline void netif_tx_disable(struct net_device *dev)
 extern void		ether_setup(struct net_device *dev);
 
 /* Support for loadable net-drivers */
-extern struct net_device *alloc_netdev(int sizeof_priv, const char *name,
-				       void (*setup)(struct net_device *));
+extern struct net_device *alloc_netdev_mq(int sizeof_priv, const char *name,
+				       void (*setup)(struct net_device *),
+				       unsigned int queue_count);
+#define alloc_netdev(sizeof_priv, name, setup) \
+	alloc_netdev_mq(sizeof_priv, name, setup, 1)
 extern int		register_netdev(struct net_device *dev);
 extern void		unregister_netdev(struct net_device *dev);
 /* Functions used for multicast support */
@@ -72,6 +72,7 @@ enum ip_conntrack_status {
 #include <linux/netfilter_ipv4/ip_conntrack_tuple.h>
 #include <linux/bitops.h>
 #include <linux/compiler.h>
+#include <linux/rcupdate.h>
 #include <asm/atomic.h>
 
 #include <linux/netfilter_ipv4/ip_conntrack_tcp.h>
@@ -177,6 +178,8 @@ struct ip_conntrack
 	/* Traversed often, so hopefully in different cacheline to top */
 	/* These are my tuples; original and reply */
 	struct ip_conntrack_tuple_hash tuplehash[IP_CT_DIR_MAX];
+	/* Lookups walk the hash without locks, so freeing waits for RCU */
+	struct rcu_head rcu;
 };
 
 struct ip_conntrack_expect
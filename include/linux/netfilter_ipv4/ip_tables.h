@@ -443,10 +443,7 @@ struct ipt_table
 	/* What hooks you will enter on */
 	unsigned int valid_hooks;
 
-	/* Lock for the curtain */
-	rwlock_t lock;
-
-	/* Man behind the curtain... */
+	/* Man behind the curtain: replaced under RCU */
 	struct ipt_table_info *private;
 
 	/* Set to THIS_MODULE. */
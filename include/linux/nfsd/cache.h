@@ -15,11 +15,9 @@
 #include <linux/uio.h>
 
 /*
- * Representation of a reply cache entry. The first two members *must*
- * be hash_next and hash_prev.
+ * Representation of a reply cache entry.
  */
 struct svc_cacherep {
-	struct hlist_node	c_hash;
 	struct list_head	c_lru;
 
 	unsigned char		c_state,	/* unused, inprog, done */
@@ -30,6 +28,8 @@ struct svc_cacherep {
 	u32			c_prot;
 	u32			c_proc;
 	u32			c_vers;
+	u32			c_len;		/* length of the call */
+	u32			c_csum;		/* checksum of its arguments */
 	unsigned long		c_timestamp;
 	union {
 		struct kvec	u_vec;
@@ -68,6 +68,10 @@ void oprofile_add_pc(unsigned long pc, int is_kernel, unsigned long event);
 /* add a backtrace entry, to be called from the ->backtrace callback */
 void oprofile_add_trace(unsigned long eip);
 
+/* the following backtrace entries are kernel (1) or user (0) addresses,
+ * for a backtrace that goes on from the kernel stack to the user stack */
+void oprofile_trace_mode(int is_kernel);
+
 
 /**
  * Create a file of the given name as a child of the given root, with
@@ -44,6 +44,15 @@
  * space, they need to be kmapped separately for doing IO on the pages.  The
  * struct page (these bits with information) are always mapped into kernel
  * address space...
+ *
+ * PG_swapbacked is set on anonymous and shmem pages before they are first
+ * put on the LRU, and cleared when the page is next allocated.  It selects
+ * the zone's anon LRU lists rather than the file ones and must not change
+ * while the page is on an LRU list.
+ *
+ * PG_ptshared is set on a page table page when it is first shared between
+ * mms (see share_page_table in mm/memory.c).  The ptes in it are then not
+ * counted in any mm's rss, until a single mm is left to take them back.
  */
 
 /*
@@ -76,10 +85,16 @@
 #define PG_reclaim		18	/* To be reclaimed asap */
 #define PG_nosave_free		19	/* Free, should not be written */
 #define PG_uncached		20	/* Page has been mapped as uncached */
+#define PG_swapbacked		21	/* Anon or shmem: goes on the anon LRU */
+#define PG_ptshared		22	/* Page table: ptes out of rss, may be shared */
 
 /*
  * Global page accounting.  One instance per CPU.  Only unsigned longs are
  * allowed.
+ *
+ * The in-use counters up to GET_PAGE_STATE_LAST are kept as small per-cpu
+ * deltas which are folded into global totals, so reading them is cheap
+ * and approximate.  The event counters after them are summed on read.
  */
 struct page_state {
 	unsigned long nr_dirty;		/* Dirty writeable pages */
@@ -131,6 +146,12 @@ struct page_state {
 	unsigned long allocstall;	/* direct reclaim calls */
 
 	unsigned long pgrotated;	/* pages rotated to tail of the LRU */
+	unsigned long pcp_refill;	/* per-cpu list refills from the buddy */
+	unsigned long pcp_drain;	/* per-cpu list batches freed to buddy */
+
+	unsigned long bh_lru_hit;	/* __find_get_block() found in bh LRU */
+	unsigned long bh_hash_hit;	/* ... in the per-cpu bh hash */
+	unsigned long bh_lru_miss;	/* ... had to search the pagecache */
 };
 
 extern void get_page_state(struct page_state *ret);
@@ -305,6 +326,14 @@ extern void __mod_page_state(unsigned offset, unsigned long delta);
 #define SetPageUncached(page)	set_bit(PG_uncached, &(page)->flags)
 #define ClearPageUncached(page)	clear_bit(PG_uncached, &(page)->flags)
 
+#define PageSwapBacked(page)	test_bit(PG_swapbacked, &(page)->flags)
+#define SetPageSwapBacked(page)	set_bit(PG_swapbacked, &(page)->flags)
+#define ClearPageSwapBacked(page) clear_bit(PG_swapbacked, &(page)->flags)
+
+#define PagePtShared(page)	test_bit(PG_ptshared, &(page)->flags)
+#define SetPagePtShared(page)	set_bit(PG_ptshared, &(page)->flags)
+#define ClearPagePtShared(page)	clear_bit(PG_ptshared, &(page)->flags)
+
 struct page;	/* forward declaration */
 
 int test_clear_page_dirty(struct page *page);
@@ -50,14 +50,71 @@ static inline void mapping_set_gfp_mask(struct address_space *m, int mask)
 #define page_cache_release(page)	put_page(page)
 void release_pages(struct page **pages, int nr, int cold);
 
+#ifdef __HAVE_ARCH_CMPXCHG
+/*
+ * find_get_page() and find_get_pages() look pages up without the
+ * tree_lock.  The page they find may be freed, or even reused, before
+ * they get to take a reference, so the reference is only taken if the
+ * page is not free, and the caller then checks that the page is still
+ * in the slot it was found in.
+ *
+ * Code which removes a page from the pagecache only if nobody else
+ * holds a reference uses page_freeze_refs() under the tree_lock.  It
+ * makes the count look like that of a free page, so no new reference
+ * can be taken until page_unfreeze_refs().
+ */
+#define PAGECACHE_LOCKLESS
+
+static inline int page_cache_get_speculative(struct page *page)
+{
+	int count = atomic_read(&page->_count);
+	int old;
+
+	for (;;) {
+		if (unlikely(count == -1))	/* free, or frozen */
+			return 0;
+		old = cmpxchg(&page->_count.counter, count, count + 1);
+		if (likely(old == count))
+			return 1;
+		count = old;
+	}
+}
+
+static inline int page_freeze_refs(struct page *page, int count)
+{
+	return cmpxchg(&page->_count.counter, count - 1, -1) == count - 1;
+}
+#else
+/* Lookups hold the tree_lock, which the callers of this hold for writing */
+static inline int page_freeze_refs(struct page *page, int count)
+{
+	return page_count(page) == count;
+}
+#endif
+
+static inline void page_unfreeze_refs(struct page *page, int count)
+{
+	smp_wmb();
+	set_page_count(page, count);
+}
+
+#ifdef CONFIG_NUMA
+extern struct page *__page_cache_alloc(unsigned int __nocast gfp);
+#else
+static inline struct page *__page_cache_alloc(unsigned int __nocast gfp)
+{
+	return alloc_pages(gfp, 0);
+}
+#endif
+
 static inline struct page *page_cache_alloc(struct address_space *x)
 {
-	return alloc_pages(mapping_gfp_mask(x), 0);
+	return __page_cache_alloc(mapping_gfp_mask(x));
 }
 
 static inline struct page *page_cache_alloc_cold(struct address_space *x)
 {
-	return alloc_pages(mapping_gfp_mask(x)|__GFP_COLD, 0);
+	return __page_cache_alloc(mapping_gfp_mask(x)|__GFP_COLD);
 }
 
 typedef int filler_t(void *, struct page *);
@@ -66,6 +123,8 @@ extern struct page * find_get_page(struct address_space *mapping,
 				unsigned long index);
 extern struct page * find_lock_page(struct address_space *mapping,
 				unsigned long index);
+extern struct page * find_lock_entry(struct address_space *mapping,
+				unsigned long index);
 extern struct page * find_trylock_page(struct address_space *mapping,
 				unsigned long index);
 extern struct page * find_or_create_page(struct address_space *mapping,
@@ -95,8 +154,15 @@ int add_to_page_cache(struct page *page, struct address_space *mapping,
 				unsigned long index, int gfp_mask);
 int add_to_page_cache_lru(struct page *page, struct address_space *mapping,
 				unsigned long index, int gfp_mask);
+int add_to_page_cache_swapped(struct page *page, struct address_space *mapping,
+				unsigned long index, void *entry);
 extern void remove_from_page_cache(struct page *page);
 extern void __remove_from_page_cache(struct page *page);
+extern void __remove_from_page_cache_swapped(struct page *page, void *entry);
+extern void remove_from_page_cache_batch(struct address_space *mapping,
+				struct page **pages, int nr);
+extern void __remove_from_page_cache_batch(struct address_space *mapping,
+				struct page **pages, int nr);
 
 extern atomic_t nr_pagecache;
 
@@ -161,6 +227,7 @@ static inline pgoff_t linear_page_index(struct vm_area_struct *vma,
 
 extern void FASTCALL(__lock_page(struct page *page));
 extern void FASTCALL(unlock_page(struct page *page));
+extern int FASTCALL(lock_page_async(struct page *page, wait_queue_t *wait));
 
 static inline void lock_page(struct page *page)
 {
@@ -174,6 +241,8 @@ static inline void lock_page(struct page *page)
  * Never use this directly!
  */
 extern void FASTCALL(wait_on_page_bit(struct page *page, int bit_nr));
+extern int FASTCALL(wait_on_page_bit_async(struct page *page, int bit_nr,
+					   wait_queue_t *wait));
 
 /* 
  * Wait for a page to be unlocked.
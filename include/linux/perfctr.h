@@ -0,0 +1,152 @@
+#ifndef _LINUX_PERFCTR_H
+#define _LINUX_PERFCTR_H
+
+/*
+ * Hardware performance counters, see kernel/perfctr.c.
+ *
+ * perfctr_open(attr, 0, -1) counts for the calling thread only, across
+ * context switches; perfctr_open(attr, -1, cpu) counts everything on a
+ * CPU and needs CAP_SYS_ADMIN.  read() of the returned descriptor gives
+ * the count as a __u64.
+ *
+ * mmap() of the descriptor gives a struct perfctr_mmap page, then the
+ * sample_pages pages of struct perfctr_sample.  A thread reads its own
+ * counter from it without a system call:
+ *
+ *	do {
+ *		seq = pc->seq;
+ *		rmb();
+ *		count = pc->offset;
+ *		if (pc->index)
+ *			count += sign_extend(rdpmc(pc->index - 1), pc->width);
+ *		rmb();
+ *	} while ((seq & 1) || pc->seq != seq);
+ *
+ * With a sample_period, every sample_period events the interrupted ip is
+ * written at data_head % (number of samples) and data_head is
+ * incremented, overwriting the oldest samples.
+ */
+
+#include <linux/types.h>
+
+/* perfctr_attr.type */
+enum perfctr_type {
+	PERFCTR_CYCLES,
+	PERFCTR_INSTRUCTIONS,
+	PERFCTR_CACHE_MISSES,	/* of the last level cache, where counted */
+	PERFCTR_BRANCH_MISSES,
+	PERFCTR_RAW,		/* model specific event select in config */
+	PERFCTR_TYPE_MAX,
+};
+
+/* perfctr_attr.flags */
+#define PERFCTR_EXCLUDE_USER	1
+#define PERFCTR_EXCLUDE_KERNEL	2
+
+struct perfctr_attr {
+	__u32 type;
+	__u32 flags;
+	__u64 config;
+	__u64 sample_period;	/* 0 only counts */
+	__u32 sample_pages;	/* a power of 2, with a sample_period */
+	__u32 pad;
+};
+
+struct perfctr_mmap {
+	__u32 seq;		/* odd while the kernel updates the rest */
+	__u32 index;		/* rdpmc index + 1 while counting, or 0 */
+	__s64 offset;
+	__u32 width;		/* significant bits of rdpmc */
+	__u32 pad;
+	__u64 data_head;	/* samples written */
+};
+
+struct perfctr_sample {
+	__u64 ip;
+	__u32 pid;
+	__u32 cpu;
+};
+
+#ifdef __KERNEL__
+
+#include <linux/config.h>
+#include <linux/list.h>
+#include <linux/spinlock.h>
+#include <linux/sched.h>
+#include <linux/err.h>
+
+#define PERFCTR_MAX_COUNTERS	4
+/* the counters are written as 32bit, sign extended values */
+#define PERFCTR_MAX_PERIOD	(1ULL << 31)
+
+struct pt_regs;
+struct task_struct;
+struct perfctr;
+
+/*
+ * The counters of a CPU model.  Their methods are called with
+ * interrupts off, on the CPU whose counter @hw is meant.
+ */
+struct perfctr_pmu {
+	const char	*name;
+	int		num_counters;
+	int		width;		/* bits of a counter */
+	/* the event select for @attr, or -EINVAL */
+	int		(*event)(struct perfctr_attr *attr, u64 *evntsel);
+	/* take over the counters and their interrupt, and give them back */
+	int		(*reserve)(void);
+	void		(*release)(void);
+	/* count from -@left on, with the interrupt on overflow */
+	void		(*start)(int hw, u64 evntsel, u64 left);
+	void		(*stop)(int hw);
+	u64		(*read)(int hw);
+};
+
+/* the counters of a thread, task->perfctr */
+struct perfctr_context {
+	spinlock_t		lock;
+	struct list_head	counters;
+};
+
+#ifdef CONFIG_PERFCTR
+extern int perfctr_register_pmu(struct perfctr_pmu *pmu);
+/* from the overflow interrupt */
+extern void perfctr_overflow(struct pt_regs *regs);
+
+/* counters of the kernel itself, which interrupt every sample_period */
+extern struct perfctr *perfctr_create_kernel(struct perfctr_attr *attr, int cpu,
+		void (*overflow)(struct perfctr *ctr, struct pt_regs *regs));
+extern void perfctr_release_kernel(struct perfctr *ctr);
+
+extern void __perfctr_task_switch(struct task_struct *prev,
+				  struct task_struct *next);
+extern void perfctr_exit_task(struct task_struct *tsk);
+
+/* from schedule(), with interrupts off */
+static inline void perfctr_task_switch(struct task_struct *prev,
+				       struct task_struct *next)
+{
+	if (unlikely(prev->perfctr || next->perfctr))
+		__perfctr_task_switch(prev, next);
+}
+#else
+static inline struct perfctr *perfctr_create_kernel(struct perfctr_attr *attr,
+		int cpu, void (*overflow)(struct perfctr *, struct pt_regs *))
+{
+	return ERR_PTR(-ENODEV);
+}
+static inline void perfctr_release_kernel(struct perfctr *ctr)
+{
+}
+static inline void perfctr_task_switch(struct task_struct *prev,
+				       struct task_struct *next)
+{
+}
+static inline void perfctr_exit_task(struct task_struct *tsk)
+{
+}
+#endif
+
+#endif /* __KERNEL__ */
+
+#endif /* _LINUX_PERFCTR_H */
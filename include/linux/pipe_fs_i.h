@@ -9,13 +9,21 @@ struct pipe_buffer {
 	struct page *page;
 	unsigned int offset, len;
 	struct pipe_buf_operations *ops;
+	unsigned int flags;
 };
 
+#define PIPE_BUF_FLAG_ATOMIC	0x01	/* mapped with kmap_atomic() */
+
+/*
+ * ->map() with atomic set maps the page with kmap_atomic(), to be copied
+ * from or to without sleeping; ->unmap() gets the address back.
+ */
 struct pipe_buf_operations {
 	int can_merge;
-	void * (*map)(struct file *, struct pipe_inode_info *, struct pipe_buffer *);
-	void (*unmap)(struct pipe_inode_info *, struct pipe_buffer *);
+	void * (*map)(struct file *, struct pipe_inode_info *, struct pipe_buffer *, int atomic);
+	void (*unmap)(struct pipe_inode_info *, struct pipe_buffer *, void *);
 	void (*release)(struct pipe_inode_info *, struct pipe_buffer *);
+	void (*get)(struct pipe_inode_info *, struct pipe_buffer *);
 };
 
 struct pipe_inode_info {
@@ -56,4 +64,16 @@ void pipe_wait(struct inode * inode);
 struct inode* pipe_new(struct inode* inode);
 void free_pipe_info(struct inode* inode);
 
+extern struct pipe_buf_operations anon_pipe_buf_ops;
+
+void *generic_pipe_buf_map(struct file *, struct pipe_inode_info *, struct pipe_buffer *, int);
+void generic_pipe_buf_unmap(struct pipe_inode_info *, struct pipe_buffer *, void *);
+
+/*
+ * Flags passed in from splice/tee
+ */
+#define SPLICE_F_MOVE		(0x01)	/* move pages instead of copying */
+#define SPLICE_F_NONBLOCK	(0x02)	/* don't block on the pipe splicing */
+#define SPLICE_F_MORE		(0x04)	/* expect more data */
+
 #endif
@@ -36,10 +36,22 @@ static inline void init_poll_funcptr(poll_table *pt, poll_queue_proc qproc)
 /*
  * Structures and helpers for sys_poll/sys_poll
  */
+struct poll_table_entry {
+	struct file * filp;
+	wait_queue_t wait;
+	wait_queue_head_t * wait_address;
+};
+
+/* Entries taken from the poll_wqueues itself, on the stack of the poller,
+ * before whole pages are allocated for them. */
+#define N_INLINE_POLL_ENTRIES	(512 / sizeof(struct poll_table_entry))
+
 struct poll_wqueues {
 	poll_table pt;
 	struct poll_table_page * table;
 	int error;
+	int inline_index;
+	struct poll_table_entry inline_entries[N_INLINE_POLL_ENTRIES];
 };
 
 extern void poll_initwait(struct poll_wqueues *pwq);
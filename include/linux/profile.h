@@ -1,6 +1,35 @@
 #ifndef _LINUX_PROFILE_H
 #define _LINUX_PROFILE_H
 
+#include <linux/types.h>
+
+/*
+ * /proc/profile_callers: the header, then nr_entries entries, in no
+ * particular order.  See kernel/profile.c.
+ */
+#define PROFILE_CALLERS_MAGIC	0x70726366	/* "prcf" */
+#define PROFILE_CALLERS_VERSION	1
+
+/* profile_callers_header.source */
+#define PROFILE_CALLERS_OFF	0
+#define PROFILE_CALLERS_HRTIMER	1
+#define PROFILE_CALLERS_NMI	2
+
+struct profile_callers_header {
+	__u32 magic;
+	__u32 version;
+	__u32 source;		/* the current one */
+	__u32 nr_entries;
+	__u64 period;		/* hrtimer ns or NMI cycles between samples */
+	__u64 lost;		/* samples for which there was no room */
+};
+
+struct profile_callers_entry {
+	__u64 function;		/* start of the function hit */
+	__u64 caller;		/* return address into its caller, or 0 */
+	__u64 hits;
+};
+
 #ifdef __KERNEL__
 
 #include <linux/kernel.h>
@@ -220,6 +220,7 @@ struct dquot {
 	loff_t dq_off;			/* Offset of dquot on disk */
 	unsigned long dq_flags;		/* See DQ_* */
 	short dq_type;			/* Type of quota */
+	spinlock_t dq_dqb_lock;		/* Protects dq_dqb */
 	struct mem_dqblk dq_dqb;	/* Diskquota usage */
 };
 
@@ -28,6 +28,21 @@ struct radix_tree_root {
 	struct radix_tree_node	*rnode;
 };
 
+/*
+ * A user of the tree may store values other than pointers in it by
+ * setting RADIX_TREE_EXCEPTIONAL_ENTRY, a bit which is always clear in
+ * the pointers to the aligned objects stored otherwise, and keeping the
+ * value itself above RADIX_TREE_EXCEPTIONAL_SHIFT.  The tree does not
+ * look at its items, those who walk it have to tell them apart.
+ */
+#define RADIX_TREE_EXCEPTIONAL_ENTRY	2
+#define RADIX_TREE_EXCEPTIONAL_SHIFT	2
+
+static inline int radix_tree_exceptional_entry(void *arg)
+{
+	return (unsigned long)arg & RADIX_TREE_EXCEPTIONAL_ENTRY;
+}
+
 #define RADIX_TREE_INIT(mask)	{					\
 	.height = 0,							\
 	.gfp_mask = (mask),						\
@@ -44,12 +59,26 @@ do {									\
 	(root)->rnode = NULL;						\
 } while (0)
 
+/*
+ * Changes to a tree need to be serialised by the user.  radix_tree_lookup(),
+ * radix_tree_lookup_slot() and the untagged gang lookups may also run
+ * under rcu_read_lock() alone: they then see each slot either before or
+ * after a concurrent change, and the nodes they walk are not freed before
+ * rcu_read_unlock().  The tag functions always need the lock.
+ */
 int radix_tree_insert(struct radix_tree_root *, unsigned long, void *);
 void *radix_tree_lookup(struct radix_tree_root *, unsigned long);
+void **radix_tree_lookup_slot(struct radix_tree_root *, unsigned long);
 void *radix_tree_delete(struct radix_tree_root *, unsigned long);
+unsigned int radix_tree_gang_delete(struct radix_tree_root *root,
+			unsigned long *indices, unsigned int nr);
 unsigned int
 radix_tree_gang_lookup(struct radix_tree_root *root, void **results,
 			unsigned long first_index, unsigned int max_items);
+unsigned int
+radix_tree_gang_lookup_slot(struct radix_tree_root *root, void ***results,
+			unsigned long *indices, unsigned long first_index,
+			unsigned int max_items);
 int radix_tree_preload(int gfp_mask);
 void radix_tree_init(void);
 void *radix_tree_tag_set(struct radix_tree_root *root,
@@ -0,0 +1,148 @@
+#ifndef _ASYNC_TX_H
+#define _ASYNC_TX_H
+
+/*
+ * Asynchronous memory transactions for the RAID personalities: xor,
+ * memcpy and RAID-6 P+Q generation.
+ *
+ * An operation goes to the first registered engine that can do it.  An
+ * engine queues it behind everything submitted to it before and returns
+ * a transaction, which the caller waits for or passes as the dependency
+ * of its next operation.  When there is no engine, or the engine cannot
+ * take the operation, the CPU does it before the call returns, using the
+ * xor template or raid6 routine benchmarked at boot, and the call
+ * returns NULL.  A NULL dependency means there is nothing to wait for.
+ *
+ * Pages must be lowmem for xor and P+Q; memcpy takes any page.
+ */
+
+#include <linux/list.h>
+#include <linux/mm.h>
+#include <asm/atomic.h>
+
+enum async_tx_flags {
+	ASYNC_TX_XOR_ZERO_DST	= (1 << 0), /* else dest is a source too */
+	ASYNC_TX_ACK		= (1 << 1), /* caller won't look at the tx */
+	ASYNC_TX_DEP_ACK	= (1 << 2), /* ack depend_tx once submitted */
+};
+
+typedef void (*async_tx_callback)(void *param);
+
+struct async_tx_engine;
+
+/*
+ * Embedded in the engine's own descriptor.  A transaction is freed once
+ * the engine completed it and the submitter acked it.
+ */
+struct async_tx {
+	struct async_tx_engine	*engine;
+	unsigned long		state;
+	atomic_t		count;
+	async_tx_callback	callback;
+	void			*callback_param;
+};
+
+/* tx->state bits */
+#define ASYNC_TX_COMPLETE	0
+
+/* engine capabilities */
+#define ASYNC_TX_CAP_MEMCPY	(1 << 0)
+#define ASYNC_TX_CAP_XOR	(1 << 1)
+#define ASYNC_TX_CAP_PQ		(1 << 2)
+
+/*
+ * All methods may be called in atomic context.  An engine unregisters
+ * only once nothing it was given is still in flight.
+ */
+struct async_tx_engine {
+	const char		*name;
+	struct list_head	node;
+	unsigned long		cap;
+	int			max_xor;	/* sources per xor */
+
+	/*
+	 * Prepare a descriptor and set it up with async_tx_init(), or
+	 * return NULL to have the CPU do this one.
+	 */
+	struct async_tx *(*prep_memcpy)(struct async_tx_engine *,
+					struct page *dest,
+					unsigned int dest_offset,
+					struct page *src,
+					unsigned int src_offset, size_t len);
+	struct async_tx *(*prep_xor)(struct async_tx_engine *,
+				     struct page *dest,
+				     struct page **src_list, int src_cnt,
+				     unsigned int offset, size_t len,
+				     int zero_dst);
+	/* blocks[disks - 2] is P, blocks[disks - 1] is Q */
+	struct async_tx *(*prep_pq)(struct async_tx_engine *,
+				    struct page **blocks, int disks,
+				    unsigned int offset, size_t len);
+
+	/* queue a prepared descriptor behind the ones submitted before */
+	void (*submit)(struct async_tx *);
+	/* start what has been queued */
+	void (*issue_pending)(struct async_tx_engine *);
+	/* reap completions for a caller spinning on one, may be NULL */
+	void (*poll)(struct async_tx_engine *);
+	/* give back a descriptor which is complete and acked */
+	void (*free)(struct async_tx *);
+};
+
+extern int async_tx_register_engine(struct async_tx_engine *engine);
+extern void async_tx_unregister_engine(struct async_tx_engine *engine);
+extern struct async_tx_engine *async_tx_find_engine(unsigned long cap);
+
+static inline void async_tx_init(struct async_tx *tx,
+				 struct async_tx_engine *engine)
+{
+	tx->engine = engine;
+	tx->state = 0;
+	atomic_set(&tx->count, 2);
+	tx->callback = NULL;
+	tx->callback_param = NULL;
+}
+
+/* for engines: @tx is done, may be called from interrupt context */
+extern void async_tx_complete(struct async_tx *tx);
+
+extern struct async_tx *async_tx_submit(struct async_tx_engine *engine,
+		struct async_tx *tx, enum async_tx_flags flags,
+		struct async_tx *depend_tx,
+		async_tx_callback callback, void *callback_param);
+extern void async_tx_sync_prolog(enum async_tx_flags flags,
+				 struct async_tx *depend_tx);
+extern void async_tx_sync_epilog(async_tx_callback callback,
+				 void *callback_param);
+
+extern void async_tx_ack(struct async_tx *tx);
+extern void async_tx_wait(struct async_tx *tx);
+extern void async_tx_issue_pending_all(void);
+
+/*
+ * Wait for *@tx, drop the caller's reference and clear it.  Safe in
+ * atomic context: the caller spins while the engine works.
+ */
+static inline void async_tx_quiesce(struct async_tx **tx)
+{
+	if (*tx) {
+		async_tx_wait(*tx);
+		async_tx_ack(*tx);
+		*tx = NULL;
+	}
+}
+
+extern struct async_tx *async_memcpy(struct page *dest, struct page *src,
+		unsigned int dest_offset, unsigned int src_offset, size_t len,
+		enum async_tx_flags flags, struct async_tx *depend_tx,
+		async_tx_callback callback, void *callback_param);
+extern struct async_tx *async_xor(struct page *dest, struct page **src_list,
+		unsigned int offset, int src_cnt, size_t len,
+		enum async_tx_flags flags, struct async_tx *depend_tx,
+		async_tx_callback callback, void *callback_param);
+extern struct async_tx *async_gen_syndrome(struct page **blocks,
+		unsigned int offset, int disks, size_t len,
+		enum async_tx_flags flags, struct async_tx *depend_tx,
+		async_tx_callback callback, void *callback_param);
+
+#endif
@@ -0,0 +1,88 @@
+/*
+ * bitmap.h: write-intent bitmap for md arrays
+ *
+ * One bit per chunk of each member device.  A bit is set on disk
+ * before the first write to its chunk and cleared lazily once the
+ * chunk has had no writes in flight for a while, so after a crash only
+ * the chunks with set bits need resyncing.
+ */
+#ifndef _BITMAP_H
+#define _BITMAP_H
+
+#define BITMAP_MAGIC	0x6d746962	/* "bitm" on disk, little endian */
+#define BITMAP_MAJOR	1
+
+/*
+ * An internal bitmap lives right after the 0.90 superblock, in the rest
+ * of the MD_RESERVED_BYTES at the end of each device, and starts with
+ * this.  All fields are little endian.
+ */
+typedef struct bitmap_super_s {
+	__u32 magic;		/*  0  BITMAP_MAGIC */
+	__u32 version;		/*  4  BITMAP_MAJOR */
+	__u8  uuid[16];		/*  8  array uuid */
+	__u64 events;		/* 24  array events when last written */
+	__u64 sync_size;	/* 32  sectors of each device covered */
+	__u32 chunksize;	/* 40  bytes per bit */
+	__u32 daemon_sleep;	/* 44  seconds between clearing passes */
+	__u8  pad[256 - 48];	/* the bits follow at 256 */
+} bitmap_super_t;
+
+#define BITMAP_SB_BITS		(sizeof(bitmap_super_t) * 8)
+#define BITMAP_MIN_CHUNK_SHIFT	7	/* sectors: 64k */
+#define BITMAP_DAEMON_SLEEP	5	/* seconds */
+
+#ifdef __KERNEL__
+
+/*
+ * In memory each chunk has a counter of writes in flight to it and
+ * three state bits.  The chunk's bit is set on disk whenever the
+ * counter is non-zero.
+ */
+typedef __u16 bitmap_counter_t;
+
+#define NEEDED_MASK	((bitmap_counter_t) 0x8000) /* must be resynced */
+#define PENDING_MASK	((bitmap_counter_t) 0x4000) /* idle, bit still set */
+#define RIPE_MASK	((bitmap_counter_t) 0x2000) /* idle for a whole pass */
+#define COUNTER_MAX	((bitmap_counter_t) 0x1fff)
+#define COUNTER(x)	((x) & COUNTER_MAX)
+
+struct bitmap {
+	mddev_t			*mddev;
+	sector_t		offset;		/* from the superblock, sectors */
+	int			chunkshift;	/* sectors per chunk, log2 */
+	unsigned long		chunks;
+	bitmap_counter_t	*counters;
+
+	struct page		**pages;	/* on-disk image */
+	int			nr_pages;
+	unsigned long		dirty;		/* pages to write, a bit each */
+	unsigned long		writing;	/* pages being written */
+	struct semaphore	write_sem;
+
+	unsigned long		pending;	/* chunks PENDING or RIPE */
+	unsigned long		daemon_sleep;	/* jiffies */
+	unsigned long		daemon_lastrun;
+
+	spinlock_t		lock;		/* counters, bits and flags */
+	wait_queue_head_t	overflow_wait;
+};
+
+extern int bitmap_create(mddev_t *mddev, int fresh);
+extern void bitmap_destroy(mddev_t *mddev);
+extern void bitmap_update_sb(struct bitmap *bitmap);
+extern void bitmap_status(struct seq_file *seq, struct bitmap *bitmap);
+
+extern void bitmap_startwrite(struct bitmap *bitmap, sector_t offset,
+			      unsigned long sectors);
+extern void bitmap_endwrite(struct bitmap *bitmap, sector_t offset,
+			    unsigned long sectors, int success);
+extern int bitmap_start_sync(struct bitmap *bitmap, sector_t offset,
+			     int *blocks);
+extern void bitmap_close_sync(struct bitmap *bitmap, sector_t upto);
+extern void bitmap_unplug(struct bitmap *bitmap);
+extern void bitmap_daemon_work(struct bitmap *bitmap);
+
+#endif
+
+#endif
@@ -200,6 +200,8 @@ struct mddev_s
 	int				ro;
 
 	struct gendisk			*gendisk;
+	struct kobject			kobj;	/* /sys/block/mdX/md, once
+						 * gendisk is there */
 
 	/* Superblock information */
 	int				major_version,
@@ -260,9 +262,24 @@ struct mddev_s
 	atomic_t			writes_pending; 
 	request_queue_t			*queue;	/* for plugging ... */
 
+	struct bitmap			*bitmap; /* write-intent bitmap */
+	long				bitmap_offset; /* sectors after the
+							* superblock, 0 if none
+							*/
+
 	struct list_head		all_mddevs;
 };
 
+/*
+ * Attributes of the md directory, shown and stored under reconfig_sem.
+ * Personalities add theirs when they run and take them away on stop.
+ */
+struct md_sysfs_entry {
+	struct attribute attr;
+	ssize_t (*show)(mddev_t *, char *);
+	ssize_t (*store)(mddev_t *, const char *, size_t);
+};
+
 
 static inline void rdev_dec_pending(mdk_rdev_t *rdev, mddev_t *mddev)
 {
@@ -291,7 +308,8 @@ struct mdk_personality_s
 	int (*hot_add_disk) (mddev_t *mddev, mdk_rdev_t *rdev);
 	int (*hot_remove_disk) (mddev_t *mddev, int number);
 	int (*spare_active) (mddev_t *mddev);
-	int (*sync_request)(mddev_t *mddev, sector_t sector_nr, int go_faster);
+	/* sets *skipped when it returns without doing any I/O */
+	int (*sync_request)(mddev_t *mddev, sector_t sector_nr, int *skipped, int go_faster);
 	int (*resize) (mddev_t *mddev, sector_t sectors);
 	int (*reshape) (mddev_t *mddev, int raid_disks);
 	int (*reconfig) (mddev_t *mddev, int layout, int chunk_size);
@@ -334,6 +352,7 @@ typedef struct mdk_thread_s {
 	unsigned long           flags;
 	struct completion	*event;
 	struct task_struct	*tsk;
+	long			timeout; /* run at least this often, jiffies */
 	const char		*name;
 } mdk_thread_t;
 
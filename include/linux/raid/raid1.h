@@ -95,4 +95,5 @@ struct r1bio_s {
 /* bits for r1bio.state */
 #define	R1BIO_Uptodate	0
 #define	R1BIO_IsSync	1
+#define	R1BIO_Degraded	2	/* some mirror did not get the write */
 #endif
@@ -200,16 +200,31 @@ struct disk_info {
 	mdk_rdev_t	*rdev;
 };
 
+/*
+ * On SMP, stripes are handled by one worker thread per CPU rather than by
+ * the array thread.  A stripe always goes to the same worker, picked by
+ * its sector, so neighbouring stripes of a large write are worked on
+ * in parallel.  The lists are protected by device_lock.
+ */
+struct raid5_worker {
+	struct raid5_private_data *conf;
+	struct list_head	handle_list; /* stripes needing handling */
+	wait_queue_head_t	wait;
+	struct task_struct	*thread;
+};
+
 struct raid5_private_data {
 	struct stripe_head	**stripe_hashtbl;
 	mddev_t			*mddev;
 	struct disk_info	*spare;
 	int			chunk_size, level, algorithm;
 	int			raid_disks, working_disks, failed_disks;
-	int			max_nr_stripes;
+	int			max_nr_stripes;	/* size of the stripe cache */
 
 	struct list_head	handle_list; /* stripes needing handling */
 	struct list_head	delayed_list; /* stripes that have plugged requests */
+	struct raid5_worker	*workers;
+	int			nr_workers; /* 0: raid5d handles stripes */
 	atomic_t		preread_active_stripes; /* stripes with scheduled io */
 
 	char			cache_name[20];
@@ -225,6 +240,12 @@ struct raid5_private_data {
 							 * waiting for 25% to be free
 							 */        
 	spinlock_t		device_lock;
+
+	/* shown under /sys/block/mdX/md/ */
+	atomic_t		cache_hits, cache_misses; /* stripe lookups */
+	atomic_t		stripe_waits;	/* waits for a free stripe */
+	atomic_t		full_stripe_writes, rmw_writes;
+
 	struct disk_info	disks[0];
 };
 
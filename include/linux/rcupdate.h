@@ -65,6 +65,9 @@ struct rcu_ctrlblk {
 	long	cur;		/* Current batch number.                      */
 	long	completed;	/* Number of the last completed batch         */
 	int	next_pending;	/* Is the next batch already waiting?         */
+#ifdef CONFIG_PREEMPT_RCU
+	int	wait_readers;	/* Only preempted readers hold up the batch   */
+#endif
 } ____cacheline_maxaligned_in_smp;
 
 /* Is batch a before batch b ? */
@@ -98,6 +101,8 @@ struct rcu_data {
 	struct rcu_head **curtail;
 	struct rcu_head *donelist;
 	struct rcu_head **donetail;
+	long		qlen;		 /* # of queued callbacks */
+	long		blimit;		 /* Upper limit on a processed batch */
 	int cpu;
 };
 
@@ -144,6 +149,12 @@ static inline int __rcu_pending(struct rcu_ctrlblk *rcp,
 	if (rdp->quiescbatch != rcp->cur || rdp->qs_pending)
 		return 1;
 
+#ifdef CONFIG_PREEMPT_RCU
+	/* The rcu core waits for preempted readers to finish */
+	if (rcp->wait_readers)
+		return 1;
+#endif
+
 	/* nothing to do */
 	return 0;
 }
@@ -182,15 +193,25 @@ static inline int rcu_pending(int cpu)
  * completes.
  *
  * It is illegal to block while in an RCU read-side critical section.
+ * With CONFIG_PREEMPT_RCU, the critical section may be preempted, but
+ * it still must not sleep.
  */
+#ifdef CONFIG_PREEMPT_RCU
+extern void rcu_read_lock(void);
+#else
 #define rcu_read_lock()		preempt_disable()
+#endif
 
 /**
  * rcu_read_unlock - marks the end of an RCU read-side critical section.
  *
  * See rcu_read_lock() for more information.
  */
+#ifdef CONFIG_PREEMPT_RCU
+extern void rcu_read_unlock(void);
+#else
 #define rcu_read_unlock()	preempt_enable()
+#endif
 
 /*
  * So where is rcu_write_lock()?  It does not exist, as there is no
@@ -266,6 +287,8 @@ extern void FASTCALL(call_rcu(struct rcu_head *head,
 extern void FASTCALL(call_rcu_bh(struct rcu_head *head,
 				void (*func)(struct rcu_head *head)));
 extern void synchronize_kernel(void);
+extern void rcu_barrier(void);
+extern void rcu_barrier_bh(void);
 
 #endif /* __KERNEL__ */
 #endif /* __LINUX_RCUPDATE_H */
@@ -339,6 +339,8 @@ enum
 #define RTAX_INITCWND RTAX_INITCWND
 	RTAX_FEATURES,
 #define RTAX_FEATURES RTAX_FEATURES
+	RTAX_RCVSPACE,
+#define RTAX_RCVSPACE RTAX_RCVSPACE
 	__RTAX_MAX
 };
 
@@ -32,11 +32,22 @@ struct rw_semaphore {
 	__s32			activity;
 	spinlock_t		wait_lock;
 	struct list_head	wait_list;
+#ifdef RWSEM_SPIN_ON_OWNER
+	struct thread_info	*owner;		/* the writer, or NULL */
+#endif
 #if RWSEM_DEBUG
 	int			debug;
 #endif
 };
 
+#ifdef RWSEM_SPIN_ON_OWNER
+#define __RWSEM_OWNER_INIT	, NULL
+#define rwsem_set_owner(sem)	((sem)->owner = current_thread_info())
+#define rwsem_clear_owner(sem)	((sem)->owner = NULL)
+#else
+#define __RWSEM_OWNER_INIT	/* */
+#endif
+
 /*
  * initialisation
  */
@@ -47,7 +58,8 @@ struct rw_semaphore {
 #endif
 
 #define __RWSEM_INITIALIZER(name) \
-{ 0, SPIN_LOCK_UNLOCKED, LIST_HEAD_INIT((name).wait_list) __RWSEM_DEBUG_INIT }
+{ 0, SPIN_LOCK_UNLOCKED, LIST_HEAD_INIT((name).wait_list) __RWSEM_OWNER_INIT \
+	__RWSEM_DEBUG_INIT }
 
 #define DECLARE_RWSEM(name) \
 	struct rw_semaphore name = __RWSEM_INITIALIZER(name)
@@ -21,12 +21,27 @@
 
 struct rw_semaphore;
 
+/*
+ * Implementations which keep the owning writer in ->owner, with
+ * rwsem_set_owner(), let a writer spin while that one runs, see
+ * spin_on_owner() in sched.h.  The others leave it undefined.
+ */
+#if defined(CONFIG_SMP) && !defined(CONFIG_DEBUG_PAGEALLOC)
+#define RWSEM_SPIN_ON_OWNER
+#endif
+
 #ifdef CONFIG_RWSEM_GENERIC_SPINLOCK
 #include <linux/rwsem-spinlock.h> /* use a generic implementation */
 #else
 #include <asm/rwsem.h> /* use an arch-specific implementation */
 #endif
 
+#ifndef rwsem_set_owner
+#undef RWSEM_SPIN_ON_OWNER
+#define rwsem_set_owner(sem)	do { } while (0)
+#define rwsem_clear_owner(sem)	do { } while (0)
+#endif
+
 #ifndef rwsemtrace
 #if RWSEM_DEBUG
 extern void FASTCALL(rwsemtrace(struct rw_semaphore *sem, const char *str));
@@ -66,6 +81,7 @@ static inline void down_write(struct rw_semaphore *sem)
 	might_sleep();
 	rwsemtrace(sem,"Entering down_write");
 	__down_write(sem);
+	rwsem_set_owner(sem);
 	rwsemtrace(sem,"Leaving down_write");
 }
 
@@ -77,6 +93,8 @@ static inline int down_write_trylock(struct rw_semaphore *sem)
 	int ret;
 	rwsemtrace(sem,"Entering down_write_trylock");
 	ret = __down_write_trylock(sem);
+	if (ret)
+		rwsem_set_owner(sem);
 	rwsemtrace(sem,"Leaving down_write_trylock");
 	return ret;
 }
@@ -97,6 +115,7 @@ static inline void up_read(struct rw_semaphore *sem)
 static inline void up_write(struct rw_semaphore *sem)
 {
 	rwsemtrace(sem,"Entering up_write");
+	rwsem_clear_owner(sem);
 	__up_write(sem);
 	rwsemtrace(sem,"Leaving up_write");
 }
@@ -107,6 +126,7 @@ static inline void up_write(struct rw_semaphore *sem)
 static inline void downgrade_write(struct rw_semaphore *sem)
 {
 	rwsemtrace(sem,"Entering downgrade_write");
+	rwsem_clear_owner(sem);
 	__downgrade_write(sem);
 	rwsemtrace(sem,"Leaving downgrade_write");
 }
@@ -102,6 +102,7 @@ extern unsigned long nr_iowait(void);
 #include <linux/param.h>
 #include <linux/resource.h>
 #include <linux/timer.h>
+#include <linux/hrtimer.h>
 
 #include <asm/processor.h>
 
@@ -132,6 +133,7 @@ extern unsigned long nr_iowait(void);
 #define SCHED_NORMAL		0
 #define SCHED_FIFO		1
 #define SCHED_RR		2
+#define SCHED_BATCH		3
 
 struct sched_param {
 	int sched_priority;
@@ -204,12 +206,34 @@ arch_get_unmapped_area_topdown(struct file *filp, unsigned long addr,
 extern void arch_unmap_area(struct vm_area_struct *area);
 extern void arch_unmap_area_topdown(struct vm_area_struct *area);
 
+/*
+ * On larger SMP machines mm->page_table_lock is the bottleneck for page
+ * faults in multithreaded processes, so the ptes of each page table page
+ * are protected by a spinlock in its struct page instead (pte_lockptr()).
+ * The rss counters are then updated without the mm-wide lock, and must
+ * be atomic.  Only architectures whose own pte walkers respect the lock
+ * split use it; the spinlock must fit in page->private and page->mapping.
+ */
+#if defined(CONFIG_SMP) && NR_CPUS >= 4 && defined(CONFIG_X86) && \
+	!defined(CONFIG_DEBUG_SPINLOCK)
+#define SPLIT_PTLOCKS
+#endif
+
+#ifdef SPLIT_PTLOCKS
+#define set_mm_counter(mm, member, value) atomic_set(&(mm)->_##member, value)
+#define get_mm_counter(mm, member) ((unsigned long)atomic_read(&(mm)->_##member))
+#define add_mm_counter(mm, member, value) atomic_add(value, &(mm)->_##member)
+#define inc_mm_counter(mm, member) atomic_inc(&(mm)->_##member)
+#define dec_mm_counter(mm, member) atomic_dec(&(mm)->_##member)
+typedef atomic_t mm_counter_t;
+#else
 #define set_mm_counter(mm, member, value) (mm)->_##member = (value)
 #define get_mm_counter(mm, member) ((mm)->_##member)
 #define add_mm_counter(mm, member, value) (mm)->_##member += (value)
 #define inc_mm_counter(mm, member) (mm)->_##member++
 #define dec_mm_counter(mm, member) (mm)->_##member--
 typedef unsigned long mm_counter_t;
+#endif
 
 struct mm_struct {
 	struct vm_area_struct * mmap;		/* list of VMAs */
@@ -239,9 +263,12 @@ struct mm_struct {
 	unsigned long total_vm, locked_vm, shared_vm;
 	unsigned long exec_vm, stack_vm, reserved_vm, def_flags, nr_ptes;
 
-	/* Special counters protected by the page_table_lock */
+	/* Special counters, protected by the page_table_lock unless SPLIT_PTLOCKS */
 	mm_counter_t _rss;
 	mm_counter_t _anon_rss;
+#ifdef CONFIG_NUMA
+	mm_counter_t _node_anon_rss[MAX_NUMNODES];	/* anon_rss by node */
+#endif
 
 	unsigned long saved_auxv[42]; /* for /proc/PID/auxv */
 
@@ -254,6 +281,12 @@ struct mm_struct {
 	/* Token based thrashing protection. */
 	unsigned long swap_token_time;
 	char recent_pagein;
+	unsigned int faultstamp;	/* global major fault count at our last */
+	unsigned int last_interval;	/* global faults between our last two */
+	unsigned int token_priority;	/* recent major fault rate */
+	unsigned long swap_token_faults;	/* major faults taken */
+	unsigned long swap_token_grabs;	/* times given the token */
+	unsigned long swap_token_held;	/* jiffies held, up to the last release */
 
 	/* coredumping support */
 	int core_waiters;
@@ -265,6 +298,11 @@ struct mm_struct {
 
 	struct kioctx		default_kioctx;
 
+	/* registered direct-IO buffers, see fs/direct-io.c */
+	spinlock_t		dio_lock;
+	struct list_head	dio_regions;
+	unsigned long		dio_pinned;	/* pages pinned by them */
+
 	unsigned long hiwater_rss;	/* High-water RSS usage */
 	unsigned long hiwater_vm;	/* High-water virtual memory usage */
 };
@@ -273,6 +311,7 @@ struct sighand_struct {
 	atomic_t		count;
 	struct k_sigaction	action[_NSIG];
 	spinlock_t		siglock;
+	struct list_head	signalfd_list;	/* under siglock */
 };
 
 /*
@@ -312,8 +351,8 @@ struct signal_struct {
 	struct list_head posix_timers;
 
 	/* ITIMER_REAL timer for the process */
-	struct timer_list real_timer;
-	unsigned long it_real_value, it_real_incr;
+	struct hrtimer real_timer;
+	ktime_t it_real_incr;
 
 	/* ITIMER_PROF and ITIMER_VIRTUAL timers for the process */
 	cputime_t it_prof_expires, it_virt_expires;
@@ -395,6 +434,7 @@ struct signal_struct {
 #define MAX_PRIO		(MAX_RT_PRIO + 40)
 
 #define rt_task(p)		(unlikely((p)->prio < MAX_RT_PRIO))
+#define batch_task(p)		(unlikely((p)->policy == SCHED_BATCH))
 
 /*
  * Some day this will be a full-fledged user tracking system..
@@ -404,9 +444,16 @@ struct user_struct {
 	atomic_t processes;	/* How many processes does this user have? */
 	atomic_t files;		/* How many open files does this user have? */
 	atomic_t sigpending;	/* How many pending signals does this user have? */
+#ifdef CONFIG_INOTIFY
+	atomic_t inotify_watches; /* How many inotify watches does this user have? */
+	atomic_t inotify_devs;	/* How many inotify devs does this user have opened? */
+#endif
 	/* protected by mq_lock	*/
 	unsigned long mq_bytes;	/* How many bytes can be allocated to mqueue? */
 	unsigned long locked_shm; /* How many pages of mlocked shm ? */
+#ifdef CONFIG_FAIR_USER_SCHED
+	atomic_t nr_running;	/* How many runnable tasks does this user have? */
+#endif
 
 #ifdef CONFIG_KEYS
 	struct key *uid_keyring;	/* UID specific keyring */
@@ -428,6 +475,9 @@ struct backing_dev_info;
 struct reclaim_state;
 
 #ifdef CONFIG_SCHEDSTATS
+/* Buckets of the log2 histograms in /proc/schedstat */
+#define SCHEDSTAT_HIST_SIZE	32
+
 struct sched_info {
 	/* cumulative counters */
 	unsigned long	cpu_time,	/* time spent on the cpu */
@@ -463,6 +513,7 @@ enum idle_type
 #define SD_WAKE_AFFINE		16	/* Wake task to waking CPU */
 #define SD_WAKE_BALANCE		32	/* Perform balancing at task wakeup */
 #define SD_SHARE_CPUPOWER	64	/* Domain members share cpu power */
+#define SD_BALANCE_FORK		128	/* Balance on fork, clone */
 
 struct sched_group {
 	struct sched_group *next;	/* Must be a circular list */
@@ -518,6 +569,9 @@ struct sched_domain {
 	unsigned long ttwu_wake_remote;
 	unsigned long ttwu_move_affine;
 	unsigned long ttwu_move_balance;
+
+	/* log2 histogram of load balancing cost, in cycles */
+	unsigned long lb_cost_hist[SCHEDSTAT_HIST_SIZE];
 #endif
 };
 
@@ -569,7 +623,9 @@ int set_current_groups(struct group_info *group_info);
 
 
 struct audit_context;		/* See audit.c */
+struct perfctr_context;		/* See perfctr.h */
 struct mempolicy;
+struct worker;			/* See workqueue.c */
 
 struct task_struct {
 	volatile long state;	/* -1 unrunnable, 0 runnable, >0 stopped */
@@ -704,6 +760,13 @@ struct task_struct {
 /* journalling filesystem info */
 	void *journal_info;
 
+/* workqueue worker, if this is one */
+	struct worker *wq_worker;
+#ifdef CONFIG_PREEMPT_RCU
+	int rcu_read_lock_nesting;
+	int rcu_flipctr_idx;
+#endif
+
 /* VM state */
 	struct reclaim_state *reclaim_state;
 
@@ -711,6 +774,8 @@ struct task_struct {
 	struct backing_dev_info *backing_dev_info;
 
 	struct io_context *io_context;
+	unsigned short ioprio;		/* see linux/ioprio.h */
+	struct perfctr_context *perfctr;	/* own counters, or NULL */
 
 	unsigned long ptrace_message;
 	siginfo_t *last_siginfo; /* For ptrace use.  */
@@ -736,6 +801,7 @@ struct task_struct {
 	struct cpuset *cpuset;
 	nodemask_t mems_allowed;
 	int cpuset_mems_generation;
+	int cpuset_mem_spread_rotor;
 #endif
 };
 
@@ -788,6 +854,8 @@ do { if (atomic_dec_and_test(&(tsk)->usage)) __put_task_struct(tsk); } while(0)
 #define PF_SYNCWRITE	0x00200000	/* I am doing a sync write */
 #define PF_BORROWED_MM	0x00400000	/* I am a kthread doing use_mm */
 #define PF_RANDOMIZE	0x00800000	/* randomize virtual address space */
+#define PF_SPREAD_PAGE	0x01000000	/* Spread page cache over cpuset */
+#define PF_SPREAD_SLAB	0x02000000	/* Spread some slab caches over cpuset */
 
 /*
  * Only the _current_ task can read/write to tsk->flags, but other
@@ -831,8 +899,10 @@ extern unsigned long long current_sched_time(const task_t *current_task);
 /* sched_exec is called by processes performing an exec */
 #ifdef CONFIG_SMP
 extern void sched_exec(void);
+extern int sched_balance_fork(task_t *p);
 #else
 #define sched_exec()   {}
+#define sched_balance_fork(p)	smp_processor_id()
 #endif
 
 #ifdef CONFIG_HOTPLUG_CPU
@@ -846,6 +916,13 @@ extern void set_user_nice(task_t *p, long nice);
 extern int task_prio(const task_t *p);
 extern int task_nice(const task_t *p);
 extern int task_curr(const task_t *p);
+/*
+ * For sleeping locks which keep their owner's thread_info in *ownerp.
+ * An exited owner's may be unmapped with DEBUG_PAGEALLOC.
+ */
+#if defined(CONFIG_SMP) && !defined(CONFIG_DEBUG_PAGEALLOC)
+extern int spin_on_owner(struct thread_info **ownerp, struct thread_info *owner);
+#endif
 extern int idle_cpu(int cpu);
 extern int sched_setscheduler(struct task_struct *, int, struct sched_param *);
 extern task_t *idle_task(int cpu);
@@ -891,6 +968,15 @@ static inline struct user_struct *get_uid(struct user_struct *u)
 }
 extern void free_uid(struct user_struct *);
 extern void switch_uid(struct user_struct *);
+#ifdef CONFIG_FAIR_USER_SCHED
+extern void sched_switch_user(struct task_struct *, struct user_struct *);
+#else
+static inline void sched_switch_user(struct task_struct *p,
+				     struct user_struct *new_user)
+{
+	p->user = new_user;
+}
+#endif
 
 #include <asm/current.h>
 
@@ -6,8 +6,6 @@
 
 /* inode in-kernel data */
 
-#define SHMEM_NR_DIRECT 16
-
 struct shmem_inode_info {
 	spinlock_t		lock;
 	unsigned long		flags;
@@ -15,8 +13,6 @@ struct shmem_inode_info {
 	unsigned long		swapped;	/* subtotal assigned to swap */
 	unsigned long		next_index;	/* highest alloced index + 1 */
 	struct shared_policy	policy;		/* NUMA memory alloc policy */
-	struct page		*i_indirect;	/* top indirect blocks page */
-	swp_entry_t		i_direct[SHMEM_NR_DIRECT]; /* first blocks */
 	struct list_head	swaplist;	/* chain of maybes on swap */
 	struct inode		vfs_inode;
 };
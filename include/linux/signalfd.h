@@ -0,0 +1,64 @@
+/*
+ *  include/linux/signalfd.h
+ *
+ *  Signals read from a file descriptor, see fs/signalfd.c.
+ */
+
+#ifndef _LINUX_SIGNALFD_H
+#define _LINUX_SIGNALFD_H
+
+#include <linux/types.h>
+
+/* What read() of a signalfd returns per signal, the same on all ABIs */
+struct signalfd_siginfo {
+	__u32 ssi_signo;
+	__s32 ssi_errno;
+	__s32 ssi_code;
+	__u32 ssi_pid;
+	__u32 ssi_uid;
+	__s32 ssi_fd;
+	__u32 ssi_tid;
+	__u32 ssi_band;
+	__u32 ssi_overrun;
+	__u32 ssi_trapno;
+	__s32 ssi_status;
+	__s32 ssi_int;
+	__u64 ssi_ptr;
+	__u64 ssi_utime;
+	__u64 ssi_stime;
+	__u64 ssi_addr;
+
+	/* room to grow without changing the size */
+	__u8 __pad[48];
+};
+
+#ifdef __KERNEL__
+
+#include <linux/config.h>
+#include <linux/sched.h>
+
+#ifdef CONFIG_SIGNALFD
+
+extern void __signalfd_notify(struct sighand_struct *sighand, int sig);
+extern void signalfd_detach(struct sighand_struct *sighand);
+
+/*
+ * Wake the signalfds which wait for @sig on the signal handlers of @tsk.
+ * Called with their siglock held, as @sig is queued.
+ */
+static inline void signalfd_notify(struct task_struct *tsk, int sig)
+{
+	if (unlikely(!list_empty(&tsk->sighand->signalfd_list)))
+		__signalfd_notify(tsk->sighand, sig);
+}
+
+#else /* CONFIG_SIGNALFD */
+
+static inline void signalfd_notify(struct task_struct *tsk, int sig) { }
+static inline void signalfd_detach(struct sighand_struct *sighand) { }
+
+#endif /* CONFIG_SIGNALFD */
+
+#endif /* __KERNEL__ */
+
+#endif /* _LINUX_SIGNALFD_H */
@@ -188,6 +188,7 @@ struct skb_shared_info {
  *	@users: User count - see {datagram,tcp}.c
  *	@protocol: Packet protocol from driver
  *	@security: Security level of packet
+ *	@queue_mapping: Hardware tx queue of a multiqueue device
  *	@truesize: Buffer size 
  *	@head: Head of buffer
  *	@data: Data head pointer
@@ -261,7 +262,8 @@ struct sk_buff {
 				ip_summed;
 	__u32			priority;
 	unsigned short		protocol,
-				security;
+				security,
+				queue_mapping;
 
 	void			(*destructor)(struct sk_buff *skb);
 #ifdef CONFIG_NETFILTER
@@ -324,6 +326,10 @@ extern struct sk_buff *skb_copy_expand(const struct sk_buff *skb,
 				       int newheadroom, int newtailroom,
 				       int priority);
 extern struct sk_buff *		skb_pad(struct sk_buff *skb, int pad);
+extern int	       skb_recycle_check(struct sk_buff *skb,
+					 unsigned int skb_size);
+extern void	       skb_recycle(struct sk_buff *skb, unsigned int skb_size);
+extern struct sk_buff *dev_alloc_skb_recycle(unsigned int length);
 #define dev_kfree_skb(a)	kfree_skb(a)
 extern void	      skb_over_panic(struct sk_buff *skb, int len,
 				     void *here);
@@ -1189,6 +1195,7 @@ extern unsigned int    skb_copy_and_csum_bits(const struct sk_buff *skb,
 extern void	       skb_copy_and_csum_dev(const struct sk_buff *skb, u8 *to);
 extern void	       skb_split(struct sk_buff *skb,
 				 struct sk_buff *skb1, const u32 len);
+extern struct sk_buff *skb_segment(struct sk_buff *skb, int features);
 
 static inline void *skb_header_pointer(const struct sk_buff *skb, int offset,
 				       int len, void *buffer)
@@ -260,6 +260,8 @@ enum
 	LINUX_MIB_TCPABORTONLINGER,		/* TCPAbortOnLinger */
 	LINUX_MIB_TCPABORTFAILED,		/* TCPAbortFailed */
 	LINUX_MIB_TCPMEMORYPRESSURES,		/* TCPMemoryPressures */
+	LINUX_MIB_IPFRAGEVICTED,		/* IPFragEvicted */
+	LINUX_MIB_IPFRAGOVERFLOW,		/* IPFragOverflow */
 	__LINUX_MIB_MAX
 };
 
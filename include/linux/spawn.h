@@ -0,0 +1,51 @@
+#ifndef _LINUX_SPAWN_H
+#define _LINUX_SPAWN_H
+
+/*
+ * spawn(path, argv, envp, attr) starts a new process running path, like
+ * vfork() and execve() but without ever running the child in user space
+ * on the parent's memory, see kernel/spawn.c.  It returns the pid of
+ * the child once it has executed path, or the error of the file actions,
+ * attributes or execve(); a child which failed has already gone then.
+ *
+ * The actions of attr are applied in order to the child's descriptors,
+ * as posix_spawn_file_actions_add*() would.
+ */
+
+#include <linux/types.h>
+
+/* spawn_attr.flags */
+#define SPAWN_RESETIDS		0x01	/* effective ids = real ids */
+#define SPAWN_SETPGROUP		0x02	/* setpgid(0, pgroup) */
+#define SPAWN_SETSIGDEF		0x04	/* signals in sigdefault to SIG_DFL */
+#define SPAWN_SETSIGMASK	0x08	/* sigmask blocked */
+#define SPAWN_SETSID		0x80	/* setsid(), as in glibc */
+
+/* spawn_action.type */
+#define SPAWN_CLOSE		0	/* close(fd) */
+#define SPAWN_DUP2		1	/* dup2(fd, newfd) */
+#define SPAWN_OPEN		2	/* open(path, oflag, mode) as fd */
+
+#define SPAWN_MAX_ACTIONS	1024
+
+struct spawn_action {
+	__u32 type;
+	__s32 fd;
+	__s32 newfd;
+	__s32 oflag;
+	__u32 mode;
+	__u32 pad;
+	__u64 path;		/* user address */
+};
+
+struct spawn_attr {
+	__u32 flags;
+	__s32 pgroup;
+	__u64 sigmask;		/* bit n - 1 for signal n */
+	__u64 sigdefault;
+	__u64 actions;		/* user address of nr_actions struct spawn_action */
+	__u32 nr_actions;
+	__u32 pad;
+};
+
+#endif /* _LINUX_SPAWN_H */
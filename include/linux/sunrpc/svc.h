@@ -16,6 +16,24 @@
 #include <linux/sunrpc/svcauth.h>
 #include <linux/wait.h>
 #include <linux/mm.h>
+#include <linux/cache.h>
+
+/*
+ * RPC service thread pool.
+ *
+ * Idle threads wait on, and sockets with pending data are queued to,
+ * the pool their CPU belongs to, so that dispatching a request only
+ * takes a lock shared with the other CPUs of one node.  Services
+ * created with svc_create() have a single pool; svc_create_pooled()
+ * gives one pool per NUMA node, pool ids being node ids.
+ */
+struct svc_pool {
+	unsigned int		sp_id;		/* pool id, also node id */
+	spinlock_t		sp_lock;	/* protects the fields below */
+	struct list_head	sp_threads;	/* idle server threads */
+	struct list_head	sp_sockets;	/* pending sockets */
+	unsigned int		sp_nrthreads;	/* # of threads in pool */
+} ____cacheline_aligned_in_smp;
 
 /*
  * RPC service.
@@ -23,16 +41,14 @@
  * An RPC service is a ``daemon,'' possibly multithreaded, which
  * receives and processes incoming RPC messages.
  * It has one or more transport sockets associated with it, and maintains
- * a list of idle threads waiting for input.
+ * per-pool lists of idle threads waiting for input.
  *
  * We currently do not support more than one RPC program per daemon.
  */
 struct svc_serv {
-	struct list_head	sv_threads;	/* idle server threads */
-	struct list_head	sv_sockets;	/* pending sockets */
 	struct svc_program *	sv_program;	/* RPC program */
 	struct svc_stat *	sv_stats;	/* RPC statistics */
-	spinlock_t		sv_lock;
+	spinlock_t		sv_lock;	/* protects socket lists */
 	unsigned int		sv_nrthreads;	/* # of server threads */
 	unsigned int		sv_bufsz;	/* datagram buffer size */
 	unsigned int		sv_xdrsize;	/* XDR buffer size */
@@ -40,8 +56,12 @@ struct svc_serv {
 	struct list_head	sv_permsocks;	/* all permanent sockets */
 	struct list_head	sv_tempsocks;	/* all temporary sockets */
 	int			sv_tmpcnt;	/* count of temporary sockets */
+	time_t			sv_agetime;	/* last temp socket age check */
 
 	char *			sv_name;	/* service name */
+
+	unsigned int		sv_nrpools;	/* # of thread pools */
+	struct svc_pool *	sv_pools;	/* array of thread pools */
 };
 
 /*
@@ -115,6 +135,7 @@ struct svc_rqst {
 	int			rq_addrlen;
 
 	struct svc_serv *	rq_server;	/* RPC service definition */
+	struct svc_pool *	rq_pool;	/* thread pool */
 	struct svc_procedure *	rq_procinfo;	/* procedure info */
 	struct auth_ops *	rq_authop;	/* authentication flavour */
 	struct svc_cred		rq_cred;	/* auth info */
@@ -295,6 +316,7 @@ typedef void		(*svc_thread_fn)(struct svc_rqst *);
  * Function prototypes.
  */
 struct svc_serv *  svc_create(struct svc_program *, unsigned int);
+struct svc_serv *  svc_create_pooled(struct svc_program *, unsigned int);
 int		   svc_create_thread(svc_thread_fn, struct svc_serv *);
 void		   svc_exit_thread(struct svc_rqst *);
 void		   svc_destroy(struct svc_serv *);
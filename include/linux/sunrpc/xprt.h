@@ -31,10 +31,12 @@
  */
 extern unsigned int xprt_udp_slot_table_entries;
 extern unsigned int xprt_tcp_slot_table_entries;
+extern unsigned int xprt_max_tcp_slot_table_entries;
 
 #define RPC_MIN_SLOT_TABLE	(2U)
 #define RPC_DEF_SLOT_TABLE	(16U)
 #define RPC_MAX_SLOT_TABLE	(128U)
+#define RPC_MAX_SLOT_TABLE_LIMIT	(65536U)
 
 #define RPC_CWNDSHIFT		(8U)
 #define RPC_CWNDSCALE		(1U << RPC_CWNDSHIFT)
@@ -149,7 +151,9 @@ struct rpc_xprt {
 	struct rpc_wait_queue	backlog;	/* waiting for slot */
 	struct list_head	free;		/* free slots */
 	struct rpc_rqst *	slot;		/* slot table storage */
-	unsigned int		max_reqs;	/* total slots */
+	unsigned int		max_reqs,	/* most slots to allocate */
+				min_reqs,	/* slots in the table */
+				num_reqs;	/* slots allocated */
 	unsigned long		sockstate;	/* Socket state */
 	unsigned char		shutdown   : 1,	/* being shut down */
 				nocong	   : 1,	/* no congestion control */
@@ -130,8 +130,6 @@ struct swap_info_struct {
 	unsigned short * swap_map;
 	unsigned int lowest_bit;
 	unsigned int highest_bit;
-	unsigned int cluster_next;
-	unsigned int cluster_nr;
 	int prio;			/* swap priority */
 	int pages;
 	unsigned long max;
@@ -166,9 +164,10 @@ extern unsigned int nr_free_pagecache_pages(void);
 extern void FASTCALL(lru_cache_add(struct page *));
 extern void FASTCALL(lru_cache_add_active(struct page *));
 extern void FASTCALL(activate_page(struct page *));
+extern void FASTCALL(mark_page_lazyfree(struct page *));
 extern void FASTCALL(mark_page_accessed(struct page *));
 extern void lru_add_drain(void);
-extern int rotate_reclaimable_page(struct page *page);
+extern void rotate_reclaimable_page(struct page *page);
 extern void swap_setup(void);
 
 /* linux/mm/vmscan.c */
@@ -218,6 +217,7 @@ extern sector_t map_swap_page(struct swap_info_struct *, pgoff_t);
 extern struct swap_info_struct *get_swap_info_struct(unsigned);
 extern int can_share_swap_page(struct page *);
 extern int remove_exclusive_swap_page(struct page *);
+extern void remap_swap_page(struct mm_struct *, struct page *);
 struct backing_dev_info;
 
 extern struct swap_list_t swap_list;
@@ -231,8 +231,10 @@ extern spinlock_t swaplock;
 /* linux/mm/thrash.c */
 extern struct mm_struct * swap_token_mm;
 extern unsigned long swap_token_default_timeout;
+extern int swap_token_check_interval;
 extern void grab_swap_token(void);
 extern void __put_swap_token(struct mm_struct *);
+extern unsigned long swap_token_held_time(struct mm_struct *);
 
 static inline int has_swap_token(struct mm_struct *mm)
 {
@@ -262,6 +264,8 @@ static inline void put_swap_token(struct mm_struct *mm)
 #define swap_duplicate(swp)			/*NOTHING*/
 #define swap_free(swp)				/*NOTHING*/
 #define read_swap_cache_async(swp,vma,addr)	NULL
+#define add_to_swap(page)			0
+#define remap_swap_page(mm, page)		/*NOTHING*/
 #define lookup_swap_cache(swp)			NULL
 #define valid_swaphandles(swp, off)		0
 #define can_share_swap_page(p)			0
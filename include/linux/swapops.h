@@ -1,3 +1,5 @@
+#include <linux/radix-tree.h>
+
 /*
  * swapcache pages are stored in the swapper_space radix tree.  We want to
  * get good packing density in that tree, so the index should be dense in
@@ -67,3 +69,26 @@ static inline pte_t swp_entry_to_pte(swp_entry_t entry)
 	BUG_ON(pte_file(__swp_entry_to_pte(arch_entry)));
 	return __swp_entry_to_pte(arch_entry);
 }
+
+/*
+ * tmpfs keeps the swap entries of its pages in the page cache radix tree,
+ * in the slots of the pages written out to them.  There the type moves
+ * down below the offset, to make room for RADIX_TREE_EXCEPTIONAL_ENTRY:
+ * a swap device may not have more pages than such an entry can address.
+ */
+static inline void *swp_to_radix_entry(swp_entry_t entry)
+{
+	unsigned long value;
+
+	value = (swp_offset(entry) << MAX_SWAPFILES_SHIFT) | swp_type(entry);
+	return (void *)((value << RADIX_TREE_EXCEPTIONAL_SHIFT) |
+			RADIX_TREE_EXCEPTIONAL_ENTRY);
+}
+
+static inline swp_entry_t radix_to_swp_entry(void *arg)
+{
+	unsigned long value = (unsigned long)arg >> RADIX_TREE_EXCEPTIONAL_SHIFT;
+
+	return swp_entry(value & ((1UL << MAX_SWAPFILES_SHIFT) - 1),
+			 value >> MAX_SWAPFILES_SHIFT);
+}
@@ -12,6 +12,7 @@
 #define _LINUX_SYSCALLS_H
 
 struct epoll_event;
+struct epoll_ctl_cmd;
 struct iattr;
 struct inode;
 struct iocb;
@@ -22,6 +23,7 @@ struct itimerval;
 struct kexec_segment;
 struct linux_dirent;
 struct linux_dirent64;
+struct dirent64_plus;
 struct list_head;
 struct msgbuf;
 struct msghdr;
@@ -50,6 +52,9 @@ struct timezone;
 struct tms;
 struct utimbuf;
 struct mq_attr;
+struct mq_mmsg;
+struct perfctr_attr;
+struct spawn_attr;
 
 #include <linux/config.h>
 #include <linux/types.h>
@@ -199,6 +204,9 @@ asmlinkage long sys_pause(void);
 asmlinkage long sys_sync(void);
 asmlinkage long sys_fsync(unsigned int fd);
 asmlinkage long sys_fdatasync(unsigned int fd);
+asmlinkage long sys_sync_file_range(int fd, loff_t offset, loff_t nbytes,
+					unsigned int flags);
+asmlinkage long sys_fallocate(int fd, int mode, loff_t offset, loff_t len);
 asmlinkage long sys_bdflush(int func, long data);
 asmlinkage long sys_mount(char __user *dev_name, char __user *dir_name,
 				char __user *type, unsigned long flags,
@@ -319,6 +327,10 @@ asmlinkage ssize_t sys_sendfile(int out_fd, int in_fd,
 				off_t __user *offset, size_t count);
 asmlinkage ssize_t sys_sendfile64(int out_fd, int in_fd,
 				loff_t __user *offset, size_t count);
+asmlinkage long sys_splice(int fd_in, loff_t __user *off_in,
+			   int fd_out, loff_t __user *off_out,
+			   size_t len, unsigned int flags);
+asmlinkage long sys_tee(int fdin, int fdout, size_t len, unsigned int flags);
 asmlinkage long sys_readlink(const char __user *path,
 				char __user *buf, int bufsiz);
 asmlinkage long sys_creat(const char __user *pathname, int mode);
@@ -425,6 +437,8 @@ asmlinkage long sys_select(int n, fd_set __user *inp, fd_set __user *outp,
 asmlinkage long sys_epoll_create(int size);
 asmlinkage long sys_epoll_ctl(int epfd, int op, int fd,
 				struct epoll_event __user *event);
+asmlinkage long sys_epoll_ctl_batch(int epfd, struct epoll_ctl_cmd __user *cmds,
+				int ncmds, unsigned int flags);
 asmlinkage long sys_epoll_wait(int epfd, struct epoll_event __user *events,
 				int maxevents, int timeout);
 asmlinkage long sys_gethostname(char __user *name, int len);
@@ -468,6 +482,8 @@ asmlinkage long sys_mq_timedsend(mqd_t mqdes, const char __user *msg_ptr, size_t
 asmlinkage ssize_t sys_mq_timedreceive(mqd_t mqdes, char __user *msg_ptr, size_t msg_len, unsigned int __user *msg_prio, const struct timespec __user *abs_timeout);
 asmlinkage long sys_mq_notify(mqd_t mqdes, const struct sigevent __user *notification);
 asmlinkage long sys_mq_getsetattr(mqd_t mqdes, const struct mq_attr __user *mqstat, struct mq_attr __user *omqstat);
+asmlinkage long sys_mq_timedsendv(mqd_t mqdes, const struct mq_mmsg __user *vec, unsigned int vlen, const struct timespec __user *abs_timeout);
+asmlinkage long sys_mq_timedreceivev(mqd_t mqdes, struct mq_mmsg __user *vec, unsigned int vlen, const struct timespec __user *abs_timeout);
 
 asmlinkage long sys_pciconfig_iobase(long which, unsigned long bus, unsigned long devfn);
 asmlinkage long sys_pciconfig_read(unsigned long bus, unsigned long dfn,
@@ -506,4 +522,37 @@ asmlinkage long sys_request_key(const char __user *_type,
 asmlinkage long sys_keyctl(int cmd, unsigned long arg2, unsigned long arg3,
 			   unsigned long arg4, unsigned long arg5);
 
+asmlinkage long sys_ioprio_set(int which, int who, int ioprio);
+asmlinkage long sys_ioprio_get(int which, int who);
+
+asmlinkage long sys_dio_register(unsigned long start, unsigned long len);
+asmlinkage long sys_dio_unregister(unsigned long start);
+
+asmlinkage long sys_getdents_plus(unsigned int fd,
+				struct dirent64_plus __user *dirent,
+				unsigned int count);
+
+asmlinkage long sys_inotify_init(void);
+asmlinkage long sys_inotify_add_watch(int fd, const char __user *path,
+					u32 mask);
+asmlinkage long sys_inotify_rm_watch(int fd, u32 wd);
+
+asmlinkage long sys_perfctr_open(struct perfctr_attr __user *attr,
+				pid_t pid, int cpu);
+asmlinkage long sys_spawn(const char __user *path,
+			  char __user * __user *argv,
+			  char __user * __user *envp,
+			  const struct spawn_attr __user *attr);
+asmlinkage long sys_migrate_pages(pid_t pid, unsigned long maxnode,
+				  const unsigned long __user *old_nodes,
+				  const unsigned long __user *new_nodes);
+asmlinkage long sys_signalfd(int ufd, sigset_t __user *user_mask,
+			     size_t sizemask);
+asmlinkage long sys_timerfd_create(int clockid, int flags);
+asmlinkage long sys_timerfd_settime(int ufd, int flags,
+				    const struct itimerspec __user *utmr,
+				    struct itimerspec __user *otmr);
+asmlinkage long sys_timerfd_gettime(int ufd, struct itimerspec __user *otmr);
+asmlinkage long sys_eventfd(unsigned int count);
+
 #endif
@@ -170,6 +170,9 @@ enum
 	VM_VFS_CACHE_PRESSURE=26, /* dcache/icache reclaim pressure */
 	VM_LEGACY_VA_LAYOUT=27, /* legacy/compatibility virtual address space layout */
 	VM_SWAP_TOKEN_TIMEOUT=28, /* default time for token time out */
+	VM_PERCPU_PAGELIST_FRACTION=29,/* int: fraction of pages in each percpu_pagelist */
+	VM_SWAP_TOKEN_CHECK_INTERVAL=30, /* how often the swap token may change hands */
+	VM_PREZERO_PAGES=31,	/* free pages to keep zeroed per zone */
 };
 
 
@@ -242,6 +245,8 @@ enum
 	NET_CORE_MOD_CONG=16,
 	NET_CORE_DEV_WEIGHT=17,
 	NET_CORE_SOMAXCONN=18,
+	NET_CORE_RX_STEERING=19,
+	NET_CORE_BPF_JIT_ENABLE=20,
 };
 
 /* /proc/sys/net/ethernet */
@@ -346,6 +351,7 @@ enum
 	NET_TCP_MODERATE_RCVBUF=106,
 	NET_TCP_TSO_WIN_DIVISOR=107,
 	NET_TCP_BIC_BETA=108,
+	NET_TCP_CONG_CONTROL=109,
 };
 
 enum {
@@ -677,6 +683,14 @@ enum
 	FS_XFS=17,	/* struct: control xfs parameters */
 	FS_AIO_NR=18,	/* current system-wide number of aio requests */
 	FS_AIO_MAX_NR=19,	/* system-wide maximum number of aio requests */
+	FS_INOTIFY=20,	/* inotify submenu */
+};
+
+/* /proc/sys/fs/inotify/ */
+enum {
+	INOTIFY_MAX_USER_INSTANCES=1,	/* max instances per user */
+	INOTIFY_MAX_USER_WATCHES=2,	/* max watches per user */
+	INOTIFY_MAX_QUEUED_EVENTS=3	/* max queued events per instance */
 };
 
 /* /proc/sys/fs/quota/ */
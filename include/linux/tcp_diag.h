@@ -4,6 +4,12 @@
 /* Just some random number */
 #define TCPDIAG_GETSOCK 18
 
+/* The same requests and replies, for UDP sockets.  Timers, retransmits
+ * and the TCP extensions do not apply; TCPDIAG_MEMINFO and
+ * TCPDIAG_SKMEMINFO do.
+ */
+#define UDPDIAG_GETSOCK 19
+
 /* Socket identity */
 struct tcpdiag_sockid
 {
@@ -99,9 +105,11 @@ enum
 	TCPDIAG_MEMINFO,
 	TCPDIAG_INFO,
 	TCPDIAG_VEGASINFO,
+	TCPDIAG_CONG,
+	TCPDIAG_SKMEMINFO,
 };
 
-#define TCPDIAG_MAX TCPDIAG_VEGASINFO
+#define TCPDIAG_MAX TCPDIAG_SKMEMINFO
 
 
 /* TCPDIAG_MEM */
@@ -114,6 +122,20 @@ struct tcpdiag_meminfo
 	__u32	tcpdiag_tmem;
 };
 
+/* TCPDIAG_SKMEMINFO: what the socket holds, and the limits on it */
+
+struct tcpdiag_skmeminfo
+{
+	__u32	tcpdiag_rmem_alloc;
+	__u32	tcpdiag_rcvbuf;
+	__u32	tcpdiag_wmem_alloc;
+	__u32	tcpdiag_sndbuf;
+	__u32	tcpdiag_fwd_alloc;
+	__u32	tcpdiag_wmem_queued;
+	__u32	tcpdiag_rcv_space;	/* TCP: read per rtt, as autotuning sees it */
+	__u32	tcpdiag_window_clamp;	/* TCP */
+};
+
 /* TCPDIAG_VEGASINFO */
 
 struct tcpvegas_info {
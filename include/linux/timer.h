@@ -65,6 +65,8 @@ extern void add_timer_on(struct timer_list *timer, int cpu);
 extern int del_timer(struct timer_list * timer);
 extern int __mod_timer(struct timer_list *timer, unsigned long expires);
 extern int mod_timer(struct timer_list *timer, unsigned long expires);
+extern int mod_timer_range(struct timer_list *timer, unsigned long expires,
+				unsigned long slack);
 
 extern unsigned long next_timer_interrupt(void);
 
@@ -97,6 +99,6 @@ static inline void add_timer(struct timer_list * timer)
 
 extern void init_timers(void);
 extern void run_local_timers(void);
-extern void it_real_fn(unsigned long);
+extern int it_real_fn(void *);
 
 #endif
@@ -0,0 +1,13 @@
+/*
+ *  include/linux/timerfd.h
+ *
+ *  Timers behind a file descriptor, see fs/timerfd.c.
+ */
+
+#ifndef _LINUX_TIMERFD_H
+#define _LINUX_TIMERFD_H
+
+/* it_value of timerfd_settime() is a time of the clock, not a delay */
+#define TFD_TIMER_ABSTIME	(1 << 0)
+
+#endif /* _LINUX_TIMERFD_H */
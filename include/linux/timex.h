@@ -281,6 +281,14 @@ extern long pps_stbcnt;		/* stability limit exceeded */
  * to the last value read from the timesource to insure that an earlier value
  * is not returned by a later call. The price to pay
  * for the compensation is that the timer routines are not as scalable anymore.
+ * It needs a 64-bit cmpxchg, so 32-bit machines cannot have it.
+ *
+ * Of all interpolators registered the one of the highest rating is used,
+ * and between those of the same rating the fastest or least drifting one.
+ * An architecture registering several of them rates each by what a read
+ * costs and how far it can be trusted, so that the cheapest counter which
+ * keeps time well is picked, and unregisters one once it stops doing so.
+ * Drivers which leave it 0 are only used if nothing rated is registered.
  */
 
 struct time_interpolator {
@@ -296,6 +304,7 @@ struct time_interpolator {
 	u64 last_cycle;			/* Last timer value if TIME_SOURCE_JITTER is set */
 	u64 frequency;			/* frequency in counts/second */
 	long drift;			/* drift in parts-per-million (or -1) */
+	int rating;			/* higher is preferred, 0 if unrated */
 	unsigned long skips;		/* skips forward */
 	unsigned long ns_skipped;	/* nanoseconds skipped */
 	struct time_interpolator *next;
@@ -0,0 +1,61 @@
+#ifndef _LINUX_TRACEBUF_H
+#define _LINUX_TRACEBUF_H
+
+/*
+ * Per-CPU trace buffers, see kernel/tracebuf.c.
+ *
+ * Each CPU's buffer appears in debugfs as <name>/cpu<n>.  mmap() of it
+ * gives a struct tracebuf_ctl page followed by n_subbufs sub-buffers of
+ * subbuf_size bytes.  The kernel fills sub-buffer produced % n_subbufs;
+ * those from consumed to produced - 1 are complete and hold commit[i]
+ * bytes of events each.  A reader working on the mapping advances
+ * consumed when it is done with a sub-buffer; read() does the same for
+ * a reader not using mmap().
+ */
+
+#include <linux/types.h>
+
+struct tracebuf_ctl {
+	__u32 produced;		/* sub-buffers completed, by the kernel */
+	__u32 consumed;		/* sub-buffers done with, by the reader */
+	__u32 subbuf_size;
+	__u32 n_subbufs;	/* a power of 2 */
+	__u32 flags;		/* TRACEBUF_* */
+	__u32 dropped;		/* events lost to a full buffer */
+	__u32 overwritten;	/* sub-buffers reused before consumed */
+	__u32 pad;
+	__u32 commit[0];	/* bytes of events in each sub-buffer */
+};
+
+/* Every event starts with this, and is padded to TRACEBUF_ALIGN bytes. */
+struct tracebuf_event {
+	__u32 len;		/* header and padding included */
+	__u32 id;		/* given by the writer */
+	__u64 time;		/* sched_clock(), in ns */
+};
+
+#define TRACEBUF_ALIGN		8
+
+/* when full, overwrite the oldest sub-buffer instead of dropping */
+#define TRACEBUF_OVERWRITE	1
+
+#ifdef __KERNEL__
+
+struct dentry;
+struct tracebuf;
+
+extern struct tracebuf *tracebuf_create(const char *name,
+			struct dentry *parent, size_t subbuf_size,
+			unsigned int n_subbufs, unsigned int flags);
+extern void tracebuf_destroy(struct tracebuf *tb);
+extern void tracebuf_flush(struct tracebuf *tb);
+
+extern void *tracebuf_reserve(struct tracebuf *tb, u32 id, size_t len,
+			      unsigned long *flags);
+extern void tracebuf_commit(struct tracebuf *tb, unsigned long flags);
+extern int tracebuf_write(struct tracebuf *tb, u32 id, const void *data,
+			  size_t len);
+
+#endif /* __KERNEL__ */
+
+#endif /* _LINUX_TRACEBUF_H */
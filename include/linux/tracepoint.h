@@ -0,0 +1,102 @@
+#ifndef _LINUX_TRACEPOINT_H
+#define _LINUX_TRACEPOINT_H
+
+/*
+ * Static tracepoints
+ *
+ * A tracepoint is a call site in the kernel, placed by hand, which
+ * probes can be attached to.  While no probe is attached it costs a
+ * load and a branch predicted not taken.  With probes it calls each of
+ * them, from an array which is replaced under RCU when probes come and
+ * go.  See Documentation/tracepoints.txt.
+ *
+ * A header declares the tracepoint:
+ *
+ *	DECLARE_TRACE(sched_switch,
+ *		TPPROTO(struct task_struct *prev, struct task_struct *next),
+ *		TPARGS(prev, next));
+ *
+ * one file defines it with DEFINE_TRACE(sched_switch), and the code
+ * calls trace_sched_switch(prev, next).  Probes have the same
+ * prototype and are attached with register_trace_sched_switch().
+ */
+
+#include <linux/config.h>
+#include <linux/compiler.h>
+#include <linux/errno.h>
+#include <linux/rcupdate.h>
+
+struct tracepoint {
+	const char *name;
+	int state;			/* probes attached */
+	void **funcs;			/* NULL terminated, or NULL */
+};
+
+#define TPPROTO(args...)	args
+#define TPARGS(args...)		args
+
+#ifdef CONFIG_TRACEPOINTS
+
+/*
+ * Probes may not sleep: they run in an RCU read-side critical section,
+ * and for some tracepoints with interrupts off.
+ */
+#define __DO_TRACE(tp, proto, args)					\
+	do {								\
+		void **it_func;						\
+									\
+		rcu_read_lock();					\
+		it_func = rcu_dereference((tp)->funcs);			\
+		if (it_func) {						\
+			do {						\
+				((void (*)(proto))(*it_func))(args);	\
+			} while (*(++it_func));				\
+		}							\
+		rcu_read_unlock();					\
+	} while (0)
+
+#define DECLARE_TRACE(name, proto, args)				\
+	extern struct tracepoint __tracepoint_##name;			\
+	static inline void trace_##name(proto)				\
+	{								\
+		if (unlikely(__tracepoint_##name.state))		\
+			__DO_TRACE(&__tracepoint_##name,		\
+				TPPROTO(proto), TPARGS(args));		\
+	}								\
+	static inline int register_trace_##name(void (*probe)(proto))	\
+	{								\
+		return tracepoint_probe_register(&__tracepoint_##name,	\
+						 (void *)probe);	\
+	}								\
+	static inline int unregister_trace_##name(void (*probe)(proto))	\
+	{								\
+		return tracepoint_probe_unregister(&__tracepoint_##name,\
+						   (void *)probe);	\
+	}
+
+#define DEFINE_TRACE(name)						\
+	struct tracepoint __tracepoint_##name = { #name, 0, NULL };	\
+	EXPORT_SYMBOL_GPL(__tracepoint_##name)
+
+extern int tracepoint_probe_register(struct tracepoint *tp, void *probe);
+extern int tracepoint_probe_unregister(struct tracepoint *tp, void *probe);
+
+#else /* !CONFIG_TRACEPOINTS */
+
+#define DECLARE_TRACE(name, proto, args)				\
+	static inline void trace_##name(proto)				\
+	{ }								\
+	static inline int register_trace_##name(void (*probe)(proto))	\
+	{								\
+		return -ENOSYS;						\
+	}								\
+	static inline int unregister_trace_##name(void (*probe)(proto))	\
+	{								\
+		return -ENOSYS;						\
+	}
+
+#define DEFINE_TRACE(name)
+
+#endif /* CONFIG_TRACEPOINTS */
+
+#endif /* _LINUX_TRACEPOINT_H */
@@ -285,6 +285,9 @@ struct usb_bus {
 	int bandwidth_int_reqs;		/* number of Interrupt requests */
 	int bandwidth_isoc_reqs;	/* number of Isoc. requests */
 
+	unsigned sg_tablesize;		/* 0, or most urb->sg entries the
+					 * HC takes in one urb */
+
 	struct dentry *usbfs_dentry;	/* usbfs dentry entry for the bus */
 
 	struct class_device class_dev;	/* class device for this bus */
@@ -662,6 +665,11 @@ typedef void (*usb_complete_t)(struct urb *, struct pt_regs *);
  *	the device driver is saying that it provided this DMA address,
  *	which the host controller driver should use in preference to the
  *	transfer_buffer.
+ * @sg: With URB_NO_TRANSFER_DMA_MAP, on a bus with a nonzero sg_tablesize,
+ *	a scatterlist already mapped for DMA which holds the buffer, one
+ *	entry after another; transfer_dma then is its first address.  Only
+ *	the last entry may end in a short packet.  usb_sg_init() sets this up.
+ * @num_sgs: How many entries of sg the buffer takes, 0 without sg.
  * @transfer_buffer_length: How big is transfer_buffer.  The transfer may
  *	be broken up into chunks according to the current maximum packet
  *	size for the endpoint, which is a function of the configuration
@@ -816,6 +824,8 @@ struct urb
 	void *transfer_buffer;		/* (in) associated data buffer */
 	dma_addr_t transfer_dma;	/* (in) dma addr for transfer_buffer */
 	int transfer_buffer_length;	/* (in) data buffer length */
+	struct scatterlist *sg;		/* (in) mapped buffer, or NULL */
+	int num_sgs;			/* (in) number of entries in sg */
 	int actual_length;		/* (return) actual transfer length */
 	unsigned char *setup_packet;	/* (in) setup packet (control only) */
 	dma_addr_t setup_dma;		/* (in) dma addr for setup_packet */
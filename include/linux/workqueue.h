@@ -58,6 +58,7 @@ extern struct workqueue_struct *__create_workqueue(const char *name,
 extern void destroy_workqueue(struct workqueue_struct *wq);
 
 extern int FASTCALL(queue_work(struct workqueue_struct *wq, struct work_struct *work));
+extern int FASTCALL(queue_work_on(int cpu, struct workqueue_struct *wq, struct work_struct *work));
 extern int FASTCALL(queue_delayed_work(struct workqueue_struct *wq, struct work_struct *work, unsigned long delay));
 extern void FASTCALL(flush_workqueue(struct workqueue_struct *wq));
 
@@ -70,6 +71,12 @@ extern int current_is_keventd(void);
 extern int keventd_up(void);
 
 extern void init_workqueues(void);
+
+/* Scheduler hooks for the worker pools */
+struct task_struct;
+extern int wq_worker_sleeping(struct task_struct *task);
+extern void wq_worker_waking_up(struct task_struct *task);
+
 void cancel_rearming_delayed_work(struct work_struct *work);
 
 /*
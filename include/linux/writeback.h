@@ -84,6 +84,8 @@ static inline void wait_on_inode(struct inode *inode)
  * mm/page-writeback.c
  */
 int wakeup_bdflush(long nr_pages);
+void bdi_writeback(struct backing_dev_info *bdi, long min_pages,
+			int for_kupdate);
 void laptop_io_completion(void);
 void laptop_sync_completion(void);
 void throttle_vm_writeout(void);
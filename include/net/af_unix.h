@@ -58,6 +58,8 @@ struct unix_skb_parms {
 #define unix_state_wunlock(s)	write_unlock(&unix_sk(s)->lock)
 
 #ifdef __KERNEL__
+struct unix_direct;
+
 /* The AF_UNIX socket */
 struct unix_sock {
 	/* WARNING: sk has to be the first member */
@@ -72,6 +74,7 @@ struct unix_sock {
         atomic_t                inflight;
         rwlock_t                lock;
         wait_queue_head_t       peer_wait;
+	struct unix_direct	*direct;	/* reader buffer posted for writers */
 };
 #define unix_sk(__sk) ((struct unix_sock *)__sk)
 #endif
@@ -253,6 +253,7 @@ struct ip_vs_daemon_user {
 #include <linux/skbuff.h>               /* for struct sk_buff */
 #include <linux/ip.h>                   /* for struct iphdr */
 #include <asm/atomic.h>                 /* for struct atomic_t */
+#include <linux/rcupdate.h>		/* for struct rcu_head */
 #include <linux/netdevice.h>		/* for struct neighbour */
 #include <net/dst.h>			/* for struct dst_entry */
 #include <net/tcp.h>
@@ -498,7 +499,7 @@ extern struct ip_vs_protocol * ip_vs_proto_get(unsigned short proto);
  *	IP_VS structure allocated for each dynamically scheduled connection
  */
 struct ip_vs_conn {
-	struct list_head        c_list;         /* hashed list heads */
+	struct list_head        c_list;         /* hashed list heads, RCU */
 
 	/* Protocol, addresses and port numbers */
 	__u32                   caddr;          /* client address */
@@ -539,6 +540,8 @@ struct ip_vs_conn {
 	void                    *app_data;      /* Application private data */
 	struct ip_vs_seq        in_seq;         /* incoming seq. struct */
 	struct ip_vs_seq        out_seq;        /* outgoing seq. struct */
+
+	struct rcu_head		rcu_head;	/* freeing after lookups */
 };
 
 
@@ -713,7 +716,9 @@ extern void ip_vs_init_hash_table(struct list_head *table, int rows);
  */
 
 /*
- *     IPVS connection entry hash table
+ *     IPVS connection entry hash table, of at least IP_VS_CONN_TAB_BITS
+ *     bits.  It gets bigger with the memory, or the conn_tab_bits of the
+ *     module, up to IP_VS_CONN_TAB_MAX_BITS.
  */
 #ifndef CONFIG_IP_VS_TAB_BITS
 #define CONFIG_IP_VS_TAB_BITS   12
@@ -728,8 +733,8 @@ extern void ip_vs_init_hash_table(struct list_head *table, int rows);
 #if 8 <= CONFIG_IP_VS_TAB_BITS && CONFIG_IP_VS_TAB_BITS <= 20
 #define IP_VS_CONN_TAB_BITS	CONFIG_IP_VS_TAB_BITS
 #endif
-#define IP_VS_CONN_TAB_SIZE     (1 << IP_VS_CONN_TAB_BITS)
-#define IP_VS_CONN_TAB_MASK     (IP_VS_CONN_TAB_SIZE - 1)
+#define IP_VS_CONN_TAB_MAX_BITS	22
+extern int ip_vs_conn_tab_size;
 
 enum {
 	IP_VS_DIR_INPUT = 0,
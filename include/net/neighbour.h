@@ -109,6 +109,8 @@ struct neigh_statistics
 
 	unsigned long periodic_gc_runs;	/* number of periodic GC runs */
 	unsigned long forced_gc_runs;	/* number of forced GC runs */
+	unsigned long forced_gc_goal_miss; /* forced GC runs short of gc_thresh2 */
+	unsigned long gc_reclaimed;	/* number of neighs freed by GC */
 };
 
 #define NEIGH_CACHE_STAT_INC(tbl, field)				\
@@ -140,6 +142,7 @@ struct neighbour
 	struct sk_buff_head	arp_queue;
 	struct timer_list	timer;
 	struct neigh_ops	*ops;
+	struct rcu_head		rcu;
 	u8			primary_key[0];
 };
 
@@ -199,6 +202,7 @@ struct neigh_table
 	unsigned int		hash_mask;
 	__u32			hash_rnd;
 	unsigned int		hash_chain_gc;
+	unsigned int		hash_chain_forced_gc;
 	struct pneigh_entry	**phash_buckets;
 #ifdef CONFIG_PROC_FS
 	struct proc_dir_entry	*pde;
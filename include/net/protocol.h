@@ -37,6 +37,10 @@
 struct net_protocol {
 	int			(*handler)(struct sk_buff *skb);
 	void			(*err_handler)(struct sk_buff *skb, u32 info);
+	struct sk_buff	       *(*gso_segment)(struct sk_buff *skb,
+					       int features);
+	int			(*gro_receive)(struct sk_buff *held,
+					       struct sk_buff *skb);
 	int			no_policy;
 };
 
@@ -49,6 +53,8 @@ struct inet6_protocol
 			       struct inet6_skb_parm *opt,
 			       int type, int code, int offset,
 			       __u32 info);
+	struct sk_buff	       *(*gso_segment)(struct sk_buff *skb,
+					       int features);
 	unsigned int	flags;	/* INET6_PROTO_xxx */
 };
 
@@ -32,6 +32,7 @@ struct Qdisc
 #define TCQ_F_BUILTIN	1
 #define TCQ_F_THROTTLED	2
 #define TCQ_F_INGRESS	4
+#define TCQ_F_CAN_BYPASS	8	/* empty => skbs may go straight to the driver */
 	int			padded;
 	struct Qdisc_ops	*ops;
 	u32			handle;
@@ -307,6 +307,30 @@ static inline void sock_hold(struct sock *sk)
 	atomic_inc(&sk->sk_refcnt);
 }
 
+#ifdef __HAVE_ARCH_CMPXCHG
+/* Sockets of protocols with SLAB_DESTROY_BY_RCU caches may be looked
+   up without the hash locks, under rcu_read_lock().  Such a walk can
+   run into a socket which is being freed or even reused, so it may
+   only grab it if the refcnt has not dropped to zero yet, and has to
+   check the identity again after that.
+ */
+#define SOCK_LOCKLESS_LOOKUP
+
+static inline int sock_hold_not_zero(struct sock *sk)
+{
+	int c = atomic_read(&sk->sk_refcnt);
+
+	while (c) {
+		int old = cmpxchg(&sk->sk_refcnt.counter, c, c + 1);
+
+		if (likely(old == c))
+			return 1;
+		c = old;
+	}
+	return 0;
+}
+#endif
+
 /* Ungrab socket in the context, which assumes that socket refcnt
    cannot hit zero, f.e. it is true in context of any socketcall.
  */
@@ -332,6 +356,12 @@ static __inline__ void __sk_add_node(struct sock *sk, struct hlist_head *list)
 	hlist_add_head(&sk->sk_node, list);
 }
 
+static __inline__ void __sk_add_node_rcu(struct sock *sk,
+					 struct hlist_head *list)
+{
+	hlist_add_head_rcu(&sk->sk_node, list);
+}
+
 static __inline__ void sk_add_node(struct sock *sk, struct hlist_head *list)
 {
 	sock_hold(sk);
@@ -351,6 +381,8 @@ static __inline__ void sk_add_bind_node(struct sock *sk,
 
 #define sk_for_each(__sk, node, list) \
 	hlist_for_each_entry(__sk, node, list, sk_node)
+#define sk_for_each_rcu(__sk, node, list) \
+	hlist_for_each_entry_rcu(__sk, node, list, sk_node)
 #define sk_for_each_from(__sk, node) \
 	if (__sk && ({ node = &(__sk)->sk_node; 1; })) \
 		hlist_for_each_entry_from(__sk, node, sk_node)
@@ -379,6 +411,7 @@ enum sock_flags {
 	SOCK_NO_LARGESEND, /* whether to sent large segments or not */
 	SOCK_LOCALROUTE, /* route locally only, %SO_DONTROUTE setting */
 	SOCK_QUEUE_SHRUNK, /* write queue has been shrunk recently */
+	SOCK_REUSEPORT, /* %SO_REUSEPORT setting */
 };
 
 static inline void sock_set_flag(struct sock *sk, enum sock_flags flag)
@@ -543,6 +576,7 @@ struct proto {
 
 	kmem_cache_t		*slab;
 	unsigned int		obj_size;
+	unsigned long		slab_flags;
 
 	struct module		*owner;
 
@@ -791,8 +825,7 @@ static inline int sk_filter(struct sock *sk, struct sk_buff *skb, int needlock)
 		
 		filter = sk->sk_filter;
 		if (filter) {
-			int pkt_len = sk_run_filter(skb, filter->insns,
-						    filter->len);
+			int pkt_len = SK_RUN_FILTER(filter, skb);
 			if (!pkt_len)
 				err = -EPERM;
 			else
@@ -819,8 +852,10 @@ static inline void sk_filter_release(struct sock *sk, struct sk_filter *fp)
 
 	atomic_sub(size, &sk->sk_omem_alloc);
 
-	if (atomic_dec_and_test(&fp->refcnt))
+	if (atomic_dec_and_test(&fp->refcnt)) {
+		bpf_jit_free(fp);
 		kfree(fp);
+	}
 }
 
 static inline void sk_filter_charge(struct sock *sk, struct sk_filter *fp)
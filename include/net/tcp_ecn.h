@@ -29,11 +29,18 @@ static inline void TCP_ECN_send_synack(struct tcp_sock *tp,
 static inline void TCP_ECN_send_syn(struct sock *sk, struct tcp_sock *tp,
 				    struct sk_buff *skb)
 {
+	struct dst_entry *dst = __sk_dst_get(sk);
+
 	tp->ecn_flags = 0;
-	if (sysctl_tcp_ecn && !(sk->sk_route_caps & NETIF_F_TSO)) {
+	/* Only hardware TSO gets in the way of ECN, large sends that
+	 * would be segmented in software are simply given up.
+	 */
+	if (sysctl_tcp_ecn &&
+	    !(sk->sk_route_caps & dst->dev->features & NETIF_F_TSO)) {
 		TCP_SKB_CB(skb)->flags |= TCPCB_FLAG_ECE|TCPCB_FLAG_CWR;
 		tp->ecn_flags = TCP_ECN_OK;
 		sock_set_flag(sk, SOCK_NO_LARGESEND);
+		sk->sk_route_caps &= ~NETIF_F_TSO;
 	}
 }
 
@@ -25,6 +25,7 @@
 #include <linux/udp.h>
 #include <linux/ip.h>
 #include <linux/list.h>
+#include <linux/jhash.h>
 #include <net/sock.h>
 #include <net/snmp.h>
 #include <linux/seq_file.h>
@@ -38,6 +39,37 @@
 extern struct hlist_head udp_hash[UDP_HTABLE_SIZE];
 extern rwlock_t udp_hash_lock;
 
+/* The same sockets on sk_bind_node, hashed on the IPv4 local address
+ * they had when hashed as well as on the port.  Only bind() gives a
+ * hashed socket an address it can lose again, so a socket is in its
+ * own address' chain or in the INADDR_ANY one.
+ */
+#define UDP_HASH2_SIZE		1024
+
+extern struct hlist_head udp_hash2[UDP_HASH2_SIZE];
+
+static inline struct hlist_head *udp_hash2_slot(u32 addr, unsigned short num)
+{
+	return &udp_hash2[jhash_2words(addr, num, 0) & (UDP_HASH2_SIZE - 1)];
+}
+
+/* Both under write_lock_bh(&udp_hash_lock) */
+static inline void udp_hash_add(struct sock *sk)
+{
+	struct inet_sock *inet = inet_sk(sk);
+
+	sk_add_node(sk, &udp_hash[inet->num & (UDP_HTABLE_SIZE - 1)]);
+	sk_add_bind_node(sk, udp_hash2_slot(inet->rcv_saddr, inet->num));
+}
+
+static inline int udp_hash_del(struct sock *sk)
+{
+	if (!sk_del_node_init(sk))
+		return 0;
+	__sk_del_bind_node(sk);
+	return 1;
+}
+
 extern int udp_port_rover;
 
 static inline int udp_lport_inuse(u16 num)
@@ -91,6 +123,8 @@ struct udp_seq_afinfo {
 struct udp_iter_state {
 	sa_family_t		family;
 	int			bucket;
+	int			offset;		/* entry within bucket */
+	loff_t			last_pos;	/* position of that entry */
 	struct seq_operations	seq_ops;
 };
 
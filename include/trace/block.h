@@ -0,0 +1,51 @@
+#ifndef _TRACE_BLOCK_H
+#define _TRACE_BLOCK_H
+
+#include <linux/blkdev.h>
+#include <linux/tracepoint.h>
+
+/* a bio entering the request queue of q, before merging */
+DECLARE_TRACE(block_bio_queue,
+	TPPROTO(request_queue_t *q, struct bio *bio),
+	TPARGS(q, bio));
+
+/* bio merged into the request rq, queue_lock held */
+DECLARE_TRACE(block_bio_backmerge,
+	TPPROTO(request_queue_t *q, struct request *rq, struct bio *bio),
+	TPARGS(q, rq, bio));
+
+DECLARE_TRACE(block_bio_frontmerge,
+	TPPROTO(request_queue_t *q, struct request *rq, struct bio *bio),
+	TPARGS(q, rq, bio));
+
+/* a new request for bio, queue_lock held */
+DECLARE_TRACE(block_getrq,
+	TPPROTO(request_queue_t *q, struct bio *bio),
+	TPARGS(q, bio));
+
+/* no free request for bio, about to sleep for one */
+DECLARE_TRACE(block_sleeprq,
+	TPPROTO(request_queue_t *q, struct bio *bio),
+	TPARGS(q, bio));
+
+/* rq added to the io scheduler, queue_lock held, as for the next two */
+DECLARE_TRACE(block_rq_insert,
+	TPPROTO(request_queue_t *q, struct request *rq),
+	TPARGS(q, rq));
+
+/* rq handed to the driver for the first time */
+DECLARE_TRACE(block_rq_issue,
+	TPPROTO(request_queue_t *q, struct request *rq),
+	TPARGS(q, rq));
+
+/* rq given back by the driver */
+DECLARE_TRACE(block_rq_requeue,
+	TPPROTO(request_queue_t *q, struct request *rq),
+	TPARGS(q, rq));
+
+/* bytes from rq->hard_sector on are done, error is 0 or -errno */
+DECLARE_TRACE(block_rq_complete,
+	TPPROTO(request_queue_t *q, struct request *rq, int bytes, int error),
+	TPARGS(q, rq, bytes, error));
+
+#endif
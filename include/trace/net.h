@@ -0,0 +1,17 @@
+#ifndef _TRACE_NET_H
+#define _TRACE_NET_H
+
+#include <linux/skbuff.h>
+#include <linux/tracepoint.h>
+
+/* passed to dev_queue_xmit() */
+DECLARE_TRACE(net_dev_queue,
+	TPPROTO(struct sk_buff *skb),
+	TPARGS(skb));
+
+/* received through netif_receive_skb(), in softirq */
+DECLARE_TRACE(net_dev_receive,
+	TPPROTO(struct sk_buff *skb),
+	TPARGS(skb));
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef _TRACE_SCHED_H
+#define _TRACE_SCHED_H
+
+#include <linux/sched.h>
+#include <linux/tracepoint.h>
+
+/* with the runqueue locked and interrupts off */
+DECLARE_TRACE(sched_wakeup,
+	TPPROTO(struct task_struct *p, int success),
+	TPARGS(p, success));
+
+/* just before the switch, with the runqueue locked and interrupts off */
+DECLARE_TRACE(sched_switch,
+	TPPROTO(struct task_struct *prev, struct task_struct *next),
+	TPARGS(prev, next));
+
+#endif
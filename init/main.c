@@ -47,6 +47,8 @@
 #include <linux/rmap.h>
 #include <linux/mempolicy.h>
 #include <linux/key.h>
+#include <linux/kthread.h>
+#include <linux/hrtimer.h>
 
 #include <asm/io.h>
 #include <asm/bugs.h>
@@ -461,11 +463,13 @@ asmlinkage void __init start_kernel(void)
 		   __stop___param - __start___param,
 		   &unknown_bootoption);
 	sort_main_extable();
+	sort_main_ksymtab();
 	trap_init();
 	rcu_init();
 	init_IRQ();
 	pidhash_init();
 	init_timers();
+	hrtimers_init();
 	softirq_init();
 	time_init();
 
@@ -539,36 +543,202 @@ struct task_struct *child_reaper = &init_task;
 
 extern initcall_t __initcall_start[], __initcall_end[];
 
-static void __init do_initcalls(void)
+static unsigned long __init ktime_to_usecs(ktime_t t)
+{
+	u64 usecs = t;
+
+	do_div(usecs, NSEC_PER_USEC);
+	return (unsigned long)usecs;
+}
+
+#define usecs_since(start)	ktime_to_usecs(ktime_get() - (start))
+
+static void __init do_one_initcall(initcall_t fn)
 {
-	initcall_t *call;
 	int count = preempt_count();
+	ktime_t start = 0;
+	char *msg;
+	int ret;
+
+	if (initcall_debug) {
+		printk(KERN_DEBUG "Calling initcall 0x%p", fn);
+		print_fn_descriptor_symbol(": %s()", (unsigned long) fn);
+		printk("\n");
+		start = ktime_get();
+	}
 
-	for (call = __initcall_start; call < __initcall_end; call++) {
-		char *msg;
+	ret = fn();
 
-		if (initcall_debug) {
-			printk(KERN_DEBUG "Calling initcall 0x%p", *call);
-			print_fn_descriptor_symbol(": %s()", (unsigned long) *call);
-			printk("\n");
-		}
+	if (initcall_debug) {
+		printk(KERN_DEBUG "initcall 0x%p", fn);
+		print_fn_descriptor_symbol(": %s()", (unsigned long) fn);
+		printk(" returned %d after %lu usecs\n", ret, usecs_since(start));
+	}
 
-		(*call)();
+	msg = NULL;
+	if (preempt_count() != count) {
+		msg = "preemption imbalance";
+		preempt_count() = count;
+	}
+	if (irqs_disabled()) {
+		msg = "disabled interrupts";
+		local_irq_enable();
+	}
+	if (msg) {
+		printk(KERN_WARNING "error in initcall at 0x%p: "
+			"returned with %s\n", fn, msg);
+	}
+}
 
-		msg = NULL;
-		if (preempt_count() != count) {
-			msg = "preemption imbalance";
-			preempt_count() = count;
-		}
-		if (irqs_disabled()) {
-			msg = "disabled interrupts";
-			local_irq_enable();
-		}
-		if (msg) {
-			printk(KERN_WARNING "error in initcall at 0x%p: "
-				"returned with %s\n", *call, msg);
+/*
+ * Asynchronous initcalls run in a few kinitcalld threads, in the order
+ * they were queued, while do_initcalls() goes on with the rest.  The
+ * bus scans and probes which sleep for a long time then overlap.
+ * initcall_threads=0 runs them in order, like the others.
+ */
+struct async_initcall {
+	struct list_head	list;
+	initcall_t		fn;
+};
+
+#define MAX_INITCALL_THREADS	16
+
+static int initcall_threads __initdata = -1;	/* -1: from num_online_cpus() */
+static struct task_struct *initcall_tasks[MAX_INITCALL_THREADS] __initdata;
+static int nr_initcall_tasks __initdata;
+static LIST_HEAD(async_initcalls);
+static DEFINE_SPINLOCK(async_initcall_lock);
+static int async_initcalls_pending;	/* queued or running */
+static DECLARE_WAIT_QUEUE_HEAD(async_initcall_wait);	/* for work */
+static DECLARE_WAIT_QUEUE_HEAD(async_initcall_done);
+static ktime_t async_initcall_waited __initdata;
+
+static int __init initcall_threads_setup(char *str)
+{
+	get_option(&str, &initcall_threads);
+	if (initcall_threads > MAX_INITCALL_THREADS)
+		initcall_threads = MAX_INITCALL_THREADS;
+	return 1;
+}
+__setup("initcall_threads=", initcall_threads_setup);
+
+/* kthread_stop() waits for it to return, before the init text is freed */
+static int __init async_initcall_thread(void *unused)
+{
+	struct async_initcall *ac;
+
+	while (!kthread_should_stop()) {
+		wait_event_interruptible(async_initcall_wait,
+				!list_empty(&async_initcalls) ||
+				kthread_should_stop());
+
+		spin_lock(&async_initcall_lock);
+		if (list_empty(&async_initcalls)) {
+			spin_unlock(&async_initcall_lock);
+			continue;
 		}
+		ac = list_entry(async_initcalls.next, struct async_initcall,
+				list);
+		list_del(&ac->list);
+		spin_unlock(&async_initcall_lock);
+
+		do_one_initcall(ac->fn);
+		kfree(ac);
+
+		spin_lock(&async_initcall_lock);
+		if (!--async_initcalls_pending)
+			wake_up_all(&async_initcall_done);
+		spin_unlock(&async_initcall_lock);
+	}
+	return 0;
+}
+
+static void __init start_initcall_threads(void)
+{
+	struct task_struct *p;
+
+	if (initcall_threads < 0)
+		initcall_threads = min(2 * num_online_cpus() + 2,
+				       MAX_INITCALL_THREADS);
+	while (nr_initcall_tasks < initcall_threads) {
+		p = kthread_run(async_initcall_thread, NULL, "kinitcalld/%d",
+				nr_initcall_tasks);
+		if (IS_ERR(p))
+			break;
+		initcall_tasks[nr_initcall_tasks++] = p;
 	}
+}
+
+/**
+ * initcall_async - run an initcall in parallel with the others
+ * @fn: the initcall
+ *
+ * Queue @fn for one of the initcall threads, or call it right away if
+ * there are none.  Only for builtin code before the late initcalls;
+ * use device_initcall_async().
+ */
+int __init initcall_async(initcall_t fn)
+{
+	struct async_initcall *ac;
+
+	if (!nr_initcall_tasks && initcall_threads)
+		start_initcall_threads();
+
+	ac = kmalloc(sizeof(*ac), GFP_KERNEL);
+	if (!ac || !nr_initcall_tasks) {
+		kfree(ac);
+		do_one_initcall(fn);
+		return 0;
+	}
+	ac->fn = fn;
+
+	spin_lock(&async_initcall_lock);
+	list_add_tail(&ac->list, &async_initcalls);
+	async_initcalls_pending++;
+	spin_unlock(&async_initcall_lock);
+	wake_up(&async_initcall_wait);
+	return 0;
+}
+
+/**
+ * initcall_async_sync - wait for the asynchronous initcalls queued so far
+ *
+ * For an initcall depending on what one of them sets up.
+ */
+void __init initcall_async_sync(void)
+{
+	ktime_t start = ktime_get();
+
+	wait_event(async_initcall_done, !async_initcalls_pending);
+	async_initcall_waited += ktime_get() - start;
+}
+
+/*
+ * init/ is linked first, so this is the first late initcall: the late
+ * ones find the device initcalls done, the asynchronous ones included.
+ */
+static int __init async_initcall_barrier(void)
+{
+	initcall_async_sync();
+	return 0;
+}
+late_initcall(async_initcall_barrier);
+
+static void __init do_initcalls(void)
+{
+	initcall_t *call;
+	ktime_t start = ktime_get();
+	int i;
+
+	for (call = __initcall_start; call < __initcall_end; call++)
+		do_one_initcall(*call);
+
+	initcall_async_sync();
+	for (i = 0; i < nr_initcall_tasks; i++)
+		kthread_stop(initcall_tasks[i]);
+	printk(KERN_INFO "Initcalls done in %lu ms, %lu ms of it waiting for "
+	       "%d initcall threads\n", usecs_since(start) / 1000,
+	       ktime_to_usecs(async_initcall_waited) / 1000, nr_initcall_tasks);
 
 	/* Make sure there is no pending stuff from the initcall sequence */
 	flush_scheduled_work();
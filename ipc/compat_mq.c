@@ -11,6 +11,7 @@
 #include <linux/kernel.h>
 #include <linux/mqueue.h>
 #include <linux/syscalls.h>
+#include <linux/uio.h>
 
 #include <asm/uaccess.h>
 
@@ -22,6 +23,12 @@ struct compat_mq_attr {
 	compat_long_t __reserved[4]; /* ignored for input, zeroed for output */
 };
 
+struct compat_mq_mmsg {
+	compat_uptr_t	msg_ptr;
+	compat_size_t	msg_len;
+	unsigned int	msg_prio;
+};
+
 static inline int get_compat_mq_attr(struct mq_attr *attr,
 			const struct compat_mq_attr __user *uattr)
 {
@@ -102,6 +109,82 @@ asmlinkage ssize_t compat_sys_mq_timedreceive(mqd_t mqdes,
 			u_msg_prio, u_ts);
 }
 
+/*
+ * Room for the timeout and a vector of vlen messages in 64 bit layout,
+ * the first filled in from u_vec.
+ */
+static int compat_prepare_mmsg(struct timespec __user **p,
+			       struct mq_mmsg __user **vec,
+			       const struct compat_timespec __user *u,
+			       const struct compat_mq_mmsg __user *u_vec,
+			       unsigned int vlen)
+{
+	struct compat_mq_mmsg cm;
+	struct mq_mmsg m;
+	struct timespec ts;
+	unsigned int i;
+
+	*p = compat_alloc_user_space(sizeof(ts) + vlen * sizeof(m));
+	*vec = (struct mq_mmsg __user *)(*p + 1);
+	if (u) {
+		if (get_compat_timespec(&ts, u) ||
+		    copy_to_user(*p, &ts, sizeof(ts)))
+			return -EFAULT;
+	} else
+		*p = NULL;
+	for (i = 0; i < vlen; i++) {
+		if (copy_from_user(&cm, &u_vec[i], sizeof(cm)))
+			return -EFAULT;
+		m.msg_ptr = compat_ptr(cm.msg_ptr);
+		m.msg_len = cm.msg_len;
+		m.msg_prio = cm.msg_prio;
+		if (copy_to_user(&(*vec)[i], &m, sizeof(m)))
+			return -EFAULT;
+	}
+	return 0;
+}
+
+asmlinkage long compat_sys_mq_timedsendv(mqd_t mqdes,
+			const struct compat_mq_mmsg __user *u_vec,
+			unsigned int vlen,
+			const struct compat_timespec __user *u_abs_timeout)
+{
+	struct timespec __user *u_ts;
+	struct mq_mmsg __user *vec;
+
+	if (vlen > UIO_MAXIOV)
+		return -EINVAL;
+	if (compat_prepare_mmsg(&u_ts, &vec, u_abs_timeout, u_vec, vlen))
+		return -EFAULT;
+
+	return sys_mq_timedsendv(mqdes, vec, vlen, u_ts);
+}
+
+asmlinkage long compat_sys_mq_timedreceivev(mqd_t mqdes,
+			struct compat_mq_mmsg __user *u_vec,
+			unsigned int vlen,
+			const struct compat_timespec __user *u_abs_timeout)
+{
+	struct timespec __user *u_ts;
+	struct mq_mmsg __user *vec;
+	struct mq_mmsg m;
+	long ret, i;
+
+	if (vlen > UIO_MAXIOV)
+		return -EINVAL;
+	if (compat_prepare_mmsg(&u_ts, &vec, u_abs_timeout, u_vec, vlen))
+		return -EFAULT;
+
+	ret = sys_mq_timedreceivev(mqdes, vec, vlen, u_ts);
+	for (i = 0; i < ret; i++) {
+		if (copy_from_user(&m, &vec[i], sizeof(m)) ||
+		    put_user(m.msg_len, &u_vec[i].msg_len) ||
+		    put_user(m.msg_prio, &u_vec[i].msg_prio))
+			return -EFAULT;
+	}
+	return ret;
+}
+
 asmlinkage long compat_sys_mq_notify(mqd_t mqdes,
 			const struct compat_sigevent __user *u_notification)
 {
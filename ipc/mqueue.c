@@ -23,6 +23,7 @@
 #include <linux/skbuff.h>
 #include <linux/netlink.h>
 #include <linux/syscalls.h>
+#include <linux/uio.h>
 #include <net/sock.h>
 #include "util.h"
 
@@ -63,7 +64,9 @@ struct mqueue_inode_info {
 	struct inode vfs_inode;
 	wait_queue_head_t wait_q;
 
+	/* a ring of mq_maxmsg slots, sorted by priority from msg_head up */
 	struct msg_msg **messages;
+	unsigned long msg_head;
 	struct mq_attr attr;
 
 	struct sigevent notify;
@@ -99,6 +102,17 @@ static inline struct mqueue_inode_info *MQUEUE_I(struct inode *inode)
 	return container_of(inode, struct mqueue_inode_info, vfs_inode);
 }
 
+/* Slot of the message with index i in priority order, 0 the lowest */
+static inline struct msg_msg **msg_slot(struct mqueue_inode_info *info,
+					long i)
+{
+	unsigned long k = info->msg_head + i;
+
+	if (k >= info->attr.mq_maxmsg)
+		k -= info->attr.mq_maxmsg;
+	return &info->messages[k];
+}
+
 static struct inode *mqueue_get_inode(struct super_block *sb, int mode,
 							struct mq_attr *attr)
 {
@@ -129,6 +143,7 @@ static struct inode *mqueue_get_inode(struct super_block *sb, int mode,
 			INIT_LIST_HEAD(&info->e_wait_q[0].list);
 			INIT_LIST_HEAD(&info->e_wait_q[1].list);
 			info->messages = NULL;
+			info->msg_head = 0;
 			info->notify_owner = 0;
 			info->qsize = 0;
 			info->user = NULL;	/* set when all is ok */
@@ -244,7 +259,7 @@ static void mqueue_delete_inode(struct inode *inode)
 	info = MQUEUE_I(inode);
 	spin_lock(&info->lock);
 	for (i = 0; i < info->attr.mq_curmsgs; i++)
-		free_msg(info->messages[i]);
+		free_msg(*msg_slot(info, i));
 	kfree(info->messages);
 	spin_unlock(&info->lock);
 
@@ -461,25 +476,50 @@ static struct ext_wait_queue *wq_get_first_waiter(
 	return list_entry(ptr, struct ext_wait_queue, list);
 }
 
-/* Auxiliary functions to manipulate messages' list */
+/*
+ * Auxiliary functions to manipulate messages' list
+ *
+ * Messages are received from the top of the ring, and a new message goes
+ * below those of its priority and above those of lower priority, so
+ * that each priority is received in the order sent.  The shorter side
+ * of the ring moves to make room: a message of no higher priority than
+ * any queued, as when all are sent with the same one, is put in place
+ * by moving msg_head alone.
+ */
 static void msg_insert(struct msg_msg *ptr, struct mqueue_inode_info *info)
 {
-	int k;
+	long n = info->attr.mq_curmsgs;
+	long lo = 0, hi = n, k;
+
+	/* lo: the number of messages of lower priority */
+	while (lo < hi) {
+		long mid = (lo + hi) / 2;
 
-	k = info->attr.mq_curmsgs - 1;
-	while (k >= 0 && info->messages[k]->m_type >= ptr->m_type) {
-		info->messages[k + 1] = info->messages[k];
-		k--;
+		if ((*msg_slot(info, mid))->m_type < ptr->m_type)
+			lo = mid + 1;
+		else
+			hi = mid;
 	}
+
+	if (lo < n - lo) {
+		info->msg_head = (info->msg_head ? : info->attr.mq_maxmsg) - 1;
+		for (k = 0; k < lo; k++)
+			*msg_slot(info, k) = *msg_slot(info, k + 1);
+	} else {
+		for (k = n; k > lo; k--)
+			*msg_slot(info, k) = *msg_slot(info, k - 1);
+	}
+	*msg_slot(info, lo) = ptr;
 	info->attr.mq_curmsgs++;
 	info->qsize += ptr->m_ts;
-	info->messages[k + 1] = ptr;
 }
 
 static inline struct msg_msg *msg_get(struct mqueue_inode_info *info)
 {
-	info->qsize -= info->messages[--info->attr.mq_curmsgs]->m_ts;
-	return info->messages[info->attr.mq_curmsgs];
+	struct msg_msg *ptr = *msg_slot(info, --info->attr.mq_curmsgs);
+
+	info->qsize -= ptr->m_ts;
+	return ptr;
 }
 
 static inline void set_cookie(struct sk_buff *skb, char code)
@@ -948,6 +988,226 @@ out:
 	return ret;
 }
 
+/*
+ * mq_timedsendv() and mq_timedreceivev() move a vector of messages, at
+ * most a queue's worth, with one hold of the queue lock.  They block, or
+ * time out, as the calls above do, but only while not even the first
+ * message can be moved; then they move what they can without waiting,
+ * and return how many messages that was.
+ */
+asmlinkage long sys_mq_timedsendv(mqd_t mqdes,
+	const struct mq_mmsg __user *u_vec, unsigned int vlen,
+	const struct timespec __user *u_abs_timeout)
+{
+	LIST_HEAD(msgs);
+	struct mq_mmsg m;
+	struct file *filp;
+	struct inode *inode;
+	struct ext_wait_queue wait;
+	struct ext_wait_queue *receiver;
+	struct msg_msg *msg_ptr, *tmp;
+	struct mqueue_inode_info *info;
+	long timeout;
+	unsigned int i, sent = 0;
+	int ret, notify = 1;
+
+	if (unlikely(vlen > UIO_MAXIOV))
+		return -EINVAL;
+
+	timeout = prepare_timeout(u_abs_timeout);
+
+	ret = -EBADF;
+	filp = fget(mqdes);
+	if (unlikely(!filp))
+		goto out;
+
+	inode = filp->f_dentry->d_inode;
+	if (unlikely(filp->f_op != &mqueue_file_operations))
+		goto out_fput;
+	info = MQUEUE_I(inode);
+
+	if (unlikely(!(filp->f_mode & FMODE_WRITE)))
+		goto out_fput;
+
+	if (vlen > info->attr.mq_maxmsg)
+		vlen = info->attr.mq_maxmsg;
+
+	/* First load all the messages, before doing anything with the queue */
+	for (i = 0; i < vlen; i++) {
+		ret = -EFAULT;
+		if (copy_from_user(&m, &u_vec[i], sizeof(m)))
+			goto out_free;
+		ret = -EINVAL;
+		if (unlikely(m.msg_prio >= (unsigned long) MQ_PRIO_MAX))
+			goto out_free;
+		ret = -EMSGSIZE;
+		if (unlikely(m.msg_len > info->attr.mq_msgsize))
+			goto out_free;
+		msg_ptr = load_msg(m.msg_ptr, m.msg_len);
+		if (IS_ERR(msg_ptr)) {
+			ret = PTR_ERR(msg_ptr);
+			goto out_free;
+		}
+		msg_ptr->m_ts = m.msg_len;
+		msg_ptr->m_type = m.msg_prio;
+		list_add_tail(&msg_ptr->m_list, &msgs);
+	}
+	ret = 0;
+	if (!vlen)
+		goto out_fput;
+
+	spin_lock(&info->lock);
+
+	if (info->attr.mq_curmsgs == info->attr.mq_maxmsg) {
+		if (filp->f_flags & O_NONBLOCK) {
+			spin_unlock(&info->lock);
+			ret = -EAGAIN;
+		} else if (unlikely(timeout < 0)) {
+			spin_unlock(&info->lock);
+			ret = timeout;
+		} else {
+			msg_ptr = list_entry(msgs.next, struct msg_msg, m_list);
+			list_del(&msg_ptr->m_list);
+			wait.task = current;
+			wait.msg = (void *) msg_ptr;
+			wait.state = STATE_NONE;
+			ret = wq_sleep(info, SEND, timeout, &wait);
+			if (ret < 0)
+				free_msg(msg_ptr);
+		}
+		if (ret < 0)
+			goto out_free;
+		sent++;
+		spin_lock(&info->lock);
+	}
+
+	while (!list_empty(&msgs) &&
+	       info->attr.mq_curmsgs < info->attr.mq_maxmsg) {
+		msg_ptr = list_entry(msgs.next, struct msg_msg, m_list);
+		list_del(&msg_ptr->m_list);
+		receiver = wq_get_first_waiter(info, RECV);
+		if (receiver) {
+			pipelined_send(info, msg_ptr, receiver);
+		} else {
+			/* adds message to the queue */
+			msg_insert(msg_ptr, info);
+			if (notify)
+				__do_notify(info);
+			notify = 0;
+		}
+		sent++;
+	}
+	inode->i_atime = inode->i_mtime = inode->i_ctime = CURRENT_TIME;
+	spin_unlock(&info->lock);
+	ret = sent;
+out_free:
+	list_for_each_entry_safe(msg_ptr, tmp, &msgs, m_list)
+		free_msg(msg_ptr);
+out_fput:
+	fput(filp);
+out:
+	return ret;
+}
+
+asmlinkage long sys_mq_timedreceivev(mqd_t mqdes,
+	struct mq_mmsg __user *u_vec, unsigned int vlen,
+	const struct timespec __user *u_abs_timeout)
+{
+	LIST_HEAD(msgs);
+	struct mq_mmsg m;
+	struct file *filp;
+	struct inode *inode;
+	struct ext_wait_queue wait;
+	struct msg_msg *msg_ptr, *tmp;
+	struct mqueue_inode_info *info;
+	long timeout;
+	unsigned int i, received = 0;
+	int ret;
+
+	if (unlikely(vlen > UIO_MAXIOV))
+		return -EINVAL;
+
+	timeout = prepare_timeout(u_abs_timeout);
+
+	ret = -EBADF;
+	filp = fget(mqdes);
+	if (unlikely(!filp))
+		goto out;
+
+	inode = filp->f_dentry->d_inode;
+	if (unlikely(filp->f_op != &mqueue_file_operations))
+		goto out_fput;
+	info = MQUEUE_I(inode);
+
+	if (unlikely(!(filp->f_mode & FMODE_READ)))
+		goto out_fput;
+
+	if (vlen > info->attr.mq_maxmsg)
+		vlen = info->attr.mq_maxmsg;
+
+	/* checks if the buffers are big enough */
+	for (i = 0; i < vlen; i++) {
+		ret = -EFAULT;
+		if (copy_from_user(&m, &u_vec[i], sizeof(m)))
+			goto out_fput;
+		ret = -EMSGSIZE;
+		if (unlikely(m.msg_len < info->attr.mq_msgsize))
+			goto out_fput;
+	}
+	ret = 0;
+	if (!vlen)
+		goto out_fput;
+
+	spin_lock(&info->lock);
+	if (info->attr.mq_curmsgs == 0) {
+		if (filp->f_flags & O_NONBLOCK) {
+			spin_unlock(&info->lock);
+			ret = -EAGAIN;
+		} else if (unlikely(timeout < 0)) {
+			spin_unlock(&info->lock);
+			ret = timeout;
+		} else {
+			wait.task = current;
+			wait.state = STATE_NONE;
+			ret = wq_sleep(info, RECV, timeout, &wait);
+		}
+		if (ret < 0)
+			goto out_fput;
+		list_add_tail(&wait.msg->m_list, &msgs);
+		received++;
+		spin_lock(&info->lock);
+	}
+
+	while (received < vlen && info->attr.mq_curmsgs) {
+		msg_ptr = msg_get(info);
+		list_add_tail(&msg_ptr->m_list, &msgs);
+		received++;
+
+		/* There is now free space in queue. */
+		pipelined_receive(info);
+	}
+	inode->i_atime = inode->i_mtime = inode->i_ctime = CURRENT_TIME;
+	spin_unlock(&info->lock);
+
+	/* What is left after a fault is lost, as it is by mq_timedreceive() */
+	i = 0;
+	list_for_each_entry(msg_ptr, &msgs, m_list) {
+		if (copy_from_user(&m, &u_vec[i], sizeof(m)) ||
+		    store_msg(m.msg_ptr, msg_ptr, msg_ptr->m_ts) ||
+		    put_user(msg_ptr->m_ts, &u_vec[i].msg_len) ||
+		    put_user(msg_ptr->m_type, &u_vec[i].msg_prio))
+			break;
+		i++;
+	}
+	ret = i ? i : -EFAULT;
+	list_for_each_entry_safe(msg_ptr, tmp, &msgs, m_list)
+		free_msg(msg_ptr);
+out_fput:
+	fput(filp);
+out:
+	return ret;
+}
+
 /*
  * Notes: the case when user wants us to deregister (with NULL as pointer)
  * and he isn't currently owner of notification, will be silently discarded.
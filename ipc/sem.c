@@ -61,6 +61,7 @@
  * (c) 2001 Red Hat Inc <alan@redhat.com>
  * Lockless wakeup
  * (c) 2003 Manfred Spraul <manfred@colorfullife.com>
+ * Per-semaphore pending lists and locks
  */
 
 #include <linux/config.h>
@@ -77,7 +78,8 @@
 #include "util.h"
 
 
-#define sem_lock(id)	((struct sem_array*)ipc_lock(&sem_ids,id))
+#define sem_obtain_object(id)	\
+	((struct sem_array*)ipc_obtain_object(&sem_ids,id))
 #define sem_unlock(sma)	ipc_unlock(&(sma)->sem_perm)
 #define sem_rmid(id)	((struct sem_array*)ipc_rmid(&sem_ids,id))
 #define sem_checkid(sma, semid)	\
@@ -98,8 +100,9 @@ static int sysvipc_sem_read_proc(char *buffer, char **start, off_t offset, int l
 /*
  * linked list protection:
  *	sem_undo.id_next,
- *	sem_array.sem_pending{,last},
+ *	sem_array.sem_pending,
  *	sem_array.sem_undo: sem_lock() for read/write
+ *	sem.sem_pending: sem_lock() or sem.lock
  *	sem_undo.proc_next: only "current" is allowed to read/write that field.
  *	
  */
@@ -112,6 +115,77 @@ int sem_ctls[4] = {SEMMSL, SEMMNS, SEMOPM, SEMMNI};
 
 static int used_sems;
 
+/*
+ * Locking: a semop() with a single operation only takes the lock of its
+ * semaphore, as long as no operation on several semaphores is pending
+ * on the array (complex_count).  Everything else takes the array lock,
+ * sem_perm.lock, and then waits until no semaphore lock is held; a
+ * semaphore lock holder in turn backs off while the array lock is
+ * held.  Both sides take their own lock before they look at the other
+ * one, so at least one of them sees the other.
+ */
+static void sem_wait_array(struct sem_array *sma)
+{
+	int i;
+
+	smp_mb();
+	for (i = 0; i < sma->sem_nsems; i++)
+		spin_unlock_wait(&sma->sem_base[i].lock);
+	smp_rmb();
+}
+
+/* the whole array, like ipc_lock() */
+static inline struct sem_array *sem_lock(int id)
+{
+	struct sem_array *sma = (struct sem_array *)ipc_lock(&sem_ids, id);
+
+	if (sma)
+		sem_wait_array(sma);
+	return sma;
+}
+
+static inline void sem_lock_by_ptr(struct sem_array *sma)
+{
+	ipc_lock_by_ptr(&sma->sem_perm);
+	sem_wait_array(sma);
+}
+
+/*
+ * Lock for the operations sops: returns the semaphore whose lock was
+ * taken, or -1 for the array lock.  The caller is inside rcu_read_lock()
+ * and checks sem_perm.deleted afterwards.
+ */
+static int sem_lock_ops(struct sem_array *sma, struct sembuf *sops,
+			int nsops)
+{
+	if (nsops == 1) {
+		struct sem *sem = sma->sem_base + sops->sem_num;
+
+		while (!sma->complex_count) {
+			spin_lock(&sem->lock);
+			smp_mb();
+			if (likely(!spin_is_locked(&sma->sem_perm.lock) &&
+				   !sma->complex_count))
+				return sops->sem_num;
+			spin_unlock(&sem->lock);
+			spin_unlock_wait(&sma->sem_perm.lock);
+		}
+	}
+
+	spin_lock(&sma->sem_perm.lock);
+	sem_wait_array(sma);
+	return -1;
+}
+
+static inline void sem_unlock_ops(struct sem_array *sma, int locknum)
+{
+	if (locknum == -1)
+		spin_unlock(&sma->sem_perm.lock);
+	else
+		spin_unlock(&sma->sem_base[locknum].lock);
+	rcu_read_unlock();
+}
+
 void __init sem_init (void)
 {
 	used_sems = 0;
@@ -158,7 +232,7 @@ void __init sem_init (void)
 
 static int newary (key_t key, int nsems, int semflg)
 {
-	int id;
+	int id, i;
 	int retval;
 	struct sem_array *sma;
 	int size;
@@ -185,6 +259,17 @@ static int newary (key_t key, int nsems, int semflg)
 		return retval;
 	}
 
+	/* semop() looks at these without the array lock */
+	sma->sem_base = (struct sem *) &sma[1];
+	for (i = 0; i < nsems; i++) {
+		spin_lock_init(&sma->sem_base[i].lock);
+		INIT_LIST_HEAD(&sma->sem_base[i].sem_pending);
+	}
+	INIT_LIST_HEAD(&sma->sem_pending);
+	/* sma->complex_count = 0; */
+	/* sma->undo = NULL; */
+	sma->sem_nsems = nsems;
+
 	id = ipc_addid(&sem_ids, &sma->sem_perm, sc_semmni);
 	if(id == -1) {
 		security_sem_free(sma);
@@ -193,11 +278,6 @@ static int newary (key_t key, int nsems, int semflg)
 	}
 	used_sems += nsems;
 
-	sma->sem_base = (struct sem *) &sma[1];
-	/* sma->sem_pending = NULL; */
-	sma->sem_pending_last = &sma->sem_pending;
-	/* sma->undo = NULL; */
-	sma->sem_nsems = nsems;
 	sma->sem_ctime = get_seconds();
 	sem_unlock(sma);
 
@@ -243,36 +323,36 @@ asmlinkage long sys_semget (key_t key, int nsems, int semflg)
 	return err;
 }
 
-/* Manage the doubly linked list sma->sem_pending as a FIFO:
- * insert new queue elements at the tail sma->sem_pending_last.
+/*
+ * An operation on a single semaphore waits on the list of that
+ * semaphore, anything else on the list of the array.  Each list is a
+ * FIFO for operations which alter the array, those which wait for zero
+ * go in front.
  */
-static inline void append_to_queue (struct sem_array * sma,
-				    struct sem_queue * q)
+static inline void add_to_queue (struct sem_array * sma,
+				 struct sem_queue * q)
 {
-	*(q->prev = sma->sem_pending_last) = q;
-	*(sma->sem_pending_last = &q->next) = NULL;
-}
+	struct list_head *pending;
 
-static inline void prepend_to_queue (struct sem_array * sma,
-				     struct sem_queue * q)
-{
-	q->next = sma->sem_pending;
-	*(q->prev = &sma->sem_pending) = q;
-	if (q->next)
-		q->next->prev = &q->next;
-	else /* sma->sem_pending_last == &sma->sem_pending */
-		sma->sem_pending_last = &q->next;
+	if (q->nsops == 1)
+		pending = &sma->sem_base[q->sops->sem_num].sem_pending;
+	else {
+		pending = &sma->sem_pending;
+		sma->complex_count++;
+	}
+
+	if (q->alter)
+		list_add_tail(&q->list, pending);
+	else
+		list_add(&q->list, pending);
 }
 
 static inline void remove_from_queue (struct sem_array * sma,
 				      struct sem_queue * q)
 {
-	*(q->prev) = q->next;
-	if (q->next)
-		q->next->prev = q->prev;
-	else /* sma->sem_pending_last == &q->next */
-		sma->sem_pending_last = q->prev;
-	q->prev = NULL; /* mark as removed */
+	list_del_init(&q->list); /* empty: removed */
+	if (q->nsops > 1)
+		sma->complex_count--;
 }
 
 /*
@@ -342,49 +422,70 @@ undo:
 	return result;
 }
 
-/* Go through the pending queue for the indicated semaphore
- * looking for tasks that can be completed.
+/* Go through one pending queue looking for tasks that can be completed.
+ * Returns 1 if one of them modified the array.
  */
-static void update_queue (struct sem_array * sma)
+static int update_queue (struct sem_array * sma, struct list_head * pending)
 {
-	int error;
-	struct sem_queue * q;
+	int error, alter, altered = 0;
+	struct sem_queue * q, * n;
 
-	q = sma->sem_pending;
-	while(q) {
+again:
+	list_for_each_entry_safe(q, n, pending, list) {
 		error = try_atomic_semop(sma, q->sops, q->nsops,
 					 q->undo, q->pid);
 
 		/* Does q->sleeper still need to sleep? */
-		if (error <= 0) {
-			struct sem_queue *n;
-			remove_from_queue(sma,q);
-			q->status = IN_WAKEUP;
-			/*
-			 * Continue scanning. The next operation
-			 * that must be checked depends on the type of the
-			 * completed operation:
-			 * - if the operation modified the array, then
-			 *   restart from the head of the queue and
-			 *   check for threads that might be waiting
-			 *   for semaphore values to become 0.
-			 * - if the operation didn't modify the array,
-			 *   then just continue.
-			 */
-			if (q->alter)
-				n = sma->sem_pending;
-			else
-				n = q->next;
-			wake_up_process(q->sleeper);
-			/* hands-off: q will disappear immediately after
-			 * writing q->status.
-			 */
-			q->status = error;
-			q = n;
-		} else {
-			q = q->next;
+		if (error > 0)
+			continue;
+
+		remove_from_queue(sma,q);
+		alter = q->alter;
+		q->status = IN_WAKEUP;
+		wake_up_process(q->sleeper);
+		/* hands-off: q will disappear immediately after
+		 * writing q->status.
+		 */
+		q->status = error;
+
+		/*
+		 * If the operation modified the array, restart from the
+		 * head of the queue and check for threads that might be
+		 * waiting for semaphore values to become 0.
+		 */
+		if (alter && !error) {
+			altered = 1;
+			goto again;
 		}
 	}
+	return altered;
+}
+
+/*
+ * Wake up whatever can proceed now that semaphore semnum, or with -1
+ * any semaphore, has changed.  A single semaphore operation only
+ * changes its own semaphore, so only its list needs to be looked at,
+ * and the list of the array if there is anything on it.  A completed
+ * operation from there may have changed any semaphore.
+ */
+static void do_smart_update (struct sem_array * sma, int semnum)
+{
+	int i, altered;
+
+	do {
+		altered = 0;
+		if (sma->complex_count &&
+		    update_queue(sma, &sma->sem_pending))
+			semnum = -1;
+
+		if (semnum != -1)
+			altered = update_queue(sma,
+					&sma->sem_base[semnum].sem_pending);
+		else
+			for (i = 0; i < sma->sem_nsems; i++)
+				altered |= update_queue(sma,
+					&sma->sem_base[i].sem_pending);
+	} while (altered && sma->complex_count);
 }
 
 /* The following counts are associated to each semaphore:
@@ -396,52 +497,56 @@ static void update_queue (struct sem_array * sma)
  * The counts we return here are a rough approximation, but still
  * warrant that semncnt+semzcnt>0 if the task is on the pending queue.
  */
-static int count_semncnt (struct sem_array * sma, ushort semnum)
+static int count_pending (struct list_head * pending, ushort semnum,
+			  int zero)
 {
-	int semncnt;
+	int count = 0;
 	struct sem_queue * q;
 
-	semncnt = 0;
-	for (q = sma->sem_pending; q; q = q->next) {
+	list_for_each_entry(q, pending, list) {
 		struct sembuf * sops = q->sops;
 		int nsops = q->nsops;
 		int i;
 		for (i = 0; i < nsops; i++)
 			if (sops[i].sem_num == semnum
-			    && (sops[i].sem_op < 0)
+			    && (zero ? sops[i].sem_op == 0 : sops[i].sem_op < 0)
 			    && !(sops[i].sem_flg & IPC_NOWAIT))
-				semncnt++;
+				count++;
 	}
-	return semncnt;
+	return count;
+}
+
+static int count_semncnt (struct sem_array * sma, ushort semnum)
+{
+	return count_pending(&sma->sem_base[semnum].sem_pending, semnum, 0) +
+	       count_pending(&sma->sem_pending, semnum, 0);
 }
 static int count_semzcnt (struct sem_array * sma, ushort semnum)
 {
-	int semzcnt;
-	struct sem_queue * q;
-
-	semzcnt = 0;
-	for (q = sma->sem_pending; q; q = q->next) {
-		struct sembuf * sops = q->sops;
-		int nsops = q->nsops;
-		int i;
-		for (i = 0; i < nsops; i++)
-			if (sops[i].sem_num == semnum
-			    && (sops[i].sem_op == 0)
-			    && !(sops[i].sem_flg & IPC_NOWAIT))
-				semzcnt++;
-	}
-	return semzcnt;
+	return count_pending(&sma->sem_base[semnum].sem_pending, semnum, 1) +
+	       count_pending(&sma->sem_pending, semnum, 1);
 }
 
 /* Free a semaphore set. freeary() is called with sem_ids.sem down and
  * the spinlock for this semaphore set hold. sem_ids.sem remains locked
  * on exit.
  */
+static void wake_all (struct list_head *pending)
+{
+	struct sem_queue *q, *n;
+
+	list_for_each_entry_safe(q, n, pending, list) {
+		list_del_init(&q->list);
+		q->status = IN_WAKEUP;
+		wake_up_process(q->sleeper); /* doesn't sleep */
+		q->status = -EIDRM;	/* hands-off q */
+	}
+}
+
 static void freeary (struct sem_array *sma, int id)
 {
 	struct sem_undo *un;
-	struct sem_queue *q;
-	int size;
+	int i, size;
 
 	/* Invalidate the existing undo structures for this semaphore set.
 	 * (They will be freed without any further action in exit_sem()
@@ -451,17 +556,9 @@ static void freeary (struct sem_array *sma, int id)
 		un->semid = -1;
 
 	/* Wake up all pending processes and let them fail with EIDRM. */
-	q = sma->sem_pending;
-	while(q) {
-		struct sem_queue *n;
-		/* lazy remove_from_queue: we are killing the whole queue */
-		q->prev = NULL;
-		n = q->next;
-		q->status = IN_WAKEUP;
-		wake_up_process(q->sleeper); /* doesn't sleep */
-		q->status = -EIDRM;	/* hands-off q */
-		q = n;
-	}
+	wake_all(&sma->sem_pending);
+	for (i = 0; i < sma->sem_nsems; i++)
+		wake_all(&sma->sem_base[i].sem_pending);
 
 	/* Remove the semaphore set from the ID array*/
 	sma = sem_rmid(id);
@@ -616,13 +713,13 @@ static int semctl_main(int semid, int semnum, int cmd, int version, union semun
 
 			sem_io = ipc_alloc(sizeof(ushort)*nsems);
 			if(sem_io == NULL) {
-				ipc_lock_by_ptr(&sma->sem_perm);
+				sem_lock_by_ptr(sma);
 				ipc_rcu_putref(sma);
 				sem_unlock(sma);
 				return -ENOMEM;
 			}
 
-			ipc_lock_by_ptr(&sma->sem_perm);
+			sem_lock_by_ptr(sma);
 			ipc_rcu_putref(sma);
 			if (sma->sem_perm.deleted) {
 				sem_unlock(sma);
@@ -650,7 +747,7 @@ static int semctl_main(int semid, int semnum, int cmd, int version, union semun
 		if(nsems > SEMMSL_FAST) {
 			sem_io = ipc_alloc(sizeof(ushort)*nsems);
 			if(sem_io == NULL) {
-				ipc_lock_by_ptr(&sma->sem_perm);
+				sem_lock_by_ptr(sma);
 				ipc_rcu_putref(sma);
 				sem_unlock(sma);
 				return -ENOMEM;
@@ -658,7 +755,7 @@ static int semctl_main(int semid, int semnum, int cmd, int version, union semun
 		}
 
 		if (copy_from_user (sem_io, arg.array, nsems*sizeof(ushort))) {
-			ipc_lock_by_ptr(&sma->sem_perm);
+			sem_lock_by_ptr(sma);
 			ipc_rcu_putref(sma);
 			sem_unlock(sma);
 			err = -EFAULT;
@@ -667,14 +764,14 @@ static int semctl_main(int semid, int semnum, int cmd, int version, union semun
 
 		for (i = 0; i < nsems; i++) {
 			if (sem_io[i] > SEMVMX) {
-				ipc_lock_by_ptr(&sma->sem_perm);
+				sem_lock_by_ptr(sma);
 				ipc_rcu_putref(sma);
 				sem_unlock(sma);
 				err = -ERANGE;
 				goto out_free;
 			}
 		}
-		ipc_lock_by_ptr(&sma->sem_perm);
+		sem_lock_by_ptr(sma);
 		ipc_rcu_putref(sma);
 		if (sma->sem_perm.deleted) {
 			sem_unlock(sma);
@@ -689,7 +786,7 @@ static int semctl_main(int semid, int semnum, int cmd, int version, union semun
 				un->semadj[i] = 0;
 		sma->sem_ctime = get_seconds();
 		/* maybe some queued-up processes were waiting for this */
-		update_queue(sma);
+		do_smart_update(sma, -1);
 		err = 0;
 		goto out_unlock;
 	}
@@ -741,7 +838,7 @@ static int semctl_main(int semid, int semnum, int cmd, int version, union semun
 		curr->sempid = current->tgid;
 		sma->sem_ctime = get_seconds();
 		/* maybe some queued-up processes were waiting for this */
-		update_queue(sma);
+		do_smart_update(sma, semnum);
 		err = 0;
 		goto out_unlock;
 	}
@@ -1007,7 +1104,7 @@ static struct sem_undo *find_undo(int semid)
 
 	new = (struct sem_undo *) kmalloc(sizeof(struct sem_undo) + sizeof(short)*nsems, GFP_KERNEL);
 	if (!new) {
-		ipc_lock_by_ptr(&sma->sem_perm);
+		sem_lock_by_ptr(sma);
 		ipc_rcu_putref(sma);
 		sem_unlock(sma);
 		return ERR_PTR(-ENOMEM);
@@ -1021,12 +1118,12 @@ static struct sem_undo *find_undo(int semid)
 	if (un) {
 		unlock_semundo();
 		kfree(new);
-		ipc_lock_by_ptr(&sma->sem_perm);
+		sem_lock_by_ptr(sma);
 		ipc_rcu_putref(sma);
 		sem_unlock(sma);
 		goto out;
 	}
-	ipc_lock_by_ptr(&sma->sem_perm);
+	sem_lock_by_ptr(sma);
 	ipc_rcu_putref(sma);
 	if (sma->sem_perm.deleted) {
 		sem_unlock(sma);
@@ -1054,7 +1151,7 @@ asmlinkage long sys_semtimedop(int semid, struct sembuf __user *tsops,
 	struct sembuf fast_sops[SEMOPM_FAST];
 	struct sembuf* sops = fast_sops, *sop;
 	struct sem_undo *un;
-	int undos = 0, decrease = 0, alter = 0, max;
+	int undos = 0, decrease = 0, alter = 0, max, locknum;
 	struct sem_queue queue;
 	unsigned long jiffies_left = 0;
 
@@ -1107,12 +1204,22 @@ retry_undos:
 	} else
 		un = NULL;
 
-	sma = sem_lock(semid);
+	rcu_read_lock();
+	sma = sem_obtain_object(semid);
 	error=-EINVAL;
-	if(sma==NULL)
+	if(sma==NULL) {
+		rcu_read_unlock();
 		goto out_free;
+	}
+	error = -EFBIG;
+	if (max >= sma->sem_nsems) {
+		rcu_read_unlock();
+		goto out_free;
+	}
+
+	locknum = sem_lock_ops(sma, sops, nsops);
 	error = -EIDRM;
-	if (sem_checkid(sma,semid))
+	if (sma->sem_perm.deleted || sem_checkid(sma,semid))
 		goto out_unlock_free;
 	/*
 	 * semid identifies are not unique - find_undo may have
@@ -1120,12 +1227,9 @@ retry_undos:
 	 * and now a new array with received the same id. Check and retry.
 	 */
 	if (un && un->semid == -1) {
-		sem_unlock(sma);
+		sem_unlock_ops(sma, locknum);
 		goto retry_undos;
 	}
-	error = -EFBIG;
-	if (max >= sma->sem_nsems)
-		goto out_unlock_free;
 
 	error = -EACCES;
 	if (ipcperms(&sma->sem_perm, alter ? S_IWUGO : S_IRUGO))
@@ -1138,7 +1242,7 @@ retry_undos:
 	error = try_atomic_semop (sma, sops, nsops, un, current->tgid);
 	if (error <= 0) {
 		if (alter && error == 0)
-			update_queue (sma);
+			do_smart_update(sma, nsops == 1 ? sops->sem_num : -1);
 		goto out_unlock_free;
 	}
 
@@ -1153,15 +1257,12 @@ retry_undos:
 	queue.pid = current->tgid;
 	queue.id = semid;
 	queue.alter = alter;
-	if (alter)
-		append_to_queue(sma ,&queue);
-	else
-		prepend_to_queue(sma ,&queue);
+	add_to_queue(sma, &queue);
 
 	queue.status = -EINTR;
 	queue.sleeper = current;
 	current->state = TASK_INTERRUPTIBLE;
-	sem_unlock(sma);
+	sem_unlock_ops(sma, locknum);
 
 	if (timeout)
 		jiffies_left = schedule_timeout(jiffies_left);
@@ -1180,10 +1281,10 @@ retry_undos:
 		goto out_free;
 	}
 
+	/* whichever lock protected the queue, the array lock does too */
 	sma = sem_lock(semid);
 	if(sma==NULL) {
-		if(queue.prev != NULL)
-			BUG();
+		BUG_ON(!list_empty(&queue.list));
 		error = -EIDRM;
 		goto out_free;
 	}
@@ -1192,20 +1293,19 @@ retry_undos:
 	 * If queue.status != -EINTR we are woken up by another process
 	 */
 	error = queue.status;
-	if (error != -EINTR) {
-		goto out_unlock_free;
+	if (error == -EINTR) {
+		/*
+		 * If an interrupt occurred we have to clean up the queue
+		 */
+		if (timeout && jiffies_left == 0)
+			error = -EAGAIN;
+		remove_from_queue(sma,&queue);
 	}
-
-	/*
-	 * If an interrupt occurred we have to clean up the queue
-	 */
-	if (timeout && jiffies_left == 0)
-		error = -EAGAIN;
-	remove_from_queue(sma,&queue);
-	goto out_unlock_free;
+	sem_unlock(sma);
+	goto out_free;
 
 out_unlock_free:
-	sem_unlock(sma);
+	sem_unlock_ops(sma, locknum);
 out_free:
 	if(sops != fast_sops)
 		kfree(sops);
@@ -1327,7 +1427,7 @@ found:
 		}
 		sma->sem_otime = get_seconds();
 		/* maybe some queued-up processes were waiting for this */
-		update_queue(sma);
+		do_smart_update(sma, -1);
 next_entry:
 		sem_unlock(sma);
 	}
@@ -501,19 +501,28 @@ struct kern_ipc_perm* ipc_get(struct ipc_ids* ids, int id)
 	return out;
 }
 
-struct kern_ipc_perm* ipc_lock(struct ipc_ids* ids, int id)
+/*
+ * Look up an ipc object without locking it.  The caller must be in an
+ * rcu read side section, which keeps the object around, and has to
+ * check ->deleted once it has whatever lock it needs.
+ */
+struct kern_ipc_perm* ipc_obtain_object(struct ipc_ids* ids, int id)
 {
-	struct kern_ipc_perm* out;
 	int lid = id % SEQ_MULTIPLIER;
 	struct ipc_id_ary* entries;
 
-	rcu_read_lock();
 	entries = rcu_dereference(ids->entries);
-	if(lid >= entries->size) {
-		rcu_read_unlock();
+	if(lid >= entries->size)
 		return NULL;
-	}
-	out = entries->p[lid];
+	return entries->p[lid];
+}
+
+struct kern_ipc_perm* ipc_lock(struct ipc_ids* ids, int id)
+{
+	struct kern_ipc_perm* out;
+
+	rcu_read_lock();
+	out = ipc_obtain_object(ids, id);
 	if(out == NULL) {
 		rcu_read_unlock();
 		return NULL;
@@ -150,6 +150,12 @@ static LIST_HEAD(audit_tsklist);
 static LIST_HEAD(audit_entlist);
 static LIST_HEAD(audit_extlist);
 
+/* The syscalls named in the mask of any rule on the entry or exit list.
+ * Only those need their audit context filled in and filtered; others
+ * go through audit_syscall_entry and _exit with just a test of their
+ * bit.  Updated with the lists, under audit_netlink_sem. */
+static u32 audit_syscall_mask[AUDIT_BITMASK_SIZE];
+
 struct audit_entry {
 	struct list_head  list;
 	struct rcu_head   rcu;
@@ -225,6 +231,32 @@ static inline int audit_del_rule(struct audit_rule *rule,
 	return -EFAULT;		/* No matching rule */
 }
 
+/* Recompute audit_syscall_mask after a change to the rule lists. */
+static void audit_update_syscall_mask(void)
+{
+	u32 mask[AUDIT_BITMASK_SIZE];
+	struct audit_entry *e;
+	int i;
+
+	memset(mask, 0, sizeof(mask));
+	list_for_each_entry(e, &audit_entlist, list)
+		for (i = 0; i < AUDIT_BITMASK_SIZE; i++)
+			mask[i] |= e->rule.mask[i];
+	list_for_each_entry(e, &audit_extlist, list)
+		for (i = 0; i < AUDIT_BITMASK_SIZE; i++)
+			mask[i] |= e->rule.mask[i];
+	for (i = 0; i < AUDIT_BITMASK_SIZE; i++)
+		audit_syscall_mask[i] = mask[i];
+}
+
+/* Whether a rule on the entry or exit list may match syscall @major */
+static inline int audit_syscall_filtered(int major)
+{
+	if (unlikely((unsigned int)major >= AUDIT_BITMASK_SIZE * 32))
+		return 1;
+	return audit_syscall_mask[AUDIT_WORD(major)] & AUDIT_BIT(major);
+}
+
 #ifdef CONFIG_NET
 /* Copy rule from user-space to kernel-space.  Called during
  * AUDIT_ADD. */
@@ -285,6 +317,7 @@ int audit_receive_filter(int type, int pid, int uid, int seq, void *data)
 			err = audit_add_rule(entry, &audit_entlist);
 		if (!err && (flags & AUDIT_AT_EXIT))
 			err = audit_add_rule(entry, &audit_extlist);
+		audit_update_syscall_mask();
 		break;
 	case AUDIT_DEL:
 		flags =((struct audit_rule *)data)->flags;
@@ -294,6 +327,7 @@ int audit_receive_filter(int type, int pid, int uid, int seq, void *data)
 			err = audit_del_rule(data, &audit_entlist);
 		if (!err && (flags & AUDIT_AT_EXIT))
 			err = audit_del_rule(data, &audit_extlist);
+		audit_update_syscall_mask();
 		break;
 	default:
 		return -EINVAL;
@@ -416,7 +450,9 @@ static int audit_filter_rules(struct task_struct *tsk,
 
 /* At process creation time, we can determine if system-call auditing is
  * completely disabled for this task.  Since we only have the task
- * structure at this point, we can only check uid and gid.
+ * structure at this point, we can only check uid and gid.  Unless a rule
+ * asks for more, the context is only filled in for the syscalls that the
+ * entry and exit rules name.
  */
 static enum audit_state audit_filter_task(struct task_struct *tsk)
 {
@@ -431,7 +467,7 @@ static enum audit_state audit_filter_task(struct task_struct *tsk)
 		}
 	}
 	rcu_read_unlock();
-	return AUDIT_BUILD_CONTEXT;
+	return AUDIT_SETUP_CONTEXT;
 }
 
 /* At syscall entry and exit time, this filter is called if the
@@ -798,13 +834,16 @@ void audit_syscall_entry(struct task_struct *tsk, int major,
 	if (!audit_enabled)
 		return;
 
+	state = context->state;
+	if (likely(state == AUDIT_SETUP_CONTEXT && !audit_syscall_filtered(major)))
+		return;
+
 	context->major      = major;
 	context->argv[0]    = a1;
 	context->argv[1]    = a2;
 	context->argv[2]    = a3;
 	context->argv[3]    = a4;
 
-	state = context->state;
 	if (state == AUDIT_SETUP_CONTEXT || state == AUDIT_BUILD_CONTEXT)
 		state = audit_filter_syscall(tsk, context, &audit_entlist);
 	if (likely(state == AUDIT_DISABLED))
@@ -823,7 +862,11 @@ void audit_syscall_entry(struct task_struct *tsk, int major,
  * free the names stored from getname(). */
 void audit_syscall_exit(struct task_struct *tsk, int return_code)
 {
-	struct audit_context *context;
+	struct audit_context *context = tsk->audit_context;
+
+	/* Nothing was filled in at entry, so there is nothing to tear down */
+	if (likely(!context || (!context->in_syscall && !context->previous)))
+		return;
 
 	get_task_struct(tsk);
 	task_lock(tsk);
@@ -955,7 +998,7 @@ void audit_inode(const char *name, const struct inode *inode)
 void audit_get_stamp(struct audit_context *ctx,
 		     struct timespec *t, int *serial)
 {
-	if (ctx) {
+	if (ctx && ctx->in_syscall) {
 		t->tv_sec  = ctx->ctime.tv_sec;
 		t->tv_nsec = ctx->ctime.tv_nsec;
 		*serial    = ctx->serial;
@@ -977,7 +1020,7 @@ int audit_set_loginuid(struct audit_context *ctx, uid_t loginuid)
 		if (ab) {
 			audit_log_format(ab, "login pid=%d uid=%u "
 				"old loginuid=%u new loginuid=%u",
-				ctx->pid, ctx->uid, ctx->loginuid, loginuid);
+				current->pid, current->uid, ctx->loginuid, loginuid);
 			audit_set_type(ab, AUDIT_LOGIN);
 			audit_log_end(ab);
 		}
@@ -996,7 +1039,8 @@ int audit_ipc_perms(unsigned long qbytes, uid_t uid, gid_t gid, mode_t mode)
 	struct audit_aux_data_ipcctl *ax;
 	struct audit_context *context = current->audit_context;
 
-	if (likely(!context))
+	/* Only syscalls with a context filled in get their aux data logged */
+	if (likely(!context || !context->in_syscall))
 		return 0;
 
 	ax = kmalloc(sizeof(*ax), GFP_KERNEL);
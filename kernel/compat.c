@@ -250,12 +250,12 @@ asmlinkage long compat_sys_futex(u32 __user *uaddr, int op, int val,
 	unsigned long timeout = MAX_SCHEDULE_TIMEOUT;
 	int val2 = 0;
 
-	if ((op == FUTEX_WAIT) && utime) {
+	if (((op & FUTEX_CMD_MASK) == FUTEX_WAIT) && utime) {
 		if (get_compat_timespec(&t, utime))
 			return -EFAULT;
 		timeout = timespec_to_jiffies(&t) + 1;
 	}
-	if (op >= FUTEX_REQUEUE)
+	if ((op & FUTEX_CMD_MASK) >= FUTEX_REQUEUE)
 		val2 = (int) (unsigned long) utime;
 
 	return do_futex((unsigned long)uaddr, op, val, timeout,
@@ -556,6 +556,43 @@ long compat_sys_timer_gettime(timer_t timer_id,
 	return err;
 } 
 
+long compat_sys_timerfd_settime(int ufd, int flags,
+				struct compat_itimerspec __user *utmr,
+				struct compat_itimerspec __user *otmr)
+{
+	long err;
+	mm_segment_t oldfs;
+	struct itimerspec newts, oldts;
+
+	if (get_compat_itimerspec(&newts, utmr))
+		return -EFAULT;
+	oldfs = get_fs();
+	set_fs(KERNEL_DS);
+	err = sys_timerfd_settime(ufd, flags,
+				  (struct itimerspec __user *) &newts,
+				  (struct itimerspec __user *) &oldts);
+	set_fs(oldfs);
+	if (!err && otmr && put_compat_itimerspec(otmr, &oldts))
+		return -EFAULT;
+	return err;
+}
+
+long compat_sys_timerfd_gettime(int ufd,
+				struct compat_itimerspec __user *otmr)
+{
+	long err;
+	mm_segment_t oldfs;
+	struct itimerspec ts;
+
+	oldfs = get_fs();
+	set_fs(KERNEL_DS);
+	err = sys_timerfd_gettime(ufd, (struct itimerspec __user *) &ts);
+	set_fs(oldfs);
+	if (!err && put_compat_itimerspec(otmr, &ts))
+		return -EFAULT;
+	return err;
+}
+
 long compat_sys_clock_settime(clockid_t which_clock,
 		struct compat_timespec __user *tp)
 {
@@ -820,6 +857,28 @@ compat_sys_rt_sigtimedwait (compat_sigset_t __user *uthese,
 
 }
 
+asmlinkage long compat_sys_signalfd(int ufd,
+				    compat_sigset_t __user *sigmask,
+				    compat_size_t sigsetsize)
+{
+	compat_sigset_t ss32;
+	sigset_t ss;
+	mm_segment_t oldfs;
+	long err;
+
+	if (sigsetsize != sizeof(compat_sigset_t))
+		return -EINVAL;
+	if (copy_from_user(&ss32, sigmask, sizeof(ss32)))
+		return -EFAULT;
+	sigset_from_compat(&ss, &ss32);
+
+	oldfs = get_fs();
+	set_fs(KERNEL_DS);
+	err = sys_signalfd(ufd, (sigset_t __user *) &ss, sizeof(ss));
+	set_fs(oldfs);
+	return err;
+}
+
 #ifdef __ARCH_WANT_COMPAT_SYS_TIME
 
 /* compat_time_t is a 32 bit "long" and needs to get converted. */
@@ -197,6 +197,9 @@ static inline int dup_mmap(struct mm_struct * mm, struct mm_struct * oldmm)
 	mm->map_count = 0;
 	set_mm_counter(mm, rss, 0);
 	set_mm_counter(mm, anon_rss, 0);
+#ifdef CONFIG_NUMA
+	memset(mm->_node_anon_rss, 0, sizeof(mm->_node_anon_rss));
+#endif
 	cpus_clear(mm->cpu_vm_mask);
 	mm->mm_rb = RB_ROOT;
 	rb_link = &mm->mm_rb.rb_node;
@@ -321,7 +324,15 @@ static struct mm_struct * mm_init(struct mm_struct * mm)
 	rwlock_init(&mm->ioctx_list_lock);
 	mm->ioctx_list = NULL;
 	mm->default_kioctx = (struct kioctx)INIT_KIOCTX(mm->default_kioctx, *mm);
+	spin_lock_init(&mm->dio_lock);
+	INIT_LIST_HEAD(&mm->dio_regions);
+	mm->dio_pinned = 0;
 	mm->free_area_cache = TASK_UNMAPPED_BASE;
+	mm->token_priority = 0;
+	mm->last_interval = 0;
+	mm->swap_token_faults = 0;
+	mm->swap_token_grabs = 0;
+	mm->swap_token_held = 0;
 
 	if (likely(!mm_alloc_pgd(mm))) {
 		mm->def_flags = 0;
@@ -366,6 +377,7 @@ void mmput(struct mm_struct *mm)
 {
 	if (atomic_dec_and_test(&mm->mm_users)) {
 		exit_aio(mm);
+		exit_dio_regions(mm);
 		exit_mmap(mm);
 		if (!list_empty(&mm->mmlist)) {
 			spin_lock(&mmlist_lock);
@@ -732,6 +744,7 @@ static inline int copy_sighand(unsigned long clone_flags, struct task_struct * t
 	if (!sig)
 		return -ENOMEM;
 	spin_lock_init(&sig->siglock);
+	INIT_LIST_HEAD(&sig->signalfd_list);
 	atomic_set(&sig->count, 1);
 	memcpy(sig->action, current->sighand->action, sizeof(sig->action));
 	return 0;
@@ -769,10 +782,10 @@ static inline int copy_signal(unsigned long clone_flags, struct task_struct * ts
 	init_sigpending(&sig->shared_pending);
 	INIT_LIST_HEAD(&sig->posix_timers);
 
-	sig->it_real_value = sig->it_real_incr = 0;
+	hrtimer_init(&sig->real_timer, CLOCK_MONOTONIC, HRTIMER_REL);
+	sig->it_real_incr = 0;
 	sig->real_timer.function = it_real_fn;
-	sig->real_timer.data = (unsigned long) tsk;
-	init_timer(&sig->real_timer);
+	sig->real_timer.data = tsk;
 
 	sig->it_virt_expires = cputime_zero;
 	sig->it_virt_incr = cputime_zero;
@@ -938,6 +951,11 @@ static task_t *copy_process(unsigned long clone_flags,
 	do_posix_clock_monotonic_gettime(&p->start_time);
 	p->security = NULL;
 	p->io_context = NULL;
+	p->perfctr = NULL;
+	p->wq_worker = NULL;
+#ifdef CONFIG_PREEMPT_RCU
+	p->rcu_read_lock_nesting = 0;
+#endif
 	p->io_wait = NULL;
 	p->audit_context = NULL;
 #ifdef CONFIG_NUMA
@@ -1018,11 +1036,11 @@ static task_t *copy_process(unsigned long clone_flags,
 	 * The task hasn't been attached yet, so cpus_allowed mask cannot
 	 * have changed. The cpus_allowed mask of the parent may have
 	 * changed after it was copied first time, and it may then move to
-	 * another CPU - so we re-copy it here and set the child's CPU to
-	 * the parent's CPU. This avoids alot of nasty races.
+	 * another CPU - so we re-copy it here and pick the child's CPU
+	 * only now, with interrupts off. This avoids alot of nasty races.
 	 */
 	p->cpus_allowed = current->cpus_allowed;
-	set_task_cpu(p, smp_processor_id());
+	set_task_cpu(p, sched_balance_fork(p));
 
 	/*
 	 * Check for pending SIGKILL! The new thread should not be allowed
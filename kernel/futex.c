@@ -39,8 +39,16 @@
 #include <linux/mount.h>
 #include <linux/pagemap.h>
 #include <linux/syscalls.h>
+#include <linux/bootmem.h>
+#include <linux/cache.h>
 
+/*
+ * The hash table is sized at boot: FUTEX_HASH_PER_CPU buckets for each
+ * possible CPU, capped by available memory, but never fewer than
+ * 1 << FUTEX_HASHBITS.
+ */
 #define FUTEX_HASHBITS (CONFIG_BASE_SMALL ? 4 : 8)
+#define FUTEX_HASH_PER_CPU (CONFIG_BASE_SMALL ? 16 : 256)
 
 /*
  * Futexes are matched on equal values of this key.
@@ -94,13 +102,16 @@ struct futex_q {
 
 /*
  * Split the global futex_lock into every hash list lock.
+ * Each bucket gets its own cacheline so that CPUs hammering on
+ * neighbouring buckets do not bounce each other's lock.
  */
 struct futex_hash_bucket {
        spinlock_t              lock;
        struct list_head       chain;
-};
+} ____cacheline_aligned_in_smp;
 
-static struct futex_hash_bucket futex_queues[1<<FUTEX_HASHBITS];
+static struct futex_hash_bucket *futex_queues;
+static unsigned int futex_hash_mask;
 
 /* Futex-fs vfsmount entry: */
 static struct vfsmount *futex_mnt;
@@ -113,7 +124,7 @@ static struct futex_hash_bucket *hash_futex(union futex_key *key)
 	u32 hash = jhash2((u32*)&key->both.word,
 			  (sizeof(key->both.word)+sizeof(key->both.ptr))/4,
 			  key->both.offset);
-	return &futex_queues[hash & ((1 << FUTEX_HASHBITS)-1)];
+	return &futex_queues[hash & futex_hash_mask];
 }
 
 /*
@@ -126,6 +137,22 @@ static inline int match_futex(union futex_key *key1, union futex_key *key2)
 		&& key1->both.offset == key2->both.offset);
 }
 
+/*
+ * mmap_sem is only needed to look up the vma of a shared futex.
+ * Process-private futexes (FUTEX_PRIVATE_FLAG) never take it.
+ */
+static inline void futex_lock_mm(int fshared)
+{
+	if (fshared)
+		down_read(&current->mm->mmap_sem);
+}
+
+static inline void futex_unlock_mm(int fshared)
+{
+	if (fshared)
+		up_read(&current->mm->mmap_sem);
+}
+
 /*
  * Get parameters which are the keys for a futex.
  *
@@ -133,12 +160,19 @@ static inline int match_futex(union futex_key *key1, union futex_key *key2)
  * offset_within_page).  For private mappings, it's (uaddr, current->mm).
  * We can usually work out the index without swapping in the page.
  *
+ * If the caller said the futex is private (fshared == 0), the key is
+ * (uaddr, current->mm) without looking at the vma at all.  This is the
+ * same key a private mapping yields in the shared case, so both kinds
+ * of callers still meet on the same futex_q.
+ *
  * Returns: 0, or negative error code.
  * The key words are stored in *key on success.
  *
- * Should be called with &current->mm->mmap_sem but NOT any spinlocks.
+ * Should be called with &current->mm->mmap_sem (if fshared) but NOT
+ * any spinlocks.
  */
-static int get_futex_key(unsigned long uaddr, union futex_key *key)
+static int get_futex_key(unsigned long uaddr, int fshared,
+			 union futex_key *key)
 {
 	struct mm_struct *mm = current->mm;
 	struct vm_area_struct *vma;
@@ -153,6 +187,16 @@ static int get_futex_key(unsigned long uaddr, union futex_key *key)
 		return -EINVAL;
 	uaddr -= key->both.offset;
 
+	if (!fshared) {
+		if (unlikely(!access_ok(VERIFY_WRITE, (void __user *)
+					(uaddr + key->both.offset),
+					sizeof(u32))))
+			return -EFAULT;
+		key->private.mm = mm;
+		key->private.uaddr = uaddr;
+		return 0;
+	}
+
 	/*
 	 * The futex is hashed differently depending on whether
 	 * it's in a shared or private mapping.  So check vma first.
@@ -293,7 +337,7 @@ static void wake_futex(struct futex_q *q)
  * Wake up all waiters hashed on the physical page that is mapped
  * to this virtual address:
  */
-static int futex_wake(unsigned long uaddr, int nr_wake)
+static int futex_wake(unsigned long uaddr, int fshared, int nr_wake)
 {
 	union futex_key key;
 	struct futex_hash_bucket *bh;
@@ -301,9 +345,9 @@ static int futex_wake(unsigned long uaddr, int nr_wake)
 	struct futex_q *this, *next;
 	int ret;
 
-	down_read(&current->mm->mmap_sem);
+	futex_lock_mm(fshared);
 
-	ret = get_futex_key(uaddr, &key);
+	ret = get_futex_key(uaddr, fshared, &key);
 	if (unlikely(ret != 0))
 		goto out;
 
@@ -321,7 +365,7 @@ static int futex_wake(unsigned long uaddr, int nr_wake)
 
 	spin_unlock(&bh->lock);
 out:
-	up_read(&current->mm->mmap_sem);
+	futex_unlock_mm(fshared);
 	return ret;
 }
 
@@ -330,7 +374,7 @@ out:
  * physical page.
  */
 static int futex_requeue(unsigned long uaddr1, unsigned long uaddr2,
-			 int nr_wake, int nr_requeue, int *valp)
+			 int fshared, int nr_wake, int nr_requeue, int *valp)
 {
 	union futex_key key1, key2;
 	struct futex_hash_bucket *bh1, *bh2;
@@ -339,12 +383,12 @@ static int futex_requeue(unsigned long uaddr1, unsigned long uaddr2,
 	int ret, drop_count = 0;
 
  retry:
-	down_read(&current->mm->mmap_sem);
+	futex_lock_mm(fshared);
 
-	ret = get_futex_key(uaddr1, &key1);
+	ret = get_futex_key(uaddr1, fshared, &key1);
 	if (unlikely(ret != 0))
 		goto out;
-	ret = get_futex_key(uaddr2, &key2);
+	ret = get_futex_key(uaddr2, fshared, &key2);
 	if (unlikely(ret != 0))
 		goto out;
 
@@ -370,7 +414,7 @@ static int futex_requeue(unsigned long uaddr1, unsigned long uaddr2,
 			/* If we would have faulted, release mmap_sem, fault
 			 * it in and start all over again.
 			 */
-			up_read(&current->mm->mmap_sem);
+			futex_unlock_mm(fshared);
 
 			ret = get_user(curval, (int __user *)uaddr1);
 
@@ -416,7 +460,7 @@ out_unlock:
 		drop_key_refs(&key1);
 
 out:
-	up_read(&current->mm->mmap_sem);
+	futex_unlock_mm(fshared);
 	return ret;
 }
 
@@ -503,7 +547,8 @@ static int unqueue_me(struct futex_q *q)
 	return ret;
 }
 
-static int futex_wait(unsigned long uaddr, int val, unsigned long time)
+static int futex_wait(unsigned long uaddr, int fshared, int val,
+		      unsigned long time)
 {
 	DECLARE_WAITQUEUE(wait, current);
 	int ret, curval;
@@ -511,9 +556,9 @@ static int futex_wait(unsigned long uaddr, int val, unsigned long time)
 	struct futex_hash_bucket *bh;
 
  retry:
-	down_read(&current->mm->mmap_sem);
+	futex_lock_mm(fshared);
 
-	ret = get_futex_key(uaddr, &q.key);
+	ret = get_futex_key(uaddr, fshared, &q.key);
 	if (unlikely(ret != 0))
 		goto out_release_sem;
 
@@ -536,8 +581,9 @@ static int futex_wait(unsigned long uaddr, int val, unsigned long time)
 	 * a wakeup when *uaddr != val on entry to the syscall.  This is
 	 * rare, but normal.
 	 *
-	 * We hold the mmap semaphore, so the mapping cannot have changed
-	 * since we looked it up in get_futex_key.
+	 * For a shared futex we hold the mmap semaphore, so the mapping
+	 * cannot have changed since we looked it up in get_futex_key.
+	 * A private key does not depend on the mapping at all.
 	 */
 
 	ret = get_futex_value_locked(&curval, (int __user *)uaddr);
@@ -548,7 +594,7 @@ static int futex_wait(unsigned long uaddr, int val, unsigned long time)
 		/* If we would have faulted, release mmap_sem, fault it in and
 		 * start all over again.
 		 */
-		up_read(&current->mm->mmap_sem);
+		futex_unlock_mm(fshared);
 
 		ret = get_user(curval, (int __user *)uaddr);
 
@@ -569,7 +615,7 @@ static int futex_wait(unsigned long uaddr, int val, unsigned long time)
 	 * Now the futex is queued and we have checked the data, we
 	 * don't want to hold mmap_sem while we sleep.
 	 */	
-	up_read(&current->mm->mmap_sem);
+	futex_unlock_mm(fshared);
 
 	/*
 	 * There might have been scheduling since the queue_me(), as we
@@ -606,7 +652,7 @@ static int futex_wait(unsigned long uaddr, int val, unsigned long time)
 	return -EINTR;
 
  out_release_sem:
-	up_read(&current->mm->mmap_sem);
+	futex_unlock_mm(fshared);
 	return ret;
 }
 
@@ -692,7 +738,7 @@ static int futex_fd(unsigned long uaddr, int signal)
 	}
 
 	down_read(&current->mm->mmap_sem);
-	err = get_futex_key(uaddr, &q->key);
+	err = get_futex_key(uaddr, 1, &q->key);
 
 	if (unlikely(err != 0)) {
 		up_read(&current->mm->mmap_sem);
@@ -720,24 +766,31 @@ out:
 long do_futex(unsigned long uaddr, int op, int val, unsigned long timeout,
 		unsigned long uaddr2, int val2, int val3)
 {
+	int cmd = op & FUTEX_CMD_MASK;
+	int fshared = !(op & FUTEX_PRIVATE_FLAG);
 	int ret;
 
-	switch (op) {
+	switch (cmd) {
 	case FUTEX_WAIT:
-		ret = futex_wait(uaddr, val, timeout);
+		ret = futex_wait(uaddr, fshared, val, timeout);
 		break;
 	case FUTEX_WAKE:
-		ret = futex_wake(uaddr, val);
+		ret = futex_wake(uaddr, fshared, val);
 		break;
 	case FUTEX_FD:
+		/* A futex fd can outlive the process: never private. */
+		if (!fshared) {
+			ret = -EINVAL;
+			break;
+		}
 		/* non-zero val means F_SETOWN(getpid()) & F_SETSIG(val) */
 		ret = futex_fd(uaddr, val);
 		break;
 	case FUTEX_REQUEUE:
-		ret = futex_requeue(uaddr, uaddr2, val, val2, NULL);
+		ret = futex_requeue(uaddr, uaddr2, fshared, val, val2, NULL);
 		break;
 	case FUTEX_CMP_REQUEUE:
-		ret = futex_requeue(uaddr, uaddr2, val, val2, &val3);
+		ret = futex_requeue(uaddr, uaddr2, fshared, val, val2, &val3);
 		break;
 	default:
 		ret = -ENOSYS;
@@ -753,8 +806,9 @@ asmlinkage long sys_futex(u32 __user *uaddr, int op, int val,
 	struct timespec t;
 	unsigned long timeout = MAX_SCHEDULE_TIMEOUT;
 	int val2 = 0;
+	int cmd = op & FUTEX_CMD_MASK;
 
-	if ((op == FUTEX_WAIT) && utime) {
+	if ((cmd == FUTEX_WAIT) && utime) {
 		if (copy_from_user(&t, utime, sizeof(t)) != 0)
 			return -EFAULT;
 		timeout = timespec_to_jiffies(&t) + 1;
@@ -762,7 +816,7 @@ asmlinkage long sys_futex(u32 __user *uaddr, int op, int val,
 	/*
 	 * requeue parameter in 'utime' if op == FUTEX_REQUEUE.
 	 */
-	if (op >= FUTEX_REQUEUE)
+	if (cmd >= FUTEX_REQUEUE)
 		val2 = (int) (unsigned long) utime;
 
 	return do_futex((unsigned long)uaddr, op, val, timeout,
@@ -784,12 +838,26 @@ static struct file_system_type futex_fs_type = {
 
 static int __init init(void)
 {
+	unsigned long entries;
 	unsigned int i;
 
 	register_filesystem(&futex_fs_type);
 	futex_mnt = kern_mount(&futex_fs_type);
 
-	for (i = 0; i < ARRAY_SIZE(futex_queues); i++) {
+	entries = FUTEX_HASH_PER_CPU * num_possible_cpus();
+	if (entries < (1 << FUTEX_HASHBITS))
+		entries = 1 << FUTEX_HASHBITS;
+
+	futex_queues = alloc_large_system_hash("Futex",
+					sizeof(struct futex_hash_bucket),
+					entries,
+					0,
+					0,
+					NULL,
+					&futex_hash_mask,
+					0);
+
+	for (i = 0; i <= futex_hash_mask; i++) {
 		INIT_LIST_HEAD(&futex_queues[i].chain);
 		spin_lock_init(&futex_queues[i].lock);
 	}
@@ -0,0 +1,981 @@
+/*
+ *  linux/kernel/hrtimer.c
+ *
+ *  High-resolution kernel timers
+ *
+ *  In contrast to the timer wheel, which is built for timeouts that
+ *  will mostly be cancelled and only need jiffy resolution, hrtimers
+ *  are kept in a time ordered rbtree per cpu and per clock and expire
+ *  at their nanosecond expiry time.  They are used for nanosleep,
+ *  ITIMER_REAL and the CLOCK_REALTIME/CLOCK_MONOTONIC posix timers.
+ *
+ *  Until a clock event device is registered for a cpu its timers are
+ *  expired from the timer softirq on every tick, so they cannot be more
+ *  precise than a jiffy.  A clock event device is programmed for the
+ *  earliest expiry of the cpu and calls hrtimer_interrupt() from its
+ *  interrupt handler.
+ *
+ *  CLOCK_REALTIME timers expire against the wall clock, so absolute
+ *  wall clock timers follow settimeofday().  Relative timers are always
+ *  queued on CLOCK_MONOTONIC and are not affected by clock setting.
+ */
+
+#include <linux/cpu.h>
+#include <linux/module.h>
+#include <linux/percpu.h>
+#include <linux/hrtimer.h>
+#include <linux/notifier.h>
+#include <linux/syscalls.h>
+#include <linux/interrupt.h>
+#include <linux/workqueue.h>
+#include <linux/sched.h>
+
+#include <asm/uaccess.h>
+#include <asm/div64.h>
+
+#define MAX_HRTIMER_BASES	2
+
+struct hrtimer_cpu_base;
+
+/*
+ * The timer base of one clock on one cpu:
+ *
+ * @index:	clock type index for per_cpu support when moving a timer
+ *		to a base on another cpu
+ * @active:	red black tree root node for the active timers
+ * @first:	pointer to the timer node which expires first
+ * @get_time:	function to retrieve the current time of the clock
+ * @curr_timer:	the timer whose callback is running, if any
+ * @cpu_base:	the cpu base this clock base belongs to
+ */
+struct hrtimer_base {
+	clockid_t		index;
+	struct rb_root		active;
+	struct rb_node		*first;
+	ktime_t			(*get_time)(void);
+	struct hrtimer		*curr_timer;
+	struct hrtimer_cpu_base	*cpu_base;
+};
+
+/*
+ * The per cpu timer bases, with one lock protecting the timers of all
+ * clocks of the cpu and the clock event device programming:
+ *
+ * @event:		the clock event device of this cpu, or NULL while
+ *			the timers expire from the tick
+ * @expires_next:	CLOCK_MONOTONIC time the device is programmed for
+ */
+struct hrtimer_cpu_base {
+	spinlock_t		lock;
+	struct hrtimer_base	clock_base[MAX_HRTIMER_BASES];
+	struct clock_event	*event;
+	ktime_t			expires_next;
+};
+
+static DEFINE_PER_CPU(struct hrtimer_cpu_base, hrtimer_bases);
+
+/* what the clock event interrupt interrupted, while it runs the timers */
+static DEFINE_PER_CPU(struct pt_regs *, hrtimer_irq_regs);
+
+/*
+ * The resolution reported for CLOCK_REALTIME and CLOCK_MONOTONIC:
+ * a jiffy, until clock event devices are registered.
+ */
+static unsigned long hrtimer_resolution = TICK_NSEC;
+
+/*
+ * Get the current CLOCK_MONOTONIC time:
+ */
+ktime_t ktime_get(void)
+{
+	struct timespec now, tomono;
+	unsigned long seq;
+
+	do {
+		seq = read_seqbegin(&xtime_lock);
+		getnstimeofday(&now);
+		tomono = wall_to_monotonic;
+	} while (read_seqretry(&xtime_lock, seq));
+
+	return (s64)(now.tv_sec + tomono.tv_sec) * NSEC_PER_SEC +
+		now.tv_nsec + tomono.tv_nsec;
+}
+EXPORT_SYMBOL_GPL(ktime_get);
+
+/*
+ * Get the current CLOCK_REALTIME time:
+ */
+ktime_t ktime_get_real(void)
+{
+	struct timespec now;
+
+	getnstimeofday(&now);
+
+	return timespec_to_ktime(now);
+}
+EXPORT_SYMBOL_GPL(ktime_get_real);
+
+/*
+ * Convert a ktime_t value, which may be negative, to a normalized
+ * timespec:
+ */
+struct timespec ktime_to_timespec(const ktime_t kt)
+{
+	struct timespec ts;
+	u64 nsec = kt < 0 ? -kt : kt;
+	long rem;
+
+	rem = do_div(nsec, NSEC_PER_SEC);
+	ts.tv_sec = nsec;
+	ts.tv_nsec = rem;
+	if (kt < 0)
+		set_normalized_timespec(&ts, -ts.tv_sec, -ts.tv_nsec);
+
+	return ts;
+}
+EXPORT_SYMBOL_GPL(ktime_to_timespec);
+
+struct timeval ktime_to_timeval(const ktime_t kt)
+{
+	struct timespec ts = ktime_to_timespec(kt);
+	struct timeval tv;
+
+	tv.tv_sec = ts.tv_sec;
+	tv.tv_usec = ts.tv_nsec / NSEC_PER_USEC;
+
+	return tv;
+}
+EXPORT_SYMBOL_GPL(ktime_to_timeval);
+
+/*
+ * Divide a ktime value by a nanosecond value; the divisor is shifted
+ * down to 32 bits for do_div(), which gives a slightly small result
+ * for huge divisors.
+ */
+static unsigned long ktime_divns(const ktime_t kt, s64 div)
+{
+	u64 dclc = kt;
+	int sft = 0;
+
+	while (div >> 32) {
+		sft++;
+		div >>= 1;
+	}
+	dclc >>= sft;
+	do_div(dclc, (unsigned long) div);
+
+	return (unsigned long) dclc;
+}
+
+/*
+ * Add two non-negative ktime values, saturating at KTIME_MAX:
+ */
+static inline ktime_t ktime_add_safe(const ktime_t lhs, const ktime_t rhs)
+{
+	ktime_t res = (ktime_t) ((u64) lhs + (u64) rhs);
+
+	if (res < lhs || res < rhs)
+		res = KTIME_MAX;
+	return res;
+}
+
+/*
+ * We are using hashed locking: holding the lock of the cpu base the
+ * timer is queued on protects the timer.  ->base is NULL while the
+ * timer moves to another cpu (see switch_hrtimer_base()), so loop
+ * until it is stable.
+ */
+static struct hrtimer_base *lock_hrtimer_base(const struct hrtimer *timer,
+					      unsigned long *flags)
+{
+	struct hrtimer_base *base;
+
+	for (;;) {
+		base = timer->base;
+		if (likely(base != NULL)) {
+			spin_lock_irqsave(&base->cpu_base->lock, *flags);
+			if (likely(base == timer->base))
+				return base;
+			/* The timer has migrated to another cpu: */
+			spin_unlock_irqrestore(&base->cpu_base->lock, *flags);
+		}
+		cpu_relax();
+	}
+}
+
+/*
+ * Switch the timer base to the current cpu, unless its callback is
+ * running on another cpu right now.  Called with the old base locked;
+ * returns with the new one locked.
+ */
+static struct hrtimer_base *switch_hrtimer_base(struct hrtimer *timer,
+						struct hrtimer_base *base)
+{
+	struct hrtimer_cpu_base *new_cpu_base;
+	struct hrtimer_base *new_base;
+
+	new_cpu_base = &__get_cpu_var(hrtimer_bases);
+	new_base = &new_cpu_base->clock_base[base->index];
+
+	if (base != new_base) {
+		/*
+		 * We are trying to schedule the timer on the local cpu.
+		 * However we can't change the timer's base while its
+		 * callback is running, otherwise hrtimer_cancel() could
+		 * not synchronize against it.  The other cpu reprograms
+		 * its device after the callback, so just leave it there.
+		 */
+		if (unlikely(base->curr_timer == timer))
+			return base;
+
+		/* See the comment in lock_hrtimer_base() */
+		timer->base = NULL;
+		spin_unlock(&base->cpu_base->lock);
+		spin_lock(&new_cpu_base->lock);
+		timer->base = new_base;
+	}
+	return new_base;
+}
+
+/*
+ * Enqueue the timer into the rbtree of its base.  Returns 1 if it is
+ * now the first timer to expire on this base.
+ */
+static int enqueue_hrtimer(struct hrtimer *timer, struct hrtimer_base *base)
+{
+	struct rb_node **link = &base->active.rb_node;
+	struct rb_node *parent = NULL;
+	struct hrtimer *entry;
+	int leftmost = 1;
+
+	/*
+	 * Find the right place in the rbtree; timers with equal expiry
+	 * times stay in insertion order.
+	 */
+	while (*link) {
+		parent = *link;
+		entry = rb_entry(parent, struct hrtimer, node);
+		if (timer->expires < entry->expires)
+			link = &(*link)->rb_left;
+		else {
+			link = &(*link)->rb_right;
+			leftmost = 0;
+		}
+	}
+
+	if (leftmost)
+		base->first = &timer->node;
+
+	rb_link_node(&timer->node, parent, link);
+	rb_insert_color(&timer->node, &base->active);
+	timer->state = HRTIMER_PENDING;
+
+	return leftmost;
+}
+
+static void __remove_hrtimer(struct hrtimer *timer, struct hrtimer_base *base)
+{
+	if (base->first == &timer->node)
+		base->first = rb_next(&timer->node);
+	rb_erase(&timer->node, &base->active);
+	timer->state = HRTIMER_INACTIVE;
+}
+
+static inline int remove_hrtimer(struct hrtimer *timer,
+				 struct hrtimer_base *base)
+{
+	if (hrtimer_active(timer)) {
+		__remove_hrtimer(timer, base);
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * Program the clock event device of the cpu for the earliest expiry of
+ * its timer bases.  Called with the cpu base locked.  Returns 0 if that
+ * expiry has passed already, so the caller has timers to run first.
+ */
+static int hrtimer_reprogram(struct hrtimer_cpu_base *cpu_base)
+{
+	struct clock_event *evt = cpu_base->event;
+	ktime_t delta, min = KTIME_MAX;
+	int i;
+
+	for (i = 0; i < MAX_HRTIMER_BASES; i++) {
+		struct hrtimer_base *base = cpu_base->clock_base + i;
+		struct hrtimer *timer;
+
+		if (!base->first)
+			continue;
+		timer = rb_entry(base->first, struct hrtimer, node);
+		delta = timer->expires - base->get_time();
+		if (delta < min)
+			min = delta;
+	}
+
+	cpu_base->expires_next = KTIME_MAX;
+	if (min == KTIME_MAX)
+		return 1;
+	if (min <= 0)
+		return 0;
+
+	if (min < (ktime_t) evt->min_delta_ns)
+		min = evt->min_delta_ns;
+	if (min > (ktime_t) evt->max_delta_ns)
+		min = evt->max_delta_ns;
+	cpu_base->expires_next = ktime_get() + min;
+	evt->set_next_event((unsigned long) min, evt);
+
+	return 1;
+}
+
+/*
+ * Reprogram the device even if a timer has expired already, so that
+ * its interrupt comes as soon as possible:
+ */
+static void hrtimer_force_reprogram(struct hrtimer_cpu_base *cpu_base)
+{
+	struct clock_event *evt = cpu_base->event;
+
+	if (!hrtimer_reprogram(cpu_base)) {
+		cpu_base->expires_next = ktime_get() + evt->min_delta_ns;
+		evt->set_next_event(evt->min_delta_ns, evt);
+	}
+}
+
+/*
+ * A timer became the first to expire on its base: program the device
+ * of the local cpu if it expires before the event programmed already.
+ */
+static void hrtimer_program_event(struct hrtimer_cpu_base *cpu_base,
+				  struct hrtimer *timer,
+				  struct hrtimer_base *base)
+{
+	struct clock_event *evt = cpu_base->event;
+	ktime_t now = ktime_get(), delta;
+
+	delta = timer->expires - base->get_time();
+	if (delta < (ktime_t) evt->min_delta_ns)
+		delta = evt->min_delta_ns;
+	if (delta >= cpu_base->expires_next - now)
+		return;
+	if (delta > (ktime_t) evt->max_delta_ns)
+		delta = evt->max_delta_ns;
+
+	cpu_base->expires_next = now + delta;
+	evt->set_next_event((unsigned long) delta, evt);
+}
+
+/**
+ * hrtimer_start - (re)start a hrtimer on the current cpu
+ *
+ * @timer:	the timer to be added
+ * @tim:	expiry time
+ * @mode:	expiry mode: absolute (HRTIMER_ABS) or relative (HRTIMER_REL)
+ *
+ * Returns:
+ *  0 on success
+ *  1 when the timer was active
+ */
+int hrtimer_start(struct hrtimer *timer, ktime_t tim,
+		  const enum hrtimer_mode mode)
+{
+	struct hrtimer_base *base, *new_base;
+	struct hrtimer_cpu_base *cpu_base;
+	unsigned long flags;
+	int ret;
+
+	base = lock_hrtimer_base(timer, &flags);
+
+	/* Remove an active timer from the queue: */
+	ret = remove_hrtimer(timer, base);
+
+	/* Switch the timer base, if necessary: */
+	new_base = switch_hrtimer_base(timer, base);
+	cpu_base = new_base->cpu_base;
+
+	if (mode == HRTIMER_REL)
+		tim = ktime_add_safe(tim, new_base->get_time());
+	timer->expires = tim;
+
+	if (enqueue_hrtimer(timer, new_base) && cpu_base->event &&
+	    cpu_base == &__get_cpu_var(hrtimer_bases))
+		hrtimer_program_event(cpu_base, timer, new_base);
+
+	spin_unlock_irqrestore(&cpu_base->lock, flags);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(hrtimer_start);
+
+/**
+ * hrtimer_try_to_cancel - try to deactivate a timer
+ *
+ * @timer:	hrtimer to stop
+ *
+ * Returns:
+ *  0 when the timer was not active
+ *  1 when the timer was active
+ * -1 when the timer is currently executing the callback function and
+ *    cannot be stopped
+ */
+int hrtimer_try_to_cancel(struct hrtimer *timer)
+{
+	struct hrtimer_base *base;
+	unsigned long flags;
+	int ret = -1;
+
+	base = lock_hrtimer_base(timer, &flags);
+
+	if (base->curr_timer != timer)
+		ret = remove_hrtimer(timer, base);
+
+	spin_unlock_irqrestore(&base->cpu_base->lock, flags);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(hrtimer_try_to_cancel);
+
+/**
+ * hrtimer_cancel - cancel a timer and wait for the callback to finish
+ *
+ * @timer:	the timer to be cancelled
+ *
+ * Returns:
+ *  0 when the timer was not active
+ *  1 when the timer was active
+ */
+int hrtimer_cancel(struct hrtimer *timer)
+{
+	for (;;) {
+		int ret = hrtimer_try_to_cancel(timer);
+
+		if (ret >= 0)
+			return ret;
+		cpu_relax();
+	}
+}
+EXPORT_SYMBOL_GPL(hrtimer_cancel);
+
+/**
+ * hrtimer_get_remaining - get remaining time for the timer
+ *
+ * @timer:	the timer to read
+ */
+ktime_t hrtimer_get_remaining(const struct hrtimer *timer)
+{
+	struct hrtimer_base *base;
+	unsigned long flags;
+	ktime_t rem;
+
+	base = lock_hrtimer_base(timer, &flags);
+	rem = timer->expires - base->get_time();
+	spin_unlock_irqrestore(&base->cpu_base->lock, flags);
+
+	return rem;
+}
+EXPORT_SYMBOL_GPL(hrtimer_get_remaining);
+
+/**
+ * hrtimer_cb_get_time - get the current time of the timer's clock
+ *
+ * @timer:	the timer whose clock to read
+ */
+ktime_t hrtimer_cb_get_time(const struct hrtimer *timer)
+{
+	return timer->base->get_time();
+}
+EXPORT_SYMBOL_GPL(hrtimer_cb_get_time);
+
+/**
+ * hrtimer_forward - forward the timer expiry
+ *
+ * @timer:	hrtimer to forward
+ * @interval:	the interval to forward
+ *
+ * Forward the timer expiry so it will expire in the future.  The
+ * interval is rounded up to the timer resolution so that short
+ * periodic timers cannot flood the cpu.
+ *
+ * Returns the number of overruns.
+ */
+unsigned long hrtimer_forward(struct hrtimer *timer, ktime_t interval)
+{
+	unsigned long orun = 1;
+	ktime_t delta, now;
+
+	now = timer->base->get_time();
+
+	delta = now - timer->expires;
+	if (delta < 0)
+		return 0;
+
+	if (interval < (ktime_t) hrtimer_resolution)
+		interval = hrtimer_resolution;
+
+	if (unlikely(delta >= interval)) {
+		orun = ktime_divns(delta, interval);
+		timer->expires += orun * interval;
+		if (timer->expires > now)
+			return orun;
+		/*
+		 * This (and the ktime_add() below) is the
+		 * correction for exact:
+		 */
+		orun++;
+	}
+	timer->expires += interval;
+
+	return orun;
+}
+EXPORT_SYMBOL_GPL(hrtimer_forward);
+
+/**
+ * hrtimer_init - initialize a timer to the given clock
+ *
+ * @timer:	the timer to be initialized
+ * @clock_id:	the clock to be used
+ * @mode:	timer mode abs/rel
+ *
+ * Relative CLOCK_REALTIME timers are queued on CLOCK_MONOTONIC, so that
+ * setting the clock does not change the interval.
+ */
+void hrtimer_init(struct hrtimer *timer, clockid_t clock_id,
+		  const enum hrtimer_mode mode)
+{
+	struct hrtimer_cpu_base *cpu_base;
+
+	memset(timer, 0, sizeof(struct hrtimer));
+
+	cpu_base = &per_cpu(hrtimer_bases, _smp_processor_id());
+
+	if (clock_id == CLOCK_REALTIME && mode != HRTIMER_ABS)
+		clock_id = CLOCK_MONOTONIC;
+
+	timer->base = &cpu_base->clock_base[clock_id];
+}
+EXPORT_SYMBOL_GPL(hrtimer_init);
+
+/**
+ * hrtimer_get_res - get the timer resolution for a clock
+ *
+ * @which_clock: which clock to query
+ * @tp:		 pointer to timespec variable to store the resolution
+ *
+ * Store the resolution of CLOCK_REALTIME and CLOCK_MONOTONIC timers in
+ * the variable pointed to by @tp.
+ */
+int hrtimer_get_res(const clockid_t which_clock, struct timespec *tp)
+{
+	tp->tv_sec = 0;
+	tp->tv_nsec = hrtimer_resolution;
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(hrtimer_get_res);
+
+/*
+ * Expire the timers of a clock base whose time has come.  The callback
+ * runs with the base unlocked and ->curr_timer set, so that a cancel
+ * on another cpu waits for it.
+ */
+static void run_hrtimer_queue(struct hrtimer_base *base)
+{
+	struct hrtimer_cpu_base *cpu_base = base->cpu_base;
+	struct rb_node *node;
+	unsigned long flags;
+	ktime_t now;
+
+	if (!base->first)
+		return;
+
+	now = base->get_time();
+
+	spin_lock_irqsave(&cpu_base->lock, flags);
+
+	while ((node = base->first)) {
+		struct hrtimer *timer = rb_entry(node, struct hrtimer, node);
+		int (*fn)(void *);
+		int restart;
+		void *data;
+
+		if (now < timer->expires)
+			break;
+
+		fn = timer->function;
+		data = timer->data;
+		base->curr_timer = timer;
+		__remove_hrtimer(timer, base);
+		spin_unlock_irqrestore(&cpu_base->lock, flags);
+
+		restart = fn(data);
+
+		spin_lock_irqsave(&cpu_base->lock, flags);
+
+		/* The callback may have restarted the timer itself: */
+		if (restart == HRTIMER_RESTART && !hrtimer_active(timer))
+			enqueue_hrtimer(timer, base);
+		base->curr_timer = NULL;
+	}
+
+	spin_unlock_irqrestore(&cpu_base->lock, flags);
+}
+
+/*
+ * Called from the timer softirq on every tick, for the cpus without a
+ * clock event device.
+ */
+void hrtimer_run_queues(void)
+{
+	struct hrtimer_cpu_base *cpu_base = &__get_cpu_var(hrtimer_bases);
+	int i;
+
+	if (cpu_base->event)
+		return;
+
+	for (i = 0; i < MAX_HRTIMER_BASES; i++)
+		run_hrtimer_queue(&cpu_base->clock_base[i]);
+}
+
+/*
+ * Called from the interrupt handler of the clock event device of this
+ * cpu, with interrupts disabled.  @regs is what the interrupt hit.
+ */
+void hrtimer_interrupt(struct pt_regs *regs)
+{
+	struct hrtimer_cpu_base *cpu_base = &__get_cpu_var(hrtimer_bases);
+	int i, done;
+
+	if (unlikely(!cpu_base->event))
+		return;
+
+	__get_cpu_var(hrtimer_irq_regs) = regs;
+	do {
+		for (i = 0; i < MAX_HRTIMER_BASES; i++)
+			run_hrtimer_queue(&cpu_base->clock_base[i]);
+
+		spin_lock(&cpu_base->lock);
+		done = hrtimer_reprogram(cpu_base);
+		spin_unlock(&cpu_base->lock);
+	} while (!done);
+	__get_cpu_var(hrtimer_irq_regs) = NULL;
+}
+
+/**
+ * hrtimer_get_irq_regs - the context a timer callback interrupted
+ *
+ * The registers of what the clock event interrupt hit, for the timer
+ * callbacks run from it, such as the tick and profilers.  NULL while
+ * the timers of this cpu expire from the timer softirq.
+ */
+struct pt_regs *hrtimer_get_irq_regs(void)
+{
+	return __get_cpu_var(hrtimer_irq_regs);
+}
+
+/**
+ * register_clock_event - drive the timers of this cpu from a device
+ *
+ * @evt:	the clock event device of the calling cpu
+ *
+ * Must be called on the cpu the device belongs to, with preemption
+ * disabled.  From then on the timers of this cpu expire from the
+ * interrupt of the device instead of the tick.
+ */
+int register_clock_event(struct clock_event *evt)
+{
+	struct hrtimer_cpu_base *cpu_base;
+	unsigned long flags;
+
+	if (!evt->set_next_event || !evt->max_delta_ns ||
+	    evt->min_delta_ns > evt->max_delta_ns)
+		return -EINVAL;
+
+	local_irq_save(flags);
+	cpu_base = &__get_cpu_var(hrtimer_bases);
+	spin_lock(&cpu_base->lock);
+	cpu_base->event = evt;
+	hrtimer_force_reprogram(cpu_base);
+	spin_unlock(&cpu_base->lock);
+	local_irq_restore(flags);
+
+	if (hrtimer_resolution == TICK_NSEC) {
+		hrtimer_resolution = max(evt->min_delta_ns, 1UL);
+		printk(KERN_INFO "hrtimers: %s clock events, %lu ns resolution\n",
+		       evt->name, hrtimer_resolution);
+	}
+	return 0;
+}
+EXPORT_SYMBOL_GPL(register_clock_event);
+
+/*
+ * Setting the clock moves the expiry of the CLOCK_REALTIME timers.
+ * Reprogram every cpu's device for its new first expiry; cpus driven
+ * by the tick check the wall clock on every tick anyway.
+ */
+static void retrigger_next_event(void *arg)
+{
+	struct hrtimer_cpu_base *cpu_base = &__get_cpu_var(hrtimer_bases);
+
+	if (!cpu_base->event)
+		return;
+
+	spin_lock(&cpu_base->lock);
+	hrtimer_force_reprogram(cpu_base);
+	spin_unlock(&cpu_base->lock);
+}
+
+static DECLARE_WORK(clock_was_set_work, (void(*)(void*))clock_was_set, NULL);
+
+/*
+ * Called whenever the wall clock is set.  When setting the clock
+ * from interrupt context (leap seconds, with xtime_lock held) defer
+ * the work to keventd.
+ */
+void clock_was_set(void)
+{
+	if (unlikely(in_interrupt())) {
+		schedule_work(&clock_was_set_work);
+		return;
+	}
+	on_each_cpu(retrigger_next_event, NULL, 0, 1);
+}
+
+/*
+ * Sleep related functions:
+ */
+static int hrtimer_wakeup(void *data)
+{
+	struct hrtimer_sleeper *t = data;
+	struct task_struct *task = t->task;
+
+	t->task = NULL;
+	if (task)
+		wake_up_process(task);
+
+	return HRTIMER_NORESTART;
+}
+
+static int __sched do_nanosleep(struct hrtimer_sleeper *t,
+				enum hrtimer_mode mode)
+{
+	t->timer.function = hrtimer_wakeup;
+	t->timer.data = t;
+	t->task = current;
+
+	do {
+		set_current_state(TASK_INTERRUPTIBLE);
+		hrtimer_start(&t->timer, t->timer.expires, mode);
+
+		if (likely(t->task))
+			schedule();
+
+		hrtimer_cancel(&t->timer);
+		mode = HRTIMER_ABS;
+
+	} while (t->task && !signal_pending(current));
+
+	__set_current_state(TASK_RUNNING);
+
+	return t->task == NULL;
+}
+
+static long __sched hrtimer_nanosleep_restart(struct restart_block *restart)
+{
+	struct hrtimer_sleeper t;
+	struct timespec __user *rmtp;
+	struct timespec tu;
+	ktime_t rem;
+
+	hrtimer_init(&t.timer, restart->arg0, HRTIMER_ABS);
+	t.timer.expires = ((u64) restart->arg3 << 32) | (u64) restart->arg2;
+
+	if (do_nanosleep(&t, HRTIMER_ABS))
+		return 0;
+
+	rmtp = (struct timespec __user *) restart->arg1;
+	if (rmtp) {
+		rem = hrtimer_get_remaining(&t.timer);
+		if (rem <= 0)
+			return 0;
+		tu = ktime_to_timespec(rem);
+		if (copy_to_user(rmtp, &tu, sizeof(tu)))
+			return -EFAULT;
+	}
+
+	/* The other values in restart are already filled in */
+	return -ERESTART_RESTARTBLOCK;
+}
+
+/**
+ * hrtimer_nanosleep - sleep on a hrtimer
+ *
+ * @rqtp:	requested sleep time, absolute or relative to now
+ * @rmtp:	kernel copy of the remaining time for relative sleeps,
+ *		or NULL
+ * @mode:	HRTIMER_ABS or HRTIMER_REL
+ * @clockid:	CLOCK_REALTIME or CLOCK_MONOTONIC
+ *
+ * Interrupted relative sleeps fill in the restart block, but the
+ * caller has to set restart->arg1 to the user's rmtp pointer.
+ */
+long hrtimer_nanosleep(struct timespec *rqtp, struct timespec *rmtp,
+		       const enum hrtimer_mode mode, const clockid_t clockid)
+{
+	struct restart_block *restart;
+	struct hrtimer_sleeper t;
+	ktime_t rem;
+
+	hrtimer_init(&t.timer, clockid, mode);
+	t.timer.expires = timespec_to_ktime(*rqtp);
+	if (do_nanosleep(&t, mode))
+		return 0;
+
+	/* Absolute timers do not update the rmtp value and restart: */
+	if (mode == HRTIMER_ABS)
+		return -ERESTARTNOHAND;
+
+	if (rmtp) {
+		rem = hrtimer_get_remaining(&t.timer);
+		if (rem <= 0)
+			return 0;
+		*rmtp = ktime_to_timespec(rem);
+	}
+
+	restart = &current_thread_info()->restart_block;
+	restart->fn = hrtimer_nanosleep_restart;
+	restart->arg0 = t.timer.base->index;
+	restart->arg2 = t.timer.expires & 0xFFFFFFFF;
+	restart->arg3 = t.timer.expires >> 32;
+
+	return -ERESTART_RESTARTBLOCK;
+}
+
+asmlinkage long
+sys_nanosleep(struct timespec __user *rqtp, struct timespec __user *rmtp)
+{
+	struct timespec tu, rmt;
+	long ret;
+
+	if (copy_from_user(&tu, rqtp, sizeof(tu)))
+		return -EFAULT;
+
+	if ((unsigned long) tu.tv_nsec >= NSEC_PER_SEC || tu.tv_sec < 0)
+		return -EINVAL;
+
+	ret = hrtimer_nanosleep(&tu, rmtp ? &rmt : NULL, HRTIMER_REL,
+				CLOCK_MONOTONIC);
+
+	if (ret == -ERESTART_RESTARTBLOCK) {
+		current_thread_info()->restart_block.arg1 =
+			(unsigned long) rmtp;
+		if (rmtp && copy_to_user(rmtp, &rmt, sizeof(rmt)))
+			return -EFAULT;
+	}
+
+	return ret;
+}
+
+/*
+ * Functions related to boot-time initialization:
+ */
+static void __devinit init_hrtimers_cpu(int cpu)
+{
+	struct hrtimer_cpu_base *cpu_base = &per_cpu(hrtimer_bases, cpu);
+	int i;
+
+	spin_lock_init(&cpu_base->lock);
+	cpu_base->event = NULL;
+	cpu_base->expires_next = KTIME_MAX;
+
+	for (i = 0; i < MAX_HRTIMER_BASES; i++) {
+		struct hrtimer_base *base = &cpu_base->clock_base[i];
+
+		base->index = i;
+		base->active = RB_ROOT;
+		base->first = NULL;
+		base->curr_timer = NULL;
+		base->cpu_base = cpu_base;
+	}
+	cpu_base->clock_base[CLOCK_REALTIME].get_time = ktime_get_real;
+	cpu_base->clock_base[CLOCK_MONOTONIC].get_time = ktime_get;
+}
+
+#ifdef CONFIG_HOTPLUG_CPU
+
+static void migrate_hrtimer_list(struct hrtimer_base *old_base,
+				 struct hrtimer_base *new_base)
+{
+	struct hrtimer *timer;
+	struct rb_node *node;
+
+	while ((node = rb_first(&old_base->active))) {
+		timer = rb_entry(node, struct hrtimer, node);
+		__remove_hrtimer(timer, old_base);
+		timer->base = new_base;
+		enqueue_hrtimer(timer, new_base);
+	}
+}
+
+static void migrate_hrtimers(int cpu)
+{
+	struct hrtimer_cpu_base *old_base, *new_base;
+	int i;
+
+	BUG_ON(cpu_online(cpu));
+	old_base = &per_cpu(hrtimer_bases, cpu);
+	new_base = &get_cpu_var(hrtimer_bases);
+
+	local_irq_disable();
+
+	spin_lock(&new_base->lock);
+	spin_lock(&old_base->lock);
+
+	for (i = 0; i < MAX_HRTIMER_BASES; i++) {
+		BUG_ON(old_base->clock_base[i].curr_timer);
+		migrate_hrtimer_list(&old_base->clock_base[i],
+				     &new_base->clock_base[i]);
+	}
+	old_base->event = NULL;
+	if (new_base->event)
+		hrtimer_force_reprogram(new_base);
+
+	spin_unlock(&old_base->lock);
+	spin_unlock(&new_base->lock);
+
+	local_irq_enable();
+	put_cpu_var(hrtimer_bases);
+}
+#endif /* CONFIG_HOTPLUG_CPU */
+
+static int __devinit hrtimer_cpu_notify(struct notifier_block *self,
+					unsigned long action, void *hcpu)
+{
+	long cpu = (long)hcpu;
+
+	switch (action) {
+	case CPU_UP_PREPARE:
+		init_hrtimers_cpu(cpu);
+		break;
+#ifdef CONFIG_HOTPLUG_CPU
+	case CPU_DEAD:
+		migrate_hrtimers(cpu);
+		break;
+#endif
+	default:
+		break;
+	}
+	return NOTIFY_OK;
+}
+
+static struct notifier_block __devinitdata hrtimers_nb = {
+	.notifier_call	= hrtimer_cpu_notify,
+};
+
+void __init hrtimers_init(void)
+{
+	hrtimer_cpu_notify(&hrtimers_nb, (unsigned long)CPU_UP_PREPARE,
+			   (void *)(long)smp_processor_id());
+	register_cpu_notifier(&hrtimers_nb);
+}
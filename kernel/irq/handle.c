@@ -11,6 +11,7 @@
 #include <linux/random.h>
 #include <linux/interrupt.h>
 #include <linux/kernel_stat.h>
+#include <linux/sched.h>
 
 #include "internals.h"
 
@@ -72,6 +73,19 @@ irqreturn_t no_action(int cpl, void *dev_id, struct pt_regs *regs)
 	return IRQ_NONE;
 }
 
+/*
+ * Hand the rest of the interrupt to the thread of @action.  The thread
+ * runs it once however often it is woken meanwhile.
+ */
+static void irq_wake_thread(struct irqaction *action)
+{
+	if (unlikely(!action->thread))
+		return;
+	if (test_and_set_bit(IRQTF_RUNTHREAD, &action->thread_flags))
+		return;
+	wake_up_process(action->thread);
+}
+
 /*
  * Have got an event to handle:
  */
@@ -85,6 +99,10 @@ fastcall int handle_IRQ_event(unsigned int irq, struct pt_regs *regs,
 
 	do {
 		ret = action->handler(irq, action->dev_id, regs);
+		if (ret == IRQ_WAKE_THREAD) {
+			irq_wake_thread(action);
+			ret = IRQ_HANDLED;
+		}
 		if (ret == IRQ_HANDLED)
 			status |= action->flags;
 		retval |= ret;
@@ -10,13 +10,47 @@
 #include <linux/module.h>
 #include <linux/random.h>
 #include <linux/interrupt.h>
+#include <linux/kthread.h>
+#include <linux/sched.h>
 
 #include "internals.h"
 
+/* Priority the threads of request_threaded_irq() start with */
+#define IRQ_THREAD_PRIO		(MAX_USER_RT_PRIO / 2)
+
 #ifdef CONFIG_SMP
 
 cpumask_t irq_affinity[NR_IRQS] = { [0 ... NR_IRQS-1] = CPU_MASK_ALL };
 
+/*
+ * The CPUs near the devices of each irq, which a balancer should keep
+ * it on: those of the node of their bus, or those set through
+ * /proc/irq/<irq>/home_cpus to where their data is consumed.
+ */
+cpumask_t irq_home[NR_IRQS] = { [0 ... NR_IRQS-1] = CPU_MASK_ALL };
+
+/**
+ *	set_irq_home - tell where a device of an irq sits
+ *	@irq: Interrupt of the device
+ *	@mask: CPUs close to the device
+ *
+ *	Devices with no CPUs in common sharing an irq leave it without a
+ *	home, all CPUs being as good.
+ */
+void set_irq_home(unsigned int irq, cpumask_t mask)
+{
+	cpumask_t home;
+
+	if (irq >= NR_IRQS)
+		return;
+	cpus_and(home, irq_home[irq], mask);
+	if (cpus_empty(home))
+		home = CPU_MASK_ALL;
+	irq_home[irq] = home;
+}
+
+EXPORT_SYMBOL(set_irq_home);
+
 /**
  *	synchronize_irq - wait for pending IRQ handlers (on other CPUs)
  *
@@ -267,6 +301,8 @@ void free_irq(unsigned int irq, void *dev_id)
 
 			/* Make sure it's not being used on another CPU */
 			synchronize_irq(irq);
+			if (action->thread)
+				kthread_stop(action->thread);
 			kfree(action);
 			return;
 		}
@@ -278,37 +314,67 @@ void free_irq(unsigned int irq, void *dev_id)
 
 EXPORT_SYMBOL(free_irq);
 
+/* Sleep until the handler has work for us, 0 then, -1 when stopped */
+static int irq_wait_for_interrupt(struct irqaction *action)
+{
+	for (;;) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (kthread_should_stop())
+			break;
+		if (test_and_clear_bit(IRQTF_RUNTHREAD,
+				       &action->thread_flags)) {
+			__set_current_state(TASK_RUNNING);
+			return 0;
+		}
+		schedule();
+	}
+	__set_current_state(TASK_RUNNING);
+	return -1;
+}
+
+static int irq_thread(void *data)
+{
+	struct sched_param param = { .sched_priority = IRQ_THREAD_PRIO };
+	struct irqaction *action = data;
+
+	sched_setscheduler(current, SCHED_FIFO, &param);
+
+	while (!irq_wait_for_interrupt(action))
+		action->thread_fn(action->irq, action->dev_id);
+
+	return 0;
+}
+
 /**
- *	request_irq - allocate an interrupt line
+ *	request_threaded_irq - allocate an interrupt line
  *	@irq: Interrupt line to allocate
  *	@handler: Function to be called when the IRQ occurs
+ *	@thread_fn: Function called from the irq thread, or NULL
  *	@irqflags: Interrupt type flags
  *	@devname: An ascii name for the claiming device
  *	@dev_id: A cookie passed back to the handler function
  *
- *	This call allocates interrupt resources and enables the
- *	interrupt line and IRQ handling. From the point this
- *	call is made your handler function may be invoked. Since
- *	your handler function must clear any interrupt the board
- *	raises, you must take care both to initialise your hardware
- *	and to set up the interrupt handler in the right order.
- *
- *	Dev_id must be globally unique. Normally the address of the
- *	device data structure is used as the cookie. Since the handler
- *	receives this value it makes sense to use it.
+ *	As request_irq(), but with @thread_fn a kernel thread "irq/N-name"
+ *	of its own is started for the handler, and @handler becomes the
+ *	quick check: it runs in hard interrupt context, finds out whether
+ *	its device raised the interrupt and stops it from raising it again,
+ *	and returns IRQ_WAKE_THREAD to have @thread_fn run in the thread for
+ *	the rest, or IRQ_HANDLED or IRQ_NONE when there is no rest to do.
+ *	The line is not masked meanwhile, so a level triggered device must
+ *	be quieted by @handler.
  *
- *	If your interrupt is shared you must pass a non NULL dev_id
- *	as this is required when freeing the interrupt.
- *
- *	Flags:
+ *	The thread runs SCHED_FIFO at priority IRQ_THREAD_PRIO, and may be
+ *	given another priority like any task, so that the handlers of
+ *	latency critical devices preempt those of bulk ones.
  *
- *	SA_SHIRQ		Interrupt is shared
- *	SA_INTERRUPT		Disable local interrupts while processing
- *	SA_SAMPLE_RANDOM	The interrupt can be used for entropy
+ *	disable_irq() and synchronize_irq() wait for @handler only;
+ *	free_irq() waits for @thread_fn as well.
  *
+ *	This function may sleep.
  */
-int request_irq(unsigned int irq,
+int request_threaded_irq(unsigned int irq,
 		irqreturn_t (*handler)(int, void *, struct pt_regs *),
+		irqreturn_t (*thread_fn)(int, void *),
 		unsigned long irqflags, const char * devname, void *dev_id)
 {
 	struct irqaction * action;
@@ -327,7 +393,8 @@ int request_irq(unsigned int irq,
 	if (!handler)
 		return -EINVAL;
 
-	action = kmalloc(sizeof(struct irqaction), GFP_ATOMIC);
+	action = kmalloc(sizeof(struct irqaction), thread_fn ?
+			 GFP_KERNEL : GFP_ATOMIC);
 	if (!action)
 		return -ENOMEM;
 
@@ -337,13 +404,73 @@ int request_irq(unsigned int irq,
 	action->name = devname;
 	action->next = NULL;
 	action->dev_id = dev_id;
+	action->irq = irq;
+	action->thread_fn = thread_fn;
+	action->thread = NULL;
+	action->thread_flags = 0;
+
+	if (thread_fn) {
+		struct task_struct *t;
+
+		t = kthread_create(irq_thread, action, "irq/%d-%s",
+				   irq, devname);
+		if (IS_ERR(t)) {
+			kfree(action);
+			return PTR_ERR(t);
+		}
+		action->thread = t;
+		/* let it go to sleep waiting for the first interrupt */
+		wake_up_process(t);
+	}
 
 	retval = setup_irq(irq, action);
-	if (retval)
+	if (retval) {
+		if (action->thread)
+			kthread_stop(action->thread);
 		kfree(action);
+	}
 
 	return retval;
 }
 
+EXPORT_SYMBOL(request_threaded_irq);
+
+/**
+ *	request_irq - allocate an interrupt line
+ *	@irq: Interrupt line to allocate
+ *	@handler: Function to be called when the IRQ occurs
+ *	@irqflags: Interrupt type flags
+ *	@devname: An ascii name for the claiming device
+ *	@dev_id: A cookie passed back to the handler function
+ *
+ *	This call allocates interrupt resources and enables the
+ *	interrupt line and IRQ handling. From the point this
+ *	call is made your handler function may be invoked. Since
+ *	your handler function must clear any interrupt the board
+ *	raises, you must take care both to initialise your hardware
+ *	and to set up the interrupt handler in the right order.
+ *
+ *	Dev_id must be globally unique. Normally the address of the
+ *	device data structure is used as the cookie. Since the handler
+ *	receives this value it makes sense to use it.
+ *
+ *	If your interrupt is shared you must pass a non NULL dev_id
+ *	as this is required when freeing the interrupt.
+ *
+ *	Flags:
+ *
+ *	SA_SHIRQ		Interrupt is shared
+ *	SA_INTERRUPT		Disable local interrupts while processing
+ *	SA_SAMPLE_RANDOM	The interrupt can be used for entropy
+ *
+ */
+int request_irq(unsigned int irq,
+		irqreturn_t (*handler)(int, void *, struct pt_regs *),
+		unsigned long irqflags, const char * devname, void *dev_id)
+{
+	return request_threaded_irq(irq, handler, NULL, irqflags,
+				    devname, dev_id);
+}
+
 EXPORT_SYMBOL(request_irq);
 
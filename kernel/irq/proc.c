@@ -65,6 +65,36 @@ static int irq_affinity_write_proc(struct file *file, const char __user *buffer,
 	return full_count;
 }
 
+/*
+ * The /proc/irq/<irq>/home_cpus values, see irq_home[]:
+ */
+static int irq_home_read_proc(char *page, char **start, off_t off,
+			      int count, int *eof, void *data)
+{
+	int len = cpumask_scnprintf(page, count, irq_home[(long)data]);
+
+	if (count - len < 2)
+		return -EINVAL;
+	len += sprintf(page + len, "\n");
+	return len;
+}
+
+static int irq_home_write_proc(struct file *file, const char __user *buffer,
+			       unsigned long count, void *data)
+{
+	unsigned int irq = (int)(long)data, full_count = count, err;
+	cpumask_t new_value;
+
+	err = cpumask_parse(buffer, count, new_value);
+	if (err)
+		return err;
+
+	/* unlike set_irq_home() this replaces what the devices said */
+	irq_home[irq] = new_value;
+
+	return full_count;
+}
+
 #endif
 
 #define MAX_NAMELEN 128
@@ -129,6 +159,16 @@ void register_irq_proc(unsigned int irq)
 			entry->write_proc = irq_affinity_write_proc;
 		}
 		smp_affinity_entry[irq] = entry;
+
+		/* create /proc/irq/<irq>/home_cpus */
+		entry = create_proc_entry("home_cpus", 0600, irq_dir[irq]);
+
+		if (entry) {
+			entry->nlink = 1;
+			entry->data = (void *)(long)irq;
+			entry->read_proc = irq_home_read_proc;
+			entry->write_proc = irq_home_write_proc;
+		}
 	}
 #endif
 }
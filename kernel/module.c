@@ -35,6 +35,7 @@
 #include <linux/notifier.h>
 #include <linux/stop_machine.h>
 #include <linux/device.h>
+#include <linux/sort.h>
 #include <asm/uaccess.h>
 #include <asm/semaphore.h>
 #include <asm/cacheflush.h>
@@ -131,6 +132,79 @@ extern const unsigned long __start___kcrctab_gpl[];
 #define symversion(base, idx) ((base) ? ((base) + (idx)) : NULL)
 #endif
 
+/*
+ * The export tables are sorted by name, the kernel's at boot and each
+ * module's as it is loaded, so that a symbol is found by binary search.
+ * Their crcs, at the same indices, move along with them.
+ */
+static struct kernel_symbol *sort_syms;
+static unsigned long *sort_crcs;
+
+static int cmp_symbol(const void *a, const void *b)
+{
+	return strcmp(((const struct kernel_symbol *)a)->name,
+		      ((const struct kernel_symbol *)b)->name);
+}
+
+static void swap_symbol(void *a, void *b, int size)
+{
+	struct kernel_symbol *x = a, *y = b, tmp;
+
+	if (sort_crcs) {
+		unsigned long crc, *cx, *cy;
+
+		cx = sort_crcs + (x - sort_syms);
+		cy = sort_crcs + (y - sort_syms);
+		crc = *cx;
+		*cx = *cy;
+		*cy = crc;
+	}
+	tmp = *x;
+	*x = *y;
+	*y = tmp;
+}
+
+/* Called at boot, or under module_mutex */
+static void sort_symbols(const struct kernel_symbol *syms,
+			 const unsigned long *crcs, unsigned int num)
+{
+	sort_syms = (struct kernel_symbol *)syms;
+	sort_crcs = (unsigned long *)crcs;
+	sort(sort_syms, num, sizeof(*syms), cmp_symbol, swap_symbol);
+	sort_syms = NULL;
+	sort_crcs = NULL;
+}
+
+/* Sort the kernel's built-in export tables */
+void __init sort_main_ksymtab(void)
+{
+	sort_symbols(__start___ksymtab, symversion(__start___kcrctab, 0),
+		     __stop___ksymtab - __start___ksymtab);
+	sort_symbols(__start___ksymtab_gpl,
+		     symversion(__start___kcrctab_gpl, 0),
+		     __stop___ksymtab_gpl - __start___ksymtab_gpl);
+}
+
+/* Binary search of a sorted export table: the index of name, or -1 */
+static int lookup_symbol(const char *name, const struct kernel_symbol *syms,
+			 unsigned int num)
+{
+	unsigned int low = 0, high = num;
+
+	while (low < high) {
+		unsigned int mid = (low + high) / 2;
+		int cmp = strcmp(name, syms[mid].name);
+
+		if (!cmp)
+			return mid;
+		if (cmp < 0)
+			high = mid;
+		else
+			low = mid + 1;
+	}
+	return -1;
+}
+
 /* Find a symbol, return value, crc and module which owns it */
 static unsigned long __find_symbol(const char *name,
 				   struct module **owner,
@@ -138,39 +212,40 @@ static unsigned long __find_symbol(const char *name,
 				   int gplok)
 {
 	struct module *mod;
-	unsigned int i;
+	int i;
 
 	/* Core kernel first. */ 
 	*owner = NULL;
-	for (i = 0; __start___ksymtab+i < __stop___ksymtab; i++) {
-		if (strcmp(__start___ksymtab[i].name, name) == 0) {
-			*crc = symversion(__start___kcrctab, i);
-			return __start___ksymtab[i].value;
-		}
+	i = lookup_symbol(name, __start___ksymtab,
+			  __stop___ksymtab - __start___ksymtab);
+	if (i >= 0) {
+		*crc = symversion(__start___kcrctab, i);
+		return __start___ksymtab[i].value;
 	}
 	if (gplok) {
-		for (i = 0; __start___ksymtab_gpl+i<__stop___ksymtab_gpl; i++)
-			if (strcmp(__start___ksymtab_gpl[i].name, name) == 0) {
-				*crc = symversion(__start___kcrctab_gpl, i);
-				return __start___ksymtab_gpl[i].value;
-			}
+		i = lookup_symbol(name, __start___ksymtab_gpl,
+				  __stop___ksymtab_gpl - __start___ksymtab_gpl);
+		if (i >= 0) {
+			*crc = symversion(__start___kcrctab_gpl, i);
+			return __start___ksymtab_gpl[i].value;
+		}
 	}
 
 	/* Now try modules. */ 
 	list_for_each_entry(mod, &modules, list) {
 		*owner = mod;
-		for (i = 0; i < mod->num_syms; i++)
-			if (strcmp(mod->syms[i].name, name) == 0) {
-				*crc = symversion(mod->crcs, i);
-				return mod->syms[i].value;
-			}
+		i = lookup_symbol(name, mod->syms, mod->num_syms);
+		if (i >= 0) {
+			*crc = symversion(mod->crcs, i);
+			return mod->syms[i].value;
+		}
 
 		if (gplok) {
-			for (i = 0; i < mod->num_gpl_syms; i++) {
-				if (strcmp(mod->gpl_syms[i].name, name) == 0) {
-					*crc = symversion(mod->gpl_crcs, i);
-					return mod->gpl_syms[i].value;
-				}
+			i = lookup_symbol(name, mod->gpl_syms,
+					  mod->num_gpl_syms);
+			if (i >= 0) {
+				*crc = symversion(mod->gpl_crcs, i);
+				return mod->gpl_syms[i].value;
 			}
 		}
 	}
@@ -1386,6 +1461,27 @@ static void add_kallsyms(struct module *mod,
 		mod->symtab[i].st_info
 			= elf_type(&mod->symtab[i], sechdrs, secstrings, mod);
 }
+
+static int cmp_ksymbol_value(const void *a, const void *b)
+{
+	const Elf_Sym *x = a, *y = b;
+
+	if (x->st_value < y->st_value)
+		return -1;
+	return x->st_value > y->st_value;
+}
+
+/*
+ * Once the module is relocated and finalized nothing refers to its
+ * symbols by index any more: sort them by address (ELF starts real
+ * symbols at 1) so that get_ksymbol() can search them.
+ */
+static void sort_kallsyms(struct module *mod)
+{
+	if (mod->num_symtab > 1)
+		sort(mod->symtab + 1, mod->num_symtab - 1, sizeof(Elf_Sym),
+		     cmp_ksymbol_value, NULL);
+}
 #else
 static inline void add_kallsyms(struct module *mod,
 				Elf_Shdr *sechdrs,
@@ -1394,6 +1490,10 @@ static inline void add_kallsyms(struct module *mod,
 				const char *secstrings)
 {
 }
+
+static inline void sort_kallsyms(struct module *mod)
+{
+}
 #endif /* CONFIG_KALLSYMS */
 
 /* Allocate and load the module: note that size of section 0 is always
@@ -1630,6 +1730,8 @@ static struct module *load_module(void __user *umod,
 	mod->gpl_syms = (void *)sechdrs[gplindex].sh_addr;
 	if (gplcrcindex)
 		mod->gpl_crcs = (void *)sechdrs[gplcrcindex].sh_addr;
+	sort_symbols(mod->syms, mod->crcs, mod->num_syms);
+	sort_symbols(mod->gpl_syms, mod->gpl_crcs, mod->num_gpl_syms);
 
 #ifdef CONFIG_MODVERSIONS
 	if ((mod->num_syms && !crcindex) || 
@@ -1676,6 +1778,7 @@ static struct module *load_module(void __user *umod,
 	err = module_finalize(hdr, sechdrs, mod);
 	if (err < 0)
 		goto cleanup;
+	sort_kallsyms(mod);
 
 	mod->args = args;
 	if (obsparmindex) {
@@ -1844,12 +1947,22 @@ static inline int is_arm_mapping_symbol(const char *str)
 	       && (str[2] == '\0' || str[2] == '.');
 }
 
+static inline int is_ksymbol(struct module *mod, unsigned int i)
+{
+	const char *name = mod->strtab + mod->symtab[i].st_name;
+
+	/* We ignore unnamed symbols: they're uninformative
+	 * and inserted at a whim. */
+	return mod->symtab[i].st_shndx != SHN_UNDEF && *name != '\0'
+		&& !is_arm_mapping_symbol(name);
+}
+
 static const char *get_ksymbol(struct module *mod,
 			       unsigned long addr,
 			       unsigned long *size,
 			       unsigned long *offset)
 {
-	unsigned int i, best = 0;
+	unsigned int i, low, high, best = 0;
 	unsigned long nextval;
 
 	/* At worse, next value is at end of module */
@@ -1858,26 +1971,31 @@ static const char *get_ksymbol(struct module *mod,
 	else 
 		nextval = (unsigned long)mod->module_core+mod->core_text_size;
 
-	/* Scan for closest preceeding symbol, and next symbol. (ELF
-           starts real symbols at 1). */
-	for (i = 1; i < mod->num_symtab; i++) {
-		if (mod->symtab[i].st_shndx == SHN_UNDEF)
-			continue;
+	/* Find the first symbol above addr, see sort_kallsyms() */
+	low = 1;
+	high = mod->num_symtab;
+	while (low < high) {
+		unsigned int mid = (low + high) / 2;
 
-		/* We ignore unnamed symbols: they're uninformative
-		 * and inserted at a whim. */
-		if (mod->symtab[i].st_value <= addr
-		    && mod->symtab[i].st_value > mod->symtab[best].st_value
-		    && *(mod->strtab + mod->symtab[i].st_name) != '\0'
-		    && !is_arm_mapping_symbol(mod->strtab + mod->symtab[i].st_name))
-			best = i;
-		if (mod->symtab[i].st_value > addr
-		    && mod->symtab[i].st_value < nextval
-		    && *(mod->strtab + mod->symtab[i].st_name) != '\0'
-		    && !is_arm_mapping_symbol(mod->strtab + mod->symtab[i].st_name))
-			nextval = mod->symtab[i].st_value;
+		if (mod->symtab[mid].st_value <= addr)
+			low = mid + 1;
+		else
+			high = mid;
 	}
 
+	/* Closest preceeding symbol, and next symbol */
+	for (i = low; i-- > 1; )
+		if (is_ksymbol(mod, i)) {
+			best = i;
+			break;
+		}
+	for (i = low; i < mod->num_symtab; i++)
+		if (is_ksymbol(mod, i)) {
+			if (mod->symtab[i].st_value < nextval)
+				nextval = mod->symtab[i].st_value;
+			break;
+		}
+
 	if (!best)
 		return NULL;
 
@@ -0,0 +1,164 @@
+/*
+ * kernel/mutex.c
+ *
+ * Sleeping mutexes, see include/linux/mutex.h.
+ *
+ * Taking and releasing an uncontended mutex is one atomic decrement or
+ * increment of ->count.  A locker which takes it below zero first spins
+ * for as long as the owner is running on another CPU, as the owner is
+ * then likely to unlock before a sleep and wakeup could be done, and
+ * only then queues itself on ->wait_list and sleeps.  Waiters leave
+ * ->count at -1 each time they look, so that the unlock goes through
+ * the slow path and wakes the first of them.
+ */
+
+#include <linux/module.h>
+#include <linux/sched.h>
+#include <linux/mutex.h>
+
+struct mutex_waiter {
+	struct list_head	list;
+	struct task_struct	*task;
+};
+
+#define mutex_xchg(lock, v)	xchg(&(lock)->count.counter, (v))
+
+#ifdef MUTEX_SPIN_ON_OWNER
+/*
+ * Spin for @lock while its owner runs, 1 if we got it meanwhile.  The
+ * lock is only taken from 1, so that the waiters' -1 is not lost.
+ */
+static int mutex_optimistic_spin(struct mutex *lock)
+{
+	int ret = 0;
+
+	preempt_disable();
+	for (;;) {
+		struct thread_info *owner = lock->owner;
+
+		if (owner && !spin_on_owner(&lock->owner, owner))
+			break;
+		if (atomic_read(&lock->count) == 1 &&
+		    cmpxchg(&lock->count.counter, 1, 0) == 1) {
+			ret = 1;
+			break;
+		}
+		/*
+		 * No owner: it has just taken the lock and not set ->owner
+		 * yet, or it has just released it.  Either way it is about
+		 * to change, unless we ought to be doing something else.
+		 */
+		if (!owner && (need_resched() || rt_task(current)))
+			break;
+		cpu_relax();
+	}
+	preempt_enable();
+	return ret;
+}
+#else
+static inline int mutex_optimistic_spin(struct mutex *lock)
+{
+	return 0;
+}
+#endif
+
+static int __sched __mutex_lock_slowpath(struct mutex *lock, long state)
+{
+	struct task_struct *task = current;
+	struct mutex_waiter waiter;
+
+	if (mutex_optimistic_spin(lock))
+		return 0;
+
+	spin_lock(&lock->wait_lock);
+	waiter.task = task;
+	list_add_tail(&waiter.list, &lock->wait_list);
+
+	for (;;) {
+		/* it may have been released since: if not, mark us waiting */
+		if (mutex_xchg(lock, -1) == 1)
+			break;
+		if (state == TASK_INTERRUPTIBLE && signal_pending(task)) {
+			list_del(&waiter.list);
+			spin_unlock(&lock->wait_lock);
+			return -EINTR;
+		}
+		__set_task_state(task, state);
+		spin_unlock(&lock->wait_lock);
+		schedule();
+		spin_lock(&lock->wait_lock);
+	}
+	__set_task_state(task, TASK_RUNNING);
+
+	list_del(&waiter.list);
+	/* the unlock need not look for anybody to wake */
+	if (list_empty(&lock->wait_list))
+		atomic_set(&lock->count, 0);
+	spin_unlock(&lock->wait_lock);
+	return 0;
+}
+
+static void __mutex_unlock_slowpath(struct mutex *lock)
+{
+	spin_lock(&lock->wait_lock);
+	atomic_set(&lock->count, 1);
+	if (!list_empty(&lock->wait_list)) {
+		struct mutex_waiter *waiter;
+
+		waiter = list_entry(lock->wait_list.next,
+				    struct mutex_waiter, list);
+		wake_up_process(waiter->task);
+	}
+	spin_unlock(&lock->wait_lock);
+}
+
+void fastcall __sched mutex_lock(struct mutex *lock)
+{
+	might_sleep();
+	if (unlikely(atomic_dec_return(&lock->count) < 0))
+		__mutex_lock_slowpath(lock, TASK_UNINTERRUPTIBLE);
+	lock->owner = current_thread_info();
+}
+
+EXPORT_SYMBOL(mutex_lock);
+
+/* 0 with the mutex taken, or -EINTR for a signal while waiting */
+int fastcall __sched mutex_lock_interruptible(struct mutex *lock)
+{
+	might_sleep();
+	if (unlikely(atomic_dec_return(&lock->count) < 0) &&
+	    __mutex_lock_slowpath(lock, TASK_INTERRUPTIBLE))
+		return -EINTR;
+	lock->owner = current_thread_info();
+	return 0;
+}
+
+EXPORT_SYMBOL(mutex_lock_interruptible);
+
+int fastcall mutex_trylock(struct mutex *lock)
+{
+	int prev;
+
+	spin_lock(&lock->wait_lock);
+	prev = mutex_xchg(lock, -1);
+	/* without waiters it need not stay marked */
+	if (list_empty(&lock->wait_list))
+		atomic_set(&lock->count, 0);
+	spin_unlock(&lock->wait_lock);
+
+	if (prev != 1)
+		return 0;
+	lock->owner = current_thread_info();
+	return 1;
+}
+
+EXPORT_SYMBOL(mutex_trylock);
+
+void fastcall mutex_unlock(struct mutex *lock)
+{
+	lock->owner = NULL;
+	if (unlikely(atomic_inc_return(&lock->count) <= 0))
+		__mutex_unlock_slowpath(lock);
+}
+
+EXPORT_SYMBOL(mutex_unlock);
@@ -0,0 +1,736 @@
+/*
+ * kernel/perfctr.c
+ *
+ * Hardware performance counters for user space: counting cycles,
+ * instructions, cache and branch misses for a thread, switched with it
+ * in schedule(), or for a whole CPU, and optionally sampling the
+ * instruction pointer every so many events.
+ *
+ * A counter is a file descriptor from perfctr_open(), see
+ * include/linux/perfctr.h.  The CPU model code, e.g.
+ * arch/i386/kernel/perfctr.c, registers a struct perfctr_pmu and calls
+ * perfctr_overflow() from its counter interrupt.
+ *
+ * Every counter is programmed to overflow after @left events, its
+ * period, or 2^31 events when it only counts, and its count is folded
+ * from the hardware counter whenever that overflows or the counter is
+ * taken off the CPU.  The hardware counters of a CPU are in
+ * perfctr_cpus, and only touched by that CPU with interrupts off.  Those
+ * of a thread are on the CPU while it runs, if there are enough of
+ * them; those of a CPU stay there from open to close.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/mm.h>
+#include <linux/fs.h>
+#include <linux/file.h>
+#include <linux/err.h>
+#include <linux/mount.h>
+#include <linux/smp.h>
+#include <linux/percpu.h>
+#include <linux/syscalls.h>
+#include <linux/perfctr.h>
+#include <asm/uaccess.h>
+#include <asm/semaphore.h>
+#include <asm/ptrace.h>
+
+struct perfctr {
+	struct perfctr_attr	attr;
+	u64			evntsel;	/* from pmu->event() */
+	u64			period;		/* between overflows */
+	u64			count;		/* up to the current period */
+	u64			left;		/* of the current period */
+	int			hw;		/* counter while loaded, or -1 */
+	int			cpu;		/* where it is or was loaded */
+	int			pinned_cpu;	/* of a CPU's counter, or -1 */
+	struct task_struct	*task;		/* of a thread's, until exit */
+	struct list_head	list;		/* in task->perfctr */
+	/* of a kernel counter, instead of samples */
+	void			(*overflow)(struct perfctr *ctr,
+					    struct pt_regs *regs);
+
+	struct perfctr_mmap	*user;		/* page 0 */
+	struct page		**pages;	/* then the samples */
+	unsigned int		nr_pages;
+	unsigned int		nr_samples;
+};
+
+#define SAMPLES_PER_PAGE	(PAGE_SIZE / sizeof(struct perfctr_sample))
+
+struct perfctr_cpu {
+	struct perfctr		*hw[PERFCTR_MAX_COUNTERS];
+};
+
+static DEFINE_PER_CPU(struct perfctr_cpu, perfctr_cpus);
+
+static struct perfctr_pmu *pmu;
+static DECLARE_MUTEX(perfctr_sem);	/* perfctr_users */
+static int perfctr_users;		/* counters, the pmu is reserved */
+/* task->perfctr and ctr->task, against exit */
+static DEFINE_SPINLOCK(perfctr_lock);
+static struct vfsmount *perfctr_mnt;
+
+int perfctr_register_pmu(struct perfctr_pmu *p)
+{
+	if (pmu || p->num_counters > PERFCTR_MAX_COUNTERS)
+		return -EBUSY;
+	pmu = p;
+	printk(KERN_INFO "perfctr: %s, %d counters\n", p->name,
+	       p->num_counters);
+	return 0;
+}
+
+/* the hardware counter as the signed distance to its overflow */
+static inline s64 perfctr_hw_value(int hw)
+{
+	int shift = 64 - pmu->width;
+
+	return (s64)(pmu->read(hw) << shift) >> shift;
+}
+
+static void perfctr_user_update(struct perfctr *ctr)
+{
+	struct perfctr_mmap *user = ctr->user;
+
+	user->seq++;
+	smp_wmb();
+	/* only a thread can read its counter itself, on its CPU */
+	if (ctr->hw >= 0 && ctr->pinned_cpu < 0) {
+		user->index = ctr->hw + 1;
+		user->offset = ctr->count + ctr->left;
+	} else {
+		user->index = 0;
+		user->offset = ctr->count;
+	}
+	smp_wmb();
+	user->seq++;
+}
+
+/* Interrupts off.  The interrupt sees ctr once it is in perfctr_cpus. */
+static void perfctr_load(struct perfctr *ctr, int hw)
+{
+	ctr->hw = hw;
+	ctr->cpu = smp_processor_id();
+	pmu->start(hw, ctr->evntsel, ctr->left);
+	perfctr_user_update(ctr);
+	barrier();
+	__get_cpu_var(perfctr_cpus).hw[hw] = ctr;
+}
+
+static void perfctr_unload(struct perfctr *ctr)
+{
+	s64 value;
+
+	__get_cpu_var(perfctr_cpus).hw[ctr->hw] = NULL;
+	barrier();
+	pmu->stop(ctr->hw);
+
+	/* past the overflow, if its interrupt did not make it */
+	value = perfctr_hw_value(ctr->hw);
+	ctr->count += ctr->left + value;
+	ctr->left = value >= 0 ? ctr->period : -value;
+	ctr->hw = -1;
+	perfctr_user_update(ctr);
+}
+
+/* the count of a counter loaded on this CPU, interrupts off */
+static u64 perfctr_live_value(struct perfctr *ctr)
+{
+	u32 seq;
+	u64 value;
+
+	/* the overflow interrupt changes count and left */
+	do {
+		seq = ctr->user->seq;
+		barrier();
+		value = ctr->count + ctr->left + perfctr_hw_value(ctr->hw);
+		barrier();
+	} while (seq != ctr->user->seq);
+	return value;
+}
+
+static void perfctr_sample(struct perfctr *ctr, struct pt_regs *regs)
+{
+	struct perfctr_mmap *user = ctr->user;
+	unsigned int slot = user->data_head & (ctr->nr_samples - 1);
+	struct perfctr_sample *s;
+
+	s = page_address(ctr->pages[1 + slot / SAMPLES_PER_PAGE]);
+	s += slot % SAMPLES_PER_PAGE;
+	s->ip = instruction_pointer(regs);
+	s->pid = current->pid;
+	s->cpu = smp_processor_id();
+	smp_wmb();
+	user->data_head++;
+}
+
+/**
+ * perfctr_overflow - handle the overflow of counters
+ * @regs: where the interrupt hit
+ *
+ * Called by the CPU model code from its interrupt, with interrupts off.
+ */
+void perfctr_overflow(struct pt_regs *regs)
+{
+	struct perfctr_cpu *cpuc = &__get_cpu_var(perfctr_cpus);
+	int i;
+
+	for (i = 0; i < pmu->num_counters; i++) {
+		struct perfctr *ctr = cpuc->hw[i];
+		s64 value;
+
+		if (!ctr)
+			continue;
+		value = perfctr_hw_value(i);
+		if (value < 0)
+			continue;
+
+		ctr->count += ctr->left + value;
+		ctr->left = ctr->period;
+		pmu->start(i, ctr->evntsel, ctr->left);
+		if (ctr->overflow)
+			ctr->overflow(ctr, regs);
+		else if (ctr->nr_samples)
+			perfctr_sample(ctr, regs);
+		perfctr_user_update(ctr);
+	}
+}
+
+/* free hardware counter of this CPU, or -1 */
+static int perfctr_find_hw(struct perfctr_cpu *cpuc)
+{
+	int i;
+
+	for (i = 0; i < pmu->num_counters; i++)
+		if (!cpuc->hw[i])
+			return i;
+	return -1;
+}
+
+static void perfctr_sched_in(struct perfctr_context *ctx)
+{
+	struct perfctr_cpu *cpuc = &__get_cpu_var(perfctr_cpus);
+	struct perfctr *ctr;
+	int hw;
+
+	spin_lock(&ctx->lock);
+	list_for_each_entry(ctr, &ctx->counters, list) {
+		/* with too few counters, the rest waits for the next time */
+		hw = perfctr_find_hw(cpuc);
+		if (hw < 0)
+			break;
+		perfctr_load(ctr, hw);
+	}
+	spin_unlock(&ctx->lock);
+}
+
+/* take those of the thread leaving this CPU off it, interrupts off */
+static void perfctr_sched_out(void)
+{
+	struct perfctr_cpu *cpuc = &__get_cpu_var(perfctr_cpus);
+	int i;
+
+	for (i = 0; i < pmu->num_counters; i++) {
+		struct perfctr *ctr = cpuc->hw[i];
+
+		if (ctr && ctr->pinned_cpu < 0)
+			perfctr_unload(ctr);
+	}
+}
+
+void __perfctr_task_switch(struct task_struct *prev, struct task_struct *next)
+{
+	if (prev->perfctr)
+		perfctr_sched_out();
+	if (next->perfctr)
+		perfctr_sched_in(next->perfctr);
+}
+
+/* from do_exit(), the counters outlive the thread until closed */
+void perfctr_exit_task(struct task_struct *tsk)
+{
+	struct perfctr_context *ctx = tsk->perfctr;
+	struct perfctr *ctr, *next;
+
+	if (!ctx)
+		return;
+
+	spin_lock_irq(&perfctr_lock);
+	perfctr_sched_out();
+	spin_lock(&ctx->lock);
+	list_for_each_entry_safe(ctr, next, &ctx->counters, list) {
+		ctr->task = NULL;
+		list_del_init(&ctr->list);
+	}
+	spin_unlock(&ctx->lock);
+	tsk->perfctr = NULL;
+	spin_unlock_irq(&perfctr_lock);
+	kfree(ctx);
+}
+
+/* IPI: take @info off the CPU it is loaded on */
+static void perfctr_remove_cpu(void *info)
+{
+	struct perfctr *ctr = info;
+	unsigned long flags;
+	int hw;
+
+	local_irq_save(flags);
+	hw = ctr->hw;
+	if (hw >= 0 && __get_cpu_var(perfctr_cpus).hw[hw] == ctr)
+		perfctr_unload(ctr);
+	local_irq_restore(flags);
+}
+
+struct perfctr_install {
+	struct perfctr	*ctr;
+	int		ret;
+};
+
+/* IPI: load a CPU's counter, taking a counter from a thread if needed */
+static void perfctr_install_cpu(void *info)
+{
+	struct perfctr_install *install = info;
+	struct perfctr *ctr = install->ctr;
+	struct perfctr_cpu *cpuc;
+	unsigned long flags;
+	int hw;
+
+	if (smp_processor_id() != ctr->pinned_cpu)
+		return;
+
+	local_irq_save(flags);
+	cpuc = &__get_cpu_var(perfctr_cpus);
+	hw = perfctr_find_hw(cpuc);
+	if (hw < 0) {
+		for (hw = 0; hw < pmu->num_counters; hw++) {
+			if (cpuc->hw[hw]->pinned_cpu < 0) {
+				perfctr_unload(cpuc->hw[hw]);
+				break;
+			}
+		}
+	}
+	if (hw < pmu->num_counters) {
+		perfctr_load(ctr, hw);
+		install->ret = 0;
+	}
+	local_irq_restore(flags);
+}
+
+struct perfctr_read {
+	struct perfctr	*ctr;
+	u64		value;
+	int		found;
+};
+
+static void perfctr_read_cpu(void *info)
+{
+	struct perfctr_read *read = info;
+	struct perfctr *ctr = read->ctr;
+	unsigned long flags;
+	int hw;
+
+	local_irq_save(flags);
+	hw = ctr->hw;
+	if (hw >= 0 && __get_cpu_var(perfctr_cpus).hw[hw] == ctr) {
+		read->value = perfctr_live_value(ctr);
+		read->found = 1;
+	}
+	local_irq_restore(flags);
+}
+
+static u64 perfctr_read_value(struct perfctr *ctr)
+{
+	struct perfctr_read read = { .ctr = ctr };
+
+	if (ctr->task == current) {
+		/* it is loaded here, if at all */
+		local_irq_disable();
+		perfctr_read_cpu(&read);
+		if (!read.found)
+			read.value = ctr->count;
+		local_irq_enable();
+		return read.value;
+	}
+
+	on_each_cpu(perfctr_read_cpu, &read, 0, 1);
+	if (!read.found)
+		read.value = ctr->count;
+	return read.value;
+}
+
+static int perfctr_get_pmu(void)
+{
+	int ret = 0;
+
+	down(&perfctr_sem);
+	if (!perfctr_users)
+		ret = pmu->reserve();
+	if (!ret)
+		perfctr_users++;
+	up(&perfctr_sem);
+	return ret;
+}
+
+static void perfctr_put_pmu(void)
+{
+	down(&perfctr_sem);
+	if (!--perfctr_users)
+		pmu->release();
+	up(&perfctr_sem);
+}
+
+static void perfctr_free(struct perfctr *ctr)
+{
+	int i;
+
+	for (i = 0; i < ctr->nr_pages; i++)
+		if (ctr->pages[i])
+			__free_page(ctr->pages[i]);
+	kfree(ctr->pages);
+	kfree(ctr);
+}
+
+static struct perfctr *perfctr_alloc(struct perfctr_attr *attr)
+{
+	struct perfctr *ctr;
+	int i;
+
+	ctr = kmalloc(sizeof(*ctr), GFP_KERNEL);
+	if (!ctr)
+		return NULL;
+	memset(ctr, 0, sizeof(*ctr));
+	ctr->attr = *attr;
+	ctr->hw = -1;
+	ctr->pinned_cpu = -1;
+	INIT_LIST_HEAD(&ctr->list);
+	ctr->period = attr->sample_period ? attr->sample_period :
+					    PERFCTR_MAX_PERIOD;
+	ctr->left = ctr->period;
+
+	ctr->nr_pages = 1 + attr->sample_pages;
+	ctr->pages = kmalloc(ctr->nr_pages * sizeof(struct page *),
+			     GFP_KERNEL);
+	if (!ctr->pages) {
+		kfree(ctr);
+		return NULL;
+	}
+	memset(ctr->pages, 0, ctr->nr_pages * sizeof(struct page *));
+	for (i = 0; i < ctr->nr_pages; i++) {
+		ctr->pages[i] = alloc_page(GFP_KERNEL);
+		if (!ctr->pages[i]) {
+			perfctr_free(ctr);
+			return NULL;
+		}
+		clear_page(page_address(ctr->pages[i]));
+	}
+	ctr->nr_samples = attr->sample_pages * SAMPLES_PER_PAGE;
+
+	ctr->user = page_address(ctr->pages[0]);
+	ctr->user->width = pmu->width;
+	ctr->user->offset = 0;
+	return ctr;
+}
+
+static void perfctr_destroy(struct perfctr *ctr)
+{
+	if (ctr->pinned_cpu < 0) {
+		spin_lock_irq(&perfctr_lock);
+		if (ctr->task) {
+			struct perfctr_context *ctx = ctr->task->perfctr;
+
+			/* no more loading, then off the CPU it is on */
+			spin_lock(&ctx->lock);
+			list_del(&ctr->list);
+			spin_unlock(&ctx->lock);
+		}
+		spin_unlock_irq(&perfctr_lock);
+	}
+	on_each_cpu(perfctr_remove_cpu, ctr, 0, 1);
+
+	perfctr_put_pmu();
+	perfctr_free(ctr);
+}
+
+static int perfctr_release(struct inode *inode, struct file *file)
+{
+	perfctr_destroy(file->private_data);
+	return 0;
+}
+
+static ssize_t perfctr_read(struct file *file, char __user *buf, size_t count,
+			    loff_t *ppos)
+{
+	u64 value;
+
+	if (count < sizeof(value))
+		return -EINVAL;
+	value = perfctr_read_value(file->private_data);
+	if (copy_to_user(buf, &value, sizeof(value)))
+		return -EFAULT;
+	return sizeof(value);
+}
+
+static struct page *perfctr_vm_nopage(struct vm_area_struct *vma,
+				      unsigned long address, int *type)
+{
+	struct perfctr *ctr = vma->vm_file->private_data;
+	unsigned long pgoff = (address - vma->vm_start) >> PAGE_SHIFT;
+	struct page *page;
+
+	if (pgoff >= ctr->nr_pages)
+		return NOPAGE_SIGBUS;
+
+	page = ctr->pages[pgoff];
+	get_page(page);
+	if (type)
+		*type = VM_FAULT_MINOR;
+	return page;
+}
+
+static struct vm_operations_struct perfctr_vm_ops = {
+	.nopage	= perfctr_vm_nopage,
+};
+
+/* the mapping keeps the file, and so the counter, alive */
+static int perfctr_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct perfctr *ctr = file->private_data;
+
+	if (vma->vm_pgoff ||
+	    vma->vm_end - vma->vm_start > ctr->nr_pages << PAGE_SHIFT)
+		return -EINVAL;
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+
+	vma->vm_flags &= ~VM_MAYWRITE;
+	vma->vm_flags |= VM_RESERVED;
+	vma->vm_ops = &perfctr_vm_ops;
+	return 0;
+}
+
+static struct file_operations perfctr_fops = {
+	.release	= perfctr_release,
+	.read		= perfctr_read,
+	.mmap		= perfctr_mmap,
+};
+
+static int perfctr_check_attr(struct perfctr_attr *attr)
+{
+	if (attr->type >= PERFCTR_TYPE_MAX || attr->pad ||
+	    attr->flags & ~(PERFCTR_EXCLUDE_USER | PERFCTR_EXCLUDE_KERNEL))
+		return -EINVAL;
+	if (attr->type != PERFCTR_RAW && attr->config)
+		return -EINVAL;
+	if (attr->sample_period >= PERFCTR_MAX_PERIOD)
+		return -EINVAL;
+	if (attr->sample_pages & (attr->sample_pages - 1) ||
+	    attr->sample_pages > 64)
+		return -EINVAL;
+	return 0;
+}
+
+/* attach to the current thread, and start counting right away */
+static int perfctr_attach_current(struct perfctr *ctr)
+{
+	struct perfctr_context *ctx = current->perfctr;
+	int hw;
+
+	if (!ctx) {
+		ctx = kmalloc(sizeof(*ctx), GFP_KERNEL);
+		if (!ctx)
+			return -ENOMEM;
+		spin_lock_init(&ctx->lock);
+		INIT_LIST_HEAD(&ctx->counters);
+		/* only exit changes it, and that is not now */
+		current->perfctr = ctx;
+	}
+
+	ctr->task = current;
+	spin_lock_irq(&ctx->lock);
+	list_add_tail(&ctr->list, &ctx->counters);
+	hw = perfctr_find_hw(&__get_cpu_var(perfctr_cpus));
+	if (hw >= 0)
+		perfctr_load(ctr, hw);
+	spin_unlock_irq(&ctx->lock);
+	return 0;
+}
+
+static int perfctr_attach_cpu(struct perfctr *ctr, int cpu)
+{
+	struct perfctr_install install = { .ctr = ctr, .ret = -EBUSY };
+
+	ctr->pinned_cpu = cpu;
+	on_each_cpu(perfctr_install_cpu, &install, 0, 1);
+	return install.ret;
+}
+
+/* a counter of @cpu, or of the current thread with -1, counting */
+static struct perfctr *perfctr_create(struct perfctr_attr *attr, int cpu,
+		void (*overflow)(struct perfctr *, struct pt_regs *))
+{
+	struct perfctr *ctr;
+	u64 evntsel;
+	int ret;
+
+	ret = pmu->event(attr, &evntsel);
+	if (ret)
+		return ERR_PTR(ret);
+	ctr = perfctr_alloc(attr);
+	if (!ctr)
+		return ERR_PTR(-ENOMEM);
+	ctr->evntsel = evntsel;
+	ctr->overflow = overflow;
+
+	ret = perfctr_get_pmu();
+	if (ret)
+		goto out_free;
+	if (cpu >= 0)
+		ret = perfctr_attach_cpu(ctr, cpu);
+	else
+		ret = perfctr_attach_current(ctr);
+	if (ret) {
+		perfctr_put_pmu();
+		goto out_free;
+	}
+	return ctr;
+
+out_free:
+	perfctr_free(ctr);
+	return ERR_PTR(ret);
+}
+
+/**
+ * perfctr_create_kernel - count on a CPU for the kernel itself
+ * @attr: what to count, with a sample_period and no sample_pages
+ * @cpu: the CPU
+ * @overflow: called every sample_period events, from the NMI
+ *
+ * Returns the counter or an ERR_PTR().  Process context.
+ */
+struct perfctr *perfctr_create_kernel(struct perfctr_attr *attr, int cpu,
+		void (*overflow)(struct perfctr *ctr, struct pt_regs *regs))
+{
+	int ret;
+
+	if (!pmu)
+		return ERR_PTR(-ENODEV);
+	ret = perfctr_check_attr(attr);
+	if (ret)
+		return ERR_PTR(ret);
+	if (!attr->sample_period || attr->sample_pages ||
+	    cpu < 0 || cpu >= NR_CPUS || !cpu_online(cpu))
+		return ERR_PTR(-EINVAL);
+	return perfctr_create(attr, cpu, overflow);
+}
+EXPORT_SYMBOL_GPL(perfctr_create_kernel);
+
+/* stop it; @overflow is not running anymore, nor called, on return */
+void perfctr_release_kernel(struct perfctr *ctr)
+{
+	perfctr_destroy(ctr);
+}
+EXPORT_SYMBOL_GPL(perfctr_release_kernel);
+
+/**
+ * sys_perfctr_open - create a performance counter
+ * @uattr: what to count
+ * @pid: 0 for the calling thread, or -1 with @cpu
+ * @cpu: the CPU to count everything on, or -1 with @pid
+ *
+ * Returns a file descriptor.
+ */
+asmlinkage long sys_perfctr_open(struct perfctr_attr __user *uattr,
+				 pid_t pid, int cpu)
+{
+	struct perfctr_attr attr;
+	struct perfctr *ctr;
+	struct file *file;
+	int fd, ret;
+
+	if (!pmu)
+		return -ENODEV;
+	if (copy_from_user(&attr, uattr, sizeof(attr)))
+		return -EFAULT;
+	ret = perfctr_check_attr(&attr);
+	if (ret)
+		return ret;
+	/* samples need a period, and the other way round */
+	if (!attr.sample_period != !attr.sample_pages)
+		return -EINVAL;
+
+	if (pid == -1 && cpu >= 0) {
+		if (!capable(CAP_SYS_ADMIN))
+			return -EACCES;
+		if (cpu >= NR_CPUS || !cpu_online(cpu))
+			return -EINVAL;
+	} else if (pid || cpu != -1)
+		return -EINVAL;
+
+	fd = get_unused_fd();
+	if (fd < 0)
+		return fd;
+	ret = -ENFILE;
+	file = get_empty_filp();
+	if (!file)
+		goto out_put_fd;
+	ctr = perfctr_create(&attr, cpu, NULL);
+	if (IS_ERR(ctr)) {
+		ret = PTR_ERR(ctr);
+		goto out_put_filp;
+	}
+
+	file->f_op = &perfctr_fops;
+	file->f_vfsmnt = mntget(perfctr_mnt);
+	file->f_dentry = dget(perfctr_mnt->mnt_root);
+	file->f_mapping = file->f_dentry->d_inode->i_mapping;
+	file->f_mode = FMODE_READ;
+	file->f_flags = O_RDONLY;
+	file->private_data = ctr;
+	fd_install(fd, file);
+	return fd;
+
+out_put_filp:
+	put_filp(file);
+out_put_fd:
+	put_unused_fd(fd);
+	return ret;
+}
+
+static struct super_block *perfctr_get_sb(struct file_system_type *fs_type,
+		int flags, const char *dev_name, void *data)
+{
+	return get_sb_pseudo(fs_type, "perfctr:", NULL, 0x70657266);
+}
+
+static struct file_system_type perfctr_fs_type = {
+	.name		= "perfctrfs",
+	.get_sb		= perfctr_get_sb,
+	.kill_sb	= kill_anon_super,
+};
+
+static int __init perfctr_init(void)
+{
+	int ret;
+
+	ret = register_filesystem(&perfctr_fs_type);
+	if (ret)
+		return ret;
+	perfctr_mnt = kern_mount(&perfctr_fs_type);
+	if (IS_ERR(perfctr_mnt)) {
+		unregister_filesystem(&perfctr_fs_type);
+		return PTR_ERR(perfctr_mnt);
+	}
+	return 0;
+}
+
+__initcall(perfctr_init);
@@ -18,6 +18,10 @@
  * allocation scenario when all but one out of 1 million PIDs possible are
  * allocated already: the scanning of 32 list entries and at most PAGE_SIZE
  * bytes. The typical fastpath is a single successful setbit. Freeing is O(1).
+ *
+ * Next to each bitmap page is one of the PIDs which are thread group IDs
+ * in use, kept by attach_pid() and detach_pid().  It lets /proc list the
+ * processes in PID order by find_next_bit(), without the tasklist_lock.
  */
 
 #include <linux/mm.h>
@@ -51,14 +55,17 @@ int pid_max_max = PID_MAX_LIMIT;
  * first use and are never deallocated. This way a low pid_max
  * value does not cause lots of bitmaps to be allocated, but
  * the scheme scales to up to 4 million PIDs, runtime.
+ * The tgid page is allocated together with the page, so that
+ * it is there for any PID which was allocated.
  */
 typedef struct pidmap {
 	atomic_t nr_free;
 	void *page;
+	void *tgids;
 } pidmap_t;
 
 static pidmap_t pidmap_array[PIDMAP_ENTRIES] =
-	 { [ 0 ... PIDMAP_ENTRIES-1 ] = { ATOMIC_INIT(BITS_PER_PAGE), NULL } };
+	 { [ 0 ... PIDMAP_ENTRIES-1 ] = { ATOMIC_INIT(BITS_PER_PAGE), NULL, NULL } };
 
 static  __cacheline_aligned_in_smp DEFINE_SPINLOCK(pidmap_lock);
 
@@ -85,15 +92,19 @@ int alloc_pidmap(void)
 	for (i = 0; i <= max_scan; ++i) {
 		if (unlikely(!map->page)) {
 			unsigned long page = get_zeroed_page(GFP_KERNEL);
+			unsigned long tgids = get_zeroed_page(GFP_KERNEL);
 			/*
-			 * Free the page if someone raced with us
-			 * installing it:
+			 * Free the pages if someone raced with us
+			 * installing them:
 			 */
 			spin_lock(&pidmap_lock);
-			if (map->page)
+			if (map->page || !page || !tgids) {
 				free_page(page);
-			else
+				free_page(tgids);
+			} else {
+				map->tgids = (void *)tgids;
 				map->page = (void *)page;
+			}
 			spin_unlock(&pidmap_lock);
 			if (unlikely(!map->page))
 				break;
@@ -131,6 +142,43 @@ int alloc_pidmap(void)
 	return -1;
 }
 
+/*
+ * The lowest thread group ID from @nr on, or 0 if there is none.  It
+ * takes no locks, so the process may have gone or others have come by
+ * the time the caller looks, as with any walk of the task list which
+ * drops the lock in between.
+ */
+int next_tgid(int nr)
+{
+	pidmap_t *map, *end = &pidmap_array[PIDMAP_ENTRIES];
+	int offset;
+
+	if (nr < 1)
+		nr = 1;
+	if (nr >= PID_MAX_LIMIT)
+		return 0;
+	map = &pidmap_array[nr/BITS_PER_PAGE];
+	offset = nr & BITS_PER_PAGE_MASK;
+	for (; map < end; map++, offset = 0) {
+		if (!map->tgids)
+			continue;
+		offset = find_next_bit(map->tgids, BITS_PER_PAGE, offset);
+		if (offset < BITS_PER_PAGE)
+			return mk_pid(map, offset);
+	}
+	return 0;
+}
+
+static inline void set_tgid(int nr)
+{
+	set_bit(nr & BITS_PER_PAGE_MASK, pidmap_array[nr/BITS_PER_PAGE].tgids);
+}
+
+static inline void clear_tgid(int nr)
+{
+	clear_bit(nr & BITS_PER_PAGE_MASK, pidmap_array[nr/BITS_PER_PAGE].tgids);
+}
+
 struct pid * fastcall find_pid(enum pid_type type, int nr)
 {
 	struct hlist_node *elem;
@@ -154,6 +202,8 @@ int fastcall attach_pid(task_t *task, enum pid_type type, int nr)
 		hlist_add_head(&task_pid->pid_chain,
 				&pid_hash[type][pid_hashfn(nr)]);
 		INIT_LIST_HEAD(&task_pid->pid_list);
+		if (type == PIDTYPE_TGID)
+			set_tgid(nr);
 	} else {
 		INIT_HLIST_NODE(&task_pid->pid_chain);
 		list_add_tail(&task_pid->pid_list, &pid->pid_list);
@@ -197,6 +247,9 @@ void fastcall detach_pid(task_t *task, enum pid_type type)
 	if (!nr)
 		return;
 
+	if (type == PIDTYPE_TGID)
+		clear_tgid(nr);
+
 	for (tmp = PIDTYPE_MAX; --tmp >= 0; )
 		if (tmp != type && find_pid(tmp, nr))
 			return;
@@ -280,6 +333,7 @@ void __init pidmap_init(void)
 	int i;
 
 	pidmap_array->page = (void *)get_zeroed_page(GFP_KERNEL);
+	pidmap_array->tgids = (void *)get_zeroed_page(GFP_KERNEL);
 	set_bit(0, pidmap_array->page);
 	atomic_dec(&pidmap_array->nr_free);
 
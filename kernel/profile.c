@@ -561,3 +561,455 @@ static int __init create_proc_profile(void)
 }
 module_init(create_proc_profile);
 #endif /* CONFIG_PROC_FS */
+
+#ifdef CONFIG_PROFILE_CALLERS
+/*
+ * Call site profiling: the kernel functions hit by a sampling interrupt,
+ * each split by the call site it was called from, for profiles which
+ * can stay on in production and be aggregated into call graphs.  The
+ * samples come from a per-cpu hrtimer, which needs a clock event device
+ * to see the context it interrupted, or from a cycle counter NMI, which
+ * also sees into irq-disabled regions.
+ *
+ * Hits pend in the same kind of per-cpu pair of open-addressed
+ * hashtables as above, keyed by (pc, caller).  Once a second, and when
+ * /proc/profile_callers is opened, they are flipped and merged into one
+ * table keyed by (function, caller), resolving the pc to the start of
+ * its function with kallsyms.  A sample finding no free entry is only
+ * counted as lost: the NMI can take no lock to make room.
+ */
+#include <linux/proc_fs.h>
+#include <linux/hrtimer.h>
+#include <linux/perfctr.h>
+#include <linux/vmalloc.h>
+#include <linux/workqueue.h>
+#include <linux/kallsyms.h>
+#include <linux/hash.h>
+#include <linux/ctype.h>
+#include <asm/uaccess.h>
+#include <asm/ptrace.h>
+
+#ifndef ARCH_HAS_PROFILE_CALLER
+#define profile_caller(regs)	0UL
+#endif
+
+struct caller_hit {
+	unsigned long pc, caller, hits;
+};
+#define CALLER_GRP_BITS		6
+#define NR_CALLER_GRP		(1 << CALLER_GRP_BITS)
+#define NR_CALLER_HIT		(NR_CALLER_GRP*PROFILE_GRPSZ)
+#define CALLER_TABLE_BITS	15
+#define NR_CALLER_ENTRIES	(1 << CALLER_TABLE_BITS)
+
+static DEFINE_PER_CPU(struct caller_hit *[2], cpu_caller_hits);
+static DEFINE_PER_CPU(unsigned long [2], cpu_caller_lost);
+static DEFINE_PER_CPU(int, cpu_caller_flip);
+static DEFINE_PER_CPU(struct hrtimer, caller_timer);
+static DEFINE_PER_CPU(struct perfctr *, caller_perfctr);
+
+static struct profile_callers_entry *caller_table;
+static u64 caller_lost;
+static DECLARE_MUTEX(caller_table_sem);	/* caller_table, the flips */
+
+static int caller_source;		/* PROFILE_CALLERS_* */
+static u64 caller_period;		/* ns, or cycles of the NMI */
+static DECLARE_MUTEX(caller_source_sem);	/* starting and stopping */
+
+static void caller_flush_work(void *unused);
+static DECLARE_WORK(caller_work, caller_flush_work, NULL);
+
+/* From the sampling interrupt, with interrupts or NMIs off. */
+static void profile_caller_hit(struct pt_regs *regs)
+{
+	unsigned long grp, primary, secondary, pc, caller;
+	int i, j, cpu = smp_processor_id();
+	int flip = per_cpu(cpu_caller_flip, cpu);
+	struct caller_hit *hits = per_cpu(cpu_caller_hits, cpu)[flip];
+
+	if (user_mode(regs) || !cpu_isset(cpu, prof_cpu_mask))
+		return;
+	pc = profile_pc(regs);
+	caller = profile_caller(regs);
+
+	grp = hash_long(pc ^ caller, CALLER_GRP_BITS);
+	i = primary = grp << PROFILE_GRPSHIFT;
+	secondary = (~(grp << 1) & (NR_CALLER_GRP - 1)) << PROFILE_GRPSHIFT;
+	do {
+		for (j = 0; j < PROFILE_GRPSZ; ++j) {
+			struct caller_hit *hit = &hits[i + j];
+
+			if (!hit->hits) {
+				hit->pc = pc;
+				hit->caller = caller;
+				hit->hits = 1;
+				return;
+			}
+			if (hit->pc == pc && hit->caller == caller) {
+				hit->hits++;
+				return;
+			}
+		}
+		i = (i + secondary) & (NR_CALLER_HIT - 1);
+	} while (i != primary);
+	per_cpu(cpu_caller_lost, cpu)[flip]++;
+}
+
+/* caller_table_sem held */
+static void caller_table_add(unsigned long pc, unsigned long caller,
+			     unsigned long hits)
+{
+	char namebuf[KSYM_NAME_LEN + 1];
+	unsigned long size, offset, i, n;
+	char *modname;
+
+	if (kallsyms_lookup(pc, &size, &offset, &modname, namebuf))
+		pc -= offset;
+
+	i = hash_long(pc ^ caller, CALLER_TABLE_BITS);
+	for (n = 0; n < NR_CALLER_ENTRIES; n++) {
+		struct profile_callers_entry *e = &caller_table[i];
+
+		if (!e->hits) {
+			e->function = pc;
+			e->caller = caller;
+			e->hits = hits;
+			return;
+		}
+		if (e->function == pc && e->caller == caller) {
+			e->hits += hits;
+			return;
+		}
+		i = (i + 1) & (NR_CALLER_ENTRIES - 1);
+	}
+	caller_lost += hits;
+}
+
+static void __profile_callers_flip(void *unused)
+{
+	int cpu = smp_processor_id();
+
+	per_cpu(cpu_caller_flip, cpu) = !per_cpu(cpu_caller_flip, cpu);
+}
+
+/*
+ * Merge the pending hits of all cpus into caller_table.  Once the flip
+ * IPI returned, no interrupt is adding to the old halves any more: an
+ * NMI finishes before the cpu it hit goes on.
+ */
+static void profile_callers_flush(void)
+{
+	int i, cpu;
+
+	down(&caller_table_sem);
+	on_each_cpu(__profile_callers_flip, NULL, 0, 1);
+	for_each_cpu(cpu) {
+		int old = !per_cpu(cpu_caller_flip, cpu);
+		struct caller_hit *hits = per_cpu(cpu_caller_hits, cpu)[old];
+
+		for (i = 0; i < NR_CALLER_HIT; ++i) {
+			if (!hits[i].hits)
+				continue;
+			caller_table_add(hits[i].pc, hits[i].caller,
+					 hits[i].hits);
+			hits[i].pc = hits[i].caller = hits[i].hits = 0;
+		}
+		caller_lost += per_cpu(cpu_caller_lost, cpu)[old];
+		per_cpu(cpu_caller_lost, cpu)[old] = 0;
+	}
+	up(&caller_table_sem);
+}
+
+static void caller_flush_work(void *unused)
+{
+	profile_callers_flush();
+	if (caller_source != PROFILE_CALLERS_OFF)
+		schedule_delayed_work(&caller_work, HZ);
+}
+
+static int profile_callers_timer(void *data)
+{
+	struct hrtimer *timer = data;
+	struct pt_regs *regs = hrtimer_get_irq_regs();
+
+	/* from the softirq there is nothing to sample */
+	if (regs)
+		profile_caller_hit(regs);
+	else
+		__get_cpu_var(cpu_caller_lost)[__get_cpu_var(cpu_caller_flip)]++;
+	hrtimer_forward(timer, caller_period);
+	return HRTIMER_RESTART;
+}
+
+static void __profile_callers_start_timer(void *unused)
+{
+	struct hrtimer *timer = &__get_cpu_var(caller_timer);
+
+	/* starting it here puts it on this cpu */
+	hrtimer_start(timer, caller_period, HRTIMER_REL);
+}
+
+static void profile_callers_nmi(struct perfctr *ctr, struct pt_regs *regs)
+{
+	profile_caller_hit(regs);
+}
+
+/* the tables stay around once allocated */
+static int profile_callers_alloc(void)
+{
+	int cpu, i;
+
+	if (caller_table)
+		return 0;
+
+	for_each_cpu(cpu) {
+		for (i = 0; i < 2; i++) {
+			if (per_cpu(cpu_caller_hits, cpu)[i])
+				continue;
+			per_cpu(cpu_caller_hits, cpu)[i] =
+				kmalloc(NR_CALLER_HIT * sizeof(struct caller_hit),
+					GFP_KERNEL);
+			if (!per_cpu(cpu_caller_hits, cpu)[i])
+				return -ENOMEM;
+			memset(per_cpu(cpu_caller_hits, cpu)[i], 0,
+			       NR_CALLER_HIT * sizeof(struct caller_hit));
+		}
+		hrtimer_init(&per_cpu(caller_timer, cpu), CLOCK_MONOTONIC,
+			     HRTIMER_REL);
+		per_cpu(caller_timer, cpu).function = profile_callers_timer;
+		per_cpu(caller_timer, cpu).data = &per_cpu(caller_timer, cpu);
+	}
+
+	caller_table = vmalloc(NR_CALLER_ENTRIES *
+			       sizeof(struct profile_callers_entry));
+	if (!caller_table)
+		return -ENOMEM;
+	memset(caller_table, 0,
+	       NR_CALLER_ENTRIES * sizeof(struct profile_callers_entry));
+	return 0;
+}
+
+/* caller_source_sem held */
+static void profile_callers_stop(void)
+{
+	int source = caller_source, cpu;
+
+	if (source == PROFILE_CALLERS_OFF)
+		return;
+	caller_source = PROFILE_CALLERS_OFF;
+
+	for_each_cpu(cpu) {
+		if (source == PROFILE_CALLERS_HRTIMER)
+			hrtimer_cancel(&per_cpu(caller_timer, cpu));
+		if (per_cpu(caller_perfctr, cpu)) {
+			perfctr_release_kernel(per_cpu(caller_perfctr, cpu));
+			per_cpu(caller_perfctr, cpu) = NULL;
+		}
+	}
+	cancel_delayed_work(&caller_work);
+	flush_scheduled_work();
+	profile_callers_flush();
+}
+
+/* caller_source_sem held, the profiler off */
+static int profile_callers_start(int source, u64 period)
+{
+	struct perfctr_attr attr = {
+		.type		= PERFCTR_CYCLES,
+		.flags		= PERFCTR_EXCLUDE_USER,
+		.sample_period	= period,
+	};
+	struct perfctr *ctr;
+	int cpu, ret;
+
+	ret = profile_callers_alloc();
+	if (ret)
+		return ret;
+
+	caller_period = period;
+	if (source == PROFILE_CALLERS_HRTIMER) {
+		on_each_cpu(__profile_callers_start_timer, NULL, 0, 1);
+	} else {
+		for_each_online_cpu(cpu) {
+			ctr = perfctr_create_kernel(&attr, cpu,
+						    profile_callers_nmi);
+			if (IS_ERR(ctr)) {
+				/* releases those created so far */
+				caller_source = source;
+				profile_callers_stop();
+				return PTR_ERR(ctr);
+			}
+			per_cpu(caller_perfctr, cpu) = ctr;
+		}
+	}
+	caller_source = source;
+	schedule_delayed_work(&caller_work, HZ);
+	return 0;
+}
+
+struct caller_snapshot {
+	size_t				size;
+	struct profile_callers_header	header;
+	struct profile_callers_entry	entries[0];
+};
+
+/* a snapshot of the merged table, so that reads see a consistent one */
+static int profile_callers_open(struct inode *inode, struct file *file)
+{
+	struct caller_snapshot *snap;
+	unsigned long i, n = 0;
+
+	if (!caller_table)
+		return -ENODATA;
+	profile_callers_flush();
+
+	down(&caller_table_sem);
+	for (i = 0; i < NR_CALLER_ENTRIES; i++)
+		if (caller_table[i].hits)
+			n++;
+	snap = vmalloc(sizeof(*snap) + n * sizeof(snap->entries[0]));
+	if (!snap) {
+		up(&caller_table_sem);
+		return -ENOMEM;
+	}
+	snap->size = sizeof(snap->header) + n * sizeof(snap->entries[0]);
+	snap->header.magic = PROFILE_CALLERS_MAGIC;
+	snap->header.version = PROFILE_CALLERS_VERSION;
+	snap->header.source = caller_source;
+	snap->header.nr_entries = n;
+	snap->header.period = caller_period;
+	snap->header.lost = caller_lost;
+	for (i = 0, n = 0; i < NR_CALLER_ENTRIES; i++)
+		if (caller_table[i].hits)
+			snap->entries[n++] = caller_table[i];
+	up(&caller_table_sem);
+
+	file->private_data = snap;
+	return 0;
+}
+
+static ssize_t profile_callers_read(struct file *file, char __user *buf,
+				    size_t count, loff_t *ppos)
+{
+	struct caller_snapshot *snap = file->private_data;
+
+	return simple_read_from_buffer(buf, count, ppos, &snap->header,
+				       snap->size);
+}
+
+static int profile_callers_release(struct inode *inode, struct file *file)
+{
+	vfree(file->private_data);
+	return 0;
+}
+
+/* caller_source_sem held */
+static int profile_callers_command(char *cmd)
+{
+	unsigned long long arg;
+	char *end;
+
+	if (!strcmp(cmd, "off")) {
+		profile_callers_stop();
+		return 0;
+	}
+	if (!strcmp(cmd, "reset")) {
+		if (!caller_table)
+			return 0;
+		profile_callers_flush();
+		down(&caller_table_sem);
+		memset(caller_table, 0,
+		       NR_CALLER_ENTRIES * sizeof(struct profile_callers_entry));
+		caller_lost = 0;
+		up(&caller_table_sem);
+		return 0;
+	}
+
+	if (!strncmp(cmd, "hrtimer", 7) && isspace(cmd[7])) {
+		arg = simple_strtoull(cmd + 8, &end, 0);
+		if (*end || arg < 1 || arg > 100000)
+			return -EINVAL;
+		profile_callers_stop();
+		return profile_callers_start(PROFILE_CALLERS_HRTIMER,
+					     NSEC_PER_SEC / arg);
+	}
+	if (!strncmp(cmd, "nmi", 3) && isspace(cmd[3])) {
+		arg = simple_strtoull(cmd + 4, &end, 0);
+		if (*end || arg < 10000 || arg >= PERFCTR_MAX_PERIOD)
+			return -EINVAL;
+		profile_callers_stop();
+		return profile_callers_start(PROFILE_CALLERS_NMI, arg);
+	}
+	return -EINVAL;
+}
+
+/*
+ * "hrtimer <hz>", "nmi <cycles between samples>", "off", or "reset"
+ * for clearing the counts gathered so far.
+ */
+static ssize_t profile_callers_write(struct file *file, const char __user *buf,
+				     size_t count, loff_t *ppos)
+{
+	char cmd[32];
+	int ret;
+
+	if (!capable(CAP_SYS_ADMIN))
+		return -EPERM;
+	if (count >= sizeof(cmd))
+		return -EINVAL;
+	if (copy_from_user(cmd, buf, count))
+		return -EFAULT;
+	cmd[count] = 0;
+	if (count && cmd[count - 1] == '\n')
+		cmd[count - 1] = 0;
+
+	down(&caller_source_sem);
+	ret = profile_callers_command(cmd);
+	up(&caller_source_sem);
+	return ret ? ret : count;
+}
+
+static struct file_operations proc_profile_callers_operations = {
+	.open		= profile_callers_open,
+	.read		= profile_callers_read,
+	.write		= profile_callers_write,
+	.release	= profile_callers_release,
+};
+
+static char caller_boot_cmd[32] __initdata;
+
+/* profile_callers=hrtimer,<hz> or profile_callers=nmi,<cycles> */
+static int __init profile_callers_setup(char *str)
+{
+	char *comma;
+
+	strlcpy(caller_boot_cmd, str, sizeof(caller_boot_cmd));
+	comma = strchr(caller_boot_cmd, ',');
+	if (comma)
+		*comma = ' ';
+	return 1;
+}
+__setup("profile_callers=", profile_callers_setup);
+
+static int __init create_proc_profile_callers(void)
+{
+	struct proc_dir_entry *entry;
+	int ret;
+
+	entry = create_proc_entry("profile_callers", S_IWUSR | S_IRUSR, NULL);
+	if (!entry)
+		return -ENOMEM;
+	entry->proc_fops = &proc_profile_callers_operations;
+
+	if (caller_boot_cmd[0]) {
+		down(&caller_source_sem);
+		ret = profile_callers_command(caller_boot_cmd);
+		up(&caller_source_sem);
+		if (ret)
+			printk(KERN_WARNING "profile_callers=%s: error %d\n",
+			       caller_boot_cmd, ret);
+	}
+	return 0;
+}
+late_initcall(create_proc_profile_callers);
+#endif /* CONFIG_PROFILE_CALLERS */
@@ -46,6 +46,7 @@
 #include <linux/notifier.h>
 #include <linux/rcupdate.h>
 #include <linux/cpu.h>
+#include <linux/kthread.h>
 
 /* Definition for rcupdate control block. */
 struct rcu_ctrlblk rcu_ctrlblk = 
@@ -53,24 +54,135 @@ struct rcu_ctrlblk rcu_ctrlblk =
 struct rcu_ctrlblk rcu_bh_ctrlblk =
 	{ .cur = -300, .completed = -300 };
 
+/*
+ * The cpus which still have to pass a quiescent state are kept in a tree
+ * of rcu_nodes, RCU_FANOUT wide.  A cpu clears its bit in its leaf, and
+ * only the cpu which empties a node goes on to clear the node's bit in
+ * the parent, so each lock is shared by at most RCU_FANOUT reporters.
+ */
+#define RCU_FANOUT	16
+#define RCU_LEAVES	((NR_CPUS + RCU_FANOUT - 1) / RCU_FANOUT)
+#define RCU_MIDDLE	((RCU_LEAVES + RCU_FANOUT - 1) / RCU_FANOUT)
+
+#if RCU_LEAVES == 1
+#define RCU_LEVELS	1
+#define RCU_NODES	1
+static const int rcu_level_cnt[RCU_LEVELS] = { 1 };
+#elif RCU_MIDDLE == 1
+#define RCU_LEVELS	2
+#define RCU_NODES	(1 + RCU_LEAVES)
+static const int rcu_level_cnt[RCU_LEVELS] = { 1, RCU_LEAVES };
+#elif RCU_MIDDLE <= RCU_FANOUT
+#define RCU_LEVELS	3
+#define RCU_NODES	(1 + RCU_MIDDLE + RCU_LEAVES)
+static const int rcu_level_cnt[RCU_LEVELS] = { 1, RCU_MIDDLE, RCU_LEAVES };
+#else
+#error "NR_CPUS too large for the RCU tree"
+#endif
+
+struct rcu_node {
+	spinlock_t	lock;
+	long		batch;		/* Batch qsmask is for */
+	unsigned long	qsmask;		/* Children yet to report */
+	unsigned long	grpmask;	/* Our bit in parent->qsmask */
+	struct rcu_node	*parent;
+} ____cacheline_aligned_in_smp;
+
 /* Bookkeeping of the progress of the grace period */
 struct rcu_state {
 	spinlock_t	lock; /* Guard this struct and writes to rcu_ctrlblk */
-	cpumask_t	cpumask; /* CPUs that need to switch in order    */
-	                              /* for current batch to proceed.        */
+	struct rcu_node	node[RCU_NODES];	/* Root first, leaves last */
 };
 
 static struct rcu_state rcu_state ____cacheline_maxaligned_in_smp =
-	  {.lock = SPIN_LOCK_UNLOCKED, .cpumask = CPU_MASK_NONE };
+	  {.lock = SPIN_LOCK_UNLOCKED };
 static struct rcu_state rcu_bh_state ____cacheline_maxaligned_in_smp =
-	  {.lock = SPIN_LOCK_UNLOCKED, .cpumask = CPU_MASK_NONE };
+	  {.lock = SPIN_LOCK_UNLOCKED };
+
+static inline struct rcu_node *rcu_leaf(struct rcu_state *rsp, int cpu)
+{
+	return rsp->node + RCU_NODES - RCU_LEAVES + cpu / RCU_FANOUT;
+}
 
 DEFINE_PER_CPU(struct rcu_data, rcu_data) = { 0L };
 DEFINE_PER_CPU(struct rcu_data, rcu_bh_data) = { 0L };
 
 /* Fake initialization required by compiler */
 static DEFINE_PER_CPU(struct tasklet_struct, rcu_tasklet) = {NULL};
-static int maxbatch = 10;
+
+/*
+ * At most blimit callbacks are invoked in one go.  A cpu with more than
+ * qhimark callbacks queued lifts the limit until it is down to qlowmark,
+ * so that memory is not held up by a flood of call_rcu().
+ */
+static int blimit = 10;
+static int qhimark = 10000;
+static int qlowmark = 100;
+
+/*
+ * With offload set, callbacks are invoked from a thread per cpu, rcud/N,
+ * instead of from the rcu tasklet, so that long batches are preemptible
+ * between callbacks.
+ */
+static int offload;
+static int rcud_ready;
+static DEFINE_PER_CPU(struct task_struct *, rcud);
+
+#ifdef CONFIG_PREEMPT_RCU
+/*
+ * Preemptible readers are counted per cpu, in one of two counters.
+ * Each new grace period flips rcu_flipctr_idx, so the readers it has to
+ * wait for are those in the other counter.  A reader may be preempted
+ * and end up leaving on another cpu than it entered, so only the sum of
+ * a counter over all cpus means anything.
+ */
+static DEFINE_PER_CPU(int, rcu_flipctr[2]);
+static int rcu_flipctr_idx;
+
+void rcu_read_lock(void)
+{
+	struct task_struct *t = current;
+	unsigned long flags;
+
+	if (t->rcu_read_lock_nesting++ == 0) {
+		/* A cpu passes no quiescent state before the count is up */
+		local_irq_save(flags);
+		t->rcu_flipctr_idx = rcu_flipctr_idx;
+		__get_cpu_var(rcu_flipctr)[t->rcu_flipctr_idx]++;
+		local_irq_restore(flags);
+		smp_mb();
+	}
+}
+
+void rcu_read_unlock(void)
+{
+	struct task_struct *t = current;
+	unsigned long flags;
+
+	if (--t->rcu_read_lock_nesting == 0) {
+		smp_mb();
+		local_irq_save(flags);
+		__get_cpu_var(rcu_flipctr)[t->rcu_flipctr_idx]--;
+		local_irq_restore(flags);
+	}
+}
+
+/*
+ * Have the readers from before the current grace period finished?
+ * The counter only goes down meanwhile, so reading the cpus one after
+ * the other can only overestimate it.  Caller must hold rcu_state.lock.
+ */
+static int rcu_readers_done(void)
+{
+	int idx = !rcu_flipctr_idx;
+	int cpu, sum = 0;
+
+	smp_mb();
+	for_each_cpu(cpu)
+		sum += per_cpu(rcu_flipctr, cpu)[idx];
+	return !sum;
+}
+#endif /* CONFIG_PREEMPT_RCU */
 
 /**
  * call_rcu - Queue an RCU callback for invocation after a grace period.
@@ -95,6 +207,8 @@ void fastcall call_rcu(struct rcu_head *head,
 	rdp = &__get_cpu_var(rcu_data);
 	*rdp->nxttail = head;
 	rdp->nxttail = &head->next;
+	if (unlikely(++rdp->qlen > qhimark))
+		rdp->blimit = INT_MAX;
 	local_irq_restore(flags);
 }
 
@@ -126,14 +240,17 @@ void fastcall call_rcu_bh(struct rcu_head *head,
 	rdp = &__get_cpu_var(rcu_bh_data);
 	*rdp->nxttail = head;
 	rdp->nxttail = &head->next;
+	if (unlikely(++rdp->qlen > qhimark))
+		rdp->blimit = INT_MAX;
 	local_irq_restore(flags);
 }
 
 /*
  * Invoke the completed RCU callbacks. They are expected to be in
- * a per-cpu list.
+ * a per-cpu list.  Runs with softirqs disabled, either from the rcu
+ * tasklet or from rcud.
  */
-static void rcu_do_batch(struct rcu_data *rdp)
+static int rcu_do_batch(struct rcu_data *rdp)
 {
 	struct rcu_head *next, *list;
 	int count = 0;
@@ -143,12 +260,34 @@ static void rcu_do_batch(struct rcu_data *rdp)
 		next = rdp->donelist = list->next;
 		list->func(list);
 		list = next;
-		if (++count >= maxbatch)
+		if (++count >= rdp->blimit)
 			break;
 	}
-	if (!rdp->donelist)
+
+	local_irq_disable();
+	rdp->qlen -= count;
+	if (rdp->blimit == INT_MAX && rdp->qlen <= qlowmark)
+		rdp->blimit = blimit;
+	local_irq_enable();
+
+	if (!rdp->donelist) {
 		rdp->donetail = &rdp->donelist;
-	else
+		return 0;
+	}
+	return 1;
+}
+
+/*
+ * Hand the completed callbacks to rcud, if it runs, or invoke a batch
+ * of them and come back for the rest later.
+ */
+static void rcu_run_done(struct rcu_data *rdp)
+{
+	struct task_struct *tsk = per_cpu(rcud, rdp->cpu);
+
+	if (tsk)
+		wake_up_process(tsk);
+	else if (rcu_do_batch(rdp))
 		tasklet_schedule(&per_cpu(rcu_tasklet, rdp->cpu));
 }
 
@@ -159,17 +298,56 @@ static void rcu_do_batch(struct rcu_data *rdp)
  *   This is done by rcu_start_batch. The start is not broadcasted to
  *   all cpus, they must pick this up by comparing rcp->cur with
  *   rdp->quiescbatch. All cpus are recorded  in the
- *   rcu_state.cpumask bitmap.
+ *   leaves of the rcu_state tree.
  * - All cpus must go through a quiescent state.
  *   Since the start of the grace period is not broadcasted, at least two
  *   calls to rcu_check_quiescent_state are required:
  *   The first call just notices that a new grace period is running. The
  *   following calls check if there was a quiescent state since the beginning
- *   of the grace period. If so, it updates rcu_state.cpumask. If
- *   the bitmap is empty, then the grace period is completed.
+ *   of the grace period. If so, it clears the cpu in its leaf. If
+ *   that empties the whole tree, then the grace period is completed.
  *   rcu_check_quiescent_state calls rcu_start_batch(0) to start the next grace
  *   period (if necessary).
  */
+/*
+ * Fill the tree for a new batch, from the leaves up: a node waits for
+ * those of its children which have cpus to wait for.  Cpus still
+ * reporting for an old batch see the new batch number and back off.
+ * Caller must hold rcu_state.lock.
+ */
+static void rcu_start_qsmask(struct rcu_state *rsp, long batch)
+{
+	struct rcu_node *rnp;
+	cpumask_t cpus;
+	int cpu, i;
+
+	cpus_andnot(cpus, cpu_online_map, nohz_cpu_mask);
+	for (i = RCU_NODES - 1; i >= 0; i--) {
+		rnp = rsp->node + i;
+		spin_lock(&rnp->lock);
+		if (rnp->batch != batch) {
+			rnp->batch = batch;
+			rnp->qsmask = 0;
+		}
+		if (i >= RCU_NODES - RCU_LEAVES) {
+			cpu = (i - (RCU_NODES - RCU_LEAVES)) * RCU_FANOUT;
+			for (; cpu < NR_CPUS && rcu_leaf(rsp, cpu) == rnp; cpu++)
+				if (cpu_isset(cpu, cpus))
+					rnp->qsmask |= 1UL << (cpu % RCU_FANOUT);
+		}
+		if (rnp->qsmask && rnp->parent) {
+			spin_lock(&rnp->parent->lock);
+			if (rnp->parent->batch != batch) {
+				rnp->parent->batch = batch;
+				rnp->parent->qsmask = 0;
+			}
+			rnp->parent->qsmask |= rnp->grpmask;
+			spin_unlock(&rnp->parent->lock);
+		}
+		spin_unlock(&rnp->lock);
+	}
+}
+
 /*
  * Register a new batch of callbacks, and start it up if there is currently no
  * active batch and the batch to be registered has not already occurred.
@@ -184,7 +362,11 @@ static void rcu_start_batch(struct rcu_ctrlblk *rcp, struct rcu_state *rsp,
 	if (rcp->next_pending &&
 			rcp->completed == rcp->cur) {
 		/* Can't change, since spin lock held. */
-		cpus_andnot(rsp->cpumask, cpu_online_map, nohz_cpu_mask);
+		rcu_start_qsmask(rsp, rcp->cur + 1);
+#ifdef CONFIG_PREEMPT_RCU
+		if (rcp == &rcu_ctrlblk)
+			rcu_flipctr_idx = !rcu_flipctr_idx;
+#endif
 
 		rcp->next_pending = 0;
 		/* next_pending == 0 must be visible in __rcu_process_callbacks()
@@ -196,18 +378,63 @@ static void rcu_start_batch(struct rcu_ctrlblk *rcp, struct rcu_state *rsp,
 }
 
 /*
- * cpu went through a quiescent state since the beginning of the grace period.
- * Clear it from the cpu mask and complete the grace period if it was the last
- * cpu. Start another grace period if someone has further entries pending
+ * All cpus went through a quiescent state: complete the grace period.
+ * Start another grace period if someone has further entries pending.
+ * Caller must hold rcu_state.lock.
+ */
+static void rcu_batch_done(struct rcu_ctrlblk *rcp, struct rcu_state *rsp)
+{
+#ifdef CONFIG_PREEMPT_RCU
+	/* Readers preempted from before the batch still running? */
+	if (rcp == &rcu_ctrlblk && !rcu_readers_done()) {
+		rcp->wait_readers = 1;
+		return;
+	}
+	rcp->wait_readers = 0;
+#endif
+	/* batch completed ! */
+	rcp->completed = rcp->cur;
+	rcu_start_batch(rcp, rsp, 0);
+}
+
+/*
+ * cpu went through a quiescent state since the beginning of the grace period
+ * of batch.  Clear it from its leaf, and the emptied nodes from their parents,
+ * and complete the grace period if the root is empty.
  */
-static void cpu_quiet(int cpu, struct rcu_ctrlblk *rcp, struct rcu_state *rsp)
+static void cpu_quiet(int cpu, long batch, struct rcu_ctrlblk *rcp,
+			struct rcu_state *rsp)
 {
-	cpu_clear(cpu, rsp->cpumask);
-	if (cpus_empty(rsp->cpumask)) {
-		/* batch completed ! */
-		rcp->completed = rcp->cur;
-		rcu_start_batch(rcp, rsp, 0);
+	struct rcu_node *rnp = rcu_leaf(rsp, cpu);
+	unsigned long mask = 1UL << (cpu % RCU_FANOUT);
+
+	for (;;) {
+		spin_lock(&rnp->lock);
+		/*
+		 * rdp->quiescbatch/rcp->cur and the tree can come out of
+		 * sync during cpu startup. Ignore the quiescent state.
+		 */
+		if (rnp->batch != batch || !(rnp->qsmask & mask)) {
+			spin_unlock(&rnp->lock);
+			return;
+		}
+		rnp->qsmask &= ~mask;
+		if (rnp->qsmask) {
+			spin_unlock(&rnp->lock);
+			return;
+		}
+		mask = rnp->grpmask;
+		spin_unlock(&rnp->lock);
+		if (!rnp->parent)
+			break;
+		rnp = rnp->parent;
 	}
+
+	/* Only the cpu emptying the root gets here */
+	spin_lock(&rsp->lock);
+	if (rcp->cur == batch && rcp->completed != batch)
+		rcu_batch_done(rcp, rsp);
+	spin_unlock(&rsp->lock);
 }
 
 /*
@@ -241,15 +468,7 @@ static void rcu_check_quiescent_state(struct rcu_ctrlblk *rcp,
 		return;
 	rdp->qs_pending = 0;
 
-	spin_lock(&rsp->lock);
-	/*
-	 * rdp->quiescbatch/rcp->cur and the cpu bitmap can come out of sync
-	 * during cpu startup. Ignore the quiescent state.
-	 */
-	if (likely(rdp->quiescbatch == rcp->cur))
-		cpu_quiet(rdp->cpu, rcp, rsp);
-
-	spin_unlock(&rsp->lock);
+	cpu_quiet(rdp->cpu, rdp->quiescbatch, rcp, rsp);
 }
 
 
@@ -276,13 +495,25 @@ static void __rcu_offline_cpu(struct rcu_data *this_rdp,
 	 * we can block indefinitely waiting for it, so flush
 	 * it here
 	 */
+	long batch;
+	int busy;
+
 	spin_lock_bh(&rsp->lock);
-	if (rcp->cur != rcp->completed)
-		cpu_quiet(rdp->cpu, rcp, rsp);
+	batch = rcp->cur;
+	busy = rcp->cur != rcp->completed;
 	spin_unlock_bh(&rsp->lock);
+	if (busy) {
+		local_bh_disable();
+		cpu_quiet(rdp->cpu, batch, rcp, rsp);
+		local_bh_enable();
+	}
+	rcu_move_batch(this_rdp, rdp->donelist, rdp->donetail);
 	rcu_move_batch(this_rdp, rdp->curlist, rdp->curtail);
 	rcu_move_batch(this_rdp, rdp->nxtlist, rdp->nxttail);
 
+	local_irq_disable();
+	this_rdp->qlen += rdp->qlen;
+	local_irq_enable();
 }
 static void rcu_offline_cpu(int cpu)
 {
@@ -298,12 +529,6 @@ static void rcu_offline_cpu(int cpu)
 	tasklet_kill_immediate(&per_cpu(rcu_tasklet, cpu), cpu);
 }
 
-#else
-
-static void rcu_offline_cpu(int cpu)
-{
-}
-
 #endif
 
 /*
@@ -312,6 +537,14 @@ static void rcu_offline_cpu(int cpu)
 static void __rcu_process_callbacks(struct rcu_ctrlblk *rcp,
 			struct rcu_state *rsp, struct rcu_data *rdp)
 {
+#ifdef CONFIG_PREEMPT_RCU
+	if (unlikely(rcp->wait_readers)) {
+		spin_lock(&rsp->lock);
+		if (rcp->wait_readers)
+			rcu_batch_done(rcp, rsp);
+		spin_unlock(&rsp->lock);
+	}
+#endif
 	if (rdp->curlist && !rcu_batch_before(rcp->completed, rdp->batch)) {
 		*rdp->donetail = rdp->curlist;
 		rdp->donetail = rdp->curtail;
@@ -349,7 +582,7 @@ static void __rcu_process_callbacks(struct rcu_ctrlblk *rcp,
 	}
 	rcu_check_quiescent_state(rcp, rsp, rdp);
 	if (rdp->donelist)
-		rcu_do_batch(rdp);
+		rcu_run_done(rdp);
 }
 
 static void rcu_process_callbacks(unsigned long unused)
@@ -381,9 +614,68 @@ static void rcu_init_percpu_data(int cpu, struct rcu_ctrlblk *rcp,
 	rdp->donetail = &rdp->donelist;
 	rdp->quiescbatch = rcp->completed;
 	rdp->qs_pending = 0;
+	rdp->blimit = blimit;
 	rdp->cpu = cpu;
 }
 
+static int rcud_pending(int cpu)
+{
+	return per_cpu(rcu_data, cpu).donelist ||
+		per_cpu(rcu_bh_data, cpu).donelist;
+}
+
+static int rcud_thread(void *__bind_cpu)
+{
+	long cpu = (long)__bind_cpu;
+	int more;
+
+	current->flags |= PF_NOFREEZE;
+
+	set_current_state(TASK_INTERRUPTIBLE);
+	while (!kthread_should_stop()) {
+		if (!rcud_pending(cpu))
+			schedule();
+		__set_current_state(TASK_RUNNING);
+
+		/* Excludes the tasklet, which feeds the lists */
+		local_bh_disable();
+		more = rcu_do_batch(&per_cpu(rcu_data, cpu)) |
+			rcu_do_batch(&per_cpu(rcu_bh_data, cpu));
+		local_bh_enable();
+
+		if (more)
+			cond_resched();
+		set_current_state(TASK_INTERRUPTIBLE);
+	}
+	__set_current_state(TASK_RUNNING);
+	return 0;
+}
+
+static int rcud_create(long cpu)
+{
+	struct task_struct *p;
+
+	if (!offload || !rcud_ready)
+		return 0;
+	p = kthread_create(rcud_thread, (void *)cpu, "rcud/%ld", cpu);
+	if (IS_ERR(p))
+		return PTR_ERR(p);
+	kthread_bind(p, cpu);
+	per_cpu(rcud, cpu) = p;
+	return 0;
+}
+
+#ifdef CONFIG_HOTPLUG_CPU
+static void rcud_stop(long cpu)
+{
+	struct task_struct *p = per_cpu(rcud, cpu);
+
+	per_cpu(rcud, cpu) = NULL;
+	if (p)
+		kthread_stop(p);
+}
+#endif
+
 static void __devinit rcu_online_cpu(int cpu)
 {
 	struct rcu_data *rdp = &per_cpu(rcu_data, cpu);
@@ -401,10 +693,25 @@ static int __devinit rcu_cpu_notify(struct notifier_block *self,
 	switch (action) {
 	case CPU_UP_PREPARE:
 		rcu_online_cpu(cpu);
+		if (rcud_create(cpu)) {
+			printk("rcud for %ld failed\n", cpu);
+			return NOTIFY_BAD;
+		}
+		break;
+	case CPU_ONLINE:
+		if (per_cpu(rcud, cpu))
+			wake_up_process(per_cpu(rcud, cpu));
 		break;
+#ifdef CONFIG_HOTPLUG_CPU
+	case CPU_UP_CANCELED:
+		/* Unbind so it can run.  Fall thru. */
+		if (per_cpu(rcud, cpu))
+			kthread_bind(per_cpu(rcud, cpu), smp_processor_id());
 	case CPU_DEAD:
+		rcud_stop(cpu);
 		rcu_offline_cpu(cpu);
 		break;
+#endif
 	default:
 		break;
 	}
@@ -421,14 +728,62 @@ static struct notifier_block __devinitdata rcu_nb = {
  * Note that rcu_qsctr and friends are implicitly
  * initialized due to the choice of ``0'' for RCU_CTR_INVALID.
  */
+static void __init rcu_init_state(struct rcu_state *rsp)
+{
+	struct rcu_node *level = rsp->node, *up = NULL, *rnp;
+	int i, j;
+
+	for (i = 0; i < RCU_LEVELS; i++) {
+		for (j = 0; j < rcu_level_cnt[i]; j++) {
+			rnp = level + j;
+			spin_lock_init(&rnp->lock);
+			rnp->batch = 0;
+			rnp->qsmask = 0;
+			if (up) {
+				rnp->parent = up + j / RCU_FANOUT;
+				rnp->grpmask = 1UL << (j % RCU_FANOUT);
+			} else {
+				rnp->parent = NULL;
+				rnp->grpmask = 0;
+			}
+		}
+		up = level;
+		level += rcu_level_cnt[i];
+	}
+}
+
 void __init rcu_init(void)
 {
+	rcu_init_state(&rcu_state);
+	rcu_init_state(&rcu_bh_state);
 	rcu_cpu_notify(&rcu_nb, CPU_UP_PREPARE,
 			(void *)(long)smp_processor_id());
 	/* Register notifier for non-boot CPUs */
 	register_cpu_notifier(&rcu_nb);
 }
 
+/*
+ * Start rcud on the cpus which came up before threads could be created.
+ */
+static int __init rcud_init(void)
+{
+	long cpu;
+
+	if (!offload)
+		return 0;
+	lock_cpu_hotplug();
+	rcud_ready = 1;
+	for_each_online_cpu(cpu) {
+		if (rcud_create(cpu))
+			printk("rcud for %ld failed\n", cpu);
+		else
+			wake_up_process(per_cpu(rcud, cpu));
+	}
+	unlock_cpu_hotplug();
+	return 0;
+}
+__initcall(rcud_init);
+
 struct rcu_synchronize {
 	struct rcu_head head;
 	struct completion completion;
@@ -464,7 +819,74 @@ void synchronize_kernel(void)
 	wait_for_completion(&rcu.completion);
 }
 
-module_param(maxbatch, int, 0);
+static DEFINE_PER_CPU(struct rcu_head, rcu_barrier_head);
+static atomic_t rcu_barrier_cpu_count;
+static DECLARE_MUTEX(rcu_barrier_sema);
+static struct completion rcu_barrier_completion;
+
+static void rcu_barrier_callback(struct rcu_head *notused)
+{
+	if (atomic_dec_and_test(&rcu_barrier_cpu_count))
+		complete(&rcu_barrier_completion);
+}
+
+/*
+ * Called with preemption disabled, and from cross-cpu IRQ context.
+ */
+static void rcu_barrier_func(void *bh)
+{
+	int cpu = smp_processor_id();
+	struct rcu_head *head = &per_cpu(rcu_barrier_head, cpu);
+
+	atomic_inc(&rcu_barrier_cpu_count);
+	if (bh)
+		call_rcu_bh(head, rcu_barrier_callback);
+	else
+		call_rcu(head, rcu_barrier_callback);
+}
+
+static void __rcu_barrier(void *bh)
+{
+	BUG_ON(in_interrupt());
+	/* Take rcu_barrier_sema, serializes concurrent rcu_barrier() calls */
+	down(&rcu_barrier_sema);
+	init_completion(&rcu_barrier_completion);
+	atomic_set(&rcu_barrier_cpu_count, 0);
+	on_each_cpu(rcu_barrier_func, bh, 0, 1);
+	wait_for_completion(&rcu_barrier_completion);
+	up(&rcu_barrier_sema);
+}
+
+/**
+ * rcu_barrier - Wait until all the in-flight RCUs are complete.
+ *
+ * Unlike synchronize_kernel(), this waits for the callbacks already
+ * queued by call_rcu() to have run, on every cpu, which is what a
+ * module has to do before the memory or code they use goes away.
+ */
+void rcu_barrier(void)
+{
+	__rcu_barrier(NULL);
+}
+
+/**
+ * rcu_barrier_bh - Wait until all the in-flight call_rcu_bh() RCUs are complete.
+ */
+void rcu_barrier_bh(void)
+{
+	__rcu_barrier((void *)1);
+}
+
+module_param(blimit, int, 0);
+module_param(qhimark, int, 0);
+module_param(qlowmark, int, 0);
+module_param(offload, bool, 0);
+#ifdef CONFIG_PREEMPT_RCU
+EXPORT_SYMBOL(rcu_read_lock);
+EXPORT_SYMBOL(rcu_read_unlock);
+#endif
 EXPORT_SYMBOL_GPL(call_rcu);
 EXPORT_SYMBOL_GPL(call_rcu_bh);
 EXPORT_SYMBOL_GPL(synchronize_kernel);
+EXPORT_SYMBOL_GPL(rcu_barrier);
+EXPORT_SYMBOL_GPL(rcu_barrier_bh);
@@ -43,14 +43,20 @@
 #include <linux/cpuset.h>
 #include <linux/percpu.h>
 #include <linux/kthread.h>
+#include <linux/workqueue.h>
 #include <linux/seq_file.h>
 #include <linux/syscalls.h>
 #include <linux/times.h>
+#include <trace/sched.h>
+#include <linux/perfctr.h>
 #include <linux/acct.h>
 #include <asm/tlb.h>
 
 #include <asm/unistd.h>
 
+DEFINE_TRACE(sched_wakeup);
+DEFINE_TRACE(sched_switch);
+
 /*
  * Convert user-nice values [ -20 ... 0 ... 19 ]
  * to static priority [ MAX_RT_PRIO..MAX_PRIO-1 ],
@@ -154,6 +160,54 @@
 #define TASK_PREEMPTS_CURR(p, rq) \
 	((p)->prio < (rq)->curr->prio)
 
+/*
+ * A waking SCHED_BATCH task leaves the running task alone (unless that
+ * is the idle task) and waits for the next reschedule.
+ */
+#define TASK_WAKEUP_PREEMPTS(p, rq) \
+	(TASK_PREEMPTS_CURR(p, rq) && \
+		(!batch_task(p) || (rq)->curr == (rq)->idle))
+
+#ifdef CONFIG_FAIR_USER_SCHED
+/*
+ * Fair share between users: a user's CPU time in one round of execution
+ * is shared out between that user's runnable tasks, so a user with many
+ * runnable tasks gets about the same CPU time as a user with one.  The
+ * share is the number of runnable tasks the user has per online CPU.
+ * Root is exempt, kernel threads and system daemons must not be
+ * throttled against each other.
+ */
+static inline unsigned int user_share(task_t *p)
+{
+	unsigned int cpus = num_online_cpus(), nr;
+
+	if (p->user == &root_user)
+		return 1;
+	nr = atomic_read(&p->user->nr_running);
+	return nr > cpus ? (nr + cpus - 1) / cpus : 1;
+}
+
+/*
+ * Tasks of a user whose share is split 2^n ways get a penalty of n
+ * dynamic priority levels, at most MAX_BONUS/2, so tasks of a lightly
+ * loaded user preempt them.
+ */
+static inline int user_penalty(task_t *p)
+{
+	int penalty = fls(user_share(p)) - 1;
+
+	return min(penalty, MAX_BONUS / 2);
+}
+
+#define inc_user_running(p)	atomic_inc(&(p)->user->nr_running)
+#define dec_user_running(p)	atomic_dec(&(p)->user->nr_running)
+#else
+#define user_share(p)		1
+#define user_penalty(p)		0
+#define inc_user_running(p)	do { } while (0)
+#define dec_user_running(p)	do { } while (0)
+#endif
+
 /*
  * task_timeslice() scales user-nice values [ -20 ... 0 ... 19 ]
  * to time slice values: [800ms ... 100ms ... 5ms]
@@ -161,6 +215,13 @@
  * The higher a thread's priority, the bigger timeslices
  * it gets during one round of execution. But even the lowest
  * priority thread gets MIN_TIMESLICE worth of execution time.
+ *
+ * SCHED_BATCH tasks are scaled like negative nice levels at every
+ * nice level, [800ms ... 400ms ... 20ms], to stay cache hot longer.
+ *
+ * With CONFIG_FAIR_USER_SCHED the timeslice of a SCHED_NORMAL or
+ * SCHED_BATCH task is further divided by its user's share, down to
+ * MIN_TIMESLICE.
  */
 
 #define SCALE_PRIO(x, prio) \
@@ -168,10 +229,17 @@
 
 static inline unsigned int task_timeslice(task_t *p)
 {
-	if (p->static_prio < NICE_TO_PRIO(0))
-		return SCALE_PRIO(DEF_TIMESLICE*4, p->static_prio);
+	unsigned int slice;
+
+	if (p->static_prio < NICE_TO_PRIO(0) || batch_task(p))
+		slice = SCALE_PRIO(DEF_TIMESLICE*4, p->static_prio);
 	else
-		return SCALE_PRIO(DEF_TIMESLICE, p->static_prio);
+		slice = SCALE_PRIO(DEF_TIMESLICE, p->static_prio);
+
+	if (rt_task(p))
+		return slice;
+	slice /= user_share(p);
+	return slice > MIN_TIMESLICE ? slice : MIN_TIMESLICE;
 }
 #define task_hot(p, now, sd) ((long long) ((now) - (p)->last_ran)	\
 				< (long long) (sd)->cache_hot_time)
@@ -255,6 +323,9 @@ struct runqueue {
 	/* try_to_wake_up() stats */
 	unsigned long ttwu_cnt;
 	unsigned long ttwu_local;
+
+	/* log2 histogram of run delays, in nanoseconds */
+	unsigned long run_delay_hist[SCHEDSTAT_HIST_SIZE];
 #endif
 };
 
@@ -309,7 +380,18 @@ static inline void task_rq_unlock(runqueue_t *rq, unsigned long *flags)
  * bump this up when changing the output format or the meaning of an existing
  * format, so that tools can adapt (or abort)
  */
-#define SCHEDSTAT_VERSION 11
+#define SCHEDSTAT_VERSION 12
+
+static void show_schedstat_hist(struct seq_file *seq, const char *name,
+				unsigned long *hist)
+{
+	int i;
+
+	seq_printf(seq, "%s", name);
+	for (i = 0; i < SCHEDSTAT_HIST_SIZE; i++)
+		seq_printf(seq, " %lu", hist[i]);
+	seq_printf(seq, "\n");
+}
 
 static int show_schedstat(struct seq_file *seq, void *v)
 {
@@ -335,6 +417,7 @@ static int show_schedstat(struct seq_file *seq, void *v)
 		    rq->rq_sched_info.run_delay, rq->rq_sched_info.pcnt);
 
 		seq_printf(seq, "\n");
+		show_schedstat_hist(seq, "rundelay", rq->run_delay_hist);
 
 #ifdef CONFIG_SMP
 		/* domain-specific stats */
@@ -360,6 +443,7 @@ static int show_schedstat(struct seq_file *seq, void *v)
 			    sd->alb_cnt, sd->alb_failed, sd->alb_pushed,
 			    sd->sbe_pushed, sd->sbe_attempts,
 			    sd->ttwu_wake_remote, sd->ttwu_move_affine, sd->ttwu_move_balance);
+			show_schedstat_hist(seq, "lbcost", sd->lb_cost_hist);
 		}
 #endif
 	}
@@ -392,11 +476,27 @@ struct file_operations proc_schedstat_operations = {
 	.release = single_release,
 };
 
+/*
+ * Histogram bucket of val: bucket 0 counts zeroes, bucket i the values
+ * from 2^(i-1) to 2^i - 1, and the last bucket everything larger.
+ */
+static inline int schedstat_bucket(unsigned long long val)
+{
+	if ((long long) val <= 0)
+		return 0;
+	if (val >> 32)
+		return SCHEDSTAT_HIST_SIZE - 1;
+	return min(fls((u32) val), SCHEDSTAT_HIST_SIZE - 1);
+}
+
 # define schedstat_inc(rq, field)	do { (rq)->field++; } while (0)
 # define schedstat_add(rq, field, amt)	do { (rq)->field += (amt); } while (0)
+# define schedstat_hist(rq, field, val)	\
+	do { (rq)->field[schedstat_bucket(val)]++; } while (0)
 #else /* !CONFIG_SCHEDSTATS */
 # define schedstat_inc(rq, field)	do { } while (0)
 # define schedstat_add(rq, field, amt)	do { } while (0)
+# define schedstat_hist(rq, field, val)	do { } while (0)
 #endif
 
 /*
@@ -430,6 +530,30 @@ static int cpu_and_siblings_are_idle(int cpu)
 #define cpu_and_siblings_are_idle(A) idle_cpu(A)
 #endif
 
+#if defined(CONFIG_SMP) && defined(CONFIG_SCHEDSTATS)
+/*
+ * Time a load balancing pass over sd, in cycles.
+ */
+static inline cycles_t balance_start(void)
+{
+	return get_cycles();
+}
+
+static inline void balance_end(struct sched_domain *sd, cycles_t start)
+{
+	schedstat_hist(sd, lb_cost_hist, get_cycles() - start);
+}
+#else
+static inline cycles_t balance_start(void)
+{
+	return 0;
+}
+
+static inline void balance_end(struct sched_domain *sd, cycles_t start)
+{
+}
+#endif
+
 #ifdef CONFIG_SCHEDSTATS
 /*
  * Called when a process is dequeued from the active array and given
@@ -586,6 +710,8 @@ static inline void enqueue_task_head(struct task_struct *p, prio_array_t *array)
  * 2) nice -20 CPU hogs do not get preempted by nice 0 tasks.
  *
  * Both properties are important to certain workloads.
+ *
+ * With CONFIG_FAIR_USER_SCHED the user's penalty is added on top.
  */
 static int effective_prio(task_t *p)
 {
@@ -596,7 +722,7 @@ static int effective_prio(task_t *p)
 
 	bonus = CURRENT_BONUS(p) - MAX_BONUS / 2;
 
-	prio = p->static_prio - bonus;
+	prio = p->static_prio - bonus + user_penalty(p);
 	if (prio < MAX_RT_PRIO)
 		prio = MAX_RT_PRIO;
 	if (prio > MAX_PRIO-1)
@@ -611,6 +737,7 @@ static inline void __activate_task(task_t *p, runqueue_t *rq)
 {
 	enqueue_task(p, rq->active);
 	rq->nr_running++;
+	inc_user_running(p);
 }
 
 /*
@@ -620,6 +747,7 @@ static inline void __activate_idle_task(task_t *p, runqueue_t *rq)
 {
 	enqueue_task_head(p, rq->active);
 	rq->nr_running++;
+	inc_user_running(p);
 }
 
 static void recalc_task_prio(task_t *p, unsigned long long now)
@@ -628,7 +756,10 @@ static void recalc_task_prio(task_t *p, unsigned long long now)
 	unsigned long long __sleep_time = now - p->timestamp;
 	unsigned long sleep_time;
 
-	if (__sleep_time > NS_MAX_SLEEP_AVG)
+	/* SCHED_BATCH tasks are never rated interactive */
+	if (batch_task(p))
+		sleep_time = 0;
+	else if (__sleep_time > NS_MAX_SLEEP_AVG)
 		sleep_time = NS_MAX_SLEEP_AVG;
 	else
 		sleep_time = (unsigned long)__sleep_time;
@@ -739,6 +870,7 @@ static void activate_task(task_t *p, runqueue_t *rq, int local)
 static void deactivate_task(struct task_struct *p, runqueue_t *rq)
 {
 	rq->nr_running--;
+	dec_user_running(p);
 	dequeue_task(p, p->array);
 	p->array = NULL;
 }
@@ -781,6 +913,34 @@ inline int task_curr(const task_t *p)
 	return cpu_curr(task_cpu(p)) == p;
 }
 
+#if defined(CONFIG_SMP) && !defined(CONFIG_DEBUG_PAGEALLOC)
+/*
+ * For a sleeping lock, with preemption off: wait while @owner still
+ * holds it, as found in *@ownerp, and runs on its CPU.  Returns 1 if the
+ * lock changed hands, 0 if the owner is not running or we should
+ * reschedule, so sleep instead.
+ *
+ * @owner may have unlocked and exited since it was read from the lock,
+ * so its ->cpu is checked before use; a stale one only fails the test.
+ */
+int spin_on_owner(struct thread_info **ownerp, struct thread_info *owner)
+{
+	unsigned int cpu = owner->cpu;
+	runqueue_t *rq;
+
+	if (cpu >= NR_CPUS || !cpu_online(cpu))
+		return 0;
+	rq = cpu_rq(cpu);
+
+	while (*(struct thread_info * volatile *)ownerp == owner) {
+		if (rq->curr->thread_info != owner || need_resched())
+			return 0;
+		cpu_relax();
+	}
+	return 1;
+}
+#endif
+
 #ifdef CONFIG_SMP
 enum request_type {
 	REQ_MOVE_TASK,
@@ -1094,12 +1254,13 @@ out_activate:
 	 */
 	activate_task(p, rq, cpu == this_cpu);
 	if (!sync || cpu != this_cpu) {
-		if (TASK_PREEMPTS_CURR(p, rq))
+		if (TASK_WAKEUP_PREEMPTS(p, rq))
 			resched_task(rq->curr);
 	}
 	success = 1;
 
 out_running:
+	trace_sched_wakeup(p, success);
 	p->state = TASK_RUNNING;
 out:
 	task_rq_unlock(rq, &flags);
@@ -1120,11 +1281,6 @@ int fastcall wake_up_state(task_t *p, unsigned int state)
 	return try_to_wake_up(p, state, 0);
 }
 
-#ifdef CONFIG_SMP
-static int find_idlest_cpu(struct task_struct *p, int this_cpu,
-			   struct sched_domain *sd);
-#endif
-
 /*
  * Perform scheduler related setup for a newly forked process p.
  * p is forked by current.
@@ -1227,6 +1383,7 @@ void fastcall wake_up_new_task(task_t * p, unsigned long clone_flags)
 				p->array = current->array;
 				p->array->nr_active++;
 				rq->nr_running++;
+				inc_user_running(p);
 			}
 			set_need_resched();
 		} else
@@ -1249,7 +1406,7 @@ void fastcall wake_up_new_task(task_t * p, unsigned long clone_flags)
 		p->timestamp = (p->timestamp - this_rq->timestamp_last_tick)
 					+ rq->timestamp_last_tick;
 		__activate_task(p, rq);
-		if (TASK_PREEMPTS_CURR(p, rq))
+		if (TASK_WAKEUP_PREEMPTS(p, rq))
 			resched_task(rq->curr);
 
 		/*
@@ -1493,11 +1650,56 @@ static void double_lock_balance(runqueue_t *this_rq, runqueue_t *busiest)
 	}
 }
 
+#ifdef CONFIG_NUMA
 /*
- * find_idlest_cpu - find the least busy runqueue.
+ * Tasks with less anonymous memory than this can run anywhere.
+ */
+#define NODE_AFFINE_RSS		(1024*1024 / PAGE_SIZE)
+
+/*
+ * remote_memory_load - the cost of running away from memory: the part
+ * of mm's anonymous memory that is not on this node, weighed as up to
+ * the load of one more task.
+ */
+static unsigned long remote_memory_load(struct mm_struct *mm, int node)
+{
+	unsigned long anon, local;
+
+	if (!mm)
+		return 0;
+	anon = get_mm_counter(mm, anon_rss);
+	if (anon < NODE_AFFINE_RSS)
+		return 0;
+	/* The counters are read without any locking */
+	local = get_mm_counter(mm, node_anon_rss[node]);
+	if (local >= anon)
+		return 0;
+
+	return (anon - local) * SCHED_LOAD_SCALE / anon;
+}
+#else
+static inline unsigned long remote_memory_load(struct mm_struct *mm, int node)
+{
+	return 0;
+}
+#endif
+
+/*
+ * Would moving p to this_cpu take it away from most of its memory?
+ */
+static inline int task_memory_bound(task_t *p, int this_cpu)
+{
+	return remote_memory_load(p->mm, cpu_to_node(this_cpu)) >
+		remote_memory_load(p->mm, cpu_to_node(task_cpu(p))) +
+		SCHED_LOAD_SCALE / 2;
+}
+
+/*
+ * find_idlest_cpu - find the least busy runqueue, counting the distance
+ * from the memory of mm as load.
  */
 static int find_idlest_cpu(struct task_struct *p, int this_cpu,
-			   struct sched_domain *sd)
+			   struct sched_domain *sd, struct mm_struct *mm)
 {
 	unsigned long load, min_load, this_load;
 	int i, min_cpu;
@@ -1509,7 +1711,7 @@ static int find_idlest_cpu(struct task_struct *p, int this_cpu,
 	cpus_and(mask, sd->span, p->cpus_allowed);
 
 	for_each_cpu_mask(i, mask) {
-		load = target_load(i);
+		load = target_load(i) + remote_memory_load(mm, cpu_to_node(i));
 
 		if (load < min_load) {
 			min_cpu = i;
@@ -1522,7 +1724,8 @@ static int find_idlest_cpu(struct task_struct *p, int this_cpu,
 	}
 
 	/* add +1 to account for the new task */
-	this_load = source_load(this_cpu) + SCHED_LOAD_SCALE;
+	this_load = source_load(this_cpu) + SCHED_LOAD_SCALE +
+			remote_memory_load(mm, cpu_to_node(this_cpu));
 
 	/*
 	 * Would with the addition of the new task to the
@@ -1592,7 +1795,8 @@ void sched_exec(void)
 
 	if (sd) {
 		schedstat_inc(sd, sbe_attempts);
-		new_cpu = find_idlest_cpu(current, this_cpu, sd);
+		/* The old memory is about to go, it does not pin us */
+		new_cpu = find_idlest_cpu(current, this_cpu, sd, NULL);
 		if (new_cpu != this_cpu) {
 			schedstat_inc(sd, sbe_pushed);
 			put_cpu();
@@ -1604,6 +1808,32 @@ out:
 	put_cpu();
 }
 
+/*
+ * sched_balance_fork(): find the highest-level, fork-balance-capable
+ * domain and pick the least loaded CPU to start the new task p on.
+ *
+ * On NUMA this places a child before its memory is spread out, next
+ * to the pages it shares with the parent unless the load demands
+ * otherwise.  Called with interrupts disabled, from copy_process().
+ */
+int sched_balance_fork(task_t *p)
+{
+	struct sched_domain *tmp, *sd = NULL;
+	int this_cpu = smp_processor_id();
+
+	/* Prefer the current CPU if there's only the parent running */
+	if (this_rq()->nr_running <= 1)
+		return this_cpu;
+
+	for_each_domain(this_cpu, tmp)
+		if (tmp->flags & SD_BALANCE_FORK)
+			sd = tmp;
+
+	if (sd)
+		return find_idlest_cpu(p, this_cpu, sd, p->mm);
+	return this_cpu;
+}
+
 /*
  * pull_task - move a task from a remote runqueue to the local runqueue.
  * Both runqueues must be locked.
@@ -1647,12 +1877,16 @@ int can_migrate_task(task_t *p, runqueue_t *rq, int this_cpu,
 
 	/*
 	 * Aggressive migration if:
-	 * 1) the [whole] cpu is idle, or
-	 * 2) too many balance attempts have failed.
+	 * 1) too many balance attempts have failed, or
+	 * 2) the [whole] cpu is idle, unless the task would leave its
+	 *    memory behind on another node.
 	 */
 
-	if (cpu_and_siblings_are_idle(this_cpu) || \
-			sd->nr_balance_failed > sd->cache_nice_tries)
+	if (sd->nr_balance_failed > sd->cache_nice_tries)
+		return 1;
+	if (task_memory_bound(p, this_cpu))
+		return 0;
+	if (cpu_and_siblings_are_idle(this_cpu))
 		return 1;
 
 	if (task_hot(p, rq->timestamp_last_tick, sd))
@@ -2067,7 +2301,11 @@ static inline void idle_balance(int this_cpu, runqueue_t *this_rq)
 
 	for_each_domain(this_cpu, sd) {
 		if (sd->flags & SD_BALANCE_NEWIDLE) {
-			if (load_balance_newidle(this_cpu, this_rq, sd)) {
+			cycles_t start = balance_start();
+			int pulled = load_balance_newidle(this_cpu, this_rq, sd);
+
+			balance_end(sd, start);
+			if (pulled) {
 				/* We've pulled tasks over so stop searching */
 				break;
 			}
@@ -2185,10 +2423,26 @@ static void rebalance_tick(int this_cpu, runqueue_t *this_rq,
 			interval = 1;
 
 		if (j - sd->last_balance >= interval) {
+			cycles_t start = balance_start();
+
 			if (load_balance(this_cpu, this_rq, sd, idle)) {
 				/* We've pulled tasks over so no longer idle */
 				idle = NOT_IDLE;
 			}
+			balance_end(sd, start);
+#ifdef CONFIG_NO_IDLE_HZ
+			/*
+			 * Idle cpus with their tick stopped do not pull
+			 * tasks; wake one up to take over some of ours.
+			 */
+			if (idle == NOT_IDLE && this_rq->nr_running > 1) {
+				cpumask_t tmp;
+
+				cpus_and(tmp, sd->span, nohz_cpu_mask);
+				if (!cpus_empty(tmp))
+					smp_send_reschedule(first_cpu(tmp));
+			}
+#endif
 			sd->last_balance += interval;
 		}
 	}
@@ -2613,7 +2867,7 @@ asmlinkage void __sched schedule(void)
 	struct list_head *queue;
 	unsigned long long now;
 	unsigned long run_time;
-	int cpu, idx;
+	int cpu, idx, wq_sleeping;
 
 	/*
 	 * Test if we are atomic.  Since do_exit() needs to call into
@@ -2634,6 +2888,15 @@ need_resched:
 	preempt_disable();
 	prev = current;
 	release_kernel_lock(prev);
+
+	/*
+	 * A workqueue worker blocking in a work function may have to
+	 * hand the rest of its pool's queued work over to another worker:
+	 */
+	wq_sleeping = 0;
+	if (unlikely(prev->wq_worker) && prev->state &&
+			!(preempt_count() & PREEMPT_ACTIVE))
+		wq_sleeping = wq_worker_sleeping(prev);
 need_resched_nonpreemptible:
 	rq = this_rq();
 
@@ -2756,11 +3019,16 @@ switch_tasks:
 
 	sched_info_switch(prev, next);
 	if (likely(prev != next)) {
+		/* next has been waiting since it was woken or preempted */
+		if (next != rq->idle)
+			schedstat_hist(rq, run_delay_hist, now - next->timestamp);
 		next->timestamp = now;
 		rq->nr_switches++;
 		rq->curr = next;
 		++*switch_count;
 
+		trace_sched_switch(prev, next);
+		perfctr_task_switch(prev, next);
 		prepare_arch_switch(rq, next);
 		prev = context_switch(rq, prev, next);
 		barrier();
@@ -2770,6 +3038,10 @@ switch_tasks:
 		spin_unlock_irq(&rq->lock);
 
 	prev = current;
+	if (unlikely(wq_sleeping)) {
+		wq_worker_waking_up(prev);
+		wq_sleeping = 0;
+	}
 	if (unlikely(reacquire_kernel_lock(prev) < 0))
 		goto need_resched_nonpreemptible;
 	preempt_enable_no_resched();
@@ -3174,6 +3446,28 @@ long fastcall __sched sleep_on_timeout(wait_queue_head_t *q, long timeout)
 
 EXPORT_SYMBOL(sleep_on_timeout);
 
+#ifdef CONFIG_FAIR_USER_SCHED
+/*
+ * sched_switch_user - move a task to another user's fair share.
+ *
+ * The runnable count moves with the task under the runqueue lock, so
+ * it cannot race with the task being activated or deactivated.
+ */
+void sched_switch_user(task_t *p, struct user_struct *new_user)
+{
+	unsigned long flags;
+	runqueue_t *rq;
+
+	rq = task_rq_lock(p, &flags);
+	if (p->array) {
+		dec_user_running(p);
+		atomic_inc(&new_user->nr_running);
+	}
+	p->user = new_user;
+	task_rq_unlock(rq, &flags);
+}
+#endif
+
 void set_user_nice(task_t *p, long nice)
 {
 	unsigned long flags;
@@ -3333,10 +3627,13 @@ static void __setscheduler(struct task_struct *p, int policy, int prio)
 	BUG_ON(p->array);
 	p->policy = policy;
 	p->rt_priority = prio;
-	if (policy != SCHED_NORMAL)
+	if (policy == SCHED_FIFO || policy == SCHED_RR)
 		p->prio = MAX_USER_RT_PRIO-1 - p->rt_priority;
 	else
 		p->prio = p->static_prio;
+	/* SCHED_BATCH tasks start out, and stay, rated as CPU hogs */
+	if (policy == SCHED_BATCH)
+		p->sleep_avg = 0;
 }
 
 /**
@@ -3359,16 +3656,18 @@ recheck:
 	if (policy < 0)
 		policy = oldpolicy = p->policy;
 	else if (policy != SCHED_FIFO && policy != SCHED_RR &&
-				policy != SCHED_NORMAL)
+			policy != SCHED_NORMAL && policy != SCHED_BATCH)
 			return -EINVAL;
 	/*
 	 * Valid priorities for SCHED_FIFO and SCHED_RR are
-	 * 1..MAX_USER_RT_PRIO-1, valid priority for SCHED_NORMAL is 0.
+	 * 1..MAX_USER_RT_PRIO-1, valid priority for SCHED_NORMAL and
+	 * SCHED_BATCH is 0.
 	 */
 	if (param->sched_priority < 0 ||
 	    param->sched_priority > MAX_USER_RT_PRIO-1)
 		return -EINVAL;
-	if ((policy == SCHED_NORMAL) != (param->sched_priority == 0))
+	if ((policy == SCHED_NORMAL || policy == SCHED_BATCH) !=
+					(param->sched_priority == 0))
 		return -EINVAL;
 
 	if ((policy == SCHED_FIFO || policy == SCHED_RR) &&
@@ -3834,6 +4133,7 @@ asmlinkage long sys_sched_get_priority_max(int policy)
 		ret = MAX_USER_RT_PRIO-1;
 		break;
 	case SCHED_NORMAL:
+	case SCHED_BATCH:
 		ret = 0;
 		break;
 	}
@@ -3857,6 +4157,7 @@ asmlinkage long sys_sched_get_priority_min(int policy)
 		ret = 1;
 		break;
 	case SCHED_NORMAL:
+	case SCHED_BATCH:
 		ret = 0;
 	}
 	return ret;
@@ -3890,7 +4191,7 @@ long sys_sched_rr_get_interval(pid_t pid, struct timespec __user *interval)
 	if (retval)
 		goto out_unlock;
 
-	jiffies_to_timespec(p->policy & SCHED_FIFO ?
+	jiffies_to_timespec(p->policy == SCHED_FIFO ?
 				0 : task_timeslice(p), &t);
 	read_unlock(&tasklist_lock);
 	retval = copy_to_user(interval, &t, sizeof(t)) ? -EFAULT : 0;
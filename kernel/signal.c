@@ -23,6 +23,7 @@
 #include <linux/syscalls.h>
 #include <linux/ptrace.h>
 #include <linux/posix-timers.h>
+#include <linux/signalfd.h>
 #include <asm/param.h>
 #include <asm/uaccess.h>
 #include <asm/unistd.h>
@@ -326,8 +327,10 @@ void __exit_sighand(struct task_struct *tsk)
 
 	/* Ok, we're done with the signal handlers */
 	tsk->sighand = NULL;
-	if (atomic_dec_and_test(&sighand->count))
+	if (atomic_dec_and_test(&sighand->count)) {
+		signalfd_detach(sighand);
 		kmem_cache_free(sighand_cachep, sighand);
+	}
 }
 
 void exit_sighand(struct task_struct *tsk)
@@ -850,6 +853,7 @@ static int send_signal(int sig, struct siginfo *info, struct task_struct *t,
 
 out_set:
 	sigaddset(&signals->signal, sig);
+	signalfd_notify(t, sig);
 	return ret;
 }
 
@@ -1393,6 +1397,7 @@ send_sigqueue(int sig, struct sigqueue *q, struct task_struct *p)
 	q->lock = &p->sighand->siglock;
 	list_add_tail(&q->list, &p->pending.list);
 	sigaddset(&p->pending.signal, sig);
+	signalfd_notify(p, sig);
 	if (!sigismember(&p->blocked, sig))
 		signal_wake_up(p, sig == SIGKILL);
 
@@ -1439,6 +1444,7 @@ send_group_sigqueue(int sig, struct sigqueue *q, struct task_struct *p)
 	q->lock = &p->sighand->siglock;
 	list_add_tail(&q->list, &p->signal->shared_pending.list);
 	sigaddset(&p->signal->shared_pending.signal, sig);
+	signalfd_notify(p, sig);
 
 	__group_complete_signal(sig, p);
 out:
@@ -43,6 +43,56 @@ EXPORT_SYMBOL(irq_stat);
 
 static struct softirq_action softirq_vec[32] __cacheline_aligned_in_smp;
 
+#ifdef CONFIG_SOFTIRQ_THREADS
+/*
+ * Every vector has a thread of its own on each cpu.  Once they are up,
+ * pending vectors are moved over to softirqd_pending and run by their
+ * threads only, so that the scheduler shares the cpu between vectors.
+ */
+struct softirqd {
+	struct task_struct *tsk;
+	int nr;
+	int cpu;
+};
+
+static DEFINE_PER_CPU(struct softirqd, softirqd[MAX_SOFTIRQ]);
+static DEFINE_PER_CPU(__u32, softirqd_pending);
+
+static const char *softirq_names[MAX_SOFTIRQ] = {
+	[HI_SOFTIRQ]		= "high",
+	[TIMER_SOFTIRQ]		= "timer",
+	[NET_TX_SOFTIRQ]	= "net-tx",
+	[NET_RX_SOFTIRQ]	= "net-rx",
+	[SCSI_SOFTIRQ]		= "scsi",
+	[TASKLET_SOFTIRQ]	= "tasklet",
+};
+
+/*
+ * Hand the pending vectors to their threads.  Returns 0 if the threads
+ * of this cpu are not running yet.  Interrupts must be disabled.
+ */
+static int softirq_handoff(void)
+{
+	struct softirqd *d = __get_cpu_var(softirqd);
+	__u32 pending = local_softirq_pending();
+	int nr;
+
+	if (!d[0].tsk)
+		return 0;
+
+	local_softirq_pending() = 0;
+	__get_cpu_var(softirqd_pending) |= pending;
+	for (nr = 0; nr < MAX_SOFTIRQ && pending; nr++, pending >>= 1)
+		if ((pending & 1) && d[nr].tsk->state != TASK_RUNNING)
+			wake_up_process(d[nr].tsk);
+	return 1;
+}
+
+static inline void wakeup_softirqd(void)
+{
+	softirq_handoff();
+}
+#else
 static DEFINE_PER_CPU(struct task_struct *, ksoftirqd);
 
 /*
@@ -59,6 +109,7 @@ static inline void wakeup_softirqd(void)
 	if (tsk && tsk->state != TASK_RUNNING)
 		wake_up_process(tsk);
 }
+#endif
 
 /*
  * We restart softirq processing MAX_SOFTIRQ_RESTART times,
@@ -68,41 +119,62 @@ static inline void wakeup_softirqd(void)
  * The two things to balance is latency against fairness -
  * we want to handle softirqs as soon as possible, but they
  * should not be able to lock up the box.
+ *
+ * On top of that, a vector which has used more than SOFTIRQ_BUDGET_NS
+ * of cpu time is left to softirqd early, while the other vectors keep
+ * being restarted, so that one busy vector does not hold them all up.
  */
 #define MAX_SOFTIRQ_RESTART 10
+#define SOFTIRQ_BUDGET_NS (NSEC_PER_SEC / HZ / 2)
 
 asmlinkage void __do_softirq(void)
 {
 	struct softirq_action *h;
-	__u32 pending;
+	__u32 pending, deferred = 0;
+	unsigned long used[MAX_SOFTIRQ];
+	unsigned long long start;
 	int max_restart = MAX_SOFTIRQ_RESTART;
-	int cpu;
+	int cpu, nr;
 
+#ifdef CONFIG_SOFTIRQ_THREADS
+	if (softirq_handoff())
+		return;
+#endif
 	pending = local_softirq_pending();
+	memset(used, 0, sizeof(used));
 
 	local_bh_disable();
 	cpu = smp_processor_id();
 restart:
 	/* Reset the pending bitmask before enabling irqs */
-	local_softirq_pending() = 0;
+	local_softirq_pending() = pending & deferred;
+	pending &= ~deferred;
 
 	local_irq_enable();
 
 	h = softirq_vec;
+	nr = 0;
 
 	do {
 		if (pending & 1) {
+			start = sched_clock();
 			h->action(h);
 			rcu_bh_qsctr_inc(cpu);
+			if (nr < MAX_SOFTIRQ) {
+				used[nr] += sched_clock() - start;
+				if (used[nr] > SOFTIRQ_BUDGET_NS)
+					deferred |= 1 << nr;
+			}
 		}
 		h++;
+		nr++;
 		pending >>= 1;
 	} while (pending);
 
 	local_irq_disable();
 
 	pending = local_softirq_pending();
-	if (pending && --max_restart)
+	if ((pending & ~deferred) && --max_restart)
 		goto restart;
 
 	if (pending)
@@ -347,6 +419,126 @@ void __init softirq_init(void)
 	open_softirq(HI_SOFTIRQ, tasklet_hi_action, NULL);
 }
 
+#ifdef CONFIG_SOFTIRQ_THREADS
+static int softirq_thread(void *__data)
+{
+	struct softirqd *d = __data;
+	struct softirq_action *h = softirq_vec + d->nr;
+	__u32 mask = 1 << d->nr;
+
+	set_user_nice(current, -5);
+	current->flags |= PF_NOFREEZE;
+
+	set_current_state(TASK_INTERRUPTIBLE);
+
+	while (!kthread_should_stop()) {
+		preempt_disable();
+		if (!(__get_cpu_var(softirqd_pending) & mask)) {
+			preempt_enable_no_resched();
+			schedule();
+			preempt_disable();
+		}
+
+		__set_current_state(TASK_RUNNING);
+
+		while (__get_cpu_var(softirqd_pending) & mask) {
+			/* Preempt disable stops cpu going offline.
+			   If already offline, we'll be on wrong CPU:
+			   don't process */
+			if (cpu_is_offline(d->cpu))
+				goto wait_to_die;
+
+			local_irq_disable();
+			__get_cpu_var(softirqd_pending) &= ~mask;
+			local_bh_disable();
+			local_irq_enable();
+
+			h->action(h);
+			rcu_bh_qsctr_inc(d->cpu);
+
+			/* Vectors raised meanwhile go to their threads */
+			local_irq_disable();
+			__local_bh_enable();
+			if (local_softirq_pending())
+				softirq_handoff();
+			local_irq_enable();
+
+			preempt_enable_no_resched();
+			cond_resched();
+			preempt_disable();
+		}
+		preempt_enable();
+		set_current_state(TASK_INTERRUPTIBLE);
+	}
+	__set_current_state(TASK_RUNNING);
+	return 0;
+
+wait_to_die:
+	preempt_enable();
+	/* Wait for kthread_stop */
+	set_current_state(TASK_INTERRUPTIBLE);
+	while (!kthread_should_stop()) {
+		schedule();
+		set_current_state(TASK_INTERRUPTIBLE);
+	}
+	__set_current_state(TASK_RUNNING);
+	return 0;
+}
+
+static void stop_softirqd(int cpu)
+{
+	struct softirqd *d = per_cpu(softirqd, cpu);
+	struct task_struct *p;
+	int nr;
+
+	for (nr = 0; nr < MAX_SOFTIRQ; nr++) {
+		p = d[nr].tsk;
+		d[nr].tsk = NULL;
+		if (p)
+			kthread_stop(p);
+	}
+}
+
+static int create_softirqd(int cpu)
+{
+	struct softirqd *d = per_cpu(softirqd, cpu);
+	struct task_struct *p;
+	int nr;
+
+	per_cpu(softirqd_pending, cpu) = 0;
+	for (nr = 0; nr < MAX_SOFTIRQ; nr++) {
+		d[nr].nr = nr;
+		d[nr].cpu = cpu;
+		p = kthread_create(softirq_thread, d + nr, "softirq-%s/%d",
+				   softirq_names[nr], cpu);
+		if (IS_ERR(p)) {
+			stop_softirqd(cpu);
+			return PTR_ERR(p);
+		}
+		kthread_bind(p, cpu);
+		d[nr].tsk = p;
+	}
+	return 0;
+}
+
+#ifdef CONFIG_HOTPLUG_CPU
+static void bind_softirqd(int cpu, int to)
+{
+	int nr;
+
+	for (nr = 0; nr < MAX_SOFTIRQ; nr++)
+		kthread_bind(per_cpu(softirqd, cpu)[nr].tsk, to);
+}
+#endif
+
+static void wake_softirqd(int cpu)
+{
+	int nr;
+
+	for (nr = 0; nr < MAX_SOFTIRQ; nr++)
+		wake_up_process(per_cpu(softirqd, cpu)[nr].tsk);
+}
+#else
 static int ksoftirqd(void * __bind_cpu)
 {
 	set_user_nice(current, 19);
@@ -393,6 +585,39 @@ wait_to_die:
 	return 0;
 }
 
+static int create_softirqd(int cpu)
+{
+	struct task_struct *p;
+
+	p = kthread_create(ksoftirqd, (void *)(long)cpu, "ksoftirqd/%d", cpu);
+	if (IS_ERR(p))
+		return PTR_ERR(p);
+	kthread_bind(p, cpu);
+	per_cpu(ksoftirqd, cpu) = p;
+	return 0;
+}
+
+#ifdef CONFIG_HOTPLUG_CPU
+static void stop_softirqd(int cpu)
+{
+	struct task_struct *p = per_cpu(ksoftirqd, cpu);
+
+	per_cpu(ksoftirqd, cpu) = NULL;
+	kthread_stop(p);
+}
+
+static void bind_softirqd(int cpu, int to)
+{
+	kthread_bind(per_cpu(ksoftirqd, cpu), to);
+}
+#endif
+
+static void wake_softirqd(int cpu)
+{
+	wake_up_process(per_cpu(ksoftirqd, cpu));
+}
+#endif /* CONFIG_SOFTIRQ_THREADS */
+
 #ifdef CONFIG_HOTPLUG_CPU
 /*
  * tasklet_kill_immediate is called to remove a tasklet which can already be
@@ -450,31 +675,25 @@ static int __devinit cpu_callback(struct notifier_block *nfb,
 				  void *hcpu)
 {
 	int hotcpu = (unsigned long)hcpu;
-	struct task_struct *p;
 
 	switch (action) {
 	case CPU_UP_PREPARE:
 		BUG_ON(per_cpu(tasklet_vec, hotcpu).list);
 		BUG_ON(per_cpu(tasklet_hi_vec, hotcpu).list);
-		p = kthread_create(ksoftirqd, hcpu, "ksoftirqd/%d", hotcpu);
-		if (IS_ERR(p)) {
+		if (create_softirqd(hotcpu)) {
 			printk("ksoftirqd for %i failed\n", hotcpu);
 			return NOTIFY_BAD;
 		}
-		kthread_bind(p, hotcpu);
-  		per_cpu(ksoftirqd, hotcpu) = p;
  		break;
 	case CPU_ONLINE:
-		wake_up_process(per_cpu(ksoftirqd, hotcpu));
+		wake_softirqd(hotcpu);
 		break;
 #ifdef CONFIG_HOTPLUG_CPU
 	case CPU_UP_CANCELED:
 		/* Unbind so it can run.  Fall thru. */
-		kthread_bind(per_cpu(ksoftirqd, hotcpu), smp_processor_id());
+		bind_softirqd(hotcpu, smp_processor_id());
 	case CPU_DEAD:
-		p = per_cpu(ksoftirqd, hotcpu);
-		per_cpu(ksoftirqd, hotcpu) = NULL;
-		kthread_stop(p);
+		stop_softirqd(hotcpu);
 		takeover_tasklets(hotcpu);
 		break;
 #endif /* CONFIG_HOTPLUG_CPU */
@@ -0,0 +1,186 @@
+/*
+ * kernel/spawn.c
+ *
+ * spawn() system call: start a program in a new process without copying
+ * the caller's address space first, see include/linux/spawn.h.
+ *
+ * fork() followed by execve() copies the page tables of the parent only
+ * to throw them away again, which for a big process costs more than the
+ * exec.  vfork() avoids that but runs the child in user space on the
+ * parent's stack until it execs.  Here the child is a kernel_thread() of
+ * the caller, like the usermode helpers of kmod.c: it shares the mm of
+ * the caller, applies the file actions and attributes to its own copies
+ * of the descriptor table, fs and signal handlers without ever leaving
+ * the kernel, and then execve()s, which gives it a new mm.  CLONE_VFORK
+ * keeps the caller waiting until then, so everything is still read
+ * from its memory.  If anything fails the child records the error for
+ * the caller and exits as a detached process, leaving neither a zombie
+ * nor a SIGCHLD behind.
+ */
+
+#define __KERNEL_SYSCALLS__
+
+#include <linux/config.h>
+#include <linux/kernel.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/signal.h>
+#include <linux/syscalls.h>
+#include <linux/unistd.h>
+#include <linux/spawn.h>
+#include <asm/uaccess.h>
+
+#define SPAWN_FLAGS	(SPAWN_RESETIDS | SPAWN_SETPGROUP | SPAWN_SETSIGDEF | \
+			 SPAWN_SETSIGMASK | SPAWN_SETSID)
+
+struct spawn_info {
+	const char __user	*path;
+	char __user * __user	*argv;
+	char __user * __user	*envp;
+	struct spawn_attr	attr;
+	struct spawn_action	*actions;
+	int			error;
+};
+
+static void spawn_sigset(sigset_t *set, u64 mask)
+{
+	int sig;
+
+	sigemptyset(set);
+	for (sig = 1; sig <= 64 && sig <= _NSIG; sig++)
+		if (mask & (1ULL << (sig - 1)))
+			sigaddset(set, sig);
+}
+
+static long spawn_file_action(struct spawn_action *act)
+{
+	long fd, error;
+
+	switch (act->type) {
+	case SPAWN_CLOSE:
+		return sys_close(act->fd);
+	case SPAWN_DUP2:
+		fd = sys_dup2(act->fd, act->newfd);
+		return fd < 0 ? fd : 0;
+	case SPAWN_OPEN:
+		fd = sys_open((const char __user *)(unsigned long)act->path,
+			      act->oflag, act->mode);
+		if (fd < 0 || fd == act->fd)
+			return fd < 0 ? fd : 0;
+		error = sys_dup2(fd, act->fd);
+		sys_close(fd);
+		return error < 0 ? error : 0;
+	}
+	return -EINVAL;
+}
+
+static long spawn_setup(struct spawn_info *info)
+{
+	struct spawn_attr *attr = &info->attr;
+	sigset_t set;
+	long error;
+	int i;
+
+	if (attr->flags & SPAWN_SETSID) {
+		error = sys_setsid();
+		if (error < 0)
+			return error;
+	}
+	if (attr->flags & SPAWN_SETPGROUP) {
+		error = sys_setpgid(0, attr->pgroup);
+		if (error)
+			return error;
+	}
+	if (attr->flags & SPAWN_RESETIDS) {
+		error = sys_setresgid(-1, current->gid, -1);
+		if (!error)
+			error = sys_setresuid(-1, current->uid, -1);
+		if (error)
+			return error;
+	}
+	if (attr->flags & SPAWN_SETSIGDEF) {
+		struct k_sigaction sa;
+
+		memset(&sa, 0, sizeof(sa));
+		sa.sa.sa_handler = SIG_DFL;
+		spawn_sigset(&set, attr->sigdefault);
+		for (i = 1; i <= _NSIG; i++)
+			if (sigismember(&set, i) && i != SIGKILL && i != SIGSTOP)
+				do_sigaction(i, &sa, NULL);
+	}
+
+	for (i = 0; i < attr->nr_actions; i++) {
+		error = spawn_file_action(&info->actions[i]);
+		if (error)
+			return error;
+	}
+
+	if (attr->flags & SPAWN_SETSIGMASK) {
+		spawn_sigset(&set, attr->sigmask);
+		sigdelsetmask(&set, sigmask(SIGKILL) | sigmask(SIGSTOP));
+		sigprocmask(SIG_SETMASK, &set, NULL);
+	}
+	return 0;
+}
+
+/* The child, with the caller waiting for it in do_fork() */
+static int spawn_child(void *data)
+{
+	struct spawn_info *info = data;
+	long error;
+
+	error = spawn_setup(info);
+	if (!error)
+		error = kernel_execve(info->path, (char **)info->argv,
+				      (char **)info->envp);
+
+	/* the caller reports it, nobody is to wait for us */
+	info->error = error;
+	write_lock_irq(&tasklist_lock);
+	current->exit_signal = -1;
+	write_unlock_irq(&tasklist_lock);
+	do_exit(0);
+}
+
+asmlinkage long sys_spawn(const char __user *path,
+			  char __user * __user *argv,
+			  char __user * __user *envp,
+			  const struct spawn_attr __user *uattr)
+{
+	struct spawn_info info = {
+		.path	= path,
+		.argv	= argv,
+		.envp	= envp,
+	};
+	size_t size;
+	long pid;
+	int i;
+
+	if (uattr && copy_from_user(&info.attr, uattr, sizeof(info.attr)))
+		return -EFAULT;
+	if ((info.attr.flags & ~SPAWN_FLAGS) ||
+	    info.attr.nr_actions > SPAWN_MAX_ACTIONS)
+		return -EINVAL;
+
+	if (info.attr.nr_actions) {
+		size = info.attr.nr_actions * sizeof(struct spawn_action);
+		info.actions = kmalloc(size, GFP_KERNEL);
+		if (!info.actions)
+			return -ENOMEM;
+		pid = -EFAULT;
+		if (copy_from_user(info.actions,
+			(void __user *)(unsigned long)info.attr.actions, size))
+			goto out;
+		pid = -EINVAL;
+		for (i = 0; i < info.attr.nr_actions; i++)
+			if (info.actions[i].type > SPAWN_OPEN)
+				goto out;
+	}
+
+	pid = kernel_thread(spawn_child, &info, CLONE_VFORK | SIGCHLD);
+	if (pid > 0 && info.error)
+		pid = info.error;
+out:
+	kfree(info.actions);
+	return pid;
+}
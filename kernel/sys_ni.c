@@ -42,6 +42,7 @@ cond_syscall(sys_futex);
 cond_syscall(compat_sys_futex);
 cond_syscall(sys_epoll_create);
 cond_syscall(sys_epoll_ctl);
+cond_syscall(sys_epoll_ctl_batch);
 cond_syscall(sys_epoll_wait);
 cond_syscall(sys_semget);
 cond_syscall(sys_semop);
@@ -60,22 +61,38 @@ cond_syscall(sys_mq_timedsend);
 cond_syscall(sys_mq_timedreceive);
 cond_syscall(sys_mq_notify);
 cond_syscall(sys_mq_getsetattr);
+cond_syscall(sys_mq_timedsendv);
+cond_syscall(sys_mq_timedreceivev);
 cond_syscall(compat_sys_mq_open);
 cond_syscall(compat_sys_mq_timedsend);
 cond_syscall(compat_sys_mq_timedreceive);
 cond_syscall(compat_sys_mq_notify);
 cond_syscall(compat_sys_mq_getsetattr);
+cond_syscall(compat_sys_mq_timedsendv);
+cond_syscall(compat_sys_mq_timedreceivev);
 cond_syscall(sys_mbind);
 cond_syscall(sys_get_mempolicy);
 cond_syscall(sys_set_mempolicy);
 cond_syscall(compat_sys_mbind);
 cond_syscall(compat_sys_get_mempolicy);
 cond_syscall(compat_sys_set_mempolicy);
+cond_syscall(sys_migrate_pages);
+cond_syscall(compat_sys_migrate_pages);
+cond_syscall(sys_signalfd);
+cond_syscall(sys_timerfd_create);
+cond_syscall(sys_timerfd_settime);
+cond_syscall(sys_timerfd_gettime);
+cond_syscall(sys_eventfd);
 cond_syscall(sys_add_key);
 cond_syscall(sys_request_key);
 cond_syscall(sys_keyctl);
 cond_syscall(compat_sys_keyctl);
 cond_syscall(compat_sys_socketcall);
+cond_syscall(sys_inotify_init);
+cond_syscall(sys_inotify_add_watch);
+cond_syscall(sys_inotify_rm_watch);
+cond_syscall(sys_perfctr_open);
+cond_syscall(sys_spawn);
 
 /* arch-specific weak syscall entries */
 cond_syscall(sys_pciconfig_read);
@@ -65,6 +65,17 @@ typedef struct tvec_root_s {
 	struct list_head vec[TVR_SIZE];
 } tvec_root_t;
 
+/*
+ * Cascading a tv3-tv5 bucket can move a lot of timers.  Instead of doing
+ * it all in the tick where the bucket is due, the bucket is detached into
+ * precascade[] one round (TVR_SIZE ticks) before, and re-hashed
+ * PRECASCADE_BATCH timers per tick.  Timers of such a bucket expire no
+ * earlier than the next round, so early re-hashing is safe; whatever is
+ * left is flushed when the bucket becomes due.
+ */
+#define NR_PRECASCADE	3
+#define PRECASCADE_BATCH 256
+
 struct tvec_t_base_s {
 	spinlock_t lock;
 	unsigned long timer_jiffies;
@@ -74,6 +85,7 @@ struct tvec_t_base_s {
 	tvec_t tv3;
 	tvec_t tv4;
 	tvec_t tv5;
+	struct list_head precascade[NR_PRECASCADE];	/* from tv3-tv5 */
 } ____cacheline_aligned_in_smp;
 
 typedef struct tvec_t_base_s tvec_base_t;
@@ -282,6 +294,61 @@ int mod_timer(struct timer_list *timer, unsigned long expires)
 
 EXPORT_SYMBOL(mod_timer);
 
+/*
+ * Pick the time in [expires, expires + slack] with the most low-order
+ * zero bits.  Timers whose windows overlap tend to get the same value,
+ * so they share a bucket and expire in the same tick.
+ */
+static unsigned long apply_slack(unsigned long expires, unsigned long slack)
+{
+	unsigned long limit = expires + slack;
+	unsigned long mask = expires ^ limit;
+	int bit;
+
+	if (!mask)
+		return expires;
+	bit = BITS_PER_LONG - 1;
+	while (!(mask & (1UL << bit)))
+		bit--;
+	limit &= ~((1UL << bit) - 1);
+	/* jiffies wrapped inside the window */
+	if (time_before(limit, expires))
+		return expires;
+	return limit;
+}
+
+/***
+ * mod_timer_range - modify a timer's timeout within a window
+ * @timer: the timer to be modified
+ * @expires: the earliest time the timer may expire
+ * @slack: how many jiffies later than @expires it may expire
+ *
+ * Like mod_timer(), but the timer fires somewhere in
+ * [@expires, @expires + @slack].  If the timer is pending and already
+ * due inside the window it is left alone, otherwise the expiry is
+ * rounded so that timers with similar windows are batched into the
+ * same jiffy.  This suits timeouts that are re-armed often and do not
+ * need to be exact, such as retransmit and keepalive timers.
+ *
+ * The function returns whether the timer was pending.
+ */
+int mod_timer_range(struct timer_list *timer, unsigned long expires,
+			unsigned long slack)
+{
+	BUG_ON(!timer->function);
+
+	check_timer(timer);
+
+	if (timer_pending(timer) &&
+	    time_after_eq(timer->expires, expires) &&
+	    time_before_eq(timer->expires, expires + slack))
+		return 1;
+
+	return __mod_timer(timer, apply_slack(expires, slack));
+}
+
+EXPORT_SYMBOL(mod_timer_range);
+
 /***
  * del_timer - deactive a timer.
  * @timer: the timer to be deactivated
@@ -400,6 +467,44 @@ int del_singleshot_timer_sync(struct timer_list *timer)
 EXPORT_SYMBOL(del_singleshot_timer_sync);
 #endif
 
+/*
+ * Re-hash up to 'count' timers of a detached bucket, all of them if
+ * count is negative.
+ */
+static void precascade(tvec_base_t *base, struct list_head *head, int count)
+{
+	while (!list_empty(head) && count--) {
+		struct timer_list *tmp;
+
+		tmp = list_entry(head->next, struct timer_list, entry);
+		BUG_ON(tmp->base != base);
+		list_del(&tmp->entry);
+		internal_add_timer(base, tmp);
+	}
+}
+
+/*
+ * Called at the start of a round: detach the tv3-tv5 buckets that are
+ * due at the start of the next round.
+ */
+static void detach_precascade(tvec_base_t *base)
+{
+	unsigned long next = base->timer_jiffies + TVR_SIZE;
+	tvec_t *tv[NR_PRECASCADE] = { &base->tv3, &base->tv4, &base->tv5 };
+	int i;
+
+	for (i = 0; i < NR_PRECASCADE; i++) {
+		int shift = TVR_BITS + i * TVN_BITS;
+
+		/* a bucket of tv(i+3) is due when tv(i+2) wraps */
+		if ((next >> shift) & TVN_MASK)
+			break;
+		list_splice_init(tv[i]->vec +
+				((next >> (shift + TVN_BITS)) & TVN_MASK),
+				base->precascade + i);
+	}
+}
+
 static int cascade(tvec_base_t *base, tvec_t *tv, int index)
 {
 	/* cascade all the timers from tv up one level */
@@ -443,14 +548,24 @@ static inline void __run_timers(tvec_base_t *base)
 		struct list_head *head = &work_list;
  		int index = base->timer_jiffies & TVR_MASK;
  
+		int i;
+
 		/*
 		 * Cascade timers:
 		 */
-		if (!index &&
-			(!cascade(base, &base->tv2, INDEX(0))) &&
+		if (!index) {
+			for (i = 0; i < NR_PRECASCADE; i++)
+				precascade(base, base->precascade + i, -1);
+			if ((!cascade(base, &base->tv2, INDEX(0))) &&
 				(!cascade(base, &base->tv3, INDEX(1))) &&
 					!cascade(base, &base->tv4, INDEX(2)))
-			cascade(base, &base->tv5, INDEX(3));
+				cascade(base, &base->tv5, INDEX(3));
+			detach_precascade(base);
+		} else {
+			for (i = 0; i < NR_PRECASCADE; i++)
+				precascade(base, base->precascade + i,
+						PRECASCADE_BATCH);
+		}
 		++base->timer_jiffies; 
 		list_splice_init(base->tv1.vec + index, &work_list);
 repeat:
@@ -547,6 +662,11 @@ found:
 				expires = nte->expires;
 		}
 	}
+	/* Detached buckets that have not been re-hashed yet */
+	for (i = 0; i < NR_PRECASCADE; i++)
+		list_for_each_entry(nte, base->precascade + i, entry)
+			if (time_before(nte->expires, expires))
+				expires = nte->expires;
 	spin_unlock(&base->lock);
 	return expires;
 }
@@ -888,6 +1008,7 @@ static void run_timer_softirq(struct softirq_action *h)
 {
 	tvec_base_t *base = &__get_cpu_var(tvec_bases);
 
+	hrtimer_run_queues();
 	if (time_after_eq(jiffies, base->timer_jiffies))
 		__run_timers(base);
 }
@@ -1135,64 +1256,6 @@ asmlinkage long sys_gettid(void)
 	return current->pid;
 }
 
-static long __sched nanosleep_restart(struct restart_block *restart)
-{
-	unsigned long expire = restart->arg0, now = jiffies;
-	struct timespec __user *rmtp = (struct timespec __user *) restart->arg1;
-	long ret;
-
-	/* Did it expire while we handled signals? */
-	if (!time_after(expire, now))
-		return 0;
-
-	current->state = TASK_INTERRUPTIBLE;
-	expire = schedule_timeout(expire - now);
-
-	ret = 0;
-	if (expire) {
-		struct timespec t;
-		jiffies_to_timespec(expire, &t);
-
-		ret = -ERESTART_RESTARTBLOCK;
-		if (rmtp && copy_to_user(rmtp, &t, sizeof(t)))
-			ret = -EFAULT;
-		/* The 'restart' block is already filled in */
-	}
-	return ret;
-}
-
-asmlinkage long sys_nanosleep(struct timespec __user *rqtp, struct timespec __user *rmtp)
-{
-	struct timespec t;
-	unsigned long expire;
-	long ret;
-
-	if (copy_from_user(&t, rqtp, sizeof(t)))
-		return -EFAULT;
-
-	if ((t.tv_nsec >= 1000000000L) || (t.tv_nsec < 0) || (t.tv_sec < 0))
-		return -EINVAL;
-
-	expire = timespec_to_jiffies(&t) + (t.tv_sec || t.tv_nsec);
-	current->state = TASK_INTERRUPTIBLE;
-	expire = schedule_timeout(expire);
-
-	ret = 0;
-	if (expire) {
-		struct restart_block *restart;
-		jiffies_to_timespec(expire, &t);
-		if (rmtp && copy_to_user(rmtp, &t, sizeof(t)))
-			return -EFAULT;
-
-		restart = &current_thread_info()->restart_block;
-		restart->fn = nanosleep_restart;
-		restart->arg0 = jiffies + expire;
-		restart->arg1 = (unsigned long) rmtp;
-		ret = -ERESTART_RESTARTBLOCK;
-	}
-	return ret;
-}
-
 /*
  * sys_sysinfo - fill in sysinfo struct
  */ 
@@ -1297,6 +1360,8 @@ static void __devinit init_timers_cpu(int cpu)
 	}
 	for (j = 0; j < TVR_SIZE; j++)
 		INIT_LIST_HEAD(base->tv1.vec + j);
+	for (j = 0; j < NR_PRECASCADE; j++)
+		INIT_LIST_HEAD(base->precascade + j);
 
 	base->timer_jiffies = jiffies;
 }
@@ -1352,6 +1417,9 @@ again:
 		    || !migrate_timer_list(new_base, old_base->tv4.vec + i)
 		    || !migrate_timer_list(new_base, old_base->tv5.vec + i))
 			goto unlock_again;
+	for (i = 0; i < NR_PRECASCADE; i++)
+		if (!migrate_timer_list(new_base, old_base->precascade + i))
+			goto unlock_again;
 	spin_unlock(&old_base->lock);
 	spin_unlock(&new_base->lock);
 	local_irq_enable();
@@ -1415,8 +1483,10 @@ static inline u64 time_interpolator_get_cycles(unsigned int src)
 			x = time_interpolator->addr;
 			return x();
 
+#ifdef readq
 		case TIME_SOURCE_MMIO64	:
 			return readq((void __iomem *) time_interpolator->addr);
+#endif
 
 		case TIME_SOURCE_MMIO32	:
 			return readl((void __iomem *) time_interpolator->addr);
@@ -1451,6 +1521,8 @@ static inline u64 time_interpolator_get_counter(void)
 
 void time_interpolator_reset(void)
 {
+	if (!time_interpolator)
+		return;
 	time_interpolator->offset = 0;
 	time_interpolator->last_counter = time_interpolator_get_counter();
 }
@@ -1519,6 +1591,8 @@ is_better_time_interpolator(struct time_interpolator *new)
 {
 	if (!time_interpolator)
 		return 1;
+	if (new->rating != time_interpolator->rating)
+		return new->rating > time_interpolator->rating;
 	return new->frequency > 2*time_interpolator->frequency ||
 	    (unsigned long)new->drift < (unsigned long)time_interpolator->drift;
 }
@@ -1531,6 +1605,11 @@ register_time_interpolator(struct time_interpolator *ti)
 	/* Sanity check */
 	if (ti->frequency == 0 || ti->mask == 0)
 		BUG();
+#ifndef readq
+	BUG_ON(ti->source == TIME_SOURCE_MMIO64);
+#endif
+	/* the jitter compensation needs a 64-bit cmpxchg */
+	BUG_ON(ti->jitter && BITS_PER_LONG < 64);
 
 	ti->nsec_per_cyc = ((u64)NSEC_PER_SEC << ti->shift) / ti->frequency;
 	spin_lock(&time_interpolator_lock);
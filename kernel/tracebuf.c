@@ -0,0 +1,450 @@
+/*
+ * kernel/tracebuf.c
+ *
+ * Per-CPU trace buffers for logging kernel events at a high rate.
+ *
+ * Every CPU writes only to its own buffer and does so with interrupts
+ * off, so writers need neither locks nor atomic operations and do not
+ * bounce cache lines between CPUs.  A buffer is a ring of sub-buffers
+ * (see include/linux/tracebuf.h); an event never straddles two of
+ * them, and the reader only ever looks at completed ones, so it needs
+ * no synchronization with the writer beyond the produced counter.
+ * When the ring is full, new events are dropped, or with
+ * TRACEBUF_OVERWRITE the oldest sub-buffer is reused.
+ *
+ * Readers are woken once per completed sub-buffer at most, and from a
+ * timer rather than directly, so that events can be logged from any
+ * context, the scheduler included.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/mm.h>
+#include <linux/fs.h>
+#include <linux/poll.h>
+#include <linux/debugfs.h>
+#include <linux/kref.h>
+#include <linux/smp.h>
+#include <linux/tracebuf.h>
+#include <asm/uaccess.h>
+#include <asm/semaphore.h>
+
+struct tracebuf_cpu {
+	struct tracebuf		*tb;
+	struct tracebuf_ctl	*ctl;		/* first page of the mapping */
+	char			*data;		/* the sub-buffers */
+	u32			offset;		/* in the current sub-buffer */
+
+	wait_queue_head_t	wait;
+	struct timer_list	timer;		/* wakes readers */
+	struct semaphore	read_sem;
+	u32			read_pos;	/* in sub-buffer consumed */
+	struct dentry		*dentry;
+};
+
+struct tracebuf {
+	struct kref		kref;		/* creator, open files, maps */
+	unsigned int		flags;
+	u32			subbuf_size;
+	u32			n_subbufs;
+	struct dentry		*dir;
+	struct tracebuf_cpu	*cpu[NR_CPUS];
+};
+
+static inline char *subbuf(struct tracebuf_cpu *buf, u32 n)
+{
+	return buf->data + (n & (buf->tb->n_subbufs - 1)) * buf->tb->subbuf_size;
+}
+
+static void tracebuf_wakeup(unsigned long data)
+{
+	struct tracebuf_cpu *buf = (struct tracebuf_cpu *)data;
+
+	wake_up_interruptible(&buf->wait);
+}
+
+/*
+ * Complete the current sub-buffer and start the next one.  Returns 0 if
+ * the buffer is full and does not overwrite.  Interrupts are off.
+ */
+static int tracebuf_switch(struct tracebuf *tb, struct tracebuf_cpu *buf)
+{
+	struct tracebuf_ctl *ctl = buf->ctl;
+	u32 produced = ctl->produced;
+
+	/* consumed is written by the reader, maybe from user space */
+	if (produced + 1 - *(volatile u32 *)&ctl->consumed >= tb->n_subbufs) {
+		if (!(tb->flags & TRACEBUF_OVERWRITE))
+			return 0;
+		ctl->overwritten++;
+	}
+
+	ctl->commit[produced & (tb->n_subbufs - 1)] = buf->offset;
+	smp_wmb();
+	ctl->produced = produced + 1;
+	buf->offset = 0;
+
+	if (waitqueue_active(&buf->wait) && !timer_pending(&buf->timer))
+		mod_timer(&buf->timer, jiffies + 1);
+	return 1;
+}
+
+/**
+ * tracebuf_reserve - start an event in this CPU's buffer
+ * @tb: the buffer
+ * @id: for the event header, the meaning is up to the writer
+ * @len: bytes of event data
+ * @flags: saved interrupt state, for tracebuf_commit()
+ *
+ * Returns where the @len bytes of data go, with interrupts off until
+ * tracebuf_commit(), or NULL if the event was dropped.
+ */
+void *tracebuf_reserve(struct tracebuf *tb, u32 id, size_t len,
+		       unsigned long *flags)
+{
+	struct tracebuf_cpu *buf;
+	struct tracebuf_event *ev;
+	u32 size = ALIGN(sizeof(*ev) + len, TRACEBUF_ALIGN);
+
+	if (unlikely(size > tb->subbuf_size))
+		return NULL;
+
+	local_irq_save(*flags);
+	buf = tb->cpu[smp_processor_id()];
+	if (unlikely(buf->offset + size > tb->subbuf_size) &&
+	    !tracebuf_switch(tb, buf)) {
+		buf->ctl->dropped++;
+		local_irq_restore(*flags);
+		return NULL;
+	}
+
+	ev = (struct tracebuf_event *)(subbuf(buf, buf->ctl->produced) +
+				       buf->offset);
+	buf->offset += size;
+	ev->len = size;
+	ev->id = id;
+	ev->time = sched_clock();
+	return ev + 1;
+}
+EXPORT_SYMBOL_GPL(tracebuf_reserve);
+
+void tracebuf_commit(struct tracebuf *tb, unsigned long flags)
+{
+	local_irq_restore(flags);
+}
+EXPORT_SYMBOL_GPL(tracebuf_commit);
+
+/* Log one event, returns -ENOSPC if it was dropped. */
+int tracebuf_write(struct tracebuf *tb, u32 id, const void *data, size_t len)
+{
+	unsigned long flags;
+	void *p;
+
+	p = tracebuf_reserve(tb, id, len, &flags);
+	if (!p)
+		return -ENOSPC;
+	memcpy(p, data, len);
+	tracebuf_commit(tb, flags);
+	return 0;
+}
+EXPORT_SYMBOL_GPL(tracebuf_write);
+
+static void tracebuf_flush_cpu(void *info)
+{
+	struct tracebuf *tb = info;
+	struct tracebuf_cpu *buf;
+	unsigned long flags;
+
+	local_irq_save(flags);
+	buf = tb->cpu[smp_processor_id()];
+	if (buf->offset)
+		tracebuf_switch(tb, buf);
+	local_irq_restore(flags);
+}
+
+/**
+ * tracebuf_flush - complete the partial sub-buffer of every CPU
+ * @tb: the buffer
+ *
+ * So that readers see the latest events, e.g. when tracing stops.
+ * May not be called with interrupts off.
+ */
+void tracebuf_flush(struct tracebuf *tb)
+{
+	on_each_cpu(tracebuf_flush_cpu, tb, 0, 1);
+}
+EXPORT_SYMBOL_GPL(tracebuf_flush);
+
+static void tracebuf_release(struct kref *kref)
+{
+	struct tracebuf *tb = container_of(kref, struct tracebuf, kref);
+	int cpu;
+
+	for (cpu = 0; cpu < NR_CPUS; cpu++) {
+		if (!tb->cpu[cpu])
+			continue;
+		vfree(tb->cpu[cpu]->ctl);
+		kfree(tb->cpu[cpu]);
+	}
+	kfree(tb);
+}
+
+static int tracebuf_open(struct inode *inode, struct file *file)
+{
+	struct tracebuf_cpu *buf = inode->u.generic_ip;
+
+	file->private_data = buf;
+	kref_get(&buf->tb->kref);
+	return 0;
+}
+
+static int tracebuf_file_release(struct inode *inode, struct file *file)
+{
+	struct tracebuf_cpu *buf = file->private_data;
+
+	kref_put(&buf->tb->kref, tracebuf_release);
+	return 0;
+}
+
+/* complete sub-buffers, oldest first, one at most per call */
+static ssize_t tracebuf_read(struct file *file, char __user *ubuf,
+			     size_t count, loff_t *ppos)
+{
+	struct tracebuf_cpu *buf = file->private_data;
+	struct tracebuf *tb = buf->tb;
+	struct tracebuf_ctl *ctl = buf->ctl;
+	ssize_t ret;
+	u32 len;
+
+	if (down_interruptible(&buf->read_sem))
+		return -ERESTARTSYS;
+
+	while (ctl->consumed == ctl->produced) {
+		up(&buf->read_sem);
+		if (file->f_flags & O_NONBLOCK)
+			return -EAGAIN;
+		if (wait_event_interruptible(buf->wait,
+				ctl->consumed != ctl->produced))
+			return -ERESTARTSYS;
+		if (down_interruptible(&buf->read_sem))
+			return -ERESTARTSYS;
+	}
+
+	/* overwritten meanwhile: skip to the oldest complete one */
+	if (ctl->produced - ctl->consumed >= tb->n_subbufs) {
+		ctl->consumed = ctl->produced - tb->n_subbufs + 1;
+		buf->read_pos = 0;
+	}
+	smp_rmb();
+
+	len = ctl->commit[ctl->consumed & (tb->n_subbufs - 1)];
+	if (count > len - buf->read_pos)
+		count = len - buf->read_pos;
+	ret = -EFAULT;
+	if (copy_to_user(ubuf, subbuf(buf, ctl->consumed) + buf->read_pos,
+			 count))
+		goto out;
+
+	ret = count;
+	buf->read_pos += count;
+	if (buf->read_pos == len) {
+		buf->read_pos = 0;
+		ctl->consumed++;
+	}
+out:
+	up(&buf->read_sem);
+	return ret;
+}
+
+static unsigned int tracebuf_poll(struct file *file, poll_table *wait)
+{
+	struct tracebuf_cpu *buf = file->private_data;
+
+	poll_wait(file, &buf->wait, wait);
+	if (buf->ctl->consumed != buf->ctl->produced)
+		return POLLIN | POLLRDNORM;
+	return 0;
+}
+
+static void tracebuf_vm_open(struct vm_area_struct *vma)
+{
+	struct tracebuf_cpu *buf = vma->vm_private_data;
+
+	kref_get(&buf->tb->kref);
+}
+
+static void tracebuf_vm_close(struct vm_area_struct *vma)
+{
+	struct tracebuf_cpu *buf = vma->vm_private_data;
+
+	kref_put(&buf->tb->kref, tracebuf_release);
+}
+
+static struct page *tracebuf_vm_nopage(struct vm_area_struct *vma,
+				       unsigned long address, int *type)
+{
+	struct tracebuf_cpu *buf = vma->vm_private_data;
+	struct page *page;
+
+	if (address >= vma->vm_end)
+		return NOPAGE_SIGBUS;
+
+	page = vmalloc_to_page((char *)buf->ctl + (address - vma->vm_start));
+	get_page(page);
+	if (type)
+		*type = VM_FAULT_MINOR;
+	return page;
+}
+
+static struct vm_operations_struct tracebuf_vm_ops = {
+	.open	= tracebuf_vm_open,
+	.close	= tracebuf_vm_close,
+	.nopage	= tracebuf_vm_nopage,
+};
+
+static int tracebuf_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct tracebuf_cpu *buf = file->private_data;
+	struct tracebuf *tb = buf->tb;
+	unsigned long size = vma->vm_end - vma->vm_start;
+
+	if (vma->vm_pgoff ||
+	    size > PAGE_ALIGN(PAGE_SIZE + tb->n_subbufs * tb->subbuf_size))
+		return -EINVAL;
+
+	vma->vm_flags |= VM_RESERVED;
+	vma->vm_ops = &tracebuf_vm_ops;
+	vma->vm_private_data = buf;
+	tracebuf_vm_open(vma);
+	return 0;
+}
+
+static struct file_operations tracebuf_fops = {
+	.owner		= THIS_MODULE,
+	.open		= tracebuf_open,
+	.release	= tracebuf_file_release,
+	.read		= tracebuf_read,
+	.poll		= tracebuf_poll,
+	.mmap		= tracebuf_mmap,
+};
+
+static struct tracebuf_cpu *tracebuf_alloc_cpu(struct tracebuf *tb, int cpu)
+{
+	struct tracebuf_cpu *buf;
+	unsigned long size;
+	char name[16];
+
+	buf = kmalloc(sizeof(*buf), GFP_KERNEL);
+	if (!buf)
+		return NULL;
+	memset(buf, 0, sizeof(*buf));
+
+	size = PAGE_ALIGN(PAGE_SIZE + tb->n_subbufs * tb->subbuf_size);
+	buf->ctl = vmalloc(size);
+	if (!buf->ctl) {
+		kfree(buf);
+		return NULL;
+	}
+	memset(buf->ctl, 0, size);
+	buf->ctl->subbuf_size = tb->subbuf_size;
+	buf->ctl->n_subbufs = tb->n_subbufs;
+	buf->ctl->flags = tb->flags;
+	buf->data = (char *)buf->ctl + PAGE_SIZE;
+	buf->tb = tb;
+
+	init_waitqueue_head(&buf->wait);
+	init_timer(&buf->timer);
+	buf->timer.function = tracebuf_wakeup;
+	buf->timer.data = (unsigned long)buf;
+	init_MUTEX(&buf->read_sem);
+
+	sprintf(name, "cpu%d", cpu);
+	buf->dentry = debugfs_create_file(name, S_IRUSR, tb->dir, buf,
+					  &tracebuf_fops);
+	/* set before the buffer is used, so the cleanup can find it */
+	tb->cpu[cpu] = buf;
+	return buf;
+}
+
+/**
+ * tracebuf_create - create a set of per-CPU trace buffers
+ * @name: directory for the cpu<n> files, in @parent or the debugfs root
+ * @parent: or NULL
+ * @subbuf_size: bytes per sub-buffer, the largest event that fits
+ * @n_subbufs: sub-buffers per CPU, a power of 2 and at least 2
+ * @flags: TRACEBUF_OVERWRITE or 0
+ *
+ * Returns NULL on failure.  May sleep.
+ */
+struct tracebuf *tracebuf_create(const char *name, struct dentry *parent,
+				 size_t subbuf_size, unsigned int n_subbufs,
+				 unsigned int flags)
+{
+	struct tracebuf *tb;
+	int cpu;
+
+	if (n_subbufs < 2 || (n_subbufs & (n_subbufs - 1)) ||
+	    n_subbufs > (PAGE_SIZE - sizeof(struct tracebuf_ctl)) / sizeof(u32) ||
+	    subbuf_size < sizeof(struct tracebuf_event) ||
+	    subbuf_size % TRACEBUF_ALIGN)
+		return NULL;
+
+	tb = kmalloc(sizeof(*tb), GFP_KERNEL);
+	if (!tb)
+		return NULL;
+	memset(tb, 0, sizeof(*tb));
+	kref_init(&tb->kref);
+	tb->flags = flags;
+	tb->subbuf_size = subbuf_size;
+	tb->n_subbufs = n_subbufs;
+
+	tb->dir = debugfs_create_dir(name, parent);
+	if (!tb->dir)
+		goto fail;
+
+	for_each_cpu(cpu)
+		if (!tracebuf_alloc_cpu(tb, cpu))
+			goto fail;
+	return tb;
+
+fail:
+	tracebuf_destroy(tb);
+	return NULL;
+}
+EXPORT_SYMBOL_GPL(tracebuf_create);
+
+/**
+ * tracebuf_destroy - remove trace buffers
+ * @tb: from tracebuf_create()
+ *
+ * Writers must be done with @tb.  The memory stays until the last
+ * reader has closed and unmapped its files.
+ */
+void tracebuf_destroy(struct tracebuf *tb)
+{
+	int cpu;
+
+	for (cpu = 0; cpu < NR_CPUS; cpu++) {
+		struct tracebuf_cpu *buf = tb->cpu[cpu];
+
+		if (!buf)
+			continue;
+		if (buf->dentry)
+			debugfs_remove(buf->dentry);
+		del_timer_sync(&buf->timer);
+		/* nothing will wake up readers anymore */
+		wake_up_interruptible(&buf->wait);
+	}
+	if (tb->dir)
+		debugfs_remove(tb->dir);
+	kref_put(&tb->kref, tracebuf_release);
+}
+EXPORT_SYMBOL_GPL(tracebuf_destroy);
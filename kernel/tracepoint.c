@@ -0,0 +1,126 @@
+/*
+ * Static tracepoints, see include/linux/tracepoint.h.
+ *
+ * The probes of a tracepoint are an array which is never changed once
+ * it is visible: attaching or detaching a probe builds a new array,
+ * publishes it and frees the old one after a grace period, so the
+ * tracepoint itself takes no lock.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/rcupdate.h>
+#include <linux/tracepoint.h>
+#include <asm/semaphore.h>
+
+/* serializes changes to any tracepoint's probes */
+static DECLARE_MUTEX(tracepoint_sem);
+
+static int count_probes(void **funcs)
+{
+	int n = 0;
+
+	if (funcs)
+		while (funcs[n])
+			n++;
+	return n;
+}
+
+/* publish new, which may be NULL, and free the old array once unused */
+static void replace_probes(struct tracepoint *tp, void **new)
+{
+	void **old = tp->funcs;
+
+	if (new)
+		tp->state = 1;
+	rcu_assign_pointer(tp->funcs, new);
+	if (!new)
+		tp->state = 0;
+	up(&tracepoint_sem);
+
+	/* also makes sure a detached probe is no longer running */
+	synchronize_kernel();
+	kfree(old);
+}
+
+/**
+ * tracepoint_probe_register - attach a probe to a tracepoint
+ * @tp: the tracepoint
+ * @probe: function with the prototype of the tracepoint
+ *
+ * Usually called through register_trace_<name>().  Returns -EEXIST if
+ * @probe is attached already.  May sleep.
+ */
+int tracepoint_probe_register(struct tracepoint *tp, void *probe)
+{
+	void **new;
+	int i, n;
+
+	down(&tracepoint_sem);
+	n = count_probes(tp->funcs);
+	for (i = 0; i < n; i++)
+		if (tp->funcs[i] == probe) {
+			up(&tracepoint_sem);
+			return -EEXIST;
+		}
+
+	new = kmalloc((n + 2) * sizeof(void *), GFP_KERNEL);
+	if (!new) {
+		up(&tracepoint_sem);
+		return -ENOMEM;
+	}
+	if (n)
+		memcpy(new, tp->funcs, n * sizeof(void *));
+	new[n] = probe;
+	new[n + 1] = NULL;
+
+	replace_probes(tp, new);
+	return 0;
+}
+EXPORT_SYMBOL_GPL(tracepoint_probe_register);
+
+/**
+ * tracepoint_probe_unregister - detach a probe from a tracepoint
+ * @tp: the tracepoint
+ * @probe: as given to tracepoint_probe_register()
+ *
+ * When this returns, @probe is not running on any CPU anymore and
+ * a module providing it can go away.  Returns -ENOENT if @probe was
+ * not attached.  May sleep.
+ */
+int tracepoint_probe_unregister(struct tracepoint *tp, void *probe)
+{
+	void **new = NULL;
+	int i, j, n;
+
+	down(&tracepoint_sem);
+	n = count_probes(tp->funcs);
+	for (i = 0; i < n; i++)
+		if (tp->funcs[i] == probe)
+			break;
+	if (i == n) {
+		up(&tracepoint_sem);
+		return -ENOENT;
+	}
+
+	if (n > 1) {
+		new = kmalloc(n * sizeof(void *), GFP_KERNEL);
+		if (!new) {
+			up(&tracepoint_sem);
+			return -ENOMEM;
+		}
+		for (i = j = 0; i < n; i++)
+			if (tp->funcs[i] != probe)
+				new[j++] = tp->funcs[i];
+		new[j] = NULL;
+	}
+
+	replace_probes(tp, new);
+	return 0;
+}
+EXPORT_SYMBOL_GPL(tracepoint_probe_unregister);
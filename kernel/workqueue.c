@@ -27,29 +27,71 @@
 #include <linux/kthread.h>
 
 /*
- * The per-CPU workqueue (if single thread, we always use cpu 0's).
+ * Work is run by pools of worker threads.  Each cpu has one pool shared
+ * by all the multithreaded workqueues, and each single threaded workqueue
+ * owns a pool of one worker, which serializes its work.
  *
- * The sequence counters are for flush_scheduled_work().  It wants to wait
- * until until all currently-scheduled works are completed, but it doesn't
- * want to be livelocked by new, incoming ones.  So it waits until
- * remove_sequence is >= the insert_sequence which pertained when
- * flush_scheduled_work() was called.
+ * The workers of a shared pool are concurrency managed: while one of them
+ * is running, newly queued work waits for it, and when the last running
+ * worker goes to sleep inside a work function, the scheduler tells us to
+ * wake up an idle one to carry on.  A worker that leaves the idle list as
+ * the last one first creates a new idle worker, so that there is always
+ * one to wake.  Workers which stay idle for IDLE_WORKER_TIMEOUT exit, down
+ * to one idle worker per pool.
  */
-struct cpu_workqueue_struct {
-
+struct worker_pool {
 	spinlock_t lock;
 
-	long remove_sequence;	/* Least-recently added (next to run) */
-	long insert_sequence;	/* Next to add */
+	struct list_head worklist;	/* Queued work, of any workqueue */
+	struct list_head idle_list;	/* Idle workers, most recent first */
+	struct list_head busy_list;	/* Workers running work */
+	int nr_workers;
+	int nr_idle;
+	atomic_t nr_running;		/* Busy workers not sleeping */
+
+	unsigned int flags;
+	int cpu;			/* Bound cpu, -1 if single threaded */
+	const char *name;		/* Worker name if single threaded */
+	struct completion *exited;	/* Last worker gone, when dying */
+};
 
-	struct list_head worklist;
-	wait_queue_head_t more_work;
-	wait_queue_head_t work_done;
+#define POOL_SINGLE	1		/* One worker, no concurrency */
+#define POOL_MANAGING	2		/* A worker is creating a worker */
+#define POOL_DYING	4		/* Workers exit once idle */
 
-	struct workqueue_struct *wq;
-	task_t *thread;
+#define IDLE_WORKER_TIMEOUT	(300 * HZ)
+
+struct worker {
+	struct list_head entry;		/* On idle_list or busy_list */
+	struct list_head scheduled;	/* Work to run next, see collision */
+	struct worker_pool *pool;
+	task_t *task;
+
+	struct work_struct *current_work;
+	struct cpu_workqueue_struct *current_cwq;
+	int current_color;
 
+	unsigned int flags;
 	int run_depth;		/* Detect run_workqueue() recursion depth */
+};
+
+#define WORKER_RUNNING	1		/* Counted in pool->nr_running */
+
+/*
+ * The per-CPU part of a workqueue (if single thread, we always use cpu 0's).
+ *
+ * With several workers running its work at once, completions come out of
+ * order, so flush_workqueue() cannot just wait for a sequence number.
+ * Instead new work is tagged with the current color, and a flush flips the
+ * color and waits until no work of the old color is in flight.
+ */
+struct cpu_workqueue_struct {
+	struct worker_pool *pool;
+	struct workqueue_struct *wq;
+
+	int color;			/* Color of newly queued work */
+	int nr_in_flight[2];		/* Queued and running work by color */
+	wait_queue_head_t work_done;
 } ____cacheline_aligned;
 
 /*
@@ -58,33 +100,89 @@ struct cpu_workqueue_struct {
  */
 struct workqueue_struct {
 	struct cpu_workqueue_struct cpu_wq[NR_CPUS];
+	struct worker_pool single_pool;	/* If single thread */
 	const char *name;
-	struct list_head list; 	/* Empty if single thread */
+	int singlethread;
 };
 
-/* All the per-cpu workqueues on the system, for hotplug cpu to add/remove
-   threads to each one as cpus come/go. */
-static DEFINE_SPINLOCK(workqueue_lock);
-static LIST_HEAD(workqueues);
+static DEFINE_PER_CPU(struct worker_pool, worker_pools);
 
-/* If it's single threaded, it isn't in the list of workqueues. */
 static inline int is_single_threaded(struct workqueue_struct *wq)
 {
-	return list_empty(&wq->list);
+	return wq->singlethread;
+}
+
+/* The color lives in the bit after the pending bit */
+#define WORK_COLOR_BIT	1
+
+static inline int work_color(struct work_struct *work)
+{
+	return test_bit(WORK_COLOR_BIT, &work->pending);
+}
+
+static inline void set_work_color(struct work_struct *work, int color)
+{
+	if (color)
+		set_bit(WORK_COLOR_BIT, &work->pending);
+	else
+		clear_bit(WORK_COLOR_BIT, &work->pending);
+}
+
+static void init_worker_pool(struct worker_pool *pool, int cpu,
+			     const char *name)
+{
+	spin_lock_init(&pool->lock);
+	INIT_LIST_HEAD(&pool->worklist);
+	INIT_LIST_HEAD(&pool->idle_list);
+	INIT_LIST_HEAD(&pool->busy_list);
+	pool->nr_workers = 0;
+	pool->nr_idle = 0;
+	atomic_set(&pool->nr_running, 0);
+	pool->flags = name ? POOL_SINGLE : 0;
+	pool->cpu = cpu;
+	pool->name = name;
+	pool->exited = NULL;
+}
+
+/*
+ * Queued work needs another worker when none is running.
+ */
+static inline int need_more_worker(struct worker_pool *pool)
+{
+	return !list_empty(&pool->worklist) && !atomic_read(&pool->nr_running);
+}
+
+/*
+ * A worker goes on with queued work as long as it is the only one running.
+ */
+static inline int keep_working(struct worker_pool *pool)
+{
+	return !list_empty(&pool->worklist) &&
+		atomic_read(&pool->nr_running) <= 1;
+}
+
+/* Called with pool->lock held. */
+static void wake_up_worker(struct worker_pool *pool)
+{
+	if (need_more_worker(pool) && !list_empty(&pool->idle_list))
+		wake_up_process(list_entry(pool->idle_list.next,
+					   struct worker, entry)->task);
 }
 
 /* Preempt must be disabled. */
 static void __queue_work(struct cpu_workqueue_struct *cwq,
 			 struct work_struct *work)
 {
+	struct worker_pool *pool = cwq->pool;
 	unsigned long flags;
 
-	spin_lock_irqsave(&cwq->lock, flags);
+	spin_lock_irqsave(&pool->lock, flags);
 	work->wq_data = cwq;
-	list_add_tail(&work->entry, &cwq->worklist);
-	cwq->insert_sequence++;
-	wake_up(&cwq->more_work);
-	spin_unlock_irqrestore(&cwq->lock, flags);
+	set_work_color(work, cwq->color);
+	cwq->nr_in_flight[cwq->color]++;
+	list_add_tail(&work->entry, &pool->worklist);
+	wake_up_worker(pool);
+	spin_unlock_irqrestore(&pool->lock, flags);
 }
 
 /*
@@ -109,6 +207,29 @@ int fastcall queue_work(struct workqueue_struct *wq, struct work_struct *work)
 	return ret;
 }
 
+/*
+ * Like queue_work(), but on the queue of @cpu.  If @cpu is not online the
+ * work goes to the submitting CPU instead; with preemption disabled here
+ * no CPU can go away under us.
+ */
+int fastcall queue_work_on(int cpu, struct workqueue_struct *wq,
+			   struct work_struct *work)
+{
+	int ret = 0, this_cpu = get_cpu();
+
+	if (!test_and_set_bit(0, &work->pending)) {
+		if (unlikely(is_single_threaded(wq)))
+			cpu = 0;
+		else if (!cpu_online(cpu))
+			cpu = this_cpu;
+		BUG_ON(!list_empty(&work->entry));
+		__queue_work(wq->cpu_wq + cpu, work);
+		ret = 1;
+	}
+	put_cpu();
+	return ret;
+}
+
 static void delayed_work_timer_fn(unsigned long __data)
 {
 	struct work_struct *work = (struct work_struct *)__data;
@@ -142,47 +263,234 @@ int fastcall queue_delayed_work(struct workqueue_struct *wq,
 	return ret;
 }
 
-static inline void run_workqueue(struct cpu_workqueue_struct *cwq)
+/*
+ * A work that requeues itself may come up again while it still runs.
+ * It is then left to the worker running it, so that a work never runs
+ * concurrently with itself on one pool.  Called with pool->lock held.
+ */
+static struct worker *find_worker_executing(struct worker_pool *pool,
+					    struct work_struct *work)
 {
-	unsigned long flags;
+	struct worker *worker;
+
+	list_for_each_entry(worker, &pool->busy_list, entry)
+		if (worker->current_work == work)
+			return worker;
+	return NULL;
+}
+
+/*
+ * Run one work, with pool->lock dropped around its function.
+ */
+static void process_one_work(struct worker *worker, struct work_struct *work)
+{
+	struct worker_pool *pool = worker->pool;
+	struct cpu_workqueue_struct *cwq = work->wq_data;
+	struct work_struct *prev_work = worker->current_work;
+	struct cpu_workqueue_struct *prev_cwq = worker->current_cwq;
+	int prev_color = worker->current_color;
+	void (*f) (void *) = work->func;
+	void *data = work->data;
+	int color = work_color(work);
+
+	list_del_init(&work->entry);
+	worker->current_work = work;
+	worker->current_cwq = cwq;
+	worker->current_color = color;
+	spin_unlock_irq(&pool->lock);
+
+	clear_bit(0, &work->pending);
+	f(data);
+
+	spin_lock_irq(&pool->lock);
+	worker->current_work = prev_work;
+	worker->current_cwq = prev_cwq;
+	worker->current_color = prev_color;
+	cwq->nr_in_flight[color]--;
+	if (waitqueue_active(&cwq->work_done))
+		wake_up(&cwq->work_done);
+}
+
+/*
+ * Keep taking off work from the pool until done, or until other
+ * workers are running too.  Called with pool->lock held.
+ */
+static void process_works(struct worker *worker)
+{
+	struct worker_pool *pool = worker->pool;
+	struct work_struct *work;
+	struct worker *collision;
+
+	for (;;) {
+		if (!list_empty(&worker->scheduled)) {
+			work = list_entry(worker->scheduled.next,
+					  struct work_struct, entry);
+		} else if (keep_working(pool)) {
+			work = list_entry(pool->worklist.next,
+					  struct work_struct, entry);
+			collision = find_worker_executing(pool, work);
+			if (unlikely(collision)) {
+				list_move_tail(&work->entry,
+					       &collision->scheduled);
+				continue;
+			}
+		} else
+			break;
+		process_one_work(worker, work);
+	}
+}
 
-	/*
-	 * Keep taking off work from the queue until
-	 * done.
-	 */
-	spin_lock_irqsave(&cwq->lock, flags);
-	cwq->run_depth++;
-	if (cwq->run_depth > 3) {
+/*
+ * run_workqueue - run the queued work of a single threaded workqueue by
+ * hand, from one of its own works.
+ */
+static void run_workqueue(struct worker *worker)
+{
+	struct worker_pool *pool = worker->pool;
+
+	spin_lock_irq(&pool->lock);
+	worker->run_depth++;
+	if (worker->run_depth > 3) {
 		/* morton gets to eat his hat */
 		printk("%s: recursion depth exceeded: %d\n",
-			__FUNCTION__, cwq->run_depth);
+			__FUNCTION__, worker->run_depth);
 		dump_stack();
 	}
-	while (!list_empty(&cwq->worklist)) {
-		struct work_struct *work = list_entry(cwq->worklist.next,
-						struct work_struct, entry);
-		void (*f) (void *) = work->func;
-		void *data = work->data;
+	while (!list_empty(&pool->worklist))
+		process_one_work(worker, list_entry(pool->worklist.next,
+						struct work_struct, entry));
+	worker->run_depth--;
+	spin_unlock_irq(&pool->lock);
+}
+
+/* Called with pool->lock held. */
+static void worker_leave_idle(struct worker *worker)
+{
+	struct worker_pool *pool = worker->pool;
+
+	pool->nr_idle--;
+	list_move(&worker->entry, &pool->busy_list);
+	worker->flags |= WORKER_RUNNING;
+	atomic_inc(&pool->nr_running);
+}
 
-		list_del_init(cwq->worklist.next);
-		spin_unlock_irqrestore(&cwq->lock, flags);
+/* Called with pool->lock held. */
+static void worker_enter_idle(struct worker *worker)
+{
+	struct worker_pool *pool = worker->pool;
 
-		BUG_ON(work->wq_data != cwq);
-		clear_bit(0, &work->pending);
-		f(data);
+	worker->flags &= ~WORKER_RUNNING;
+	atomic_dec(&pool->nr_running);
+	pool->nr_idle++;
+	list_move(&worker->entry, &pool->idle_list);
+}
 
-		spin_lock_irqsave(&cwq->lock, flags);
-		cwq->remove_sequence++;
-		wake_up(&cwq->work_done);
+/*
+ * Sleep on the idle list until there is work to do.  Returns 0 if the
+ * worker should exit instead.  Called and returns with pool->lock held.
+ */
+static int worker_wait(struct worker *worker)
+{
+	struct worker_pool *pool = worker->pool;
+	long timeout = IDLE_WORKER_TIMEOUT;
+
+	for (;;) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (need_more_worker(pool))
+			break;
+		if (pool->flags & POOL_DYING) {
+			if (list_empty(&pool->worklist))
+				goto exit;
+		} else if (!timeout && pool->nr_idle > 1 &&
+			   !(pool->flags & POOL_SINGLE))
+			goto exit;
+		spin_unlock_irq(&pool->lock);
+		timeout = schedule_timeout(IDLE_WORKER_TIMEOUT);
+		spin_lock_irq(&pool->lock);
+	}
+	__set_current_state(TASK_RUNNING);
+	return 1;
+exit:
+	__set_current_state(TASK_RUNNING);
+	return 0;
+}
+
+static int worker_thread(void *__worker);
+
+static struct worker *create_worker(struct worker_pool *pool, int bind)
+{
+	struct worker *worker;
+	struct task_struct *p;
+
+	worker = kmalloc(sizeof(*worker), GFP_KERNEL);
+	if (!worker)
+		return NULL;
+	memset(worker, 0, sizeof(*worker));
+	INIT_LIST_HEAD(&worker->entry);
+	INIT_LIST_HEAD(&worker->scheduled);
+	worker->pool = pool;
+
+	if (pool->name)
+		p = kthread_create(worker_thread, worker, "%s", pool->name);
+	else
+		p = kthread_create(worker_thread, worker, "worker/%d",
+				   pool->cpu);
+	if (IS_ERR(p)) {
+		kfree(worker);
+		return NULL;
 	}
-	cwq->run_depth--;
-	spin_unlock_irqrestore(&cwq->lock, flags);
+	if (bind)
+		kthread_bind(p, pool->cpu);
+	worker->task = p;
+	return worker;
 }
 
-static int worker_thread(void *__cwq)
+/* Put a new worker on the idle list.  Called with pool->lock held. */
+static void start_worker(struct worker *worker)
+{
+	struct worker_pool *pool = worker->pool;
+
+	pool->nr_workers++;
+	pool->nr_idle++;
+	list_add(&worker->entry, &pool->idle_list);
+}
+
+/*
+ * Keep an idle worker around for when the running one sleeps.  Called
+ * with pool->lock held, which is dropped while the worker is created.
+ */
+static void manage_workers(struct worker_pool *pool)
 {
-	struct cpu_workqueue_struct *cwq = __cwq;
-	DECLARE_WAITQUEUE(wait, current);
+	struct worker *worker;
+
+	if (pool->nr_idle ||
+	    (pool->flags & (POOL_SINGLE | POOL_MANAGING | POOL_DYING)))
+		return;
+
+	pool->flags |= POOL_MANAGING;
+	spin_unlock_irq(&pool->lock);
+	worker = create_worker(pool, 1);
+	spin_lock_irq(&pool->lock);
+	pool->flags &= ~POOL_MANAGING;
+
+	if (!worker)
+		return;
+	if (pool->flags & POOL_DYING) {
+		/* Never woken up, it exits without running worker_thread */
+		spin_unlock_irq(&pool->lock);
+		kthread_stop(worker->task);
+		kfree(worker);
+		spin_lock_irq(&pool->lock);
+		return;
+	}
+	start_worker(worker);
+	wake_up_process(worker->task);
+}
+
+static int worker_thread(void *__worker)
+{
+	struct worker *worker = __worker;
+	struct worker_pool *pool = worker->pool;
 	struct k_sigaction sa;
 	sigset_t blocked;
 
@@ -201,47 +509,135 @@ static int worker_thread(void *__cwq)
 	siginitset(&sa.sa.sa_mask, sigmask(SIGCHLD));
 	do_sigaction(SIGCHLD, &sa, (struct k_sigaction *)0);
 
-	set_current_state(TASK_INTERRUPTIBLE);
-	while (!kthread_should_stop()) {
-		add_wait_queue(&cwq->more_work, &wait);
-		if (list_empty(&cwq->worklist))
-			schedule();
-		else
-			__set_current_state(TASK_RUNNING);
-		remove_wait_queue(&cwq->more_work, &wait);
-
-		if (!list_empty(&cwq->worklist))
-			run_workqueue(cwq);
-		set_current_state(TASK_INTERRUPTIBLE);
+	current->wq_worker = worker;
+
+	spin_lock_irq(&pool->lock);
+	while (worker_wait(worker)) {
+		worker_leave_idle(worker);
+		manage_workers(pool);
+		process_works(worker);
+		worker_enter_idle(worker);
 	}
-	__set_current_state(TASK_RUNNING);
+
+	current->wq_worker = NULL;
+	list_del(&worker->entry);
+	pool->nr_idle--;
+	pool->nr_workers--;
+	if (!pool->nr_workers && pool->exited)
+		complete(pool->exited);
+	spin_unlock_irq(&pool->lock);
+
+	kfree(worker);
 	return 0;
 }
 
+/*
+ * Stop all the workers of a pool once they are idle and the pool has no
+ * more work queued, and wait for them to exit.
+ */
+static void destroy_workers(struct worker_pool *pool)
+{
+	DECLARE_COMPLETION(exited);
+	struct worker *worker;
+
+	spin_lock_irq(&pool->lock);
+	pool->flags |= POOL_DYING;
+	if (pool->nr_workers) {
+		pool->exited = &exited;
+		list_for_each_entry(worker, &pool->idle_list, entry)
+			wake_up_process(worker->task);
+		spin_unlock_irq(&pool->lock);
+		wait_for_completion(&exited);
+		/* The last worker may still be dropping the lock */
+		spin_lock_irq(&pool->lock);
+		pool->exited = NULL;
+	}
+	pool->flags &= ~POOL_DYING;
+	spin_unlock_irq(&pool->lock);
+}
+
+/*
+ * Called by the scheduler when a worker is about to sleep: if it was the
+ * last one running, wake up an idle worker to take over the queued work.
+ * Returns 1 if the worker was accounted as sleeping.
+ */
+int wq_worker_sleeping(task_t *task)
+{
+	struct worker *worker = task->wq_worker;
+	struct worker_pool *pool = worker->pool;
+	unsigned long flags;
+
+	if (!(worker->flags & WORKER_RUNNING) || (pool->flags & POOL_SINGLE))
+		return 0;
+
+	if (atomic_dec_and_test(&pool->nr_running)) {
+		spin_lock_irqsave(&pool->lock, flags);
+		wake_up_worker(pool);
+		spin_unlock_irqrestore(&pool->lock, flags);
+	}
+	return 1;
+}
+
+/*
+ * Called by the scheduler when a worker accounted as sleeping runs again.
+ */
+void wq_worker_waking_up(task_t *task)
+{
+	atomic_inc(&task->wq_worker->pool->nr_running);
+}
+
+/*
+ * Does current run a work of cwq with this color?  Its own work does not
+ * hold up a flush issued from it.
+ */
+static inline int self_in_flight(struct cpu_workqueue_struct *cwq, int color)
+{
+	struct worker *worker = current->wq_worker;
+
+	return worker && worker->current_cwq == cwq &&
+		worker->current_color == color;
+}
+
+/*
+ * Wait until no work of this color is in flight.  Called with pool->lock
+ * held, which is dropped while sleeping.
+ */
+static void wait_cwq_color(struct cpu_workqueue_struct *cwq, int color)
+{
+	struct worker_pool *pool = cwq->pool;
+	DEFINE_WAIT(wait);
+
+	while (cwq->nr_in_flight[color] > self_in_flight(cwq, color)) {
+		prepare_to_wait(&cwq->work_done, &wait, TASK_UNINTERRUPTIBLE);
+		spin_unlock_irq(&pool->lock);
+		schedule();
+		spin_lock_irq(&pool->lock);
+	}
+	finish_wait(&cwq->work_done, &wait);
+}
+
 static void flush_cpu_workqueue(struct cpu_workqueue_struct *cwq)
 {
-	if (cwq->thread == current) {
+	struct worker_pool *pool = cwq->pool;
+	struct worker *worker = current->wq_worker;
+
+	if (worker && worker->pool == pool && (pool->flags & POOL_SINGLE)) {
 		/*
-		 * Probably keventd trying to flush its own queue. So simply run
-		 * it by hand rather than deadlocking.
+		 * Probably a single threaded workqueue trying to flush its
+		 * own queue. So simply run it by hand rather than deadlocking.
 		 */
-		run_workqueue(cwq);
+		run_workqueue(worker);
 	} else {
-		DEFINE_WAIT(wait);
-		long sequence_needed;
-
-		spin_lock_irq(&cwq->lock);
-		sequence_needed = cwq->insert_sequence;
-
-		while (sequence_needed - cwq->remove_sequence > 0) {
-			prepare_to_wait(&cwq->work_done, &wait,
-					TASK_UNINTERRUPTIBLE);
-			spin_unlock_irq(&cwq->lock);
-			schedule();
-			spin_lock_irq(&cwq->lock);
-		}
-		finish_wait(&cwq->work_done, &wait);
-		spin_unlock_irq(&cwq->lock);
+		spin_lock_irq(&pool->lock);
+		/*
+		 * Only the current color takes new work.  Wait for another
+		 * flush to finish with the old color, then flip the color
+		 * and wait for the work queued before us.
+		 */
+		wait_cwq_color(cwq, !cwq->color);
+		cwq->color = !cwq->color;
+		wait_cwq_color(cwq, !cwq->color);
+		spin_unlock_irq(&pool->lock);
 	}
 }
 
@@ -251,10 +647,8 @@ static void flush_cpu_workqueue(struct cpu_workqueue_struct *cwq)
  * Forces execution of the workqueue and blocks until its completion.
  * This is typically used in driver shutdown handlers.
  *
- * This function will sample each workqueue's current insert_sequence number and
- * will sleep until the head sequence is greater than or equal to that.  This
- * means that we sleep until all works which were queued on entry have been
- * handled, but we are not livelocked by new incoming ones.
+ * This function will sleep until all works which were queued on entry
+ * have been handled, but we are not livelocked by new incoming ones.
  *
  * This function used to run the workqueues itself.  Now we just wait for the
  * helper threads to do it.
@@ -276,37 +670,25 @@ void fastcall flush_workqueue(struct workqueue_struct *wq)
 	}
 }
 
-static struct task_struct *create_workqueue_thread(struct workqueue_struct *wq,
-						   int cpu)
+static void init_cpu_workqueue(struct workqueue_struct *wq,
+			       struct worker_pool *pool, int cpu)
 {
 	struct cpu_workqueue_struct *cwq = wq->cpu_wq + cpu;
-	struct task_struct *p;
 
-	spin_lock_init(&cwq->lock);
+	cwq->pool = pool;
 	cwq->wq = wq;
-	cwq->thread = NULL;
-	cwq->insert_sequence = 0;
-	cwq->remove_sequence = 0;
-	INIT_LIST_HEAD(&cwq->worklist);
-	init_waitqueue_head(&cwq->more_work);
+	cwq->color = 0;
+	cwq->nr_in_flight[0] = 0;
+	cwq->nr_in_flight[1] = 0;
 	init_waitqueue_head(&cwq->work_done);
-
-	if (is_single_threaded(wq))
-		p = kthread_create(worker_thread, cwq, "%s", wq->name);
-	else
-		p = kthread_create(worker_thread, cwq, "%s/%d", wq->name, cpu);
-	if (IS_ERR(p))
-		return NULL;
-	cwq->thread = p;
-	return p;
 }
 
 struct workqueue_struct *__create_workqueue(const char *name,
 					    int singlethread)
 {
-	int cpu, destroy = 0;
 	struct workqueue_struct *wq;
-	struct task_struct *p;
+	struct worker *worker;
+	int cpu;
 
 	BUG_ON(strlen(name) > 10);
 
@@ -316,73 +698,33 @@ struct workqueue_struct *__create_workqueue(const char *name,
 	memset(wq, 0, sizeof(*wq));
 
 	wq->name = name;
-	/* We don't need the distraction of CPUs appearing and vanishing. */
-	lock_cpu_hotplug();
+	wq->singlethread = singlethread;
 	if (singlethread) {
-		INIT_LIST_HEAD(&wq->list);
-		p = create_workqueue_thread(wq, 0);
-		if (!p)
-			destroy = 1;
-		else
-			wake_up_process(p);
-	} else {
-		spin_lock(&workqueue_lock);
-		list_add(&wq->list, &workqueues);
-		spin_unlock(&workqueue_lock);
-		for_each_online_cpu(cpu) {
-			p = create_workqueue_thread(wq, cpu);
-			if (p) {
-				kthread_bind(p, cpu);
-				wake_up_process(p);
-			} else
-				destroy = 1;
+		init_worker_pool(&wq->single_pool, -1, name);
+		init_cpu_workqueue(wq, &wq->single_pool, 0);
+		worker = create_worker(&wq->single_pool, 0);
+		if (!worker) {
+			kfree(wq);
+			return NULL;
 		}
-	}
-	unlock_cpu_hotplug();
-
-	/*
-	 * Was there any error during startup? If yes then clean up:
-	 */
-	if (destroy) {
-		destroy_workqueue(wq);
-		wq = NULL;
+		spin_lock_irq(&wq->single_pool.lock);
+		start_worker(worker);
+		spin_unlock_irq(&wq->single_pool.lock);
+		wake_up_process(worker->task);
+	} else {
+		/* The shared pools of offline cpus are set up too */
+		for (cpu = 0; cpu < NR_CPUS; cpu++)
+			init_cpu_workqueue(wq, &per_cpu(worker_pools, cpu), cpu);
 	}
 	return wq;
 }
 
-static void cleanup_workqueue_thread(struct workqueue_struct *wq, int cpu)
-{
-	struct cpu_workqueue_struct *cwq;
-	unsigned long flags;
-	struct task_struct *p;
-
-	cwq = wq->cpu_wq + cpu;
-	spin_lock_irqsave(&cwq->lock, flags);
-	p = cwq->thread;
-	cwq->thread = NULL;
-	spin_unlock_irqrestore(&cwq->lock, flags);
-	if (p)
-		kthread_stop(p);
-}
-
 void destroy_workqueue(struct workqueue_struct *wq)
 {
-	int cpu;
-
 	flush_workqueue(wq);
 
-	/* We don't need the distraction of CPUs appearing and vanishing. */
-	lock_cpu_hotplug();
 	if (is_single_threaded(wq))
-		cleanup_workqueue_thread(wq, 0);
-	else {
-		for_each_online_cpu(cpu)
-			cleanup_workqueue_thread(wq, cpu);
-		spin_lock(&workqueue_lock);
-		list_del(&wq->list);
-		spin_unlock(&workqueue_lock);
-	}
-	unlock_cpu_hotplug();
+		destroy_workers(&wq->single_pool);
 	kfree(wq);
 }
 
@@ -454,38 +796,42 @@ int keventd_up(void)
 
 int current_is_keventd(void)
 {
-	struct cpu_workqueue_struct *cwq;
-	int cpu = smp_processor_id();	/* preempt-safe: keventd is per-cpu */
-	int ret = 0;
+	struct worker *worker = current->wq_worker;
 
 	BUG_ON(!keventd_wq);
 
-	cwq = keventd_wq->cpu_wq + cpu;
-	if (current == cwq->thread)
-		ret = 1;
-
-	return ret;
-
+	return worker && worker->current_cwq &&
+		worker->current_cwq->wq == keventd_wq;
 }
 
 #ifdef CONFIG_HOTPLUG_CPU
 /* Take the work from this (downed) CPU. */
-static void take_over_work(struct workqueue_struct *wq, unsigned int cpu)
+static void take_over_work(struct worker_pool *pool)
 {
-	struct cpu_workqueue_struct *cwq = wq->cpu_wq + cpu;
-	LIST_HEAD(list);
+	struct cpu_workqueue_struct *cwq;
 	struct work_struct *work;
+	LIST_HEAD(list);
+	int cpu;
 
-	spin_lock_irq(&cwq->lock);
-	list_splice_init(&cwq->worklist, &list);
+	spin_lock_irq(&pool->lock);
+	list_splice_init(&pool->worklist, &list);
+	list_for_each_entry(work, &list, entry) {
+		cwq = work->wq_data;
+		cwq->nr_in_flight[work_color(work)]--;
+		if (waitqueue_active(&cwq->work_done))
+			wake_up(&cwq->work_done);
+	}
+	spin_unlock_irq(&pool->lock);
 
+	cpu = get_cpu();
 	while (!list_empty(&list)) {
-		printk("Taking work for %s\n", wq->name);
-		work = list_entry(list.next,struct work_struct,entry);
-		list_del(&work->entry);
-		__queue_work(wq->cpu_wq + smp_processor_id(), work);
+		work = list_entry(list.next, struct work_struct, entry);
+		cwq = work->wq_data;
+		printk("Taking work for %s\n", cwq->wq->name);
+		list_del_init(&work->entry);
+		__queue_work(cwq->wq->cpu_wq + cpu, work);
 	}
-	spin_unlock_irq(&cwq->lock);
+	put_cpu();
 }
 
 /* We're holding the cpucontrol mutex here */
@@ -494,41 +840,44 @@ static int __devinit workqueue_cpu_callback(struct notifier_block *nfb,
 				  void *hcpu)
 {
 	unsigned int hotcpu = (unsigned long)hcpu;
-	struct workqueue_struct *wq;
+	struct worker_pool *pool = &per_cpu(worker_pools, hotcpu);
+	struct worker *worker;
 
 	switch (action) {
 	case CPU_UP_PREPARE:
-		/* Create a new workqueue thread for it. */
-		list_for_each_entry(wq, &workqueues, list) {
-			if (create_workqueue_thread(wq, hotcpu) < 0) {
-				printk("workqueue for %i failed\n", hotcpu);
-				return NOTIFY_BAD;
-			}
+		/* Create the first worker for it. */
+		worker = create_worker(pool, 0);
+		if (!worker) {
+			printk("workqueue for %i failed\n", hotcpu);
+			return NOTIFY_BAD;
 		}
+		spin_lock_irq(&pool->lock);
+		start_worker(worker);
+		spin_unlock_irq(&pool->lock);
 		break;
 
 	case CPU_ONLINE:
-		/* Kick off worker threads. */
-		list_for_each_entry(wq, &workqueues, list) {
-			kthread_bind(wq->cpu_wq[hotcpu].thread, hotcpu);
-			wake_up_process(wq->cpu_wq[hotcpu].thread);
+		/* Kick off the worker. */
+		spin_lock_irq(&pool->lock);
+		list_for_each_entry(worker, &pool->idle_list, entry) {
+			kthread_bind(worker->task, hotcpu);
+			wake_up_process(worker->task);
 		}
+		spin_unlock_irq(&pool->lock);
 		break;
 
 	case CPU_UP_CANCELED:
-		list_for_each_entry(wq, &workqueues, list) {
-			/* Unbind so it can run. */
-			kthread_bind(wq->cpu_wq[hotcpu].thread,
-				     smp_processor_id());
-			cleanup_workqueue_thread(wq, hotcpu);
-		}
+		/* Unbind so it can run. */
+		spin_lock_irq(&pool->lock);
+		list_for_each_entry(worker, &pool->idle_list, entry)
+			kthread_bind(worker->task, smp_processor_id());
+		spin_unlock_irq(&pool->lock);
+		destroy_workers(pool);
 		break;
 
 	case CPU_DEAD:
-		list_for_each_entry(wq, &workqueues, list)
-			cleanup_workqueue_thread(wq, hotcpu);
-		list_for_each_entry(wq, &workqueues, list)
-			take_over_work(wq, hotcpu);
+		take_over_work(pool);
+		destroy_workers(pool);
 		break;
 	}
 
@@ -538,6 +887,23 @@ static int __devinit workqueue_cpu_callback(struct notifier_block *nfb,
 
 void init_workqueues(void)
 {
+	struct worker_pool *pool;
+	struct worker *worker;
+	int cpu;
+
+	for (cpu = 0; cpu < NR_CPUS; cpu++)
+		init_worker_pool(&per_cpu(worker_pools, cpu), cpu, NULL);
+
+	for_each_online_cpu(cpu) {
+		pool = &per_cpu(worker_pools, cpu);
+		worker = create_worker(pool, 1);
+		BUG_ON(!worker);
+		spin_lock_irq(&pool->lock);
+		start_worker(worker);
+		spin_unlock_irq(&pool->lock);
+		wake_up_process(worker->task);
+	}
+
 	hotcpu_notifier(workqueue_cpu_callback, 0);
 	keventd_wq = create_workqueue("events");
 	BUG_ON(!keventd_wq);
@@ -545,6 +911,7 @@ void init_workqueues(void)
 
 EXPORT_SYMBOL_GPL(__create_workqueue);
 EXPORT_SYMBOL_GPL(queue_work);
+EXPORT_SYMBOL_GPL(queue_work_on);
 EXPORT_SYMBOL_GPL(queue_delayed_work);
 EXPORT_SYMBOL_GPL(flush_workqueue);
 EXPORT_SYMBOL_GPL(destroy_workqueue);
@@ -29,11 +29,14 @@
 #include <linux/init.h>
 #include <asm/atomic.h>
 #include "crc32defs.h"
-#if CRC_LE_BITS == 8
+#if CRC_LE_BITS >= 8
 #define tole(x) __constant_cpu_to_le32(x)
-#define tobe(x) __constant_cpu_to_be32(x)
 #else
 #define tole(x) (x)
+#endif
+#if CRC_BE_BITS >= 8
+#define tobe(x) __constant_cpu_to_be32(x)
+#else
 #define tobe(x) (x)
 #endif
 #include "crc32table.h"
@@ -42,6 +45,72 @@ MODULE_AUTHOR("Matt Domsch <Matt_Domsch@dell.com>");
 MODULE_DESCRIPTION("Ethernet CRC32 calculations");
 MODULE_LICENSE("GPL");
 
+#if CRC_LE_BITS >= 8 || CRC_BE_BITS >= 8
+/*
+ * The table-based loop for 8 and 64 bits at a time, for both bit orders.
+ * The crc and the tables are kept in the byte order of the data (see
+ * tole() and tobe()), so that whole words of data can be xored into the
+ * crc.  tab is @tables consecutive tables of 256 entries.
+ */
+# ifdef __LITTLE_ENDIAN
+#  define DO_CRC(x) crc = tab[ (crc ^ (x)) & 255 ] ^ (crc>>8)
+#  define DO_CRC4(t) ((t)[3*256 + (q & 255)] ^			\
+		      (t)[2*256 + ((q >> 8) & 255)] ^			\
+		      (t)[256 + ((q >> 16) & 255)] ^ (t)[q >> 24])
+# else
+#  define DO_CRC(x) crc = tab[ ((crc >> 24) ^ (x)) & 255] ^ (crc<<8)
+#  define DO_CRC4(t) ((t)[q & 255] ^ (t)[256 + ((q >> 8) & 255)] ^	\
+		      (t)[2*256 + ((q >> 16) & 255)] ^			\
+		      (t)[3*256 + (q >> 24)])
+# endif
+
+static inline u32 __attribute_pure__
+crc32_body(u32 crc, unsigned char const *p, size_t len, const u32 *tab,
+	   int tables)
+{
+	const u32 *b;
+	size_t rem;
+	u32 q;
+
+	/* Align it */
+	if (unlikely(((long)p)&3 && len)) {
+		do {
+			DO_CRC(*p++);
+		} while ((--len) && ((long)p)&3 );
+	}
+
+	b = (const u32 *)p;
+	if (tables == 8) {
+		/* slicing by 8: the eight lookups do not depend on each other */
+		rem = len & 7;
+		for (len >>= 3; len; len--) {
+			q = crc ^ *b++;
+			crc = DO_CRC4(&tab[4*256]);
+			q = *b++;
+			crc ^= DO_CRC4(tab);
+		}
+	} else {
+		/* load data 32 bits wide, xor data 32 bits wide. */
+		rem = len & 3;
+		for (len >>= 2; len; len--) {
+			crc ^= *b++;
+			DO_CRC(0);
+			DO_CRC(0);
+			DO_CRC(0);
+			DO_CRC(0);
+		}
+	}
+
+	/* And the last few bytes */
+	p = (unsigned char const *)b;
+	while (rem--)
+		DO_CRC(*p++);
+	return crc;
+}
+#undef DO_CRC
+#undef DO_CRC4
+#endif
+
 #if CRC_LE_BITS == 1
 /*
  * In fact, the table-based code will work in this case, but it can be
@@ -78,53 +147,11 @@ u32 __attribute_pure__ crc32_le(u32 crc, unsigned char const *p, size_t len)
  */
 u32 __attribute_pure__ crc32_le(u32 crc, unsigned char const *p, size_t len)
 {
-# if CRC_LE_BITS == 8
-	const u32      *b =(u32 *)p;
-	const u32      *tab = crc32table_le;
-
-# ifdef __LITTLE_ENDIAN
-#  define DO_CRC(x) crc = tab[ (crc ^ (x)) & 255 ] ^ (crc>>8)
-# else
-#  define DO_CRC(x) crc = tab[ ((crc >> 24) ^ (x)) & 255] ^ (crc<<8)
-# endif
-
+# if CRC_LE_BITS >= 8
 	crc = __cpu_to_le32(crc);
-	/* Align it */
-	if(unlikely(((long)b)&3 && len)){
-		do {
-			u8 *p = (u8 *)b;
-			DO_CRC(*p++);
-			b = (void *)p;
-		} while ((--len) && ((long)b)&3 );
-	}
-	if(likely(len >= 4)){
-		/* load data 32 bits wide, xor data 32 bits wide. */
-		size_t save_len = len & 3;
-	        len = len >> 2;
-		--b; /* use pre increment below(*++b) for speed */
-		do {
-			crc ^= *++b;
-			DO_CRC(0);
-			DO_CRC(0);
-			DO_CRC(0);
-			DO_CRC(0);
-		} while (--len);
-		b++; /* point to next byte(s) */
-		len = save_len;
-	}
-	/* And the last few bytes */
-	if(len){
-		do {
-			u8 *p = (u8 *)b;
-			DO_CRC(*p++);
-			b = (void *)p;
-		} while (--len);
-	}
-
+	crc = crc32_body(crc, p, len, (const u32 *)crc32table_le,
+			 CRC_LE_TABLES);
 	return __le32_to_cpu(crc);
-#undef ENDIAN_SHIFT
-#undef DO_CRC
-
 # elif CRC_LE_BITS == 4
 	while (len--) {
 		crc ^= *p++;
@@ -183,52 +210,11 @@ u32 __attribute_pure__ crc32_be(u32 crc, unsigned char const *p, size_t len)
  */
 u32 __attribute_pure__ crc32_be(u32 crc, unsigned char const *p, size_t len)
 {
-# if CRC_BE_BITS == 8
-	const u32      *b =(u32 *)p;
-	const u32      *tab = crc32table_be;
-
-# ifdef __LITTLE_ENDIAN
-#  define DO_CRC(x) crc = tab[ (crc ^ (x)) & 255 ] ^ (crc>>8)
-# else
-#  define DO_CRC(x) crc = tab[ ((crc >> 24) ^ (x)) & 255] ^ (crc<<8)
-# endif
-
+# if CRC_BE_BITS >= 8
 	crc = __cpu_to_be32(crc);
-	/* Align it */
-	if(unlikely(((long)b)&3 && len)){
-		do {
-			u8 *p = (u8 *)b;
-			DO_CRC(*p++);
-			b = (u32 *)p;
-		} while ((--len) && ((long)b)&3 );
-	}
-	if(likely(len >= 4)){
-		/* load data 32 bits wide, xor data 32 bits wide. */
-		size_t save_len = len & 3;
-	        len = len >> 2;
-		--b; /* use pre increment below(*++b) for speed */
-		do {
-			crc ^= *++b;
-			DO_CRC(0);
-			DO_CRC(0);
-			DO_CRC(0);
-			DO_CRC(0);
-		} while (--len);
-		b++; /* point to next byte(s) */
-		len = save_len;
-	}
-	/* And the last few bytes */
-	if(len){
-		do {
-			u8 *p = (u8 *)b;
-			DO_CRC(*p++);
-			b = (void *)p;
-		} while (--len);
-	}
+	crc = crc32_body(crc, p, len, (const u32 *)crc32table_be,
+			 CRC_BE_TABLES);
 	return __be32_to_cpu(crc);
-#undef ENDIAN_SHIFT
-#undef DO_CRC
-
 # elif CRC_BE_BITS == 4
 	while (len--) {
 		crc ^= *p++ << 24;
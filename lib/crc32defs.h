@@ -6,27 +6,37 @@
 #define CRCPOLY_LE 0xedb88320
 #define CRCPOLY_BE 0x04c11db7
 
-/* How many bits at a time to use.  Requires a table of 4<<CRC_xx_BITS bytes. */
-/* For less performance-sensitive, use 4 */
+/*
+ * How many bits at a time to use.  Requires a table of 4<<CRC_xx_BITS bytes,
+ * except for 64, which is "slicing by 8": eight 1k tables, taking eight
+ * bytes per step with independent lookups.  For less performance-sensitive,
+ * use 4.
+ */
 #ifndef CRC_LE_BITS 
-# define CRC_LE_BITS 8
+# define CRC_LE_BITS 64
 #endif
 #ifndef CRC_BE_BITS
-# define CRC_BE_BITS 8
+# define CRC_BE_BITS 64
 #endif
 
 /*
  * Little-endian CRC computation.  Used with serial bit streams sent
  * lsbit-first.  Be sure to use cpu_to_le32() to append the computed CRC.
  */
-#if CRC_LE_BITS > 8 || CRC_LE_BITS < 1 || CRC_LE_BITS & CRC_LE_BITS-1
-# error CRC_LE_BITS must be a power of 2 between 1 and 8
+#if (CRC_LE_BITS > 8 && CRC_LE_BITS != 64) || CRC_LE_BITS < 1 || \
+    CRC_LE_BITS & CRC_LE_BITS-1
+# error CRC_LE_BITS must be 64 or a power of 2 between 1 and 8
 #endif
 
 /*
  * Big-endian CRC computation.  Used with serial bit streams sent
  * msbit-first.  Be sure to use cpu_to_be32() to append the computed CRC.
  */
-#if CRC_BE_BITS > 8 || CRC_BE_BITS < 1 || CRC_BE_BITS & CRC_BE_BITS-1
-# error CRC_BE_BITS must be a power of 2 between 1 and 8
+#if (CRC_BE_BITS > 8 && CRC_BE_BITS != 64) || CRC_BE_BITS < 1 || \
+    CRC_BE_BITS & CRC_BE_BITS-1
+# error CRC_BE_BITS must be 64 or a power of 2 between 1 and 8
 #endif
+
+/* Number of 256 entry tables for the sliced versions */
+#define CRC_LE_TABLES	(CRC_LE_BITS == 64 ? 8 : 1)
+#define CRC_BE_TABLES	(CRC_BE_BITS == 64 ? 8 : 1)
@@ -4,11 +4,11 @@
 
 #define ENTRIES_PER_LINE 4
 
-#define LE_TABLE_SIZE (1 << CRC_LE_BITS)
-#define BE_TABLE_SIZE (1 << CRC_BE_BITS)
+#define LE_TABLE_SIZE (CRC_LE_BITS > 8 ? 256 : 1 << CRC_LE_BITS)
+#define BE_TABLE_SIZE (CRC_BE_BITS > 8 ? 256 : 1 << CRC_BE_BITS)
 
-static uint32_t crc32table_le[LE_TABLE_SIZE];
-static uint32_t crc32table_be[BE_TABLE_SIZE];
+static uint32_t crc32table_le[CRC_LE_TABLES][LE_TABLE_SIZE];
+static uint32_t crc32table_be[CRC_BE_TABLES][BE_TABLE_SIZE];
 
 /**
  * crc32init_le() - allocate and initialize LE table data
@@ -16,18 +16,27 @@ static uint32_t crc32table_be[BE_TABLE_SIZE];
  * crc is the crc of the byte i; other entries are filled in based on the
  * fact that crctable[i^j] = crctable[i] ^ crctable[j].
  *
+ * Table k of the sliced version is the crc of byte i followed by k zero
+ * bytes.
  */
 static void crc32init_le(void)
 {
 	unsigned i, j;
 	uint32_t crc = 1;
 
-	crc32table_le[0] = 0;
+	crc32table_le[0][0] = 0;
 
-	for (i = 1 << (CRC_LE_BITS - 1); i; i >>= 1) {
+	for (i = LE_TABLE_SIZE >> 1; i; i >>= 1) {
 		crc = (crc >> 1) ^ ((crc & 1) ? CRCPOLY_LE : 0);
 		for (j = 0; j < LE_TABLE_SIZE; j += 2 * i)
-			crc32table_le[i + j] = crc ^ crc32table_le[j];
+			crc32table_le[0][i + j] = crc ^ crc32table_le[0][j];
+	}
+	for (i = 0; i < LE_TABLE_SIZE; i++) {
+		crc = crc32table_le[0][i];
+		for (j = 1; j < CRC_LE_TABLES; j++) {
+			crc = crc32table_le[0][crc & 0xff] ^ (crc >> 8);
+			crc32table_le[j][i] = crc;
+		}
 	}
 }
 
@@ -39,12 +48,19 @@ static void crc32init_be(void)
 	unsigned i, j;
 	uint32_t crc = 0x80000000;
 
-	crc32table_be[0] = 0;
+	crc32table_be[0][0] = 0;
 
 	for (i = 1; i < BE_TABLE_SIZE; i <<= 1) {
 		crc = (crc << 1) ^ ((crc & 0x80000000) ? CRCPOLY_BE : 0);
 		for (j = 0; j < i; j++)
-			crc32table_be[i + j] = crc ^ crc32table_be[j];
+			crc32table_be[0][i + j] = crc ^ crc32table_be[0][j];
+	}
+	for (i = 0; i < BE_TABLE_SIZE; i++) {
+		crc = crc32table_be[0][i];
+		for (j = 1; j < CRC_BE_TABLES; j++) {
+			crc = crc32table_be[0][(crc >> 24) & 0xff] ^ (crc << 8);
+			crc32table_be[j][i] = crc;
+		}
 	}
 }
 
@@ -60,22 +76,42 @@ static void output_table(uint32_t table[], int len, char *trans)
 	printf("%s(0x%8.8xL)\n", trans, table[len - 1]);
 }
 
+/* a single table as before, or an array of them for the sliced version */
+static void output_tables(char *name, uint32_t *tables, int rows, int len,
+			  char *trans)
+{
+	int i;
+
+	if (rows == 1) {
+		printf("static const u32 %s[] = {", name);
+		output_table(tables, len, trans);
+		printf("};\n");
+		return;
+	}
+
+	printf("static const u32 %s[%d][%d] = {", name, rows, len);
+	for (i = 0; i < rows; i++) {
+		printf("{");
+		output_table(tables + i * len, len, trans);
+		printf("}%s", i < rows - 1 ? ", " : "");
+	}
+	printf("};\n");
+}
+
 int main(int argc, char** argv)
 {
 	printf("/* this file is generated - do not edit */\n\n");
 
 	if (CRC_LE_BITS > 1) {
 		crc32init_le();
-		printf("static const u32 crc32table_le[] = {");
-		output_table(crc32table_le, LE_TABLE_SIZE, "tole");
-		printf("};\n");
+		output_tables("crc32table_le", crc32table_le[0], CRC_LE_TABLES,
+			      LE_TABLE_SIZE, "tole");
 	}
 
 	if (CRC_BE_BITS > 1) {
 		crc32init_be();
-		printf("static const u32 crc32table_be[] = {");
-		output_table(crc32table_be, BE_TABLE_SIZE, "tobe");
-		printf("};\n");
+		output_tables("crc32table_be", crc32table_be[0], CRC_BE_TABLES,
+			      BE_TABLE_SIZE, "tobe");
 	}
 
 	return 0;
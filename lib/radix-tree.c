@@ -29,6 +29,7 @@
 #include <linux/gfp.h>
 #include <linux/string.h>
 #include <linux/bitops.h>
+#include <linux/rcupdate.h>
 
 
 #ifdef __KERNEL__
@@ -44,8 +45,16 @@
 #define RADIX_TREE_TAG_LONGS	\
 	((RADIX_TREE_MAP_SIZE + BITS_PER_LONG - 1) / BITS_PER_LONG)
 
+/*
+ * Lookups may run under rcu_read_lock() instead of the lock which
+ * serialises changes to the tree.  For them nodes are freed through RCU,
+ * are filled in before they are linked in, and carry their own height so
+ * a lookup never has to pair root->rnode with root->height.
+ */
 struct radix_tree_node {
+	unsigned int	height;		/* of the subtree, 1 for a leaf */
 	unsigned int	count;
+	struct rcu_head	rcu_head;
 	void		*slots[RADIX_TREE_MAP_SIZE];
 	unsigned long	tags[RADIX_TREE_TAGS][RADIX_TREE_TAG_LONGS];
 };
@@ -97,10 +106,18 @@ radix_tree_node_alloc(struct radix_tree_root *root)
 	return ret;
 }
 
+static void radix_tree_node_rcu_free(struct rcu_head *head)
+{
+	struct radix_tree_node *node =
+			container_of(head, struct radix_tree_node, rcu_head);
+
+	kmem_cache_free(radix_tree_node_cachep, node);
+}
+
 static inline void
 radix_tree_node_free(struct radix_tree_node *node)
 {
-	kmem_cache_free(radix_tree_node_cachep, node);
+	call_rcu(&node->rcu_head, radix_tree_node_rcu_free);
 }
 
 /*
@@ -201,6 +218,7 @@ static int radix_tree_extend(struct radix_tree_root *root, unsigned long index)
 
 		/* Increase the height.  */
 		node->slots[0] = root->rnode;
+		node->height = root->height + 1;
 
 		/* Propagate the aggregated tag info into the new root */
 		for (tag = 0; tag < RADIX_TREE_TAGS; tag++) {
@@ -209,7 +227,7 @@ static int radix_tree_extend(struct radix_tree_root *root, unsigned long index)
 		}
 
 		node->count = 1;
-		root->rnode = node;
+		rcu_assign_pointer(root->rnode, node);
 		root->height++;
 	} while (height > root->height);
 out:
@@ -250,7 +268,8 @@ int radix_tree_insert(struct radix_tree_root *root,
 			/* Have to add a child node.  */
 			if (!(tmp = radix_tree_node_alloc(root)))
 				return -ENOMEM;
-			*slot = tmp;
+			tmp->height = height;
+			rcu_assign_pointer(*slot, tmp);
 			if (node)
 				node->count++;
 		}
@@ -271,42 +290,67 @@ int radix_tree_insert(struct radix_tree_root *root,
 		BUG_ON(tag_get(node, 1, offset));
 	}
 
-	*slot = item;
+	rcu_assign_pointer(*slot, item);
 	return 0;
 }
 EXPORT_SYMBOL(radix_tree_insert);
 
 /**
- *	radix_tree_lookup    -    perform lookup operation on a radix tree
+ *	radix_tree_lookup_slot    -    lookup a slot in a radix tree
  *	@root:		radix tree root
  *	@index:		index key
  *
- *	Lookup the item at the position @index in the radix tree @root.
+ *	Lookup the slot corresponding to the position @index in the radix tree
+ *	@root.  This is useful for update-if-exists operations, and for
+ *	lockless lookups which want to check that what they found is still
+ *	there once they have taken a reference to it.
+ *
+ *	May be called under rcu_read_lock().  The slot then stays valid until
+ *	rcu_read_unlock(), but the item in it may be replaced or removed at
+ *	any time.
  */
-void *radix_tree_lookup(struct radix_tree_root *root, unsigned long index)
+void **radix_tree_lookup_slot(struct radix_tree_root *root, unsigned long index)
 {
 	unsigned int height, shift;
-	struct radix_tree_node **slot;
+	struct radix_tree_node *node;
 
-	height = root->height;
+	node = rcu_dereference(root->rnode);
+	if (node == NULL)
+		return NULL;
+
+	height = node->height;
 	if (index > radix_tree_maxindex(height))
 		return NULL;
 
 	shift = (height-1) * RADIX_TREE_MAP_SHIFT;
-	slot = &root->rnode;
-
-	while (height > 0) {
-		if (*slot == NULL)
+	while (height > 1) {
+		node = rcu_dereference(node->slots[(index >> shift) &
+						   RADIX_TREE_MAP_MASK]);
+		if (node == NULL)
 			return NULL;
-
-		slot = (struct radix_tree_node **)
-			((*slot)->slots +
-				((index >> shift) & RADIX_TREE_MAP_MASK));
 		shift -= RADIX_TREE_MAP_SHIFT;
 		height--;
 	}
 
-	return *slot;
+	return node->slots + (index & RADIX_TREE_MAP_MASK);
+}
+EXPORT_SYMBOL(radix_tree_lookup_slot);
+
+/**
+ *	radix_tree_lookup    -    perform lookup operation on a radix tree
+ *	@root:		radix tree root
+ *	@index:		index key
+ *
+ *	Lookup the item at the position @index in the radix tree @root.
+ *
+ *	May be called under rcu_read_lock(), see radix_tree_lookup_slot().
+ */
+void *radix_tree_lookup(struct radix_tree_root *root, unsigned long index)
+{
+	void **slot;
+
+	slot = radix_tree_lookup_slot(root, index);
+	return slot != NULL ? rcu_dereference(*slot) : NULL;
 }
 EXPORT_SYMBOL(radix_tree_lookup);
 
@@ -467,20 +511,25 @@ int radix_tree_tag_get(struct radix_tree_root *root,
 EXPORT_SYMBOL(radix_tree_tag_get);
 #endif
 
+/*
+ * Collect the slots of up to @max_items present items in the subtree at
+ * @slot from @index on, and their keys at @indices if that is not NULL.
+ * A child which disappears under a lockless lookup ends the pass early;
+ * the caller just starts over from *@next_index.
+ */
 static unsigned int
-__lookup(struct radix_tree_root *root, void **results, unsigned long index,
-	unsigned int max_items, unsigned long *next_index)
+__lookup(struct radix_tree_node *slot, void ***results, unsigned long *indices,
+	unsigned long index, unsigned int max_items, unsigned long *next_index)
 {
 	unsigned int nr_found = 0;
 	unsigned int shift;
-	unsigned int height = root->height;
-	struct radix_tree_node *slot;
+	unsigned int height = slot->height;
+	unsigned long i;
 
 	shift = (height-1) * RADIX_TREE_MAP_SHIFT;
-	slot = root->rnode;
 
-	while (height > 0) {
-		unsigned long i = (index >> shift) & RADIX_TREE_MAP_MASK;
+	for ( ; height > 1; height--) {
+		i = (index >> shift) & RADIX_TREE_MAP_MASK;
 
 		for ( ; i < RADIX_TREE_MAP_SIZE; i++) {
 			if (slot->slots[i] != NULL)
@@ -492,21 +541,22 @@ __lookup(struct radix_tree_root *root, void **results, unsigned long index,
 		}
 		if (i == RADIX_TREE_MAP_SIZE)
 			goto out;
-		height--;
-		if (height == 0) {	/* Bottom level: grab some items */
-			unsigned long j = index & RADIX_TREE_MAP_MASK;
+		shift -= RADIX_TREE_MAP_SHIFT;
+		slot = rcu_dereference(slot->slots[i]);
+		if (slot == NULL)
+			goto out;
+	}
 
-			for ( ; j < RADIX_TREE_MAP_SIZE; j++) {
-				index++;
-				if (slot->slots[j]) {
-					results[nr_found++] = slot->slots[j];
-					if (nr_found == max_items)
-						goto out;
-				}
-			}
+	/* Bottom level: grab some items */
+	for (i = index & RADIX_TREE_MAP_MASK; i < RADIX_TREE_MAP_SIZE; i++) {
+		index++;
+		if (slot->slots[i]) {
+			if (indices)
+				indices[nr_found] = index - 1;
+			results[nr_found++] = slot->slots + i;
+			if (nr_found == max_items)
+				goto out;
 		}
-		shift -= RADIX_TREE_MAP_SHIFT;
-		slot = slot->slots[i];
 	}
 out:
 	*next_index = index;
@@ -514,34 +564,44 @@ out:
 }
 
 /**
- *	radix_tree_gang_lookup - perform multiple lookup on a radix tree
+ *	radix_tree_gang_lookup_slot - perform multiple slot lookup on a
+ *	                              radix tree
  *	@root:		radix tree root
  *	@results:	where the results of the lookup are placed
+ *	@indices:	where their keys are placed, or NULL
  *	@first_index:	start the lookup from this key
  *	@max_items:	place up to this many items at *results
  *
- *	Performs an index-ascending scan of the tree for present items.  Places
- *	them at *@results and returns the number of items which were placed at
- *	*@results.
- *
- *	The implementation is naive.
+ *	Like radix_tree_gang_lookup(), but places the slots of the items
+ *	found at *@results.  Under rcu_read_lock() the items in them may
+ *	have been replaced or removed by the time they are looked at, see
+ *	radix_tree_lookup_slot().  The keys tell a caller which skips some
+ *	of the items where to carry on from.
  */
 unsigned int
-radix_tree_gang_lookup(struct radix_tree_root *root, void **results,
-			unsigned long first_index, unsigned int max_items)
+radix_tree_gang_lookup_slot(struct radix_tree_root *root, void ***results,
+			unsigned long *indices, unsigned long first_index,
+			unsigned int max_items)
 {
-	const unsigned long max_index = radix_tree_maxindex(root->height);
+	struct radix_tree_node *node;
+	unsigned long max_index;
 	unsigned long cur_index = first_index;
 	unsigned int ret = 0;
 
+	node = rcu_dereference(root->rnode);
+	if (node == NULL)
+		return 0;
+	max_index = radix_tree_maxindex(node->height);
+
 	while (ret < max_items) {
 		unsigned int nr_found;
 		unsigned long next_index;	/* Index of next search */
 
 		if (cur_index > max_index)
 			break;
-		nr_found = __lookup(root, results + ret, cur_index,
-					max_items - ret, &next_index);
+		nr_found = __lookup(node, results + ret,
+					indices ? indices + ret : NULL,
+					cur_index, max_items - ret, &next_index);
 		ret += nr_found;
 		if (next_index == 0)
 			break;
@@ -549,6 +609,42 @@ radix_tree_gang_lookup(struct radix_tree_root *root, void **results,
 	}
 	return ret;
 }
+EXPORT_SYMBOL(radix_tree_gang_lookup_slot);
+
+/**
+ *	radix_tree_gang_lookup - perform multiple lookup on a radix tree
+ *	@root:		radix tree root
+ *	@results:	where the results of the lookup are placed
+ *	@first_index:	start the lookup from this key
+ *	@max_items:	place up to this many items at *results
+ *
+ *	Performs an index-ascending scan of the tree for present items.  Places
+ *	them at *@results and returns the number of items which were placed at
+ *	*@results.
+ *
+ *	May be called under rcu_read_lock(); items removed meanwhile are left
+ *	out.
+ *
+ *	The implementation is naive.
+ */
+unsigned int
+radix_tree_gang_lookup(struct radix_tree_root *root, void **results,
+			unsigned long first_index, unsigned int max_items)
+{
+	void ***slots = (void ***)results;
+	unsigned int i, nr_found, ret = 0;
+
+	/* a slot pointer and an item take the same room, convert in place */
+	nr_found = radix_tree_gang_lookup_slot(root, slots, NULL, first_index,
+					       max_items);
+	for (i = 0; i < nr_found; i++) {
+		void *item = rcu_dereference(*slots[i]);
+
+		if (item != NULL)
+			results[ret++] = item;
+	}
+	return ret;
+}
 EXPORT_SYMBOL(radix_tree_gang_lookup);
 
 /*
@@ -732,6 +828,129 @@ out:
 }
 EXPORT_SYMBOL(radix_tree_delete);
 
+static inline int any_tag_set(struct radix_tree_node *node, int tag)
+{
+	int idx;
+
+	for (idx = 0; idx < RADIX_TREE_TAG_LONGS; idx++) {
+		if (node->tags[tag][idx])
+			return 1;
+	}
+	return 0;
+}
+
+/*
+ * Take the items at @indices[0..@nr) out of the leaf at the bottom of
+ * @path, which is @height levels deep, then clear the tags and free the
+ * nodes which that leaves empty, once for the whole group.
+ */
+static unsigned int
+__delete_leaf_items(struct radix_tree_root *root, struct radix_tree_path *path,
+		unsigned int height, unsigned long *indices, unsigned int nr)
+{
+	struct radix_tree_node *leaf = path[height].node;
+	unsigned int deleted = 0;
+	unsigned int i;
+	int tag, k;
+
+	for (i = 0; i < nr; i++) {
+		int offset = indices[i] & RADIX_TREE_MAP_MASK;
+
+		if (leaf->slots[offset] == NULL)
+			continue;
+		for (tag = 0; tag < RADIX_TREE_TAGS; tag++)
+			tag_clear(leaf, tag, offset);
+		leaf->slots[offset] = NULL;
+		leaf->count--;
+		deleted++;
+	}
+	if (!deleted)
+		return 0;
+
+	for (tag = 0; tag < RADIX_TREE_TAGS; tag++) {
+		for (k = height; k > 1; k--) {
+			if (any_tag_set(path[k].node, tag))
+				break;
+			tag_clear(path[k - 1].node, tag, path[k - 1].offset);
+		}
+	}
+
+	for (k = height; k > 0 && path[k].node->count == 0; k--) {
+		*path[k - 1].slot = NULL;
+		radix_tree_node_free(path[k].node);
+		if (k > 1)
+			path[k - 1].node->count--;
+	}
+	if (root->rnode == NULL)
+		root->height = 0;
+	return deleted;
+}
+
+/**
+ *	radix_tree_gang_delete    -    delete several items from a radix tree
+ *	@root:		radix tree root
+ *	@indices:	index keys of the items to delete
+ *	@nr:		number of keys at @indices
+ *
+ *	Like radix_tree_delete() on each of @indices, but items which share
+ *	a leaf are removed in one walk of the tree, and the tags and nodes
+ *	above are dealt with once per leaf instead of once per item.  This
+ *	works best on ascending keys, as a pagevec holds them.
+ *
+ *	Returns the number of items deleted.
+ */
+unsigned int radix_tree_gang_delete(struct radix_tree_root *root,
+			unsigned long *indices, unsigned int nr)
+{
+	struct radix_tree_path path[RADIX_TREE_MAX_PATH], *pathp;
+	unsigned int deleted = 0;
+	unsigned int i = 0;
+
+	while (i < nr) {
+		unsigned long index = indices[i];
+		unsigned int height, shift, n;
+
+		/* the keys which fall into the same leaf */
+		for (n = 1; i + n < nr; n++) {
+			if ((indices[i + n] >> RADIX_TREE_MAP_SHIFT) !=
+					(index >> RADIX_TREE_MAP_SHIFT))
+				break;
+		}
+
+		height = root->height;
+		if (height == 0 || index > radix_tree_maxindex(height))
+			goto next;
+
+		shift = (height - 1) * RADIX_TREE_MAP_SHIFT;
+		pathp = path;
+		pathp->node = NULL;
+		pathp->slot = &root->rnode;
+
+		while (height > 0) {
+			int offset;
+
+			if (*pathp->slot == NULL)
+				goto next;
+
+			offset = (index >> shift) & RADIX_TREE_MAP_MASK;
+			pathp[1].offset = offset;
+			pathp[1].node = *pathp[0].slot;
+			pathp[1].slot = (struct radix_tree_node **)
+					(pathp[1].node->slots + offset);
+			pathp++;
+			shift -= RADIX_TREE_MAP_SHIFT;
+			height--;
+		}
+
+		deleted += __delete_leaf_items(root, path, root->height,
+					       indices + i, n);
+next:
+		i += n;
+	}
+	return deleted;
+}
+EXPORT_SYMBOL(radix_tree_gang_delete);
+
 /**
  *	radix_tree_tagged - test whether any items in the tree are tagged
  *	@root:		radix tree root
@@ -35,6 +35,9 @@ void fastcall init_rwsem(struct rw_semaphore *sem)
 	sem->activity = 0;
 	spin_lock_init(&sem->wait_lock);
 	INIT_LIST_HEAD(&sem->wait_list);
+#ifdef RWSEM_SPIN_ON_OWNER
+	sem->owner = NULL;
+#endif
 #if RWSEM_DEBUG
 	sem->debug = 0;
 #endif
@@ -46,8 +49,9 @@ void fastcall init_rwsem(struct rw_semaphore *sem)
  *   - the 'active count' _reached_ zero
  *   - the 'waiting count' is non-zero
  * - the spinlock must be held by the caller
- * - woken process blocks are discarded from the list after having task zeroed
- * - writers are only woken if wakewrite is non-zero
+ * - woken readers are discarded from the list after having task zeroed
+ * - writers are only woken if wakewrite is non-zero, and then take the
+ *   lock themselves, unless another writer has stolen it meanwhile
  */
 static inline struct rw_semaphore *
 __rwsem_do_wake(struct rw_semaphore *sem, int wakewrite)
@@ -66,20 +70,8 @@ __rwsem_do_wake(struct rw_semaphore *sem, int wakewrite)
 		goto dont_wake_writers;
 	}
 
-	/* if we are allowed to wake writers try to grant a single write lock
-	 * if there's a writer at the front of the queue
-	 * - we leave the 'waiting count' incremented to signify potential
-	 *   contention
-	 */
 	if (waiter->flags & RWSEM_WAITING_FOR_WRITE) {
-		sem->activity = -1;
-		list_del(&waiter->list);
-		tsk = waiter->task;
-		/* Don't touch waiter after ->task has been NULLed */
-		mb();
-		waiter->task = NULL;
-		wake_up_process(tsk);
-		put_task_struct(tsk);
+		wake_up_process(waiter->task);
 		goto out;
 	}
 
@@ -109,24 +101,15 @@ __rwsem_do_wake(struct rw_semaphore *sem, int wakewrite)
 }
 
 /*
- * wake a single writer
+ * wake a single writer, to try for the lock
  */
 static inline struct rw_semaphore *
 __rwsem_wake_one_writer(struct rw_semaphore *sem)
 {
 	struct rwsem_waiter *waiter;
-	struct task_struct *tsk;
-
-	sem->activity = -1;
 
 	waiter = list_entry(sem->wait_list.next, struct rwsem_waiter, list);
-	list_del(&waiter->list);
-
-	tsk = waiter->task;
-	mb();
-	waiter->task = NULL;
-	wake_up_process(tsk);
-	put_task_struct(tsk);
+	wake_up_process(waiter->task);
 	return sem;
 }
 
@@ -200,9 +183,34 @@ int fastcall __down_read_trylock(struct rw_semaphore *sem)
 	return ret;
 }
 
+#ifdef RWSEM_SPIN_ON_OWNER
+/*
+ * spin while the writer holding the lock runs, 1 if it was released
+ * meanwhile; readers are not spun on
+ */
+static int rwsem_spin_on_owner(struct rw_semaphore *sem)
+{
+	struct thread_info *owner;
+	int ret = 0;
+
+	preempt_disable();
+	owner = sem->owner;
+	if (owner && spin_on_owner(&sem->owner, owner))
+		ret = !sem->activity;
+	preempt_enable();
+	return ret;
+}
+#else
+static inline int rwsem_spin_on_owner(struct rw_semaphore *sem)
+{
+	return 0;
+}
+#endif
+
 /*
  * get a write lock on the semaphore
- * - we increment the waiting count anyway to indicate an exclusive lock
+ * - the lock is taken whenever nothing is active, even past the queue:
+ *   a queued writer is only woken to try for it again
  */
 void fastcall __sched __down_write(struct rw_semaphore *sem)
 {
@@ -213,36 +221,42 @@ void fastcall __sched __down_write(struct rw_semaphore *sem)
 
 	spin_lock_irq(&sem->wait_lock);
 
-	if (sem->activity == 0 && list_empty(&sem->wait_list)) {
-		/* granted */
-		sem->activity = -1;
+	while (sem->activity) {
 		spin_unlock_irq(&sem->wait_lock);
-		goto out;
+		if (!rwsem_spin_on_owner(sem)) {
+			spin_lock_irq(&sem->wait_lock);
+			goto queue;
+		}
+		spin_lock_irq(&sem->wait_lock);
 	}
 
+	/* granted */
+	sem->activity = -1;
+	spin_unlock_irq(&sem->wait_lock);
+	goto out;
+
+ queue:
 	tsk = current;
-	set_task_state(tsk, TASK_UNINTERRUPTIBLE);
 
 	/* set up my own style of waitqueue */
 	waiter.task = tsk;
 	waiter.flags = RWSEM_WAITING_FOR_WRITE;
-	get_task_struct(tsk);
 
 	list_add_tail(&waiter.list, &sem->wait_list);
 
-	/* we don't need to touch the semaphore struct anymore */
-	spin_unlock_irq(&sem->wait_lock);
-
-	/* wait to be given the lock */
-	for (;;) {
-		if (!waiter.task)
-			break;
-		schedule();
+	/* wait for nothing to be active, and take it */
+	while (sem->activity) {
 		set_task_state(tsk, TASK_UNINTERRUPTIBLE);
+		spin_unlock_irq(&sem->wait_lock);
+		schedule();
+		spin_lock_irq(&sem->wait_lock);
 	}
-
 	tsk->state = TASK_RUNNING;
 
+	sem->activity = -1;
+	list_del(&waiter.list);
+	spin_unlock_irq(&sem->wait_lock);
+
  out:
 	rwsemtrace(sem, "Leaving __down_write");
 }
@@ -259,7 +273,7 @@ int fastcall __down_write_trylock(struct rw_semaphore *sem)
 
 	spin_lock_irqsave(&sem->wait_lock, flags);
 
-	if (sem->activity == 0 && list_empty(&sem->wait_list)) {
+	if (sem->activity == 0) {
 		/* granted */
 		sem->activity = -1;
 		ret = 1;
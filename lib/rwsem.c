@@ -27,71 +27,74 @@ void rwsemtrace(struct rw_semaphore *sem, const char *str)
 }
 #endif
 
+/*
+ * The count is as described in asm/rwsem.h, with RWSEM_WAITING_BIAS in it
+ * once while anything is on the queue.
+ *
+ * Writers are not handed the lock: they take it themselves whenever no
+ * lock is active.  One which finds it held first spins while the writer
+ * holding it runs, then queues and is woken, when it comes to the front
+ * of the queue and the lock is released, to try again.  A running writer
+ * can so take the lock from under the queue rather than wait for a
+ * sleeping one to be scheduled, and short write sections of mmap_sem and
+ * the like do not turn into convoys.  Readers are granted the lock in
+ * batches of those at the front of the queue, and the first one to
+ * queue behind active readers joins them at once.
+ */
+
+enum rwsem_wake_type {
+	RWSEM_WAKE_ANY,		/* whatever is at the front of the queue */
+	RWSEM_WAKE_READERS,	/* only readers */
+	RWSEM_WAKE_READ_OWNED,	/* readers, and the waker holds a read lock */
+};
+
 /*
  * handle the lock release when processes blocked on it that can now run
- * - if we come here from up_xxxx(), then:
- *   - the 'active part' of count (&0x0000ffff) reached 0 (but may have changed)
- *   - the 'waiting part' of count (&0xffff0000) is -ve (and will still be so)
- *   - there must be someone on the queue
  * - the spinlock must be held by the caller
- * - woken process blocks are discarded from the list after having task zeroed
- * - writers are only woken if downgrading is false
+ * - there must be someone on the queue
+ * - a writer at the front is only woken, to try for the lock itself
+ * - woken readers are discarded from the list after having task zeroed
  */
 static inline struct rw_semaphore *
-__rwsem_do_wake(struct rw_semaphore *sem, int downgrading)
+__rwsem_do_wake(struct rw_semaphore *sem, enum rwsem_wake_type wake_type)
 {
 	struct rwsem_waiter *waiter;
 	struct task_struct *tsk;
 	struct list_head *next;
-	signed long oldcount, woken, loop;
+	signed long oldcount, woken, loop, adjustment;
 
 	rwsemtrace(sem, "Entering __rwsem_do_wake");
 
-	if (downgrading)
-		goto dont_wake_writers;
-
-	/* if we came through an up_xxxx() call, we only only wake someone up
-	 * if we can transition the active part of the count from 0 -> 1
-	 */
- try_again:
-	oldcount = rwsem_atomic_update(RWSEM_ACTIVE_BIAS, sem)
-						- RWSEM_ACTIVE_BIAS;
-	if (oldcount & RWSEM_ACTIVE_MASK)
-		goto undo;
-
 	waiter = list_entry(sem->wait_list.next, struct rwsem_waiter, list);
+	if (waiter->flags & RWSEM_WAITING_FOR_WRITE) {
+		if (wake_type == RWSEM_WAKE_ANY)
+			wake_up_process(waiter->task);
+		goto out;
+	}
 
-	/* try to grant a single write lock if there's a writer at the front
-	 * of the queue - note we leave the 'active part' of the count
-	 * incremented by 1 and the waiting part incremented by 0x00010000
-	 */
-	if (!(waiter->flags & RWSEM_WAITING_FOR_WRITE))
-		goto readers_only;
-
-	/* We must be careful not to touch 'waiter' after we set ->task = NULL.
-	 * It is an allocated on the waiter's stack and may become invalid at
-	 * any time after that point (due to a wakeup from another source).
+	/* a writer may take the lock before we grant it to the readers, so
+	 * grant the first read lock before counting them, and back off if
+	 * one did
 	 */
-	list_del(&waiter->list);
-	tsk = waiter->task;
-	mb();
-	waiter->task = NULL;
-	wake_up_process(tsk);
-	put_task_struct(tsk);
-	goto out;
-
-	/* don't want to wake any writers */
- dont_wake_writers:
-	waiter = list_entry(sem->wait_list.next, struct rwsem_waiter, list);
-	if (waiter->flags & RWSEM_WAITING_FOR_WRITE)
-		goto out;
+	adjustment = 0;
+	if (wake_type != RWSEM_WAKE_READ_OWNED) {
+		adjustment = RWSEM_ACTIVE_READ_BIAS;
+ try_reader_grant:
+		oldcount = rwsem_atomic_update(adjustment, sem) - adjustment;
+		if (unlikely(oldcount < RWSEM_WAITING_BIAS)) {
+			/* a writer has it; undo, unless we were the last */
+			if (rwsem_atomic_update(-adjustment, sem) &
+			    RWSEM_ACTIVE_MASK)
+				goto out;
+			goto try_reader_grant;
+		}
+	}
 
 	/* grant an infinite number of read locks to the readers at the front
 	 * of the queue
 	 * - note we increment the 'active part' of the count by the number of
 	 *   readers before waking any processes up
 	 */
- readers_only:
 	woken = 0;
 	do {
 		woken++;
@@ -104,16 +107,16 @@ __rwsem_do_wake(struct rw_semaphore *sem, int downgrading)
 
 	} while (waiter->flags & RWSEM_WAITING_FOR_READ);
 
-	loop = woken;
-	woken *= RWSEM_ACTIVE_BIAS - RWSEM_WAITING_BIAS;
-	if (!downgrading)
-		/* we'd already done one increment earlier */
-		woken -= RWSEM_ACTIVE_BIAS;
+	adjustment = woken * RWSEM_ACTIVE_READ_BIAS - adjustment;
+	if (waiter->flags & RWSEM_WAITING_FOR_READ)
+		/* that empties the queue */
+		adjustment -= RWSEM_WAITING_BIAS;
 
-	rwsem_atomic_add(woken, sem);
+	if (adjustment)
+		rwsem_atomic_add(adjustment, sem);
 
 	next = sem->wait_list.next;
-	for (; loop > 0; loop--) {
+	for (loop = woken; loop > 0; loop--) {
 		waiter = list_entry(next, struct rwsem_waiter, list);
 		next = waiter->list.next;
 		tsk = waiter->task;
@@ -129,86 +132,179 @@ __rwsem_do_wake(struct rw_semaphore *sem, int downgrading)
  out:
 	rwsemtrace(sem, "Leaving __rwsem_do_wake");
 	return sem;
-
-	/* undo the change to count, but check for a transition 1->0 */
- undo:
-	if (rwsem_atomic_update(-RWSEM_ACTIVE_BIAS, sem) != 0)
-		goto out;
-	goto try_again;
 }
 
 /*
- * wait for a lock to be granted
+ * wait for the read lock to be granted
  */
-static inline struct rw_semaphore *
-rwsem_down_failed_common(struct rw_semaphore *sem,
-			struct rwsem_waiter *waiter, signed long adjustment)
+struct rw_semaphore fastcall __sched *
+rwsem_down_read_failed(struct rw_semaphore *sem)
 {
+	signed long count, adjustment = -RWSEM_ACTIVE_READ_BIAS;
+	struct rwsem_waiter waiter;
 	struct task_struct *tsk = current;
-	signed long count;
 
-	set_task_state(tsk, TASK_UNINTERRUPTIBLE);
+	rwsemtrace(sem, "Entering rwsem_down_read_failed");
 
 	/* set up my own style of waitqueue */
-	spin_lock_irq(&sem->wait_lock);
-	waiter->task = tsk;
+	waiter.task = tsk;
+	waiter.flags = RWSEM_WAITING_FOR_READ;
 	get_task_struct(tsk);
 
-	list_add_tail(&waiter->list, &sem->wait_list);
+	spin_lock_irq(&sem->wait_lock);
+	if (list_empty(&sem->wait_list))
+		adjustment += RWSEM_WAITING_BIAS;
+	list_add_tail(&waiter.list, &sem->wait_list);
 
 	/* we're now waiting on the lock, but no longer actively read-locking */
 	count = rwsem_atomic_update(adjustment, sem);
 
-	/* if there are no active locks, wake the front queued process(es) up */
-	if (!(count & RWSEM_ACTIVE_MASK))
-		sem = __rwsem_do_wake(sem, 0);
+	/* if there are no active locks, wake the front queued process(es);
+	 * if there are only active readers and we are first on the queue,
+	 * join them
+	 */
+	if (count == RWSEM_WAITING_BIAS ||
+	    (count > RWSEM_WAITING_BIAS &&
+	     adjustment != -RWSEM_ACTIVE_READ_BIAS))
+		sem = __rwsem_do_wake(sem, RWSEM_WAKE_ANY);
 
 	spin_unlock_irq(&sem->wait_lock);
 
 	/* wait to be given the lock */
 	for (;;) {
-		if (!waiter->task)
+		set_task_state(tsk, TASK_UNINTERRUPTIBLE);
+		if (!waiter.task)
 			break;
 		schedule();
-		set_task_state(tsk, TASK_UNINTERRUPTIBLE);
 	}
 
 	tsk->state = TASK_RUNNING;
 
+	rwsemtrace(sem, "Leaving rwsem_down_read_failed");
 	return sem;
 }
 
 /*
- * wait for the read lock to be granted
+ * take the write lock from the queue, with nothing active, if still so
+ * - the spinlock must be held by the caller, who is on the queue
  */
-struct rw_semaphore fastcall __sched *
-rwsem_down_read_failed(struct rw_semaphore *sem)
+static inline int rwsem_try_write_lock(signed long count,
+				       struct rw_semaphore *sem)
 {
-	struct rwsem_waiter waiter;
+	if (count & RWSEM_ACTIVE_MASK)
+		return 0;
+	if (sem->count != RWSEM_WAITING_BIAS ||
+	    cmpxchg(&sem->count, RWSEM_WAITING_BIAS,
+		    RWSEM_ACTIVE_WRITE_BIAS) != RWSEM_WAITING_BIAS)
+		return 0;
+	/* the waiting bias went with the one we took; others still wait */
+	if (sem->wait_list.next != sem->wait_list.prev)
+		rwsem_atomic_add(RWSEM_WAITING_BIAS, sem);
+	return 1;
+}
 
-	rwsemtrace(sem, "Entering rwsem_down_read_failed");
+/*
+ * take the write lock without queueing, if nothing is active
+ */
+static inline int rwsem_try_write_lock_unqueued(struct rw_semaphore *sem)
+{
+	signed long old, count = sem->count;
+
+	while (count == 0 || count == RWSEM_WAITING_BIAS) {
+		old = cmpxchg(&sem->count, count,
+			      count + RWSEM_ACTIVE_WRITE_BIAS);
+		if (old == count)
+			return 1;
+		count = old;
+	}
+	return 0;
+}
 
-	waiter.flags = RWSEM_WAITING_FOR_READ;
-	rwsem_down_failed_common(sem, &waiter,
-				RWSEM_WAITING_BIAS - RWSEM_ACTIVE_BIAS);
+#ifdef RWSEM_SPIN_ON_OWNER
+/*
+ * Spin for the write lock while the writer holding it runs.  Without a
+ * writer there are readers, who may be in for a page fault or other
+ * long wait, so that is tried only once.
+ */
+static int rwsem_optimistic_spin(struct rw_semaphore *sem)
+{
+	struct thread_info *owner;
+	int taken = 0;
 
-	rwsemtrace(sem, "Leaving rwsem_down_read_failed");
-	return sem;
+	preempt_disable();
+	for (owner = sem->owner; owner; owner = sem->owner) {
+		if (!spin_on_owner(&sem->owner, owner))
+			break;
+		if (rwsem_try_write_lock_unqueued(sem)) {
+			taken = 1;
+			break;
+		}
+		cpu_relax();
+	}
+	if (!owner)
+		taken = rwsem_try_write_lock_unqueued(sem);
+	preempt_enable();
+	return taken;
+}
+#else
+static inline int rwsem_optimistic_spin(struct rw_semaphore *sem)
+{
+	return 0;
 }
+#endif
 
 /*
- * wait for the write lock to be granted
+ * wait for the write lock, and take it
  */
 struct rw_semaphore fastcall __sched *
 rwsem_down_write_failed(struct rw_semaphore *sem)
 {
 	struct rwsem_waiter waiter;
+	struct task_struct *tsk = current;
+	signed long count;
+	int waiting;
 
 	rwsemtrace(sem, "Entering rwsem_down_write_failed");
 
+	/* undo the write bias of down_write(), we're not active locking */
+	count = rwsem_atomic_update(-RWSEM_ACTIVE_WRITE_BIAS, sem);
+
+	if (rwsem_optimistic_spin(sem))
+		goto out;
+
+	waiter.task = tsk;
 	waiter.flags = RWSEM_WAITING_FOR_WRITE;
-	rwsem_down_failed_common(sem, &waiter, -RWSEM_ACTIVE_BIAS);
 
+	spin_lock_irq(&sem->wait_lock);
+	waiting = !list_empty(&sem->wait_list);
+	list_add_tail(&waiter.list, &sem->wait_list);
+
+	if (waiting) {
+		count = sem->count;
+		/* with waiters ahead of us and no writer active, readers
+		 * hold it: let those readers queued ahead of us join them
+		 */
+		if (count > RWSEM_WAITING_BIAS)
+			sem = __rwsem_do_wake(sem, RWSEM_WAKE_READERS);
+	} else
+		count = rwsem_atomic_update(RWSEM_WAITING_BIAS, sem);
+
+	/* try for the lock whenever nothing is active */
+	set_task_state(tsk, TASK_UNINTERRUPTIBLE);
+	while (!rwsem_try_write_lock(count, sem)) {
+		spin_unlock_irq(&sem->wait_lock);
+		do {
+			schedule();
+			set_task_state(tsk, TASK_UNINTERRUPTIBLE);
+		} while ((count = sem->count) & RWSEM_ACTIVE_MASK);
+		spin_lock_irq(&sem->wait_lock);
+	}
+	tsk->state = TASK_RUNNING;
+
+	list_del(&waiter.list);
+	spin_unlock_irq(&sem->wait_lock);
+
+ out:
 	rwsemtrace(sem, "Leaving rwsem_down_write_failed");
 	return sem;
 }
@@ -227,7 +323,7 @@ struct rw_semaphore fastcall *rwsem_wake(struct rw_semaphore *sem)
 
 	/* do nothing if list empty */
 	if (!list_empty(&sem->wait_list))
-		sem = __rwsem_do_wake(sem, 0);
+		sem = __rwsem_do_wake(sem, RWSEM_WAKE_ANY);
 
 	spin_unlock_irqrestore(&sem->wait_lock, flags);
 
@@ -251,7 +347,7 @@ struct rw_semaphore fastcall *rwsem_downgrade_wake(struct rw_semaphore *sem)
 
 	/* do nothing if list empty */
 	if (!list_empty(&sem->wait_list))
-		sem = __rwsem_do_wake(sem, 1);
+		sem = __rwsem_do_wake(sem, RWSEM_WAKE_READ_OWNED);
 
 	spin_unlock_irqrestore(&sem->wait_lock, flags);
 
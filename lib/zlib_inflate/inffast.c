@@ -20,6 +20,36 @@ struct inflate_codes_state;
 #define GRABBITS(j) {while(k<(j)){b|=((uLong)NEXTBYTE)<<k;k+=8;}}
 #define UNGRAB {c=z->avail_in-n;c=(k>>3)<c?k>>3:c;n+=c;p-=c;k-=c<<3;}
 
+/* With a 64 bit bit buffer, fill it once per code: the 56 bits or more
+   that gives cover the 48 of the longest length/distance pair, so the
+   GRABBITS after it find the bits already there.  That takes up to
+   seven bytes, which the ten bytes of input guaranteed below allow. */
+#if BITS_PER_LONG == 64
+#define FILLBITS {while(k<56){b|=((uLong)NEXTBYTE)<<k;k+=8;}}
+#else
+#define FILLBITS GRABBITS(20)
+#endif
+
+/* copy a match of c bytes from r, which does not wrap around the window,
+   bytewise only where it overlaps its own output */
+static inline Byte *copy_match(Byte *q, Byte *r, uInt c)
+{
+  if ((uInt)(q - r) >= c)
+  {
+    memcpy(q, r, c);
+    return q + c;
+  }
+  if (q - r == 1)                       /* a run of one byte */
+  {
+    memset(q, *r, c);
+    return q + c;
+  }
+  do {
+    *q++ = *r++;
+  } while (--c);
+  return q;
+}
+
 /* Called with number of bytes left to write in window at least 258
    (the maximum string length) and number of input bytes available
    at least ten.  The ten bytes are six bytes for the longest length/
@@ -58,7 +88,7 @@ int zlib_inflate_fast(
   /* do until not enough input or output space for fast loop */
   do {                          /* assume called with m >= 258 && n >= 10 */
     /* get literal/length code */
-    GRABBITS(20)                /* max bits for literal/length code */
+    FILLBITS                    /* max bits for literal/length code */
     if ((e = (t = tl + ((uInt)b & ml))->exop) == 0)
     {
       DUMPBITS(t->bits)
@@ -109,22 +139,10 @@ int zlib_inflate_fast(
                 } while (--c);
               }
               else                              /* normal copy */
-              {
-                *q++ = *r++;  c--;
-                *q++ = *r++;  c--;
-                do {
-                    *q++ = *r++;
-                } while (--c);
-              }
+                q = copy_match(q, r, c);
             }
             else                                /* normal copy */
-            {
-              *q++ = *r++;  c--;
-              *q++ = *r++;  c--;
-              do {
-                *q++ = *r++;
-              } while (--c);
-            }
+              q = copy_match(q, r, c);
             break;
           }
           else if ((e & 64) == 0)
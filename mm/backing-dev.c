@@ -0,0 +1,153 @@
+/*
+ * mm/backing-dev.c
+ *
+ * Per-device writeback threads.
+ *
+ * A backing device registered here gets a flusher thread of its own which
+ * performs the background and kupdate writeout for that device's inodes.
+ * Writeout to many spindles then proceeds in parallel, instead of through
+ * pdflush walking every superblock in turn where a single congested disk
+ * holds up flushing to all the others.
+ *
+ * Devices which are not registered (stacked devices, network filesystems)
+ * are written back by pdflush as before; pdflush skips the registered ones
+ * in its background and kupdate walks (see sync_sb_inodes()).
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/sched.h>
+#include <linux/fs.h>
+#include <linux/err.h>
+#include <linux/kthread.h>
+#include <linux/spinlock.h>
+#include <linux/backing-dev.h>
+#include <linux/writeback.h>
+
+/* registered devices, protected by bdi_lock */
+static LIST_HEAD(bdi_list);
+static DEFINE_SPINLOCK(bdi_lock);
+
+static inline int bdi_flush_pending(struct backing_dev_info *bdi)
+{
+	return test_bit(BDI_flush_background, &bdi->state) ||
+		test_bit(BDI_flush_kupdate, &bdi->state);
+}
+
+static int bdi_flusher(void *data)
+{
+	struct backing_dev_info *bdi = data;
+
+	/* take part in pdflush's per-queue collision avoidance */
+	current->flags |= PF_FLUSHER;
+
+	while (!kthread_should_stop()) {
+		wait_event_interruptible(bdi->flush_wait,
+				bdi_flush_pending(bdi) || kthread_should_stop());
+		if (try_to_freeze(PF_FREEZE))
+			continue;
+
+		if (test_and_clear_bit(BDI_flush_kupdate, &bdi->state))
+			bdi_writeback(bdi, 0, 1);
+		if (test_and_clear_bit(BDI_flush_background, &bdi->state))
+			bdi_writeback(bdi, xchg(&bdi->flush_pages, 0), 0);
+	}
+	return 0;
+}
+
+static void __bdi_start_writeback(struct backing_dev_info *bdi, long nr_pages,
+				int for_kupdate)
+{
+	if (for_kupdate)
+		set_bit(BDI_flush_kupdate, &bdi->state);
+	else {
+		if (nr_pages > bdi->flush_pages)
+			bdi->flush_pages = nr_pages;
+		set_bit(BDI_flush_background, &bdi->state);
+	}
+	wake_up(&bdi->flush_wait);
+}
+
+/**
+ * bdi_start_writeback - kick a device's flusher thread
+ * @bdi: the device
+ * @nr_pages: minimum number of pages for background writeout
+ * @for_kupdate: write back old data rather than work down the dirty level
+ *
+ * Returns 0 if the work was handed to @bdi's flusher thread, -1 if the
+ * device has none and the caller should fall back to pdflush.
+ */
+int bdi_start_writeback(struct backing_dev_info *bdi, long nr_pages,
+			int for_kupdate)
+{
+	int ret = -1;
+
+	spin_lock(&bdi_lock);
+	if (bdi->flusher) {
+		__bdi_start_writeback(bdi, nr_pages, for_kupdate);
+		ret = 0;
+	}
+	spin_unlock(&bdi_lock);
+	return ret;
+}
+
+/*
+ * Kick the flusher threads of all registered devices.
+ */
+void bdi_writeback_all(long nr_pages, int for_kupdate)
+{
+	struct backing_dev_info *bdi;
+
+	spin_lock(&bdi_lock);
+	list_for_each_entry(bdi, &bdi_list, bdi_list)
+		__bdi_start_writeback(bdi, nr_pages, for_kupdate);
+	spin_unlock(&bdi_lock);
+}
+
+/**
+ * bdi_register - start a flusher thread for a backing device
+ * @bdi: the device
+ * @name: used to name the thread, "flush-<name>"
+ */
+int bdi_register(struct backing_dev_info *bdi, const char *name)
+{
+	struct task_struct *task;
+
+	init_waitqueue_head(&bdi->flush_wait);
+	bdi->flush_pages = 0;
+
+	task = kthread_run(bdi_flusher, bdi, "flush-%s", name);
+	if (IS_ERR(task))
+		return PTR_ERR(task);
+
+	spin_lock(&bdi_lock);
+	bdi->flusher = task;
+	list_add_tail(&bdi->bdi_list, &bdi_list);
+	spin_unlock(&bdi_lock);
+	return 0;
+}
+EXPORT_SYMBOL(bdi_register);
+
+/**
+ * bdi_unregister - stop a backing device's flusher thread
+ * @bdi: the device
+ *
+ * Waits for writeout in progress to finish.  Further writeback against the
+ * device, if any, is done by pdflush.
+ */
+void bdi_unregister(struct backing_dev_info *bdi)
+{
+	struct task_struct *task;
+
+	spin_lock(&bdi_lock);
+	task = bdi->flusher;
+	if (task) {
+		list_del(&bdi->bdi_list);
+		bdi->flusher = NULL;
+	}
+	spin_unlock(&bdi_lock);
+
+	if (task)
+		kthread_stop(task);
+}
+EXPORT_SYMBOL(bdi_unregister);
@@ -28,6 +28,7 @@
 #include <linux/blkdev.h>
 #include <linux/security.h>
 #include <linux/syscalls.h>
+#include <linux/cpuset.h>
 /*
  * This is needed for the following functions:
  *  - try_to_release_page
@@ -119,6 +120,28 @@ void __remove_from_page_cache(struct page *page)
 	pagecache_acct(-1);
 }
 
+/*
+ * Like __remove_from_page_cache(), but @entry takes the page's slot: tmpfs
+ * leaves the swap entry of a page there when the page goes out to swap,
+ * see move_to_swap_cache().
+ */
+void __remove_from_page_cache_swapped(struct page *page, void *entry)
+{
+	struct address_space *mapping = page->mapping;
+	void **slot;
+
+	slot = radix_tree_lookup_slot(&mapping->page_tree, page->index);
+	BUG_ON(!slot || *slot != page);
+	radix_tree_tag_clear(&mapping->page_tree, page->index,
+				PAGECACHE_TAG_DIRTY);
+	radix_tree_tag_clear(&mapping->page_tree, page->index,
+				PAGECACHE_TAG_WRITEBACK);
+	rcu_assign_pointer(*slot, entry);
+	page->mapping = NULL;
+	mapping->nrpages--;
+	pagecache_acct(-1);
+}
+
 void remove_from_page_cache(struct page *page)
 {
 	struct address_space *mapping = page->mapping;
@@ -131,6 +154,44 @@ void remove_from_page_cache(struct page *page)
 	write_unlock_irq(&mapping->tree_lock);
 }
 
+/*
+ * Remove up to PAGEVEC_SIZE pages of @mapping in one go, with the same
+ * rules as for __remove_from_page_cache().  Pages in ascending index
+ * order are removed a leaf at a time, see radix_tree_gang_delete().
+ */
+void __remove_from_page_cache_batch(struct address_space *mapping,
+				struct page **pages, int nr)
+{
+	unsigned long indices[PAGEVEC_SIZE];
+	int i;
+
+	BUG_ON(nr > PAGEVEC_SIZE);
+	for (i = 0; i < nr; i++) {
+		BUG_ON(pages[i]->mapping != mapping);
+		indices[i] = pages[i]->index;
+	}
+	radix_tree_gang_delete(&mapping->page_tree, indices, nr);
+	for (i = 0; i < nr; i++)
+		pages[i]->mapping = NULL;
+	mapping->nrpages -= nr;
+	pagecache_acct(-nr);
+}
+
+void remove_from_page_cache_batch(struct address_space *mapping,
+				struct page **pages, int nr)
+{
+	int i;
+
+	for (i = 0; i < nr; i++) {
+		if (unlikely(!PageLocked(pages[i])))
+			PAGE_BUG(pages[i]);
+	}
+
+	write_lock_irq(&mapping->tree_lock);
+	__remove_from_page_cache_batch(mapping, pages, nr);
+	write_unlock_irq(&mapping->tree_lock);
+}
+
 static int sync_page(void *word)
 {
 	struct address_space *mapping;
@@ -161,7 +222,7 @@ static int sync_page(void *word)
  * these two operations is that if a dirty page/buffer is encountered, it must
  * be waited upon, and not just skipped over.
  */
-static int __filemap_fdatawrite_range(struct address_space *mapping,
+int __filemap_fdatawrite_range(struct address_space *mapping,
 	loff_t start, loff_t end, int sync_mode)
 {
 	int ret;
@@ -211,7 +272,7 @@ EXPORT_SYMBOL(filemap_flush);
  * Wait for writeback to complete against pages indexed by start->end
  * inclusive
  */
-static int wait_on_page_writeback_range(struct address_space *mapping,
+int wait_on_page_writeback_range(struct address_space *mapping,
 				pgoff_t start, pgoff_t end)
 {
 	struct pagevec pvec;
@@ -359,23 +420,54 @@ int filemap_write_and_wait_range(struct address_space *mapping,
  *
  * This function does not add the page to the LRU.  The caller must do that.
  */
+static int __add_to_page_cache(struct page *page,
+		struct address_space *mapping, pgoff_t offset, void *entry)
+{
+	int was_locked;
+	int error;
+
+	/*
+	 * Lockless lookups can find the page as soon as it is in
+	 * the tree, so it has to be set up before it goes in.
+	 */
+	page_cache_get(page);
+	was_locked = TestSetPageLocked(page);
+	page->mapping = mapping;
+	page->index = offset;
+
+	write_lock_irq(&mapping->tree_lock);
+	if (entry) {
+		void **slot;
+
+		error = -EEXIST;
+		slot = radix_tree_lookup_slot(&mapping->page_tree, offset);
+		if (slot && *slot == entry) {
+			rcu_assign_pointer(*slot, page);
+			error = 0;
+		}
+	} else
+		error = radix_tree_insert(&mapping->page_tree, offset, page);
+	if (!error) {
+		mapping->nrpages++;
+		pagecache_acct(1);
+	}
+	write_unlock_irq(&mapping->tree_lock);
+	if (error) {
+		page->mapping = NULL;
+		if (!was_locked)
+			ClearPageLocked(page);
+		__put_page(page);
+	}
+	return error;
+}
+
 int add_to_page_cache(struct page *page, struct address_space *mapping,
 		pgoff_t offset, int gfp_mask)
 {
 	int error = radix_tree_preload(gfp_mask & ~__GFP_HIGHMEM);
 
 	if (error == 0) {
-		write_lock_irq(&mapping->tree_lock);
-		error = radix_tree_insert(&mapping->page_tree, offset, page);
-		if (!error) {
-			page_cache_get(page);
-			SetPageLocked(page);
-			page->mapping = mapping;
-			page->index = offset;
-			mapping->nrpages++;
-			pagecache_acct(1);
-		}
-		write_unlock_irq(&mapping->tree_lock);
+		error = __add_to_page_cache(page, mapping, offset, NULL);
 		radix_tree_preload_end();
 	}
 	return error;
@@ -383,6 +475,17 @@ int add_to_page_cache(struct page *page, struct address_space *mapping,
 
 EXPORT_SYMBOL(add_to_page_cache);
 
+/*
+ * Like add_to_page_cache(), but the page takes the slot of @entry, the
+ * swap entry tmpfs left there when the page went out to swap: see
+ * move_from_swap_cache().  Fails with -EEXIST if @entry is gone.
+ */
+int add_to_page_cache_swapped(struct page *page, struct address_space *mapping,
+		pgoff_t offset, void *entry)
+{
+	return __add_to_page_cache(page, mapping, offset, entry);
+}
+
 int add_to_page_cache_lru(struct page *page, struct address_space *mapping,
 				pgoff_t offset, int gfp_mask)
 {
@@ -392,6 +495,20 @@ int add_to_page_cache_lru(struct page *page, struct address_space *mapping,
 	return ret;
 }
 
+#ifdef CONFIG_NUMA
+/*
+ * Page cache of tasks in a cpuset with memory_spread_page goes round
+ * the nodes of the cpuset instead of filling up the local one.
+ */
+struct page *__page_cache_alloc(unsigned int __nocast gfp)
+{
+	if (cpuset_do_page_mem_spread())
+		return alloc_pages_node(cpuset_mem_spread_node(), gfp, 0);
+	return alloc_pages(gfp, 0);
+}
+EXPORT_SYMBOL(__page_cache_alloc);
+#endif
+
 /*
  * In order to wait for pages to become available there must be
  * waitqueues associated with pages. By using a hash table of
@@ -454,10 +571,10 @@ EXPORT_SYMBOL(unlock_page);
  */
 void end_page_writeback(struct page *page)
 {
-	if (!TestClearPageReclaim(page) || rotate_reclaimable_page(page)) {
-		if (!test_clear_page_writeback(page))
-			BUG();
-	}
+	if (TestClearPageReclaim(page))
+		rotate_reclaimable_page(page);
+	if (!test_clear_page_writeback(page))
+		BUG();
 	smp_mb__after_clear_bit();
 	wake_up_page(page, PG_writeback);
 }
@@ -480,21 +597,123 @@ void fastcall __lock_page(struct page *page)
 }
 EXPORT_SYMBOL(__lock_page);
 
+/*
+ * Asynchronous page waits for retry-based AIO.
+ *
+ * When called from an aio retry, @wait is the iocb's ki_wait entry
+ * (current->io_wait).  Instead of sleeping, the entry is queued on the
+ * page's waitqueue with the bit we are waiting for filled in, the
+ * block queue is unplugged and -EIOCBRETRY is returned.  Once the bit
+ * clears, aio_wake_function() kicks the iocb and the whole operation is
+ * retried from the aio workqueue.  From a synchronous context these
+ * behave exactly like lock_page() and wait_on_page_bit().
+ */
+static int page_wait_async_prepare(struct page *page, int bit_nr,
+				   wait_queue_t *wait)
+{
+	struct wait_bit_queue *q = container_of(wait, struct wait_bit_queue,
+						 wait);
+	struct address_space *mapping;
+
+	q->key.flags = &page->flags;
+	q->key.bit_nr = bit_nr;
+	prepare_to_wait(page_waitqueue(page), wait, TASK_UNINTERRUPTIBLE);
+
+	/* Kick the I/O along, as sync_page() would, but don't sleep. */
+	smp_mb();
+	mapping = page_mapping(page);
+	if (mapping && mapping->a_ops && mapping->a_ops->sync_page)
+		mapping->a_ops->sync_page(page);
+	return -EIOCBRETRY;
+}
+
+int fastcall wait_on_page_bit_async(struct page *page, int bit_nr,
+				    wait_queue_t *wait)
+{
+	if (is_sync_wait(wait)) {
+		wait_on_page_bit(page, bit_nr);
+		return 0;
+	}
+	if (!test_bit(bit_nr, &page->flags))
+		return 0;
+
+	page_wait_async_prepare(page, bit_nr, wait);
+	if (test_bit(bit_nr, &page->flags))
+		return -EIOCBRETRY;
+
+	finish_wait(page_waitqueue(page), wait);
+	return 0;
+}
+EXPORT_SYMBOL(wait_on_page_bit_async);
+
+int fastcall lock_page_async(struct page *page, wait_queue_t *wait)
+{
+	if (is_sync_wait(wait)) {
+		lock_page(page);
+		return 0;
+	}
+	if (!TestSetPageLocked(page))
+		return 0;
+
+	page_wait_async_prepare(page, PG_locked, wait);
+	if (TestSetPageLocked(page))
+		return -EIOCBRETRY;
+
+	finish_wait(page_waitqueue(page), wait);
+	return 0;
+}
+EXPORT_SYMBOL(lock_page_async);
+
 /*
  * a rather lightweight function, finding and getting a reference to a
  * hashed page atomically.
  */
+#ifdef PAGECACHE_LOCKLESS
+struct page * find_get_page(struct address_space *mapping, unsigned long offset)
+{
+	void **pagep;
+	struct page *page;
+
+	rcu_read_lock();
+repeat:
+	page = NULL;
+	pagep = radix_tree_lookup_slot(&mapping->page_tree, offset);
+	if (pagep) {
+		page = rcu_dereference(*pagep);
+		if (unlikely(!page))
+			goto out;
+		/* a tmpfs swap entry: the page is not in the cache */
+		if (unlikely(radix_tree_exceptional_entry(page))) {
+			page = NULL;
+			goto out;
+		}
+		if (!page_cache_get_speculative(page))
+			goto repeat;
+		/* Has the page been removed, or replaced, meanwhile? */
+		if (unlikely(page != *pagep)) {
+			page_cache_release(page);
+			goto repeat;
+		}
+	}
+out:
+	rcu_read_unlock();
+	return page;
+}
+#else
 struct page * find_get_page(struct address_space *mapping, unsigned long offset)
 {
 	struct page *page;
 
 	read_lock_irq(&mapping->tree_lock);
 	page = radix_tree_lookup(&mapping->page_tree, offset);
+	if (radix_tree_exceptional_entry(page))
+		page = NULL;
 	if (page)
 		page_cache_get(page);
 	read_unlock_irq(&mapping->tree_lock);
 	return page;
 }
+#endif
 
 EXPORT_SYMBOL(find_get_page);
 
@@ -507,7 +726,8 @@ struct page *find_trylock_page(struct address_space *mapping, unsigned long offs
 
 	read_lock_irq(&mapping->tree_lock);
 	page = radix_tree_lookup(&mapping->page_tree, offset);
-	if (page && TestSetPageLocked(page))
+	if (page && (radix_tree_exceptional_entry(page) ||
+		     TestSetPageLocked(page)))
 		page = NULL;
 	read_unlock_irq(&mapping->tree_lock);
 	return page;
@@ -516,17 +736,15 @@ struct page *find_trylock_page(struct address_space *mapping, unsigned long offs
 EXPORT_SYMBOL(find_trylock_page);
 
 /**
- * find_lock_page - locate, pin and lock a pagecache page
+ * find_lock_entry - locate, pin and lock a pagecache page or swap entry
  *
  * @mapping - the address_space to search
  * @offset - the page index
  *
- * Locates the desired pagecache page, locks it, increments its reference
- * count and returns its address.
- *
- * Returns zero if the page was not present. find_lock_page() may sleep.
+ * Like find_lock_page(), but a swap entry which tmpfs keeps in place of
+ * a page is returned as it is, neither pinned nor locked.
  */
-struct page *find_lock_page(struct address_space *mapping,
+struct page *find_lock_entry(struct address_space *mapping,
 				unsigned long offset)
 {
 	struct page *page;
@@ -534,7 +752,7 @@ struct page *find_lock_page(struct address_space *mapping,
 	read_lock_irq(&mapping->tree_lock);
 repeat:
 	page = radix_tree_lookup(&mapping->page_tree, offset);
-	if (page) {
+	if (page && !radix_tree_exceptional_entry(page)) {
 		page_cache_get(page);
 		if (TestSetPageLocked(page)) {
 			read_unlock_irq(&mapping->tree_lock);
@@ -553,6 +771,27 @@ repeat:
 	return page;
 }
 
+/**
+ * find_lock_page - locate, pin and lock a pagecache page
+ *
+ * @mapping - the address_space to search
+ * @offset - the page index
+ *
+ * Locates the desired pagecache page, locks it, increments its reference
+ * count and returns its address.  A tmpfs page out on swap is read back.
+ *
+ * Returns zero if the page was not present. find_lock_page() may sleep.
+ */
+struct page *find_lock_page(struct address_space *mapping,
+				unsigned long offset)
+{
+	struct page *page = find_lock_entry(mapping, offset);
+
+	if (unlikely(radix_tree_exceptional_entry(page)))
+		page = shmem_find_lock_page(mapping, offset);
+	return page;
+}
+
 EXPORT_SYMBOL(find_lock_page);
 
 /**
@@ -617,20 +856,86 @@ EXPORT_SYMBOL(find_or_create_page);
  *
  * find_get_pages() returns the number of pages which were found.
  */
+#ifdef PAGECACHE_LOCKLESS
 unsigned find_get_pages(struct address_space *mapping, pgoff_t start,
 			    unsigned int nr_pages, struct page **pages)
 {
+	void ***slots = (void ***)pages;
+	unsigned long indices[PAGEVEC_SIZE];
 	unsigned int i;
-	unsigned int ret;
+	unsigned int nr_found;
+	unsigned int ret = 0;
+
+	rcu_read_lock();
+	/* tmpfs swap entries are skipped, so look again until pages[] is full */
+	while (ret < nr_pages) {
+		unsigned int base = ret;
+		unsigned int nr = min(nr_pages - base, (unsigned int)PAGEVEC_SIZE);
+
+		nr_found = radix_tree_gang_lookup_slot(&mapping->page_tree,
+					slots + base, indices, start, nr);
+		/* pages[] is filled in over the slots already looked at */
+		for (i = 0; i < nr_found; i++) {
+			void **slot = slots[base + i];
+			struct page *page;
+repeat:
+			page = rcu_dereference(*slot);
+			if (unlikely(!page) ||
+			    unlikely(radix_tree_exceptional_entry(page)))
+				continue;
+			if (!page_cache_get_speculative(page))
+				goto repeat;
+			if (unlikely(page != *slot)) {
+				page_cache_release(page);
+				goto repeat;
+			}
+			pages[ret++] = page;
+		}
+		if (nr_found < nr)
+			break;
+		start = indices[nr_found - 1] + 1;
+		if (!start)
+			break;
+	}
+	rcu_read_unlock();
+	return ret;
+}
+#else
+unsigned find_get_pages(struct address_space *mapping, pgoff_t start,
+			    unsigned int nr_pages, struct page **pages)
+{
+	void ***slots = (void ***)pages;
+	unsigned long indices[PAGEVEC_SIZE];
+	unsigned int i;
+	unsigned int nr_found;
+	unsigned int ret = 0;
 
 	read_lock_irq(&mapping->tree_lock);
-	ret = radix_tree_gang_lookup(&mapping->page_tree,
-				(void **)pages, start, nr_pages);
-	for (i = 0; i < ret; i++)
-		page_cache_get(pages[i]);
+	/* tmpfs swap entries are skipped, so look again until pages[] is full */
+	while (ret < nr_pages) {
+		unsigned int base = ret;
+		unsigned int nr = min(nr_pages - base, (unsigned int)PAGEVEC_SIZE);
+
+		nr_found = radix_tree_gang_lookup_slot(&mapping->page_tree,
+					slots + base, indices, start, nr);
+		for (i = 0; i < nr_found; i++) {
+			struct page *page = *slots[base + i];
+
+			if (radix_tree_exceptional_entry(page))
+				continue;
+			page_cache_get(page);
+			pages[ret++] = page;
+		}
+		if (nr_found < nr)
+			break;
+		start = indices[nr_found - 1] + 1;
+		if (!start)
+			break;
+	}
 	read_unlock_irq(&mapping->tree_lock);
 	return ret;
 }
+#endif
 
 /*
  * Like find_get_pages, except we only return pages which are tagged with
@@ -794,8 +1099,13 @@ page_ok:
 		goto out;
 
 page_not_up_to_date:
-		/* Get exclusive access to the page ... */
-		lock_page(page);
+		/*
+		 * Get exclusive access to the page ... if this is an aio
+		 * retry, queue the iocb on the page instead of blocking.
+		 */
+		error = lock_page_async(page, current->io_wait);
+		if (unlikely(error))
+			goto readpage_error;
 
 		/* Did it get unhashed before we got the lock? */
 		if (!page->mapping) {
@@ -818,7 +1128,9 @@ readpage:
 			goto readpage_error;
 
 		if (!PageUptodate(page)) {
-			lock_page(page);
+			error = lock_page_async(page, current->io_wait);
+			if (unlikely(error))
+				goto readpage_error;
 			if (!PageUptodate(page)) {
 				if (page->mapping == NULL) {
 					/*
@@ -863,7 +1175,10 @@ readpage:
 		goto page_ok;
 
 readpage_error:
-		/* UHHUH! A synchronous read error occurred. Report it */
+		/*
+		 * UHHUH! A synchronous read error occurred (or -EIOCBRETRY:
+		 * the aio retry will pick up from *ppos). Report it
+		 */
 		desc->error = error;
 		page_cache_release(page);
 		goto out;
@@ -2297,7 +2612,8 @@ generic_file_direct_IO(int rw, struct kiocb *iocb, const struct iovec *iov,
 						>> PAGE_CACHE_SHIFT;
 			int err = invalidate_inode_pages2_range(mapping,
 					offset >> PAGE_CACHE_SHIFT, end);
-			if (err)
+			/* a queued kernel kiocb is completed regardless */
+			if (err && retval != -EIOCBQUEUED)
 				retval = err;
 		}
 	}
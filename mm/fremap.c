@@ -21,7 +21,7 @@
 #include <asm/tlbflush.h>
 
 static inline void zap_pte(struct mm_struct *mm, struct vm_area_struct *vma,
-			unsigned long addr, pte_t *ptep)
+			unsigned long addr, pte_t *ptep, int counted)
 {
 	pte_t pte = *ptep;
 
@@ -39,7 +39,8 @@ static inline void zap_pte(struct mm_struct *mm, struct vm_area_struct *vma,
 					set_page_dirty(page);
 				page_remove_rmap(page);
 				page_cache_release(page);
-				dec_mm_counter(mm, rss);
+				if (counted)
+					dec_mm_counter(mm, rss);
 			}
 		}
 	} else {
@@ -64,6 +65,7 @@ int install_page(struct mm_struct *mm, struct vm_area_struct *vma,
 	pud_t *pud;
 	pgd_t *pgd;
 	pte_t pte_val;
+	int counted;
 
 	pgd = pgd_offset(mm, addr);
 	spin_lock(&mm->page_table_lock);
@@ -90,15 +92,19 @@ int install_page(struct mm_struct *mm, struct vm_area_struct *vma,
 	if (!page->mapping || page->index >= size)
 		goto err_unlock;
 
-	zap_pte(mm, vma, addr, pte);
+	pte_lock_nested(pmd);
+	counted = pt_counted(mm, pmd);
+	zap_pte(mm, vma, addr, pte, counted);
 
-	inc_mm_counter(mm,rss);
+	if (counted)
+		inc_mm_counter(mm, rss);
 	flush_icache_page(vma, page);
 	set_pte_at(mm, addr, pte, mk_pte(page, prot));
 	page_add_file_rmap(page);
 	pte_val = *pte;
 	pte_unmap(pte);
 	update_mmu_cache(vma, addr, pte_val);
+	pte_unlock_nested(pmd);
 
 	err = 0;
 err_unlock:
@@ -137,12 +143,14 @@ int install_file_pte(struct mm_struct *mm, struct vm_area_struct *vma,
 	if (!pte)
 		goto err_unlock;
 
-	zap_pte(mm, vma, addr, pte);
+	pte_lock_nested(pmd);
+	zap_pte(mm, vma, addr, pte, pt_counted(mm, pmd));
 
 	set_pte_at(mm, addr, pte, pgoff_to_pte(pgoff));
 	pte_val = *pte;
 	pte_unmap(pte);
 	update_mmu_cache(vma, addr, pte_val);
+	pte_unlock_nested(pmd);
 	spin_unlock(&mm->page_table_lock);
 	return 0;
 
@@ -234,6 +242,7 @@ asmlinkage long sys_remap_file_pages(unsigned long start, unsigned long size,
 			vma_nonlinear_insert(vma, &mapping->i_mmap_nonlinear);
 			flush_dcache_mmap_unlock(mapping);
 			spin_unlock(&mapping->i_mmap_lock);
+			unshare_page_tables(vma, vma->vm_start, vma->vm_end);
 		}
 
 		err = vma->vm_ops->populate(vma, start, size,
@@ -9,6 +9,10 @@
 #include <linux/pagemap.h>
 #include <linux/syscalls.h>
 #include <linux/hugetlb.h>
+#include <linux/swap.h>
+#include <linux/highmem.h>
+
+#include <asm/tlbflush.h>
 
 /*
  * We can potentially split a vm area into separate
@@ -106,8 +110,127 @@ static long madvise_dontneed(struct vm_area_struct * vma,
 			.last_index = ULONG_MAX,
 		};
 		zap_page_range(vma, start, end - start, &details);
-	} else
+	} else {
+		if (unshare_page_table_ends(vma->vm_mm, start, end))
+			return -ENOMEM;
 		zap_page_range(vma, start, end - start, NULL);
+	}
+	return 0;
+}
+
+/*
+ * Clean the ptes of the anonymous pages only this mm maps, and queue the
+ * pages for the inactive file list: reclaim then drops them instead of
+ * swapping them out, unless they are written to again first.  Pages in
+ * use elsewhere, or locked just now, are left alone, the advice being
+ * only advice.
+ */
+static void lazyfree_pte_range(struct vm_area_struct *vma, pmd_t *pmd,
+			       unsigned long addr, unsigned long end)
+{
+	pte_t *pte;
+
+	pte_lock_nested(pmd);
+	pte = pte_offset_map(pmd, addr);
+	do {
+		pte_t ptent = *pte;
+		struct page *page;
+		unsigned long pfn;
+
+		if (!pte_present(ptent))
+			continue;
+		pfn = pte_pfn(ptent);
+		if (!pfn_valid(pfn))
+			continue;
+		page = pfn_to_page(pfn);
+		if (!PageAnon(page) || page_mapcount(page) != 1)
+			continue;
+		if (TestSetPageLocked(page))
+			continue;
+		if (PageSwapCache(page) && !remove_exclusive_swap_page(page)) {
+			unlock_page(page);
+			continue;
+		}
+		ClearPageDirty(page);
+		unlock_page(page);
+
+		/* the hardware may be setting the bits meanwhile */
+		ptent = ptep_get_and_clear(vma->vm_mm, addr, pte);
+		ptent = pte_mkold(pte_mkclean(ptent));
+		set_pte_at(vma->vm_mm, addr, pte, ptent);
+		mark_page_lazyfree(page);
+	} while (pte++, addr += PAGE_SIZE, addr != end);
+	pte_unmap(pte - 1);
+	pte_unlock_nested(pmd);
+}
+
+static void lazyfree_pmd_range(struct vm_area_struct *vma, pud_t *pud,
+			       unsigned long addr, unsigned long end)
+{
+	pmd_t *pmd;
+	unsigned long next;
+
+	pmd = pmd_offset(pud, addr);
+	do {
+		next = pmd_addr_end(addr, end);
+		if (pmd_none_or_clear_bad(pmd))
+			continue;
+		/* the ptes of a page table shared at fork are not ours alone */
+		if (pt_shared(pmd))
+			continue;
+		lazyfree_pte_range(vma, pmd, addr, next);
+	} while (pmd++, addr = next, addr != end);
+}
+
+static void lazyfree_pud_range(struct vm_area_struct *vma, pgd_t *pgd,
+			       unsigned long addr, unsigned long end)
+{
+	pud_t *pud;
+	unsigned long next;
+
+	pud = pud_offset(pgd, addr);
+	do {
+		next = pud_addr_end(addr, end);
+		if (pud_none_or_clear_bad(pud))
+			continue;
+		lazyfree_pmd_range(vma, pud, addr, next);
+	} while (pud++, addr = next, addr != end);
+}
+
+/*
+ * The application no longer needs the contents of these pages, but is
+ * likely to reuse the memory soon: malloc and garbage collectors giving
+ * back their free arenas.  Unlike MADV_DONTNEED the pages stay mapped,
+ * and are only freed by vmscan under memory pressure.  Until then a
+ * write keeps the old page, with no fault and no clearing; a read before
+ * any write may find either the old contents or a zero filled page.
+ *
+ * Only private anonymous memory is freed lazily, mmap_sem is only taken
+ * for reading, and the lru moves are batched per cpu.
+ */
+static long madvise_free(struct vm_area_struct * vma,
+			 unsigned long start, unsigned long end)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	unsigned long addr = start;
+	unsigned long next;
+	pgd_t *pgd;
+
+	if (vma->vm_file || (vma->vm_flags & (VM_SHARED | VM_LOCKED |
+					      VM_IO | VM_RESERVED)) ||
+	    is_vm_hugetlb_page(vma))
+		return -EINVAL;
+
+	pgd = pgd_offset(mm, addr);
+	spin_lock(&mm->page_table_lock);
+	do {
+		next = pgd_addr_end(addr, end);
+		if (pgd_none_or_clear_bad(pgd))
+			continue;
+		lazyfree_pud_range(vma, pgd, addr, next);
+	} while (pgd++, addr = next, addr != end);
+	flush_tlb_range(vma, start, end);
+	spin_unlock(&mm->page_table_lock);
 	return 0;
 }
 
@@ -131,6 +254,10 @@ static long madvise_vma(struct vm_area_struct * vma, unsigned long start,
 		error = madvise_dontneed(vma, start, end);
 		break;
 
+	case MADV_FREE:
+		error = madvise_free(vma, start, end);
+		break;
+
 	default:
 		error = -EINVAL;
 		break;
@@ -161,6 +288,8 @@ static long madvise_vma(struct vm_area_struct * vma, unsigned long start,
  *		some pages ahead.
  *  MADV_DONTNEED - the application is finished with the given range,
  *		so the kernel can free resources associated with it.
+ *  MADV_FREE - the application no longer needs the contents of the
+ *		range, which the kernel may free when it needs memory.
  *
  * return values:
  *  zero    - success
@@ -179,9 +308,13 @@ asmlinkage long sys_madvise(unsigned long start, size_t len_in, int behavior)
 	struct vm_area_struct * vma;
 	int unmapped_error = 0;
 	int error = -EINVAL;
+	int write = (behavior != MADV_FREE);
 	size_t len;
 
-	down_write(&current->mm->mmap_sem);
+	if (write)
+		down_write(&current->mm->mmap_sem);
+	else
+		down_read(&current->mm->mmap_sem);
 
 	if (start & ~PAGE_MASK)
 		goto out;
@@ -237,6 +370,9 @@ asmlinkage long sys_madvise(unsigned long start, size_t len_in, int behavior)
 	}
 
 out:
-	up_write(&current->mm->mmap_sem);
+	if (write)
+		up_write(&current->mm->mmap_sem);
+	else
+		up_read(&current->mm->mmap_sem);
 	return error;
 }
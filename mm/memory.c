@@ -106,6 +106,351 @@ void pmd_clear_bad(pmd_t *pmd)
 	pmd_clear(pmd);
 }
 
+#ifdef SHARED_PAGE_TABLES
+/*
+ * Sharing page tables between the hundreds of processes which map the
+ * same large shared file or shm segment saves building, and tearing
+ * down, the same page tables in every one of them.
+ *
+ * A page table page is shareable when it is wholly covered by one linear
+ * VM_SHARED vma of a regular file (shmem included) which can never hold
+ * a private COW page, and it is only shared with vmas of the same
+ * protection and mlock state mapping the same part of the file at the
+ * same alignment.  Another mm's page table is taken on a fault (or at
+ * fork) under i_mmap_lock, with that mm's mmap_sem trylocked for read so
+ * that it cannot be in the middle of mprotect, mremap or the like.
+ *
+ * The mm itself drops its pmd from a shared page table, and refaults,
+ * before doing anything to the ptes on its own account: munmap, exit,
+ * mprotect, mlock, mremap, nonlinear remap.  Truncation and rmap clear
+ * the shared ptes for everybody, and must then flush all the TLBs.
+ *
+ * With COW_PAGE_TABLES fork also shares, instead of copying pte by pte,
+ * each page table wholly covered by one private vma, write protected in
+ * the pmds of parent and child.  The first fault through such a pmd
+ * copies the page table for the faulting mm, as fork would have done,
+ * or takes it back if the other sharers have gone: so fork and exec no
+ * longer cost in proportion to the memory the parent has touched, and
+ * only the page tables a child writes to are ever copied.  Here too the
+ * mm unshares before changing the ptes on its own account, but copying
+ * the page table rather than dropping it, unless the whole page table
+ * is being unmapped.  rmap and swapoff change the shared ptes for all.
+ */
+static pmd_t *pt_lookup_pmd(struct mm_struct *mm, unsigned long addr)
+{
+	pgd_t *pgd;
+	pud_t *pud;
+	pmd_t *pmd;
+
+	pgd = pgd_offset(mm, addr);
+	if (pgd_none(*pgd) || unlikely(pgd_bad(*pgd)))
+		return NULL;
+	pud = pud_offset(pgd, addr);
+	if (pud_none(*pud) || unlikely(pud_bad(*pud)))
+		return NULL;
+	pmd = pmd_offset(pud, addr);
+	if (pmd_none(*pmd) || unlikely(pmd_bad(*pmd)))
+		return NULL;
+	return pmd;
+}
+
+/* Add the ptes of the page table to mm's rss, or take them out of it */
+static void pt_account_rss(struct mm_struct *mm, pmd_t *pmd, int add)
+{
+	pte_t *pte = pte_offset_map_nested(pmd, 0);
+	int i, rss = 0;
+
+	for (i = 0; i < PTRS_PER_PTE; i++) {
+		pte_t ptent = pte[i];
+		unsigned long pfn;
+		struct page *page;
+
+		if (!pte_present(ptent))
+			continue;
+		pfn = pte_pfn(ptent);
+		if (!pfn_valid(pfn))
+			continue;
+		page = pfn_to_page(pfn);
+		if (PageReserved(page))
+			continue;
+		rss++;
+		if (!PageAnon(page))
+			continue;
+		if (add)
+			inc_mm_anon_rss(mm, page);
+		else
+			dec_mm_anon_rss(mm, page);
+	}
+	pte_unmap_nested(pte);
+	add_mm_counter(mm, rss, add ? rss : -rss);
+}
+
+/*
+ * pt_counted() slow path, with the pte lock held: if the other sharers
+ * have all gone, clear PG_ptshared and put the ptes back in our rss.
+ */
+int __pt_counted(struct mm_struct *mm, pmd_t *pmd)
+{
+	struct page *ptpage = pmd_page(*pmd);
+
+	if (page_count(ptpage) > 1)
+		return 0;
+	ClearPagePtShared(ptpage);
+	pt_account_rss(mm, pmd, 1);
+	return 1;
+}
+
+/*
+ * Drop this mm's pmd from a shared page table, leaving the ptes to the
+ * other sharers; or if it is no longer shared, take back its ptes.
+ * Returns 1 if the pmd was cleared.  mm->page_table_lock is held.
+ */
+static int unshare_pmd(struct mm_struct *mm, pmd_t *pmd)
+{
+	struct page *ptpage = pmd_page(*pmd);
+	spinlock_t *ptl = __pte_lockptr(ptpage);
+	int unshared = 0;
+
+	spin_lock(ptl);
+	if (page_count(ptpage) > 1) {
+		pmd_clear(pmd);
+		mm->nr_ptes--;
+		/* Nothing of it may stay in our TLB once others can free it */
+		flush_tlb_mm(mm);
+		put_page(ptpage);
+		unshared = 1;
+	} else
+		pt_counted(mm, pmd);
+	spin_unlock(ptl);
+	return unshared;
+}
+
+/* May the page table mapping base..base+PMD_SIZE of vma be shared? */
+static int pt_shareable(struct vm_area_struct *vma, unsigned long base)
+{
+	unsigned long flags = vma->vm_flags;
+	struct file *file = vma->vm_file;
+
+	if ((base & ~PMD_MASK) || base < vma->vm_start ||
+	    base + PMD_SIZE > vma->vm_end)
+		return 0;
+	if (!(flags & VM_SHARED) ||
+	    (flags & (VM_NONLINEAR | VM_IO | VM_RESERVED | VM_HUGETLB)))
+		return 0;
+	/* A forced write to a read-only mapping would COW into the ptes */
+	if ((flags & (VM_WRITE | VM_MAYWRITE)) == VM_MAYWRITE)
+		return 0;
+	return file && S_ISREG(file->f_dentry->d_inode->i_mode);
+}
+
+#define VM_PT_MATCH	(VM_READ | VM_WRITE | VM_EXEC | VM_LOCKED)
+
+static inline int pt_compatible(struct vm_area_struct *vma,
+				struct vm_area_struct *svma)
+{
+	return svma->vm_ops == vma->vm_ops &&
+		!((svma->vm_flags ^ vma->vm_flags) & VM_PT_MATCH) &&
+		pgprot_val(svma->vm_page_prot) == pgprot_val(vma->vm_page_prot);
+}
+
+/*
+ * Point pmd at the page table smm has at spmd.  mm->page_table_lock is
+ * held, and smm cannot be changing its mappings.
+ */
+static void __share_pmd(struct mm_struct *mm, pmd_t *pmd,
+			struct mm_struct *smm, pmd_t *spmd)
+{
+	struct page *ptpage = pmd_page(*spmd);
+	spinlock_t *ptl = __pte_lockptr(ptpage);
+
+	spin_lock(ptl);
+	if (!PagePtShared(ptpage)) {
+		pt_account_rss(smm, spmd, 0);
+		SetPagePtShared(ptpage);
+	}
+	get_page(ptpage);
+	spin_unlock(ptl);
+	mm->nr_ptes++;
+	pmd_populate(mm, pmd, ptpage);
+}
+
+/*
+ * A fault found the pmd for address empty in a shareable vma: try to take
+ * the page table of another mm mapping the same part of the file.
+ * Called without page_table_lock.
+ */
+static void share_page_table(struct vm_area_struct *vma, pmd_t *pmd,
+				unsigned long address)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	struct address_space *mapping = vma->vm_file->f_mapping;
+	unsigned long base = address & PMD_MASK;
+	pgoff_t pgoff = vma->vm_pgoff + ((base - vma->vm_start) >> PAGE_SHIFT);
+	struct vm_area_struct *svma;
+	struct prio_tree_iter iter;
+
+	spin_lock(&mapping->i_mmap_lock);
+	spin_lock(&mm->page_table_lock);
+	if (!pmd_none(*pmd))
+		goto out;
+
+	vma_prio_tree_foreach(svma, &iter, &mapping->i_mmap,
+				pgoff, pgoff + PTRS_PER_PTE - 1) {
+		struct mm_struct *smm = svma->vm_mm;
+		unsigned long saddr;
+		pmd_t *spmd;
+
+		if (smm == mm || svma->vm_pgoff > pgoff)
+			continue;
+		saddr = svma->vm_start +
+			((pgoff - svma->vm_pgoff) << PAGE_SHIFT);
+		if (saddr & ~PMD_MASK)
+			continue;
+		if (!down_read_trylock(&smm->mmap_sem))
+			continue;
+		if (pt_shareable(svma, saddr) && pt_compatible(vma, svma) &&
+		    spin_trylock(&smm->page_table_lock)) {
+			spmd = pt_lookup_pmd(smm, saddr);
+			if (spmd)
+				__share_pmd(mm, pmd, smm, spmd);
+			spin_unlock(&smm->page_table_lock);
+		}
+		up_read(&smm->mmap_sem);
+		if (!pmd_none(*pmd))
+			break;
+	}
+out:
+	spin_unlock(&mm->page_table_lock);
+	spin_unlock(&mapping->i_mmap_lock);
+}
+
+#ifdef COW_PAGE_TABLES
+#define pt_cow(pmd)	(pmd_present(*(pmd)) && !pmd_write(*(pmd)))
+
+static int cow_unshare_pmd(struct mm_struct *mm, pmd_t *pmd,
+				unsigned long addr);
+
+/* May fork share the page table mapping base..base+PMD_SIZE of vma? */
+static int pt_cow_shareable(struct vm_area_struct *vma, unsigned long base)
+{
+	if ((base & ~PMD_MASK) || base < vma->vm_start ||
+	    base + PMD_SIZE > vma->vm_end)
+		return 0;
+	/* rmap through the child's vma must not unmap mlocked pages */
+	return !(vma->vm_flags & (VM_SHARED | VM_LOCKED | VM_NONLINEAR |
+				  VM_IO | VM_RESERVED | VM_HUGETLB));
+}
+
+/*
+ * Share the parent's page table at src_pmd with the child, write
+ * protected in both.  Both page_table_locks are held.
+ */
+static void share_cow_pmd(struct mm_struct *dst_mm, pmd_t *dst_pmd,
+			struct mm_struct *src_mm, pmd_t *src_pmd)
+{
+	/*
+	 * rmap may leave swap entries in the ptes for all the sharers,
+	 * and swapoff must find them whichever sharer keeps them.
+	 */
+	if (list_empty(&src_mm->mmlist) || list_empty(&dst_mm->mmlist)) {
+		spin_lock(&mmlist_lock);
+		if (list_empty(&src_mm->mmlist))
+			list_add(&src_mm->mmlist, &init_mm.mmlist);
+		if (list_empty(&dst_mm->mmlist))
+			list_add(&dst_mm->mmlist, &src_mm->mmlist);
+		spin_unlock(&mmlist_lock);
+	}
+	/* dup_mmap flushes the parent's TLB when it is done */
+	set_pmd(src_pmd, pmd_wrprotect(*src_pmd));
+	__share_pmd(dst_mm, dst_pmd, src_mm, src_pmd);
+	set_pmd(dst_pmd, *src_pmd);
+}
+
+static int unshare_cow_addr(struct mm_struct *mm, unsigned long addr)
+{
+	pmd_t *pmd = pt_lookup_pmd(mm, addr);
+
+	if (pmd && pt_cow(pmd))
+		return cow_unshare_pmd(mm, pmd, addr);
+	return 0;
+}
+
+/*
+ * Called with mmap_sem held before unmapping start..end on the mm's own
+ * account.  unmap_vmas drops the pmds of shared page tables inside the
+ * range, leaving the ptes to the other sharers: copy-on-write shared
+ * page tables across either end of it must be copied first.
+ */
+int unshare_page_table_ends(struct mm_struct *mm,
+			unsigned long start, unsigned long end)
+{
+	int err = 0;
+
+	spin_lock(&mm->page_table_lock);
+	if (start & ~PMD_MASK)
+		err = unshare_cow_addr(mm, start);
+	if (!err && (end & ~PMD_MASK))
+		err = unshare_cow_addr(mm, end);
+	spin_unlock(&mm->page_table_lock);
+	return err;
+}
+#else
+#define pt_cow(pmd)				0
+#define cow_unshare_pmd(mm, pmd, addr)		0
+#define pt_cow_shareable(vma, base)		0
+#define share_cow_pmd(dst_mm, dst_pmd, src_mm, src_pmd)	do {} while (0)
+#endif
+
+static void __unshare_page_tables(struct mm_struct *mm,
+				unsigned long addr, unsigned long end)
+{
+	for (addr &= PMD_MASK; addr < end; addr += PMD_SIZE) {
+		pmd_t *pmd = pt_lookup_pmd(mm, addr);
+
+		if (pmd && PagePtShared(pmd_page(*pmd)))
+			unshare_pmd(mm, pmd);
+	}
+}
+
+/*
+ * Called with mmap_sem held for writing before the ptes of the range
+ * are changed for this mm alone.  Fails only to copy a page table.
+ */
+int unshare_page_tables(struct vm_area_struct *vma,
+			unsigned long start, unsigned long end)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	unsigned long addr;
+	int err = 0;
+
+	if (is_vm_hugetlb_page(vma))
+		return 0;
+	spin_lock(&mm->page_table_lock);
+	for (addr = start & PMD_MASK; addr < end && !err; addr += PMD_SIZE) {
+		pmd_t *pmd = pt_lookup_pmd(mm, addr);
+
+		if (!pmd)
+			continue;
+		if (pt_cow(pmd))
+			err = cow_unshare_pmd(mm, pmd, addr);
+		else if (PagePtShared(pmd_page(*pmd)))
+			unshare_pmd(mm, pmd);
+	}
+	spin_unlock(&mm->page_table_lock);
+	return err;
+}
+#else
+#define unshare_pmd(mm, pmd)			0
+#define __unshare_page_tables(mm, addr, end)	do {} while (0)
+#define pt_shareable(vma, base)			0
+#define __share_pmd(mm, pmd, smm, spmd)		do {} while (0)
+#define share_page_table(vma, pmd, address)	do {} while (0)
+#define pt_cow(pmd)				0
+#define cow_unshare_pmd(mm, pmd, addr)		0
+#define pt_cow_shareable(vma, base)		0
+#define share_cow_pmd(dst_mm, dst_pmd, src_mm, src_pmd)	do {} while (0)
+#endif
+
 /*
  * Note: this doesn't free the actual pages themselves. That
  * has been handled earlier when unmapping all the memory regions.
@@ -116,9 +461,12 @@ static inline void clear_pte_range(struct mmu_gather *tlb, pmd_t *pmd,
 	if (!((addr | end) & ~PMD_MASK)) {
 		/* Only free fully aligned ranges */
 		struct page *page = pmd_page(*pmd);
+		if (pt_shared(pmd) && unshare_pmd(tlb->mm, pmd))
+			return;
 		pmd_clear(pmd);
 		dec_page_state(nr_page_table_pages);
 		tlb->mm->nr_ptes--;
+		pte_lock_deinit(page);
 		pte_free_tlb(tlb, page);
 	}
 }
@@ -211,6 +559,7 @@ pte_t fastcall * pte_alloc_map(struct mm_struct *mm, pmd_t *pmd, unsigned long a
 			pte_free(new);
 			goto out;
 		}
+		pte_lock_init(new);
 		mm->nr_ptes++;
 		inc_page_state(nr_page_table_pages);
 		pmd_populate(mm, pmd, new);
@@ -311,11 +660,83 @@ copy_one_pte(struct mm_struct *dst_mm, struct mm_struct *src_mm,
 	get_page(page);
 	inc_mm_counter(dst_mm, rss);
 	if (PageAnon(page))
-		inc_mm_counter(dst_mm, anon_rss);
+		inc_mm_anon_rss(dst_mm, page);
 	set_pte_at(dst_mm, addr, dst_pte, pte);
 	page_dup_rmap(page);
 }
 
+#ifdef COW_PAGE_TABLES
+/*
+ * Give mm a page table of its own for the copy-on-write shared one at
+ * pmd, copying the ptes as fork would have done, write protecting them
+ * in both; or if the other sharers have all gone, just let mm write
+ * through its pmd again.  Called with mm->page_table_lock held, which is
+ * dropped to allocate: threads of mm unsharing the same pmd meanwhile
+ * are then what can have changed it.
+ */
+static int cow_unshare_pmd(struct mm_struct *mm, pmd_t *pmd,
+				unsigned long addr)
+{
+	struct page *ptpage, *new = NULL;
+	spinlock_t *ptl;
+	pte_t *src_pte, *dst_pte;
+	pmd_t new_pmd;
+	int i;
+
+	addr &= PMD_MASK;
+again:
+	ptpage = pmd_page(*pmd);
+	ptl = __pte_lockptr(ptpage);
+	spin_lock(ptl);
+	if (page_count(ptpage) == 1) {
+		pt_counted(mm, pmd);
+		set_pmd(pmd, pmd_mkwrite(*pmd));
+		spin_unlock(ptl);
+		if (new)
+			pte_free(new);
+		return 0;
+	}
+	if (!new) {
+		spin_unlock(ptl);
+		spin_unlock(&mm->page_table_lock);
+		new = pte_alloc_one(mm, addr);
+		spin_lock(&mm->page_table_lock);
+		if (!new)
+			return -ENOMEM;
+		if (!pt_cow(pmd)) {
+			pte_free(new);
+			return 0;
+		}
+		goto again;
+	}
+
+	/*
+	 * Fill the new page table before pointing the pmd at it: lockless
+	 * anonymous faults only keep out of write protected pmds.  The
+	 * vmas are private, so copy as for a COW mapping; mm is on the
+	 * mmlist since the page table was shared.
+	 */
+	pte_lock_init(new);
+	pmd_populate(mm, &new_pmd, new);
+	src_pte = pte_offset_map_nested(pmd, addr);
+	dst_pte = pte_offset_map(&new_pmd, addr);
+	for (i = 0; i < PTRS_PER_PTE; i++, addr += PAGE_SIZE)
+		if (!pte_none(src_pte[i]))
+			copy_one_pte(mm, mm, dst_pte + i, src_pte + i,
+				     VM_MAYWRITE, addr);
+	pte_unmap(dst_pte);
+	pte_unmap_nested(src_pte);
+
+	inc_page_state(nr_page_table_pages);
+	set_pmd(pmd, new_pmd);
+	/* Nothing of the old one may stay in our TLB once others free it */
+	flush_tlb_mm(mm);
+	put_page(ptpage);
+	spin_unlock(ptl);
+	return 0;
+}
+#endif
+
 static int copy_pte_range(struct mm_struct *dst_mm, struct mm_struct *src_mm,
 		pmd_t *dst_pmd, pmd_t *src_pmd, struct vm_area_struct *vma,
 		unsigned long addr, unsigned long end)
@@ -332,6 +753,8 @@ again:
 
 	progress = 0;
 	spin_lock(&src_mm->page_table_lock);
+	/* Other sharers of the source page table may be faulting into it */
+	pte_lock_nested(src_pmd);
 	do {
 		/*
 		 * We are holding two locks at this point - either of them
@@ -348,6 +771,7 @@ again:
 		copy_one_pte(dst_mm, src_mm, dst_pte, src_pte, vm_flags, addr);
 		progress += 8;
 	} while (dst_pte++, src_pte++, addr += PAGE_SIZE, addr != end);
+	pte_unlock_nested(src_pmd);
 	spin_unlock(&src_mm->page_table_lock);
 
 	pte_unmap_nested(src_pte - 1);
@@ -373,6 +797,16 @@ static inline int copy_pmd_range(struct mm_struct *dst_mm, struct mm_struct *src
 		next = pmd_addr_end(addr, end);
 		if (pmd_none_or_clear_bad(src_pmd))
 			continue;
+		/* The child's vma is the parent's, less VM_LOCKED */
+		if (!(vma->vm_flags & VM_LOCKED) && pt_shareable(vma, addr) &&
+		    pmd_none(*dst_pmd)) {
+			__share_pmd(dst_mm, dst_pmd, src_mm, src_pmd);
+			continue;
+		}
+		if (pt_cow_shareable(vma, addr) && pmd_none(*dst_pmd)) {
+			share_cow_pmd(dst_mm, dst_pmd, src_mm, src_pmd);
+			continue;
+		}
 		if (copy_pte_range(dst_mm, src_mm, dst_pmd, src_pmd,
 						vma, addr, next))
 			return -ENOMEM;
@@ -431,7 +865,10 @@ static void zap_pte_range(struct mmu_gather *tlb, pmd_t *pmd,
 				struct zap_details *details)
 {
 	pte_t *pte;
+	int counted;
 
+	pte_lock_nested(pmd);
+	counted = pt_counted(tlb->mm, pmd);
 	pte = pte_offset_map(pmd, addr);
 	do {
 		pte_t ptent = *pte;
@@ -474,11 +911,13 @@ static void zap_pte_range(struct mmu_gather *tlb, pmd_t *pmd,
 					   pgoff_to_pte(page->index));
 			if (pte_dirty(ptent))
 				set_page_dirty(page);
-			if (PageAnon(page))
-				dec_mm_counter(tlb->mm, anon_rss);
-			else if (pte_young(ptent))
+			if (PageAnon(page)) {
+				if (counted)
+					dec_mm_anon_rss(tlb->mm, page);
+			} else if (pte_young(ptent))
 				mark_page_accessed(page);
-			tlb->freed++;
+			if (counted)
+				tlb->freed++;
 			page_remove_rmap(page);
 			tlb_remove_page(tlb, page);
 			continue;
@@ -494,6 +933,10 @@ static void zap_pte_range(struct mmu_gather *tlb, pmd_t *pmd,
 		pte_clear(tlb->mm, addr, pte);
 	} while (pte++, addr += PAGE_SIZE, addr != end);
 	pte_unmap(pte - 1);
+	/* Truncating a shared page table: the other sharers' TLBs too */
+	if (pt_shared(pmd))
+		flush_tlb_all();
+	pte_unlock_nested(pmd);
 }
 
 static inline void zap_pmd_range(struct mmu_gather *tlb, pud_t *pud,
@@ -624,6 +1067,16 @@ int unmap_vmas(struct mmu_gather **tlbp, struct mm_struct *mm,
 				unmap_hugepage_range(vma, start, end);
 			} else {
 				block = min(zap_bytes, end - start);
+				/*
+				 * Unmapping on the mm's own account: leave
+				 * shared page tables to the other sharers.
+				 * Copy-on-write ones across the ends of the
+				 * range have been copied by the caller, see
+				 * unshare_page_table_ends().
+				 */
+				if (!details)
+					__unshare_page_tables(mm, start,
+							start + block);
 				unmap_page_range(*tlbp, vma, start,
 						start + block, details);
 			}
@@ -688,7 +1141,7 @@ void zap_page_range(struct vm_area_struct *vma, unsigned long address,
 
 /*
  * Do a quick page-table lookup for a single page.
- * mm->page_table_lock must be held.
+ * mm->page_table_lock must be held; the pte lock is taken here.
  */
 static struct page *
 __follow_page(struct mm_struct *mm, unsigned long address, int read, int write)
@@ -717,13 +1170,15 @@ __follow_page(struct mm_struct *mm, unsigned long address, int read, int write)
 		goto out;
 	if (pmd_huge(*pmd))
 		return follow_huge_pmd(mm, address, pmd, write);
-
-	ptep = pte_offset_map(pmd, address);
-	if (!ptep)
+	/* Writing through a shared page table must fault to copy it */
+	if (write && pt_cow(pmd))
 		goto out;
 
+	pte_lock_nested(pmd);
+	ptep = pte_offset_map(pmd, address);
 	pte = *ptep;
 	pte_unmap(ptep);
+	pte_unlock_nested(pmd);
 	if (pte_present(pte)) {
 		if (write && !pte_write(pte))
 			goto out;
@@ -934,6 +1389,28 @@ out:
 
 EXPORT_SYMBOL(get_user_pages);
 
+/*
+ * With split pte locks (hence atomic rss counters) and an atomic pte
+ * exchange, write faults on untouched anonymous pages fill the pte
+ * without taking any lock: see do_anonymous_page_atomic().  Everyone
+ * else filling a pte_none() entry of an anonymous vma must then use
+ * set_pte_none(), which fails if such a fault got there first.
+ */
+#if defined(SPLIT_PTLOCKS) && defined(__HAVE_ARCH_PTEP_CMPXCHG)
+#define ATOMIC_ANON_FAULT
+#endif
+
+static inline int set_pte_none(struct mm_struct *mm, unsigned long addr,
+				pte_t *ptep, pte_t orig_pte, pte_t pte)
+{
+#ifdef ATOMIC_ANON_FAULT
+	return ptep_cmpxchg(mm, addr, ptep, orig_pte, pte);
+#else
+	set_pte_at(mm, addr, ptep, pte);
+	return 1;
+#endif
+}
+
 static int zeromap_pte_range(struct mm_struct *mm, pmd_t *pmd,
 			unsigned long addr, unsigned long end, pgprot_t prot)
 {
@@ -942,11 +1419,15 @@ static int zeromap_pte_range(struct mm_struct *mm, pmd_t *pmd,
 	pte = pte_alloc_map(mm, pmd, addr);
 	if (!pte)
 		return -ENOMEM;
+	pte_lock_nested(pmd);
 	do {
 		pte_t zero_pte = pte_wrprotect(mk_pte(ZERO_PAGE(addr), prot));
-		BUG_ON(!pte_none(*pte));
-		set_pte_at(mm, addr, pte, zero_pte);
+		pte_t orig_pte = *pte;
+		BUG_ON(!pte_none(orig_pte));
+		/* A racing fault leaves a zeroed page: as good */
+		set_pte_none(mm, addr, pte, orig_pte, zero_pte);
 	} while (pte++, addr += PAGE_SIZE, addr != end);
+	pte_unlock_nested(pmd);
 	pte_unmap(pte - 1);
 	return 0;
 }
@@ -1123,7 +1604,7 @@ static inline pte_t maybe_mkwrite(pte_t pte, struct vm_area_struct *vma)
 }
 
 /*
- * We hold the mm semaphore for reading and vma->vm_mm->page_table_lock
+ * We hold the mm semaphore for reading and the pte lock
  */
 static inline void break_cow(struct vm_area_struct * vma, struct page * new_page, unsigned long address, 
 		pte_t *page_table)
@@ -1154,14 +1635,15 @@ static inline void break_cow(struct vm_area_struct * vma, struct page * new_page
  * change only once the write actually happens. This avoids a few races,
  * and potentially makes it more efficient.
  *
- * We hold the mm semaphore and the page_table_lock on entry and exit
- * with the page_table_lock released.
+ * We hold the mm semaphore and the pte lock on entry and exit
+ * with the pte lock released.
  */
 static int do_wp_page(struct mm_struct *mm, struct vm_area_struct * vma,
 	unsigned long address, pte_t *page_table, pmd_t *pmd, pte_t pte)
 {
 	struct page *old_page, *new_page;
 	unsigned long pfn = pte_pfn(pte);
+	spinlock_t *ptl = pte_lockptr(mm, pmd);
 	pte_t entry;
 
 	if (unlikely(!pfn_valid(pfn))) {
@@ -1173,7 +1655,7 @@ static int do_wp_page(struct mm_struct *mm, struct vm_area_struct * vma,
 		pte_unmap(page_table);
 		printk(KERN_ERR "do_wp_page: bogus page at address %08lx\n",
 				address);
-		spin_unlock(&mm->page_table_lock);
+		spin_unlock(ptl);
 		return VM_FAULT_OOM;
 	}
 	old_page = pfn_to_page(pfn);
@@ -1189,7 +1671,7 @@ static int do_wp_page(struct mm_struct *mm, struct vm_area_struct * vma,
 			update_mmu_cache(vma, address, entry);
 			lazy_mmu_prot_update(entry);
 			pte_unmap(page_table);
-			spin_unlock(&mm->page_table_lock);
+			spin_unlock(ptl);
 			return VM_FAULT_MINOR;
 		}
 	}
@@ -1200,7 +1682,7 @@ static int do_wp_page(struct mm_struct *mm, struct vm_area_struct * vma,
 	 */
 	if (!PageReserved(old_page))
 		page_cache_get(old_page);
-	spin_unlock(&mm->page_table_lock);
+	spin_unlock(ptl);
 
 	if (unlikely(anon_vma_prepare(vma)))
 		goto no_new_page;
@@ -1217,17 +1699,18 @@ static int do_wp_page(struct mm_struct *mm, struct vm_area_struct * vma,
 	/*
 	 * Re-check the pte - we dropped the lock
 	 */
-	spin_lock(&mm->page_table_lock);
+	spin_lock(ptl);
 	page_table = pte_offset_map(pmd, address);
 	if (likely(pte_same(*page_table, pte))) {
 		if (PageAnon(old_page))
-			dec_mm_counter(mm, anon_rss);
+			dec_mm_anon_rss(mm, old_page);
 		if (PageReserved(old_page))
 			inc_mm_counter(mm, rss);
 		else
 			page_remove_rmap(old_page);
 		flush_cache_page(vma, address, pfn);
 		break_cow(vma, new_page, address, page_table);
+		SetPageSwapBacked(new_page);
 		lru_cache_add_active(new_page);
 		page_add_anon_rmap(new_page, vma, address);
 
@@ -1237,7 +1720,7 @@ static int do_wp_page(struct mm_struct *mm, struct vm_area_struct * vma,
 	pte_unmap(page_table);
 	page_cache_release(new_page);
 	page_cache_release(old_page);
-	spin_unlock(&mm->page_table_lock);
+	spin_unlock(ptl);
 	return VM_FAULT_MINOR;
 
 no_new_page:
@@ -1565,8 +2048,8 @@ void swapin_readahead(swp_entry_t entry, unsigned long addr,struct vm_area_struc
 }
 
 /*
- * We hold the mm semaphore and the page_table_lock on entry and
- * should release the pagetable lock on exit..
+ * We hold the mm semaphore and the pte lock on entry and
+ * should release the pte lock on exit..
  */
 static int do_swap_page(struct mm_struct * mm,
 	struct vm_area_struct * vma, unsigned long address,
@@ -1574,11 +2057,12 @@ static int do_swap_page(struct mm_struct * mm,
 {
 	struct page *page;
 	swp_entry_t entry = pte_to_swp_entry(orig_pte);
+	spinlock_t *ptl = pte_lockptr(mm, pmd);
 	pte_t pte;
 	int ret = VM_FAULT_MINOR;
 
 	pte_unmap(page_table);
-	spin_unlock(&mm->page_table_lock);
+	spin_unlock(ptl);
 	page = lookup_swap_cache(entry);
 	if (!page) {
  		swapin_readahead(entry, address, vma);
@@ -1588,14 +2072,14 @@ static int do_swap_page(struct mm_struct * mm,
 			 * Back out if somebody else faulted in this pte while
 			 * we released the page table lock.
 			 */
-			spin_lock(&mm->page_table_lock);
+			spin_lock(ptl);
 			page_table = pte_offset_map(pmd, address);
 			if (likely(pte_same(*page_table, orig_pte)))
 				ret = VM_FAULT_OOM;
 			else
 				ret = VM_FAULT_MINOR;
 			pte_unmap(page_table);
-			spin_unlock(&mm->page_table_lock);
+			spin_unlock(ptl);
 			goto out;
 		}
 
@@ -1612,11 +2096,11 @@ static int do_swap_page(struct mm_struct * mm,
 	 * Back out if somebody else faulted in this pte while we
 	 * released the page table lock.
 	 */
-	spin_lock(&mm->page_table_lock);
+	spin_lock(ptl);
 	page_table = pte_offset_map(pmd, address);
 	if (unlikely(!pte_same(*page_table, orig_pte))) {
 		pte_unmap(page_table);
-		spin_unlock(&mm->page_table_lock);
+		spin_unlock(ptl);
 		unlock_page(page);
 		page_cache_release(page);
 		ret = VM_FAULT_MINOR;
@@ -1652,13 +2136,13 @@ static int do_swap_page(struct mm_struct * mm,
 	update_mmu_cache(vma, address, pte);
 	lazy_mmu_prot_update(pte);
 	pte_unmap(page_table);
-	spin_unlock(&mm->page_table_lock);
+	spin_unlock(ptl);
 out:
 	return ret;
 }
 
 /*
- * We are called with the MM semaphore and page_table_lock
+ * We are called with the MM semaphore and pte lock
  * spinlock held to protect against concurrent faults in
  * multithreaded programs. 
  */
@@ -1667,17 +2151,19 @@ do_anonymous_page(struct mm_struct *mm, struct vm_area_struct *vma,
 		pte_t *page_table, pmd_t *pmd, int write_access,
 		unsigned long addr)
 {
-	pte_t entry;
+	pte_t entry, orig_pte;
 	struct page * page = ZERO_PAGE(addr);
+	spinlock_t *ptl = pte_lockptr(mm, pmd);
 
 	/* Read-only mapping of ZERO_PAGE. */
 	entry = pte_wrprotect(mk_pte(ZERO_PAGE(addr), vma->vm_page_prot));
+	orig_pte = *page_table;
 
 	/* ..except if it's a write access */
 	if (write_access) {
 		/* Allocate our own private page. */
 		pte_unmap(page_table);
-		spin_unlock(&mm->page_table_lock);
+		spin_unlock(ptl);
 
 		if (unlikely(anon_vma_prepare(vma)))
 			goto no_mem;
@@ -1685,37 +2171,98 @@ do_anonymous_page(struct mm_struct *mm, struct vm_area_struct *vma,
 		if (!page)
 			goto no_mem;
 
-		spin_lock(&mm->page_table_lock);
+		spin_lock(ptl);
 		page_table = pte_offset_map(pmd, addr);
+		orig_pte = *page_table;
 
-		if (!pte_none(*page_table)) {
+		entry = maybe_mkwrite(pte_mkdirty(mk_pte(page,
+							 vma->vm_page_prot)),
+				      vma);
+		if (!pte_none(orig_pte) ||
+		    !set_pte_none(mm, addr, page_table, orig_pte, entry)) {
 			pte_unmap(page_table);
 			page_cache_release(page);
-			spin_unlock(&mm->page_table_lock);
+			spin_unlock(ptl);
 			goto out;
 		}
 		inc_mm_counter(mm, rss);
-		entry = maybe_mkwrite(pte_mkdirty(mk_pte(page,
-							 vma->vm_page_prot)),
-				      vma);
+		SetPageSwapBacked(page);
 		lru_cache_add_active(page);
 		SetPageReferenced(page);
 		page_add_anon_rmap(page, vma, addr);
+	} else if (!set_pte_none(mm, addr, page_table, orig_pte, entry)) {
+		pte_unmap(page_table);
+		spin_unlock(ptl);
+		goto out;
 	}
-
-	set_pte_at(mm, addr, page_table, entry);
 	pte_unmap(page_table);
 
 	/* No need to invalidate - it was non-present before */
 	update_mmu_cache(vma, addr, entry);
 	lazy_mmu_prot_update(entry);
-	spin_unlock(&mm->page_table_lock);
+	spin_unlock(ptl);
 out:
 	return VM_FAULT_MINOR;
 no_mem:
 	return VM_FAULT_OOM;
 }
 
+/* Pages of the aligned window around a fault on a file which get mapped */
+#define FAULT_AROUND_PAGES	16
+
+/*
+ * After a read fault on a file mapping, map the other pages of the
+ * window around it which are already uptodate in the page cache, and
+ * not locked, into the empty ptes of the same page table, so that they
+ * need no fault of their own when touched.  Called with the pte lock
+ * held after the truncate_count check of do_no_page(): a truncation
+ * after that unmaps these pages too.
+ */
+static void do_fault_around(struct mm_struct *mm, struct vm_area_struct *vma,
+		unsigned long address, pte_t *page_table, pmd_t *pmd)
+{
+	struct address_space *mapping = vma->vm_file->f_mapping;
+	struct page *pages[FAULT_AROUND_PAGES];
+	unsigned long start, end, addr;
+	pgoff_t pgoff, size;
+	int counted = pt_counted(mm, pmd);
+	unsigned int i, nr;
+	pte_t *pte, entry;
+
+	address &= PAGE_MASK;
+	start = address & ~(FAULT_AROUND_PAGES * PAGE_SIZE - 1);
+	end = start + FAULT_AROUND_PAGES * PAGE_SIZE;
+	if (start < vma->vm_start)
+		start = vma->vm_start;
+	if (end > vma->vm_end)
+		end = vma->vm_end;
+	pgoff = ((start - vma->vm_start) >> PAGE_SHIFT) + vma->vm_pgoff;
+	size = (i_size_read(mapping->host) + PAGE_CACHE_SIZE - 1) >> PAGE_CACHE_SHIFT;
+
+	nr = find_get_pages(mapping, pgoff, (end - start) >> PAGE_SHIFT, pages);
+	for (i = 0; i < nr; i++) {
+		struct page *page = pages[i];
+
+		addr = start + ((page->index - pgoff) << PAGE_SHIFT);
+		pte = page_table + ((long)(addr - address) >> PAGE_SHIFT);
+		if (addr >= end || addr == address || page->index >= size ||
+		    !PageUptodate(page) || PageLocked(page) ||
+		    page->mapping != mapping || !pte_none(*pte)) {
+			page_cache_release(page);
+			continue;
+		}
+		/* the reference taken by find_get_pages() is the mapping's */
+		if (counted)
+			inc_mm_counter(mm, rss);
+		flush_icache_page(vma, page);
+		entry = mk_pte(page, vma->vm_page_prot);
+		set_pte_at(mm, addr, pte, entry);
+		page_add_file_rmap(page);
+		update_mmu_cache(vma, addr, entry);
+		lazy_mmu_prot_update(entry);
+	}
+}
+
 /*
  * do_no_page() tries to create a new page mapping. It aggressively
  * tries to share with existing pages, but makes a separate copy if
@@ -1725,8 +2272,8 @@ no_mem:
  * As this is called only for pages that do not currently exist, we
  * do not need to flush old virtual caches or the TLB.
  *
- * This is called with the MM semaphore held and the page table
- * spinlock held. Exit with the spinlock released.
+ * This is called with the MM semaphore held and the pte lock
+ * held. Exit with the lock released.
  */
 static int
 do_no_page(struct mm_struct *mm, struct vm_area_struct *vma,
@@ -1734,6 +2281,7 @@ do_no_page(struct mm_struct *mm, struct vm_area_struct *vma,
 {
 	struct page * new_page;
 	struct address_space *mapping = NULL;
+	spinlock_t *ptl = pte_lockptr(mm, pmd);
 	pte_t entry;
 	unsigned int sequence = 0;
 	int ret = VM_FAULT_MINOR;
@@ -1743,7 +2291,7 @@ do_no_page(struct mm_struct *mm, struct vm_area_struct *vma,
 		return do_anonymous_page(mm, vma, page_table,
 					pmd, write_access, address);
 	pte_unmap(page_table);
-	spin_unlock(&mm->page_table_lock);
+	spin_unlock(ptl);
 
 	if (vma->vm_file) {
 		mapping = vma->vm_file->f_mapping;
@@ -1784,7 +2332,7 @@ retry:
 		anon = 1;
 	}
 
-	spin_lock(&mm->page_table_lock);
+	spin_lock(ptl);
 	/*
 	 * For a file-backed vma, someone could have truncated or otherwise
 	 * invalidated this page.  If unmap_mapping_range got called,
@@ -1792,7 +2340,7 @@ retry:
 	 */
 	if (mapping && unlikely(sequence != mapping->truncate_count)) {
 		sequence = mapping->truncate_count;
-		spin_unlock(&mm->page_table_lock);
+		spin_unlock(ptl);
 		page_cache_release(new_page);
 		goto retry;
 	}
@@ -1810,7 +2358,7 @@ retry:
 	 */
 	/* Only go through if we didn't race with anybody else... */
 	if (pte_none(*page_table)) {
-		if (!PageReserved(new_page))
+		if (!PageReserved(new_page) && pt_counted(mm, pmd))
 			inc_mm_counter(mm, rss);
 
 		flush_icache_page(vma, new_page);
@@ -1819,23 +2367,29 @@ retry:
 			entry = maybe_mkwrite(pte_mkdirty(entry), vma);
 		set_pte_at(mm, address, page_table, entry);
 		if (anon) {
+			SetPageSwapBacked(new_page);
 			lru_cache_add_active(new_page);
 			page_add_anon_rmap(new_page, vma, address);
-		} else
+		} else {
 			page_add_file_rmap(new_page);
+			if (!write_access &&
+			    vma->vm_ops->nopage == filemap_nopage &&
+			    !(vma->vm_flags & (VM_NONLINEAR | VM_RAND_READ)))
+				do_fault_around(mm, vma, address, page_table, pmd);
+		}
 		pte_unmap(page_table);
 	} else {
 		/* One of our sibling threads was faster, back out. */
 		pte_unmap(page_table);
 		page_cache_release(new_page);
-		spin_unlock(&mm->page_table_lock);
+		spin_unlock(ptl);
 		goto out;
 	}
 
 	/* no need to invalidate: a not-present page shouldn't be cached */
 	update_mmu_cache(vma, address, entry);
 	lazy_mmu_prot_update(entry);
-	spin_unlock(&mm->page_table_lock);
+	spin_unlock(ptl);
 out:
 	return ret;
 oom:
@@ -1869,7 +2423,7 @@ static int do_file_page(struct mm_struct * mm, struct vm_area_struct * vma,
 	pgoff = pte_to_pgoff(*pte);
 
 	pte_unmap(pte);
-	spin_unlock(&mm->page_table_lock);
+	spin_unlock(pte_lockptr(mm, pmd));
 
 	err = vma->vm_ops->populate(vma, address & PAGE_MASK, PAGE_SIZE, vma->vm_page_prot, pgoff, 0);
 	if (err == -ENOMEM)
@@ -1888,7 +2442,7 @@ static int do_file_page(struct mm_struct * mm, struct vm_area_struct * vma,
  * with external mmu caches can use to update those (ie the Sparc or
  * PowerPC hashed page tables that act as extended TLBs).
  *
- * Note the "page_table_lock". It is to protect against kswapd removing
+ * Note the pte lock. It is to protect against kswapd removing
  * pages from under us. Note that kswapd only ever _removes_ pages, never
  * adds them. As such, once we have noticed that the page is not present,
  * we can drop the lock early.
@@ -1897,7 +2451,7 @@ static int do_file_page(struct mm_struct * mm, struct vm_area_struct * vma,
  * so we don't need to worry about a page being suddenly been added into
  * our VM.
  *
- * We enter with the pagetable spinlock held, we are supposed to
+ * We enter with the pte lock held, we are supposed to
  * release it when done.
  */
 static inline int handle_pte_fault(struct mm_struct *mm,
@@ -1931,9 +2485,79 @@ static inline int handle_pte_fault(struct mm_struct *mm,
 	update_mmu_cache(vma, address, entry);
 	lazy_mmu_prot_update(entry);
 	pte_unmap(pte);
-	spin_unlock(&mm->page_table_lock);
+	spin_unlock(pte_lockptr(mm, pmd));
+	return VM_FAULT_MINOR;
+}
+
+#ifdef ATOMIC_ANON_FAULT
+/*
+ * Write fault on an untouched page of a private anonymous vma whose page
+ * table is already there: allocate the zeroed page and install it with
+ * ptep_cmpxchg(), taking neither the pte lock nor page_table_lock.  The
+ * mmap_sem we hold keeps the page table in place.  Returns 0 if the
+ * fault must go the ordinary way.
+ *
+ * The page gets its anon rmap before the pte makes it visible to zap,
+ * and reaches the LRU, hence vmscan, only once it is installed.
+ */
+static int do_anonymous_page_atomic(struct mm_struct *mm,
+		struct vm_area_struct *vma, unsigned long address)
+{
+	pgd_t *pgd;
+	pud_t *pud;
+	pmd_t *pmd;
+	pte_t *pte;
+	pte_t orig_pte, entry;
+	struct page *page;
+	int installed;
+
+	pgd = pgd_offset(mm, address);
+	if (pgd_none(*pgd) || unlikely(pgd_bad(*pgd)))
+		return 0;
+	pud = pud_offset(pgd, address);
+	if (pud_none(*pud) || unlikely(pud_bad(*pud)))
+		return 0;
+	pmd = pmd_offset(pud, address);
+	if (pmd_none(*pmd) || unlikely(pmd_bad(*pmd)) || pt_cow(pmd))
+		return 0;
+
+	pte = pte_offset_map(pmd, address);
+	orig_pte = *pte;
+	pte_unmap(pte);
+	if (!pte_none(orig_pte))
+		return 0;
+
+	if (unlikely(anon_vma_prepare(vma)))
+		return 0;
+	page = alloc_zeroed_user_highpage(vma, address);
+	if (!page)
+		return 0;
+	entry = maybe_mkwrite(pte_mkdirty(mk_pte(page, vma->vm_page_prot)),
+			      vma);
+
+	inc_mm_counter(mm, rss);
+	page_add_anon_rmap(page, vma, address);
+	pte = pte_offset_map(pmd, address);
+	installed = ptep_cmpxchg(mm, address, pte, orig_pte, entry);
+	pte_unmap(pte);
+	if (unlikely(!installed)) {
+		/* Another fault filled the pte first: just use that */
+		page_remove_rmap(page);
+		dec_mm_anon_rss(mm, page);
+		dec_mm_counter(mm, rss);
+		page_cache_release(page);
+		return VM_FAULT_MINOR;
+	}
+	SetPageSwapBacked(page);
+	lru_cache_add_active(page);
+	SetPageReferenced(page);
+
+	/* No need to invalidate - it was non-present before */
+	update_mmu_cache(vma, address, entry);
+	lazy_mmu_prot_update(entry);
 	return VM_FAULT_MINOR;
 }
+#endif
 
 /*
  * By the time we get here, we already hold the mm semaphore
@@ -1945,6 +2569,7 @@ int handle_mm_fault(struct mm_struct *mm, struct vm_area_struct * vma,
 	pud_t *pud;
 	pmd_t *pmd;
 	pte_t *pte;
+	spinlock_t *ptl;
 
 	__set_current_state(TASK_RUNNING);
 
@@ -1953,9 +2578,20 @@ int handle_mm_fault(struct mm_struct *mm, struct vm_area_struct * vma,
 	if (is_vm_hugetlb_page(vma))
 		return VM_FAULT_SIGBUS;	/* mapping truncation does this. */
 
+#ifdef ATOMIC_ANON_FAULT
+	if (write_access && !vma->vm_ops) {
+		int ret = do_anonymous_page_atomic(mm, vma, address);
+		if (ret)
+			return ret;
+	}
+#endif
+
 	/*
 	 * We need the page table lock to synchronize with kswapd
-	 * and the SMP-safe atomic PTE updates.
+	 * and the SMP-safe atomic PTE updates.  mm->page_table_lock
+	 * covers allocating the page tables; the pte itself is then
+	 * handled under its own pte lock, and the mmap_sem we hold
+	 * keeps the page table from being freed.
 	 */
 	pgd = pgd_offset(mm, address);
 	spin_lock(&mm->page_table_lock);
@@ -1968,10 +2604,24 @@ int handle_mm_fault(struct mm_struct *mm, struct vm_area_struct * vma,
 	if (!pmd)
 		goto oom;
 
+	if (pmd_none(*pmd) && pt_shareable(vma, address & PMD_MASK)) {
+		spin_unlock(&mm->page_table_lock);
+		share_page_table(vma, pmd, address);
+		spin_lock(&mm->page_table_lock);
+	}
+	/* Any fault through a shared page table may change its ptes */
+	if (pt_cow(pmd) && cow_unshare_pmd(mm, pmd, address))
+		goto oom;
+
 	pte = pte_alloc_map(mm, pmd, address);
 	if (!pte)
 		goto oom;
-	
+
+	ptl = pte_lockptr(mm, pmd);
+	if (ptl != &mm->page_table_lock) {
+		spin_unlock(&mm->page_table_lock);
+		spin_lock(ptl);
+	}
 	return handle_pte_fault(mm, vma, address, write_access, pte, pmd);
 
  oom:
@@ -76,6 +76,8 @@
 #include <linux/init.h>
 #include <linux/compat.h>
 #include <linux/mempolicy.h>
+#include <linux/swap.h>
+#include <linux/migrate.h>
 #include <asm/tlbflush.h>
 #include <asm/uaccess.h>
 
@@ -127,9 +129,9 @@ static int mpol_check_policy(int mode, unsigned long *nodes)
 	return nodes_online(nodes);
 }
 
-/* Copy a node mask from user space. */
-static int get_nodes(unsigned long *nodes, unsigned long __user *nmask,
-		     unsigned long maxnode, int mode)
+/* Copy a node mask from user space, as it is. */
+static int __get_nodes(unsigned long *nodes, const unsigned long __user *nmask,
+		       unsigned long maxnode)
 {
 	unsigned long k;
 	unsigned long nlongs;
@@ -168,6 +170,18 @@ static int get_nodes(unsigned long *nodes, unsigned long __user *nmask,
 	if (copy_from_user(nodes, nmask, nlongs*sizeof(unsigned long)))
 		return -EFAULT;
 	nodes[nlongs-1] &= endmask;
+	return 0;
+}
+
+/* Copy a node mask from user space for a policy. */
+static int get_nodes(unsigned long *nodes, const unsigned long __user *nmask,
+		     unsigned long maxnode, int mode)
+{
+	int err;
+
+	err = __get_nodes(nodes, nmask, maxnode);
+	if (err)
+		return err;
 	/* Update current mems_allowed */
 	cpuset_update_current_mems_allowed();
 	/* Ignore nodes not set in current->mems_allowed */
@@ -298,7 +312,8 @@ check_range(struct mm_struct *mm, unsigned long start, unsigned long end,
 			return ERR_PTR(-EFAULT);
 		if (prev && prev->vm_end < vma->vm_start)
 			return ERR_PTR(-EFAULT);
-		if ((flags & MPOL_MF_STRICT) && !is_vm_hugetlb_page(vma)) {
+		if ((flags & MPOL_MF_STRICT) && !(flags & MPOL_MF_MOVE) &&
+		    !is_vm_hugetlb_page(vma)) {
 			err = verify_pages(vma->vm_mm,
 					   vma->vm_start, vma->vm_end, nodes);
 			if (err) {
@@ -354,6 +369,96 @@ static int mbind_range(struct vm_area_struct *vma, unsigned long start,
 	return err;
 }
 
+/*
+ * Set dest[] for the page migration from the nodes of @from to those of
+ * @to: the n-th node of @from goes to the n-th node of @to, starting
+ * again with the first when @to has fewer.  -1 for nodes not to move.
+ */
+static void map_nodes(int *dest, unsigned long *from, unsigned long *to)
+{
+	int n, t = -1;
+
+	for (n = 0; n < MAX_NUMNODES; n++)
+		dest[n] = -1;
+	for (n = find_first_bit(from, MAX_NUMNODES);
+	     n < MAX_NUMNODES;
+	     n = find_next_bit(from, MAX_NUMNODES, 1+n)) {
+		t = find_next_bit(to, MAX_NUMNODES, 1+t);
+		if (t >= MAX_NUMNODES)
+			t = find_first_bit(to, MAX_NUMNODES);
+		if (t != n)
+			dest[n] = t;
+	}
+}
+
+/* Isolate the pages of [addr, end) which dest[] wants moved. */
+static void isolate_range(struct mm_struct *mm, unsigned long addr,
+			  unsigned long end, const int *dest,
+			  struct list_head *pagelist)
+{
+	spin_lock(&mm->page_table_lock);
+	while (addr < end) {
+		struct page *p;
+		pte_t *pte;
+		pmd_t *pmd;
+		pud_t *pud;
+		pgd_t *pgd;
+		pgd = pgd_offset(mm, addr);
+		if (pgd_none(*pgd)) {
+			unsigned long next = (addr + PGDIR_SIZE) & PGDIR_MASK;
+			if (next <= addr)
+				break;
+			addr = next;
+			continue;
+		}
+		pud = pud_offset(pgd, addr);
+		if (pud_none(*pud)) {
+			addr = (addr + PUD_SIZE) & PUD_MASK;
+			continue;
+		}
+		pmd = pmd_offset(pud, addr);
+		if (pmd_none(*pmd)) {
+			addr = (addr + PMD_SIZE) & PMD_MASK;
+			continue;
+		}
+		p = NULL;
+		pte_lock_nested(pmd);
+		pte = pte_offset_map(pmd, addr);
+		if (pte_present(*pte) && pfn_valid(pte_pfn(*pte)))
+			p = pte_page(*pte);
+		/* pages mapped elsewhere too are not ours to move */
+		if (p && !PageReserved(p) && page_mapcount(p) == 1 &&
+		    dest[page_to_nid(p)] >= 0)
+			isolate_lru_page(p, pagelist);
+		pte_unmap(pte);
+		pte_unlock_nested(pmd);
+		addr += PAGE_SIZE;
+		cond_resched_lock(&mm->page_table_lock);
+	}
+	spin_unlock(&mm->page_table_lock);
+}
+
+/*
+ * Step 3: move the pages of the vmas from @vma on in [start, end) to
+ * the nodes dest[] gives; the number of pages which were not moved.
+ */
+static int migrate_range(struct mm_struct *mm, struct vm_area_struct *vma,
+			 unsigned long start, unsigned long end,
+			 const int *dest)
+{
+	LIST_HEAD(pagelist);
+
+	lru_add_drain();
+	for (; vma && vma->vm_start < end; vma = vma->vm_next) {
+		if ((vma->vm_flags & (VM_IO|VM_RESERVED|VM_LOCKED)) ||
+		    is_vm_hugetlb_page(vma))
+			continue;
+		isolate_range(mm, max(start, vma->vm_start),
+			      min(end, vma->vm_end), dest, &pagelist);
+	}
+	return migrate_pages(mm, &pagelist, dest);
+}
+
 /* Change policy for a memory range */
 asmlinkage long sys_mbind(unsigned long start, unsigned long len,
 			  unsigned long mode,
@@ -365,14 +470,17 @@ asmlinkage long sys_mbind(unsigned long start, unsigned long len,
 	struct mempolicy *new;
 	unsigned long end;
 	DECLARE_BITMAP(nodes, MAX_NUMNODES);
+	DECLARE_BITMAP(others, MAX_NUMNODES);
+	int *dest = NULL;
 	int err;
 
-	if ((flags & ~(unsigned long)(MPOL_MF_STRICT)) || mode > MPOL_MAX)
+	if ((flags & ~(unsigned long)(MPOL_MF_STRICT|MPOL_MF_MOVE)) ||
+	    mode > MPOL_MAX)
 		return -EINVAL;
 	if (start & ~PAGE_MASK)
 		return -EINVAL;
 	if (mode == MPOL_DEFAULT)
-		flags &= ~MPOL_MF_STRICT;
+		flags &= ~(MPOL_MF_STRICT|MPOL_MF_MOVE);
 	len = (len + PAGE_SIZE - 1) & PAGE_MASK;
 	end = start + len;
 	if (end < start)
@@ -384,9 +492,22 @@ asmlinkage long sys_mbind(unsigned long start, unsigned long len,
 	if (err)
 		return err;
 
+	/* a local preferred node has nowhere to move to */
+	if (bitmap_empty(nodes, MAX_NUMNODES))
+		flags &= ~MPOL_MF_MOVE;
+	if (flags & MPOL_MF_MOVE) {
+		dest = kmalloc(MAX_NUMNODES * sizeof(int), GFP_KERNEL);
+		if (!dest)
+			return -ENOMEM;
+		bitmap_andnot(others, nodes_addr(node_online_map), nodes,
+			      MAX_NUMNODES);
+		map_nodes(dest, others, nodes);
+	}
+
 	new = mpol_new(mode, nodes);
+	err = PTR_ERR(new);
 	if (IS_ERR(new))
-		return PTR_ERR(new);
+		goto out;
 
 	PDprintk("mbind %lx-%lx mode:%ld nodes:%lx\n",start,start+len,
 			mode,nodes[0]);
@@ -396,8 +517,14 @@ asmlinkage long sys_mbind(unsigned long start, unsigned long len,
 	err = PTR_ERR(vma);
 	if (!IS_ERR(vma))
 		err = mbind_range(vma, start, end, new);
+	if (!err && dest &&
+	    migrate_range(mm, find_vma(mm, start), start, end, dest) &&
+	    (flags & MPOL_MF_STRICT))
+		err = -EIO;
 	up_write(&mm->mmap_sem);
 	mpol_free(new);
+out:
+	kfree(dest);
 	return err;
 }
 
@@ -550,6 +677,60 @@ asmlinkage long sys_get_mempolicy(int __user *policy,
 	return err;
 }
 
+/*
+ * Move the pages of process @pid which are on the nodes of @old_nodes to
+ * those of @new_nodes.  Returns the number of pages which could not be
+ * moved.
+ */
+asmlinkage long sys_migrate_pages(pid_t pid, unsigned long maxnode,
+				  const unsigned long __user *old_nodes,
+				  const unsigned long __user *new_nodes)
+{
+	struct mm_struct *mm;
+	struct task_struct *task;
+	DECLARE_BITMAP(old, MAX_NUMNODES);
+	DECLARE_BITMAP(new, MAX_NUMNODES);
+	int *dest;
+	int err;
+
+	err = __get_nodes(old, old_nodes, maxnode);
+	if (err)
+		return err;
+	err = get_nodes(new, new_nodes, maxnode, MPOL_INTERLEAVE);
+	if (err)
+		return err;
+
+	read_lock(&tasklist_lock);
+	task = pid ? find_task_by_pid(pid) : current;
+	if (!task) {
+		read_unlock(&tasklist_lock);
+		return -ESRCH;
+	}
+	mm = get_task_mm(task);
+	read_unlock(&tasklist_lock);
+	if (!mm)
+		return -EINVAL;
+
+	err = -EPERM;
+	if ((current->euid != task->euid) && (current->euid != task->uid) &&
+	    !capable(CAP_SYS_NICE))
+		goto out;
+
+	err = -ENOMEM;
+	dest = kmalloc(MAX_NUMNODES * sizeof(int), GFP_KERNEL);
+	if (!dest)
+		goto out;
+	map_nodes(dest, old, new);
+
+	down_read(&mm->mmap_sem);
+	err = migrate_range(mm, mm->mmap, 0, ~0UL, dest);
+	up_read(&mm->mmap_sem);
+	kfree(dest);
+out:
+	mmput(mm);
+	return err;
+}
+
 #ifdef CONFIG_COMPAT
 
 asmlinkage long compat_sys_get_mempolicy(int __user *policy,
@@ -627,6 +808,39 @@ asmlinkage long compat_sys_mbind(compat_ulong_t start, compat_ulong_t len,
 	return sys_mbind(start, len, mode, nm, nr_bits+1, flags);
 }
 
+asmlinkage long compat_sys_migrate_pages(compat_pid_t pid,
+			     compat_ulong_t maxnode,
+			     compat_ulong_t __user *old_nodes,
+			     compat_ulong_t __user *new_nodes)
+{
+	long err = 0;
+	unsigned long __user *old = NULL;
+	unsigned long __user *new = NULL;
+	unsigned long nr_bits, alloc_size;
+	DECLARE_BITMAP(bm, MAX_NUMNODES);
+
+	nr_bits = min_t(unsigned long, maxnode-1, MAX_NUMNODES);
+	alloc_size = ALIGN(nr_bits, BITS_PER_LONG) / 8;
+
+	if (old_nodes) {
+		err = compat_get_bitmap(bm, old_nodes, nr_bits);
+		old = compat_alloc_user_space(2 * alloc_size);
+		new = old + alloc_size / sizeof(unsigned long);
+		err |= copy_to_user(old, bm, alloc_size);
+	}
+	if (new_nodes) {
+		err |= compat_get_bitmap(bm, new_nodes, nr_bits);
+		if (!new)
+			new = compat_alloc_user_space(alloc_size);
+		err |= copy_to_user(new, bm, alloc_size);
+	}
+
+	if (err)
+		return -EFAULT;
+
+	return sys_migrate_pages(pid, nr_bits+1, old, new);
+}
+
 #endif
 
 /* Return effective policy for a VMA */
@@ -0,0 +1,234 @@
+/*
+ * linux/mm/migrate.c
+ *
+ * Moving pages to another NUMA node, for sys_migrate_pages() and for
+ * mbind(MPOL_MF_MOVE).
+ *
+ * A page is isolated from the LRU, unmapped with try_to_unmap() and
+ * copied into a page allocated on the target node, which then takes its
+ * slot in the radix tree of the mapping.  Anonymous pages have no such
+ * slot of their own, so they are added to the swap cache first: their
+ * ptes become swap entries, and the new copy is mapped back into the mm
+ * afterwards.  Only pages nobody else holds a reference to can be moved;
+ * the others are left where they are, and counted.
+ */
+
+#include <linux/mm.h>
+#include <linux/swap.h>
+#include <linux/pagemap.h>
+#include <linux/buffer_head.h>
+#include <linux/highmem.h>
+#include <linux/mm_inline.h>
+#include <linux/rmap.h>
+#include <linux/migrate.h>
+
+/* Passes over the pages which could not be moved yet */
+#define MIGRATE_PASSES	3
+
+/*
+ * Take @page off its LRU list and put it on @pagelist with a reference
+ * of its own, 1 if it was on the LRU.  PageActive still tells which list
+ * it came from.
+ */
+int isolate_lru_page(struct page *page, struct list_head *pagelist)
+{
+	struct zone *zone = page_zone(page);
+	int ret = 0;
+
+	spin_lock_irq(&zone->lru_lock);
+	if (TestClearPageLRU(page)) {
+		page_cache_get(page);
+		del_page_from_lru_list(zone, page, page_lru(page));
+		list_add_tail(&page->lru, pagelist);
+		ret = 1;
+	}
+	spin_unlock_irq(&zone->lru_lock);
+	return ret;
+}
+
+/* Give the pages of isolate_lru_page() back to the LRU */
+void putback_lru_pages(struct list_head *pagelist)
+{
+	struct page *page, *page2;
+
+	list_for_each_entry_safe(page, page2, pagelist, lru) {
+		list_del(&page->lru);
+		if (TestClearPageActive(page))
+			lru_cache_add_active(page);
+		else
+			lru_cache_add(page);
+		page_cache_release(page);
+	}
+}
+
+/*
+ * Hand the state of @page over to @newpage, which replaces it in @slot.
+ * Called with the tree_lock of the mapping held and the references of
+ * @page frozen.
+ */
+static void migrate_page_state(struct page *newpage, struct page *page,
+			       void **slot)
+{
+	SetPageLocked(newpage);
+	if (PageUptodate(page))
+		SetPageUptodate(newpage);
+	if (PageReferenced(page))
+		SetPageReferenced(newpage);
+	if (PageError(page))
+		SetPageError(newpage);
+	if (PageChecked(page))
+		SetPageChecked(newpage);
+	if (PageMappedToDisk(page))
+		SetPageMappedToDisk(newpage);
+	if (PageSwapBacked(page))
+		SetPageSwapBacked(newpage);
+	/* the radix tree tags stay with the slot, the accounting too */
+	if (PageDirty(page))
+		SetPageDirty(newpage);
+	ClearPageDirty(page);
+	if (PageSwapCache(page)) {
+		SetPageSwapCache(newpage);
+		newpage->private = page->private;
+		ClearPageSwapCache(page);
+		page->private = 0;
+	}
+	newpage->index = page->index;
+	newpage->mapping = page->mapping;
+	page->mapping = NULL;
+
+	page_cache_get(newpage);		/* for the mapping */
+	rcu_assign_pointer(*slot, newpage);
+}
+
+/*
+ * Move an isolated page to node @nid, remapping anonymous pages into @mm.
+ * 0 when @page is no longer in use and can be freed, -EAGAIN when it
+ * may be worth trying again, another error when it is not.
+ */
+static int migrate_page(struct mm_struct *mm, struct page *page, int nid)
+{
+	struct address_space *mapping;
+	struct page *newpage;
+	unsigned int gfp_mask;
+	pgoff_t index;
+	void **slot;
+	int rc;
+
+	lock_page(page);
+
+	if (PageAnon(page) && !PageSwapCache(page)) {
+		rc = -ENOMEM;
+		if (!add_to_swap(page))
+			goto unlock;
+	}
+
+	rc = 0;
+	mapping = page_mapping(page);
+	if (!mapping)
+		goto unlock;		/* truncated meanwhile */
+
+	rc = -EAGAIN;
+	if (page_mapped(page) && try_to_unmap(page, 1) != SWAP_SUCCESS)
+		goto unlock;
+
+	if (PagePrivate(page)) {
+		if (PageDirty(page)) {
+			write_one_page(page, 1);
+			lock_page(page);
+			if (page_mapping(page) != mapping)
+				goto unlock;
+		}
+		if (!try_to_release_page(page, GFP_KERNEL))
+			goto unlock;
+	}
+	wait_on_page_writeback(page);
+
+	if (PageSwapCache(page)) {
+		gfp_mask = GFP_HIGHUSER;
+		index = page->private;
+	} else {
+		gfp_mask = mapping_gfp_mask(mapping);
+		index = page->index;
+	}
+
+	rc = -ENOMEM;
+	newpage = alloc_pages_node(nid, gfp_mask | __GFP_NOWARN, 0);
+	if (!newpage)
+		goto unlock;
+	if (page_to_nid(newpage) != nid) {
+		page_cache_release(newpage);
+		goto unlock;
+	}
+	copy_highpage(newpage, page);
+
+	/* Nobody but us and the mapping may hold the page any more */
+	rc = -EAGAIN;
+	write_lock_irq(&mapping->tree_lock);
+	slot = radix_tree_lookup_slot(&mapping->page_tree, index);
+	if (!slot || *slot != page || page_mapped(page) ||
+	    PagePrivate(page) || !page_freeze_refs(page, 2)) {
+		write_unlock_irq(&mapping->tree_lock);
+		page_cache_release(newpage);
+		goto unlock;
+	}
+	migrate_page_state(newpage, page, slot);
+	page_unfreeze_refs(page, 1);		/* ours */
+	write_unlock_irq(&mapping->tree_lock);
+
+	if (PageAnon(newpage))
+		remap_swap_page(mm, newpage);
+	unlock_page(newpage);
+	if (PageActive(page))
+		lru_cache_add_active(newpage);
+	else
+		lru_cache_add(newpage);
+	page_cache_release(newpage);
+	rc = 0;
+unlock:
+	/* give back the ptes of an anonymous page we could not move */
+	if (rc && PageAnon(page) && PageSwapCache(page))
+		remap_swap_page(mm, page);
+	unlock_page(page);
+	return rc;
+}
+
+/**
+ * migrate_pages - move pages to other nodes
+ * @mm: the mm to map anonymous pages back into
+ * @pagelist: pages isolated with isolate_lru_page()
+ * @dest: the node to move to, indexed by the node a page is on
+ *
+ * The caller holds the mmap_sem of @mm.  All pages are off @pagelist
+ * afterwards: freed when they were moved, back on the LRU when not.
+ * Returns the number of pages which were not moved.
+ */
+int migrate_pages(struct mm_struct *mm, struct list_head *pagelist,
+		  const int *dest)
+{
+	LIST_HEAD(failed);
+	struct page *page, *page2;
+	int pass, rc, nr_failed = 0;
+
+	for (pass = 0; pass < MIGRATE_PASSES && !list_empty(pagelist); pass++) {
+		list_for_each_entry_safe(page, page2, pagelist, lru) {
+			cond_resched();
+			rc = migrate_page(mm, page, dest[page_to_nid(page)]);
+			if (rc == -EAGAIN)
+				continue;
+			if (rc) {
+				list_move(&page->lru, &failed);
+				nr_failed++;
+				continue;
+			}
+			list_del(&page->lru);
+			ClearPageActive(page);
+			page_cache_release(page);
+		}
+	}
+	list_for_each_entry(page, pagelist, lru)
+		nr_failed++;
+
+	putback_lru_pages(pagelist);
+	putback_lru_pages(&failed);
+	return nr_failed;
+}
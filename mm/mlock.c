@@ -24,6 +24,11 @@ static int mlock_fixup(struct vm_area_struct *vma, struct vm_area_struct **prev,
 		goto out;
 	}
 
+	/* Page tables are only shared between vmas of the same VM_LOCKED */
+	ret = unshare_page_tables(vma, start, end);
+	if (ret)
+		goto out;
+
 	pgoff = vma->vm_pgoff + ((start - vma->vm_start) >> PAGE_SHIFT);
 	*prev = vma_merge(mm, *prev, start, end, newflags, vma->anon_vma,
 			  vma->vm_file, pgoff, vma_policy(vma));
@@ -907,6 +907,17 @@ unsigned long do_mmap_pgoff(struct file * file, unsigned long addr,
 	if ((pgoff + (len >> PAGE_SHIFT)) < pgoff)
                return -EOVERFLOW;
 
+#ifdef MAP_LARGEPAGE
+	/* huge page snapshot if we can, an ordinary mapping if not */
+	if (file && (flags & MAP_LARGEPAGE) && !is_file_hugepages(file)) {
+		unsigned long ret;
+
+		ret = hugetlb_mmap_file(file, addr, len, prot, flags, pgoff);
+		if (!(ret & ~PAGE_MASK))
+			return ret;
+	}
+#endif
+
 	/* Too many mappings? */
 	if (mm->map_count > sysctl_max_map_count)
 		return -ENOMEM;
@@ -1778,6 +1789,7 @@ int do_munmap(struct mm_struct *mm, unsigned long start, size_t len)
 {
 	unsigned long end;
 	struct vm_area_struct *mpnt, *prev, *last;
+	int error;
 
 	if ((start & ~PAGE_MASK) || start > TASK_SIZE || len > TASK_SIZE-start)
 		return -EINVAL;
@@ -1796,6 +1808,11 @@ int do_munmap(struct mm_struct *mm, unsigned long start, size_t len)
 	if (mpnt->vm_start >= end)
 		return 0;
 
+	/* Page tables shared with other mms must not be partly unmapped */
+	error = unshare_page_table_ends(mm, start, end);
+	if (error)
+		return error;
+
 	/*
 	 * If we need to split any vma, do it now to save pain later.
 	 *
@@ -1804,7 +1821,7 @@ int do_munmap(struct mm_struct *mm, unsigned long start, size_t len)
 	 * places tmp vma above, and higher split_vma places tmp vma below.
 	 */
 	if (start > mpnt->vm_start) {
-		int error = split_vma(mm, mpnt, start, 0);
+		error = split_vma(mm, mpnt, start, 0);
 		if (error)
 			return error;
 		prev = mpnt;
@@ -1813,7 +1830,7 @@ int do_munmap(struct mm_struct *mm, unsigned long start, size_t len)
 	/* Does it split the last one? */
 	last = find_vma(mm, end);
 	if (last && end > last->vm_start) {
-		int error = split_vma(mm, last, end, 1);
+		error = split_vma(mm, last, end, 1);
 		if (error)
 			return error;
 	}
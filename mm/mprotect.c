@@ -135,6 +135,11 @@ mprotect_fixup(struct vm_area_struct *vma, struct vm_area_struct **pprev,
 
 	newprot = protection_map[newflags & 0xf];
 
+	/* The ptes are about to change for this mm alone */
+	error = unshare_page_tables(vma, start, end);
+	if (error)
+		goto fail;
+
 	/*
 	 * First try to merge with previous and/or next vma.
 	 */
@@ -18,8 +18,9 @@
 #include <asm/tlbflush.h>
 
 /*
- * Called with mm->page_table_lock held to protect against other
- * threads/the swapper from ripping pte's out from under us.
+ * Called with mm->page_table_lock held, and takes the pte lock, to
+ * protect against other threads/the swapper from ripping pte's out
+ * from under us.
  */
 
 static void sync_pte_range(struct vm_area_struct *vma, pmd_t *pmd,
@@ -27,6 +28,7 @@ static void sync_pte_range(struct vm_area_struct *vma, pmd_t *pmd,
 {
 	pte_t *pte;
 
+	pte_lock_nested(pmd);
 	pte = pte_offset_map(pmd, addr);
 	do {
 		unsigned long pfn;
@@ -46,6 +48,10 @@ static void sync_pte_range(struct vm_area_struct *vma, pmd_t *pmd,
 			set_page_dirty(page);
 	} while (pte++, addr += PAGE_SIZE, addr != end);
 	pte_unmap(pte - 1);
+	/* Sharers of the page table must not keep dirty TLB entries */
+	if (pt_shared(pmd))
+		flush_tlb_all();
+	pte_unlock_nested(pmd);
 }
 
 static inline void sync_pmd_range(struct vm_area_struct *vma, pud_t *pud,
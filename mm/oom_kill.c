@@ -18,15 +18,12 @@
 #include <linux/mm.h>
 #include <linux/sched.h>
 #include <linux/swap.h>
-#include <linux/timex.h>
-#include <linux/jiffies.h>
 
 /* #define DEBUG */
 
 /**
  * oom_badness - calculate a numeric value for how bad this task has been
  * @p: task struct of which task we should calculate
- * @p: current uptime in seconds
  *
  * The formula used is relatively simple and documented inline in the
  * function. The main rationale is that we want to select a good task
@@ -42,51 +39,41 @@
  *    of least surprise ... (be careful when you change it)
  */
 
-unsigned long badness(struct task_struct *p, unsigned long uptime)
+unsigned long badness(struct task_struct *p)
 {
-	unsigned long points, cpu_time, run_time, s;
+	struct mm_struct *mm = p->mm;
+	unsigned long points;
 	struct list_head *tsk;
 
-	if (!p->mm)
+	if (!mm)
 		return 0;
 
 	/*
-	 * The memory size of the process is the basis for the badness.
+	 * The memory the process has resident is the basis for the
+	 * badness: that is what killing it gives back, where its
+	 * virtual size may be mostly reservations never touched.  The
+	 * rss is kept up to date by the page table code, so this costs
+	 * two loads rather than a walk of anything.
 	 */
-	points = p->mm->total_vm;
+	points = get_mm_counter(mm, rss);
 
 	/*
 	 * Processes which fork a lot of child processes are likely
-	 * a good choice. We add the vmsize of the childs if they
+	 * a good choice. We add the rss of the childs if they
 	 * have an own mm. This prevents forking servers to flood the
 	 * machine with an endless amount of childs
 	 */
 	list_for_each(tsk, &p->children) {
 		struct task_struct *chld;
 		chld = list_entry(tsk, struct task_struct, sibling);
-		if (chld->mm != p->mm && chld->mm)
-			points += chld->mm->total_vm;
+		if (chld->mm != mm && chld->mm)
+			points += get_mm_counter(chld->mm, rss);
 	}
 
 	/*
-	 * CPU time is in tens of seconds and run time is in thousands
-         * of seconds. There is no particular reason for this other than
-         * that it turned out to work very well in practice.
+	 * No discount for CPU time or run time any more: it used to
+	 * spare exactly the long running hog which had filled memory.
 	 */
-	cpu_time = (cputime_to_jiffies(p->utime) + cputime_to_jiffies(p->stime))
-		>> (SHIFT_HZ + 3);
-
-	if (uptime >= p->start_time.tv_sec)
-		run_time = (uptime - p->start_time.tv_sec) >> 10;
-	else
-		run_time = 0;
-
-	s = int_sqrt(cpu_time);
-	if (s)
-		points /= s;
-	s = int_sqrt(int_sqrt(run_time));
-	if (s)
-		points /= s;
 
 	/*
 	 * Niced processes are most likely less important, so double
@@ -129,9 +116,27 @@ unsigned long badness(struct task_struct *p, unsigned long uptime)
 	return points;
 }
 
+/*
+ * The threads of a process share its mm, so one of them stands for all:
+ * the group leader, unless it has exited already, then the first thread
+ * which still has an mm.  NULL when none has.
+ */
+static struct task_struct *oom_thread(struct task_struct *p)
+{
+	struct task_struct *t = p;
+
+	do {
+		if (t->mm)
+			return t;
+	} while ((t = next_thread(t)) != p);
+	return NULL;
+}
+
 /*
  * Simple selection loop. We chose the process with the highest
  * number of 'points'. We expect the caller will lock the tasklist.
+ * Only processes are looked at, not each of their threads, and each
+ * one's badness is read off its mm counters.
  *
  * (not docbooked, we don't want this one cluttering up the manual)
  */
@@ -140,31 +145,33 @@ static struct task_struct * select_bad_process(void)
 	unsigned long maxpoints = 0;
 	struct task_struct *g, *p;
 	struct task_struct *chosen = NULL;
-	struct timespec uptime;
 
-	do_posix_clock_monotonic_gettime(&uptime);
-	do_each_thread(g, p)
+	for_each_process(g) {
+		unsigned long points;
+
 		/* skip the init task with pid == 1 */
-		if (p->pid > 1) {
-			unsigned long points;
-
-			/*
-			 * This is in the process of releasing memory so wait it
-			 * to finish before killing some other task by mistake.
-			 */
-			if ((unlikely(test_tsk_thread_flag(p, TIF_MEMDIE)) || (p->flags & PF_EXITING)) &&
-			    !(p->flags & PF_DEAD))
-				return ERR_PTR(-1UL);
-			if (p->flags & PF_SWAPOFF)
-				return p;
-
-			points = badness(p, uptime.tv_sec);
-			if (points > maxpoints || !chosen) {
-				chosen = p;
-				maxpoints = points;
-			}
+		if (g->pid <= 1)
+			continue;
+		p = oom_thread(g);
+		if (!p)
+			continue;
+
+		/*
+		 * This is in the process of releasing memory so wait it
+		 * to finish before killing some other task by mistake.
+		 */
+		if ((unlikely(test_tsk_thread_flag(p, TIF_MEMDIE)) || (p->flags & PF_EXITING)) &&
+		    !(p->flags & PF_DEAD))
+			return ERR_PTR(-1UL);
+		if (p->flags & PF_SWAPOFF)
+			return p;
+
+		points = badness(p);
+		if (points > maxpoints || !chosen) {
+			chosen = p;
+			maxpoints = points;
 		}
-	while_each_thread(g, p);
+	}
 	return chosen;
 }
 
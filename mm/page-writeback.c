@@ -29,6 +29,7 @@
 #include <linux/sysctl.h>
 #include <linux/cpu.h>
 #include <linux/syscalls.h>
+#include <asm/div64.h>
 
 /*
  * The maximum number of pages to writeout in a single bdflush/kupdate
@@ -99,6 +100,84 @@ EXPORT_SYMBOL(laptop_mode);
 
 static void background_writeout(unsigned long _min_pages);
 
+/*
+ * Each backing device gets a share of the dirty limit proportional to its
+ * share of recently completed writeout, so a slow device can only pin as
+ * much dirty memory as it manages to clean, and writers to fast devices are
+ * not held up behind it.
+ *
+ * "Recently" is a floating average: every writeout_period_events completions
+ * (system-wide) a new period starts and all per-device counts are halved.
+ * The halving is done lazily, when a device is next looked at, by shifting
+ * its count by the number of periods it missed.  writeout_total tracks the
+ * decayed sum of all devices as of the start of the current period.
+ *
+ * The per-device updates are not serialised; the odd lost event only skews
+ * the proportions slightly and is forgotten within a few periods.
+ */
+static int writeout_period_events = 1024;
+static atomic_t writeout_countdown = ATOMIC_INIT(1024);
+static unsigned long writeout_period;
+static unsigned long writeout_total;
+static DEFINE_SPINLOCK(writeout_lock);
+
+static void bdi_writeout_catch_up(struct backing_dev_info *bdi)
+{
+	unsigned long period = writeout_period;
+	unsigned long missed = period - bdi->writeout_period;
+
+	if (!missed)
+		return;
+
+	bdi->writeout_period = period;
+	if (missed >= 32)
+		atomic_set(&bdi->writeout_events, 0);
+	else
+		atomic_set(&bdi->writeout_events,
+			   atomic_read(&bdi->writeout_events) >> missed);
+}
+
+/*
+ * Account a completed page writeout against @bdi.  Called from the I/O
+ * completion path, possibly from interrupt context.
+ */
+void bdi_writeout_inc(struct backing_dev_info *bdi)
+{
+	unsigned long flags;
+
+	bdi_writeout_catch_up(bdi);
+	atomic_inc(&bdi->writeout_events);
+
+	if (atomic_dec_and_test(&writeout_countdown)) {
+		spin_lock_irqsave(&writeout_lock, flags);
+		writeout_total = (writeout_total + writeout_period_events) / 2;
+		writeout_period++;
+		atomic_set(&writeout_countdown, writeout_period_events);
+		spin_unlock_irqrestore(&writeout_lock, flags);
+	}
+}
+EXPORT_SYMBOL(bdi_writeout_inc);
+
+/*
+ * Scale @dirty down to @bdi's share of recent writeout.
+ */
+static long bdi_dirty_limit(struct backing_dev_info *bdi, long dirty)
+{
+	unsigned long events, total;
+	u64 limit;
+
+	bdi_writeout_catch_up(bdi);
+	events = atomic_read(&bdi->writeout_events);
+	total = writeout_total + writeout_period_events -
+			atomic_read(&writeout_countdown);
+	if (events >= total)
+		return dirty;
+
+	limit = (u64)dirty * events;
+	do_div(limit, total);
+	return limit;
+}
+
 struct writeback_state
 {
 	unsigned long nr_dirty;
@@ -134,7 +213,7 @@ static void get_writeback_state(struct writeback_state *wbs)
  */
 static void
 get_dirty_limits(struct writeback_state *wbs, long *pbackground, long *pdirty,
-		struct address_space *mapping)
+		long *pbdi_dirty, struct address_space *mapping)
 {
 	int background_ratio;		/* Percentages */
 	int dirty_ratio;
@@ -178,21 +257,25 @@ get_dirty_limits(struct writeback_state *wbs, long *pbackground, long *pdirty,
 	}
 	*pbackground = background;
 	*pdirty = dirty;
+
+	if (pbdi_dirty)
+		*pbdi_dirty = bdi_dirty_limit(mapping->backing_dev_info, dirty);
 }
 
 /*
  * balance_dirty_pages() must be called by processes which are generating dirty
- * data.  It looks at the number of dirty pages in the machine and will force
- * the caller to perform writeback if the system is over `vm_dirty_ratio'.
- * If we're over `background_thresh' then pdflush is woken to perform some
- * writeout.
+ * data.  It looks at the number of dirty pages against the mapping's backing
+ * device and will force the caller to perform writeback if the device is over
+ * its share of `vm_dirty_ratio'.  If the machine is over `background_thresh'
+ * then pdflush is woken to perform some writeout.
  */
 static void balance_dirty_pages(struct address_space *mapping)
 {
 	struct writeback_state wbs;
-	long nr_reclaimable;
+	long nr_reclaimable, bdi_nr_reclaimable, bdi_nr_writeback;
 	long background_thresh;
 	long dirty_thresh;
+	long bdi_thresh;
 	unsigned long pages_written = 0;
 	unsigned long write_chunk = sync_writeback_pages();
 
@@ -207,9 +290,11 @@ static void balance_dirty_pages(struct address_space *mapping)
 		};
 
 		get_dirty_limits(&wbs, &background_thresh,
-					&dirty_thresh, mapping);
+					&dirty_thresh, &bdi_thresh, mapping);
 		nr_reclaimable = wbs.nr_dirty + wbs.nr_unstable;
-		if (nr_reclaimable + wbs.nr_writeback <= dirty_thresh)
+		bdi_nr_reclaimable = bdi_stat(bdi, BDI_RECLAIMABLE);
+		bdi_nr_writeback = bdi_stat(bdi, BDI_WRITEBACK);
+		if (bdi_nr_reclaimable + bdi_nr_writeback <= bdi_thresh)
 			break;
 
 		dirty_exceeded = 1;
@@ -220,12 +305,14 @@ static void balance_dirty_pages(struct address_space *mapping)
 		 * written to the server's write cache, but has not yet
 		 * been flushed to permanent storage.
 		 */
-		if (nr_reclaimable) {
+		if (bdi_nr_reclaimable) {
 			writeback_inodes(&wbc);
 			get_dirty_limits(&wbs, &background_thresh,
-					&dirty_thresh, mapping);
+					&dirty_thresh, &bdi_thresh, mapping);
 			nr_reclaimable = wbs.nr_dirty + wbs.nr_unstable;
-			if (nr_reclaimable + wbs.nr_writeback <= dirty_thresh)
+			bdi_nr_reclaimable = bdi_stat(bdi, BDI_RECLAIMABLE);
+			bdi_nr_writeback = bdi_stat(bdi, BDI_WRITEBACK);
+			if (bdi_nr_reclaimable + bdi_nr_writeback <= bdi_thresh)
 				break;
 			pages_written += write_chunk - wbc.nr_to_write;
 			if (pages_written >= write_chunk)
@@ -234,7 +321,7 @@ static void balance_dirty_pages(struct address_space *mapping)
 		blk_congestion_wait(WRITE, HZ/10);
 	}
 
-	if (nr_reclaimable + wbs.nr_writeback <= dirty_thresh)
+	if (bdi_nr_reclaimable + bdi_nr_writeback <= bdi_thresh)
 		dirty_exceeded = 0;
 
 	if (writeback_in_progress(bdi))
@@ -249,8 +336,10 @@ static void balance_dirty_pages(struct address_space *mapping)
 	 * background_thresh, to keep the amount of dirty memory low.
 	 */
 	if ((laptop_mode && pages_written) ||
-	     (!laptop_mode && (nr_reclaimable > background_thresh)))
-		pdflush_operation(background_writeout, 0);
+	     (!laptop_mode && (nr_reclaimable > background_thresh))) {
+		if (bdi_start_writeback(bdi, 0, 0))
+			pdflush_operation(background_writeout, 0);
+	}
 }
 
 /**
@@ -296,7 +385,8 @@ void throttle_vm_writeout(void)
 	long dirty_thresh;
 
         for ( ; ; ) {
-		get_dirty_limits(&wbs, &background_thresh, &dirty_thresh, NULL);
+		get_dirty_limits(&wbs, &background_thresh, &dirty_thresh,
+				NULL, NULL);
 
                 /*
                  * Boost the allowable dirty threshold a bit for page
@@ -331,7 +421,8 @@ static void background_writeout(unsigned long _min_pages)
 		long background_thresh;
 		long dirty_thresh;
 
-		get_dirty_limits(&wbs, &background_thresh, &dirty_thresh, NULL);
+		get_dirty_limits(&wbs, &background_thresh, &dirty_thresh,
+				NULL, NULL);
 		if (wbs.nr_dirty + wbs.nr_unstable < background_thresh
 				&& min_pages <= 0)
 			break;
@@ -362,9 +453,63 @@ int wakeup_bdflush(long nr_pages)
 		get_writeback_state(&wbs);
 		nr_pages = wbs.nr_dirty + wbs.nr_unstable;
 	}
+	bdi_writeback_all(nr_pages, 0);
 	return pdflush_operation(background_writeout, nr_pages);
 }
 
+/*
+ * Writeout run by @bdi's flusher thread, see mm/backing-dev.c.  kupdate-style
+ * writeout of the device's old data, or background writeout of at least
+ * @min_pages and until the device is below its share of the background
+ * threshold.  The thread serves only this device, so it may block on its
+ * queue instead of skipping it when congested.
+ */
+void bdi_writeback(struct backing_dev_info *bdi, long min_pages,
+			int for_kupdate)
+{
+	unsigned long oldest_jif;
+	struct writeback_control wbc = {
+		.bdi		= bdi,
+		.sync_mode	= WB_SYNC_NONE,
+		.older_than_this = NULL,
+		.nr_to_write	= 0,
+		.for_kupdate	= for_kupdate,
+	};
+
+	if (for_kupdate) {
+		oldest_jif = jiffies - (dirty_expire_centisecs * HZ) / 100;
+		wbc.older_than_this = &oldest_jif;
+		min_pages = bdi_stat(bdi, BDI_RECLAIMABLE) +
+			(inodes_stat.nr_inodes - inodes_stat.nr_unused);
+	}
+
+	for ( ; ; ) {
+		struct writeback_state wbs;
+		long background_thresh;
+		long dirty_thresh;
+
+		if (min_pages <= 0) {
+			if (for_kupdate)
+				break;
+			get_dirty_limits(&wbs, &background_thresh,
+					&dirty_thresh, NULL, NULL);
+			if (bdi_stat(bdi, BDI_RECLAIMABLE) <
+			    bdi_dirty_limit(bdi, background_thresh))
+				break;
+		}
+		wbc.nr_to_write = MAX_WRITEBACK_PAGES;
+		wbc.pages_skipped = 0;
+		writeback_inodes(&wbc);
+		min_pages -= MAX_WRITEBACK_PAGES - wbc.nr_to_write;
+		if (wbc.nr_to_write > 0 || wbc.pages_skipped > 0) {
+			/* Wrote less than expected: clean, or pages locked */
+			if (wbc.pages_skipped)
+				blk_congestion_wait(WRITE, HZ/10);
+			break;
+		}
+	}
+}
+
 static void wb_timer_fn(unsigned long unused);
 static void laptop_timer_fn(unsigned long unused);
 
@@ -406,6 +551,9 @@ static void wb_kupdate(unsigned long arg)
 
 	sync_supers();
 
+	/* devices with a flusher thread write back their own old data */
+	bdi_writeback_all(0, 1);
+
 	get_writeback_state(&wbs);
 	oldest_jif = jiffies - (dirty_expire_centisecs * HZ) / 100;
 	start_jif = jiffies;
@@ -545,6 +693,14 @@ void __init page_writeback_init(void)
 		if (vm_dirty_ratio <= 0)
 			vm_dirty_ratio = 1;
 	}
+	/*
+	 * let a writeout period cover about half the default dirty limit, so
+	 * the proportions follow changes in device speed within a limit's
+	 * worth of writeout
+	 */
+	writeout_period_events = max(total_pages * vm_dirty_ratio / 200, 1024L);
+	atomic_set(&writeout_countdown, writeout_period_events);
+
 	mod_timer(&wb_timer, jiffies + (dirty_writeback_centisecs * HZ) / 100);
 	set_ratelimit();
 	register_cpu_notifier(&ratelimit_nb);
@@ -627,8 +783,11 @@ int __set_page_dirty_nobuffers(struct page *page)
 			mapping2 = page_mapping(page);
 			if (mapping2) { /* Race with truncate? */
 				BUG_ON(mapping2 != mapping);
-				if (mapping_cap_account_dirty(mapping))
+				if (mapping_cap_account_dirty(mapping)) {
 					inc_page_state(nr_dirty);
+					inc_bdi_stat(mapping->backing_dev_info,
+							BDI_RECLAIMABLE);
+				}
 				radix_tree_tag_set(&mapping->page_tree,
 					page_index(page), PAGECACHE_TAG_DIRTY);
 			}
@@ -713,8 +872,11 @@ int test_clear_page_dirty(struct page *page)
 						page_index(page),
 						PAGECACHE_TAG_DIRTY);
 			write_unlock_irqrestore(&mapping->tree_lock, flags);
-			if (mapping_cap_account_dirty(mapping))
+			if (mapping_cap_account_dirty(mapping)) {
 				dec_page_state(nr_dirty);
+				dec_bdi_stat(mapping->backing_dev_info,
+						BDI_RECLAIMABLE);
+			}
 			return 1;
 		}
 		write_unlock_irqrestore(&mapping->tree_lock, flags);
@@ -744,8 +906,11 @@ int clear_page_dirty_for_io(struct page *page)
 
 	if (mapping) {
 		if (TestClearPageDirty(page)) {
-			if (mapping_cap_account_dirty(mapping))
+			if (mapping_cap_account_dirty(mapping)) {
 				dec_page_state(nr_dirty);
+				dec_bdi_stat(mapping->backing_dev_info,
+						BDI_RECLAIMABLE);
+			}
 			return 1;
 		}
 		return 0;
@@ -764,10 +929,13 @@ int test_clear_page_writeback(struct page *page)
 
 		write_lock_irqsave(&mapping->tree_lock, flags);
 		ret = TestClearPageWriteback(page);
-		if (ret)
+		if (ret) {
 			radix_tree_tag_clear(&mapping->page_tree,
 						page_index(page),
 						PAGECACHE_TAG_WRITEBACK);
+			dec_bdi_stat(mapping->backing_dev_info, BDI_WRITEBACK);
+			bdi_writeout_inc(mapping->backing_dev_info);
+		}
 		write_unlock_irqrestore(&mapping->tree_lock, flags);
 	} else {
 		ret = TestClearPageWriteback(page);
@@ -785,10 +953,12 @@ int test_set_page_writeback(struct page *page)
 
 		write_lock_irqsave(&mapping->tree_lock, flags);
 		ret = TestSetPageWriteback(page);
-		if (!ret)
+		if (!ret) {
 			radix_tree_tag_set(&mapping->page_tree,
 						page_index(page),
 						PAGECACHE_TAG_WRITEBACK);
+			inc_bdi_stat(mapping->backing_dev_info, BDI_WRITEBACK);
+		}
 		if (!PageDirty(page))
 			radix_tree_tag_clear(&mapping->page_tree,
 						page_index(page),
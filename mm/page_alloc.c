@@ -59,6 +59,14 @@ long nr_swap_pages;
  */
 int sysctl_lowmem_reserve_ratio[MAX_NR_ZONES-1] = { 256, 32 };
 
+/*
+ * If non-zero, each cpu's hot list may hold up to this fraction of its
+ * zone's pages, instead of the size zone_batchsize() picks at boot.
+ */
+int percpu_pagelist_fraction;
+int sysctl_prezero_pages;
+static DECLARE_WAIT_QUEUE_HEAD(kzerod_wait);
+
 EXPORT_SYMBOL(totalram_pages);
 EXPORT_SYMBOL(nr_swap_pages);
 
@@ -452,7 +460,8 @@ static void prep_new_page(struct page *page, int order)
 
 	page->flags &= ~(1 << PG_uptodate | 1 << PG_error |
 			1 << PG_referenced | 1 << PG_arch_1 |
-			1 << PG_checked | 1 << PG_mappedtodisk);
+			1 << PG_checked | 1 << PG_mappedtodisk |
+			1 << PG_swapbacked | 1 << PG_ptshared);
 	page->private = 0;
 	set_page_refs(page, order);
 	kernel_map_pages(page, 1 << order, 1);
@@ -615,8 +624,11 @@ static void fastcall free_hot_cold_page(struct page *page, int cold)
 	free_pages_check(__FUNCTION__, page);
 	pcp = &zone->pageset[get_cpu()].pcp[cold];
 	local_irq_save(flags);
-	if (pcp->count >= pcp->high)
+	if (pcp->count >= pcp->high) {
 		pcp->count -= free_pages_bulk(zone, pcp->batch, &pcp->list, 0);
+		pcp->drains++;
+		inc_page_state(pcp_drain);
+	}
 	list_add(&page->lru, &pcp->list);
 	pcp->count++;
 	local_irq_restore(flags);
@@ -642,6 +654,34 @@ static inline void prep_zero_page(struct page *page, int order, unsigned int __n
 		clear_highpage(page + i);
 }
 
+/* Take a page off zone->zeroed_list.  Called with zone->lock held. */
+static struct page *rmqueue_zeroed(struct zone *zone)
+{
+	struct page *page;
+
+	if (!zone->nr_zeroed)
+		return NULL;
+	page = list_entry(zone->zeroed_list.next, struct page, lru);
+	list_del(&page->lru);
+	zone->nr_zeroed--;
+	zone->free_pages--;
+	return page;
+}
+
+/* Give all but @keep of the zeroed pages of @zone back to the buddy lists */
+static void drain_zeroed_pages(struct zone *zone, unsigned long keep)
+{
+	unsigned long flags;
+	struct page *page;
+
+	spin_lock_irqsave(&zone->lock, flags);
+	while (zone->nr_zeroed > keep) {
+		page = rmqueue_zeroed(zone);
+		__free_pages_bulk(page, zone, 0);
+	}
+	spin_unlock_irqrestore(&zone->lock, flags);
+}
+
 /*
  * Really, prep_compound_page() should be called from __rmqueue_bulk().  But
  * we cheat by calling it from here, in the order > 0 path.  Saves a branch
@@ -653,15 +693,31 @@ buffered_rmqueue(struct zone *zone, int order, unsigned int __nocast gfp_flags)
 	unsigned long flags;
 	struct page *page = NULL;
 	int cold = !!(gfp_flags & __GFP_COLD);
+	int zeroed = 0;
 
-	if (order == 0) {
+	if (order == 0 && (gfp_flags & __GFP_ZERO) && zone->nr_zeroed) {
+		spin_lock_irqsave(&zone->lock, flags);
+		page = rmqueue_zeroed(zone);
+		spin_unlock_irqrestore(&zone->lock, flags);
+		if (page) {
+			zeroed = 1;
+			if (zone->nr_zeroed < sysctl_prezero_pages / 2 &&
+			    waitqueue_active(&kzerod_wait))
+				wake_up_interruptible(&kzerod_wait);
+		}
+	}
+
+	if (order == 0 && page == NULL) {
 		struct per_cpu_pages *pcp;
 
 		pcp = &zone->pageset[get_cpu()].pcp[cold];
 		local_irq_save(flags);
-		if (pcp->count <= pcp->low)
+		if (pcp->count <= pcp->low) {
 			pcp->count += rmqueue_bulk(zone, 0,
 						pcp->batch, &pcp->list);
+			pcp->refills++;
+			inc_page_state(pcp_refill);
+		}
 		if (pcp->count) {
 			page = list_entry(pcp->list.next, struct page, lru);
 			list_del(&page->lru);
@@ -674,6 +730,11 @@ buffered_rmqueue(struct zone *zone, int order, unsigned int __nocast gfp_flags)
 	if (page == NULL) {
 		spin_lock_irqsave(&zone->lock, flags);
 		page = __rmqueue(zone, order);
+		/* the zeroed pages are the last free pages of the zone */
+		if (page == NULL && order == 0) {
+			page = rmqueue_zeroed(zone);
+			zeroed = page != NULL;
+		}
 		spin_unlock_irqrestore(&zone->lock, flags);
 	}
 
@@ -682,7 +743,7 @@ buffered_rmqueue(struct zone *zone, int order, unsigned int __nocast gfp_flags)
 		mod_page_state_zone(zone, pgalloc, 1 << order);
 		prep_new_page(page, order);
 
-		if (gfp_flags & __GFP_ZERO)
+		if ((gfp_flags & __GFP_ZERO) && !zeroed)
 			prep_zero_page(page, order, gfp_flags);
 
 		if (order && (gfp_flags & __GFP_COMP))
@@ -774,8 +835,12 @@ __alloc_pages(unsigned int __nocast gfp_mask, unsigned int order,
 			goto got_pg;
 	}
 
-	for (i = 0; (z = zones[i]) != NULL; i++)
+	for (i = 0; (z = zones[i]) != NULL; i++) {
 		wakeup_kswapd(z, order);
+		/* zeroed pages can't merge into higher orders */
+		if (order && z->nr_zeroed)
+			drain_zeroed_pages(z, 0);
+	}
 
 	/*
 	 * Go through the zonelist again. Let __GFP_HIGH and allocations
@@ -883,7 +948,8 @@ rebalance:
 	 */
 	do_retry = 0;
 	if (!(gfp_mask & __GFP_NORETRY)) {
-		if ((order <= 3) || (gfp_mask & __GFP_REPEAT))
+		if ((order <= PAGE_ALLOC_COSTLY_ORDER) ||
+		    (gfp_mask & __GFP_REPEAT))
 			do_retry = 1;
 		if (gfp_mask & __GFP_NOFAIL)
 			do_retry = 1;
@@ -1061,24 +1127,76 @@ static void show_node(struct zone *zone)
  * Accumulate the page_state information across all CPUs.
  * The result is unavoidably approximate - it can change
  * during and after execution of this function.
+ *
+ * The in-use counters up to GET_PAGE_STATE_LAST are read far more often
+ * than the event counters (by /proc/meminfo, and by dirty page balancing
+ * on every write), so they are not summed across CPUs at all.  Each CPU's
+ * copy holds only a small signed delta, which is folded into a global
+ * total once it passes PAGE_STATE_THRESHOLD, and every
+ * PAGE_STATE_INTERVAL in any case.  Reading one is a single atomic_read,
+ * which is off by at most the threshold for each CPU.
  */
 static DEFINE_PER_CPU(struct page_state, page_states) = {0};
 
+#define NR_PAGE_STATE_TOTALS	\
+	(offsetof(struct page_state, GET_PAGE_STATE_LAST) / sizeof(unsigned long) + 1)
+
+static atomic_t page_state_totals[NR_PAGE_STATE_TOTALS];
+
+#ifdef CONFIG_SMP
+#define PAGE_STATE_THRESHOLD	32
+#define PAGE_STATE_INTERVAL	HZ
+#else
+#define PAGE_STATE_THRESHOLD	0
+#endif
+
 atomic_t nr_pagecache = ATOMIC_INIT(0);
 EXPORT_SYMBOL(nr_pagecache);
 #ifdef CONFIG_SMP
 DEFINE_PER_CPU(long, nr_pagecache_local) = 0;
 #endif
 
+static inline unsigned long read_page_state_total(int i)
+{
+	int ret = atomic_read(&page_state_totals[i]);
+
+	return ret < 0 ? 0 : ret;
+}
+
+/*
+ * Fold @cpu's in-use counter deltas into the totals.  Called with local
+ * interrupts disabled, on @cpu or with @cpu offline.
+ */
+static void fold_page_state(int cpu)
+{
+	long *local = (long *)&per_cpu(page_states, cpu);
+	int i;
+
+	for (i = 0; i < NR_PAGE_STATE_TOTALS; i++) {
+		if (local[i]) {
+			atomic_add(local[i], &page_state_totals[i]);
+			local[i] = 0;
+		}
+	}
+}
+
 void __get_page_state(struct page_state *ret, int nr)
 {
 	int cpu = 0;
+	unsigned long *out;
+	int i;
 
 	memset(ret, 0, sizeof(*ret));
 
+	out = (unsigned long *)ret;
+	for (i = 0; i < NR_PAGE_STATE_TOTALS; i++)
+		out[i] = read_page_state_total(i);
+	if (nr <= NR_PAGE_STATE_TOTALS)
+		return;
+
 	cpu = first_cpu(cpu_online_map);
 	while (cpu < NR_CPUS) {
-		unsigned long *in, *out, off;
+		unsigned long *in, off;
 
 		in = (unsigned long *)&per_cpu(page_states, cpu);
 
@@ -1087,20 +1205,14 @@ void __get_page_state(struct page_state *ret, int nr)
 		if (cpu < NR_CPUS)
 			prefetch(&per_cpu(page_states, cpu));
 
-		out = (unsigned long *)ret;
-		for (off = 0; off < nr; off++)
-			*out++ += *in++;
+		for (off = NR_PAGE_STATE_TOTALS; off < nr; off++)
+			out[off] += in[off];
 	}
 }
 
 void get_page_state(struct page_state *ret)
 {
-	int nr;
-
-	nr = offsetof(struct page_state, GET_PAGE_STATE_LAST);
-	nr /= sizeof(unsigned long);
-
-	__get_page_state(ret, nr + 1);
+	__get_page_state(ret, NR_PAGE_STATE_TOTALS);
 }
 
 void get_full_page_state(struct page_state *ret)
@@ -1113,6 +1225,9 @@ unsigned long __read_page_state(unsigned offset)
 	unsigned long ret = 0;
 	int cpu;
 
+	if (offset < NR_PAGE_STATE_TOTALS * sizeof(unsigned long))
+		return read_page_state_total(offset / sizeof(unsigned long));
+
 	for_each_online_cpu(cpu) {
 		unsigned long in;
 
@@ -1129,7 +1244,18 @@ void __mod_page_state(unsigned offset, unsigned long delta)
 
 	local_irq_save(flags);
 	ptr = &__get_cpu_var(page_states);
-	*(unsigned long*)(ptr + offset) += delta;
+	if (offset < NR_PAGE_STATE_TOTALS * sizeof(unsigned long)) {
+		long *local = (long *)(ptr + offset);
+
+		*local += (long)delta;
+		if (*local > PAGE_STATE_THRESHOLD ||
+		    *local < -PAGE_STATE_THRESHOLD) {
+			atomic_add(*local, &page_state_totals[offset /
+							sizeof(unsigned long)]);
+			*local = 0;
+		}
+	} else
+		*(unsigned long*)(ptr + offset) += delta;
 	local_irq_restore(flags);
 }
 
@@ -1145,8 +1271,10 @@ void __get_zone_counts(unsigned long *active, unsigned long *inactive,
 	*inactive = 0;
 	*free = 0;
 	for (i = 0; i < MAX_NR_ZONES; i++) {
-		*active += zones[i].nr_active;
-		*inactive += zones[i].nr_inactive;
+		*active += zones[i].nr_lru[LRU_ACTIVE_ANON] +
+			   zones[i].nr_lru[LRU_ACTIVE_FILE];
+		*inactive += zones[i].nr_lru[LRU_INACTIVE_ANON] +
+			     zones[i].nr_lru[LRU_INACTIVE_FILE];
 		*free += zones[i].free_pages;
 	}
 }
@@ -1234,12 +1362,15 @@ void show_free_areas(void)
 			pageset = zone->pageset + cpu;
 
 			for (temperature = 0; temperature < 2; temperature++)
-				printk("cpu %d %s: low %d, high %d, batch %d\n",
+				printk("cpu %d %s: low %d, high %d, batch %d, "
+					"refills %lu, drains %lu\n",
 					cpu,
 					temperature ? "cold" : "hot",
 					pageset->pcp[temperature].low,
 					pageset->pcp[temperature].high,
-					pageset->pcp[temperature].batch);
+					pageset->pcp[temperature].batch,
+					pageset->pcp[temperature].refills,
+					pageset->pcp[temperature].drains);
 		}
 	}
 
@@ -1271,8 +1402,10 @@ void show_free_areas(void)
 			" min:%lukB"
 			" low:%lukB"
 			" high:%lukB"
-			" active:%lukB"
-			" inactive:%lukB"
+			" active_anon:%lukB"
+			" inactive_anon:%lukB"
+			" active_file:%lukB"
+			" inactive_file:%lukB"
 			" present:%lukB"
 			" pages_scanned:%lu"
 			" all_unreclaimable? %s"
@@ -1282,8 +1415,10 @@ void show_free_areas(void)
 			K(zone->pages_min),
 			K(zone->pages_low),
 			K(zone->pages_high),
-			K(zone->nr_active),
-			K(zone->nr_inactive),
+			K(zone->nr_lru[LRU_ACTIVE_ANON]),
+			K(zone->nr_lru[LRU_INACTIVE_ANON]),
+			K(zone->nr_lru[LRU_ACTIVE_FILE]),
+			K(zone->nr_lru[LRU_INACTIVE_FILE]),
 			K(zone->present_pages),
 			zone->pages_scanned,
 			(zone->all_unreclaimable ? "yes" : "no")
@@ -1610,6 +1745,58 @@ void zone_init_free_lists(struct pglist_data *pgdat, struct zone *zone,
 	}
 }
 
+/*
+ * The per-cpu-pages pools are set to around 1000th of the
+ * size of the zone.  But no more than 1/4 of a meg - there's
+ * no point in going beyond the size of L2 cache.
+ *
+ * OK, so we don't know how big the cache is.  So guess.
+ */
+static int zone_batchsize(struct zone *zone)
+{
+	int batch;
+
+	batch = zone->present_pages / 1024;
+	if (batch * PAGE_SIZE > 256 * 1024)
+		batch = (256 * 1024) / PAGE_SIZE;
+	batch /= 4;		/* We effectively *= 4 below */
+	if (batch < 1)
+		batch = 1;
+	return batch;
+}
+
+static void pageset_set_batch(struct per_cpu_pageset *p, int batch)
+{
+	struct per_cpu_pages *pcp;
+
+	pcp = &p->pcp[0];		/* hot */
+	pcp->low = 2 * batch;
+	pcp->high = 6 * batch;
+	pcp->batch = 1 * batch;
+
+	pcp = &p->pcp[1];		/* cold */
+	pcp->low = 0;
+	pcp->high = 2 * batch;
+	pcp->batch = 1 * batch;
+}
+
+/*
+ * Size the hot list to hold up to @high pages, keeping the proportions
+ * pageset_set_batch() uses, but with the batch capped so that a single
+ * refill or drain does not hold zone->lock for too long.
+ */
+static void pageset_set_high(struct per_cpu_pageset *p, int high)
+{
+	struct per_cpu_pages *pcp = &p->pcp[0];
+	int batch = max(1, high / 6);
+
+	if (batch > PAGE_SHIFT * 8)
+		batch = PAGE_SHIFT * 8;
+	pcp->low = 2 * batch;
+	pcp->high = max(high, 3 * batch);
+	pcp->batch = batch;
+}
+
 #ifndef __HAVE_ARCH_MEMMAP_INIT
 #define memmap_init(size, nid, zone, start_pfn) \
 	memmap_init_zone((size), (nid), (zone), (start_pfn))
@@ -1637,6 +1824,7 @@ static void __init free_area_init_core(struct pglist_data *pgdat,
 		struct zone *zone = pgdat->node_zones + j;
 		unsigned long size, realsize;
 		unsigned long batch;
+		enum lru_list l;
 
 		zone_table[NODEZONE(nid, j)] = zone;
 		realsize = size = zones_size[j];
@@ -1651,51 +1839,33 @@ static void __init free_area_init_core(struct pglist_data *pgdat,
 		zone->present_pages = realsize;
 		zone->name = zone_names[j];
 		spin_lock_init(&zone->lock);
+		INIT_LIST_HEAD(&zone->zeroed_list);
+		zone->nr_zeroed = 0;
 		spin_lock_init(&zone->lru_lock);
 		zone->zone_pgdat = pgdat;
 		zone->free_pages = 0;
 
 		zone->temp_priority = zone->prev_priority = DEF_PRIORITY;
 
-		/*
-		 * The per-cpu-pages pools are set to around 1000th of the
-		 * size of the zone.  But no more than 1/4 of a meg - there's
-		 * no point in going beyond the size of L2 cache.
-		 *
-		 * OK, so we don't know how big the cache is.  So guess.
-		 */
-		batch = zone->present_pages / 1024;
-		if (batch * PAGE_SIZE > 256 * 1024)
-			batch = (256 * 1024) / PAGE_SIZE;
-		batch /= 4;		/* We effectively *= 4 below */
-		if (batch < 1)
-			batch = 1;
+		batch = zone_batchsize(zone);
 
 		for (cpu = 0; cpu < NR_CPUS; cpu++) {
-			struct per_cpu_pages *pcp;
+			struct per_cpu_pageset *p = &zone->pageset[cpu];
 
-			pcp = &zone->pageset[cpu].pcp[0];	/* hot */
-			pcp->count = 0;
-			pcp->low = 2 * batch;
-			pcp->high = 6 * batch;
-			pcp->batch = 1 * batch;
-			INIT_LIST_HEAD(&pcp->list);
-
-			pcp = &zone->pageset[cpu].pcp[1];	/* cold */
-			pcp->count = 0;
-			pcp->low = 0;
-			pcp->high = 2 * batch;
-			pcp->batch = 1 * batch;
-			INIT_LIST_HEAD(&pcp->list);
+			memset(p->pcp, 0, sizeof(p->pcp));
+			INIT_LIST_HEAD(&p->pcp[0].list);
+			INIT_LIST_HEAD(&p->pcp[1].list);
+			pageset_set_batch(p, batch);
 		}
 		printk(KERN_DEBUG "  %s zone: %lu pages, LIFO batch:%lu\n",
 				zone_names[j], realsize, batch);
-		INIT_LIST_HEAD(&zone->active_list);
-		INIT_LIST_HEAD(&zone->inactive_list);
-		zone->nr_scan_active = 0;
-		zone->nr_scan_inactive = 0;
-		zone->nr_active = 0;
-		zone->nr_inactive = 0;
+		for_each_lru(l) {
+			INIT_LIST_HEAD(&zone->lru[l]);
+			zone->nr_scan[l] = 0;
+			zone->nr_lru[l] = 0;
+		}
+		zone->recent_scanned[0] = zone->recent_scanned[1] = 0;
+		zone->recent_rotated[0] = zone->recent_rotated[1] = 0;
 		if (!size)
 			continue;
 
@@ -1881,6 +2051,12 @@ static char *vmstat_text[] = {
 	"allocstall",
 
 	"pgrotated",
+	"pcp_refill",
+	"pcp_drain",
+
+	"bh_lru_hit",
+	"bh_hash_hit",
+	"bh_lru_miss",
 };
 
 static void *vmstat_start(struct seq_file *m, loff_t *pos)
@@ -1932,6 +2108,48 @@ struct seq_operations vmstat_op = {
 
 #endif /* CONFIG_PROC_FS */
 
+#ifdef CONFIG_SMP
+static DEFINE_PER_CPU(struct work_struct, page_state_work);
+
+/*
+ * Fold this cpu's in-use counter deltas every PAGE_STATE_INTERVAL, so
+ * that the totals do not keep an error from cpus which have gone quiet.
+ * The work stops if it finds itself off its cpu, which only happens
+ * once the cpu has been unplugged.
+ */
+static void page_state_work_fn(void *data)
+{
+	int cpu = (long)data;
+
+	if (cpu != smp_processor_id())
+		return;
+	local_irq_disable();
+	fold_page_state(cpu);
+	local_irq_enable();
+	schedule_delayed_work_on(cpu, &per_cpu(page_state_work, cpu),
+				 PAGE_STATE_INTERVAL);
+}
+
+static void start_page_state_work(int cpu)
+{
+	schedule_delayed_work_on(cpu, &per_cpu(page_state_work, cpu),
+				 PAGE_STATE_INTERVAL + cpu);
+}
+
+static int __init page_state_work_init(void)
+{
+	int cpu;
+
+	for_each_cpu(cpu)
+		INIT_WORK(&per_cpu(page_state_work, cpu), page_state_work_fn,
+			  (void *)(long)cpu);
+	for_each_online_cpu(cpu)
+		start_page_state_work(cpu);
+	return 0;
+}
+__initcall(page_state_work_init);
+#endif /* CONFIG_SMP */
+
 #ifdef CONFIG_HOTPLUG_CPU
 static int page_alloc_cpu_notify(struct notifier_block *self,
 				 unsigned long action, void *hcpu)
@@ -1950,18 +2168,26 @@ static int page_alloc_cpu_notify(struct notifier_block *self,
 		local_irq_disable();
 		__drain_pages(cpu);
 
-		/* Add dead cpu's page_states to our own. */
+		/*
+		 * Fold the dead cpu's in-use counters into the totals and
+		 * add its event counters to our own.
+		 */
+		fold_page_state(cpu);
 		dest = (unsigned long *)&__get_cpu_var(page_states);
 		src = (unsigned long *)&per_cpu(page_states, cpu);
 
-		for (i = 0; i < sizeof(struct page_state)/sizeof(unsigned long);
-				i++) {
+		for (i = NR_PAGE_STATE_TOTALS;
+		     i < sizeof(struct page_state)/sizeof(unsigned long); i++) {
 			dest[i] += src[i];
 			src[i] = 0;
 		}
 
 		local_irq_enable();
 	}
+#ifdef CONFIG_SMP
+	if (action == CPU_ONLINE)
+		start_page_state_work(cpu);
+#endif
 	return NOTIFY_OK;
 }
 #endif /* CONFIG_HOTPLUG_CPU */
@@ -2128,6 +2354,124 @@ int lowmem_reserve_ratio_sysctl_handler(ctl_table *table, int write,
 	return 0;
 }
 
+/*
+ * percpu_pagelist_fraction - resizes each zone's per-cpu hot lists
+ *	to hold up to present_pages/fraction pages, or back to the boot
+ *	time size when set to 0.  Values below 8 are treated as 8, so a
+ *	zone never gives more than an eighth of itself to any one cpu.
+ *
+ * The lists are resized in place: a list above its new high mark just
+ * drains at its next free.
+ */
+int percpu_pagelist_fraction_sysctl_handler(ctl_table *table, int write,
+	struct file *file, void __user *buffer, size_t *length, loff_t *ppos)
+{
+	struct zone *zone;
+	int ret;
+
+	ret = proc_dointvec_minmax(table, write, file, buffer, length, ppos);
+	if (!write || ret < 0)
+		return ret;
+	for_each_zone(zone) {
+		int cpu;
+
+		for (cpu = 0; cpu < NR_CPUS; cpu++) {
+			struct per_cpu_pageset *p = &zone->pageset[cpu];
+
+			if (percpu_pagelist_fraction)
+				pageset_set_high(p, zone->present_pages /
+					max(percpu_pagelist_fraction, 8));
+			else
+				pageset_set_batch(p, zone_batchsize(zone));
+		}
+	}
+	return 0;
+}
+
+/*
+ * Zero free pages of @zone ahead of the allocations which want them
+ * zeroed, as long as its other free pages stay above pages_high.
+ */
+static void prezero_zone(struct zone *zone)
+{
+	struct page *page;
+
+	while (zone->nr_zeroed < sysctl_prezero_pages) {
+		page = NULL;
+		spin_lock_irq(&zone->lock);
+		if (zone->free_pages - zone->nr_zeroed > zone->pages_high) {
+			page = __rmqueue(zone, 0);
+			if (page)
+				zone->free_pages++;	/* still free while zeroed */
+		}
+		spin_unlock_irq(&zone->lock);
+		if (!page)
+			break;
+
+		clear_highpage(page);
+
+		spin_lock_irq(&zone->lock);
+		list_add(&page->lru, &zone->zeroed_list);
+		zone->nr_zeroed++;
+		spin_unlock_irq(&zone->lock);
+		cond_resched();
+	}
+}
+
+/*
+ * kzerod runs at the lowest priority, so the pages are zeroed with
+ * cycles nothing else wants.  It looks again every second, or sooner
+ * when an allocation has taken half of a zone's zeroed pages.
+ */
+static int kzerod(void *p)
+{
+	DEFINE_WAIT(wait);
+	struct zone *zone;
+
+	daemonize("kzerod");
+	set_user_nice(current, 19);
+
+	for ( ; ; ) {
+		if (current->flags & PF_FREEZE)
+			refrigerator(PF_FREEZE);
+
+		prepare_to_wait(&kzerod_wait, &wait, TASK_INTERRUPTIBLE);
+		schedule_timeout(sysctl_prezero_pages ? HZ : MAX_SCHEDULE_TIMEOUT);
+		finish_wait(&kzerod_wait, &wait);
+
+		for_each_zone(zone)
+			prezero_zone(zone);
+	}
+	return 0;
+}
+
+static int __init kzerod_init(void)
+{
+	kernel_thread(kzerod, NULL, CLONE_KERNEL);
+	return 0;
+}
+module_init(kzerod_init)
+
+/*
+ * prezero_pages_sysctl_handler - vm.prezero_pages is the number of free
+ * pages kzerod keeps zeroed in each zone, 0 (the default) for none.
+ */
+int prezero_pages_sysctl_handler(ctl_table *table, int write,
+	struct file *file, void __user *buffer, size_t *length, loff_t *ppos)
+{
+	struct zone *zone;
+	int ret;
+
+	ret = proc_dointvec_minmax(table, write, file, buffer, length, ppos);
+	if (!write || ret < 0)
+		return ret;
+	for_each_zone(zone)
+		if (zone->nr_zeroed > sysctl_prezero_pages)
+			drain_zeroed_pages(zone, sysctl_prezero_pages);
+	wake_up_interruptible(&kzerod_wait);
+	return 0;
+}
+
 __initdata int hashdist = HASHDIST_DEFAULT;
 
 #ifdef CONFIG_NUMA
@@ -14,6 +14,7 @@
 #include <linux/blkdev.h>
 #include <linux/backing-dev.h>
 #include <linux/pagevec.h>
+#include <linux/pagemap.h>
 
 void default_unplug_io_fn(struct backing_dev_info *bdi, struct page *page)
 {
@@ -235,6 +236,19 @@ out:
  * read is about to happen and the window is immediately set to the initial size
  * based on I/O request size and the max_readahead.
  *
+ * Several readers can go through a file at once: interleaved streams on one
+ * fd (a server multiplexing clients), or many fds on one file.  To avoid
+ * treating those as random IO:
+ *
+ * - when a read breaks the current stream, the stream is remembered in
+ *   ra->streams[] (a few slots, recycled round robin), and a later read which
+ *   continues one of them resumes it with its old window size;
+ *
+ * - a read which matches no known stream but lands just after pages already
+ *   in the page cache is taken to continue someone else's sequential read
+ *   through there, and readahead starts with a window sized by the number
+ *   of cached pages found behind it.
+ *
  * This function is to be called for every read request, rather than when
  * it is time to perform readahead.  It is called only once for the entire I/O
  * regardless of size unless readahead is unable to start enough I/O to satisfy
@@ -430,6 +444,70 @@ static int make_ahead_window(struct address_space *mapping, struct file *filp,
 	return ret;
 }
 
+/*
+ * Park the current stream in a free (or the oldest) stream slot.
+ */
+static void ra_save_stream(struct file_ra_state *ra)
+{
+	struct file_ra_stream *stream;
+	int i;
+
+	if (ra->size == 0)
+		return;
+
+	for (i = 0; i < RA_STREAMS; i++)
+		if (ra->streams[i].size == 0)
+			break;
+	if (i == RA_STREAMS) {
+		i = ra->stream_next;
+		ra->stream_next = (i + 1) % RA_STREAMS;
+	}
+	stream = &ra->streams[i];
+	stream->prev_page = ra->prev_page;
+	stream->size = ra->size;
+}
+
+/*
+ * If offset continues a remembered stream, park the current one and return
+ * the window size of the resumed stream.  Returns 0 if none matches.
+ */
+static unsigned long ra_resume_stream(struct file_ra_state *ra,
+					unsigned long offset)
+{
+	unsigned long size;
+	int i;
+
+	for (i = 0; i < RA_STREAMS; i++) {
+		struct file_ra_stream *stream = &ra->streams[i];
+
+		if (stream->size == 0 || stream->prev_page + 1 != offset)
+			continue;
+
+		size = stream->size;
+		stream->size = 0;
+		ra_save_stream(ra);
+		return size;
+	}
+	return 0;
+}
+
+/*
+ * Count the pages just before offset which are present in the page cache, up
+ * to max.  A long run means somebody has been reading sequentially up to here.
+ */
+static unsigned long ra_cache_history(struct address_space *mapping,
+					unsigned long offset, unsigned long max)
+{
+	unsigned long count = 0;
+
+	read_lock_irq(&mapping->tree_lock);
+	while (count < max && count < offset &&
+	       radix_tree_lookup(&mapping->page_tree, offset - count - 1))
+		count++;
+	read_unlock_irq(&mapping->tree_lock);
+	return count;
+}
+
 /*
  * page_cache_readahead is the main function.  If performs the adaptive
  * readahead window size management and submits the readahead I/O.
@@ -440,6 +518,7 @@ page_cache_readahead(struct address_space *mapping, struct file_ra_state *ra,
 		     unsigned long req_size)
 {
 	unsigned long max, newsize;
+	unsigned long resume = 0;
 	int sequential;
 
 	/*
@@ -449,13 +528,28 @@ page_cache_readahead(struct address_space *mapping, struct file_ra_state *ra,
 	if (offset == ra->prev_page && --req_size)
 		++offset;
 
+	max = get_max_readahead(ra);
+	newsize = min(req_size, max);
+
 	/* Note that prev_page == -1 if it is a first read */
 	sequential = (offset == ra->prev_page + 1);
+	if (!sequential && newsize && !(ra->flags & RA_FLAG_INCACHE)) {
+		/* another stream on this fd, or someone else's? */
+		resume = ra_resume_stream(ra, offset);
+		if (!resume) {
+			ra_save_stream(ra);
+			if (offset)
+				resume = ra_cache_history(mapping, offset, max);
+			if (resume < get_min_readahead(ra))
+				resume = 0;
+		}
+		if (resume) {
+			ra_off(ra);
+			sequential = 1;
+		}
+	}
 	ra->prev_page = offset;
 
-	max = get_max_readahead(ra);
-	newsize = min(req_size, max);
-
 	/* No readahead or sub-page sized read or file already in cache */
 	if (newsize == 0 || (ra->flags & RA_FLAG_INCACHE))
 		goto out;
@@ -468,7 +562,8 @@ page_cache_readahead(struct address_space *mapping, struct file_ra_state *ra,
 	 * sequential access
 	 */
 	if (sequential && ra->size == 0) {
-		ra->size = get_init_ra_size(newsize, max);
+		ra->size = max(get_init_ra_size(newsize, max), resume);
+		ra->size = min(ra->size, max);
 		ra->start = offset;
 		if (!blockable_page_cache_readahead(mapping, filp, offset,
 							 ra->size, ra, 1))
@@ -33,6 +33,7 @@
  *     mapping->i_mmap_lock
  *       anon_vma->lock
  *         mm->page_table_lock
+ *           pte lock (see pte_lockptr: also taken alone by page faults)
  *           zone->lru_lock (in mark_page_accessed)
  *           swap_list_lock (in swap_free etc's swap_info_get)
  *             mmlist_lock (in mmput, drain_mmlist and others)
@@ -242,6 +243,16 @@ unsigned long page_address_in_vma(struct page *page, struct vm_area_struct *vma)
 	return vma_address(page, vma);
 }
 
+/*
+ * The ptes of shared page tables are in no mm's rss, so an mm with
+ * page tables may still be mapping the page.
+ */
+#ifdef SHARED_PAGE_TABLES
+#define mm_maps_nothing(mm)	(!(mm)->nr_ptes)
+#else
+#define mm_maps_nothing(mm)	(!get_mm_counter(mm, rss))
+#endif
+
 /*
  * Subfunctions of page_referenced: page_referenced_one called
  * repeatedly from either page_referenced_anon or page_referenced_file.
@@ -257,7 +268,7 @@ static int page_referenced_one(struct page *page,
 	pte_t *pte;
 	int referenced = 0;
 
-	if (!get_mm_counter(mm, rss))
+	if (mm_maps_nothing(mm))
 		goto out;
 	address = vma_address(page, vma);
 	if (address == -EFAULT)
@@ -277,6 +288,7 @@ static int page_referenced_one(struct page *page,
 	if (!pmd_present(*pmd))
 		goto out_unlock;
 
+	pte_lock_nested(pmd);
 	pte = pte_offset_map(pmd, address);
 	if (!pte_present(*pte))
 		goto out_unmap;
@@ -294,6 +306,7 @@ static int page_referenced_one(struct page *page,
 
 out_unmap:
 	pte_unmap(pte);
+	pte_unlock_nested(pmd);
 out_unlock:
 	spin_unlock(&mm->page_table_lock);
 out:
@@ -425,7 +438,7 @@ int page_referenced(struct page *page, int is_locked, int ignore_token)
  * @vma:	the vm area in which the mapping is added
  * @address:	the user virtual address mapped
  *
- * The caller needs to hold the mm->page_table_lock.
+ * The caller needs to hold the pte lock.
  */
 void page_add_anon_rmap(struct page *page,
 	struct vm_area_struct *vma, unsigned long address)
@@ -436,7 +449,7 @@ void page_add_anon_rmap(struct page *page,
 	BUG_ON(PageReserved(page));
 	BUG_ON(!anon_vma);
 
-	inc_mm_counter(vma->vm_mm, anon_rss);
+	inc_mm_anon_rss(vma->vm_mm, page);
 
 	anon_vma = (void *) anon_vma + PAGE_MAPPING_ANON;
 	index = (address - vma->vm_start) >> PAGE_SHIFT;
@@ -455,7 +468,7 @@ void page_add_anon_rmap(struct page *page,
  * page_add_file_rmap - add pte mapping to a file page
  * @page: the page to add the mapping to
  *
- * The caller needs to hold the mm->page_table_lock.
+ * The caller needs to hold the pte lock.
  */
 void page_add_file_rmap(struct page *page)
 {
@@ -471,7 +484,7 @@ void page_add_file_rmap(struct page *page)
  * page_remove_rmap - take down pte mapping from a page
  * @page: page to remove mapping from
  *
- * Caller needs to hold the mm->page_table_lock.
+ * Caller needs to hold the pte lock.
  */
 void page_remove_rmap(struct page *page)
 {
@@ -498,7 +511,8 @@ void page_remove_rmap(struct page *page)
  * Subfunctions of try_to_unmap: try_to_unmap_one called
  * repeatedly from either try_to_unmap_anon or try_to_unmap_file.
  */
-static int try_to_unmap_one(struct page *page, struct vm_area_struct *vma)
+static int try_to_unmap_one(struct page *page, struct vm_area_struct *vma,
+			    int migration)
 {
 	struct mm_struct *mm = vma->vm_mm;
 	unsigned long address;
@@ -508,8 +522,9 @@ static int try_to_unmap_one(struct page *page, struct vm_area_struct *vma)
 	pte_t *pte;
 	pte_t pteval;
 	int ret = SWAP_AGAIN;
+	int counted;
 
-	if (!get_mm_counter(mm, rss))
+	if (mm_maps_nothing(mm))
 		goto out;
 	address = vma_address(page, vma);
 	if (address == -EFAULT)
@@ -533,6 +548,7 @@ static int try_to_unmap_one(struct page *page, struct vm_area_struct *vma)
 	if (!pmd_present(*pmd))
 		goto out_unlock;
 
+	pte_lock_nested(pmd);
 	pte = pte_offset_map(pmd, address);
 	if (!pte_present(*pte))
 		goto out_unmap;
@@ -540,13 +556,16 @@ static int try_to_unmap_one(struct page *page, struct vm_area_struct *vma)
 	if (page_to_pfn(page) != pte_pfn(*pte))
 		goto out_unmap;
 
+	counted = pt_counted(mm, pmd);
+
 	/*
 	 * If the page is mlock()d, we cannot swap it out.
 	 * If it's recently referenced (perhaps page_referenced
-	 * skipped over this mm) then we should reactivate it.
+	 * skipped over this mm) then we should reactivate it,
+	 * unless it is only being moved to another node.
 	 */
 	if ((vma->vm_flags & (VM_LOCKED|VM_RESERVED)) ||
-			ptep_clear_flush_young(vma, address, pte)) {
+	    (!migration && ptep_clear_flush_young(vma, address, pte))) {
 		ret = SWAP_FAIL;
 		goto out_unmap;
 	}
@@ -571,39 +590,66 @@ static int try_to_unmap_one(struct page *page, struct vm_area_struct *vma)
 		ret = SWAP_FAIL;
 		goto out_unmap;
 	}
+	/* Likewise for a MADV_FREE page, which has no swap cache reference */
+	if (PageAnon(page) && !PageSwapCache(page) &&
+	    page_count(page) != page_mapcount(page) + 1) {
+		ret = SWAP_FAIL;
+		goto out_unmap;
+	}
 
 	/* Nuke the page table entry. */
 	flush_cache_page(vma, address, page_to_pfn(page));
 	pteval = ptep_clear_flush(vma, address, pte);
+	/* Other mms sharing the page table may have it in their TLBs */
+	if (pt_shared(pmd))
+		flush_tlb_all();
+
+	/*
+	 * A MADV_FREE page written to since is anonymous memory again: put
+	 * the pte back, vmscan activates the page and swaps it another time.
+	 */
+	if (PageAnon(page) && !PageSwapCache(page) &&
+	    (pte_dirty(pteval) || PageDirty(page))) {
+		set_pte_at(mm, address, pte, pteval);
+		SetPageSwapBacked(page);
+		ret = SWAP_FAIL;
+		goto out_unmap;
+	}
 
 	/* Move the dirty bit to the physical page now the pte is gone. */
 	if (pte_dirty(pteval))
 		set_page_dirty(page);
 
 	if (PageAnon(page)) {
-		swp_entry_t entry = { .val = page->private };
-		/*
-		 * Store the swap location in the pte.
-		 * See handle_pte_fault() ...
-		 */
-		BUG_ON(!PageSwapCache(page));
-		swap_duplicate(entry);
-		if (list_empty(&mm->mmlist)) {
-			spin_lock(&mmlist_lock);
-			list_add(&mm->mmlist, &init_mm.mmlist);
-			spin_unlock(&mmlist_lock);
+		/* A clean MADV_FREE page leaves the pte empty, to refault zeroed */
+		BUG_ON(!PageSwapCache(page) && PageSwapBacked(page));
+		if (PageSwapCache(page)) {
+			swp_entry_t entry = { .val = page->private };
+			/*
+			 * Store the swap location in the pte.
+			 * See handle_pte_fault() ...
+			 */
+			swap_duplicate(entry);
+			if (list_empty(&mm->mmlist)) {
+				spin_lock(&mmlist_lock);
+				list_add(&mm->mmlist, &init_mm.mmlist);
+				spin_unlock(&mmlist_lock);
+			}
+			set_pte_at(mm, address, pte, swp_entry_to_pte(entry));
+			BUG_ON(pte_file(*pte));
 		}
-		set_pte_at(mm, address, pte, swp_entry_to_pte(entry));
-		BUG_ON(pte_file(*pte));
-		dec_mm_counter(mm, anon_rss);
+		if (counted)
+			dec_mm_anon_rss(mm, page);
 	}
 
-	inc_mm_counter(mm, rss);
+	if (counted)
+		dec_mm_counter(mm, rss);
 	page_remove_rmap(page);
 	page_cache_release(page);
 
 out_unmap:
 	pte_unmap(pte);
+	pte_unlock_nested(pmd);
 out_unlock:
 	spin_unlock(&mm->page_table_lock);
 out:
@@ -645,6 +691,7 @@ static void try_to_unmap_cluster(unsigned long cursor,
 	unsigned long address;
 	unsigned long end;
 	unsigned long pfn;
+	int counted;
 
 	/*
 	 * We need the page_table_lock to protect us from page faults,
@@ -671,6 +718,8 @@ static void try_to_unmap_cluster(unsigned long cursor,
 	if (!pmd_present(*pmd))
 		goto out_unlock;
 
+	pte_lock_nested(pmd);
+	counted = pt_counted(mm, pmd);
 	for (pte = pte_offset_map(pmd, address);
 			address < end; pte++, address += PAGE_SIZE) {
 
@@ -703,17 +752,19 @@ static void try_to_unmap_cluster(unsigned long cursor,
 
 		page_remove_rmap(page);
 		page_cache_release(page);
-		dec_mm_counter(mm, rss);
+		if (counted)
+			dec_mm_counter(mm, rss);
 		(*mapcount)--;
 	}
 
 	pte_unmap(pte);
+	pte_unlock_nested(pmd);
 
 out_unlock:
 	spin_unlock(&mm->page_table_lock);
 }
 
-static int try_to_unmap_anon(struct page *page)
+static int try_to_unmap_anon(struct page *page, int migration)
 {
 	struct anon_vma *anon_vma;
 	struct vm_area_struct *vma;
@@ -724,7 +775,7 @@ static int try_to_unmap_anon(struct page *page)
 		return ret;
 
 	list_for_each_entry(vma, &anon_vma->head, anon_vma_node) {
-		ret = try_to_unmap_one(page, vma);
+		ret = try_to_unmap_one(page, vma, migration);
 		if (ret == SWAP_FAIL || !page_mapped(page))
 			break;
 	}
@@ -741,7 +792,7 @@ static int try_to_unmap_anon(struct page *page)
  *
  * This function is only called from try_to_unmap for object-based pages.
  */
-static int try_to_unmap_file(struct page *page)
+static int try_to_unmap_file(struct page *page, int migration)
 {
 	struct address_space *mapping = page->mapping;
 	pgoff_t pgoff = page->index << (PAGE_CACHE_SHIFT - PAGE_SHIFT);
@@ -755,7 +806,7 @@ static int try_to_unmap_file(struct page *page)
 
 	spin_lock(&mapping->i_mmap_lock);
 	vma_prio_tree_foreach(vma, &iter, &mapping->i_mmap, pgoff, pgoff) {
-		ret = try_to_unmap_one(page, vma);
+		ret = try_to_unmap_one(page, vma, migration);
 		if (ret == SWAP_FAIL || !page_mapped(page))
 			goto out;
 	}
@@ -763,6 +814,12 @@ static int try_to_unmap_file(struct page *page)
 	if (list_empty(&mapping->i_mmap_nonlinear))
 		goto out;
 
+	/* Unmapping clusters of other pages would not move this one */
+	if (migration) {
+		ret = SWAP_FAIL;
+		goto out;
+	}
+
 	list_for_each_entry(vma, &mapping->i_mmap_nonlinear,
 						shared.vm_set.list) {
 		if (vma->vm_flags & (VM_LOCKED|VM_RESERVED))
@@ -835,16 +892,18 @@ out:
 /**
  * try_to_unmap - try to remove all page table mappings to a page
  * @page: the page to get unmapped
+ * @migration: the page is to be moved, not reclaimed
  *
  * Tries to remove all the page table entries which are mapping this
- * page, used in the pageout path.  Caller must hold the page lock.
- * Return values are:
+ * page, used in the pageout path and by page migration, which does not
+ * care whether the page was referenced recently.  Caller must hold the
+ * page lock.  Return values are:
  *
  * SWAP_SUCCESS	- we succeeded in removing all mappings
  * SWAP_AGAIN	- we missed a mapping, try again later
  * SWAP_FAIL	- the page is unswappable
  */
-int try_to_unmap(struct page *page)
+int try_to_unmap(struct page *page, int migration)
 {
 	int ret;
 
@@ -852,9 +911,9 @@ int try_to_unmap(struct page *page)
 	BUG_ON(!PageLocked(page));
 
 	if (PageAnon(page))
-		ret = try_to_unmap_anon(page);
+		ret = try_to_unmap_anon(page, migration);
 	else
-		ret = try_to_unmap_file(page);
+		ret = try_to_unmap_file(page, migration);
 
 	if (!page_mapped(page))
 		ret = SWAP_SUCCESS;
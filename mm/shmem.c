@@ -33,6 +33,7 @@
 #include <linux/file.h>
 #include <linux/swap.h>
 #include <linux/pagemap.h>
+#include <linux/pagevec.h>
 #include <linux/string.h>
 #include <linux/slab.h>
 #include <linux/backing-dev.h>
@@ -53,12 +54,10 @@
 /* This magic number is used in glibc for posix shared memory */
 #define TMPFS_MAGIC	0x01021994
 
-#define ENTRIES_PER_PAGE (PAGE_CACHE_SIZE/sizeof(unsigned long))
-#define ENTRIES_PER_PAGEPAGE (ENTRIES_PER_PAGE*ENTRIES_PER_PAGE)
 #define BLOCKS_PER_PAGE  (PAGE_CACHE_SIZE/512)
 
-#define SHMEM_MAX_INDEX  (SHMEM_NR_DIRECT + (ENTRIES_PER_PAGEPAGE/2) * (ENTRIES_PER_PAGE+1))
-#define SHMEM_MAX_BYTES  ((unsigned long long)SHMEM_MAX_INDEX << PAGE_CACHE_SHIFT)
+#define SHMEM_MAX_BYTES  MAX_LFS_FILESIZE
+#define SHMEM_MAX_INDEX  (SHMEM_MAX_BYTES >> PAGE_CACHE_SHIFT)
 
 #define VM_ACCT(size)    (PAGE_CACHE_ALIGN(size) >> PAGE_SHIFT)
 
@@ -66,16 +65,10 @@
 #define SHMEM_PAGEIN	 VM_READ
 #define SHMEM_TRUNCATE	 VM_WRITE
 
-/* Definition to limit shmem_truncate's steps between cond_rescheds */
-#define LATENCY_LIMIT	 64
-
 /* Pretend that each entry is of this size in directory's i_size */
 #define BOGO_DIRENT_SIZE 20
 
-/* Keep swapped page count in private field of indirect struct page */
-#define nr_swapped		private
-
-/* Flag allocation requirements to shmem_getpage and shmem_swp_alloc */
+/* Flag allocation requirements to shmem_getpage */
 enum sgp_type {
 	SGP_QUICK,	/* don't try more than file page cache lookup */
 	SGP_READ,	/* don't exceed i_size, don't allocate page */
@@ -86,53 +79,6 @@ enum sgp_type {
 static int shmem_getpage(struct inode *inode, unsigned long idx,
 			 struct page **pagep, enum sgp_type sgp, int *type);
 
-static inline struct page *shmem_dir_alloc(unsigned int gfp_mask)
-{
-	/*
-	 * The above definition of ENTRIES_PER_PAGE, and the use of
-	 * BLOCKS_PER_PAGE on indirect pages, assume PAGE_CACHE_SIZE:
-	 * might be reconsidered if it ever diverges from PAGE_SIZE.
-	 */
-	return alloc_pages(gfp_mask, PAGE_CACHE_SHIFT-PAGE_SHIFT);
-}
-
-static inline void shmem_dir_free(struct page *page)
-{
-	__free_pages(page, PAGE_CACHE_SHIFT-PAGE_SHIFT);
-}
-
-static struct page **shmem_dir_map(struct page *page)
-{
-	return (struct page **)kmap_atomic(page, KM_USER0);
-}
-
-static inline void shmem_dir_unmap(struct page **dir)
-{
-	kunmap_atomic(dir, KM_USER0);
-}
-
-static swp_entry_t *shmem_swp_map(struct page *page)
-{
-	return (swp_entry_t *)kmap_atomic(page, KM_USER1);
-}
-
-static inline void shmem_swp_balance_unmap(void)
-{
-	/*
-	 * When passing a pointer to an i_direct entry, to code which
-	 * also handles indirect entries and so will shmem_swp_unmap,
-	 * we must arrange for the preempt count to remain in balance.
-	 * What kmap_atomic of a lowmem page does depends on config
-	 * and architecture, so pretend to kmap_atomic some lowmem page.
-	 */
-	(void) kmap_atomic(ZERO_PAGE(0), KM_USER1);
-}
-
-static inline void shmem_swp_unmap(swp_entry_t *entry)
-{
-	kunmap_atomic(entry, KM_USER1);
-}
-
 static inline struct shmem_sb_info *SHMEM_SB(struct super_block *sb)
 {
 	return sb->s_fs_info;
@@ -229,256 +175,128 @@ static void shmem_recalc_inode(struct inode *inode)
 }
 
 /*
- * shmem_swp_entry - find the swap vector position in the info structure
- *
- * @info:  info structure for the inode
- * @index: index of the page to find
- * @page:  optional page to add to the structure. Has to be preset to
- *         all zeros
- *
- * If there is no space allocated yet it will return NULL when
- * page is NULL, else it will use the page for the needed block,
- * setting it to NULL on return to indicate that it has been used.
- *
- * The swap vector is organized the following way:
- *
- * There are SHMEM_NR_DIRECT entries directly stored in the
- * shmem_inode_info structure. So small files do not need an addional
- * allocation.
- *
- * For pages with index > SHMEM_NR_DIRECT there is the pointer
- * i_indirect which points to a page which holds in the first half
- * doubly indirect blocks, in the second half triple indirect blocks:
- *
- * For an artificial ENTRIES_PER_PAGE = 4 this would lead to the
- * following layout (for SHMEM_NR_DIRECT == 16):
- *
- * i_indirect -> dir --> 16-19
- * 	      |	     +-> 20-23
- * 	      |
- * 	      +-->dir2 --> 24-27
- * 	      |	       +-> 28-31
- * 	      |	       +-> 32-35
- * 	      |	       +-> 36-39
- * 	      |
- * 	      +-->dir3 --> 40-43
- * 	       	       +-> 44-47
- * 	      	       +-> 48-51
- * 	      	       +-> 52-55
+ * The swap entries of the pages of a file which are out on swap are kept
+ * in its page cache radix tree, in the slots of the pages written out to
+ * them: see swp_to_radix_entry().  They are put in and taken out under
+ * info->lock, so shmem_get_swap() gives an answer which holds as long as
+ * that is held.  The generic page cache lookups skip over them, except
+ * find_lock_page(), which reads the page back in: shmem_find_lock_page().
  */
-static swp_entry_t *shmem_swp_entry(struct shmem_inode_info *info, unsigned long index, struct page **page)
-{
-	unsigned long offset;
-	struct page **dir;
-	struct page *subdir;
-
-	if (index < SHMEM_NR_DIRECT) {
-		shmem_swp_balance_unmap();
-		return info->i_direct+index;
-	}
-	if (!info->i_indirect) {
-		if (page) {
-			info->i_indirect = *page;
-			*page = NULL;
-		}
-		return NULL;			/* need another page */
-	}
-
-	index -= SHMEM_NR_DIRECT;
-	offset = index % ENTRIES_PER_PAGE;
-	index /= ENTRIES_PER_PAGE;
-	dir = shmem_dir_map(info->i_indirect);
-
-	if (index >= ENTRIES_PER_PAGE/2) {
-		index -= ENTRIES_PER_PAGE/2;
-		dir += ENTRIES_PER_PAGE/2 + index/ENTRIES_PER_PAGE;
-		index %= ENTRIES_PER_PAGE;
-		subdir = *dir;
-		if (!subdir) {
-			if (page) {
-				*dir = *page;
-				*page = NULL;
-			}
-			shmem_dir_unmap(dir);
-			return NULL;		/* need another page */
-		}
-		shmem_dir_unmap(dir);
-		dir = shmem_dir_map(subdir);
-	}
-
-	dir += index;
-	subdir = *dir;
-	if (!subdir) {
-		if (!page || !(subdir = *page)) {
-			shmem_dir_unmap(dir);
-			return NULL;		/* need a page */
-		}
-		*dir = subdir;
-		*page = NULL;
-	}
-	shmem_dir_unmap(dir);
-	return shmem_swp_map(subdir) + offset;
-}
-
-static void shmem_swp_set(struct shmem_inode_info *info, swp_entry_t *entry, unsigned long value)
+static swp_entry_t shmem_get_swap(struct address_space *mapping,
+				  unsigned long idx)
 {
-	long incdec = value? 1: -1;
+	swp_entry_t swap = { .val = 0 };
+	void *entry;
 
-	entry->val = value;
-	info->swapped += incdec;
-	if ((unsigned long)(entry - info->i_direct) >= SHMEM_NR_DIRECT)
-		kmap_atomic_to_page(entry)->nr_swapped += incdec;
+	read_lock_irq(&mapping->tree_lock);
+	entry = radix_tree_lookup(&mapping->page_tree, idx);
+	if (radix_tree_exceptional_entry(entry))
+		swap = radix_to_swp_entry(entry);
+	read_unlock_irq(&mapping->tree_lock);
+	return swap;
 }
 
 /*
- * shmem_swp_alloc - get the position of the swap entry for the page.
- *                   If it does not exist allocate the entry.
+ * shmem_find_swap - find where a swap entry is in a file
  *
- * @info:	info structure for the inode
- * @index:	index of the page to find
- * @sgp:	check and recheck i_size? skip allocation?
+ * @mapping: mapping of the file
+ * @radswap: the swap entry, as kept in the radix tree
+ * @end:     index to search up to
+ * @idxp:    where to return the index found
+ *
+ * It has to be called with info->lock held.  The tree_lock is only held
+ * a batch of entries at a time, to keep interrupts enabled on big files.
  */
-static swp_entry_t *shmem_swp_alloc(struct shmem_inode_info *info, unsigned long index, enum sgp_type sgp)
-{
-	struct inode *inode = &info->vfs_inode;
-	struct shmem_sb_info *sbinfo = SHMEM_SB(inode->i_sb);
-	struct page *page = NULL;
-	swp_entry_t *entry;
-
-	if (sgp != SGP_WRITE &&
-	    ((loff_t) index << PAGE_CACHE_SHIFT) >= i_size_read(inode))
-		return ERR_PTR(-EINVAL);
-
-	while (!(entry = shmem_swp_entry(info, index, &page))) {
-		if (sgp == SGP_READ)
-			return shmem_swp_map(ZERO_PAGE(0));
-		/*
-		 * Test free_blocks against 1 not 0, since we have 1 data
-		 * page (and perhaps indirect index pages) yet to allocate:
-		 * a waste to allocate index if we cannot allocate data.
-		 */
-		if (sbinfo) {
-			spin_lock(&sbinfo->stat_lock);
-			if (sbinfo->free_blocks <= 1) {
-				spin_unlock(&sbinfo->stat_lock);
-				return ERR_PTR(-ENOSPC);
+static int shmem_find_swap(struct address_space *mapping, void *radswap,
+			   unsigned long end, unsigned long *idxp)
+{
+	void **slots[PAGEVEC_SIZE];
+	unsigned long indices[PAGEVEC_SIZE];
+	unsigned long idx = 0;
+	unsigned int i, nr;
+
+	while (idx < end) {
+		read_lock_irq(&mapping->tree_lock);
+		nr = radix_tree_gang_lookup_slot(&mapping->page_tree,
+					slots, indices, idx, PAGEVEC_SIZE);
+		for (i = 0; i < nr && indices[i] < end; i++) {
+			if (*slots[i] == radswap) {
+				read_unlock_irq(&mapping->tree_lock);
+				*idxp = indices[i];
+				return 1;
 			}
-			sbinfo->free_blocks--;
-			inode->i_blocks += BLOCKS_PER_PAGE;
-			spin_unlock(&sbinfo->stat_lock);
-		}
-
-		spin_unlock(&info->lock);
-		page = shmem_dir_alloc(mapping_gfp_mask(inode->i_mapping) | __GFP_ZERO);
-		if (page) {
-			page->nr_swapped = 0;
 		}
-		spin_lock(&info->lock);
-
-		if (!page) {
-			shmem_free_blocks(inode, 1);
-			return ERR_PTR(-ENOMEM);
-		}
-		if (sgp != SGP_WRITE &&
-		    ((loff_t) index << PAGE_CACHE_SHIFT) >= i_size_read(inode)) {
-			entry = ERR_PTR(-EINVAL);
+		read_unlock_irq(&mapping->tree_lock);
+		if (nr < PAGEVEC_SIZE)
+			break;
+		idx = indices[nr - 1] + 1;
+		if (!idx)
 			break;
-		}
-		if (info->next_index <= index)
-			info->next_index = index + 1;
-	}
-	if (page) {
-		/* another task gave its page, or truncated the file */
-		shmem_free_blocks(inode, 1);
-		shmem_dir_free(page);
 	}
-	if (info->next_index <= index && !IS_ERR(entry))
-		info->next_index = index + 1;
-	return entry;
+	return 0;
 }
 
 /*
- * shmem_free_swp - free some swap entries in a directory
+ * shmem_free_swap - free the swap entries of a file in a range
+ *
+ * @inode: inode of the file
+ * @idx:   first index of the range
+ * @end:   index after the range
  *
- * @dir:   pointer to the directory
- * @edir:  pointer after last entry of the directory
+ * The entries are taken out of the tree a batch at a time under
+ * info->lock, and freed after it has been dropped.  Returns how many
+ * were freed, for the caller to take off info->swapped.
  */
-static int shmem_free_swp(swp_entry_t *dir, swp_entry_t *edir)
+static long shmem_free_swap(struct inode *inode, unsigned long idx,
+			    unsigned long end)
 {
-	swp_entry_t *ptr;
-	int freed = 0;
-
-	for (ptr = dir; ptr < edir; ptr++) {
-		if (ptr->val) {
-			free_swap_and_cache(*ptr);
-			*ptr = (swp_entry_t){0};
-			freed++;
+	struct address_space *mapping = inode->i_mapping;
+	struct shmem_inode_info *info = SHMEM_I(inode);
+	void **slots[PAGEVEC_SIZE];
+	unsigned long indices[PAGEVEC_SIZE];
+	swp_entry_t swaps[PAGEVEC_SIZE];
+	unsigned long next;
+	unsigned int i, nr, nr_swaps;
+	long freed = 0;
+
+	while (idx < end) {
+		nr_swaps = 0;
+		spin_lock(&info->lock);
+		write_lock_irq(&mapping->tree_lock);
+		nr = radix_tree_gang_lookup_slot(&mapping->page_tree,
+					slots, indices, idx, PAGEVEC_SIZE);
+		next = nr ? indices[nr - 1] + 1 : 0;
+		for (i = 0; i < nr && indices[i] < end; i++) {
+			void *entry = *slots[i];
+
+			if (!radix_tree_exceptional_entry(entry))
+				continue;
+			swaps[nr_swaps] = radix_to_swp_entry(entry);
+			indices[nr_swaps++] = indices[i];
 		}
-	}
-	return freed;
-}
-
-static int shmem_map_and_free_swp(struct page *subdir,
-		int offset, int limit, struct page ***dir)
-{
-	swp_entry_t *ptr;
-	int freed = 0;
+		if (nr_swaps)
+			radix_tree_gang_delete(&mapping->page_tree,
+						indices, nr_swaps);
+		write_unlock_irq(&mapping->tree_lock);
+		spin_unlock(&info->lock);
 
-	ptr = shmem_swp_map(subdir);
-	for (; offset < limit; offset += LATENCY_LIMIT) {
-		int size = limit - offset;
-		if (size > LATENCY_LIMIT)
-			size = LATENCY_LIMIT;
-		freed += shmem_free_swp(ptr+offset, ptr+offset+size);
-		if (need_resched()) {
-			shmem_swp_unmap(ptr);
-			if (*dir) {
-				shmem_dir_unmap(*dir);
-				*dir = NULL;
-			}
-			cond_resched();
-			ptr = shmem_swp_map(subdir);
-		}
+		for (i = 0; i < nr_swaps; i++)
+			free_swap_and_cache(swaps[i]);
+		freed += nr_swaps;
+		if (nr < PAGEVEC_SIZE || !next)
+			break;
+		idx = next;
+		cond_resched();
 	}
-	shmem_swp_unmap(ptr);
 	return freed;
 }
 
-static void shmem_free_pages(struct list_head *next)
-{
-	struct page *page;
-	int freed = 0;
-
-	do {
-		page = container_of(next, struct page, lru);
-		next = next->next;
-		shmem_dir_free(page);
-		freed++;
-		if (freed >= LATENCY_LIMIT) {
-			cond_resched();
-			freed = 0;
-		}
-	} while (next);
-}
-
 static void shmem_truncate(struct inode *inode)
 {
 	struct shmem_inode_info *info = SHMEM_I(inode);
 	unsigned long idx;
-	unsigned long size;
 	unsigned long limit;
-	unsigned long stage;
-	unsigned long diroff;
-	struct page **dir;
-	struct page *topdir;
-	struct page *middir;
-	struct page *subdir;
-	swp_entry_t *ptr;
-	LIST_HEAD(pages_to_free);
-	long nr_pages_to_free = 0;
 	long nr_swaps_freed = 0;
-	int offset;
-	int freed;
 
 	inode->i_ctime = inode->i_mtime = CURRENT_TIME;
 	idx = (inode->i_size + PAGE_CACHE_SIZE - 1) >> PAGE_CACHE_SHIFT;
@@ -489,107 +307,11 @@ static void shmem_truncate(struct inode *inode)
 	info->flags |= SHMEM_TRUNCATE;
 	limit = info->next_index;
 	info->next_index = idx;
-	topdir = info->i_indirect;
-	if (topdir && idx <= SHMEM_NR_DIRECT) {
-		info->i_indirect = NULL;
-		nr_pages_to_free++;
-		list_add(&topdir->lru, &pages_to_free);
-	}
 	spin_unlock(&info->lock);
 
-	if (info->swapped && idx < SHMEM_NR_DIRECT) {
-		ptr = info->i_direct;
-		size = limit;
-		if (size > SHMEM_NR_DIRECT)
-			size = SHMEM_NR_DIRECT;
-		nr_swaps_freed = shmem_free_swp(ptr+idx, ptr+size);
-	}
-	if (!topdir)
-		goto done2;
-
-	BUG_ON(limit <= SHMEM_NR_DIRECT);
-	limit -= SHMEM_NR_DIRECT;
-	idx = (idx > SHMEM_NR_DIRECT)? (idx - SHMEM_NR_DIRECT): 0;
-	offset = idx % ENTRIES_PER_PAGE;
-	idx -= offset;
-
-	dir = shmem_dir_map(topdir);
-	stage = ENTRIES_PER_PAGEPAGE/2;
-	if (idx < ENTRIES_PER_PAGEPAGE/2) {
-		middir = topdir;
-		diroff = idx/ENTRIES_PER_PAGE;
-	} else {
-		dir += ENTRIES_PER_PAGE/2;
-		dir += (idx - ENTRIES_PER_PAGEPAGE/2)/ENTRIES_PER_PAGEPAGE;
-		while (stage <= idx)
-			stage += ENTRIES_PER_PAGEPAGE;
-		middir = *dir;
-		if (*dir) {
-			diroff = ((idx - ENTRIES_PER_PAGEPAGE/2) %
-				ENTRIES_PER_PAGEPAGE) / ENTRIES_PER_PAGE;
-			if (!diroff && !offset) {
-				*dir = NULL;
-				nr_pages_to_free++;
-				list_add(&middir->lru, &pages_to_free);
-			}
-			shmem_dir_unmap(dir);
-			dir = shmem_dir_map(middir);
-		} else {
-			diroff = 0;
-			offset = 0;
-			idx = stage;
-		}
-	}
+	if (info->swapped)
+		nr_swaps_freed = shmem_free_swap(inode, idx, limit);
 
-	for (; idx < limit; idx += ENTRIES_PER_PAGE, diroff++) {
-		if (unlikely(idx == stage)) {
-			shmem_dir_unmap(dir);
-			dir = shmem_dir_map(topdir) +
-			    ENTRIES_PER_PAGE/2 + idx/ENTRIES_PER_PAGEPAGE;
-			while (!*dir) {
-				dir++;
-				idx += ENTRIES_PER_PAGEPAGE;
-				if (idx >= limit)
-					goto done1;
-			}
-			stage = idx + ENTRIES_PER_PAGEPAGE;
-			middir = *dir;
-			*dir = NULL;
-			nr_pages_to_free++;
-			list_add(&middir->lru, &pages_to_free);
-			shmem_dir_unmap(dir);
-			cond_resched();
-			dir = shmem_dir_map(middir);
-			diroff = 0;
-		}
-		subdir = dir[diroff];
-		if (subdir && subdir->nr_swapped) {
-			size = limit - idx;
-			if (size > ENTRIES_PER_PAGE)
-				size = ENTRIES_PER_PAGE;
-			freed = shmem_map_and_free_swp(subdir,
-						offset, size, &dir);
-			if (!dir)
-				dir = shmem_dir_map(middir);
-			nr_swaps_freed += freed;
-			if (offset)
-				spin_lock(&info->lock);
-			subdir->nr_swapped -= freed;
-			if (offset)
-				spin_unlock(&info->lock);
-			BUG_ON(subdir->nr_swapped > offset);
-		}
-		if (offset)
-			offset = 0;
-		else if (subdir) {
-			dir[diroff] = NULL;
-			nr_pages_to_free++;
-			list_add(&subdir->lru, &pages_to_free);
-		}
-	}
-done1:
-	shmem_dir_unmap(dir);
-done2:
 	if (inode->i_mapping->nrpages && (info->flags & SHMEM_PAGEIN)) {
 		/*
 		 * Call truncate_inode_pages again: racing shmem_unuse_inode
@@ -604,18 +326,8 @@ done2:
 	spin_lock(&info->lock);
 	info->flags &= ~SHMEM_TRUNCATE;
 	info->swapped -= nr_swaps_freed;
-	if (nr_pages_to_free)
-		shmem_free_blocks(inode, nr_pages_to_free);
 	shmem_recalc_inode(inode);
 	spin_unlock(&info->lock);
-
-	/*
-	 * Empty swap vector directory pages to be freed?
-	 */
-	if (!list_empty(&pages_to_free)) {
-		pages_to_free.prev->next = NULL;
-		shmem_free_pages(pages_to_free.next);
-	}
 }
 
 static int shmem_notify_change(struct dentry *dentry, struct iattr *attr)
@@ -686,90 +398,21 @@ static void shmem_delete_inode(struct inode *inode)
 	clear_inode(inode);
 }
 
-static inline int shmem_find_swp(swp_entry_t entry, swp_entry_t *dir, swp_entry_t *edir)
-{
-	swp_entry_t *ptr;
-
-	for (ptr = dir; ptr < edir; ptr++) {
-		if (ptr->val == entry.val)
-			return ptr - dir;
-	}
-	return -1;
-}
-
 static int shmem_unuse_inode(struct shmem_inode_info *info, swp_entry_t entry, struct page *page)
 {
-	struct inode *inode;
+	struct address_space *mapping = info->vfs_inode.i_mapping;
 	unsigned long idx;
-	unsigned long size;
-	unsigned long limit;
-	unsigned long stage;
-	struct page **dir;
-	struct page *subdir;
-	swp_entry_t *ptr;
-	int offset;
-
-	idx = 0;
-	ptr = info->i_direct;
+
 	spin_lock(&info->lock);
-	limit = info->next_index;
-	size = limit;
-	if (size > SHMEM_NR_DIRECT)
-		size = SHMEM_NR_DIRECT;
-	offset = shmem_find_swp(entry, ptr, ptr+size);
-	if (offset >= 0) {
-		shmem_swp_balance_unmap();
-		goto found;
-	}
-	if (!info->i_indirect)
-		goto lost2;
-
-	dir = shmem_dir_map(info->i_indirect);
-	stage = SHMEM_NR_DIRECT + ENTRIES_PER_PAGEPAGE/2;
-
-	for (idx = SHMEM_NR_DIRECT; idx < limit; idx += ENTRIES_PER_PAGE, dir++) {
-		if (unlikely(idx == stage)) {
-			shmem_dir_unmap(dir-1);
-			dir = shmem_dir_map(info->i_indirect) +
-			    ENTRIES_PER_PAGE/2 + idx/ENTRIES_PER_PAGEPAGE;
-			while (!*dir) {
-				dir++;
-				idx += ENTRIES_PER_PAGEPAGE;
-				if (idx >= limit)
-					goto lost1;
-			}
-			stage = idx + ENTRIES_PER_PAGEPAGE;
-			subdir = *dir;
-			shmem_dir_unmap(dir);
-			dir = shmem_dir_map(subdir);
-		}
-		subdir = *dir;
-		if (subdir && subdir->nr_swapped) {
-			ptr = shmem_swp_map(subdir);
-			size = limit - idx;
-			if (size > ENTRIES_PER_PAGE)
-				size = ENTRIES_PER_PAGE;
-			offset = shmem_find_swp(entry, ptr, ptr+size);
-			if (offset >= 0) {
-				shmem_dir_unmap(dir);
-				goto found;
-			}
-			shmem_swp_unmap(ptr);
-		}
+	if (!shmem_find_swap(mapping, swp_to_radix_entry(entry),
+			     info->next_index, &idx)) {
+		spin_unlock(&info->lock);
+		return 0;
 	}
-lost1:
-	shmem_dir_unmap(dir-1);
-lost2:
-	spin_unlock(&info->lock);
-	return 0;
-found:
-	idx += offset;
-	inode = &info->vfs_inode;
-	if (move_from_swap_cache(page, idx, inode->i_mapping) == 0) {
+	if (move_from_swap_cache(page, idx, mapping) == 0) {
 		info->flags |= SHMEM_PAGEIN;
-		shmem_swp_set(info, ptr + offset, 0);
+		info->swapped--;
 	}
-	shmem_swp_unmap(ptr);
 	spin_unlock(&info->lock);
 	/*
 	 * Decrement swap count even when the entry is left behind:
@@ -810,7 +453,7 @@ int shmem_unuse(swp_entry_t entry, struct page *page)
 static int shmem_writepage(struct page *page, struct writeback_control *wbc)
 {
 	struct shmem_inode_info *info;
-	swp_entry_t *entry, swap;
+	swp_entry_t swap;
 	struct address_space *mapping;
 	unsigned long index;
 	struct inode *inode;
@@ -834,13 +477,9 @@ static int shmem_writepage(struct page *page, struct writeback_control *wbc)
 		BUG_ON(!(info->flags & SHMEM_TRUNCATE));
 		goto unlock;
 	}
-	entry = shmem_swp_entry(info, index, NULL);
-	BUG_ON(!entry);
-	BUG_ON(entry->val);
 
 	if (move_to_swap_cache(page, swap) == 0) {
-		shmem_swp_set(info, entry, swap.val);
-		shmem_swp_unmap(entry);
+		info->swapped++;
 		spin_unlock(&info->lock);
 		if (list_empty(&info->swaplist)) {
 			spin_lock(&shmem_swaplist_lock);
@@ -852,7 +491,6 @@ static int shmem_writepage(struct page *page, struct writeback_control *wbc)
 		return 0;
 	}
 
-	shmem_swp_unmap(entry);
 unlock:
 	spin_unlock(&info->lock);
 	swap_free(swap);
@@ -944,7 +582,6 @@ static int shmem_getpage(struct inode *inode, unsigned long idx,
 	struct shmem_sb_info *sbinfo;
 	struct page *filepage = *pagep;
 	struct page *swappage;
-	swp_entry_t *entry;
 	swp_entry_t swap;
 	int error;
 
@@ -955,12 +592,16 @@ static int shmem_getpage(struct inode *inode, unsigned long idx,
 	 * uptodate immediately, or allocated and zeroed, or read
 	 * in under swappage, which is then assigned to filepage.
 	 * But shmem_prepare_write passes in a locked filepage,
-	 * which may be found not uptodate by other callers too,
-	 * and may need to be copied from the swappage read in.
+	 * which may be found not uptodate by other callers too:
+	 * it holds the slot, so there cannot be a swap entry.
 	 */
 repeat:
-	if (!filepage)
-		filepage = find_lock_page(mapping, idx);
+	if (!filepage) {
+		filepage = find_lock_entry(mapping, idx);
+		/* out on swap: looked at below */
+		if (radix_tree_exceptional_entry(filepage))
+			filepage = NULL;
+	}
 	if (filepage && PageUptodate(filepage))
 		goto done;
 	error = 0;
@@ -969,19 +610,18 @@ repeat:
 
 	spin_lock(&info->lock);
 	shmem_recalc_inode(inode);
-	entry = shmem_swp_alloc(info, idx, sgp);
-	if (IS_ERR(entry)) {
+	if (sgp != SGP_WRITE &&
+	    ((loff_t) idx << PAGE_CACHE_SHIFT) >= i_size_read(inode)) {
 		spin_unlock(&info->lock);
-		error = PTR_ERR(entry);
+		error = -EINVAL;
 		goto failed;
 	}
-	swap = *entry;
+	swap = shmem_get_swap(mapping, idx);
 
 	if (swap.val) {
 		/* Look it up and read it in.. */
 		swappage = lookup_swap_cache(swap);
 		if (!swappage) {
-			shmem_swp_unmap(entry);
 			spin_unlock(&info->lock);
 			/* here we actually do the io */
 			if (type && *type == VM_FAULT_MINOR) {
@@ -991,14 +631,8 @@ repeat:
 			swappage = shmem_swapin(info, swap, idx);
 			if (!swappage) {
 				spin_lock(&info->lock);
-				entry = shmem_swp_alloc(info, idx, sgp);
-				if (IS_ERR(entry))
-					error = PTR_ERR(entry);
-				else {
-					if (entry->val == swap.val)
-						error = -ENOMEM;
-					shmem_swp_unmap(entry);
-				}
+				if (shmem_get_swap(mapping, idx).val == swap.val)
+					error = -ENOMEM;
 				spin_unlock(&info->lock);
 				if (error)
 					goto failed;
@@ -1011,14 +645,12 @@ repeat:
 
 		/* We have to do this with page locked to prevent races */
 		if (TestSetPageLocked(swappage)) {
-			shmem_swp_unmap(entry);
 			spin_unlock(&info->lock);
 			wait_on_page_locked(swappage);
 			page_cache_release(swappage);
 			goto repeat;
 		}
 		if (PageWriteback(swappage)) {
-			shmem_swp_unmap(entry);
 			spin_unlock(&info->lock);
 			wait_on_page_writeback(swappage);
 			unlock_page(swappage);
@@ -1026,7 +658,6 @@ repeat:
 			goto repeat;
 		}
 		if (!PageUptodate(swappage)) {
-			shmem_swp_unmap(entry);
 			spin_unlock(&info->lock);
 			unlock_page(swappage);
 			page_cache_release(swappage);
@@ -1034,28 +665,13 @@ repeat:
 			goto failed;
 		}
 
-		if (filepage) {
-			shmem_swp_set(info, entry, 0);
-			shmem_swp_unmap(entry);
-			delete_from_swap_cache(swappage);
-			spin_unlock(&info->lock);
-			copy_highpage(filepage, swappage);
-			unlock_page(swappage);
-			page_cache_release(swappage);
-			flush_dcache_page(filepage);
-			SetPageUptodate(filepage);
-			set_page_dirty(filepage);
-			swap_free(swap);
-		} else if (!(error = move_from_swap_cache(
-				swappage, idx, mapping))) {
+		if (!(error = move_from_swap_cache(swappage, idx, mapping))) {
 			info->flags |= SHMEM_PAGEIN;
-			shmem_swp_set(info, entry, 0);
-			shmem_swp_unmap(entry);
+			info->swapped--;
 			spin_unlock(&info->lock);
 			filepage = swappage;
 			swap_free(swap);
 		} else {
-			shmem_swp_unmap(entry);
 			spin_unlock(&info->lock);
 			unlock_page(swappage);
 			page_cache_release(swappage);
@@ -1066,7 +682,6 @@ repeat:
 			goto repeat;
 		}
 	} else if (sgp == SGP_READ && !filepage) {
-		shmem_swp_unmap(entry);
 		filepage = find_get_page(mapping, idx);
 		if (filepage &&
 		    (!PageUptodate(filepage) || TestSetPageLocked(filepage))) {
@@ -1078,7 +693,6 @@ repeat:
 		}
 		spin_unlock(&info->lock);
 	} else {
-		shmem_swp_unmap(entry);
 		sbinfo = SHMEM_SB(inode->i_sb);
 		if (sbinfo) {
 			spin_lock(&sbinfo->stat_lock);
@@ -1109,16 +723,14 @@ repeat:
 				error = -ENOMEM;
 				goto failed;
 			}
+			SetPageSwapBacked(filepage);
 
 			spin_lock(&info->lock);
-			entry = shmem_swp_alloc(info, idx, sgp);
-			if (IS_ERR(entry))
-				error = PTR_ERR(entry);
-			else {
-				swap = *entry;
-				shmem_swp_unmap(entry);
-			}
-			if (error || swap.val || 0 != add_to_page_cache_lru(
+			if (sgp != SGP_WRITE && ((loff_t) idx << PAGE_CACHE_SHIFT)
+						>= i_size_read(inode))
+				error = -EINVAL;
+			/* fails if a swap entry has come in meanwhile */
+			if (error || 0 != add_to_page_cache_lru(
 					filepage, mapping, idx, GFP_ATOMIC)) {
 				spin_unlock(&info->lock);
 				page_cache_release(filepage);
@@ -1132,6 +744,8 @@ repeat:
 			info->flags |= SHMEM_PAGEIN;
 		}
 
+		if (info->next_index <= idx)
+			info->next_index = idx + 1;
 		info->alloced++;
 		spin_unlock(&info->lock);
 		flush_dcache_page(filepage);
@@ -1152,6 +766,28 @@ failed:
 	return error;
 }
 
+/*
+ * find_lock_page() found a swap entry: read the page back in for callers
+ * outside tmpfs, like the loop driver through grab_cache_page(), which
+ * expect the pages of a file to be in its cache.
+ */
+struct page *shmem_find_lock_page(struct address_space *mapping,
+				  unsigned long idx)
+{
+	struct page *page = NULL;
+
+	if (shmem_getpage(mapping->host, idx, &page, SGP_READ, NULL) || !page)
+		return NULL;
+	lock_page(page);
+	if (page->mapping != mapping) {
+		/* truncated meanwhile */
+		unlock_page(page);
+		page_cache_release(page);
+		return NULL;
+	}
+	return page;
+}
+
 struct page *shmem_nopage(struct vm_area_struct *vma, unsigned long address, int *type)
 {
 	struct inode *inode = vma->vm_file->f_dentry->d_inode;
@@ -2056,7 +1692,7 @@ static int init_inodecache(void)
 {
 	shmem_inode_cachep = kmem_cache_create("shmem_inode_cache",
 				sizeof(struct shmem_inode_info),
-				0, 0, init_once, NULL);
+				0, SLAB_MEM_SPREAD, init_once, NULL);
 	if (shmem_inode_cachep == NULL)
 		return -ENOMEM;
 	return 0;
@@ -60,6 +60,14 @@
  *  The per-cpu arrays are never accessed from the wrong cpu, no locking,
  *  	and local interrupts are disabled so slab code is preempt-safe.
  *  The non-constant members are protected with a per-cache irq spinlock.
+ *  The slab lists are per node, each kmem_list3 has its own list_lock.
+ *
+ * NUMA:
+ *  The slabs of a node are only handed out through the per-cpu arrays of
+ *  the cpus on that node.  Objects of another node that get freed on
+ *  this node are collected in an "alien" cache and given back in batches.
+ *  kmem_cache_alloc_node() takes objects directly from the lists of a
+ *  remote node.
  *
  * Many thanks to Mark Hemment, who wrote another per-cpu slab patch
  * in 2000 - many ideas in the current implementation are derived from
@@ -92,6 +100,7 @@
 #include	<linux/sysctl.h>
 #include	<linux/module.h>
 #include	<linux/rcupdate.h>
+#include	<linux/cpuset.h>
 
 #include	<asm/uaccess.h>
 #include	<asm/cacheflush.h>
@@ -161,12 +170,12 @@
 			 SLAB_NO_REAP | SLAB_CACHE_DMA | \
 			 SLAB_MUST_HWCACHE_ALIGN | SLAB_STORE_USER | \
 			 SLAB_RECLAIM_ACCOUNT | SLAB_PANIC | \
-			 SLAB_DESTROY_BY_RCU)
+			 SLAB_DESTROY_BY_RCU | SLAB_MEM_SPREAD)
 #else
 # define CREATE_MASK	(SLAB_HWCACHE_ALIGN | SLAB_NO_REAP | \
 			 SLAB_CACHE_DMA | SLAB_MUST_HWCACHE_ALIGN | \
 			 SLAB_RECLAIM_ACCOUNT | SLAB_PANIC | \
-			 SLAB_DESTROY_BY_RCU)
+			 SLAB_DESTROY_BY_RCU | SLAB_MEM_SPREAD)
 #endif
 
 /*
@@ -210,6 +219,7 @@ struct slab {
 	void			*s_mem;		/* including colour offset */
 	unsigned int		inuse;		/* num of objs active in slab */
 	kmem_bufctl_t		free;
+	unsigned short		nodeid;		/* node owning the pages */
 };
 
 /*
@@ -246,12 +256,31 @@ struct slab_rcu {
  * The limit is stored in the per-cpu structure to reduce the data cache
  * footprint.
  *
+ * The same structure is used for the per-node shared arrays and for the
+ * alien caches, which collect objects freed on one node that belong to
+ * another node.  Only the alien caches use the lock: they are filled by
+ * every cpu of a node.
+ *
+ * The per-cpu arrays also carry the event counters of the cpu, exported
+ * through /proc/slab_stats.  They live in a cache line that is written
+ * anyway, so they are always enabled.
  */
+struct array_cache_stats {
+	unsigned long alloc_hit;	/* served from the head array */
+	unsigned long alloc_refill;	/* cache_alloc_refill() calls */
+	unsigned long free_hit;		/* freed into the head array */
+	unsigned long free_flush;	/* cache_flusharray() calls */
+	unsigned long remote_free;	/* frees of objects of another node */
+	unsigned long reap_drain;	/* head array drains by cache_reap() */
+};
+
 struct array_cache {
 	unsigned int avail;
 	unsigned int limit;
 	unsigned int batchcount;
 	unsigned int touched;
+	spinlock_t lock;
+	struct array_cache_stats stats;
 };
 
 /* bootstrap: The caches do not work without cpuarrays anymore,
@@ -264,11 +293,11 @@ struct arraycache_init {
 };
 
 /*
- * The slab lists of all objects.
- * Hopefully reduce the internal fragmentation
- * NUMA: The spinlock could be moved from the kmem_cache_t
- * into this structure, too. Figure out what causes
- * fewer cross-node spinlock operations.
+ * The slab lists of all objects, one instance per node.
+ * Hopefully reduce the internal fragmentation.
+ * Each node has its own list_lock, so cpus on different nodes never
+ * contend for the same lock, and every slab on the lists of a node
+ * was allocated for that node (slabp->nodeid).
  */
 struct kmem_list3 {
 	struct list_head	slabs_partial;	/* partial list first, better asm code */
@@ -277,21 +306,73 @@ struct kmem_list3 {
 	unsigned long	free_objects;
 	int		free_touched;
 	unsigned long	next_reap;
-	struct array_cache	*shared;
+	struct array_cache	*shared;	/* shared per node */
+	struct array_cache	**alien;	/* on other nodes */
+	unsigned int	free_limit;	/* upper limit of objects in the lists */
+	spinlock_t	list_lock;
 };
 
-#define LIST3_INIT(parent) \
-	{ \
-		.slabs_full	= LIST_HEAD_INIT(parent.slabs_full), \
-		.slabs_partial	= LIST_HEAD_INIT(parent.slabs_partial), \
-		.slabs_free	= LIST_HEAD_INIT(parent.slabs_free) \
-	}
-#define list3_data(cachep) \
-	(&(cachep)->lists)
+/*
+ * Need this for bootstrapping a per node allocator.
+ */
+#define NUM_INIT_LISTS (2 * MAX_NUMNODES + 1)
+static struct kmem_list3 __initdata initkmem_list3[NUM_INIT_LISTS];
+#define	CACHE_CACHE 0
+#define	SIZE_AC 1
+#define	SIZE_L3 (1 + MAX_NUMNODES)
+
+/*
+ * This function must be completely optimized away if
+ * a constant is passed to it. Mostly the same as
+ * what is in linux/slab.h except it returns an index.
+ */
+static inline int index_of(const size_t size)
+{
+	extern void __bad_size(void);
+
+	if (__builtin_constant_p(size)) {
+		int i = 0;
+
+#define CACHE(x) \
+	if (size <= x) \
+		return i; \
+	else \
+		i++;
+#include <linux/kmalloc_sizes.h>
+#undef CACHE
+		__bad_size();
+	} else
+		__bad_size();
+	return 0;
+}
+
+#define INDEX_AC index_of(sizeof(struct arraycache_init))
+#define INDEX_L3 index_of(sizeof(struct kmem_list3))
+
+static inline void kmem_list3_init(struct kmem_list3 *parent)
+{
+	INIT_LIST_HEAD(&parent->slabs_full);
+	INIT_LIST_HEAD(&parent->slabs_partial);
+	INIT_LIST_HEAD(&parent->slabs_free);
+	parent->shared = NULL;
+	parent->alien = NULL;
+	spin_lock_init(&parent->list_lock);
+	parent->free_objects = 0;
+	parent->free_touched = 0;
+}
+
+#define MAKE_LIST(cachep, listp, slab, nodeid) \
+	do { \
+		INIT_LIST_HEAD(listp); \
+		list_splice(&(cachep->nodelists[nodeid]->slab), listp); \
+	} while (0)
 
-/* NUMA: per-node */
-#define list3_data_ptr(cachep, ptr) \
-		list3_data(cachep)
+#define MAKE_ALL_LISTS(cachep, ptr, nodeid) \
+	do { \
+		MAKE_LIST((cachep), (&(ptr)->slabs_full), slabs_full, nodeid); \
+		MAKE_LIST((cachep), (&(ptr)->slabs_partial), slabs_partial, nodeid); \
+		MAKE_LIST((cachep), (&(ptr)->slabs_free), slabs_free, nodeid); \
+	} while (0)
 
 /*
  * kmem_cache_t
@@ -304,13 +385,12 @@ struct kmem_cache_s {
 	struct array_cache	*array[NR_CPUS];
 	unsigned int		batchcount;
 	unsigned int		limit;
+	unsigned int		shared;
 /* 2) touched by every alloc & free from the backend */
-	struct kmem_list3	lists;
-	/* NUMA: kmem_3list_t	*nodelists[MAX_NUMNODES] */
+	struct kmem_list3	*nodelists[MAX_NUMNODES];
 	unsigned int		objsize;
 	unsigned int	 	flags;	/* constant flags */
 	unsigned int		num;	/* # of objs per slab */
-	unsigned int		free_limit; /* upper limit of objects in the lists */
 	spinlock_t		spinlock;
 
 /* 3) cache_grow/shrink */
@@ -347,11 +427,9 @@ struct kmem_cache_s {
 	unsigned long 		errors;
 	unsigned long		max_freeable;
 	unsigned long		node_allocs;
-	atomic_t		allochit;
-	atomic_t		allocmiss;
-	atomic_t		freehit;
-	atomic_t		freemiss;
 #endif
+	/* event counters of cpus that went offline */
+	struct array_cache_stats	offline_stats;
 #if DEBUG
 	int			dbghead;
 	int			reallen;
@@ -386,11 +464,6 @@ struct kmem_cache_s {
 				do { if ((x)->max_freeable < i) \
 					(x)->max_freeable = i; \
 				} while (0)
-
-#define STATS_INC_ALLOCHIT(x)	atomic_inc(&(x)->allochit)
-#define STATS_INC_ALLOCMISS(x)	atomic_inc(&(x)->allocmiss)
-#define STATS_INC_FREEHIT(x)	atomic_inc(&(x)->freehit)
-#define STATS_INC_FREEMISS(x)	atomic_inc(&(x)->freemiss)
 #else
 #define	STATS_INC_ACTIVE(x)	do { } while (0)
 #define	STATS_DEC_ACTIVE(x)	do { } while (0)
@@ -402,11 +475,6 @@ struct kmem_cache_s {
 #define	STATS_INC_NODEALLOCS(x)	do { } while (0)
 #define	STATS_SET_FREEABLE(x, i) \
 				do { } while (0)
-
-#define STATS_INC_ALLOCHIT(x)	do { } while (0)
-#define STATS_INC_ALLOCMISS(x)	do { } while (0)
-#define STATS_INC_FREEHIT(x)	do { } while (0)
-#define STATS_INC_FREEMISS(x)	do { } while (0)
 #endif
 
 #if DEBUG
@@ -532,9 +600,9 @@ static struct arraycache_init initarray_generic =
 
 /* internal cache of cache description objs */
 static kmem_cache_t cache_cache = {
-	.lists		= LIST3_INIT(cache_cache.lists),
 	.batchcount	= 1,
 	.limit		= BOOT_CPUCACHE_ENTRIES,
+	.shared		= 1,
 	.objsize	= sizeof(kmem_cache_t),
 	.flags		= SLAB_NO_REAP,
 	.spinlock	= SPIN_LOCK_UNLOCKED,
@@ -563,7 +631,8 @@ EXPORT_SYMBOL(slab_reclaim_pages);
  */
 static enum {
 	NONE,
-	PARTIAL,
+	PARTIAL_AC,
+	PARTIAL_L3,
 	FULL
 } g_cpucache_up;
 
@@ -583,6 +652,22 @@ static inline struct array_cache *ac_data(kmem_cache_t *cachep)
 	return cachep->array[smp_processor_id()];
 }
 
+static inline struct kmem_list3 *list3_data(kmem_cache_t *cachep)
+{
+	return cachep->nodelists[numa_node_id()];
+}
+
+static inline void add_array_cache_stats(struct array_cache_stats *sum,
+					struct array_cache_stats *st)
+{
+	sum->alloc_hit += st->alloc_hit;
+	sum->alloc_refill += st->alloc_refill;
+	sum->free_hit += st->free_hit;
+	sum->free_flush += st->free_flush;
+	sum->remote_free += st->remote_free;
+	sum->reap_drain += st->reap_drain;
+}
+
 static inline kmem_cache_t *kmem_find_general_cachep(size_t size, int gfpflags)
 {
 	struct cache_sizes *csizep = malloc_sizes;
@@ -666,51 +751,170 @@ static void __devinit start_cpu_timer(int cpu)
 	}
 }
 
-static struct array_cache *alloc_arraycache(int cpu, int entries,
+static struct array_cache *alloc_arraycache(int node, int entries,
 						int batchcount)
 {
 	int memsize = sizeof(void*)*entries+sizeof(struct array_cache);
-	struct array_cache *nc = NULL;
+	struct array_cache *nc;
 
-	if (cpu != -1) {
-		kmem_cache_t *cachep;
-		cachep = kmem_find_general_cachep(memsize, GFP_KERNEL);
-		if (cachep)
-			nc = kmem_cache_alloc_node(cachep, cpu_to_node(cpu));
-	}
-	if (!nc)
-		nc = kmalloc(memsize, GFP_KERNEL);
+	nc = kmalloc_node(memsize, GFP_KERNEL, node);
 	if (nc) {
 		nc->avail = 0;
 		nc->limit = entries;
 		nc->batchcount = batchcount;
 		nc->touched = 0;
+		spin_lock_init(&nc->lock);
 	}
 	return nc;
 }
 
+#ifdef CONFIG_NUMA
+static void free_alien_cache(struct array_cache **ac_ptr)
+{
+	int i;
+
+	if (!ac_ptr)
+		return;
+	for_each_node(i)
+		kfree(ac_ptr[i]);
+	kfree(ac_ptr);
+}
+
+static struct array_cache **alloc_alien_cache(int node, int limit)
+{
+	struct array_cache **ac_ptr;
+	int memsize = sizeof(void*)*MAX_NUMNODES;
+	int i;
+
+	if (limit > 1)
+		limit = 12;
+	ac_ptr = kmalloc_node(memsize, GFP_KERNEL, node);
+	if (ac_ptr) {
+		memset(ac_ptr, 0, memsize);
+		for_each_node(i) {
+			if (i == node || !node_online(i)) {
+				ac_ptr[i] = NULL;
+				continue;
+			}
+			ac_ptr[i] = alloc_arraycache(node, limit, 0xbaadf00d);
+			if (!ac_ptr[i]) {
+				free_alien_cache(ac_ptr);
+				return NULL;
+			}
+		}
+	}
+	return ac_ptr;
+}
+
+/*
+ * Hand the objects collected in an alien cache back to the node they
+ * came from.  Called with ac->lock held and interrupts disabled.
+ */
+static void __drain_alien_cache(kmem_cache_t *cachep,
+				struct array_cache *ac, int node)
+{
+	struct kmem_list3 *rl3 = cachep->nodelists[node];
+
+	if (ac->avail) {
+		spin_lock(&rl3->list_lock);
+		free_block(cachep, ac_entry(ac), ac->avail);
+		ac->avail = 0;
+		spin_unlock(&rl3->list_lock);
+	}
+}
+
+static void drain_alien_cache(kmem_cache_t *cachep, struct array_cache **alien)
+{
+	int i;
+	struct array_cache *ac;
+	unsigned long flags;
+
+	for_each_online_node(i) {
+		ac = alien[i];
+		if (ac) {
+			spin_lock_irqsave(&ac->lock, flags);
+			__drain_alien_cache(cachep, ac, i);
+			spin_unlock_irqrestore(&ac->lock, flags);
+		}
+	}
+}
+#else
+#define free_alien_cache(ac_ptr)		do { } while (0)
+#define drain_alien_cache(cachep, alien)	do { } while (0)
+#endif
+
 static int __devinit cpuup_callback(struct notifier_block *nfb,
 				  unsigned long action, void *hcpu)
 {
 	long cpu = (long)hcpu;
+	int node = cpu_to_node(cpu);
 	kmem_cache_t* cachep;
+	struct kmem_list3 *l3;
+	struct array_cache *nc;
 
 	switch (action) {
 	case CPU_UP_PREPARE:
 		down(&cache_chain_sem);
+		/*
+		 * Set up the kmem_list3 of the node first: the allocations
+		 * of the arrays below go through kmalloc_node(), which
+		 * needs the kmem_list3 of the target node.
+		 * Another cpu of the same node may have done it already.
+		 */
 		list_for_each_entry(cachep, &cache_chain, next) {
-			struct array_cache *nc;
+			if (!cachep->nodelists[node]) {
+				l3 = kmalloc_node(sizeof(struct kmem_list3),
+							GFP_KERNEL, node);
+				if (!l3)
+					goto bad;
+				kmem_list3_init(l3);
+				l3->next_reap = jiffies + REAPTIMEOUT_LIST3 +
+				    ((unsigned long)cachep)%REAPTIMEOUT_LIST3;
+				cachep->nodelists[node] = l3;
+			}
 
-			nc = alloc_arraycache(cpu, cachep->limit, cachep->batchcount);
+			l3 = cachep->nodelists[node];
+			spin_lock_irq(&l3->list_lock);
+			l3->free_limit = (1 + nr_cpus_node(node)) *
+					cachep->batchcount + cachep->num;
+			spin_unlock_irq(&l3->list_lock);
+		}
+
+		/* Now the head array, and the shared and alien arrays */
+		list_for_each_entry(cachep, &cache_chain, next) {
+			nc = alloc_arraycache(node, cachep->limit,
+						cachep->batchcount);
 			if (!nc)
 				goto bad;
 
+			l3 = cachep->nodelists[node];
+			if (!l3->shared) {
+				struct array_cache *shared;
+
+				shared = alloc_arraycache(node,
+					cachep->shared*cachep->batchcount,
+					0xbaadf00d);
+				if (!shared) {
+					kfree(nc);
+					goto bad;
+				}
+				/* serialised against CPU_DEAD by
+				 * cache_chain_sem */
+				l3->shared = shared;
+			}
+#ifdef CONFIG_NUMA
+			if (!l3->alien) {
+				l3->alien = alloc_alien_cache(node,
+							cachep->limit);
+				if (!l3->alien) {
+					kfree(nc);
+					goto bad;
+				}
+			}
+#endif
 			spin_lock_irq(&cachep->spinlock);
 			cachep->array[cpu] = nc;
-			cachep->free_limit = (1+num_online_cpus())*cachep->batchcount
-						+ cachep->num;
 			spin_unlock_irq(&cachep->spinlock);
-
 		}
 		up(&cache_chain_sem);
 		break;
@@ -724,16 +928,51 @@ static int __devinit cpuup_callback(struct notifier_block *nfb,
 		down(&cache_chain_sem);
 
 		list_for_each_entry(cachep, &cache_chain, next) {
-			struct array_cache *nc;
+			struct array_cache *shared = NULL;
+			struct array_cache **alien = NULL;
+			cpumask_t mask;
+
+			cpus_and(mask, node_to_cpumask(node), cpu_online_map);
 
 			spin_lock_irq(&cachep->spinlock);
 			/* cpu is dead; no one can alloc from it. */
 			nc = cachep->array[cpu];
 			cachep->array[cpu] = NULL;
-			cachep->free_limit -= cachep->batchcount;
-			free_block(cachep, ac_entry(nc), nc->avail);
+			if (nc)
+				add_array_cache_stats(&cachep->offline_stats,
+							&nc->stats);
+			l3 = cachep->nodelists[node];
+			if (!l3)
+				goto unlock_cache;
+
+			spin_lock(&l3->list_lock);
+			l3->free_limit -= cachep->batchcount;
+			if (nc)
+				free_block(cachep, ac_entry(nc), nc->avail);
+
+			/*
+			 * The last cpu of the node is gone: nobody uses the
+			 * shared and alien arrays of the node anymore.  The
+			 * kmem_list3 itself stays, the node's slabs are still
+			 * referenced by objects in use.
+			 */
+			if (cpus_empty(mask)) {
+				shared = l3->shared;
+				l3->shared = NULL;
+				if (shared)
+					free_block(cachep, ac_entry(shared),
+							shared->avail);
+				alien = l3->alien;
+				l3->alien = NULL;
+			}
+			spin_unlock(&l3->list_lock);
+			if (alien)
+				drain_alien_cache(cachep, alien);
+unlock_cache:
 			spin_unlock_irq(&cachep->spinlock);
 			kfree(nc);
+			kfree(shared);
+			free_alien_cache(alien);
 		}
 		up(&cache_chain_sem);
 		break;
@@ -744,9 +983,43 @@ bad:
 	up(&cache_chain_sem);
 	return NOTIFY_BAD;
 }
-
 static struct notifier_block cpucache_notifier = { &cpuup_callback, NULL, 0 };
 
+/*
+ * swap the static kmem_list3 with kmalloced memory
+ */
+static void init_list(kmem_cache_t *cachep, struct kmem_list3 *list,
+		int nodeid)
+{
+	struct kmem_list3 *ptr;
+
+	BUG_ON(cachep->nodelists[nodeid] != list);
+	ptr = kmalloc_node(sizeof(struct kmem_list3), GFP_KERNEL, nodeid);
+	BUG_ON(!ptr);
+
+	local_irq_disable();
+	memcpy(ptr, list, sizeof(struct kmem_list3));
+	MAKE_ALL_LISTS(cachep, ptr, nodeid);
+	cachep->nodelists[nodeid] = ptr;
+	local_irq_enable();
+}
+
+/*
+ * Hand a static bootstrap kmem_list3 to each online node of a cache
+ * that is created before kmalloc_node() of a kmem_list3 works.
+ */
+static void __init set_up_list3s(kmem_cache_t *cachep, int index)
+{
+	int node;
+
+	for_each_online_node(node) {
+		cachep->nodelists[node] = &initkmem_list3[index+node];
+		cachep->nodelists[node]->next_reap = jiffies +
+			REAPTIMEOUT_LIST3 +
+			((unsigned long)cachep)%REAPTIMEOUT_LIST3;
+	}
+}
+
 /* Initialisation.
  * Called after the gfp() functions have been enabled, and before smp_init().
  */
@@ -755,6 +1028,10 @@ void __init kmem_cache_init(void)
 	size_t left_over;
 	struct cache_sizes *sizes;
 	struct cache_names *names;
+	int i;
+
+	for (i = 0; i < NUM_INIT_LISTS; i++)
+		kmem_list3_init(&initkmem_list3[i]);
 
 	/*
 	 * Fragmentation resistance on low memory - only use bigger
@@ -769,15 +1046,19 @@ void __init kmem_cache_init(void)
 	 * 1) initialize the cache_cache cache: it contains the kmem_cache_t
 	 *    structures of all caches, except cache_cache itself: cache_cache
 	 *    is statically allocated.
-	 *    Initially an __init data area is used for the head array, it's
-	 *    replaced with a kmalloc allocated array at the end of the bootstrap.
+	 *    Initially an __init data area is used for the head array and the
+	 *    kmem_list3 structures, it's replaced with a kmalloc allocated
+	 *    array at the end of the bootstrap.
 	 * 2) Create the first kmalloc cache.
-	 *    The kmem_cache_t for the new cache is allocated normally. An __init
-	 *    data area is used for the head array.
-	 * 3) Create the remaining kmalloc caches, with minimally sized head arrays.
+	 *    The kmem_cache_t for the new cache is allocated normally.
+	 *    An __init data area is used for the head array.
+	 * 3) Create the remaining kmalloc caches, with minimally sized
+	 *    head arrays.
 	 * 4) Replace the __init data head arrays for cache_cache and the first
 	 *    kmalloc cache with kmalloc allocated arrays.
-	 * 5) Resize the head arrays of the kmalloc caches to their final sizes.
+	 * 5) Replace the __init data for kmem_list3 for cache_cache and
+	 *    the other cache's with kmalloc allocated memory.
+	 * 6) Resize the head arrays of the kmalloc caches to their final sizes.
 	 */
 
 	/* 1) create the cache_cache */
@@ -786,6 +1067,7 @@ void __init kmem_cache_init(void)
 	list_add(&cache_cache.next, &cache_chain);
 	cache_cache.colour_off = cache_line_size();
 	cache_cache.array[smp_processor_id()] = &initarray_cache.cache;
+	cache_cache.nodelists[numa_node_id()] = &initkmem_list3[CACHE_CACHE];
 
 	cache_cache.objsize = ALIGN(cache_cache.objsize, cache_line_size());
 
@@ -803,15 +1085,30 @@ void __init kmem_cache_init(void)
 	sizes = malloc_sizes;
 	names = cache_names;
 
+	/* Initialize the caches that provide memory for the array cache
+	 * and the kmem_list3 structures first.
+	 * Without this, further allocations will bug
+	 */
+	sizes[INDEX_AC].cs_cachep = kmem_cache_create(names[INDEX_AC].name,
+		sizes[INDEX_AC].cs_size, ARCH_KMALLOC_MINALIGN,
+		(ARCH_KMALLOC_FLAGS | SLAB_PANIC), NULL, NULL);
+
+	if (INDEX_AC != INDEX_L3)
+		sizes[INDEX_L3].cs_cachep =
+			kmem_cache_create(names[INDEX_L3].name,
+				sizes[INDEX_L3].cs_size, ARCH_KMALLOC_MINALIGN,
+				(ARCH_KMALLOC_FLAGS | SLAB_PANIC), NULL, NULL);
+
 	while (sizes->cs_size != ULONG_MAX) {
 		/* For performance, all the general caches are L1 aligned.
 		 * This should be particularly beneficial on SMP boxes, as it
 		 * eliminates "false sharing".
 		 * Note for systems short on memory removing the alignment will
 		 * allow tighter packing of the smaller caches. */
-		sizes->cs_cachep = kmem_cache_create(names->name,
-			sizes->cs_size, ARCH_KMALLOC_MINALIGN,
-			(ARCH_KMALLOC_FLAGS | SLAB_PANIC), NULL, NULL);
+		if (!sizes->cs_cachep)
+			sizes->cs_cachep = kmem_cache_create(names->name,
+				sizes->cs_size, ARCH_KMALLOC_MINALIGN,
+				(ARCH_KMALLOC_FLAGS | SLAB_PANIC), NULL, NULL);
 
 		/* Inc off-slab bufctl limit until the ceiling is hit. */
 		if (!(OFF_SLAB(sizes->cs_cachep))) {
@@ -840,14 +1137,33 @@ void __init kmem_cache_init(void)
 	
 		ptr = kmalloc(sizeof(struct arraycache_init), GFP_KERNEL);
 		local_irq_disable();
-		BUG_ON(ac_data(malloc_sizes[0].cs_cachep) != &initarray_generic.cache);
-		memcpy(ptr, ac_data(malloc_sizes[0].cs_cachep),
+		BUG_ON(ac_data(malloc_sizes[INDEX_AC].cs_cachep) !=
+				&initarray_generic.cache);
+		memcpy(ptr, ac_data(malloc_sizes[INDEX_AC].cs_cachep),
 				sizeof(struct arraycache_init));
-		malloc_sizes[0].cs_cachep->array[smp_processor_id()] = ptr;
+		malloc_sizes[INDEX_AC].cs_cachep->array[smp_processor_id()] =
+				ptr;
 		local_irq_enable();
 	}
 
-	/* 5) resize the head arrays to their final sizes */
+	/* 5) Replace the bootstrap kmem_list3's */
+	{
+		int node;
+
+		init_list(&cache_cache, &initkmem_list3[CACHE_CACHE],
+				numa_node_id());
+
+		for_each_online_node(node) {
+			init_list(malloc_sizes[INDEX_AC].cs_cachep,
+					&initkmem_list3[SIZE_AC+node], node);
+
+			if (INDEX_AC != INDEX_L3)
+				init_list(malloc_sizes[INDEX_L3].cs_cachep,
+					&initkmem_list3[SIZE_L3+node], node);
+		}
+	}
+
+	/* 6) resize the head arrays to their final sizes */
 	{
 		kmem_cache_t *cachep;
 		down(&cache_chain_sem);
@@ -1415,10 +1731,6 @@ next:
 		cachep->gfpflags |= GFP_DMA;
 	spin_lock_init(&cachep->spinlock);
 	cachep->objsize = size;
-	/* NUMA */
-	INIT_LIST_HEAD(&cachep->lists.slabs_full);
-	INIT_LIST_HEAD(&cachep->lists.slabs_partial);
-	INIT_LIST_HEAD(&cachep->lists.slabs_free);
 
 	if (flags & CFLGS_OFF_SLAB)
 		cachep->slabp_cache = kmem_find_general_cachep(slab_size,0);
@@ -1438,9 +1750,37 @@ next:
 			 * the creation of further caches will BUG().
 			 */
 			cachep->array[smp_processor_id()] = &initarray_generic.cache;
-			g_cpucache_up = PARTIAL;
+
+			/* If the cache that's used by
+			 * kmalloc(sizeof(kmem_list3)) is the first cache,
+			 * then we need to set up all its list3s, otherwise
+			 * the creation of further caches will BUG().
+			 */
+			set_up_list3s(cachep, SIZE_AC);
+			if (INDEX_AC == INDEX_L3)
+				g_cpucache_up = PARTIAL_L3;
+			else
+				g_cpucache_up = PARTIAL_AC;
 		} else {
 			cachep->array[smp_processor_id()] = kmalloc(sizeof(struct arraycache_init),GFP_KERNEL);
+
+			if (g_cpucache_up == PARTIAL_AC) {
+				set_up_list3s(cachep, SIZE_L3);
+				g_cpucache_up = PARTIAL_L3;
+			} else {
+				int node;
+
+				for_each_online_node(node) {
+					cachep->nodelists[node] =
+						kmalloc_node(sizeof(struct kmem_list3),
+							GFP_KERNEL, node);
+					BUG_ON(!cachep->nodelists[node]);
+					kmem_list3_init(cachep->nodelists[node]);
+					cachep->nodelists[node]->next_reap =
+						jiffies + REAPTIMEOUT_LIST3 +
+						((unsigned long)cachep)%REAPTIMEOUT_LIST3;
+				}
+			}
 		}
 		BUG_ON(!ac_data(cachep));
 		ac_data(cachep)->avail = 0;
@@ -1449,12 +1789,16 @@ next:
 		ac_data(cachep)->touched = 0;
 		cachep->batchcount = 1;
 		cachep->limit = BOOT_CPUCACHE_ENTRIES;
-		cachep->free_limit = (1+num_online_cpus())*cachep->batchcount
-					+ cachep->num;
-	} 
-
-	cachep->lists.next_reap = jiffies + REAPTIMEOUT_LIST3 +
-					((unsigned long)cachep)%REAPTIMEOUT_LIST3;
+		cachep->shared = 1;
+		{
+			int node;
+
+			for_each_online_node(node)
+				cachep->nodelists[node]->free_limit =
+					(1 + nr_cpus_node(node)) *
+					cachep->batchcount + cachep->num;
+		}
+	}
 
 	/* Need the semaphore to access the chain. */
 	down(&cache_chain_sem);
@@ -1512,13 +1856,22 @@ static void check_spinlock_acquired(kmem_cache_t *cachep)
 {
 #ifdef CONFIG_SMP
 	check_irq_off();
-	BUG_ON(spin_trylock(&cachep->spinlock));
+	BUG_ON(spin_trylock(&list3_data(cachep)->list_lock));
+#endif
+}
+
+static void check_spinlock_acquired_node(kmem_cache_t *cachep, int node)
+{
+#ifdef CONFIG_SMP
+	check_irq_off();
+	BUG_ON(spin_trylock(&cachep->nodelists[node]->list_lock));
 #endif
 }
 #else
 #define check_irq_off()	do { } while(0)
 #define check_irq_on()	do { } while(0)
 #define check_spinlock_acquired(x) do { } while(0)
+#define check_spinlock_acquired_node(x, y) do { } while(0)
 #endif
 
 /*
@@ -1539,66 +1892,95 @@ static void smp_call_function_all_cpus(void (*func) (void *arg), void *arg)
 	preempt_enable();
 }
 
-static void drain_array_locked(kmem_cache_t* cachep,
-				struct array_cache *ac, int force);
+static int drain_array_locked(kmem_cache_t* cachep,
+				struct array_cache *ac, int force, int node);
 
 static void do_drain(void *arg)
 {
 	kmem_cache_t *cachep = (kmem_cache_t*)arg;
 	struct array_cache *ac;
+	struct kmem_list3 *l3;
 
 	check_irq_off();
 	ac = ac_data(cachep);
-	spin_lock(&cachep->spinlock);
+	l3 = list3_data(cachep);
+	spin_lock(&l3->list_lock);
 	free_block(cachep, &ac_entry(ac)[0], ac->avail);
-	spin_unlock(&cachep->spinlock);
+	spin_unlock(&l3->list_lock);
 	ac->avail = 0;
 }
 
 static void drain_cpu_caches(kmem_cache_t *cachep)
 {
+	struct kmem_list3 *l3;
+	int node;
+
 	smp_call_function_all_cpus(do_drain, cachep);
 	check_irq_on();
 	spin_lock_irq(&cachep->spinlock);
-	if (cachep->lists.shared)
-		drain_array_locked(cachep, cachep->lists.shared, 1);
+	for_each_online_node(node) {
+		l3 = cachep->nodelists[node];
+		if (!l3)
+			continue;
+		spin_lock(&l3->list_lock);
+		if (l3->shared)
+			drain_array_locked(cachep, l3->shared, 1, node);
+		spin_unlock(&l3->list_lock);
+		if (l3->alien)
+			drain_alien_cache(cachep, l3->alien);
+	}
 	spin_unlock_irq(&cachep->spinlock);
 }
 
-
-/* NUMA shrink all list3s */
-static int __cache_shrink(kmem_cache_t *cachep)
+/*
+ * Release the free slabs of one node.
+ * Called with l3->list_lock held and interrupts disabled.
+ */
+static int __node_shrink(kmem_cache_t *cachep, int node)
 {
 	struct slab *slabp;
-	int ret;
-
-	drain_cpu_caches(cachep);
-
-	check_irq_on();
-	spin_lock_irq(&cachep->spinlock);
+	struct kmem_list3 *l3 = cachep->nodelists[node];
 
 	for(;;) {
 		struct list_head *p;
 
-		p = cachep->lists.slabs_free.prev;
-		if (p == &cachep->lists.slabs_free)
+		p = l3->slabs_free.prev;
+		if (p == &l3->slabs_free)
 			break;
 
-		slabp = list_entry(cachep->lists.slabs_free.prev, struct slab, list);
+		slabp = list_entry(l3->slabs_free.prev, struct slab, list);
 #if DEBUG
 		if (slabp->inuse)
 			BUG();
 #endif
 		list_del(&slabp->list);
 
-		cachep->lists.free_objects -= cachep->num;
-		spin_unlock_irq(&cachep->spinlock);
+		l3->free_objects -= cachep->num;
+		spin_unlock_irq(&l3->list_lock);
 		slab_destroy(cachep, slabp);
-		spin_lock_irq(&cachep->spinlock);
+		spin_lock_irq(&l3->list_lock);
+	}
+	return !list_empty(&l3->slabs_full) ||
+		!list_empty(&l3->slabs_partial);
+}
+
+static int __cache_shrink(kmem_cache_t *cachep)
+{
+	struct kmem_list3 *l3;
+	int ret = 0;
+	int node;
+
+	drain_cpu_caches(cachep);
+
+	check_irq_on();
+	for_each_online_node(node) {
+		l3 = cachep->nodelists[node];
+		if (!l3)
+			continue;
+		spin_lock_irq(&l3->list_lock);
+		ret |= __node_shrink(cachep, node);
+		spin_unlock_irq(&l3->list_lock);
 	}
-	ret = !list_empty(&cachep->lists.slabs_full) ||
-		!list_empty(&cachep->lists.slabs_partial);
-	spin_unlock_irq(&cachep->spinlock);
 	return ret;
 }
 
@@ -1671,9 +2053,16 @@ int kmem_cache_destroy(kmem_cache_t * cachep)
 	for (i = 0; i < NR_CPUS; i++)
 		kfree(cachep->array[i]);
 
-	/* NUMA: free the list3 structures */
-	kfree(cachep->lists.shared);
-	cachep->lists.shared = NULL;
+	/* free the list3 structures */
+	for_each_node(i) {
+		struct kmem_list3 *l3 = cachep->nodelists[i];
+
+		if (l3) {
+			kfree(l3->shared);
+			free_alien_cache(l3->alien);
+			kfree(l3);
+		}
+	}
 	kmem_cache_free(&cache_cache, cachep);
 
 	unlock_cpu_hotplug();
@@ -1683,8 +2072,9 @@ int kmem_cache_destroy(kmem_cache_t * cachep)
 EXPORT_SYMBOL(kmem_cache_destroy);
 
 /* Get the memory for a slab management obj. */
-static struct slab* alloc_slabmgmt(kmem_cache_t *cachep,
-			void *objp, int colour_off, unsigned int __nocast local_flags)
+static struct slab* alloc_slabmgmt(kmem_cache_t *cachep, void *objp,
+			int colour_off, unsigned int __nocast local_flags,
+			int nodeid)
 {
 	struct slab *slabp;
 	
@@ -1700,6 +2090,7 @@ static struct slab* alloc_slabmgmt(kmem_cache_t *cachep,
 	slabp->inuse = 0;
 	slabp->colouroff = colour_off;
 	slabp->s_mem = objp+colour_off;
+	slabp->nodeid = nodeid;
 
 	return slabp;
 }
@@ -1784,9 +2175,11 @@ static void set_slab_attr(kmem_cache_t *cachep, struct slab *slabp, void *objp)
 /*
  * Grow (by 1) the number of slabs within a cache.  This is called by
  * kmem_cache_alloc() when there are no active objs left in a cache.
+ * The new slab is put on the lists of node nodeid.
  */
 static int cache_grow(kmem_cache_t *cachep, unsigned int __nocast flags, int nodeid)
 {
+	struct kmem_list3 *l3 = cachep->nodelists[nodeid];
 	struct slab	*slabp;
 	void		*objp;
 	size_t		 offset;
@@ -1840,7 +2233,8 @@ static int cache_grow(kmem_cache_t *cachep, unsigned int __nocast flags, int nod
 		goto failed;
 
 	/* Get slab management. */
-	if (!(slabp = alloc_slabmgmt(cachep, objp, offset, local_flags)))
+	if (!(slabp = alloc_slabmgmt(cachep, objp, offset, local_flags,
+					nodeid)))
 		goto opps1;
 
 	set_slab_attr(cachep, slabp, objp);
@@ -1850,13 +2244,13 @@ static int cache_grow(kmem_cache_t *cachep, unsigned int __nocast flags, int nod
 	if (local_flags & __GFP_WAIT)
 		local_irq_disable();
 	check_irq_off();
-	spin_lock(&cachep->spinlock);
+	spin_lock(&l3->list_lock);
 
 	/* Make slab active. */
-	list_add_tail(&slabp->list, &(list3_data(cachep)->slabs_free));
+	list_add_tail(&slabp->list, &(l3->slabs_free));
 	STATS_INC_GROWN(cachep);
-	list3_data(cachep)->free_objects += cachep->num;
-	spin_unlock(&cachep->spinlock);
+	l3->free_objects += cachep->num;
+	spin_unlock(&l3->list_lock);
 	return 1;
 opps1:
 	kmem_freepages(cachep, objp);
@@ -1962,7 +2356,6 @@ static void check_slabp(kmem_cache_t *cachep, struct slab *slabp)
 	kmem_bufctl_t i;
 	int entries = 0;
 	
-	check_spinlock_acquired(cachep);
 	/* Check slab's freelist to see if this obj is there. */
 	for (i = slabp->free; i != BUFCTL_END; i = slab_bufctl(slabp)[i]) {
 		entries++;
@@ -2008,7 +2401,7 @@ retry:
 	l3 = list3_data(cachep);
 
 	BUG_ON(ac->avail > 0);
-	spin_lock(&cachep->spinlock);
+	spin_lock(&l3->list_lock);
 	if (l3->shared) {
 		struct array_cache *shared_array = l3->shared;
 		if (shared_array->avail) {
@@ -2066,11 +2459,11 @@ retry:
 must_grow:
 	l3->free_objects -= ac->avail;
 alloc_done:
-	spin_unlock(&cachep->spinlock);
+	spin_unlock(&l3->list_lock);
 
 	if (unlikely(!ac->avail)) {
 		int x;
-		x = cache_grow(cachep, flags, -1);
+		x = cache_grow(cachep, flags, numa_node_id());
 		
 		// cache_grow can reenable interrupts, then ac could change.
 		ac = ac_data(cachep);
@@ -2140,42 +2533,140 @@ cache_alloc_debugcheck_after(kmem_cache_t *cachep,
 #endif
 
 
-static inline void *__cache_alloc(kmem_cache_t *cachep, unsigned int __nocast flags)
+static inline void *____cache_alloc(kmem_cache_t *cachep, unsigned int __nocast flags)
 {
-	unsigned long save_flags;
 	void* objp;
 	struct array_cache *ac;
 
-	cache_alloc_debugcheck_before(cachep, flags);
-
-	local_irq_save(save_flags);
+	check_irq_off();
 	ac = ac_data(cachep);
 	if (likely(ac->avail)) {
-		STATS_INC_ALLOCHIT(cachep);
+		ac->stats.alloc_hit++;
 		ac->touched = 1;
 		objp = ac_entry(ac)[--ac->avail];
 	} else {
-		STATS_INC_ALLOCMISS(cachep);
+		ac->stats.alloc_refill++;
 		objp = cache_alloc_refill(cachep, flags);
 	}
+	return objp;
+}
+
+#ifdef CONFIG_NUMA
+static void *alternate_node_alloc(kmem_cache_t *, unsigned int __nocast);
+#endif
+
+static inline void *__cache_alloc(kmem_cache_t *cachep, unsigned int __nocast flags)
+{
+	unsigned long save_flags;
+	void* objp = NULL;
+
+	cache_alloc_debugcheck_before(cachep, flags);
+
+	local_irq_save(save_flags);
+#ifdef CONFIG_NUMA
+	if (unlikely(cachep->flags & SLAB_MEM_SPREAD))
+		objp = alternate_node_alloc(cachep, flags);
+#endif
+	if (!objp)
+		objp = ____cache_alloc(cachep, flags);
 	local_irq_restore(save_flags);
 	objp = cache_alloc_debugcheck_after(cachep, flags, objp, __builtin_return_address(0));
 	return objp;
 }
 
-/* 
- * NUMA: different approach needed if the spinlock is moved into
- * the l3 structure
+#ifdef CONFIG_NUMA
+/*
+ * Allocate an object from the lists of another node, bypassing the
+ * per-cpu array: that one only holds objects of the local node.
+ * Called with interrupts disabled.
+ */
+static void *__cache_alloc_node(kmem_cache_t *cachep, unsigned int __nocast flags, int nodeid)
+{
+	struct list_head *entry;
+	struct slab *slabp;
+	struct kmem_list3 *l3;
+	void *obj;
+	kmem_bufctl_t next;
+	int x;
+
+	l3 = cachep->nodelists[nodeid];
+	BUG_ON(!l3);
+
+retry:
+	spin_lock(&l3->list_lock);
+	entry = l3->slabs_partial.next;
+	if (entry == &l3->slabs_partial) {
+		l3->free_touched = 1;
+		entry = l3->slabs_free.next;
+		if (entry == &l3->slabs_free)
+			goto must_grow;
+	}
+
+	slabp = list_entry(entry, struct slab, list);
+	check_spinlock_acquired_node(cachep, nodeid);
+	check_slabp(cachep, slabp);
+
+	STATS_INC_NODEALLOCS(cachep);
+	STATS_INC_ACTIVE(cachep);
+	STATS_SET_HIGH(cachep);
+
+	BUG_ON(slabp->inuse == cachep->num);
+
+	/* get obj pointer */
+	obj = slabp->s_mem + slabp->free*cachep->objsize;
+	slabp->inuse++;
+	next = slab_bufctl(slabp)[slabp->free];
+#if DEBUG
+	slab_bufctl(slabp)[slabp->free] = BUFCTL_FREE;
+#endif
+	slabp->free = next;
+	check_slabp(cachep, slabp);
+	l3->free_objects--;
+
+	/* move slabp to correct slabp list: */
+	list_del(&slabp->list);
+	if (slabp->free == BUFCTL_END)
+		list_add(&slabp->list, &l3->slabs_full);
+	else
+		list_add(&slabp->list, &l3->slabs_partial);
+
+	spin_unlock(&l3->list_lock);
+	return obj;
+
+must_grow:
+	spin_unlock(&l3->list_lock);
+	x = cache_grow(cachep, flags, nodeid);
+	if (!x)
+		return NULL;
+	goto retry;
+}
+
+/*
+ * Objects of SLAB_MEM_SPREAD caches go round the nodes of the cpuset
+ * of a task which asks for that; NULL to take the local fast path.
+ * Called with interrupts disabled.
  */
+static void *alternate_node_alloc(kmem_cache_t *cachep, unsigned int __nocast flags)
+{
+	int nid;
+
+	if (in_interrupt() || !cpuset_do_slab_mem_spread())
+		return NULL;
+	nid = cpuset_mem_spread_node();
+	if (nid == numa_node_id() || !cachep->nodelists[nid])
+		return NULL;
+	return __cache_alloc_node(cachep, flags, nid);
+}
+#endif
 
+/*
+ * Return objects to their slabs.  All objects must belong to the same
+ * node, the caller holds the list_lock of that node.
+ */
 static void free_block(kmem_cache_t *cachep, void **objpp, int nr_objects)
 {
 	int i;
-
-	check_spinlock_acquired(cachep);
-
-	/* NUMA: move add into loop */
-	cachep->lists.free_objects += nr_objects;
+	struct kmem_list3 *l3;
 
 	for (i = 0; i < nr_objects; i++) {
 		void *objp = objpp[i];
@@ -2183,6 +2674,8 @@ static void free_block(kmem_cache_t *cachep, void **objpp, int nr_objects)
 		unsigned int objnr;
 
 		slabp = GET_PAGE_SLAB(virt_to_page(objp));
+		l3 = cachep->nodelists[slabp->nodeid];
+		check_spinlock_acquired_node(cachep, slabp->nodeid);
 		list_del(&slabp->list);
 		objnr = (objp - slabp->s_mem) / cachep->objsize;
 		check_slabp(cachep, slabp);
@@ -2197,24 +2690,23 @@ static void free_block(kmem_cache_t *cachep, void **objpp, int nr_objects)
 		slabp->free = objnr;
 		STATS_DEC_ACTIVE(cachep);
 		slabp->inuse--;
+		l3->free_objects++;
 		check_slabp(cachep, slabp);
 
 		/* fixup slab chains */
 		if (slabp->inuse == 0) {
-			if (cachep->lists.free_objects > cachep->free_limit) {
-				cachep->lists.free_objects -= cachep->num;
+			if (l3->free_objects > l3->free_limit) {
+				l3->free_objects -= cachep->num;
 				slab_destroy(cachep, slabp);
 			} else {
-				list_add(&slabp->list,
-				&list3_data_ptr(cachep, objp)->slabs_free);
+				list_add(&slabp->list, &l3->slabs_free);
 			}
 		} else {
 			/* Unconditionally move a slab to the end of the
 			 * partial list on free - maximum time for the
 			 * other objects to be freed, too.
 			 */
-			list_add_tail(&slabp->list,
-				&list3_data_ptr(cachep, objp)->slabs_partial);
+			list_add_tail(&slabp->list, &l3->slabs_partial);
 		}
 	}
 }
@@ -2222,15 +2714,17 @@ static void free_block(kmem_cache_t *cachep, void **objpp, int nr_objects)
 static void cache_flusharray(kmem_cache_t *cachep, struct array_cache *ac)
 {
 	int batchcount;
+	struct kmem_list3 *l3;
 
 	batchcount = ac->batchcount;
 #if DEBUG
 	BUG_ON(!batchcount || batchcount > ac->avail);
 #endif
 	check_irq_off();
-	spin_lock(&cachep->spinlock);
-	if (cachep->lists.shared) {
-		struct array_cache *shared_array = cachep->lists.shared;
+	l3 = list3_data(cachep);
+	spin_lock(&l3->list_lock);
+	if (l3->shared) {
+		struct array_cache *shared_array = l3->shared;
 		int max = shared_array->limit-shared_array->avail;
 		if (max) {
 			if (batchcount > max)
@@ -2250,8 +2744,8 @@ free_done:
 		int i = 0;
 		struct list_head *p;
 
-		p = list3_data(cachep)->slabs_free.next;
-		while (p != &(list3_data(cachep)->slabs_free)) {
+		p = l3->slabs_free.next;
+		while (p != &(l3->slabs_free)) {
 			struct slab *slabp;
 
 			slabp = list_entry(p, struct slab, list);
@@ -2263,7 +2757,7 @@ free_done:
 		STATS_SET_FREEABLE(cachep, i);
 	}
 #endif
-	spin_unlock(&cachep->spinlock);
+	spin_unlock(&l3->list_lock);
 	ac->avail -= batchcount;
 	memmove(&ac_entry(ac)[0], &ac_entry(ac)[batchcount],
 			sizeof(void*)*ac->avail);
@@ -2283,12 +2777,45 @@ static inline void __cache_free(kmem_cache_t *cachep, void *objp)
 	check_irq_off();
 	objp = cache_free_debugcheck(cachep, objp, __builtin_return_address(0));
 
+#ifdef CONFIG_NUMA
+	/* Make sure we are not freeing an object from another
+	 * node to the array cache on this cpu.
+	 */
+	{
+		struct slab *slabp;
+
+		slabp = GET_PAGE_SLAB(virt_to_page(objp));
+		if (unlikely(slabp->nodeid != numa_node_id())) {
+			struct array_cache *alien = NULL;
+			int nodeid = slabp->nodeid;
+			struct kmem_list3 *l3 = list3_data(cachep);
+
+			ac->stats.remote_free++;
+			if (l3->alien && l3->alien[nodeid]) {
+				alien = l3->alien[nodeid];
+				spin_lock(&alien->lock);
+				if (unlikely(alien->avail == alien->limit))
+					__drain_alien_cache(cachep,
+							alien, nodeid);
+				ac_entry(alien)[alien->avail++] = objp;
+				spin_unlock(&alien->lock);
+			} else {
+				spin_lock(&(cachep->nodelists[nodeid])->
+						list_lock);
+				free_block(cachep, &objp, 1);
+				spin_unlock(&(cachep->nodelists[nodeid])->
+						list_lock);
+			}
+			return;
+		}
+	}
+#endif
 	if (likely(ac->avail < ac->limit)) {
-		STATS_INC_FREEHIT(cachep);
+		ac->stats.free_hit++;
 		ac_entry(ac)[ac->avail++] = objp;
 		return;
 	} else {
-		STATS_INC_FREEMISS(cachep);
+		ac->stats.free_flush++;
 		cache_flusharray(cachep, ac);
 		ac_entry(ac)[ac->avail++] = objp;
 	}
@@ -2357,84 +2884,46 @@ out:
  * @flags: See kmalloc().
  * @nodeid: node number of the target node.
  *
- * Identical to kmem_cache_alloc, except that this function is slow
- * and can sleep. And it will allocate memory on the given node, which
- * can improve the performance for cpu bound structures.
+ * Identical to kmem_cache_alloc, except that this function will
+ * allocate memory on the given node, which can improve the performance
+ * for cpu bound structures.  Allocations for the local node, or with a
+ * nodeid of -1, take the per-cpu fast path of kmem_cache_alloc.
  */
-void *kmem_cache_alloc_node(kmem_cache_t *cachep, int nodeid)
+void *kmem_cache_alloc_node(kmem_cache_t *cachep, unsigned int __nocast flags, int nodeid)
 {
-	int loop;
-	void *objp;
-	struct slab *slabp;
-	kmem_bufctl_t next;
-
-	for (loop = 0;;loop++) {
-		struct list_head *q;
-
-		objp = NULL;
-		check_irq_on();
-		spin_lock_irq(&cachep->spinlock);
-		/* walk through all partial and empty slab and find one
-		 * from the right node */
-		list_for_each(q,&cachep->lists.slabs_partial) {
-			slabp = list_entry(q, struct slab, list);
-
-			if (page_to_nid(virt_to_page(slabp->s_mem)) == nodeid ||
-					loop > 2)
-				goto got_slabp;
-		}
-		list_for_each(q, &cachep->lists.slabs_free) {
-			slabp = list_entry(q, struct slab, list);
-
-			if (page_to_nid(virt_to_page(slabp->s_mem)) == nodeid ||
-					loop > 2)
-				goto got_slabp;
-		}
-		spin_unlock_irq(&cachep->spinlock);
-
-		local_irq_disable();
-		if (!cache_grow(cachep, GFP_KERNEL, nodeid)) {
-			local_irq_enable();
-			return NULL;
-		}
-		local_irq_enable();
-	}
-got_slabp:
-	/* found one: allocate object */
-	check_slabp(cachep, slabp);
-	check_spinlock_acquired(cachep);
-
-	STATS_INC_ALLOCED(cachep);
-	STATS_INC_ACTIVE(cachep);
-	STATS_SET_HIGH(cachep);
-	STATS_INC_NODEALLOCS(cachep);
-
-	objp = slabp->s_mem + slabp->free*cachep->objsize;
-
-	slabp->inuse++;
-	next = slab_bufctl(slabp)[slabp->free];
-#if DEBUG
-	slab_bufctl(slabp)[slabp->free] = BUFCTL_FREE;
-#endif
-	slabp->free = next;
-	check_slabp(cachep, slabp);
+	unsigned long save_flags;
+	void *ptr;
 
-	/* move slabp to correct slabp list: */
-	list_del(&slabp->list);
-	if (slabp->free == BUFCTL_END)
-		list_add(&slabp->list, &cachep->lists.slabs_full);
+	cache_alloc_debugcheck_before(cachep, flags);
+	local_irq_save(save_flags);
+	if (nodeid == -1 || nodeid == numa_node_id() ||
+			!cachep->nodelists[nodeid])
+		ptr = ____cache_alloc(cachep, flags);
 	else
-		list_add(&slabp->list, &cachep->lists.slabs_partial);
-
-	list3_data(cachep)->free_objects--;
-	spin_unlock_irq(&cachep->spinlock);
-
-	objp = cache_alloc_debugcheck_after(cachep, GFP_KERNEL, objp,
+		ptr = __cache_alloc_node(cachep, flags, nodeid);
+	local_irq_restore(save_flags);
+	ptr = cache_alloc_debugcheck_after(cachep, flags, ptr,
 					__builtin_return_address(0));
-	return objp;
+	return ptr;
 }
 EXPORT_SYMBOL(kmem_cache_alloc_node);
 
+/**
+ * kmalloc_node - allocate memory on a specific node
+ * @size: how many bytes of memory are required.
+ * @flags: the type of memory to allocate, see kmalloc().
+ * @node: node number of the target node.
+ */
+void *kmalloc_node(size_t size, unsigned int __nocast flags, int node)
+{
+	kmem_cache_t *cachep;
+
+	cachep = kmem_find_general_cachep(size, flags);
+	if (unlikely(cachep == NULL))
+		return NULL;
+	return kmem_cache_alloc_node(cachep, flags, node);
+}
+EXPORT_SYMBOL(kmalloc_node);
 #endif
 
 /**
@@ -2489,8 +2978,7 @@ void *__alloc_percpu(size_t size, size_t align)
 	for (i = 0; i < NR_CPUS; i++) {
 		if (!cpu_possible(i))
 			continue;
-		pdata->ptrs[i] = kmem_cache_alloc_node(
-				kmem_find_general_cachep(size, GFP_KERNEL),
+		pdata->ptrs[i] = kmalloc_node(size, GFP_KERNEL,
 				cpu_to_node(i));
 
 		if (!pdata->ptrs[i])
@@ -2615,23 +3103,85 @@ static void do_ccupdate_local(void *info)
 
 	check_irq_off();
 	old = ac_data(new->cachep);
-	
+	if (old)
+		new->new[smp_processor_id()]->stats = old->stats;
+
 	new->cachep->array[smp_processor_id()] = new->new[smp_processor_id()];
 	new->new[smp_processor_id()] = old;
 }
 
 
+/*
+ * This initializes kmem_list3 for all nodes, and replaces their shared
+ * and alien arrays.
+ */
+static int alloc_kmemlist(kmem_cache_t *cachep)
+{
+	int node;
+	struct kmem_list3 *l3;
+
+	for_each_online_node(node) {
+		struct array_cache *nc = NULL, *new;
+		struct array_cache **new_alien = NULL;
+
+		new = alloc_arraycache(node, cachep->shared*cachep->batchcount,
+					0xbaadf00d);
+		if (!new)
+			return -ENOMEM;
+#ifdef CONFIG_NUMA
+		new_alien = alloc_alien_cache(node, cachep->limit);
+		if (!new_alien) {
+			kfree(new);
+			return -ENOMEM;
+		}
+#endif
+		if ((l3 = cachep->nodelists[node])) {
+			spin_lock_irq(&l3->list_lock);
+
+			if ((nc = l3->shared))
+				free_block(cachep, ac_entry(nc), nc->avail);
+
+			l3->shared = new;
+			if (!l3->alien) {
+				l3->alien = new_alien;
+				new_alien = NULL;
+			}
+			l3->free_limit = (1 + nr_cpus_node(node)) *
+					cachep->batchcount + cachep->num;
+			spin_unlock_irq(&l3->list_lock);
+			kfree(nc);
+			free_alien_cache(new_alien);
+			continue;
+		}
+		l3 = kmalloc_node(sizeof(struct kmem_list3), GFP_KERNEL, node);
+		if (!l3) {
+			kfree(new);
+			free_alien_cache(new_alien);
+			return -ENOMEM;
+		}
+		kmem_list3_init(l3);
+		l3->next_reap = jiffies + REAPTIMEOUT_LIST3 +
+			((unsigned long)cachep)%REAPTIMEOUT_LIST3;
+		l3->shared = new;
+		l3->alien = new_alien;
+		l3->free_limit = (1 + nr_cpus_node(node)) *
+				cachep->batchcount + cachep->num;
+		cachep->nodelists[node] = l3;
+	}
+	return 0;
+}
+
 static int do_tune_cpucache(kmem_cache_t *cachep, int limit, int batchcount,
 				int shared)
 {
 	struct ccupdate_struct new;
-	struct array_cache *new_shared;
 	int i;
 
 	memset(&new.new,0,sizeof(new.new));
 	for (i = 0; i < NR_CPUS; i++) {
 		if (cpu_online(i)) {
-			new.new[i] = alloc_arraycache(i, limit, batchcount);
+			new.new[i] = alloc_arraycache(cpu_to_node(i), limit,
+						batchcount);
 			if (!new.new[i]) {
 				for (i--; i >= 0; i--) kfree(new.new[i]);
 				return -ENOMEM;
@@ -2648,32 +3198,23 @@ static int do_tune_cpucache(kmem_cache_t *cachep, int limit, int batchcount,
 	spin_lock_irq(&cachep->spinlock);
 	cachep->batchcount = batchcount;
 	cachep->limit = limit;
-	cachep->free_limit = (1+num_online_cpus())*cachep->batchcount + cachep->num;
+	cachep->shared = shared;
 	spin_unlock_irq(&cachep->spinlock);
 
 	for (i = 0; i < NR_CPUS; i++) {
 		struct array_cache *ccold = new.new[i];
+		struct kmem_list3 *l3;
+
 		if (!ccold)
 			continue;
-		spin_lock_irq(&cachep->spinlock);
+		l3 = cachep->nodelists[cpu_to_node(i)];
+		spin_lock_irq(&l3->list_lock);
 		free_block(cachep, ac_entry(ccold), ccold->avail);
-		spin_unlock_irq(&cachep->spinlock);
+		spin_unlock_irq(&l3->list_lock);
 		kfree(ccold);
 	}
-	new_shared = alloc_arraycache(-1, batchcount*shared, 0xbaadf00d);
-	if (new_shared) {
-		struct array_cache *old;
-
-		spin_lock_irq(&cachep->spinlock);
-		old = cachep->lists.shared;
-		cachep->lists.shared = new_shared;
-		if (old)
-			free_block(cachep, ac_entry(old), old->avail);
-		spin_unlock_irq(&cachep->spinlock);
-		kfree(old);
-	}
 
-	return 0;
+	return alloc_kmemlist(cachep);
 }
 
 
@@ -2729,12 +3270,16 @@ static void enable_cpucache(kmem_cache_t *cachep)
 					cachep->name, -err);
 }
 
-static void drain_array_locked(kmem_cache_t *cachep,
-				struct array_cache *ac, int force)
+/*
+ * Give back part of a head array, or all of it if force is set.
+ * Returns the number of objects that were freed.
+ */
+static int drain_array_locked(kmem_cache_t *cachep,
+				struct array_cache *ac, int force, int node)
 {
-	int tofree;
+	int tofree = 0;
 
-	check_spinlock_acquired(cachep);
+	check_spinlock_acquired_node(cachep, node);
 	if (ac->touched && !force) {
 		ac->touched = 0;
 	} else if (ac->avail) {
@@ -2747,6 +3292,7 @@ static void drain_array_locked(kmem_cache_t *cachep,
 		memmove(&ac_entry(ac)[0], &ac_entry(ac)[tofree],
 					sizeof(void*)*ac->avail);
 	}
+	return tofree;
 }
 
 /**
@@ -2755,6 +3301,7 @@ static void drain_array_locked(kmem_cache_t *cachep,
  * Called from workqueue/eventd every few seconds.
  * Purpose:
  * - clear the per-cpu caches for this CPU.
+ * - return objects freed on this node to the node they belong to.
  * - return freeable pages to the main free memory pool.
  *
  * If we cannot acquire the cache chain semaphore then just give up - we'll
@@ -2775,6 +3322,7 @@ static void cache_reap(void *unused)
 		struct list_head* p;
 		int tofree;
 		struct slab *slabp;
+		struct kmem_list3 *l3;
 
 		searchp = list_entry(walk, kmem_cache_t, next);
 
@@ -2783,27 +3331,33 @@ static void cache_reap(void *unused)
 
 		check_irq_on();
 
-		spin_lock_irq(&searchp->spinlock);
+		l3 = list3_data(searchp);
+		if (l3->alien)
+			drain_alien_cache(searchp, l3->alien);
+		spin_lock_irq(&l3->list_lock);
 
-		drain_array_locked(searchp, ac_data(searchp), 0);
+		if (drain_array_locked(searchp, ac_data(searchp), 0,
+				numa_node_id()))
+			ac_data(searchp)->stats.reap_drain++;
 
-		if(time_after(searchp->lists.next_reap, jiffies))
+		if(time_after(l3->next_reap, jiffies))
 			goto next_unlock;
 
-		searchp->lists.next_reap = jiffies + REAPTIMEOUT_LIST3;
+		l3->next_reap = jiffies + REAPTIMEOUT_LIST3;
 
-		if (searchp->lists.shared)
-			drain_array_locked(searchp, searchp->lists.shared, 0);
+		if (l3->shared)
+			drain_array_locked(searchp, l3->shared, 0,
+				numa_node_id());
 
-		if (searchp->lists.free_touched) {
-			searchp->lists.free_touched = 0;
+		if (l3->free_touched) {
+			l3->free_touched = 0;
 			goto next_unlock;
 		}
 
-		tofree = (searchp->free_limit+5*searchp->num-1)/(5*searchp->num);
+		tofree = (l3->free_limit+5*searchp->num-1)/(5*searchp->num);
 		do {
-			p = list3_data(searchp)->slabs_free.next;
-			if (p == &(list3_data(searchp)->slabs_free))
+			p = l3->slabs_free.next;
+			if (p == &(l3->slabs_free))
 				break;
 
 			slabp = list_entry(p, struct slab, list);
@@ -2816,13 +3370,13 @@ static void cache_reap(void *unused)
 			 * searchp cannot disappear, we hold
 			 * cache_chain_lock
 			 */
-			searchp->lists.free_objects -= searchp->num;
-			spin_unlock_irq(&searchp->spinlock);
+			l3->free_objects -= searchp->num;
+			spin_unlock_irq(&l3->list_lock);
 			slab_destroy(searchp, slabp);
-			spin_lock_irq(&searchp->spinlock);
+			spin_lock_irq(&l3->list_lock);
 		} while(--tofree > 0);
 next_unlock:
-		spin_unlock_irq(&searchp->spinlock);
+		spin_unlock_irq(&l3->list_lock);
 next:
 		cond_resched();
 	}
@@ -2834,6 +3388,24 @@ next:
 
 #ifdef CONFIG_PROC_FS
 
+/*
+ * Sum up the event counters of all cpus.  The caller holds
+ * cache_chain_sem, so the head arrays cannot be freed under us.
+ */
+static void sum_array_cache_stats(kmem_cache_t *cachep,
+				struct array_cache_stats *sum)
+{
+	int cpu;
+
+	*sum = cachep->offline_stats;
+	for (cpu = 0; cpu < NR_CPUS; cpu++) {
+		struct array_cache *ac = cachep->array[cpu];
+
+		if (ac)
+			add_array_cache_stats(sum, &ac->stats);
+	}
+}
+
 static void *s_start(struct seq_file *m, loff_t *pos)
 {
 	loff_t n = *pos;
@@ -2891,38 +3463,57 @@ static int s_show(struct seq_file *m, void *p)
 	unsigned long	num_objs;
 	unsigned long	active_slabs = 0;
 	unsigned long	num_slabs;
+	unsigned long	free_objects = 0;
+	unsigned long	shared_avail = 0;
+	unsigned long	free_limit = 0;
 	const char *name; 
 	char *error = NULL;
+	int node;
+	struct kmem_list3 *l3;
 
 	check_irq_on();
 	spin_lock_irq(&cachep->spinlock);
 	active_objs = 0;
 	num_slabs = 0;
-	list_for_each(q,&cachep->lists.slabs_full) {
-		slabp = list_entry(q, struct slab, list);
-		if (slabp->inuse != cachep->num && !error)
-			error = "slabs_full accounting error";
-		active_objs += cachep->num;
-		active_slabs++;
-	}
-	list_for_each(q,&cachep->lists.slabs_partial) {
-		slabp = list_entry(q, struct slab, list);
-		if (slabp->inuse == cachep->num && !error)
-			error = "slabs_partial inuse accounting error";
-		if (!slabp->inuse && !error)
-			error = "slabs_partial/inuse accounting error";
-		active_objs += slabp->inuse;
-		active_slabs++;
-	}
-	list_for_each(q,&cachep->lists.slabs_free) {
-		slabp = list_entry(q, struct slab, list);
-		if (slabp->inuse && !error)
-			error = "slabs_free/inuse accounting error";
-		num_slabs++;
+	for_each_online_node(node) {
+		l3 = cachep->nodelists[node];
+		if (!l3)
+			continue;
+
+		spin_lock(&l3->list_lock);
+
+		list_for_each(q,&l3->slabs_full) {
+			slabp = list_entry(q, struct slab, list);
+			if (slabp->inuse != cachep->num && !error)
+				error = "slabs_full accounting error";
+			active_objs += cachep->num;
+			active_slabs++;
+		}
+		list_for_each(q,&l3->slabs_partial) {
+			slabp = list_entry(q, struct slab, list);
+			if (slabp->inuse == cachep->num && !error)
+				error = "slabs_partial inuse accounting error";
+			if (!slabp->inuse && !error)
+				error = "slabs_partial/inuse accounting error";
+			active_objs += slabp->inuse;
+			active_slabs++;
+		}
+		list_for_each(q,&l3->slabs_free) {
+			slabp = list_entry(q, struct slab, list);
+			if (slabp->inuse && !error)
+				error = "slabs_free/inuse accounting error";
+			num_slabs++;
+		}
+		free_objects += l3->free_objects;
+		free_limit += l3->free_limit;
+		if (l3->shared)
+			shared_avail += l3->shared->avail;
+
+		spin_unlock(&l3->list_lock);
 	}
 	num_slabs+=active_slabs;
 	num_objs = num_slabs*cachep->num;
-	if (num_objs - active_objs != cachep->lists.free_objects && !error)
+	if (num_objs - active_objs != free_objects && !error)
 		error = "free_objects accounting error";
 
 	name = cachep->name; 
@@ -2934,9 +3525,9 @@ static int s_show(struct seq_file *m, void *p)
 		cachep->num, (1<<cachep->gfporder));
 	seq_printf(m, " : tunables %4u %4u %4u",
 			cachep->limit, cachep->batchcount,
-			cachep->lists.shared->limit/cachep->batchcount);
-	seq_printf(m, " : slabdata %6lu %6lu %6u",
-			active_slabs, num_slabs, cachep->lists.shared->avail);
+			cachep->shared);
+	seq_printf(m, " : slabdata %6lu %6lu %6lu",
+			active_slabs, num_slabs, shared_avail);
 #if STATS
 	{	/* list3 stats */
 		unsigned long high = cachep->high_mark;
@@ -2945,7 +3536,6 @@ static int s_show(struct seq_file *m, void *p)
 		unsigned long reaped = cachep->reaped;
 		unsigned long errors = cachep->errors;
 		unsigned long max_freeable = cachep->max_freeable;
-		unsigned long free_limit = cachep->free_limit;
 		unsigned long node_allocs = cachep->node_allocs;
 
 		seq_printf(m, " : globalstat %7lu %6lu %5lu %4lu %4lu %4lu %4lu %4lu",
@@ -2954,13 +3544,12 @@ static int s_show(struct seq_file *m, void *p)
 	}
 	/* cpu stats */
 	{
-		unsigned long allochit = atomic_read(&cachep->allochit);
-		unsigned long allocmiss = atomic_read(&cachep->allocmiss);
-		unsigned long freehit = atomic_read(&cachep->freehit);
-		unsigned long freemiss = atomic_read(&cachep->freemiss);
+		struct array_cache_stats st;
 
+		sum_array_cache_stats(cachep, &st);
 		seq_printf(m, " : cpustat %6lu %6lu %6lu %6lu",
-			allochit, allocmiss, freehit, freemiss);
+			st.alloc_hit, st.alloc_refill,
+			st.free_hit, st.free_flush);
 	}
 #endif
 	seq_putc(m, '\n');
@@ -2989,6 +3578,56 @@ struct seq_operations slabinfo_op = {
 	.show	= s_show,
 };
 
+static void *ss_start(struct seq_file *m, loff_t *pos)
+{
+	loff_t n = *pos;
+	struct list_head *p;
+
+	down(&cache_chain_sem);
+	if (!n) {
+		seq_puts(m, "slab_stats - version: 1.0\n");
+		seq_puts(m, "# name            <allochit> <allocrefill>"
+				" <freehit> <freeflush> <remotefree>"
+				" <reapdrain>\n");
+	}
+	p = cache_chain.next;
+	while (n--) {
+		p = p->next;
+		if (p == &cache_chain)
+			return NULL;
+	}
+	return list_entry(p, kmem_cache_t, next);
+}
+
+static int ss_show(struct seq_file *m, void *p)
+{
+	kmem_cache_t *cachep = p;
+	struct array_cache_stats st;
+
+	sum_array_cache_stats(cachep, &st);
+	seq_printf(m, "%-17s %10lu %10lu %10lu %10lu %10lu %10lu\n",
+			cachep->name, st.alloc_hit, st.alloc_refill,
+			st.free_hit, st.free_flush, st.remote_free,
+			st.reap_drain);
+	return 0;
+}
+
+/*
+ * slabstats_op - iterator that generates /proc/slab_stats
+ *
+ * One line per cache with the event counters summed over all cpus:
+ * allocations served from the head array, cache_alloc_refill() calls,
+ * frees into the head array, cache_flusharray() calls, frees of
+ * objects that belong to another node and head array drains done by
+ * cache_reap().
+ */
+struct seq_operations slabstats_op = {
+	.start	= ss_start,
+	.next	= s_next,
+	.stop	= s_stop,
+	.show	= ss_show,
+};
+
 #define MAX_SLABINFO_WRITE 128
 /**
  * slabinfo_write - Tuning for the slab allocator
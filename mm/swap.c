@@ -55,62 +55,171 @@ EXPORT_SYMBOL(put_page);
 #endif
 
 /*
- * Writeback is about to end against a page which has been marked for immediate
- * reclaim.  If it still appears to be reclaimable, move it to the tail of the
- * inactive list.  The page still has PageWriteback set, which will pin it.
- *
- * We don't expect many pages to come through here, so don't bother batching
- * things up.
+ * Pages which are queued for rotation to the tail of the inactive list and
+ * pages which are queued for activation.  Both are batched through per-cpu
+ * pagevecs so that zone->lru_lock is taken once per PAGEVEC_SIZE pages rather
+ * than once per page.  Each queued page holds a reference, which pins it
+ * until the pagevec is drained.
  *
- * To avoid placing the page at the tail of the LRU while PG_writeback is still
- * set, this function will clear PG_writeback before performing the page
- * motion.  Do that inside the lru lock because once PG_writeback is cleared
- * we may not touch the page.
- *
- * Returns zero if it cleared PG_writeback.
+ * The rotation pagevecs are fed from end_page_writeback(), which may run in
+ * interrupt context, so they are only touched with local interrupts off.
+ */
+static DEFINE_PER_CPU(struct pagevec, lru_rotate_pvecs) = { 0, };
+static DEFINE_PER_CPU(struct pagevec, activate_page_pvecs) = { 0, };
+static DEFINE_PER_CPU(struct pagevec, lru_lazyfree_pvecs) = { 0, };
+
+/*
+ * Move the pages in the pagevec to the tail of their zone's inactive list,
+ * if they are still inactive and on the LRU, then drop the references taken
+ * by rotate_reclaimable_page().  Called with local interrupts disabled.
+ */
+static void pagevec_move_tail(struct pagevec *pvec)
+{
+	int i;
+	int pgmoved = 0;
+	struct zone *zone = NULL;
+
+	for (i = 0; i < pagevec_count(pvec); i++) {
+		struct page *page = pvec->pages[i];
+		struct zone *pagezone = page_zone(page);
+
+		if (pagezone != zone) {
+			if (zone)
+				spin_unlock(&zone->lru_lock);
+			zone = pagezone;
+			spin_lock(&zone->lru_lock);
+		}
+		if (PageLRU(page) && !PageActive(page)) {
+			list_move_tail(&page->lru,
+				       &zone->lru[page_lru_base(page)]);
+			pgmoved++;
+		}
+	}
+	if (zone)
+		spin_unlock(&zone->lru_lock);
+	mod_page_state(pgrotated, pgmoved);
+	release_pages(pvec->pages, pvec->nr, pvec->cold);
+	pagevec_reinit(pvec);
+}
+
+/*
+ * Writeback is about to end against a page which has been marked for immediate
+ * reclaim.  If it still appears to be reclaimable, queue it for moving to the
+ * tail of the inactive list.  The queue holds a reference against the page, so
+ * the caller may clear PG_writeback as soon as this returns.
  */
-int rotate_reclaimable_page(struct page *page)
+void rotate_reclaimable_page(struct page *page)
 {
-	struct zone *zone;
+	struct pagevec *pvec;
 	unsigned long flags;
 
-	if (PageLocked(page))
-		return 1;
-	if (PageDirty(page))
-		return 1;
-	if (PageActive(page))
-		return 1;
-	if (!PageLRU(page))
-		return 1;
+	if (PageLocked(page) || PageDirty(page) || PageActive(page) ||
+	    !PageLRU(page))
+		return;
 
-	zone = page_zone(page);
-	spin_lock_irqsave(&zone->lru_lock, flags);
-	if (PageLRU(page) && !PageActive(page)) {
-		list_del(&page->lru);
-		list_add_tail(&page->lru, &zone->inactive_list);
-		inc_page_state(pgrotated);
+	page_cache_get(page);
+	local_irq_save(flags);
+	pvec = &__get_cpu_var(lru_rotate_pvecs);
+	if (!pagevec_add(pvec, page))
+		pagevec_move_tail(pvec);
+	local_irq_restore(flags);
+}
+
+/*
+ * Move the pages in the pagevec onto their zone's active list, if they are
+ * still inactive and on the LRU, then drop the references taken by
+ * activate_page().
+ */
+static void __pagevec_activate(struct pagevec *pvec)
+{
+	int i;
+	int pgmoved = 0;
+	struct zone *zone = NULL;
+
+	for (i = 0; i < pagevec_count(pvec); i++) {
+		struct page *page = pvec->pages[i];
+		struct zone *pagezone = page_zone(page);
+
+		if (pagezone != zone) {
+			if (zone)
+				spin_unlock_irq(&zone->lru_lock);
+			zone = pagezone;
+			spin_lock_irq(&zone->lru_lock);
+		}
+		if (PageLRU(page) && !PageActive(page)) {
+			del_page_from_inactive_list(zone, page);
+			SetPageActive(page);
+			add_page_to_active_list(zone, page);
+			pgmoved++;
+		}
 	}
-	if (!test_clear_page_writeback(page))
-		BUG();
-	spin_unlock_irqrestore(&zone->lru_lock, flags);
-	return 0;
+	if (zone)
+		spin_unlock_irq(&zone->lru_lock);
+	mod_page_state(pgactivate, pgmoved);
+	release_pages(pvec->pages, pvec->nr, pvec->cold);
+	pagevec_reinit(pvec);
 }
 
 /*
- * FIXME: speed this up?
+ * Queue a page for activation.  The move to the active list happens when
+ * this CPU's activation pagevec fills up or is drained by lru_add_drain().
  */
 void fastcall activate_page(struct page *page)
 {
-	struct zone *zone = page_zone(page);
+	struct pagevec *pvec = &get_cpu_var(activate_page_pvecs);
 
-	spin_lock_irq(&zone->lru_lock);
-	if (PageLRU(page) && !PageActive(page)) {
-		del_page_from_inactive_list(zone, page);
-		SetPageActive(page);
-		add_page_to_active_list(zone, page);
-		inc_page_state(pgactivate);
+	page_cache_get(page);
+	if (!pagevec_add(pvec, page))
+		__pagevec_activate(pvec);
+	put_cpu_var(activate_page_pvecs);
+}
+
+/*
+ * Move the anonymous pages in the pagevec to the inactive file list, as
+ * pages vmscan may drop without swapping them, if they are still on the
+ * LRU, then drop the references taken by mark_page_lazyfree().
+ */
+static void __pagevec_lazyfree(struct pagevec *pvec)
+{
+	int i;
+	struct zone *zone = NULL;
+
+	for (i = 0; i < pagevec_count(pvec); i++) {
+		struct page *page = pvec->pages[i];
+		struct zone *pagezone = page_zone(page);
+
+		if (pagezone != zone) {
+			if (zone)
+				spin_unlock_irq(&zone->lru_lock);
+			zone = pagezone;
+			spin_lock_irq(&zone->lru_lock);
+		}
+		if (PageLRU(page) && PageAnon(page) && PageSwapBacked(page) &&
+		    !PageSwapCache(page)) {
+			del_page_from_lru(zone, page);
+			ClearPageSwapBacked(page);
+			add_page_to_inactive_list(zone, page);
+		}
 	}
-	spin_unlock_irq(&zone->lru_lock);
+	if (zone)
+		spin_unlock_irq(&zone->lru_lock);
+	release_pages(pvec->pages, pvec->nr, pvec->cold);
+	pagevec_reinit(pvec);
+}
+
+/*
+ * Queue an anonymous page whose contents the task no longer needs, for
+ * madvise(MADV_FREE).  Its ptes have been cleaned already: reclaim frees
+ * it as long as they stay clean, see try_to_unmap_one().
+ */
+void fastcall mark_page_lazyfree(struct page *page)
+{
+	struct pagevec *pvec = &get_cpu_var(lru_lazyfree_pvecs);
+
+	page_cache_get(page);
+	if (!pagevec_add(pvec, page))
+		__pagevec_lazyfree(pvec);
+	put_cpu_var(lru_lazyfree_pvecs);
 }
 
 /*
@@ -168,6 +277,20 @@ void lru_add_drain(void)
 	pvec = &__get_cpu_var(lru_add_active_pvecs);
 	if (pagevec_count(pvec))
 		__pagevec_lru_add_active(pvec);
+	pvec = &__get_cpu_var(activate_page_pvecs);
+	if (pagevec_count(pvec))
+		__pagevec_activate(pvec);
+	pvec = &__get_cpu_var(lru_lazyfree_pvecs);
+	if (pagevec_count(pvec))
+		__pagevec_lazyfree(pvec);
+	pvec = &__get_cpu_var(lru_rotate_pvecs);
+	if (pagevec_count(pvec)) {
+		unsigned long flags;
+
+		local_irq_save(flags);
+		pagevec_move_tail(pvec);
+		local_irq_restore(flags);
+	}
 	put_cpu_var(lru_add_pvecs);
 }
 
@@ -424,6 +547,20 @@ static void lru_drain_cache(unsigned int cpu)
 	pvec = &per_cpu(lru_add_active_pvecs, cpu);
 	if (pagevec_count(pvec))
 		__pagevec_lru_add_active(pvec);
+	pvec = &per_cpu(activate_page_pvecs, cpu);
+	if (pagevec_count(pvec))
+		__pagevec_activate(pvec);
+	pvec = &per_cpu(lru_lazyfree_pvecs, cpu);
+	if (pagevec_count(pvec))
+		__pagevec_lazyfree(pvec);
+	pvec = &per_cpu(lru_rotate_pvecs, cpu);
+	if (pagevec_count(pvec)) {
+		unsigned long flags;
+
+		local_irq_save(flags);
+		pagevec_move_tail(pvec);
+		local_irq_restore(flags);
+	}
 }
 
 /* Drop the CPU's cached committed space back into the central pool. */
@@ -463,6 +600,26 @@ void percpu_counter_mod(struct percpu_counter *fbc, long amount)
 	put_cpu();
 }
 EXPORT_SYMBOL(percpu_counter_mod);
+
+/*
+ * Add up all the per-cpu counts, return the result.  This is a more accurate
+ * but much slower version of percpu_counter_read_positive()
+ */
+long percpu_counter_sum(struct percpu_counter *fbc)
+{
+	long ret;
+	int cpu;
+
+	spin_lock(&fbc->lock);
+	ret = fbc->count;
+	for_each_cpu(cpu) {
+		long *pcount = per_cpu_ptr(fbc->counters, cpu);
+		ret += *pcount;
+	}
+	spin_unlock(&fbc->lock);
+	return ret < 0 ? 0 : ret;
+}
+EXPORT_SYMBOL(percpu_counter_sum);
 #endif
 
 /*
@@ -14,6 +14,7 @@
 #include <linux/pagemap.h>
 #include <linux/buffer_head.h>
 #include <linux/backing-dev.h>
+#include <linux/swapops.h>
 
 #include <asm/pgtable.h>
 
@@ -76,18 +77,30 @@ static int __add_to_swap_cache(struct page *page,
 	BUG_ON(PagePrivate(page));
 	error = radix_tree_preload(gfp_mask);
 	if (!error) {
+		unsigned long private = page->private;
+		int was_locked;
+
+		/* set up before lockless lookups can see it, as in filemap.c */
+		page_cache_get(page);
+		was_locked = TestSetPageLocked(page);
+		SetPageSwapCache(page);
+		page->private = entry.val;
+
 		write_lock_irq(&swapper_space.tree_lock);
 		error = radix_tree_insert(&swapper_space.page_tree,
 						entry.val, page);
 		if (!error) {
-			page_cache_get(page);
-			SetPageLocked(page);
-			SetPageSwapCache(page);
-			page->private = entry.val;
 			total_swapcache_pages++;
 			pagecache_acct(1);
 		}
 		write_unlock_irq(&swapper_space.tree_lock);
+		if (error) {
+			page->private = private;
+			ClearPageSwapCache(page);
+			if (!was_locked)
+				ClearPageLocked(page);
+			__put_page(page);
+		}
 		radix_tree_preload_end();
 	}
 	return error;
@@ -223,13 +236,18 @@ void delete_from_swap_cache(struct page *page)
 }
 
 /*
- * Strange swizzling function only for use by shmem_writepage
+ * Strange swizzling function only for use by shmem_writepage:
+ * the swap entry is left in the page's slot in its mapping.
  */
 int move_to_swap_cache(struct page *page, swp_entry_t entry)
 {
+	struct address_space *mapping = page->mapping;
 	int err = __add_to_swap_cache(page, entry, GFP_ATOMIC);
 	if (!err) {
-		remove_from_page_cache(page);
+		write_lock_irq(&mapping->tree_lock);
+		__remove_from_page_cache_swapped(page,
+					swp_to_radix_entry(entry));
+		write_unlock_irq(&mapping->tree_lock);
 		page_cache_release(page);	/* pagecache ref */
 		if (!swap_duplicate(entry))
 			BUG();
@@ -241,12 +259,15 @@ int move_to_swap_cache(struct page *page, swp_entry_t entry)
 }
 
 /*
- * Strange swizzling function for shmem_getpage (and shmem_unuse)
+ * Strange swizzling function for shmem_getpage (and shmem_unuse):
+ * the page goes back into the slot of its swap entry.
  */
 int move_from_swap_cache(struct page *page, unsigned long index,
 		struct address_space *mapping)
 {
-	int err = add_to_page_cache(page, mapping, index, GFP_ATOMIC);
+	swp_entry_t entry = { .val = page->private };
+	int err = add_to_page_cache_swapped(page, mapping, index,
+					swp_to_radix_entry(entry));
 	if (!err) {
 		delete_from_swap_cache(page);
 		/* shift page from clean_pages to dirty_pages list */
@@ -370,6 +391,7 @@ struct page *read_swap_cache_async(swp_entry_t entry,
 			/*
 			 * Initiate read into locked page and return.
 			 */
+			SetPageSwapBacked(new_page);
 			lru_cache_add_active(new_page);
 			swap_readpage(NULL, new_page);
 			return new_page;
@@ -84,64 +84,90 @@ void swap_unplug_io_fn(struct backing_dev_info *unused_bdi, struct page *page)
 	up_read(&swap_unplug_sem);
 }
 
-static inline int scan_swap_map(struct swap_info_struct *si)
+/*
+ * Slots are handed out in clusters of SWAPFILE_CLUSTER aligned slots, one
+ * cluster per CPU at a time, so that each reclaimer writes its pages out
+ * sequentially and the elevator can merge them into large requests, and
+ * so that the pages which went out together are neighbours on disk for
+ * swapin readahead.  The cursors are protected by swap_list_lock.
+ */
+struct swap_cluster {
+	int type;		/* swap device the cluster is on */
+	unsigned long next;	/* next slot to try */
+	unsigned long end;	/* slot after the cluster, 0 if none */
+};
+
+static DEFINE_PER_CPU(struct swap_cluster, swap_clusters);
+
+/*
+ * Take the free slot @offset.  Called with the device lock held.
+ */
+static unsigned long take_swap_slot(struct swap_info_struct *si,
+				    unsigned long offset)
 {
-	unsigned long offset;
-	/* 
-	 * We try to cluster swap pages by allocating them
-	 * sequentially in swap.  Once we've allocated
-	 * SWAPFILE_CLUSTER pages this way, however, we resort to
-	 * first-free allocation, starting a new cluster.  This
-	 * prevents us from scattering swap pages all over the entire
-	 * swap partition, so that we reduce overall disk seek times
-	 * between swap pages.  -- sct */
-	if (si->cluster_nr) {
-		while (si->cluster_next <= si->highest_bit) {
-			offset = si->cluster_next++;
-			if (si->swap_map[offset])
-				continue;
-			si->cluster_nr--;
-			goto got_page;
-		}
+	if (offset == si->lowest_bit)
+		si->lowest_bit++;
+	if (offset == si->highest_bit)
+		si->highest_bit--;
+	if (si->lowest_bit > si->highest_bit) {
+		si->lowest_bit = si->max;
+		si->highest_bit = 0;
 	}
-	si->cluster_nr = SWAPFILE_CLUSTER;
-
-	/* try to find an empty (even not aligned) cluster. */
-	offset = si->lowest_bit;
- check_next_cluster:
-	if (offset+SWAPFILE_CLUSTER-1 <= si->highest_bit)
-	{
-		unsigned long nr;
-		for (nr = offset; nr < offset+SWAPFILE_CLUSTER; nr++)
+	si->swap_map[offset] = 1;
+	si->inuse_pages++;
+	nr_swap_pages--;
+	return offset;
+}
+
+/*
+ * Allocate the next free slot of this CPU's current cluster on @si, or
+ * return 0 once the cluster is used up.
+ */
+static unsigned long scan_swap_cluster(struct swap_info_struct *si,
+				       struct swap_cluster *cl)
+{
+	while (cl->next < cl->end && cl->next <= si->highest_bit) {
+		unsigned long offset = cl->next++;
+
+		if (!si->swap_map[offset])
+			return take_swap_slot(si, offset);
+	}
+	cl->end = 0;
+	return 0;
+}
+
+static unsigned long scan_swap_map(struct swap_info_struct *si,
+				   struct swap_cluster *cl)
+{
+	unsigned long offset;
+	unsigned long nr;
+
+	/*
+	 * Look for a completely free aligned cluster.  Another CPU's
+	 * cluster is never free once it has been started, so clusters
+	 * in use by different CPUs cannot overlap.
+	 */
+	offset = (si->lowest_bit + SWAPFILE_CLUSTER - 1) &
+			~(SWAPFILE_CLUSTER - 1UL);
+	while (offset + SWAPFILE_CLUSTER - 1 <= si->highest_bit) {
+		for (nr = offset; nr < offset + SWAPFILE_CLUSTER; nr++)
 			if (si->swap_map[nr])
-			{
-				offset = nr+1;
-				goto check_next_cluster;
-			}
-		/* We found a completly empty cluster, so start
-		 * using it.
-		 */
-		goto got_page;
+				break;
+		if (nr == offset + SWAPFILE_CLUSTER) {
+			cl->type = si - swap_info;
+			cl->next = offset + 1;
+			cl->end = offset + SWAPFILE_CLUSTER;
+			return take_swap_slot(si, offset);
+		}
+		offset = (nr + SWAPFILE_CLUSTER) & ~(SWAPFILE_CLUSTER - 1UL);
 	}
+
 	/* No luck, so now go finegrined as usual. -Andrea */
 	for (offset = si->lowest_bit; offset <= si->highest_bit ; offset++) {
 		if (si->swap_map[offset])
 			continue;
-		si->lowest_bit = offset+1;
-	got_page:
-		if (offset == si->lowest_bit)
-			si->lowest_bit++;
-		if (offset == si->highest_bit)
-			si->highest_bit--;
-		if (si->lowest_bit > si->highest_bit) {
-			si->lowest_bit = si->max;
-			si->highest_bit = 0;
-		}
-		si->swap_map[offset] = 1;
-		si->inuse_pages++;
-		nr_swap_pages--;
-		si->cluster_next = offset+1;
-		return offset;
+		si->lowest_bit = offset;
+		return take_swap_slot(si, offset);
 	}
 	si->lowest_bit = si->max;
 	si->highest_bit = 0;
@@ -151,6 +177,7 @@ static inline int scan_swap_map(struct swap_info_struct *si)
 swp_entry_t get_swap_page(void)
 {
 	struct swap_info_struct * p;
+	struct swap_cluster *cl;
 	unsigned long offset;
 	swp_entry_t entry;
 	int type, wrapped = 0;
@@ -163,11 +190,27 @@ swp_entry_t get_swap_page(void)
 	if (nr_swap_pages <= 0)
 		goto out;
 
+	/* Keep filling this CPU's cluster while it lasts */
+	cl = &__get_cpu_var(swap_clusters);
+	if (cl->end) {
+		p = &swap_info[cl->type];
+		if ((p->flags & SWP_ACTIVE) == SWP_ACTIVE) {
+			swap_device_lock(p);
+			offset = scan_swap_cluster(p, cl);
+			swap_device_unlock(p);
+			if (offset) {
+				entry = swp_entry(cl->type, offset);
+				goto out;
+			}
+		}
+		cl->end = 0;
+	}
+
 	while (1) {
 		p = &swap_info[type];
 		if ((p->flags & SWP_ACTIVE) == SWP_ACTIVE) {
 			swap_device_lock(p);
-			offset = scan_swap_map(p);
+			offset = scan_swap_map(p, cl);
 			swap_device_unlock(p);
 			if (offset) {
 				entry = swp_entry(type,offset);
@@ -363,10 +406,13 @@ int remove_exclusive_swap_page(struct page *page)
 	if (p->swap_map[swp_offset(entry)] == 1) {
 		/* Recheck the page count with the swapcache lock held.. */
 		write_lock_irq(&swapper_space.tree_lock);
-		if ((page_count(page) == 2) && !PageWriteback(page)) {
-			__delete_from_swap_cache(page);
-			SetPageDirty(page);
-			retval = 1;
+		if (page_freeze_refs(page, 2)) {
+			if (!PageWriteback(page)) {
+				__delete_from_swap_cache(page);
+				SetPageDirty(page);
+				retval = 1;
+			}
+			page_unfreeze_refs(page, 2);
 		}
 		write_unlock_irq(&swapper_space.tree_lock);
 	}
@@ -417,16 +463,23 @@ void free_swap_and_cache(swp_entry_t entry)
  * share this swap entry, so be cautious and let do_wp_page work out
  * what to do if a write is requested later.
  *
- * vma->vm_mm->page_table_lock is held.
+ * vma->vm_mm->page_table_lock and the pte lock are held.  The pte may be
+ * in a page table shared copy-on-write with other mms (see mm/memory.c),
+ * whose ptes are then in nobody's rss.
  */
-static void unuse_pte(struct vm_area_struct *vma, pte_t *pte,
+static void unuse_pte(struct vm_area_struct *vma, pmd_t *pmd, pte_t *pte,
 		unsigned long addr, swp_entry_t entry, struct page *page)
 {
-	inc_mm_counter(vma->vm_mm, rss);
+	int counted = pt_counted(vma->vm_mm, pmd);
+
+	if (counted)
+		inc_mm_counter(vma->vm_mm, rss);
 	get_page(page);
 	set_pte_at(vma->vm_mm, addr, pte,
 		   pte_mkold(mk_pte(page, vma->vm_page_prot)));
 	page_add_anon_rmap(page, vma, addr);
+	if (!counted)
+		dec_mm_anon_rss(vma->vm_mm, page);
 	swap_free(entry);
 	/*
 	 * Move the page to the active list so it is not
@@ -442,6 +495,7 @@ static int unuse_pte_range(struct vm_area_struct *vma, pmd_t *pmd,
 	pte_t *pte;
 	pte_t swp_pte = swp_entry_to_pte(entry);
 
+	pte_lock_nested(pmd);
 	pte = pte_offset_map(pmd, addr);
 	do {
 		/*
@@ -449,12 +503,14 @@ static int unuse_pte_range(struct vm_area_struct *vma, pmd_t *pmd,
 		 * Test inline before going to call unuse_pte.
 		 */
 		if (unlikely(pte_same(*pte, swp_pte))) {
-			unuse_pte(vma, pte, addr, entry, page);
+			unuse_pte(vma, pmd, pte, addr, entry, page);
 			pte_unmap(pte);
+			pte_unlock_nested(pmd);
 			return 1;
 		}
 	} while (pte++, addr += PAGE_SIZE, addr != end);
 	pte_unmap(pte - 1);
+	pte_unlock_nested(pmd);
 	return 0;
 }
 
@@ -522,11 +578,22 @@ static int unuse_vma(struct vm_area_struct *vma,
 	return 0;
 }
 
-static int unuse_mm(struct mm_struct *mm,
+static void unuse_mm_vmas(struct mm_struct *mm,
 				swp_entry_t entry, struct page *page)
 {
 	struct vm_area_struct *vma;
 
+	spin_lock(&mm->page_table_lock);
+	for (vma = mm->mmap; vma; vma = vma->vm_next) {
+		if (vma->anon_vma && unuse_vma(vma, entry, page))
+			break;
+	}
+	spin_unlock(&mm->page_table_lock);
+}
+
+static int unuse_mm(struct mm_struct *mm,
+				swp_entry_t entry, struct page *page)
+{
 	if (!down_read_trylock(&mm->mmap_sem)) {
 		/*
 		 * Our reference to the page stops try_to_unmap_one from
@@ -536,12 +603,7 @@ static int unuse_mm(struct mm_struct *mm,
 		down_read(&mm->mmap_sem);
 		lock_page(page);
 	}
-	spin_lock(&mm->page_table_lock);
-	for (vma = mm->mmap; vma; vma = vma->vm_next) {
-		if (vma->anon_vma && unuse_vma(vma, entry, page))
-			break;
-	}
-	spin_unlock(&mm->page_table_lock);
+	unuse_mm_vmas(mm, entry, page);
 	up_read(&mm->mmap_sem);
 	/*
 	 * Currently unuse_mm cannot fail, but leave error handling
@@ -550,6 +612,41 @@ static int unuse_mm(struct mm_struct *mm,
 	return 0;
 }
 
+/*
+ * Page migration has unmapped the anonymous pages it moves into swap
+ * ptes and put the new copy in the swap cache in place of the old page:
+ * map the new page back into @mm, whose mmap_sem the caller holds, then
+ * drop it from the swap cache again if nothing else refers to the slot.
+ * The new page is locked.
+ */
+void remap_swap_page(struct mm_struct *mm, struct page *page)
+{
+	struct swap_info_struct *p;
+	swp_entry_t entry;
+	int unused = 0;
+
+	entry.val = page->private;
+	unuse_mm_vmas(mm, entry, page);
+
+	p = swap_info_get(entry);
+	if (!p)
+		return;
+	if (p->swap_map[swp_offset(entry)] == 1 && !PageWriteback(page)) {
+		write_lock_irq(&swapper_space.tree_lock);
+		__delete_from_swap_cache(page);
+		write_unlock_irq(&swapper_space.tree_lock);
+		unused = 1;
+	}
+	swap_info_put(p);
+
+	if (unused) {
+		/* the data now only lives in the page */
+		SetPageDirty(page);
+		swap_free(entry);
+		page_cache_release(page);
+	}
+}
+
 /*
  * Scan swap_map from current position to next entry still in use.
  * Recycle to start on reaching the end, returning 0 when empty.
@@ -1337,7 +1434,6 @@ asmlinkage long sys_swapon(const char __user * specialfile, int swap_flags)
 	p->swap_map = NULL;
 	p->lowest_bit = 0;
 	p->highest_bit = 0;
-	p->cluster_nr = 0;
 	p->inuse_pages = 0;
 	spin_lock_init(&p->sdev_lock);
 	p->next = -1;
@@ -1461,9 +1557,12 @@ asmlinkage long sys_swapon(const char __user * specialfile, int swap_flags)
 		 * offset is extracted. This will mask all the bits from
 		 * the initial ~0UL mask that can't be encoded in either
 		 * the swp_entry_t or the architecture definition of a
-		 * swap pte.
+		 * swap pte.  The same goes for the entries tmpfs keeps in
+		 * its page cache, see swp_to_radix_entry().
 		 */
 		maxpages = swp_offset(pte_to_swp_entry(swp_entry_to_pte(swp_entry(0,~0UL)))) - 1;
+		maxpages = min_t(unsigned long, maxpages,
+			swp_offset(radix_to_swp_entry(swp_to_radix_entry(swp_entry(0,~0UL)))) - 1);
 		if (maxpages > swap_header->info.last_page)
 			maxpages = swap_header->info.last_page;
 		p->highest_bit = maxpages - 1;
@@ -16,6 +16,8 @@
 static DEFINE_SPINLOCK(swap_token_lock);
 static unsigned long swap_token_timeout;
 static unsigned long swap_token_check;
+static unsigned long swap_token_start;
+static unsigned int global_faults;
 struct mm_struct * swap_token_mm = &init_mm;
 
 #define SWAP_TOKEN_CHECK_INTERVAL (HZ * 2)
@@ -25,27 +27,56 @@ struct mm_struct * swap_token_mm = &init_mm;
  */
 unsigned long swap_token_default_timeout = SWAP_TOKEN_TIMEOUT;
 
+/* How often the token may change hands, in jiffies */
+int swap_token_check_interval = SWAP_TOKEN_CHECK_INTERVAL;
+
+/*
+ * Track how fast an mm is taking major faults, measured in major faults
+ * taken system-wide between two of its own.  An mm which faults at least
+ * as often as it did last time gains priority, one which slows down loses
+ * it.  Being approximate, this is done without locking.
+ */
+static void update_fault_rate(struct mm_struct *mm)
+{
+	unsigned int interval;
+
+	global_faults++;
+	interval = global_faults - mm->faultstamp;
+	if (interval <= mm->last_interval)
+		mm->token_priority++;
+	else if (mm->token_priority)
+		mm->token_priority--;
+	mm->faultstamp = global_faults;
+	mm->last_interval = interval;
+	mm->swap_token_faults++;
+}
+
 /*
  * Take the token away if the process had no page faults
- * in the last interval, or if it has held the token for
- * too long.
+ * in the last interval, if it has held the token for
+ * too long, or if the process asking for it is faulting
+ * harder.
  */
 #define SWAP_TOKEN_ENOUGH_RSS 1
 #define SWAP_TOKEN_TIMED_OUT 2
-static int should_release_swap_token(struct mm_struct *mm)
+#define SWAP_TOKEN_OUTRANKED 3
+static int should_release_swap_token(struct mm_struct *mm,
+				     struct mm_struct *contender)
 {
 	int ret = 0;
 	if (!mm->recent_pagein)
 		ret = SWAP_TOKEN_ENOUGH_RSS;
 	else if (time_after(jiffies, swap_token_timeout))
 		ret = SWAP_TOKEN_TIMED_OUT;
+	else if (contender->token_priority > mm->token_priority)
+		ret = SWAP_TOKEN_OUTRANKED;
 	mm->recent_pagein = 0;
 	return ret;
 }
 
 /*
  * Try to grab the swapout protection token.  We only try to
- * grab it once every TOKEN_CHECK_INTERVAL, both to prevent
+ * grab it once every swap_token_check_interval, both to prevent
  * SMP lock contention and to check that the process that held
  * the token before is no longer thrashing.
  */
@@ -54,6 +85,8 @@ void grab_swap_token(void)
 	struct mm_struct *mm;
 	int reason;
 
+	update_fault_rate(current->mm);
+
 	/* We have the token. Let others know we still need it. */
 	if (has_swap_token(current->mm)) {
 		current->mm->recent_pagein = 1;
@@ -73,23 +106,42 @@ void grab_swap_token(void)
 		if (!spin_trylock(&swap_token_lock))
 			return;
 
-		swap_token_check = jiffies + SWAP_TOKEN_CHECK_INTERVAL;
+		swap_token_check = jiffies + swap_token_check_interval;
 
 		mm = swap_token_mm;
-		if ((reason = should_release_swap_token(mm))) {
+		if ((reason = should_release_swap_token(mm, current->mm))) {
 			unsigned long eligible = jiffies;
 			if (reason == SWAP_TOKEN_TIMED_OUT) {
 				eligible += swap_token_default_timeout;
 			}
 			mm->swap_token_time = eligible;
+			mm->swap_token_held += jiffies - swap_token_start;
 			swap_token_timeout = jiffies + swap_token_default_timeout;
+			swap_token_start = jiffies;
 			swap_token_mm = current->mm;
+			current->mm->swap_token_grabs++;
 		}
 		spin_unlock(&swap_token_lock);
 	}
 	return;
 }
 
+/*
+ * How long @mm has held the token in total, including the current
+ * hold if it has it now.  For /proc/<pid>/swap_token.
+ */
+unsigned long swap_token_held_time(struct mm_struct *mm)
+{
+	unsigned long held;
+
+	spin_lock(&swap_token_lock);
+	held = mm->swap_token_held;
+	if (mm == swap_token_mm)
+		held += jiffies - swap_token_start;
+	spin_unlock(&swap_token_lock);
+	return held;
+}
+
 /* Called on process exit. */
 void __put_swap_token(struct mm_struct *mm)
 {
@@ -97,6 +149,7 @@ void __put_swap_token(struct mm_struct *mm)
 	if (likely(mm == swap_token_mm)) {
 		swap_token_mm = &init_mm;
 		swap_token_check = jiffies;
+		swap_token_start = jiffies;
 	}
 	spin_unlock(&swap_token_lock);
 }
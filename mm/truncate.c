@@ -42,11 +42,11 @@ static inline void truncate_partial_page(struct page *page, unsigned partial)
  * its lock, b) when a concurrent invalidate_inode_pages got there first and
  * c) when tmpfs swizzles a page between a tmpfs inode and swapper_space.
  */
-static void
-truncate_complete_page(struct address_space *mapping, struct page *page)
+static int
+truncate_prepare_page(struct address_space *mapping, struct page *page)
 {
 	if (page->mapping != mapping)
-		return;
+		return 0;
 
 	if (PagePrivate(page))
 		do_invalidatepage(page, 0);
@@ -54,10 +54,37 @@ truncate_complete_page(struct address_space *mapping, struct page *page)
 	clear_page_dirty(page);
 	ClearPageUptodate(page);
 	ClearPageMappedToDisk(page);
+	return 1;
+}
+
+static void
+truncate_complete_page(struct address_space *mapping, struct page *page)
+{
+	if (!truncate_prepare_page(mapping, page))
+		return;
 	remove_from_page_cache(page);
 	page_cache_release(page);	/* pagecache ref */
 }
 
+/*
+ * Take @nr locked pages, ready for truncate_complete_page(), out of the
+ * pagecache together and unlock them.
+ */
+static void
+truncate_complete_pages(struct address_space *mapping, struct page **pages,
+			int nr)
+{
+	int i;
+
+	if (!nr)
+		return;
+	remove_from_page_cache_batch(mapping, pages, nr);
+	for (i = 0; i < nr; i++) {
+		page_cache_release(pages[i]);	/* pagecache ref */
+		unlock_page(pages[i]);
+	}
+}
+
 /*
  * This is for invalidate_inode_pages().  That function can be called at
  * any time, and is not supposed to throw away dirty pages.  But pages can
@@ -90,6 +117,47 @@ invalidate_complete_page(struct address_space *mapping, struct page *page)
 	return 1;
 }
 
+/*
+ * invalidate_complete_page() for @nr locked pages of one pagevec, under
+ * one hold of the tree_lock.  Returns the number invalidated; the pages
+ * stay locked.
+ */
+static int
+invalidate_complete_pages(struct address_space *mapping, struct page **pages,
+			  int nr)
+{
+	struct page *victims[PAGEVEC_SIZE];
+	int i, n = 0;
+
+	for (i = 0; i < nr; i++) {
+		struct page *page = pages[i];
+
+		if (page->mapping != mapping)
+			continue;
+		if (PagePrivate(page) && !try_to_release_page(page, 0))
+			continue;
+		victims[n++] = page;
+	}
+	if (!n)
+		return 0;
+
+	write_lock_irq(&mapping->tree_lock);
+	for (i = 0, nr = n, n = 0; i < nr; i++) {
+		if (!PageDirty(victims[i]))
+			victims[n++] = victims[i];
+	}
+	for (i = 0; i < n; i++)
+		BUG_ON(PagePrivate(victims[i]));
+	__remove_from_page_cache_batch(mapping, victims, n);
+	write_unlock_irq(&mapping->tree_lock);
+
+	for (i = 0; i < n; i++) {
+		ClearPageUptodate(victims[i]);
+		page_cache_release(victims[i]);	/* pagecache ref */
+	}
+	return n;
+}
+
 /**
  * truncate_inode_pages - truncate *all* the pages from an offset
  * @mapping: mapping to truncate
@@ -102,7 +170,8 @@ invalidate_complete_page(struct address_space *mapping, struct page *page)
  * block on page locks and it will not block on writeback.  The second pass
  * will wait.  This is to prevent as much IO as possible in the affected region.
  * The first pass will remove most pages, so the search cost of the second pass
- * is low.
+ * is low.  It also takes the pages of each pagevec out of the radix tree
+ * together, under one hold of the tree_lock.
  *
  * When looking at page->index outside the page lock we need to be careful to
  * copy it into a local to avoid races (it could change at any time).
@@ -127,6 +196,9 @@ void truncate_inode_pages(struct address_space *mapping, loff_t lstart)
 	pagevec_init(&pvec, 0);
 	next = start;
 	while (pagevec_lookup(&pvec, mapping, next, PAGEVEC_SIZE)) {
+		struct page *locked[PAGEVEC_SIZE];
+		int nr_locked = 0;
+
 		for (i = 0; i < pagevec_count(&pvec); i++) {
 			struct page *page = pvec.pages[i];
 			pgoff_t page_index = page->index;
@@ -136,13 +208,14 @@ void truncate_inode_pages(struct address_space *mapping, loff_t lstart)
 			next++;
 			if (TestSetPageLocked(page))
 				continue;
-			if (PageWriteback(page)) {
+			if (PageWriteback(page) ||
+			    !truncate_prepare_page(mapping, page)) {
 				unlock_page(page);
 				continue;
 			}
-			truncate_complete_page(mapping, page);
-			unlock_page(page);
+			locked[nr_locked++] = page;
 		}
+		truncate_complete_pages(mapping, locked, nr_locked);
 		pagevec_release(&pvec);
 		cond_resched();
 	}
@@ -207,6 +280,9 @@ unsigned long invalidate_mapping_pages(struct address_space *mapping,
 	pagevec_init(&pvec, 0);
 	while (next <= end &&
 			pagevec_lookup(&pvec, mapping, next, PAGEVEC_SIZE)) {
+		struct page *locked[PAGEVEC_SIZE];
+		int nr_locked = 0;
+
 		for (i = 0; i < pagevec_count(&pvec); i++) {
 			struct page *page = pvec.pages[i];
 
@@ -217,16 +293,17 @@ unsigned long invalidate_mapping_pages(struct address_space *mapping,
 			if (page->index > next)
 				next = page->index;
 			next++;
-			if (PageDirty(page) || PageWriteback(page))
-				goto unlock;
-			if (page_mapped(page))
-				goto unlock;
-			ret += invalidate_complete_page(mapping, page);
-unlock:
-			unlock_page(page);
+			if (PageDirty(page) || PageWriteback(page) ||
+			    page_mapped(page))
+				unlock_page(page);
+			else
+				locked[nr_locked++] = page;
 			if (next > end)
 				break;
 		}
+		ret += invalidate_complete_pages(mapping, locked, nr_locked);
+		for (i = 0; i < nr_locked; i++)
+			unlock_page(locked[i]);
 		pagevec_release(&pvec);
 		cond_resched();
 	}
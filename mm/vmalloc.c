@@ -20,8 +20,22 @@
 #include <asm/tlbflush.h>
 
 
+/*
+ * The areas are on vmlist in address order, and in vmlist_root for
+ * looking them up by address.  vfree() and vunmap() only clear the ptes
+ * of an area and leave it there marked VM_LAZY_FREE: its addresses are
+ * not handed out again until the TLBs have been flushed, which is done
+ * for all such areas at once by purge_lazy_areas() when enough of them
+ * are waiting, or when the space runs out.  That saves a flush of all
+ * CPUs' TLBs on each of them.
+ */
 DEFINE_RWLOCK(vmlist_lock);
 struct vm_struct *vmlist;
+static struct rb_root vmlist_root = RB_ROOT;
+
+/* Pages of VM_LAZY_FREE areas, and the range they are in */
+static unsigned long lazy_nr_pages;
+static unsigned long lazy_start = ULONG_MAX, lazy_end;
 
 static void vunmap_pte_range(pmd_t *pmd, unsigned long addr, unsigned long end)
 {
@@ -64,7 +78,8 @@ static inline void vunmap_pud_range(pgd_t *pgd, unsigned long addr,
 	} while (pud++, addr = next, addr != end);
 }
 
-void unmap_vm_area(struct vm_struct *area)
+/* Clear the ptes of @area, leaving the TLBs to the caller */
+static void vunmap_area_ptes(struct vm_struct *area)
 {
 	pgd_t *pgd;
 	unsigned long next;
@@ -80,7 +95,13 @@ void unmap_vm_area(struct vm_struct *area)
 			continue;
 		vunmap_pud_range(pgd, addr, next);
 	} while (pgd++, addr = next, addr != end);
-	flush_tlb_kernel_range((unsigned long) area->addr, end);
+}
+
+void unmap_vm_area(struct vm_struct *area)
+{
+	vunmap_area_ptes(area);
+	flush_tlb_kernel_range((unsigned long) area->addr,
+			       (unsigned long) area->addr + area->size);
 }
 
 static int vmap_pte_range(pmd_t *pmd, unsigned long addr,
@@ -158,6 +179,114 @@ int map_vm_area(struct vm_struct *area, pgprot_t prot, struct page ***pages)
 	return err;
 }
 
+/* The area starting at @addr, with vmlist_lock held */
+static struct vm_struct *__find_vm_area(void *addr)
+{
+	struct rb_node *n = vmlist_root.rb_node;
+
+	while (n) {
+		struct vm_struct *tmp = rb_entry(n, struct vm_struct, rb_node);
+
+		if (addr < tmp->addr)
+			n = n->rb_left;
+		else if (addr > tmp->addr)
+			n = n->rb_right;
+		else
+			return tmp;
+	}
+	return NULL;
+}
+
+/* The last area starting below @addr, with vmlist_lock held */
+static struct vm_struct *__find_vm_area_before(unsigned long addr)
+{
+	struct rb_node *n = vmlist_root.rb_node;
+	struct vm_struct *prev = NULL;
+
+	while (n) {
+		struct vm_struct *tmp = rb_entry(n, struct vm_struct, rb_node);
+
+		if ((unsigned long)tmp->addr < addr) {
+			prev = tmp;
+			n = n->rb_right;
+		} else
+			n = n->rb_left;
+	}
+	return prev;
+}
+
+static void __insert_vm_area(struct vm_struct *area)
+{
+	struct rb_node **p = &vmlist_root.rb_node;
+	struct rb_node *parent = NULL;
+
+	while (*p) {
+		struct vm_struct *tmp;
+
+		parent = *p;
+		tmp = rb_entry(parent, struct vm_struct, rb_node);
+		if (area->addr < tmp->addr)
+			p = &parent->rb_left;
+		else
+			p = &parent->rb_right;
+	}
+	rb_link_node(&area->rb_node, parent, p);
+	rb_insert_color(&area->rb_node, &vmlist_root);
+}
+
+/* Take @area off vmlist and vmlist_root, with vmlist_lock held */
+static void __unlink_vm_area(struct vm_struct *area)
+{
+	struct rb_node *prev = rb_prev(&area->rb_node);
+	struct vm_struct **p = &vmlist;
+
+	if (prev)
+		p = &rb_entry(prev, struct vm_struct, rb_node)->next;
+	BUG_ON(*p != area);
+	*p = area->next;
+	rb_erase(&area->rb_node, &vmlist_root);
+}
+
+/*
+ * How many pages of freed areas may wait for their TLB flush: more
+ * with more CPUs to interrupt, but a quarter of the space at most.
+ */
+static unsigned long lazy_max_pages(void)
+{
+	unsigned long pages;
+
+	pages = fls(num_online_cpus()) * (8UL << (20 - PAGE_SHIFT));
+	return min_t(unsigned long, pages,
+		     (VMALLOC_END - VMALLOC_START) >> (PAGE_SHIFT + 2));
+}
+
+/*
+ * Flush the TLBs of all the VM_LAZY_FREE areas in one go, and make
+ * their addresses available again.  Called with vmlist_lock held for
+ * writing.
+ */
+static void purge_lazy_areas(void)
+{
+	struct vm_struct **p, *tmp;
+
+	if (!lazy_nr_pages)
+		return;
+	flush_tlb_kernel_range(lazy_start, lazy_end);
+
+	p = &vmlist;
+	while ((tmp = *p) != NULL) {
+		if (tmp->flags & VM_LAZY_FREE) {
+			*p = tmp->next;
+			rb_erase(&tmp->rb_node, &vmlist_root);
+			kfree(tmp);
+		} else
+			p = &tmp->next;
+	}
+	lazy_nr_pages = 0;
+	lazy_start = ULONG_MAX;
+	lazy_end = 0;
+}
+
 #define IOREMAP_MAX_ORDER	(7 + PAGE_SHIFT)	/* 128 pages */
 
 struct vm_struct *__get_vm_area(unsigned long size, unsigned long flags,
@@ -166,6 +295,7 @@ struct vm_struct *__get_vm_area(unsigned long size, unsigned long flags,
 	struct vm_struct **p, *tmp, *area;
 	unsigned long align = 1;
 	unsigned long addr;
+	int purged = 0;
 
 	if (flags & VM_IOREMAP) {
 		int bit = fls(size);
@@ -177,7 +307,6 @@ struct vm_struct *__get_vm_area(unsigned long size, unsigned long flags,
 
 		align = 1ul << bit;
 	}
-	addr = ALIGN(start, align);
 	size = PAGE_ALIGN(size);
 
 	area = kmalloc(sizeof(*area), GFP_KERNEL);
@@ -195,7 +324,18 @@ struct vm_struct *__get_vm_area(unsigned long size, unsigned long flags,
 	size += PAGE_SIZE;
 
 	write_lock(&vmlist_lock);
-	for (p = &vmlist; (tmp = *p) != NULL ;p = &tmp->next) {
+retry:
+	addr = ALIGN(start, align);
+	/* skip the areas below start, which the loop would walk */
+	p = &vmlist;
+	tmp = __find_vm_area_before(addr);
+	if (tmp) {
+		if ((unsigned long)tmp->addr + tmp->size >= addr)
+			addr = ALIGN(tmp->size +
+				     (unsigned long)tmp->addr, align);
+		p = &tmp->next;
+	}
+	for (; (tmp = *p) != NULL ;p = &tmp->next) {
 		if ((unsigned long)tmp->addr < addr) {
 			if((unsigned long)tmp->addr + tmp->size >= addr)
 				addr = ALIGN(tmp->size + 
@@ -221,11 +361,18 @@ found:
 	area->pages = NULL;
 	area->nr_pages = 0;
 	area->phys_addr = 0;
+	__insert_vm_area(area);
 	write_unlock(&vmlist_lock);
 
 	return area;
 
 out:
+	/* the space may only be taken by areas waiting for a flush */
+	if (lazy_nr_pages && !purged) {
+		purge_lazy_areas();
+		purged = 1;
+		goto retry;
+	}
 	write_unlock(&vmlist_lock);
 	kfree(area);
 	if (printk_ratelimit())
@@ -248,6 +395,26 @@ struct vm_struct *get_vm_area(unsigned long size, unsigned long flags)
 	return __get_vm_area(size, flags, VMALLOC_START, VMALLOC_END);
 }
 
+/**
+ *	__remove_vm_area  -  remove a kernel virtual area, vmlist_lock held
+ *
+ *	@addr:		base address
+ *
+ *	Like remove_vm_area(), for a caller holding vmlist_lock for writing.
+ *	The area keeps its guard page in ->size.
+ */
+struct vm_struct *__remove_vm_area(void *addr)
+{
+	struct vm_struct *tmp;
+
+	tmp = __find_vm_area(addr);
+	if (!tmp || (tmp->flags & VM_LAZY_FREE))
+		return NULL;
+	unmap_vm_area(tmp);
+	__unlink_vm_area(tmp);
+	return tmp;
+}
+
 /**
  *	remove_vm_area  -  find and remove a contingous kernel virtual area
  *
@@ -255,24 +422,17 @@ struct vm_struct *get_vm_area(unsigned long size, unsigned long flags)
  *
  *	Search for the kernel VM area starting at @addr, and remove it.
  *	This function returns the found VM area, but using it is NOT safe
- *	on SMP machines.
+ *	on SMP machines.  Its TLB entries are flushed before it returns.
  */
 struct vm_struct *remove_vm_area(void *addr)
 {
-	struct vm_struct **p, *tmp;
+	struct vm_struct *tmp;
 
 	write_lock(&vmlist_lock);
-	for (p = &vmlist ; (tmp = *p) != NULL ;p = &tmp->next) {
-		 if (tmp->addr == addr)
-			 goto found;
-	}
-	write_unlock(&vmlist_lock);
-	return NULL;
-
-found:
-	unmap_vm_area(tmp);
-	*p = tmp->next;
+	tmp = __remove_vm_area(addr);
 	write_unlock(&vmlist_lock);
+	if (!tmp)
+		return NULL;
 
 	/*
 	 * Remove the guard page.
@@ -284,6 +444,8 @@ found:
 void __vunmap(void *addr, int deallocate_pages)
 {
 	struct vm_struct *area;
+	struct page **pages;
+	unsigned int i, nr_pages;
 
 	if (!addr)
 		return;
@@ -294,30 +456,40 @@ void __vunmap(void *addr, int deallocate_pages)
 		return;
 	}
 
-	area = remove_vm_area(addr);
-	if (unlikely(!area)) {
+	write_lock(&vmlist_lock);
+	area = __find_vm_area(addr);
+	if (unlikely(!area || (area->flags & VM_LAZY_FREE))) {
+		write_unlock(&vmlist_lock);
 		printk(KERN_ERR "Trying to vfree() nonexistent vm area (%p)\n",
 				addr);
 		WARN_ON(1);
 		return;
 	}
 
-	if (deallocate_pages) {
-		int i;
+	/* the area itself goes when its TLB entries do, in a purge */
+	vunmap_area_ptes(area);
+	area->flags |= VM_LAZY_FREE;
+	pages = area->pages;
+	nr_pages = area->nr_pages;
+	lazy_nr_pages += area->size >> PAGE_SHIFT;
+	lazy_start = min(lazy_start, (unsigned long)area->addr);
+	lazy_end = max(lazy_end, (unsigned long)area->addr + area->size);
+	if (lazy_nr_pages > lazy_max_pages())
+		purge_lazy_areas();
+	write_unlock(&vmlist_lock);
 
-		for (i = 0; i < area->nr_pages; i++) {
-			if (unlikely(!area->pages[i]))
+	if (deallocate_pages) {
+		for (i = 0; i < nr_pages; i++) {
+			if (unlikely(!pages[i]))
 				BUG();
-			__free_page(area->pages[i]);
+			__free_page(pages[i]);
 		}
 
-		if (area->nr_pages > PAGE_SIZE/sizeof(struct page *))
-			vfree(area->pages);
+		if (nr_pages > PAGE_SIZE/sizeof(struct page *))
+			vfree(pages);
 		else
-			kfree(area->pages);
+			kfree(pages);
 	}
-
-	kfree(area);
 	return;
 }
 
@@ -525,7 +697,8 @@ long vread(char *buf, char *addr, unsigned long count)
 	read_lock(&vmlist_lock);
 	for (tmp = vmlist; tmp; tmp = tmp->next) {
 		vaddr = (char *) tmp->addr;
-		if (addr >= vaddr + tmp->size - PAGE_SIZE)
+		if (addr >= vaddr + tmp->size - PAGE_SIZE ||
+		    (tmp->flags & VM_LAZY_FREE))
 			continue;
 		while (addr < vaddr) {
 			if (count == 0)
@@ -563,7 +736,8 @@ long vwrite(char *buf, char *addr, unsigned long count)
 	read_lock(&vmlist_lock);
 	for (tmp = vmlist; tmp; tmp = tmp->next) {
 		vaddr = (char *) tmp->addr;
-		if (addr >= vaddr + tmp->size - PAGE_SIZE)
+		if (addr >= vaddr + tmp->size - PAGE_SIZE ||
+		    (tmp->flags & VM_LAZY_FREE))
 			continue;
 		while (addr < vaddr) {
 			if (count == 0)
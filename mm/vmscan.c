@@ -72,6 +72,9 @@ struct scan_control {
 	/* This context's GFP mask */
 	unsigned int gfp_mask;
 
+	/* Order of the allocation this reclaim is for */
+	int order;
+
 	int may_writepage;
 
 	/* This context's SWAP_CLUSTER_MAX. If freeing memory for
@@ -225,6 +228,12 @@ static int shrink_slab(unsigned long scanned, unsigned int gfp_mask,
 	return 0;
 }
 
+/* A MADV_FREE page: anonymous memory which is dropped, not swapped out */
+static inline int lazyfree_page(struct page *page)
+{
+	return PageAnon(page) && !PageSwapCache(page) && !PageSwapBacked(page);
+}
+
 /* Called without lock on whether page is mapped, so answer is unstable */
 static inline int page_mapping_inuse(struct page *page)
 {
@@ -360,13 +369,96 @@ static pageout_t pageout(struct page *page, struct address_space *mapping)
 	return PAGE_CLEAN;
 }
 
+/*
+ * Take @nr locked pages of @mapping, which shrink_list() found freeable,
+ * out of the pagecache or swapcache under one hold of the tree_lock.
+ * Pages which turn out to be busy go back to @ret_pages.  Returns the
+ * number freed.
+ */
+static int remove_mapping_pages(struct address_space *mapping,
+				struct page **pages, int nr,
+				struct pagevec *freed_pvec,
+				struct list_head *ret_pages)
+{
+	struct page *victims[PAGEVEC_SIZE];
+	struct page *file[PAGEVEC_SIZE];
+#ifdef CONFIG_SWAP
+	swp_entry_t swap[PAGEVEC_SIZE];
+	int nr_swap = 0;
+#endif
+	int nr_victims = 0, nr_file = 0, nr_kept = 0;
+	int i;
+
+	write_lock_irq(&mapping->tree_lock);
+	for (i = 0; i < nr; i++) {
+		struct page *page = pages[i];
+
+		/*
+		 * The non-racy check for busy page.  It is critical to check
+		 * PageDirty _after_ making sure that the page is freeable and
+		 * not in use by anybody. 	(pagecache + us == 2)
+		 *
+		 * Lockless pagecache lookups can take a reference without
+		 * the tree_lock, so the count is frozen until the page is
+		 * out of the tree.
+		 */
+		if (!page_freeze_refs(page, 2)) {
+			pages[nr_kept++] = page;
+			continue;
+		}
+		if (PageDirty(page)) {
+			page_unfreeze_refs(page, 2);
+			pages[nr_kept++] = page;
+			continue;
+		}
+
+		victims[nr_victims++] = page;
+#ifdef CONFIG_SWAP
+		if (PageSwapCache(page)) {
+			swap[nr_swap++].val = page->private;
+			__delete_from_swap_cache(page);
+			continue;
+		}
+#endif /* CONFIG_SWAP */
+		file[nr_file++] = page;
+	}
+	__remove_from_page_cache_batch(mapping, file, nr_file);
+	write_unlock_irq(&mapping->tree_lock);
+
+#ifdef CONFIG_SWAP
+	for (i = 0; i < nr_swap; i++)
+		swap_free(swap[i]);
+#endif
+	for (i = 0; i < nr_victims; i++) {
+		struct page *page = victims[i];
+
+		page_unfreeze_refs(page, 1);	/* drop the pagecache ref */
+		unlock_page(page);
+		if (!pagevec_add(freed_pvec, page))
+			__pagevec_release_nonlru(freed_pvec);
+	}
+	for (i = 0; i < nr_kept; i++) {
+		unlock_page(pages[i]);
+		list_add(&pages[i]->lru, ret_pages);
+	}
+	return nr_victims;
+}
+
 /*
  * shrink_list adds the number of reclaimed pages to sc->nr_reclaimed
+ *
+ * Freeable pages of one mapping are collected into a batch and taken out
+ * of the tree together, see remove_mapping_pages().  The batch is pushed
+ * out before anything which may block, so its page locks are not held
+ * across I/O.
  */
 static int shrink_list(struct list_head *page_list, struct scan_control *sc)
 {
 	LIST_HEAD(ret_pages);
 	struct pagevec freed_pvec;
+	struct page *batch[PAGEVEC_SIZE];
+	struct address_space *batch_mapping = NULL;
+	int nr_batch = 0;
 	int pgactivate = 0;
 	int reclaimed = 0;
 
@@ -398,16 +490,23 @@ static int shrink_list(struct list_head *page_list, struct scan_control *sc)
 			goto keep_locked;
 
 		referenced = page_referenced(page, 1, sc->priority <= 0);
-		/* In active use or really unfreeable?  Activate it. */
-		if (referenced && page_mapping_inuse(page))
+		/*
+		 * In active use or really unfreeable?  Activate it.  Not when
+		 * reclaiming a whole block for a costly allocation: one
+		 * referenced page would defeat the rest of the block.
+		 */
+		if (referenced && page_mapping_inuse(page) &&
+		    sc->order <= PAGE_ALLOC_COSTLY_ORDER)
 			goto activate_locked;
 
 #ifdef CONFIG_SWAP
 		/*
 		 * Anonymous process memory has backing store?
-		 * Try to allocate it some swap space here.
+		 * Try to allocate it some swap space here.  Not for
+		 * MADV_FREE pages, which are dropped if still clean.
 		 */
-		if (PageAnon(page) && !PageSwapCache(page)) {
+		if (PageAnon(page) && !PageSwapCache(page) &&
+		    PageSwapBacked(page)) {
 			if (!add_to_swap(page))
 				goto activate_locked;
 		}
@@ -421,8 +520,8 @@ static int shrink_list(struct list_head *page_list, struct scan_control *sc)
 		 * The page is mapped into the page tables of one or more
 		 * processes. Try to unmap it here.
 		 */
-		if (page_mapped(page) && mapping) {
-			switch (try_to_unmap(page)) {
+		if (page_mapped(page) && (mapping || lazyfree_page(page))) {
+			switch (try_to_unmap(page, 0)) {
 			case SWAP_FAIL:
 				goto activate_locked;
 			case SWAP_AGAIN:
@@ -440,6 +539,13 @@ static int shrink_list(struct list_head *page_list, struct scan_control *sc)
 			if (laptop_mode && !sc->may_writepage)
 				goto keep_locked;
 
+			if (nr_batch) {
+				reclaimed += remove_mapping_pages(batch_mapping,
+						batch, nr_batch, &freed_pvec,
+						&ret_pages);
+				nr_batch = 0;
+			}
+
 			/* Page is dirty, try to write it out here */
 			switch(pageout(page, mapping)) {
 			case PAGE_KEEP:
@@ -491,35 +597,23 @@ static int shrink_list(struct list_head *page_list, struct scan_control *sc)
 				goto free_it;
 		}
 
-		if (!mapping)
+		if (!mapping) {
+			/* nobody else can find an unmapped MADV_FREE page */
+			if (lazyfree_page(page) && !page_mapped(page) &&
+			    page_count(page) == 1)
+				goto free_it;
 			goto keep_locked;	/* truncate got there first */
-
-		write_lock_irq(&mapping->tree_lock);
-
-		/*
-		 * The non-racy check for busy page.  It is critical to check
-		 * PageDirty _after_ making sure that the page is freeable and
-		 * not in use by anybody. 	(pagecache + us == 2)
-		 */
-		if (page_count(page) != 2 || PageDirty(page)) {
-			write_unlock_irq(&mapping->tree_lock);
-			goto keep_locked;
 		}
 
-#ifdef CONFIG_SWAP
-		if (PageSwapCache(page)) {
-			swp_entry_t swap = { .val = page->private };
-			__delete_from_swap_cache(page);
-			write_unlock_irq(&mapping->tree_lock);
-			swap_free(swap);
-			__put_page(page);	/* The pagecache ref */
-			goto free_it;
+		if (nr_batch &&
+		    (mapping != batch_mapping || nr_batch == PAGEVEC_SIZE)) {
+			reclaimed += remove_mapping_pages(batch_mapping, batch,
+					nr_batch, &freed_pvec, &ret_pages);
+			nr_batch = 0;
 		}
-#endif /* CONFIG_SWAP */
-
-		__remove_from_page_cache(page);
-		write_unlock_irq(&mapping->tree_lock);
-		__put_page(page);
+		batch_mapping = mapping;
+		batch[nr_batch++] = page;
+		continue;
 
 free_it:
 		unlock_page(page);
@@ -537,6 +631,9 @@ keep:
 		list_add(&page->lru, &ret_pages);
 		BUG_ON(PageLRU(page));
 	}
+	if (nr_batch)
+		reclaimed += remove_mapping_pages(batch_mapping, batch, nr_batch,
+						  &freed_pvec, &ret_pages);
 	list_splice(&ret_pages, page_list);
 	if (pagevec_count(&freed_pvec))
 		__pagevec_release_nonlru(&freed_pvec);
@@ -545,6 +642,46 @@ keep:
 	return reclaimed;
 }
 
+/*
+ * Lumpy reclaim: @page has just been taken off its LRU list; take the
+ * other pages of its order-@order aligned block off the same list too.
+ * Pages that are off the LRU, on another list, or being freed are
+ * left alone.  Called with the zone's lru_lock held, which keeps PG_lru
+ * stable.  Returns the number of extra pages moved onto @dst.
+ */
+static int isolate_lru_block(struct page *page, struct list_head *dst,
+			     int order)
+{
+	struct zone *zone = page_zone(page);
+	enum lru_list l = page_lru(page);
+	unsigned long pfn = page_to_pfn(page);
+	unsigned long start = pfn & ~((1UL << order) - 1);
+	unsigned long end = start + (1UL << order);
+	int nr_taken = 0;
+
+	for (pfn = start; pfn < end; pfn++) {
+		struct page *cursor;
+
+		if (!pfn_valid(pfn))
+			continue;
+		cursor = pfn_to_page(pfn);
+		if (cursor == page || page_zone(cursor) != zone)
+			continue;
+		if (!PageLRU(cursor) || page_lru(cursor) != l)
+			continue;
+		if (get_page_testone(cursor)) {
+			/* It is being freed elsewhere */
+			__put_page(cursor);
+			continue;
+		}
+		if (!TestClearPageLRU(cursor))
+			BUG();
+		list_move(&cursor->lru, dst);
+		nr_taken++;
+	}
+	return nr_taken;
+}
+
 /*
  * zone->lru_lock is heavily contended.  Some of the functions that
  * shrink the lists perform better by taking out a batch of pages
@@ -559,11 +696,16 @@ keep:
  * @src:	The LRU list to pull pages off.
  * @dst:	The temp list to put pages on to.
  * @scanned:	The number of pages that were scanned.
+ * @order:	The order of the allocation being reclaimed for.
+ *
+ * For a higher-order allocation, each page taken brings along the other
+ * pages of its naturally aligned block (see isolate_lru_block()), so that
+ * reclaim frees contiguous blocks rather than scattered pages.
  *
  * returns how many pages were moved onto *@dst.
  */
 static int isolate_lru_pages(int nr_to_scan, struct list_head *src,
-			     struct list_head *dst, int *scanned)
+			     struct list_head *dst, int *scanned, int order)
 {
 	int nr_taken = 0;
 	struct page *page;
@@ -587,6 +729,8 @@ static int isolate_lru_pages(int nr_to_scan, struct list_head *src,
 		} else {
 			list_add(&page->lru, dst);
 			nr_taken++;
+			if (order)
+				nr_taken += isolate_lru_block(page, dst, order);
 		}
 	}
 
@@ -595,13 +739,15 @@ static int isolate_lru_pages(int nr_to_scan, struct list_head *src,
 }
 
 /*
- * shrink_cache() adds the number of pages reclaimed to sc->nr_reclaimed
+ * shrink_cache() scans the zone's inactive anon or file list and adds the
+ * number of pages reclaimed to sc->nr_reclaimed
  */
-static void shrink_cache(struct zone *zone, struct scan_control *sc)
+static void shrink_cache(struct zone *zone, struct scan_control *sc, int file)
 {
 	LIST_HEAD(page_list);
 	struct pagevec pvec;
 	int max_scan = sc->nr_to_scan;
+	enum lru_list l = file ? LRU_INACTIVE_FILE : LRU_INACTIVE_ANON;
 
 	pagevec_init(&pvec, 1);
 
@@ -614,10 +760,11 @@ static void shrink_cache(struct zone *zone, struct scan_control *sc)
 		int nr_freed;
 
 		nr_taken = isolate_lru_pages(sc->swap_cluster_max,
-					     &zone->inactive_list,
-					     &page_list, &nr_scan);
-		zone->nr_inactive -= nr_taken;
+					     &zone->lru[l],
+					     &page_list, &nr_scan, sc->order);
+		zone->nr_lru[l] -= nr_taken;
 		zone->pages_scanned += nr_scan;
+		zone->recent_scanned[file] += nr_taken;
 		spin_unlock_irq(&zone->lru_lock);
 
 		if (nr_taken == 0)
@@ -643,9 +790,10 @@ static void shrink_cache(struct zone *zone, struct scan_control *sc)
 			if (TestSetPageLRU(page))
 				BUG();
 			list_del(&page->lru);
-			if (PageActive(page))
+			if (PageActive(page)) {
 				add_page_to_active_list(zone, page);
-			else
+				zone->recent_rotated[file]++;
+			} else
 				add_page_to_inactive_list(zone, page);
 			if (!pagevec_add(&pvec, page)) {
 				spin_unlock_irq(&zone->lru_lock);
@@ -660,10 +808,13 @@ done:
 }
 
 /*
- * This moves pages from the active list to the inactive list.
+ * This moves pages from the zone's active anon or file list to the matching
+ * inactive list.
  *
  * We move them the other way if the page is referenced by one or more
- * processes, from rmap.
+ * processes, from rmap.  Mapped file pages are only considered once reclaim
+ * is in enough distress to start unmapping them; anonymous pages come here
+ * only when shrink_zone() has decided that they are worth scanning at all.
  *
  * If the pages are mostly unmapped, the processing is fast and it is
  * appropriate to hold zone->lru_lock across the whole operation.  But if
@@ -677,7 +828,7 @@ done:
  * But we had to alter page->flags anyway.
  */
 static void
-refill_inactive_zone(struct zone *zone, struct scan_control *sc)
+refill_inactive_zone(struct zone *zone, struct scan_control *sc, int file)
 {
 	int pgmoved;
 	int pgdeactivate = 0;
@@ -692,13 +843,16 @@ refill_inactive_zone(struct zone *zone, struct scan_control *sc)
 	long mapped_ratio;
 	long distress;
 	long swap_tendency;
+	enum lru_list lru = file ? LRU_INACTIVE_FILE : LRU_INACTIVE_ANON;
+	int pgrotated = 0;
 
 	lru_add_drain();
 	spin_lock_irq(&zone->lru_lock);
-	pgmoved = isolate_lru_pages(nr_pages, &zone->active_list,
-				    &l_hold, &pgscanned);
+	pgmoved = isolate_lru_pages(nr_pages, &zone->lru[lru + LRU_ACTIVE],
+				    &l_hold, &pgscanned, 0);
 	zone->pages_scanned += pgscanned;
-	zone->nr_active -= pgmoved;
+	zone->nr_lru[lru + LRU_ACTIVE] -= pgmoved;
+	zone->recent_scanned[file] += pgmoved;
 	spin_unlock_irq(&zone->lru_lock);
 
 	/*
@@ -737,12 +891,15 @@ refill_inactive_zone(struct zone *zone, struct scan_control *sc)
 		page = lru_to_page(&l_hold);
 		list_del(&page->lru);
 		if (page_mapped(page)) {
-			if (!reclaim_mapped ||
-			    (total_swap_pages == 0 && PageAnon(page)) ||
-			    page_referenced(page, 0, sc->priority <= 0)) {
+			if (file && !reclaim_mapped) {
 				list_add(&page->lru, &l_active);
 				continue;
 			}
+			if (page_referenced(page, 0, sc->priority <= 0)) {
+				list_add(&page->lru, &l_active);
+				pgrotated++;
+				continue;
+			}
 		}
 		list_add(&page->lru, &l_inactive);
 	}
@@ -757,10 +914,10 @@ refill_inactive_zone(struct zone *zone, struct scan_control *sc)
 			BUG();
 		if (!TestClearPageActive(page))
 			BUG();
-		list_move(&page->lru, &zone->inactive_list);
+		list_move(&page->lru, &zone->lru[lru]);
 		pgmoved++;
 		if (!pagevec_add(&pvec, page)) {
-			zone->nr_inactive += pgmoved;
+			zone->nr_lru[lru] += pgmoved;
 			spin_unlock_irq(&zone->lru_lock);
 			pgdeactivate += pgmoved;
 			pgmoved = 0;
@@ -770,7 +927,7 @@ refill_inactive_zone(struct zone *zone, struct scan_control *sc)
 			spin_lock_irq(&zone->lru_lock);
 		}
 	}
-	zone->nr_inactive += pgmoved;
+	zone->nr_lru[lru] += pgmoved;
 	pgdeactivate += pgmoved;
 	if (buffer_heads_over_limit) {
 		spin_unlock_irq(&zone->lru_lock);
@@ -785,17 +942,18 @@ refill_inactive_zone(struct zone *zone, struct scan_control *sc)
 		if (TestSetPageLRU(page))
 			BUG();
 		BUG_ON(!PageActive(page));
-		list_move(&page->lru, &zone->active_list);
+		list_move(&page->lru, &zone->lru[lru + LRU_ACTIVE]);
 		pgmoved++;
 		if (!pagevec_add(&pvec, page)) {
-			zone->nr_active += pgmoved;
+			zone->nr_lru[lru + LRU_ACTIVE] += pgmoved;
 			pgmoved = 0;
 			spin_unlock_irq(&zone->lru_lock);
 			__pagevec_release(&pvec);
 			spin_lock_irq(&zone->lru_lock);
 		}
 	}
-	zone->nr_active += pgmoved;
+	zone->nr_lru[lru + LRU_ACTIVE] += pgmoved;
+	zone->recent_rotated[file] += pgrotated;
 	spin_unlock_irq(&zone->lru_lock);
 	pagevec_release(&pvec);
 
@@ -803,51 +961,130 @@ refill_inactive_zone(struct zone *zone, struct scan_control *sc)
 	mod_page_state(pgdeactivate, pgdeactivate);
 }
 
+/*
+ * Pages on the anon lists can only be reclaimed while there is swap to put
+ * them in; the file lists are always reclaimable.
+ */
+static unsigned long zone_reclaimable_pages(struct zone *zone)
+{
+	unsigned long nr;
+
+	nr = zone->nr_lru[LRU_ACTIVE_FILE] + zone->nr_lru[LRU_INACTIVE_FILE];
+	if (nr_swap_pages > 0)
+		nr += zone->nr_lru[LRU_ACTIVE_ANON] +
+			zone->nr_lru[LRU_INACTIVE_ANON];
+	return nr;
+}
+
+/*
+ * Decide how to split the scanning pressure on a zone between its anon and
+ * file lists.  vm_swappiness sets a bias (0: file only, 100: even), which is
+ * then scaled by how much of what reclaim recently scanned of each kind was
+ * not put straight back on the active list - a kind whose pages keep being
+ * found in use is expensive to scan and gets less pressure.  percent[0] is
+ * for anon, percent[1] for file; they add up to 100.
+ */
+static void get_scan_ratio(struct zone *zone, unsigned long *percent)
+{
+	unsigned long anon, file;
+	unsigned long anon_prio, file_prio;
+	unsigned long ap, fp;
+
+	/* Without swap there is no point in scanning anon pages at all */
+	if (nr_swap_pages <= 0) {
+		percent[0] = 0;
+		percent[1] = 100;
+		return;
+	}
+
+	anon = zone->nr_lru[LRU_ACTIVE_ANON] + zone->nr_lru[LRU_INACTIVE_ANON];
+	file = zone->nr_lru[LRU_ACTIVE_FILE] + zone->nr_lru[LRU_INACTIVE_FILE];
+
+	/*
+	 * Keep the history to about a quarter of each list's size, so that
+	 * it follows changes in the workload.
+	 */
+	if (unlikely(zone->recent_scanned[0] > anon / 4 ||
+		     zone->recent_scanned[1] > file / 4)) {
+		spin_lock_irq(&zone->lru_lock);
+		if (zone->recent_scanned[0] > anon / 4) {
+			zone->recent_scanned[0] /= 2;
+			zone->recent_rotated[0] /= 2;
+		}
+		if (zone->recent_scanned[1] > file / 4) {
+			zone->recent_scanned[1] /= 2;
+			zone->recent_rotated[1] /= 2;
+		}
+		spin_unlock_irq(&zone->lru_lock);
+	}
+
+	anon_prio = vm_swappiness;
+	file_prio = 200 - vm_swappiness;
+
+	ap = (anon_prio + 1) * (zone->recent_scanned[0] + 1);
+	ap /= zone->recent_rotated[0] + 1;
+	fp = (file_prio + 1) * (zone->recent_scanned[1] + 1);
+	fp /= zone->recent_rotated[1] + 1;
+
+	percent[0] = 100 * ap / (ap + fp + 1);
+	percent[1] = 100 - percent[0];
+}
+
 /*
  * This is a basic per-zone page freer.  Used by both kswapd and direct reclaim.
+ *
+ * Each of the zone's four LRU lists gets its own scan count, so the cost of
+ * a pass is proportional to the pages reclaim is aiming at rather than to
+ * everything on the LRU.
  */
 static void
 shrink_zone(struct zone *zone, struct scan_control *sc)
 {
-	unsigned long nr_active;
-	unsigned long nr_inactive;
+	unsigned long nr[NR_LRU_LISTS];
+	unsigned long percent[2];
+	enum lru_list l;
 
-	/*
-	 * Add one to `nr_to_scan' just to make sure that the kernel will
-	 * slowly sift through the active list.
-	 */
-	zone->nr_scan_active += (zone->nr_active >> sc->priority) + 1;
-	nr_active = zone->nr_scan_active;
-	if (nr_active >= sc->swap_cluster_max)
-		zone->nr_scan_active = 0;
-	else
-		nr_active = 0;
-
-	zone->nr_scan_inactive += (zone->nr_inactive >> sc->priority) + 1;
-	nr_inactive = zone->nr_scan_inactive;
-	if (nr_inactive >= sc->swap_cluster_max)
-		zone->nr_scan_inactive = 0;
-	else
-		nr_inactive = 0;
+	get_scan_ratio(zone, percent);
 
-	sc->nr_to_reclaim = sc->swap_cluster_max;
+	for_each_lru(l) {
+		int file = is_file_lru(l);
+		unsigned long scan;
 
-	while (nr_active || nr_inactive) {
-		if (nr_active) {
-			sc->nr_to_scan = min(nr_active,
-					(unsigned long)sc->swap_cluster_max);
-			nr_active -= sc->nr_to_scan;
-			refill_inactive_zone(zone, sc);
+		if (!percent[file]) {
+			nr[l] = 0;
+			continue;
 		}
 
-		if (nr_inactive) {
-			sc->nr_to_scan = min(nr_inactive,
+		/*
+		 * Add one to the scan count just to make sure that the kernel
+		 * will slowly sift through each list.
+		 */
+		scan = (zone->nr_lru[l] >> sc->priority) * percent[file] / 100;
+		zone->nr_scan[l] += scan + 1;
+		nr[l] = zone->nr_scan[l];
+		if (nr[l] >= sc->swap_cluster_max)
+			zone->nr_scan[l] = 0;
+		else
+			nr[l] = 0;
+	}
+
+	sc->nr_to_reclaim = sc->swap_cluster_max;
+
+	while (nr[LRU_ACTIVE_ANON] || nr[LRU_INACTIVE_ANON] ||
+	       nr[LRU_ACTIVE_FILE] || nr[LRU_INACTIVE_FILE]) {
+		for_each_lru(l) {
+			if (!nr[l])
+				continue;
+			sc->nr_to_scan = min(nr[l],
 					(unsigned long)sc->swap_cluster_max);
-			nr_inactive -= sc->nr_to_scan;
-			shrink_cache(zone, sc);
-			if (sc->nr_to_reclaim <= 0)
-				break;
+			nr[l] -= sc->nr_to_scan;
+			if (is_active_lru(l))
+				refill_inactive_zone(zone, sc, is_file_lru(l));
+			else
+				shrink_cache(zone, sc, is_file_lru(l));
 		}
+		if (sc->nr_to_reclaim <= 0)
+			break;
 	}
 
 	throttle_vm_writeout();
@@ -919,6 +1156,7 @@ int try_to_free_pages(struct zone **zones,
 	int i;
 
 	sc.gfp_mask = gfp_mask;
+	sc.order = order;
 	sc.may_writepage = 0;
 
 	inc_page_state(allocstall);
@@ -930,7 +1168,7 @@ int try_to_free_pages(struct zone **zones,
 			continue;
 
 		zone->temp_priority = DEF_PRIORITY;
-		lru_pages += zone->nr_active + zone->nr_inactive;
+		lru_pages += zone_reclaimable_pages(zone);
 	}
 
 	for (priority = DEF_PRIORITY; priority >= 0; priority--) {
@@ -1019,6 +1257,7 @@ loop_again:
 	total_scanned = 0;
 	total_reclaimed = 0;
 	sc.gfp_mask = GFP_KERNEL;
+	sc.order = order;
 	sc.may_writepage = 0;
 	sc.nr_mapped = read_page_state(nr_mapped);
 
@@ -1065,7 +1304,7 @@ scan:
 		for (i = 0; i <= end_zone; i++) {
 			struct zone *zone = pgdat->node_zones + i;
 
-			lru_pages += zone->nr_active + zone->nr_inactive;
+			lru_pages += zone_reclaimable_pages(zone);
 		}
 
 		/*
@@ -1106,8 +1345,8 @@ scan:
 			total_scanned += sc.nr_scanned;
 			if (zone->all_unreclaimable)
 				continue;
-			if (zone->pages_scanned >= (zone->nr_active +
-							zone->nr_inactive) * 4)
+			if (zone->pages_scanned >=
+					zone_reclaimable_pages(zone) * 4)
 				zone->all_unreclaimable = 1;
 			/*
 			 * If we've done a decent amount of scanning and
@@ -71,12 +71,12 @@ void br_fdb_changeaddr(struct net_bridge_port *p, const unsigned char *newaddr)
 {
 	struct net_bridge *br = p->br;
 	int i;
-	
-	spin_lock_bh(&br->hash_lock);
 
 	/* Search all chains since old address/hash is unknown */
 	for (i = 0; i < BR_HASH_SIZE; i++) {
 		struct hlist_node *h;
+
+		spin_lock_bh(&br->hash_lock[i]);
 		hlist_for_each(h, &br->hash[i]) {
 			struct net_bridge_fdb_entry *f;
 
@@ -89,21 +89,23 @@ void br_fdb_changeaddr(struct net_bridge_port *p, const unsigned char *newaddr)
 					    !memcmp(op->dev->dev_addr,
 						    f->addr.addr, ETH_ALEN)) {
 						f->dst = op;
-						goto insert;
+						goto unlock;
 					}
 				}
 
 				/* delete old one */
 				fdb_delete(f);
-				goto insert;
+				goto unlock;
 			}
 		}
+		spin_unlock_bh(&br->hash_lock[i]);
 	}
+	goto insert;
+ unlock:
+	spin_unlock_bh(&br->hash_lock[i]);
  insert:
 	/* insert new address,  may fail if invalid address or dup. */
-	fdb_insert(br, p, newaddr);
-
-	spin_unlock_bh(&br->hash_lock);
+	br_fdb_insert(br, p, newaddr);
 }
 
 void br_fdb_cleanup(unsigned long _data)
@@ -112,18 +114,20 @@ void br_fdb_cleanup(unsigned long _data)
 	unsigned long delay = hold_time(br);
 	int i;
 
-	spin_lock_bh(&br->hash_lock);
 	for (i = 0; i < BR_HASH_SIZE; i++) {
 		struct net_bridge_fdb_entry *f;
 		struct hlist_node *h, *n;
 
+		if (hlist_empty(&br->hash[i]))
+			continue;
+		spin_lock_bh(&br->hash_lock[i]);
 		hlist_for_each_entry_safe(f, h, n, &br->hash[i], hlist) {
 			if (!f->is_static && 
 			    time_before_eq(f->ageing_timer + delay, jiffies)) 
 				fdb_delete(f);
 		}
+		spin_unlock_bh(&br->hash_lock[i]);
 	}
-	spin_unlock_bh(&br->hash_lock);
 
 	mod_timer(&br->gc_timer, jiffies + HZ/10);
 }
@@ -132,10 +136,10 @@ void br_fdb_delete_by_port(struct net_bridge *br, struct net_bridge_port *p)
 {
 	int i;
 
-	spin_lock_bh(&br->hash_lock);
 	for (i = 0; i < BR_HASH_SIZE; i++) {
 		struct hlist_node *h, *g;
-		
+
+		spin_lock_bh(&br->hash_lock[i]);
 		hlist_for_each_safe(h, g, &br->hash[i]) {
 			struct net_bridge_fdb_entry *f
 				= hlist_entry(h, struct net_bridge_fdb_entry, hlist);
@@ -162,8 +166,8 @@ void br_fdb_delete_by_port(struct net_bridge *br, struct net_bridge_port *p)
 			fdb_delete(f);
 		skip_delete: ;
 		}
+		spin_unlock_bh(&br->hash_lock[i]);
 	}
-	spin_unlock_bh(&br->hash_lock);
 }
 
 /* No locking or refcounting, assumes caller has no preempt (rcu_read_lock) */
@@ -291,6 +295,7 @@ static struct net_bridge_fdb_entry *fdb_create(struct hlist_head *head,
 	return fdb;
 }
 
+/* Called with the hash_lock of the chain of addr */
 static int fdb_insert(struct net_bridge *br, struct net_bridge_port *source,
 		  const unsigned char *addr)
 {
@@ -323,18 +328,19 @@ static int fdb_insert(struct net_bridge *br, struct net_bridge_port *source,
 int br_fdb_insert(struct net_bridge *br, struct net_bridge_port *source,
 		  const unsigned char *addr)
 {
-	int ret;
+	int ret, hash = br_mac_hash(addr);
 
-	spin_lock_bh(&br->hash_lock);
+	spin_lock_bh(&br->hash_lock[hash]);
 	ret = fdb_insert(br, source, addr);
-	spin_unlock_bh(&br->hash_lock);
+	spin_unlock_bh(&br->hash_lock[hash]);
 	return ret;
 }
 
 void br_fdb_update(struct net_bridge *br, struct net_bridge_port *source,
 		   const unsigned char *addr)
 {
-	struct hlist_head *head = &br->hash[br_mac_hash(addr)];
+	int hash = br_mac_hash(addr);
+	struct hlist_head *head = &br->hash[hash];
 	struct net_bridge_fdb_entry *fdb;
 
 	/* some users want to always flood. */
@@ -351,18 +357,23 @@ void br_fdb_update(struct net_bridge *br, struct net_bridge_port *source,
 				       " own address as source address\n",
 				       source->dev->name);
 		} else {
-			/* fastpath: update of existing entry */
-			fdb->dst = source;
-			fdb->ageing_timer = jiffies;
+			/* fastpath: update of existing entry, which only
+			 * needs writing, and its cacheline taking from the
+			 * other CPUs, once a jiffy or when the host moved.
+			 */
+			if (unlikely(fdb->dst != source))
+				fdb->dst = source;
+			if (fdb->ageing_timer != jiffies)
+				fdb->ageing_timer = jiffies;
 		}
 	} else {
-		spin_lock_bh(&br->hash_lock);
+		spin_lock_bh(&br->hash_lock[hash]);
 		if (!fdb_find(head, addr))
 			fdb_create(head, source, addr, 0);
 		/* else  we lose race and someone else inserts
 		 * it first, don't bother updating
 		 */
-		spin_unlock_bh(&br->hash_lock);
+		spin_unlock_bh(&br->hash_lock[hash]);
 	}
 	rcu_read_unlock();
 }
@@ -137,6 +137,7 @@ static struct net_device *new_bridge_dev(const char *name)
 {
 	struct net_bridge *br;
 	struct net_device *dev;
+	int i;
 
 	dev = alloc_netdev(sizeof(struct net_bridge), name,
 			   br_dev_setup);
@@ -149,7 +150,8 @@ static struct net_device *new_bridge_dev(const char *name)
 
 	spin_lock_init(&br->lock);
 	INIT_LIST_HEAD(&br->port_list);
-	spin_lock_init(&br->hash_lock);
+	for (i = 0; i < BR_HASH_SIZE; i++)
+		spin_lock_init(&br->hash_lock[i]);
 
 	br->bridge_id.prio[0] = 0x80;
 	br->bridge_id.prio[1] = 0x00;
@@ -87,7 +87,8 @@ struct net_bridge
 	struct list_head		port_list;
 	struct net_device		*dev;
 	struct net_device_stats		statistics;
-	spinlock_t			hash_lock;
+	/* one lock per chain for changes, lookups are RCU */
+	spinlock_t			hash_lock[BR_HASH_SIZE];
 	struct hlist_head		hash[BR_HASH_SIZE];
 	struct list_head		age_list;
 
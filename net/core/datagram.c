@@ -233,19 +233,32 @@ int skb_copy_datagram_iovec(const struct sk_buff *skb, int offset,
 
 		end = start + skb_shinfo(skb)->frags[i].size;
 		if ((copy = end - offset) > 0) {
-			int err;
+			int err, left;
 			u8  *vaddr;
 			skb_frag_t *frag = &skb_shinfo(skb)->frags[i];
 			struct page *page = frag->page;
 
 			if (copy > len)
 				copy = len;
-			vaddr = kmap(page);
-			err = memcpy_toiovec(to, vaddr + frag->page_offset +
-					     offset - start, copy);
-			kunmap(page);
-			if (err)
-				goto fault;
+			/*
+			 * Try without a kmap() first, they are a global
+			 * resource; what faults is copied with one.
+			 */
+			vaddr = kmap_atomic(page, KM_USER0);
+			left = memcpy_toiovec_inatomic(to, vaddr +
+						       frag->page_offset +
+						       offset - start, copy);
+			kunmap_atomic(vaddr, KM_USER0);
+			if (left) {
+				vaddr = kmap(page);
+				err = memcpy_toiovec(to, vaddr +
+						     frag->page_offset +
+						     offset - start +
+						     copy - left, left);
+				kunmap(page);
+				if (err)
+					goto fault;
+			}
 			if (!(len -= copy))
 				return 0;
 			offset += copy;
@@ -322,14 +335,27 @@ static int skb_copy_and_csum_datagram(const struct sk_buff *skb, int offset,
 
 			if (copy > len)
 				copy = len;
-			vaddr = kmap(page);
+			/*
+			 * The checksum cannot be resumed halfway, so a
+			 * fault under kmap_atomic() redoes the whole frag.
+			 */
+			vaddr = kmap_atomic(page, KM_USER0);
 			csum2 = csum_and_copy_to_user(vaddr +
 							frag->page_offset +
 							offset - start,
 						      to, copy, 0, &err);
-			kunmap(page);
-			if (err)
-				goto fault;
+			kunmap_atomic(vaddr, KM_USER0);
+			if (err) {
+				err = 0;
+				vaddr = kmap(page);
+				csum2 = csum_and_copy_to_user(vaddr +
+							frag->page_offset +
+							offset - start,
+							to, copy, 0, &err);
+				kunmap(page);
+				if (err)
+					goto fault;
+			}
 			*csump = csum_block_add(*csump, csum2, pos);
 			if (!(len -= copy))
 				return 0;
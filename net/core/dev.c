@@ -109,11 +109,19 @@
 #include <linux/netpoll.h>
 #include <linux/rcupdate.h>
 #include <linux/delay.h>
+#include <linux/jhash.h>
+#include <linux/random.h>
+#include <linux/err.h>
+#include <net/ip.h>
 #ifdef CONFIG_NET_RADIO
 #include <linux/wireless.h>		/* Note : will define WIRELESS_EXT */
 #include <net/iw_handler.h>
 #endif	/* CONFIG_NET_RADIO */
 #include <asm/current.h>
+#include <trace/net.h>
+
+DEFINE_TRACE(net_dev_queue);
+DEFINE_TRACE(net_dev_receive);
 
 /* This define, if set, will randomly drop a packet when congestion
  * is more than moderate.  It helps fairness in the multi-interface
@@ -1189,6 +1197,171 @@ int __skb_linearize(struct sk_buff *skb, int gfp_mask)
 	return 0;
 }
 
+/**
+ *	skb_gso_segment - Perform segmentation on skb.
+ *	@skb: buffer to segment
+ *	@features: features for the output path (see dev->features)
+ *
+ *	This function segments the given skb and returns a list of segments.
+ *	The protocol handler for skb->protocol does the real work; the
+ *	network header must already be set in skb->nh.
+ */
+struct sk_buff *skb_gso_segment(struct sk_buff *skb, int features)
+{
+	struct sk_buff *segs = ERR_PTR(-EPROTONOSUPPORT);
+	struct packet_type *ptype;
+	int type = skb->protocol;
+
+	BUG_ON(skb_shinfo(skb)->frag_list);
+
+	skb->mac.raw = skb->data;
+	skb->mac_len = skb->nh.raw - skb->data;
+	__skb_pull(skb, skb->mac_len);
+
+	rcu_read_lock();
+	list_for_each_entry_rcu(ptype, &ptype_base[ntohs(type) & 15], list) {
+		if (ptype->type == type && !ptype->dev && ptype->gso_segment) {
+			segs = ptype->gso_segment(skb, features);
+			break;
+		}
+	}
+	rcu_read_unlock();
+
+	__skb_push(skb, skb->data - skb->mac.raw);
+
+	return segs;
+}
+
+/* The original skb stays around, holding the socket send buffer
+ * accounting, until its last segment has been handed to the driver.
+ * The segments hang off skb->next and the original destructor is
+ * parked in the control block.
+ */
+struct dev_gso_cb {
+	void (*destructor)(struct sk_buff *skb);
+};
+
+#define DEV_GSO_CB(skb) ((struct dev_gso_cb *)(skb)->cb)
+
+static void dev_gso_skb_destructor(struct sk_buff *skb)
+{
+	struct dev_gso_cb *cb;
+
+	do {
+		struct sk_buff *nskb = skb->next;
+
+		skb->next = nskb->next;
+		nskb->next = NULL;
+		kfree_skb(nskb);
+	} while (skb->next);
+
+	cb = DEV_GSO_CB(skb);
+	if (cb->destructor)
+		cb->destructor(skb);
+}
+
+static int dev_gso_segment(struct sk_buff *skb)
+{
+	struct net_device *dev = skb->dev;
+	struct sk_buff *segs;
+	int features = dev->features;
+
+	/* Segments that share pages with the original must be
+	 * reachable by the device and are left for it to checksum,
+	 * otherwise copy them out and checksum them here.
+	 */
+	if (illegal_highdma(dev, skb) ||
+	    (!(features & (NETIF_F_HW_CSUM | NETIF_F_NO_CSUM)) &&
+	     (!(features & NETIF_F_IP_CSUM) ||
+	      skb->protocol != htons(ETH_P_IP))))
+		features &= ~NETIF_F_SG;
+
+	segs = skb_gso_segment(skb, features);
+	if (unlikely(IS_ERR(segs)))
+		return PTR_ERR(segs);
+
+	skb->next = segs;
+	DEV_GSO_CB(skb)->destructor = skb->destructor;
+	skb->destructor = dev_gso_skb_destructor;
+
+	return 0;
+}
+
+/**
+ *	dev_hard_start_xmit - hand a buffer to the driver
+ *	@skb: buffer to transmit
+ *	@dev: device to transmit on
+ *
+ *	Large sends the device cannot segment are split here. If the driver
+ *	refuses a segment, the rest stay linked to @skb and the non-zero
+ *	driver return code is passed up so that the caller can retry @skb
+ *	later. The caller must hold the device transmit lock.
+ */
+int dev_hard_start_xmit(struct sk_buff *skb, struct net_device *dev)
+{
+	if (likely(!skb->next)) {
+		if (netdev_nit)
+			dev_queue_xmit_nit(skb, dev);
+
+		if (netif_needs_gso(dev, skb)) {
+			if (unlikely(dev_gso_segment(skb)))
+				goto out_kfree_skb;
+			if (skb->next)
+				goto gso;
+		}
+
+		return dev->hard_start_xmit(skb, dev);
+	}
+
+gso:
+	do {
+		struct sk_buff *nskb = skb->next;
+		int rc;
+
+		skb->next = nskb->next;
+		nskb->next = NULL;
+		nskb->queue_mapping = skb->queue_mapping;
+		rc = dev->hard_start_xmit(nskb, dev);
+		if (unlikely(rc)) {
+			nskb->next = skb->next;
+			skb->next = nskb;
+			return rc;
+		}
+		if (unlikely(netif_tx_stopped(dev, skb) && skb->next))
+			return NETDEV_TX_BUSY;
+	} while (skb->next);
+
+	skb->destructor = DEV_GSO_CB(skb)->destructor;
+
+out_kfree_skb:
+	kfree_skb(skb);
+	return NETDEV_TX_OK;
+}
+
+/*
+ * Hand skb to a multiqueue device on its hardware queue, holding only
+ * that queue's lock.  Returns NETDEV_TX_OK if the driver took the skb;
+ * otherwise the skb is left to the caller.
+ */
+static int dev_subqueue_xmit(struct sk_buff *skb, struct net_device *dev)
+{
+	struct net_device_subqueue *sq = &dev->egress_subqueue[skb->queue_mapping];
+	int cpu = smp_processor_id(); /* ok because BHs are off */
+	int rc = NETDEV_TX_BUSY;
+
+	/* Recursion goes the slow way, qdisc_restart() catches dead loops */
+	if (sq->xmit_lock_owner == cpu)
+		return rc;
+
+	spin_lock(&sq->xmit_lock);
+	sq->xmit_lock_owner = cpu;
+	if (!netif_tx_stopped(dev, skb))
+		rc = dev_hard_start_xmit(skb, dev);
+	sq->xmit_lock_owner = -1;
+	spin_unlock(&sq->xmit_lock);
+	return rc;
+}
+
 #define HARD_TX_LOCK(dev, cpu) {			\
 	if ((dev->features & NETIF_F_LLTX) == 0) {	\
 		spin_lock(&dev->xmit_lock);		\
@@ -1222,11 +1395,20 @@ int dev_queue_xmit(struct sk_buff *skb)
 	struct Qdisc *q;
 	int rc = -ENOMEM;
 
+	trace_net_dev_queue(skb);
+
 	if (skb_shinfo(skb)->frag_list &&
-	    !(dev->features & NETIF_F_FRAGLIST) &&
+	    (!(dev->features & NETIF_F_FRAGLIST) ||
+	     netif_needs_gso(dev, skb)) &&
 	    __skb_linearize(skb, GFP_ATOMIC))
 		goto out_kfree_skb;
 
+	/* Large sends are segmented right before the driver sees them,
+	 * and every segment gets pages and checksum the device can take.
+	 */
+	if (netif_needs_gso(dev, skb))
+		goto gso;
+
 	/* Fragmented skb is linearized if device does not support SG,
 	 * or if at least one of fragments is in highmem and device
 	 * does not support DMA from it.
@@ -1246,6 +1428,8 @@ int dev_queue_xmit(struct sk_buff *skb)
 	      	if (skb_checksum_help(skb, 0))
 	      		goto out_kfree_skb;
 
+gso:
+
 	/* Disable soft irqs for various locks below. Also 
 	 * stops preemption for RCU. 
 	 */
@@ -1267,6 +1451,25 @@ int dev_queue_xmit(struct sk_buff *skb)
 #ifdef CONFIG_NET_CLS_ACT
 	skb->tc_verd = SET_TC_AT(skb->tc_verd,AT_EGRESS);
 #endif
+	if (dev->features & NETIF_F_MULTI_QUEUE) {
+		/* Each cpu sends on its own hardware queue */
+		skb->queue_mapping = smp_processor_id() %
+				     dev->egress_subqueue_count;
+
+		/* While the default qdisc holds nothing, it would hand the
+		 * skb on at once: skip it and dev->queue_lock.  A queue
+		 * being filled meanwhile only reorders against other cpus.
+		 * The skb is not counted in the qdisc statistics then.
+		 */
+		if ((q->flags & TCQ_F_CAN_BYPASS) && !q->q.qlen &&
+		    !dev->gso_skb && !netif_needs_gso(dev, skb) &&
+		    (dev->flags & IFF_UP) &&
+		    dev_subqueue_xmit(skb, dev) == NETDEV_TX_OK) {
+			rc = NET_XMIT_SUCCESS;
+			goto out;
+		}
+	}
+
 	if (q->enqueue) {
 		/* Grab device queue */
 		spin_lock(&dev->queue_lock);
@@ -1300,11 +1503,8 @@ int dev_queue_xmit(struct sk_buff *skb)
 			HARD_TX_LOCK(dev, cpu);
 
 			if (!netif_queue_stopped(dev)) {
-				if (netdev_nit)
-					dev_queue_xmit_nit(skb, dev);
-
 				rc = 0;
-				if (!dev->hard_start_xmit(skb, dev)) {
+				if (!dev_hard_start_xmit(skb, dev)) {
 					HARD_TX_UNLOCK(dev);
 					goto out;
 				}
@@ -1340,6 +1540,7 @@ out:
 
 int netdev_max_backlog = 300;
 int weight_p = 64;            /* old backlog weight */
+int netdev_rx_steering;       /* spread NAPI receive work over CPUs */
 /* These numbers are selected based on intuition and some
  * experimentatiom, if you have more scientific way of doing this
  * please go ahead and fix things.
@@ -1441,6 +1642,8 @@ int netif_rx(struct sk_buff *skb)
 	local_irq_save(flags);
 	this_cpu = smp_processor_id();
 	queue = &__get_cpu_var(softnet_data);
+	/* Other CPUs may steer packets onto our queue. */
+	spin_lock(&queue->input_pkt_queue.lock);
 
 	__get_cpu_var(netdev_rx_stat).total++;
 	if (queue->input_pkt_queue.qlen <= netdev_max_backlog) {
@@ -1454,6 +1657,7 @@ enqueue:
 #ifndef OFFLINE_SAMPLE
 			get_sample_stats(this_cpu);
 #endif
+			spin_unlock(&queue->input_pkt_queue.lock);
 			local_irq_restore(flags);
 			return queue->cng_level;
 		}
@@ -1472,6 +1676,7 @@ enqueue:
 
 drop:
 	__get_cpu_var(netdev_rx_stat).dropped++;
+	spin_unlock(&queue->input_pkt_queue.lock);
 	local_irq_restore(flags);
 
 	kfree_skb(skb);
@@ -1624,12 +1829,151 @@ static int ing_filter(struct sk_buff *skb)
 }
 #endif
 
-int netif_receive_skb(struct sk_buff *skb)
+#ifdef CONFIG_SMP
+/*
+ * Receive steering.  A NIC with a single receive queue interrupts one
+ * CPU, which then does all of the protocol work for every flow.  When
+ * netdev_rx_steering is set, netif_receive_skb() hashes the IPv4 flow
+ * tuple of packets coming in through NAPI and hands the packet to the
+ * backlog queue of the CPU that owns the flow, so that per-flow ordering
+ * is kept and the protocol processing scales with the number of CPUs.
+ *
+ * Remote CPUs are kicked in a batch from the end of net_rx_action():
+ * each CPU collects in rx_steer_pending the CPUs whose backlog went from
+ * empty to non-empty, and a single cross call then schedules the backlog
+ * device on every CPU that has packets waiting.
+ */
+static u32 rx_steer_rnd;
+static int rx_steer_map[NR_CPUS];
+static int rx_steer_count;
+static DEFINE_SPINLOCK(rx_steer_lock);
+static DEFINE_PER_CPU(cpumask_t, rx_steer_pending);
+
+static void rx_steer_build_map(void)
 {
-	struct packet_type *ptype, *pt_prev;
-	int ret = NET_RX_DROP;
-	unsigned short type;
+	int cpu, n = 0;
+
+	spin_lock(&rx_steer_lock);
+	for_each_online_cpu(cpu)
+		rx_steer_map[n++] = cpu;
+	rx_steer_count = n;
+	spin_unlock(&rx_steer_lock);
+}
+
+static u32 rx_steer_hash(struct sk_buff *skb)
+{
+	struct iphdr *iph;
+	u32 ports = 0;
+
+	if (skb->protocol != htons(ETH_P_IP) ||
+	    !pskb_may_pull(skb, sizeof(struct iphdr)))
+		return 0;
+
+	iph = (struct iphdr *)skb->data;
+	if (iph->ihl < 5)
+		return 0;
+
+	if (!(iph->frag_off & htons(IP_MF|IP_OFFSET)) &&
+	    (iph->protocol == IPPROTO_TCP || iph->protocol == IPPROTO_UDP) &&
+	    pskb_may_pull(skb, iph->ihl * 4 + 4)) {
+		iph = (struct iphdr *)skb->data;
+		ports = *(u32 *)(skb->data + iph->ihl * 4);
+	}
+
+	return jhash_3words(iph->saddr, iph->daddr, ports ^ iph->protocol,
+			    rx_steer_rnd);
+}
+
+/*
+ * Pick the CPU that should run the protocol stack for this packet,
+ * or -1 to process it right here.
+ */
+static int rx_steer_cpu(struct sk_buff *skb)
+{
+	int count = rx_steer_count;
+	int cpu;
+	u32 hash;
+
+	if (count <= 1)
+		return -1;
+
+	hash = rx_steer_hash(skb);
+	if (!hash)
+		return -1;
+
+	cpu = rx_steer_map[hash % count];
+	if (cpu == smp_processor_id())
+		return -1;
+	return cpu;
+}
+
+/*
+ * Queue the packet on the backlog of @cpu.  Returns -1 if @cpu went
+ * offline under us and the caller has to process the packet itself.
+ */
+static int rx_steer_enqueue(struct sk_buff *skb, int cpu)
+{
+	struct softnet_data *queue = &per_cpu(softnet_data, cpu);
+	unsigned long flags;
+	int kick;
+
+	spin_lock_irqsave(&queue->input_pkt_queue.lock, flags);
+	/* dev_cpu_callback() drains a dead CPU's queue under this lock */
+	if (unlikely(!cpu_online(cpu))) {
+		spin_unlock_irqrestore(&queue->input_pkt_queue.lock, flags);
+		return -1;
+	}
+
+	if (queue->input_pkt_queue.qlen > netdev_max_backlog) {
+		spin_unlock_irqrestore(&queue->input_pkt_queue.lock, flags);
+		__get_cpu_var(netdev_rx_stat).dropped++;
+		kfree_skb(skb);
+		return NET_RX_DROP;
+	}
 
+	kick = !queue->input_pkt_queue.qlen;
+	dev_hold(skb->dev);
+	__skb_queue_tail(&queue->input_pkt_queue, skb);
+	spin_unlock_irqrestore(&queue->input_pkt_queue.lock, flags);
+
+	if (kick) {
+		cpu_set(cpu, __get_cpu_var(rx_steer_pending));
+		/* make sure net_rx_action() runs and sends the kick */
+		raise_softirq(NET_RX_SOFTIRQ);
+	}
+	return NET_RX_SUCCESS;
+}
+
+/* Cross call handler: runs on every other CPU in interrupt context. */
+static void rx_steer_kick(void *unused)
+{
+	struct softnet_data *queue = &__get_cpu_var(softnet_data);
+
+	if (queue->input_pkt_queue.qlen)
+		netif_rx_schedule(&queue->backlog_dev);
+}
+
+static void rx_steer_flush(void)
+{
+	cpumask_t *pending = &__get_cpu_var(rx_steer_pending);
+
+	if (likely(cpus_empty(*pending)))
+		return;
+
+	cpus_clear(*pending);
+	smp_call_function(rx_steer_kick, NULL, 0, 0);
+}
+#else
+#define rx_steer_build_map()		do { } while (0)
+#define rx_steer_cpu(skb)		(-1)
+#define rx_steer_enqueue(skb, cpu)	(-1)
+#define rx_steer_flush()		do { } while (0)
+#endif
+
+static int __netif_receive_skb(struct sk_buff *skb);
+
+int netif_receive_skb(struct sk_buff *skb)
+{
 	/* if we've gotten here through NAPI, check netpoll */
 	if (skb->dev->poll && netpoll_rx(skb))
 		return NET_RX_DROP;
@@ -1637,6 +1981,28 @@ int netif_receive_skb(struct sk_buff *skb)
 	if (!skb->stamp.tv_sec)
 		net_timestamp(&skb->stamp);
 
+	trace_net_dev_receive(skb);
+
+	if (netdev_rx_steering && skb->dev->poll) {
+		int cpu = rx_steer_cpu(skb);
+
+		if (cpu >= 0) {
+			int ret = rx_steer_enqueue(skb, cpu);
+
+			if (ret >= 0)
+				return ret;
+		}
+	}
+
+	return __netif_receive_skb(skb);
+}
+
+static int __netif_receive_skb(struct sk_buff *skb)
+{
+	struct packet_type *ptype, *pt_prev;
+	int ret = NET_RX_DROP;
+	unsigned short type;
+
 	skb_bond(skb);
 
 	__get_cpu_var(netdev_rx_stat).total++;
@@ -1712,6 +2078,163 @@ out:
 	return ret;
 }
 
+/*
+ * Receive aggregation.  NAPI drivers may hand packets to
+ * netif_gro_receive() instead of netif_receive_skb().  In-order segments
+ * of one TCP flow are chained onto the first segment of the run and go
+ * up the stack as one skb, so the protocol layers pay their per packet
+ * cost once per run.  The protocol hooks decide what can be merged; the
+ * packets held here never outlive the dev->poll() that brought them in.
+ */
+#define GRO_MAX_HELD	8
+
+static struct packet_type *gro_find_ptype(unsigned short type)
+{
+	struct packet_type *ptype;
+
+	list_for_each_entry_rcu(ptype, &ptype_base[ntohs(type) & 15], list) {
+		if (ptype->type == type && !ptype->dev && ptype->gro_receive)
+			return ptype;
+	}
+	return NULL;
+}
+
+/**
+ *	skb_gro_append - chain a segment onto a held packet
+ *	@held: first packet of the run
+ *	@skb: next segment, already pulled to its payload
+ */
+void skb_gro_append(struct sk_buff *held, struct sk_buff *skb)
+{
+	struct gro_cb *cb = GRO_CB(held);
+
+	if (cb->last == held)
+		skb_shinfo(held)->frag_list = skb;
+	else
+		cb->last->next = skb;
+	cb->last = skb;
+	cb->count++;
+
+	held->len += skb->len;
+	held->data_len += skb->len;
+	held->truesize += skb->truesize;
+}
+
+static void gro_complete(struct sk_buff *skb)
+{
+	struct packet_type *ptype;
+
+	if (GRO_CB(skb)->count > 1) {
+		rcu_read_lock();
+		ptype = gro_find_ptype(skb->protocol);
+		if (ptype && ptype->gro_complete)
+			ptype->gro_complete(skb);
+		rcu_read_unlock();
+
+		/* Lets the receiver see the size of the wire segments. */
+		skb_shinfo(skb)->tso_size = GRO_CB(skb)->size;
+		skb_shinfo(skb)->tso_segs = GRO_CB(skb)->count;
+	}
+	memset(skb->cb, 0, sizeof(skb->cb));
+	netif_receive_skb(skb);
+}
+
+static void netif_gro_flush(void)
+{
+	struct softnet_data *queue = &__get_cpu_var(softnet_data);
+	struct sk_buff *skb, *next;
+
+	skb = queue->gro_list;
+	queue->gro_list = NULL;
+	queue->gro_count = 0;
+
+	for (; skb; skb = next) {
+		next = skb->next;
+		skb->next = NULL;
+		gro_complete(skb);
+	}
+}
+
+/**
+ *	netif_gro_receive - receive a packet, merging it with its flow
+ *	@skb: buffer to process
+ *
+ *	Same contract as netif_receive_skb(), but only to be called from
+ *	the dev->poll() routine of a NAPI driver.
+ */
+int netif_gro_receive(struct sk_buff *skb)
+{
+	struct softnet_data *queue = &__get_cpu_var(softnet_data);
+	struct packet_type *ptype;
+	struct sk_buff **pp, *p;
+	int kind, ret;
+
+	if (!(skb->dev->features & NETIF_F_GRO) || skb_shinfo(skb)->frag_list)
+		return netif_receive_skb(skb);
+#if defined(CONFIG_BRIDGE) || defined(CONFIG_BRIDGE_MODULE)
+	/* Bridged frames are forwarded as they came in. */
+	if (skb->dev->br_port)
+		return netif_receive_skb(skb);
+#endif
+
+	if (!skb->stamp.tv_sec)
+		net_timestamp(&skb->stamp);
+
+	skb->nh.raw = skb->data;
+	GRO_CB(skb)->flush = 0;
+
+	rcu_read_lock();
+	ptype = gro_find_ptype(skb->protocol);
+	kind = ptype ? ptype->gro_receive(NULL, skb) : GRO_NORMAL;
+	if (kind == GRO_NORMAL)
+		goto normal;
+
+	for (pp = &queue->gro_list; (p = *pp) != NULL; pp = &p->next) {
+		if (p->dev != skb->dev || p->protocol != skb->protocol)
+			continue;
+
+		ret = ptype->gro_receive(p, skb);
+		if (ret == GRO_NOMATCH)
+			continue;
+		if (ret == GRO_MERGED)
+			goto out;
+
+		/* The held run is complete or broken, pass it up first. */
+		*pp = p->next;
+		p->next = NULL;
+		queue->gro_count--;
+		gro_complete(p);
+		if (ret == GRO_MERGED_FLUSH)
+			goto out;
+		break;
+	}
+
+	if (kind != GRO_HOLD)
+		goto normal;
+
+	if (queue->gro_count >= GRO_MAX_HELD) {
+		for (pp = &queue->gro_list; (*pp)->next; pp = &(*pp)->next)
+			;
+		p = *pp;
+		*pp = NULL;
+		queue->gro_count--;
+		gro_complete(p);
+	}
+
+	GRO_CB(skb)->last = skb;
+	GRO_CB(skb)->count = 1;
+	skb->next = queue->gro_list;
+	queue->gro_list = skb;
+	queue->gro_count++;
+out:
+	rcu_read_unlock();
+	return NET_RX_SUCCESS;
+
+normal:
+	rcu_read_unlock();
+	return netif_receive_skb(skb);
+}
+
 static int process_backlog(struct net_device *backlog_dev, int *budget)
 {
 	int work = 0;
@@ -1724,14 +2247,17 @@ static int process_backlog(struct net_device *backlog_dev, int *budget)
 		struct net_device *dev;
 
 		local_irq_disable();
+		spin_lock(&queue->input_pkt_queue.lock);
 		skb = __skb_dequeue(&queue->input_pkt_queue);
+		spin_unlock(&queue->input_pkt_queue.lock);
 		if (!skb)
 			goto job_done;
 		local_irq_enable();
 
 		dev = skb->dev;
 
-		netif_receive_skb(skb);
+		/* already hashed if the packet was steered here */
+		__netif_receive_skb(skb);
 
 		dev_put(dev);
 
@@ -1782,6 +2308,7 @@ static void net_rx_action(struct softirq_action *h)
 		netpoll_poll_lock(dev);
 
 		if (dev->quota <= 0 || dev->poll(dev, &budget)) {
+			netif_gro_flush();
 			netpoll_poll_unlock(dev);
 			local_irq_disable();
 			list_del(&dev->poll_list);
@@ -1791,6 +2318,7 @@ static void net_rx_action(struct softirq_action *h)
 			else
 				dev->quota = dev->weight;
 		} else {
+			netif_gro_flush();
 			netpoll_poll_unlock(dev);
 			dev_put(dev);
 			local_irq_disable();
@@ -1798,6 +2326,7 @@ static void net_rx_action(struct softirq_action *h)
 	}
 out:
 	local_irq_enable();
+	rx_steer_flush();
 	return;
 
 softnet_break:
@@ -2781,6 +3310,19 @@ int register_netdevice(struct net_device *dev)
 		dev->features &= ~NETIF_F_TSO;
 	}
 
+	/* Multiqueue transmit needs the queues of alloc_netdev_mq(). */
+	if ((dev->features & NETIF_F_MULTI_QUEUE) &&
+	    (!dev->egress_subqueue || (dev->features & NETIF_F_LLTX))) {
+		printk("%s: Dropping NETIF_F_MULTI_QUEUE since no tx queues.\n",
+		       dev->name);
+		dev->features &= ~NETIF_F_MULTI_QUEUE;
+	}
+
+	/* Software segmentation and receive aggregation work on any
+	 * device, the latter only for drivers that use netif_gro_receive().
+	 */
+	dev->features |= NETIF_F_GSO | NETIF_F_GRO;
+
 	/*
 	 *	nil rebuild_header routine,
 	 *	that should be never called and used as just bug trap.
@@ -3008,24 +3550,33 @@ out:
 }
 
 /**
- *	alloc_netdev - allocate network device
+ *	alloc_netdev_mq - allocate network device
  *	@sizeof_priv:	size of private data to allocate space for
  *	@name:		device name format string
  *	@setup:		callback to initialize device
+ *	@queue_count:	the number of hardware tx queues
  *
  *	Allocates a struct net_device with private data area for driver use
- *	and performs basic initialization.
+ *	and performs basic initialization.  The tx queues are used once the
+ *	driver sets NETIF_F_MULTI_QUEUE.
  */
-struct net_device *alloc_netdev(int sizeof_priv, const char *name,
-		void (*setup)(struct net_device *))
+struct net_device *alloc_netdev_mq(int sizeof_priv, const char *name,
+		void (*setup)(struct net_device *), unsigned int queue_count)
 {
 	void *p;
 	struct net_device *dev;
-	int alloc_size;
+	int alloc_size, subqueue_off;
+	int i;
+
+	BUG_ON(queue_count < 1);
 
 	/* ensure 32-byte alignment of both the device and private area */
 	alloc_size = (sizeof(*dev) + NETDEV_ALIGN_CONST) & ~NETDEV_ALIGN_CONST;
-	alloc_size += sizeof_priv + NETDEV_ALIGN_CONST;
+	alloc_size += sizeof_priv;
+	/* the tx queues follow, each in its own cache line */
+	subqueue_off = alloc_size;
+	alloc_size += queue_count * sizeof(struct net_device_subqueue);
+	alloc_size += SMP_CACHE_BYTES - 1 + NETDEV_ALIGN_CONST;
 
 	p = kmalloc(alloc_size, GFP_KERNEL);
 	if (!p) {
@@ -3041,11 +3592,19 @@ struct net_device *alloc_netdev(int sizeof_priv, const char *name,
 	if (sizeof_priv)
 		dev->priv = netdev_priv(dev);
 
+	dev->egress_subqueue = (struct net_device_subqueue *)
+		ALIGN((unsigned long)dev + subqueue_off, SMP_CACHE_BYTES);
+	dev->egress_subqueue_count = queue_count;
+	for (i = 0; i < queue_count; i++) {
+		spin_lock_init(&dev->egress_subqueue[i].xmit_lock);
+		dev->egress_subqueue[i].xmit_lock_owner = -1;
+	}
+
 	setup(dev);
 	strcpy(dev->name, name);
 	return dev;
 }
-EXPORT_SYMBOL(alloc_netdev);
+EXPORT_SYMBOL(alloc_netdev_mq);
 
 /**
  *	free_netdev - free network device
@@ -3199,9 +3758,13 @@ static int dev_cpu_callback(struct notifier_block *nfb,
 	unsigned int cpu, oldcpu = (unsigned long)ocpu;
 	struct softnet_data *sd, *oldsd;
 
+	if (action == CPU_ONLINE)
+		rx_steer_build_map();
 	if (action != CPU_DEAD)
 		return NOTIFY_OK;
 
+	rx_steer_build_map();
+
 	local_irq_disable();
 	cpu = smp_processor_id();
 	sd = &per_cpu(softnet_data, cpu);
@@ -3227,7 +3790,7 @@ static int dev_cpu_callback(struct notifier_block *nfb,
 	local_irq_enable();
 
 	/* Process offline CPU's input_pkt_queue */
-	while ((skb = __skb_dequeue(&oldsd->input_pkt_queue)))
+	while ((skb = skb_dequeue(&oldsd->input_pkt_queue)))
 		netif_rx(skb);
 
 	return NOTIFY_OK;
@@ -3290,6 +3853,11 @@ static int __init net_dev_init(void)
 		atomic_set(&queue->backlog_dev.refcnt, 1);
 	}
 
+#ifdef CONFIG_SMP
+	get_random_bytes(&rx_steer_rnd, sizeof(rx_steer_rnd));
+#endif
+	rx_steer_build_map();
+
 #ifdef OFFLINE_SAMPLE
 	samp_timer.expires = jiffies + (10 * HZ);
 	add_timer(&samp_timer);
@@ -3323,6 +3891,7 @@ EXPORT_SYMBOL(dev_get_by_name);
 EXPORT_SYMBOL(dev_ioctl);
 EXPORT_SYMBOL(dev_open);
 EXPORT_SYMBOL(dev_queue_xmit);
+EXPORT_SYMBOL(skb_gso_segment);
 EXPORT_SYMBOL(dev_remove_pack);
 EXPORT_SYMBOL(dev_set_allmulti);
 EXPORT_SYMBOL(dev_set_promiscuity);
@@ -3334,6 +3903,8 @@ EXPORT_SYMBOL(netdev_boot_setup_check);
 EXPORT_SYMBOL(netdev_set_master);
 EXPORT_SYMBOL(netdev_state_change);
 EXPORT_SYMBOL(netif_receive_skb);
+EXPORT_SYMBOL(netif_gro_receive);
+EXPORT_SYMBOL(skb_gro_append);
 EXPORT_SYMBOL(netif_rx);
 EXPORT_SYMBOL(register_gifconf);
 EXPORT_SYMBOL(register_netdevice);
@@ -318,6 +318,63 @@ load_b:
 	return 0;
 }
 
+#ifdef CONFIG_BPF_JIT
+int bpf_jit_enable = 1;
+
+/**
+ *	bpf_jit_load - slow path packet load for compiled filters
+ *	@skb: buffer the filter runs on
+ *	@k: offset, as for the interpreter's BPF_LD
+ *	@size: 1, 2 or 4 bytes
+ *	@to: where the loaded value goes, in host byte order
+ *
+ * Called by JIT generated code for loads it cannot do from the linear
+ * data directly.  Returns 0 on success, or nonzero if the filter must
+ * return 0, exactly where sk_run_filter() would.
+ */
+asmlinkage int bpf_jit_load(struct sk_buff *skb, int k, unsigned int size,
+			    u32 *to)
+{
+	u32 _tmp;
+	u8 *ptr;
+
+	if (k >= 0) {
+		ptr = skb_header_pointer(skb, k, size, &_tmp);
+	} else if (k >= SKF_AD_OFF) {
+		switch (k-SKF_AD_OFF) {
+		case SKF_AD_PROTOCOL:
+			*to = htons(skb->protocol);
+			return 0;
+		case SKF_AD_PKTTYPE:
+			*to = skb->pkt_type;
+			return 0;
+		case SKF_AD_IFINDEX:
+			*to = skb->dev->ifindex;
+			return 0;
+		default:
+			return -EINVAL;
+		}
+	} else
+		ptr = load_pointer(skb, k);
+
+	if (ptr == NULL)
+		return -EFAULT;
+
+	switch (size) {
+	case 4:
+		*to = ntohl(*(u32 *)ptr);
+		break;
+	case 2:
+		*to = ntohs(*(u16 *)ptr);
+		break;
+	default:
+		*to = *ptr;
+		break;
+	}
+	return 0;
+}
+#endif
+
 /**
  *	sk_chk_filter - verify socket filter code
  *	@filter: filter to verify
@@ -411,11 +468,14 @@ int sk_attach_filter(struct sock_fprog *fprog, struct sock *sk)
 
 	atomic_set(&fp->refcnt, 1);
 	fp->len = fprog->len;
+	fp->bpf_func = NULL;
 
 	err = sk_chk_filter(fp->insns, fp->len);
 	if (!err) {
 		struct sk_filter *old_fp;
 
+		bpf_jit_compile(fp);
+
 		spin_lock_bh(&sk->sk_lock.slock);
 		old_fp = sk->sk_filter;
 		sk->sk_filter = fp;
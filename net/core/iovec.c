@@ -98,6 +98,37 @@ int memcpy_toiovec(struct iovec *iov, unsigned char *kdata, int len)
 	return 0;
 }
 
+/*
+ *	Copy kernel to iovec without sleeping, for a source mapped with
+ *	kmap_atomic(): a fault is not taken, the copy just stops there.
+ *	Returns the number of bytes not copied, the iovec is moved over
+ *	the ones that were.
+ */
+
+int memcpy_toiovec_inatomic(struct iovec *iov, unsigned char *kdata, int len)
+{
+	while (len > 0) {
+		if (iov->iov_len) {
+			int copy = min_t(unsigned int, iov->iov_len, len);
+			int left = copy;
+
+			if (access_ok(VERIFY_WRITE, iov->iov_base, copy))
+				left = __copy_to_user_inatomic(iov->iov_base,
+							       kdata, copy);
+			copy -= left;
+			kdata += copy;
+			len -= copy;
+			iov->iov_len -= copy;
+			iov->iov_base += copy;
+			if (left)
+				return len;
+		}
+		iov++;
+	}
+
+	return 0;
+}
+
 /*
  *	Copy iovec to kernel. Returns -EFAULT on error.
  *
@@ -237,3 +268,4 @@ EXPORT_SYMBOL(csum_partial_copy_fromiovecend);
 EXPORT_SYMBOL(memcpy_fromiovec);
 EXPORT_SYMBOL(memcpy_fromiovecend);
 EXPORT_SYMBOL(memcpy_toiovec);
+EXPORT_SYMBOL(memcpy_toiovec_inatomic);
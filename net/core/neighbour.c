@@ -72,6 +72,12 @@ static struct file_operations neigh_stat_seq_fops;
      cache.
    - If the entry requires some non-trivial actions, increase
      its reference count and release table lock.
+   - neigh_lookup() and neigh_lookup_nodev() only walk the buckets
+     under rcu_read_lock_bh(): entries are freed and old bucket
+     arrays released with call_rcu_bh(), and an entry found is taken
+     only if it is not dead yet, see neigh_hold_live().  The lookups
+     may miss an entry being added or moved by neigh_hash_grow(),
+     which neigh_create() then finds under the lock.
 
    Neighbour entries are protected:
    - with reference count.
@@ -113,18 +119,38 @@ unsigned long neigh_rand_reach_time(unsigned long base)
 }
 
 
+/* Buckets neigh_forced_gc() scans before letting others at the lock */
+#define NEIGH_GC_CHUNK	16
+
+/*
+ * Rather than the whole table, scan the buckets on from where the
+ * last run stopped until enough entries are gone to be back down to
+ * gc_thresh2, or every bucket has been seen once.
+ */
 static int neigh_forced_gc(struct neigh_table *tbl)
 {
+	int goal = atomic_read(&tbl->entries) - tbl->gc_thresh2;
+	unsigned int scanned = 0;
 	int shrunk = 0;
-	int i;
 
 	NEIGH_CACHE_STAT_INC(tbl, forced_gc_runs);
 
+	if (goal < 1)
+		goal = 1;
+
 	write_lock_bh(&tbl->lock);
-	for (i = 0; i <= tbl->hash_mask; i++) {
+	while (shrunk < goal && scanned <= tbl->hash_mask) {
 		struct neighbour *n, **np;
 
-		np = &tbl->hash_buckets[i];
+		if (scanned && !(scanned % NEIGH_GC_CHUNK)) {
+			write_unlock_bh(&tbl->lock);
+			write_lock_bh(&tbl->lock);
+		}
+		np = &tbl->hash_buckets[tbl->hash_chain_forced_gc];
+		tbl->hash_chain_forced_gc = ((tbl->hash_chain_forced_gc + 1) &
+					     tbl->hash_mask);
+		scanned++;
+
 		while ((n = *np) != NULL) {
 			/* Neighbour record may be discarded if:
 			 * - nobody refers to it.
@@ -135,9 +161,10 @@ static int neigh_forced_gc(struct neigh_table *tbl)
 			    !(n->nud_state & NUD_PERMANENT)) {
 				*np	= n->next;
 				n->dead = 1;
-				shrunk	= 1;
+				shrunk++;
 				write_unlock(&n->lock);
 				neigh_release(n);
+				NEIGH_CACHE_STAT_INC(tbl, gc_reclaimed);
 				continue;
 			}
 			write_unlock(&n->lock);
@@ -149,6 +176,9 @@ static int neigh_forced_gc(struct neigh_table *tbl)
 
 	write_unlock_bh(&tbl->lock);
 
+	if (shrunk < goal)
+		NEIGH_CACHE_STAT_INC(tbl, forced_gc_goal_miss);
+
 	return shrunk;
 }
 
@@ -319,17 +349,43 @@ static void neigh_hash_free(struct neighbour **hash, unsigned int entries)
 		free_pages((unsigned long)hash, get_order(size));
 }
 
+/* A bucket array waiting for the lookups still walking it */
+struct neigh_hash_rcu {
+	struct rcu_head		rcu;
+	struct neighbour	**hash;
+	unsigned int		entries;
+};
+
+static void neigh_hash_free_rcu(struct rcu_head *head)
+{
+	struct neigh_hash_rcu *old = container_of(head, struct neigh_hash_rcu, rcu);
+
+	neigh_hash_free(old->hash, old->entries);
+	kfree(old);
+}
+
+/*
+ * The lookups read hash_mask before hash_buckets, so the bucket array
+ * is published first: whichever array they get is at least as large as
+ * the mask.
+ */
 static void neigh_hash_grow(struct neigh_table *tbl, unsigned long new_entries)
 {
 	struct neighbour **new_hash, **old_hash;
 	unsigned int i, new_hash_mask, old_entries;
+	struct neigh_hash_rcu *old;
 
 	NEIGH_CACHE_STAT_INC(tbl, hash_grows);
 
 	BUG_ON(new_entries & (new_entries - 1));
+	old = kmalloc(sizeof(*old), GFP_ATOMIC);
+	if (!old)
+		return;
 	new_hash = neigh_hash_alloc(new_entries);
-	if (!new_hash)
+	if (!new_hash) {
+		kfree(old);
 		return;
+	}
 
 	old_entries = tbl->hash_mask + 1;
 	new_hash_mask = new_entries - 1;
@@ -349,10 +405,42 @@ static void neigh_hash_grow(struct neigh_table *tbl, unsigned long new_entries)
 			new_hash[hash_val] = n;
 		}
 	}
-	tbl->hash_buckets = new_hash;
+	rcu_assign_pointer(tbl->hash_buckets, new_hash);
+	smp_wmb();
 	tbl->hash_mask = new_hash_mask;
 
-	neigh_hash_free(old_hash, old_entries);
+	old->hash = old_hash;
+	old->entries = old_entries;
+	call_rcu_bh(&old->rcu, neigh_hash_free_rcu);
+}
+
+/* First entry of the bucket of hash_val, under rcu_read_lock_bh() */
+static inline struct neighbour *neigh_bucket_rcu(struct neigh_table *tbl,
+						 u32 hash_val)
+{
+	unsigned int hash_mask = tbl->hash_mask;
+	struct neighbour **buckets;
+
+	smp_rmb();
+	buckets = rcu_dereference(tbl->hash_buckets);
+	return rcu_dereference(buckets[hash_val & hash_mask]);
+}
+
+/*
+ * Take a reference to an entry found under rcu_read_lock_bh(), unless
+ * it has been unlinked meanwhile.  Entries are marked dead under
+ * n->lock, and the GC only unlinks entries nobody else holds.
+ */
+static inline int neigh_hold_live(struct neighbour *n)
+{
+	int dead;
+
+	read_lock(&n->lock);
+	dead = n->dead;
+	if (!dead)
+		neigh_hold(n);
+	read_unlock(&n->lock);
+	return !dead;
 }
 
 struct neighbour *neigh_lookup(struct neigh_table *tbl, const void *pkey,
@@ -360,19 +448,19 @@ struct neighbour *neigh_lookup(struct neigh_table *tbl, const void *pkey,
 {
 	struct neighbour *n;
 	int key_len = tbl->key_len;
-	u32 hash_val = tbl->hash(pkey, dev) & tbl->hash_mask;
-	
+
 	NEIGH_CACHE_STAT_INC(tbl, lookups);
 
-	read_lock_bh(&tbl->lock);
-	for (n = tbl->hash_buckets[hash_val]; n; n = n->next) {
-		if (dev == n->dev && !memcmp(n->primary_key, pkey, key_len)) {
-			neigh_hold(n);
+	rcu_read_lock_bh();
+	for (n = neigh_bucket_rcu(tbl, tbl->hash(pkey, dev)); n;
+	     n = rcu_dereference(n->next)) {
+		if (dev == n->dev && !memcmp(n->primary_key, pkey, key_len) &&
+		    neigh_hold_live(n)) {
 			NEIGH_CACHE_STAT_INC(tbl, hits);
 			break;
 		}
 	}
-	read_unlock_bh(&tbl->lock);
+	rcu_read_unlock_bh();
 	return n;
 }
 
@@ -380,19 +468,19 @@ struct neighbour *neigh_lookup_nodev(struct neigh_table *tbl, const void *pkey)
 {
 	struct neighbour *n;
 	int key_len = tbl->key_len;
-	u32 hash_val = tbl->hash(pkey, NULL) & tbl->hash_mask;
 
 	NEIGH_CACHE_STAT_INC(tbl, lookups);
 
-	read_lock_bh(&tbl->lock);
-	for (n = tbl->hash_buckets[hash_val]; n; n = n->next) {
-		if (!memcmp(n->primary_key, pkey, key_len)) {
-			neigh_hold(n);
+	rcu_read_lock_bh();
+	for (n = neigh_bucket_rcu(tbl, tbl->hash(pkey, NULL)); n;
+	     n = rcu_dereference(n->next)) {
+		if (!memcmp(n->primary_key, pkey, key_len) &&
+		    neigh_hold_live(n)) {
 			NEIGH_CACHE_STAT_INC(tbl, hits);
 			break;
 		}
 	}
-	read_unlock_bh(&tbl->lock);
+	rcu_read_unlock_bh();
 	return n;
 }
 
@@ -448,10 +536,10 @@ struct neighbour *neigh_create(struct neigh_table *tbl, const void *pkey,
 		}
 	}
 
-	n->next = tbl->hash_buckets[hash_val];
-	tbl->hash_buckets[hash_val] = n;
 	n->dead = 0;
 	neigh_hold(n);
+	n->next = tbl->hash_buckets[hash_val];
+	rcu_assign_pointer(tbl->hash_buckets[hash_val], n);
 	write_unlock_bh(&tbl->lock);
 	NEIGH_PRINTK2("neigh %p is created.\n", n);
 	rc = n;
@@ -570,6 +658,13 @@ static int pneigh_ifdown(struct neigh_table *tbl, struct net_device *dev)
 }
 
 
+static void neigh_rcu_free(struct rcu_head *head)
+{
+	struct neighbour *neigh = container_of(head, struct neighbour, rcu);
+
+	kmem_cache_free(neigh->tbl->kmem_cachep, neigh);
+}
+
 /*
  *	neighbour must already be out of the table;
  *
@@ -611,7 +706,7 @@ void neigh_destroy(struct neighbour *neigh)
 	NEIGH_PRINTK2("neigh %p is destroyed.\n", neigh);
 
 	atomic_dec(&neigh->tbl->entries);
-	kmem_cache_free(neigh->tbl->kmem_cachep, neigh);
+	call_rcu_bh(&neigh->rcu, neigh_rcu_free);
 }
 
 /* Neighbour state is suspicious;
@@ -694,6 +789,7 @@ static void neigh_periodic_timer(unsigned long arg)
 			n->dead = 1;
 			write_unlock(&n->lock);
 			neigh_release(n);
+			NEIGH_CACHE_STAT_INC(tbl, gc_reclaimed);
 			continue;
 		}
 		write_unlock(&n->lock);
@@ -1407,6 +1503,9 @@ int neigh_table_clear(struct neigh_table *tbl)
 	}
 	write_unlock(&neigh_tbl_lock);
 
+	/* the entries and bucket arrays still waiting to be freed */
+	rcu_barrier_bh();
+
 	neigh_hash_free(tbl->hash_buckets, tbl->hash_mask + 1);
 	tbl->hash_buckets = NULL;
 
@@ -1953,12 +2052,12 @@ static int neigh_stat_seq_show(struct seq_file *seq, void *v)
 	struct neigh_statistics *st = v;
 
 	if (v == SEQ_START_TOKEN) {
-		seq_printf(seq, "entries  allocs destroys hash_grows  lookups hits  res_failed  rcv_probes_mcast rcv_probes_ucast  periodic_gc_runs forced_gc_runs forced_gc_goal_miss\n");
+		seq_printf(seq, "entries  allocs destroys hash_grows  lookups hits  res_failed  rcv_probes_mcast rcv_probes_ucast  periodic_gc_runs forced_gc_runs forced_gc_goal_miss gc_reclaimed\n");
 		return 0;
 	}
 
 	seq_printf(seq, "%08x  %08lx %08lx %08lx  %08lx %08lx  %08lx  "
-			"%08lx %08lx  %08lx %08lx\n",
+			"%08lx %08lx  %08lx %08lx %08lx %08lx\n",
 		   atomic_read(&tbl->entries),
 
 		   st->allocs,
@@ -1974,7 +2073,9 @@ static int neigh_stat_seq_show(struct seq_file *seq, void *v)
 		   st->rcv_probes_ucast,
 
 		   st->periodic_gc_runs,
-		   st->forced_gc_runs
+		   st->forced_gc_runs,
+		   st->forced_gc_goal_miss,
+		   st->gc_reclaimed
 		   );
 
 	return 0;
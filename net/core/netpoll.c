@@ -245,6 +245,8 @@ repeat:
 static void netpoll_send_skb(struct netpoll *np, struct sk_buff *skb)
 {
 	int status;
+	spinlock_t *xmit_lock;
+	int *xmit_lock_owner;
 
 repeat:
 	if(!np || !np->dev || !netif_running(np->dev)) {
@@ -252,9 +254,19 @@ repeat:
 		return;
 	}
 
+	xmit_lock = &np->dev->xmit_lock;
+	xmit_lock_owner = &np->dev->xmit_lock_owner;
+	if (np->dev->features & NETIF_F_MULTI_QUEUE) {
+		struct net_device_subqueue *sq;
+
+		sq = &np->dev->egress_subqueue[skb->queue_mapping];
+		xmit_lock = &sq->xmit_lock;
+		xmit_lock_owner = &sq->xmit_lock_owner;
+	}
+
 	/* avoid recursion */
 	if(np->poll_owner == smp_processor_id() ||
-	   np->dev->xmit_lock_owner == smp_processor_id()) {
+	   *xmit_lock_owner == smp_processor_id()) {
 		if (np->drop)
 			np->drop(skb);
 		else
@@ -262,24 +274,24 @@ repeat:
 		return;
 	}
 
-	spin_lock(&np->dev->xmit_lock);
-	np->dev->xmit_lock_owner = smp_processor_id();
+	spin_lock(xmit_lock);
+	*xmit_lock_owner = smp_processor_id();
 
 	/*
 	 * network drivers do not expect to be called if the queue is
 	 * stopped.
 	 */
-	if (netif_queue_stopped(np->dev)) {
-		np->dev->xmit_lock_owner = -1;
-		spin_unlock(&np->dev->xmit_lock);
+	if (netif_tx_stopped(np->dev, skb)) {
+		*xmit_lock_owner = -1;
+		spin_unlock(xmit_lock);
 
 		netpoll_poll(np);
 		goto repeat;
 	}
 
 	status = np->dev->hard_start_xmit(skb, np->dev);
-	np->dev->xmit_lock_owner = -1;
-	spin_unlock(&np->dev->xmit_lock);
+	*xmit_lock_owner = -1;
+	spin_unlock(xmit_lock);
 
 	/* transmit busy */
 	if(status) {
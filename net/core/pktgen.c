@@ -151,7 +151,7 @@
 #include <asm/timex.h>
 
 
-#define VERSION  "pktgen v2.61: Packet Generator for packet performance testing.\n"
+#define VERSION  "pktgen v2.62: Packet Generator for packet performance testing.\n"
 
 /* #define PG_DEBUG(a) a */
 #define PG_DEBUG(a) 
@@ -190,6 +190,15 @@
 
 #define MAX_CFLOWS  65536
 
+#define MAX_IMIX_ENTRIES 8
+
+/* Packet size and relative weight of one entry in an IMIX profile */
+struct imix_pkt
+{
+	__u32		size;
+	__u32		weight;
+};
+
 struct flow_state
 {
 	__u32		cur_daddr;
@@ -316,6 +325,10 @@ struct pktgen_dev {
 	unsigned cflows;         /* Concurrent flows (config) */
 	unsigned lflow;          /* Flow length  (config) */
 	unsigned nflows;         /* accumulated flows (stats) */
+
+	struct imix_pkt imix_entries[MAX_IMIX_ENTRIES];
+	unsigned n_imix;         /* IMIX entries in use, 0 = use pkt_size */
+	__u32 imix_total;        /* Sum of the IMIX weights */
 };
 
 struct pktgen_hdr {
@@ -495,6 +508,10 @@ static void pktgen_stop(struct pktgen_thread* t);
 static void pktgen_clear_counters(struct pktgen_dev *pkt_dev);
 static struct pktgen_dev *pktgen_NN_threads(const char* dev_name, int remove);
 static unsigned int scan_ip6(const char *s,char ip[16]);
+static int pktgen_rx_add(const char *ifname);
+static void pktgen_rx_remove(struct net_device *dev);
+static void pktgen_rx_reset(void);
+static int proc_rx_read(char *buf , char **start, off_t offset, int len, int *eof, void *data);
 static unsigned int fmt_ip6(char *s,const char ip[16]);
 
 /* Module parameters, defaults. */
@@ -589,6 +606,18 @@ static ssize_t proc_pgctrl_write(struct file* file,const char __user * buf,
         else if (!strcmp(data, "start")) 
 		pktgen_run_all_threads();
 
+	else if (!strncmp(data, "rx ", 3)) {
+		err = pktgen_rx_add(data + 3);
+		if (err)
+			goto out_free;
+	}
+
+	else if (!strcmp(data, "rx_reset"))
+		pktgen_rx_reset();
+
+	else if (!strcmp(data, "rx_stop"))
+		pktgen_rx_remove(NULL);
+
 	else 
 		printk("pktgen: Unknown command: %s\n", data);
 
@@ -620,6 +649,13 @@ static int proc_if_read(char *buf , char **start, off_t offset,
 
 	p += sprintf(p, "     flows: %u flowlen: %u\n", pkt_dev->cflows, pkt_dev->lflow);
 
+	if (pkt_dev->n_imix) {
+		p += sprintf(p, "     imix_weights:");
+		for (i = 0; i < pkt_dev->n_imix; i++)
+			p += sprintf(p, " %u,%u", pkt_dev->imix_entries[i].size,
+				     pkt_dev->imix_entries[i].weight);
+		p += sprintf(p, "\n");
+	}
 
 	if(pkt_dev->flags & F_IPV6) {
 		char b1[128], b2[128], b3[128];
@@ -880,6 +916,56 @@ static int proc_if_write(struct file *file, const char __user *user_buffer,
 		return count;
 	}
 
+	/* IMIX profile: "imix_weights 64,7 576,4 1500,1"; each packet
+	 * size is picked at random in proportion to its weight.  An
+	 * empty list goes back to min/max_pkt_size.
+	 */
+	if (!strcmp(name, "imix_weights")) {
+		struct imix_pkt entries[MAX_IMIX_ENTRIES];
+		unsigned n = 0;
+		__u32 total = 0;
+
+		while (i < count) {
+			unsigned long size, weight;
+			char c;
+
+			len = num_arg(&user_buffer[i], 10, &size);
+			if (len <= 0)
+				break;
+			i += len;
+			if (i >= count)
+				return -EINVAL;
+			if (get_user(c, &user_buffer[i]))
+				return -EFAULT;
+			if (c != ',')
+				return -EINVAL;
+			i++;
+			len = num_arg(&user_buffer[i], 10, &weight);
+			if (len <= 0)
+				return -EINVAL;
+			i += len;
+			if (n == MAX_IMIX_ENTRIES)
+				return -E2BIG;
+			if (size < 14+20+8)
+				size = 14+20+8;
+			if (weight) {
+				entries[n].size = size;
+				entries[n].weight = weight;
+				total += weight;
+				n++;
+			}
+			len = count_trail_chars(&user_buffer[i], count - i);
+			if (len < 0)
+				return len;
+			i += len;
+		}
+		memcpy(pkt_dev->imix_entries, entries, n * sizeof(entries[0]));
+		pkt_dev->imix_total = total;
+		pkt_dev->n_imix = n;
+		sprintf(pg_result, "OK: imix_weights=%u", pkt_dev->n_imix);
+		return count;
+	}
+
         /* Shortcut for min = max */
 
 	if (!strcmp(name, "pkt_size")) {
@@ -1552,6 +1638,7 @@ static int pktgen_device_event(struct notifier_block *unused, unsigned long even
 		
 	case NETDEV_UNREGISTER:
                 pktgen_NN_threads(dev->name, REMOVE);
+		pktgen_rx_remove(dev);
 		break;
 	};
 
@@ -1893,7 +1980,15 @@ static void mod_cur_headers(struct pktgen_dev *pkt_dev) {
  		}
 	}
 
-        if (pkt_dev->min_pkt_size < pkt_dev->max_pkt_size) {
+        if (pkt_dev->n_imix) {
+		__u32 w = pktgen_random() % pkt_dev->imix_total;
+		int i;
+
+		for (i = 0; w >= pkt_dev->imix_entries[i].weight; i++)
+			w -= pkt_dev->imix_entries[i].weight;
+		pkt_dev->cur_pkt_size = pkt_dev->imix_entries[i].size;
+	}
+	else if (pkt_dev->min_pkt_size < pkt_dev->max_pkt_size) {
                 __u32 t;
                 if (pkt_dev->flags & F_TXSIZE_RND) {
                         t = ((pktgen_random() % (pkt_dev->max_pkt_size - pkt_dev->min_pkt_size))
@@ -2031,8 +2126,7 @@ static struct sk_buff *fill_packet_ipv4(struct net_device *odev,
 	      pgh->tv_sec    = htonl(timestamp.tv_sec);
 	      pgh->tv_usec   = htonl(timestamp.tv_usec);
         }
-        pkt_dev->seq_num++;
-        
+
 	return skb;
 }
 
@@ -2309,8 +2403,7 @@ static struct sk_buff *fill_packet_ipv6(struct net_device *odev,
 	      pgh->tv_sec    = htonl(timestamp.tv_sec);
 	      pgh->tv_usec   = htonl(timestamp.tv_usec);
         }
-        pkt_dev->seq_num++;
-        
+
 	return skb;
 }
 
@@ -3061,6 +3154,333 @@ static int pktgen_remove_device(struct pktgen_thread *t, struct pktgen_dev *pkt_
         return 0;
 }
 
+/*
+ * Receive side.  A sink attached to an interface picks pktgen packets
+ * out of its IPv4 traffic and keeps counters per stream, a stream being
+ * one source address and UDP source port.  The sender numbers the
+ * packets it transmits per pktgen device, so loss and reordering figures
+ * assume every device sends from a fixed address and port.  Latency is
+ * the difference between the send timestamp and the time of arrival,
+ * which needs a common clock: loop the test back into the same box, or
+ * keep the clocks of sender and sink in sync.
+ *
+ *   echo "rx eth1" > /proc/net/pktgen/pgctrl
+ *   cat /proc/net/pktgen/pgrx
+ *
+ * The sink list is protected by the RTNL semaphore, the streams of a
+ * sink by its lock.
+ */
+
+#define PG_RX_HASH_SIZE   64
+#define PG_RX_MAX_STREAMS 1024
+
+struct pktgen_rx_stream {
+	struct pktgen_rx_stream *next;
+	__u32 saddr;
+	__u16 sport;
+	__u32 next_seq;         /* Sequence number we expect next */
+	__u32 last_seq;
+	__u64 pkts;
+	__u64 bytes;
+	__u64 lost;
+	__u64 reordered;
+	__u64 dups;             /* clone_skb copies of the previous packet */
+	__u64 lat_sum;          /* micro-seconds */
+	__u32 lat_min;
+	__u32 lat_max;
+	__u32 lat_hist[LAT_BUCKETS_MAX]; /* bucket i: latency < 2^i us */
+};
+
+struct pktgen_rx {
+	struct pktgen_rx *next;
+	struct packet_type pt;
+	spinlock_t lock;
+	unsigned nstreams;
+	__u64 untracked;        /* packets beyond PG_RX_MAX_STREAMS */
+	struct pktgen_rx_stream *hash[PG_RX_HASH_SIZE];
+};
+
+static struct pktgen_rx *pktgen_rx_list = NULL;
+static char pg_rx_fname[128];
+
+static inline unsigned pktgen_rx_hash(__u32 saddr, __u16 sport)
+{
+	__u32 h = saddr ^ sport;
+
+	return (h ^ (h >> 16) ^ (h >> 8)) & (PG_RX_HASH_SIZE - 1);
+}
+
+static struct pktgen_rx_stream *pktgen_rx_find(struct pktgen_rx *rx,
+					       __u32 saddr, __u16 sport)
+{
+	unsigned h = pktgen_rx_hash(saddr, sport);
+	struct pktgen_rx_stream *s;
+
+	for (s = rx->hash[h]; s; s = s->next)
+		if (s->saddr == saddr && s->sport == sport)
+			return s;
+
+	if (rx->nstreams >= PG_RX_MAX_STREAMS)
+		return NULL;
+	s = kmalloc(sizeof(*s), GFP_ATOMIC);
+	if (!s)
+		return NULL;
+	memset(s, 0, sizeof(*s));
+	s->saddr = saddr;
+	s->sport = sport;
+	s->lat_min = ~0U;
+	s->next = rx->hash[h];
+	rx->hash[h] = s;
+	rx->nstreams++;
+	return s;
+}
+
+static void pktgen_rx_account(struct pktgen_rx_stream *s, __u32 seq,
+			      const struct timeval *sent,
+			      const struct timeval *now, unsigned int len)
+{
+	__s64 lat;
+	__u32 us;
+	int b;
+
+	if (!s->pkts)
+		s->next_seq = seq + 1;
+	else if (seq == s->last_seq) {
+		/* With clone_skb the same packet goes out several times
+		 * and the sender counts every copy.
+		 */
+		s->dups++;
+		s->next_seq++;
+	}
+	else if ((__s32)(seq - s->next_seq) >= 0) {
+		s->lost += seq - s->next_seq;
+		s->next_seq = seq + 1;
+	}
+	else {
+		/* Late arrival of a packet we already counted as lost */
+		s->reordered++;
+		if (s->lost)
+			s->lost--;
+	}
+	s->last_seq = seq;
+	s->pkts++;
+	s->bytes += len;
+
+	lat = (__s64)(now->tv_sec - sent->tv_sec) * USEC_PER_SEC +
+		now->tv_usec - sent->tv_usec;
+	if (lat < 0)
+		lat = 0;
+	us = lat > 0xffffffffLL ? 0xffffffff : (__u32)lat;
+
+	s->lat_sum += us;
+	if (us < s->lat_min)
+		s->lat_min = us;
+	if (us > s->lat_max)
+		s->lat_max = us;
+	b = fls(us);
+	if (b >= LAT_BUCKETS_MAX)
+		b = LAT_BUCKETS_MAX - 1;
+	s->lat_hist[b]++;
+}
+
+static int pktgen_rcv(struct sk_buff *skb, struct net_device *dev,
+		      struct packet_type *pt)
+{
+	struct pktgen_rx *rx = container_of(pt, struct pktgen_rx, pt);
+	struct iphdr _iph, *iph;
+	struct udphdr _udph, *udph;
+	struct pktgen_hdr _pgh, *pgh;
+	struct pktgen_rx_stream *s;
+	struct timeval sent, now;
+	int off;
+
+	iph = skb_header_pointer(skb, 0, sizeof(_iph), &_iph);
+	if (!iph || iph->ihl < 5 || iph->protocol != IPPROTO_UDP ||
+	    (iph->frag_off & htons(0x3fff)))
+		goto out;
+
+	off = iph->ihl * 4;
+	udph = skb_header_pointer(skb, off, sizeof(_udph), &_udph);
+	if (!udph)
+		goto out;
+
+	pgh = skb_header_pointer(skb, off + sizeof(_udph), sizeof(_pgh), &_pgh);
+	if (!pgh || pgh->pgh_magic != htonl(PKTGEN_MAGIC))
+		goto out;
+
+	do_gettimeofday(&now);
+	sent.tv_sec = ntohl(pgh->tv_sec);
+	sent.tv_usec = ntohl(pgh->tv_usec);
+
+	spin_lock(&rx->lock);
+	s = pktgen_rx_find(rx, iph->saddr, udph->source);
+	if (s)
+		pktgen_rx_account(s, ntohl(pgh->seq_num), &sent, &now,
+				  skb->len + dev->hard_header_len);
+	else
+		rx->untracked++;
+	spin_unlock(&rx->lock);
+out:
+	kfree_skb(skb);
+	return 0;
+}
+
+static void pktgen_rx_free_streams(struct pktgen_rx *rx)
+{
+	int h;
+
+	for (h = 0; h < PG_RX_HASH_SIZE; h++) {
+		while (rx->hash[h]) {
+			struct pktgen_rx_stream *s = rx->hash[h];
+
+			rx->hash[h] = s->next;
+			kfree(s);
+		}
+	}
+	rx->nstreams = 0;
+	rx->untracked = 0;
+}
+
+static int pktgen_rx_add(const char *ifname)
+{
+	struct net_device *dev;
+	struct pktgen_rx *rx;
+	int err = 0;
+
+	rtnl_lock();
+	dev = __dev_get_by_name(ifname);
+	if (!dev) {
+		printk("pktgen: no such netdevice: \"%s\"\n", ifname);
+		err = -ENODEV;
+		goto out;
+	}
+
+	for (rx = pktgen_rx_list; rx; rx = rx->next)
+		if (rx->pt.dev == dev) {
+			err = -EEXIST;
+			goto out;
+		}
+
+	rx = kmalloc(sizeof(*rx), GFP_KERNEL);
+	if (!rx) {
+		err = -ENOMEM;
+		goto out;
+	}
+	memset(rx, 0, sizeof(*rx));
+	spin_lock_init(&rx->lock);
+	rx->pt.type = htons(ETH_P_IP);
+	rx->pt.dev = dev;
+	rx->pt.func = pktgen_rcv;
+	dev_hold(dev);
+	dev_add_pack(&rx->pt);
+
+	rx->next = pktgen_rx_list;
+	pktgen_rx_list = rx;
+out:
+	rtnl_unlock();
+	return err;
+}
+
+/* Drop the sink on dev, or every sink if dev is NULL */
+static void __pktgen_rx_remove(struct net_device *dev)
+{
+	struct pktgen_rx **prx = &pktgen_rx_list;
+
+	while (*prx) {
+		struct pktgen_rx *rx = *prx;
+
+		if (dev && rx->pt.dev != dev) {
+			prx = &rx->next;
+			continue;
+		}
+		*prx = rx->next;
+		dev_remove_pack(&rx->pt);   /* waits for pktgen_rcv to finish */
+		dev_put(rx->pt.dev);
+		pktgen_rx_free_streams(rx);
+		kfree(rx);
+	}
+}
+
+static void pktgen_rx_remove(struct net_device *dev)
+{
+	/* The netdevice notifier already runs under the RTNL lock */
+	if (dev) {
+		__pktgen_rx_remove(dev);
+		return;
+	}
+	rtnl_lock();
+	__pktgen_rx_remove(NULL);
+	rtnl_unlock();
+}
+
+static void pktgen_rx_reset(void)
+{
+	struct pktgen_rx *rx;
+
+	rtnl_lock();
+	for (rx = pktgen_rx_list; rx; rx = rx->next) {
+		spin_lock_bh(&rx->lock);
+		pktgen_rx_free_streams(rx);
+		spin_unlock_bh(&rx->lock);
+	}
+	rtnl_unlock();
+}
+
+static int proc_rx_read(char *buf , char **start, off_t offset,
+			int len, int *eof, void *data)
+{
+	struct pktgen_rx *rx;
+	char *p = buf;
+	int h, b;
+
+	rtnl_lock();
+	for (rx = pktgen_rx_list; rx; rx = rx->next) {
+		spin_lock_bh(&rx->lock);
+		p += sprintf(p, "%s: streams: %u  untracked: %llu\n",
+			     rx->pt.dev->name, rx->nstreams,
+			     (unsigned long long) rx->untracked);
+
+		for (h = 0; h < PG_RX_HASH_SIZE; h++) {
+			struct pktgen_rx_stream *s;
+
+			for (s = rx->hash[h]; s; s = s->next) {
+				/* Leave room for one more stream */
+				if (p - buf > PAGE_SIZE - 512)
+					goto full;
+
+				p += sprintf(p, "  %u.%u.%u.%u:%u  pkts: %llu  bytes: %llu\n"
+					     "     lost: %llu  reordered: %llu  dups: %llu  next_seq: %u\n",
+					     NIPQUAD(s->saddr), ntohs(s->sport),
+					     (unsigned long long) s->pkts,
+					     (unsigned long long) s->bytes,
+					     (unsigned long long) s->lost,
+					     (unsigned long long) s->reordered,
+					     (unsigned long long) s->dups,
+					     s->next_seq);
+				p += sprintf(p, "     latency min: %uus  avg: %lluus  max: %uus\n     hist:",
+					     s->pkts ? s->lat_min : 0,
+					     (unsigned long long) pg_div64(s->lat_sum, s->pkts ? : 1),
+					     s->lat_max);
+				for (b = 0; b < LAT_BUCKETS_MAX; b++)
+					if (s->lat_hist[b])
+						p += sprintf(p, " <%uus:%u",
+							     1U << b, s->lat_hist[b]);
+				p += sprintf(p, "\n");
+			}
+		}
+		spin_unlock_bh(&rx->lock);
+	}
+	goto out;
+full:
+	spin_unlock_bh(&rx->lock);
+	p += sprintf(p, "...\n");
+out:
+	rtnl_unlock();
+	*eof = 1;
+
+	return p - buf;
+}
+
 static int __init pg_init(void) 
 {
 	int cpu;
@@ -3080,6 +3500,10 @@ static int __init pg_init(void)
         module_proc_ent->proc_fops =  &pktgen_fops;
         module_proc_ent->data = NULL;
 
+        sprintf(pg_rx_fname, "net/%s/pgrx", PG_PROC_DIR);
+        if (!create_proc_read_entry(pg_rx_fname, 0400, NULL, proc_rx_read, NULL))
+                printk("pktgen: ERROR: cannot create %s procfs entry.\n", pg_rx_fname);
+
 	/* Register us to receive netdevice events */
 	register_netdevice_notifier(&pktgen_notifier_block);
         
@@ -3112,8 +3536,11 @@ static void __exit pg_cleanup(void)
         /* Un-register us from receiving netdevice events */
 	unregister_netdevice_notifier(&pktgen_notifier_block);
 
+        pktgen_rx_remove(NULL);
+
         /* Clean up proc file system */
 
+        remove_proc_entry(pg_rx_fname, NULL);
         remove_proc_entry(module_fname, NULL);
         
 	remove_proc_dir();
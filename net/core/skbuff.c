@@ -57,7 +57,9 @@
 #include <linux/cache.h>
 #include <linux/rtnetlink.h>
 #include <linux/init.h>
+#include <linux/cpu.h>
 #include <linux/highmem.h>
+#include <linux/err.h>
 
 #include <net/protocol.h>
 #include <net/dst.h>
@@ -274,14 +276,8 @@ void kfree_skbmem(struct sk_buff *skb)
  *	always call kfree_skb
  */
 
-void __kfree_skb(struct sk_buff *skb)
+static void skb_release_head_state(struct sk_buff *skb)
 {
-	if (skb->list) {
-	 	printk(KERN_WARNING "Warning: kfree_skb passed an skb still "
-		       "on a list (from %p).\n", NET_CALLER(skb));
-		BUG();
-	}
-
 	dst_release(skb->dst);
 #ifdef CONFIG_XFRM
 	secpath_put(skb->sp);
@@ -298,6 +294,17 @@ void __kfree_skb(struct sk_buff *skb)
 	nf_bridge_put(skb->nf_bridge);
 #endif
 #endif
+}
+
+void __kfree_skb(struct sk_buff *skb)
+{
+	if (skb->list) {
+	 	printk(KERN_WARNING "Warning: kfree_skb passed an skb still "
+		       "on a list (from %p).\n", NET_CALLER(skb));
+		BUG();
+	}
+
+	skb_release_head_state(skb);
 /* XXX: IS this still necessary? - JHS */
 #ifdef CONFIG_NET_SCHED
 	skb->tc_index = 0;
@@ -310,6 +317,115 @@ void __kfree_skb(struct sk_buff *skb)
 	kfree_skbmem(skb);
 }
 
+/*
+ * Receive buffer recycling.  Forwarding boxes free about as many
+ * linear buffers on transmit completion as they allocate for their
+ * receive rings.  Instead of handing them back to the slab, a driver
+ * may pass them to skb_recycle(), which keeps a few reset buffers on
+ * a per-cpu list for dev_alloc_skb_recycle() to refill the ring with.
+ */
+#define SKB_RECYCLE_MAX		64
+
+static DEFINE_PER_CPU(struct sk_buff_head, skb_recycle_pool);
+
+/**
+ *	skb_recycle_check - check if skb can be reused for receive
+ *	@skb: buffer
+ *	@skb_size: minimum receive buffer size
+ *
+ *	Checks that the skb passed in is neither shared nor cloned, that
+ *	it is linear and that its buffer can hold @skb_size bytes after the
+ *	headroom of dev_alloc_skb().  If so, everything attached to the skb
+ *	is released and it is reset to the state dev_alloc_skb() returns
+ *	it in.  Must not be called from hard interrupt context.
+ */
+int skb_recycle_check(struct sk_buff *skb, unsigned int skb_size)
+{
+	if (skb_is_nonlinear(skb) || skb->list)
+		return 0;
+
+	if (skb->end - skb->head < SKB_DATA_ALIGN(skb_size + 16))
+		return 0;
+
+	if (skb_shared(skb) || skb_cloned(skb))
+		return 0;
+
+	skb_release_head_state(skb);
+	skb_shinfo(skb)->tso_size = 0;
+	skb_shinfo(skb)->tso_segs = 0;
+
+	memset(skb, 0, offsetof(struct sk_buff, truesize));
+	skb->data = skb->head + 16;
+	skb->tail = skb->data;
+	return 1;
+}
+
+/**
+ *	skb_recycle - free a transmitted buffer for reuse on receive
+ *	@skb: buffer
+ *	@skb_size: receive buffer size of the device
+ *
+ *	Drop a reference to @skb like dev_kfree_skb_any().  If the buffer
+ *	is fit for reuse it is put on this cpu's recycle list instead of
+ *	being freed.
+ */
+void skb_recycle(struct sk_buff *skb, unsigned int skb_size)
+{
+	struct sk_buff_head *pool;
+	unsigned long flags;
+
+	if (in_irq() || irqs_disabled() || !skb_recycle_check(skb, skb_size)) {
+		dev_kfree_skb_any(skb);
+		return;
+	}
+
+	local_irq_save(flags);
+	pool = &__get_cpu_var(skb_recycle_pool);
+	if (likely(skb_queue_len(pool) < SKB_RECYCLE_MAX)) {
+		__skb_queue_head(pool, skb);
+		skb = NULL;
+	}
+	local_irq_restore(flags);
+
+	if (skb)
+		kfree_skbmem(skb);
+}
+
+/**
+ *	dev_alloc_skb_recycle - allocate a receive buffer
+ *	@length: length to allocate
+ *
+ *	Like dev_alloc_skb(), but take a buffer from this cpu's recycle
+ *	list if there is one large enough.
+ */
+struct sk_buff *dev_alloc_skb_recycle(unsigned int length)
+{
+	struct sk_buff *skb;
+	unsigned long flags;
+
+	local_irq_save(flags);
+	skb = __skb_dequeue(&__get_cpu_var(skb_recycle_pool));
+	local_irq_restore(flags);
+
+	if (skb) {
+		if (likely(skb->end - skb->data >= length))
+			return skb;
+		/* The list is shared by all devices, drop misfits. */
+		kfree_skbmem(skb);
+	}
+	return dev_alloc_skb(length);
+}
+
+#ifdef CONFIG_HOTPLUG_CPU
+static int skb_recycle_cpu_callback(struct notifier_block *nfb,
+				    unsigned long action, void *ocpu)
+{
+	if (action == CPU_DEAD)
+		skb_queue_purge(&per_cpu(skb_recycle_pool, (long)ocpu));
+	return NOTIFY_OK;
+}
+#endif
+
 /**
  *	skb_clone	-	duplicate an sk_buff
  *	@skb: buffer to clone
@@ -360,6 +476,7 @@ struct sk_buff *skb_clone(struct sk_buff *skb, int gfp_mask)
 	C(priority);
 	C(protocol);
 	C(security);
+	C(queue_mapping);
 	n->destructor = NULL;
 #ifdef CONFIG_NETFILTER
 	C(nfmark);
@@ -428,6 +545,7 @@ static void copy_skb_header(struct sk_buff *new, const struct sk_buff *old)
 	new->stamp	= old->stamp;
 	new->destructor = NULL;
 	new->security	= old->security;
+	new->queue_mapping = old->queue_mapping;
 #ifdef CONFIG_NETFILTER
 	new->nfmark	= old->nfmark;
 	new->nfcache	= old->nfcache;
@@ -1420,8 +1538,141 @@ void skb_split(struct sk_buff *skb, struct sk_buff *skb1, const u32 len)
 		skb_split_no_header(skb, skb1, len, pos);
 }
 
+/**
+ *	skb_segment - Perform protocol segmentation on skb.
+ *	@skb: buffer to segment
+ *	@features: features for the output path (see dev->features)
+ *
+ *	This function performs segmentation on the given skb.  Each segment
+ *	is at most skb_shinfo(skb)->tso_size bytes of payload and carries a
+ *	copy of the headers from skb->mac.raw up to skb->data.  The caller
+ *	has pulled the headers, so skb->data points at the payload.  When
+ *	%NETIF_F_SG is set in @features the payload pages are shared with
+ *	the original, otherwise the payload is copied and checksummed into
+ *	skb->csum of every segment.  It returns a list of segments linked
+ *	through skb->next, or an ERR_PTR() on failure.
+ */
+struct sk_buff *skb_segment(struct sk_buff *skb, int features)
+{
+	struct sk_buff *segs = NULL;
+	struct sk_buff *tail = NULL;
+	unsigned int mss = skb_shinfo(skb)->tso_size;
+	unsigned int doffset = skb->data - skb->mac.raw;
+	unsigned int offset = doffset;
+	unsigned int headroom;
+	unsigned int len;
+	int sg = features & NETIF_F_SG;
+	int nfrags = skb_shinfo(skb)->nr_frags;
+	int i = 0;
+	int pos;
+
+	__skb_push(skb, doffset);
+	headroom = skb_headroom(skb);
+	pos = skb_headlen(skb);
+
+	do {
+		struct sk_buff *nskb;
+		skb_frag_t *frag;
+		int hsize, nsize;
+		int k;
+		int size;
+
+		len = skb->len - offset;
+		if (len > mss)
+			len = mss;
+
+		hsize = skb_headlen(skb) - offset;
+		if (hsize < 0)
+			hsize = 0;
+		nsize = hsize + doffset;
+		if (nsize > len + doffset || !sg)
+			nsize = len + doffset;
+
+		nskb = alloc_skb(nsize + headroom, GFP_ATOMIC);
+		if (unlikely(!nskb))
+			goto err;
+
+		if (segs)
+			tail->next = nskb;
+		else
+			segs = nskb;
+		tail = nskb;
+
+		nskb->dev = skb->dev;
+		nskb->priority = skb->priority;
+		nskb->protocol = skb->protocol;
+		nskb->dst = dst_clone(skb->dst);
+		memcpy(nskb->cb, skb->cb, sizeof(skb->cb));
+		nskb->pkt_type = skb->pkt_type;
+		nskb->mac_len = skb->mac_len;
+#ifdef CONFIG_NETFILTER
+		nskb->nfmark = skb->nfmark;
+#endif
+
+		skb_reserve(nskb, headroom);
+		nskb->mac.raw = nskb->data;
+		nskb->nh.raw = nskb->data + (skb->nh.raw - skb->mac.raw);
+		nskb->h.raw = nskb->data + (skb->h.raw - skb->mac.raw);
+		memcpy(skb_put(nskb, doffset), skb->data, doffset);
+
+		if (!sg) {
+			nskb->csum = skb_copy_and_csum_bits(skb, offset,
+							    skb_put(nskb, len),
+							    len, 0);
+			continue;
+		}
+
+		frag = skb_shinfo(nskb)->frags;
+		k = 0;
+
+		nskb->ip_summed = CHECKSUM_HW;
+		memcpy(skb_put(nskb, hsize), skb->data + offset, hsize);
+
+		while (pos < offset + len) {
+			BUG_ON(i >= nfrags);
+
+			*frag = skb_shinfo(skb)->frags[i];
+			get_page(frag->page);
+			size = frag->size;
+
+			if (pos < offset) {
+				frag->page_offset += offset - pos;
+				frag->size -= offset - pos;
+			}
+
+			k++;
+
+			if (pos + size <= offset + len) {
+				i++;
+				pos += size;
+			} else {
+				frag->size -= pos + size - (offset + len);
+				break;
+			}
+
+			frag++;
+		}
+
+		skb_shinfo(nskb)->nr_frags = k;
+		nskb->data_len = len - hsize;
+		nskb->len += nskb->data_len;
+		nskb->truesize += nskb->data_len;
+	} while ((offset += len) < skb->len);
+
+	return segs;
+
+err:
+	while ((skb = segs)) {
+		segs = skb->next;
+		kfree_skb(skb);
+	}
+	return ERR_PTR(-ENOMEM);
+}
+
 void __init skb_init(void)
 {
+	int i;
+
 	skbuff_head_cache = kmem_cache_create("skbuff_head_cache",
 					      sizeof(struct sk_buff),
 					      0,
@@ -1429,6 +1680,10 @@ void __init skb_init(void)
 					      NULL, NULL);
 	if (!skbuff_head_cache)
 		panic("cannot create skbuff cache");
+
+	for (i = 0; i < NR_CPUS; i++)
+		skb_queue_head_init(&per_cpu(skb_recycle_pool, i));
+	hotcpu_notifier(skb_recycle_cpu_callback, 0);
 }
 
 EXPORT_SYMBOL(___pskb_trim);
@@ -1458,3 +1713,7 @@ EXPORT_SYMBOL(skb_queue_tail);
 EXPORT_SYMBOL(skb_unlink);
 EXPORT_SYMBOL(skb_append);
 EXPORT_SYMBOL(skb_split);
+EXPORT_SYMBOL_GPL(skb_segment);
+EXPORT_SYMBOL(skb_recycle_check);
+EXPORT_SYMBOL(skb_recycle);
+EXPORT_SYMBOL(dev_alloc_skb_recycle);
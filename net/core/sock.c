@@ -238,6 +238,9 @@ int sock_setsockopt(struct socket *sock, int level, int optname,
 		case SO_REUSEADDR:
 			sk->sk_reuse = valbool;
 			break;
+		case SO_REUSEPORT:
+			sock_valbool_flag(sk, SOCK_REUSEPORT, valbool);
+			break;
 		case SO_TYPE:
 		case SO_ERROR:
 			ret = -ENOPROTOOPT;
@@ -498,6 +501,10 @@ int sock_getsockopt(struct socket *sock, int level, int optname,
 			v.val = sk->sk_reuse;
 			break;
 
+		case SO_REUSEPORT:
+			v.val = sock_flag(sk, SOCK_REUSEPORT);
+			break;
+
 		case SO_KEEPALIVE:
 			v.val = !!sock_flag(sk, SOCK_KEEPOPEN);
 			break;
@@ -1363,7 +1370,8 @@ int proto_register(struct proto *prot, int alloc_slab)
 
 	if (alloc_slab) {
 		prot->slab = kmem_cache_create(prot->name, prot->obj_size, 0,
-					       SLAB_HWCACHE_ALIGN, NULL, NULL);
+					       SLAB_HWCACHE_ALIGN |
+					       prot->slab_flags, NULL, NULL);
 
 		if (prot->slab == NULL) {
 			printk(KERN_CRIT "%s: Can't create sock SLAB cache!\n",
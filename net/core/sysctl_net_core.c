@@ -13,6 +13,7 @@
 #ifdef CONFIG_SYSCTL
 
 extern int netdev_max_backlog;
+extern int netdev_rx_steering;
 extern int weight_p;
 extern int no_cong_thresh;
 extern int no_cong;
@@ -35,6 +36,10 @@ extern int sysctl_somaxconn;
 extern char sysctl_divert_version[];
 #endif /* CONFIG_NET_DIVERT */
 
+#ifdef CONFIG_BPF_JIT
+extern int bpf_jit_enable;
+#endif /* CONFIG_BPF_JIT */
+
 /*
  * This strdup() is used for creating copies of network 
  * device names to be handed over to sysctl.
@@ -98,6 +103,14 @@ ctl_table core_table[] = {
 		.mode		= 0644,
 		.proc_handler	= &proc_dointvec
 	},
+	{
+		.ctl_name	= NET_CORE_RX_STEERING,
+		.procname	= "netdev_rx_steering",
+		.data		= &netdev_rx_steering,
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= &proc_dointvec
+	},
 	{
 		.ctl_name	= NET_CORE_NO_CONG_THRESH,
 		.procname	= "no_cong_thresh",
@@ -165,6 +178,16 @@ ctl_table core_table[] = {
 		.proc_handler	= &proc_dostring
 	},
 #endif /* CONFIG_NET_DIVERT */
+#ifdef CONFIG_BPF_JIT
+	{
+		.ctl_name	= NET_CORE_BPF_JIT_ENABLE,
+		.procname	= "bpf_jit_enable",
+		.data		= &bpf_jit_enable,
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= &proc_dointvec
+	},
+#endif /* CONFIG_BPF_JIT */
 #endif /* CONFIG_NET */
 	{
 		.ctl_name	= NET_CORE_SOMAXCONN,
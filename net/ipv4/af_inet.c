@@ -971,6 +971,8 @@ static struct net_protocol igmp_protocol = {
 static struct net_protocol tcp_protocol = {
 	.handler =	tcp_v4_rcv,
 	.err_handler =	tcp_v4_err,
+	.gso_segment =	tcp_tso_segment,
+	.gro_receive =	tcp_gro_receive,
 	.no_policy =	1,
 };
 
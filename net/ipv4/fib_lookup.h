@@ -3,6 +3,7 @@
 
 #include <linux/types.h>
 #include <linux/list.h>
+#include <linux/rcupdate.h>
 #include <net/ip_fib.h>
 
 struct fib_alias {
@@ -12,6 +13,7 @@ struct fib_alias {
 	u8			fa_type;
 	u8			fa_scope;
 	u8			fa_state;
+	struct rcu_head		rcu;
 };
 
 #define FA_S_ACCESSED	0x01
@@ -0,0 +1,1599 @@
+/*
+ * INET		An implementation of the TCP/IP protocol suite for the LINUX
+ *		operating system.  INET is implemented using the  BSD Socket
+ *		interface as the means of communication with the user level.
+ *
+ *		IPv4 FIB: level compressed trie lookup engine.
+ *
+ *		This program is free software; you can redistribute it and/or
+ *		modify it under the terms of the GNU General Public License
+ *		as published by the Free Software Foundation; either version
+ *		2 of the License, or (at your option) any later version.
+ *
+ * The table is a path and level compressed binary trie keyed by the
+ * destination prefix, as described in
+ *
+ *   S. Nilsson, G. Karlsson: "IP-address lookup using LC-tries",
+ *   IEEE Journal on Selected Areas in Communications 17(6), 1999.
+ *
+ *   S. Nilsson, M. Tikkanen: "Implementing a dynamic compressed trie",
+ *   Proceedings of the 2nd Workshop on Algorithm Engineering, 1998.
+ *
+ * Every internal node (tnode) indexes 'bits' bits of the key starting at
+ * bit 'pos', so a dense part of the address space is resolved in a single
+ * step; bits shared by a whole subtree are skipped.  A leaf holds one key
+ * and the list of prefix lengths (leaf_info) routed at that key, longest
+ * first, each with the usual list of fib_alias entries.
+ *
+ * Lookups take no locks: they run under rcu_read_lock() and never touch
+ * parent pointers.  Updates are serialized by the RTNL semaphore, replace
+ * nodes instead of resizing them in place and free everything through
+ * call_rcu().
+ */
+
+#include <linux/config.h>
+#include <asm/uaccess.h>
+#include <asm/system.h>
+#include <linux/bitops.h>
+#include <linux/types.h>
+#include <linux/kernel.h>
+#include <linux/sched.h>
+#include <linux/mm.h>
+#include <linux/string.h>
+#include <linux/socket.h>
+#include <linux/sockios.h>
+#include <linux/errno.h>
+#include <linux/in.h>
+#include <linux/inet.h>
+#include <linux/netdevice.h>
+#include <linux/if_arp.h>
+#include <linux/proc_fs.h>
+#include <linux/rcupdate.h>
+#include <linux/skbuff.h>
+#include <linux/netlink.h>
+#include <linux/init.h>
+#include <linux/list.h>
+
+#include <net/ip.h>
+#include <net/protocol.h>
+#include <net/route.h>
+#include <net/tcp.h>
+#include <net/sock.h>
+#include <net/ip_fib.h>
+
+#include "fib_lookup.h"
+
+typedef unsigned int t_key;
+
+#define KEYLENGTH	(8*sizeof(t_key))
+
+#define T_TNODE		0
+#define T_LEAF		1
+#define NODE_TYPE_MASK	0x1UL
+
+#define IS_TNODE(n)	(!((n)->parent & T_LEAF))
+#define IS_LEAF(n)	((n)->parent & T_LEAF)
+
+struct node {
+	t_key			key;
+	unsigned long		parent;
+};
+
+struct leaf {
+	t_key			key;
+	unsigned long		parent;
+	struct hlist_head	list;
+	struct rcu_head		rcu;
+};
+
+struct leaf_info {
+	struct hlist_node	hlist;
+	struct rcu_head		rcu;
+	int			plen;
+	struct list_head	falh;
+};
+
+struct tnode {
+	t_key			key;
+	unsigned long		parent;
+	unsigned char		pos;		/* 2log(KEYLENGTH) bits needed */
+	unsigned char		bits;		/* 2log(KEYLENGTH) bits needed */
+	unsigned int		full_children;	/* KEYLENGTH bits needed */
+	unsigned int		empty_children;	/* KEYLENGTH bits needed */
+	struct rcu_head		rcu;
+	struct node		*child[0];
+};
+
+struct trie {
+	struct node		*trie;
+	unsigned int		size;		/* number of leaves */
+};
+
+/*
+ * A tnode is doubled when at least inflate_threshold percent of the
+ * children of the doubled node would be non-empty, and halved when
+ * fewer than halve_threshold percent of its own children are used.
+ */
+static const int halve_threshold = 25;
+static const int inflate_threshold = 50;
+
+static kmem_cache_t *fn_alias_kmem;
+
+/* Bumped on every change so /proc readers know when to restart. */
+static unsigned int fib_trie_genid;
+
+static int fn_trie_last_dflt = -1;
+
+static inline struct tnode *node_parent(struct node *n)
+{
+	return (struct tnode *) (n->parent & ~NODE_TYPE_MASK);
+}
+
+static inline void node_set_parent(struct node *n, struct tnode *tp)
+{
+	n->parent = (unsigned long) tp | (n->parent & NODE_TYPE_MASK);
+}
+
+static inline int tnode_child_length(const struct tnode *tn)
+{
+	return 1 << tn->bits;
+}
+
+static inline struct node *tnode_get_child(struct tnode *tn, int i)
+{
+	BUG_ON(i >= tnode_child_length(tn));
+
+	return rcu_dereference(tn->child[i]);
+}
+
+/* The first l bits of k, the rest cleared. */
+static inline t_key mask_pfx(t_key k, int l)
+{
+	return l == 0 ? 0 : (k >> (KEYLENGTH - l)) << (KEYLENGTH - l);
+}
+
+static inline t_key tkey_extract_bits(t_key a, int offset, int bits)
+{
+	if (offset < KEYLENGTH)
+		return ((t_key)(a << offset)) >> (KEYLENGTH - bits);
+	return 0;
+}
+
+static inline int tkey_equals(t_key a, t_key b)
+{
+	return a == b;
+}
+
+/* Do a and b agree in the bits [offset, offset + bits) ? */
+static inline int tkey_sub_equals(t_key a, int offset, int bits, t_key b)
+{
+	if (bits == 0 || offset >= KEYLENGTH)
+		return 1;
+	return ((t_key)((a ^ b) << offset) >> (KEYLENGTH - bits)) == 0;
+}
+
+/* The first bit at or after offset where a and b differ; they must differ. */
+static inline int tkey_mismatch(t_key a, int offset, t_key b)
+{
+	t_key diff = a ^ b;
+	int i = offset;
+
+	while (!((diff << i) & (1U << (KEYLENGTH - 1))))
+		i++;
+	return i;
+}
+
+/*
+ * A child is "full" when it is a tnode that skips no bits below tn, so
+ * doubling tn absorbs one level of it.
+ */
+static inline int tnode_full(const struct tnode *tn, const struct node *n)
+{
+	if (n == NULL || IS_LEAF(n))
+		return 0;
+
+	return ((struct tnode *) n)->pos == tn->pos + tn->bits;
+}
+
+/*
+ * ---------------------------------------------------------------------
+ * Allocation.  Nothing is freed before a grace period has elapsed,
+ * lookups may still be walking it.
+ */
+
+static void __alias_free_mem(struct rcu_head *head)
+{
+	struct fib_alias *fa = container_of(head, struct fib_alias, rcu);
+
+	fib_info_put(fa->fa_info);
+	kmem_cache_free(fn_alias_kmem, fa);
+}
+
+/*
+ * Unlink the alias from the fib_info tables right away, but keep a
+ * reference on the fib_info for the lookups still holding the alias.
+ */
+static inline void alias_free_mem_rcu(struct fib_alias *fa)
+{
+	atomic_inc(&fa->fa_info->fib_clntref);
+	fib_release_info(fa->fa_info);
+	call_rcu(&fa->rcu, __alias_free_mem);
+}
+
+static void __leaf_free_rcu(struct rcu_head *head)
+{
+	kfree(container_of(head, struct leaf, rcu));
+}
+
+static inline void free_leaf(struct leaf *l)
+{
+	call_rcu(&l->rcu, __leaf_free_rcu);
+}
+
+static void __leaf_info_free_rcu(struct rcu_head *head)
+{
+	kfree(container_of(head, struct leaf_info, rcu));
+}
+
+static inline void free_leaf_info(struct leaf_info *li)
+{
+	call_rcu(&li->rcu, __leaf_info_free_rcu);
+}
+
+static inline size_t tnode_size(int bits)
+{
+	return sizeof(struct tnode) + (sizeof(struct node *) << bits);
+}
+
+static struct tnode *tnode_alloc(size_t size)
+{
+	if (size <= PAGE_SIZE)
+		return kmalloc(size, GFP_KERNEL);
+
+	return (struct tnode *) __get_free_pages(GFP_KERNEL, get_order(size));
+}
+
+static void __tnode_free_rcu(struct rcu_head *head)
+{
+	struct tnode *tn = container_of(head, struct tnode, rcu);
+	size_t size = tnode_size(tn->bits);
+
+	if (size <= PAGE_SIZE)
+		kfree(tn);
+	else
+		free_pages((unsigned long) tn, get_order(size));
+}
+
+static inline void tnode_free(struct tnode *tn)
+{
+	if (IS_LEAF(tn))
+		free_leaf((struct leaf *) tn);
+	else
+		call_rcu(&tn->rcu, __tnode_free_rcu);
+}
+
+static struct leaf *leaf_new(void)
+{
+	struct leaf *l = kmalloc(sizeof(struct leaf), GFP_KERNEL);
+
+	if (l) {
+		l->parent = T_LEAF;
+		INIT_HLIST_HEAD(&l->list);
+	}
+	return l;
+}
+
+static struct leaf_info *leaf_info_new(int plen)
+{
+	struct leaf_info *li = kmalloc(sizeof(struct leaf_info), GFP_KERNEL);
+
+	if (li) {
+		li->plen = plen;
+		INIT_LIST_HEAD(&li->falh);
+	}
+	return li;
+}
+
+static struct tnode *tnode_new(t_key key, int pos, int bits)
+{
+	size_t size = tnode_size(bits);
+	struct tnode *tn = tnode_alloc(size);
+
+	if (tn) {
+		memset(tn, 0, size);
+		tn->parent = T_TNODE;
+		tn->pos = pos;
+		tn->bits = bits;
+		tn->key = key;
+		tn->full_children = 0;
+		tn->empty_children = 1 << bits;
+	}
+	return tn;
+}
+
+/*
+ * Set child i of tn to n, keeping the empty/full child counts of tn up
+ * to date.  wasfull tells whether the old child was full; pass -1 to
+ * have it computed.
+ */
+static void tnode_put_child_reorg(struct tnode *tn, int i, struct node *n,
+				  int wasfull)
+{
+	struct node *chi = tn->child[i];
+	int isfull;
+
+	BUG_ON(i >= tnode_child_length(tn));
+
+	if (n == NULL && chi != NULL)
+		tn->empty_children++;
+	else if (n != NULL && chi == NULL)
+		tn->empty_children--;
+
+	if (wasfull == -1)
+		wasfull = tnode_full(tn, chi);
+
+	isfull = tnode_full(tn, n);
+	if (wasfull && !isfull)
+		tn->full_children--;
+	else if (!wasfull && isfull)
+		tn->full_children++;
+
+	if (n)
+		node_set_parent(n, tn);
+
+	rcu_assign_pointer(tn->child[i], n);
+}
+
+static inline void put_child(struct tnode *tn, int i, struct node *n)
+{
+	tnode_put_child_reorg(tn, i, n, -1);
+}
+
+/*
+ * ---------------------------------------------------------------------
+ * Level compression.  inflate() and halve() build a replacement for tn
+ * and leave the old node intact for concurrent lookups; on allocation
+ * failure they return an error and the trie is left as it was.
+ */
+
+static struct node *resize(struct tnode *tn);
+
+static struct tnode *inflate(struct tnode *oldtnode)
+{
+	int olen = tnode_child_length(oldtnode);
+	struct tnode *tn;
+	int i;
+
+	tn = tnode_new(oldtnode->key, oldtnode->pos, oldtnode->bits + 1);
+	if (!tn)
+		return ERR_PTR(-ENOMEM);
+
+	/*
+	 * Allocate the split halves of every full child with more than
+	 * two children up front, so running out of memory leaves the old
+	 * node untouched.
+	 */
+	for (i = 0; i < olen; i++) {
+		struct tnode *inode = (struct tnode *) oldtnode->child[i];
+		struct tnode *left, *right;
+		t_key m;
+
+		if (!tnode_full(oldtnode, (struct node *) inode) ||
+		    inode->bits == 1)
+			continue;
+
+		m = 1U << (KEYLENGTH - 1 - inode->pos);
+		left = tnode_new(inode->key & ~m, inode->pos + 1,
+				 inode->bits - 1);
+		if (!left)
+			goto nomem;
+		right = tnode_new(inode->key | m, inode->pos + 1,
+				  inode->bits - 1);
+		if (!right) {
+			tnode_free(left);
+			goto nomem;
+		}
+		put_child(tn, 2*i, (struct node *) left);
+		put_child(tn, 2*i+1, (struct node *) right);
+	}
+
+	for (i = 0; i < olen; i++) {
+		struct node *node = oldtnode->child[i];
+		struct tnode *inode, *left, *right;
+		int size, j;
+
+		if (node == NULL)
+			continue;
+
+		/* A leaf or a tnode with skipped bits goes on one side. */
+		if (!tnode_full(oldtnode, node)) {
+			put_child(tn, 2*i + tkey_extract_bits(node->key,
+					oldtnode->pos + oldtnode->bits, 1),
+				  node);
+			continue;
+		}
+
+		/* A binary tnode is absorbed into the new node. */
+		inode = (struct tnode *) node;
+		if (inode->bits == 1) {
+			put_child(tn, 2*i, inode->child[0]);
+			put_child(tn, 2*i+1, inode->child[1]);
+			tnode_free(inode);
+			continue;
+		}
+
+		/* Anything larger is split in two halves. */
+		left = (struct tnode *) tn->child[2*i];
+		right = (struct tnode *) tn->child[2*i+1];
+		put_child(tn, 2*i, NULL);
+		put_child(tn, 2*i+1, NULL);
+
+		size = tnode_child_length(left);
+		for (j = 0; j < size; j++) {
+			put_child(left, j, inode->child[j]);
+			put_child(right, j, inode->child[j + size]);
+		}
+		put_child(tn, 2*i, resize(left));
+		put_child(tn, 2*i+1, resize(right));
+		tnode_free(inode);
+	}
+	tnode_free(oldtnode);
+	return tn;
+
+nomem:
+	for (i = 0; i < tnode_child_length(tn); i++)
+		if (tn->child[i])
+			tnode_free((struct tnode *) tn->child[i]);
+	tnode_free(tn);
+	return ERR_PTR(-ENOMEM);
+}
+
+static struct tnode *halve(struct tnode *oldtnode)
+{
+	int olen = tnode_child_length(oldtnode);
+	struct node *left, *right;
+	struct tnode *tn;
+	int i;
+
+	tn = tnode_new(oldtnode->key, oldtnode->pos, oldtnode->bits - 1);
+	if (!tn)
+		return ERR_PTR(-ENOMEM);
+
+	/* Allocate the binary tnodes for pairs of used children first. */
+	for (i = 0; i < olen; i += 2) {
+		struct tnode *newn;
+
+		left = oldtnode->child[i];
+		right = oldtnode->child[i+1];
+		if (!left || !right)
+			continue;
+
+		newn = tnode_new(left->key, tn->pos + tn->bits, 1);
+		if (!newn)
+			goto nomem;
+		put_child(tn, i/2, (struct node *) newn);
+	}
+
+	for (i = 0; i < olen; i += 2) {
+		struct tnode *newn;
+
+		left = oldtnode->child[i];
+		right = oldtnode->child[i+1];
+
+		if (left == NULL) {
+			if (right)
+				put_child(tn, i/2, right);
+			continue;
+		}
+		if (right == NULL) {
+			put_child(tn, i/2, left);
+			continue;
+		}
+
+		newn = (struct tnode *) tn->child[i/2];
+		put_child(tn, i/2, NULL);
+		put_child(newn, 0, left);
+		put_child(newn, 1, right);
+		put_child(tn, i/2, resize(newn));
+	}
+	tnode_free(oldtnode);
+	return tn;
+
+nomem:
+	for (i = 0; i < tnode_child_length(tn); i++)
+		if (tn->child[i])
+			tnode_free((struct tnode *) tn->child[i]);
+	tnode_free(tn);
+	return ERR_PTR(-ENOMEM);
+}
+
+/*
+ * Return the node that should replace tn: NULL when it has no children
+ * left, its only child, or tn inflated or halved as long as the fill
+ * factor calls for it.
+ */
+static struct node *resize(struct tnode *tn)
+{
+	struct tnode *old_tn;
+	int i;
+
+	if (tn->empty_children == tnode_child_length(tn)) {
+		tnode_free(tn);
+		return NULL;
+	}
+
+	/*
+	 * Doubling turns every full child into two children and every
+	 * other used child into one, so the fill factor of the doubled
+	 * node is (full + used) / (2 * length).
+	 */
+	while (tn->full_children > 0 &&
+	       50 * (tn->full_children + tnode_child_length(tn) -
+		     tn->empty_children) >=
+	       inflate_threshold * tnode_child_length(tn)) {
+		old_tn = tn;
+		tn = inflate(tn);
+		if (IS_ERR(tn)) {
+			tn = old_tn;
+			break;
+		}
+	}
+
+	while (tn->bits > 1 &&
+	       100 * (tnode_child_length(tn) - tn->empty_children) <
+	       halve_threshold * tnode_child_length(tn)) {
+		old_tn = tn;
+		tn = halve(tn);
+		if (IS_ERR(tn)) {
+			tn = old_tn;
+			break;
+		}
+	}
+
+	/* Only one child remains: compress this level away. */
+	if (tn->empty_children == tnode_child_length(tn) - 1) {
+		for (i = 0; i < tnode_child_length(tn); i++) {
+			struct node *n = tn->child[i];
+
+			if (!n)
+				continue;
+			node_set_parent(n, NULL);
+			tnode_free(tn);
+			return n;
+		}
+	}
+
+	return (struct node *) tn;
+}
+
+/*
+ * Resize tn and every tnode above it after a change below tn, and
+ * return the new root.  Called with RTNL held.
+ */
+static struct node *trie_rebalance(struct tnode *tn)
+{
+	t_key key = tn->key;
+	struct tnode *tp;
+
+	while ((tp = node_parent((struct node *) tn)) != NULL) {
+		int cindex = tkey_extract_bits(key, tp->pos, tp->bits);
+		int wasfull = tnode_full(tp, tp->child[cindex]);
+
+		tnode_put_child_reorg(tp, cindex, resize(tn), wasfull);
+		tn = tp;
+	}
+
+	return resize(tn);
+}
+
+/*
+ * ---------------------------------------------------------------------
+ * Walking the trie.
+ */
+
+static struct leaf *fib_find_node(struct trie *t, t_key key)
+{
+	struct node *n = rcu_dereference(t->trie);
+	int pos = 0;
+
+	while (n && IS_TNODE(n)) {
+		struct tnode *tn = (struct tnode *) n;
+
+		if (!tkey_sub_equals(tn->key, pos, tn->pos - pos, key))
+			return NULL;
+		pos = tn->pos + tn->bits;
+		n = tnode_get_child(tn, tkey_extract_bits(key, tn->pos,
+							  tn->bits));
+	}
+
+	if (n && tkey_equals(key, n->key))
+		return (struct leaf *) n;
+	return NULL;
+}
+
+static struct leaf_info *find_leaf_info(struct leaf *l, int plen)
+{
+	struct leaf_info *li;
+	struct hlist_node *node;
+
+	hlist_for_each_entry_rcu(li, node, &l->list, hlist)
+		if (li->plen == plen)
+			return li;
+	return NULL;
+}
+
+static inline struct list_head *get_fa_head(struct leaf *l, int plen)
+{
+	struct leaf_info *li = find_leaf_info(l, plen);
+
+	return li ? &li->falh : NULL;
+}
+
+/* Keep the prefixes of a leaf sorted longest first. */
+static void insert_leaf_info(struct hlist_head *head, struct leaf_info *new)
+{
+	struct leaf_info *li = NULL, *last = NULL;
+	struct hlist_node *node;
+
+	if (hlist_empty(head)) {
+		hlist_add_head_rcu(&new->hlist, head);
+		return;
+	}
+
+	hlist_for_each_entry(li, node, head, hlist) {
+		if (new->plen > li->plen)
+			break;
+		last = li;
+	}
+	if (last)
+		hlist_add_after_rcu(&last->hlist, &new->hlist);
+	else
+		hlist_add_before_rcu(&new->hlist, &li->hlist);
+}
+
+/* The leftmost leaf below n. */
+static struct leaf *leaf_first(struct node *n)
+{
+	while (n && IS_TNODE(n)) {
+		struct tnode *tn = (struct tnode *) n;
+		int i;
+
+		n = NULL;
+		for (i = 0; !n && i < tnode_child_length(tn); i++)
+			n = tnode_get_child(tn, i);
+	}
+	return (struct leaf *) n;
+}
+
+/*
+ * The leaf with the smallest key >= key below n.  This goes top down
+ * rather than following parent pointers, so it can run concurrently
+ * with updates; recursion is bounded by the key length.
+ */
+static struct leaf *leaf_ge(struct node *n, t_key key)
+{
+	struct tnode *tn;
+	struct leaf *l;
+	t_key prefix;
+	int i;
+
+	if (n == NULL)
+		return NULL;
+
+	if (IS_LEAF(n))
+		return n->key >= key ? (struct leaf *) n : NULL;
+
+	tn = (struct tnode *) n;
+	prefix = mask_pfx(tn->key, tn->pos);
+	if (prefix != mask_pfx(key, tn->pos))
+		return prefix > key ? leaf_first(n) : NULL;
+
+	i = tkey_extract_bits(key, tn->pos, tn->bits);
+	l = leaf_ge(tnode_get_child(tn, i), key);
+	while (!l && ++i < tnode_child_length(tn))
+		l = leaf_first(tnode_get_child(tn, i));
+	return l;
+}
+
+static struct leaf *trie_nextleaf(struct trie *t, struct leaf *l)
+{
+	struct node *root = rcu_dereference(t->trie);
+
+	if (l == NULL)
+		return leaf_first(root);
+	if (l->key == ~0U)
+		return NULL;
+	return leaf_ge(root, l->key + 1);
+}
+
+/*
+ * ---------------------------------------------------------------------
+ * Updates, all under RTNL.
+ */
+
+static struct list_head *
+fib_insert_node(struct trie *t, int *err, t_key key, int plen)
+{
+	struct tnode *tp = NULL, *tn;
+	struct node *n;
+	struct leaf *l;
+	struct leaf_info *li;
+	int pos = 0;
+
+	n = t->trie;
+	while (n && IS_TNODE(n)) {
+		tn = (struct tnode *) n;
+		if (!tkey_sub_equals(tn->key, pos, tn->pos - pos, key))
+			break;
+		tp = tn;
+		pos = tn->pos + tn->bits;
+		n = tn->child[tkey_extract_bits(key, tn->pos, tn->bits)];
+		BUG_ON(n && node_parent(n) != tn);
+	}
+
+	/*
+	 * n is now NULL, the leaf for key, or a node whose key diverges
+	 * from key at or after pos; tp is its parent.
+	 */
+	if (n && IS_LEAF(n) && tkey_equals(key, n->key)) {
+		li = leaf_info_new(plen);
+		if (!li) {
+			*err = -ENOMEM;
+			return NULL;
+		}
+		insert_leaf_info(&((struct leaf *) n)->list, li);
+		return &li->falh;
+	}
+
+	l = leaf_new();
+	if (!l) {
+		*err = -ENOMEM;
+		return NULL;
+	}
+	l->key = key;
+	li = leaf_info_new(plen);
+	if (!li) {
+		kfree(l);
+		*err = -ENOMEM;
+		return NULL;
+	}
+	insert_leaf_info(&l->list, li);
+	t->size++;
+
+	if (n == NULL && tp == NULL) {
+		/* First leaf of the table. */
+		rcu_assign_pointer(t->trie, (struct node *) l);
+		return &li->falh;
+	}
+
+	if (n == NULL) {
+		put_child(tp, tkey_extract_bits(key, tp->pos, tp->bits),
+			  (struct node *) l);
+	} else {
+		/* Branch off a new binary tnode where the keys differ. */
+		int newpos = tkey_mismatch(key, pos, n->key);
+		int missbit = tkey_extract_bits(key, newpos, 1);
+
+		tn = tnode_new(n->key, newpos, 1);
+		if (!tn) {
+			t->size--;
+			kfree(li);
+			kfree(l);
+			*err = -ENOMEM;
+			return NULL;
+		}
+		put_child(tn, missbit, (struct node *) l);
+		put_child(tn, 1 - missbit, n);
+
+		if (tp)
+			put_child(tp, tkey_extract_bits(key, tp->pos, tp->bits),
+				  (struct node *) tn);
+		else {
+			node_set_parent((struct node *) tn, NULL);
+			rcu_assign_pointer(t->trie, (struct node *) tn);
+		}
+		tp = tn;
+	}
+
+	rcu_assign_pointer(t->trie, trie_rebalance(tp));
+	return &li->falh;
+}
+
+static void trie_leaf_remove(struct trie *t, struct leaf *l)
+{
+	struct tnode *tp = node_parent((struct node *) l);
+
+	t->size--;
+	if (tp) {
+		put_child(tp, tkey_extract_bits(l->key, tp->pos, tp->bits),
+			  NULL);
+		rcu_assign_pointer(t->trie, trie_rebalance(tp));
+	} else
+		rcu_assign_pointer(t->trie, NULL);
+
+	free_leaf(l);
+}
+
+static int
+fn_trie_insert(struct fib_table *tb, struct rtmsg *r, struct kern_rta *rta,
+	       struct nlmsghdr *nlhdr, struct netlink_skb_parms *req)
+{
+	struct trie *t = (struct trie *) tb->tb_data;
+	struct fib_alias *fa, *new_fa;
+	struct list_head *fa_head = NULL;
+	struct fib_info *fi;
+	int plen = r->rtm_dst_len;
+	int type = r->rtm_type;
+	u8 tos = r->rtm_tos;
+	struct leaf *l;
+	t_key key;
+	u32 mask;
+	int err;
+
+	if (plen > 32)
+		return -EINVAL;
+
+	key = 0;
+	if (rta->rta_dst) {
+		u32 dst;
+		memcpy(&dst, rta->rta_dst, 4);
+		key = ntohl(dst);
+	}
+	mask = ntohl(inet_make_mask(plen));
+	if (key & ~mask)
+		return -EINVAL;
+
+	if ((fi = fib_create_info(r, rta, nlhdr, &err)) == NULL)
+		return err;
+
+	l = fib_find_node(t, key);
+	fa = NULL;
+	if (l) {
+		fa_head = get_fa_head(l, plen);
+		if (fa_head)
+			fa = fib_find_alias(fa_head, tos, fi->fib_priority);
+	}
+
+	/* Now fa, if non-NULL, points to the first fib alias
+	 * with the same keys [prefix,tos,priority], if such key already
+	 * exists or to the node before which we will insert new one.
+	 *
+	 * If fa is NULL, we will need to allocate a new one and
+	 * insert to the head of fa_head.
+	 *
+	 * If fa_head is NULL, no leaf_info for this prefix exists yet
+	 * and fib_insert_node() will add one, with a leaf if needed.
+	 */
+
+	if (fa && fa->fa_tos == tos &&
+	    fa->fa_info->fib_priority == fi->fib_priority) {
+		struct fib_alias *fa_orig;
+
+		err = -EEXIST;
+		if (nlhdr->nlmsg_flags & NLM_F_EXCL)
+			goto out;
+
+		if (nlhdr->nlmsg_flags & NLM_F_REPLACE) {
+			/*
+			 * Lookups may be looking at fa, so swap in a
+			 * new alias rather than editing it in place.
+			 */
+			err = -ENOBUFS;
+			new_fa = kmem_cache_alloc(fn_alias_kmem, SLAB_KERNEL);
+			if (new_fa == NULL)
+				goto out;
+
+			new_fa->fa_info = fi;
+			new_fa->fa_tos = fa->fa_tos;
+			new_fa->fa_type = type;
+			new_fa->fa_scope = r->rtm_scope;
+			new_fa->fa_state = 0;
+
+			list_replace_rcu(&fa->fa_list, &new_fa->fa_list);
+			fib_trie_genid++;
+
+			if (fa->fa_state & FA_S_ACCESSED)
+				rt_cache_flush(-1);
+			alias_free_mem_rcu(fa);
+			return 0;
+		}
+
+		/* Error if we find a perfect match which
+		 * uses the same scope, type, and nexthop
+		 * information.
+		 */
+		fa_orig = fa;
+		fa = list_entry(fa->fa_list.prev, struct fib_alias, fa_list);
+		list_for_each_entry_continue(fa, fa_head, fa_list) {
+			if (fa->fa_tos != tos)
+				break;
+			if (fa->fa_info->fib_priority != fi->fib_priority)
+				break;
+			if (fa->fa_type == type &&
+			    fa->fa_scope == r->rtm_scope &&
+			    fa->fa_info == fi)
+				goto out;
+		}
+		if (!(nlhdr->nlmsg_flags & NLM_F_APPEND))
+			fa = fa_orig;
+	}
+
+	err = -ENOENT;
+	if (!(nlhdr->nlmsg_flags & NLM_F_CREATE))
+		goto out;
+
+	err = -ENOBUFS;
+	new_fa = kmem_cache_alloc(fn_alias_kmem, SLAB_KERNEL);
+	if (new_fa == NULL)
+		goto out;
+
+	new_fa->fa_info = fi;
+	new_fa->fa_tos = tos;
+	new_fa->fa_type = type;
+	new_fa->fa_scope = r->rtm_scope;
+	new_fa->fa_state = 0;
+
+	if (!fa_head) {
+		err = 0;
+		fa_head = fib_insert_node(t, &err, key, plen);
+		if (err)
+			goto out_free_new_fa;
+	}
+
+	list_add_tail_rcu(&new_fa->fa_list,
+			  (fa ? &fa->fa_list : fa_head));
+	fib_trie_genid++;
+
+	rt_cache_flush(-1);
+	rtmsg_fib(RTM_NEWROUTE, htonl(key), new_fa, plen, tb->tb_id,
+		  nlhdr, req);
+	return 0;
+
+out_free_new_fa:
+	kmem_cache_free(fn_alias_kmem, new_fa);
+out:
+	fib_release_info(fi);
+	return err;
+}
+
+static int
+fn_trie_delete(struct fib_table *tb, struct rtmsg *r, struct kern_rta *rta,
+	       struct nlmsghdr *nlhdr, struct netlink_skb_parms *req)
+{
+	struct trie *t = (struct trie *) tb->tb_data;
+	struct fib_alias *fa, *fa_to_delete;
+	struct list_head *fa_head;
+	struct leaf_info *li;
+	struct leaf *l;
+	int plen = r->rtm_dst_len;
+	u8 tos = r->rtm_tos;
+	t_key key;
+	u32 mask;
+
+	if (plen > 32)
+		return -EINVAL;
+
+	key = 0;
+	if (rta->rta_dst) {
+		u32 dst;
+		memcpy(&dst, rta->rta_dst, 4);
+		key = ntohl(dst);
+	}
+	mask = ntohl(inet_make_mask(plen));
+	if (key & ~mask)
+		return -EINVAL;
+
+	l = fib_find_node(t, key);
+	if (!l)
+		return -ESRCH;
+
+	li = find_leaf_info(l, plen);
+	if (!li)
+		return -ESRCH;
+	fa_head = &li->falh;
+
+	fa = fib_find_alias(fa_head, tos, 0);
+	if (!fa)
+		return -ESRCH;
+
+	fa_to_delete = NULL;
+	fa = list_entry(fa->fa_list.prev, struct fib_alias, fa_list);
+	list_for_each_entry_continue(fa, fa_head, fa_list) {
+		struct fib_info *fi = fa->fa_info;
+
+		if (fa->fa_tos != tos)
+			break;
+
+		if ((!r->rtm_type ||
+		     fa->fa_type == r->rtm_type) &&
+		    (r->rtm_scope == RT_SCOPE_NOWHERE ||
+		     fa->fa_scope == r->rtm_scope) &&
+		    (!r->rtm_protocol ||
+		     fi->fib_protocol == r->rtm_protocol) &&
+		    fib_nh_match(r, nlhdr, rta, fi) == 0) {
+			fa_to_delete = fa;
+			break;
+		}
+	}
+
+	if (!fa_to_delete)
+		return -ESRCH;
+
+	fa = fa_to_delete;
+	rtmsg_fib(RTM_DELROUTE, htonl(key), fa, plen, tb->tb_id, nlhdr, req);
+
+	list_del_rcu(&fa->fa_list);
+	if (list_empty(fa_head)) {
+		hlist_del_rcu(&li->hlist);
+		free_leaf_info(li);
+	}
+	if (hlist_empty(&l->list))
+		trie_leaf_remove(t, l);
+	fib_trie_genid++;
+
+	if (fa->fa_state & FA_S_ACCESSED)
+		rt_cache_flush(-1);
+	alias_free_mem_rcu(fa);
+	return 0;
+}
+
+static int trie_flush_leaf(struct leaf *l)
+{
+	struct hlist_node *node, *tmp;
+	struct leaf_info *li;
+	int found = 0;
+
+	hlist_for_each_entry_safe(li, node, tmp, &l->list, hlist) {
+		struct fib_alias *fa, *fa_node;
+
+		list_for_each_entry_safe(fa, fa_node, &li->falh, fa_list) {
+			struct fib_info *fi = fa->fa_info;
+
+			if (fi && (fi->fib_flags & RTNH_F_DEAD)) {
+				list_del_rcu(&fa->fa_list);
+				alias_free_mem_rcu(fa);
+				found++;
+			}
+		}
+
+		if (list_empty(&li->falh)) {
+			hlist_del_rcu(&li->hlist);
+			free_leaf_info(li);
+		}
+	}
+	return found;
+}
+
+static int fn_trie_flush(struct fib_table *tb)
+{
+	struct trie *t = (struct trie *) tb->tb_data;
+	struct leaf *l, *ll = NULL;
+	int found = 0;
+
+	/* Drop an emptied leaf only once we have moved past it. */
+	for (l = trie_nextleaf(t, NULL); l; l = trie_nextleaf(t, l)) {
+		found += trie_flush_leaf(l);
+		if (ll && hlist_empty(&ll->list))
+			trie_leaf_remove(t, ll);
+		ll = l;
+	}
+	if (ll && hlist_empty(&ll->list))
+		trie_leaf_remove(t, ll);
+
+	if (found)
+		fib_trie_genid++;
+	return found;
+}
+
+/*
+ * ---------------------------------------------------------------------
+ * Lookups, under rcu_read_lock() only.
+ */
+
+static inline int check_leaf(struct leaf *l, t_key key,
+			     const struct flowi *flp, struct fib_result *res)
+{
+	struct leaf_info *li;
+	struct hlist_node *node;
+	int err;
+
+	hlist_for_each_entry_rcu(li, node, &l->list, hlist) {
+		u32 mask = inet_make_mask(li->plen);
+
+		if (l->key != (key & ntohl(mask)))
+			continue;
+
+		err = fib_semantic_match(&li->falh, flp, res,
+					 htonl(l->key), mask, li->plen);
+		if (err <= 0)
+			return err;
+	}
+	return 1;
+}
+
+/*
+ * Longest prefix match.  Follow the destination down to a leaf; if no
+ * prefix there matches, back up and retry with the lowest set bit of
+ * the child index cleared, which is where the next shorter prefix of
+ * the destination lives.  Bits below the current prefix length are
+ * taken as zero on the way down again.  The path is kept on the stack
+ * so parent pointers, which updates rewrite, are never followed.
+ */
+static int
+fn_trie_lookup(struct fib_table *tb, const struct flowi *flp,
+	       struct fib_result *res)
+{
+	struct trie *t = (struct trie *) tb->tb_data;
+	struct tnode *path[KEYLENGTH];
+	t_key key = ntohl(flp->fl4_dst);
+	int plen = KEYLENGTH;
+	int depth = 0;
+	int chopped = 0;
+	struct tnode *pn;
+	struct node *n;
+	int cindex;
+	int ret = 1;
+
+	rcu_read_lock();
+
+	n = rcu_dereference(t->trie);
+	if (!n)
+		goto out;
+
+	if (IS_LEAF(n)) {
+		ret = check_leaf((struct leaf *) n, key, flp, res);
+		goto out;
+	}
+
+	pn = (struct tnode *) n;
+	cindex = tkey_extract_bits(key, pn->pos, pn->bits);
+
+	for (;;) {
+		n = tnode_get_child(pn, cindex);
+		if (n) {
+			if (IS_TNODE(n)) {
+				path[depth++] = pn;
+				pn = (struct tnode *) n;
+				cindex = tkey_extract_bits(mask_pfx(key, plen),
+							   pn->pos, pn->bits);
+				chopped = 0;
+				continue;
+			}
+			ret = check_leaf((struct leaf *) n, key, flp, res);
+			if (ret <= 0)
+				goto out;
+		}
+
+backtrace:
+		/* Clearing a zero bit would revisit the same child. */
+		while (chopped < pn->bits && !(cindex & (1 << chopped)))
+			chopped++;
+
+		if (chopped < pn->bits) {
+			cindex &= ~(1 << chopped);
+			chopped++;
+			if (plen > pn->pos + pn->bits - chopped)
+				plen = pn->pos + pn->bits - chopped;
+			continue;
+		}
+
+		/* Every index bit is gone, continue in the parent. */
+		if (depth == 0)
+			break;
+		n = (struct node *) pn;
+		pn = path[--depth];
+		cindex = tkey_extract_bits(n->key, pn->pos, pn->bits);
+		chopped = 0;
+		goto backtrace;
+	}
+	ret = 1;
+out:
+	rcu_read_unlock();
+	return ret;
+}
+
+static void
+fn_trie_select_default(struct fib_table *tb, const struct flowi *flp,
+		       struct fib_result *res)
+{
+	struct trie *t = (struct trie *) tb->tb_data;
+	int order, last_idx;
+	struct fib_info *fi = NULL;
+	struct fib_info *last_resort;
+	struct fib_alias *fa;
+	struct list_head *fa_head;
+	struct leaf *l;
+
+	last_idx = -1;
+	last_resort = NULL;
+	order = -1;
+
+	rcu_read_lock();
+
+	l = fib_find_node(t, 0);
+	if (!l)
+		goto out;
+
+	fa_head = get_fa_head(l, 0);
+	if (!fa_head)
+		goto out;
+
+	list_for_each_entry_rcu(fa, fa_head, fa_list) {
+		struct fib_info *next_fi = fa->fa_info;
+
+		if (fa->fa_scope != res->scope ||
+		    fa->fa_type != RTN_UNICAST)
+			continue;
+
+		if (next_fi->fib_priority > res->fi->fib_priority)
+			break;
+		if (!next_fi->fib_nh[0].nh_gw ||
+		    next_fi->fib_nh[0].nh_scope != RT_SCOPE_LINK)
+			continue;
+		fa->fa_state |= FA_S_ACCESSED;
+
+		if (fi == NULL) {
+			if (next_fi != res->fi)
+				break;
+		} else if (!fib_detect_death(fi, order, &last_resort,
+					     &last_idx, &fn_trie_last_dflt)) {
+			if (res->fi)
+				fib_info_put(res->fi);
+			res->fi = fi;
+			atomic_inc(&fi->fib_clntref);
+			fn_trie_last_dflt = order;
+			goto out;
+		}
+		fi = next_fi;
+		order++;
+	}
+
+	if (order <= 0 || fi == NULL) {
+		fn_trie_last_dflt = -1;
+		goto out;
+	}
+
+	if (!fib_detect_death(fi, order, &last_resort, &last_idx,
+			      &fn_trie_last_dflt)) {
+		if (res->fi)
+			fib_info_put(res->fi);
+		res->fi = fi;
+		atomic_inc(&fi->fib_clntref);
+		fn_trie_last_dflt = order;
+		goto out;
+	}
+
+	if (last_idx >= 0) {
+		if (res->fi)
+			fib_info_put(res->fi);
+		res->fi = last_resort;
+		if (last_resort)
+			atomic_inc(&last_resort->fib_clntref);
+	}
+	fn_trie_last_dflt = last_idx;
+out:
+	rcu_read_unlock();
+}
+
+/*
+ * Netlink dumps may span several calls with the table changing in
+ * between.  cb->args[1] is set once we stopped inside this table,
+ * cb->args[2] is then the key of the leaf we stopped at and
+ * cb->args[3] the number of its entries already sent.
+ */
+static int fn_trie_dump(struct fib_table *tb, struct sk_buff *skb,
+			struct netlink_callback *cb)
+{
+	struct trie *t = (struct trie *) tb->tb_data;
+	struct leaf *l;
+	int s_i = 0;
+
+	rcu_read_lock();
+
+	if (cb->args[1]) {
+		l = leaf_ge(rcu_dereference(t->trie), (t_key) cb->args[2]);
+		if (l && l->key == (t_key) cb->args[2])
+			s_i = cb->args[3];
+	} else
+		l = trie_nextleaf(t, NULL);
+
+	for (; l; l = trie_nextleaf(t, l)) {
+		u32 prefix = htonl(l->key);
+		struct leaf_info *li;
+		struct hlist_node *node;
+		int i = 0;
+
+		hlist_for_each_entry_rcu(li, node, &l->list, hlist) {
+			struct fib_alias *fa;
+
+			list_for_each_entry_rcu(fa, &li->falh, fa_list) {
+				if (i < s_i)
+					goto next;
+
+				if (fib_dump_info(skb, NETLINK_CB(cb->skb).pid,
+						  cb->nlh->nlmsg_seq,
+						  RTM_NEWROUTE,
+						  tb->tb_id,
+						  fa->fa_type,
+						  fa->fa_scope,
+						  &prefix,
+						  li->plen,
+						  fa->fa_tos,
+						  fa->fa_info) < 0) {
+					cb->args[1] = 1;
+					cb->args[2] = l->key;
+					cb->args[3] = i;
+					rcu_read_unlock();
+					return -1;
+				}
+			next:
+				i++;
+			}
+		}
+		s_i = 0;
+	}
+
+	rcu_read_unlock();
+	return skb->len;
+}
+
+#ifdef CONFIG_IP_MULTIPLE_TABLES
+struct fib_table * fib_hash_init(int id)
+#else
+struct fib_table * __init fib_hash_init(int id)
+#endif
+{
+	struct fib_table *tb;
+
+	if (fn_alias_kmem == NULL)
+		fn_alias_kmem = kmem_cache_create("ip_fib_alias",
+						  sizeof(struct fib_alias),
+						  0, SLAB_HWCACHE_ALIGN,
+						  NULL, NULL);
+
+	tb = kmalloc(sizeof(struct fib_table) + sizeof(struct trie),
+		     GFP_KERNEL);
+	if (tb == NULL)
+		return NULL;
+
+	tb->tb_id = id;
+	tb->tb_lookup = fn_trie_lookup;
+	tb->tb_insert = fn_trie_insert;
+	tb->tb_delete = fn_trie_delete;
+	tb->tb_flush = fn_trie_flush;
+	tb->tb_select_default = fn_trie_select_default;
+	tb->tb_dump = fn_trie_dump;
+	memset(tb->tb_data, 0, sizeof(struct trie));
+	return tb;
+}
+
+/* ------------------------------------------------------------------------ */
+#ifdef CONFIG_PROC_FS
+
+struct fib_iter_state {
+	struct leaf		*l;
+	struct leaf_info	*li;
+	struct fib_alias	*fa;
+	loff_t			pos;
+	unsigned int		genid;
+	int			valid;
+};
+
+/* The first alias at or after leaf l. */
+static struct fib_alias *fib_iter_leaf(struct fib_iter_state *iter,
+				       struct trie *t, struct leaf *l)
+{
+	for (; l; l = trie_nextleaf(t, l)) {
+		struct leaf_info *li;
+		struct hlist_node *node;
+
+		hlist_for_each_entry_rcu(li, node, &l->list, hlist) {
+			struct fib_alias *fa;
+
+			list_for_each_entry_rcu(fa, &li->falh, fa_list) {
+				iter->l = l;
+				iter->li = li;
+				iter->fa = fa;
+				return fa;
+			}
+		}
+	}
+	iter->l = NULL;
+	iter->li = NULL;
+	iter->fa = NULL;
+	return NULL;
+}
+
+static struct fib_alias *fib_get_first(struct seq_file *seq)
+{
+	struct fib_iter_state *iter = seq->private;
+	struct trie *t = (struct trie *) ip_fib_main_table->tb_data;
+
+	iter->pos	= 0;
+	iter->genid	= fib_trie_genid;
+	iter->valid	= 1;
+
+	return fib_iter_leaf(iter, t, trie_nextleaf(t, NULL));
+}
+
+static struct fib_alias *fib_get_next(struct seq_file *seq)
+{
+	struct fib_iter_state *iter = seq->private;
+	struct trie *t = (struct trie *) ip_fib_main_table->tb_data;
+	struct leaf_info *li = iter->li;
+	struct fib_alias *fa = iter->fa;
+	struct list_head *next;
+	struct hlist_node *node;
+
+	iter->pos++;
+	if (!fa)
+		return NULL;
+
+	/* Advance FA, then LI, then the leaf. */
+	next = rcu_dereference(fa->fa_list.next);
+	if (next != &li->falh) {
+		iter->fa = list_entry(next, struct fib_alias, fa_list);
+		return iter->fa;
+	}
+
+	for (node = rcu_dereference(li->hlist.next); node;
+	     node = rcu_dereference(node->next)) {
+		li = hlist_entry(node, struct leaf_info, hlist);
+		list_for_each_entry_rcu(fa, &li->falh, fa_list) {
+			iter->li = li;
+			iter->fa = fa;
+			return fa;
+		}
+	}
+
+	return fib_iter_leaf(iter, t, trie_nextleaf(t, iter->l));
+}
+
+static struct fib_alias *fib_get_idx(struct seq_file *seq, loff_t pos)
+{
+	struct fib_iter_state *iter = seq->private;
+	struct fib_alias *fa;
+
+	if (iter->valid && pos >= iter->pos && iter->genid == fib_trie_genid) {
+		fa   = iter->fa;
+		pos -= iter->pos;
+	} else
+		fa = fib_get_first(seq);
+
+	if (fa)
+		while (pos && (fa = fib_get_next(seq)))
+			--pos;
+	return pos ? NULL : fa;
+}
+
+static void *fib_seq_start(struct seq_file *seq, loff_t *pos)
+{
+	void *v = NULL;
+
+	rcu_read_lock();
+	if (ip_fib_main_table)
+		v = *pos ? fib_get_idx(seq, *pos - 1) : SEQ_START_TOKEN;
+	return v;
+}
+
+static void *fib_seq_next(struct seq_file *seq, void *v, loff_t *pos)
+{
+	++*pos;
+	return v == SEQ_START_TOKEN ? fib_get_first(seq) : fib_get_next(seq);
+}
+
+static void fib_seq_stop(struct seq_file *seq, void *v)
+{
+	rcu_read_unlock();
+}
+
+static unsigned fib_flag_trans(int type, u32 mask, struct fib_info *fi)
+{
+	static unsigned type2flags[RTN_MAX + 1] = {
+		[7] = RTF_REJECT, [8] = RTF_REJECT,
+	};
+	unsigned flags = type2flags[type];
+
+	if (fi && fi->fib_nh->nh_gw)
+		flags |= RTF_GATEWAY;
+	if (mask == 0xFFFFFFFF)
+		flags |= RTF_HOST;
+	flags |= RTF_UP;
+	return flags;
+}
+
+/*
+ *	This outputs /proc/net/route.
+ *
+ *	It always works in backward compatibility mode.
+ *	The format of the file is not supposed to be changed.
+ */
+static int fib_seq_show(struct seq_file *seq, void *v)
+{
+	struct fib_iter_state *iter;
+	char bf[128];
+	u32 prefix, mask;
+	unsigned flags;
+	struct fib_alias *fa;
+	struct fib_info *fi;
+
+	if (v == SEQ_START_TOKEN) {
+		seq_printf(seq, "%-127s\n", "Iface\tDestination\tGateway "
+			   "\tFlags\tRefCnt\tUse\tMetric\tMask\t\tMTU"
+			   "\tWindow\tIRTT");
+		goto out;
+	}
+
+	iter	= seq->private;
+	fa	= iter->fa;
+	fi	= fa->fa_info;
+	prefix	= htonl(iter->l->key);
+	mask	= inet_make_mask(iter->li->plen);
+	flags	= fib_flag_trans(fa->fa_type, mask, fi);
+	if (fi)
+		snprintf(bf, sizeof(bf),
+			 "%s\t%08X\t%08X\t%04X\t%d\t%u\t%d\t%08X\t%d\t%u\t%u",
+			 fi->fib_dev ? fi->fib_dev->name : "*", prefix,
+			 fi->fib_nh->nh_gw, flags, 0, 0, fi->fib_priority,
+			 mask, (fi->fib_advmss ? fi->fib_advmss + 40 : 0),
+			 fi->fib_window,
+			 fi->fib_rtt >> 3);
+	else
+		snprintf(bf, sizeof(bf),
+			 "*\t%08X\t%08X\t%04X\t%d\t%u\t%d\t%08X\t%d\t%u\t%u",
+			 prefix, 0, flags, 0, 0, 0, mask, 0, 0, 0);
+	seq_printf(seq, "%-127s\n", bf);
+out:
+	return 0;
+}
+
+static struct seq_operations fib_seq_ops = {
+	.start  = fib_seq_start,
+	.next   = fib_seq_next,
+	.stop   = fib_seq_stop,
+	.show   = fib_seq_show,
+};
+
+static int fib_seq_open(struct inode *inode, struct file *file)
+{
+	struct seq_file *seq;
+	int rc = -ENOMEM;
+	struct fib_iter_state *s = kmalloc(sizeof(*s), GFP_KERNEL);
+
+	if (!s)
+		goto out;
+
+	rc = seq_open(file, &fib_seq_ops);
+	if (rc)
+		goto out_kfree;
+
+	seq	     = file->private_data;
+	seq->private = s;
+	memset(s, 0, sizeof(*s));
+out:
+	return rc;
+out_kfree:
+	kfree(s);
+	goto out;
+}
+
+static struct file_operations fib_seq_fops = {
+	.owner		= THIS_MODULE,
+	.open           = fib_seq_open,
+	.read           = seq_read,
+	.llseek         = seq_lseek,
+	.release	= seq_release_private,
+};
+
+int __init fib_proc_init(void)
+{
+	if (!proc_net_fops_create("route", S_IRUGO, &fib_seq_fops))
+		return -ENOMEM;
+	return 0;
+}
+
+void __init fib_proc_exit(void)
+{
+	proc_net_remove("route");
+}
+#endif /* CONFIG_PROC_FS */
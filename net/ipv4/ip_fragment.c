@@ -91,62 +91,118 @@ struct ipq {
 	struct timer_list timer;	/* when will this queue expire?		*/
 	struct ipq	**pprev;
 	int		iif;
+	unsigned long	lru_stamp;	/* when last moved in the lru list	*/
 	struct timeval	stamp;
 };
 
-/* Hash table. */
+/* Hash table.
+ *
+ * ipfrag_lock is only taken for writing to change the secret or the size
+ * of the table; lookups and changes of a chain read_lock it and take the
+ * lock of the chain.  The lru list has its own lock, and a queue moves to
+ * its tail at most once a jiffy.
+ *
+ * The table starts at IPQ_HASHSZ chains and doubles, when the secret is
+ * rebuilt, while there are more queues than chains.  A lookup passing
+ * more than IPQ_MAX_DEPTH queues has the secret rebuilt at once, and
+ * does not add one more to a full sized table: that chain is under
+ * attack, or the table is too small anyway.
+ */
 
 #define IPQ_HASHSZ	64
+#define IPQ_MAX_HASHSZ	4096
+#define IPQ_MAX_DEPTH	32
+#define IPQ_LOCKS	64		/* no more than IPQ_HASHSZ */
 
-/* Per-bucket lock is easy to add now. */
-static struct ipq *ipq_hash[IPQ_HASHSZ];
+static struct ipq *ipq_hash_init[IPQ_HASHSZ];
+static struct ipq **ipq_hash = ipq_hash_init;
+static unsigned int ipq_hash_size = IPQ_HASHSZ;
 static DEFINE_RWLOCK(ipfrag_lock);
+static spinlock_t ipq_chain_lock[IPQ_LOCKS];
 static u32 ipfrag_hash_rnd;
 static LIST_HEAD(ipq_lru_list);
-int ip_frag_nqueues = 0;
+static DEFINE_SPINLOCK(ipq_lru_lock);
+atomic_t ip_frag_nqueues = ATOMIC_INIT(0);
+
+#define ipq_chain_lock(hash)	(&ipq_chain_lock[(hash) & (IPQ_LOCKS - 1)])
+
+static unsigned int ipqhashfn(u16 id, u32 saddr, u32 daddr, u8 prot)
+{
+	return jhash_3words((u32)id << 16 | prot, saddr, daddr,
+			    ipfrag_hash_rnd) & (ipq_hash_size - 1);
+}
 
 static __inline__ void __ipq_unlink(struct ipq *qp)
 {
 	if(qp->next)
 		qp->next->pprev = qp->pprev;
 	*qp->pprev = qp->next;
-	list_del(&qp->lru_list);
-	ip_frag_nqueues--;
 }
 
 static __inline__ void ipq_unlink(struct ipq *ipq)
 {
-	write_lock(&ipfrag_lock);
+	unsigned int hash;
+
+	read_lock(&ipfrag_lock);
+	hash = ipqhashfn(ipq->id, ipq->saddr, ipq->daddr, ipq->protocol);
+	spin_lock(ipq_chain_lock(hash));
 	__ipq_unlink(ipq);
-	write_unlock(&ipfrag_lock);
-}
+	spin_unlock(ipq_chain_lock(hash));
+	read_unlock(&ipfrag_lock);
 
-static unsigned int ipqhashfn(u16 id, u32 saddr, u32 daddr, u8 prot)
-{
-	return jhash_3words((u32)id << 16 | prot, saddr, daddr,
-			    ipfrag_hash_rnd) & (IPQ_HASHSZ - 1);
+	spin_lock(&ipq_lru_lock);
+	list_del(&ipq->lru_list);
+	spin_unlock(&ipq_lru_lock);
+	atomic_dec(&ip_frag_nqueues);
 }
 
 static struct timer_list ipfrag_secret_timer;
 int sysctl_ipfrag_secret_interval = 10 * 60 * HZ;
 
+/* Called with ipfrag_lock held for writing */
+static struct ipq **ipfrag_hash_grow(void)
+{
+	unsigned int size = ipq_hash_size;
+	struct ipq **hash;
+
+	while (size < IPQ_MAX_HASHSZ &&
+	       atomic_read(&ip_frag_nqueues) > size)
+		size <<= 1;
+	if (size == ipq_hash_size)
+		return NULL;
+
+	hash = kmalloc(size * sizeof(struct ipq *), GFP_ATOMIC);
+	if (!hash)
+		return NULL;
+	memset(hash, 0, size * sizeof(struct ipq *));
+	ipq_hash_size = size;
+	return hash;
+}
+
 static void ipfrag_secret_rebuild(unsigned long dummy)
 {
 	unsigned long now = jiffies;
+	unsigned int old_size;
+	struct ipq **old_hash, **new_hash;
 	int i;
 
 	write_lock(&ipfrag_lock);
 	get_random_bytes(&ipfrag_hash_rnd, sizeof(u32));
-	for (i = 0; i < IPQ_HASHSZ; i++) {
+	old_hash = ipq_hash;
+	old_size = ipq_hash_size;
+	new_hash = ipfrag_hash_grow();
+	if (new_hash)
+		ipq_hash = new_hash;
+	for (i = 0; i < old_size; i++) {
 		struct ipq *q;
 
-		q = ipq_hash[i];
+		q = old_hash[i];
 		while (q) {
 			struct ipq *next = q->next;
 			unsigned int hval = ipqhashfn(q->id, q->saddr,
 						      q->daddr, q->protocol);
 
-			if (hval != i) {
+			if (new_hash || hval != i) {
 				/* Unlink. */
 				if (q->next)
 					q->next->pprev = q->pprev;
@@ -164,6 +220,9 @@ static void ipfrag_secret_rebuild(unsigned long dummy)
 	}
 	write_unlock(&ipfrag_lock);
 
+	if (new_hash && old_hash != ipq_hash_init)
+		kfree(old_hash);
+
 	mod_timer(&ipfrag_secret_timer, now + sysctl_ipfrag_secret_interval);
 }
 
@@ -255,15 +314,15 @@ static void ip_evictor(void)
 		return;
 
 	while (work > 0) {
-		read_lock(&ipfrag_lock);
+		spin_lock(&ipq_lru_lock);
 		if (list_empty(&ipq_lru_list)) {
-			read_unlock(&ipfrag_lock);
+			spin_unlock(&ipq_lru_lock);
 			return;
 		}
 		tmp = ipq_lru_list.next;
 		qp = list_entry(tmp, struct ipq, lru_list);
 		atomic_inc(&qp->refcnt);
-		read_unlock(&ipfrag_lock);
+		spin_unlock(&ipq_lru_lock);
 
 		spin_lock(&qp->lock);
 		if (!(qp->last_in&COMPLETE))
@@ -272,6 +331,7 @@ static void ip_evictor(void)
 
 		ipq_put(qp, &work);
 		IP_INC_STATS_BH(IPSTATS_MIB_REASMFAILS);
+		NET_INC_STATS_BH(LINUX_MIB_IPFRAGEVICTED);
 	}
 }
 
@@ -307,31 +367,13 @@ out:
 
 /* Creation primitives. */
 
-static struct ipq *ip_frag_intern(unsigned int hash, struct ipq *qp_in)
+/* Called with ipfrag_lock read locked and the chain of hash locked,
+ * which are both unlocked on return.  The chain has stayed locked since
+ * ip_find() did not find the queue in it, so no other cpu can have
+ * created it meanwhile.
+ */
+static struct ipq *ip_frag_intern(unsigned int hash, struct ipq *qp)
 {
-	struct ipq *qp;
-
-	write_lock(&ipfrag_lock);
-#ifdef CONFIG_SMP
-	/* With SMP race we have to recheck hash table, because
-	 * such entry could be created on other cpu, while we
-	 * promoted read lock to write lock.
-	 */
-	for(qp = ipq_hash[hash]; qp; qp = qp->next) {
-		if(qp->id == qp_in->id		&&
-		   qp->saddr == qp_in->saddr	&&
-		   qp->daddr == qp_in->daddr	&&
-		   qp->protocol == qp_in->protocol &&
-		   qp->user == qp_in->user) {
-			atomic_inc(&qp->refcnt);
-			write_unlock(&ipfrag_lock);
-			qp_in->last_in |= COMPLETE;
-			ipq_put(qp_in, NULL);
-			return qp;
-		}
-	}
-#endif
-	qp = qp_in;
 
 	if (!mod_timer(&qp->timer, jiffies + sysctl_ipfrag_time))
 		atomic_inc(&qp->refcnt);
@@ -341,14 +383,21 @@ static struct ipq *ip_frag_intern(unsigned int hash, struct ipq *qp_in)
 		qp->next->pprev = &qp->next;
 	ipq_hash[hash] = qp;
 	qp->pprev = &ipq_hash[hash];
-	INIT_LIST_HEAD(&qp->lru_list);
+	/* on the lru before the chain is unlocked, for ip_frag_queue() */
+	qp->lru_stamp = jiffies;
+	spin_lock(&ipq_lru_lock);
 	list_add_tail(&qp->lru_list, &ipq_lru_list);
-	ip_frag_nqueues++;
-	write_unlock(&ipfrag_lock);
+	spin_unlock(&ipq_lru_lock);
+	atomic_inc(&ip_frag_nqueues);
+	spin_unlock(ipq_chain_lock(hash));
+	read_unlock(&ipfrag_lock);
 	return qp;
 }
 
-/* Add an entry to the 'ipq' queue for a newly received IP datagram. */
+/* Add an entry to the 'ipq' queue for a newly received IP datagram.
+ * Called with ipfrag_lock read locked and the chain of hash locked,
+ * which are both unlocked on return.
+ */
 static struct ipq *ip_frag_create(unsigned hash, struct iphdr *iph, u32 user)
 {
 	struct ipq *qp;
@@ -377,6 +426,8 @@ static struct ipq *ip_frag_create(unsigned hash, struct iphdr *iph, u32 user)
 	return ip_frag_intern(hash, qp);
 
 out_nomem:
+	spin_unlock(ipq_chain_lock(hash));
+	read_unlock(&ipfrag_lock);
 	NETDEBUG(if (net_ratelimit()) printk(KERN_ERR "ip_frag_create: no memory left !\n"));
 	return NULL;
 }
@@ -390,10 +441,13 @@ static inline struct ipq *ip_find(struct iphdr *iph, u32 user)
 	__u32 saddr = iph->saddr;
 	__u32 daddr = iph->daddr;
 	__u8 protocol = iph->protocol;
-	unsigned int hash = ipqhashfn(id, saddr, daddr, protocol);
+	unsigned int hash;
 	struct ipq *qp;
+	int depth = 0;
 
 	read_lock(&ipfrag_lock);
+	hash = ipqhashfn(id, saddr, daddr, protocol);
+	spin_lock(ipq_chain_lock(hash));
 	for(qp = ipq_hash[hash]; qp; qp = qp->next) {
 		if(qp->id == id		&&
 		   qp->saddr == saddr	&&
@@ -401,11 +455,23 @@ static inline struct ipq *ip_find(struct iphdr *iph, u32 user)
 		   qp->protocol == protocol &&
 		   qp->user == user) {
 			atomic_inc(&qp->refcnt);
+			spin_unlock(ipq_chain_lock(hash));
 			read_unlock(&ipfrag_lock);
 			return qp;
 		}
+		depth++;
+	}
+
+	if (unlikely(depth > IPQ_MAX_DEPTH)) {
+		/* a new secret, and a bigger table if it may grow */
+		mod_timer(&ipfrag_secret_timer, jiffies);
+		if (ipq_hash_size == IPQ_MAX_HASHSZ) {
+			spin_unlock(ipq_chain_lock(hash));
+			read_unlock(&ipfrag_lock);
+			NET_INC_STATS_BH(LINUX_MIB_IPFRAGOVERFLOW);
+			return NULL;
+		}
 	}
-	read_unlock(&ipfrag_lock);
 
 	return ip_frag_create(hash, iph, user);
 }
@@ -539,9 +605,12 @@ static void ip_frag_queue(struct ipq *qp, struct sk_buff *skb)
 	if (offset == 0)
 		qp->last_in |= FIRST_IN;
 
-	write_lock(&ipfrag_lock);
-	list_move_tail(&qp->lru_list, &ipq_lru_list);
-	write_unlock(&ipfrag_lock);
+	if (qp->lru_stamp != jiffies) {
+		qp->lru_stamp = jiffies;
+		spin_lock(&ipq_lru_lock);
+		list_move_tail(&qp->lru_list, &ipq_lru_list);
+		spin_unlock(&ipq_lru_lock);
+	}
 
 	return;
 
@@ -679,6 +748,11 @@ struct sk_buff *ip_defrag(struct sk_buff *skb, u32 user)
 
 void ipfrag_init(void)
 {
+	int i;
+
+	for (i = 0; i < IPQ_LOCKS; i++)
+		spin_lock_init(&ipq_chain_lock[i]);
+
 	ipfrag_hash_rnd = (u32) ((num_physpages ^ (num_physpages>>7)) ^
 				 (jiffies ^ (jiffies >> 6)));
 
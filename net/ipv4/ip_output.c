@@ -60,6 +60,7 @@
 #include <linux/in.h>
 #include <linux/inet.h>
 #include <linux/netdevice.h>
+#include <linux/inetdevice.h>
 #include <linux/etherdevice.h>
 #include <linux/proc_fs.h>
 #include <linux/stat.h>
@@ -84,6 +85,7 @@
 #include <linux/netfilter_bridge.h>
 #include <linux/mroute.h>
 #include <linux/netlink.h>
+#include <linux/err.h>
 
 /*
  *      Shall we try to damage output packets if routing dev changes?
@@ -1323,6 +1325,110 @@ void ip_send_reply(struct sock *sk, struct sk_buff *skb, struct ip_reply_arg *ar
 	ip_rt_put(rt);
 }
 
+/*
+ *	Software segmentation of a large send on its way to a device that
+ *	cannot do TSO.  The transport protocol cuts the payload and every
+ *	segment then gets its own IP id, length and header checksum.
+ */
+static struct sk_buff *inet_gso_segment(struct sk_buff *skb, int features)
+{
+	struct sk_buff *segs = ERR_PTR(-EINVAL);
+	struct iphdr *iph;
+	struct net_protocol *ops;
+	int proto;
+	int ihl;
+	int id;
+
+	if (!pskb_may_pull(skb, sizeof(*iph)))
+		goto out;
+
+	iph = skb->nh.iph;
+	ihl = iph->ihl * 4;
+	if (ihl < sizeof(*iph))
+		goto out;
+
+	if (!pskb_may_pull(skb, ihl))
+		goto out;
+
+	skb->h.raw = __skb_pull(skb, ihl);
+	iph = skb->nh.iph;
+	id = ntohs(iph->id);
+	proto = iph->protocol & (MAX_INET_PROTOS - 1);
+	segs = ERR_PTR(-EPROTONOSUPPORT);
+
+	rcu_read_lock();
+	ops = rcu_dereference(inet_protos[proto]);
+	if (ops && ops->gso_segment)
+		segs = ops->gso_segment(skb, features);
+	rcu_read_unlock();
+
+	if (IS_ERR(segs))
+		goto out;
+
+	skb = segs;
+	do {
+		iph = skb->nh.iph;
+		iph->id = htons(id++);
+		iph->tot_len = htons(skb->len - skb->mac_len);
+		iph->check = 0;
+		iph->check = ip_fast_csum(skb->nh.raw, iph->ihl);
+	} while ((skb = skb->next));
+
+out:
+	return segs;
+}
+
+/*
+ *	Receive aggregation.  Only plain datagrams without options or
+ *	fragmentation are merged, and never on a host that forwards: a
+ *	merged packet could not be sent out again as it came in.
+ */
+static int inet_gro_receive(struct sk_buff *held, struct sk_buff *skb)
+{
+	struct iphdr *iph, *iph2;
+	struct net_protocol *ops;
+
+	if (!held) {
+		if (ipv4_devconf.forwarding ||
+		    !pskb_may_pull(skb, sizeof(*iph)))
+			return GRO_NORMAL;
+
+		iph = skb->nh.iph;
+		if (iph->version != 4 || iph->ihl != 5 ||
+		    (iph->frag_off & htons(IP_MF | IP_OFFSET)) ||
+		    ntohs(iph->tot_len) != skb->len ||
+		    ip_fast_csum((u8 *)iph, iph->ihl))
+			return GRO_NORMAL;
+
+		skb->h.raw = skb->nh.raw + sizeof(*iph);
+	} else {
+		iph = skb->nh.iph;
+		iph2 = held->nh.iph;
+		if (iph->saddr != iph2->saddr || iph->daddr != iph2->daddr ||
+		    iph->protocol != iph2->protocol)
+			return GRO_NOMATCH;
+
+		GRO_CB(skb)->flush = iph->tos != iph2->tos ||
+				     iph->ttl != iph2->ttl ||
+				     iph->frag_off != iph2->frag_off;
+	}
+
+	ops = rcu_dereference(inet_protos[iph->protocol & (MAX_INET_PROTOS - 1)]);
+	if (!ops || !ops->gro_receive)
+		return held ? GRO_FLUSH : GRO_NORMAL;
+
+	return ops->gro_receive(held, skb);
+}
+
+static void inet_gro_complete(struct sk_buff *skb)
+{
+	struct iphdr *iph = skb->nh.iph;
+
+	iph->tot_len = htons(skb->len);
+	iph->check = 0;
+	iph->check = ip_fast_csum((u8 *)iph, iph->ihl);
+}
+
 /*
  *	IP protocol layer initialiser
  */
@@ -1330,6 +1436,9 @@ void ip_send_reply(struct sock *sk, struct sk_buff *skb, struct ip_reply_arg *ar
 static struct packet_type ip_packet_type = {
 	.type = __constant_htons(ETH_P_IP),
 	.func = ip_rcv,
+	.gso_segment = inet_gso_segment,
+	.gro_receive = inet_gro_receive,
+	.gro_complete = inet_gro_complete,
 };
 
 /*
@@ -25,6 +25,8 @@
  */
 
 #include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/mm.h>
 #include <linux/vmalloc.h>
 #include <linux/proc_fs.h>		/* for proc_net_* */
 #include <linux/seq_file.h>
@@ -35,10 +37,19 @@
 
 
 /*
- *  Connection hash table: for input and output packets lookups of IPVS
+ *  Connection hash table: for input and output packets lookups of IPVS.
+ *  The lookups run under RCU, the changes take the lock array below.
  */
 static struct list_head *ip_vs_conn_tab;
 
+/*  its size, from conn_tab_bits or else from the memory, at load time */
+static int conn_tab_bits;
+module_param(conn_tab_bits, int, 0444);
+MODULE_PARM_DESC(conn_tab_bits, "Set connections' hash size, 2^N buckets, 0 to size it from memory");
+
+int ip_vs_conn_tab_size;
+static int ip_vs_conn_tab_mask;
+
 /*  SLAB cache for IPVS connections */
 static kmem_cache_t *ip_vs_conn_cachep;
 
@@ -54,7 +65,7 @@ static unsigned int ip_vs_conn_rnd;
 /*
  *  Fine locking granularity for big connection hash table
  */
-#define CT_LOCKARRAY_BITS  4
+#define CT_LOCKARRAY_BITS  8
 #define CT_LOCKARRAY_SIZE  (1<<CT_LOCKARRAY_BITS)
 #define CT_LOCKARRAY_MASK  (CT_LOCKARRAY_SIZE-1)
 
@@ -114,7 +125,41 @@ static inline void ct_write_unlock_bh(unsigned key)
 static unsigned int ip_vs_conn_hashkey(unsigned proto, __u32 addr, __u16 port)
 {
 	return jhash_3words(addr, port, proto, ip_vs_conn_rnd)
-		& IP_VS_CONN_TAB_MASK;
+		& ip_vs_conn_tab_mask;
+}
+
+
+/*
+ *	A lookup goes on until it gets to one of the chain heads, not just
+ *	to the head of its own chain: an entry ip_vs_conn_fill_cport() has
+ *	moved to another chain meanwhile leads into that one.
+ */
+static inline int ip_vs_conn_tab_head(struct list_head *e)
+{
+	return e >= ip_vs_conn_tab && e < ip_vs_conn_tab + ip_vs_conn_tab_size;
+}
+
+#define ip_vs_conn_for_each_rcu(cp, hash)				\
+	for (cp = list_entry(rcu_dereference(ip_vs_conn_tab[hash].next),\
+			     struct ip_vs_conn, c_list);		\
+	     !ip_vs_conn_tab_head(&cp->c_list);				\
+	     cp = list_entry(rcu_dereference(cp->c_list.next),		\
+			     struct ip_vs_conn, c_list))
+
+/*
+ *	Take a reference to an entry found under RCU, unless it has been
+ *	unhashed meanwhile: ip_vs_conn_expire() then either sees our
+ *	reference and keeps it, or it frees it after the grace period and
+ *	we see it unhashed.
+ */
+static inline int ip_vs_conn_hold(struct ip_vs_conn *cp)
+{
+	atomic_inc(&cp->refcnt);
+	smp_mb__after_atomic_inc();
+	if (likely(cp->flags & IP_VS_CONN_F_HASHED))
+		return 1;
+	__ip_vs_conn_put(cp);
+	return 0;
 }
 
 
@@ -133,9 +178,9 @@ static inline int ip_vs_conn_hash(struct ip_vs_conn *cp)
 	ct_write_lock(hash);
 
 	if (!(cp->flags & IP_VS_CONN_F_HASHED)) {
-		list_add(&cp->c_list, &ip_vs_conn_tab[hash]);
 		cp->flags |= IP_VS_CONN_F_HASHED;
 		atomic_inc(&cp->refcnt);
+		list_add_rcu(&cp->c_list, &ip_vs_conn_tab[hash]);
 		ret = 1;
 	} else {
 		IP_VS_ERR("ip_vs_conn_hash(): request for already hashed, "
@@ -164,7 +209,7 @@ static inline int ip_vs_conn_unhash(struct ip_vs_conn *cp)
 	ct_write_lock(hash);
 
 	if (cp->flags & IP_VS_CONN_F_HASHED) {
-		list_del(&cp->c_list);
+		list_del_rcu(&cp->c_list);
 		cp->flags &= ~IP_VS_CONN_F_HASHED;
 		atomic_dec(&cp->refcnt);
 		ret = 1;
@@ -191,20 +236,19 @@ static inline struct ip_vs_conn *__ip_vs_conn_in_get
 
 	hash = ip_vs_conn_hashkey(protocol, s_addr, s_port);
 
-	ct_read_lock(hash);
+	rcu_read_lock();
 
-	list_for_each_entry(cp, &ip_vs_conn_tab[hash], c_list) {
+	ip_vs_conn_for_each_rcu(cp, hash) {
 		if (s_addr==cp->caddr && s_port==cp->cport &&
 		    d_port==cp->vport && d_addr==cp->vaddr &&
-		    protocol==cp->protocol) {
+		    protocol==cp->protocol && ip_vs_conn_hold(cp)) {
 			/* HIT */
-			atomic_inc(&cp->refcnt);
-			ct_read_unlock(hash);
+			rcu_read_unlock();
 			return cp;
 		}
 	}
 
-	ct_read_unlock(hash);
+	rcu_read_unlock();
 
 	return NULL;
 }
@@ -245,20 +289,19 @@ struct ip_vs_conn *ip_vs_conn_out_get
 	 */
 	hash = ip_vs_conn_hashkey(protocol, d_addr, d_port);
 
-	ct_read_lock(hash);
+	rcu_read_lock();
 
-	list_for_each_entry(cp, &ip_vs_conn_tab[hash], c_list) {
+	ip_vs_conn_for_each_rcu(cp, hash) {
 		if (d_addr == cp->caddr && d_port == cp->cport &&
 		    s_port == cp->dport && s_addr == cp->daddr &&
-		    protocol == cp->protocol) {
+		    protocol == cp->protocol && ip_vs_conn_hold(cp)) {
 			/* HIT */
-			atomic_inc(&cp->refcnt);
 			ret = cp;
 			break;
 		}
 	}
 
-	ct_read_unlock(hash);
+	rcu_read_unlock();
 
 	IP_VS_DBG(7, "lookup/out %s %u.%u.%u.%u:%d->%u.%u.%u.%u:%d %s\n",
 		  ip_vs_proto_name(protocol),
@@ -486,6 +529,14 @@ int ip_vs_check_template(struct ip_vs_conn *ct)
 	return 1;
 }
 
+static void ip_vs_conn_rcu_free(struct rcu_head *head)
+{
+	struct ip_vs_conn *cp = container_of(head, struct ip_vs_conn,
+					     rcu_head);
+
+	kmem_cache_free(ip_vs_conn_cachep, cp);
+}
+
 static void ip_vs_conn_expire(unsigned long data)
 {
 	struct ip_vs_conn *cp = (struct ip_vs_conn *)data;
@@ -510,8 +561,10 @@ static void ip_vs_conn_expire(unsigned long data)
 		goto expire_later;
 
 	/*
-	 *	refcnt==1 implies I'm the only one referrer
+	 *	refcnt==1 implies I'm the only one referrer, the lookups
+	 *	under RCU see the unhashing before they take any more
 	 */
+	smp_mb();
 	if (likely(atomic_read(&cp->refcnt) == 1)) {
 		/* delete the timer if it is activated by other users */
 		if (timer_pending(&cp->timer))
@@ -528,7 +581,7 @@ static void ip_vs_conn_expire(unsigned long data)
 			atomic_dec(&ip_vs_conn_no_cport_cnt);
 		atomic_dec(&ip_vs_conn_count);
 
-		kmem_cache_free(ip_vs_conn_cachep, cp);
+		call_rcu(&cp->rcu_head, ip_vs_conn_rcu_free);
 		return;
 	}
 
@@ -628,7 +681,7 @@ static void *ip_vs_conn_array(struct seq_file *seq, loff_t pos)
 	int idx;
 	struct ip_vs_conn *cp;
 	
-	for(idx = 0; idx < IP_VS_CONN_TAB_SIZE; idx++) {
+	for(idx = 0; idx < ip_vs_conn_tab_size; idx++) {
 		ct_read_lock_bh(idx);
 		list_for_each_entry(cp, &ip_vs_conn_tab[idx], c_list) {
 			if (pos-- == 0) {
@@ -665,7 +718,7 @@ static void *ip_vs_conn_seq_next(struct seq_file *seq, void *v, loff_t *pos)
 	idx = l - ip_vs_conn_tab;
 	ct_read_unlock_bh(idx);
 
-	while (++idx < IP_VS_CONN_TAB_SIZE) {
+	while (++idx < ip_vs_conn_tab_size) {
 		ct_read_lock_bh(idx);
 		list_for_each_entry(cp, &ip_vs_conn_tab[idx], c_list) {
 			seq->private = &ip_vs_conn_tab[idx];
@@ -769,8 +822,8 @@ void ip_vs_random_dropentry(void)
 	/*
 	 * Randomly scan 1/32 of the whole table every second
 	 */
-	for (idx = 0; idx < (IP_VS_CONN_TAB_SIZE>>5); idx++) {
-		unsigned hash = net_random() & IP_VS_CONN_TAB_MASK;
+	for (idx = 0; idx < (ip_vs_conn_tab_size>>5); idx++) {
+		unsigned hash = net_random() & ip_vs_conn_tab_mask;
 
 		/*
 		 *  Lock is actually needed in this loop.
@@ -832,7 +885,7 @@ static void ip_vs_conn_flush(void)
 	struct ip_vs_conn *ct;
 
   flush_again:
-	for (idx=0; idx<IP_VS_CONN_TAB_SIZE; idx++) {
+	for (idx=0; idx<ip_vs_conn_tab_size; idx++) {
 		/*
 		 *  Lock is actually needed in this loop.
 		 */
@@ -868,10 +921,30 @@ int ip_vs_conn_init(void)
 {
 	int idx;
 
+	/*
+	 * Unless told, the table takes about 1/1024 of the memory, and
+	 * no less than the configured size
+	 */
+	if (conn_tab_bits <= 0) {
+		unsigned long goal = (num_physpages << (PAGE_SHIFT - 10)) /
+				     sizeof(struct list_head);
+
+		for (conn_tab_bits = IP_VS_CONN_TAB_BITS;
+		     conn_tab_bits < IP_VS_CONN_TAB_MAX_BITS &&
+		     (2UL << conn_tab_bits) <= goal; conn_tab_bits++)
+			;
+	}
+	if (conn_tab_bits < 8)
+		conn_tab_bits = 8;
+	if (conn_tab_bits > IP_VS_CONN_TAB_MAX_BITS)
+		conn_tab_bits = IP_VS_CONN_TAB_MAX_BITS;
+	ip_vs_conn_tab_size = 1 << conn_tab_bits;
+	ip_vs_conn_tab_mask = ip_vs_conn_tab_size - 1;
+
 	/*
 	 * Allocate the connection hash table and initialize its list heads
 	 */
-	ip_vs_conn_tab = vmalloc(IP_VS_CONN_TAB_SIZE*sizeof(struct list_head));
+	ip_vs_conn_tab = vmalloc(ip_vs_conn_tab_size*sizeof(struct list_head));
 	if (!ip_vs_conn_tab)
 		return -ENOMEM;
 
@@ -886,12 +959,12 @@ int ip_vs_conn_init(void)
 
 	IP_VS_INFO("Connection hash table configured "
 		   "(size=%d, memory=%ldKbytes)\n",
-		   IP_VS_CONN_TAB_SIZE,
-		   (long)(IP_VS_CONN_TAB_SIZE*sizeof(struct list_head))/1024);
+		   ip_vs_conn_tab_size,
+		   (long)(ip_vs_conn_tab_size*sizeof(struct list_head))/1024);
 	IP_VS_DBG(0, "Each connection entry needs %Zd bytes at least\n",
 		  sizeof(struct ip_vs_conn));
 
-	for (idx = 0; idx < IP_VS_CONN_TAB_SIZE; idx++) {
+	for (idx = 0; idx < ip_vs_conn_tab_size; idx++) {
 		INIT_LIST_HEAD(&ip_vs_conn_tab[idx]);
 	}
 
@@ -913,6 +986,9 @@ void ip_vs_conn_cleanup(void)
 	/* flush all the connection entries first */
 	ip_vs_conn_flush();
 
+	/* wait for the entries still to be freed after lookups */
+	rcu_barrier();
+
 	/* Release the empty cache */
 	kmem_cache_destroy(ip_vs_conn_cachep);
 	proc_net_remove("ip_vs_conn");
@@ -27,6 +27,7 @@
 #include <linux/skbuff.h>
 #include <linux/in.h>
 #include <linux/igmp.h>                 /* for ip_mc_join_group */
+#include <linux/percpu.h>
 
 #include <net/ip.h>
 #include <net/sock.h>
@@ -121,9 +122,19 @@ struct ip_vs_sync_buff {
 static LIST_HEAD(ip_vs_sync_queue);
 static DEFINE_SPINLOCK(ip_vs_sync_lock);
 
-/* current sync_buff for accepting new conn entries */
-static struct ip_vs_sync_buff   *curr_sb = NULL;
-static DEFINE_SPINLOCK(curr_sb_lock);
+/*
+ * current sync_buff for accepting new conn entries, one per CPU so that
+ * the CPUs fill messages without sharing a lock.  The lock is only taken
+ * from elsewhere by the master thread sending a buffer waiting too long.
+ */
+struct ip_vs_sync_curr {
+	spinlock_t		lock;
+	struct ip_vs_sync_buff	*sb;
+};
+
+static DEFINE_PER_CPU(struct ip_vs_sync_curr, ip_vs_sync_curr) = {
+	.lock	= SPIN_LOCK_UNLOCKED,
+};
 
 /* ipvs sync daemon state */
 volatile int ip_vs_sync_state = IP_VS_STATE_NONE;
@@ -190,22 +201,23 @@ static inline void ip_vs_sync_buff_release(struct ip_vs_sync_buff *sb)
 }
 
 /*
- *	Get the current sync buffer if it has been created for more
+ *	Get the current sync buffer of cpu if it has been created for more
  *	than the specified time or the specified time is zero.
  */
 static inline struct ip_vs_sync_buff *
-get_curr_sync_buff(unsigned long time)
+get_curr_sync_buff(int cpu, unsigned long time)
 {
+	struct ip_vs_sync_curr *curr = &per_cpu(ip_vs_sync_curr, cpu);
 	struct ip_vs_sync_buff *sb;
 
-	spin_lock_bh(&curr_sb_lock);
-	if (curr_sb && (time == 0 ||
-			time_before(jiffies - curr_sb->firstuse, time))) {
-		sb = curr_sb;
-		curr_sb = NULL;
-	} else
+	spin_lock_bh(&curr->lock);
+	sb = curr->sb;
+	if (sb && (time == 0 ||
+		   time_after_eq(jiffies - sb->firstuse, time)))
+		curr->sb = NULL;
+	else
 		sb = NULL;
-	spin_unlock_bh(&curr_sb_lock);
+	spin_unlock_bh(&curr->lock);
 	return sb;
 }
 
@@ -216,17 +228,20 @@ get_curr_sync_buff(unsigned long time)
  */
 void ip_vs_sync_conn(struct ip_vs_conn *cp)
 {
+	struct ip_vs_sync_curr *curr = &__get_cpu_var(ip_vs_sync_curr);
+	struct ip_vs_sync_buff *curr_sb;
 	struct ip_vs_sync_mesg *m;
 	struct ip_vs_sync_conn *s;
 	int len;
 
-	spin_lock(&curr_sb_lock);
-	if (!curr_sb) {
+	spin_lock(&curr->lock);
+	if (!(curr_sb = curr->sb)) {
 		if (!(curr_sb=ip_vs_sync_buff_create())) {
-			spin_unlock(&curr_sb_lock);
+			spin_unlock(&curr->lock);
 			IP_VS_ERR("ip_vs_sync_buff_create failed.\n");
 			return;
 		}
+		curr->sb = curr_sb;
 	}
 
 	len = (cp->flags & IP_VS_CONN_F_SEQ_MASK) ? FULL_CONN_SIZE :
@@ -257,9 +272,9 @@ void ip_vs_sync_conn(struct ip_vs_conn *cp)
 	/* check if there is a space for next one */
 	if (curr_sb->head+FULL_CONN_SIZE > curr_sb->end) {
 		sb_queue_tail(curr_sb);
-		curr_sb = NULL;
+		curr->sb = NULL;
 	}
-	spin_unlock(&curr_sb_lock);
+	spin_unlock(&curr->lock);
 
 	/* synchronize its controller if it has */
 	if (cp->control)
@@ -622,6 +637,7 @@ static void sync_master_loop(void)
 {
 	struct socket *sock;
 	struct ip_vs_sync_buff *sb;
+	int cpu;
 
 	/* create the sending multicast socket */
 	sock = make_send_sock();
@@ -638,10 +654,12 @@ static void sync_master_loop(void)
 			ip_vs_sync_buff_release(sb);
 		}
 
-		/* check if entries stay in curr_sb for 2 seconds */
-		if ((sb = get_curr_sync_buff(2*HZ))) {
-			ip_vs_send_sync_msg(sock, sb->mesg);
-			ip_vs_sync_buff_release(sb);
+		/* check if entries stay in a curr_sb for 2 seconds */
+		for_each_cpu(cpu) {
+			if ((sb = get_curr_sync_buff(cpu, 2*HZ))) {
+				ip_vs_send_sync_msg(sock, sb->mesg);
+				ip_vs_sync_buff_release(sb);
+			}
 		}
 
 		if (stop_master_sync)
@@ -655,9 +673,11 @@ static void sync_master_loop(void)
 		ip_vs_sync_buff_release(sb);
 	}
 
-	/* clean up the current sync_buff */
-	if ((sb = get_curr_sync_buff(0))) {
-		ip_vs_sync_buff_release(sb);
+	/* clean up the current sync_buffs */
+	for_each_cpu(cpu) {
+		if ((sb = get_curr_sync_buff(cpu, 0))) {
+			ip_vs_sync_buff_release(sb);
+		}
 	}
 
 	/* release the sending multicast socket */
@@ -38,8 +38,10 @@
 #include <linux/percpu.h>
 #include <linux/moduleparam.h>
 
-/* This rwlock protects the main hash table, protocol/helper/expected
-   registrations, conntrack timers*/
+/* This rwlock protects protocol/helper/expected registrations.  The
+   hash chains and the unconfirmed list are changed with it read locked
+   and their own spinlock held, so write locking it still freezes the
+   whole table. */
 #define ASSERT_READ_LOCK(x) MUST_BE_READ_LOCKED(&ip_conntrack_lock)
 #define ASSERT_WRITE_LOCK(x) MUST_BE_WRITE_LOCKED(&ip_conntrack_lock)
 
@@ -59,6 +61,13 @@
 
 DECLARE_RWLOCK(ip_conntrack_lock);
 
+/* The hash chains are guarded by a spinlock of a striped array, picked
+   by bucket.  Lookups take none of them: they walk the chains under
+   rcu_read_lock(), and a conntrack is freed only after a grace period. */
+#define CONNTRACK_LOCKS 256
+static spinlock_t ip_conntrack_locks[CONNTRACK_LOCKS];
+static DEFINE_SPINLOCK(ip_conntrack_unconfirmed_lock);
+
 /* ip_conntrack_standalone needs this */
 atomic_t ip_conntrack_count = ATOMIC_INIT(0);
 
@@ -85,6 +94,35 @@ ip_conntrack_put(struct ip_conntrack *ct)
 	nf_conntrack_put(&ct->ct_general);
 }
 
+static inline spinlock_t *ip_conntrack_bucket_lock(unsigned int hash)
+{
+	return &ip_conntrack_locks[hash % CONNTRACK_LOCKS];
+}
+
+/* Lock the chains of both directions, in array order. */
+static void ip_conntrack_lock_buckets(unsigned int ho, unsigned int hr)
+{
+	ho %= CONNTRACK_LOCKS;
+	hr %= CONNTRACK_LOCKS;
+	if (ho > hr) {
+		unsigned int tmp = ho;
+		ho = hr;
+		hr = tmp;
+	}
+	spin_lock(&ip_conntrack_locks[ho]);
+	if (ho != hr)
+		spin_lock(&ip_conntrack_locks[hr]);
+}
+
+static void ip_conntrack_unlock_buckets(unsigned int ho, unsigned int hr)
+{
+	ho %= CONNTRACK_LOCKS;
+	hr %= CONNTRACK_LOCKS;
+	if (ho != hr)
+		spin_unlock(&ip_conntrack_locks[hr]);
+	spin_unlock(&ip_conntrack_locks[ho]);
+}
+
 static int ip_conntrack_hash_rnd_initted;
 static unsigned int ip_conntrack_hash_rnd;
 
@@ -209,15 +247,21 @@ clean_from_lists(struct ip_conntrack *ct)
 	unsigned int ho, hr;
 	
 	DEBUGP("clean_from_lists(%p)\n", ct);
-	MUST_BE_WRITE_LOCKED(&ip_conntrack_lock);
+	MUST_BE_READ_LOCKED(&ip_conntrack_lock);
 
 	ho = hash_conntrack(&ct->tuplehash[IP_CT_DIR_ORIGINAL].tuple);
 	hr = hash_conntrack(&ct->tuplehash[IP_CT_DIR_REPLY].tuple);
-	LIST_DELETE(&ip_conntrack_hash[ho], &ct->tuplehash[IP_CT_DIR_ORIGINAL]);
-	LIST_DELETE(&ip_conntrack_hash[hr], &ct->tuplehash[IP_CT_DIR_REPLY]);
+	ip_conntrack_lock_buckets(ho, hr);
+	list_del_rcu(&ct->tuplehash[IP_CT_DIR_ORIGINAL].list);
+	list_del_rcu(&ct->tuplehash[IP_CT_DIR_REPLY].list);
+	ip_conntrack_unlock_buckets(ho, hr);
+}
 
-	/* Destroy all pending expectations */
-	remove_expectations(ct);
+static void free_conntrack_rcu(struct rcu_head *head)
+{
+	struct ip_conntrack *ct = container_of(head, struct ip_conntrack, rcu);
+
+	kmem_cache_free(ip_conntrack_cachep, ct);
 }
 
 static void
@@ -240,27 +284,33 @@ destroy_conntrack(struct nf_conntrack *nfct)
 	if (ip_conntrack_destroyed)
 		ip_conntrack_destroyed(ct);
 
-	WRITE_LOCK(&ip_conntrack_lock);
-	/* Expectations will have been removed in clean_from_lists,
+	/* Expectations will have been removed in death_by_timeout,
 	 * except TFTP can create an expectation on the first packet,
 	 * before connection is in the list, so we need to clean here,
 	 * too. */
-	remove_expectations(ct);
+	if (ct->expecting) {
+		WRITE_LOCK(&ip_conntrack_lock);
+		remove_expectations(ct);
+		WRITE_UNLOCK(&ip_conntrack_lock);
+	}
 
+	READ_LOCK(&ip_conntrack_lock);
 	/* We overload first tuple to link into unconfirmed list. */
 	if (!is_confirmed(ct)) {
+		spin_lock(&ip_conntrack_unconfirmed_lock);
 		BUG_ON(list_empty(&ct->tuplehash[IP_CT_DIR_ORIGINAL].list));
 		list_del(&ct->tuplehash[IP_CT_DIR_ORIGINAL].list);
+		spin_unlock(&ip_conntrack_unconfirmed_lock);
 	}
 
 	CONNTRACK_STAT_INC(delete);
-	WRITE_UNLOCK(&ip_conntrack_lock);
+	READ_UNLOCK(&ip_conntrack_lock);
 
 	if (ct->master)
 		ip_conntrack_put(ct->master);
 
 	DEBUGP("destroy_conntrack: returning ct=%p to slab\n", ct);
-	kmem_cache_free(ip_conntrack_cachep, ct);
+	call_rcu(&ct->rcu, free_conntrack_rcu);
 	atomic_dec(&ip_conntrack_count);
 }
 
@@ -268,12 +318,19 @@ static void death_by_timeout(unsigned long ul_conntrack)
 {
 	struct ip_conntrack *ct = (void *)ul_conntrack;
 
-	WRITE_LOCK(&ip_conntrack_lock);
+	READ_LOCK(&ip_conntrack_lock);
 	/* Inside lock so preempt is disabled on module removal path.
 	 * Otherwise we can get spurious warnings. */
 	CONNTRACK_STAT_INC(delete_list);
 	clean_from_lists(ct);
-	WRITE_UNLOCK(&ip_conntrack_lock);
+	READ_UNLOCK(&ip_conntrack_lock);
+
+	/* Destroy all pending expectations */
+	if (ct->expecting) {
+		WRITE_LOCK(&ip_conntrack_lock);
+		remove_expectations(ct);
+		WRITE_UNLOCK(&ip_conntrack_lock);
+	}
 	ip_conntrack_put(ct);
 }
 
@@ -282,7 +339,6 @@ conntrack_tuple_cmp(const struct ip_conntrack_tuple_hash *i,
 		    const struct ip_conntrack_tuple *tuple,
 		    const struct ip_conntrack *ignored_conntrack)
 {
-	MUST_BE_READ_LOCKED(&ip_conntrack_lock);
 	return tuplehash_to_ctrack(i) != ignored_conntrack
 		&& ip_ct_tuple_equal(tuple, &i->tuple);
 }
@@ -294,8 +350,8 @@ __ip_conntrack_find(const struct ip_conntrack_tuple *tuple,
 	struct ip_conntrack_tuple_hash *h;
 	unsigned int hash = hash_conntrack(tuple);
 
-	MUST_BE_READ_LOCKED(&ip_conntrack_lock);
-	list_for_each_entry(h, &ip_conntrack_hash[hash], list) {
+	/* Caller holds rcu_read_lock() or the bucket lock */
+	list_for_each_entry_rcu(h, &ip_conntrack_hash[hash], list) {
 		if (conntrack_tuple_cmp(h, tuple, ignored_conntrack)) {
 			CONNTRACK_STAT_INC(found);
 			return h;
@@ -312,12 +368,42 @@ ip_conntrack_find_get(const struct ip_conntrack_tuple *tuple,
 		      const struct ip_conntrack *ignored_conntrack)
 {
 	struct ip_conntrack_tuple_hash *h;
+#ifdef __HAVE_ARCH_CMPXCHG
+	/* A conntrack that is being unhashed may already be at zero
+	   refcount, and must not be revived. */
+	rcu_read_lock();
+	h = __ip_conntrack_find(tuple, ignored_conntrack);
+	if (h) {
+		atomic_t *use = &tuplehash_to_ctrack(h)->ct_general.use;
+		int c = atomic_read(use);
+
+		for (;;) {
+			int old;
+
+			if (!c) {
+				h = NULL;
+				break;
+			}
+			old = cmpxchg(&use->counter, c, c + 1);
+			if (likely(old == c))
+				break;
+			c = old;
+		}
+	}
+	rcu_read_unlock();
+#else
+	spinlock_t *lock = ip_conntrack_bucket_lock(hash_conntrack(tuple));
 
+	/* Entries are unhashed under the bucket lock before their
+	   refcount can drop to zero. */
 	READ_LOCK(&ip_conntrack_lock);
+	spin_lock(lock);
 	h = __ip_conntrack_find(tuple, ignored_conntrack);
 	if (h)
 		atomic_inc(&tuplehash_to_ctrack(h)->ct_general.use);
+	spin_unlock(lock);
 	READ_UNLOCK(&ip_conntrack_lock);
+#endif
 
 	return h;
 }
@@ -352,7 +438,8 @@ __ip_conntrack_confirm(struct sk_buff **pskb)
 	IP_NF_ASSERT(!is_confirmed(ct));
 	DEBUGP("Confirming conntrack %p\n", ct);
 
-	WRITE_LOCK(&ip_conntrack_lock);
+	READ_LOCK(&ip_conntrack_lock);
+	ip_conntrack_lock_buckets(hash, repl_hash);
 
 	/* See if there's one in the list already, including reverse:
            NAT could have grabbed it without realizing, since we're
@@ -366,12 +453,14 @@ __ip_conntrack_confirm(struct sk_buff **pskb)
 			  struct ip_conntrack_tuple_hash *,
 			  &ct->tuplehash[IP_CT_DIR_REPLY].tuple, NULL)) {
 		/* Remove from unconfirmed list */
+		spin_lock(&ip_conntrack_unconfirmed_lock);
 		list_del(&ct->tuplehash[IP_CT_DIR_ORIGINAL].list);
+		spin_unlock(&ip_conntrack_unconfirmed_lock);
 
-		list_prepend(&ip_conntrack_hash[hash],
-			     &ct->tuplehash[IP_CT_DIR_ORIGINAL]);
-		list_prepend(&ip_conntrack_hash[repl_hash],
-			     &ct->tuplehash[IP_CT_DIR_REPLY]);
+		list_add_rcu(&ct->tuplehash[IP_CT_DIR_ORIGINAL].list,
+			     &ip_conntrack_hash[hash]);
+		list_add_rcu(&ct->tuplehash[IP_CT_DIR_REPLY].list,
+			     &ip_conntrack_hash[repl_hash]);
 		/* Timer relative to confirmation time, not original
 		   setting time, otherwise we'd get timer wrap in
 		   weird delay cases. */
@@ -380,12 +469,14 @@ __ip_conntrack_confirm(struct sk_buff **pskb)
 		atomic_inc(&ct->ct_general.use);
 		set_bit(IPS_CONFIRMED_BIT, &ct->status);
 		CONNTRACK_STAT_INC(insert);
-		WRITE_UNLOCK(&ip_conntrack_lock);
+		ip_conntrack_unlock_buckets(hash, repl_hash);
+		READ_UNLOCK(&ip_conntrack_lock);
 		return NF_ACCEPT;
 	}
 
 	CONNTRACK_STAT_INC(insert_failed);
-	WRITE_UNLOCK(&ip_conntrack_lock);
+	ip_conntrack_unlock_buckets(hash, repl_hash);
+	READ_UNLOCK(&ip_conntrack_lock);
 
 	return NF_DROP;
 }
@@ -398,9 +489,9 @@ ip_conntrack_tuple_taken(const struct ip_conntrack_tuple *tuple,
 {
 	struct ip_conntrack_tuple_hash *h;
 
-	READ_LOCK(&ip_conntrack_lock);
+	rcu_read_lock();
 	h = __ip_conntrack_find(tuple, ignored_conntrack);
-	READ_UNLOCK(&ip_conntrack_lock);
+	rcu_read_unlock();
 
 	return h != NULL;
 }
@@ -412,19 +503,24 @@ static inline int unreplied(const struct ip_conntrack_tuple_hash *i)
 	return !(test_bit(IPS_ASSURED_BIT, &tuplehash_to_ctrack(i)->status));
 }
 
-static int early_drop(struct list_head *chain)
+static int early_drop(unsigned int hash)
 {
 	/* Traverse backwards: gives us oldest, which is roughly LRU */
+	struct list_head *chain = &ip_conntrack_hash[hash];
+	spinlock_t *lock = ip_conntrack_bucket_lock(hash);
 	struct ip_conntrack_tuple_hash *h;
 	struct ip_conntrack *ct = NULL;
 	int dropped = 0;
 
+	/* The prev pointers are not safe for RCU, so lock the chain */
 	READ_LOCK(&ip_conntrack_lock);
+	spin_lock(lock);
 	h = LIST_FIND_B(chain, unreplied, struct ip_conntrack_tuple_hash *);
 	if (h) {
 		ct = tuplehash_to_ctrack(h);
 		atomic_inc(&ct->ct_general.use);
 	}
+	spin_unlock(lock);
 	READ_UNLOCK(&ip_conntrack_lock);
 
 	if (!ct)
@@ -474,7 +570,7 @@ init_conntrack(const struct ip_conntrack_tuple *tuple,
 	if (ip_conntrack_max
 	    && atomic_read(&ip_conntrack_count) >= ip_conntrack_max) {
 		/* Try dropping from this hash chain. */
-		if (!early_drop(&ip_conntrack_hash[hash])) {
+		if (!early_drop(hash)) {
 			if (net_ratelimit())
 				printk(KERN_WARNING
 				       "ip_conntrack: table full, dropping"
@@ -508,8 +604,18 @@ init_conntrack(const struct ip_conntrack_tuple *tuple,
 	conntrack->timeout.data = (unsigned long)conntrack;
 	conntrack->timeout.function = death_by_timeout;
 
-	WRITE_LOCK(&ip_conntrack_lock);
-	exp = find_expectation(tuple);
+	/* Only taking an expectation needs the write lock */
+	if (!list_empty(&ip_conntrack_expect_list)) {
+		WRITE_LOCK(&ip_conntrack_lock);
+		exp = find_expectation(tuple);
+		if (!exp) {
+			WRITE_UNLOCK(&ip_conntrack_lock);
+			READ_LOCK(&ip_conntrack_lock);
+		}
+	} else {
+		READ_LOCK(&ip_conntrack_lock);
+		exp = NULL;
+	}
 
 	if (exp) {
 		DEBUGP("conntrack: expectation arrives ct=%p exp=%p\n",
@@ -529,10 +635,15 @@ init_conntrack(const struct ip_conntrack_tuple *tuple,
 	}
 
 	/* Overload tuple linked list to put us in unconfirmed list. */
+	spin_lock(&ip_conntrack_unconfirmed_lock);
 	list_add(&conntrack->tuplehash[IP_CT_DIR_ORIGINAL].list, &unconfirmed);
+	spin_unlock(&ip_conntrack_unconfirmed_lock);
 
 	atomic_inc(&ip_conntrack_count);
-	WRITE_UNLOCK(&ip_conntrack_lock);
+	if (exp)
+		WRITE_UNLOCK(&ip_conntrack_lock);
+	else
+		READ_UNLOCK(&ip_conntrack_lock);
 
 	if (exp) {
 		if (exp->expectfn)
@@ -925,14 +1036,19 @@ void ip_ct_refresh_acct(struct ip_conntrack *ct,
 		ct->timeout.expires = extra_jiffies;
 		ct_add_counters(ct, ctinfo, skb);
 	} else {
-		WRITE_LOCK(&ip_conntrack_lock);
+		/* Any stripe will do, as long as it is always the same
+		   one for this conntrack. */
+		spinlock_t *lock = ip_conntrack_bucket_lock((unsigned long)ct
+							    / L1_CACHE_BYTES);
+
+		spin_lock_bh(lock);
 		/* Need del_timer for race avoidance (may already be dying). */
 		if (del_timer(&ct->timeout)) {
 			ct->timeout.expires = jiffies + extra_jiffies;
 			add_timer(&ct->timeout);
 		}
 		ct_add_counters(ct, ctinfo, skb);
-		WRITE_UNLOCK(&ip_conntrack_lock);
+		spin_unlock_bh(lock);
 	}
 }
 
@@ -1136,6 +1252,8 @@ void ip_conntrack_cleanup(void)
 		schedule();
 		goto i_see_dead_people;
 	}
+	/* Wait for the conntracks still waiting out their grace period */
+	rcu_barrier();
 
 	kmem_cache_destroy(ip_conntrack_cachep);
 	kmem_cache_destroy(ip_conntrack_expect_cachep);
@@ -1224,6 +1342,8 @@ int __init ip_conntrack_init(void)
 
 	for (i = 0; i < ip_conntrack_htable_size; i++)
 		INIT_LIST_HEAD(&ip_conntrack_hash[i]);
+	for (i = 0; i < CONNTRACK_LOCKS; i++)
+		spin_lock_init(&ip_conntrack_locks[i]);
 
 	/* For use by ipt_REJECT */
 	ip_ct_attach = ip_conntrack_attach;
@@ -89,7 +89,7 @@ static struct list_head *ct_get_first(struct seq_file *seq)
 	     st->bucket < ip_conntrack_htable_size;
 	     st->bucket++) {
 		if (!list_empty(&ip_conntrack_hash[st->bucket]))
-			return ip_conntrack_hash[st->bucket].next;
+			return rcu_dereference(ip_conntrack_hash[st->bucket].next);
 	}
 	return NULL;
 }
@@ -98,11 +98,11 @@ static struct list_head *ct_get_next(struct seq_file *seq, struct list_head *hea
 {
 	struct ct_iter_state *st = seq->private;
 
-	head = head->next;
+	head = rcu_dereference(head->next);
 	while (head == &ip_conntrack_hash[st->bucket]) {
 		if (++st->bucket >= ip_conntrack_htable_size)
 			return NULL;
-		head = ip_conntrack_hash[st->bucket].next;
+		head = rcu_dereference(ip_conntrack_hash[st->bucket].next);
 	}
 	return head;
 }
@@ -117,9 +117,11 @@ static struct list_head *ct_get_idx(struct seq_file *seq, loff_t pos)
 	return pos ? NULL : head;
 }
 
+/* The chains change under the read lock too, so walk them with RCU */
 static void *ct_seq_start(struct seq_file *seq, loff_t *pos)
 {
 	READ_LOCK(&ip_conntrack_lock);
+	rcu_read_lock();
 	return ct_get_idx(seq, *pos);
 }
 
@@ -131,6 +133,7 @@ static void *ct_seq_next(struct seq_file *s, void *v, loff_t *pos)
   
 static void ct_seq_stop(struct seq_file *s, void *v)
 {
+	rcu_read_unlock();
 	READ_UNLOCK(&ip_conntrack_lock);
 }
  
@@ -22,6 +22,10 @@
 #include <linux/tcp.h>
 #include <linux/udp.h>
 #include <linux/icmp.h>
+#include <linux/jhash.h>
+#include <linux/percpu.h>
+#include <linux/seqlock.h>
+#include <linux/rcupdate.h>
 #include <net/ip.h>
 #include <asm/uaccess.h>
 #include <asm/semaphore.h>
@@ -77,11 +81,13 @@ static DECLARE_MUTEX(ipt_mutex);
 #endif
 
 /*
-   We keep a set of rules for each CPU, so we can avoid write-locking
-   them in the softirq when updating the counters and therefore
-   only need to read-lock in the softirq; doing a write_lock_bh() in user
-   context stops packets coming through and allows user context to read
-   the counters or update the rules.
+   We keep a set of rules for each CPU, so the softirq updates only the
+   counters of its own CPU.  Packets go through the table under
+   rcu_read_lock_bh(); a new table replaces the old one with
+   rcu_assign_pointer(), and the old one is only read and freed after
+   synchronize_net().  The counters of each CPU are updated under a
+   seqcount of that CPU, so user context can add them up while packets
+   keep coming through.
 
    To be cache friendly on SMP, we arrange them like so:
    [ n-entries ]
@@ -104,15 +110,66 @@ struct ipt_table_info
 	unsigned int hook_entry[NF_IP_NUMHOOKS];
 	unsigned int underflow[NF_IP_NUMHOOKS];
 
+	/* Runs of rules looked up by address, or NULL */
+	struct ipt_classifier *classifier;
+
 	/* ipt_entry tables: one per CPU */
 	char entries[0] ____cacheline_aligned;
 };
 
+/*
+ * Runs of consecutive rules which, as far as a lookup can tell, differ
+ * only in the source (or destination) prefix they match, such as the
+ * per-customer rules of a large filter.  From the first entry of a run
+ * ipt_do_table() goes straight to the first entry whose prefix holds the
+ * packet's address, and from there to the next such one, rather than
+ * try each entry in turn.  The entries skipped are ones ip_packet_match()
+ * would have failed; the ones gone to are still checked in full, matches
+ * and all.  The offsets are the same in the copy of every CPU.
+ */
+#define IPT_RUN_MIN	16		/* entries, for a run to be worth it */
+#define IPT_RUN_MASKS	4		/* prefix lengths in one run */
+#define IPT_RUN_NONE	(~0U)
+
+struct ipt_run
+{
+	unsigned int first, last;	/* entry numbers */
+	unsigned int nfcache;		/* of all its entries */
+	int dst;			/* keyed on daddr rather than saddr */
+	unsigned int nmasks;
+	u_int32_t mask[IPT_RUN_MASKS];
+};
+
+/* The entries of a run with one prefix */
+struct ipt_run_key
+{
+	u_int32_t addr;
+	unsigned int run, mask;
+	unsigned int first, last;	/* entry numbers */
+	int next;			/* in the hash chain, or -1 */
+};
+
+struct ipt_classifier
+{
+	unsigned int nruns;
+	struct ipt_run *runs;		/* in table order */
+	unsigned int *offset;		/* of each entry */
+	unsigned int *next;		/* next in the run with the same key */
+	unsigned long *head;		/* bitmap of the offsets runs start at */
+	unsigned int hmask;
+	int *hash;
+	struct ipt_run_key *keys;
+};
+
+#define IPT_HEAD_BIT(offset)	((offset) / __alignof__(struct ipt_entry))
+
 static LIST_HEAD(ipt_target);
 static LIST_HEAD(ipt_match);
 static LIST_HEAD(ipt_tables);
 #define ADD_COUNTER(c,b,p) do { (c).bcnt += (b); (c).pcnt += (p); } while(0)
 
+static DEFINE_PER_CPU(seqcount_t, ipt_counters_seq);
+
 #ifdef CONFIG_SMP
 #define TABLE_OFFSET(t,p) (SMP_ALIGN((t)->size)*(p))
 #else
@@ -255,6 +312,108 @@ get_entry(void *base, unsigned int offset)
 	return (struct ipt_entry *)(base + offset);
 }
 
+static struct ipt_run_key *
+ipt_run_find(const struct ipt_classifier *c, u_int32_t addr,
+	     unsigned int run, unsigned int mask)
+{
+	int i = c->hash[jhash_3words(addr, run, mask, 0) & c->hmask];
+
+	for (; i >= 0; i = c->keys[i].next) {
+		struct ipt_run_key *k = &c->keys[i];
+
+		if (k->addr == addr && k->run == run && k->mask == mask)
+			return k;
+	}
+	return NULL;
+}
+
+/* The first entry left in @r for the packet, or IPT_RUN_NONE */
+static inline unsigned int
+ipt_run_cursor(const struct ipt_run *r, const unsigned int *cur)
+{
+	unsigned int i, k = IPT_RUN_NONE;
+
+	for (i = 0; i < r->nmasks; i++)
+		if (cur[i] < k)
+			k = cur[i];
+	return k;
+}
+
+static inline struct ipt_entry *
+ipt_run_end(const struct ipt_classifier *c, void *table_base,
+	    const struct ipt_run *r)
+{
+	struct ipt_entry *e = get_entry(table_base, c->offset[r->last]);
+
+	return (void *)e + e->next_offset;
+}
+
+/*
+ * If @e starts a run, the first entry of it which the packet may match,
+ * with *@runp and @cur set up for ipt_run_next(); or the entry after the
+ * run when there is none.  @e itself otherwise.
+ */
+static struct ipt_entry *
+ipt_run_enter(const struct ipt_classifier *c, void *table_base,
+	      struct ipt_entry *e, const struct iphdr *ip,
+	      const struct ipt_run **runp, unsigned int *cur,
+	      struct sk_buff *skb)
+{
+	unsigned int off;
+
+	while (off = (void *)e - table_base,
+	       test_bit(IPT_HEAD_BIT(off), c->head)) {
+		unsigned int lo = 0, hi = c->nruns, i, k;
+		const struct ipt_run *r;
+		u_int32_t addr;
+
+		while (lo + 1 < hi) {
+			unsigned int mid = (lo + hi) / 2;
+
+			if (c->offset[c->runs[mid].first] <= off)
+				lo = mid;
+			else
+				hi = mid;
+		}
+		r = &c->runs[lo];
+		addr = r->dst ? ip->daddr : ip->saddr;
+		for (i = 0; i < r->nmasks; i++) {
+			struct ipt_run_key *key;
+
+			key = ipt_run_find(c, addr & r->mask[i], lo, i);
+			cur[i] = key ? key->first : IPT_RUN_NONE;
+		}
+		skb->nfcache |= r->nfcache;
+
+		k = ipt_run_cursor(r, cur);
+		if (k != IPT_RUN_NONE) {
+			*runp = r;
+			return get_entry(table_base, c->offset[k]);
+		}
+		e = ipt_run_end(c, table_base, r);
+	}
+	return e;
+}
+
+/* Past the current entry of *@runp: the next one the packet may match */
+static struct ipt_entry *
+ipt_run_next(const struct ipt_classifier *c, void *table_base,
+	     const struct ipt_run **runp, unsigned int *cur)
+{
+	const struct ipt_run *r = *runp;
+	unsigned int i, k = ipt_run_cursor(r, cur);
+
+	for (i = 0; i < r->nmasks; i++)
+		if (cur[i] == k)
+			cur[i] = c->next[k];
+
+	k = ipt_run_cursor(r, cur);
+	if (k != IPT_RUN_NONE)
+		return get_entry(table_base, c->offset[k]);
+	*runp = NULL;
+	return ipt_run_end(c, table_base, r);
+}
+
 /* Returns one of the generic firewall policies, like NF_ACCEPT. */
 unsigned int
 ipt_do_table(struct sk_buff **pskb,
@@ -274,6 +433,12 @@ ipt_do_table(struct sk_buff **pskb,
 	const char *indev, *outdev;
 	void *table_base;
 	struct ipt_entry *e, *back;
+	struct ipt_table_info *private;
+	seqcount_t *seq;
+	const struct ipt_classifier *cls;
+	const struct ipt_run *run = NULL;
+	unsigned int cur[IPT_RUN_MASKS];
+	u_int32_t run_addr = 0;
 
 	/* Initialization */
 	ip = (*pskb)->nh.iph;
@@ -288,11 +453,14 @@ ipt_do_table(struct sk_buff **pskb,
 	 * match it. */
 	offset = ntohs(ip->frag_off) & IP_OFFSET;
 
-	read_lock_bh(&table->lock);
+	rcu_read_lock_bh();
 	IP_NF_ASSERT(table->valid_hooks & (1 << hook));
-	table_base = (void *)table->private->entries
-		+ TABLE_OFFSET(table->private, smp_processor_id());
-	e = get_entry(table_base, table->private->hook_entry[hook]);
+	private = rcu_dereference(table->private);
+	table_base = (void *)private->entries
+		+ TABLE_OFFSET(private, smp_processor_id());
+	seq = &__get_cpu_var(ipt_counters_seq);
+	e = get_entry(table_base, private->hook_entry[hook]);
+	cls = private->classifier;
 
 #ifdef CONFIG_NETFILTER_DEBUG
 	/* Check noone else using our table */
@@ -308,9 +476,15 @@ ipt_do_table(struct sk_buff **pskb,
 #endif
 
 	/* For return from builtin chain */
-	back = get_entry(table_base, table->private->underflow[hook]);
+	back = get_entry(table_base, private->underflow[hook]);
 
 	do {
+		if (cls && !run) {
+			e = ipt_run_enter(cls, table_base, e, ip, &run, cur,
+					  *pskb);
+			if (run)
+				run_addr = run->dst ? ip->daddr : ip->saddr;
+		}
 		IP_NF_ASSERT(e);
 		IP_NF_ASSERT(back);
 		(*pskb)->nfcache |= e->nfcache;
@@ -322,7 +496,9 @@ ipt_do_table(struct sk_buff **pskb,
 					      offset, &hotdrop) != 0)
 				goto no_match;
 
+			write_seqcount_begin(seq);
 			ADD_COUNTER(e->counters, ntohs(ip->tot_len), 1);
+			write_seqcount_end(seq);
 
 			t = ipt_get_target(e);
 			IP_NF_ASSERT(t->u.kernel.target);
@@ -330,6 +506,7 @@ ipt_do_table(struct sk_buff **pskb,
 			if (!t->u.kernel.target->target) {
 				int v;
 
+				run = NULL;
 				v = ((struct ipt_standard_target *)t)->verdict;
 				if (v < 0) {
 					/* Pop from stack? */
@@ -382,23 +559,28 @@ ipt_do_table(struct sk_buff **pskb,
 				ip = (*pskb)->nh.iph;
 				datalen = (*pskb)->len - ip->ihl * 4;
 
-				if (verdict == IPT_CONTINUE)
-					e = (void *)e + e->next_offset;
-				else
+				if (verdict != IPT_CONTINUE)
 					/* Verdict */
 					break;
+				if (run && run_addr !=
+				    (run->dst ? ip->daddr : ip->saddr))
+					run = NULL;
+				goto no_match;
 			}
 		} else {
 
 		no_match:
-			e = (void *)e + e->next_offset;
+			if (run)
+				e = ipt_run_next(cls, table_base, &run, cur);
+			else
+				e = (void *)e + e->next_offset;
 		}
 	} while (!hotdrop);
 
 #ifdef CONFIG_NETFILTER_DEBUG
 	((struct ipt_entry *)table_base)->comefrom = 0xdead57ac;
 #endif
-	read_unlock_bh(&table->lock);
+	rcu_read_unlock_bh();
 
 #ifdef DEBUG_ALLOW_ALL
 	return NF_ACCEPT;
@@ -850,6 +1032,161 @@ cleanup_entry(struct ipt_entry *e, unsigned int *i)
 	return 0;
 }
 
+static void free_classifier(struct ipt_classifier *c)
+{
+	if (!c)
+		return;
+	vfree(c->keys);
+	vfree(c->hash);
+	vfree(c->head);
+	vfree(c->runs);
+	vfree(c->next);
+	vfree(c->offset);
+	kfree(c);
+}
+
+/* Grow run @r, started at entry @i, as far as it goes; its end + 1 */
+static unsigned int
+classifier_run(const struct ipt_classifier *c, struct ipt_table_info *info,
+	       struct ipt_run *r, unsigned int i)
+{
+	unsigned int j, m;
+
+	r->first = i;
+	r->nfcache = 0;
+	r->nmasks = 0;
+	for (j = i; j < info->number; j++) {
+		struct ipt_entry *e = get_entry(info->entries, c->offset[j]);
+		u_int32_t mask;
+
+		if (e->ip.invflags & (r->dst ? IPT_INV_DSTIP : IPT_INV_SRCIP))
+			break;
+		mask = r->dst ? e->ip.dmsk.s_addr : e->ip.smsk.s_addr;
+		for (m = 0; m < r->nmasks && r->mask[m] != mask; m++)
+			;
+		if (m == r->nmasks) {
+			if (m == IPT_RUN_MASKS)
+				break;
+			r->mask[r->nmasks++] = mask;
+		}
+		r->nfcache |= e->nfcache;
+	}
+	r->last = j - 1;
+	return j;
+}
+
+/* Index the runs of the translated table in newinfo, if it has any */
+static struct ipt_classifier *build_classifier(struct ipt_table_info *info)
+{
+	unsigned int n = info->number, bits = IPT_HEAD_BIT(info->size) + 1;
+	unsigned int i, j, nkeys = 0, nk = 0, off;
+	struct ipt_classifier *c;
+
+	if (n < IPT_RUN_MIN)
+		return NULL;
+	c = kmalloc(sizeof(*c), GFP_KERNEL);
+	if (!c)
+		return NULL;
+	memset(c, 0, sizeof(*c));
+	c->offset = vmalloc(n * sizeof(unsigned int));
+	c->next = vmalloc(n * sizeof(unsigned int));
+	c->runs = vmalloc(n / IPT_RUN_MIN * sizeof(struct ipt_run));
+	c->head = vmalloc(BITS_TO_LONGS(bits) * sizeof(long));
+	if (!c->offset || !c->next || !c->runs || !c->head)
+		goto fail;
+	memset(c->head, 0, BITS_TO_LONGS(bits) * sizeof(long));
+
+	for (i = 0, off = 0; i < n; i++) {
+		c->offset[i] = off;
+		off += get_entry(info->entries, off)->next_offset;
+	}
+
+	for (i = 0; i < n; i = j) {
+		struct ipt_entry *e = get_entry(info->entries, c->offset[i]);
+		struct ipt_run *r = &c->runs[c->nruns];
+
+		j = i + 1;
+		if (e->ip.smsk.s_addr && !(e->ip.invflags & IPT_INV_SRCIP))
+			r->dst = 0;
+		else if (e->ip.dmsk.s_addr && !(e->ip.invflags & IPT_INV_DSTIP))
+			r->dst = 1;
+		else
+			continue;
+		if (classifier_run(c, info, r, i) - i < IPT_RUN_MIN)
+			continue;
+		j = r->last + 1;
+		nkeys += j - i;
+		c->nruns++;
+	}
+	if (!c->nruns)
+		goto fail;
+
+	c->hmask = roundup_pow_of_two(nkeys) - 1;
+	c->hash = vmalloc((c->hmask + 1) * sizeof(int));
+	c->keys = vmalloc(nkeys * sizeof(struct ipt_run_key));
+	if (!c->hash || !c->keys)
+		goto fail;
+	memset(c->hash, -1, (c->hmask + 1) * sizeof(int));
+
+	for (i = 0; i < c->nruns; i++) {
+		struct ipt_run *r = &c->runs[i];
+
+		set_bit(IPT_HEAD_BIT(c->offset[r->first]), c->head);
+		for (j = r->first; j <= r->last; j++) {
+			struct ipt_entry *e;
+			struct ipt_run_key *k;
+			u_int32_t addr, mask;
+			unsigned int m;
+			int h;
+
+			e = get_entry(info->entries, c->offset[j]);
+			addr = r->dst ? e->ip.dst.s_addr : e->ip.src.s_addr;
+			mask = r->dst ? e->ip.dmsk.s_addr : e->ip.smsk.s_addr;
+			for (m = 0; r->mask[m] != mask; m++)
+				;
+
+			c->next[j] = IPT_RUN_NONE;
+			k = ipt_run_find(c, addr, i, m);
+			if (k) {
+				c->next[k->last] = j;
+				k->last = j;
+				continue;
+			}
+			k = &c->keys[nk];
+			k->addr = addr;
+			k->run = i;
+			k->mask = m;
+			k->first = k->last = j;
+			h = jhash_3words(addr, i, m, 0) & c->hmask;
+			k->next = c->hash[h];
+			c->hash[h] = nk++;
+		}
+	}
+	duprintf("build_classifier: %u runs, %u entries\n", c->nruns, nkeys);
+	return c;
+
+fail:
+	free_classifier(c);
+	return NULL;
+}
+
+static struct ipt_table_info *alloc_table_info(unsigned int size)
+{
+	struct ipt_table_info *info;
+
+	info = vmalloc(sizeof(struct ipt_table_info)
+		       + SMP_ALIGN(size) * num_possible_cpus());
+	if (info)
+		info->classifier = NULL;
+	return info;
+}
+
+static void free_table_info(struct ipt_table_info *info)
+{
+	free_classifier(info->classifier);
+	vfree(info);
+}
+
 /* Checks and translates the user-supplied table segment (held in
    newinfo) */
 static int
@@ -929,6 +1266,7 @@ translate_table(const char *name,
 		       SMP_ALIGN(newinfo->size));
 	}
 
+	newinfo->classifier = build_classifier(newinfo);
 	return ret;
 }
 
@@ -955,20 +1293,19 @@ replace_table(struct ipt_table *table,
 	}
 #endif
 
-	/* Do the substitution. */
-	write_lock_bh(&table->lock);
-	/* Check inside lock: is the old number correct? */
+	/* Do the substitution: ipt_mutex keeps other replacements out. */
 	if (num_counters != table->private->number) {
 		duprintf("num_counters != table->private->number (%u/%u)\n",
 			 num_counters, table->private->number);
-		write_unlock_bh(&table->lock);
 		*error = -EAGAIN;
 		return NULL;
 	}
 	oldinfo = table->private;
-	table->private = newinfo;
 	newinfo->initial_entries = oldinfo->initial_entries;
-	write_unlock_bh(&table->lock);
+	rcu_assign_pointer(table->private, newinfo);
+
+	/* No packet is left on the old table for its counters to change */
+	synchronize_net();
 
 	return oldinfo;
 }
@@ -977,9 +1314,18 @@ replace_table(struct ipt_table *table,
 static inline int
 add_entry_to_counter(const struct ipt_entry *e,
 		     struct ipt_counters total[],
-		     unsigned int *i)
+		     unsigned int *i,
+		     seqcount_t *seq)
 {
-	ADD_COUNTER(total[*i], e->counters.bcnt, e->counters.pcnt);
+	u_int64_t bcnt, pcnt;
+	unsigned int start;
+
+	do {
+		start = read_seqcount_begin(seq);
+		bcnt = e->counters.bcnt;
+		pcnt = e->counters.pcnt;
+	} while (read_seqcount_retry(seq, start));
+	ADD_COUNTER(total[*i], bcnt, pcnt);
 
 	(*i)++;
 	return 0;
@@ -998,7 +1344,8 @@ get_counters(const struct ipt_table_info *t,
 				  t->size,
 				  add_entry_to_counter,
 				  counters,
-				  &i);
+				  &i,
+				  &per_cpu(ipt_counters_seq, cpu));
 	}
 }
 
@@ -1012,9 +1359,9 @@ copy_entries_to_user(unsigned int total_size,
 	struct ipt_counters *counters;
 	int ret = 0;
 
-	/* We need atomic snapshot of counters: rest doesn't change
-	   (other than comefrom, which userspace doesn't care
-	   about). */
+	/* The counters are summed as they are, each one consistently:
+	   rest doesn't change (other than comefrom, which userspace
+	   doesn't care about), ipt_mutex keeps the table in place. */
 	countersize = sizeof(struct ipt_counters) * table->private->number;
 	counters = vmalloc(countersize);
 
@@ -1023,9 +1370,7 @@ copy_entries_to_user(unsigned int total_size,
 
 	/* First, sum counters... */
 	memset(counters, 0, countersize);
-	write_lock_bh(&table->lock);
 	get_counters(table->private, counters);
-	write_unlock_bh(&table->lock);
 
 	/* ... then copy entire thing from CPU 0... */
 	if (copy_to_user(userptr, table->private->entries, total_size) != 0) {
@@ -1129,8 +1474,7 @@ do_replace(void __user *user, unsigned int len)
 	if ((SMP_ALIGN(tmp.size) >> PAGE_SHIFT) + 2 > num_physpages)
 		return -ENOMEM;
 
-	newinfo = vmalloc(sizeof(struct ipt_table_info)
-			  + SMP_ALIGN(tmp.size) * num_possible_cpus());
+	newinfo = alloc_table_info(tmp.size);
 	if (!newinfo)
 		return -ENOMEM;
 
@@ -1188,7 +1532,7 @@ do_replace(void __user *user, unsigned int len)
 	get_counters(oldinfo, counters);
 	/* Decrease module usage counts and free resource */
 	IPT_ENTRY_ITERATE(oldinfo->entries, oldinfo->size, cleanup_entry,NULL);
-	vfree(oldinfo);
+	free_table_info(oldinfo);
 	if (copy_to_user(tmp.counters, counters,
 			 sizeof(struct ipt_counters) * tmp.num_counters) != 0)
 		ret = -EFAULT;
@@ -1204,11 +1548,11 @@ do_replace(void __user *user, unsigned int len)
  free_newinfo_counters:
 	vfree(counters);
  free_newinfo:
-	vfree(newinfo);
+	free_table_info(newinfo);
 	return ret;
 }
 
-/* We're lazy, and add to the first CPU; overflow works its fey magic
+/* We're lazy, and add to the CPU we run on; overflow works its fey magic
  * and everything is OK. */
 static inline int
 add_counter_to_entry(struct ipt_entry *e,
@@ -1259,20 +1603,23 @@ do_add_counters(void __user *user, unsigned int len)
 		goto free;
 	}
 
-	write_lock_bh(&t->lock);
 	if (t->private->number != paddc->num_counters) {
 		ret = -EINVAL;
 		goto unlock_up_free;
 	}
 
+	local_bh_disable();
+	write_seqcount_begin(&__get_cpu_var(ipt_counters_seq));
 	i = 0;
-	IPT_ENTRY_ITERATE(t->private->entries,
+	IPT_ENTRY_ITERATE(t->private->entries
+			  + TABLE_OFFSET(t->private, smp_processor_id()),
 			  t->private->size,
 			  add_counter_to_entry,
 			  paddc->counters,
 			  &i);
+	write_seqcount_end(&__get_cpu_var(ipt_counters_seq));
+	local_bh_enable();
  unlock_up_free:
-	write_unlock_bh(&t->lock);
 	up(&ipt_mutex);
 	module_put(t->me);
  free:
@@ -1457,10 +1804,9 @@ int ipt_register_table(struct ipt_table *table, const struct ipt_replace *repl)
 	int ret;
 	struct ipt_table_info *newinfo;
 	static struct ipt_table_info bootstrap
-		= { 0, 0, 0, { 0 }, { 0 }, { } };
+		= { 0, 0, 0, { 0 }, { 0 }, NULL, { } };
 
-	newinfo = vmalloc(sizeof(struct ipt_table_info)
-			  + SMP_ALIGN(repl->size) * num_possible_cpus());
+	newinfo = alloc_table_info(repl->size);
 	if (!newinfo)
 		return -ENOMEM;
 
@@ -1472,13 +1818,13 @@ int ipt_register_table(struct ipt_table *table, const struct ipt_replace *repl)
 			      repl->hook_entry,
 			      repl->underflow);
 	if (ret != 0) {
-		vfree(newinfo);
+		free_table_info(newinfo);
 		return ret;
 	}
 
 	ret = down_interruptible(&ipt_mutex);
 	if (ret != 0) {
-		vfree(newinfo);
+		free_table_info(newinfo);
 		return ret;
 	}
 
@@ -1499,7 +1845,6 @@ int ipt_register_table(struct ipt_table *table, const struct ipt_replace *repl)
 	/* save number of initial entries */
 	table->private->initial_entries = table->private->number;
 
-	rwlock_init(&table->lock);
 	list_prepend(&ipt_tables, table);
 
  unlock:
@@ -1507,7 +1852,7 @@ int ipt_register_table(struct ipt_table *table, const struct ipt_replace *repl)
 	return ret;
 
  free_unlock:
-	vfree(newinfo);
+	free_table_info(newinfo);
 	goto unlock;
 }
 
@@ -1520,7 +1865,7 @@ void ipt_unregister_table(struct ipt_table *table)
 	/* Decrease module usage counts and free resources */
 	IPT_ENTRY_ITERATE(table->private->entries, table->private->size,
 			  cleanup_entry, NULL);
-	vfree(table->private);
+	free_table_info(table->private);
 }
 
 /* Returns 1 if the port is matched by the range, 0 otherwise */
@@ -69,8 +69,8 @@ static int sockstat_seq_show(struct seq_file *seq, void *v)
 		   atomic_read(&tcp_memory_allocated));
 	seq_printf(seq, "UDP: inuse %d\n", fold_prot_inuse(&udp_prot));
 	seq_printf(seq, "RAW: inuse %d\n", fold_prot_inuse(&raw_prot));
-	seq_printf(seq,  "FRAG: inuse %d memory %d\n", ip_frag_nqueues,
-		   atomic_read(&ip_frag_mem));
+	seq_printf(seq,  "FRAG: inuse %d memory %d\n",
+		   atomic_read(&ip_frag_nqueues), atomic_read(&ip_frag_mem));
 	return 0;
 }
 
@@ -246,6 +246,8 @@ static struct snmp_mib snmp4_net_list[] = {
 	SNMP_MIB_ITEM("TCPAbortOnLinger", LINUX_MIB_TCPABORTONLINGER),
 	SNMP_MIB_ITEM("TCPAbortFailed", LINUX_MIB_TCPABORTFAILED),
 	SNMP_MIB_ITEM("TCPMemoryPressures", LINUX_MIB_TCPMEMORYPRESSURES),
+	SNMP_MIB_ITEM("IPFragEvicted", LINUX_MIB_IPFRAGEVICTED),
+	SNMP_MIB_ITEM("IPFragOverflow", LINUX_MIB_IPFRAGOVERFLOW),
 	SNMP_MIB_SENTINEL
 };
 
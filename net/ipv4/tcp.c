@@ -257,11 +257,13 @@
 #include <linux/fs.h>
 #include <linux/random.h>
 #include <linux/bootmem.h>
+#include <linux/err.h>
 
 #include <net/icmp.h>
 #include <net/tcp.h>
 #include <net/xfrm.h>
 #include <net/ip.h>
+#include <net/ip6_checksum.h>
 
 
 #include <asm/uaccess.h>
@@ -1953,6 +1955,25 @@ int tcp_setsockopt(struct sock *sk, int level, int optname, char __user *optval,
 		return tp->af_specific->setsockopt(sk, level, optname,
 						   optval, optlen);
 
+	/* This is a string value all the others are int's */
+	if (optname == TCP_CONGESTION) {
+		char name[TCP_CA_NAME_MAX];
+
+		if (optlen < 1)
+			return -EINVAL;
+
+		val = strncpy_from_user(name, optval,
+					min(TCP_CA_NAME_MAX-1, optlen));
+		if (val < 0)
+			return -EFAULT;
+		name[val] = 0;
+
+		lock_sock(sk);
+		err = tcp_set_congestion_control(tp, name);
+		release_sock(sk);
+		return err;
+	}
+
 	if (optlen < sizeof(int))
 		return -EINVAL;
 
@@ -2237,6 +2258,15 @@ int tcp_getsockopt(struct sock *sk, int level, int optname, char __user *optval,
 	case TCP_QUICKACK:
 		val = !tp->ack.pingpong;
 		break;
+	case TCP_CONGESTION:
+		if (get_user(len, optlen))
+			return -EFAULT;
+		len = min_t(unsigned int, len, TCP_CA_NAME_MAX);
+		if (put_user(len, optlen))
+			return -EFAULT;
+		if (copy_to_user(optval, tp->ca_ops->name, len))
+			return -EFAULT;
+		return 0;
 	default:
 		return -ENOPROTOOPT;
 	};
@@ -2248,6 +2278,145 @@ int tcp_getsockopt(struct sock *sk, int level, int optname, char __user *optval,
 	return 0;
 }
 
+/*
+ *	Cut a large send into tso_size pieces for a device without TSO.
+ *	Only the first segment may carry CWR and only the last one keeps
+ *	FIN and PSH, which is what a TSO capable card would emit.
+ */
+struct sk_buff *tcp_tso_segment(struct sk_buff *skb, int features)
+{
+	struct sk_buff *segs = ERR_PTR(-EINVAL);
+	struct tcphdr *th;
+	unsigned int thlen;
+	unsigned int mss;
+	u32 seq;
+
+	if (!pskb_may_pull(skb, sizeof(*th)))
+		goto out;
+
+	th = skb->h.th;
+	thlen = th->doff * 4;
+	if (thlen < sizeof(*th))
+		goto out;
+
+	if (!pskb_may_pull(skb, thlen))
+		goto out;
+
+	th = skb->h.th;
+	seq = ntohl(th->seq);
+	mss = skb_shinfo(skb)->tso_size;
+	__skb_pull(skb, thlen);
+
+	segs = skb_segment(skb, features);
+	if (IS_ERR(segs))
+		goto out;
+
+	for (skb = segs; skb; skb = skb->next) {
+		struct iphdr *iph = skb->nh.iph;
+		unsigned int len = skb->len - (skb->h.raw - skb->data);
+
+		th = skb->h.th;
+		th->seq = htonl(seq);
+		if (skb != segs)
+			th->cwr = 0;
+		if (skb->next)
+			th->fin = th->psh = 0;
+		seq += mss;
+
+		if (skb->protocol == htons(ETH_P_IPV6)) {
+			struct ipv6hdr *ipv6h = skb->nh.ipv6h;
+
+			if (skb->ip_summed == CHECKSUM_HW) {
+				th->check = ~csum_ipv6_magic(&ipv6h->saddr,
+							     &ipv6h->daddr,
+							     len, IPPROTO_TCP, 0);
+				skb->csum = offsetof(struct tcphdr, check);
+			} else {
+				th->check = 0;
+				th->check = csum_ipv6_magic(&ipv6h->saddr,
+							    &ipv6h->daddr,
+							    len, IPPROTO_TCP,
+							    csum_partial((char *)th,
+									 thlen,
+									 skb->csum));
+			}
+		} else if (skb->ip_summed == CHECKSUM_HW) {
+			th->check = ~tcp_v4_check(th, len, iph->saddr,
+						  iph->daddr, 0);
+			skb->csum = offsetof(struct tcphdr, check);
+		} else {
+			th->check = 0;
+			th->check = tcp_v4_check(th, len, iph->saddr,
+						 iph->daddr,
+						 csum_partial((char *)th,
+							      thlen,
+							      skb->csum));
+		}
+	}
+
+out:
+	return segs;
+}
+
+/*
+ *	Receive aggregation of a bulk transfer.  Segments are merged only
+ *	when they carry data and nothing but an unchanged ACK, follow each
+ *	other in sequence and were checksummed by the device.
+ */
+#define TCP_GRO_NOMERGE	(TCP_FLAG_CWR | TCP_FLAG_ECE | TCP_FLAG_URG | \
+			 TCP_FLAG_RST | TCP_FLAG_SYN | TCP_FLAG_FIN)
+
+int tcp_gro_receive(struct sk_buff *held, struct sk_buff *skb)
+{
+	struct tcphdr *th, *th2;
+	unsigned int off = skb->h.raw - skb->data;
+	unsigned int thlen, len;
+
+	if (!held) {
+		if (skb->ip_summed != CHECKSUM_UNNECESSARY ||
+		    !pskb_may_pull(skb, off + sizeof(*th)))
+			return GRO_NORMAL;
+
+		thlen = skb->h.th->doff * 4;
+		if (thlen < sizeof(*th) || !pskb_may_pull(skb, off + thlen))
+			return GRO_NORMAL;
+
+		th = skb->h.th;
+		len = skb->len - off - thlen;
+		GRO_CB(skb)->size = len;
+		if (!len || !th->ack ||
+		    (tcp_flag_word(th) & TCP_GRO_NOMERGE))
+			return GRO_NOHOLD;
+		return GRO_HOLD;
+	}
+
+	th = skb->h.th;
+	th2 = held->h.th;
+	if (th->source != th2->source || th->dest != th2->dest)
+		return GRO_NOMATCH;
+
+	thlen = th->doff * 4;
+	len = skb->len - off - thlen;
+	if (GRO_CB(skb)->flush || !len || !th->ack || th2->psh ||
+	    (tcp_flag_word(th) & TCP_GRO_NOMERGE) ||
+	    th->doff != th2->doff || th->ack_seq != th2->ack_seq ||
+	    memcmp(th + 1, th2 + 1, thlen - sizeof(*th)) ||
+	    ntohl(th->seq) != ntohl(th2->seq) + held->len -
+			      (held->h.raw - held->data) - thlen ||
+	    len > GRO_CB(held)->size || held->len + len > 65535)
+		return GRO_FLUSH;
+
+	th2->window = th->window;
+	th2->psh = th->psh;
+
+	__skb_pull(skb, off + thlen);
+	skb_gro_append(held, skb);
+
+	if (th->psh || len < GRO_CB(held)->size)
+		return GRO_MERGED_FLUSH;
+	return GRO_MERGED;
+}
+
 
 extern void __skb_cb_too_small_for_tcp(int, int);
 extern void tcpdiag_init(void);
@@ -2287,7 +2456,8 @@ void __init tcp_init(void)
 
 	tcp_timewait_cachep = kmem_cache_create("tcp_tw_bucket",
 						sizeof(struct tcp_tw_bucket),
-						0, SLAB_HWCACHE_ALIGN,
+						0, SLAB_HWCACHE_ALIGN |
+						SLAB_DESTROY_BY_RCU,
 						NULL, NULL);
 	if (!tcp_timewait_cachep)
 		panic("tcp_init: Cannot alloc tcp_tw_bucket cache.");
@@ -2384,3 +2554,4 @@ EXPORT_SYMBOL(tcp_setsockopt);
 EXPORT_SYMBOL(tcp_shutdown);
 EXPORT_SYMBOL(tcp_statistics);
 EXPORT_SYMBOL(tcp_timewait_cachep);
+EXPORT_SYMBOL(tcp_tso_segment);
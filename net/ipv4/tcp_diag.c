@@ -22,6 +22,7 @@
 
 #include <net/icmp.h>
 #include <net/tcp.h>
+#include <net/udp.h>
 #include <net/ipv6.h>
 #include <net/inet_common.h>
 
@@ -52,16 +53,49 @@ static struct sock *tcpnl;
    rta->rta_len = rtalen;                   \
    RTA_DATA(rta); })
 
+/* Ports and addresses of a full socket, as opposed to a time-wait one */
+static void tcpdiag_fill_addrs(struct tcpdiagmsg *r, struct sock *sk)
+{
+	struct inet_sock *inet = inet_sk(sk);
+
+	r->id.tcpdiag_sport = inet->sport;
+	r->id.tcpdiag_dport = inet->dport;
+	r->id.tcpdiag_src[0] = inet->rcv_saddr;
+	r->id.tcpdiag_dst[0] = inet->daddr;
+
+#ifdef CONFIG_IP_TCPDIAG_IPV6
+	if (r->tcpdiag_family == AF_INET6) {
+		struct ipv6_pinfo *np = inet6_sk(sk);
+
+		ipv6_addr_copy((struct in6_addr *)r->id.tcpdiag_src,
+			       &np->rcv_saddr);
+		ipv6_addr_copy((struct in6_addr *)r->id.tcpdiag_dst,
+			       &np->daddr);
+	}
+#endif
+}
+
+static void tcpdiag_fill_skmeminfo(struct tcpdiag_skmeminfo *m, struct sock *sk)
+{
+	m->tcpdiag_rmem_alloc = atomic_read(&sk->sk_rmem_alloc);
+	m->tcpdiag_rcvbuf = sk->sk_rcvbuf;
+	m->tcpdiag_wmem_alloc = atomic_read(&sk->sk_wmem_alloc);
+	m->tcpdiag_sndbuf = sk->sk_sndbuf;
+	m->tcpdiag_fwd_alloc = sk->sk_forward_alloc;
+	m->tcpdiag_wmem_queued = sk->sk_wmem_queued;
+	m->tcpdiag_rcv_space = 0;
+	m->tcpdiag_window_clamp = 0;
+}
+
 static int tcpdiag_fill(struct sk_buff *skb, struct sock *sk,
 			int ext, u32 pid, u32 seq, u16 nlmsg_flags)
 {
-	struct inet_sock *inet = inet_sk(sk);
 	struct tcp_sock *tp = tcp_sk(sk);
 	struct tcpdiagmsg *r;
 	struct nlmsghdr  *nlh;
 	struct tcp_info  *info = NULL;
 	struct tcpdiag_meminfo  *minfo = NULL;
-	struct tcpvegas_info *vinfo = NULL;
+	struct tcpdiag_skmeminfo *skminfo = NULL;
 	unsigned char	 *b = skb->tail;
 
 	nlh = NLMSG_PUT(skb, pid, seq, TCPDIAG_GETSOCK, sizeof(*r));
@@ -70,12 +104,17 @@ static int tcpdiag_fill(struct sk_buff *skb, struct sock *sk,
 	if (sk->sk_state != TCP_TIME_WAIT) {
 		if (ext & (1<<(TCPDIAG_MEMINFO-1)))
 			minfo = TCPDIAG_PUT(skb, TCPDIAG_MEMINFO, sizeof(*minfo));
+		if (ext & (1<<(TCPDIAG_SKMEMINFO-1)))
+			skminfo = TCPDIAG_PUT(skb, TCPDIAG_SKMEMINFO,
+					      sizeof(*skminfo));
 		if (ext & (1<<(TCPDIAG_INFO-1)))
 			info = TCPDIAG_PUT(skb, TCPDIAG_INFO, sizeof(*info));
-		
-		if ((tcp_is_westwood(tp) || tcp_is_vegas(tp))
-		    && (ext & (1<<(TCPDIAG_VEGASINFO-1))))
-			vinfo = TCPDIAG_PUT(skb, TCPDIAG_VEGASINFO, sizeof(*vinfo));
+
+		if (ext & (1<<(TCPDIAG_CONG-1))) {
+			size_t len = strlen(tp->ca_ops->name);
+			strcpy(TCPDIAG_PUT(skb, TCPDIAG_CONG, len+1),
+			       tp->ca_ops->name);
+		}
 	}
 	r->tcpdiag_family = sk->sk_family;
 	r->tcpdiag_state = sk->sk_state;
@@ -115,21 +154,7 @@ static int tcpdiag_fill(struct sk_buff *skb, struct sock *sk,
 		return skb->len;
 	}
 
-	r->id.tcpdiag_sport = inet->sport;
-	r->id.tcpdiag_dport = inet->dport;
-	r->id.tcpdiag_src[0] = inet->rcv_saddr;
-	r->id.tcpdiag_dst[0] = inet->daddr;
-
-#ifdef CONFIG_IP_TCPDIAG_IPV6
-	if (r->tcpdiag_family == AF_INET6) {
-		struct ipv6_pinfo *np = inet6_sk(sk);
-
-		ipv6_addr_copy((struct in6_addr *)r->id.tcpdiag_src,
-			       &np->rcv_saddr);
-		ipv6_addr_copy((struct in6_addr *)r->id.tcpdiag_dst,
-			       &np->daddr);
-	}
-#endif
+	tcpdiag_fill_addrs(r, sk);
 
 #define EXPIRES_IN_MS(tmo)  ((tmo-jiffies)*1000+HZ-1)/HZ
 
@@ -163,22 +188,17 @@ static int tcpdiag_fill(struct sk_buff *skb, struct sock *sk,
 		minfo->tcpdiag_tmem = atomic_read(&sk->sk_wmem_alloc);
 	}
 
+	if (skminfo) {
+		tcpdiag_fill_skmeminfo(skminfo, sk);
+		skminfo->tcpdiag_rcv_space = tp->rcvq_space.space;
+		skminfo->tcpdiag_window_clamp = tp->window_clamp;
+	}
+
 	if (info) 
 		tcp_get_info(sk, info);
 
-	if (vinfo) {
-		if (tcp_is_vegas(tp)) {
-			vinfo->tcpv_enabled = tp->vegas.doing_vegas_now;
-			vinfo->tcpv_rttcnt = tp->vegas.cntRTT;
-			vinfo->tcpv_rtt = jiffies_to_usecs(tp->vegas.baseRTT);
-			vinfo->tcpv_minrtt = jiffies_to_usecs(tp->vegas.minRTT);
-		} else {
-			vinfo->tcpv_enabled = 0;
-			vinfo->tcpv_rttcnt = 0;
-			vinfo->tcpv_rtt = jiffies_to_usecs(tp->westwood.rtt);
-			vinfo->tcpv_minrtt = jiffies_to_usecs(tp->westwood.rtt_min);
-		}
-	}
+	if (tp->ca_ops->get_info)
+		tp->ca_ops->get_info(tp, ext, skb);
 
 	nlh->nlmsg_len = skb->tail - b;
 	return skb->len;
@@ -239,6 +259,7 @@ static int tcpdiag_get_exact(struct sk_buff *in_skb, const struct nlmsghdr *nlh)
 	err = -ENOMEM;
 	rep = alloc_skb(NLMSG_SPACE(sizeof(struct tcpdiagmsg)+
 				    sizeof(struct tcpdiag_meminfo)+
+				    sizeof(struct tcpdiag_skmeminfo)+
 				    sizeof(struct tcp_info)+64), GFP_KERNEL);
 	if (!rep)
 		goto out;
@@ -419,36 +440,44 @@ static int tcpdiag_bc_audit(const void *bytecode, int bytecode_len)
 	return len == 0 ? 0 : -EINVAL;
 }
 
-static int tcpdiag_dump_sock(struct sk_buff *skb, struct sock *sk,
-			     struct netlink_callback *cb)
+/* Whether the bytecode of the dump request, if any, accepts @sk */
+static int tcpdiag_bc_match(struct sock *sk, struct netlink_callback *cb)
 {
 	struct tcpdiagreq *r = NLMSG_DATA(cb->nlh);
+	struct tcpdiag_entry entry;
+	struct rtattr *bc = (struct rtattr *)(r + 1);
+	struct inet_sock *inet = inet_sk(sk);
 
-	if (cb->nlh->nlmsg_len > 4 + NLMSG_SPACE(sizeof(*r))) {
-		struct tcpdiag_entry entry;
-		struct rtattr *bc = (struct rtattr *)(r + 1);
-		struct inet_sock *inet = inet_sk(sk);
+	if (cb->nlh->nlmsg_len <= 4 + NLMSG_SPACE(sizeof(*r)))
+		return 1;
 
-		entry.family = sk->sk_family;
+	entry.family = sk->sk_family;
 #ifdef CONFIG_IP_TCPDIAG_IPV6
-		if (entry.family == AF_INET6) {
-			struct ipv6_pinfo *np = inet6_sk(sk);
+	if (entry.family == AF_INET6) {
+		struct ipv6_pinfo *np = inet6_sk(sk);
 
-			entry.saddr = np->rcv_saddr.s6_addr32;
-			entry.daddr = np->daddr.s6_addr32;
-		} else
+		entry.saddr = np->rcv_saddr.s6_addr32;
+		entry.daddr = np->daddr.s6_addr32;
+	} else
 #endif
-		{
-			entry.saddr = &inet->rcv_saddr;
-			entry.daddr = &inet->daddr;
-		}
-		entry.sport = inet->num;
-		entry.dport = ntohs(inet->dport);
-		entry.userlocks = sk->sk_userlocks;
-
-		if (!tcpdiag_bc_run(RTA_DATA(bc), RTA_PAYLOAD(bc), &entry))
-			return 0;
+	{
+		entry.saddr = &inet->rcv_saddr;
+		entry.daddr = &inet->daddr;
 	}
+	entry.sport = inet->num;
+	entry.dport = ntohs(inet->dport);
+	entry.userlocks = sk->sk_userlocks;
+
+	return tcpdiag_bc_run(RTA_DATA(bc), RTA_PAYLOAD(bc), &entry);
+}
+
+static int tcpdiag_dump_sock(struct sk_buff *skb, struct sock *sk,
+			     struct netlink_callback *cb)
+{
+	struct tcpdiagreq *r = NLMSG_DATA(cb->nlh);
+
+	if (!tcpdiag_bc_match(sk, cb))
+		return 0;
 
 	return tcpdiag_fill(skb, sk, r->tcpdiag_ext, NETLINK_CB(cb->skb).pid,
 			    cb->nlh->nlmsg_seq, NLM_F_MULTI);
@@ -719,6 +748,185 @@ done:
 	return skb->len;
 }
 
+static int udpdiag_fill(struct sk_buff *skb, struct sock *sk,
+			int ext, u32 pid, u32 seq, u16 nlmsg_flags)
+{
+	struct tcpdiagmsg *r;
+	struct nlmsghdr  *nlh;
+	struct tcpdiag_meminfo  *minfo = NULL;
+	struct tcpdiag_skmeminfo *skminfo = NULL;
+	unsigned char	 *b = skb->tail;
+
+	nlh = NLMSG_PUT(skb, pid, seq, UDPDIAG_GETSOCK, sizeof(*r));
+	nlh->nlmsg_flags = nlmsg_flags;
+	r = NLMSG_DATA(nlh);
+	if (ext & (1<<(TCPDIAG_MEMINFO-1)))
+		minfo = TCPDIAG_PUT(skb, TCPDIAG_MEMINFO, sizeof(*minfo));
+	if (ext & (1<<(TCPDIAG_SKMEMINFO-1)))
+		skminfo = TCPDIAG_PUT(skb, TCPDIAG_SKMEMINFO, sizeof(*skminfo));
+
+	r->tcpdiag_family = sk->sk_family;
+	r->tcpdiag_state = sk->sk_state;
+	r->tcpdiag_timer = 0;
+	r->tcpdiag_retrans = 0;
+
+	r->id.tcpdiag_if = sk->sk_bound_dev_if;
+	r->id.tcpdiag_cookie[0] = (u32)(unsigned long)sk;
+	r->id.tcpdiag_cookie[1] = (u32)(((unsigned long)sk >> 31) >> 1);
+	tcpdiag_fill_addrs(r, sk);
+
+	/* as /proc/net/udp shows them */
+	r->tcpdiag_expires = 0;
+	r->tcpdiag_rqueue = atomic_read(&sk->sk_rmem_alloc);
+	r->tcpdiag_wqueue = atomic_read(&sk->sk_wmem_alloc);
+	r->tcpdiag_uid = sock_i_uid(sk);
+	r->tcpdiag_inode = sock_i_ino(sk);
+
+	if (minfo) {
+		minfo->tcpdiag_rmem = atomic_read(&sk->sk_rmem_alloc);
+		minfo->tcpdiag_wmem = sk->sk_wmem_queued;
+		minfo->tcpdiag_fmem = sk->sk_forward_alloc;
+		minfo->tcpdiag_tmem = atomic_read(&sk->sk_wmem_alloc);
+	}
+
+	if (skminfo)
+		tcpdiag_fill_skmeminfo(skminfo, sk);
+
+	nlh->nlmsg_len = skb->tail - b;
+	return skb->len;
+
+nlmsg_failure:
+	skb_trim(skb, b - skb->data);
+	return -1;
+}
+
+/* Whether @sk is the socket @req asks for exactly, bar the cookie */
+static int udpdiag_id_match(struct sock *sk, const struct tcpdiagreq *req)
+{
+	struct inet_sock *inet = inet_sk(sk);
+
+	if (sk->sk_family != req->tcpdiag_family ||
+	    inet->sport != req->id.tcpdiag_sport ||
+	    inet->dport != req->id.tcpdiag_dport)
+		return 0;
+	if (req->id.tcpdiag_if && sk->sk_bound_dev_if != req->id.tcpdiag_if)
+		return 0;
+#ifdef CONFIG_IP_TCPDIAG_IPV6
+	if (sk->sk_family == AF_INET6) {
+		struct ipv6_pinfo *np = inet6_sk(sk);
+
+		return ipv6_addr_equal(&np->rcv_saddr,
+				(struct in6_addr *)req->id.tcpdiag_src) &&
+		       ipv6_addr_equal(&np->daddr,
+				(struct in6_addr *)req->id.tcpdiag_dst);
+	}
+#endif
+	return inet->rcv_saddr == req->id.tcpdiag_src[0] &&
+	       inet->daddr == req->id.tcpdiag_dst[0];
+}
+
+static int udpdiag_get_exact(struct sk_buff *in_skb, const struct nlmsghdr *nlh)
+{
+	struct tcpdiagreq *req = NLMSG_DATA(nlh);
+	struct hlist_node *node;
+	struct sk_buff *rep;
+	struct sock *sk;
+	int err;
+
+	if (req->tcpdiag_family != AF_INET
+#ifdef CONFIG_IP_TCPDIAG_IPV6
+	    && req->tcpdiag_family != AF_INET6
+#endif
+	   )
+		return -EINVAL;
+
+	rep = alloc_skb(NLMSG_SPACE(sizeof(struct tcpdiagmsg)+
+				    sizeof(struct tcpdiag_meminfo)+
+				    sizeof(struct tcpdiag_skmeminfo)+64),
+			GFP_KERNEL);
+	if (!rep)
+		return -ENOMEM;
+
+	err = -ENOENT;
+	read_lock(&udp_hash_lock);
+	sk_for_each(sk, node, &udp_hash[ntohs(req->id.tcpdiag_sport) &
+					 (UDP_HTABLE_SIZE - 1)]) {
+		if (!udpdiag_id_match(sk, req))
+			continue;
+
+		err = -ESTALE;
+		if ((req->id.tcpdiag_cookie[0] != TCPDIAG_NOCOOKIE ||
+		     req->id.tcpdiag_cookie[1] != TCPDIAG_NOCOOKIE) &&
+		    ((u32)(unsigned long)sk != req->id.tcpdiag_cookie[0] ||
+		     (u32)((((unsigned long)sk) >> 31) >> 1) != req->id.tcpdiag_cookie[1]))
+			continue;
+
+		if (udpdiag_fill(rep, sk, req->tcpdiag_ext,
+				 NETLINK_CB(in_skb).pid,
+				 nlh->nlmsg_seq, 0) <= 0)
+			BUG();
+		err = 0;
+		break;
+	}
+	read_unlock(&udp_hash_lock);
+
+	if (err) {
+		kfree_skb(rep);
+		return err;
+	}
+	err = netlink_unicast(tcpnl, rep, NETLINK_CB(in_skb).pid, MSG_DONTWAIT);
+	if (err > 0)
+		err = 0;
+	return err;
+}
+
+static int udpdiag_dump(struct sk_buff *skb, struct netlink_callback *cb)
+{
+	int i, num;
+	int s_i, s_num;
+	struct tcpdiagreq *r = NLMSG_DATA(cb->nlh);
+
+	s_i = cb->args[1];
+	s_num = num = cb->args[2];
+
+	read_lock(&udp_hash_lock);
+	for (i = s_i; i < UDP_HTABLE_SIZE; i++) {
+		struct sock *sk;
+		struct hlist_node *node;
+
+		num = 0;
+		sk_for_each(sk, node, &udp_hash[i]) {
+			struct inet_sock *inet = inet_sk(sk);
+
+			if (num < s_num)
+				goto next;
+			if (!(r->tcpdiag_states & (1 << sk->sk_state)))
+				goto next;
+			if (r->id.tcpdiag_sport != inet->sport &&
+			    r->id.tcpdiag_sport)
+				goto next;
+			if (r->id.tcpdiag_dport != inet->dport &&
+			    r->id.tcpdiag_dport)
+				goto next;
+			if (!tcpdiag_bc_match(sk, cb))
+				goto next;
+			if (udpdiag_fill(skb, sk, r->tcpdiag_ext,
+					 NETLINK_CB(cb->skb).pid,
+					 cb->nlh->nlmsg_seq, NLM_F_MULTI) < 0)
+				goto done;
+next:
+			++num;
+		}
+		s_num = 0;
+	}
+done:
+	read_unlock(&udp_hash_lock);
+
+	cb->args[1] = i;
+	cb->args[2] = num;
+	return skb->len;
+}
+
 static int tcpdiag_dump_done(struct netlink_callback *cb)
 {
 	return 0;
@@ -731,7 +939,8 @@ tcpdiag_rcv_msg(struct sk_buff *skb, struct nlmsghdr *nlh)
 	if (!(nlh->nlmsg_flags&NLM_F_REQUEST))
 		return 0;
 
-	if (nlh->nlmsg_type != TCPDIAG_GETSOCK)
+	if (nlh->nlmsg_type != TCPDIAG_GETSOCK &&
+	    nlh->nlmsg_type != UDPDIAG_GETSOCK)
 		goto err_inval;
 
 	if (NLMSG_LENGTH(sizeof(struct tcpdiagreq)) > skb->len)
@@ -748,8 +957,11 @@ tcpdiag_rcv_msg(struct sk_buff *skb, struct nlmsghdr *nlh)
 				goto err_inval;
 		}
 		return netlink_dump_start(tcpnl, skb, nlh,
-					  tcpdiag_dump,
+					  nlh->nlmsg_type == UDPDIAG_GETSOCK ?
+					  udpdiag_dump : tcpdiag_dump,
 					  tcpdiag_dump_done);
+	} else if (nlh->nlmsg_type == UDPDIAG_GETSOCK) {
+		return udpdiag_get_exact(skb, nlh);
 	} else {
 		return tcpdiag_get_exact(skb, nlh);
 	}
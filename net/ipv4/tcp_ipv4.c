@@ -191,7 +191,8 @@ static inline int tcp_bind_conflict(struct sock *sk, struct tcp_bind_bucket *tb)
 		    !tcp_v6_ipv6only(sk2) &&
 		    (!sk->sk_bound_dev_if ||
 		     !sk2->sk_bound_dev_if ||
-		     sk->sk_bound_dev_if == sk2->sk_bound_dev_if)) {
+		     sk->sk_bound_dev_if == sk2->sk_bound_dev_if) &&
+		    !tcp_reuseport_ok(sk, sk2)) {
 			if (!reuse || !sk2->sk_reuse ||
 			    sk2->sk_state == TCP_LISTEN) {
 				const u32 sk2_rcv_saddr = tcp_v4_rcv_saddr(sk2);
@@ -363,7 +364,7 @@ static __inline__ void __tcp_v4_hash(struct sock *sk, const int listen_possible)
 		lock = &tcp_ehash[sk->sk_hashent].lock;
 		write_lock(lock);
 	}
-	__sk_add_node(sk, list);
+	__sk_add_node_rcu(sk, list);
 	sock_prot_inc_use(sk->sk_prot);
 	write_unlock(lock);
 	if (listen_possible && sk->sk_state == TCP_LISTEN)
@@ -411,15 +412,18 @@ void tcp_unhash(struct sock *sk)
  * connection.  So always assume those are both wildcarded
  * during the search since they can never be otherwise.
  */
-static struct sock *__tcp_v4_lookup_listener(struct hlist_head *head, u32 daddr,
+static struct sock *__tcp_v4_lookup_listener(struct hlist_head *head,
+					     u32 saddr, u16 sport, u32 daddr,
 					     unsigned short hnum, int dif)
 {
 	struct sock *result = NULL, *sk;
 	struct hlist_node *node;
 	int score, hiscore;
+	unsigned int matches = 0;
+	u32 phash = 0;
 
 	hiscore=-1;
-	sk_for_each(sk, node, head) {
+	sk_for_each_rcu(sk, node, head) {
 		struct inet_sock *inet = inet_sk(sk);
 
 		if (inet->num == hnum && !ipv6_only_sock(sk)) {
@@ -436,11 +440,20 @@ static struct sock *__tcp_v4_lookup_listener(struct hlist_head *head, u32 daddr,
 					continue;
 				score+=2;
 			}
-			if (score == 5)
+			if (score == 5 && !sock_flag(sk, SOCK_REUSEPORT))
 				return sk;
 			if (score > hiscore) {
 				hiscore = score;
 				result = sk;
+				matches = sock_flag(sk, SOCK_REUSEPORT);
+				if (matches)
+					phash = jhash_3words(saddr, daddr,
+							     (u32)sport << 16 | hnum,
+							     0);
+			} else if (score == hiscore && matches &&
+				   sock_flag(sk, SOCK_REUSEPORT)) {
+				if (tcp_reuseport_select(&phash, ++matches))
+					result = sk;
 			}
 		}
 	}
@@ -448,14 +461,31 @@ static struct sock *__tcp_v4_lookup_listener(struct hlist_head *head, u32 daddr,
 }
 
 /* Optimize the common listener case. */
-static inline struct sock *tcp_v4_lookup_listener(u32 daddr,
-		unsigned short hnum, int dif)
+static inline struct sock *tcp_v4_lookup_listener(u32 saddr, u16 sport,
+		u32 daddr, unsigned short hnum, int dif)
 {
 	struct sock *sk = NULL;
-	struct hlist_head *head;
+	struct hlist_head *head = &tcp_listening_hash[tcp_lhashfn(hnum)];
 
+#ifdef SOCK_LOCKLESS_LOOKUP
+	rcu_read_lock();
+	sk = __tcp_v4_lookup_listener(head, saddr, sport, daddr, hnum, dif);
+	if (sk && sock_hold_not_zero(sk)) {
+		struct inet_sock *inet = inet_sk(sk);
+
+		if (likely(sk->sk_state == TCP_LISTEN && inet->num == hnum &&
+			   (!inet->rcv_saddr || inet->rcv_saddr == daddr) &&
+			   (!sk->sk_bound_dev_if || sk->sk_bound_dev_if == dif) &&
+			   !ipv6_only_sock(sk))) {
+			rcu_read_unlock();
+			return sk;
+		}
+		sock_put(sk);
+	}
+	rcu_read_unlock();
+	sk = NULL;
+#endif
 	read_lock(&tcp_lhash_lock);
-	head = &tcp_listening_hash[tcp_lhashfn(hnum)];
 	if (!hlist_empty(head)) {
 		struct inet_sock *inet = inet_sk((sk = __sk_head(head)));
 
@@ -464,7 +494,8 @@ static inline struct sock *tcp_v4_lookup_listener(u32 daddr,
 		    (sk->sk_family == PF_INET || !ipv6_only_sock(sk)) &&
 		    !sk->sk_bound_dev_if)
 			goto sherry_cache;
-		sk = __tcp_v4_lookup_listener(head, daddr, hnum, dif);
+		sk = __tcp_v4_lookup_listener(head, saddr, sport,
+					      daddr, hnum, dif);
 	}
 	if (sk) {
 sherry_cache:
@@ -494,6 +525,37 @@ static inline struct sock *__tcp_v4_lookup_established(u32 saddr, u16 sport,
 	 */
 	int hash = tcp_hashfn(daddr, hnum, saddr, sport);
 	head = &tcp_ehash[hash];
+#ifdef SOCK_LOCKLESS_LOOKUP
+	/* A socket found here may be reused under us and move to
+	 * another chain, so only a hit is trusted.  Misses are
+	 * confirmed under the lock below.
+	 */
+	rcu_read_lock();
+	sk_for_each_rcu(sk, node, &head->chain) {
+		if (TCP_IPV4_MATCH(sk, acookie, saddr, daddr, ports, dif)) {
+			if (!sock_hold_not_zero(sk))
+				goto slow;
+			if (likely(TCP_IPV4_MATCH(sk, acookie, saddr, daddr,
+						  ports, dif)))
+				goto fast_hit;
+			sock_put(sk);
+			goto slow;
+		}
+	}
+	sk_for_each_rcu(sk, node, &(head + tcp_ehash_size)->chain) {
+		if (TCP_IPV4_TW_MATCH(sk, acookie, saddr, daddr, ports, dif)) {
+			if (!sock_hold_not_zero(sk))
+				goto slow;
+			if (likely(TCP_IPV4_TW_MATCH(sk, acookie, saddr, daddr,
+						     ports, dif)))
+				goto fast_hit;
+			tcp_tw_put(tcptw_sk(sk));
+			goto slow;
+		}
+	}
+slow:
+	rcu_read_unlock();
+#endif
 	read_lock(&head->lock);
 	sk_for_each(sk, node, &head->chain) {
 		if (TCP_IPV4_MATCH(sk, acookie, saddr, daddr, ports, dif))
@@ -512,6 +574,11 @@ out:
 hit:
 	sock_hold(sk);
 	goto out;
+#ifdef SOCK_LOCKLESS_LOOKUP
+fast_hit:
+	rcu_read_unlock();
+	return sk;
+#endif
 }
 
 static inline struct sock *__tcp_v4_lookup(u32 saddr, u16 sport,
@@ -520,7 +587,7 @@ static inline struct sock *__tcp_v4_lookup(u32 saddr, u16 sport,
 	struct sock *sk = __tcp_v4_lookup_established(saddr, sport,
 						      daddr, hnum, dif);
 
-	return sk ? : tcp_v4_lookup_listener(daddr, hnum, dif);
+	return sk ? : tcp_v4_lookup_listener(saddr, sport, daddr, hnum, dif);
 }
 
 inline struct sock *tcp_v4_lookup(u32 saddr, u16 sport, u32 daddr,
@@ -614,7 +681,7 @@ unique:
 	inet->sport = htons(lport);
 	sk->sk_hashent = hash;
 	BUG_TRAP(sk_unhashed(sk));
-	__sk_add_node(sk, &head->chain);
+	__sk_add_node_rcu(sk, &head->chain);
 	sock_prot_inc_use(sk->sk_prot);
 	write_unlock(&head->lock);
 
@@ -1822,7 +1889,9 @@ do_time_wait:
 	switch (tcp_timewait_state_process((struct tcp_tw_bucket *)sk,
 					   skb, th, skb->len)) {
 	case TCP_TW_SYN: {
-		struct sock *sk2 = tcp_v4_lookup_listener(skb->nh.iph->daddr,
+		struct sock *sk2 = tcp_v4_lookup_listener(skb->nh.iph->saddr,
+							  th->source,
+							  skb->nh.iph->daddr,
 							  ntohs(th->dest),
 							  tcp_v4_iif(skb));
 		if (sk2) {
@@ -2060,6 +2129,7 @@ static int tcp_v4_init_sock(struct sock *sk)
 	tp->mss_cache_std = tp->mss_cache = 536;
 
 	tp->reordering = sysctl_tcp_reordering;
+	tp->ca_ops = &tcp_init_congestion_ops;
 
 	sk->sk_state = TCP_CLOSE;
 
@@ -2082,6 +2152,8 @@ int tcp_v4_destroy_sock(struct sock *sk)
 
 	tcp_clear_xmit_timers(sk);
 
+	tcp_cleanup_congestion_control(tp);
+
 	/* Cleanup up the write buffer. */
   	sk_stream_writequeue_purge(sk);
 
@@ -2133,12 +2205,13 @@ static void *listening_get_next(struct seq_file *seq, void *cur)
 	struct tcp_iter_state* st = seq->private;
 
 	if (!sk) {
-		st->bucket = 0;
-		sk = sk_head(&tcp_listening_hash[0]);
+		sk = sk_head(&tcp_listening_hash[st->bucket]);
+		st->offset = 0;
 		goto get_sk;
 	}
 
 	++st->num;
+	++st->offset;
 
 	if (st->state == TCP_SEQ_STATE_OPENREQ) {
 		struct open_request *req = cur;
@@ -2187,6 +2260,7 @@ start_req:
 		}
 		read_unlock_bh(&tp->syn_wait_lock);
 	}
+	st->offset = 0;
 	if (++st->bucket < TCP_LHTABLE_SIZE) {
 		sk = sk_head(&tcp_listening_hash[st->bucket]);
 		goto get_sk;
@@ -2198,7 +2272,11 @@ out:
 
 static void *listening_get_idx(struct seq_file *seq, loff_t *pos)
 {
-	void *rc = listening_get_next(seq, NULL);
+	struct tcp_iter_state* st = seq->private;
+	void *rc;
+
+	st->bucket = 0;
+	rc = listening_get_next(seq, NULL);
 
 	while (rc && *pos) {
 		rc = listening_get_next(seq, rc);
@@ -2212,7 +2290,8 @@ static void *established_get_first(struct seq_file *seq)
 	struct tcp_iter_state* st = seq->private;
 	void *rc = NULL;
 
-	for (st->bucket = 0; st->bucket < tcp_ehash_size; ++st->bucket) {
+	st->offset = 0;
+	for (; st->bucket < tcp_ehash_size; ++st->bucket) {
 		struct sock *sk;
 		struct hlist_node *node;
 		struct tcp_tw_bucket *tw;
@@ -2252,6 +2331,7 @@ static void *established_get_next(struct seq_file *seq, void *cur)
 	struct tcp_iter_state* st = seq->private;
 
 	++st->num;
+	++st->offset;
 
 	if (st->state == TCP_SEQ_STATE_TIME_WAIT) {
 		tw = cur;
@@ -2270,6 +2350,7 @@ get_tw:
 		/* We can reschedule between buckets: */
 		cond_resched_softirq();
 
+		st->offset = 0;
 		if (++st->bucket < tcp_ehash_size) {
 			read_lock(&tcp_ehash[st->bucket].lock);
 			sk = sk_head(&tcp_ehash[st->bucket].chain);
@@ -2296,7 +2377,11 @@ out:
 
 static void *established_get_idx(struct seq_file *seq, loff_t pos)
 {
-	void *rc = established_get_first(seq);
+	struct tcp_iter_state* st = seq->private;
+	void *rc;
+
+	st->bucket = 0;
+	rc = established_get_first(seq);
 
 	while (rc && pos) {
 		rc = established_get_next(seq, rc);
@@ -2324,12 +2409,83 @@ static void *tcp_get_idx(struct seq_file *seq, loff_t pos)
 	return rc;
 }
 
+/*
+ * Find the entry at st->last_pos again, from its bucket and offset in it,
+ * rather than walk the tables from the start: with many sockets each read
+ * of /proc/net/tcp would cost as much as the whole file so far.  Sockets
+ * come and go meanwhile, so it is only the entry at that offset now.
+ * Takes the locks tcp_seq_stop() expects for st->state.
+ */
+static void *tcp_seek_last_pos(struct seq_file *seq)
+{
+	struct tcp_iter_state* st = seq->private;
+	int offset = st->offset;
+	int orig_num = st->num;
+	void *rc = NULL;
+
+	switch (st->state) {
+	case TCP_SEQ_STATE_OPENREQ:
+	case TCP_SEQ_STATE_LISTENING:
+		tcp_listen_lock();
+		st->state = TCP_SEQ_STATE_LISTENING;
+		if (st->bucket < TCP_LHTABLE_SIZE) {
+			rc = listening_get_next(seq, NULL);
+			while (offset-- && rc)
+				rc = listening_get_next(seq, rc);
+			if (rc)
+				break;
+		}
+		tcp_listen_unlock();
+		st->bucket = 0;
+		offset = 0;
+		/* fall through */
+	case TCP_SEQ_STATE_ESTABLISHED:
+	case TCP_SEQ_STATE_TIME_WAIT:
+		local_bh_disable();
+		st->state = TCP_SEQ_STATE_ESTABLISHED;
+		if (st->bucket < tcp_ehash_size) {
+			rc = established_get_first(seq);
+			while (offset-- && rc)
+				rc = established_get_next(seq, rc);
+		}
+		break;
+	}
+
+	st->num = orig_num;
+	return rc;
+}
+
+static void *tcp_seq_next(struct seq_file *seq, void *v, loff_t *pos);
+static void tcp_seq_stop(struct seq_file *seq, void *v);
+
 static void *tcp_seq_start(struct seq_file *seq, loff_t *pos)
 {
 	struct tcp_iter_state* st = seq->private;
+	void *rc;
+
+	/*
+	 * seq_read() starts again either at the entry which did not fit
+	 * in the last read, or at the one after it.
+	 */
+	if (*pos && st->last_pos &&
+	    (*pos == st->last_pos || *pos == st->last_pos + 1)) {
+		loff_t last = st->last_pos;
+
+		rc = tcp_seek_last_pos(seq);
+		if (rc) {
+			if (last < *pos)
+				rc = tcp_seq_next(seq, rc, &last);
+			goto out;
+		}
+		tcp_seq_stop(seq, NULL);
+	}
+
 	st->state = TCP_SEQ_STATE_LISTENING;
 	st->num = 0;
-	return *pos ? tcp_get_idx(seq, *pos - 1) : SEQ_START_TOKEN;
+	rc = *pos ? tcp_get_idx(seq, *pos - 1) : SEQ_START_TOKEN;
+out:
+	st->last_pos = *pos;
+	return rc;
 }
 
 static void *tcp_seq_next(struct seq_file *seq, void *v, loff_t *pos)
@@ -2351,6 +2507,7 @@ static void *tcp_seq_next(struct seq_file *seq, void *v, loff_t *pos)
 			tcp_listen_unlock();
 			local_bh_disable();
 			st->state = TCP_SEQ_STATE_ESTABLISHED;
+			st->bucket = 0;
 			rc	  = established_get_first(seq);
 		}
 		break;
@@ -2361,6 +2518,8 @@ static void *tcp_seq_next(struct seq_file *seq, void *v, loff_t *pos)
 	}
 out:
 	++*pos;
+	st = seq->private;
+	st->last_pos = *pos;
 	return rc;
 }
 
@@ -2615,6 +2774,7 @@ struct proto tcp_prot = {
 	.sysctl_rmem		= sysctl_tcp_rmem,
 	.max_header		= MAX_TCP_HEADER,
 	.obj_size		= sizeof(struct tcp_sock),
+	.slab_flags		= SLAB_DESTROY_BY_RCU,
 };
 
 
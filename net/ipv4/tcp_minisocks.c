@@ -317,7 +317,7 @@ static void __tcp_tw_hashdance(struct sock *sk, struct tcp_tw_bucket *tw)
 		sock_prot_dec_use(sk->sk_prot);
 
 	/* Step 3: Hash TW into TIMEWAIT half of established hash table. */
-	tw_add_node(tw, &(ehead + tcp_ehash_size)->chain);
+	tw_add_node_rcu(tw, &(ehead + tcp_ehash_size)->chain);
 	atomic_inc(&tw->tw_refcnt);
 
 	write_unlock(&ehead->lock);
@@ -354,7 +354,6 @@ void tcp_time_wait(struct sock *sk, int state, int timeo)
 		tw->tw_family		= sk->sk_family;
 		tw->tw_reuse		= sk->sk_reuse;
 		tw->tw_rcv_wscale	= tp->rx_opt.rcv_wscale;
-		atomic_set(&tw->tw_refcnt, 1);
 
 		tw->tw_hashent		= sk->sk_hashent;
 		tw->tw_rcv_nxt		= tp->rcv_nxt;
@@ -377,6 +376,13 @@ void tcp_time_wait(struct sock *sk, int state, int timeo)
 			tw->tw_v6_ipv6only = 0;
 		}
 #endif
+		/* Lockless lookups may still see the previous user of
+		 * this bucket, its refcnt must stay zero until the new
+		 * identity is complete.
+		 */
+		smp_wmb();
+		atomic_set(&tw->tw_refcnt, 1);
+
 		/* Linkage updates. */
 		__tcp_tw_hashdance(sk, tw);
 
@@ -695,7 +701,14 @@ struct sock *tcp_create_openreq_child(struct sock *sk, struct open_request *req,
 		struct tcp_sock *newtp;
 		struct sk_filter *filter;
 
-		memcpy(newsk, sk, sizeof(struct tcp_sock));
+		/* Do not copy the refcnt, a lockless lookup may have
+		 * found the previous incarnation of newsk and must not
+		 * be able to grab it before it is set up below.
+		 */
+		memcpy(newsk, sk, offsetof(struct sock, sk_refcnt));
+		memcpy(&newsk->sk_refcnt + 1, &sk->sk_refcnt + 1,
+		       sizeof(struct tcp_sock) -
+		       offsetof(struct sock, sk_refcnt) - sizeof(atomic_t));
 		newsk->sk_state = TCP_SYN_RECV;
 
 		/* SANITY */
@@ -772,6 +785,12 @@ struct sock *tcp_create_openreq_child(struct sock *sk, struct open_request *req,
 		newtp->frto_counter = 0;
 		newtp->frto_highmark = 0;
 
+		/* Keep the listener's congestion control, if it chose one,
+		 * with a module reference of our own.
+		 */
+		if (!try_module_get(newtp->ca_ops->owner))
+			newtp->ca_ops = &tcp_init_congestion_ops;
+
 		tcp_set_ca_state(newtp, TCP_CA_Open);
 		tcp_init_xmit_timers(newsk);
 		skb_queue_head_init(&newtp->out_of_order_queue);
@@ -796,6 +815,7 @@ struct sock *tcp_create_openreq_child(struct sock *sk, struct open_request *req,
 		/* Back to base struct sock members. */
 		newsk->sk_err = 0;
 		newsk->sk_priority = 0;
+		smp_wmb();
 		atomic_set(&newsk->sk_refcnt, 2);
 #ifdef INET_REFCNT_DEBUG
 		atomic_inc(&inet_sock_nr);
@@ -842,7 +862,7 @@ struct sock *tcp_create_openreq_child(struct sock *sk, struct open_request *req,
 		if (newtp->ecn_flags&TCP_ECN_OK)
 			sock_set_flag(newsk, SOCK_NO_LARGESEND);
 
-		tcp_ca_init(newtp);
+		tcp_init_congestion_control(newtp);
 
 		TCP_INC_STATS_BH(TCP_MIB_PASSIVEOPENS);
 	}
@@ -115,6 +115,7 @@
 DEFINE_SNMP_STAT(struct udp_mib, udp_statistics);
 
 struct hlist_head udp_hash[UDP_HTABLE_SIZE];
+struct hlist_head udp_hash2[UDP_HASH2_SIZE];
 DEFINE_RWLOCK(udp_hash_lock);
 
 /* Shared by v4/v6 udp. */
@@ -188,9 +189,7 @@ gotit:
 	}
 	inet->num = snum;
 	if (sk_unhashed(sk)) {
-		struct hlist_head *h = &udp_hash[snum & (UDP_HTABLE_SIZE - 1)];
-
-		sk_add_node(sk, h);
+		udp_hash_add(sk);
 		sock_prot_inc_use(sk->sk_prot);
 	}
 	write_unlock_bh(&udp_hash_lock);
@@ -209,57 +208,77 @@ static void udp_v4_hash(struct sock *sk)
 static void udp_v4_unhash(struct sock *sk)
 {
 	write_lock_bh(&udp_hash_lock);
-	if (sk_del_node_init(sk)) {
+	if (udp_hash_del(sk)) {
 		inet_sk(sk)->num = 0;
 		sock_prot_dec_use(sk->sk_prot);
 	}
 	write_unlock_bh(&udp_hash_lock);
 }
 
+/* How well @sk fits the datagram, -1 if not at all */
+static inline int udp_v4_score(struct sock *sk, unsigned short hnum,
+			       u32 saddr, u16 sport, u32 daddr, int dif)
+{
+	struct inet_sock *inet = inet_sk(sk);
+	int score;
+
+	if (inet->num != hnum || ipv6_only_sock(sk))
+		return -1;
+	score = (sk->sk_family == PF_INET ? 1 : 0);
+	if (inet->rcv_saddr) {
+		if (inet->rcv_saddr != daddr)
+			return -1;
+		score+=2;
+	}
+	if (inet->daddr) {
+		if (inet->daddr != saddr)
+			return -1;
+		score+=2;
+	}
+	if (inet->dport) {
+		if (inet->dport != sport)
+			return -1;
+		score+=2;
+	}
+	if (sk->sk_bound_dev_if) {
+		if (sk->sk_bound_dev_if != dif)
+			return -1;
+		score+=2;
+	}
+	return score;
+}
+
 /* UDP is nearly always wildcards out the wazoo, it makes no sense to try
  * harder than this. -DaveM
+ *
+ * Only the sockets hashed on the destination address and on INADDR_ANY
+ * can match, so those two chains are all there is to look at, however
+ * many addresses the port is bound to.
  */
 static struct sock *udp_v4_lookup_longway(u32 saddr, u16 sport,
 					  u32 daddr, u16 dport, int dif)
 {
 	struct sock *sk, *result = NULL;
 	struct hlist_node *node;
+	struct hlist_head *slot, *any;
 	unsigned short hnum = ntohs(dport);
-	int badness = -1;
-
-	sk_for_each(sk, node, &udp_hash[hnum & (UDP_HTABLE_SIZE - 1)]) {
-		struct inet_sock *inet = inet_sk(sk);
-
-		if (inet->num == hnum && !ipv6_only_sock(sk)) {
-			int score = (sk->sk_family == PF_INET ? 1 : 0);
-			if (inet->rcv_saddr) {
-				if (inet->rcv_saddr != daddr)
-					continue;
-				score+=2;
-			}
-			if (inet->daddr) {
-				if (inet->daddr != saddr)
-					continue;
-				score+=2;
-			}
-			if (inet->dport) {
-				if (inet->dport != sport)
-					continue;
-				score+=2;
-			}
-			if (sk->sk_bound_dev_if) {
-				if (sk->sk_bound_dev_if != dif)
-					continue;
-				score+=2;
-			}
-			if(score == 9) {
-				result = sk;
-				break;
-			} else if(score > badness) {
+	int badness = -1, score;
+
+	slot = udp_hash2_slot(daddr, hnum);
+	any = udp_hash2_slot(0, hnum);
+	for (;;) {
+		sk_for_each_bound(sk, node, slot) {
+			score = udp_v4_score(sk, hnum, saddr, sport, daddr, dif);
+			if (score == 9)
+				return sk;
+			if (score > badness) {
 				result = sk;
 				badness = score;
 			}
 		}
+		if (slot == any)
+			break;
+		slot = any;
 	}
 	return result;
 }
@@ -1382,7 +1401,8 @@ static struct sock *udp_get_first(struct seq_file *seq)
 	struct sock *sk;
 	struct udp_iter_state *state = seq->private;
 
-	for (state->bucket = 0; state->bucket < UDP_HTABLE_SIZE; ++state->bucket) {
+	state->offset = 0;
+	for (; state->bucket < UDP_HTABLE_SIZE; ++state->bucket) {
 		struct hlist_node *node;
 		sk_for_each(sk, node, &udp_hash[state->bucket]) {
 			if (sk->sk_family == state->family)
@@ -1398,6 +1418,7 @@ static struct sock *udp_get_next(struct seq_file *seq, struct sock *sk)
 {
 	struct udp_iter_state *state = seq->private;
 
+	++state->offset;
 	do {
 		sk = sk_next(sk);
 try_again:
@@ -1405,6 +1426,7 @@ try_again:
 	} while (sk && sk->sk_family != state->family);
 
 	if (!sk && ++state->bucket < UDP_HTABLE_SIZE) {
+		state->offset = 0;
 		sk = sk_head(&udp_hash[state->bucket]);
 		goto try_again;
 	}
@@ -1413,7 +1435,11 @@ try_again:
 
 static struct sock *udp_get_idx(struct seq_file *seq, loff_t pos)
 {
-	struct sock *sk = udp_get_first(seq);
+	struct udp_iter_state *state = seq->private;
+	struct sock *sk;
+
+	state->bucket = 0;
+	sk = udp_get_first(seq);
 
 	if (sk)
 		while(pos && (sk = udp_get_next(seq, sk)) != NULL)
@@ -1421,14 +1447,49 @@ static struct sock *udp_get_idx(struct seq_file *seq, loff_t pos)
 	return pos ? NULL : sk;
 }
 
+/*
+ * The entry a read stopped at, found from its bucket and offset in it as
+ * for /proc/net/tcp, instead of from the start of the table each time.
+ */
+static struct sock *udp_seek_last_pos(struct seq_file *seq)
+{
+	struct udp_iter_state *state = seq->private;
+	int offset = state->offset;
+	struct sock *sk;
+
+	if (state->bucket >= UDP_HTABLE_SIZE)
+		return NULL;
+	sk = udp_get_first(seq);
+	while (offset-- && sk)
+		sk = udp_get_next(seq, sk);
+	return sk;
+}
+
+static void *udp_seq_next(struct seq_file *seq, void *v, loff_t *pos);
+
 static void *udp_seq_start(struct seq_file *seq, loff_t *pos)
 {
+	struct udp_iter_state *state = seq->private;
+	void *rc = NULL;
+
 	read_lock(&udp_hash_lock);
-	return *pos ? udp_get_idx(seq, *pos-1) : (void *)1;
+	if (*pos && state->last_pos &&
+	    (*pos == state->last_pos || *pos == state->last_pos + 1)) {
+		loff_t last = state->last_pos;
+
+		rc = udp_seek_last_pos(seq);
+		if (rc && last < *pos)
+			rc = udp_seq_next(seq, rc, &last);
+	}
+	if (!rc)
+		rc = *pos ? udp_get_idx(seq, *pos-1) : (void *)1;
+	state->last_pos = *pos;
+	return rc;
 }
 
 static void *udp_seq_next(struct seq_file *seq, void *v, loff_t *pos)
 {
+	struct udp_iter_state *state = seq->private;
 	struct sock *sk;
 
 	if (v == (void *)1)
@@ -1437,6 +1498,7 @@ static void *udp_seq_next(struct seq_file *seq, void *v, loff_t *pos)
 		sk = udp_get_next(seq, v);
 
 	++*pos;
+	state->last_pos = *pos;
 	return sk;
 }
 
@@ -1562,6 +1624,7 @@ void udp4_proc_exit(void)
 
 EXPORT_SYMBOL(udp_disconnect);
 EXPORT_SYMBOL(udp_hash);
+EXPORT_SYMBOL(udp_hash2);
 EXPORT_SYMBOL(udp_hash_lock);
 EXPORT_SYMBOL(udp_ioctl);
 EXPORT_SYMBOL(udp_port_rover);
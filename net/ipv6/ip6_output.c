@@ -147,7 +147,8 @@ static int ip6_output2(struct sk_buff *skb)
 
 int ip6_output(struct sk_buff *skb)
 {
-	if (skb->len > dst_mtu(skb->dst) || dst_allfrag(skb->dst))
+	if ((skb->len > dst_mtu(skb->dst) && !skb_shinfo(skb)->tso_size) ||
+	    dst_allfrag(skb->dst))
 		return ip6_fragment(skb, ip6_output2);
 	else
 		return ip6_output2(skb);
@@ -264,7 +265,7 @@ int ip6_xmit(struct sock *sk, struct sk_buff *skb, struct flowi *fl,
 	ipv6_addr_copy(&hdr->daddr, first_hop);
 
 	mtu = dst_mtu(dst);
-	if ((skb->len <= mtu) || ipfragok) {
+	if ((skb->len <= mtu) || ipfragok || skb_shinfo(skb)->tso_size) {
 		IP6_INC_STATS(IPSTATS_MIB_OUTREQUESTS);
 		return NF_HOOK(PF_INET6, NF_IP6_LOCAL_OUT, skb, NULL, dst->dev, ip6_maybe_reroute);
 	}
@@ -897,6 +898,12 @@ int ip6_append_data(struct sock *sk, int getfrag(void *from, char *to, int offse
 	 * --yoshfuji 
 	 */
 
+	if (transhdrlen && sk->sk_protocol == IPPROTO_UDP &&
+	    length + fragheaderlen <= mtu &&
+	    rt->u.dst.dev->features & (NETIF_F_NO_CSUM | NETIF_F_HW_CSUM) &&
+	    !exthdrlen && !(inet->cork.flags & IPCORK_ALLFRAG))
+		csummode = CHECKSUM_HW;
+
 	inet->cork.length += length;
 
 	if ((skb = skb_peek_tail(&sk->sk_write_queue)) == NULL)
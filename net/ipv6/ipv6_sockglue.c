@@ -57,9 +57,48 @@
 
 DEFINE_SNMP_STAT(struct ipstats_mib, ipv6_statistics);
 
+/*
+ *	Software segmentation of a large send.  TCP only hands us one
+ *	when there are no extension headers, so the upper layer header
+ *	directly follows the fixed one.
+ */
+static struct sk_buff *ipv6_gso_segment(struct sk_buff *skb, int features)
+{
+	struct sk_buff *segs = ERR_PTR(-EINVAL);
+	struct ipv6hdr *ipv6h;
+	struct inet6_protocol *ops;
+
+	if (!pskb_may_pull(skb, sizeof(*ipv6h)))
+		goto out;
+
+	ipv6h = skb->nh.ipv6h;
+	skb->h.raw = __skb_pull(skb, sizeof(*ipv6h));
+	segs = ERR_PTR(-EPROTONOSUPPORT);
+
+	rcu_read_lock();
+	ops = rcu_dereference(inet6_protos[ipv6h->nexthdr &
+					   (MAX_INET_PROTOS - 1)]);
+	if (ops && ops->gso_segment)
+		segs = ops->gso_segment(skb, features);
+	rcu_read_unlock();
+
+	if (IS_ERR(segs))
+		goto out;
+
+	for (skb = segs; skb; skb = skb->next) {
+		ipv6h = skb->nh.ipv6h;
+		ipv6h->payload_len = htons(skb->len - skb->mac_len -
+					   sizeof(*ipv6h));
+	}
+
+out:
+	return segs;
+}
+
 static struct packet_type ipv6_packet_type = {
 	.type = __constant_htons(ETH_P_IPV6), 
 	.func = ipv6_rcv,
+	.gso_segment = ipv6_gso_segment,
 };
 
 struct ip6_ra_chain *ip6_ra_chain;
@@ -112,6 +112,7 @@ static inline int tcp_v6_bind_conflict(struct sock *sk,
 		     sk->sk_bound_dev_if == sk2->sk_bound_dev_if) &&
 		    (!sk->sk_reuse || !sk2->sk_reuse ||
 		     sk2->sk_state == TCP_LISTEN) &&
+		    !tcp_reuseport_ok(sk, sk2) &&
 		     ipv6_rcv_saddr_equal(sk, sk2))
 			break;
 	}
@@ -226,7 +227,7 @@ static __inline__ void __tcp_v6_hash(struct sock *sk)
 		write_lock(lock);
 	}
 
-	__sk_add_node(sk, list);
+	__sk_add_node_rcu(sk, list);
 	sock_prot_inc_use(sk->sk_prot);
 	write_unlock(lock);
 }
@@ -247,16 +248,20 @@ static void tcp_v6_hash(struct sock *sk)
 	}
 }
 
-static struct sock *tcp_v6_lookup_listener(struct in6_addr *daddr, unsigned short hnum, int dif)
+static struct sock *__tcp_v6_lookup_listener(struct hlist_head *head,
+					     struct in6_addr *saddr, u16 sport,
+					     struct in6_addr *daddr,
+					     unsigned short hnum, int dif)
 {
 	struct sock *sk;
 	struct hlist_node *node;
 	struct sock *result = NULL;
 	int score, hiscore;
+	unsigned int matches = 0;
+	u32 phash = 0;
 
 	hiscore=0;
-	read_lock(&tcp_lhash_lock);
-	sk_for_each(sk, node, &tcp_listening_hash[tcp_lhashfn(hnum)]) {
+	sk_for_each_rcu(sk, node, head) {
 		if (inet_sk(sk)->num == hnum && sk->sk_family == PF_INET6) {
 			struct ipv6_pinfo *np = inet6_sk(sk);
 			
@@ -271,22 +276,76 @@ static struct sock *tcp_v6_lookup_listener(struct in6_addr *daddr, unsigned shor
 					continue;
 				score++;
 			}
-			if (score == 3) {
+			if (score == 3 && !sock_flag(sk, SOCK_REUSEPORT)) {
 				result = sk;
 				break;
 			}
 			if (score > hiscore) {
 				hiscore = score;
 				result = sk;
+				matches = sock_flag(sk, SOCK_REUSEPORT);
+				if (matches)
+					phash = jhash_3words(saddr->s6_addr32[3],
+							     daddr->s6_addr32[3],
+							     (u32)sport << 16 | hnum,
+							     saddr->s6_addr32[2]);
+			} else if (score == hiscore && matches &&
+				   sock_flag(sk, SOCK_REUSEPORT)) {
+				if (tcp_reuseport_select(&phash, ++matches))
+					result = sk;
 			}
 		}
 	}
-	if (result)
-		sock_hold(result);
-	read_unlock(&tcp_lhash_lock);
 	return result;
 }
 
+static struct sock *tcp_v6_lookup_listener(struct in6_addr *saddr, u16 sport,
+					   struct in6_addr *daddr,
+					   unsigned short hnum, int dif)
+{
+	struct hlist_head *head = &tcp_listening_hash[tcp_lhashfn(hnum)];
+	struct sock *sk;
+
+#ifdef SOCK_LOCKLESS_LOOKUP
+	rcu_read_lock();
+	sk = __tcp_v6_lookup_listener(head, saddr, sport, daddr, hnum, dif);
+	if (sk && sock_hold_not_zero(sk)) {
+		struct ipv6_pinfo *np = inet6_sk(sk);
+
+		if (likely(sk->sk_state == TCP_LISTEN &&
+			   sk->sk_family == PF_INET6 &&
+			   inet_sk(sk)->num == hnum &&
+			   (ipv6_addr_any(&np->rcv_saddr) ||
+			    ipv6_addr_equal(&np->rcv_saddr, daddr)) &&
+			   (!sk->sk_bound_dev_if || sk->sk_bound_dev_if == dif))) {
+			rcu_read_unlock();
+			return sk;
+		}
+		sock_put(sk);
+	}
+	rcu_read_unlock();
+#endif
+	read_lock(&tcp_lhash_lock);
+	sk = __tcp_v6_lookup_listener(head, saddr, sport, daddr, hnum, dif);
+	if (sk)
+		sock_hold(sk);
+	read_unlock(&tcp_lhash_lock);
+	return sk;
+}
+
+static inline int tcp_v6_tw_match(struct sock *sk, struct in6_addr *saddr,
+				  struct in6_addr *daddr, __u32 ports, int dif)
+{
+	/* FIXME: acme: check this... */
+	struct tcp_tw_bucket *tw = (struct tcp_tw_bucket *)sk;
+
+	return *((__u32 *)&(tw->tw_dport)) == ports		&&
+	       sk->sk_family			== PF_INET6	&&
+	       ipv6_addr_equal(&tw->tw_v6_daddr, saddr)		&&
+	       ipv6_addr_equal(&tw->tw_v6_rcv_saddr, daddr)	&&
+	       (!sk->sk_bound_dev_if || sk->sk_bound_dev_if == dif);
+}
+
 /* Sockets in TCP_CLOSE state are _always_ taken out of the hash, so
  * we need not check it for TCP lookups anymore, thanks Alexey. -DaveM
  *
@@ -308,6 +367,34 @@ static inline struct sock *__tcp_v6_lookup_established(struct in6_addr *saddr, u
 	 */
 	hash = tcp_v6_hashfn(daddr, hnum, saddr, sport);
 	head = &tcp_ehash[hash];
+#ifdef SOCK_LOCKLESS_LOOKUP
+	/* Same as in IPv4: trust a hit on a socket we managed to grab,
+	 * confirm misses under the lock.
+	 */
+	rcu_read_lock();
+	sk_for_each_rcu(sk, node, &head->chain) {
+		if(TCP_IPV6_MATCH(sk, saddr, daddr, ports, dif)) {
+			if (!sock_hold_not_zero(sk))
+				goto slow;
+			if (likely(TCP_IPV6_MATCH(sk, saddr, daddr, ports, dif)))
+				goto fast_hit;
+			sock_put(sk);
+			goto slow;
+		}
+	}
+	sk_for_each_rcu(sk, node, &(head + tcp_ehash_size)->chain) {
+		if (tcp_v6_tw_match(sk, saddr, daddr, ports, dif)) {
+			if (!sock_hold_not_zero(sk))
+				goto slow;
+			if (likely(tcp_v6_tw_match(sk, saddr, daddr, ports, dif)))
+				goto fast_hit;
+			tcp_tw_put(tcptw_sk(sk));
+			goto slow;
+		}
+	}
+slow:
+	rcu_read_unlock();
+#endif
 	read_lock(&head->lock);
 	sk_for_each(sk, node, &head->chain) {
 		/* For IPV6 do the cheaper port and family tests first. */
@@ -316,16 +403,8 @@ static inline struct sock *__tcp_v6_lookup_established(struct in6_addr *saddr, u
 	}
 	/* Must check for a TIME_WAIT'er before going to listener hash. */
 	sk_for_each(sk, node, &(head + tcp_ehash_size)->chain) {
-		/* FIXME: acme: check this... */
-		struct tcp_tw_bucket *tw = (struct tcp_tw_bucket *)sk;
-
-		if(*((__u32 *)&(tw->tw_dport))	== ports	&&
-		   sk->sk_family		== PF_INET6) {
-			if(ipv6_addr_equal(&tw->tw_v6_daddr, saddr)	&&
-			   ipv6_addr_equal(&tw->tw_v6_rcv_saddr, daddr)	&&
-			   (!sk->sk_bound_dev_if || sk->sk_bound_dev_if == dif))
-				goto hit;
-		}
+		if (tcp_v6_tw_match(sk, saddr, daddr, ports, dif))
+			goto hit;
 	}
 	read_unlock(&head->lock);
 	return NULL;
@@ -334,6 +413,11 @@ hit:
 	sock_hold(sk);
 	read_unlock(&head->lock);
 	return sk;
+#ifdef SOCK_LOCKLESS_LOOKUP
+fast_hit:
+	rcu_read_unlock();
+	return sk;
+#endif
 }
 
 
@@ -348,7 +432,7 @@ static inline struct sock *__tcp_v6_lookup(struct in6_addr *saddr, u16 sport,
 	if (sk)
 		return sk;
 
-	return tcp_v6_lookup_listener(daddr, hnum, dif);
+	return tcp_v6_lookup_listener(saddr, sport, daddr, hnum, dif);
 }
 
 inline struct sock *tcp_v6_lookup(struct in6_addr *saddr, u16 sport,
@@ -495,7 +579,7 @@ static int __tcp_v6_check_established(struct sock *sk, __u16 lport,
 
 unique:
 	BUG_TRAP(sk_unhashed(sk));
-	__sk_add_node(sk, &head->chain);
+	__sk_add_node_rcu(sk, &head->chain);
 	sk->sk_hashent = hash;
 	sock_prot_inc_use(sk->sk_prot);
 	write_unlock(&head->lock);
@@ -626,6 +710,22 @@ static __inline__ int tcp_v6_iif(struct sk_buff *skb)
 	return IP6CB(skb)->iif;
 }
 
+/*
+ * Devices only do TSO for IPv4, so large sends always go through the
+ * software segmentation path.  Extension headers would end up in every
+ * segment and change the pseudo header, leave those sockets alone.
+ */
+static inline void tcp_v6_setup_caps(struct sock *sk, struct dst_entry *dst)
+{
+	sk->sk_route_caps = dst->dev->features &
+		~(NETIF_F_IP_CSUM | NETIF_F_TSO);
+	if ((sk->sk_route_caps & NETIF_F_GSO) &&
+	    !sock_flag(sk, SOCK_NO_LARGESEND) && !dst->header_len &&
+	    !inet6_sk(sk)->opt)
+		sk->sk_route_caps |= NETIF_F_TSO | NETIF_F_SG |
+				     NETIF_F_HW_CSUM;
+}
+
 static int tcp_v6_connect(struct sock *sk, struct sockaddr *uaddr, 
 			  int addr_len)
 {
@@ -776,8 +876,7 @@ static int tcp_v6_connect(struct sock *sk, struct sockaddr *uaddr,
 	inet->rcv_saddr = LOOPBACK4_IPV6;
 
 	ip6_dst_store(sk, dst, NULL);
-	sk->sk_route_caps = dst->dev->features &
-		~(NETIF_F_IP_CSUM | NETIF_F_TSO);
+	tcp_v6_setup_caps(sk, dst);
 
 	tp->ext_header_len = 0;
 	if (np->opt)
@@ -1467,8 +1566,6 @@ static struct sock * tcp_v6_syn_recv_sock(struct sock *sk, struct sk_buff *skb,
 #endif
 
 	ip6_dst_store(newsk, dst, NULL);
-	newsk->sk_route_caps = dst->dev->features &
-		~(NETIF_F_IP_CSUM | NETIF_F_TSO);
 
 	newtcp6sk = (struct tcp6_sock *)newsk;
 	inet_sk(newsk)->pinet6 = &newtcp6sk->inet6;
@@ -1524,6 +1621,7 @@ static struct sock * tcp_v6_syn_recv_sock(struct sock *sk, struct sk_buff *skb,
 		newtp->ext_header_len = newnp->opt->opt_nflen +
 					newnp->opt->opt_flen;
 
+	tcp_v6_setup_caps(newsk, dst);
 	tcp_sync_mss(newsk, dst_mtu(dst));
 	newtp->advmss = dst_metric(dst, RTAX_ADVMSS);
 	tcp_initialize_rcv_mss(newsk);
@@ -1806,7 +1904,9 @@ do_time_wait:
 	{
 		struct sock *sk2;
 
-		sk2 = tcp_v6_lookup_listener(&skb->nh.ipv6h->daddr, ntohs(th->dest), tcp_v6_iif(skb));
+		sk2 = tcp_v6_lookup_listener(&skb->nh.ipv6h->saddr, th->source,
+					     &skb->nh.ipv6h->daddr,
+					     ntohs(th->dest), tcp_v6_iif(skb));
 		if (sk2 != NULL) {
 			tcp_tw_deschedule((struct tcp_tw_bucket *)sk);
 			tcp_tw_put((struct tcp_tw_bucket *)sk);
@@ -1869,8 +1969,7 @@ static int tcp_v6_rebuild_header(struct sock *sk)
 		}
 
 		ip6_dst_store(sk, dst, NULL);
-		sk->sk_route_caps = dst->dev->features &
-			~(NETIF_F_IP_CSUM | NETIF_F_TSO);
+		tcp_v6_setup_caps(sk, dst);
 	}
 
 	return 0;
@@ -1922,8 +2021,7 @@ static int tcp_v6_xmit(struct sk_buff *skb, int ipfragok)
 		}
 
 		ip6_dst_store(sk, dst, NULL);
-		sk->sk_route_caps = dst->dev->features &
-			~(NETIF_F_IP_CSUM | NETIF_F_TSO);
+		tcp_v6_setup_caps(sk, dst);
 	}
 
 	skb->dst = dst_clone(dst);
@@ -2021,6 +2119,7 @@ static int tcp_v6_init_sock(struct sock *sk)
 	tp->mss_cache_std = tp->mss_cache = 536;
 
 	tp->reordering = sysctl_tcp_reordering;
+	tp->ca_ops = &tcp_init_congestion_ops;
 
 	sk->sk_state = TCP_CLOSE;
 
@@ -2236,11 +2335,13 @@ struct proto tcpv6_prot = {
 	.sysctl_rmem		= sysctl_tcp_rmem,
 	.max_header		= MAX_TCP_HEADER,
 	.obj_size		= sizeof(struct tcp6_sock),
+	.slab_flags		= SLAB_DESTROY_BY_RCU,
 };
 
 static struct inet6_protocol tcpv6_protocol = {
 	.handler	=	tcp_v6_rcv,
 	.err_handler	=	tcp_v6_err,
+	.gso_segment	=	tcp_tso_segment,
 	.flags		=	INET6_PROTO_NOPOLICY|INET6_PROTO_FINAL,
 };
 
@@ -124,7 +124,7 @@ gotit:
 
 	inet_sk(sk)->num = snum;
 	if (sk_unhashed(sk)) {
-		sk_add_node(sk, &udp_hash[snum & (UDP_HTABLE_SIZE - 1)]);
+		udp_hash_add(sk);
 		sock_prot_inc_use(sk->sk_prot);
 	}
 	write_unlock_bh(&udp_hash_lock);
@@ -143,7 +143,7 @@ static void udp_v6_hash(struct sock *sk)
 static void udp_v6_unhash(struct sock *sk)
 {
  	write_lock_bh(&udp_hash_lock);
-	if (sk_del_node_init(sk)) {
+	if (udp_hash_del(sk)) {
 		inet_sk(sk)->num = 0;
 		sock_prot_dec_use(sk->sk_prot);
 	}
@@ -591,6 +591,13 @@ static int udp_v6_push_pending_frames(struct sock *sk, struct udp_sock *up)
 	}
 
 	if (skb_queue_len(&sk->sk_write_queue) == 1) {
+		if (skb->ip_summed == CHECKSUM_HW) {
+			skb->csum = offsetof(struct udphdr, check);
+			uh->check = ~csum_ipv6_magic(&fl->fl6_src,
+						     &fl->fl6_dst,
+						     up->len, fl->proto, 0);
+			goto send;
+		}
 		skb->csum = csum_partial((char *)uh,
 				sizeof(struct udphdr), skb->csum);
 		uh->check = csum_ipv6_magic(&fl->fl6_src,
@@ -599,11 +606,24 @@ static int udp_v6_push_pending_frames(struct sock *sk, struct udp_sock *up)
 	} else {
 		u32 tmp_csum = 0;
 
+		/*
+		 * Corked data spilled into more than one skb, the device
+		 * can't sum across them.  Fold the header into the first
+		 * skb's sum like the others.
+		 */
+		if (skb->ip_summed == CHECKSUM_HW) {
+			int offset = (unsigned char *)uh - skb->data;
+			skb->csum = skb_checksum(skb, offset,
+						 skb->len - offset, 0);
+			skb->ip_summed = CHECKSUM_NONE;
+		} else {
+			skb->csum = csum_partial((char *)uh,
+					sizeof(struct udphdr), skb->csum);
+		}
+
 		skb_queue_walk(&sk->sk_write_queue, skb) {
 			tmp_csum = csum_add(tmp_csum, skb->csum);
 		}
-		tmp_csum = csum_partial((char *)uh,
-				sizeof(struct udphdr), tmp_csum);
                 tmp_csum = csum_ipv6_magic(&fl->fl6_src,
 					   &fl->fl6_dst,
 					   up->len, fl->proto, tmp_csum);
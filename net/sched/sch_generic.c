@@ -72,7 +72,10 @@ void qdisc_unlock_tree(struct net_device *dev)
    dev->queue_lock serializes queue accesses for this device
    AND dev->qdisc pointer itself.
 
-   dev->xmit_lock serializes accesses to device driver.
+   dev->xmit_lock serializes accesses to device driver.  On a
+   NETIF_F_MULTI_QUEUE device the lock of the skb's hardware queue
+   is taken instead, and skbs may be handed to the driver without
+   dev->queue_lock while the default qdisc is empty.
 
    dev->queue_lock and dev->xmit_lock are mutually exclusive,
    if one is grabbed, another must be free.
@@ -95,9 +98,25 @@ int qdisc_restart(struct net_device *dev)
 	struct Qdisc *q = dev->qdisc;
 	struct sk_buff *skb;
 
-	/* Dequeue packet */
-	if ((skb = q->dequeue(q)) != NULL) {
+	/* Dequeue packet, finishing a partially sent GSO packet first */
+	if (((skb = dev->gso_skb)) || ((skb = q->dequeue(q)))) {
 		unsigned nolock = (dev->features & NETIF_F_LLTX);
+		spinlock_t *xmit_lock = &dev->xmit_lock;
+		int *xmit_lock_owner = &dev->xmit_lock_owner;
+
+		dev->gso_skb = NULL;
+
+		if (dev->features & NETIF_F_MULTI_QUEUE) {
+			struct net_device_subqueue *sq;
+
+			/* netif_wake_subqueue() reschedules us */
+			if (__netif_subqueue_stopped(dev, skb->queue_mapping))
+				goto requeue_stopped;
+			sq = &dev->egress_subqueue[skb->queue_mapping];
+			xmit_lock = &sq->xmit_lock;
+			xmit_lock_owner = &sq->xmit_lock_owner;
+		}
+
 		/*
 		 * When the driver has LLTX set it does its own locking
 		 * in start_xmit. No need to add additional overhead by
@@ -108,7 +127,7 @@ int qdisc_restart(struct net_device *dev)
 		 * will be requeued.
 		 */
 		if (!nolock) {
-			if (!spin_trylock(&dev->xmit_lock)) {
+			if (!spin_trylock(xmit_lock)) {
 			collision:
 				/* So, someone grabbed the driver. */
 				
@@ -117,7 +136,7 @@ int qdisc_restart(struct net_device *dev)
 				   it by checking xmit owner and drop the
 				   packet when deadloop is detected.
 				*/
-				if (dev->xmit_lock_owner == smp_processor_id()) {
+				if (*xmit_lock_owner == smp_processor_id()) {
 					kfree_skb(skb);
 					if (net_ratelimit())
 						printk(KERN_DEBUG "Dead loop on netdevice %s, fix it urgently!\n", dev->name);
@@ -127,23 +146,21 @@ int qdisc_restart(struct net_device *dev)
 				goto requeue;
 			}
 			/* Remember that the driver is grabbed by us. */
-			dev->xmit_lock_owner = smp_processor_id();
+			*xmit_lock_owner = smp_processor_id();
 		}
 		
 		{
 			/* And release queue */
 			spin_unlock(&dev->queue_lock);
 
-			if (!netif_queue_stopped(dev)) {
+			if (!netif_tx_stopped(dev, skb)) {
 				int ret;
-				if (netdev_nit)
-					dev_queue_xmit_nit(skb, dev);
 
-				ret = dev->hard_start_xmit(skb, dev);
+				ret = dev_hard_start_xmit(skb, dev);
 				if (ret == NETDEV_TX_OK) { 
 					if (!nolock) {
-						dev->xmit_lock_owner = -1;
-						spin_unlock(&dev->xmit_lock);
+						*xmit_lock_owner = -1;
+						spin_unlock(xmit_lock);
 					}
 					spin_lock(&dev->queue_lock);
 					return -1;
@@ -157,8 +174,8 @@ int qdisc_restart(struct net_device *dev)
 			/* NETDEV_TX_BUSY - we need to requeue */
 			/* Release the driver */
 			if (!nolock) { 
-				dev->xmit_lock_owner = -1;
-				spin_unlock(&dev->xmit_lock);
+				*xmit_lock_owner = -1;
+				spin_unlock(xmit_lock);
 			} 
 			spin_lock(&dev->queue_lock);
 			q = dev->qdisc;
@@ -175,9 +192,19 @@ int qdisc_restart(struct net_device *dev)
 		 */
 
 requeue:
-		q->ops->requeue(skb, q);
+		if (skb->next)
+			dev->gso_skb = skb;
+		else
+			q->ops->requeue(skb, q);
 		netif_schedule(dev);
 		return 1;
+
+requeue_stopped:
+		if (skb->next)
+			dev->gso_skb = skb;
+		else
+			q->ops->requeue(skb, q);
+		return 1;
 	}
 	return q->q.qlen;
 }
@@ -297,7 +324,7 @@ static struct Qdisc_ops noqueue_qdisc_ops = {
 static struct Qdisc noqueue_qdisc = {
 	.enqueue	=	NULL,
 	.dequeue	=	noop_dequeue,
-	.flags		=	TCQ_F_BUILTIN,
+	.flags		=	TCQ_F_BUILTIN | TCQ_F_CAN_BYPASS,
 	.ops		=	&noqueue_qdisc_ops,
 	.list		=	LIST_HEAD_INIT(noqueue_qdisc.list),
 };
@@ -528,6 +555,7 @@ void dev_activate(struct net_device *dev)
 				printk(KERN_INFO "%s: activation failed\n", dev->name);
 				return;
 			}
+			qdisc->flags |= TCQ_F_CAN_BYPASS;
 			write_lock_bh(&qdisc_tree_lock);
 			list_add_tail(&qdisc->list, &dev->qdisc_list);
 			write_unlock_bh(&qdisc_tree_lock);
@@ -551,6 +579,7 @@ void dev_activate(struct net_device *dev)
 void dev_deactivate(struct net_device *dev)
 {
 	struct Qdisc *qdisc;
+	struct sk_buff *skb;
 
 	spin_lock_bh(&dev->queue_lock);
 	qdisc = dev->qdisc;
@@ -558,14 +587,25 @@ void dev_deactivate(struct net_device *dev)
 
 	qdisc_reset(qdisc);
 
+	skb = dev->gso_skb;
+	dev->gso_skb = NULL;
 	spin_unlock_bh(&dev->queue_lock);
 
+	if (skb)
+		kfree_skb(skb);
+
 	dev_watchdog_down(dev);
 
 	while (test_bit(__LINK_STATE_SCHED, &dev->state))
 		yield();
 
 	spin_unlock_wait(&dev->xmit_lock);
+	if (dev->features & NETIF_F_MULTI_QUEUE) {
+		int i;
+
+		for (i = 0; i < dev->egress_subqueue_count; i++)
+			spin_unlock_wait(&dev->egress_subqueue[i].xmit_lock);
+	}
 }
 
 void dev_init_scheduler(struct net_device *dev)
@@ -55,6 +55,7 @@
 #include <net/sock.h>
 #include <net/pkt_sched.h>
 #include <linux/rbtree.h>
+#include <asm/div64.h>
 
 /* HTB algorithm.
     Author: devik@cdi.cz
@@ -200,6 +201,11 @@ struct htb_class
     long mbuffer;			/* max wait time */
     long tokens,ctokens;		/* current number of tokens */
     psched_time_t t_c;			/* checkpoint time */
+
+    /* rates above one byte per tick: ticks per byte, in 1/2^32 units,
+       and what the last charges left over below one tick; see htb_l2t */
+    u32 rate_mult,ceil_mult;
+    u32 rate_frac,ceil_frac;
 };
 
 /* TODO: maybe compute rate when size is too large .. or drop ? */
@@ -214,6 +220,37 @@ static __inline__ long L2T(struct htb_class *cl,struct qdisc_rate_table *rate,
     return rate->data[slot];
 }
 
+/* 2^32 times the ticks a byte takes at the rate of @rtab, or 0 when a
+   byte takes a tick or more and the table of tc is precise enough */
+static u32 htb_rate_mult(struct qdisc_rate_table *rtab)
+{
+	u64 tps = PSCHED_JIFFIE2US((u64)HZ);
+
+	if (rtab->rate.rate <= tps)
+		return 0;
+	tps <<= 32;
+	do_div(tps, rtab->rate.rate);
+	return tps;
+}
+
+/* Ticks to send size bytes.  Above one byte per tick the table rounds a
+   packet to whole ticks and clamps big ones to its last slot, so there
+   the time is computed from the rate instead, carrying the fraction of
+   a tick over to the next packet in *frac. */
+static inline long htb_l2t(struct htb_class *cl,struct qdisc_rate_table *rate,
+	u32 mult,u32 *frac,int size)
+{
+    u64 t;
+
+    if (!mult)
+	return L2T(cl,rate,size);
+    if (size < rate->rate.mpu)
+	size = rate->rate.mpu;
+    t = (u64)size * mult + *frac;
+    *frac = (u32)t;
+    return (long)(t >> 32);
+}
+
 struct htb_sched
 {
     struct list_head root;			/* root classes list */
@@ -318,7 +355,10 @@ static struct htb_class *htb_classify(struct sk_buff *skb, struct Qdisc *sch, in
 	   rules in it */
 	if (skb->priority == sch->handle)
 		return HTB_DIRECT;  /* X:0 (direct flow) selected */
-	if ((cl = htb_find(skb->priority,sch)) != NULL && cl->level == 0) 
+	/* only classids of ours can be found; with thousands of classes
+	   the hash chains are long, so do not walk one for every packet */
+	if (!TC_H_MAJ(skb->priority^sch->handle) &&
+	    (cl = htb_find(skb->priority,sch)) != NULL && cl->level == 0)
 		return cl;
 
 	*qerr = NET_XMIT_DROP;
@@ -829,7 +869,7 @@ static void htb_charge_class(struct htb_sched *q,struct htb_class *cl,
 
 #define HTB_ACCNT(T,B,R) toks = diff + cl->T; \
 	if (toks > cl->B) toks = cl->B; \
-	toks -= L2T(cl, cl->R, bytes); \
+	toks -= htb_l2t(cl, cl->R, cl->R##_mult, &cl->R##_frac, bytes); \
 	if (toks <= -cl->mbuffer) toks = 1-cl->mbuffer; \
 	cl->T = toks
 
@@ -1636,6 +1676,8 @@ static int htb_change_class(struct Qdisc *sch, u32 classid,
 	cl->cbuffer = hopt->cbuffer;
 	if (cl->rate) qdisc_put_rtab(cl->rate); cl->rate = rtab;
 	if (cl->ceil) qdisc_put_rtab(cl->ceil); cl->ceil = ctab;
+	cl->rate_mult = htb_rate_mult(rtab);
+	cl->ceil_mult = htb_rate_mult(ctab);
 	sch_tree_unlock(sch);
 
 	*arg = (unsigned long)cl;
@@ -81,6 +81,7 @@
 #include <linux/syscalls.h>
 #include <linux/compat.h>
 #include <linux/kmod.h>
+#include <linux/aio.h>
 
 #ifdef CONFIG_NET_RADIO
 #include <linux/wireless.h>		/* Note : will define WIRELESS_EXT */
@@ -629,11 +630,107 @@ int kernel_recvmsg(struct socket *sock, struct msghdr *msg,
 	return result;
 }
 
+/*
+ * Send size bytes of page from offset, without copying them where the
+ * protocol can help it.
+ */
+int kernel_sendpage(struct socket *sock, struct page *page, int offset,
+		    size_t size, int flags)
+{
+	if (sock->ops->sendpage)
+		return sock->ops->sendpage(sock, page, offset, size, flags);
+	return sock_no_sendpage(sock, page, offset, size, flags);
+}
+
 static void sock_aio_dtor(struct kiocb *iocb)
 {
 	kfree(iocb->private);
 }
 
+/*
+ *	Asynchronous kiocbs on TCP/IP sockets never block in the protocol.
+ *	When there is nothing to do the kiocb is put on the socket's wait
+ *	queue instead, and the next wakeup kicks it for a retry through
+ *	aio_wake_function().
+ */
+
+static inline int sock_aio_async(struct kiocb *iocb, struct socket *sock)
+{
+	int family = sock->sk->sk_family;
+
+	return !is_sync_kiocb(iocb) &&
+		(family == PF_INET || family == PF_INET6);
+}
+
+static ssize_t sock_aio_wait(struct kiocb *iocb, struct socket *sock,
+			     unsigned int mask)
+{
+	wait_queue_head_t *q = sock->sk->sk_sleep;
+	wait_queue_t *wait = &iocb->ki_wait.wait;
+	unsigned long flags;
+
+	/* The wait queue lock orders us against sock_aio_cancel() */
+	spin_lock_irqsave(&q->lock, flags);
+	if (kiocbIsCancelled(iocb)) {
+		spin_unlock_irqrestore(&q->lock, flags);
+		return -EINTR;
+	}
+	__add_wait_queue(q, wait);
+	spin_unlock_irqrestore(&q->lock, flags);
+
+	/* What we are waiting for may have come before we queued; if so
+	 * dequeue again and aio_run_iocb() retries at once.
+	 */
+	if (sock->ops->poll(iocb->ki_filp, sock, NULL) & mask) {
+		spin_lock_irqsave(&q->lock, flags);
+		list_del_init(&wait->task_list);
+		spin_unlock_irqrestore(&q->lock, flags);
+	}
+	return -EIOCBRETRY;
+}
+
+static int sock_aio_cancel(struct kiocb *iocb, struct io_event *res)
+{
+	struct socket *sock = SOCKET_I(iocb->ki_filp->f_dentry->d_inode);
+	wait_queue_head_t *q = sock->sk->sk_sleep;
+	wait_queue_t *wait = &iocb->ki_wait.wait;
+	unsigned long flags;
+	ssize_t done;
+	int queued;
+
+	spin_lock_irqsave(&q->lock, flags);
+	queued = !list_empty(&wait->task_list);
+	if (queued)
+		list_del_init(&wait->task_list);
+	spin_unlock_irqrestore(&q->lock, flags);
+
+	/* A waiting kiocb is kicked so that aio_run_iocb() finishes it off;
+	 * one that is being retried sees the cancel before it waits again.
+	 */
+	if (queued)
+		kick_iocb(iocb);
+
+	done = iocb->ki_nbytes - iocb->ki_left;
+	res->res = done ? done : -EINTR;
+	aio_put_req(iocb);
+	return 0;
+}
+
+static struct sock_iocb *sock_aio_alloc(struct kiocb *iocb)
+{
+	struct sock_iocb *x = iocb->private;
+
+	/* Retries of an asynchronous kiocb reuse the first allocation */
+	if (!x) {
+		x = kmalloc(sizeof(struct sock_iocb), GFP_KERNEL);
+		if (!x)
+			return NULL;
+		iocb->private = x;
+		iocb->ki_dtor = sock_aio_dtor;
+	}
+	return x;
+}
+
 /*
  *	Read data from a socket. ubuf is a user mode pointer. We make sure the user
  *	area ubuf...ubuf+size-1 is writable before asking the protocol.
@@ -644,7 +741,8 @@ static ssize_t sock_aio_read(struct kiocb *iocb, char __user *ubuf,
 {
 	struct sock_iocb *x, siocb;
 	struct socket *sock;
-	int flags;
+	int flags, async;
+	ssize_t ret;
 
 	if (pos != 0)
 		return -ESPIPE;
@@ -653,12 +751,8 @@ static ssize_t sock_aio_read(struct kiocb *iocb, char __user *ubuf,
 
 	if (is_sync_kiocb(iocb))
 		x = &siocb;
-	else {
-		x = kmalloc(sizeof(struct sock_iocb), GFP_KERNEL);
-		if (!x)
-			return -ENOMEM;
-		iocb->ki_dtor = sock_aio_dtor;
-	}
+	else if (!(x = sock_aio_alloc(iocb)))
+		return -ENOMEM;
 	iocb->private = x;
 	x->kiocb = iocb;
 	sock = SOCKET_I(iocb->ki_filp->f_dentry->d_inode); 
@@ -673,7 +767,16 @@ static ssize_t sock_aio_read(struct kiocb *iocb, char __user *ubuf,
 	x->async_iov.iov_len = size;
 	flags = !(iocb->ki_filp->f_flags & O_NONBLOCK) ? 0 : MSG_DONTWAIT;
 
-	return __sock_recvmsg(iocb, sock, &x->async_msg, size, flags);
+	async = sock_aio_async(iocb, sock);
+	if (async) {
+		iocb->ki_cancel = sock_aio_cancel;
+		flags |= MSG_DONTWAIT;
+	}
+	ret = __sock_recvmsg(iocb, sock, &x->async_msg, size, flags);
+	if (async && ret == -EAGAIN)
+		ret = sock_aio_wait(iocb, sock,
+				    POLLIN | POLLRDNORM | POLLERR | POLLHUP);
+	return ret;
 }
 
 
@@ -687,6 +790,8 @@ static ssize_t sock_aio_write(struct kiocb *iocb, const char __user *ubuf,
 {
 	struct sock_iocb *x, siocb;
 	struct socket *sock;
+	int async;
+	ssize_t ret;
 	
 	if (pos != 0)
 		return -ESPIPE;
@@ -695,12 +800,8 @@ static ssize_t sock_aio_write(struct kiocb *iocb, const char __user *ubuf,
 
 	if (is_sync_kiocb(iocb))
 		x = &siocb;
-	else {
-		x = kmalloc(sizeof(struct sock_iocb), GFP_KERNEL);
-		if (!x)
-			return -ENOMEM;
-		iocb->ki_dtor = sock_aio_dtor;
-	}
+	else if (!(x = sock_aio_alloc(iocb)))
+		return -ENOMEM;
 	iocb->private = x;
 	x->kiocb = iocb;
 	sock = SOCKET_I(iocb->ki_filp->f_dentry->d_inode); 
@@ -716,8 +817,17 @@ static ssize_t sock_aio_write(struct kiocb *iocb, const char __user *ubuf,
 		x->async_msg.msg_flags |= MSG_EOR;
 	x->async_iov.iov_base = (void __user *)ubuf;
 	x->async_iov.iov_len = size;
-	
-	return __sock_sendmsg(iocb, sock, &x->async_msg, size);
+
+	async = sock_aio_async(iocb, sock);
+	if (async) {
+		iocb->ki_cancel = sock_aio_cancel;
+		x->async_msg.msg_flags |= MSG_DONTWAIT;
+	}
+	ret = __sock_sendmsg(iocb, sock, &x->async_msg, size);
+	if (async && ret == -EAGAIN)
+		ret = sock_aio_wait(iocb, sock,
+				    POLLOUT | POLLWRNORM | POLLERR | POLLHUP);
+	return ret;
 }
 
 ssize_t sock_sendpage(struct file *file, struct page *page,
@@ -2086,3 +2196,4 @@ EXPORT_SYMBOL(sock_wake_async);
 EXPORT_SYMBOL(sockfd_lookup);
 EXPORT_SYMBOL(kernel_sendmsg);
 EXPORT_SYMBOL(kernel_recvmsg);
+EXPORT_SYMBOL(kernel_sendpage);
@@ -139,6 +139,9 @@ buf_to_sg(struct scatterlist *sg, char *ptr, int len) {
 	sg->length = len;
 }
 
+/* Scatterlist entries handed to the digest per crypto_digest_update(). */
+#define KRB5_CKSUM_SG	16
+
 /* checksum the plaintext data and hdrlen bytes of the token header */
 s32
 make_checksum(s32 cksumtype, char *header, int hdrlen, struct xdr_buf *body,
@@ -146,10 +149,10 @@ make_checksum(s32 cksumtype, char *header, int hdrlen, struct xdr_buf *body,
 {
 	char                            *cksumname;
 	struct crypto_tfm               *tfm = NULL; /* XXX add to ctx? */
-	struct scatterlist              sg[1];
+	struct scatterlist              sg[KRB5_CKSUM_SG];
 	u32                             code = GSS_S_FAILURE;
 	int				len, thislen, offset;
-	int				i;
+	int				i, n;
 
 	switch (cksumtype) {
 		case CKSUMTYPE_RSA_MD5:
@@ -166,13 +169,17 @@ make_checksum(s32 cksumtype, char *header, int hdrlen, struct xdr_buf *body,
 	if ((cksum->data = kmalloc(cksum->len, GFP_KERNEL)) == NULL)
 		goto out;
 
+	/*
+	 * The reply pages are digested where they are, a batch of
+	 * scatterlist entries at a time; the digest code maps each page
+	 * itself with kmap_atomic.
+	 */
 	crypto_digest_init(tfm);
-	buf_to_sg(sg, header, hdrlen);
-	crypto_digest_update(tfm, sg, 1);
-	if (body->head[0].iov_len) {
-		buf_to_sg(sg, body->head[0].iov_base, body->head[0].iov_len);
-		crypto_digest_update(tfm, sg, 1);
-	}
+	n = 0;
+	buf_to_sg(&sg[n++], header, hdrlen);
+	if (body->head[0].iov_len)
+		buf_to_sg(&sg[n++], body->head[0].iov_base,
+				body->head[0].iov_len);
 
 	len = body->page_len;
 	if (len != 0) {
@@ -182,12 +189,14 @@ make_checksum(s32 cksumtype, char *header, int hdrlen, struct xdr_buf *body,
 		do {
 			if (thislen > len)
 				thislen = len;
-			sg->page = body->pages[i];
-			sg->offset = offset;
-			sg->length = thislen;
-			kmap(sg->page); /* XXX kmap_atomic? */
-			crypto_digest_update(tfm, sg, 1);
-			kunmap(sg->page);
+			if (n == KRB5_CKSUM_SG) {
+				crypto_digest_update(tfm, sg, n);
+				n = 0;
+			}
+			sg[n].page = body->pages[i];
+			sg[n].offset = offset;
+			sg[n].length = thislen;
+			n++;
 			len -= thislen;
 			i++;
 			offset = 0;
@@ -195,9 +204,14 @@ make_checksum(s32 cksumtype, char *header, int hdrlen, struct xdr_buf *body,
 		} while(len != 0);
 	}
 	if (body->tail[0].iov_len) {
-		buf_to_sg(sg, body->tail[0].iov_base, body->tail[0].iov_len);
-		crypto_digest_update(tfm, sg, 1);
+		if (n == KRB5_CKSUM_SG) {
+			crypto_digest_update(tfm, sg, n);
+			n = 0;
+		}
+		buf_to_sg(&sg[n++], body->tail[0].iov_base,
+				body->tail[0].iov_len);
 	}
+	crypto_digest_update(tfm, sg, n);
 	crypto_digest_final(tfm, cksum->data);
 	code = 0;
 out:
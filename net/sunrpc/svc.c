@@ -12,6 +12,9 @@
 #include <linux/net.h>
 #include <linux/in.h>
 #include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/nodemask.h>
+#include <linux/topology.h>
 
 #include <linux/sunrpc/types.h>
 #include <linux/sunrpc/xdr.h>
@@ -23,14 +26,16 @@
 #define RPC_PARANOIA 1
 
 /*
- * Create an RPC service
+ * Create an RPC service with @npools thread pools
  */
-struct svc_serv *
-svc_create(struct svc_program *prog, unsigned int bufsize)
+static struct svc_serv *
+__svc_create(struct svc_program *prog, unsigned int bufsize,
+	     unsigned int npools)
 {
 	struct svc_serv	*serv;
 	int vers;
 	unsigned int xdrsize;
+	unsigned int i;
 
 	if (!(serv = (struct svc_serv *) kmalloc(sizeof(*serv), GFP_KERNEL)))
 		return NULL;
@@ -50,12 +55,26 @@ svc_create(struct svc_program *prog, unsigned int bufsize)
 				xdrsize = prog->pg_vers[vers]->vs_xdrsize;
 		}
 	serv->sv_xdrsize   = xdrsize;
-	INIT_LIST_HEAD(&serv->sv_threads);
-	INIT_LIST_HEAD(&serv->sv_sockets);
 	INIT_LIST_HEAD(&serv->sv_tempsocks);
 	INIT_LIST_HEAD(&serv->sv_permsocks);
 	spin_lock_init(&serv->sv_lock);
 
+	serv->sv_pools = kmalloc(npools * sizeof(struct svc_pool), GFP_KERNEL);
+	if (!serv->sv_pools) {
+		kfree(serv);
+		return NULL;
+	}
+	memset(serv->sv_pools, 0, npools * sizeof(struct svc_pool));
+	serv->sv_nrpools = npools;
+	for (i = 0; i < npools; i++) {
+		struct svc_pool *pool = &serv->sv_pools[i];
+
+		pool->sp_id = i;
+		INIT_LIST_HEAD(&pool->sp_threads);
+		INIT_LIST_HEAD(&pool->sp_sockets);
+		spin_lock_init(&pool->sp_lock);
+	}
+
 	serv->sv_name      = prog->pg_name;
 
 	/* Remove any stale portmap registrations */
@@ -64,6 +83,30 @@ svc_create(struct svc_program *prog, unsigned int bufsize)
 	return serv;
 }
 
+/*
+ * Create an RPC service
+ */
+struct svc_serv *
+svc_create(struct svc_program *prog, unsigned int bufsize)
+{
+	return __svc_create(prog, bufsize, 1);
+}
+
+/*
+ * Create an RPC service with one thread pool per NUMA node.  Only
+ * worth it for services that run many threads, i.e. nfsd.
+ */
+struct svc_serv *
+svc_create_pooled(struct svc_program *prog, unsigned int bufsize)
+{
+	unsigned int npools = 0;
+	int node;
+
+	for_each_online_node(node)
+		npools = node + 1;
+	return __svc_create(prog, bufsize, npools ? npools : 1);
+}
+
 /*
  * Destroy an RPC service
  */
@@ -101,6 +144,7 @@ svc_destroy(struct svc_serv *serv)
 
 	/* Unregister service with the portmapper */
 	svc_register(serv, 0, 0);
+	kfree(serv->sv_pools);
 	kfree(serv);
 }
 
@@ -149,6 +193,28 @@ svc_release_buffer(struct svc_rqst *rqstp)
 	rqstp->rq_argused = 0;
 }
 
+/*
+ * Choose the pool for a new thread: the one with the fewest threads
+ * among those whose node has CPUs to run them.
+ */
+static struct svc_pool *
+svc_pool_for_thread(struct svc_serv *serv)
+{
+	struct svc_pool *best = &serv->sv_pools[0];
+	unsigned int i;
+
+	for (i = 1; i < serv->sv_nrpools; i++) {
+		struct svc_pool *pool = &serv->sv_pools[i];
+
+		if (pool->sp_nrthreads >= best->sp_nrthreads)
+			continue;
+		if (cpus_empty(node_to_cpumask(pool->sp_id)))
+			continue;
+		best = pool;
+	}
+	return best;
+}
+
 /*
  * Create a server thread
  */
@@ -156,6 +222,8 @@ int
 svc_create_thread(svc_thread_fn func, struct svc_serv *serv)
 {
 	struct svc_rqst	*rqstp;
+	struct svc_pool	*pool;
+	cpumask_t	oldmask;
 	int		error = -ENOMEM;
 
 	rqstp = kmalloc(sizeof(*rqstp), GFP_KERNEL);
@@ -170,9 +238,21 @@ svc_create_thread(svc_thread_fn func, struct svc_serv *serv)
 	 || !svc_init_buffer(rqstp, serv->sv_bufsz))
 		goto out_thread;
 
+	pool = svc_pool_for_thread(serv);
+	spin_lock_bh(&pool->sp_lock);
+	pool->sp_nrthreads++;
+	spin_unlock_bh(&pool->sp_lock);
 	serv->sv_nrthreads++;
 	rqstp->rq_server = serv;
+	rqstp->rq_pool = pool;
+
+	/* The new thread inherits our CPU mask: keep it on the pool's node */
+	oldmask = current->cpus_allowed;
+	if (serv->sv_nrpools > 1)
+		set_cpus_allowed(current, node_to_cpumask(pool->sp_id));
 	error = kernel_thread((int (*)(void *)) func, rqstp, 0);
+	if (serv->sv_nrpools > 1)
+		set_cpus_allowed(current, oldmask);
 	if (error < 0)
 		goto out_thread;
 	svc_sock_update_bufs(serv);
@@ -192,6 +272,17 @@ void
 svc_exit_thread(struct svc_rqst *rqstp)
 {
 	struct svc_serv	*serv = rqstp->rq_server;
+	struct svc_pool	*pool = rqstp->rq_pool;
+
+	if (pool) {
+		int last;
+
+		spin_lock_bh(&pool->sp_lock);
+		last = !--pool->sp_nrthreads;
+		spin_unlock_bh(&pool->sp_lock);
+		if (last)
+			svc_pool_flush(pool);
+	}
 
 	svc_release_buffer(rqstp);
 	if (rqstp->rq_resp)
@@ -45,7 +45,10 @@
 
 /* SMP locking strategy:
  *
- * 	svc_serv->sv_lock protects most stuff for that service.
+ *	svc_pool->sp_lock protects the idle thread and pending socket
+ *	lists of that pool.
+ *	svc_serv->sv_lock protects most other stuff for that service.
+ *	sk_inuse and sk_reserved are atomic and need neither.
  *
  *	Some flags can be set to certain values at any time
  *	providing that certain rules are followed:
@@ -74,26 +77,37 @@ static int svc_deferred_recv(struct svc_rqst *rqstp);
 static struct cache_deferred_req *svc_defer(struct cache_req *req);
 
 /*
- * Queue up an idle server thread.  Must have serv->sv_lock held.
+ * Queue up an idle server thread.  Must have pool->sp_lock held.
  * Note: this is really a stack rather than a queue, so that we only
  * use as many different threads as we need, and the rest don't polute
  * the cache.
  */
 static inline void
-svc_serv_enqueue(struct svc_serv *serv, struct svc_rqst *rqstp)
+svc_pool_enqueue(struct svc_pool *pool, struct svc_rqst *rqstp)
 {
-	list_add(&rqstp->rq_list, &serv->sv_threads);
+	list_add(&rqstp->rq_list, &pool->sp_threads);
 }
 
 /*
- * Dequeue an nfsd thread.  Must have serv->sv_lock held.
+ * Dequeue an nfsd thread.  Must have pool->sp_lock held.
  */
 static inline void
-svc_serv_dequeue(struct svc_serv *serv, struct svc_rqst *rqstp)
+svc_pool_dequeue(struct svc_pool *pool, struct svc_rqst *rqstp)
 {
 	list_del(&rqstp->rq_list);
 }
 
+/*
+ * Pool serving the given CPU.
+ */
+static inline struct svc_pool *
+svc_pool_for_cpu(struct svc_serv *serv, int cpu)
+{
+	if (serv->sv_nrpools == 1)
+		return &serv->sv_pools[0];
+	return &serv->sv_pools[cpu_to_node(cpu) % serv->sv_nrpools];
+}
+
 /*
  * Release an skbuff after use
  */
@@ -135,12 +149,17 @@ svc_sock_wspace(struct svc_sock *svsk)
  * Queue up a socket with data pending. If there are idle nfsd
  * processes, wake 'em up.
  *
+ * The socket goes to the pool of the CPU we are running on, which
+ * for incoming data is the one that took the interrupt, unless that
+ * pool has no threads at all.
  */
 static void
 svc_sock_enqueue(struct svc_sock *svsk)
 {
 	struct svc_serv	*serv = svsk->sk_server;
+	struct svc_pool *pool;
 	struct svc_rqst	*rqstp;
+	unsigned int	i, id;
 
 	if (!(svsk->sk_flags &
 	      ( (1<<SK_CONN)|(1<<SK_DATA)|(1<<SK_CLOSE)|(1<<SK_DEFERRED)) ))
@@ -148,10 +167,18 @@ svc_sock_enqueue(struct svc_sock *svsk)
 	if (test_bit(SK_DEAD, &svsk->sk_flags))
 		return;
 
-	spin_lock_bh(&serv->sv_lock);
+	id = svc_pool_for_cpu(serv, get_cpu())->sp_id;
+	put_cpu();
+	for (i = 0; ; i++) {
+		pool = &serv->sv_pools[(id + i) % serv->sv_nrpools];
+		spin_lock_bh(&pool->sp_lock);
+		if (pool->sp_nrthreads || i == serv->sv_nrpools - 1)
+			break;
+		spin_unlock_bh(&pool->sp_lock);
+	}
 
-	if (!list_empty(&serv->sv_threads) && 
-	    !list_empty(&serv->sv_sockets))
+	if (!list_empty(&pool->sp_threads) &&
+	    !list_empty(&pool->sp_sockets))
 		printk(KERN_ERR
 			"svc_sock_enqueue: threads and sockets both waiting??\n");
 
@@ -168,13 +195,13 @@ svc_sock_enqueue(struct svc_sock *svsk)
 	}
 
 	set_bit(SOCK_NOSPACE, &svsk->sk_sock->flags);
-	if (((svsk->sk_reserved + serv->sv_bufsz)*2
+	if (((atomic_read(&svsk->sk_reserved) + serv->sv_bufsz)*2
 	     > svc_sock_wspace(svsk))
 	    && !test_bit(SK_CLOSE, &svsk->sk_flags)
 	    && !test_bit(SK_CONN, &svsk->sk_flags)) {
 		/* Don't enqueue while not enough space for reply */
 		dprintk("svc: socket %p  no space, %d*2 > %ld, not enqueued\n",
-			svsk->sk_sk, svsk->sk_reserved+serv->sv_bufsz,
+			svsk->sk_sk, atomic_read(&svsk->sk_reserved)+serv->sv_bufsz,
 			svc_sock_wspace(svsk));
 		goto out_unlock;
 	}
@@ -186,52 +213,77 @@ svc_sock_enqueue(struct svc_sock *svsk)
 	 */
 	set_bit(SK_BUSY, &svsk->sk_flags);
 
-	if (!list_empty(&serv->sv_threads)) {
-		rqstp = list_entry(serv->sv_threads.next,
+	if (!list_empty(&pool->sp_threads)) {
+		rqstp = list_entry(pool->sp_threads.next,
 				   struct svc_rqst,
 				   rq_list);
 		dprintk("svc: socket %p served by daemon %p\n",
 			svsk->sk_sk, rqstp);
-		svc_serv_dequeue(serv, rqstp);
+		svc_pool_dequeue(pool, rqstp);
 		if (rqstp->rq_sock)
 			printk(KERN_ERR 
 				"svc_sock_enqueue: server %p, rq_sock=%p!\n",
 				rqstp, rqstp->rq_sock);
 		rqstp->rq_sock = svsk;
-		svsk->sk_inuse++;
+		atomic_inc(&svsk->sk_inuse);
 		rqstp->rq_reserved = serv->sv_bufsz;
-		svsk->sk_reserved += rqstp->rq_reserved;
+		atomic_add(rqstp->rq_reserved, &svsk->sk_reserved);
 		wake_up(&rqstp->rq_wait);
 	} else {
 		dprintk("svc: socket %p put into queue\n", svsk->sk_sk);
-		list_add_tail(&svsk->sk_ready, &serv->sv_sockets);
+		list_add_tail(&svsk->sk_ready, &pool->sp_sockets);
+		svsk->sk_pool = pool;
 	}
 
 out_unlock:
-	spin_unlock_bh(&serv->sv_lock);
+	spin_unlock_bh(&pool->sp_lock);
 }
 
 /*
- * Dequeue the first socket.  Must be called with the serv->sv_lock held.
+ * Dequeue the first socket.  Must be called with the pool->sp_lock held.
  */
 static inline struct svc_sock *
-svc_sock_dequeue(struct svc_serv *serv)
+svc_sock_dequeue(struct svc_pool *pool)
 {
 	struct svc_sock	*svsk;
 
-	if (list_empty(&serv->sv_sockets))
+	if (list_empty(&pool->sp_sockets))
 		return NULL;
 
-	svsk = list_entry(serv->sv_sockets.next,
+	svsk = list_entry(pool->sp_sockets.next,
 			  struct svc_sock, sk_ready);
 	list_del_init(&svsk->sk_ready);
+	svsk->sk_pool = NULL;
 
 	dprintk("svc: socket %p dequeued, inuse=%d\n",
-		svsk->sk_sk, svsk->sk_inuse);
+		svsk->sk_sk, atomic_read(&svsk->sk_inuse));
 
 	return svsk;
 }
 
+/*
+ * A pool has lost its last thread.  Requeue any sockets still waiting
+ * on it so that the threads of other pools pick them up.
+ */
+void
+svc_pool_flush(struct svc_pool *pool)
+{
+	struct svc_sock	*svsk;
+	LIST_HEAD(pending);
+
+	spin_lock_bh(&pool->sp_lock);
+	list_splice_init(&pool->sp_sockets, &pending);
+	spin_unlock_bh(&pool->sp_lock);
+
+	while (!list_empty(&pending)) {
+		svsk = list_entry(pending.next, struct svc_sock, sk_ready);
+		list_del_init(&svsk->sk_ready);
+		svsk->sk_pool = NULL;
+		clear_bit(SK_BUSY, &svsk->sk_flags);
+		svc_sock_enqueue(svsk);
+	}
+}
+
 /*
  * Having read something from a socket, check whether it
  * needs to be re-enqueued.
@@ -262,10 +314,8 @@ void svc_reserve(struct svc_rqst *rqstp, int space)
 
 	if (space < rqstp->rq_reserved) {
 		struct svc_sock *svsk = rqstp->rq_sock;
-		spin_lock_bh(&svsk->sk_server->sv_lock);
-		svsk->sk_reserved -= (rqstp->rq_reserved - space);
+		atomic_sub((rqstp->rq_reserved - space), &svsk->sk_reserved);
 		rqstp->rq_reserved = space;
-		spin_unlock_bh(&svsk->sk_server->sv_lock);
 
 		svc_sock_enqueue(svsk);
 	}
@@ -277,17 +327,12 @@ void svc_reserve(struct svc_rqst *rqstp, int space)
 static inline void
 svc_sock_put(struct svc_sock *svsk)
 {
-	struct svc_serv *serv = svsk->sk_server;
-
-	spin_lock_bh(&serv->sv_lock);
-	if (!--(svsk->sk_inuse) && test_bit(SK_DEAD, &svsk->sk_flags)) {
-		spin_unlock_bh(&serv->sv_lock);
+	if (atomic_dec_and_test(&svsk->sk_inuse) &&
+	    test_bit(SK_DEAD, &svsk->sk_flags)) {
 		dprintk("svc: releasing dead socket\n");
 		sock_release(svsk->sk_sock);
 		kfree(svsk);
 	}
-	else
-		spin_unlock_bh(&serv->sv_lock);
 }
 
 static void
@@ -326,20 +371,25 @@ void
 svc_wake_up(struct svc_serv *serv)
 {
 	struct svc_rqst	*rqstp;
+	unsigned int	i;
 
-	spin_lock_bh(&serv->sv_lock);
-	if (!list_empty(&serv->sv_threads)) {
-		rqstp = list_entry(serv->sv_threads.next,
-				   struct svc_rqst,
-				   rq_list);
-		dprintk("svc: daemon %p woken up.\n", rqstp);
-		/*
-		svc_serv_dequeue(serv, rqstp);
-		rqstp->rq_sock = NULL;
-		 */
-		wake_up(&rqstp->rq_wait);
+	for (i = 0; i < serv->sv_nrpools; i++) {
+		struct svc_pool *pool = &serv->sv_pools[i];
+
+		spin_lock_bh(&pool->sp_lock);
+		if (!list_empty(&pool->sp_threads)) {
+			rqstp = list_entry(pool->sp_threads.next,
+					   struct svc_rqst,
+					   rq_list);
+			dprintk("svc: daemon %p woken up.\n", rqstp);
+			/*
+			svc_pool_dequeue(pool, rqstp);
+			rqstp->rq_sock = NULL;
+			 */
+			wake_up(&rqstp->rq_wait);
+		}
+		spin_unlock_bh(&pool->sp_lock);
 	}
-	spin_unlock_bh(&serv->sv_lock);
 }
 
 /*
@@ -862,7 +912,7 @@ svc_tcp_accept(struct svc_sock *svsk)
 					  struct svc_sock,
 					  sk_list);
 			set_bit(SK_CLOSE, &svsk->sk_flags);
-			svsk->sk_inuse ++;
+			atomic_inc(&svsk->sk_inuse);
 		}
 		spin_unlock_bh(&serv->sv_lock);
 
@@ -1141,6 +1191,8 @@ int
 svc_recv(struct svc_serv *serv, struct svc_rqst *rqstp, long timeout)
 {
 	struct svc_sock		*svsk =NULL;
+	struct svc_pool		*pool = rqstp->rq_pool;
+	time_t			now;
 	int			len;
 	int 			pages;
 	struct xdr_buf		*arg;
@@ -1190,59 +1242,71 @@ svc_recv(struct svc_serv *serv, struct svc_rqst *rqstp, long timeout)
 	if (signalled())
 		return -EINTR;
 
-	spin_lock_bh(&serv->sv_lock);
-	if (!list_empty(&serv->sv_tempsocks)) {
-		svsk = list_entry(serv->sv_tempsocks.next,
-				  struct svc_sock, sk_list);
-		/* apparently the "standard" is that clients close
-		 * idle connections after 5 minutes, servers after
-		 * 6 minutes
-		 *   http://www.connectathon.org/talks96/nfstcp.pdf 
-		 */
-		if (get_seconds() - svsk->sk_lastrecv < 6*60
-		    || test_bit(SK_BUSY, &svsk->sk_flags))
-			svsk = NULL;
+	/* Look for an idle temporary socket to close, but only once a
+	 * second so that sv_lock stays out of the request path.
+	 */
+	now = get_seconds();
+	if (serv->sv_tmpcnt && serv->sv_agetime != now) {
+		serv->sv_agetime = now;
+		spin_lock_bh(&serv->sv_lock);
+		if (!list_empty(&serv->sv_tempsocks)) {
+			svsk = list_entry(serv->sv_tempsocks.next,
+					  struct svc_sock, sk_list);
+			/* apparently the "standard" is that clients close
+			 * idle connections after 5 minutes, servers after
+			 * 6 minutes
+			 *   http://www.connectathon.org/talks96/nfstcp.pdf 
+			 */
+			if (now - svsk->sk_lastrecv < 6*60
+			    || test_and_set_bit(SK_BUSY, &svsk->sk_flags))
+				svsk = NULL;
+		}
+		if (svsk) {
+			set_bit(SK_CLOSE, &svsk->sk_flags);
+			rqstp->rq_sock = svsk;
+			atomic_inc(&svsk->sk_inuse);
+		}
+		spin_unlock_bh(&serv->sv_lock);
 	}
-	if (svsk) {
-		set_bit(SK_BUSY, &svsk->sk_flags);
-		set_bit(SK_CLOSE, &svsk->sk_flags);
-		rqstp->rq_sock = svsk;
-		svsk->sk_inuse++;
-	} else if ((svsk = svc_sock_dequeue(serv)) != NULL) {
-		rqstp->rq_sock = svsk;
-		svsk->sk_inuse++;
-		rqstp->rq_reserved = serv->sv_bufsz;	
-		svsk->sk_reserved += rqstp->rq_reserved;
-	} else {
-		/* No data pending. Go to sleep */
-		svc_serv_enqueue(serv, rqstp);
 
-		/*
-		 * We have to be able to interrupt this wait
-		 * to bring down the daemons ...
-		 */
-		set_current_state(TASK_INTERRUPTIBLE);
-		add_wait_queue(&rqstp->rq_wait, &wait);
-		spin_unlock_bh(&serv->sv_lock);
+	if (!svsk) {
+		spin_lock_bh(&pool->sp_lock);
+		if ((svsk = svc_sock_dequeue(pool)) != NULL) {
+			rqstp->rq_sock = svsk;
+			atomic_inc(&svsk->sk_inuse);
+			rqstp->rq_reserved = serv->sv_bufsz;
+			atomic_add(rqstp->rq_reserved, &svsk->sk_reserved);
+		} else {
+			/* No data pending. Go to sleep */
+			svc_pool_enqueue(pool, rqstp);
 
-		schedule_timeout(timeout);
+			/*
+			 * We have to be able to interrupt this wait
+			 * to bring down the daemons ...
+			 */
+			set_current_state(TASK_INTERRUPTIBLE);
+			add_wait_queue(&rqstp->rq_wait, &wait);
+			spin_unlock_bh(&pool->sp_lock);
 
-		try_to_freeze(PF_FREEZE);
+			schedule_timeout(timeout);
 
-		spin_lock_bh(&serv->sv_lock);
-		remove_wait_queue(&rqstp->rq_wait, &wait);
+			try_to_freeze(PF_FREEZE);
 
-		if (!(svsk = rqstp->rq_sock)) {
-			svc_serv_dequeue(serv, rqstp);
-			spin_unlock_bh(&serv->sv_lock);
-			dprintk("svc: server %p, no data yet\n", rqstp);
-			return signalled()? -EINTR : -EAGAIN;
+			spin_lock_bh(&pool->sp_lock);
+			remove_wait_queue(&rqstp->rq_wait, &wait);
+
+			if (!(svsk = rqstp->rq_sock)) {
+				svc_pool_dequeue(pool, rqstp);
+				spin_unlock_bh(&pool->sp_lock);
+				dprintk("svc: server %p, no data yet\n", rqstp);
+				return signalled()? -EINTR : -EAGAIN;
+			}
 		}
+		spin_unlock_bh(&pool->sp_lock);
 	}
-	spin_unlock_bh(&serv->sv_lock);
 
 	dprintk("svc: server %p, socket %p, inuse=%d\n",
-		 rqstp, svsk, svsk->sk_inuse);
+		 rqstp, svsk, atomic_read(&svsk->sk_inuse));
 	len = svsk->sk_recvfrom(rqstp);
 	dprintk("svc: got len=%d\n", len);
 
@@ -1252,14 +1316,17 @@ svc_recv(struct svc_serv *serv, struct svc_rqst *rqstp, long timeout)
 		svc_sock_release(rqstp);
 		return -EAGAIN;
 	}
-	svsk->sk_lastrecv = get_seconds();
-	if (test_bit(SK_TEMP, &svsk->sk_flags)) {
-		/* push active sockets to end of list */
+	now = get_seconds();
+	if (test_bit(SK_TEMP, &svsk->sk_flags) && svsk->sk_lastrecv != now) {
+		/* push active sockets to end of list; the list is only
+		 * used for aging, so once a second is plenty
+		 */
 		spin_lock_bh(&serv->sv_lock);
 		if (!list_empty(&svsk->sk_list))
 			list_move_tail(&svsk->sk_list, &serv->sv_tempsocks);
 		spin_unlock_bh(&serv->sv_lock);
 	}
+	svsk->sk_lastrecv = now;
 
 	rqstp->rq_secure  = ntohs(rqstp->rq_addr.sin_port) < 1024;
 	rqstp->rq_chandle.defer = svc_defer;
@@ -1442,6 +1509,7 @@ void
 svc_delete_socket(struct svc_sock *svsk)
 {
 	struct svc_serv	*serv;
+	struct svc_pool	*pool;
 	struct sock	*sk;
 
 	dprintk("svc: svc_delete_socket(%p)\n", svsk);
@@ -1453,23 +1521,30 @@ svc_delete_socket(struct svc_sock *svsk)
 	sk->sk_data_ready = svsk->sk_odata;
 	sk->sk_write_space = svsk->sk_owspace;
 
+	/* Hold a reference across SK_DEAD being set, so the socket
+	 * goes away with whoever drops the last one
+	 */
+	atomic_inc(&svsk->sk_inuse);
+
 	spin_lock_bh(&serv->sv_lock);
 
 	list_del_init(&svsk->sk_list);
-	list_del_init(&svsk->sk_ready);
 	if (!test_and_set_bit(SK_DEAD, &svsk->sk_flags))
 		if (test_bit(SK_TEMP, &svsk->sk_flags))
 			serv->sv_tmpcnt--;
+	spin_unlock_bh(&serv->sv_lock);
 
-	if (!svsk->sk_inuse) {
-		spin_unlock_bh(&serv->sv_lock);
-		sock_release(svsk->sk_sock);
-		kfree(svsk);
-	} else {
-		spin_unlock_bh(&serv->sv_lock);
-		dprintk(KERN_NOTICE "svc: server socket destroy delayed\n");
-		/* svsk->sk_server = NULL; */
+	pool = svsk->sk_pool;
+	if (pool) {
+		spin_lock_bh(&pool->sp_lock);
+		list_del_init(&svsk->sk_ready);
+		svsk->sk_pool = NULL;
+		spin_unlock_bh(&pool->sp_lock);
 	}
+
+	if (atomic_read(&svsk->sk_inuse) > 1)
+		dprintk(KERN_NOTICE "svc: server socket destroy delayed\n");
+	svc_sock_put(svsk);
 }
 
 /*
@@ -1538,10 +1613,8 @@ svc_defer(struct cache_req *req)
 		dr->argslen = rqstp->rq_arg.len >> 2;
 		memcpy(dr->args, rqstp->rq_arg.head[0].iov_base-skip, dr->argslen<<2);
 	}
-	spin_lock_bh(&rqstp->rq_server->sv_lock);
-	rqstp->rq_sock->sk_inuse++;
+	atomic_inc(&rqstp->rq_sock->sk_inuse);
 	dr->svsk = rqstp->rq_sock;
-	spin_unlock_bh(&rqstp->rq_server->sv_lock);
 
 	dr->handle.revisit = svc_revisit;
 	return &dr->handle;
@@ -1299,6 +1299,32 @@ xprt_transmit(struct rpc_task *task)
 	spin_unlock_bh(&xprt->sock_lock);
 }
 
+/*
+ * Slots beyond the preallocated table, for transports which may have more
+ * requests in flight than that.  They are allocated when the table runs
+ * out and freed again on release, so the table shrinks back as the load
+ * goes; a failed allocation just means sleeping on the backlog.
+ */
+static inline int xprt_dynamic_slot(struct rpc_xprt *xprt, struct rpc_rqst *req)
+{
+	return req < xprt->slot || req >= xprt->slot + xprt->min_reqs;
+}
+
+static struct rpc_rqst *xprt_dynamic_alloc_slot(struct rpc_xprt *xprt)
+{
+	struct rpc_rqst *req;
+
+	if (xprt->num_reqs >= xprt->max_reqs)
+		return NULL;
+	req = kmalloc(sizeof(*req), GFP_ATOMIC | __GFP_NOWARN);
+	if (req == NULL)
+		return NULL;
+	memset(req, 0, sizeof(*req));
+	INIT_LIST_HEAD(&req->rq_list);
+	xprt->num_reqs++;
+	return req;
+}
+
 /*
  * Reserve an RPC call slot.
  */
@@ -1306,17 +1332,23 @@ static inline void
 do_xprt_reserve(struct rpc_task *task)
 {
 	struct rpc_xprt	*xprt = task->tk_xprt;
+	struct rpc_rqst	*req;
 
 	task->tk_status = 0;
 	if (task->tk_rqstp)
 		return;
 	if (!list_empty(&xprt->free)) {
-		struct rpc_rqst	*req = list_entry(xprt->free.next, struct rpc_rqst, rq_list);
+		req = list_entry(xprt->free.next, struct rpc_rqst, rq_list);
 		list_del_init(&req->rq_list);
 		task->tk_rqstp = req;
 		xprt_request_init(task, xprt);
 		return;
 	}
+	if ((req = xprt_dynamic_alloc_slot(xprt)) != NULL) {
+		task->tk_rqstp = req;
+		xprt_request_init(task, xprt);
+		return;
+	}
 	dprintk("RPC:      waiting for request slot\n");
 	task->tk_status = -EAGAIN;
 	task->tk_timeout = 0;
@@ -1393,7 +1425,11 @@ xprt_release(struct rpc_task *task)
 	dprintk("RPC: %4d release request %p\n", task->tk_pid, req);
 
 	spin_lock(&xprt->xprt_lock);
-	list_add(&req->rq_list, &xprt->free);
+	if (xprt_dynamic_slot(xprt, req)) {
+		kfree(req);
+		xprt->num_reqs--;
+	} else
+		list_add(&req->rq_list, &xprt->free);
 	xprt_clear_backlog(xprt);
 	spin_unlock(&xprt->xprt_lock);
 }
@@ -1425,6 +1461,7 @@ xprt_set_timeout(struct rpc_timeout *to, unsigned int retr, unsigned long incr)
 
 unsigned int xprt_udp_slot_table_entries = RPC_DEF_SLOT_TABLE;
 unsigned int xprt_tcp_slot_table_entries = RPC_DEF_SLOT_TABLE;
+unsigned int xprt_max_tcp_slot_table_entries = RPC_MAX_SLOT_TABLE_LIMIT;
 
 /*
  * Initialize an RPC client
@@ -1446,7 +1483,13 @@ xprt_setup(int proto, struct sockaddr_in *ap, struct rpc_timeout *to)
 	if ((xprt = kmalloc(sizeof(struct rpc_xprt), GFP_KERNEL)) == NULL)
 		return ERR_PTR(-ENOMEM);
 	memset(xprt, 0, sizeof(*xprt)); /* Nnnngh! */
-	xprt->max_reqs = entries;
+	xprt->min_reqs = xprt->num_reqs = xprt->max_reqs = entries;
+	/*
+	 * TCP has no congestion window of ours to respect: let the table grow
+	 * on demand and leave the pacing to the server's TCP window.
+	 */
+	if (proto == IPPROTO_TCP && xprt_max_tcp_slot_table_entries > entries)
+		xprt->max_reqs = xprt_max_tcp_slot_table_entries;
 	slot_table_size = entries * sizeof(xprt->slot[0]);
 	xprt->slot = kmalloc(slot_table_size, GFP_KERNEL);
 	if (xprt->slot == NULL) {
@@ -1500,8 +1543,8 @@ xprt_setup(int proto, struct sockaddr_in *ap, struct rpc_timeout *to)
 	/* Check whether we want to use a reserved port */
 	xprt->resvport = capable(CAP_NET_BIND_SERVICE) ? 1 : 0;
 
-	dprintk("RPC:      created transport %p with %u slots\n", xprt,
-			xprt->max_reqs);
+	dprintk("RPC:      created transport %p with %u slots, up to %u\n",
+			xprt, xprt->min_reqs, xprt->max_reqs);
 	
 	return xprt;
 }
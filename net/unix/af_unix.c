@@ -118,6 +118,9 @@
 #include <linux/mount.h>
 #include <net/checksum.h>
 #include <linux/security.h>
+#include <linux/mm.h>
+#include <linux/pagemap.h>
+#include <linux/highmem.h>
 
 int sysctl_unix_max_dgram_qlen = 10;
 
@@ -569,6 +572,7 @@ static struct sock * unix_create1(struct socket *sock)
 	atomic_set(&u->inflight, sock ? 0 : -1);
 	init_MUTEX(&u->readsem); /* single task reading lock */
 	init_waitqueue_head(&u->peer_wait);
+	u->direct = NULL;
 	unix_insert_socket(unix_sockets_unbound, sk);
 out:
 	return sk;
@@ -1409,6 +1413,209 @@ out:
 }
 
 		
+/*
+ *	Direct stream transfer.  A reader blocking on an empty stream
+ *	socket with a large buffer pins that buffer and posts it on its
+ *	socket; the next large write copies straight into it instead of
+ *	going through an skb, so the data is copied once instead of twice.
+ */
+
+#define UNIX_DIRECT_MIN		(16*1024)	/* smallest read/write done directly */
+#define UNIX_DIRECT_PAGES	32		/* most reader pages pinned at once */
+
+enum {
+	UNIX_DIRECT_WAITING,			/* posted, waiting for a writer */
+	UNIX_DIRECT_CLAIMED,			/* a writer is copying into it */
+	UNIX_DIRECT_DONE			/* writer is finished with it */
+};
+
+struct unix_direct {
+	struct page		**pages;	/* reader's buffer */
+	int			nr_pages;
+	unsigned int		offset;		/* of the data in pages[0] */
+	size_t			len;		/* room in the buffer */
+	size_t			copied;		/* bytes the writer put there */
+	int			state;
+	int			check_creds;	/* only take data from creds */
+	struct ucred		creds;
+	struct msghdr		*addr_msg;	/* wants the writer's address */
+};
+
+static void unix_copy_addr(struct msghdr *msg, struct sock *sk);
+
+/*
+ *	Copy up to len bytes of msg into a buffer posted by the reader of
+ *	other.  Returns 0 or -EFAULT, with the bytes copied in *copied;
+ *	nothing is copied when no suitable buffer is posted.
+ */
+static int unix_stream_direct_send(struct sock *sk, struct sock *other,
+				   struct msghdr *msg, size_t len,
+				   struct ucred *creds, size_t *copied)
+{
+	struct unix_sock *u = unix_sk(other);
+	struct unix_direct *d;
+	unsigned int offset;
+	size_t done = 0;
+	int i, err = 0;
+
+	*copied = 0;
+	unix_state_wlock(other);
+	d = u->direct;
+	if (!d ||
+	    skb_queue_len(&other->sk_receive_queue) ||
+	    sock_flag(other, SOCK_DEAD) ||
+	    (other->sk_shutdown & RCV_SHUTDOWN) ||
+	    (d->check_creds &&
+	     memcmp(&d->creds, creds, sizeof(*creds)) != 0)) {
+		unix_state_wunlock(other);
+		return 0;
+	}
+	/* The reader waits for us until DONE, so d stays valid */
+	u->direct = NULL;
+	d->state = UNIX_DIRECT_CLAIMED;
+	unix_state_wunlock(other);
+
+	if (len > d->len)
+		len = d->len;
+	offset = d->offset;
+	for (i = 0; done < len; i++) {
+		size_t n = min_t(size_t, len - done, PAGE_SIZE - offset);
+		char *kaddr = kmap(d->pages[i]);
+
+		err = memcpy_fromiovec(kaddr + offset, msg->msg_iov, n);
+		kunmap(d->pages[i]);
+		flush_dcache_page(d->pages[i]);
+		if (err)
+			break;
+		done += n;
+		offset = 0;
+	}
+	if (done && d->addr_msg)
+		unix_copy_addr(d->addr_msg, sk);
+
+	unix_state_wlock(other);
+	d->copied = done;
+	d->creds = *creds;
+	d->state = UNIX_DIRECT_DONE;
+	unix_state_wunlock(other);
+	wake_up(other->sk_sleep);
+
+	*copied = done;
+	return err;
+}
+
+/*
+ *	Wait for data on an empty stream socket by posting the reader's
+ *	buffer for a writer to fill.  Returns the bytes received, 0 when
+ *	the wait ended otherwise (data queued, timeout, signal...), or
+ *	-EAGAIN when the buffer is unsuitable and the caller should wait
+ *	the ordinary way.
+ */
+static int unix_stream_direct_recv(struct sock *sk, struct msghdr *msg,
+				   size_t size, long *timeo,
+				   struct ucred *creds, int check_creds,
+				   int want_addr)
+{
+	struct unix_sock *u = unix_sk(sk);
+	struct page *pages[UNIX_DIRECT_PAGES];
+	struct iovec *iov = msg->msg_iov;
+	struct unix_direct d;
+	unsigned long addr;
+	size_t len;
+	int i, nr;
+	DEFINE_WAIT(wait);
+
+	if (!segment_eq(get_fs(), USER_DS) || !current->mm)
+		return -EAGAIN;
+
+	/* memcpy_toiovec leaves used up segments behind */
+	while (!iov->iov_len)
+		iov++;
+	len = min_t(size_t, iov->iov_len, size);
+	addr = (unsigned long)iov->iov_base;
+	d.offset = addr & ~PAGE_MASK;
+	if (len > UNIX_DIRECT_PAGES * PAGE_SIZE - d.offset)
+		len = UNIX_DIRECT_PAGES * PAGE_SIZE - d.offset;
+	if (len < UNIX_DIRECT_MIN)
+		return -EAGAIN;
+
+	nr = (d.offset + len + PAGE_SIZE - 1) >> PAGE_SHIFT;
+	down_read(&current->mm->mmap_sem);
+	nr = get_user_pages(current, current->mm, addr & PAGE_MASK, nr,
+			    1, 0, pages, NULL);
+	up_read(&current->mm->mmap_sem);
+	if (nr <= 0)
+		return -EAGAIN;
+
+	d.pages = pages;
+	d.nr_pages = nr;
+	d.len = min_t(size_t, len, nr * PAGE_SIZE - d.offset);
+	d.copied = 0;
+	d.state = UNIX_DIRECT_WAITING;
+	d.check_creds = check_creds;
+	d.creds = *creds;
+	d.addr_msg = want_addr ? msg : NULL;
+
+	unix_state_wlock(sk);
+	if (u->direct) {
+		/* Some other reader got here first */
+		unix_state_wunlock(sk);
+		nr = -EAGAIN;
+		goto out_release;
+	}
+	u->direct = &d;
+
+	for (;;) {
+		prepare_to_wait(sk->sk_sleep, &wait, TASK_INTERRUPTIBLE);
+
+		if (d.state == UNIX_DIRECT_DONE)
+			break;
+		if (d.state == UNIX_DIRECT_WAITING &&
+		    (skb_queue_len(&sk->sk_receive_queue) ||
+		     sk->sk_err ||
+		     (sk->sk_shutdown & RCV_SHUTDOWN) ||
+		     signal_pending(current) ||
+		     !*timeo)) {
+			u->direct = NULL;
+			break;
+		}
+
+		if (d.state == UNIX_DIRECT_CLAIMED) {
+			/* The writer is copying into our pages and has to
+			 * be done with them before we may return.
+			 */
+			set_current_state(TASK_UNINTERRUPTIBLE);
+			unix_state_wunlock(sk);
+			schedule();
+		} else {
+			set_bit(SOCK_ASYNC_WAITDATA, &sk->sk_socket->flags);
+			unix_state_wunlock(sk);
+			*timeo = schedule_timeout(*timeo);
+		}
+		unix_state_wlock(sk);
+		clear_bit(SOCK_ASYNC_WAITDATA, &sk->sk_socket->flags);
+	}
+
+	finish_wait(sk->sk_sleep, &wait);
+	unix_state_wunlock(sk);
+
+	if (d.copied) {
+		iov->iov_base += d.copied;
+		iov->iov_len -= d.copied;
+		if (!check_creds)
+			*creds = d.creds;
+	}
+	nr = d.copied;
+
+out_release:
+	for (i = 0; i < d.nr_pages; i++) {
+		if (d.copied)
+			set_page_dirty_lock(pages[i]);
+		page_cache_release(pages[i]);
+	}
+	return nr;
+}
+
 static int unix_stream_sendmsg(struct kiocb *kiocb, struct socket *sock,
 			       struct msghdr *msg, size_t len)
 {
@@ -1447,6 +1654,24 @@ static int unix_stream_sendmsg(struct kiocb *kiocb, struct socket *sock,
 
 	while(sent < len)
 	{
+		/*
+		 *	Large writes go straight into the buffer of a waiting
+		 *	reader if there is one.
+		 */
+
+		if (len - sent >= UNIX_DIRECT_MIN && !siocb->scm->fp) {
+			size_t copied;
+
+			err = unix_stream_direct_send(sk, other, msg, len - sent,
+						      &siocb->scm->creds,
+						      &copied);
+			sent += copied;
+			if (err)
+				goto out_err;
+			if (copied)
+				continue;
+		}
+
 		/*
 		 *	Optimisation for the fact that under 0.01% of X messages typically
 		 *	need breaking up.
@@ -1726,7 +1951,21 @@ static int unix_stream_recvmsg(struct kiocb *iocb, struct socket *sock,
 				break;
 			up(&u->readsem);
 
-			timeo = unix_stream_data_wait(sk, timeo);
+			chunk = -EAGAIN;
+			if (!(flags & MSG_PEEK) && size >= UNIX_DIRECT_MIN)
+				chunk = unix_stream_direct_recv(sk, msg, size,
+						&timeo, &siocb->scm->creds,
+						check_creds, sunaddr != NULL);
+			if (chunk > 0) {
+				check_creds = 1;
+				sunaddr = NULL;
+				copied += chunk;
+				size -= chunk;
+				down(&u->readsem);
+				continue;
+			}
+			if (chunk < 0)
+				timeo = unix_stream_data_wait(sk, timeo);
 
 			if (signal_pending(current)) {
 				err = sock_intr_errno(timeo);